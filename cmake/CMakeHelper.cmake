@@ -141,3 +141,34 @@ macro(COLMAP_ADD_TEST)
         endif()
     endif()
 endmacro(COLMAP_ADD_TEST)
+
+# Wrapper for benchmark executables.
+macro(COLMAP_ADD_BENCHMARK)
+    set(options)
+    set(oneValueArgs)
+    set(multiValueArgs NAME SRCS LINK_LIBS)
+    cmake_parse_arguments(COLMAP_ADD_BENCHMARK "${options}" "${oneValueArgs}" "${multiValueArgs}" ${ARGN})
+    if(BENCHMARKS_ENABLED)
+        set(COLMAP_ADD_BENCHMARK_NAME "colmap_${FOLDER_NAME}_${COLMAP_ADD_BENCHMARK_NAME}")
+        add_executable(${COLMAP_ADD_BENCHMARK_NAME} ${COLMAP_ADD_BENCHMARK_SRCS})
+        set_target_properties(${COLMAP_ADD_BENCHMARK_NAME} PROPERTIES FOLDER
+            ${COLMAP_TARGETS_ROOT_FOLDER}/${FOLDER_NAME})
+        target_link_libraries(${COLMAP_ADD_BENCHMARK_NAME}
+            ${COLMAP_ADD_BENCHMARK_LINK_LIBS}
+            benchmark::benchmark
+            benchmark::benchmark_main)
+        add_dependencies(colmap_benchmarks ${COLMAP_ADD_BENCHMARK_NAME})
+        set(COLMAP_ADD_BENCHMARK_OUTPUT
+            "${CMAKE_BINARY_DIR}/benchmarks/${COLMAP_ADD_BENCHMARK_NAME}.json")
+        add_custom_target(run_${COLMAP_ADD_BENCHMARK_NAME}
+            COMMAND ${CMAKE_COMMAND} -E make_directory
+                "${CMAKE_BINARY_DIR}/benchmarks"
+            COMMAND ${COLMAP_ADD_BENCHMARK_NAME}
+                "--benchmark_out=${COLMAP_ADD_BENCHMARK_OUTPUT}"
+                --benchmark_out_format=json
+            DEPENDS ${COLMAP_ADD_BENCHMARK_NAME}
+            COMMENT "Running benchmark ${COLMAP_ADD_BENCHMARK_NAME}"
+            USES_TERMINAL)
+        add_dependencies(colmap_run_benchmarks run_${COLMAP_ADD_BENCHMARK_NAME})
+    endif()
+endmacro(COLMAP_ADD_BENCHMARK)
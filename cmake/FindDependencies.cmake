@@ -24,7 +24,11 @@ find_package(Glog ${COLMAP_FIND_TYPE})
 find_package(SQLite3 ${COLMAP_FIND_TYPE})
 
 set(OpenGL_GL_PREFERENCE GLVND)
-find_package(OpenGL ${COLMAP_FIND_TYPE})
+if(EGL_ENABLED)
+    find_package(OpenGL ${COLMAP_FIND_TYPE} OPTIONAL_COMPONENTS EGL)
+else()
+    find_package(OpenGL ${COLMAP_FIND_TYPE})
+endif()
 
 find_package(Glew ${COLMAP_FIND_TYPE})
 
@@ -44,6 +48,10 @@ if(TESTS_ENABLED)
     find_package(GTest ${COLMAP_FIND_TYPE})
 endif()
 
+if(BENCHMARKS_ENABLED)
+    find_package(benchmark ${COLMAP_FIND_TYPE})
+endif()
+
 if(OPENMP_ENABLED)
     find_package(OpenMP QUIET)
 endif()
@@ -178,9 +186,21 @@ else()
     message(STATUS "Disabling GUI support")
 endif()
 
+if(EGL_ENABLED)
+    if(OPENGL_ENABLED AND OpenGL_EGL_FOUND)
+        add_definitions("-DCOLMAP_EGL_ENABLED")
+        message(STATUS "Enabling EGL support")
+    else()
+        set(EGL_ENABLED OFF)
+        message(STATUS "Disabling EGL support (OpenGL disabled or EGL not found)")
+    endif()
+else()
+    message(STATUS "Disabling EGL support")
+endif()
+
 if(OPENGL_ENABLED)
-    if(NOT GUI_ENABLED)
-        message(STATUS "Disabling GUI also disables OpenGL")
+    if(NOT GUI_ENABLED AND NOT EGL_ENABLED)
+        message(STATUS "Disabling GUI without EGL also disables OpenGL")
         set(OPENGL_ENABLED OFF)
     else()
         add_definitions("-DCOLMAP_OPENGL_ENABLED")
@@ -25,7 +25,7 @@ CAMERA_MODELS = [
     "METASHAPE_FISHEYE",
 ]
 
-CAMERA_REFRAC_MODELS = ["FLATPORT", "DOMEPORT"]
+CAMERA_REFRAC_MODELS = ["FLATPORT", "DOMEPORT", "FLATPORT_2L", "FLATPORT_3L"]
 
 
 def print_heading1(heading):
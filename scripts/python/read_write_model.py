@@ -86,6 +86,16 @@ CAMERA_REFRAC_MODELS = {
     CameraRefracModel(
         refrac_model_id=1, refrac_model_name="DOMEPORT", num_refrac_params=8
     ),
+    CameraRefracModel(
+        refrac_model_id=2,
+        refrac_model_name="FLATPORT_2L",
+        num_refrac_params=10,
+    ),
+    CameraRefracModel(
+        refrac_model_id=3,
+        refrac_model_name="FLATPORT_3L",
+        num_refrac_params=12,
+    ),
 }
 CAMERA_REFRAC_MODEL_IDS = dict(
     [
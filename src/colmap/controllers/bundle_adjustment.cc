@@ -94,10 +94,18 @@ void BundleAdjustmentController::Run() {
   ba_config.SetConstantCamPositions(reg_image_ids[1], {0});
 
   // Run bundle adjustment.
-  BundleAdjuster bundle_adjuster(ba_options, ba_config);
-  bundle_adjuster.Solve(reconstruction_.get());
+  if (ba_options.enable_refraction && ba_options.refine_refrac_params &&
+      ba_options.refrac_calibration_two_stage) {
+    RefracCalibrationBundleAdjuster bundle_adjuster(ba_options, ba_config);
+    bundle_adjuster.Solve(reconstruction_.get());
+  } else {
+    BundleAdjuster bundle_adjuster(ba_options, ba_config);
+    bundle_adjuster.Solve(reconstruction_.get());
+  }
 
-  reconstruction_->UpdatePoint3DErrors(ba_options.enable_refraction);
+  reconstruction_->UpdatePoint3DErrors(
+      ba_options.enable_refraction,
+      ba_options.solver_options.num_threads);
 
   GetTimer().PrintMinutes();
 }
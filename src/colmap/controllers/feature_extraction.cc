@@ -29,13 +29,22 @@
 
 #include "colmap/controllers/feature_extraction.h"
 
+#include "colmap/feature/keyframes.h"
 #include "colmap/feature/sift.h"
+#include "colmap/image/preprocessing.h"
 #include "colmap/scene/database.h"
 #include "colmap/util/cuda.h"
 #include "colmap/util/misc.h"
 #include "colmap/util/opengl_utils.h"
+#include "colmap/util/timer.h"
+#include "colmap/util/tracing.h"
 
+#include <fstream>
+#include <future>
+#include <map>
+#include <mutex>
 #include <numeric>
+#include <unordered_map>
 
 namespace colmap {
 namespace {
@@ -82,6 +91,9 @@ void MaskKeypoints(const Bitmap& mask,
 }
 
 struct ImageData {
+  // The index of the image in the order of the image reader.
+  size_t index = 0;
+
   ImageReader::Status status = ImageReader::Status::FAILURE;
 
   Camera camera;
@@ -96,8 +108,8 @@ struct ImageData {
 class ImageResizerThread : public Thread {
  public:
   ImageResizerThread(int max_image_size,
-                     JobQueue<ImageData>* input_queue,
-                     JobQueue<ImageData>* output_queue)
+                     LockFreeJobQueue<ImageData>* input_queue,
+                     LockFreeJobQueue<ImageData>* output_queue)
       : max_image_size_(max_image_size),
         input_queue_(input_queue),
         output_queue_(output_queue) {}
@@ -138,25 +150,178 @@ class ImageResizerThread : public Thread {
 
   const int max_image_size_;
 
-  JobQueue<ImageData>* input_queue_;
-  JobQueue<ImageData>* output_queue_;
+  LockFreeJobQueue<ImageData>* input_queue_;
+  LockFreeJobQueue<ImageData>* output_queue_;
+};
+
+// Vignetting calibrations of the cameras, which are read on first use and then
+// shared between all preprocessing threads.
+class VignettingCalibrations {
+ public:
+  explicit VignettingCalibrations(const std::string& path) : path_(path) {}
+
+  // Returns nullptr, if the camera has no calibration.
+  std::shared_ptr<const Bitmap> Get(const camera_t camera_id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto it = calibrations_.find(camera_id);
+    if (it != calibrations_.end()) {
+      return it->second;
+    }
+
+    std::shared_ptr<Bitmap> calibration;
+    const std::string calibration_path =
+        JoinPaths(path_, std::to_string(camera_id) + ".png");
+    if (ExistsFile(calibration_path)) {
+      calibration = std::make_shared<Bitmap>();
+      if (!calibration->Read(calibration_path, /*as_rgb=*/false)) {
+        LOG(ERROR) << "Cannot read vignetting calibration file: "
+                   << calibration_path;
+        calibration.reset();
+      }
+    }
+
+    calibrations_.emplace(camera_id, calibration);
+    return calibration;
+  }
+
+ private:
+  const std::string path_;
+  std::mutex mutex_;
+  std::unordered_map<camera_t, std::shared_ptr<const Bitmap>> calibrations_;
+};
+
+// The masks of the image regions of refractive cameras, whose rays leave the
+// housing, which are computed once per camera.
+class RefracValidityMasks {
+ public:
+  // Returns nullptr, if the camera is not refractive.
+  std::shared_ptr<const Bitmap> Get(const Camera& camera) {
+    if (!camera.IsCameraRefractive()) {
+      return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto it = masks_.find(camera.camera_id);
+    if (it != masks_.end()) {
+      return it->second;
+    }
+
+    const std::vector<bool> validity = camera.RefracValidityMask();
+    auto mask = std::make_shared<Bitmap>();
+    mask->Allocate(camera.width, camera.height, /*as_rgb=*/false);
+    size_t num_invalid = 0;
+    for (size_t y = 0; y < camera.height; ++y) {
+      for (size_t x = 0; x < camera.width; ++x) {
+        const bool is_valid = validity[y * camera.width + x];
+        mask->SetPixel(x, y, BitmapColor<uint8_t>(is_valid ? 255 : 0));
+        if (!is_valid) {
+          num_invalid += 1;
+        }
+      }
+    }
+
+    VLOG(2) << StringPrintf(
+        "Refractive validity mask of camera %d: %.2f%% invalid pixels",
+        camera.camera_id,
+        100.0 * num_invalid / std::max<size_t>(1, validity.size()));
+
+    masks_.emplace(camera.camera_id, mask);
+    return mask;
+  }
+
+ private:
+  std::mutex mutex_;
+  std::unordered_map<camera_t, std::shared_ptr<const Bitmap>> masks_;
+};
+
+class ImagePreprocessorThread : public Thread {
+ public:
+  ImagePreprocessorThread(
+      const ImagePreprocessingOptions& options,
+      const std::shared_ptr<VignettingCalibrations>& vignetting_calibrations,
+      LockFreeJobQueue<ImageData>* input_queue,
+      LockFreeJobQueue<ImageData>* output_queue)
+      : options_(options),
+        vignetting_calibrations_(vignetting_calibrations),
+        input_queue_(input_queue),
+        output_queue_(output_queue) {
+    CHECK(options_.Check());
+  }
+
+ private:
+  void Run() override {
+    while (true) {
+      if (IsStopped()) {
+        break;
+      }
+
+      auto input_job = input_queue_->Pop();
+      if (input_job.IsValid()) {
+        auto& image_data = input_job.Data();
+
+        if (image_data.status == ImageReader::Status::SUCCESS) {
+          if (options_.color_compensation) {
+            CompensateColorAttenuation(&image_data.bitmap);
+          }
+
+          if (vignetting_calibrations_) {
+            const std::shared_ptr<const Bitmap> vignetting =
+                vignetting_calibrations_->Get(image_data.camera.camera_id);
+            if (vignetting) {
+              CorrectVignetting(*vignetting, &image_data.bitmap);
+            }
+          }
+
+          // The feature extractors expect grey images.
+          if (!image_data.bitmap.IsGrey()) {
+            image_data.bitmap = image_data.bitmap.CloneAsGrey();
+          }
+
+          if (options_.clahe) {
+            EqualizeHistogramCLAHE(options_.clahe_clip_limit,
+                                   options_.clahe_num_tiles,
+                                   &image_data.bitmap);
+          }
+        }
+
+        output_queue_->Push(std::move(image_data));
+      } else {
+        break;
+      }
+    }
+  }
+
+  const ImagePreprocessingOptions options_;
+  std::shared_ptr<VignettingCalibrations> vignetting_calibrations_;
+
+  LockFreeJobQueue<ImageData>* input_queue_;
+  LockFreeJobQueue<ImageData>* output_queue_;
 };
 
 class SiftFeatureExtractorThread : public Thread {
  public:
-  SiftFeatureExtractorThread(const SiftExtractionOptions& sift_options,
-                             const std::shared_ptr<Bitmap>& camera_mask,
-                             JobQueue<ImageData>* input_queue,
-                             JobQueue<ImageData>* output_queue)
+  SiftFeatureExtractorThread(
+      const SiftExtractionOptions& sift_options,
+      const std::shared_ptr<Bitmap>& camera_mask,
+      const std::shared_ptr<RefracValidityMasks>& refrac_validity_masks,
+      LockFreeJobQueue<ImageData>* input_queue,
+      LockFreeJobQueue<ImageData>* output_queue)
       : sift_options_(sift_options),
         camera_mask_(camera_mask),
+        refrac_validity_masks_(refrac_validity_masks),
         input_queue_(input_queue),
         output_queue_(output_queue) {
     CHECK(sift_options_.Check());
 
 #if !defined(COLMAP_CUDA_ENABLED)
     if (sift_options_.use_gpu) {
-      opengl_context_ = std::make_unique<OpenGLContextManager>();
+      const std::vector<int> gpu_indices =
+          CSVToVector<int>(sift_options_.gpu_index);
+      CHECK_EQ(gpu_indices.size(), 1);
+      opengl_context_ = std::make_unique<OpenGLContextManager>(
+          /*opengl_major_version=*/2,
+          /*opengl_minor_version=*/1,
+          /*device_index=*/gpu_indices[0]);
     }
 #endif
   }
@@ -200,6 +365,15 @@ class SiftFeatureExtractorThread : public Thread {
                             &image_data.keypoints,
                             &image_data.descriptors);
             }
+            if (refrac_validity_masks_) {
+              const std::shared_ptr<const Bitmap> refrac_validity_mask =
+                  refrac_validity_masks_->Get(image_data.camera);
+              if (refrac_validity_mask) {
+                MaskKeypoints(*refrac_validity_mask,
+                              &image_data.keypoints,
+                              &image_data.descriptors);
+              }
+            }
             if (image_data.mask.Data()) {
               MaskKeypoints(image_data.mask,
                             &image_data.keypoints,
@@ -221,25 +395,107 @@ class SiftFeatureExtractorThread : public Thread {
 
   const SiftExtractionOptions sift_options_;
   std::shared_ptr<Bitmap> camera_mask_;
+  std::shared_ptr<RefracValidityMasks> refrac_validity_masks_;
 
   std::unique_ptr<OpenGLContextManager> opengl_context_;
 
-  JobQueue<ImageData>* input_queue_;
-  JobQueue<ImageData>* output_queue_;
+  LockFreeJobQueue<ImageData>* input_queue_;
+  LockFreeJobQueue<ImageData>* output_queue_;
+};
+
+// Select the keyframes of the images in the order of the image reader, where
+// the images of every sub-folder form a separate sequence, and write the names
+// of the skipped non-keyframes to a file, if given.
+class KeyframeFilter {
+ public:
+  explicit KeyframeFilter(const ImageReaderOptions& options) {
+    if (!options.select_keyframes) {
+      return;
+    }
+    selector_ = std::make_unique<KeyframeSelector>(options.keyframe_selection);
+    if (!options.non_keyframes_path.empty()) {
+      non_keyframes_file_.open(options.non_keyframes_path, std::ios::trunc);
+      CHECK(non_keyframes_file_.is_open()) << options.non_keyframes_path;
+    }
+  }
+
+  bool IsKeyframe(const Camera& camera,
+                  const Image& image,
+                  const FeatureKeypoints& keypoints,
+                  const FeatureDescriptors& descriptors) {
+    if (!selector_) {
+      return true;
+    }
+
+    const std::string sequence = GetParentDir(image.Name());
+    if (sequence != sequence_) {
+      selector_->Reset();
+      sequence_ = sequence;
+    }
+
+    if (selector_->Next(keypoints, descriptors, camera.width, camera.height)) {
+      num_keyframes_ += 1;
+      return true;
+    }
+
+    num_non_keyframes_ += 1;
+    if (non_keyframes_file_.is_open()) {
+      non_keyframes_file_ << image.Name() << std::endl;
+    }
+    return false;
+  }
+
+  double LastOverlap() const { return selector_->LastOverlap(); }
+  double LastFlow() const { return selector_->LastFlow(); }
+
+  void PrintSummary() const {
+    if (selector_) {
+      LOG(INFO) << StringPrintf("Selected %d keyframes and skipped %d frames",
+                                num_keyframes_,
+                                num_non_keyframes_);
+    }
+  }
+
+ private:
+  std::unique_ptr<KeyframeSelector> selector_;
+  std::string sequence_;
+  std::ofstream non_keyframes_file_;
+  size_t num_keyframes_ = 0;
+  size_t num_non_keyframes_ = 0;
 };
 
 class FeatureWriterThread : public Thread {
  public:
   FeatureWriterThread(size_t num_images,
+                      int commit_num_images,
+                      double commit_size_mb,
+                      const ImageReaderOptions& reader_options,
                       Database* database,
-                      JobQueue<ImageData>* input_queue)
+                      LockFreeJobQueue<ImageData>* input_queue)
       : num_images_(num_images),
+        commit_num_images_(commit_num_images),
+        commit_num_bytes_(
+            static_cast<size_t>(commit_size_mb * 1024.0 * 1024.0)),
+        keyframe_filter_(reader_options),
         database_(database),
-        input_queue_(input_queue) {}
+        input_queue_(input_queue) {
+    CHECK_GT(commit_num_images_, 0);
+  }
 
  private:
+  // The features of an image that are buffered until the next commit.
+  struct PendingFeatures {
+    Image image;
+    FeatureKeypoints keypoints;
+    FeatureDescriptors descriptors;
+  };
+
   void Run() override {
-    size_t image_index = 0;
+    Timer write_timer;
+    // The extractor threads may finish the images out of order, so they are
+    // reordered for the sequential selection of the keyframes.
+    std::map<size_t, ImageData> reordered_image_data;
+    size_t next_index = 0;
     while (true) {
       if (IsStopped()) {
         break;
@@ -247,85 +503,182 @@ class FeatureWriterThread : public Thread {
 
       auto input_job = input_queue_->Pop();
       if (input_job.IsValid()) {
-        auto& image_data = input_job.Data();
-
-        image_index += 1;
-
-        LOG(INFO) << StringPrintf(
-            "Processed file [%d/%d]", image_index, num_images_);
-
-        LOG(INFO) << StringPrintf("  Name:            %s",
-                                  image_data.image.Name().c_str());
-
-        if (image_data.status == ImageReader::Status::IMAGE_EXISTS) {
-          LOG(INFO) << "  SKIP: Features for image already extracted.";
-        } else if (image_data.status == ImageReader::Status::BITMAP_ERROR) {
-          LOG(ERROR) << "Failed to read image file format.";
-        } else if (image_data.status ==
-                   ImageReader::Status::CAMERA_SINGLE_DIM_ERROR) {
-          LOG(ERROR) << "Single camera specified, "
-                        "but images have different dimensions.";
-        } else if (image_data.status ==
-                   ImageReader::Status::CAMERA_EXIST_DIM_ERROR) {
-          LOG(ERROR) << "Image previously processed, but current image "
-                        "has different dimensions.";
-        } else if (image_data.status ==
-                   ImageReader::Status::CAMERA_PARAM_ERROR) {
-          LOG(ERROR) << "Camera has invalid parameters.";
-        } else if (image_data.status == ImageReader::Status::FAILURE) {
-          LOG(ERROR) << "Failed to extract features.";
+        const size_t index = input_job.Data().index;
+        reordered_image_data.emplace(index, std::move(input_job.Data()));
+        while (!reordered_image_data.empty() &&
+               reordered_image_data.begin()->first == next_index) {
+          Write(&reordered_image_data.begin()->second, &write_timer);
+          reordered_image_data.erase(reordered_image_data.begin());
+          next_index += 1;
         }
+      } else {
+        break;
+      }
+    }
 
-        if (image_data.status != ImageReader::Status::SUCCESS) {
-          continue;
-        }
+    // Images may be missing, if the extraction was stopped early.
+    for (auto& image_data : reordered_image_data) {
+      Write(&image_data.second, &write_timer);
+    }
 
-        LOG(INFO) << StringPrintf("  Dimensions:      %d x %d",
-                                  image_data.camera.width,
-                                  image_data.camera.height);
-        LOG(INFO) << StringPrintf("  Camera:          #%d - %s",
-                                  image_data.camera.camera_id,
-                                  image_data.camera.ModelName().c_str());
-        LOG(INFO) << StringPrintf(
-            "  Focal Length:    %.2fpx%s",
-            image_data.camera.MeanFocalLength(),
-            image_data.camera.has_prior_focal_length ? " (Prior)" : "");
-        const Eigen::Vector3d& translation_prior =
-            image_data.image.CamFromWorldPrior().translation;
-        if (translation_prior.array().isFinite().any()) {
-          LOG(INFO) << StringPrintf(
-              "  GPS:             LAT=%.3f, LON=%.3f, ALT=%.3f",
-              translation_prior.x(),
-              translation_prior.y(),
-              translation_prior.z());
-        }
-        LOG(INFO) << StringPrintf("  Features:        %d",
-                                  image_data.keypoints.size());
+    // Also write the buffered features, if the thread was stopped early.
+    Commit(&write_timer);
+
+    keyframe_filter_.PrintSummary();
+
+    if (num_written_images_ > 0) {
+      const double num_written_mb = num_written_bytes_ / (1024.0 * 1024.0);
+      const double elapsed_seconds = write_timer.ElapsedSeconds();
+      LOG(INFO) << StringPrintf(
+          "Wrote features of %d images (%.2f MB) in %d transactions in %.3fs "
+          "(%.2f MB/s)",
+          num_written_images_,
+          num_written_mb,
+          num_commits_,
+          elapsed_seconds,
+          elapsed_seconds > 0 ? num_written_mb / elapsed_seconds : 0.0);
+    }
+  }
 
-        DatabaseTransaction database_transaction(database_);
+  // Log the image and buffer its features for the next commit.
+  void Write(ImageData* data, Timer* write_timer) {
+    ImageData& image_data = *data;
+
+    image_index_ += 1;
+    COLMAP_METRIC_COUNTER("Processed images", 1);
+
+    LOG(INFO) << StringPrintf(
+        "Processed file [%d/%d]", image_index_, num_images_);
+
+    LOG(INFO) << StringPrintf("  Name:            %s",
+                              image_data.image.Name().c_str());
+
+    if (image_data.status == ImageReader::Status::IMAGE_EXISTS) {
+      LOG(INFO) << "  SKIP: Features for image already extracted.";
+    } else if (image_data.status == ImageReader::Status::BITMAP_ERROR) {
+      LOG(ERROR) << "Failed to read image file format.";
+    } else if (image_data.status ==
+               ImageReader::Status::CAMERA_SINGLE_DIM_ERROR) {
+      LOG(ERROR) << "Single camera specified, "
+                    "but images have different dimensions.";
+    } else if (image_data.status ==
+               ImageReader::Status::CAMERA_EXIST_DIM_ERROR) {
+      LOG(ERROR) << "Image previously processed, but current image "
+                    "has different dimensions.";
+    } else if (image_data.status == ImageReader::Status::CAMERA_PARAM_ERROR) {
+      LOG(ERROR) << "Camera has invalid parameters.";
+    } else if (image_data.status == ImageReader::Status::FAILURE) {
+      LOG(ERROR) << "Failed to extract features.";
+    }
 
-        if (image_data.image.ImageId() == kInvalidImageId) {
-          image_data.image.SetImageId(database_->WriteImage(image_data.image));
+    if (image_data.status != ImageReader::Status::SUCCESS) {
+      return;
+    }
+
+    LOG(INFO) << StringPrintf("  Dimensions:      %d x %d",
+                              image_data.camera.width,
+                              image_data.camera.height);
+    LOG(INFO) << StringPrintf("  Camera:          #%d - %s",
+                              image_data.camera.camera_id,
+                              image_data.camera.ModelName().c_str());
+    LOG(INFO) << StringPrintf(
+        "  Focal Length:    %.2fpx%s",
+        image_data.camera.MeanFocalLength(),
+        image_data.camera.has_prior_focal_length ? " (Prior)" : "");
+    const Eigen::Vector3d& translation_prior =
+        image_data.image.CamFromWorldPrior().translation;
+    if (translation_prior.array().isFinite().any()) {
+      LOG(INFO) << StringPrintf(
+          "  GPS:             LAT=%.3f, LON=%.3f, ALT=%.3f",
+          translation_prior.x(),
+          translation_prior.y(),
+          translation_prior.z());
+    }
+    LOG(INFO) << StringPrintf("  Features:        %d",
+                              image_data.keypoints.size());
+    COLMAP_METRIC_COUNTER("Extracted images", 1);
+    COLMAP_METRIC_COUNTER("Extracted features", image_data.keypoints.size());
+
+    if (!keyframe_filter_.IsKeyframe(image_data.camera,
+                                     image_data.image,
+                                     image_data.keypoints,
+                                     image_data.descriptors)) {
+      LOG(INFO) << StringPrintf(
+          "  SKIP: No keyframe (overlap=%.2f, flow=%.3f).",
+          keyframe_filter_.LastOverlap(),
+          keyframe_filter_.LastFlow());
+      return;
+    }
+
+    PendingFeatures pending;
+    pending.image = std::move(image_data.image);
+    pending.keypoints = std::move(image_data.keypoints);
+    pending.descriptors = std::move(image_data.descriptors);
+    pending_num_bytes_ += pending.keypoints.size() * sizeof(FeatureKeypoint) +
+                          pending.descriptors.size() * sizeof(uint8_t);
+    pending_.push_back(std::move(pending));
+
+    if (pending_.size() >= static_cast<size_t>(commit_num_images_) ||
+        pending_num_bytes_ >= commit_num_bytes_) {
+      Commit(write_timer);
+    }
+  }
+
+  // Write all buffered features to the database in a single transaction.
+  void Commit(Timer* write_timer) {
+    if (pending_.empty()) {
+      return;
+    }
+
+    if (num_commits_ == 0) {
+      write_timer->Start();
+    } else {
+      write_timer->Resume();
+    }
+
+    {
+      DatabaseTransaction database_transaction(database_);
+      for (auto& pending : pending_) {
+        if (pending.image.ImageId() == kInvalidImageId) {
+          pending.image.SetImageId(database_->WriteImage(pending.image));
         }
 
-        if (!database_->ExistsKeypoints(image_data.image.ImageId())) {
-          database_->WriteKeypoints(image_data.image.ImageId(),
-                                    image_data.keypoints);
+        if (!database_->ExistsKeypoints(pending.image.ImageId())) {
+          database_->WriteKeypoints(pending.image.ImageId(),
+                                    pending.keypoints);
         }
 
-        if (!database_->ExistsDescriptors(image_data.image.ImageId())) {
-          database_->WriteDescriptors(image_data.image.ImageId(),
-                                      image_data.descriptors);
+        if (!database_->ExistsDescriptors(pending.image.ImageId())) {
+          database_->WriteDescriptors(pending.image.ImageId(),
+                                      pending.descriptors);
         }
-      } else {
-        break;
       }
     }
+
+    write_timer->Pause();
+
+    num_commits_ += 1;
+    num_written_images_ += pending_.size();
+    num_written_bytes_ += pending_num_bytes_;
+    pending_.clear();
+    pending_num_bytes_ = 0;
   }
 
   const size_t num_images_;
+  const int commit_num_images_;
+  const size_t commit_num_bytes_;
+  KeyframeFilter keyframe_filter_;
   Database* database_;
-  JobQueue<ImageData>* input_queue_;
+  LockFreeJobQueue<ImageData>* input_queue_;
+
+  size_t image_index_ = 0;
+
+  std::vector<PendingFeatures> pending_;
+  size_t pending_num_bytes_ = 0;
+
+  size_t num_commits_ = 0;
+  size_t num_written_images_ = 0;
+  size_t num_written_bytes_ = 0;
 };
 
 // Feature extraction class to extract features for all images in a directory.
@@ -352,6 +705,11 @@ class FeatureExtractorController : public Thread {
       }
     }
 
+    std::shared_ptr<RefracValidityMasks> refrac_validity_masks;
+    if (reader_options_.refrac_validity_mask) {
+      refrac_validity_masks = std::make_shared<RefracValidityMasks>();
+    }
+
     const int num_threads = GetEffectiveNumThreads(sift_options_.num_threads);
     CHECK_GT(num_threads, 0);
 
@@ -359,16 +717,42 @@ class FeatureExtractorController : public Thread {
     // avoid excess in memory usage since images and features take lots of
     // memory.
     const int kQueueSize = 1;
-    resizer_queue_ = std::make_unique<JobQueue<ImageData>>(kQueueSize);
-    extractor_queue_ = std::make_unique<JobQueue<ImageData>>(kQueueSize);
-    writer_queue_ = std::make_unique<JobQueue<ImageData>>(kQueueSize);
+    resizer_queue_ = std::make_unique<LockFreeJobQueue<ImageData>>(kQueueSize);
+    preprocessor_queue_ =
+        std::make_unique<LockFreeJobQueue<ImageData>>(kQueueSize);
+    extractor_queue_ =
+        std::make_unique<LockFreeJobQueue<ImageData>>(kQueueSize);
+    writer_queue_ = std::make_unique<LockFreeJobQueue<ImageData>>(kQueueSize);
+
+    // The images are optionally preprocessed after resizing, such that the
+    // preprocessing runs on the smaller images.
+    const ImagePreprocessingOptions& preprocessing_options =
+        reader_options_.preprocessing;
+    LockFreeJobQueue<ImageData>* resizer_output_queue = extractor_queue_.get();
+    if (preprocessing_options.IsEnabled()) {
+      resizer_output_queue = preprocessor_queue_.get();
+
+      std::shared_ptr<VignettingCalibrations> vignetting_calibrations;
+      if (!preprocessing_options.vignetting_path.empty()) {
+        vignetting_calibrations = std::make_shared<VignettingCalibrations>(
+            preprocessing_options.vignetting_path);
+      }
+
+      for (int i = 0; i < num_threads; ++i) {
+        preprocessors_.emplace_back(
+            std::make_unique<ImagePreprocessorThread>(preprocessing_options,
+                                                      vignetting_calibrations,
+                                                      preprocessor_queue_.get(),
+                                                      extractor_queue_.get()));
+      }
+    }
 
     if (sift_options_.max_image_size > 0) {
       for (int i = 0; i < num_threads; ++i) {
         resizers_.emplace_back(
             std::make_unique<ImageResizerThread>(sift_options_.max_image_size,
                                                  resizer_queue_.get(),
-                                                 extractor_queue_.get()));
+                                                 resizer_output_queue));
       }
     }
 
@@ -389,11 +773,14 @@ class FeatureExtractorController : public Thread {
       auto sift_gpu_options = sift_options_;
       for (const auto& gpu_index : gpu_indices) {
         sift_gpu_options.gpu_index = std::to_string(gpu_index);
-        extractors_.emplace_back(
-            std::make_unique<SiftFeatureExtractorThread>(sift_gpu_options,
-                                                         camera_mask,
-                                                         extractor_queue_.get(),
-                                                         writer_queue_.get()));
+        for (int i = 0; i < sift_options_.num_threads_per_gpu; ++i) {
+          extractors_.emplace_back(std::make_unique<SiftFeatureExtractorThread>(
+              sift_gpu_options,
+              camera_mask,
+              refrac_validity_masks,
+              extractor_queue_.get(),
+              writer_queue_.get()));
+        }
       }
     } else {
       if (sift_options_.num_threads == -1 &&
@@ -413,16 +800,22 @@ class FeatureExtractorController : public Thread {
       auto custom_sift_options = sift_options_;
       custom_sift_options.use_gpu = false;
       for (int i = 0; i < num_threads; ++i) {
-        extractors_.emplace_back(
-            std::make_unique<SiftFeatureExtractorThread>(custom_sift_options,
-                                                         camera_mask,
-                                                         extractor_queue_.get(),
-                                                         writer_queue_.get()));
+        extractors_.emplace_back(std::make_unique<SiftFeatureExtractorThread>(
+            custom_sift_options,
+            camera_mask,
+            refrac_validity_masks,
+            extractor_queue_.get(),
+            writer_queue_.get()));
       }
     }
 
     writer_ = std::make_unique<FeatureWriterThread>(
-        image_reader_.NumImages(), &database_, writer_queue_.get());
+        image_reader_.NumImages(),
+        reader_options_.database_commit_num_images,
+        reader_options_.database_commit_size_mb,
+        reader_options_,
+        &database_,
+        writer_queue_.get());
   }
 
  private:
@@ -433,6 +826,10 @@ class FeatureExtractorController : public Thread {
       resizer->Start();
     }
 
+    for (auto& preprocessor : preprocessors_) {
+      preprocessor->Start();
+    }
+
     for (auto& extractor : extractors_) {
       extractor->Start();
     }
@@ -448,13 +845,16 @@ class FeatureExtractorController : public Thread {
     while (image_reader_.NextIndex() < image_reader_.NumImages()) {
       if (IsStopped()) {
         resizer_queue_->Stop();
+        preprocessor_queue_->Stop();
         extractor_queue_->Stop();
         resizer_queue_->Clear();
+        preprocessor_queue_->Clear();
         extractor_queue_->Clear();
         break;
       }
 
       ImageData image_data;
+      image_data.index = image_reader_.NextIndex();
       image_data.status = image_reader_.Next(&image_data.camera,
                                              &image_data.image,
                                              &image_data.bitmap,
@@ -466,9 +866,20 @@ class FeatureExtractorController : public Thread {
 
       if (sift_options_.max_image_size > 0) {
         CHECK(resizer_queue_->Push(std::move(image_data)));
+      } else if (reader_options_.preprocessing.IsEnabled()) {
+        CHECK(preprocessor_queue_->Push(std::move(image_data)));
       } else {
         CHECK(extractor_queue_->Push(std::move(image_data)));
       }
+
+      COLMAP_METRIC_GAUGE("Feature extraction resizer queue size",
+                          resizer_queue_->Size());
+      COLMAP_METRIC_GAUGE("Feature extraction preprocessor queue size",
+                          preprocessor_queue_->Size());
+      COLMAP_METRIC_GAUGE("Feature extraction extractor queue size",
+                          extractor_queue_->Size());
+      COLMAP_METRIC_GAUGE("Feature extraction writer queue size",
+                          writer_queue_->Size());
     }
 
     resizer_queue_->Wait();
@@ -477,6 +888,12 @@ class FeatureExtractorController : public Thread {
       resizer->Wait();
     }
 
+    preprocessor_queue_->Wait();
+    preprocessor_queue_->Stop();
+    for (auto& preprocessor : preprocessors_) {
+      preprocessor->Wait();
+    }
+
     extractor_queue_->Wait();
     extractor_queue_->Stop();
     for (auto& extractor : extractors_) {
@@ -497,23 +914,40 @@ class FeatureExtractorController : public Thread {
   ImageReader image_reader_;
 
   std::vector<std::unique_ptr<Thread>> resizers_;
+  std::vector<std::unique_ptr<Thread>> preprocessors_;
   std::vector<std::unique_ptr<Thread>> extractors_;
   std::unique_ptr<Thread> writer_;
 
-  std::unique_ptr<JobQueue<ImageData>> resizer_queue_;
-  std::unique_ptr<JobQueue<ImageData>> extractor_queue_;
-  std::unique_ptr<JobQueue<ImageData>> writer_queue_;
+  std::unique_ptr<LockFreeJobQueue<ImageData>> resizer_queue_;
+  std::unique_ptr<LockFreeJobQueue<ImageData>> preprocessor_queue_;
+  std::unique_ptr<LockFreeJobQueue<ImageData>> extractor_queue_;
+  std::unique_ptr<LockFreeJobQueue<ImageData>> writer_queue_;
 };
 
-// Import features from text files. Each image must have a corresponding text
-// file with the same name and an additional ".txt" suffix.
+// Import features from text or binary files. Each image must have a
+// corresponding text file with the same name and an additional ".txt" suffix
+// or a binary file with an additional ".bin" suffix. The files are parsed in
+// parallel and the features of multiple images are written in one transaction.
 class FeatureImporterController : public Thread {
  public:
   FeatureImporterController(const ImageReaderOptions& reader_options,
-                            const std::string& import_path)
-      : reader_options_(reader_options), import_path_(import_path) {}
+                            const std::string& import_path,
+                            const int num_threads)
+      : reader_options_(reader_options),
+        import_path_(import_path),
+        num_threads_(num_threads) {}
 
  private:
+  // The maximum number of images whose features are written to the database
+  // in a single transaction.
+  const static size_t kMaxNumImagesPerTransaction = 100;
+
+  struct ImportData {
+    Camera camera;
+    Image image;
+    std::future<std::pair<FeatureKeypoints, FeatureDescriptors>> features;
+  };
+
   void Run() override {
     PrintHeading1("Feature import");
 
@@ -524,57 +958,106 @@ class FeatureImporterController : public Thread {
 
     Database database(reader_options_.database_path);
     ImageReader image_reader(reader_options_, &database);
+    ThreadPool thread_pool(num_threads_);
+    KeyframeFilter keyframe_filter(reader_options_);
 
-    while (image_reader.NextIndex() < image_reader.NumImages()) {
-      if (IsStopped()) {
-        break;
+    const auto LoadFeatures = [](const std::string& path, const bool binary) {
+      std::pair<FeatureKeypoints, FeatureDescriptors> features;
+      if (binary) {
+        LoadSiftFeaturesFromBinaryFile(path, &features.first, &features.second);
+      } else {
+        LoadSiftFeaturesFromTextFile(path, &features.first, &features.second);
       }
+      return features;
+    };
 
-      LOG(INFO) << StringPrintf("Processing file [%d/%d]",
-                                image_reader.NextIndex() + 1,
-                                image_reader.NumImages());
-
-      // Load image data and possibly save camera to database.
-      Camera camera;
-      Image image;
-      Bitmap bitmap;
-      if (image_reader.Next(&camera, &image, &bitmap, nullptr) !=
-          ImageReader::Status::SUCCESS) {
-        continue;
-      }
+    while (image_reader.NextIndex() < image_reader.NumImages()) {
+      // The image reader writes the cameras in its own transaction, so that
+      // the images of a batch are read before writing their features.
+      std::vector<ImportData> batch;
+      while (batch.size() < kMaxNumImagesPerTransaction &&
+             image_reader.NextIndex() < image_reader.NumImages()) {
+        if (IsStopped()) {
+          break;
+        }
+
+        LOG(INFO) << StringPrintf("Processing file [%d/%d]",
+                                  image_reader.NextIndex() + 1,
+                                  image_reader.NumImages());
 
-      const std::string path = JoinPaths(import_path_, image.Name() + ".txt");
+        // Load image data and possibly save camera to database.
+        Camera camera;
+        Image image;
+        Bitmap bitmap;
+        if (image_reader.Next(&camera, &image, &bitmap, nullptr) !=
+            ImageReader::Status::SUCCESS) {
+          continue;
+        }
+
+        const std::string text_path =
+            JoinPaths(import_path_, image.Name() + ".txt");
+        const std::string binary_path =
+            JoinPaths(import_path_, image.Name() + ".bin");
+        if (ExistsFile(text_path)) {
+          batch.push_back({camera,
+                           image,
+                           thread_pool.AddTask(
+                               LoadFeatures, text_path, false)});
+        } else if (ExistsFile(binary_path)) {
+          batch.push_back({camera,
+                           image,
+                           thread_pool.AddTask(
+                               LoadFeatures, binary_path, true)});
+        } else {
+          LOG(INFO) << "SKIP: No features found at " << text_path;
+        }
+      }
 
-      if (ExistsFile(path)) {
-        FeatureKeypoints keypoints;
-        FeatureDescriptors descriptors;
-        LoadSiftFeaturesFromTextFile(path, &keypoints, &descriptors);
+      DatabaseTransaction database_transaction(&database);
+      for (auto& data : batch) {
+        const auto features = data.features.get();
+        const FeatureKeypoints& keypoints = features.first;
+        const FeatureDescriptors& descriptors = features.second;
 
-        LOG(INFO) << "Features:       " << keypoints.size();
+        LOG(INFO) << StringPrintf("Features:       %d (%s)",
+                                  keypoints.size(),
+                                  data.image.Name().c_str());
 
-        DatabaseTransaction database_transaction(&database);
+        if (!keyframe_filter.IsKeyframe(
+                data.camera, data.image, keypoints, descriptors)) {
+          LOG(INFO) << StringPrintf(
+              "SKIP: No keyframe (overlap=%.2f, flow=%.3f)",
+              keyframe_filter.LastOverlap(),
+              keyframe_filter.LastFlow());
+          continue;
+        }
 
-        if (image.ImageId() == kInvalidImageId) {
-          image.SetImageId(database.WriteImage(image));
+        if (data.image.ImageId() == kInvalidImageId) {
+          data.image.SetImageId(database.WriteImage(data.image));
         }
 
-        if (!database.ExistsKeypoints(image.ImageId())) {
-          database.WriteKeypoints(image.ImageId(), keypoints);
+        if (!database.ExistsKeypoints(data.image.ImageId())) {
+          database.WriteKeypoints(data.image.ImageId(), keypoints);
         }
 
-        if (!database.ExistsDescriptors(image.ImageId())) {
-          database.WriteDescriptors(image.ImageId(), descriptors);
+        if (!database.ExistsDescriptors(data.image.ImageId())) {
+          database.WriteDescriptors(data.image.ImageId(), descriptors);
         }
-      } else {
-        LOG(INFO) << "SKIP: No features found at " << path;
+      }
+
+      if (IsStopped()) {
+        break;
       }
     }
 
+    keyframe_filter.PrintSummary();
+
     GetTimer().PrintMinutes();
   }
 
   const ImageReaderOptions reader_options_;
   const std::string import_path_;
+  const int num_threads_;
 };
 
 }  // namespace
@@ -587,9 +1070,11 @@ std::unique_ptr<Thread> CreateFeatureExtractorController(
 }
 
 std::unique_ptr<Thread> CreateFeatureImporterController(
-    const ImageReaderOptions& reader_options, const std::string& import_path) {
-  return std::make_unique<FeatureImporterController>(reader_options,
-                                                     import_path);
+    const ImageReaderOptions& reader_options,
+    const std::string& import_path,
+    const int num_threads) {
+  return std::make_unique<FeatureImporterController>(
+      reader_options, import_path, num_threads);
 }
 
 }  // namespace colmap
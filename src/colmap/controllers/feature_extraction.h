@@ -40,9 +40,14 @@ std::unique_ptr<Thread> CreateFeatureExtractorController(
     const ImageReaderOptions& reader_options,
     const SiftExtractionOptions& sift_options);
 
-// Import features from text files. Each image must have a corresponding text
-// file with the same name and an additional ".txt" suffix.
+// Import features from text or binary files. Each image must have a
+// corresponding text file with the same name and an additional ".txt" suffix,
+// see `LoadSiftFeaturesFromTextFile`, or a binary file with an additional
+// ".bin" suffix, see `LoadSiftFeaturesFromBinaryFile`. The files are parsed
+// with the given number of threads.
 std::unique_ptr<Thread> CreateFeatureImporterController(
-    const ImageReaderOptions& reader_options, const std::string& import_path);
+    const ImageReaderOptions& reader_options,
+    const std::string& import_path,
+    int num_threads = -1);
 
 }  // namespace colmap
@@ -34,10 +34,18 @@
 #include "colmap/feature/utils.h"
 #include "colmap/geometry/gps.h"
 #include "colmap/retrieval/visual_index.h"
+#include "colmap/scene/camera_rig.h"
 #include "colmap/util/misc.h"
 
+#include <algorithm>
+#include <cmath>
 #include <fstream>
+#include <future>
+#include <limits>
 #include <numeric>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
 
 namespace colmap {
 namespace {
@@ -46,7 +54,18 @@ void PrintElapsedTime(const Timer& timer) {
   LOG(INFO) << StringPrintf(" in %.3fs", timer.ElapsedSeconds());
 }
 
-void IndexImagesInVisualIndex(const int num_threads,
+// Assign the visual words on the first matching GPU, if enabled.
+template <typename VisualIndexOptions>
+void SetVisualIndexGPUOptions(const SiftMatchingOptions& matching_options,
+                              VisualIndexOptions* options) {
+  options->use_gpu = matching_options.use_gpu;
+  const std::vector<int> gpu_indices =
+      CSVToVector<int>(matching_options.gpu_index);
+  CHECK_GT(gpu_indices.size(), 0);
+  options->gpu_index = gpu_indices[0];
+}
+
+void IndexImagesInVisualIndex(const SiftMatchingOptions& matching_options,
                               const int num_checks,
                               const int max_num_features,
                               const std::vector<image_t>& image_ids,
@@ -54,8 +73,9 @@ void IndexImagesInVisualIndex(const int num_threads,
                               FeatureMatcherCache* cache,
                               retrieval::VisualIndex<>* visual_index) {
   retrieval::VisualIndex<>::IndexOptions index_options;
-  index_options.num_threads = num_threads;
+  index_options.num_threads = matching_options.num_threads;
   index_options.num_checks = num_checks;
+  SetVisualIndexGPUOptions(matching_options, &index_options);
 
   for (size_t i = 0; i < image_ids.size(); ++i) {
     if (thread->IsStopped()) {
@@ -78,30 +98,69 @@ void IndexImagesInVisualIndex(const int num_threads,
 
     PrintElapsedTime(timer);
   }
-
-  // Compute the TF-IDF weights, etc.
-  visual_index->Prepare();
 }
 
-void MatchNearestNeighborsInVisualIndex(const int num_threads,
-                                        const int num_images,
-                                        const int num_neighbors,
-                                        const int num_checks,
-                                        const int num_images_after_verification,
-                                        const int max_num_features,
-                                        const std::vector<image_t>& image_ids,
-                                        Thread* thread,
-                                        FeatureMatcherCache* cache,
-                                        retrieval::VisualIndex<>* visual_index,
-                                        FeatureMatcherController* matcher) {
-  struct Retrieval {
-    image_t image_id = kInvalidImageId;
-    std::vector<retrieval::ImageScore> image_scores;
-  };
+struct Retrieval {
+  image_t image_id = kInvalidImageId;
+  std::vector<retrieval::ImageScore> image_scores;
+};
+
+// Order the retrievals such that consecutive queries share many retrieved
+// images, whose features are then likely still in the cache. The retrieval
+// graph is traversed depth-first, visiting the best scoring neighbors first,
+// and a new traversal starts at the first unvisited query in the given order.
+std::vector<size_t> OrderRetrievalsByOverlap(
+    const std::vector<Retrieval>& retrievals) {
+  std::unordered_map<image_t, size_t> retrieval_idxs;
+  retrieval_idxs.reserve(retrievals.size());
+  for (size_t i = 0; i < retrievals.size(); ++i) {
+    retrieval_idxs.emplace(retrievals[i].image_id, i);
+  }
+
+  std::vector<size_t> order;
+  order.reserve(retrievals.size());
+  std::vector<bool> visited(retrievals.size(), false);
+  std::vector<size_t> stack;
+  for (size_t i = 0; i < retrievals.size(); ++i) {
+    stack.push_back(i);
+    while (!stack.empty()) {
+      const size_t idx = stack.back();
+      stack.pop_back();
+      if (visited[idx]) {
+        continue;
+      }
+      visited[idx] = true;
+      order.push_back(idx);
+      const auto& image_scores = retrievals[idx].image_scores;
+      for (auto it = image_scores.rbegin(); it != image_scores.rend(); ++it) {
+        const auto retrieval_idx = retrieval_idxs.find(it->image_id);
+        if (retrieval_idx != retrieval_idxs.end() &&
+            !visited[retrieval_idx->second]) {
+          stack.push_back(retrieval_idx->second);
+        }
+      }
+    }
+  }
 
+  return order;
+}
+
+void MatchNearestNeighborsInVisualIndex(
+    const SiftMatchingOptions& matching_options,
+    const int num_images,
+    const int num_neighbors,
+    const int num_checks,
+    const int num_images_after_verification,
+    const int max_num_features,
+    const std::vector<image_t>& image_ids,
+    const bool order_by_overlap,
+    Thread* thread,
+    FeatureMatcherCache* cache,
+    retrieval::VisualIndex<>* visual_index,
+    FeatureMatcherController* matcher) {
   // Create a thread pool to retrieve the nearest neighbors.
-  ThreadPool retrieval_thread_pool(num_threads);
-  JobQueue<Retrieval> retrieval_queue(num_threads);
+  ThreadPool retrieval_thread_pool(matching_options.num_threads);
+  JobQueue<Retrieval> retrieval_queue(matching_options.num_threads);
 
   // The retrieval thread kernel function. Note that the descriptors should be
   // extracted outside of this function sequentially to avoid any concurrent
@@ -111,6 +170,7 @@ void MatchNearestNeighborsInVisualIndex(const int num_threads,
   query_options.num_neighbors = num_neighbors;
   query_options.num_checks = num_checks;
   query_options.num_images_after_verification = num_images_after_verification;
+  SetVisualIndexGPUOptions(matching_options, &query_options);
   auto QueryFunc = [&](const image_t image_id) {
     auto keypoints = *cache->GetKeypoints(image_id);
     auto descriptors = *cache->GetDescriptors(image_id);
@@ -135,6 +195,22 @@ void MatchNearestNeighborsInVisualIndex(const int num_threads,
   }
 
   std::vector<std::pair<image_t, image_t>> image_pairs;
+  auto MatchRetrieval = [&](const Retrieval& retrieval) {
+    // Compose the image pairs from the scores.
+    image_pairs.clear();
+    image_pairs.reserve(retrieval.image_scores.size());
+    for (const auto image_score : retrieval.image_scores) {
+      image_pairs.emplace_back(retrieval.image_id, image_score.image_id);
+    }
+
+    matcher->MatchAsync(image_pairs);
+  };
+
+  // When ordering by overlap, all retrievals are collected before matching.
+  std::vector<Retrieval> retrievals;
+  if (order_by_overlap) {
+    retrievals.reserve(image_ids.size());
+  }
 
   // Pop the finished retrieval results and enqueue them for feature matching.
   for (size_t i = 0; i < image_ids.size(); ++i) {
@@ -146,7 +222,10 @@ void MatchNearestNeighborsInVisualIndex(const int num_threads,
     Timer timer;
     timer.Start();
 
-    LOG(INFO) << StringPrintf("Matching image [%d/%d]", i + 1, image_ids.size())
+    LOG(INFO) << StringPrintf(order_by_overlap ? "Retrieving image [%d/%d]"
+                                               : "Matching image [%d/%d]",
+                              i + 1,
+                              image_ids.size())
               << std::flush;
 
     // Push the next image to the retrieval queue.
@@ -159,20 +238,38 @@ void MatchNearestNeighborsInVisualIndex(const int num_threads,
     auto retrieval = retrieval_queue.Pop();
     CHECK(retrieval.IsValid());
 
-    const auto& image_id = retrieval.Data().image_id;
-    const auto& image_scores = retrieval.Data().image_scores;
+    if (order_by_overlap) {
+      retrievals.push_back(std::move(retrieval.Data()));
+    } else {
+      MatchRetrieval(retrieval.Data());
+    }
 
-    // Compose the image pairs from the scores.
-    image_pairs.clear();
-    image_pairs.reserve(image_scores.size());
-    for (const auto image_score : image_scores) {
-      image_pairs.emplace_back(image_id, image_score.image_id);
+    PrintElapsedTime(timer);
+  }
+
+  if (!order_by_overlap) {
+    matcher->Wait();
+    return;
+  }
+
+  const std::vector<size_t> order = OrderRetrievalsByOverlap(retrievals);
+  for (size_t i = 0; i < order.size(); ++i) {
+    if (thread->IsStopped()) {
+      return;
     }
 
-    matcher->Match(image_pairs);
+    Timer timer;
+    timer.Start();
+
+    LOG(INFO) << StringPrintf("Matching image [%d/%d]", i + 1, order.size())
+              << std::flush;
+
+    MatchRetrieval(retrievals[order[i]]);
 
     PrintElapsedTime(timer);
   }
+
+  matcher->Wait();
 }
 
 class ExhaustiveFeatureMatcher : public Thread {
@@ -184,7 +281,7 @@ class ExhaustiveFeatureMatcher : public Thread {
       : options_(options),
         matching_options_(matching_options),
         database_(database_path),
-        cache_(5 * options_.block_size,
+        cache_((kNumStripeBlocks + 1) * options_.block_size,
                &database_,
                geometry_options.enable_refraction),
         matcher_(matching_options, geometry_options, &database_, &cache_) {
@@ -194,6 +291,10 @@ class ExhaustiveFeatureMatcher : public Thread {
   }
 
  private:
+  // Number of row blocks that are kept in the cache, in addition to the
+  // currently matched column block.
+  static constexpr size_t kNumStripeBlocks = 4;
+
   void Run() override {
     PrintHeading1("Exhaustive feature matching");
 
@@ -211,17 +312,39 @@ class ExhaustiveFeatureMatcher : public Thread {
     const size_t num_pairs_per_block = block_size * (block_size - 1) / 2;
 
     std::vector<std::pair<image_t, image_t>> image_pairs;
-    image_pairs.reserve(num_pairs_per_block);
+    image_pairs.reserve(2 * kNumStripeBlocks * num_pairs_per_block);
 
-    for (size_t start_idx1 = 0; start_idx1 < image_ids.size();
-         start_idx1 += block_size) {
+    const auto AddBlockPairs = [&](const size_t block1, const size_t block2) {
+      const size_t start_idx1 = block1 * block_size;
       const size_t end_idx1 =
           std::min(image_ids.size(), start_idx1 + block_size) - 1;
-      for (size_t start_idx2 = 0; start_idx2 < image_ids.size();
-           start_idx2 += block_size) {
-        const size_t end_idx2 =
-            std::min(image_ids.size(), start_idx2 + block_size) - 1;
-
+      const size_t start_idx2 = block2 * block_size;
+      const size_t end_idx2 =
+          std::min(image_ids.size(), start_idx2 + block_size) - 1;
+      for (size_t idx1 = start_idx1; idx1 <= end_idx1; ++idx1) {
+        for (size_t idx2 = start_idx2; idx2 <= end_idx2; ++idx2) {
+          const size_t block_id1 = idx1 % block_size;
+          const size_t block_id2 = idx2 % block_size;
+          if ((idx1 > idx2 && block_id1 <= block_id2) ||
+              (idx1 < idx2 &&
+               block_id1 < block_id2)) {  // Avoid duplicate pairs
+            image_pairs.emplace_back(image_ids[idx1], image_ids[idx2]);
+          }
+        }
+      }
+    };
+
+    // Traversing the blocks in row-major order loads every block once per
+    // row. Instead, keep a stripe of row blocks in the cache and stream the
+    // remaining column blocks past it, which loads every block only once per
+    // stripe. All block pairs (block1, block2) and (block2, block1) of a
+    // column block are matched together, such that the union of the pairs is
+    // the same as for the row-major traversal.
+    for (size_t stripe_start = 0; stripe_start < num_blocks;
+         stripe_start += kNumStripeBlocks) {
+      const size_t stripe_end =
+          std::min(num_blocks, stripe_start + kNumStripeBlocks);
+      for (size_t block2 = stripe_start; block2 < num_blocks; ++block2) {
         if (IsStopped()) {
           GetTimer().PrintMinutes();
           return;
@@ -230,33 +353,33 @@ class ExhaustiveFeatureMatcher : public Thread {
         Timer timer;
         timer.Start();
 
-        LOG(INFO) << StringPrintf("Matching block [%d/%d, %d/%d]",
-                                  start_idx1 / block_size + 1,
+        const size_t block1_end = std::min(stripe_end, block2 + 1);
+        LOG(INFO) << StringPrintf("Matching block [%d-%d/%d, %d/%d]",
+                                  stripe_start + 1,
+                                  block1_end,
                                   num_blocks,
-                                  start_idx2 / block_size + 1,
+                                  block2 + 1,
                                   num_blocks)
                   << std::flush;
 
         image_pairs.clear();
-        for (size_t idx1 = start_idx1; idx1 <= end_idx1; ++idx1) {
-          for (size_t idx2 = start_idx2; idx2 <= end_idx2; ++idx2) {
-            const size_t block_id1 = idx1 % block_size;
-            const size_t block_id2 = idx2 % block_size;
-            if ((idx1 > idx2 && block_id1 <= block_id2) ||
-                (idx1 < idx2 &&
-                 block_id1 < block_id2)) {  // Avoid duplicate pairs
-              image_pairs.emplace_back(image_ids[idx1], image_ids[idx2]);
-            }
+        for (size_t block1 = stripe_start; block1 < block1_end; ++block1) {
+          AddBlockPairs(block1, block2);
+          if (block1 != block2) {
+            AddBlockPairs(block2, block1);
           }
         }
 
         DatabaseTransaction database_transaction(&database_);
-        matcher_.Match(image_pairs);
+        matcher_.MatchAsync(image_pairs);
 
         PrintElapsedTime(timer);
       }
     }
 
+    DatabaseTransaction database_transaction(&database_);
+    matcher_.Wait();
+
     GetTimer().PrintMinutes();
   }
 
@@ -316,9 +439,18 @@ class SequentialFeatureMatcher : public Thread {
 
     const std::vector<image_t> ordered_image_ids = GetOrderedImageIds();
 
-    RunSequentialMatching(ordered_image_ids);
-    if (options_.loop_detection) {
-      RunLoopDetection(ordered_image_ids);
+    if (options_.loop_detection && options_.loop_detection_background &&
+        !options_.loop_detection_online) {
+      RunSequentialMatchingWithBackgroundLoopDetection(ordered_image_ids);
+    } else {
+      RunSequentialMatching(ordered_image_ids);
+      if (options_.loop_detection) {
+        if (options_.loop_detection_online) {
+          RunOnlineLoopDetection(ordered_image_ids);
+        } else {
+          RunLoopDetection(ordered_image_ids);
+        }
+      }
     }
 
     GetTimer().PrintMinutes();
@@ -348,7 +480,9 @@ class SequentialFeatureMatcher : public Thread {
     return ordered_image_ids;
   }
 
-  void RunSequentialMatching(const std::vector<image_t>& image_ids) {
+  // If given, the detected loops are matched after every sequential image.
+  void RunSequentialMatching(const std::vector<image_t>& image_ids,
+                             JobQueue<Retrieval>* loop_queue = nullptr) {
     std::vector<std::pair<image_t, image_t>> image_pairs;
     image_pairs.reserve(options_.overlap);
 
@@ -385,10 +519,155 @@ class SequentialFeatureMatcher : public Thread {
       }
 
       DatabaseTransaction database_transaction(&database_);
-      matcher_.Match(image_pairs);
+      matcher_.MatchAsync(image_pairs);
+      if (loop_queue != nullptr) {
+        MatchLoops(loop_queue, /*wait=*/false);
+      }
 
       PrintElapsedTime(timer);
     }
+
+    DatabaseTransaction database_transaction(&database_);
+    matcher_.Wait();
+  }
+
+  // Detect the loops in a background thread, while matching the sequential
+  // image pairs and the already detected loops in this thread.
+  void RunSequentialMatchingWithBackgroundLoopDetection(
+      const std::vector<image_t>& image_ids) {
+    JobQueue<Retrieval> loop_queue;
+    loop_detection_finished_ = false;
+    std::thread loop_detection_thread(
+        [&]() { DetectLoops(image_ids, &loop_queue); });
+
+    RunSequentialMatching(image_ids, &loop_queue);
+    if (!IsStopped()) {
+      DatabaseTransaction database_transaction(&database_);
+      MatchLoops(&loop_queue, /*wait=*/true);
+      matcher_.Wait();
+    }
+
+    loop_queue.Stop();
+    loop_detection_thread.join();
+  }
+
+  // Index all images and retrieve the loop candidates of every period image,
+  // which are pushed to the queue followed by an invalid end marker.
+  void DetectLoops(const std::vector<image_t>& image_ids,
+                   JobQueue<Retrieval>* loop_queue) {
+    retrieval::VisualIndex<> visual_index;
+    visual_index.Read(options_.vocab_tree_path);
+    IndexImagesInVisualIndex(matching_options_,
+                             options_.loop_detection_num_checks,
+                             options_.loop_detection_max_num_features,
+                             image_ids,
+                             this,
+                             &cache_,
+                             &visual_index);
+
+    if (!IsStopped()) {
+      visual_index.Prepare();
+
+      retrieval::VisualIndex<>::QueryOptions query_options;
+      query_options.max_num_images = options_.loop_detection_num_images;
+      query_options.num_neighbors =
+          options_.loop_detection_num_nearest_neighbors;
+      query_options.num_checks = options_.loop_detection_num_checks;
+      query_options.num_images_after_verification =
+          options_.loop_detection_num_images_after_verification;
+      SetVisualIndexGPUOptions(matching_options_, &query_options);
+
+      std::unordered_map<image_t, int> image_idxs;
+      image_idxs.reserve(image_ids.size());
+      for (size_t i = 0; i < image_ids.size(); ++i) {
+        image_idxs.emplace(image_ids[i], static_cast<int>(i));
+      }
+
+      // The sequential indices of the detected loops, as (query, retrieved).
+      std::vector<std::pair<int, int>> loops;
+      size_t num_candidates = 0;
+      for (size_t i = 0; i < image_ids.size() && !IsStopped();
+           i += options_.loop_detection_period) {
+        auto keypoints = *cache_.GetKeypoints(image_ids[i]);
+        auto descriptors = *cache_.GetDescriptors(image_ids[i]);
+        if (options_.loop_detection_max_num_features > 0 &&
+            descriptors.rows() > options_.loop_detection_max_num_features) {
+          ExtractTopScaleFeatures(&keypoints,
+                                  &descriptors,
+                                  options_.loop_detection_max_num_features);
+        }
+
+        std::vector<retrieval::ImageScore> image_scores;
+        visual_index.Query(
+            query_options, keypoints, descriptors, &image_scores);
+        num_candidates += image_scores.size();
+
+        // The images are retrieved in descending order of their scores, such
+        // that the best scoring candidate of every revisit is kept.
+        const int query_idx = static_cast<int>(i);
+        Retrieval retrieval;
+        retrieval.image_id = image_ids[i];
+        for (const auto& image_score : image_scores) {
+          const int idx = image_idxs.at(image_score.image_id);
+          if (std::abs(idx - query_idx) > options_.overlap &&
+              !IsSuppressedLoop(loops, query_idx, idx)) {
+            loops.emplace_back(query_idx, idx);
+            retrieval.image_scores.push_back(image_score);
+          }
+        }
+
+        if (!retrieval.image_scores.empty()) {
+          loop_queue->Push(std::move(retrieval));
+        }
+      }
+
+      LOG(INFO) << StringPrintf("Detected %d loops of %d candidates",
+                                loops.size(),
+                                num_candidates);
+    }
+
+    loop_queue->Push(Retrieval());
+  }
+
+  // Whether a detected loop connects images within the radius of the
+  // non-maximum suppression of both images of the loop candidate.
+  bool IsSuppressedLoop(const std::vector<std::pair<int, int>>& loops,
+                        const int query_idx,
+                        const int idx) const {
+    for (auto loop = loops.rbegin(); loop != loops.rend(); ++loop) {
+      if (query_idx - loop->first > options_.loop_detection_nms_radius) {
+        break;
+      }
+      if (std::abs(idx - loop->second) <= options_.loop_detection_nms_radius) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Match the detected loops in the queue until the end marker, or only the
+  // already detected loops, if not waiting.
+  void MatchLoops(JobQueue<Retrieval>* loop_queue, const bool wait) {
+    std::vector<std::pair<image_t, image_t>> image_pairs;
+    while (!loop_detection_finished_ && !IsStopped()) {
+      auto loop = wait ? loop_queue->Pop() : loop_queue->TryPop();
+      if (!loop.IsValid()) {
+        // An invalid job means an empty queue, if not waiting.
+        loop_detection_finished_ = wait;
+        return;
+      }
+      if (loop.Data().image_id == kInvalidImageId) {
+        loop_detection_finished_ = true;
+        return;
+      }
+
+      image_pairs.clear();
+      image_pairs.reserve(loop.Data().image_scores.size());
+      for (const auto& image_score : loop.Data().image_scores) {
+        image_pairs.emplace_back(loop.Data().image_id, image_score.image_id);
+      }
+      matcher_.MatchAsync(image_pairs);
+    }
   }
 
   void RunLoopDetection(const std::vector<image_t>& image_ids) {
@@ -397,7 +676,7 @@ class SequentialFeatureMatcher : public Thread {
     visual_index.Read(options_.vocab_tree_path);
 
     // Index all images in the visual index.
-    IndexImagesInVisualIndex(matching_options_.num_threads,
+    IndexImagesInVisualIndex(matching_options_,
                              options_.loop_detection_num_checks,
                              options_.loop_detection_max_num_features,
                              image_ids,
@@ -409,6 +688,9 @@ class SequentialFeatureMatcher : public Thread {
       return;
     }
 
+    // Compute the TF-IDF weights, etc.
+    visual_index.Prepare();
+
     // Only perform loop detection for every n-th image.
     std::vector<image_t> match_image_ids;
     for (size_t i = 0; i < image_ids.size();
@@ -417,24 +699,71 @@ class SequentialFeatureMatcher : public Thread {
     }
 
     MatchNearestNeighborsInVisualIndex(
-        matching_options_.num_threads,
+        matching_options_,
         options_.loop_detection_num_images,
         options_.loop_detection_num_nearest_neighbors,
         options_.loop_detection_num_checks,
         options_.loop_detection_num_images_after_verification,
         options_.loop_detection_max_num_features,
         match_image_ids,
+        /*order_by_overlap=*/true,
         this,
         &cache_,
         &visual_index,
         &matcher_);
   }
 
+  // Index the images in their sequential order and retrieve only previously
+  // indexed images, as if the images arrived during acquisition. The visual
+  // index is updated incrementally after every period of images.
+  void RunOnlineLoopDetection(const std::vector<image_t>& image_ids) {
+    retrieval::VisualIndex<> visual_index;
+    visual_index.Read(options_.vocab_tree_path);
+
+    for (size_t period_begin = 0; period_begin < image_ids.size();
+         period_begin += options_.loop_detection_period) {
+      const size_t period_end =
+          std::min(period_begin + options_.loop_detection_period,
+                   image_ids.size());
+      const std::vector<image_t> period_image_ids(
+          image_ids.begin() + period_begin, image_ids.begin() + period_end);
+
+      IndexImagesInVisualIndex(matching_options_,
+                               options_.loop_detection_num_checks,
+                               options_.loop_detection_max_num_features,
+                               period_image_ids,
+                               this,
+                               &cache_,
+                               &visual_index);
+
+      if (IsStopped()) {
+        return;
+      }
+
+      visual_index.Update();
+
+      MatchNearestNeighborsInVisualIndex(
+          matching_options_,
+          options_.loop_detection_num_images,
+          options_.loop_detection_num_nearest_neighbors,
+          options_.loop_detection_num_checks,
+          options_.loop_detection_num_images_after_verification,
+          options_.loop_detection_max_num_features,
+          {image_ids[period_begin]},
+          /*order_by_overlap=*/false,
+          this,
+          &cache_,
+          &visual_index,
+          &matcher_);
+    }
+  }
+
   const SequentialMatchingOptions options_;
   const SiftMatchingOptions matching_options_;
   Database database_;
   FeatureMatcherCache cache_;
   FeatureMatcherController matcher_;
+  bool loop_detection_finished_ = false;
 };
 
 }  // namespace
@@ -445,6 +774,7 @@ bool SequentialMatchingOptions::Check() const {
   CHECK_OPTION_GT(loop_detection_num_images, 0);
   CHECK_OPTION_GT(loop_detection_num_nearest_neighbors, 0);
   CHECK_OPTION_GT(loop_detection_num_checks, 0);
+  CHECK_OPTION_GE(loop_detection_nms_radius, 0);
   return true;
 }
 
@@ -524,7 +854,7 @@ class VocabTreeFeatureMatcher : public Thread {
     }
 
     // Index all images in the visual index.
-    IndexImagesInVisualIndex(matching_options_.num_threads,
+    IndexImagesInVisualIndex(matching_options_,
                              options_.num_checks,
                              options_.max_num_features,
                              all_image_ids,
@@ -537,14 +867,18 @@ class VocabTreeFeatureMatcher : public Thread {
       return;
     }
 
+    // Compute the TF-IDF weights, etc.
+    visual_index.Prepare();
+
     // Match all images in the visual index.
-    MatchNearestNeighborsInVisualIndex(matching_options_.num_threads,
+    MatchNearestNeighborsInVisualIndex(matching_options_,
                                        options_.num_images,
                                        options_.num_nearest_neighbors,
                                        options_.num_checks,
                                        options_.num_images_after_verification,
                                        options_.max_num_features,
                                        image_ids,
+                                       /*order_by_overlap=*/true,
                                        this,
                                        &cache_,
                                        &visual_index,
@@ -628,7 +962,10 @@ class SpatialFeatureMatcher : public Thread {
     std::vector<size_t> location_idxs;
     location_idxs.reserve(image_ids.size());
 
-    std::vector<Eigen::Vector3d> ells(1);
+    // The GPS locations are converted in one batch after the loop.
+    std::vector<size_t> gps_location_idxs;
+    gps_location_idxs.reserve(image_ids.size());
+    Eigen::ArrayX3d gps_ells(image_ids.size(), 3);
 
     for (size_t i = 0; i < image_ids.size(); ++i) {
       const auto image_id = image_ids[i];
@@ -646,15 +983,9 @@ class SpatialFeatureMatcher : public Thread {
       location_idxs.push_back(i);
 
       if (options_.is_gps) {
-        ells[0](0) = translation_prior(0);
-        ells[0](1) = translation_prior(1);
-        ells[0](2) = options_.ignore_z ? 0 : translation_prior(2);
-
-        const auto xyzs = gps_transform.EllToXYZ(ells);
-
-        location_matrix(num_locations, 0) = static_cast<float>(xyzs[0](0));
-        location_matrix(num_locations, 1) = static_cast<float>(xyzs[0](1));
-        location_matrix(num_locations, 2) = static_cast<float>(xyzs[0](2));
+        gps_ells.row(gps_location_idxs.size()) << translation_prior(0),
+            translation_prior(1), options_.ignore_z ? 0 : translation_prior(2);
+        gps_location_idxs.push_back(num_locations);
       } else {
         const bool has_rotation_prior = image.CamFromWorldPrior()
                                             .rotation.coeffs()
@@ -676,6 +1007,16 @@ class SpatialFeatureMatcher : public Thread {
       num_locations += 1;
     }
 
+    if (!gps_location_idxs.empty()) {
+      Eigen::ArrayX3d xyzs;
+      gps_transform.EllToXYZ(gps_ells.topRows(gps_location_idxs.size()),
+                             &xyzs);
+      for (size_t i = 0; i < gps_location_idxs.size(); ++i) {
+        location_matrix.row(gps_location_idxs[i]) =
+            xyzs.row(i).matrix().cast<float>();
+      }
+    }
+
     PrintElapsedTime(timer);
 
     if (num_locations == 0) {
@@ -775,11 +1116,14 @@ class SpatialFeatureMatcher : public Thread {
       }
 
       DatabaseTransaction database_transaction(&database_);
-      matcher_.Match(image_pairs);
+      matcher_.MatchAsync(image_pairs);
 
       PrintElapsedTime(timer);
     }
 
+    DatabaseTransaction database_transaction(&database_);
+    matcher_.Wait();
+
     GetTimer().PrintMinutes();
   }
 
@@ -809,6 +1153,556 @@ std::unique_ptr<Thread> CreateSpatialFeatureMatcher(
 
 namespace {
 
+// Area of the intersection of two disks relative to the area of the smaller
+// disk.
+double ComputeRelativeDiskOverlap(const double radius1,
+                                  const double radius2,
+                                  const double distance) {
+  const double min_radius = std::min(radius1, radius2);
+  if (min_radius <= 0 || distance >= radius1 + radius2) {
+    return 0;
+  } else if (distance <= std::abs(radius1 - radius2)) {
+    return 1;
+  }
+
+  const double radius1_sq = radius1 * radius1;
+  const double radius2_sq = radius2 * radius2;
+  const double distance_sq = distance * distance;
+  const double area =
+      radius1_sq * std::acos(std::min(
+                       1.0,
+                       std::max(-1.0,
+                                (distance_sq + radius1_sq - radius2_sq) /
+                                    (2 * distance * radius1)))) +
+      radius2_sq * std::acos(std::min(
+                       1.0,
+                       std::max(-1.0,
+                                (distance_sq + radius2_sq - radius1_sq) /
+                                    (2 * distance * radius2)))) -
+      0.5 * std::sqrt(std::max(0.0,
+                               (-distance + radius1 + radius2) *
+                                   (distance + radius1 - radius2) *
+                                   (distance - radius1 + radius2) *
+                                   (distance + radius1 + radius2)));
+  return std::min(1.0, area / (M_PI * min_radius * min_radius));
+}
+
+class PosePriorFeatureMatcher : public Thread {
+ public:
+  PosePriorFeatureMatcher(const PosePriorMatchingOptions& options,
+                          const SiftMatchingOptions& matching_options,
+                          const TwoViewGeometryOptions& geometry_options,
+                          const std::string& database_path)
+      : options_(options),
+        matching_options_(matching_options),
+        database_(database_path),
+        cache_(5 * options_.max_num_neighbors,
+               &database_,
+               geometry_options.enable_refraction),
+        matcher_(matching_options, geometry_options, &database_, &cache_) {
+    CHECK(options.Check());
+    CHECK(matching_options.Check());
+    CHECK(geometry_options.Check());
+  }
+
+ private:
+  void Run() override {
+    PrintHeading1("Pose prior feature matching");
+
+    if (!matcher_.Setup()) {
+      return;
+    }
+
+    cache_.Setup();
+
+    const std::vector<image_t> image_ids = cache_.GetImageIds();
+
+    //////////////////////////////////////////////////////////////////////////////
+    // Footprint prediction
+    //////////////////////////////////////////////////////////////////////////////
+
+    Timer timer;
+    timer.Start();
+
+    LOG(INFO) << "Predicting image footprints..." << std::flush;
+
+    std::vector<image_t> footprint_image_ids;
+    footprint_image_ids.reserve(image_ids.size());
+    Eigen::Matrix<float, Eigen::Dynamic, 3, Eigen::RowMajor> footprint_centers(
+        image_ids.size(), 3);
+    std::vector<double> footprint_radii;
+    footprint_radii.reserve(image_ids.size());
+
+    for (const image_t image_id : image_ids) {
+      const Image& image = cache_.GetImage(image_id);
+      const Rigid3d& cam_from_world_prior = image.CamFromWorldPrior();
+      if (!cam_from_world_prior.rotation.coeffs().array().isFinite().all() ||
+          !cam_from_world_prior.translation.array().isFinite().all()) {
+        continue;
+      }
+
+      const Rigid3d world_from_cam = Inverse(cam_from_world_prior);
+      const Eigen::Vector3d footprint_center =
+          world_from_cam * Eigen::Vector3d(0, 0, options_.altitude);
+
+      // The footprint radius is given by the ray through the image corner,
+      // which is furthest from the principal point.
+      const Camera& camera = cache_.GetCamera(image.CameraId());
+      double max_tan_half_fov = 0;
+      const double width = static_cast<double>(camera.width);
+      const double height = static_cast<double>(camera.height);
+      for (const Eigen::Vector2d& corner : {Eigen::Vector2d(0, 0),
+                                            Eigen::Vector2d(width, 0),
+                                            Eigen::Vector2d(0, height),
+                                            Eigen::Vector2d(width, height)}) {
+        max_tan_half_fov =
+            std::max(max_tan_half_fov, camera.CamFromImg(corner).norm());
+      }
+
+      footprint_centers.row(footprint_image_ids.size()) =
+          footprint_center.cast<float>();
+      footprint_radii.push_back(options_.altitude * max_tan_half_fov);
+      footprint_image_ids.push_back(image_id);
+    }
+
+    PrintElapsedTime(timer);
+
+    const size_t num_footprints = footprint_image_ids.size();
+    if (num_footprints == 0) {
+      LOG(INFO) << "=> No images with pose priors.";
+      GetTimer().PrintMinutes();
+      return;
+    }
+
+    //////////////////////////////////////////////////////////////////////////////
+    // Searching spatial index
+    //////////////////////////////////////////////////////////////////////////////
+
+    timer.Restart();
+
+    LOG(INFO) << "Searching for overlapping footprints..." << std::flush;
+
+    flann::Matrix<float> centers(
+        footprint_centers.data(), num_footprints, footprint_centers.cols());
+    flann::Index<flann::L2<float>> search_index(
+        centers, flann::KDTreeSingleIndexParams());
+    search_index.buildIndex();
+
+    const int knn = std::min<int>(options_.max_num_neighbors + 1,
+                                  static_cast<int>(num_footprints));
+
+    Eigen::Matrix<size_t, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>
+        index_matrix(num_footprints, knn);
+    flann::Matrix<size_t> indices(index_matrix.data(), num_footprints, knn);
+
+    Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>
+        distance_matrix(num_footprints, knn);
+    flann::Matrix<float> distances(distance_matrix.data(), num_footprints, knn);
+
+    flann::SearchParams search_params;
+    search_params.cores =
+        GetEffectiveNumThreads(matching_options_.num_threads);
+
+    search_index.knnSearch(centers, indices, distances, knn, search_params);
+
+    PrintElapsedTime(timer);
+
+    //////////////////////////////////////////////////////////////////////////////
+    // Matching
+    //////////////////////////////////////////////////////////////////////////////
+
+    std::vector<std::pair<image_t, image_t>> image_pairs;
+    image_pairs.reserve(knn);
+
+    size_t num_pairs = 0;
+    for (size_t i = 0; i < num_footprints; ++i) {
+      if (IsStopped()) {
+        GetTimer().PrintMinutes();
+        return;
+      }
+
+      timer.Restart();
+
+      LOG(INFO) << StringPrintf("Matching image [%d/%d]", i + 1, num_footprints)
+                << std::flush;
+
+      image_pairs.clear();
+
+      for (int j = 0; j < knn; ++j) {
+        const size_t nn_idx = index_matrix(i, j);
+        if (nn_idx == i) {
+          continue;
+        }
+
+        const double overlap = ComputeRelativeDiskOverlap(
+            footprint_radii[i],
+            footprint_radii[nn_idx],
+            std::sqrt(static_cast<double>(distance_matrix(i, j))));
+
+        // The footprints differ in size, so the overlap does not decrease
+        // monotonically with the distance and all neighbors are checked.
+        if (overlap < options_.min_overlap) {
+          continue;
+        }
+
+        image_pairs.emplace_back(footprint_image_ids[i],
+                                 footprint_image_ids[nn_idx]);
+      }
+
+      num_pairs += image_pairs.size();
+
+      DatabaseTransaction database_transaction(&database_);
+      matcher_.MatchAsync(image_pairs);
+
+      PrintElapsedTime(timer);
+    }
+
+    DatabaseTransaction database_transaction(&database_);
+    matcher_.Wait();
+
+    LOG(INFO) << StringPrintf("Matched %d candidate pairs", num_pairs);
+
+    GetTimer().PrintMinutes();
+  }
+
+  const PosePriorMatchingOptions options_;
+  const SiftMatchingOptions matching_options_;
+  Database database_;
+  FeatureMatcherCache cache_;
+  FeatureMatcherController matcher_;
+};
+
+}  // namespace
+
+bool PosePriorMatchingOptions::Check() const {
+  CHECK_OPTION_GT(altitude, 0.0);
+  CHECK_OPTION_GE(min_overlap, 0.0);
+  CHECK_OPTION_LE(min_overlap, 1.0);
+  CHECK_OPTION_GT(max_num_neighbors, 0);
+  return true;
+}
+
+std::unique_ptr<Thread> CreatePosePriorFeatureMatcher(
+    const PosePriorMatchingOptions& options,
+    const SiftMatchingOptions& matching_options,
+    const TwoViewGeometryOptions& geometry_options,
+    const std::string& database_path) {
+  return std::make_unique<PosePriorFeatureMatcher>(
+      options, matching_options, geometry_options, database_path);
+}
+
+namespace {
+
+class RigFeatureMatcher : public Thread {
+ public:
+  RigFeatureMatcher(const RigMatchingOptions& options,
+                    const SiftMatchingOptions& matching_options,
+                    const TwoViewGeometryOptions& geometry_options,
+                    const std::string& database_path)
+      : options_(options),
+        matching_options_(matching_options),
+        database_(database_path),
+        // Hold the images of the overlapping snapshots of rigs with a few
+        // cameras to avoid reading their features repeatedly.
+        cache_(20 * (options_.overlap + 1),
+               &database_,
+               geometry_options.enable_refraction),
+        matcher_(matching_options, geometry_options, &database_, &cache_) {
+    CHECK(options.Check());
+    CHECK(matching_options.Check());
+    CHECK(geometry_options.Check());
+  }
+
+ private:
+  void Run() override {
+    PrintHeading1("Rig feature matching");
+
+    if (!matcher_.Setup()) {
+      return;
+    }
+
+    cache_.Setup();
+
+    const std::vector<image_t> image_ids = cache_.GetImageIds();
+    std::vector<Image> images;
+    images.reserve(image_ids.size());
+    std::unordered_map<image_t, camera_t> image_camera_ids;
+    image_camera_ids.reserve(image_ids.size());
+    for (const image_t image_id : image_ids) {
+      images.push_back(cache_.GetImage(image_id));
+      image_camera_ids.emplace(image_id, images.back().CameraId());
+    }
+
+    bool has_cams_from_rigs = false;
+    const std::vector<CameraRig> camera_rigs = ReadCameraRigConfig(
+        options_.rig_config_path, images, &has_cams_from_rigs);
+
+    const bool verify_with_rig_poses =
+        options_.verify_with_rig_poses && has_cams_from_rigs;
+    if (options_.verify_with_rig_poses && !has_cams_from_rigs) {
+      LOG(WARNING) << "The rig configuration does not provide all relative "
+                      "poses; estimating the two-view geometry instead";
+    }
+
+    std::unordered_set<camera_t> inter_snapshot_camera_ids;
+    for (const int camera_id :
+         CSVToVector<int>(options_.inter_snapshot_camera_ids)) {
+      inter_snapshot_camera_ids.insert(camera_id);
+    }
+
+    std::vector<std::pair<image_t, image_t>> intra_snapshot_pairs;
+    std::vector<std::pair<image_t, image_t>> inter_snapshot_pairs;
+    std::vector<Rigid3d> cams2_from_cams1;
+
+    size_t num_intra_snapshot_pairs = 0;
+    size_t num_inter_snapshot_pairs = 0;
+    for (size_t rig_idx = 0; rig_idx < camera_rigs.size(); ++rig_idx) {
+      const CameraRig& camera_rig = camera_rigs[rig_idx];
+      for (size_t snapshot_idx = 0; snapshot_idx < camera_rig.NumSnapshots();
+           ++snapshot_idx) {
+        if (IsStopped()) {
+          GetTimer().PrintMinutes();
+          return;
+        }
+
+        Timer timer;
+        timer.Start();
+
+        LOG(INFO) << StringPrintf("Matching rig %d snapshot [%d/%d]",
+                                  rig_idx + 1,
+                                  snapshot_idx + 1,
+                                  camera_rig.NumSnapshots())
+                  << std::flush;
+
+        GenerateCameraRigImagePairs(camera_rig,
+                                    snapshot_idx,
+                                    image_camera_ids,
+                                    options_.overlap,
+                                    options_.quadratic_overlap,
+                                    inter_snapshot_camera_ids,
+                                    options_.inter_snapshot_cross_camera,
+                                    &intra_snapshot_pairs,
+                                    &inter_snapshot_pairs);
+
+        num_intra_snapshot_pairs += intra_snapshot_pairs.size();
+        num_inter_snapshot_pairs += inter_snapshot_pairs.size();
+
+        DatabaseTransaction database_transaction(&database_);
+        if (verify_with_rig_poses) {
+          cams2_from_cams1.clear();
+          for (const auto& image_pair : intra_snapshot_pairs) {
+            cams2_from_cams1.push_back(camera_rig.Cam2FromCam1(
+                image_camera_ids.at(image_pair.first),
+                image_camera_ids.at(image_pair.second)));
+          }
+          matcher_.MatchAsync(intra_snapshot_pairs, cams2_from_cams1);
+        } else {
+          matcher_.MatchAsync(intra_snapshot_pairs);
+        }
+        matcher_.MatchAsync(inter_snapshot_pairs);
+
+        PrintElapsedTime(timer);
+      }
+    }
+
+    DatabaseTransaction database_transaction(&database_);
+    matcher_.Wait();
+
+    LOG(INFO) << StringPrintf("Matched %d intra-snapshot and %d inter-snapshot "
+                              "pairs",
+                              num_intra_snapshot_pairs,
+                              num_inter_snapshot_pairs);
+
+    GetTimer().PrintMinutes();
+  }
+
+  const RigMatchingOptions options_;
+  const SiftMatchingOptions matching_options_;
+  Database database_;
+  FeatureMatcherCache cache_;
+  FeatureMatcherController matcher_;
+};
+
+}  // namespace
+
+bool RigMatchingOptions::Check() const {
+  CHECK_OPTION_GE(overlap, 0);
+  return true;
+}
+
+std::unique_ptr<Thread> CreateRigFeatureMatcher(
+    const RigMatchingOptions& options,
+    const SiftMatchingOptions& matching_options,
+    const TwoViewGeometryOptions& geometry_options,
+    const std::string& database_path) {
+  return std::make_unique<RigFeatureMatcher>(
+      options, matching_options, geometry_options, database_path);
+}
+
+namespace {
+
+// A transitive candidate pair, which is not yet matched but connected through
+// at least one common neighbor in the matching graph.
+struct TransitiveCandidate {
+  image_t image_id1 = kInvalidImageId;
+  image_t image_id2 = kInvalidImageId;
+  // The sum over all common neighbors of the minimum number of inliers of the
+  // two pairs through the neighbor.
+  int64_t score = 0;
+};
+
+// Adjacency of the matching graph in compressed sparse row format, where the
+// neighbors of every image are sorted by their index.
+class TransitiveAdjacency {
+ public:
+  TransitiveAdjacency(const std::vector<image_t>& image_ids,
+                      const std::vector<std::pair<image_t, image_t>>& pairs,
+                      const std::vector<int>& num_inliers,
+                      ThreadPool* thread_pool)
+      : image_ids_(image_ids), offsets_(image_ids.size() + 1, 0) {
+    std::unordered_map<image_t, uint32_t> image_idxs;
+    image_idxs.reserve(image_ids_.size());
+    for (size_t i = 0; i < image_ids_.size(); ++i) {
+      image_idxs.emplace(image_ids_[i], static_cast<uint32_t>(i));
+    }
+
+    std::vector<std::pair<uint32_t, uint32_t>> edges;
+    edges.reserve(pairs.size());
+    for (const auto& pair : pairs) {
+      const auto idx1 = image_idxs.find(pair.first);
+      const auto idx2 = image_idxs.find(pair.second);
+      if (idx1 != image_idxs.end() && idx2 != image_idxs.end()) {
+        edges.emplace_back(idx1->second, idx2->second);
+        offsets_[idx1->second + 1] += 1;
+        offsets_[idx2->second + 1] += 1;
+      } else {
+        edges.emplace_back(kInvalidIdx, kInvalidIdx);
+      }
+    }
+
+    std::partial_sum(offsets_.begin(), offsets_.end(), offsets_.begin());
+
+    neighbors_.resize(offsets_.back());
+    neighbor_num_inliers_.resize(offsets_.back());
+    std::vector<size_t> fill_offsets(offsets_.begin(), offsets_.end() - 1);
+    for (size_t i = 0; i < edges.size(); ++i) {
+      const uint32_t idx1 = edges[i].first;
+      const uint32_t idx2 = edges[i].second;
+      if (idx1 == kInvalidIdx) {
+        continue;
+      }
+      neighbors_[fill_offsets[idx1]] = idx2;
+      neighbor_num_inliers_[fill_offsets[idx1]++] = num_inliers[i];
+      neighbors_[fill_offsets[idx2]] = idx1;
+      neighbor_num_inliers_[fill_offsets[idx2]++] = num_inliers[i];
+    }
+
+    // Sort the neighbors of every image for the adjacency lookups.
+    const int64_t kGrainSize = 64;
+    thread_pool->ParallelFor(
+        0, image_ids_.size(), kGrainSize, [&](const int64_t idx) {
+          const size_t begin = offsets_[idx];
+          const size_t end = offsets_[idx + 1];
+          std::vector<std::pair<uint32_t, int>> sorted_neighbors;
+          sorted_neighbors.reserve(end - begin);
+          for (size_t i = begin; i < end; ++i) {
+            sorted_neighbors.emplace_back(neighbors_[i],
+                                          neighbor_num_inliers_[i]);
+          }
+          std::sort(sorted_neighbors.begin(), sorted_neighbors.end());
+          for (size_t i = begin; i < end; ++i) {
+            neighbors_[i] = sorted_neighbors[i - begin].first;
+            neighbor_num_inliers_[i] = sorted_neighbors[i - begin].second;
+          }
+        });
+  }
+
+  // Enumerate all pairs of images that are connected through a common
+  // neighbor but not through an edge, in parallel for every image.
+  std::vector<TransitiveCandidate> FindCandidates(
+      ThreadPool* thread_pool) const {
+    const size_t num_images = image_ids_.size();
+
+    // Scratch space of every thread to accumulate the scores of the two-hop
+    // neighbors of an image.
+    struct Scratch {
+      std::vector<int64_t> scores;
+      std::vector<uint32_t> touched_idxs;
+    };
+    std::vector<Scratch> scratches(thread_pool->NumThreads());
+    for (auto& scratch : scratches) {
+      scratch.scores.resize(num_images, 0);
+    }
+
+    std::vector<std::vector<TransitiveCandidate>> image_candidates(num_images);
+
+    const auto find_image_candidates = [&](const int64_t idx1) {
+      Scratch& scratch = scratches[thread_pool->GetThreadIndex()];
+      for (size_t i = offsets_[idx1]; i < offsets_[idx1 + 1]; ++i) {
+        const uint32_t idx2 = neighbors_[i];
+        const int num_inliers12 = neighbor_num_inliers_[i];
+        for (size_t j = offsets_[idx2]; j < offsets_[idx2 + 1]; ++j) {
+          // Every unordered pair is only enumerated from its smaller index.
+          const uint32_t idx3 = neighbors_[j];
+          if (idx3 <= idx1) {
+            continue;
+          }
+          if (scratch.scores[idx3] == 0) {
+            scratch.touched_idxs.push_back(idx3);
+          }
+          scratch.scores[idx3] +=
+              std::max(1, std::min(num_inliers12, neighbor_num_inliers_[j]));
+        }
+      }
+
+      for (const uint32_t idx3 : scratch.touched_idxs) {
+        if (!HasEdge(idx1, idx3)) {
+          TransitiveCandidate candidate;
+          candidate.image_id1 = image_ids_[idx1];
+          candidate.image_id2 = image_ids_[idx3];
+          candidate.score = scratch.scores[idx3];
+          image_candidates[idx1].push_back(candidate);
+        }
+        scratch.scores[idx3] = 0;
+      }
+      scratch.touched_idxs.clear();
+    };
+
+    const int64_t kGrainSize = 16;
+    thread_pool->ParallelFor(0, num_images, kGrainSize, find_image_candidates);
+
+    size_t num_candidates = 0;
+    for (const auto& candidates : image_candidates) {
+      num_candidates += candidates.size();
+    }
+
+    std::vector<TransitiveCandidate> candidates;
+    candidates.reserve(num_candidates);
+    for (auto& candidates_of_image : image_candidates) {
+      candidates.insert(candidates.end(),
+                        candidates_of_image.begin(),
+                        candidates_of_image.end());
+      candidates_of_image = {};
+    }
+
+    return candidates;
+  }
+
+ private:
+  static constexpr uint32_t kInvalidIdx = std::numeric_limits<uint32_t>::max();
+
+  bool HasEdge(const uint32_t idx1, const uint32_t idx2) const {
+    return std::binary_search(neighbors_.begin() + offsets_[idx1],
+                              neighbors_.begin() + offsets_[idx1 + 1],
+                              idx2);
+  }
+
+  const std::vector<image_t>& image_ids_;
+  std::vector<size_t> offsets_;
+  std::vector<uint32_t> neighbors_;
+  std::vector<int> neighbor_num_inliers_;
+};
+
 class TransitiveFeatureMatcher : public Thread {
  public:
   TransitiveFeatureMatcher(const TransitiveMatchingOptions& options,
@@ -825,6 +1719,9 @@ class TransitiveFeatureMatcher : public Thread {
     CHECK(options.Check());
     CHECK(matching_options.Check());
     CHECK(geometry_options.Check());
+    // The transitive pairs depend on the matches of all shards.
+    CHECK_EQ(matching_options.num_shards, 1)
+        << "Transitive matching cannot be split into shards";
   }
 
  private:
@@ -839,8 +1736,14 @@ class TransitiveFeatureMatcher : public Thread {
 
     const std::vector<image_t> image_ids = cache_.GetImageIds();
 
+    ThreadPool thread_pool(
+        GetEffectiveNumThreads(matching_options_.num_threads));
+
+    // The candidates of previous iterations, which are not matched again even
+    // if their verification failed.
+    std::unordered_set<image_pair_t> tried_image_pair_ids;
+
     std::vector<std::pair<image_t, image_t>> image_pairs;
-    std::unordered_set<image_pair_t> image_pair_ids;
 
     for (int iteration = 0; iteration < options_.num_iterations; ++iteration) {
       if (IsStopped()) {
@@ -861,53 +1764,71 @@ class TransitiveFeatureMatcher : public Thread {
 
       CHECK_EQ(existing_image_pairs.size(), existing_num_inliers.size());
 
-      std::unordered_map<image_t, std::vector<image_t>> adjacency;
-      for (const auto& image_pair : existing_image_pairs) {
-        adjacency[image_pair.first].push_back(image_pair.second);
-        adjacency[image_pair.second].push_back(image_pair.first);
+      const TransitiveAdjacency adjacency(
+          image_ids, existing_image_pairs, existing_num_inliers, &thread_pool);
+      std::vector<TransitiveCandidate> candidates =
+          adjacency.FindCandidates(&thread_pool);
+
+      // Skip the candidates that were already tried and match the ones with
+      // the strongest connections through their common neighbors first.
+      candidates.erase(
+          std::remove_if(candidates.begin(),
+                         candidates.end(),
+                         [&](const TransitiveCandidate& candidate) {
+                           return !tried_image_pair_ids
+                                       .insert(Database::ImagePairToPairId(
+                                           candidate.image_id1,
+                                           candidate.image_id2))
+                                       .second;
+                         }),
+          candidates.end());
+      std::sort(candidates.begin(),
+                candidates.end(),
+                [](const TransitiveCandidate& candidate1,
+                   const TransitiveCandidate& candidate2) {
+                  return candidate1.score > candidate2.score;
+                });
+
+      LOG(INFO) << StringPrintf("  Found %d transitive candidates in %.3fs",
+                                candidates.size(),
+                                timer.ElapsedSeconds());
+
+      if (candidates.empty()) {
+        break;
       }
 
       const size_t batch_size = static_cast<size_t>(options_.batch_size);
+      const size_t num_batches =
+          (candidates.size() + batch_size - 1) / batch_size;
+      for (size_t batch_idx = 0; batch_idx < num_batches; ++batch_idx) {
+        if (IsStopped()) {
+          GetTimer().PrintMinutes();
+          return;
+        }
 
-      size_t num_batches = 0;
-      image_pairs.clear();
-      image_pair_ids.clear();
-      for (const auto& image : adjacency) {
-        const auto image_id1 = image.first;
-        for (const auto& image_id2 : image.second) {
-          if (adjacency.count(image_id2) > 0) {
-            for (const auto& image_id3 : adjacency.at(image_id2)) {
-              const auto image_pair_id =
-                  Database::ImagePairToPairId(image_id1, image_id3);
-              if (image_pair_ids.count(image_pair_id) == 0) {
-                image_pairs.emplace_back(image_id1, image_id3);
-                image_pair_ids.insert(image_pair_id);
-                if (image_pairs.size() >= batch_size) {
-                  num_batches += 1;
-                  LOG(INFO)
-                      << StringPrintf("  Batch %d", num_batches) << std::flush;
-                  DatabaseTransaction database_transaction(&database_);
-                  matcher_.Match(image_pairs);
-                  image_pairs.clear();
-                  PrintElapsedTime(timer);
-                  timer.Restart();
-
-                  if (IsStopped()) {
-                    GetTimer().PrintMinutes();
-                    return;
-                  }
-                }
-              }
-            }
-          }
+        timer.Restart();
+
+        LOG(INFO) << StringPrintf(
+                         "  Batch [%d/%d]", batch_idx + 1, num_batches)
+                  << std::flush;
+
+        image_pairs.clear();
+        const size_t begin = batch_idx * batch_size;
+        const size_t end = std::min(begin + batch_size, candidates.size());
+        for (size_t i = begin; i < end; ++i) {
+          image_pairs.emplace_back(candidates[i].image_id1,
+                                   candidates[i].image_id2);
         }
+
+        DatabaseTransaction database_transaction(&database_);
+        matcher_.MatchAsync(image_pairs);
+
+        PrintElapsedTime(timer);
       }
 
-      num_batches += 1;
-      LOG(INFO) << StringPrintf("  Batch %d", num_batches) << std::flush;
+      // The next iteration reads the written matches.
       DatabaseTransaction database_transaction(&database_);
-      matcher_.Match(image_pairs);
-      PrintElapsedTime(timer);
+      matcher_.Wait();
     }
 
     GetTimer().PrintMinutes();
@@ -1052,11 +1973,14 @@ class ImagePairsFeatureMatcher : public Thread {
       }
 
       DatabaseTransaction database_transaction(&database_);
-      matcher_.Match(block_image_pairs);
+      matcher_.MatchAsync(block_image_pairs);
 
       PrintElapsedTime(timer);
     }
 
+    DatabaseTransaction database_transaction(&database_);
+    matcher_.Wait();
+
     GetTimer().PrintMinutes();
   }
 
@@ -1104,6 +2028,18 @@ class FeaturePairsFeatureMatcher : public Thread {
  private:
   const static size_t kCacheSize = 100;
 
+  // The maximum number of image pairs whose matches are verified in parallel
+  // and written to the database in a single transaction.
+  const static size_t kMaxNumPairsPerTransaction = 1000;
+
+  struct ImagePairData {
+    image_t image_id1 = kInvalidImageId;
+    image_t image_id2 = kInvalidImageId;
+    FeatureMatches matches;
+    // Only valid if the matches are verified.
+    std::future<TwoViewGeometry> two_view_geometry;
+  };
+
   void Run() override {
     PrintHeading1("Importing matches");
 
@@ -1119,108 +2055,142 @@ class FeaturePairsFeatureMatcher : public Thread {
     std::ifstream file(options_.match_list_path);
     CHECK(file.is_open()) << options_.match_list_path;
 
-    std::string line;
-    while (std::getline(file, line)) {
+    ThreadPool thread_pool(matching_options_.num_threads);
+
+    bool finished = false;
+    while (!finished) {
       if (IsStopped()) {
         GetTimer().PrintMinutes();
         return;
       }
 
-      StringTrim(&line);
-      if (line.empty()) {
-        continue;
-      }
-
-      std::istringstream line_stream(line);
-
-      std::string image_name1, image_name2;
-      try {
-        line_stream >> image_name1 >> image_name2;
-      } catch (...) {
-        LOG(ERROR) << "Could not read image pair.";
-        break;
-      }
-
-      LOG(INFO) << StringPrintf(
-          "%s - %s", image_name1.c_str(), image_name2.c_str());
-
-      if (image_name_to_image.count(image_name1) == 0) {
-        LOG(INFO) << StringPrintf("SKIP: Image %s not found in database.",
-                                  image_name1.c_str());
-        break;
-      }
-      if (image_name_to_image.count(image_name2) == 0) {
-        LOG(INFO) << StringPrintf("SKIP: Image %s not found in database.",
-                                  image_name2.c_str());
-        break;
-      }
-
-      const Image& image1 = *image_name_to_image[image_name1];
-      const Image& image2 = *image_name_to_image[image_name2];
-
-      bool skip_pair = false;
-      if (database_.ExistsInlierMatches(image1.ImageId(), image2.ImageId())) {
-        LOG(INFO) << "SKIP: Matches for image pair already exist in database.";
-        skip_pair = true;
-      }
+      std::vector<ImagePairData> batch;
+      std::string line;
+      while (batch.size() < kMaxNumPairsPerTransaction) {
+        if (!std::getline(file, line)) {
+          finished = true;
+          break;
+        }
 
-      FeatureMatches matches;
-      while (std::getline(file, line)) {
         StringTrim(&line);
-
         if (line.empty()) {
-          break;
+          continue;
         }
 
         std::istringstream line_stream(line);
 
-        FeatureMatch match;
+        std::string image_name1, image_name2;
         try {
-          line_stream >> match.point2D_idx1 >> match.point2D_idx2;
+          line_stream >> image_name1 >> image_name2;
         } catch (...) {
-          LOG(ERROR) << "Cannot read feature matches.";
+          LOG(ERROR) << "Could not read image pair.";
+          finished = true;
           break;
         }
 
-        matches.push_back(match);
-      }
+        LOG(INFO) << StringPrintf(
+            "%s - %s", image_name1.c_str(), image_name2.c_str());
 
-      if (skip_pair) {
-        continue;
-      }
+        if (image_name_to_image.count(image_name1) == 0) {
+          LOG(INFO) << StringPrintf("SKIP: Image %s not found in database.",
+                                    image_name1.c_str());
+          finished = true;
+          break;
+        }
+        if (image_name_to_image.count(image_name2) == 0) {
+          LOG(INFO) << StringPrintf("SKIP: Image %s not found in database.",
+                                    image_name2.c_str());
+          finished = true;
+          break;
+        }
 
-      const Camera& camera1 = cache_.GetCamera(image1.CameraId());
-      const Camera& camera2 = cache_.GetCamera(image2.CameraId());
+        const Image& image1 = *image_name_to_image[image_name1];
+        const Image& image2 = *image_name_to_image[image_name2];
 
-      if (options_.verify_matches) {
-        database_.WriteMatches(image1.ImageId(), image2.ImageId(), matches);
+        bool skip_pair = false;
+        if (database_.ExistsInlierMatches(image1.ImageId(),
+                                          image2.ImageId())) {
+          LOG(INFO)
+              << "SKIP: Matches for image pair already exist in database.";
+          skip_pair = true;
+        }
 
-        const auto keypoints1 = cache_.GetKeypoints(image1.ImageId());
-        const auto keypoints2 = cache_.GetKeypoints(image2.ImageId());
+        FeatureMatches matches;
+        while (std::getline(file, line)) {
+          StringTrim(&line);
 
-        TwoViewGeometry two_view_geometry =
-            EstimateTwoViewGeometry(camera1,
-                                    FeatureKeypointsToPointsVector(*keypoints1),
-                                    camera2,
-                                    FeatureKeypointsToPointsVector(*keypoints2),
-                                    matches,
-                                    geometry_options_);
+          if (line.empty()) {
+            break;
+          }
 
-        database_.WriteTwoViewGeometry(
-            image1.ImageId(), image2.ImageId(), two_view_geometry);
-      } else {
-        TwoViewGeometry two_view_geometry;
+          std::istringstream line_stream(line);
 
-        if (camera1.has_prior_focal_length && camera2.has_prior_focal_length) {
-          two_view_geometry.config = TwoViewGeometry::CALIBRATED;
-        } else {
-          two_view_geometry.config = TwoViewGeometry::UNCALIBRATED;
+          FeatureMatch match;
+          try {
+            line_stream >> match.point2D_idx1 >> match.point2D_idx2;
+          } catch (...) {
+            LOG(ERROR) << "Cannot read feature matches.";
+            break;
+          }
+
+          matches.push_back(match);
         }
 
-        two_view_geometry.inlier_matches = matches;
+        if (skip_pair) {
+          continue;
+        }
+
+        batch.emplace_back();
+        ImagePairData& data = batch.back();
+        data.image_id1 = image1.ImageId();
+        data.image_id2 = image2.ImageId();
+
+        if (options_.verify_matches) {
+          const Camera* camera1 = &cache_.GetCamera(image1.CameraId());
+          const Camera* camera2 = &cache_.GetCamera(image2.CameraId());
+          const auto keypoints1 = cache_.GetKeypoints(image1.ImageId());
+          const auto keypoints2 = cache_.GetKeypoints(image2.ImageId());
+          data.two_view_geometry = thread_pool.AddTask(
+              [this, camera1, camera2, keypoints1, keypoints2, matches]() {
+                return EstimateTwoViewGeometry(
+                    *camera1,
+                    FeatureKeypointsToPointsVector(*keypoints1),
+                    *camera2,
+                    FeatureKeypointsToPointsVector(*keypoints2),
+                    matches,
+                    geometry_options_);
+              });
+        }
+
+        data.matches = std::move(matches);
+      }
 
-        database_.WriteTwoViewGeometry(
-            image1.ImageId(), image2.ImageId(), two_view_geometry);
+      DatabaseTransaction database_transaction(&database_);
+      for (auto& data : batch) {
+        if (options_.verify_matches) {
+          database_.WriteMatches(data.image_id1, data.image_id2, data.matches);
+          database_.WriteTwoViewGeometry(
+              data.image_id1, data.image_id2, data.two_view_geometry.get());
+        } else {
+          const Camera& camera1 =
+              cache_.GetCamera(cache_.GetImage(data.image_id1).CameraId());
+          const Camera& camera2 =
+              cache_.GetCamera(cache_.GetImage(data.image_id2).CameraId());
+
+          TwoViewGeometry two_view_geometry;
+
+          if (camera1.has_prior_focal_length &&
+              camera2.has_prior_focal_length) {
+            two_view_geometry.config = TwoViewGeometry::CALIBRATED;
+          } else {
+            two_view_geometry.config = TwoViewGeometry::UNCALIBRATED;
+          }
+
+          two_view_geometry.inlier_matches = std::move(data.matches);
+
+          database_.WriteTwoViewGeometry(
+              data.image_id1, data.image_id2, two_view_geometry);
+        }
       }
     }
 
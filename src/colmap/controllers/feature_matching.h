@@ -86,6 +86,27 @@ struct SequentialMatchingOptions {
   // Loop detection is invoked every `loop_detection_period` images.
   int loop_detection_period = 10;
 
+  // Whether to detect loops online, i.e., to index the images incrementally
+  // in their sequential order and to retrieve only previously indexed images,
+  // as when the images arrive during acquisition.
+  bool loop_detection_online = false;
+
+  // Whether to detect loops in a background thread ahead of the sequential
+  // matching, such that the loop candidates are matched in between the
+  // sequential image pairs as soon as they are retrieved. The candidates are
+  // deduplicated by temporal non-maximum suppression. Only applies to offline
+  // loop detection.
+  bool loop_detection_background = false;
+
+  // Radius in sequential images of the temporal non-maximum suppression in
+  // background loop detection. A loop candidate is suppressed if an already
+  // detected loop connects images within this radius of both its images,
+  // since nearby query images usually retrieve the same revisited section.
+  // Suppression across query images requires a radius of at least
+  // `loop_detection_period`. Candidates within the sequential overlap are
+  // always dropped. Set to 0 to only drop exact duplicates.
+  int loop_detection_nms_radius = 5;
+
   // The number of images to retrieve in loop detection. This number should
   // be significantly bigger than the sequential matching overlap.
   int loop_detection_num_images = 50;
@@ -194,6 +215,74 @@ std::unique_ptr<Thread> CreateSpatialFeatureMatcher(
     const TwoViewGeometryOptions& geometry_options,
     const std::string& database_path);
 
+struct PosePriorMatchingOptions {
+  // The distance of the cameras to the scene along their optical axes in the
+  // unit of the pose priors, e.g., the altitude of an underwater vehicle above
+  // the seabed.
+  double altitude = 2.0;
+
+  // The minimum predicted overlap of the image footprints in the scene,
+  // relative to the area of the smaller footprint.
+  double min_overlap = 0.1;
+
+  // The maximum number of images with the closest footprints to match.
+  int max_num_neighbors = 50;
+
+  bool Check() const;
+};
+
+// Match images with overlapping predicted view frustums, e.g., the adjacent
+// tracks of a lawnmower survey. The footprint of an image is approximated as
+// a disk around the point at the given altitude along its optical axis, whose
+// radius is given by the field of view of the camera. The candidates are
+// found with a k-d tree over the footprint centers, so that only images with
+// both a position and orientation prior are matched.
+std::unique_ptr<Thread> CreatePosePriorFeatureMatcher(
+    const PosePriorMatchingOptions& options,
+    const SiftMatchingOptions& matching_options,
+    const TwoViewGeometryOptions& geometry_options,
+    const std::string& database_path);
+
+struct RigMatchingOptions {
+  // Path to the JSON configuration of the camera rigs, which assigns the images
+  // to the cameras and snapshots of the rigs, see `ReadCameraRigConfig`.
+  std::string rig_config_path = "";
+
+  // Number of subsequent snapshots to be matched.
+  int overlap = 10;
+
+  // Whether to match snapshots in quadratic overlap.
+  bool quadratic_overlap = true;
+
+  // Whether to verify the image pairs within a snapshot with the known
+  // relative poses of the cameras instead of estimating their two-view
+  // geometry. Only used if the rig configuration provides all relative poses.
+  bool verify_with_rig_poses = true;
+
+  // Comma-separated list of the cameras whose images are matched between
+  // snapshots, e.g., the forward-looking cameras of the rig. All cameras are
+  // matched between snapshots if empty.
+  std::string inter_snapshot_camera_ids = "";
+
+  // Whether to match the images of different cameras between snapshots,
+  // otherwise only the images of the same camera are matched.
+  bool inter_snapshot_cross_camera = false;
+
+  bool Check() const;
+};
+
+// Match the images of multi-camera rigs, whose snapshots are ordered by the
+// names of their images. The images within a snapshot are matched once, as
+// they are captured simultaneously, and the images of the designated cameras
+// are matched with the subsequent snapshots as in sequential matching, see
+// `GenerateCameraRigImagePairs`. Images that are not part of any snapshot of
+// the rigs are not matched.
+std::unique_ptr<Thread> CreateRigFeatureMatcher(
+    const RigMatchingOptions& options,
+    const SiftMatchingOptions& matching_options,
+    const TwoViewGeometryOptions& geometry_options,
+    const std::string& database_path);
+
 struct TransitiveMatchingOptions {
   // The maximum number of image pairs to process in one batch.
   int batch_size = 1000;
@@ -249,7 +338,9 @@ struct FeaturePairsMatchingOptions {
   bool Check() const;
 };
 
-// Import feature matches from a text file.
+// Import feature matches from a text file. The matches are verified in parallel
+// with `SiftMatchingOptions::num_threads` threads and the matches of many image
+// pairs are written to the database in a single transaction.
 //
 // Read matches file with the following format:
 //
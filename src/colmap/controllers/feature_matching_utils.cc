@@ -33,6 +33,7 @@
 #include "colmap/feature/utils.h"
 #include "colmap/util/cuda.h"
 #include "colmap/util/misc.h"
+#include "colmap/util/tracing.h"
 
 #include <fstream>
 #include <numeric>
@@ -44,10 +45,9 @@ FeatureMatcherCache::FeatureMatcherCache(const size_t cache_size,
                                          const Database* database,
                                          const bool enable_refraction)
     : cache_size_(cache_size),
-      database_(database),
-      enable_refraction_(enable_refraction) {
-  CHECK_NOTNULL(database_);
-}
+      database_(CHECK_NOTNULL(database)),
+      database_readers_(std::make_unique<DatabaseReaderPool>(database)),
+      enable_refraction_(enable_refraction) {}
 
 void FeatureMatcherCache::Setup() {
   std::vector<Camera> cameras = database_->ReadAllCameras();
@@ -86,16 +86,75 @@ void FeatureMatcherCache::Setup() {
         return database_->ExistsDescriptors(image_id);
       });
 
+  descriptor_codes_cache_ =
+      std::make_unique<LRUCache<image_t, std::shared_ptr<FeatureDescriptors>>>(
+          cache_size_, [this](const image_t image_id) {
+            return std::make_shared<FeatureDescriptors>(
+                database_->ReadDescriptorCodes(image_id));
+          });
+
+  descriptor_codes_exists_cache_ = std::make_unique<LRUCache<image_t, bool>>(
+      images_cache_.size(), [this](const image_t image_id) {
+        return database_->ExistsDescriptorCodes(image_id);
+      });
+
+  if (database_->ExistsDescriptorCodebook()) {
+    descriptor_quantizer_ = std::make_shared<const ProductQuantizer>(
+        database_->ReadDescriptorCodebook());
+  }
+
   if (enable_refraction_) {
     // Hard coded distance as 5.0 meter to compute the best fit pinhole camera
     // model of the refractive camera.
     const double kApproxDepth = 5.0;
+    ReadBestFitNonRefracCameras(*database_);
     best_fit_cameras_.reserve(cameras_cache_.size());
     for (const auto& camera : cameras_cache_) {
       Camera best_fit = BestFitNonRefracCamera(
           CameraModelId::kOpenCV, camera.second, kApproxDepth);
       best_fit_cameras_.emplace(camera.first, std::move(best_fit));
     }
+    WriteBestFitNonRefracCameras(*database_);
+
+    // The cameras of a multi-camera rig often share the same housing and
+    // calibration, such that their virtual camera tables are only built once
+    // and shared between the cameras.
+    std::vector<const Camera*> table_cameras;
+    for (auto& camera : cameras_cache_) {
+      if (!camera.second.IsCameraRefractive()) {
+        continue;
+      }
+      for (const Camera* table_camera : table_cameras) {
+        if (table_camera->width == camera.second.width &&
+            table_camera->height == camera.second.height &&
+            table_camera->refrac_virtual_camera_table->IsValidFor(
+                camera.second.model_id,
+                camera.second.refrac_model_id,
+                camera.second.params,
+                camera.second.refrac_params)) {
+          camera.second.refrac_virtual_camera_table =
+              table_camera->refrac_virtual_camera_table;
+          break;
+        }
+      }
+      if (!camera.second.HasValidRefracVirtualCameraTable()) {
+        camera.second.BuildRefracVirtualCameraTable();
+        if (camera.second.HasValidRefracVirtualCameraTable()) {
+          table_cameras.push_back(&camera.second);
+        }
+      }
+    }
+
+    virtual_cameras_cache_ = std::make_unique<
+        LRUCache<image_t, std::shared_ptr<VirtualPinholeCameras>>>(
+        cache_size_, [this](const image_t image_id) {
+          const Camera& camera = GetCamera(GetImage(image_id).CameraId());
+          const std::vector<Eigen::Vector2d> points =
+              FeatureKeypointsToPointsVector(*GetKeypoints(image_id));
+          auto virtual_cameras = std::make_shared<VirtualPinholeCameras>();
+          camera.ComputeVirtuals(points, virtual_cameras.get());
+          return virtual_cameras;
+        });
   }
 }
 
@@ -109,18 +168,47 @@ const Image& FeatureMatcherCache::GetImage(const image_t image_id) const {
 
 std::shared_ptr<FeatureKeypoints> FeatureMatcherCache::GetKeypoints(
     const image_t image_id) {
-  std::lock_guard<std::mutex> lock(database_mutex_);
-  return keypoints_cache_->Get(image_id);
+  return GetCached<std::shared_ptr<FeatureKeypoints>>(
+      keypoints_cache_.get(),
+      image_id,
+      [image_id](const Database& database) {
+        return std::make_shared<FeatureKeypoints>(
+            database.ReadKeypoints(image_id));
+      },
+      "FeatureMatcherCache keypoints hits",
+      "FeatureMatcherCache keypoints misses");
 }
 
 std::shared_ptr<FeatureDescriptors> FeatureMatcherCache::GetDescriptors(
     const image_t image_id) {
-  std::lock_guard<std::mutex> lock(database_mutex_);
-  return descriptors_cache_->Get(image_id);
+  return GetCached<std::shared_ptr<FeatureDescriptors>>(
+      descriptors_cache_.get(),
+      image_id,
+      [image_id](const Database& database) {
+        return std::make_shared<FeatureDescriptors>(
+            database.ReadDescriptors(image_id));
+      },
+      "FeatureMatcherCache descriptors hits",
+      "FeatureMatcherCache descriptors misses");
+}
+
+std::shared_ptr<FeatureDescriptors> FeatureMatcherCache::GetDescriptorCodes(
+    const image_t image_id) {
+  return GetCached<std::shared_ptr<FeatureDescriptors>>(
+      descriptor_codes_cache_.get(),
+      image_id,
+      [image_id](const Database& database) {
+        return std::make_shared<FeatureDescriptors>(
+            database.ReadDescriptorCodes(image_id));
+      },
+      "FeatureMatcherCache descriptor codes hits",
+      "FeatureMatcherCache descriptor codes misses");
 }
 
 FeatureMatches FeatureMatcherCache::GetMatches(const image_t image_id1,
                                                const image_t image_id2) {
+  // The matches are read through the database itself, since they may have
+  // been written in its current transaction, which the readers do not see.
   std::lock_guard<std::mutex> lock(database_mutex_);
   return database_->ReadMatches(image_id1, image_id2);
 }
@@ -135,13 +223,41 @@ std::vector<image_t> FeatureMatcherCache::GetImageIds() const {
 }
 
 bool FeatureMatcherCache::ExistsKeypoints(const image_t image_id) {
-  std::lock_guard<std::mutex> lock(database_mutex_);
-  return keypoints_exists_cache_->Get(image_id);
+  return GetCached<bool>(
+      keypoints_exists_cache_.get(),
+      image_id,
+      [image_id](const Database& database) {
+        return database.ExistsKeypoints(image_id);
+      },
+      "FeatureMatcherCache keypoints exists hits",
+      "FeatureMatcherCache keypoints exists misses");
 }
 
 bool FeatureMatcherCache::ExistsDescriptors(const image_t image_id) {
-  std::lock_guard<std::mutex> lock(database_mutex_);
-  return descriptors_exists_cache_->Get(image_id);
+  return GetCached<bool>(
+      descriptors_exists_cache_.get(),
+      image_id,
+      [image_id](const Database& database) {
+        return database.ExistsDescriptors(image_id);
+      },
+      "FeatureMatcherCache descriptors exists hits",
+      "FeatureMatcherCache descriptors exists misses");
+}
+
+bool FeatureMatcherCache::ExistsDescriptorCodes(const image_t image_id) {
+  return GetCached<bool>(
+      descriptor_codes_exists_cache_.get(),
+      image_id,
+      [image_id](const Database& database) {
+        return database.ExistsDescriptorCodes(image_id);
+      },
+      "FeatureMatcherCache descriptor codes exists hits",
+      "FeatureMatcherCache descriptor codes exists misses");
+}
+
+std::shared_ptr<const ProductQuantizer>
+FeatureMatcherCache::GetDescriptorQuantizer() const {
+  return descriptor_quantizer_;
 }
 
 bool FeatureMatcherCache::ExistsMatches(const image_t image_id1,
@@ -187,12 +303,46 @@ const Camera& FeatureMatcherCache::GetBestFitCameras(camera_t camera_id) const {
   return best_fit_cameras_.at(camera_id);
 }
 
+std::shared_ptr<VirtualPinholeCameras> FeatureMatcherCache::GetVirtualCameras(
+    const image_t image_id) {
+  CHECK(enable_refraction_);
+  std::lock_guard<std::mutex> lock(virtual_cameras_mutex_);
+  return virtual_cameras_cache_->Get(image_id);
+}
+
+template <typename T>
+T FeatureMatcherCache::GetCached(
+    LRUCache<image_t, T>* cache,
+    const image_t image_id,
+    const std::function<T(const Database&)>& read_func,
+    const char* hits_counter_name,
+    const char* misses_counter_name) {
+  {
+    std::lock_guard<std::mutex> lock(database_mutex_);
+    if (cache->Exists(image_id)) {
+      COLMAP_METRIC_COUNTER(hits_counter_name, 1);
+      return cache->Get(image_id);
+    }
+    COLMAP_METRIC_COUNTER(misses_counter_name, 1);
+    if (database_readers_->IsShared()) {
+      return cache->Get(image_id);
+    }
+  }
+
+  // Concurrent misses of the same image may read it multiple times, which is
+  // cheaper than serializing all reads.
+  T value = read_func(database_readers_->Reader());
+  std::lock_guard<std::mutex> lock(database_mutex_);
+  cache->Set(image_id, value);
+  return value;
+}
+
 FeatureMatcherWorker::FeatureMatcherWorker(
     const SiftMatchingOptions& matching_options,
     const TwoViewGeometryOptions& geometry_options,
     FeatureMatcherCache* cache,
-    JobQueue<Input>* input_queue,
-    JobQueue<Output>* output_queue)
+    LockFreeJobQueue<Input>* input_queue,
+    LockFreeJobQueue<Output>* output_queue)
     : matching_options_(matching_options),
       geometry_options_(geometry_options),
       cache_(cache),
@@ -204,10 +354,18 @@ FeatureMatcherWorker::FeatureMatcherWorker(
   prev_keypoints_image_ids_[1] = kInvalidImageId;
   prev_descriptors_image_ids_[0] = kInvalidImageId;
   prev_descriptors_image_ids_[1] = kInvalidImageId;
+  prev_descriptor_codes_image_ids_[0] = kInvalidImageId;
+  prev_descriptor_codes_image_ids_[1] = kInvalidImageId;
 
   if (matching_options_.use_gpu) {
 #if !defined(COLMAP_CUDA_ENABLED)
-    opengl_context_ = std::make_unique<OpenGLContextManager>();
+    const std::vector<int> gpu_indices =
+        CSVToVector<int>(matching_options_.gpu_index);
+    CHECK_EQ(gpu_indices.size(), 1);
+    opengl_context_ = std::make_unique<OpenGLContextManager>(
+        /*opengl_major_version=*/2,
+        /*opengl_minor_version=*/1,
+        /*device_index=*/gpu_indices[0]);
 #endif
   }
 }
@@ -242,20 +400,47 @@ void FeatureMatcherWorker::Run() {
     auto input_job = input_queue_->Pop();
     if (input_job.IsValid()) {
       auto& data = input_job.Data();
+      COLMAP_TRACE_SCOPE("FeatureMatcherWorker::Match");
+      COLMAP_METRIC_COUNTER("Matched image pairs", 1);
 
-      if (!cache_->ExistsDescriptors(data.image_id1) ||
-          !cache_->ExistsDescriptors(data.image_id2)) {
+      if (!ExistsMatchingDescriptors(data.image_id1) ||
+          !ExistsMatchingDescriptors(data.image_id2)) {
         CHECK(output_queue_->Push(std::move(data)));
         continue;
       }
 
-      if (matching_options_.guided_matching) {
+      if (matching_options_.guided_matching &&
+          data.two_view_geometry.config == TwoViewGeometry::REFRACTIVE) {
+        const Camera& camera1 =
+            cache_->GetCamera(cache_->GetImage(data.image_id1).CameraId());
+        const Camera& camera2 =
+            cache_->GetCamera(cache_->GetImage(data.image_id2).CameraId());
+        matcher->MatchGuidedRefrac(geometry_options_,
+                                   camera1,
+                                   camera2,
+                                   GetKeypointsPtr(0, data.image_id1),
+                                   GetKeypointsPtr(1, data.image_id2),
+                                   GetDescriptorsPtr(0, data.image_id1),
+                                   GetDescriptorsPtr(1, data.image_id2),
+                                   &data.two_view_geometry);
+      } else if (matching_options_.guided_matching) {
         matcher->MatchGuided(geometry_options_,
                              GetKeypointsPtr(0, data.image_id1),
                              GetKeypointsPtr(1, data.image_id2),
                              GetDescriptorsPtr(0, data.image_id1),
                              GetDescriptorsPtr(1, data.image_id2),
                              &data.two_view_geometry);
+      } else if (matching_options_.use_descriptor_codes) {
+        // The raw descriptors are only read for re-ranking the candidates.
+        const bool rerank =
+            matching_options_.descriptor_codes_num_candidates > 0;
+        matcher->MatchQuantized(
+            *cache_->GetDescriptorQuantizer(),
+            GetDescriptorCodesPtr(0, data.image_id1),
+            GetDescriptorCodesPtr(1, data.image_id2),
+            rerank ? GetDescriptorsPtr(0, data.image_id1) : nullptr,
+            rerank ? GetDescriptorsPtr(1, data.image_id2) : nullptr,
+            &data.matches);
       } else {
         matcher->Match(GetDescriptorsPtr(0, data.image_id1),
                        GetDescriptorsPtr(1, data.image_id2),
@@ -293,8 +478,38 @@ std::shared_ptr<FeatureDescriptors> FeatureMatcherWorker::GetDescriptorsPtr(
   }
 }
 
+std::shared_ptr<FeatureDescriptors> FeatureMatcherWorker::GetDescriptorCodesPtr(
+    const int index, const image_t image_id) {
+  CHECK_GE(index, 0);
+  CHECK_LE(index, 1);
+  if (prev_descriptor_codes_image_ids_[index] == image_id) {
+    return nullptr;
+  } else {
+    prev_descriptor_codes_image_ids_[index] = image_id;
+    prev_descriptor_codes_[index] = cache_->GetDescriptorCodes(image_id);
+    return prev_descriptor_codes_[index];
+  }
+}
+
+bool FeatureMatcherWorker::ExistsMatchingDescriptors(const image_t image_id) {
+  if (matching_options_.use_descriptor_codes &&
+      !matching_options_.guided_matching) {
+    if (!cache_->ExistsDescriptorCodes(image_id)) {
+      return false;
+    }
+    if (matching_options_.descriptor_codes_num_candidates == 0) {
+      return true;
+    }
+  }
+  return cache_->ExistsDescriptors(image_id);
+}
+
 namespace {
 
+// Maximum number of jobs in each queue of the matching pipeline, which bounds
+// the memory of the queued image pairs and their matches.
+const size_t kMaxNumQueuedJobs = 512;
+
 class VerifierWorker : public Thread {
  public:
   typedef FeatureMatcherData Input;
@@ -302,8 +517,8 @@ class VerifierWorker : public Thread {
 
   VerifierWorker(const TwoViewGeometryOptions& options,
                  FeatureMatcherCache* cache,
-                 JobQueue<Input>* input_queue,
-                 JobQueue<Output>* output_queue)
+                 LockFreeJobQueue<Input>* input_queue,
+                 LockFreeJobQueue<Output>* output_queue)
       : options_(options),
         cache_(cache),
         input_queue_(input_queue),
@@ -321,6 +536,12 @@ class VerifierWorker : public Thread {
       auto input_job = input_queue_->Pop();
       if (input_job.IsValid()) {
         auto& data = input_job.Data();
+        COLMAP_TRACE_SCOPE("VerifierWorker::Verify");
+        COLMAP_METRIC_COUNTER("Verified image pairs", 1);
+        // The RANSAC samples only depend on the image pair and not on the
+        // verifier that happens to pop it in deterministic execution.
+        ScopedTaskStream stream(
+            Database::ImagePairToPairId(data.image_id1, data.image_id2));
 
         if (data.matches.size() <
             static_cast<size_t>(options_.min_num_inliers)) {
@@ -339,7 +560,10 @@ class VerifierWorker : public Thread {
         const std::vector<Eigen::Vector2d> points2 =
             FeatureKeypointsToPointsVector(*keypoints2);
 
-        if (!options_.enable_refraction) {
+        if (data.has_known_pose) {
+          data.two_view_geometry =
+              VerifyKnownPose(data, camera1, points1, camera2, points2);
+        } else if (!options_.enable_refraction) {
           data.two_view_geometry = EstimateTwoViewGeometry(
               camera1, points1, camera2, points2, data.matches, options_);
         } else {
@@ -348,25 +572,18 @@ class VerifierWorker : public Thread {
           const Camera& best_fit_camera2 =
               cache_->GetBestFitCameras(camera2.camera_id);
 
-          std::vector<Camera> virtual_cameras1;
-          std::vector<Camera> virtual_cameras2;
-          std::vector<Rigid3d> virtual_from_reals1;
-          std::vector<Rigid3d> virtual_from_reals2;
-
-          camera1.ComputeVirtuals(
-              points1, virtual_cameras1, virtual_from_reals1);
-          camera1.ComputeVirtuals(
-              points2, virtual_cameras2, virtual_from_reals2);
+          const auto virtual_cameras1 =
+              cache_->GetVirtualCameras(data.image_id1);
+          const auto virtual_cameras2 =
+              cache_->GetVirtualCameras(data.image_id2);
 
           data.two_view_geometry =
               EstimateRefractiveTwoViewGeometryUseBestFit(best_fit_camera1,
                                                           points1,
-                                                          virtual_cameras1,
-                                                          virtual_from_reals1,
+                                                          *virtual_cameras1,
                                                           best_fit_camera2,
                                                           points2,
-                                                          virtual_cameras2,
-                                                          virtual_from_reals2,
+                                                          *virtual_cameras2,
                                                           data.matches,
                                                           options_);
         }
@@ -377,10 +594,34 @@ class VerifierWorker : public Thread {
   }
 
  private:
+  TwoViewGeometry VerifyKnownPose(const FeatureMatcherData& data,
+                                  const Camera& camera1,
+                                  const std::vector<Eigen::Vector2d>& points1,
+                                  const Camera& camera2,
+                                  const std::vector<Eigen::Vector2d>& points2) {
+    if (!options_.enable_refraction) {
+      return EstimateTwoViewGeometryWithKnownPose(camera1,
+                                                  points1,
+                                                  camera2,
+                                                  points2,
+                                                  data.matches,
+                                                  data.cam2_from_cam1,
+                                                  options_);
+    }
+    return EstimateRefractiveTwoViewGeometryWithKnownPose(
+        points1,
+        *cache_->GetVirtualCameras(data.image_id1),
+        points2,
+        *cache_->GetVirtualCameras(data.image_id2),
+        data.matches,
+        data.cam2_from_cam1,
+        options_);
+  }
+
   const TwoViewGeometryOptions options_;
   FeatureMatcherCache* cache_;
-  JobQueue<Input>* input_queue_;
-  JobQueue<Output>* output_queue_;
+  LockFreeJobQueue<Input>* input_queue_;
+  LockFreeJobQueue<Output>* output_queue_;
 };
 
 }  // namespace
@@ -394,10 +635,17 @@ FeatureMatcherController::FeatureMatcherController(
       geometry_options_(geometry_options),
       database_(database),
       cache_(cache),
-      is_setup_(false) {
+      is_setup_(false),
+      num_batches_(0),
+      matcher_queue_(kMaxNumQueuedJobs),
+      verifier_queue_(kMaxNumQueuedJobs),
+      guided_matcher_queue_(kMaxNumQueuedJobs),
+      output_queue_(kMaxNumQueuedJobs) {
   CHECK(matching_options_.Check());
   CHECK(geometry_options_.Check());
 
+  database_->SetCompactInlierMatches(matching_options_.compact_inlier_matches);
+
   const int num_threads = GetEffectiveNumThreads(matching_options_.num_threads);
   CHECK_GT(num_threads, 0);
 
@@ -418,15 +666,18 @@ FeatureMatcherController::FeatureMatcherController(
     auto matching_options_copy = matching_options_;
     // The first matching is always without guided matching.
     matching_options_copy.guided_matching = false;
-    matchers_.reserve(gpu_indices.size());
+    matchers_.reserve(gpu_indices.size() *
+                      matching_options_.num_threads_per_gpu);
     for (const auto& gpu_index : gpu_indices) {
       matching_options_copy.gpu_index = std::to_string(gpu_index);
-      matchers_.emplace_back(
-          std::make_unique<FeatureMatcherWorker>(matching_options_copy,
-                                                 geometry_options_,
-                                                 cache,
-                                                 &matcher_queue_,
-                                                 &verifier_queue_));
+      for (int i = 0; i < matching_options_.num_threads_per_gpu; ++i) {
+        matchers_.emplace_back(
+            std::make_unique<FeatureMatcherWorker>(matching_options_copy,
+                                                   geometry_options_,
+                                                   cache,
+                                                   &matcher_queue_,
+                                                   &verifier_queue_));
+      }
     }
   } else {
     auto matching_options_copy = matching_options_;
@@ -443,25 +694,32 @@ FeatureMatcherController::FeatureMatcherController(
     }
   }
 
+  // Redirect the verification output to final round of guided matching.
+  LockFreeJobQueue<FeatureMatcherData>* verifier_output_queue =
+      matching_options_.guided_matching ? &guided_matcher_queue_
+                                        : &output_queue_;
+
   verifiers_.reserve(num_threads);
-  if (matching_options_.guided_matching) {
-    // Redirect the verification output to final round of guided matching.
-    for (int i = 0; i < num_threads; ++i) {
-      verifiers_.emplace_back(std::make_unique<VerifierWorker>(
-          geometry_options_, cache, &verifier_queue_, &guided_matcher_queue_));
-    }
+  for (int i = 0; i < num_threads; ++i) {
+    verifiers_.emplace_back(std::make_unique<VerifierWorker>(
+        geometry_options_, cache, &verifier_queue_, verifier_output_queue));
+  }
 
+  if (matching_options_.guided_matching) {
     if (matching_options_.use_gpu) {
       auto matching_options_copy = matching_options_;
-      guided_matchers_.reserve(gpu_indices.size());
+      guided_matchers_.reserve(gpu_indices.size() *
+                               matching_options_.num_threads_per_gpu);
       for (const auto& gpu_index : gpu_indices) {
         matching_options_copy.gpu_index = std::to_string(gpu_index);
-        guided_matchers_.emplace_back(
-            std::make_unique<FeatureMatcherWorker>(matching_options_copy,
-                                                   geometry_options_,
-                                                   cache,
-                                                   &guided_matcher_queue_,
-                                                   &output_queue_));
+        for (int i = 0; i < matching_options_.num_threads_per_gpu; ++i) {
+          guided_matchers_.emplace_back(
+              std::make_unique<FeatureMatcherWorker>(matching_options_copy,
+                                                     geometry_options_,
+                                                     cache,
+                                                     &guided_matcher_queue_,
+                                                     &output_queue_));
+        }
       }
     } else {
       guided_matchers_.reserve(num_threads);
@@ -474,15 +732,15 @@ FeatureMatcherController::FeatureMatcherController(
                                                    &output_queue_));
       }
     }
-  } else {
-    for (int i = 0; i < num_threads; ++i) {
-      verifiers_.emplace_back(std::make_unique<VerifierWorker>(
-          geometry_options_, cache, &verifier_queue_, &output_queue_));
-    }
   }
 }
 
 FeatureMatcherController::~FeatureMatcherController() {
+  // Write the results of the batches submitted without waiting.
+  if (is_setup_) {
+    Wait();
+  }
+
   matcher_queue_.Wait();
   verifier_queue_.Wait();
   guided_matcher_queue_.Wait();
@@ -519,6 +777,13 @@ FeatureMatcherController::~FeatureMatcherController() {
 }
 
 bool FeatureMatcherController::Setup() {
+  if (matching_options_.use_descriptor_codes &&
+      !CHECK_NOTNULL(database_)->ExistsDescriptorCodebook()) {
+    LOG(ERROR) << "Matching descriptor codes requires a descriptor codebook "
+                  "in the database - run the descriptor_compressor first.";
+    return false;
+  }
+
   // Minimize the amount of allocated GPU memory by computing the maximum number
   // of descriptors for any image over the whole database.
   const int max_num_features = CHECK_NOTNULL(database_)->MaxNumKeypoints();
@@ -558,6 +823,20 @@ bool FeatureMatcherController::Setup() {
 
 void FeatureMatcherController::Match(
     const std::vector<std::pair<image_t, image_t>>& image_pairs) {
+  MatchAsync(image_pairs);
+  Wait();
+}
+
+void FeatureMatcherController::MatchAsync(
+    const std::vector<std::pair<image_t, image_t>>& image_pairs) {
+  MatchAsync(image_pairs, std::vector<Rigid3d>());
+}
+
+void FeatureMatcherController::MatchAsync(
+    const std::vector<std::pair<image_t, image_t>>& image_pairs,
+    const std::vector<Rigid3d>& cams2_from_cams1) {
+  CHECK(cams2_from_cams1.empty() ||
+        cams2_from_cams1.size() == image_pairs.size());
   CHECK_NOTNULL(database_);
   CHECK_NOTNULL(cache_);
   CHECK(is_setup_);
@@ -566,29 +845,30 @@ void FeatureMatcherController::Match(
     return;
   }
 
-  //////////////////////////////////////////////////////////////////////////////
-  // Match the image pairs
-  //////////////////////////////////////////////////////////////////////////////
+  // The batches are generated identically in all shards, so that assigning
+  // whole batches preserves the locality of the cached features.
+  const size_t batch_idx = num_batches_++;
+  if (batch_idx % matching_options_.num_shards !=
+      static_cast<size_t>(matching_options_.shard_index)) {
+    return;
+  }
 
-  std::unordered_set<image_pair_t> image_pair_ids;
-  image_pair_ids.reserve(image_pairs.size());
+  for (size_t i = 0; i < image_pairs.size(); ++i) {
+    const auto& image_pair = image_pairs[i];
 
-  size_t num_outputs = 0;
-  for (const auto& image_pair : image_pairs) {
     // Avoid self-matches.
     if (image_pair.first == image_pair.second) {
       continue;
     }
 
-    // Avoid duplicate image pairs.
+    // Avoid duplicate image pairs within and across the pending batches, whose
+    // results are not yet in the database.
     const image_pair_t pair_id =
         Database::ImagePairToPairId(image_pair.first, image_pair.second);
-    if (image_pair_ids.count(pair_id) > 0) {
+    if (pending_image_pair_ids_.count(pair_id) > 0) {
       continue;
     }
 
-    image_pair_ids.insert(pair_id);
-
     const bool exists_matches =
         cache_->ExistsMatches(image_pair.first, image_pair.second);
     const bool exists_inlier_matches =
@@ -598,8 +878,6 @@ void FeatureMatcherController::Match(
       continue;
     }
 
-    num_outputs += 1;
-
     // If only one of the matches or inlier matches exist, we recompute them
     // from scratch and delete the existing results. This must be done before
     // pushing the jobs to the queue, otherwise database constraints might fail
@@ -612,41 +890,84 @@ void FeatureMatcherController::Match(
     FeatureMatcherData data;
     data.image_id1 = image_pair.first;
     data.image_id2 = image_pair.second;
+    if (!cams2_from_cams1.empty()) {
+      data.has_known_pose = true;
+      data.cam2_from_cam1 = cams2_from_cams1[i];
+    }
 
+    LockFreeJobQueue<FeatureMatcherData>& input_queue =
+        exists_matches ? verifier_queue_ : matcher_queue_;
     if (exists_matches) {
       data.matches = cache_->GetMatches(image_pair.first, image_pair.second);
       cache_->DeleteMatches(image_pair.first, image_pair.second);
-      CHECK(verifier_queue_.Push(std::move(data)));
-    } else {
-      CHECK(matcher_queue_.Push(std::move(data)));
     }
+
+    // The queues are bounded, such that the results must already be written
+    // while pushing, since otherwise the workers block on the full output
+    // queue. A full input queue implies pending outputs, so this terminates.
+    while (!input_queue.TryPush(&data)) {
+      CHECK(!pending_image_pair_ids_.empty());
+      WriteOutput(/*wait=*/true);
+    }
+
+    pending_image_pair_ids_.insert(pair_id);
   }
 
-  //////////////////////////////////////////////////////////////////////////////
-  // Write results to database
-  //////////////////////////////////////////////////////////////////////////////
+  // Write the already finished results, so that the workers do not block on
+  // the full output queue while the caller prepares the next batch.
+  while (WriteOutput(/*wait=*/false)) {
+  }
+}
 
-  for (size_t i = 0; i < num_outputs; ++i) {
-    auto output_job = output_queue_.Pop();
-    CHECK(output_job.IsValid());
-    auto& output = output_job.Data();
+void FeatureMatcherController::Wait() {
+  while (!pending_image_pair_ids_.empty()) {
+    WriteOutput(/*wait=*/true);
+  }
 
-    if (output.matches.size() <
-        static_cast<size_t>(geometry_options_.min_num_inliers)) {
-      output.matches = {};
-    }
+  CHECK_EQ(output_queue_.Size(), 0);
+}
 
-    if (output.two_view_geometry.inlier_matches.size() <
-        static_cast<size_t>(geometry_options_.min_num_inliers)) {
-      output.two_view_geometry = TwoViewGeometry();
-    }
+bool FeatureMatcherController::WriteOutput(const bool wait) {
+  if (pending_image_pair_ids_.empty()) {
+    return false;
+  }
 
-    cache_->WriteMatches(output.image_id1, output.image_id2, output.matches);
-    cache_->WriteTwoViewGeometry(
-        output.image_id1, output.image_id2, output.two_view_geometry);
+  auto output_job = wait ? output_queue_.Pop() : output_queue_.TryPop();
+  if (!output_job.IsValid()) {
+    CHECK(!wait);
+    return false;
   }
 
-  CHECK_EQ(output_queue_.Size(), 0);
+  auto& output = output_job.Data();
+
+  COLMAP_METRIC_COUNTER("Written image pairs", 1);
+  COLMAP_METRIC_GAUGE("Feature matching matcher queue size",
+                      matcher_queue_.Size());
+  COLMAP_METRIC_GAUGE("Feature matching verifier queue size",
+                      verifier_queue_.Size());
+  COLMAP_METRIC_GAUGE("Feature matching guided matcher queue size",
+                      guided_matcher_queue_.Size());
+  COLMAP_METRIC_GAUGE("Feature matching output queue size",
+                      output_queue_.Size());
+
+  if (output.matches.size() <
+      static_cast<size_t>(geometry_options_.min_num_inliers)) {
+    output.matches = {};
+  }
+
+  if (output.two_view_geometry.inlier_matches.size() <
+      static_cast<size_t>(geometry_options_.min_num_inliers)) {
+    output.two_view_geometry = TwoViewGeometry();
+  }
+
+  cache_->WriteMatches(output.image_id1, output.image_id2, output.matches);
+  cache_->WriteTwoViewGeometry(
+      output.image_id1, output.image_id2, output.two_view_geometry);
+
+  pending_image_pair_ids_.erase(
+      Database::ImagePairToPairId(output.image_id1, output.image_id2));
+
+  return true;
 }
 
 }  // namespace colmap
@@ -37,8 +37,10 @@
 #include "colmap/util/threading.h"
 
 #include <array>
+#include <functional>
 #include <memory>
 #include <string>
+#include <unordered_set>
 #include <vector>
 
 namespace colmap {
@@ -48,9 +50,16 @@ struct FeatureMatcherData {
   image_t image_id2 = kInvalidImageId;
   FeatureMatches matches;
   TwoViewGeometry two_view_geometry;
+  // Whether the relative pose of the images is known, e.g., from a calibrated
+  // camera rig, such that the matches are verified with the known pose
+  // instead of robustly estimating the two-view geometry.
+  bool has_known_pose = false;
+  Rigid3d cam2_from_cam1;
 };
 
-// Cache for feature matching to minimize database access during matching.
+// Cache for feature matching to minimize database access during matching. The
+// features of cache misses are read concurrently through one read-only
+// database connection per thread, see `DatabaseReaderPool`.
 class FeatureMatcherCache {
  public:
   FeatureMatcherCache(size_t cache_size,
@@ -63,11 +72,17 @@ class FeatureMatcherCache {
   const Image& GetImage(image_t image_id) const;
   std::shared_ptr<FeatureKeypoints> GetKeypoints(image_t image_id);
   std::shared_ptr<FeatureDescriptors> GetDescriptors(image_t image_id);
+  std::shared_ptr<FeatureDescriptors> GetDescriptorCodes(image_t image_id);
   FeatureMatches GetMatches(image_t image_id1, image_t image_id2);
   std::vector<image_t> GetImageIds() const;
 
   bool ExistsKeypoints(image_t image_id);
   bool ExistsDescriptors(image_t image_id);
+  bool ExistsDescriptorCodes(image_t image_id);
+
+  // The quantizer of the descriptor codes or nullptr, if the database has no
+  // descriptor codebook.
+  std::shared_ptr<const ProductQuantizer> GetDescriptorQuantizer() const;
 
   bool ExistsMatches(image_t image_id1, image_t image_id2);
   bool ExistsInlierMatches(image_t image_id1, image_t image_id2);
@@ -84,10 +99,26 @@ class FeatureMatcherCache {
 
   const Camera& GetBestFitCameras(camera_t camera_id) const;
 
+  // The virtual cameras of the keypoints of a refractive image, which describe
+  // the refracted ray of every keypoint, see `Camera::ComputeVirtuals`. Only
+  // available if refraction is enabled.
+  std::shared_ptr<VirtualPinholeCameras> GetVirtualCameras(image_t image_id);
+
  private:
+  // Get the value of the image from the cache or read it from the database on
+  // a miss. Unless the readers share the database, the read happens outside
+  // of the lock, so that misses of multiple threads are read concurrently.
+  template <typename T>
+  T GetCached(LRUCache<image_t, T>* cache,
+              image_t image_id,
+              const std::function<T(const Database&)>& read_func,
+              const char* hits_counter_name,
+              const char* misses_counter_name);
+
   const size_t cache_size_;
   const Database* database_;
   std::mutex database_mutex_;
+  std::unique_ptr<DatabaseReaderPool> database_readers_;
   std::unordered_map<camera_t, Camera> cameras_cache_;
   std::unordered_map<image_t, Image> images_cache_;
   std::unique_ptr<LRUCache<image_t, std::shared_ptr<FeatureKeypoints>>>
@@ -96,11 +127,21 @@ class FeatureMatcherCache {
       descriptors_cache_;
   std::unique_ptr<LRUCache<image_t, bool>> keypoints_exists_cache_;
   std::unique_ptr<LRUCache<image_t, bool>> descriptors_exists_cache_;
+  std::unique_ptr<LRUCache<image_t, std::shared_ptr<FeatureDescriptors>>>
+      descriptor_codes_cache_;
+  std::unique_ptr<LRUCache<image_t, bool>> descriptor_codes_exists_cache_;
+  std::shared_ptr<const ProductQuantizer> descriptor_quantizer_;
 
   // If refraction is enabled, and if the camera is also refractive. We
   // pre-compute best approximate pinhole model and cache them.
   const bool enable_refraction_;
   std::unordered_map<camera_t, Camera> best_fit_cameras_;
+
+  // The virtual cameras of the keypoints are cached such that images in
+  // multiple pairs are not traced through the interface multiple times.
+  std::mutex virtual_cameras_mutex_;
+  std::unique_ptr<LRUCache<image_t, std::shared_ptr<VirtualPinholeCameras>>>
+      virtual_cameras_cache_;
 };
 
 class FeatureMatcherWorker : public Thread {
@@ -111,8 +152,8 @@ class FeatureMatcherWorker : public Thread {
   FeatureMatcherWorker(const SiftMatchingOptions& matching_options,
                        const TwoViewGeometryOptions& geometry_options,
                        FeatureMatcherCache* cache,
-                       JobQueue<Input>* input_queue,
-                       JobQueue<Output>* output_queue);
+                       LockFreeJobQueue<Input>* input_queue,
+                       LockFreeJobQueue<Output>* output_queue);
 
   void SetMaxNumMatches(int max_num_matches);
 
@@ -123,12 +164,18 @@ class FeatureMatcherWorker : public Thread {
                                                     image_t image_id);
   std::shared_ptr<FeatureDescriptors> GetDescriptorsPtr(int index,
                                                         image_t image_id);
+  std::shared_ptr<FeatureDescriptors> GetDescriptorCodesPtr(int index,
+                                                            image_t image_id);
+
+  // Whether the descriptors or, when matching descriptor codes, the data read
+  // for matching the codes exist.
+  bool ExistsMatchingDescriptors(image_t image_id);
 
   SiftMatchingOptions matching_options_;
   TwoViewGeometryOptions geometry_options_;
   FeatureMatcherCache* cache_;
-  JobQueue<Input>* input_queue_;
-  JobQueue<Output>* output_queue_;
+  LockFreeJobQueue<Input>* input_queue_;
+  LockFreeJobQueue<Output>* output_queue_;
 
   std::unique_ptr<OpenGLContextManager> opengl_context_;
 
@@ -136,13 +183,18 @@ class FeatureMatcherWorker : public Thread {
   std::array<std::shared_ptr<FeatureKeypoints>, 2> prev_keypoints_;
   std::array<image_t, 2> prev_descriptors_image_ids_;
   std::array<std::shared_ptr<FeatureDescriptors>, 2> prev_descriptors_;
+  std::array<image_t, 2> prev_descriptor_codes_image_ids_;
+  std::array<std::shared_ptr<FeatureDescriptors>, 2> prev_descriptor_codes_;
 };
 
 // Multi-threaded and multi-GPU SIFT feature matcher, which writes the computed
 // results to the database and skips already matched image pairs. To improve
 // performance of the matching by taking advantage of caching and database
 // transactions, pass multiple images to the `Match` function. Note that the
-// database should be in an active transaction while calling `Match`.
+// database should be in an active transaction while calling `Match`,
+// `MatchAsync`, or `Wait`. If the
+// matching is split into multiple shards, only the batches of the shard of this
+// controller are matched, see `SiftMatchingOptions::num_shards`.
 class FeatureMatcherController {
  public:
   FeatureMatcherController(
@@ -156,10 +208,31 @@ class FeatureMatcherController {
   // Setup the matchers and return if successful.
   bool Setup();
 
-  // Match one batch of multiple image pairs.
+  // Match one batch of multiple image pairs and wait for all results to be
+  // written to the database.
   void Match(const std::vector<std::pair<image_t, image_t>>& image_pairs);
 
+  // Submit one batch of multiple image pairs without waiting for its results.
+  // The results of the previously submitted batches are written to the
+  // database while submitting, such that the matchers already process the
+  // next batch while the tail of the previous batch is verified and written.
+  // Call `Wait` before reading the matches of the submitted pairs.
+  void MatchAsync(const std::vector<std::pair<image_t, image_t>>& image_pairs);
+
+  // Submit one batch of image pairs with known relative poses, which are
+  // verified with `EstimateTwoViewGeometryWithKnownPose`.
+  void MatchAsync(const std::vector<std::pair<image_t, image_t>>& image_pairs,
+                  const std::vector<Rigid3d>& cams2_from_cams1);
+
+  // Wait for the results of all submitted batches and write them to the
+  // database.
+  void Wait();
+
  private:
+  // Pop the next matched image pair from the output queue and write it to the
+  // database. Returns false without waiting if no output is ready.
+  bool WriteOutput(bool wait);
+
   SiftMatchingOptions matching_options_;
   TwoViewGeometryOptions geometry_options_;
   Database* database_;
@@ -167,15 +240,21 @@ class FeatureMatcherController {
 
   bool is_setup_;
 
+  // Number of batches passed to `Match`, which assigns the batches to shards.
+  size_t num_batches_;
+
+  // The submitted image pairs whose results are not yet written.
+  std::unordered_set<image_pair_t> pending_image_pair_ids_;
+
   std::vector<std::unique_ptr<FeatureMatcherWorker>> matchers_;
   std::vector<std::unique_ptr<FeatureMatcherWorker>> guided_matchers_;
   std::vector<std::unique_ptr<Thread>> verifiers_;
   std::unique_ptr<ThreadPool> thread_pool_;
 
-  JobQueue<FeatureMatcherData> matcher_queue_;
-  JobQueue<FeatureMatcherData> verifier_queue_;
-  JobQueue<FeatureMatcherData> guided_matcher_queue_;
-  JobQueue<FeatureMatcherData> output_queue_;
+  LockFreeJobQueue<FeatureMatcherData> matcher_queue_;
+  LockFreeJobQueue<FeatureMatcherData> verifier_queue_;
+  LockFreeJobQueue<FeatureMatcherData> guided_matcher_queue_;
+  LockFreeJobQueue<FeatureMatcherData> output_queue_;
 };
 
 }  // namespace colmap
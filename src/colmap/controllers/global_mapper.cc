@@ -0,0 +1,165 @@
+#include "colmap/controllers/global_mapper.h"
+
+#include "colmap/util/misc.h"
+
+namespace colmap {
+
+GlobalMapper::Options GlobalMapperController::Options::Mapper() const {
+  GlobalMapper::Options options = global_options;
+  options.use_pose_prior = incremental_options.use_pose_prior;
+  options.num_threads = incremental_options.num_threads;
+  return options;
+}
+
+bool GlobalMapperController::Options::Check() const {
+  CHECK_OPTION(global_options.Check());
+  CHECK_OPTION(incremental_options.Check());
+  return true;
+}
+
+GlobalMapperController::GlobalMapperController(
+    const Options& options,
+    std::shared_ptr<ReconstructionManager> reconstruction_manager)
+    : options_(options),
+      reconstruction_manager_(std::move(reconstruction_manager)) {
+  CHECK(options_.Check());
+}
+
+void GlobalMapperController::Run() {
+  if (!LoadDatabase()) {
+    return;
+  }
+
+  const IncrementalMapperOptions& incremental_options =
+      options_.incremental_options;
+  const GlobalMapper::Options mapper_options = options_.Mapper();
+
+  auto reconstruction = std::make_shared<Reconstruction>();
+  // Set prior_from_cam if pose prior is used in reconstruction.
+  if (incremental_options.use_pose_prior &&
+      !incremental_options.prior_from_cam.empty()) {
+    const std::vector<double> params =
+        CSVToVector<double>(incremental_options.prior_from_cam);
+    reconstruction->PriorFromCam() =
+        Rigid3d(Eigen::Quaterniond(params[0], params[1], params[2], params[3])
+                    .normalized(),
+                Eigen::Vector3d(params[4], params[5], params[6]));
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+  // Rotation and translation averaging
+  //////////////////////////////////////////////////////////////////////////////
+
+  GlobalMapper global_mapper(database_cache_);
+  global_mapper.BeginReconstruction(reconstruction);
+
+  PrintHeading1("Loading relative poses");
+  {
+    Database database(options_.database_path);
+    global_mapper.LoadRelativePoses(mapper_options, database);
+  }
+
+  PrintHeading1("Rotation averaging");
+  if (global_mapper.AverageRotations(mapper_options) < 2) {
+    LOG(WARNING) << "Not enough image pairs with relative poses.";
+    global_mapper.EndReconstruction();
+    return;
+  }
+
+  if (IsStopped()) {
+    global_mapper.EndReconstruction();
+    return;
+  }
+
+  PrintHeading1("Translation averaging");
+  const size_t num_reg_images =
+      global_mapper.AverageTranslations(mapper_options);
+  global_mapper.EndReconstruction();
+  if (num_reg_images < 2) {
+    LOG(WARNING) << "Not enough image pairs with relative translations.";
+    return;
+  }
+
+  if (IsStopped()) {
+    return;
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+  // Triangulation and bundle adjustment
+  //////////////////////////////////////////////////////////////////////////////
+
+  IncrementalMapper mapper(database_cache_);
+  mapper.BeginReconstruction(reconstruction);
+
+  PrintHeading1("Triangulation");
+  const IncrementalTriangulator::Options tri_options =
+      incremental_options.Triangulation();
+  size_t num_tri_observations = 0;
+  for (const image_t image_id : reconstruction->RegImageIds()) {
+    num_tri_observations += mapper.TriangulateImage(tri_options, image_id);
+  }
+  LOG(INFO) << "  => Triangulated observations: " << num_tri_observations;
+
+  for (int i = 0; i < incremental_options.ba_global_max_refinements; ++i) {
+    if (IsStopped()) {
+      break;
+    }
+
+    const size_t num_observations = reconstruction->ComputeNumObservations();
+    PrintHeading1("Global bundle adjustment");
+    mapper.AdjustGlobalBundle(incremental_options.Mapper(),
+                              incremental_options.GlobalBundleAdjustment());
+    size_t num_changed_observations =
+        CompleteAndMergeTracks(incremental_options, &mapper);
+    num_changed_observations += FilterPoints(incremental_options, &mapper);
+    const double changed =
+        num_observations == 0
+            ? 0
+            : static_cast<double>(num_changed_observations) / num_observations;
+    LOG(INFO) << StringPrintf("  => Changed observations: %.6f", changed);
+    if (changed < incremental_options.ba_global_max_refinement_change) {
+      break;
+    }
+  }
+
+  FilterImages(incremental_options, &mapper);
+
+  if (incremental_options.extract_colors) {
+    PrintHeading1("Extracting color");
+    reconstruction->ExtractColorsForAllImages(options_.image_path,
+                                              incremental_options.num_threads);
+  }
+
+  mapper.EndReconstruction(/*discard=*/false);
+
+  reconstruction_manager_->Get(reconstruction_manager_->Add()) =
+      reconstruction;
+
+  GetTimer().PrintMinutes();
+}
+
+bool GlobalMapperController::LoadDatabase() {
+  PrintHeading1("Loading database");
+
+  std::unordered_set<std::string> image_names;
+  Timer timer;
+  timer.Start();
+  const size_t min_num_matches =
+      static_cast<size_t>(options_.incremental_options.min_num_matches);
+  database_cache_ = DatabaseCache::CreateOrRetain(
+      options_.database_path,
+      min_num_matches,
+      options_.incremental_options.ignore_watermarks,
+      image_names,
+      options_.incremental_options.database_cache_path);
+  timer.PrintMinutes();
+
+  if (database_cache_->NumImages() == 0) {
+    LOG(WARNING) << "No images with matches found in the database.";
+    return false;
+  }
+
+  return true;
+}
+
+}  // namespace colmap
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "colmap/controllers/incremental_mapper.h"
+#include "colmap/scene/reconstruction_manager.h"
+#include "colmap/sfm/global_mapper.h"
+#include "colmap/util/threading.h"
+
+#include <memory>
+
+namespace colmap {
+
+// Global mapping estimates the poses of all images at once by rotation and
+// translation averaging of the relative poses of the verified image pairs,
+// then triangulates the scene and refines it by a few rounds of global bundle
+// adjustment. In contrast to incremental mapping, the bundle adjustment is not
+// repeated for every batch of registered images.
+class GlobalMapperController : public Thread {
+ public:
+  struct Options {
+    // The path to the image folder which are used as input.
+    std::string image_path;
+
+    // The path to the database file which is used as input.
+    std::string database_path;
+
+    // Options of the rotation and translation averaging.
+    GlobalMapper::Options global_options;
+
+    // Options of the triangulation, bundle adjustment, and filtering.
+    IncrementalMapperOptions incremental_options;
+
+    GlobalMapper::Options Mapper() const;
+
+    bool Check() const;
+  };
+
+  GlobalMapperController(
+      const Options& options,
+      std::shared_ptr<ReconstructionManager> reconstruction_manager);
+
+ private:
+  void Run() override;
+  bool LoadDatabase();
+
+  const Options options_;
+  std::shared_ptr<ReconstructionManager> reconstruction_manager_;
+  std::shared_ptr<const DatabaseCache> database_cache_;
+};
+
+}  // namespace colmap
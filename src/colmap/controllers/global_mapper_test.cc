@@ -0,0 +1,94 @@
+#include "colmap/controllers/global_mapper.h"
+
+#include "colmap/estimators/alignment.h"
+#include "colmap/math/math.h"
+#include "colmap/scene/synthetic.h"
+#include "colmap/util/testing.h"
+
+#include <gtest/gtest.h>
+
+namespace colmap {
+namespace {
+
+// Store the ground-truth relative poses of the synthesized image pairs, as
+// estimated during matching.
+void WriteRelativePoses(const Reconstruction& reconstruction,
+                        Database* database) {
+  std::vector<image_pair_t> image_pair_ids;
+  std::vector<TwoViewGeometry> two_view_geometries;
+  database->ReadTwoViewGeometries(&image_pair_ids, &two_view_geometries);
+  database->ClearTwoViewGeometries();
+  for (size_t i = 0; i < image_pair_ids.size(); ++i) {
+    image_t image_id1;
+    image_t image_id2;
+    Database::PairIdToImagePair(image_pair_ids[i], &image_id1, &image_id2);
+    TwoViewGeometry& two_view_geometry = two_view_geometries[i];
+    two_view_geometry.cam2_from_cam1 =
+        reconstruction.Image(image_id2).CamFromWorld() *
+        Inverse(reconstruction.Image(image_id1).CamFromWorld());
+    two_view_geometry.cam2_from_cam1.translation.normalize();
+    two_view_geometry.tri_angle = DegToRad(10.0);
+    database->WriteTwoViewGeometry(image_id1, image_id2, two_view_geometry);
+  }
+}
+
+TEST(GlobalMapperController, WithoutNoise) {
+  const std::string database_path = CreateTestDir() + "/database.db";
+
+  Database database(database_path);
+  Reconstruction gt_reconstruction;
+  SyntheticDatasetOptions synthetic_dataset_options;
+  synthetic_dataset_options.num_cameras = 2;
+  synthetic_dataset_options.num_images = 10;
+  synthetic_dataset_options.num_points3D = 100;
+  synthetic_dataset_options.point2D_stddev = 0;
+  SynthesizeDataset(synthetic_dataset_options, &gt_reconstruction, &database);
+  WriteRelativePoses(gt_reconstruction, &database);
+
+  auto reconstruction_manager = std::make_shared<ReconstructionManager>();
+  GlobalMapperController::Options mapper_options;
+  mapper_options.database_path = database_path;
+  GlobalMapperController mapper(mapper_options, reconstruction_manager);
+  mapper.Start();
+  mapper.Wait();
+
+  ASSERT_EQ(reconstruction_manager->Size(), 1);
+  const Reconstruction& computed = *reconstruction_manager->Get(0);
+  EXPECT_EQ(computed.NumRegImages(), gt_reconstruction.NumRegImages());
+
+  Sim3d gt_from_computed;
+  ASSERT_TRUE(AlignReconstructionsViaProjCenters(computed,
+                                                 gt_reconstruction,
+                                                 /*max_proj_center_error=*/0.1,
+                                                 &gt_from_computed));
+  const std::vector<ImageAlignmentError> errors =
+      ComputeImageAlignmentError(computed, gt_reconstruction, gt_from_computed);
+  EXPECT_EQ(errors.size(), gt_reconstruction.NumImages());
+  for (const auto& error : errors) {
+    EXPECT_LT(error.rotation_error_deg, 1e-2);
+    EXPECT_LT(error.proj_center_error, 1e-3);
+  }
+}
+
+TEST(GlobalMapperController, WithoutRelativePoses) {
+  const std::string database_path = CreateTestDir() + "/database.db";
+
+  Database database(database_path);
+  Reconstruction gt_reconstruction;
+  SyntheticDatasetOptions synthetic_dataset_options;
+  synthetic_dataset_options.num_images = 5;
+  SynthesizeDataset(synthetic_dataset_options, &gt_reconstruction, &database);
+
+  // Without estimated relative poses, no images can be registered.
+  auto reconstruction_manager = std::make_shared<ReconstructionManager>();
+  GlobalMapperController::Options mapper_options;
+  mapper_options.database_path = database_path;
+  GlobalMapperController mapper(mapper_options, reconstruction_manager);
+  mapper.Start();
+  mapper.Wait();
+
+  EXPECT_EQ(reconstruction_manager->Size(), 0);
+}
+
+}  // namespace
+}  // namespace colmap
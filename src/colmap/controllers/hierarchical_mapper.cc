@@ -36,18 +36,19 @@
 namespace colmap {
 namespace {
 
-void MergeClusters(const SceneClustering::Cluster& cluster,
-                   std::unordered_map<const SceneClustering::Cluster*,
-                                      std::shared_ptr<ReconstructionManager>>*
-                       reconstruction_managers) {
+// Merge the reconstructions of the child clusters. The reconstruction manager
+// of the cluster must already exist, such that concurrent merges of clusters on
+// the same level of the hierarchy only read from the map.
+void MergeChildClusters(
+    const SceneClustering::Cluster& cluster,
+    const int num_threads,
+    const std::unordered_map<const SceneClustering::Cluster*,
+                             std::shared_ptr<ReconstructionManager>>&
+        reconstruction_managers) {
   // Extract all reconstructions from all child clusters.
   std::vector<std::shared_ptr<Reconstruction>> reconstructions;
   for (const auto& child_cluster : cluster.child_clusters) {
-    if (!child_cluster.child_clusters.empty()) {
-      MergeClusters(child_cluster, reconstruction_managers);
-    }
-
-    auto& reconstruction_manager = reconstruction_managers->at(&child_cluster);
+    auto& reconstruction_manager = reconstruction_managers.at(&child_cluster);
     for (size_t i = 0; i < reconstruction_manager->Size(); ++i) {
       reconstructions.push_back(reconstruction_manager->Get(i));
     }
@@ -63,7 +64,9 @@ void MergeClusters(const SceneClustering::Cluster& cluster,
         const int num_reg_images_j = reconstructions[j]->NumRegImages();
         if (MergeReconstructions(kMaxReprojError,
                                  *reconstructions[j],
-                                 reconstructions[i].get())) {
+                                 reconstructions[i].get(),
+                                 /*align=*/true,
+                                 num_threads)) {
           LOG(INFO) << StringPrintf(
               "=> Merged clusters with %d and %d images into %d images",
               num_reg_images_i,
@@ -85,16 +88,68 @@ void MergeClusters(const SceneClustering::Cluster& cluster,
     }
   }
 
-  // Insert a new reconstruction manager for merged cluster.
-  auto& reconstruction_manager = (*reconstruction_managers)[&cluster];
-  reconstruction_manager = std::make_shared<ReconstructionManager>();
+  auto& reconstruction_manager = reconstruction_managers.at(&cluster);
   for (const auto& reconstruction : reconstructions) {
     reconstruction_manager->Get(reconstruction_manager->Add()) = reconstruction;
   }
+}
 
-  // Delete all merged child cluster reconstruction managers.
-  for (const auto& child_cluster : cluster.child_clusters) {
-    reconstruction_managers->erase(&child_cluster);
+// Merge the cluster hierarchy bottom-up. Clusters on the same level do not
+// share any reconstructions and are merged in parallel, starting from the
+// deepest level. Each cluster merges its children in their fixed order, so the
+// result does not depend on the scheduling of the threads.
+void MergeClusters(const SceneClustering::Cluster& root_cluster,
+                   const int num_workers,
+                   const int num_threads,
+                   std::unordered_map<const SceneClustering::Cluster*,
+                                      std::shared_ptr<ReconstructionManager>>*
+                       reconstruction_managers) {
+  std::vector<std::vector<const SceneClustering::Cluster*>> levels;
+  std::vector<const SceneClustering::Cluster*> level_clusters = {&root_cluster};
+  while (!level_clusters.empty()) {
+    std::vector<const SceneClustering::Cluster*> non_leaf_clusters;
+    std::vector<const SceneClustering::Cluster*> child_clusters;
+    for (const auto* cluster : level_clusters) {
+      if (!cluster->child_clusters.empty()) {
+        non_leaf_clusters.push_back(cluster);
+        for (const auto& child_cluster : cluster->child_clusters) {
+          child_clusters.push_back(&child_cluster);
+        }
+      }
+    }
+    if (!non_leaf_clusters.empty()) {
+      levels.push_back(std::move(non_leaf_clusters));
+    }
+    level_clusters = std::move(child_clusters);
+  }
+
+  ThreadPool thread_pool(num_workers);
+  for (auto level = levels.rbegin(); level != levels.rend(); ++level) {
+    for (const auto* cluster : *level) {
+      (*reconstruction_managers)[cluster] =
+          std::make_shared<ReconstructionManager>();
+    }
+
+    // The threads not occupied by concurrent merges align the reconstructions.
+    const int num_threads_per_merge = std::max(
+        1,
+        num_threads /
+            std::min(num_workers, static_cast<int>(level->size())));
+    for (const auto* cluster : *level) {
+      thread_pool.AddTask(
+          [cluster, num_threads_per_merge, reconstruction_managers]() {
+            MergeChildClusters(
+                *cluster, num_threads_per_merge, *reconstruction_managers);
+          });
+    }
+    thread_pool.Wait();
+
+    // Delete all merged child cluster reconstruction managers.
+    for (const auto* cluster : *level) {
+      for (const auto& child_cluster : cluster->child_clusters) {
+        reconstruction_managers->erase(&child_cluster);
+      }
+    }
   }
 }
 
@@ -226,7 +281,10 @@ void HierarchicalMapperController::Run() {
 
   PrintHeading1("Merging clusters");
 
-  MergeClusters(*scene_clustering.GetRootCluster(), &reconstruction_managers);
+  MergeClusters(*scene_clustering.GetRootCluster(),
+                num_eff_workers,
+                num_eff_threads,
+                &reconstruction_managers);
 
   CHECK_EQ(reconstruction_managers.size(), 1);
   CHECK_GT(reconstruction_managers.begin()->second->Get(0)->NumRegImages(), 0);
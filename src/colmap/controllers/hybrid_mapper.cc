@@ -2,8 +2,99 @@
 
 #include "colmap/util/misc.h"
 
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <future>
+
 namespace colmap {
 namespace {
+
+// The stages of the hybrid mapper, after which checkpoints are written.
+enum class CheckpointStage {
+  kNone = 0,
+  kPartition = 1,
+  kClusters = 2,
+  kPoseGraph = 3,
+  kInlierTracks = 4,
+};
+
+// The last completed stage and the number of completed weak area revisits
+// after the cluster reconstruction, which are written to a text file after
+// the data of the stage.
+struct CheckpointState {
+  CheckpointStage stage = CheckpointStage::kNone;
+  size_t num_weak_area_revisits = 0;
+};
+
+const char kCheckpointStateFileName[] = "checkpoint.txt";
+
+CheckpointState ReadCheckpointState(const std::string& checkpoint_path) {
+  CheckpointState state;
+  const std::string path =
+      JoinPaths(checkpoint_path, kCheckpointStateFileName);
+  if (!ExistsFile(path)) {
+    return state;
+  }
+  std::ifstream file(path);
+  CHECK(file.is_open()) << path;
+  int stage = 0;
+  file >> stage >> state.num_weak_area_revisits;
+  CHECK(!file.fail()) << "Invalid checkpoint state in " << path;
+  state.stage = static_cast<CheckpointStage>(stage);
+  return state;
+}
+
+// Replace the state file by renaming, such that an interrupted write leaves
+// the state of the previous stage intact.
+void WriteCheckpointState(const std::string& checkpoint_path,
+                          const CheckpointState& state) {
+  const std::string path =
+      JoinPaths(checkpoint_path, kCheckpointStateFileName);
+  const std::string tmp_path = path + ".tmp";
+  {
+    std::ofstream file(tmp_path, std::ios::trunc);
+    CHECK(file.is_open()) << tmp_path;
+    file << static_cast<int>(state.stage) << " "
+         << state.num_weak_area_revisits << "\n";
+  }
+  CHECK_EQ(std::rename(tmp_path.c_str(), path.c_str()), 0) << path;
+}
+
+// Write the reconstructions into sub-folders "0", "1", "2", ... of the path.
+void WriteCheckpointReconstructions(
+    const std::string& path,
+    const std::vector<std::shared_ptr<const Reconstruction>>&
+        reconstructions) {
+  CreateDirIfNotExists(path, /*recursive=*/true);
+  for (size_t i = 0; i < reconstructions.size(); ++i) {
+    const std::string reconstruction_path = JoinPaths(path, std::to_string(i));
+    CreateDirIfNotExists(reconstruction_path);
+    reconstructions[i]->WriteBinary(reconstruction_path);
+  }
+}
+
+std::shared_ptr<ReconstructionManager> ReadCheckpointReconstructions(
+    const std::string& path) {
+  CHECK(ExistsDir(path)) << path;
+  auto reconstruction_manager = std::make_shared<ReconstructionManager>();
+  for (size_t i = 0; ExistsDir(JoinPaths(path, std::to_string(i))); ++i) {
+    reconstruction_manager->Read(JoinPaths(path, std::to_string(i)));
+  }
+  return reconstruction_manager;
+}
+
+std::vector<std::shared_ptr<const Reconstruction>> CollectReconstructions(
+    const std::vector<std::shared_ptr<ReconstructionManager>>&
+        reconstruction_managers) {
+  std::vector<std::shared_ptr<const Reconstruction>> reconstructions;
+  for (const auto& reconstruction_manager : reconstruction_managers) {
+    for (size_t i = 0; i < reconstruction_manager->Size(); ++i) {
+      reconstructions.push_back(reconstruction_manager->Get(i));
+    }
+  }
+  return reconstructions;
+}
 void AdjustGlobalBundle(const IncrementalMapperOptions& options,
                         IncrementalMapper* mapper) {
   BundleAdjustmentOptions custom_ba_options = options.GlobalBundleAdjustment();
@@ -76,22 +167,36 @@ void IterativeGlobalRefinement(const IncrementalMapperOptions& options,
 HybridMapper::Options HybridMapperController::Options::Mapper() const {
   HybridMapper::Options options;
   options.num_workers = num_workers;
+  options.max_memory_usage_mb = max_memory_usage_mb;
   options.re_max_num_images = re_max_num_images;
   options.re_max_distance = re_max_distance;
+  options.re_max_overlap_ratio = re_max_overlap_ratio;
+  options.re_reuse_poses = re_reuse_poses;
   options.pgo_rel_pose_multi = pgo_rel_pose_multi;
+  options.pgo_use_pose_covariance = pgo_use_pose_covariance;
   options.pgo_abs_pose_multi = pgo_abs_pose_multi;
   options.pgo_smooth_multi = pgo_smooth_multi;
+  CHECK(ceres::StringToLinearSolverType(
+      pgo_linear_solver_type, &options.pgo_options.linear_solver_type));
+  options.pgo_options.use_analytic_jacobians = pgo_use_analytic_jacobians;
+  options.pgo_options.num_threads = incremental_options.num_threads;
   return options;
 }
 
 bool HybridMapperController::Options::Check() const {
   CHECK_OPTION_GE(num_workers, -1);
+  CHECK_OPTION(!resume || !checkpoint_path.empty());
   CHECK_OPTION_GE(max_num_weak_area_revisit, 0);
   CHECK_OPTION_GT(re_max_num_images, 0);
   CHECK_OPTION_GT(re_max_distance, 0);
+  CHECK_OPTION_GE(re_max_overlap_ratio, 0);
+  CHECK_OPTION_LE(re_max_overlap_ratio, 1);
   CHECK_OPTION_GE(pgo_rel_pose_multi, 0);
   CHECK_OPTION_GE(pgo_abs_pose_multi, 0);
   CHECK_OPTION_GE(pgo_smooth_multi, 0);
+  ceres::LinearSolverType linear_solver_type;
+  CHECK_OPTION(ceres::StringToLinearSolverType(pgo_linear_solver_type,
+                                               &linear_solver_type));
   clustering_options.Check();
   CHECK_EQ(clustering_options.branching, 2);
   incremental_options.Check();
@@ -135,22 +240,120 @@ void HybridMapperController::Run() {
                              options_.image_path);
   hybrid_mapper.BeginReconstruction(global_recon);
 
+  //////////////////////////////////////////////////////////////////////////////
+  // Checkpoints
+  //////////////////////////////////////////////////////////////////////////////
+
+  const std::string& checkpoint_path = options_.checkpoint_path;
+  CheckpointState checkpoint_state;
+  if (!checkpoint_path.empty()) {
+    CreateDirIfNotExists(checkpoint_path, /*recursive=*/true);
+    if (options_.resume) {
+      checkpoint_state = ReadCheckpointState(checkpoint_path);
+      LOG(INFO) << StringPrintf(
+          "Resuming after stage %d with %d weak area revisits",
+          static_cast<int>(checkpoint_state.stage),
+          static_cast<int>(checkpoint_state.num_weak_area_revisits));
+    }
+  }
+
+  // The checkpoints are written in the background, followed by the state of
+  // the completed stage. At most one checkpoint is pending at a time. The
+  // writers only hold references to reconstructions that are not modified
+  // until the pending checkpoint is waited for, or to copies.
+  std::future<void> checkpoint_writer;
+  const auto write_checkpoint = [&](const CheckpointState& state,
+                                    std::function<void()> write_data) {
+    if (checkpoint_path.empty()) {
+      return;
+    }
+    if (checkpoint_writer.valid()) {
+      checkpoint_writer.get();
+    }
+    checkpoint_writer = std::async(
+        std::launch::async, [checkpoint_path, state, write_data]() {
+          write_data();
+          WriteCheckpointState(checkpoint_path, state);
+        });
+  };
+  const auto wait_checkpoint = [&checkpoint_writer]() {
+    if (checkpoint_writer.valid()) {
+      checkpoint_writer.get();
+    }
+  };
+
   //////////////////////////////////////////////////////////////////////////////
   // Cluster scene
   //////////////////////////////////////////////////////////////////////////////
 
-  hybrid_mapper.PartitionScene(options_.clustering_options);
+  const std::string partition_path =
+      JoinPaths(checkpoint_path, "partition.txt");
+  if (checkpoint_state.stage >= CheckpointStage::kPartition) {
+    hybrid_mapper.ReadPartition(options_.clustering_options, partition_path);
+  } else {
+    hybrid_mapper.PartitionScene(options_.clustering_options);
+    write_checkpoint({CheckpointStage::kPartition, 0},
+                     [&hybrid_mapper, partition_path]() {
+                       hybrid_mapper.WritePartition(partition_path);
+                     });
+  }
 
   //////////////////////////////////////////////////////////////////////////////
   // Reconstruct clusters
   //////////////////////////////////////////////////////////////////////////////
 
-  PrintHeading1("Reconstructing clusters");
-  hybrid_mapper.ReconstructClusters(options_.Mapper());
+  const std::string clusters_path = JoinPaths(checkpoint_path, "clusters");
+  if (checkpoint_state.stage >= CheckpointStage::kClusters) {
+    PrintHeading1("Reading cluster reconstructions");
+    std::vector<std::shared_ptr<ReconstructionManager>> reconstruction_managers;
+    for (size_t i = 0; ExistsDir(JoinPaths(clusters_path, std::to_string(i)));
+         ++i) {
+      reconstruction_managers.push_back(ReadCheckpointReconstructions(
+          JoinPaths(clusters_path, std::to_string(i))));
+    }
+    hybrid_mapper.SetLeafReconstructionManagers(reconstruction_managers);
+  } else {
+    PrintHeading1("Reconstructing clusters");
+    hybrid_mapper.ReconstructClusters(options_.Mapper());
+    const auto reconstruction_managers =
+        hybrid_mapper.GetLeafReconstructionManagers();
+    write_checkpoint({CheckpointStage::kClusters, 0},
+                     [reconstruction_managers, clusters_path]() {
+                       for (size_t i = 0; i < reconstruction_managers.size();
+                            ++i) {
+                         WriteCheckpointReconstructions(
+                             JoinPaths(clusters_path, std::to_string(i)),
+                             CollectReconstructions(
+                                 {reconstruction_managers[i]}));
+                       }
+                     });
+  }
 
+  const std::string weak_areas_path = JoinPaths(checkpoint_path, "weak_areas");
   for (size_t i = 0; i < options_.max_num_weak_area_revisit; i++) {
+    const std::string weak_area_path =
+        JoinPaths(weak_areas_path, std::to_string(i));
+    if (i < checkpoint_state.num_weak_area_revisits) {
+      hybrid_mapper.AddWeakAreaReconstructionManager(
+          ReadCheckpointReconstructions(weak_area_path));
+      continue;
+    }
+
     PrintHeading1("Reconstructing weak areas");
+    const auto& weak_area_managers =
+        hybrid_mapper.GetWeakAreaReconstructionManagers();
+    const size_t num_prev_weak_areas = weak_area_managers.size();
     hybrid_mapper.ReconstructWeakArea(options_.Mapper());
+    const std::vector<std::shared_ptr<ReconstructionManager>>
+        new_weak_area_managers(weak_area_managers.begin() + num_prev_weak_areas,
+                               weak_area_managers.end());
+    const auto weak_area_reconstructions =
+        CollectReconstructions(new_weak_area_managers);
+    write_checkpoint({CheckpointStage::kClusters, i + 1},
+                     [weak_area_reconstructions, weak_area_path]() {
+                       WriteCheckpointReconstructions(
+                           weak_area_path, weak_area_reconstructions);
+                     });
   }
 
   // Abuse reconstruction_manager to store intermediate steps (not good, but do
@@ -166,11 +369,47 @@ void HybridMapperController::Run() {
     }
   }
 
-  PrintHeading1("Global pose graph optimization");
-  hybrid_mapper.GlobalPoseGraphOptim(options_.Mapper());
+  const std::string pose_graph_path = JoinPaths(checkpoint_path, "pose_graph");
+  const std::string inlier_tracks_path =
+      JoinPaths(checkpoint_path, "inlier_tracks");
+  if (checkpoint_state.stage >= CheckpointStage::kInlierTracks) {
+    PrintHeading1("Reading reconstruction of inlier tracks");
+    Reconstruction reconstruction;
+    reconstruction.ReadBinary(inlier_tracks_path);
+    hybrid_mapper.RestoreReconstruction(reconstruction);
+  } else {
+    const size_t num_weak_area_revisits = options_.max_num_weak_area_revisit;
+    if (checkpoint_state.stage >= CheckpointStage::kPoseGraph) {
+      PrintHeading1("Reading pose graph optimization result");
+      Reconstruction reconstruction;
+      reconstruction.ReadBinary(pose_graph_path);
+      hybrid_mapper.RestoreReconstruction(reconstruction);
+    } else {
+      PrintHeading1("Global pose graph optimization");
+      hybrid_mapper.GlobalPoseGraphOptim(options_.Mapper());
+      auto reconstruction =
+          std::make_shared<const Reconstruction>(*global_recon);
+      write_checkpoint(
+          {CheckpointStage::kPoseGraph, num_weak_area_revisits},
+          [reconstruction, pose_graph_path]() {
+            CreateDirIfNotExists(pose_graph_path);
+            reconstruction->WriteBinary(pose_graph_path);
+          });
+    }
 
-  PrintHeading1("Reconstruct inlier tracks");
-  hybrid_mapper.ReconstructInlierTracks(options_.Mapper());
+    // The merging of the clusters modifies the cluster reconstructions, which
+    // may still be written by a pending checkpoint.
+    wait_checkpoint();
+
+    PrintHeading1("Reconstruct inlier tracks");
+    hybrid_mapper.ReconstructInlierTracks(options_.Mapper());
+    auto reconstruction = std::make_shared<const Reconstruction>(*global_recon);
+    write_checkpoint({CheckpointStage::kInlierTracks, num_weak_area_revisits},
+                     [reconstruction, inlier_tracks_path]() {
+                       CreateDirIfNotExists(inlier_tracks_path);
+                       reconstruction->WriteBinary(inlier_tracks_path);
+                     });
+  }
 
   if (options_.show_pgo_result) {
     // Make a copy of the current stage of reconstruction and write out.
@@ -194,11 +433,18 @@ void HybridMapperController::Run() {
   IncrementalMapper incremental_mapper(database_cache_);
   incremental_mapper.BeginReconstruction(global_recon);
 
-  IterativeGlobalRefinement(options_.incremental_options, &incremental_mapper);
+  // The final global refinement determines the accuracy of the result.
+  IncrementalMapperOptions final_options = options_.incremental_options;
+  final_options.ba_global_stage =
+      BundleAdjustmentOptions::Stage::HYBRID_FINAL;
+  IterativeGlobalRefinement(final_options, &incremental_mapper);
+
+  wait_checkpoint();
 
   if (options_.incremental_options.extract_colors) {
     PrintHeading1("Extracting color");
-    global_recon->ExtractColorsForAllImages(options_.image_path);
+    global_recon->ExtractColorsForAllImages(
+        options_.image_path, options_.incremental_options.num_threads);
   }
 
   hybrid_mapper.EndReconstruction();
@@ -212,16 +458,16 @@ bool HybridMapperController::LoadDatabase() {
   PrintHeading1("Loading database");
 
   std::unordered_set<std::string> image_names;
-  Database database(options_.database_path);
   Timer timer;
   timer.Start();
   const size_t min_num_matches =
       static_cast<size_t>(options_.incremental_options.min_num_matches);
-  database_cache_ =
-      DatabaseCache::Create(database,
-                            min_num_matches,
-                            options_.incremental_options.ignore_watermarks,
-                            image_names);
+  database_cache_ = DatabaseCache::CreateOrRetain(
+      options_.database_path,
+      min_num_matches,
+      options_.incremental_options.ignore_watermarks,
+      image_names,
+      options_.incremental_options.database_cache_path);
   timer.PrintMinutes();
 
   if (database_cache_->NumImages() == 0) {
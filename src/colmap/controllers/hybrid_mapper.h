@@ -19,6 +19,10 @@ class HybridMapperController : public Thread {
     // The number of workers used to reconstruct clusters in parallel.
     int num_workers = -1;
 
+    // The maximum memory in megabytes of the clusters reconstructed in
+    // parallel. Unlimited if <= 0.
+    int max_memory_usage_mb = -1;
+
     // The maxinum number of weak area revists.
     size_t max_num_weak_area_revisit = 1;
 
@@ -28,10 +32,29 @@ class HybridMapperController : public Thread {
     // How large the radius is when selecting a weak area to revisit.
     double re_max_distance = 2.5;
 
+    // Weak areas, which share more than this ratio of the images of the
+    // smaller area, are merged into one area with the union of their images,
+    // as long as the merged area has at most twice `re_max_num_images`
+    // images. Heavily overlapping areas then do not reconstruct their shared
+    // images repeatedly. A ratio of 1 disables the merging.
+    double re_max_overlap_ratio = 1.0;
+
+    // Whether to initialize the weak areas, whose images are all registered
+    // in one of the previous sub-reconstructions, with the poses and cameras
+    // of that reconstruction. These areas are only triangulated and bundle
+    // adjusted instead of reconstructed incrementally from scratch.
+    bool re_reuse_poses = false;
+
     // The multiplier factor for the relative pose term in pose graph
     // optimization.
     double pgo_rel_pose_multi = 1.0;
 
+    // Whether to weight the relative pose terms in pose graph optimization by
+    // the inverse covariances of the relative poses, as estimated from the
+    // bundle adjustment problems of the sub-reconstructions, instead of the
+    // identity.
+    bool pgo_use_pose_covariance = false;
+
     // The multiplier factor for the absolute pose prior term in pose graph
     // optimization.
     double pgo_abs_pose_multi = 0.001;
@@ -40,6 +63,13 @@ class HybridMapperController : public Thread {
     // optimization.
     double pgo_smooth_multi = 2.0;
 
+    // The linear solver of the pose graph optimization, e.g.,
+    // SPARSE_NORMAL_CHOLESKY, ITERATIVE_SCHUR, or CGNR for very large graphs.
+    std::string pgo_linear_solver_type = "SPARSE_NORMAL_CHOLESKY";
+
+    // Whether to use analytic derivatives in the pose graph optimization.
+    bool pgo_use_analytic_jacobians = true;
+
     // Whether to additionally export the optimized pose graph results together
     // with the reconstruction.
     bool show_pgo_result = false;
@@ -48,6 +78,18 @@ class HybridMapperController : public Thread {
     // the reconstruction.
     bool show_clusters = false;
 
+    // The path to a directory, to which the state of the mapper is written
+    // after every stage, i.e., the partition, the cluster and weak area
+    // reconstructions, and the global reconstruction after the pose graph
+    // optimization and the re-triangulation of the inlier tracks. Disabled if
+    // empty.
+    std::string checkpoint_path;
+
+    // Whether to resume the mapping after the last stage in the checkpoint
+    // directory instead of starting over. The database and options must be the
+    // same as in the interrupted run.
+    bool resume = false;
+
     // Options for clustering the scene graph.
     SceneClustering::Options clustering_options;
 
@@ -69,7 +111,7 @@ class HybridMapperController : public Thread {
 
   const Options options_;
   std::shared_ptr<ReconstructionManager> reconstruction_manager_;
-  std::shared_ptr<DatabaseCache> database_cache_;
+  std::shared_ptr<const DatabaseCache> database_cache_;
 };
 
 }  // namespace colmap
\ No newline at end of file
@@ -37,6 +37,13 @@ namespace colmap {
 
 bool ImageReaderOptions::Check() const {
   CHECK_OPTION_GT(default_focal_length_factor, 0.0);
+  CHECK_OPTION_GT(database_commit_num_images, 0);
+  CHECK_OPTION_GT(database_commit_size_mb, 0.0);
+  CHECK_OPTION_NE(num_read_threads, 0);
+  CHECK_OPTION(preprocessing.Check());
+  if (select_keyframes) {
+    CHECK_OPTION(keyframe_selection.Check());
+  }
   CHECK_OPTION(ExistsCameraModelWithName(camera_model));
   const CameraModelId model_id = CameraModelNameToId(camera_model);
   if (!camera_params.empty()) {
@@ -52,11 +59,19 @@ bool ImageReaderOptions::Check() const {
     CHECK_OPTION(CameraRefracModelVerifyParams(
         refrac_model_id, CSVToVector<double>(camera_refrac_params)));
   }
+  if (!pose_prior_navigation_log_path.empty()) {
+    CHECK_OPTION(pose_prior_path.empty());
+    CHECK_OPTION(!image_timestamps_path.empty());
+  }
   return true;
 }
 
 ImageReader::ImageReader(const ImageReaderOptions& options, Database* database)
-    : options_(options), database_(database), image_index_(0) {
+    : options_(options),
+      database_(database),
+      image_index_(0),
+      has_pose_priors_(false),
+      next_decode_index_(0) {
   CHECK(options_.Check());
 
   // Ensure trailing slash, so that we can build the correct image name.
@@ -69,7 +84,8 @@ ImageReader::ImageReader(const ImageReaderOptions& options, Database* database)
 
   // Get a list of all files in the image path, sorted by image name.
   if (options_.image_list.empty()) {
-    options_.image_list = GetRecursiveFileList(options_.image_path);
+    options_.image_list =
+        GetRecursiveFileList(options_.image_path, options_.num_read_threads);
     std::sort(options_.image_list.begin(), options_.image_list.end());
   } else {
     if (!std::is_sorted(options_.image_list.begin(),
@@ -81,9 +97,16 @@ ImageReader::ImageReader(const ImageReaderOptions& options, Database* database)
     }
   }
 
+  IndexExistingImages();
+
   if (static_cast<camera_t>(options_.existing_camera_id) != kInvalidCameraId) {
     CHECK(database->ExistsCamera(options_.existing_camera_id));
     prev_camera_ = database->ReadCamera(options_.existing_camera_id);
+  } else if (options_.resume && options_.single_camera &&
+             !options_.single_camera_per_folder && !existing_images_.empty()) {
+    // Continue with the single camera of the existing images.
+    prev_camera_ =
+        database->ReadCamera(existing_images_.begin()->second.CameraId());
   } else {
     // Set the manually specified camera parameters.
     prev_camera_.camera_id = kInvalidCameraId;
@@ -105,6 +128,21 @@ ImageReader::ImageReader(const ImageReaderOptions& options, Database* database)
       }
     }
   }
+
+  const int num_read_threads = GetEffectiveNumThreads(options_.num_read_threads);
+  if (num_read_threads > 1) {
+    decode_thread_pool_ = std::make_unique<ThreadPool>(num_read_threads);
+  }
+
+  has_pose_priors_ = options_.pose_prior_path != "/" ||
+                     !options_.pose_prior_navigation_log_path.empty();
+  if (has_pose_priors_) {
+    ReadPosePriors();
+  }
+
+  if (options_.resume) {
+    DropExistingImages();
+  }
 }
 
 ImageReader::Status ImageReader::Next(Camera* camera,
@@ -120,17 +158,11 @@ ImageReader::Status ImageReader::Next(Camera* camera,
 
   const std::string image_path = options_.image_list.at(image_index_ - 1);
 
-  DatabaseTransaction database_transaction(database_);
-
   //////////////////////////////////////////////////////////////////////////////
   // Set the image name.
   //////////////////////////////////////////////////////////////////////////////
 
-  image->SetName(image_path);
-  image->SetName(StringReplace(image->Name(), "\\", "/"));
-  image->SetName(
-      image->Name().substr(options_.image_path.size(),
-                           image->Name().size() - options_.image_path.size()));
+  image->SetName(ImageName(image_path));
 
   const std::string image_folder = GetParentDir(image->Name());
 
@@ -138,38 +170,49 @@ ImageReader::Status ImageReader::Next(Camera* camera,
   // Check if image already read.
   //////////////////////////////////////////////////////////////////////////////
 
-  const bool exists_image = database_->ExistsImageWithName(image->Name());
+  // The image was scheduled for decoding before, if decoding in parallel.
+  DecodedImage decoded_image;
+  if (decode_thread_pool_) {
+    ScheduleDecoding();
+    decoded_image = decode_futures_.front().get();
+    decode_futures_.pop_front();
+  }
 
-  if (exists_image) {
-    *image = database_->ReadImageWithName(image->Name());
-    const bool exists_keypoints = database_->ExistsKeypoints(image->ImageId());
-    const bool exists_descriptors =
-        database_->ExistsDescriptors(image->ImageId());
+  const auto existing_image_it = existing_images_.find(image->Name());
+  const bool exists_image = existing_image_it != existing_images_.end();
 
-    if (exists_keypoints && exists_descriptors) {
+  if (exists_image) {
+    *image = existing_image_it->second;
+    if (existing_image_ids_with_features_.count(image->ImageId()) > 0) {
       return Status::IMAGE_EXISTS;
     }
   }
 
+  DatabaseTransaction database_transaction(database_);
+
   //////////////////////////////////////////////////////////////////////////////
   // Read image.
   //////////////////////////////////////////////////////////////////////////////
 
-  if (!bitmap->Read(image_path, false)) {
+  if (!decoded_image.is_decoded) {
+    decoded_image = Decode(image_path, image->Name());
+  }
+
+  if (!decoded_image.bitmap_ok) {
     return Status::BITMAP_ERROR;
   }
+  *bitmap = std::move(decoded_image.bitmap);
 
   //////////////////////////////////////////////////////////////////////////////
   // Read mask.
   //////////////////////////////////////////////////////////////////////////////
 
-  if (mask && !options_.mask_path.empty()) {
-    const std::string mask_path =
-        JoinPaths(options_.mask_path, image->Name() + ".png");
-    if (ExistsFile(mask_path) && !mask->Read(mask_path, false)) {
-      // NOTE: Maybe introduce a separate error type MASK_ERROR?
-      return Status::BITMAP_ERROR;
-    }
+  if (!decoded_image.mask_ok) {
+    // NOTE: Maybe introduce a separate error type MASK_ERROR?
+    return Status::BITMAP_ERROR;
+  }
+  if (mask && decoded_image.mask.Data()) {
+    *mask = std::move(decoded_image.mask);
   }
 
   //////////////////////////////////////////////////////////////////////////////
@@ -206,6 +249,25 @@ ImageReader::Status ImageReader::Next(Camera* camera,
       return Status::CAMERA_SINGLE_DIM_ERROR;
     }
 
+    //////////////////////////////////////////////////////////////////////////////
+    // Continue with the camera of the existing images in the sub-folder
+    //////////////////////////////////////////////////////////////////////////////
+
+    if (options_.resume && options_.single_camera_per_folder &&
+        image_folders_.count(image_folder) == 0) {
+      const auto folder_camera_it =
+          existing_folder_camera_ids_.find(image_folder);
+      if (folder_camera_it != existing_folder_camera_ids_.end()) {
+        Camera camera = database_->ReadCamera(folder_camera_it->second);
+        if (camera.width != static_cast<size_t>(bitmap->Width()) ||
+            camera.height != static_cast<size_t>(bitmap->Height())) {
+          return Status::CAMERA_SINGLE_DIM_ERROR;
+        }
+        prev_camera_ = std::move(camera);
+        image_folders_.insert(image_folder);
+      }
+    }
+
     //////////////////////////////////////////////////////////////////////////////
     // Read camera model and check for consistency if it exists
     //////////////////////////////////////////////////////////////////////////////
@@ -288,20 +350,12 @@ ImageReader::Status ImageReader::Next(Camera* camera,
     // Extract GPS data (extended to read pose prior data from `.csv` file).
     //////////////////////////////////////////////////////////////////////////////
 
-    if (options_.pose_prior_path != "/") {
-      std::string root, ext;
-      SplitFileExtension(image->Name(), &root, &ext);
-      const std::string pose_prior_path =
-          JoinPaths(options_.pose_prior_path, root + ".csv");
-      Rigid3d prior_from_world;
-      Eigen::Matrix7d prior_from_world_cov;
-      if (ExistsFile(pose_prior_path) &&
-          !pose_prior_.Read(
-              pose_prior_path, &prior_from_world, &prior_from_world_cov)) {
+    if (has_pose_priors_) {
+      if (pose_prior_status_[image_index_ - 1] == PosePriorStatus::INVALID) {
         return Status::POSE_PRIOR_ERROR;
       }
-      image->CamFromWorldPrior() = prior_from_world;
-      image->CamFromWorldPriorCov() = prior_from_world_cov;
+      image->CamFromWorldPrior() = prior_from_worlds_[image_index_ - 1];
+      image->CamFromWorldPriorCov() = prior_from_world_covs_[image_index_ - 1];
     } else {
       Eigen::Vector3d& translation_prior =
           image->CamFromWorldPrior().translation;
@@ -323,6 +377,235 @@ ImageReader::Status ImageReader::Next(Camera* camera,
 
 size_t ImageReader::NextIndex() const { return image_index_; }
 
+void ImageReader::ReadPosePriors() {
+  const size_t num_images = options_.image_list.size();
+  pose_prior_status_.assign(num_images, PosePriorStatus::MISSING);
+  prior_from_worlds_.assign(num_images, Rigid3d());
+  prior_from_world_covs_.assign(num_images, Eigen::Matrix7d::Zero());
+
+  std::vector<size_t> image_idxs;
+  std::vector<Rigid3d> prior_from_worlds;
+  std::vector<Eigen::Matrix7d> prior_from_world_covs;
+  std::vector<char> success;
+  if (options_.pose_prior_navigation_log_path.empty()) {
+    ReadPosePriorFiles(
+        &image_idxs, &prior_from_worlds, &prior_from_world_covs, &success);
+  } else {
+    ReadPosePriorNavigationLog(
+        &image_idxs, &prior_from_worlds, &prior_from_world_covs, &success);
+  }
+
+  for (size_t k = 0; k < image_idxs.size(); ++k) {
+    const size_t i = image_idxs[k];
+    if (success[k]) {
+      pose_prior_status_[i] = PosePriorStatus::VALID;
+      prior_from_worlds_[i] = prior_from_worlds[k];
+      prior_from_world_covs_[i] = prior_from_world_covs[k];
+    } else {
+      pose_prior_status_[i] = PosePriorStatus::INVALID;
+    }
+  }
+
+  // Images that already exist in the database are not written again in Next,
+  // so their priors are updated here.
+  size_t num_updated_images = 0;
+  DatabaseTransaction database_transaction(database_);
+  for (size_t i = 0; i < num_images; ++i) {
+    if (pose_prior_status_[i] != PosePriorStatus::VALID) {
+      continue;
+    }
+    const auto existing_image_it =
+        existing_images_.find(ImageName(options_.image_list[i]));
+    if (existing_image_it == existing_images_.end()) {
+      continue;
+    }
+    Image& image = existing_image_it->second;
+    image.CamFromWorldPrior() = prior_from_worlds_[i];
+    image.CamFromWorldPriorCov() = prior_from_world_covs_[i];
+    database_->UpdateImage(image);
+    num_updated_images += 1;
+  }
+
+  if (num_updated_images > 0) {
+    LOG(INFO) << "Updated the pose priors of " << num_updated_images
+              << " existing images";
+  }
+}
+
+void ImageReader::ReadPosePriorFiles(
+    std::vector<size_t>* image_idxs,
+    std::vector<Rigid3d>* prior_from_worlds,
+    std::vector<Eigen::Matrix7d>* prior_from_world_covs,
+    std::vector<char>* success) {
+  std::vector<std::string> pose_prior_paths;
+  for (size_t i = 0; i < options_.image_list.size(); ++i) {
+    std::string root, ext;
+    SplitFileExtension(ImageName(options_.image_list[i]), &root, &ext);
+    const std::string pose_prior_path =
+        JoinPaths(options_.pose_prior_path, root + ".csv");
+    if (ExistsFile(pose_prior_path)) {
+      image_idxs->push_back(i);
+      pose_prior_paths.push_back(pose_prior_path);
+    }
+  }
+
+  pose_prior_.ReadBatch(
+      pose_prior_paths, prior_from_worlds, prior_from_world_covs, success);
+}
+
+void ImageReader::ReadPosePriorNavigationLog(
+    std::vector<size_t>* image_idxs,
+    std::vector<Rigid3d>* prior_from_worlds,
+    std::vector<Eigen::Matrix7d>* prior_from_world_covs,
+    std::vector<char>* success) {
+  std::unordered_map<std::string, double> image_timestamps;
+  for (const auto& line : ReadTextFileLines(options_.image_timestamps_path)) {
+    if (line[0] == '#') {
+      continue;
+    }
+    const std::vector<std::string> values = CSVToVector<std::string>(line);
+    CHECK_EQ(values.size(), 2) << "Invalid image timestamp: " << line;
+    image_timestamps.emplace(values[0], std::stod(values[1]));
+  }
+
+  std::vector<double> timestamps;
+  for (size_t i = 0; i < options_.image_list.size(); ++i) {
+    const auto timestamp_it =
+        image_timestamps.find(ImageName(options_.image_list[i]));
+    if (timestamp_it != image_timestamps.end()) {
+      image_idxs->push_back(i);
+      timestamps.push_back(timestamp_it->second);
+    }
+  }
+
+  CHECK(pose_prior_.ReadNavigationLog(options_.pose_prior_navigation_log_path,
+                                      timestamps,
+                                      prior_from_worlds,
+                                      prior_from_world_covs,
+                                      success))
+      << "Failed to read navigation log "
+      << options_.pose_prior_navigation_log_path;
+
+  // Images outside of the time range of the log have no prior, like images
+  // without a pose prior file.
+  size_t num_valid = 0;
+  for (size_t k = 0; k < success->size(); ++k) {
+    if ((*success)[k]) {
+      (*image_idxs)[num_valid] = (*image_idxs)[k];
+      (*prior_from_worlds)[num_valid] = (*prior_from_worlds)[k];
+      (*prior_from_world_covs)[num_valid] = (*prior_from_world_covs)[k];
+      (*success)[num_valid] = true;
+      num_valid += 1;
+    }
+  }
+  if (num_valid < success->size()) {
+    LOG(WARNING) << success->size() - num_valid
+                 << " image timestamps lie outside of the navigation log";
+  }
+  image_idxs->resize(num_valid);
+  prior_from_worlds->resize(num_valid);
+  prior_from_world_covs->resize(num_valid);
+  success->resize(num_valid);
+}
+
+std::string ImageReader::ImageName(const std::string& image_path) const {
+  const std::string image_name = StringReplace(image_path, "\\", "/");
+  return image_name.substr(options_.image_path.size(),
+                           image_name.size() - options_.image_path.size());
+}
+
+void ImageReader::IndexExistingImages() {
+  std::vector<Image> images = database_->ReadAllImages();
+  existing_images_.reserve(images.size());
+  for (Image& image : images) {
+    existing_folder_camera_ids_.emplace(GetParentDir(image.Name()),
+                                        image.CameraId());
+    existing_images_.emplace(image.Name(), std::move(image));
+  }
+
+  for (const image_t image_id : database_->ReadImageIdsWithFeatures()) {
+    existing_image_ids_with_features_.insert(image_id);
+  }
+}
+
+void ImageReader::DropExistingImages() {
+  size_t num_images = 0;
+  for (size_t i = 0; i < options_.image_list.size(); ++i) {
+    if (ExistsFeatures(ImageName(options_.image_list[i]))) {
+      continue;
+    }
+    options_.image_list[num_images] = std::move(options_.image_list[i]);
+    if (has_pose_priors_) {
+      pose_prior_status_[num_images] = pose_prior_status_[i];
+      prior_from_worlds_[num_images] = prior_from_worlds_[i];
+      prior_from_world_covs_[num_images] = prior_from_world_covs_[i];
+    }
+    num_images += 1;
+  }
+
+  const size_t num_existing_images = options_.image_list.size() - num_images;
+  options_.image_list.resize(num_images);
+  if (has_pose_priors_) {
+    pose_prior_status_.resize(num_images);
+    prior_from_worlds_.resize(num_images);
+    prior_from_world_covs_.resize(num_images);
+  }
+
+  if (num_existing_images > 0) {
+    LOG(INFO) << "Resuming after " << num_existing_images
+              << " images with existing features";
+  }
+}
+
+bool ImageReader::ExistsFeatures(const std::string& image_name) const {
+  const auto existing_image_it = existing_images_.find(image_name);
+  return existing_image_it != existing_images_.end() &&
+         existing_image_ids_with_features_.count(
+             existing_image_it->second.ImageId()) > 0;
+}
+
+ImageReader::DecodedImage ImageReader::Decode(
+    const std::string& image_path, const std::string& image_name) const {
+  DecodedImage decoded_image;
+  decoded_image.is_decoded = true;
+  // Color compensation requires the color image, which is only converted to
+  // grey after preprocessing.
+  decoded_image.bitmap_ok = decoded_image.bitmap.Read(
+      image_path, /*as_rgb=*/options_.preprocessing.color_compensation);
+  if (decoded_image.bitmap_ok && !options_.mask_path.empty()) {
+    const std::string mask_path =
+        JoinPaths(options_.mask_path, image_name + ".png");
+    if (ExistsFile(mask_path)) {
+      decoded_image.mask_ok = decoded_image.mask.Read(mask_path, false);
+    }
+  }
+  return decoded_image;
+}
+
+void ImageReader::ScheduleDecoding() {
+  // The front of the queue is the image to be read next.
+  CHECK_GE(next_decode_index_, image_index_ - 1);
+  const size_t num_read_threads =
+      static_cast<size_t>(GetEffectiveNumThreads(options_.num_read_threads));
+  const size_t max_decode_index = std::min(options_.image_list.size(),
+                                           image_index_ - 1 + num_read_threads);
+  while (next_decode_index_ < max_decode_index) {
+    const std::string& image_path = options_.image_list[next_decode_index_];
+    const std::string image_name = ImageName(image_path);
+    if (ExistsFeatures(image_name)) {
+      // Return an empty result, since the image will be skipped.
+      std::promise<DecodedImage> skipped;
+      skipped.set_value(DecodedImage());
+      decode_futures_.push_back(skipped.get_future());
+    } else {
+      decode_futures_.push_back(decode_thread_pool_->AddTask(
+          &ImageReader::Decode, this, image_path, image_name));
+    }
+    next_decode_index_ += 1;
+  }
+}
+
+
 size_t ImageReader::NumImages() const { return options_.image_list.size(); }
 
 }  // namespace colmap
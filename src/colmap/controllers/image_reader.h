@@ -29,11 +29,17 @@
 
 #pragma once
 
+#include "colmap/feature/keyframes.h"
+#include "colmap/image/preprocessing.h"
 #include "colmap/scene/database.h"
 #include "colmap/sensor/bitmap.h"
 #include "colmap/util/threading.h"
 #include "colmap/geometry/pose_prior.h"
 
+#include <deque>
+#include <future>
+#include <memory>
+#include <unordered_map>
 #include <unordered_set>
 
 namespace colmap {
@@ -96,6 +102,12 @@ struct ImageReaderOptions {
   // intensity value 0 in grayscale).
   std::string camera_mask_path = "";
 
+  // Whether to drop the features of refractive cameras in image regions,
+  // whose rays do not leave the housing, e.g., due to total internal
+  // reflection. The mask of every camera is computed once from its refractive
+  // parameters.
+  bool refrac_validity_mask = false;
+
   // Optional root path to folder which contains pose prior files (stored as
   // .csv). For a given image,  the corresponding pose prior file must have the
   // same sub-path below this root as the image has below image_path. The
@@ -105,6 +117,52 @@ struct ImageReaderOptions {
   // Pitch, Roll, Latitude, Longitude, Depth.
   std::string pose_prior_path = "";
 
+  // Optional path to a single navigation log (stored as .csv) as an
+  // alternative to pose_prior_path. Besides the columns of the pose prior
+  // files, it must contain a "Time [s]" column and one row per navigation
+  // sample. The pose priors are interpolated at the timestamps of the images,
+  // which are read from image_timestamps_path with one line per image in the
+  // format IMAGE_NAME,TIMESTAMP.
+  std::string pose_prior_navigation_log_path = "";
+  std::string image_timestamps_path = "";
+
+  // The extracted features of multiple images are buffered and written to the
+  // database in a single transaction, once either the number of buffered
+  // images or the size of their features in megabytes reaches the given
+  // limit. This reduces the number of commits to the database file.
+  int database_commit_num_images = 32;
+  double database_commit_size_mb = 64.0;
+
+  // Number of threads that decode the next images in advance, while the
+  // current image is processed. The images are still returned in order. The
+  // directories of the image path are also listed with this many threads.
+  int num_read_threads = 4;
+
+  // Whether to drop the images, whose features were already extracted, from
+  // the image list before reading, such that a restarted extraction over a
+  // large image tree only reads the remaining images. Otherwise, they are
+  // returned as `Status::IMAGE_EXISTS`. The remaining images continue with
+  // the cameras of the existing images for `single_camera` and
+  // `single_camera_per_folder`.
+  bool resume = false;
+
+  // Optional preprocessing of the images before feature extraction.
+  ImagePreprocessingOptions preprocessing;
+
+  // Whether to select keyframes among the images, which are treated as
+  // sequential video frames in the order of their names, where the images of
+  // every sub-folder form a separate sequence. Only the features of the
+  // keyframes are written to the database during feature extraction and
+  // import, see `KeyframeSelector`.
+  bool select_keyframes = false;
+  KeyframeSelectionOptions keyframe_selection;
+
+  // Optional path to a text file, to which the names of the skipped
+  // non-keyframes are written, one per line. The file can be used as image
+  // list to extract their features later and to register them in an existing
+  // reconstruction with the image registrator.
+  std::string non_keyframes_path = "";
+
   bool Check() const;
 };
 
@@ -131,6 +189,49 @@ class ImageReader {
   size_t NumImages() const;
 
  private:
+  // The decoded image and mask of an image.
+  struct DecodedImage {
+    bool is_decoded = false;
+    bool bitmap_ok = false;
+    Bitmap bitmap;
+    bool mask_ok = true;
+    Bitmap mask;
+  };
+
+  // Get the image name relative to the image path.
+  std::string ImageName(const std::string& image_path) const;
+
+  // Read the pose priors of all images in a batch, either from the per-image
+  // files or from the navigation log. The priors of images that already exist
+  // in the database are updated in a single transaction.
+  void ReadPosePriors();
+  void ReadPosePriorFiles(std::vector<size_t>* image_idxs,
+                          std::vector<Rigid3d>* prior_from_worlds,
+                          std::vector<Eigen::Matrix7d>* prior_from_world_covs,
+                          std::vector<char>* success);
+  void ReadPosePriorNavigationLog(
+      std::vector<size_t>* image_idxs,
+      std::vector<Rigid3d>* prior_from_worlds,
+      std::vector<Eigen::Matrix7d>* prior_from_world_covs,
+      std::vector<char>* success);
+
+  // Index the images and cameras of the database, such that the database is
+  // not queried for every image, and drop the images with features from the
+  // image list in resume mode.
+  void IndexExistingImages();
+  void DropExistingImages();
+
+  // Whether the features of the image were already extracted.
+  bool ExistsFeatures(const std::string& image_name) const;
+
+  // Decode image and mask from file, which is thread-safe.
+  DecodedImage Decode(const std::string& image_path,
+                      const std::string& image_name) const;
+
+  // Schedule decoding of the images up to `num_read_threads` ahead of the
+  // image to be read next. Images with existing features are not decoded.
+  void ScheduleDecoding();
+
   // Image reader options.
   ImageReaderOptions options_;
   Database* database_;
@@ -143,8 +244,26 @@ class ImageReader {
   std::string prev_image_folder_;
   std::unordered_set<std::string> image_folders_;
 
+  // The images in the database before reading by name, the images with
+  // features, and the camera of the existing images of every sub-folder.
+  std::unordered_map<std::string, Image> existing_images_;
+  std::unordered_set<image_t> existing_image_ids_with_features_;
+  std::unordered_map<std::string, camera_t> existing_folder_camera_ids_;
+
   // Pose prior reader.
   PosePrior pose_prior_;
+
+  // Pose priors of the images in the image list.
+  bool has_pose_priors_;
+  enum class PosePriorStatus { MISSING, VALID, INVALID };
+  std::vector<PosePriorStatus> pose_prior_status_;
+  std::vector<Rigid3d> prior_from_worlds_;
+  std::vector<Eigen::Matrix7d> prior_from_world_covs_;
+
+  // Images that are decoded in advance, starting at the image to be read next.
+  size_t next_decode_index_;
+  std::deque<std::future<DecodedImage>> decode_futures_;
+  std::unique_ptr<ThreadPool> decode_thread_pool_;
 };
 
 }  // namespace colmap
@@ -29,7 +29,11 @@
 
 #include "colmap/controllers/incremental_mapper.h"
 
+#include "colmap/estimators/two_view_geometry.h"
 #include "colmap/util/misc.h"
+#include "colmap/util/tracing.h"
+
+#include <future>
 
 namespace colmap {
 namespace {
@@ -229,8 +233,11 @@ IncrementalMapper::Options IncrementalMapperOptions::Mapper() const {
   options.min_focal_length_ratio = min_focal_length_ratio;
   options.max_focal_length_ratio = max_focal_length_ratio;
   options.max_extra_param = max_extra_param;
-  options.num_threads = num_threads;
+  options.num_threads = NumThreads();
   options.local_ba_num_images = ba_local_num_images;
+  options.local_ba_max_num_residuals = ba_local_max_num_residuals;
+  options.global_ba_max_num_points_per_cell =
+      ba_global_max_num_points_per_cell;
   options.fix_existing_images = fix_existing_images;
   options.use_pose_prior = use_pose_prior;
   options.enable_refraction = enable_refraction;
@@ -244,6 +251,7 @@ IncrementalTriangulator::Options IncrementalMapperOptions::Triangulation()
   options.max_focal_length_ratio = max_focal_length_ratio;
   options.max_extra_param = max_extra_param;
   options.enable_refraction = enable_refraction;
+  options.num_threads = NumThreads();
   return options;
 }
 
@@ -256,9 +264,10 @@ BundleAdjustmentOptions IncrementalMapperOptions::LocalBundleAdjustment()
   options.solver_options.max_num_iterations = ba_local_max_num_iterations;
   options.solver_options.max_linear_solver_iterations = 100;
   options.solver_options.logging_type = ceres::LoggingType::SILENT;
-  options.solver_options.num_threads = num_threads;
+  options.solver_options.num_threads = NumThreads();
 #if CERES_VERSION_MAJOR < 2
-  options.solver_options.num_linear_solver_threads = num_threads;
+  options.solver_options.num_linear_solver_threads =
+      options.solver_options.num_threads;
 #endif  // CERES_VERSION_MAJOR
   options.print_summary = true;
   options.refine_focal_length = ba_refine_focal_length;
@@ -266,6 +275,8 @@ BundleAdjustmentOptions IncrementalMapperOptions::LocalBundleAdjustment()
   options.refine_extra_params = ba_refine_extra_params;
   options.min_num_residuals_for_multi_threading =
       ba_min_num_residuals_for_multi_threading;
+  options.use_gpu = ba_use_gpu;
+  options.gpu_index = ba_gpu_index;
   options.loss_function_scale = 1.0;
   options.loss_function_type =
       BundleAdjustmentOptions::LossFunctionType::SOFT_L1;
@@ -274,6 +285,9 @@ BundleAdjustmentOptions IncrementalMapperOptions::LocalBundleAdjustment()
   options.pose_prior_std = CSVToVector<double>(ba_pose_prior_std);
   options.enable_refraction = enable_refraction;
   options.refine_refrac_params = ba_refine_refrac_params;
+  options.refrac_mixed_precision = ba_refrac_mixed_precision;
+  options.adaptive_termination = ba_adaptive_termination;
+  options.SetStage(BundleAdjustmentOptions::Stage::LOCAL);
   return options;
 }
 
@@ -288,9 +302,10 @@ BundleAdjustmentOptions IncrementalMapperOptions::GlobalBundleAdjustment()
   options.solver_options.logging_type =
       ceres::LoggingType::PER_MINIMIZER_ITERATION;
   options.solver_options.minimizer_progress_to_stdout = true;
-  options.solver_options.num_threads = num_threads;
+  options.solver_options.num_threads = NumThreads();
 #if CERES_VERSION_MAJOR < 2
-  options.solver_options.num_linear_solver_threads = num_threads;
+  options.solver_options.num_linear_solver_threads =
+      options.solver_options.num_threads;
 #endif  // CERES_VERSION_MAJOR
   options.print_summary = true;
   options.refine_focal_length = ba_refine_focal_length;
@@ -298,6 +313,8 @@ BundleAdjustmentOptions IncrementalMapperOptions::GlobalBundleAdjustment()
   options.refine_extra_params = ba_refine_extra_params;
   options.min_num_residuals_for_multi_threading =
       ba_min_num_residuals_for_multi_threading;
+  options.use_gpu = ba_use_gpu;
+  options.gpu_index = ba_gpu_index;
   options.loss_function_type =
       BundleAdjustmentOptions::LossFunctionType::TRIVIAL;
   options.use_pose_prior = use_pose_prior;
@@ -306,9 +323,19 @@ BundleAdjustmentOptions IncrementalMapperOptions::GlobalBundleAdjustment()
   options.refine_prior_from_cam = ba_refine_prior_from_cam;
   options.enable_refraction = enable_refraction;
   options.refine_refrac_params = ba_refine_refrac_params;
+  options.refrac_mixed_precision = ba_refrac_mixed_precision;
+  options.adaptive_termination = ba_adaptive_termination;
+  options.SetStage(ba_global_stage);
   return options;
 }
 
+int IncrementalMapperOptions::NumThreads() const {
+  if (dynamic_num_threads) {
+    return dynamic_num_threads();
+  }
+  return num_threads;
+}
+
 bool IncrementalMapperOptions::Check() const {
   CHECK_OPTION_GT(min_num_matches, 0);
   CHECK_OPTION_GT(max_num_models, 0);
@@ -319,17 +346,21 @@ bool IncrementalMapperOptions::Check() const {
   CHECK_OPTION_GT(max_focal_length_ratio, 0);
   CHECK_OPTION_GE(max_extra_param, 0);
   CHECK_OPTION_GE(ba_local_num_images, 2);
+  CHECK_OPTION_GE(ba_local_max_num_residuals, 0);
   CHECK_OPTION_GE(ba_local_max_num_iterations, 0);
   CHECK_OPTION_GT(ba_global_images_ratio, 1.0);
   CHECK_OPTION_GT(ba_global_points_ratio, 1.0);
   CHECK_OPTION_GT(ba_global_images_freq, 0);
   CHECK_OPTION_GT(ba_global_points_freq, 0);
   CHECK_OPTION_GT(ba_global_max_num_iterations, 0);
+  CHECK_OPTION_GE(ba_global_max_num_points_per_cell, 0);
   CHECK_OPTION_GT(ba_local_max_refinements, 0);
   CHECK_OPTION_GE(ba_local_max_refinement_change, 0);
   CHECK_OPTION_GT(ba_global_max_refinements, 0);
   CHECK_OPTION_GE(ba_global_max_refinement_change, 0);
   CHECK_OPTION_GE(snapshot_images_freq, 0);
+  CHECK_OPTION_GE(dome_port_max_centering_error, 0);
+  CHECK_OPTION_GT(dome_port_min_distance, 0);
   if (!prior_from_cam.empty()) {
     const std::vector<double> params = CSVToVector<double>(prior_from_cam);
     CHECK_OPTION_EQ(params.size(), 7);
@@ -362,8 +393,29 @@ IncrementalMapperController::IncrementalMapperController(
   RegisterCallback(LAST_IMAGE_REG_CALLBACK);
 }
 
+IncrementalMapperController::IncrementalMapperController(
+    std::shared_ptr<const IncrementalMapperOptions> options,
+    const std::string& image_path,
+    std::shared_ptr<const DatabaseCache> database_cache,
+    std::shared_ptr<ReconstructionManager> reconstruction_manager)
+    : options_(std::move(options)),
+      image_path_(image_path),
+      reconstruction_manager_(std::move(reconstruction_manager)),
+      database_cache_(std::move(database_cache)) {
+  CHECK(options_->Check());
+  CHECK(database_cache_ != nullptr);
+  RegisterCallback(INITIAL_IMAGE_PAIR_REG_CALLBACK);
+  RegisterCallback(NEXT_IMAGE_REG_CALLBACK);
+  RegisterCallback(LAST_IMAGE_REG_CALLBACK);
+}
+
 void IncrementalMapperController::Run() {
-  if (!LoadDatabase()) {
+  if (database_cache_ == nullptr) {
+    if (!LoadDatabase()) {
+      return;
+    }
+  } else if (database_cache_->NumImages() == 0) {
+    LOG(WARNING) << "No images with matches found in the database cache";
     return;
   }
 
@@ -389,6 +441,8 @@ void IncrementalMapperController::Run() {
     Reconstruct(init_mapper_options);
   }
 
+  RestoreCenteredDomePorts();
+
   GetTimer().PrintMinutes();
 }
 
@@ -406,12 +460,19 @@ bool IncrementalMapperController::LoadDatabase() {
     }
   }
 
-  Database database(database_path_);
   Timer timer;
   timer.Start();
   const size_t min_num_matches = static_cast<size_t>(options_->min_num_matches);
-  database_cache_ = DatabaseCache::Create(
-      database, min_num_matches, options_->ignore_watermarks, image_names);
+  database_cache_ =
+      DatabaseCache::CreateOrRetain(database_path_,
+                                    min_num_matches,
+                                    options_->ignore_watermarks,
+                                    image_names,
+                                    options_->database_cache_path);
+  if (options_->enable_refraction) {
+    // Reuse the best fit cameras of the matching.
+    ReadBestFitNonRefracCameras(Database(database_path_));
+  }
   timer.PrintMinutes();
 
   if (database_cache_->NumImages() == 0) {
@@ -422,6 +483,60 @@ bool IncrementalMapperController::LoadDatabase() {
   return true;
 }
 
+void IncrementalMapperController::ApproximateCenteredDomePorts(
+    Reconstruction* reconstruction) {
+  if (options_->dome_port_max_centering_error <= 0 ||
+      options_->ba_refine_refrac_params) {
+    return;
+  }
+
+  for (const auto& camera_id_and_camera : reconstruction->Cameras()) {
+    const camera_t camera_id = camera_id_and_camera.first;
+    Camera& camera = reconstruction->Camera(camera_id);
+    if (camera.refrac_model_id != DomePort::refrac_model_id ||
+        DomePort::IsCentered(camera.refrac_params.data())) {
+      continue;
+    }
+
+    double max_error = 0;
+    for (const double scale : {1.0, 10.0, 100.0, 1000.0}) {
+      max_error = std::max(max_error,
+                           camera.DomePortCenteringError(
+                               scale * options_->dome_port_min_distance));
+    }
+
+    if (max_error > options_->dome_port_max_centering_error) {
+      VLOG(2) << StringPrintf(
+          "Dome port of camera %d is not centered (max. error %.3f px)",
+          camera_id,
+          max_error);
+      continue;
+    }
+
+    LOG(INFO) << StringPrintf(
+        "Approximating dome port of camera %d as centered (max. error %.3f px)",
+        camera_id,
+        max_error);
+    dome_port_refrac_params_.emplace(camera_id, camera.refrac_params);
+    std::fill(
+        camera.refrac_params.begin(), camera.refrac_params.begin() + 3, 0.0);
+    reconstruction->SetModifiedCamera(camera_id);
+  }
+}
+
+void IncrementalMapperController::RestoreCenteredDomePorts() {
+  for (size_t i = 0; i < reconstruction_manager_->Size(); ++i) {
+    Reconstruction& reconstruction = *reconstruction_manager_->Get(i);
+    for (const auto& refrac_params : dome_port_refrac_params_) {
+      if (reconstruction.ExistsCamera(refrac_params.first)) {
+        reconstruction.Camera(refrac_params.first).refrac_params =
+            refrac_params.second;
+        reconstruction.SetModifiedCamera(refrac_params.first);
+      }
+    }
+  }
+}
+
 void IncrementalMapperController::Reconstruct(
     const IncrementalMapper::Options& init_mapper_options) {
   //////////////////////////////////////////////////////////////////////////////
@@ -455,6 +570,13 @@ void IncrementalMapperController::Reconstruct(
         reconstruction_manager_->Get(reconstruction_idx);
 
     mapper.BeginReconstruction(reconstruction);
+    if (options_->enable_refraction) {
+      ApproximateCenteredDomePorts(reconstruction.get());
+      // Look up the virtual cameras of the registration and triangulation.
+      // The tables fall back to the exact computation once the intrinsics
+      // are refined by bundle adjustment.
+      reconstruction->UpdateRefracVirtualCameraTables();
+    }
     // Set prior_from_cam if pose prior is used in reconstruction.
     if (init_mapper_options.use_pose_prior &&
         !options_->prior_from_cam.empty()) {
@@ -543,17 +665,28 @@ void IncrementalMapperController::Reconstruct(
     ////////////////////////////////////////////////////////////////////////////
 
     size_t snapshot_prev_num_reg_images = reconstruction->NumRegImages();
+    // Snapshots are written in the background, see below. The destructor of
+    // the future waits for the pending snapshot to be written.
+    std::future<void> snapshot_writer;
     size_t ba_prev_num_reg_images = reconstruction->NumRegImages();
     size_t ba_prev_num_points = reconstruction->NumPoints3D();
 
     bool reg_next_success = true;
     bool prev_reg_next_success = true;
+    bool exceeds_memory_budget = ExceedsMemoryBudget();
     while (reg_next_success) {
       BlockIfPaused();
       if (IsStopped()) {
         break;
       }
 
+      if (exceeds_memory_budget) {
+        LOG(WARNING) << StringPrintf(
+            "=> Memory budget of %d MB exceeded, stopping the reconstruction.",
+            options_->max_memory_usage_mb);
+        break;
+      }
+
       reg_next_success = false;
 
       const std::vector<image_t> next_images =
@@ -563,24 +696,64 @@ void IncrementalMapperController::Reconstruct(
         break;
       }
 
-      for (size_t reg_trial = 0; reg_trial < next_images.size(); ++reg_trial) {
-        const image_t next_image_id = next_images[reg_trial];
-        const Image& next_image = reconstruction->Image(next_image_id);
-
-        PrintHeading1(StringPrintf("Registering image #%d (%d)",
-                                   next_image_id,
-                                   reconstruction->NumRegImages() + 1));
-
-        LOG(INFO) << StringPrintf("=> Image sees %d / %d points",
-                                  next_image.NumVisiblePoints3D(),
-                                  next_image.NumObservations());
+      // In the refractive case, the poses of multiple next images can be
+      // estimated in parallel and registered together.
+      const IncrementalMapper::Options mapper_options = options_->Mapper();
+      const size_t num_parallel_reg_images =
+          mapper_options.enable_refraction
+              ? static_cast<size_t>(mapper_options.num_parallel_reg_images)
+              : 1;
+
+      for (size_t reg_trial = 0; reg_trial < next_images.size();
+           reg_trial += num_parallel_reg_images) {
+        std::vector<image_t> reg_image_ids;
+        if (num_parallel_reg_images == 1) {
+          const image_t next_image_id = next_images[reg_trial];
+          const Image& next_image = reconstruction->Image(next_image_id);
+
+          PrintHeading1(StringPrintf("Registering image #%d (%d)",
+                                     next_image_id,
+                                     reconstruction->NumRegImages() + 1));
+
+          LOG(INFO) << StringPrintf("=> Image sees %d / %d points",
+                                    next_image.NumVisiblePoints3D(),
+                                    next_image.NumObservations());
+
+          if (mapper.RegisterNextImage(mapper_options, next_image_id)) {
+            reg_image_ids.push_back(next_image_id);
+          }
+        } else {
+          const std::vector<image_t> next_image_ids(
+              next_images.begin() + reg_trial,
+              next_images.begin() +
+                  std::min(reg_trial + num_parallel_reg_images,
+                           next_images.size()));
+
+          PrintHeading1(StringPrintf("Registering %d images (%d)",
+                                     next_image_ids.size(),
+                                     reconstruction->NumRegImages() + 1));
+
+          reg_image_ids =
+              mapper.RegisterNextImages(mapper_options, next_image_ids);
+
+          LOG(INFO) << StringPrintf("=> Registered %d / %d images",
+                                    reg_image_ids.size(),
+                                    next_image_ids.size());
+        }
 
-        reg_next_success =
-            mapper.RegisterNextImage(options_->Mapper(), next_image_id);
+        reg_next_success = !reg_image_ids.empty();
+        COLMAP_METRIC_COUNTER("Registered images", reg_image_ids.size());
+        COLMAP_METRIC_GAUGE("Reconstruction registered images",
+                            reconstruction->NumRegImages());
 
         if (reg_next_success) {
-          TriangulateImage(*options_, next_image, &mapper);
-          IterativeLocalRefinement(*options_, next_image_id, &mapper);
+          for (const image_t reg_image_id : reg_image_ids) {
+            TriangulateImage(
+                *options_, reconstruction->Image(reg_image_id), &mapper);
+          }
+          for (const image_t reg_image_id : reg_image_ids) {
+            IterativeLocalRefinement(*options_, reg_image_id, &mapper);
+          }
 
           if (reconstruction->NumRegImages() >=
                   options_->ba_global_images_ratio * ba_prev_num_reg_images ||
@@ -591,12 +764,20 @@ void IncrementalMapperController::Reconstruct(
               reconstruction->NumPoints3D() >=
                   options_->ba_global_points_freq + ba_prev_num_points) {
             IterativeGlobalRefinement(*options_, &mapper);
+            // Release the memory of the points deleted and merged since the
+            // last global refinement.
+            reconstruction->CompactPoints3D();
             ba_prev_num_points = reconstruction->NumPoints3D();
             ba_prev_num_reg_images = reconstruction->NumRegImages();
+            if (ExceedsMemoryBudget()) {
+              exceeds_memory_budget = true;
+            }
           }
 
           if (options_->extract_colors) {
-            ExtractColors(image_path_, next_image_id, reconstruction.get());
+            for (const image_t reg_image_id : reg_image_ids) {
+              ExtractColors(image_path_, reg_image_id, reconstruction.get());
+            }
           }
 
           if (options_->snapshot_images_freq > 0 &&
@@ -604,7 +785,19 @@ void IncrementalMapperController::Reconstruct(
                   options_->snapshot_images_freq +
                       snapshot_prev_num_reg_images) {
             snapshot_prev_num_reg_images = reconstruction->NumRegImages();
-            WriteSnapshot(*reconstruction, options_->snapshot_path);
+            // Write a copy of the reconstruction in the background, such that
+            // the mapping does not stall on the IO. At most one snapshot is
+            // pending at a time to bound the memory of the copies.
+            if (snapshot_writer.valid()) {
+              snapshot_writer.get();
+            }
+            auto snapshot =
+                std::make_shared<const Reconstruction>(*reconstruction);
+            const std::string snapshot_path = options_->snapshot_path;
+            snapshot_writer =
+                std::async(std::launch::async, [snapshot, snapshot_path]() {
+                  WriteSnapshot(*snapshot, snapshot_path);
+                });
           }
 
           Callback(NEXT_IMAGE_REG_CALLBACK);
@@ -678,10 +871,33 @@ void IncrementalMapperController::Reconstruct(
     if (initial_reconstruction_given || !options_->multiple_models ||
         reconstruction_manager_->Size() >=
             static_cast<size_t>(options_->max_num_models) ||
-        total_num_reg_images >= database_cache_->NumImages() - 1) {
+        total_num_reg_images >= database_cache_->NumImages() - 1 ||
+        exceeds_memory_budget) {
       break;
     }
   }
 }
 
+bool IncrementalMapperController::ExceedsMemoryBudget() const {
+  if (options_->max_memory_usage_mb <= 0 && !Tracer::IsEnabled()) {
+    return false;
+  }
+
+  const size_t database_cache_memory = database_cache_->MemoryUsage();
+  size_t reconstructions_memory = 0;
+  for (size_t i = 0; i < reconstruction_manager_->Size(); ++i) {
+    reconstructions_memory += reconstruction_manager_->Get(i)->MemoryUsage();
+  }
+
+  constexpr double kBytesPerMB = 1024.0 * 1024.0;
+  COLMAP_METRIC_HISTOGRAM("DatabaseCache memory [MB]",
+                          database_cache_memory / kBytesPerMB);
+  COLMAP_METRIC_HISTOGRAM("Reconstructions memory [MB]",
+                          reconstructions_memory / kBytesPerMB);
+
+  return options_->max_memory_usage_mb > 0 &&
+         database_cache_memory + reconstructions_memory >
+             static_cast<size_t>(options_->max_memory_usage_mb) * 1024 * 1024;
+}
+
 }  // namespace colmap
@@ -33,6 +33,8 @@
 #include "colmap/sfm/incremental_mapper.h"
 #include "colmap/util/threading.h"
 
+#include <functional>
+
 namespace colmap {
 
 struct IncrementalMapperOptions {
@@ -42,12 +44,22 @@ struct IncrementalMapperOptions {
   // Whether to ignore the inlier matches of watermark image pairs.
   bool ignore_watermarks = false;
 
+  // Optional path of a binary snapshot of the loaded database contents, which
+  // avoids reading and parsing the same database again on repeated runs. The
+  // snapshot is recreated whenever the database file or loading options change.
+  std::string database_cache_path = "";
+
   // Whether to reconstruct multiple sub-models.
   bool multiple_models = true;
 
   // The number of sub-models to reconstruct.
   int max_num_models = 50;
 
+  // The maximum memory in megabytes of the database cache and all
+  // reconstructed sub-models. Once exceeded, the current sub-model stops
+  // growing and no further sub-models are started. Unlimited if <= 0.
+  int max_memory_usage_mb = -1;
+
   // The maximum number of overlapping images between sub-models. If the
   // current sub-models shares more than this number of images with another
   // model, then the reconstruction is stopped.
@@ -73,6 +85,12 @@ struct IncrementalMapperOptions {
   // The number of threads to use during reconstruction.
   int num_threads = -1;
 
+  // Optional function overriding num_threads, which is queried anew for every
+  // image registration and bundle adjustment step. This allows to
+  // reassign threads between multiple mappers running in parallel, e.g., once
+  // some of them finished.
+  std::function<int()> dynamic_num_threads;
+
   // Thresholds for filtering images with degenerate intrinsics.
   double min_focal_length_ratio = 0.1;
   double max_focal_length_ratio = 10.0;
@@ -90,6 +108,11 @@ struct IncrementalMapperOptions {
   // The number of images to optimize in local bundle adjustment.
   int ba_local_num_images = 6;
 
+  // The maximum number of residuals of the local bundle adjustment, see
+  // `IncrementalMapper::Options::local_ba_max_num_residuals`. Set to 0 to not
+  // limit the number of residuals.
+  int ba_local_max_num_residuals = 0;
+
   // Ceres solver function tolerance for local bundle adjustment
   double ba_local_function_tolerance = 0.0;
 
@@ -108,12 +131,36 @@ struct IncrementalMapperOptions {
   // The maximum number of global bundle adjustment iterations.
   int ba_global_max_num_iterations = 50;
 
+  // Whether to terminate the local and global bundle adjustments adaptively
+  // with the preset of their stage, see
+  // `BundleAdjustmentOptions::adaptive_termination`. The maximum number of
+  // iterations above then only bound the number of iterations. Disabled by
+  // default, such that only the solver tolerances terminate early.
+  bool ba_adaptive_termination = false;
+
+  // Stage of the global bundle adjustment, which selects the preset of the
+  // adaptive termination, e.g., the final global refinement of the hybrid
+  // mapper uses stricter tolerances.
+  BundleAdjustmentOptions::Stage ba_global_stage =
+      BundleAdjustmentOptions::Stage::GLOBAL;
+
+  // The maximum number of points per image cell in the reduced global bundle
+  // adjustment, see
+  // `IncrementalMapper::Options::global_ba_max_num_points_per_cell`. Set to 0
+  // to refine all points jointly with the poses.
+  int ba_global_max_num_points_per_cell = 0;
+
   // The thresholds for iterative bundle adjustment refinements.
   int ba_local_max_refinements = 2;
   double ba_local_max_refinement_change = 0.001;
   int ba_global_max_refinements = 5;
   double ba_global_max_refinement_change = 0.0005;
 
+  // Whether to use the GPU for solving larger bundle adjustment problems and
+  // the index of the GPU to use, see `BundleAdjustmentOptions::use_gpu`.
+  bool ba_use_gpu = false;
+  std::string ba_gpu_index = "-1";
+
   // Path to a folder with reconstruction snapshots during incremental
   // reconstruction. Snapshots will be saved according to the specified
   // frequency of registered images.
@@ -139,7 +186,8 @@ struct IncrementalMapperOptions {
   // p_from_c)
   std::string prior_from_cam = "";
 
-  // Use global pose prior weight in bundle adjustment.
+  // Whether to weight all pose priors in bundle adjustment by the global pose
+  // prior std instead of the covariance of the individual pose priors.
   bool ba_use_global_pose_prior_std = true;
 
   // Pose prior standard deviation when using pose prior constraint in bundle
@@ -147,9 +195,9 @@ struct IncrementalMapperOptions {
   //
   // First 3 components: standard deviation of 3D rotation.
   // Last 3 components: standard deviation of translation in [meter].
-  /// TODO: Currently we are using a fixed STD for all images, which is not
-  // optimal of course. Better way to go is to get covariance matrix from sensor
-  // reading
+  //
+  // It is used for all images if ba_use_global_pose_prior_std and otherwise
+  // only for the images whose pose prior has no covariance.
   std::string ba_pose_prior_std = "0.1, 0.1, 0.1, 0.1, 0.1, 0.1";
 
   // Whether to optimize prior_from_cam during bundle adjustment.
@@ -168,10 +216,24 @@ struct IncrementalMapperOptions {
   // Which refractive parameters to optimize during the reconstruction.
   bool ba_refine_refrac_params = false;
 
+  // Whether to trace the refracted rays in single precision in the bundle
+  // adjustment, see `BundleAdjustmentOptions::refrac_mixed_precision`.
+  bool ba_refrac_mixed_precision = false;
+
   // Whether to fix refractive parameters until registering a certain
   // number of images.
   int ba_fix_refrac_params_until_num_images = -1;
 
+  // Approximate the dome ports, which are within the given error in pixels of
+  // a perfectly centered dome port, by a centered dome port, whose projection
+  // reduces to the perspective camera model. The error is evaluated for scene
+  // distances from the given minimum distance to a thousand times of it. The
+  // original refractive parameters are restored in the final reconstructions.
+  // Set to 0 to disable the approximation, which is not applied if the
+  // refractive parameters are refined.
+  double dome_port_max_centering_error = 0.1;
+  double dome_port_min_distance = 0.5;
+
   IncrementalMapper::Options mapper;
   IncrementalTriangulator::Options triangulation;
 
@@ -180,6 +242,9 @@ struct IncrementalMapperOptions {
   BundleAdjustmentOptions LocalBundleAdjustment() const;
   BundleAdjustmentOptions GlobalBundleAdjustment() const;
 
+  // The number of threads for the next step of the reconstruction.
+  int NumThreads() const;
+
   bool Check() const;
 };
 
@@ -199,16 +264,34 @@ class IncrementalMapperController : public Thread {
       const std::string& database_path,
       std::shared_ptr<ReconstructionManager> reconstruction_manager);
 
+  // Reconstruct from an already loaded database cache instead of reading it
+  // from the database, e.g., when multiple controllers reconstruct different
+  // parts of the same scene in parallel.
+  IncrementalMapperController(
+      std::shared_ptr<const IncrementalMapperOptions> options,
+      const std::string& image_path,
+      std::shared_ptr<const DatabaseCache> database_cache,
+      std::shared_ptr<ReconstructionManager> reconstruction_manager);
+
  private:
   void Run();
   bool LoadDatabase();
   void Reconstruct(const IncrementalMapper::Options& init_mapper_options);
+  // Approximate the nearly centered dome ports of the reconstruction by
+  // centered dome ports and restore their original parameters.
+  void ApproximateCenteredDomePorts(Reconstruction* reconstruction);
+  void RestoreCenteredDomePorts();
+  // Returns whether the memory of the database cache and all reconstructions
+  // exceeds the configured budget. Also traces the current memory usage.
+  bool ExceedsMemoryBudget() const;
 
   const std::shared_ptr<const IncrementalMapperOptions> options_;
   const std::string image_path_;
   const std::string database_path_;
   std::shared_ptr<ReconstructionManager> reconstruction_manager_;
-  std::shared_ptr<DatabaseCache> database_cache_;
+  std::shared_ptr<const DatabaseCache> database_cache_;
+  // The original refractive parameters of the approximated dome ports.
+  std::unordered_map<camera_t, std::vector<double>> dome_port_refrac_params_;
 };
 
 // Globally filter points and images in mapper.
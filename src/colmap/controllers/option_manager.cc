@@ -42,19 +42,42 @@
 #include "colmap/mvs/patch_match.h"
 #include "colmap/ui/render_options.h"
 #include "colmap/util/misc.h"
+#include "colmap/util/threading.h"
+#include "colmap/util/tracing.h"
 #include "colmap/util/version.h"
 
+#include <atomic>
+
 #include <boost/filesystem/operations.hpp>
 #include <boost/property_tree/ini_parser.hpp>
 
 namespace config = boost::program_options;
 
 namespace colmap {
+namespace {
+
+std::atomic<bool> exit_on_parse(true);
+
+// Exit the process with the given status or throw it, if exiting is disabled.
+[[noreturn]] void ExitParse(const int status) {
+  if (exit_on_parse.load(std::memory_order_relaxed)) {
+    // NOLINTNEXTLINE(concurrency-mt-unsafe)
+    exit(status);
+  }
+  throw OptionManager::ParseExit(status);
+}
+
+}  // namespace
 
 OptionManager::OptionManager(bool add_project_options) {
   project_path = std::make_shared<std::string>();
   database_path = std::make_shared<std::string>();
   image_path = std::make_shared<std::string>();
+  trace_path = std::make_shared<std::string>();
+  metrics_path = std::make_shared<std::string>();
+  metrics_interval =
+      std::make_shared<double>(TracerOptions().metrics_interval);
+  deterministic = std::make_shared<bool>(false);
 
   image_reader = std::make_shared<ImageReaderOptions>();
   sift_extraction = std::make_shared<SiftExtractionOptions>();
@@ -64,6 +87,8 @@ OptionManager::OptionManager(bool add_project_options) {
   sequential_matching = std::make_shared<SequentialMatchingOptions>();
   vocab_tree_matching = std::make_shared<VocabTreeMatchingOptions>();
   spatial_matching = std::make_shared<SpatialMatchingOptions>();
+  pose_prior_matching = std::make_shared<PosePriorMatchingOptions>();
+  rig_matching = std::make_shared<RigMatchingOptions>();
   transitive_matching = std::make_shared<TransitiveMatchingOptions>();
   image_pairs_matching = std::make_shared<ImagePairsMatchingOptions>();
   bundle_adjustment = std::make_shared<BundleAdjustmentOptions>();
@@ -181,6 +206,8 @@ void OptionManager::AddAllOptions() {
   AddSequentialMatchingOptions();
   AddVocabTreeMatchingOptions();
   AddSpatialMatchingOptions();
+  AddPosePriorMatchingOptions();
+  AddRigMatchingOptions();
   AddTransitiveMatchingOptions();
   AddImagePairsMatchingOptions();
   AddBundleAdjustmentOptions();
@@ -200,6 +227,10 @@ void OptionManager::AddLogOptions() {
 
   AddAndRegisterDefaultOption("log_to_stderr", &FLAGS_logtostderr);
   AddAndRegisterDefaultOption("log_level", &FLAGS_v);
+  AddAndRegisterDefaultOption("trace_path", trace_path.get());
+  AddAndRegisterDefaultOption("metrics_path", metrics_path.get());
+  AddAndRegisterDefaultOption("metrics_interval", metrics_interval.get());
+  AddAndRegisterDefaultOption("deterministic", deterministic.get());
 }
 
 void OptionManager::AddRandomOptions() {
@@ -257,8 +288,49 @@ void OptionManager::AddExtractionOptions() {
                               &image_reader->default_focal_length_factor);
   AddAndRegisterDefaultOption("ImageReader.camera_mask_path",
                               &image_reader->camera_mask_path);
+  AddAndRegisterDefaultOption("ImageReader.refrac_validity_mask",
+                              &image_reader->refrac_validity_mask);
   AddAndRegisterDefaultOption("ImageReader.pose_prior_path",
                               &image_reader->pose_prior_path);
+  AddAndRegisterDefaultOption(
+      "ImageReader.pose_prior_navigation_log_path",
+      &image_reader->pose_prior_navigation_log_path);
+  AddAndRegisterDefaultOption("ImageReader.image_timestamps_path",
+                              &image_reader->image_timestamps_path);
+  AddAndRegisterDefaultOption("ImageReader.database_commit_num_images",
+                              &image_reader->database_commit_num_images);
+  AddAndRegisterDefaultOption("ImageReader.database_commit_size_mb",
+                              &image_reader->database_commit_size_mb);
+  AddAndRegisterDefaultOption("ImageReader.num_read_threads",
+                              &image_reader->num_read_threads);
+  AddAndRegisterDefaultOption("ImageReader.resume", &image_reader->resume);
+  AddAndRegisterDefaultOption(
+      "ImageReader.preprocessing_color_compensation",
+      &image_reader->preprocessing.color_compensation);
+  AddAndRegisterDefaultOption("ImageReader.preprocessing_vignetting_path",
+                              &image_reader->preprocessing.vignetting_path);
+  AddAndRegisterDefaultOption("ImageReader.preprocessing_clahe",
+                              &image_reader->preprocessing.clahe);
+  AddAndRegisterDefaultOption("ImageReader.preprocessing_clahe_clip_limit",
+                              &image_reader->preprocessing.clahe_clip_limit);
+  AddAndRegisterDefaultOption("ImageReader.preprocessing_clahe_num_tiles",
+                              &image_reader->preprocessing.clahe_num_tiles);
+  AddAndRegisterDefaultOption("ImageReader.select_keyframes",
+                              &image_reader->select_keyframes);
+  AddAndRegisterDefaultOption(
+      "ImageReader.keyframe_max_num_features",
+      &image_reader->keyframe_selection.max_num_features);
+  AddAndRegisterDefaultOption("ImageReader.keyframe_max_ratio",
+                              &image_reader->keyframe_selection.max_ratio);
+  AddAndRegisterDefaultOption("ImageReader.keyframe_min_overlap",
+                              &image_reader->keyframe_selection.min_overlap);
+  AddAndRegisterDefaultOption("ImageReader.keyframe_max_flow",
+                              &image_reader->keyframe_selection.max_flow);
+  AddAndRegisterDefaultOption(
+      "ImageReader.keyframe_max_num_skipped_frames",
+      &image_reader->keyframe_selection.max_num_skipped_frames);
+  AddAndRegisterDefaultOption("ImageReader.non_keyframes_path",
+                              &image_reader->non_keyframes_path);
 
   AddAndRegisterDefaultOption("SiftExtraction.num_threads",
                               &sift_extraction->num_threads);
@@ -266,10 +338,18 @@ void OptionManager::AddExtractionOptions() {
                               &sift_extraction->use_gpu);
   AddAndRegisterDefaultOption("SiftExtraction.gpu_index",
                               &sift_extraction->gpu_index);
+  AddAndRegisterDefaultOption("SiftExtraction.num_threads_per_gpu",
+                              &sift_extraction->num_threads_per_gpu);
   AddAndRegisterDefaultOption("SiftExtraction.max_image_size",
                               &sift_extraction->max_image_size);
   AddAndRegisterDefaultOption("SiftExtraction.max_num_features",
                               &sift_extraction->max_num_features);
+  AddAndRegisterDefaultOption("SiftExtraction.feature_grid_cell_size",
+                              &sift_extraction->feature_grid_cell_size);
+  AddAndRegisterDefaultOption("SiftExtraction.max_num_features_per_cell",
+                              &sift_extraction->max_num_features_per_cell);
+  AddAndRegisterDefaultOption("SiftExtraction.min_image_contrast",
+                              &sift_extraction->min_image_contrast);
   AddAndRegisterDefaultOption("SiftExtraction.first_octave",
                               &sift_extraction->first_octave);
   AddAndRegisterDefaultOption("SiftExtraction.num_octaves",
@@ -307,6 +387,8 @@ void OptionManager::AddMatchingOptions() {
   AddAndRegisterDefaultOption("SiftMatching.use_gpu", &sift_matching->use_gpu);
   AddAndRegisterDefaultOption("SiftMatching.gpu_index",
                               &sift_matching->gpu_index);
+  AddAndRegisterDefaultOption("SiftMatching.num_threads_per_gpu",
+                              &sift_matching->num_threads_per_gpu);
   AddAndRegisterDefaultOption("SiftMatching.max_ratio",
                               &sift_matching->max_ratio);
   AddAndRegisterDefaultOption("SiftMatching.max_distance",
@@ -315,12 +397,34 @@ void OptionManager::AddMatchingOptions() {
                               &sift_matching->cross_check);
   AddAndRegisterDefaultOption("SiftMatching.guided_matching",
                               &sift_matching->guided_matching);
+  AddAndRegisterDefaultOption("SiftMatching.refrac_guided_min_depth",
+                              &sift_matching->refrac_guided_min_depth);
+  AddAndRegisterDefaultOption("SiftMatching.refrac_guided_max_depth",
+                              &sift_matching->refrac_guided_max_depth);
+  AddAndRegisterDefaultOption("SiftMatching.refrac_guided_num_samples",
+                              &sift_matching->refrac_guided_num_samples);
   AddAndRegisterDefaultOption("SiftMatching.max_num_matches",
                               &sift_matching->max_num_matches);
+  AddAndRegisterDefaultOption("SiftMatching.flann_index_cache_size_mb",
+                              &sift_matching->flann_index_cache_size_mb);
+  AddAndRegisterDefaultOption("SiftMatching.gpu_descriptor_cache_size_mb",
+                              &sift_matching->gpu_descriptor_cache_size_mb);
+  AddAndRegisterDefaultOption("SiftMatching.use_descriptor_codes",
+                              &sift_matching->use_descriptor_codes);
+  AddAndRegisterDefaultOption("SiftMatching.descriptor_codes_num_candidates",
+                              &sift_matching->descriptor_codes_num_candidates);
+  AddAndRegisterDefaultOption("SiftMatching.num_shards",
+                              &sift_matching->num_shards);
+  AddAndRegisterDefaultOption("SiftMatching.shard_index",
+                              &sift_matching->shard_index);
+  AddAndRegisterDefaultOption("SiftMatching.compact_inlier_matches",
+                              &sift_matching->compact_inlier_matches);
   AddAndRegisterDefaultOption("TwoViewGeometry.min_num_inliers",
                               &two_view_geometry->min_num_inliers);
   AddAndRegisterDefaultOption("TwoViewGeometry.multiple_models",
                               &two_view_geometry->multiple_models);
+  AddAndRegisterDefaultOption("TwoViewGeometry.use_prosac",
+                              &two_view_geometry->use_prosac);
   AddAndRegisterDefaultOption("TwoViewGeometry.compute_relative_pose",
                               &two_view_geometry->compute_relative_pose);
   AddAndRegisterDefaultOption("TwoViewGeometry.enable_refraction",
@@ -335,6 +439,8 @@ void OptionManager::AddMatchingOptions() {
   AddAndRegisterDefaultOption(
       "TwoViewGeometry.min_inlier_ratio",
       &two_view_geometry->ransac_options.min_inlier_ratio);
+  AddAndRegisterDefaultOption("TwoViewGeometry.use_sprt",
+                              &two_view_geometry->ransac_options.use_sprt);
 }
 
 void OptionManager::AddExhaustiveMatchingOptions() {
@@ -365,6 +471,12 @@ void OptionManager::AddSequentialMatchingOptions() {
                               &sequential_matching->loop_detection);
   AddAndRegisterDefaultOption("SequentialMatching.loop_detection_period",
                               &sequential_matching->loop_detection_period);
+  AddAndRegisterDefaultOption("SequentialMatching.loop_detection_online",
+                              &sequential_matching->loop_detection_online);
+  AddAndRegisterDefaultOption("SequentialMatching.loop_detection_background",
+                              &sequential_matching->loop_detection_background);
+  AddAndRegisterDefaultOption("SequentialMatching.loop_detection_nms_radius",
+                              &sequential_matching->loop_detection_nms_radius);
   AddAndRegisterDefaultOption("SequentialMatching.loop_detection_num_images",
                               &sequential_matching->loop_detection_num_images);
   AddAndRegisterDefaultOption(
@@ -425,6 +537,43 @@ void OptionManager::AddSpatialMatchingOptions() {
                               &spatial_matching->max_distance);
 }
 
+void OptionManager::AddPosePriorMatchingOptions() {
+  if (added_pose_prior_match_options_) {
+    return;
+  }
+  added_pose_prior_match_options_ = true;
+
+  AddMatchingOptions();
+
+  AddAndRegisterDefaultOption("PosePriorMatching.altitude",
+                              &pose_prior_matching->altitude);
+  AddAndRegisterDefaultOption("PosePriorMatching.min_overlap",
+                              &pose_prior_matching->min_overlap);
+  AddAndRegisterDefaultOption("PosePriorMatching.max_num_neighbors",
+                              &pose_prior_matching->max_num_neighbors);
+}
+
+void OptionManager::AddRigMatchingOptions() {
+  if (added_rig_match_options_) {
+    return;
+  }
+  added_rig_match_options_ = true;
+
+  AddMatchingOptions();
+
+  AddAndRegisterDefaultOption("RigMatching.rig_config_path",
+                              &rig_matching->rig_config_path);
+  AddAndRegisterDefaultOption("RigMatching.overlap", &rig_matching->overlap);
+  AddAndRegisterDefaultOption("RigMatching.quadratic_overlap",
+                              &rig_matching->quadratic_overlap);
+  AddAndRegisterDefaultOption("RigMatching.verify_with_rig_poses",
+                              &rig_matching->verify_with_rig_poses);
+  AddAndRegisterDefaultOption("RigMatching.inter_snapshot_camera_ids",
+                              &rig_matching->inter_snapshot_camera_ids);
+  AddAndRegisterDefaultOption("RigMatching.inter_snapshot_cross_camera",
+                              &rig_matching->inter_snapshot_cross_camera);
+}
+
 void OptionManager::AddTransitiveMatchingOptions() {
   if (added_transitive_match_options_) {
     return;
@@ -480,6 +629,50 @@ void OptionManager::AddBundleAdjustmentOptions() {
                               &bundle_adjustment->refine_extra_params);
   AddAndRegisterDefaultOption("BundleAdjustment.refine_extrinsics",
                               &bundle_adjustment->refine_extrinsics);
+  AddAndRegisterDefaultOption("BundleAdjustment.enable_refraction",
+                              &bundle_adjustment->enable_refraction);
+  AddAndRegisterDefaultOption("BundleAdjustment.refine_refrac_params",
+                              &bundle_adjustment->refine_refrac_params);
+  AddAndRegisterDefaultOption(
+      "BundleAdjustment.refrac_calibration_two_stage",
+      &bundle_adjustment->refrac_calibration_two_stage);
+  AddAndRegisterDefaultOption(
+      "BundleAdjustment.refrac_calibration_max_num_iterations",
+      &bundle_adjustment->refrac_calibration_max_num_iterations);
+  AddAndRegisterDefaultOption(
+      "BundleAdjustment.refrac_calibration_max_num_observations",
+      &bundle_adjustment->refrac_calibration_max_num_observations);
+  AddAndRegisterDefaultOption(
+      "BundleAdjustment.refrac_calibration_tolerance",
+      &bundle_adjustment->refrac_calibration_tolerance);
+  AddAndRegisterDefaultOption("BundleAdjustment.refrac_mixed_precision",
+                              &bundle_adjustment->refrac_mixed_precision);
+  AddAndRegisterDefaultOption("BundleAdjustment.adaptive_termination",
+                              &bundle_adjustment->adaptive_termination);
+  AddAndRegisterDefaultOption("BundleAdjustment.adaptive_cost_tolerance",
+                              &bundle_adjustment->adaptive_cost_tolerance);
+  AddAndRegisterDefaultOption(
+      "BundleAdjustment.adaptive_rotation_tolerance",
+      &bundle_adjustment->adaptive_rotation_tolerance);
+  AddAndRegisterDefaultOption(
+      "BundleAdjustment.adaptive_translation_tolerance",
+      &bundle_adjustment->adaptive_translation_tolerance);
+  AddAndRegisterDefaultOption(
+      "BundleAdjustment.adaptive_num_converged_iterations",
+      &bundle_adjustment->adaptive_num_converged_iterations);
+  AddAndRegisterDefaultOption("BundleAdjustment.use_gpu",
+                              &bundle_adjustment->use_gpu);
+  AddAndRegisterDefaultOption("BundleAdjustment.gpu_index",
+                              &bundle_adjustment->gpu_index);
+  AddAndRegisterDefaultOption(
+      "BundleAdjustment.min_num_images_gpu_solver",
+      &bundle_adjustment->min_num_images_gpu_solver);
+  AddAndRegisterDefaultOption(
+      "BundleAdjustment.max_num_images_direct_dense_gpu_solver",
+      &bundle_adjustment->max_num_images_direct_dense_gpu_solver);
+  AddAndRegisterDefaultOption(
+      "BundleAdjustment.max_num_images_direct_sparse_gpu_solver",
+      &bundle_adjustment->max_num_images_direct_sparse_gpu_solver);
 }
 
 void OptionManager::AddMapperOptions() {
@@ -492,9 +685,13 @@ void OptionManager::AddMapperOptions() {
                               &mapper->min_num_matches);
   AddAndRegisterDefaultOption("Mapper.ignore_watermarks",
                               &mapper->ignore_watermarks);
+  AddAndRegisterDefaultOption("Mapper.database_cache_path",
+                              &mapper->database_cache_path);
   AddAndRegisterDefaultOption("Mapper.multiple_models",
                               &mapper->multiple_models);
   AddAndRegisterDefaultOption("Mapper.max_num_models", &mapper->max_num_models);
+  AddAndRegisterDefaultOption("Mapper.max_memory_usage_mb",
+                              &mapper->max_memory_usage_mb);
   AddAndRegisterDefaultOption("Mapper.max_model_overlap",
                               &mapper->max_model_overlap);
   AddAndRegisterDefaultOption("Mapper.min_model_size", &mapper->min_model_size);
@@ -521,6 +718,8 @@ void OptionManager::AddMapperOptions() {
       &mapper->ba_min_num_residuals_for_multi_threading);
   AddAndRegisterDefaultOption("Mapper.ba_local_num_images",
                               &mapper->ba_local_num_images);
+  AddAndRegisterDefaultOption("Mapper.ba_local_max_num_residuals",
+                              &mapper->ba_local_max_num_residuals);
   AddAndRegisterDefaultOption("Mapper.ba_local_function_tolerance",
                               &mapper->ba_local_function_tolerance);
   AddAndRegisterDefaultOption("Mapper.ba_local_max_num_iterations",
@@ -537,6 +736,8 @@ void OptionManager::AddMapperOptions() {
                               &mapper->ba_global_function_tolerance);
   AddAndRegisterDefaultOption("Mapper.ba_global_max_num_iterations",
                               &mapper->ba_global_max_num_iterations);
+  AddAndRegisterDefaultOption("Mapper.ba_global_max_num_points_per_cell",
+                              &mapper->ba_global_max_num_points_per_cell);
   AddAndRegisterDefaultOption("Mapper.ba_global_max_refinements",
                               &mapper->ba_global_max_refinements);
   AddAndRegisterDefaultOption("Mapper.ba_global_max_refinement_change",
@@ -552,6 +753,8 @@ void OptionManager::AddMapperOptions() {
                               &mapper->fix_existing_images);
   AddAndRegisterDefaultOption("Mapper.use_pose_prior", &mapper->use_pose_prior);
   AddAndRegisterDefaultOption("Mapper.prior_from_cam", &mapper->prior_from_cam);
+  AddAndRegisterDefaultOption("Mapper.ba_use_gpu", &mapper->ba_use_gpu);
+  AddAndRegisterDefaultOption("Mapper.ba_gpu_index", &mapper->ba_gpu_index);
   AddAndRegisterDefaultOption("Mapper.ba_use_global_pose_prior_std",
                               &mapper->ba_use_global_pose_prior_std);
   AddAndRegisterDefaultOption("Mapper.ba_pose_prior_std",
@@ -567,8 +770,16 @@ void OptionManager::AddMapperOptions() {
                               &mapper->enable_refraction);
   AddAndRegisterDefaultOption("Mapper.ba_refine_refrac_params",
                               &mapper->ba_refine_refrac_params);
+  AddAndRegisterDefaultOption("Mapper.ba_refrac_mixed_precision",
+                              &mapper->ba_refrac_mixed_precision);
+  AddAndRegisterDefaultOption("Mapper.ba_adaptive_termination",
+                              &mapper->ba_adaptive_termination);
   AddAndRegisterDefaultOption("Mapper.ba_fix_refrac_params_until_num_images",
                               &mapper->ba_fix_refrac_params_until_num_images);
+  AddAndRegisterDefaultOption("Mapper.dome_port_max_centering_error",
+                              &mapper->dome_port_max_centering_error);
+  AddAndRegisterDefaultOption("Mapper.dome_port_min_distance",
+                              &mapper->dome_port_min_distance);
 
   // IncrementalMapper.
   AddAndRegisterDefaultOption("Mapper.init_min_num_inliers",
@@ -581,18 +792,28 @@ void OptionManager::AddMapperOptions() {
                               &mapper->mapper.init_min_tri_angle);
   AddAndRegisterDefaultOption("Mapper.init_max_reg_trials",
                               &mapper->mapper.init_max_reg_trials);
+  AddAndRegisterDefaultOption("Mapper.init_num_parallel_pairs",
+                              &mapper->mapper.init_num_parallel_pairs);
+  AddAndRegisterDefaultOption("Mapper.init_use_stored_poses",
+                              &mapper->mapper.init_use_stored_poses);
   AddAndRegisterDefaultOption("Mapper.abs_pose_max_error",
                               &mapper->mapper.abs_pose_max_error);
   AddAndRegisterDefaultOption("Mapper.abs_pose_min_num_inliers",
                               &mapper->mapper.abs_pose_min_num_inliers);
   AddAndRegisterDefaultOption("Mapper.abs_pose_min_inlier_ratio",
                               &mapper->mapper.abs_pose_min_inlier_ratio);
+  AddAndRegisterDefaultOption("Mapper.abs_pose_prior_max_error",
+                              &mapper->mapper.abs_pose_prior_max_error);
+  AddAndRegisterDefaultOption("Mapper.use_prior_gravity",
+                              &mapper->mapper.use_prior_gravity);
   AddAndRegisterDefaultOption("Mapper.filter_max_reproj_error",
                               &mapper->mapper.filter_max_reproj_error);
   AddAndRegisterDefaultOption("Mapper.filter_min_tri_angle",
                               &mapper->mapper.filter_min_tri_angle);
   AddAndRegisterDefaultOption("Mapper.max_reg_trials",
                               &mapper->mapper.max_reg_trials);
+  AddAndRegisterDefaultOption("Mapper.num_parallel_reg_images",
+                              &mapper->mapper.num_parallel_reg_images);
   AddAndRegisterDefaultOption("Mapper.local_ba_min_tri_angle",
                               &mapper->mapper.local_ba_min_tri_angle);
 
@@ -631,6 +852,8 @@ void OptionManager::AddPatchMatchStereoOptions() {
                               &patch_match_stereo->max_image_size);
   AddAndRegisterDefaultOption("PatchMatchStereo.gpu_index",
                               &patch_match_stereo->gpu_index);
+  AddAndRegisterDefaultOption("PatchMatchStereo.num_problems_per_gpu",
+                              &patch_match_stereo->num_problems_per_gpu);
   AddAndRegisterDefaultOption("PatchMatchStereo.depth_min",
                               &patch_match_stereo->depth_min);
   AddAndRegisterDefaultOption("PatchMatchStereo.depth_max",
@@ -653,6 +876,22 @@ void OptionManager::AddPatchMatchStereoOptions() {
                               &patch_match_stereo->incident_angle_sigma);
   AddAndRegisterDefaultOption("PatchMatchStereo.num_iterations",
                               &patch_match_stereo->num_iterations);
+  AddAndRegisterDefaultOption("PatchMatchStereo.num_coarse_levels",
+                              &patch_match_stereo->num_coarse_levels);
+  AddAndRegisterDefaultOption(
+      "PatchMatchStereo.num_coarse_to_fine_iterations",
+      &patch_match_stereo->num_coarse_to_fine_iterations);
+  AddAndRegisterDefaultOption("PatchMatchStereo.max_tile_size",
+                              &patch_match_stereo->max_tile_size);
+  AddAndRegisterDefaultOption("PatchMatchStereo.tile_overlap",
+                              &patch_match_stereo->tile_overlap);
+  AddAndRegisterDefaultOption("PatchMatchStereo.init_from_sparse_points",
+                              &patch_match_stereo->init_from_sparse_points);
+  AddAndRegisterDefaultOption("PatchMatchStereo.sparse_prior_cell_size",
+                              &patch_match_stereo->sparse_prior_cell_size);
+  AddAndRegisterDefaultOption(
+      "PatchMatchStereo.sparse_prior_depth_margin",
+      &patch_match_stereo->sparse_prior_depth_margin);
   AddAndRegisterDefaultOption("PatchMatchStereo.geom_consistency",
                               &patch_match_stereo->geom_consistency);
   AddAndRegisterDefaultOption(
@@ -674,10 +913,19 @@ void OptionManager::AddPatchMatchStereoOptions() {
       &patch_match_stereo->filter_geom_consistency_max_cost);
   AddAndRegisterDefaultOption("PatchMatchStereo.cache_size",
                               &patch_match_stereo->cache_size);
+  AddAndRegisterDefaultOption("PatchMatchStereo.cache_images",
+                              &patch_match_stereo->cache_images);
   AddAndRegisterDefaultOption("PatchMatchStereo.allow_missing_files",
                               &patch_match_stereo->allow_missing_files);
   AddAndRegisterDefaultOption("PatchMatchStereo.write_consistency_graph",
                               &patch_match_stereo->write_consistency_graph);
+  AddAndRegisterDefaultOption("PatchMatchStereo.pack_consistency_graph",
+                              &patch_match_stereo->pack_consistency_graph);
+  AddAndRegisterDefaultOption("PatchMatchStereo.write_compressed_maps",
+                              &patch_match_stereo->write_compressed_maps);
+  AddAndRegisterDefaultOption(
+      "PatchMatchStereo.pipeline_geom_consistency",
+      &patch_match_stereo->pipeline_geom_consistency);
 }
 
 void OptionManager::AddStereoFusionOptions() {
@@ -710,6 +958,14 @@ void OptionManager::AddStereoFusionOptions() {
                               &stereo_fusion->cache_size);
   AddAndRegisterDefaultOption("StereoFusion.use_cache",
                               &stereo_fusion->use_cache);
+  AddAndRegisterDefaultOption("StereoFusion.enable_refraction",
+                              &stereo_fusion->enable_refraction);
+  AddAndRegisterDefaultOption("StereoFusion.num_tiles",
+                              &stereo_fusion->num_tiles);
+  AddAndRegisterDefaultOption("StereoFusion.block_size",
+                              &stereo_fusion->block_size);
+  AddAndRegisterDefaultOption("StereoFusion.cache_images",
+                              &stereo_fusion->cache_images);
 }
 
 void OptionManager::AddPoissonMeshingOptions() {
@@ -725,6 +981,10 @@ void OptionManager::AddPoissonMeshingOptions() {
   AddAndRegisterDefaultOption("PoissonMeshing.trim", &poisson_meshing->trim);
   AddAndRegisterDefaultOption("PoissonMeshing.num_threads",
                               &poisson_meshing->num_threads);
+  AddAndRegisterDefaultOption("PoissonMeshing.max_chunk_num_points",
+                              &poisson_meshing->max_chunk_num_points);
+  AddAndRegisterDefaultOption("PoissonMeshing.chunk_overlap",
+                              &poisson_meshing->chunk_overlap);
 }
 
 void OptionManager::AddDelaunayMeshingOptions() {
@@ -747,6 +1007,14 @@ void OptionManager::AddDelaunayMeshingOptions() {
                               &delaunay_meshing->max_side_length_factor);
   AddAndRegisterDefaultOption("DelaunayMeshing.max_side_length_percentile",
                               &delaunay_meshing->max_side_length_percentile);
+  AddAndRegisterDefaultOption("DelaunayMeshing.max_block_num_points",
+                              &delaunay_meshing->max_block_num_points);
+  AddAndRegisterDefaultOption("DelaunayMeshing.block_overlap",
+                              &delaunay_meshing->block_overlap);
+  AddAndRegisterDefaultOption("DelaunayMeshing.accelerate_visibility",
+                              &delaunay_meshing->accelerate_visibility);
+  AddAndRegisterDefaultOption("DelaunayMeshing.max_num_visibility_rays",
+                              &delaunay_meshing->max_num_visibility_rays);
   AddAndRegisterDefaultOption("DelaunayMeshing.num_threads",
                               &delaunay_meshing->num_threads);
 }
@@ -759,6 +1027,10 @@ void OptionManager::AddRenderOptions() {
 
   AddAndRegisterDefaultOption("Render.min_track_len", &render->min_track_len);
   AddAndRegisterDefaultOption("Render.max_error", &render->max_error);
+  AddAndRegisterDefaultOption("Render.max_point_screen_error",
+                              &render->max_point_screen_error);
+  AddAndRegisterDefaultOption("Render.max_point_gpu_memory_mb",
+                              &render->max_point_gpu_memory_mb);
   AddAndRegisterDefaultOption("Render.refresh_rate", &render->refresh_rate);
   AddAndRegisterDefaultOption("Render.adapt_refresh_rate",
                               &render->adapt_refresh_rate);
@@ -768,6 +1040,8 @@ void OptionManager::AddRenderOptions() {
                               &render->projection_type);
   AddAndRegisterDefaultOption("Render.render_pose_prior",
                               &render->render_pose_priors);
+  AddAndRegisterDefaultOption("Render.refrac_image_models",
+                              &render->refrac_image_models);
 }
 
 void OptionManager::Reset() {
@@ -793,6 +1067,8 @@ void OptionManager::Reset() {
   added_sequential_match_options_ = false;
   added_vocab_tree_match_options_ = false;
   added_spatial_match_options_ = false;
+  added_pose_prior_match_options_ = false;
+  added_rig_match_options_ = false;
   added_transitive_match_options_ = false;
   added_image_pairs_match_options_ = false;
   added_ba_options_ = false;
@@ -809,7 +1085,11 @@ void OptionManager::ResetOptions(const bool reset_paths) {
     *project_path = "";
     *database_path = "";
     *image_path = "";
+    *trace_path = "";
+    *metrics_path = "";
   }
+  *metrics_interval = TracerOptions().metrics_interval;
+  *deterministic = false;
   *image_reader = ImageReaderOptions();
   *sift_extraction = SiftExtractionOptions();
   *sift_matching = SiftMatchingOptions();
@@ -817,6 +1097,8 @@ void OptionManager::ResetOptions(const bool reset_paths) {
   *sequential_matching = SequentialMatchingOptions();
   *vocab_tree_matching = VocabTreeMatchingOptions();
   *spatial_matching = SpatialMatchingOptions();
+  *pose_prior_matching = PosePriorMatchingOptions();
+  *rig_matching = RigMatchingOptions();
   *transitive_matching = TransitiveMatchingOptions();
   *image_pairs_matching = ImagePairsMatchingOptions();
   *bundle_adjustment = BundleAdjustmentOptions();
@@ -841,6 +1123,8 @@ bool OptionManager::Check() {
   if (added_image_options_)
     success = success && CHECK_OPTION_IMPL(ExistsDir(*image_path));
 
+  success = success && CHECK_OPTION_IMPL(*metrics_interval > 0);
+
   if (image_reader) success = success && image_reader->Check();
   if (sift_extraction) success = success && sift_extraction->Check();
 
@@ -850,6 +1134,8 @@ bool OptionManager::Check() {
   if (sequential_matching) success = success && sequential_matching->Check();
   if (vocab_tree_matching) success = success && vocab_tree_matching->Check();
   if (spatial_matching) success = success && spatial_matching->Check();
+  if (pose_prior_matching) success = success && pose_prior_matching->Check();
+  if (rig_matching) success = success && rig_matching->Check();
   if (transitive_matching) success = success && transitive_matching->Check();
   if (image_pairs_matching) success = success && image_pairs_matching->Check();
 
@@ -868,6 +1154,15 @@ bool OptionManager::Check() {
   return success;
 }
 
+OptionManager::ParseExit::ParseExit(const int status)
+    : std::runtime_error(StringPrintf("Parsing options exited with status %d",
+                                      status)),
+      status(status) {}
+
+void OptionManager::SetExitOnParse(const bool enabled) {
+  exit_on_parse.store(enabled, std::memory_order_relaxed);
+}
+
 void OptionManager::Parse(const int argc, char** argv) {
   config::variables_map vmap;
 
@@ -881,33 +1176,45 @@ void OptionManager::Parse(const int argc, char** argv) {
           << "Options can either be specified via command-line or by defining "
              "them in a .ini project file passed to `--project_path`.\n"
           << *desc_;
-      // NOLINTNEXTLINE(concurrency-mt-unsafe)
-      exit(EXIT_SUCCESS);
+      ExitParse(EXIT_SUCCESS);
     }
 
     if (vmap.count("project_path")) {
       *project_path = vmap["project_path"].as<std::string>();
       if (!Read(*project_path)) {
-        // NOLINTNEXTLINE(concurrency-mt-unsafe)
-        exit(EXIT_FAILURE);
+        ExitParse(EXIT_FAILURE);
       }
     } else {
       vmap.notify();
     }
+  } catch (const ParseExit&) {
+    throw;
   } catch (std::exception& exc) {
     LOG(ERROR) << "Failed to parse options - " << exc.what() << ".";
-    // NOLINTNEXTLINE(concurrency-mt-unsafe)
-    exit(EXIT_FAILURE);
+    ExitParse(EXIT_FAILURE);
   } catch (...) {
     LOG(ERROR) << "Failed to parse options for unknown reason.";
-    // NOLINTNEXTLINE(concurrency-mt-unsafe)
-    exit(EXIT_FAILURE);
+    ExitParse(EXIT_FAILURE);
   }
 
   if (!Check()) {
     LOG(ERROR) << "Invalid options provided.";
-    // NOLINTNEXTLINE(concurrency-mt-unsafe)
-    exit(EXIT_FAILURE);
+    ExitParse(EXIT_FAILURE);
+  }
+
+  SetDeterministicExecution(*deterministic);
+
+  if (!trace_path->empty() || !metrics_path->empty()) {
+    TracerOptions tracer_options;
+    tracer_options.output_path = *trace_path;
+    tracer_options.metrics_path = *metrics_path;
+    tracer_options.metrics_interval = *metrics_interval;
+    // Only the statistics are required for the metrics, such that the memory
+    // of the span events is not spent without a trace.
+    if (trace_path->empty()) {
+      tracer_options.max_num_events_per_thread = 0;
+    }
+    Tracer::Instance().Start(tracer_options);
   }
 }
 
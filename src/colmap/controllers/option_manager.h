@@ -32,6 +32,7 @@
 #include "colmap/util/logging.h"
 
 #include <memory>
+#include <stdexcept>
 
 #include <boost/program_options.hpp>
 
@@ -45,6 +46,8 @@ struct ExhaustiveMatchingOptions;
 struct SequentialMatchingOptions;
 struct VocabTreeMatchingOptions;
 struct SpatialMatchingOptions;
+struct PosePriorMatchingOptions;
+struct RigMatchingOptions;
 struct TransitiveMatchingOptions;
 struct ImagePairsMatchingOptions;
 struct BundleAdjustmentOptions;
@@ -88,6 +91,8 @@ class OptionManager {
   void AddSequentialMatchingOptions();
   void AddVocabTreeMatchingOptions();
   void AddSpatialMatchingOptions();
+  void AddPosePriorMatchingOptions();
+  void AddRigMatchingOptions();
   void AddTransitiveMatchingOptions();
   void AddImagePairsMatchingOptions();
   void AddBundleAdjustmentOptions();
@@ -112,6 +117,19 @@ class OptionManager {
 
   bool Check();
 
+  // Thrown by `Parse` instead of exiting the process, if exiting is disabled,
+  // where `status` is the exit status the process would have exited with.
+  struct ParseExit : public std::runtime_error {
+    explicit ParseExit(int status);
+    int status;
+  };
+
+  // Enable or disable exiting the process in `Parse` after printing the help
+  // or on invalid options. Long-running processes, such as `colmap serve`,
+  // that parse the options of many jobs disable it and catch `ParseExit`
+  // instead. Enabled by default.
+  static void SetExitOnParse(bool enabled);
+
   void Parse(int argc, char** argv);
   bool Read(const std::string& path);
   bool ReRead(const std::string& path);
@@ -121,6 +139,21 @@ class OptionManager {
   std::shared_ptr<std::string> database_path;
   std::shared_ptr<std::string> image_path;
 
+  // Output path of the trace without extension, which enables the tracing of
+  // the instrumented hot paths if not empty, see `Tracer`.
+  std::shared_ptr<std::string> trace_path;
+
+  // Output path of the metrics without extension, which periodically exports
+  // the progress of the command every `metrics_interval` seconds if not empty,
+  // see `MetricsExporter`.
+  std::shared_ptr<std::string> metrics_path;
+  std::shared_ptr<double> metrics_interval;
+
+  // Whether to execute the parallel stages deterministically, such that the
+  // results do not depend on the number of threads or their scheduling, see
+  // `SetDeterministicExecution`.
+  std::shared_ptr<bool> deterministic;
+
   std::shared_ptr<ImageReaderOptions> image_reader;
   std::shared_ptr<SiftExtractionOptions> sift_extraction;
 
@@ -130,6 +163,8 @@ class OptionManager {
   std::shared_ptr<SequentialMatchingOptions> sequential_matching;
   std::shared_ptr<VocabTreeMatchingOptions> vocab_tree_matching;
   std::shared_ptr<SpatialMatchingOptions> spatial_matching;
+  std::shared_ptr<PosePriorMatchingOptions> pose_prior_matching;
+  std::shared_ptr<RigMatchingOptions> rig_matching;
   std::shared_ptr<TransitiveMatchingOptions> transitive_matching;
   std::shared_ptr<ImagePairsMatchingOptions> image_pairs_matching;
 
@@ -173,6 +208,8 @@ class OptionManager {
   bool added_sequential_match_options_;
   bool added_vocab_tree_match_options_;
   bool added_spatial_match_options_;
+  bool added_pose_prior_match_options_;
+  bool added_rig_match_options_;
   bool added_transitive_match_options_;
   bool added_image_pairs_match_options_;
   bool added_ba_options_;
@@ -33,7 +33,10 @@
 #include "colmap/geometry/pose.h"
 #include "colmap/optim/loransac.h"
 #include "colmap/scene/projection.h"
+#include "colmap/util/threading.h"
 
+#include <algorithm>
+#include <memory>
 #include <unordered_map>
 
 #include <glog/logging.h>
@@ -41,25 +44,84 @@
 namespace colmap {
 namespace {
 
+// The observations of an image registered in both reconstructions, which are
+// triangulated in both reconstructions, together with their 3D points. They
+// are gathered once, such that the alignment residuals only iterate over
+// contiguous arrays instead of looking up the points in the reconstructions.
+struct CommonImageObservations {
+  Eigen::Vector3d src_proj_center;
+  Eigen::Vector3d tgt_proj_center;
+  Eigen::Matrix3x4d src_cam_from_world;
+  Eigen::Matrix3x4d tgt_cam_from_world;
+  const Camera* src_camera = nullptr;
+  const Camera* tgt_camera = nullptr;
+  std::vector<Eigen::Vector2d> src_points2D;
+  std::vector<Eigen::Vector2d> tgt_points2D;
+  std::vector<Eigen::Vector3d> src_points3D;
+  std::vector<Eigen::Vector3d> tgt_points3D;
+};
+
+CommonImageObservations ExtractCommonImageObservations(
+    const Reconstruction& src_reconstruction,
+    const Reconstruction& tgt_reconstruction,
+    const Image& src_image,
+    const Image& tgt_image) {
+  CHECK_EQ(src_image.ImageId(), tgt_image.ImageId());
+  CHECK_EQ(src_image.NumPoints2D(), tgt_image.NumPoints2D());
+
+  CommonImageObservations observations;
+  observations.src_proj_center = src_image.ProjectionCenter();
+  observations.tgt_proj_center = tgt_image.ProjectionCenter();
+  observations.src_cam_from_world = src_image.CamFromWorld().ToMatrix();
+  observations.tgt_cam_from_world = tgt_image.CamFromWorld().ToMatrix();
+  observations.src_camera = &src_reconstruction.Camera(src_image.CameraId());
+  observations.tgt_camera = &tgt_reconstruction.Camera(tgt_image.CameraId());
+
+  for (point2D_t point2D_idx = 0; point2D_idx < src_image.NumPoints2D();
+       ++point2D_idx) {
+    // Check if both images have a 3D point.
+
+    const auto& src_point2D = src_image.Point2D(point2D_idx);
+    if (!src_point2D.HasPoint3D()) {
+      continue;
+    }
+
+    const auto& tgt_point2D = tgt_image.Point2D(point2D_idx);
+    if (!tgt_point2D.HasPoint3D()) {
+      continue;
+    }
+
+    observations.src_points2D.push_back(src_point2D.xy);
+    observations.tgt_points2D.push_back(tgt_point2D.xy);
+    observations.src_points3D.push_back(
+        src_reconstruction.Point3D(src_point2D.point3D_id).xyz);
+    observations.tgt_points3D.push_back(
+        tgt_reconstruction.Point3D(tgt_point2D.point3D_id).xyz);
+  }
+
+  return observations;
+}
+
 struct ReconstructionAlignmentEstimator {
   static const int kMinNumSamples = 3;
 
-  typedef const Image* X_t;
-  typedef const Image* Y_t;
+  typedef const CommonImageObservations* X_t;
+  typedef const CommonImageObservations* Y_t;
   typedef Sim3d M_t;
 
   void SetMaxReprojError(const double max_reproj_error) {
     max_squared_reproj_error_ = max_reproj_error * max_reproj_error;
   }
 
-  void SetReconstructions(const Reconstruction* src_reconstruction,
-                          const Reconstruction* tgt_reconstruction) {
-    CHECK_NOTNULL(src_reconstruction);
-    CHECK_NOTNULL(tgt_reconstruction);
-    src_reconstruction_ = src_reconstruction;
-    tgt_reconstruction_ = tgt_reconstruction;
+  // The maximum residual of an inlier image, as used by RANSAC, such that the
+  // scoring of an image can be stopped once it cannot become an inlier.
+  void SetMaxResidual(const double max_residual) {
+    max_residual_ = max_residual;
   }
 
+  // Optional thread pool to compute the residuals of the images in parallel.
+  void SetThreadPool(ThreadPool* thread_pool) { thread_pool_ = thread_pool; }
+
   // Estimate 3D similarity transform from corresponding projection centers.
   void Estimate(const std::vector<X_t>& src_images,
                 const std::vector<Y_t>& tgt_images,
@@ -74,9 +136,8 @@ struct ReconstructionAlignmentEstimator {
     std::vector<Eigen::Vector3d> proj_centers1(src_images.size());
     std::vector<Eigen::Vector3d> proj_centers2(tgt_images.size());
     for (size_t i = 0; i < src_images.size(); ++i) {
-      CHECK_EQ(src_images[i]->ImageId(), tgt_images[i]->ImageId());
-      proj_centers1[i] = src_images[i]->ProjectionCenter();
-      proj_centers2[i] = tgt_images[i]->ProjectionCenter();
+      proj_centers1[i] = src_images[i]->src_proj_center;
+      proj_centers2[i] = tgt_images[i]->tgt_proj_center;
     }
 
     Sim3d tgt_from_src;
@@ -98,92 +159,111 @@ struct ReconstructionAlignmentEstimator {
                  const M_t& tgt_from_src,
                  std::vector<double>* residuals) const {
     CHECK_EQ(src_images.size(), tgt_images.size());
-    CHECK_NOTNULL(src_reconstruction_);
-    CHECK_NOTNULL(tgt_reconstruction_);
 
-    const Sim3d srcFromTgt = Inverse(tgt_from_src);
+    // Transform the points and project them into the other reconstruction
+    // with a single projection matrix per image.
+    const Eigen::Matrix3x4d tgt_from_src_matrix = tgt_from_src.ToMatrix();
+    const Eigen::Matrix3x4d src_from_tgt_matrix =
+        Inverse(tgt_from_src).ToMatrix();
 
     residuals->resize(src_images.size());
 
-    for (size_t i = 0; i < src_images.size(); ++i) {
-      const auto& src_image = *src_images[i];
-      const auto& tgt_image = *tgt_images[i];
-
-      CHECK_EQ(src_image.ImageId(), tgt_image.ImageId());
-
-      const auto& src_camera =
-          src_reconstruction_->Camera(src_image.CameraId());
-      const auto& tgt_camera =
-          tgt_reconstruction_->Camera(tgt_image.CameraId());
+    const auto compute_residual = [&](const int64_t i) {
+      // The source and target data both refer to the common observations.
+      const CommonImageObservations& src_observations = *src_images[i];
 
-      const Eigen::Matrix3x4d src_cam_from_world =
-          src_image.CamFromWorld().ToMatrix();
-      const Eigen::Matrix3x4d tgt_cam_from_world =
-          tgt_image.CamFromWorld().ToMatrix();
+      const size_t num_common_points = src_observations.src_points2D.size();
+      if (num_common_points == 0) {
+        (*residuals)[i] = 1.0;
+        return;
+      }
 
-      CHECK_EQ(src_image.NumPoints2D(), tgt_image.NumPoints2D());
+      const Eigen::Matrix3x4d tgt_cam_from_src_world =
+          ComposeProjectionMatrices(src_observations.tgt_cam_from_world,
+                                    tgt_from_src_matrix);
+      const Eigen::Matrix3x4d src_cam_from_tgt_world =
+          ComposeProjectionMatrices(src_observations.src_cam_from_world,
+                                    src_from_tgt_matrix);
 
       size_t num_inliers = 0;
-      size_t num_common_points = 0;
-
-      for (point2D_t point2D_idx = 0; point2D_idx < src_image.NumPoints2D();
-           ++point2D_idx) {
-        // Check if both images have a 3D point.
-
-        const auto& src_point2D = src_image.Point2D(point2D_idx);
-        if (!src_point2D.HasPoint3D()) {
+      size_t num_outliers = 0;
+      for (size_t j = 0; j < num_common_points; ++j) {
+        if (CalculateSquaredReprojectionError(
+                src_observations.tgt_points2D[j],
+                src_observations.src_points3D[j],
+                tgt_cam_from_src_world,
+                *src_observations.tgt_camera) <= max_squared_reproj_error_ &&
+            CalculateSquaredReprojectionError(
+                src_observations.src_points2D[j],
+                src_observations.tgt_points3D[j],
+                src_cam_from_tgt_world,
+                *src_observations.src_camera) <= max_squared_reproj_error_) {
+          num_inliers += 1;
           continue;
         }
 
-        const auto& tgt_point2D = tgt_image.Point2D(point2D_idx);
-        if (!tgt_point2D.HasPoint3D()) {
-          continue;
-        }
-
-        num_common_points += 1;
-
-        const Eigen::Vector3d src_point_in_tgt =
-            tgt_from_src *
-            src_reconstruction_->Point3D(src_point2D.point3D_id).xyz;
-        if (CalculateSquaredReprojectionError(tgt_point2D.xy,
-                                              src_point_in_tgt,
-                                              tgt_cam_from_world,
-                                              tgt_camera) >
-            max_squared_reproj_error_) {
-          continue;
-        }
-
-        const Eigen::Vector3d tgt_point_in_src =
-            srcFromTgt *
-            tgt_reconstruction_->Point3D(tgt_point2D.point3D_id).xyz;
-        if (CalculateSquaredReprojectionError(src_point2D.xy,
-                                              tgt_point_in_src,
-                                              src_cam_from_world,
-                                              src_camera) >
-            max_squared_reproj_error_) {
-          continue;
+        // Stop, if the image cannot become an inlier anymore, even if all
+        // remaining points are inliers. The residual of outliers does not
+        // contribute to the support of the model.
+        num_outliers += 1;
+        const double min_negative_inlier_ratio =
+            1.0 - static_cast<double>(num_common_points - num_outliers) /
+                      static_cast<double>(num_common_points);
+        if (min_negative_inlier_ratio * min_negative_inlier_ratio >
+            max_residual_) {
+          (*residuals)[i] = 1.0;
+          return;
         }
-
-        num_inliers += 1;
       }
 
-      if (num_common_points == 0) {
-        (*residuals)[i] = 1.0;
-      } else {
-        const double negative_inlier_ratio =
-            1.0 - static_cast<double>(num_inliers) /
-                      static_cast<double>(num_common_points);
-        (*residuals)[i] = negative_inlier_ratio * negative_inlier_ratio;
+      const double negative_inlier_ratio =
+          1.0 - static_cast<double>(num_inliers) /
+                    static_cast<double>(num_common_points);
+      (*residuals)[i] = negative_inlier_ratio * negative_inlier_ratio;
+    };
+
+    if (thread_pool_ != nullptr && src_images.size() > 1) {
+      thread_pool_->ParallelFor(0, src_images.size(), 1, compute_residual);
+    } else {
+      for (size_t i = 0; i < src_images.size(); ++i) {
+        compute_residual(i);
       }
     }
   }
 
  private:
+  // The projection matrix of a camera applied after a transformation of the
+  // world, both given as 3x4 matrices.
+  static Eigen::Matrix3x4d ComposeProjectionMatrices(
+      const Eigen::Matrix3x4d& cam_from_world,
+      const Eigen::Matrix3x4d& world_from_other) {
+    Eigen::Matrix3x4d cam_from_other;
+    cam_from_other.leftCols<3>() =
+        cam_from_world.leftCols<3>() * world_from_other.leftCols<3>();
+    cam_from_other.col(3) =
+        cam_from_world.leftCols<3>() * world_from_other.col(3) +
+        cam_from_world.col(3);
+    return cam_from_other;
+  }
+
   double max_squared_reproj_error_ = 0.0;
-  const Reconstruction* src_reconstruction_ = nullptr;
-  const Reconstruction* tgt_reconstruction_ = nullptr;
+  double max_residual_ = std::numeric_limits<double>::max();
+  ThreadPool* thread_pool_ = nullptr;
 };
 
+// The identifiers of the 3D points in ascending order, such that points are
+// merged in a stable order, which does not depend on the insertion history of
+// the hash map of the points.
+std::vector<point3D_t> SortedPoint3DIds(const Reconstruction& reconstruction) {
+  std::vector<point3D_t> point3D_ids;
+  point3D_ids.reserve(reconstruction.NumPoints3D());
+  for (const auto& point3D : reconstruction.Points3D()) {
+    point3D_ids.push_back(point3D.first);
+  }
+  std::sort(point3D_ids.begin(), point3D_ids.end());
+  return point3D_ids;
+}
+
 }  // namespace
 
 bool AlignReconstructionToLocations(
@@ -249,7 +329,8 @@ bool AlignReconstructionsViaReprojections(
     const Reconstruction& tgt_reconstruction,
     const double min_inlier_observations,
     const double max_reproj_error,
-    Sim3d* tgt_from_src) {
+    Sim3d* tgt_from_src,
+    const int num_threads) {
   CHECK_GE(min_inlier_observations, 0.0);
   CHECK_LE(min_inlier_observations, 1.0);
 
@@ -257,14 +338,6 @@ bool AlignReconstructionsViaReprojections(
   ransac_options.max_error = 1.0 - min_inlier_observations;
   ransac_options.min_inlier_ratio = 0.2;
 
-  LORANSAC<ReconstructionAlignmentEstimator, ReconstructionAlignmentEstimator>
-      ransac(ransac_options);
-  ransac.estimator.SetMaxReprojError(max_reproj_error);
-  ransac.estimator.SetReconstructions(&src_reconstruction, &tgt_reconstruction);
-  ransac.local_estimator.SetMaxReprojError(max_reproj_error);
-  ransac.local_estimator.SetReconstructions(&src_reconstruction,
-                                            &tgt_reconstruction);
-
   const std::vector<std::pair<image_t, image_t>> common_image_ids =
       src_reconstruction.FindCommonRegImageIds(tgt_reconstruction);
 
@@ -272,14 +345,45 @@ bool AlignReconstructionsViaReprojections(
     return false;
   }
 
-  std::vector<const Image*> src_images(common_image_ids.size());
-  std::vector<const Image*> tgt_images(common_image_ids.size());
-  for (size_t i = 0; i < common_image_ids.size(); ++i) {
-    src_images[i] = &src_reconstruction.Image(common_image_ids[i].first);
-    tgt_images[i] = &tgt_reconstruction.Image(common_image_ids[i].second);
+  const int num_eff_threads = GetEffectiveNumThreads(num_threads);
+  std::unique_ptr<ThreadPool> thread_pool;
+  if (num_eff_threads > 1) {
+    thread_pool = std::make_unique<ThreadPool>(num_eff_threads);
+  }
+
+  std::vector<CommonImageObservations> observations(common_image_ids.size());
+  const auto extract_observations = [&](const int64_t i) {
+    observations[i] = ExtractCommonImageObservations(
+        src_reconstruction,
+        tgt_reconstruction,
+        src_reconstruction.Image(common_image_ids[i].first),
+        tgt_reconstruction.Image(common_image_ids[i].second));
+  };
+  if (thread_pool) {
+    thread_pool->ParallelFor(
+        0, common_image_ids.size(), 1, extract_observations);
+  } else {
+    for (size_t i = 0; i < common_image_ids.size(); ++i) {
+      extract_observations(i);
+    }
+  }
+
+  std::vector<const CommonImageObservations*> images(observations.size());
+  for (size_t i = 0; i < observations.size(); ++i) {
+    images[i] = &observations[i];
+  }
+
+  LORANSAC<ReconstructionAlignmentEstimator, ReconstructionAlignmentEstimator>
+      ransac(ransac_options);
+  for (ReconstructionAlignmentEstimator* estimator :
+       {&ransac.estimator, &ransac.local_estimator}) {
+    estimator->SetMaxReprojError(max_reproj_error);
+    estimator->SetMaxResidual(ransac_options.max_error *
+                              ransac_options.max_error);
+    estimator->SetThreadPool(thread_pool.get());
   }
 
-  const auto report = ransac.Estimate(src_images, tgt_images);
+  const auto report = ransac.Estimate(images, images);
 
   if (report.success) {
     *tgt_from_src = report.model;
@@ -412,14 +516,16 @@ bool AlignReconstructionsViaPoints(const Reconstruction& src_reconstruction,
 bool MergeReconstructions(const double max_reproj_error,
                           const Reconstruction& src_reconstruction,
                           Reconstruction* tgt_reconstruction,
-                          bool align) {
+                          bool align,
+                          const int num_threads) {
   Sim3d tgt_from_src;
   if (align) {
     if (!AlignReconstructionsViaReprojections(src_reconstruction,
                                               *tgt_reconstruction,
                                               /*min_inlier_observations=*/0.3,
                                               max_reproj_error,
-                                              &tgt_from_src)) {
+                                              &tgt_from_src,
+                                              num_threads)) {
       return false;
     }
   }
@@ -438,7 +544,10 @@ bool MergeReconstructions(const double max_reproj_error,
   }
 
   // Register the missing images in this src_reconstruction.
-  for (const auto image_id : missing_image_ids) {
+  for (const auto image_id : src_reconstruction.RegImageIds()) {
+    if (missing_image_ids.count(image_id) == 0) {
+      continue;
+    }
     auto src_image = src_reconstruction.Image(image_id);
     src_image.SetRegistered(false);
     src_image.CamFromWorld() =
@@ -459,11 +568,12 @@ bool MergeReconstructions(const double max_reproj_error,
   //      reconstructions if they have a one-to-one mapping.
   // Note that in both cases no cheirality or reprojection test is performed.
 
-  for (const auto& point3D : src_reconstruction.Points3D()) {
+  for (const point3D_t src_point3D_id : SortedPoint3DIds(src_reconstruction)) {
+    const Point3D& point3D = src_reconstruction.Point3D(src_point3D_id);
     Track new_track;
     Track old_track;
     std::unordered_set<point3D_t> old_point3D_ids;
-    for (const auto& track_el : point3D.second.track.Elements()) {
+    for (const auto& track_el : point3D.track.Elements()) {
       if (common_image_ids.count(track_el.image_id) > 0) {
         const auto& point2D = tgt_reconstruction->Image(track_el.image_id)
                                   .Point2D(track_el.point2D_idx);
@@ -485,9 +595,9 @@ bool MergeReconstructions(const double max_reproj_error,
         (new_track.Length() + old_track.Length()) >= 2 &&
         old_point3D_ids.size() == 1;
     if (create_new_point || merge_new_and_old_point) {
-      const Eigen::Vector3d xyz = tgt_from_src * point3D.second.xyz;
+      const Eigen::Vector3d xyz = tgt_from_src * point3D.xyz;
       const auto point3D_id =
-          tgt_reconstruction->AddPoint3D(xyz, new_track, point3D.second.color);
+          tgt_reconstruction->AddPoint3D(xyz, new_track, point3D.color);
       if (old_point3D_ids.size() == 1) {
         tgt_reconstruction->MergePoints3D(point3D_id, *old_point3D_ids.begin());
       }
@@ -499,4 +609,79 @@ bool MergeReconstructions(const double max_reproj_error,
   return true;
 }
 
+void MergeReconstructions(const double max_reproj_error,
+                          const Reconstruction& src_reconstruction,
+                          ReconstructionOverlay* tgt_reconstruction) {
+  // Find common and missing images in the two reconstructions.
+  std::unordered_set<image_t> common_image_ids;
+  common_image_ids.reserve(src_reconstruction.NumRegImages());
+  std::unordered_set<image_t> missing_image_ids;
+  missing_image_ids.reserve(src_reconstruction.NumRegImages());
+  for (const auto& image_id : src_reconstruction.RegImageIds()) {
+    if (tgt_reconstruction->ExistsImage(image_id)) {
+      common_image_ids.insert(image_id);
+    } else {
+      missing_image_ids.insert(image_id);
+    }
+  }
+
+  // Register the missing images without their 3D points, which are added with
+  // the merged point cloud below.
+  for (const auto image_id : src_reconstruction.RegImageIds()) {
+    if (missing_image_ids.count(image_id) == 0) {
+      continue;
+    }
+    auto src_image = src_reconstruction.Image(image_id);
+    src_image.SetRegistered(false);
+    for (point2D_t point2D_idx = 0; point2D_idx < src_image.NumPoints2D();
+         ++point2D_idx) {
+      src_image.ResetPoint3DForPoint2D(point2D_idx);
+    }
+    tgt_reconstruction->AddImage(std::move(src_image));
+    tgt_reconstruction->RegisterImage(image_id);
+    const camera_t camera_id =
+        tgt_reconstruction->Image(image_id).CameraId();
+    if (!tgt_reconstruction->ExistsCamera(camera_id)) {
+      tgt_reconstruction->AddCamera(src_reconstruction.Camera(camera_id));
+    }
+  }
+
+  // Merge the two point clouds with the same rules as above.
+  for (const point3D_t src_point3D_id : SortedPoint3DIds(src_reconstruction)) {
+    const Point3D& point3D = src_reconstruction.Point3D(src_point3D_id);
+    Track new_track;
+    Track old_track;
+    std::unordered_set<point3D_t> old_point3D_ids;
+    for (const auto& track_el : point3D.track.Elements()) {
+      if (common_image_ids.count(track_el.image_id) > 0) {
+        const auto& point2D = tgt_reconstruction->Image(track_el.image_id)
+                                  .Point2D(track_el.point2D_idx);
+        if (point2D.HasPoint3D()) {
+          old_track.AddElement(track_el);
+          old_point3D_ids.insert(point2D.point3D_id);
+        } else {
+          new_track.AddElement(track_el);
+        }
+      } else if (missing_image_ids.count(track_el.image_id) > 0) {
+        new_track.AddElement(track_el);
+      }
+    }
+
+    const bool create_new_point = new_track.Length() >= 2;
+    const bool merge_new_and_old_point =
+        (new_track.Length() + old_track.Length()) >= 2 &&
+        old_point3D_ids.size() == 1;
+    if (create_new_point || merge_new_and_old_point) {
+      const auto point3D_id = tgt_reconstruction->AddPoint3D(
+          point3D.xyz, new_track, point3D.color);
+      if (old_point3D_ids.size() == 1) {
+        tgt_reconstruction->MergePoints3D(point3D_id,
+                                          *old_point3D_ids.begin());
+      }
+    }
+  }
+
+  tgt_reconstruction->FilterLocalPoints3D(max_reproj_error);
+}
+
 }  // namespace colmap
@@ -31,6 +31,7 @@
 
 #include "colmap/geometry/sim3.h"
 #include "colmap/scene/reconstruction.h"
+#include "colmap/scene/reconstruction_overlay.h"
 
 namespace colmap {
 
@@ -47,13 +48,15 @@ bool AlignReconstructionToLocations(
 // robustly inside RANSAC from corresponding projection centers. An alignment
 // is verified by reprojecting common 3D point observations.
 // The min_inlier_observations threshold determines how many observations
-// in a common image must reproject within the given threshold.
+// in a common image must reproject within the given threshold. The common
+// images are verified in parallel with the given number of threads.
 bool AlignReconstructionsViaReprojections(
     const Reconstruction& src_reconstruction,
     const Reconstruction& tgt_reconstruction,
     double min_inlier_observations,
     double max_reproj_error,
-    Sim3d* tgt_from_src);
+    Sim3d* tgt_from_src,
+    int num_threads = -1);
 
 // Robustly compute alignment between reconstructions by finding images that
 // are registered in both reconstructions. The alignment is then estimated
@@ -91,9 +94,19 @@ std::vector<ImageAlignmentError> ComputeImageAlignmentError(
 //
 // @align: Whether to compute the Sim3d between the source
 // reconstruction and the target reconstruction.
+// @num_threads: Number of threads to compute the alignment.
 bool MergeReconstructions(double max_reproj_error,
                           const Reconstruction& src_reconstruction,
                           Reconstruction* tgt_reconstruction,
-                          bool align = true);
+                          bool align = true,
+                          int num_threads = -1);
+
+// Merges cameras, images, and points3D of the source into a copy-on-write view
+// of the target reconstruction, which must be in the same coordinate frame,
+// such that the target is not copied. Only the added and merged 3D points are
+// filtered by their reprojection error.
+void MergeReconstructions(double max_reproj_error,
+                          const Reconstruction& src_reconstruction,
+                          ReconstructionOverlay* tgt_reconstruction);
 
 }  // namespace colmap
@@ -83,6 +83,25 @@ TEST(Alignment, AlignReconstructionsViaReprojections) {
   ExpectEqualSim3d(gt_tgt_from_src, tgt_from_src);
 }
 
+TEST(Alignment, AlignReconstructionsViaReprojectionsMultiThreaded) {
+  Reconstruction src_reconstruction = GenerateReconstructionForAlignment();
+  Reconstruction tgt_reconstruction = src_reconstruction;
+
+  Sim3d gt_tgt_from_src = TestSim3d();
+  tgt_reconstruction.Transform(gt_tgt_from_src);
+
+  for (const int num_threads : {1, 4}) {
+    Sim3d tgt_from_src;
+    CHECK(AlignReconstructionsViaReprojections(src_reconstruction,
+                                               tgt_reconstruction,
+                                               /*min_inlier_observations=*/0.9,
+                                               /*max_reproj_error=*/2,
+                                               &tgt_from_src,
+                                               num_threads));
+    ExpectEqualSim3d(gt_tgt_from_src, tgt_from_src);
+  }
+}
+
 TEST(Alignment, AlignReconstructionsViaProjCenters) {
   Reconstruction src_reconstruction = GenerateReconstructionForAlignment();
   Reconstruction tgt_reconstruction = src_reconstruction;
@@ -115,4 +134,41 @@ TEST(Alignment, AlignReconstructionsViaPoints) {
   ExpectEqualSim3d(gt_tgt_from_src, tgt_from_src);
 }
 
+TEST(Alignment, MergeReconstructionsIntoOverlay) {
+  const Reconstruction src_reconstruction =
+      GenerateReconstructionForAlignment();
+
+  // The target holds the first half of the images without any 3D points.
+  auto tgt_reconstruction = std::make_shared<Reconstruction>();
+  for (const auto& camera : src_reconstruction.Cameras()) {
+    tgt_reconstruction->AddCamera(camera.second);
+  }
+  const std::vector<image_t>& reg_image_ids = src_reconstruction.RegImageIds();
+  for (size_t i = 0; i < reg_image_ids.size() / 2; ++i) {
+    Image image = src_reconstruction.Image(reg_image_ids[i]);
+    for (point2D_t point2D_idx = 0; point2D_idx < image.NumPoints2D();
+         ++point2D_idx) {
+      image.ResetPoint3DForPoint2D(point2D_idx);
+    }
+    tgt_reconstruction->AddImage(std::move(image));
+  }
+
+  ReconstructionOverlay overlay(tgt_reconstruction);
+  MergeReconstructions(
+      /*max_reproj_error=*/1.0, src_reconstruction, &overlay);
+  EXPECT_EQ(overlay.NumRegImages(), src_reconstruction.NumRegImages());
+  EXPECT_EQ(overlay.NumPoints3D(), src_reconstruction.NumPoints3D());
+  EXPECT_EQ(tgt_reconstruction->NumRegImages(), reg_image_ids.size() / 2);
+  EXPECT_EQ(tgt_reconstruction->NumPoints3D(), 0);
+
+  Reconstruction merged_reconstruction = *tgt_reconstruction;
+  overlay.Commit(&merged_reconstruction);
+  EXPECT_EQ(merged_reconstruction.NumRegImages(),
+            src_reconstruction.NumRegImages());
+  EXPECT_EQ(merged_reconstruction.NumPoints3D(),
+            src_reconstruction.NumPoints3D());
+  EXPECT_EQ(merged_reconstruction.ComputeNumObservations(),
+            src_reconstruction.ComputeNumObservations());
+}
+
 }  // namespace colmap
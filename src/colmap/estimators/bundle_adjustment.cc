@@ -31,14 +31,23 @@
 
 #include "colmap/estimators/cost_functions.h"
 #include "colmap/geometry/covariance_transform.h"
+#include "colmap/geometry/pose.h"
+#include "colmap/math/math.h"
+#include "colmap/scene/database.h"
 #include "colmap/scene/projection.h"
 #include "colmap/sensor/models.h"
 #include "colmap/sensor/models_refrac.h"
 #include "colmap/util/misc.h"
 #include "colmap/util/threading.h"
 #include "colmap/util/timer.h"
+#include "colmap/util/tracing.h"
+
+#if defined(COLMAP_CUDA_ENABLED)
+#include "colmap/util/cuda.h"
+#endif  // COLMAP_CUDA_ENABLED
 
 #include <iomanip>
+#include <limits>
 
 namespace colmap {
 
@@ -65,9 +74,293 @@ ceres::LossFunction* BundleAdjustmentOptions::CreateLossFunction() const {
 
 bool BundleAdjustmentOptions::Check() const {
   CHECK_OPTION_GE(loss_function_scale, 0);
+  if (use_pose_prior) {
+    CHECK_OPTION_EQ(pose_prior_std.size(), 6);
+  }
+  CHECK_OPTION_GT(refrac_calibration_max_num_iterations, 0);
+  CHECK_OPTION_GT(refrac_calibration_max_num_observations, 0);
+  CHECK_OPTION_GE(refrac_calibration_tolerance, 0);
+  CHECK_OPTION_GE(min_num_images_gpu_solver, 0);
+  CHECK_OPTION_GE(max_num_images_direct_dense_gpu_solver, 0);
+  CHECK_OPTION_GE(max_num_images_direct_sparse_gpu_solver, 0);
+  CHECK_OPTION_GE(adaptive_cost_tolerance, 0);
+  CHECK_OPTION_GE(adaptive_rotation_tolerance, 0);
+  CHECK_OPTION_GE(adaptive_translation_tolerance, 0);
+  CHECK_OPTION_GT(adaptive_num_converged_iterations, 0);
   return true;
 }
 
+void BundleAdjustmentOptions::SetStage(const Stage stage) {
+  this->stage = stage;
+  switch (stage) {
+    case Stage::DEFAULT:
+    case Stage::GLOBAL:
+      adaptive_cost_tolerance = 1e-5;
+      adaptive_rotation_tolerance = 1e-4;
+      adaptive_translation_tolerance = 1e-5;
+      adaptive_num_converged_iterations = 2;
+      break;
+    case Stage::LOCAL:
+    case Stage::REFRAC_CALIBRATION:
+      adaptive_cost_tolerance = 1e-4;
+      adaptive_rotation_tolerance = 1e-3;
+      adaptive_translation_tolerance = 1e-4;
+      adaptive_num_converged_iterations = 1;
+      break;
+    case Stage::HYBRID_FINAL:
+      adaptive_cost_tolerance = 1e-6;
+      adaptive_rotation_tolerance = 1e-5;
+      adaptive_translation_tolerance = 1e-6;
+      adaptive_num_converged_iterations = 3;
+      break;
+  }
+}
+
+const char* BundleAdjustmentIterationsMetricName(
+    const BundleAdjustmentOptions::Stage stage) {
+  switch (stage) {
+    case BundleAdjustmentOptions::Stage::LOCAL:
+      return "Local bundle adjustment iterations";
+    case BundleAdjustmentOptions::Stage::GLOBAL:
+      return "Global bundle adjustment iterations";
+    case BundleAdjustmentOptions::Stage::HYBRID_FINAL:
+      return "Final hybrid bundle adjustment iterations";
+    case BundleAdjustmentOptions::Stage::REFRAC_CALIBRATION:
+      return "Refractive calibration bundle adjustment iterations";
+    default:
+      return "Bundle adjustment iterations";
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// BundleAdjustmentConvergenceCallback
+////////////////////////////////////////////////////////////////////////////////
+
+BundleAdjustmentConvergenceCallback::BundleAdjustmentConvergenceCallback(
+    const BundleAdjustmentOptions& options,
+    std::vector<std::pair<const double*, const double*>> poses)
+    : cost_tolerance_(options.adaptive_cost_tolerance),
+      rotation_tolerance_(DegToRad(options.adaptive_rotation_tolerance)),
+      translation_tolerance_(options.adaptive_translation_tolerance),
+      num_converged_iterations_(options.adaptive_num_converged_iterations),
+      poses_(std::move(poses)),
+      prev_poses_(7 * poses_.size()),
+      translation_scale_(1.0),
+      num_consecutive_converged_iterations_(0),
+      converged_(false) {
+  double max_rotation_update;
+  double max_translation_update;
+  UpdatePoses(&max_rotation_update, &max_translation_update);
+
+  // The translation updates are relative to the scale of the scene, which
+  // makes the tolerance independent of the gauge of the reconstruction.
+  std::vector<double> translation_norms;
+  translation_norms.reserve(poses_.size());
+  for (const auto& pose : poses_) {
+    translation_norms.push_back(
+        Eigen::Map<const Eigen::Vector3d>(pose.second).norm());
+  }
+  if (!translation_norms.empty()) {
+    const double median_translation_norm = Median(translation_norms);
+    if (median_translation_norm > std::numeric_limits<double>::epsilon()) {
+      translation_scale_ = median_translation_norm;
+    }
+  }
+}
+
+ceres::CallbackReturnType BundleAdjustmentConvergenceCallback::operator()(
+    const ceres::IterationSummary& summary) {
+  if (summary.iteration == 0 || !summary.step_is_successful) {
+    return ceres::SOLVER_CONTINUE;
+  }
+
+  const double prev_cost = summary.cost + summary.cost_change;
+  const double relative_cost_decrease =
+      prev_cost > 0 ? summary.cost_change / prev_cost : 0;
+
+  double max_rotation_update;
+  double max_translation_update;
+  UpdatePoses(&max_rotation_update, &max_translation_update);
+
+  if (relative_cost_decrease <= cost_tolerance_ &&
+      max_rotation_update <= rotation_tolerance_ &&
+      max_translation_update <= translation_tolerance_ * translation_scale_) {
+    num_consecutive_converged_iterations_ += 1;
+  } else {
+    num_consecutive_converged_iterations_ = 0;
+  }
+
+  if (num_consecutive_converged_iterations_ >= num_converged_iterations_) {
+    converged_ = true;
+    return ceres::SOLVER_TERMINATE_SUCCESSFULLY;
+  }
+
+  return ceres::SOLVER_CONTINUE;
+}
+
+bool BundleAdjustmentConvergenceCallback::Converged() const {
+  return converged_;
+}
+
+void BundleAdjustmentConvergenceCallback::UpdatePoses(
+    double* max_rotation_update, double* max_translation_update) {
+  *max_rotation_update = 0;
+  *max_translation_update = 0;
+  for (size_t i = 0; i < poses_.size(); ++i) {
+    double* prev_pose = prev_poses_.data() + 7 * i;
+    const Eigen::Map<const Eigen::Vector4d> rotation(poses_[i].first);
+    const Eigen::Map<const Eigen::Vector3d> translation(poses_[i].second);
+    Eigen::Map<Eigen::Vector4d> prev_rotation(prev_pose);
+    Eigen::Map<Eigen::Vector3d> prev_translation(prev_pose + 4);
+    // Angle between the rotations, where q and -q are the same rotation.
+    const double cos_half_angle =
+        std::min(1.0, std::abs(rotation.dot(prev_rotation)) /
+                          std::max(rotation.norm() * prev_rotation.norm(),
+                                   std::numeric_limits<double>::min()));
+    *max_rotation_update =
+        std::max(*max_rotation_update, 2 * std::acos(cos_half_angle));
+    *max_translation_update = std::max(*max_translation_update,
+                                       (translation - prev_translation).norm());
+    prev_rotation = rotation;
+    prev_translation = translation;
+  }
+}
+
+double BundleAdjustmentProblemStructure::VisibilityDensity() const {
+  if (num_images < 2) {
+    return 1.0;
+  }
+  return 2.0 * num_covisible_image_pairs /
+         (static_cast<double>(num_images) * (num_images - 1));
+}
+
+double BundleAdjustmentProblemStructure::AvgNumCovisibleImages() const {
+  if (num_images == 0) {
+    return 0.0;
+  }
+  return 2.0 * num_covisible_image_pairs / num_images;
+}
+
+void ConfigureBundleAdjustmentSolver(
+    const BundleAdjustmentOptions& options,
+    const BundleAdjustmentProblemStructure& structure,
+    ceres::Solver::Options* solver_options) {
+  CHECK_NOTNULL(solver_options);
+
+  const size_t num_images = structure.num_images;
+  const bool has_sparse =
+      solver_options->sparse_linear_algebra_library_type != ceres::NO_SPARSE;
+
+  bool cuda_solver_enabled = false;
+  bool cuda_sparse_solver_enabled = false;
+  if (options.use_gpu &&
+      num_images >= static_cast<size_t>(options.min_num_images_gpu_solver)) {
+#if (CERES_VERSION_MAJOR >= 3 || \
+     (CERES_VERSION_MAJOR == 2 && CERES_VERSION_MINOR >= 1)) && \
+    !defined(CERES_NO_CUDA)
+    cuda_solver_enabled = true;
+    solver_options->dense_linear_algebra_library_type = ceres::CUDA;
+#else
+    LOG_FIRST_N(WARNING, 1)
+        << "Requested to use GPU for bundle adjustment, but Ceres-Solver was "
+           "compiled without CUDA support. Falling back to CPU-based solvers.";
+#endif
+
+#if (CERES_VERSION_MAJOR >= 3 || \
+     (CERES_VERSION_MAJOR == 2 && CERES_VERSION_MINOR >= 3)) && \
+    !defined(CERES_NO_CUDSS)
+    cuda_sparse_solver_enabled = true;
+#endif
+  }
+
+  if (cuda_solver_enabled) {
+#if defined(COLMAP_CUDA_ENABLED)
+    const std::vector<int> gpu_indices = CSVToVector<int>(options.gpu_index);
+    CHECK_GT(gpu_indices.size(), 0);
+    SetBestCudaDevice(gpu_indices[0]);
+#else
+    LOG_FIRST_N(WARNING, 1)
+        << "COLMAP was compiled without CUDA support, ignoring the requested "
+           "GPU index for bundle adjustment.";
+#endif  // COLMAP_CUDA_ENABLED
+  }
+
+  // Empirical choice. The reduced camera system of small problems or of
+  // problems, in which most images see each other, is factorized densely.
+  // Larger problems with a sparse visibility graph, e.g., sequentially
+  // captured surveys, in which each image only sees its neighbors, can still
+  // be factorized efficiently by the sparse direct solver.
+  const size_t kMaxNumImagesDirectDenseSolver = 50;
+  const size_t kMaxNumImagesDirectDenseSolverDenseVisibility = 200;
+  const double kMinVisibilityDensityDirectDenseSolver = 0.5;
+  const size_t kMaxNumImagesDirectSparseSolver = 1000;
+  const size_t kSparseVisibilitySizeFactor = 5;
+  const double kMaxAvgNumCovisibleImagesSparseVisibility = 30;
+
+  const double visibility_density = structure.VisibilityDensity();
+  const bool has_sparse_visibility =
+      structure.AvgNumCovisibleImages() <=
+      kMaxAvgNumCovisibleImagesSparseVisibility;
+  const size_t max_num_images_direct_dense_gpu_solver =
+      options.max_num_images_direct_dense_gpu_solver;
+  const size_t max_num_images_direct_sparse_gpu_solver =
+      options.max_num_images_direct_sparse_gpu_solver;
+
+  solver_options->preconditioner_type = ceres::JACOBI;
+  if (num_images <= kMaxNumImagesDirectDenseSolver ||
+      (num_images <= kMaxNumImagesDirectDenseSolverDenseVisibility &&
+       visibility_density >= kMinVisibilityDensityDirectDenseSolver) ||
+      (cuda_solver_enabled &&
+       num_images <= max_num_images_direct_dense_gpu_solver)) {
+    solver_options->linear_solver_type = ceres::DENSE_SCHUR;
+  } else if (cuda_sparse_solver_enabled &&
+             num_images <= max_num_images_direct_sparse_gpu_solver) {
+#if (CERES_VERSION_MAJOR >= 3 || \
+     (CERES_VERSION_MAJOR == 2 && CERES_VERSION_MINOR >= 3)) && \
+    !defined(CERES_NO_CUDSS)
+    solver_options->linear_solver_type = ceres::SPARSE_SCHUR;
+    solver_options->sparse_linear_algebra_library_type = ceres::CUDA_SPARSE;
+#endif
+  } else if (has_sparse && (num_images <= kMaxNumImagesDirectSparseSolver ||
+                            (has_sparse_visibility &&
+                             num_images <= kMaxNumImagesDirectSparseSolver *
+                                               kSparseVisibilitySizeFactor))) {
+    solver_options->linear_solver_type = ceres::SPARSE_SCHUR;
+  } else {  // Indirect sparse (preconditioned CG) solver.
+    solver_options->linear_solver_type = ceres::ITERATIVE_SCHUR;
+    // Clustering the visibility graph only pays off if it is sparse. Shared
+    // parameter blocks connect all images in the visibility graph, such that
+    // the clustering degenerates and is expensive to compute.
+    if (has_sparse && has_sparse_visibility && !structure.has_shared_blocks) {
+      solver_options->preconditioner_type = ceres::CLUSTER_JACOBI;
+      solver_options->visibility_clustering_type = ceres::SINGLE_LINKAGE;
+      std::string solver_error;
+      if (!solver_options->IsValid(&solver_error)) {
+        solver_options->preconditioner_type = ceres::SCHUR_JACOBI;
+      }
+    } else {
+      solver_options->preconditioner_type = ceres::SCHUR_JACOBI;
+    }
+  }
+
+  // Single-threaded is typically faster for small problems due to the
+  // overhead of threading.
+  if (structure.num_residuals <
+      static_cast<size_t>(options.min_num_residuals_for_multi_threading)) {
+    solver_options->num_threads = 1;
+#if CERES_VERSION_MAJOR < 2
+    solver_options->num_linear_solver_threads = 1;
+#endif  // CERES_VERSION_MAJOR
+  } else {
+    solver_options->num_threads =
+        GetEffectiveNumThreads(solver_options->num_threads);
+#if CERES_VERSION_MAJOR < 2
+    solver_options->num_linear_solver_threads =
+        GetEffectiveNumThreads(solver_options->num_linear_solver_threads);
+#endif  // CERES_VERSION_MAJOR
+  }
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // BundleAdjustmentConfig
 ////////////////////////////////////////////////////////////////////////////////
@@ -105,7 +398,16 @@ size_t BundleAdjustmentConfig::NumResiduals(
   // Count the number of observations for all added images.
   size_t num_observations = 0;
   for (const image_t image_id : image_ids_) {
-    num_observations += reconstruction.Image(image_id).NumPoints3D();
+    const Image& image = reconstruction.Image(image_id);
+    if (!has_point_subset_) {
+      num_observations += image.NumPoints3D();
+      continue;
+    }
+    for (const Point2D& point2D : image.Points2D()) {
+      if (point2D.HasPoint3D() && IsInPointSubset(point2D.point3D_id)) {
+        num_observations += 1;
+      }
+    }
   }
 
   // Count the number of observations for all added 3D points that are not
@@ -196,6 +498,26 @@ bool BundleAdjustmentConfig::HasConstantCamPositions(
          constant_cam_positions_.end();
 }
 
+void BundleAdjustmentConfig::SetPointSubset(
+    std::unordered_set<point3D_t> point3D_ids) {
+  has_point_subset_ = true;
+  point_subset_ = std::move(point3D_ids);
+}
+
+void BundleAdjustmentConfig::ClearPointSubset() {
+  has_point_subset_ = false;
+  point_subset_.clear();
+}
+
+bool BundleAdjustmentConfig::HasPointSubset() const {
+  return has_point_subset_;
+}
+
+bool BundleAdjustmentConfig::IsInPointSubset(
+    const point3D_t point3D_id) const {
+  return !has_point_subset_ || point_subset_.count(point3D_id) > 0;
+}
+
 const std::unordered_set<image_t>& BundleAdjustmentConfig::Images() const {
   return image_ids_;
 }
@@ -247,17 +569,127 @@ void BundleAdjustmentConfig::RemoveConstantPoint(const point3D_t point3D_id) {
   constant_point3D_ids_.erase(point3D_id);
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// PosePriorInformationCache
+////////////////////////////////////////////////////////////////////////////////
+
+bool ComputePosePriorSqrtInformation(const Rigid3d& tform_measured,
+                                     const Eigen::Matrix7d& tform_measured_cov,
+                                     Eigen::Matrix6d* sqrt_information) {
+  CHECK_NOTNULL(sqrt_information);
+
+  // Jacobian of the residuals of AbsolutePoseErrorCostFunction w.r.t. the
+  // measured pose, evaluated at the measured pose. The rotation residual is
+  // 2 * vec(q_measured * q_estimated^-1), i.e. the right-multiplication of the
+  // quaternion perturbation with the conjugate of the measured rotation. The
+  // translation residual additionally depends on the rotation residual through
+  // the rotation of the estimated translation.
+  const Eigen::Quaterniond& q = tform_measured.rotation;
+  Eigen::Matrix<double, 3, 4> d_rotation;
+  d_rotation << -q.x(), q.w(), -q.z(), q.y(),  //
+      -q.y(), q.z(), q.w(), -q.x(),            //
+      -q.z(), -q.y(), q.x(), q.w();
+  d_rotation *= 2.0;
+
+  Eigen::Matrix<double, 6, 7> jacobian = Eigen::Matrix<double, 6, 7>::Zero();
+  jacobian.block<3, 4>(0, 0) = d_rotation;
+  jacobian.block<3, 4>(3, 0) =
+      CrossProductMatrix(tform_measured.translation) * d_rotation;
+  jacobian.block<3, 3>(3, 4).setIdentity();
+
+  const Eigen::Matrix6d residual_cov =
+      jacobian * tform_measured_cov * jacobian.transpose();
+  const Eigen::LLT<Eigen::Matrix6d> residual_cov_llt(residual_cov);
+  if (residual_cov_llt.info() != Eigen::Success) {
+    return false;
+  }
+
+  // With residual_cov = L * L^T, the whitened residuals L^-1 * r yield the
+  // squared Mahalanobis distance r^T * residual_cov^-1 * r.
+  *sqrt_information = residual_cov_llt.matrixL().solve(
+      Eigen::Matrix6d::Identity().eval());
+  return sqrt_information->allFinite();
+}
+
+bool PosePriorInformationCache::SqrtInformation(
+    const Image& image,
+    const Rigid3d& prior_from_cam,
+    const bool refine_prior_from_cam,
+    Eigen::Matrix6d* sqrt_information) {
+  CHECK_NOTNULL(sqrt_information);
+
+  const Rigid3d& prior_from_world = image.CamFromWorldPrior();
+  const Eigen::Matrix7d& prior_from_world_cov = image.CamFromWorldPriorCov();
+
+  Entry& entry = entries_[image.ImageId()];
+  const bool is_cached =
+      entry.prior_from_world.rotation.coeffs() ==
+          prior_from_world.rotation.coeffs() &&
+      entry.prior_from_world.translation == prior_from_world.translation &&
+      entry.prior_from_world_cov == prior_from_world_cov &&
+      entry.refine_prior_from_cam == refine_prior_from_cam &&
+      (refine_prior_from_cam ||
+       (entry.prior_from_cam.rotation.coeffs() ==
+            prior_from_cam.rotation.coeffs() &&
+        entry.prior_from_cam.translation == prior_from_cam.translation));
+  if (!is_cached) {
+    entry.prior_from_world = prior_from_world;
+    entry.prior_from_world_cov = prior_from_world_cov;
+    entry.prior_from_cam = prior_from_cam;
+    entry.refine_prior_from_cam = refine_prior_from_cam;
+    entry.valid = false;
+
+    if (!prior_from_world_cov.isZero()) {
+      if (refine_prior_from_cam) {
+        // If refine prior_from_cam transformation, then the residuals are
+        // directly computed in the `prior from world` frame.
+        entry.valid = ComputePosePriorSqrtInformation(
+            prior_from_world, prior_from_world_cov, &entry.sqrt_information);
+      } else {
+        const Rigid3d cam_from_prior = Inverse(prior_from_cam);
+        const Eigen::Matrix7d cam_from_prior_cov =
+            1e-20 * Eigen::Matrix7d::Identity();
+
+        Rigid3d cam_from_world_prior;
+        Eigen::Matrix7d cam_from_world_prior_cov;
+        CovRigid3dTransform cov_tfrom;
+        if (cov_tfrom.Transform(prior_from_world,
+                                prior_from_world_cov,
+                                cam_from_prior,
+                                cam_from_prior_cov,
+                                cam_from_world_prior,
+                                cam_from_world_prior_cov)) {
+          entry.valid =
+              ComputePosePriorSqrtInformation(cam_from_prior * prior_from_world,
+                                              cam_from_world_prior_cov,
+                                              &entry.sqrt_information);
+        }
+      }
+    }
+  }
+
+  if (entry.valid) {
+    *sqrt_information = entry.sqrt_information;
+  }
+  return entry.valid;
+}
+
+void PosePriorInformationCache::Clear() { entries_.clear(); }
+
 ////////////////////////////////////////////////////////////////////////////////
 // BundleAdjuster
 ////////////////////////////////////////////////////////////////////////////////
 
 BundleAdjuster::BundleAdjuster(const BundleAdjustmentOptions& options,
                                const BundleAdjustmentConfig& config)
-    : options_(options), config_(config) {
+    : options_(options),
+      config_(config),
+      pose_prior_information_cache_(nullptr) {
   CHECK(options_.Check());
 }
 
 bool BundleAdjuster::Solve(Reconstruction* reconstruction) {
+  COLMAP_TRACE_SCOPE("BundleAdjuster::Solve");
   CHECK_NOTNULL(reconstruction);
   CHECK(!problem_) << "Cannot use the same BundleAdjuster multiple times";
 
@@ -273,42 +705,21 @@ bool BundleAdjuster::Solve(Reconstruction* reconstruction) {
     return false;
   }
 
-  ceres::Solver::Options solver_options = options_.solver_options;
-  const bool has_sparse =
-      solver_options.sparse_linear_algebra_library_type != ceres::NO_SPARSE;
-
-  // Empirical choice.
-  const size_t kMaxNumImagesDirectDenseSolver = 50;
-  const size_t kMaxNumImagesDirectSparseSolver = 1000;
-  const size_t num_images = config_.NumImages();
-  if (num_images <= kMaxNumImagesDirectDenseSolver) {
-    solver_options.linear_solver_type = ceres::DENSE_SCHUR;
-  } else if (num_images <= kMaxNumImagesDirectSparseSolver && has_sparse) {
-    solver_options.linear_solver_type = ceres::SPARSE_SCHUR;
-  } else {  // Indirect sparse (preconditioned CG) solver.
-    solver_options.linear_solver_type = ceres::ITERATIVE_SCHUR;
-    solver_options.preconditioner_type = ceres::SCHUR_JACOBI;
-  }
-
-  if (problem_->NumResiduals() <
-      options_.min_num_residuals_for_multi_threading) {
-    solver_options.num_threads = 1;
-#if CERES_VERSION_MAJOR < 2
-    solver_options.num_linear_solver_threads = 1;
-#endif  // CERES_VERSION_MAJOR
-  } else {
-    solver_options.num_threads =
-        GetEffectiveNumThreads(solver_options.num_threads);
-#if CERES_VERSION_MAJOR < 2
-    solver_options.num_linear_solver_threads =
-        GetEffectiveNumThreads(solver_options.num_linear_solver_threads);
-#endif  // CERES_VERSION_MAJOR
-  }
+  ceres::Solver::Options solver_options =
+      CreateSolverOptions(AnalyzeProblemStructure(*reconstruction),
+                          *reconstruction);
+  AddConvergenceCallback(reconstruction, &solver_options);
 
   std::string solver_error;
   CHECK(solver_options.IsValid(&solver_error)) << solver_error;
 
-  ceres::Solve(solver_options, problem_.get(), &summary_);
+  {
+    COLMAP_TRACE_SCOPE("ceres::Solve");
+    ceres::Solve(solver_options, problem_.get(), &summary_);
+  }
+  ReportIterations();
+  COLMAP_METRIC_HISTOGRAM("Bundle adjustment time [s]",
+                          summary_.total_time_in_seconds);
 
   if (options_.print_summary) {
     PrintHeading2("Bundle adjustment report");
@@ -324,6 +735,13 @@ const ceres::Solver::Summary& BundleAdjuster::Summary() const {
   return summary_;
 }
 
+ceres::Problem* BundleAdjuster::Problem() { return problem_.get(); }
+
+void BundleAdjuster::SetPosePriorInformationCache(
+    PosePriorInformationCache* cache) {
+  pose_prior_information_cache_ = cache;
+}
+
 void BundleAdjuster::SetUp(Reconstruction* reconstruction,
                            ceres::LossFunction* loss_function) {
   // Warning: AddPointsToProblem assumes that AddImageToProblem is called first.
@@ -342,8 +760,35 @@ void BundleAdjuster::SetUp(Reconstruction* reconstruction,
   ParameterizePoints(reconstruction);
 }
 
-void BundleAdjuster::TearDown(Reconstruction*) {
-  // Nothing to do
+void BundleAdjuster::TearDown(Reconstruction* reconstruction) {
+  // Report the refined parameters to the change tracking of the
+  // reconstruction, such that only the affected 3D points are re-evaluated.
+  if (options_.refine_extrinsics) {
+    for (const image_t image_id : config_.Images()) {
+      if (!config_.HasConstantCamPose(image_id)) {
+        reconstruction->SetModifiedImage(image_id);
+      }
+    }
+  }
+
+  const bool constant_camera = !options_.refine_focal_length &&
+                               !options_.refine_principal_point &&
+                               !options_.refine_extra_params;
+  for (const camera_t camera_id : camera_ids_) {
+    if (HasConstantRefracCamera(camera_id)) {
+      continue;
+    }
+    if ((!constant_camera && !config_.HasConstantCamIntrinsics(camera_id)) ||
+        (options_.enable_refraction && options_.refine_refrac_params)) {
+      reconstruction->SetModifiedCamera(camera_id);
+    }
+  }
+
+  for (const auto& point3D_num_observations : point3D_num_observations_) {
+    if (!config_.HasConstantPoint(point3D_num_observations.first)) {
+      reconstruction->SetModifiedPoint3D(point3D_num_observations.first);
+    }
+  }
 }
 
 void BundleAdjuster::AddImageToProblem(const image_t image_id,
@@ -362,11 +807,14 @@ void BundleAdjuster::AddImageToProblem(const image_t image_id,
 
   const bool constant_cam_pose =
       !options_.refine_extrinsics || config_.HasConstantCamPose(image_id);
+  const bool constant_refrac_camera =
+      HasConstantRefracCamera(image.CameraId());
 
   // Add residuals to bundle adjustment problem.
   size_t num_observations = 0;
   for (const Point2D& point2D : image.Points2D()) {
-    if (!point2D.HasPoint3D()) {
+    if (!point2D.HasPoint3D() ||
+        !config_.IsInPointSubset(point2D.point3D_id)) {
       continue;
     }
 
@@ -378,7 +826,32 @@ void BundleAdjuster::AddImageToProblem(const image_t image_id,
 
     ceres::CostFunction* cost_function = nullptr;
 
-    if (constant_cam_pose) {
+    if (constant_refrac_camera) {
+      // Refractive case with constant refracted ray.
+      const Ray3D ray_refrac = camera.CamFromImgRefrac(point2D.xy);
+      const Eigen::Vector3d virtual_cam_center =
+          camera.VirtualCameraCenter(ray_refrac);
+      const Eigen::Vector2d cam_point = ray_refrac.dir.hnormalized();
+
+      if (constant_cam_pose) {
+        cost_function =
+            ReprojErrorRefracConstantPoseCameraCostFunction::Create(
+                image.CamFromWorld(),
+                virtual_cam_center,
+                cam_point,
+                camera_params[0]);
+        problem_->AddResidualBlock(
+            cost_function, loss_function, point3D.xyz.data());
+      } else {
+        cost_function = ReprojErrorRefracConstantCameraCostFunction::Create(
+            virtual_cam_center, cam_point, camera_params[0]);
+        problem_->AddResidualBlock(cost_function,
+                                   loss_function,
+                                   cam_from_world_rotation,
+                                   cam_from_world_translation,
+                                   point3D.xyz.data());
+      }
+    } else if (constant_cam_pose) {
       if (!options_.enable_refraction) {
         // Non-refractive case.
         switch (camera.model_id) {
@@ -444,9 +917,15 @@ void BundleAdjuster::AddImageToProblem(const image_t image_id,
 #define CAMERA_COMBINATION_MODEL_CASE(CameraRefracModel, CameraModel)          \
   if (camera.model_id == CameraModel::model_id &&                              \
       camera.refrac_model_id == CameraRefracModel::refrac_model_id) {          \
-    cost_function =                                                            \
-        ReprojErrorRefracCostFunction<CameraRefracModel, CameraModel>::Create( \
-            point2D.xy);                                                       \
+    if (options_.refrac_mixed_precision) {                                     \
+      cost_function = ReprojErrorRefracMixedPrecisionCostFunction<             \
+          CameraRefracModel,                                                   \
+          CameraModel>::Create(point2D.xy);                                    \
+    } else {                                                                   \
+      cost_function = ReprojErrorRefracCostFunction<CameraRefracModel,         \
+                                                    CameraModel>::Create(      \
+          point2D.xy);                                                         \
+    }                                                                          \
   } else
 
         CAMERA_COMBINATION_MODEL_IF_ELSE_CASES
@@ -471,48 +950,29 @@ void BundleAdjuster::AddImageToProblem(const image_t image_id,
     const Rigid3d cam_from_world_prior =
         cam_from_prior * image.CamFromWorldPrior();
 
-    Eigen::Matrix6d information = Eigen::Matrix6d::Identity();
+    Eigen::Matrix6d sqrt_information;
+    bool has_prior_cov = false;
+    if (!options_.use_global_pose_prior_std) {
+      PosePriorInformationCache local_cache;
+      PosePriorInformationCache* cache =
+          pose_prior_information_cache_ != nullptr
+              ? pose_prior_information_cache_
+              : &local_cache;
+      has_prior_cov = cache->SqrtInformation(image,
+                                             reconstruction->PriorFromCam(),
+                                             options_.refine_prior_from_cam,
+                                             &sqrt_information);
+    }
 
-    if (image.CamFromWorldPriorCov().isZero() ||
-        options_.use_global_pose_prior_std) {
+    if (!has_prior_cov) {
       // Image does not have covariance for pose prior. Then create an
       // information matrix from user input.
-      Eigen::Matrix3d rotation_cov = Eigen::Matrix3d::Identity();
-      Eigen::Matrix3d translation_cov = Eigen::Matrix3d::Identity();
-      rotation_cov(0, 0) = std::pow(options_.pose_prior_std[0], 2);
-      rotation_cov(1, 1) = std::pow(options_.pose_prior_std[1], 2);
-      rotation_cov(2, 2) = std::pow(options_.pose_prior_std[2], 2);
-      translation_cov(0, 0) = std::pow(options_.pose_prior_std[3], 2);
-      translation_cov(1, 1) = std::pow(options_.pose_prior_std[4], 2);
-      translation_cov(2, 2) = std::pow(options_.pose_prior_std[5], 2);
-      information.block<3, 3>(0, 0) = rotation_cov.inverse();
-      information.block<3, 3>(3, 3) = translation_cov.inverse();
-    } else {
-      const Eigen::Matrix7d& prior_from_world_cov =
-          image.CamFromWorldPriorCov();
-
-      if (options_.refine_prior_from_cam) {
-        // If refine prior_from_cam transformation, then covariance matrix is
-        // directly `prior from world`.
-        information = prior_from_world_cov.inverse().block<6, 6>(1, 1);
-      } else {
-        Eigen::Matrix7d cam_from_prior_cov = Eigen::Matrix7d::Identity();
-        cam_from_prior_cov *= 1e-20;
-
-        Rigid3d tform_dst;
-        Eigen::Matrix7d cam_from_world_prior_cov;
-        CovRigid3dTransform cov_tfrom;
-        cov_tfrom.Transform(image.CamFromWorldPrior(),
-                            prior_from_world_cov,
-                            cam_from_prior,
-                            cam_from_prior_cov,
-                            tform_dst,
-                            cam_from_world_prior_cov);
-        information = cam_from_world_prior_cov.inverse().block<6, 6>(1, 1);
+      sqrt_information.setZero();
+      for (int i = 0; i < 6; ++i) {
+        sqrt_information(i, i) = 1.0 / options_.pose_prior_std[i];
       }
     }
 
-    const Eigen::Matrix6d sqrt_information = information.llt().matrixL();
     ceres::CostFunction* cost_function = nullptr;
 
     if (options_.refine_prior_from_cam) {
@@ -610,6 +1070,16 @@ void BundleAdjuster::AddPointToProblem(const point3D_t point3D_id,
                                  loss_function,
                                  point3D.xyz.data(),
                                  camera.params.data());
+    } else if (HasConstantRefracCamera(image.CameraId())) {
+      // Refractive case with constant refracted ray.
+      const Ray3D ray_refrac = camera.CamFromImgRefrac(point2D.xy);
+      cost_function = ReprojErrorRefracConstantPoseCameraCostFunction::Create(
+          image.CamFromWorld(),
+          camera.VirtualCameraCenter(ray_refrac),
+          ray_refrac.dir.hnormalized(),
+          camera.params[0]);
+      problem_->AddResidualBlock(
+          cost_function, loss_function, point3D.xyz.data());
     } else {
       // Refractive case.
 #define CAMERA_COMBINATION_MODEL_CASE(CameraRefracModel, CameraModel) \
@@ -633,6 +1103,14 @@ void BundleAdjuster::AddPointToProblem(const point3D_t point3D_id,
   }
 }
 
+bool BundleAdjuster::HasConstantRefracCamera(const camera_t camera_id) const {
+  const bool constant_camera = !options_.refine_focal_length &&
+                               !options_.refine_principal_point &&
+                               !options_.refine_extra_params;
+  return options_.enable_refraction && !options_.refine_refrac_params &&
+         (constant_camera || config_.HasConstantCamIntrinsics(camera_id));
+}
+
 void BundleAdjuster::ParameterizeCameras(Reconstruction* reconstruction) {
   const bool constant_camera = !options_.refine_focal_length &&
                                !options_.refine_principal_point &&
@@ -640,94 +1118,110 @@ void BundleAdjuster::ParameterizeCameras(Reconstruction* reconstruction) {
   for (const camera_t camera_id : camera_ids_) {
     Camera& camera = reconstruction->Camera(camera_id);
 
+    // The parameters of refractive cameras with precomputed refracted rays are
+    // not part of the problem.
+    if (HasConstantRefracCamera(camera_id)) {
+      continue;
+    }
+
     if (constant_camera || config_.HasConstantCamIntrinsics(camera_id)) {
       problem_->SetParameterBlockConstant(camera.params.data());
-      continue;
     } else {
-      std::vector<int> const_camera_params;
-
-      if (!options_.refine_focal_length) {
-        const span<const size_t> params_idxs = camera.FocalLengthIdxs();
-        const_camera_params.insert(
-            const_camera_params.end(), params_idxs.begin(), params_idxs.end());
-      }
-      if (!options_.refine_principal_point) {
-        const span<const size_t> params_idxs = camera.PrincipalPointIdxs();
-        const_camera_params.insert(
-            const_camera_params.end(), params_idxs.begin(), params_idxs.end());
-      }
-      if (!options_.refine_extra_params) {
-        const span<const size_t> params_idxs = camera.ExtraParamsIdxs();
-        const_camera_params.insert(
-            const_camera_params.end(), params_idxs.begin(), params_idxs.end());
-      }
-
-      if (const_camera_params.size() > 0) {
-        SetSubsetManifold(static_cast<int>(camera.params.size()),
-                          const_camera_params,
-                          problem_.get(),
-                          camera.params.data());
-      }
+      SetCameraParamsManifold(&camera);
     }
   }
 
   if (options_.enable_refraction) {
     for (const camera_t camera_id : camera_ids_) {
       Camera& camera = reconstruction->Camera(camera_id);
+      if (HasConstantRefracCamera(camera_id)) {
+        continue;
+      }
       if (!options_.refine_refrac_params) {
         problem_->SetParameterBlockConstant(camera.refrac_params.data());
-        continue;
       } else {
-        std::vector<int> refrac_params_idxs(camera.refrac_params.size());
-        std::iota(refrac_params_idxs.begin(), refrac_params_idxs.end(), 0);
-
-        const std::vector<size_t>& optimizable_refrac_params_idxs =
-            camera.OptimizableRefracParamsIdxs();
-
-        std::vector<int> const_params_idxs;
-        std::set_difference(refrac_params_idxs.begin(),
-                            refrac_params_idxs.end(),
-                            optimizable_refrac_params_idxs.begin(),
-                            optimizable_refrac_params_idxs.end(),
-                            std::back_inserter(const_params_idxs));
-        if (camera.RefracModelName() == "FLATPORT") {
-          for (int& idx : const_params_idxs) {
-            idx -= 3;
-          }
+        SetRefracParamsManifold(&camera);
+      }
+    }
+  }
+}
+
+void BundleAdjuster::SetCameraParamsManifold(Camera* camera) {
+  std::vector<int> const_camera_params;
+
+  if (!options_.refine_focal_length) {
+    const span<const size_t> params_idxs = camera->FocalLengthIdxs();
+    const_camera_params.insert(
+        const_camera_params.end(), params_idxs.begin(), params_idxs.end());
+  }
+  if (!options_.refine_principal_point) {
+    const span<const size_t> params_idxs = camera->PrincipalPointIdxs();
+    const_camera_params.insert(
+        const_camera_params.end(), params_idxs.begin(), params_idxs.end());
+  }
+  if (!options_.refine_extra_params) {
+    const span<const size_t> params_idxs = camera->ExtraParamsIdxs();
+    const_camera_params.insert(
+        const_camera_params.end(), params_idxs.begin(), params_idxs.end());
+  }
+
+  if (const_camera_params.size() > 0) {
+    SetSubsetManifold(static_cast<int>(camera->params.size()),
+                      const_camera_params,
+                      problem_.get(),
+                      camera->params.data());
+  }
+}
+
+void BundleAdjuster::SetRefracParamsManifold(Camera* camera) {
+  std::vector<int> refrac_params_idxs(camera->refrac_params.size());
+  std::iota(refrac_params_idxs.begin(), refrac_params_idxs.end(), 0);
+
+  const std::vector<size_t>& optimizable_refrac_params_idxs =
+      camera->OptimizableRefracParamsIdxs();
+
+  std::vector<int> const_params_idxs;
+  std::set_difference(refrac_params_idxs.begin(),
+                      refrac_params_idxs.end(),
+                      optimizable_refrac_params_idxs.begin(),
+                      optimizable_refrac_params_idxs.end(),
+                      std::back_inserter(const_params_idxs));
+  // The interface normal of the flat ports is a unit vector.
+  if (camera->refrac_model_id == FlatPort::refrac_model_id ||
+      camera->refrac_model_id == FlatPort2L::refrac_model_id ||
+      camera->refrac_model_id == FlatPort3L::refrac_model_id) {
+    for (int& idx : const_params_idxs) {
+      idx -= 3;
+    }
 #if CERES_VERSION_MAJOR >= 3 || \
     (CERES_VERSION_MAJOR == 2 && CERES_VERSION_MINOR >= 1)
-          ceres::SphereManifold<3> sphere_manifold = ceres::SphereManifold<3>();
-          ceres::SubsetManifold subset_manifold = ceres::SubsetManifold(
-              camera.refrac_params.size() - 3, const_params_idxs);
-          ceres::ProductManifold<ceres::SphereManifold<3>,
-                                 ceres::SubsetManifold>* product_manifold =
-              new ceres::ProductManifold<ceres::SphereManifold<3>,
-                                         ceres::SubsetManifold>(
-                  sphere_manifold, subset_manifold);
-          problem_->SetManifold(camera.refrac_params.data(), product_manifold);
+    ceres::SphereManifold<3> sphere_manifold = ceres::SphereManifold<3>();
+    ceres::SubsetManifold subset_manifold = ceres::SubsetManifold(
+        camera->refrac_params.size() - 3, const_params_idxs);
+    ceres::ProductManifold<ceres::SphereManifold<3>, ceres::SubsetManifold>*
+        product_manifold = new ceres::ProductManifold<ceres::SphereManifold<3>,
+                                                      ceres::SubsetManifold>(
+            sphere_manifold, subset_manifold);
+    problem_->SetManifold(camera->refrac_params.data(), product_manifold);
 #else
-          ceres::HomogeneousVectorParameterization* sphere_manifold =
-              new ceres::HomogeneousVectorParameterization(3);
-          ceres::SubsetParameterization* subset_manifold =
-              new ceres::SubsetParameterization(camera.refrac_params.size() - 3,
-                                                const_params_idxs);
-
-          ceres::ProductParameterization* product_manifold =
-              new ceres::ProductParameterization(sphere_manifold,
-                                                 subset_manifold);
-
-          problem_->SetParameterization(camera.refrac_params.data(),
-                                        product_manifold);
+    ceres::HomogeneousVectorParameterization* sphere_manifold =
+        new ceres::HomogeneousVectorParameterization(3);
+    ceres::SubsetParameterization* subset_manifold =
+        new ceres::SubsetParameterization(camera->refrac_params.size() - 3,
+                                          const_params_idxs);
+
+    ceres::ProductParameterization* product_manifold =
+        new ceres::ProductParameterization(sphere_manifold, subset_manifold);
+
+    problem_->SetParameterization(camera->refrac_params.data(),
+                                  product_manifold);
 #endif
-        } else {
-          if (const_params_idxs.size() > 0) {
-            SetSubsetManifold(static_cast<int>(camera.refrac_params.size()),
-                              const_params_idxs,
-                              problem_.get(),
-                              camera.refrac_params.data());
-          }
-        }
-      }
+  } else {
+    if (const_params_idxs.size() > 0) {
+      SetSubsetManifold(static_cast<int>(camera->refrac_params.size()),
+                        const_params_idxs,
+                        problem_.get(),
+                        camera->refrac_params.data());
     }
   }
 }
@@ -746,6 +1240,160 @@ void BundleAdjuster::ParameterizePoints(Reconstruction* reconstruction) {
   }
 }
 
+BundleAdjustmentProblemStructure BundleAdjuster::AnalyzeProblemStructure(
+    const Reconstruction& reconstruction) const {
+  BundleAdjustmentProblemStructure structure;
+  structure.num_images = config_.NumImages();
+  structure.num_points = point3D_num_observations_.size();
+  structure.num_residuals = problem_->NumResiduals();
+
+  std::unordered_set<image_pair_t> covisible_image_pairs;
+  std::vector<image_t> track_image_ids;
+  for (const auto& point3D_num_observations : point3D_num_observations_) {
+    if (config_.HasConstantPoint(point3D_num_observations.first)) {
+      continue;
+    }
+    const Point3D& point3D =
+        reconstruction.Point3D(point3D_num_observations.first);
+    track_image_ids.clear();
+    for (const auto& track_el : point3D.track.Elements()) {
+      if (config_.HasImage(track_el.image_id)) {
+        track_image_ids.push_back(track_el.image_id);
+      }
+    }
+    for (size_t i = 0; i < track_image_ids.size(); ++i) {
+      for (size_t j = 0; j < i; ++j) {
+        if (track_image_ids[i] != track_image_ids[j]) {
+          covisible_image_pairs.insert(Database::ImagePairToPairId(
+              track_image_ids[i], track_image_ids[j]));
+        }
+      }
+    }
+  }
+  structure.num_covisible_image_pairs = covisible_image_pairs.size();
+
+  const bool constant_camera = !options_.refine_focal_length &&
+                               !options_.refine_principal_point &&
+                               !options_.refine_extra_params;
+  std::unordered_map<camera_t, size_t> camera_num_images;
+  for (const image_t image_id : config_.Images()) {
+    camera_num_images[reconstruction.Image(image_id).CameraId()] += 1;
+  }
+  for (const auto& camera_num_image : camera_num_images) {
+    const camera_t camera_id = camera_num_image.first;
+    if (camera_num_image.second < 2 || HasConstantRefracCamera(camera_id)) {
+      continue;
+    }
+    if ((!constant_camera && !config_.HasConstantCamIntrinsics(camera_id)) ||
+        (options_.enable_refraction && options_.refine_refrac_params)) {
+      structure.has_shared_blocks = true;
+    }
+  }
+
+  structure.has_refrac_residuals = options_.enable_refraction;
+  structure.has_pose_prior_residuals =
+      options_.use_pose_prior && options_.refine_extrinsics;
+  if (structure.has_pose_prior_residuals && options_.refine_prior_from_cam) {
+    structure.has_shared_blocks = true;
+  }
+
+  return structure;
+}
+
+void BundleAdjuster::AddConvergenceCallback(
+    Reconstruction* reconstruction, ceres::Solver::Options* solver_options) {
+  convergence_callback_.reset();
+  if (!options_.adaptive_termination) {
+    return;
+  }
+
+  std::vector<std::pair<const double*, const double*>> poses;
+  for (const image_t image_id : config_.Images()) {
+    Image& image = reconstruction->Image(image_id);
+    const double* rotation = image.CamFromWorld().rotation.coeffs().data();
+    const double* translation = image.CamFromWorld().translation.data();
+    const bool variable_rotation =
+        problem_->HasParameterBlock(rotation) &&
+        !problem_->IsParameterBlockConstant(rotation);
+    const bool variable_translation =
+        problem_->HasParameterBlock(translation) &&
+        !problem_->IsParameterBlockConstant(translation);
+    if (variable_rotation || variable_translation) {
+      poses.emplace_back(rotation, translation);
+    }
+  }
+
+  convergence_callback_ = std::make_unique<BundleAdjustmentConvergenceCallback>(
+      options_, std::move(poses));
+  solver_options->callbacks.push_back(convergence_callback_.get());
+  solver_options->update_state_every_iteration = true;
+}
+
+void BundleAdjuster::ReportIterations() const {
+  COLMAP_METRIC_HISTOGRAM("Bundle adjustment iterations",
+                          summary_.iterations.size());
+  if (options_.stage != BundleAdjustmentOptions::Stage::DEFAULT) {
+    COLMAP_METRIC_HISTOGRAM(
+        BundleAdjustmentIterationsMetricName(options_.stage),
+        summary_.iterations.size());
+  }
+  if (convergence_callback_ && convergence_callback_->Converged()) {
+    COLMAP_METRIC_COUNTER("Bundle adjustment adaptive terminations", 1);
+  }
+}
+
+ceres::Solver::Options BundleAdjuster::CreateSolverOptions(
+    const BundleAdjustmentProblemStructure& structure,
+    const Reconstruction& reconstruction) const {
+  Timer timer;
+  timer.Start();
+
+  ceres::Solver::Options solver_options = options_.solver_options;
+  ConfigureBundleAdjustmentSolver(options_, structure, &solver_options);
+
+  if (ceres::IsSchurType(solver_options.linear_solver_type)) {
+    auto ordering = std::make_shared<ceres::ParameterBlockOrdering>();
+    for (const auto& point3D_num_observations : point3D_num_observations_) {
+      double* xyz = const_cast<double*>(
+          reconstruction.Point3D(point3D_num_observations.first).xyz.data());
+      if (problem_->HasParameterBlock(xyz)) {
+        ordering->AddElementToGroup(xyz, 0);
+      }
+    }
+    std::vector<double*> parameter_blocks;
+    problem_->GetParameterBlocks(&parameter_blocks);
+    for (double* parameter_block : parameter_blocks) {
+      if (!ordering->IsMember(parameter_block)) {
+        ordering->AddElementToGroup(parameter_block, 1);
+      }
+    }
+    solver_options.linear_solver_ordering = ordering;
+  }
+
+  if (options_.print_summary) {
+    LOG(INFO) << "Bundle adjustment problem: " << structure.num_images
+              << " images, " << structure.num_points << " points, "
+              << structure.num_residuals << " residuals, "
+              << structure.num_covisible_image_pairs
+              << " covisible image pairs (density "
+              << structure.VisibilityDensity() << "), shared blocks: "
+              << structure.has_shared_blocks
+              << ", refractive residuals: " << structure.has_refrac_residuals
+              << ", pose prior residuals: "
+              << structure.has_pose_prior_residuals;
+    LOG(INFO) << "Bundle adjustment solver: "
+              << ceres::LinearSolverTypeToString(
+                     solver_options.linear_solver_type)
+              << ", preconditioner: "
+              << ceres::PreconditionerTypeToString(
+                     solver_options.preconditioner_type)
+              << ", threads: " << solver_options.num_threads << " (chosen in "
+              << timer.ElapsedSeconds() << " [s])";
+  }
+
+  return solver_options;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // RigBundleAdjuster
 ////////////////////////////////////////////////////////////////////////////////
@@ -757,6 +1405,7 @@ RigBundleAdjuster::RigBundleAdjuster(const BundleAdjustmentOptions& options,
 
 bool RigBundleAdjuster::Solve(Reconstruction* reconstruction,
                               std::vector<CameraRig>* camera_rigs) {
+  COLMAP_TRACE_SCOPE("RigBundleAdjuster::Solve");
   CHECK_NOTNULL(reconstruction);
   CHECK_NOTNULL(camera_rigs);
   CHECK(!problem_) << "Cannot use the same BundleAdjuster multiple times";
@@ -794,34 +1443,25 @@ bool RigBundleAdjuster::Solve(Reconstruction* reconstruction,
     return false;
   }
 
-  ceres::Solver::Options solver_options = options_.solver_options;
-  const bool has_sparse =
-      solver_options.sparse_linear_algebra_library_type != ceres::NO_SPARSE;
-
-  // Empirical choice.
-  const size_t kMaxNumImagesDirectDenseSolver = 50;
-  const size_t kMaxNumImagesDirectSparseSolver = 1000;
-  const size_t num_images = config_.NumImages();
-  if (num_images <= kMaxNumImagesDirectDenseSolver) {
-    solver_options.linear_solver_type = ceres::DENSE_SCHUR;
-  } else if (num_images <= kMaxNumImagesDirectSparseSolver && has_sparse) {
-    solver_options.linear_solver_type = ceres::SPARSE_SCHUR;
-  } else {  // Indirect sparse (preconditioned CG) solver.
-    solver_options.linear_solver_type = ceres::ITERATIVE_SCHUR;
-    solver_options.preconditioner_type = ceres::SCHUR_JACOBI;
+  BundleAdjustmentProblemStructure structure =
+      AnalyzeProblemStructure(*reconstruction);
+  if (rig_options_.refine_relative_poses) {
+    structure.has_shared_blocks = true;
   }
-
-  solver_options.num_threads =
-      GetEffectiveNumThreads(solver_options.num_threads);
-#if CERES_VERSION_MAJOR < 2
-  solver_options.num_linear_solver_threads =
-      GetEffectiveNumThreads(solver_options.num_linear_solver_threads);
-#endif  // CERES_VERSION_MAJOR
+  ceres::Solver::Options solver_options =
+      CreateSolverOptions(structure, *reconstruction);
+  AddConvergenceCallback(reconstruction, &solver_options);
 
   std::string solver_error;
   CHECK(solver_options.IsValid(&solver_error)) << solver_error;
 
-  ceres::Solve(solver_options, problem_.get(), &summary_);
+  {
+    COLMAP_TRACE_SCOPE("ceres::Solve");
+    ceres::Solve(solver_options, problem_.get(), &summary_);
+  }
+  ReportIterations();
+  COLMAP_METRIC_HISTOGRAM("Bundle adjustment time [s]",
+                          summary_.total_time_in_seconds);
 
   if (options_.print_summary) {
     PrintHeading2("Rig Bundle adjustment report");
@@ -851,6 +1491,22 @@ void RigBundleAdjuster::SetUp(Reconstruction* reconstruction,
   ParameterizeCameras(reconstruction);
   ParameterizePoints(reconstruction);
   ParameterizeCameraRigs(reconstruction);
+
+  // Different from BundleAdjuster, the refracted rays of cameras with fixed
+  // intrinsics and refractive parameters are not precomputed, such that
+  // their parameters are part of the problem and must be set constant.
+  for (const camera_t camera_id : camera_ids_) {
+    if (!HasConstantRefracCamera(camera_id)) {
+      continue;
+    }
+    Camera& camera = reconstruction->Camera(camera_id);
+    if (problem_->HasParameterBlock(camera.params.data())) {
+      problem_->SetParameterBlockConstant(camera.params.data());
+    }
+    if (problem_->HasParameterBlock(camera.refrac_params.data())) {
+      problem_->SetParameterBlockConstant(camera.refrac_params.data());
+    }
+  }
 }
 
 void RigBundleAdjuster::TearDown(Reconstruction* reconstruction,
@@ -862,6 +1518,9 @@ void RigBundleAdjuster::TearDown(Reconstruction* reconstruction,
     image.CamFromWorld() = camera_rig.CamFromRig(image.CameraId()) *
                            (*image_id_to_rig_from_world_.at(image_id));
   }
+
+  // The refined parameters are not tracked individually for camera rigs.
+  reconstruction->SetAllPoints3DModified();
 }
 
 void RigBundleAdjuster::AddImageToProblem(const image_t image_id,
@@ -914,7 +1573,8 @@ void RigBundleAdjuster::AddImageToProblem(const image_t image_id,
 
   // Add residuals to bundle adjustment problem.
   for (const Point2D& point2D : image.Points2D()) {
-    if (!point2D.HasPoint3D()) {
+    if (!point2D.HasPoint3D() ||
+        !config_.IsInPointSubset(point2D.point3D_id)) {
       continue;
     }
 
@@ -922,8 +1582,11 @@ void RigBundleAdjuster::AddImageToProblem(const image_t image_id,
     assert(point3D.track.Length() > 1);
 
     if (camera_rig != nullptr &&
-        CalculateSquaredReprojectionError(
-            point2D.xy, point3D.xyz, cam_from_world_mat, camera) >
+        CalculateSquaredReprojectionError(point2D.xy,
+                                          point3D.xyz,
+                                          cam_from_world_mat,
+                                          camera,
+                                          options_.enable_refraction) >
             max_squared_reproj_error) {
       continue;
     }
@@ -933,7 +1596,17 @@ void RigBundleAdjuster::AddImageToProblem(const image_t image_id,
 
     ceres::CostFunction* cost_function = nullptr;
 
-    if (camera_rig == nullptr) {
+    if (options_.enable_refraction) {
+      AddRefracResidual(point2D.xy,
+                        &camera,
+                        constant_cam_pose ? &image.CamFromWorld() : nullptr,
+                        cam_from_rig_rotation,
+                        cam_from_rig_translation,
+                        rig_from_world_rotation,
+                        rig_from_world_translation,
+                        point3D.xyz.data(),
+                        loss_function);
+    } else if (camera_rig == nullptr) {
       if (constant_cam_pose) {
         switch (camera.model_id) {
 #define CAMERA_MODEL_CASE(CameraModel)                                        \
@@ -1050,6 +1723,19 @@ void RigBundleAdjuster::AddPointToProblem(const point3D_t point3D_id,
       config_.SetConstantCamIntrinsics(image.CameraId());
     }
 
+    if (options_.enable_refraction) {
+      AddRefracResidual(point2D.xy,
+                        &camera,
+                        &image.CamFromWorld(),
+                        nullptr,
+                        nullptr,
+                        nullptr,
+                        nullptr,
+                        point3D.xyz.data(),
+                        loss_function);
+      continue;
+    }
+
     ceres::CostFunction* cost_function = nullptr;
 
     switch (camera.model_id) {
@@ -1070,6 +1756,82 @@ void RigBundleAdjuster::AddPointToProblem(const point3D_t point3D_id,
   }
 }
 
+void RigBundleAdjuster::AddRefracResidual(const Eigen::Vector2d& point2D,
+                                          Camera* camera,
+                                          const Rigid3d* cam_from_world,
+                                          double* cam_from_rig_rotation,
+                                          double* cam_from_rig_translation,
+                                          double* rig_from_world_rotation,
+                                          double* rig_from_world_translation,
+                                          double* point3D,
+                                          ceres::LossFunction* loss_function) {
+  double* camera_params = camera->params.data();
+  double* refrac_params = camera->refrac_params.data();
+  ceres::CostFunction* cost_function = nullptr;
+
+  if (cam_from_world != nullptr) {
+    // Constant camera pose.
+#define CAMERA_COMBINATION_MODEL_CASE(CameraRefracModel, CameraModel) \
+  if (camera->model_id == CameraModel::model_id &&                    \
+      camera->refrac_model_id == CameraRefracModel::refrac_model_id) { \
+    cost_function = ReprojErrorRefracConstantPoseCostFunction<        \
+        CameraRefracModel,                                            \
+        CameraModel>::Create(*cam_from_world, point2D);               \
+  } else
+
+    CAMERA_COMBINATION_MODEL_IF_ELSE_CASES
+
+#undef CAMERA_COMBINATION_MODEL_CASE
+
+    problem_->AddResidualBlock(
+        cost_function, loss_function, point3D, camera_params, refrac_params);
+  } else if (rig_from_world_rotation == nullptr) {
+    // Image without camera rig, i.e., rig == world.
+#define CAMERA_COMBINATION_MODEL_CASE(CameraRefracModel, CameraModel)          \
+  if (camera->model_id == CameraModel::model_id &&                             \
+      camera->refrac_model_id == CameraRefracModel::refrac_model_id) {         \
+    cost_function =                                                            \
+        ReprojErrorRefracCostFunction<CameraRefracModel, CameraModel>::Create( \
+            point2D);                                                          \
+  } else
+
+    CAMERA_COMBINATION_MODEL_IF_ELSE_CASES
+
+#undef CAMERA_COMBINATION_MODEL_CASE
+
+    problem_->AddResidualBlock(cost_function,
+                               loss_function,
+                               cam_from_rig_rotation,
+                               cam_from_rig_translation,
+                               point3D,
+                               camera_params,
+                               refrac_params);
+  } else {
+#define CAMERA_COMBINATION_MODEL_CASE(CameraRefracModel, CameraModel) \
+  if (camera->model_id == CameraModel::model_id &&                    \
+      camera->refrac_model_id == CameraRefracModel::refrac_model_id) { \
+    cost_function = RigReprojErrorRefracCostFunction<                 \
+        CameraRefracModel,                                            \
+        CameraModel>::Create(point2D);                                \
+  } else
+
+    CAMERA_COMBINATION_MODEL_IF_ELSE_CASES
+
+#undef CAMERA_COMBINATION_MODEL_CASE
+
+    problem_->AddResidualBlock(cost_function,
+                               loss_function,
+                               cam_from_rig_rotation,
+                               cam_from_rig_translation,
+                               rig_from_world_rotation,
+                               rig_from_world_translation,
+                               point3D,
+                               camera_params,
+                               refrac_params);
+  }
+}
+
+
 void RigBundleAdjuster::ComputeCameraRigPoses(
     const Reconstruction& reconstruction,
     const std::vector<CameraRig>& camera_rigs) {
@@ -1097,6 +1859,780 @@ void RigBundleAdjuster::ParameterizeCameraRigs(Reconstruction* reconstruction) {
   }
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// PersistentBundleAdjuster
+////////////////////////////////////////////////////////////////////////////////
+
+PersistentBundleAdjuster::PersistentBundleAdjuster(
+    const BundleAdjustmentOptions& options)
+    : BundleAdjuster(options, BundleAdjustmentConfig()),
+      loss_function_(options.CreateLossFunction()),
+      generation_(0) {
+  CHECK(IsSupported(options));
+  Reset();
+}
+
+bool PersistentBundleAdjuster::IsSupported(
+    const BundleAdjustmentOptions& options) {
+  return !options.use_pose_prior;
+}
+
+void PersistentBundleAdjuster::Reset() {
+  ceres::Problem::Options problem_options;
+  problem_options.loss_function_ownership = ceres::DO_NOT_TAKE_OWNERSHIP;
+  problem_options.enable_fast_removal = true;
+  problem_ = std::make_unique<ceres::Problem>(problem_options);
+  residuals_.clear();
+  cam_from_world_rotations_.clear();
+  camera_params_.clear();
+  points3D_.clear();
+  constant_cam_positions_.clear();
+  refrac_camera_params_.clear();
+}
+
+bool PersistentBundleAdjuster::Solve(const BundleAdjustmentConfig& config,
+                                     Reconstruction* reconstruction) {
+  COLMAP_TRACE_SCOPE("PersistentBundleAdjuster::Solve");
+  CHECK_NOTNULL(reconstruction);
+
+  config_ = config;
+  camera_ids_.clear();
+  point3D_num_observations_.clear();
+  generation_ += 1;
+
+  // Collect the observations in the same way as BundleAdjuster::SetUp, where
+  // images outside of the configuration have constant poses and intrinsics.
+  std::vector<Observation> observations;
+  std::unordered_set<image_t> image_ids;
+  for (const image_t image_id : config_.Images()) {
+    const Image& image = reconstruction->Image(image_id);
+    size_t num_observations = 0;
+    for (point2D_t point2D_idx = 0; point2D_idx < image.NumPoints2D();
+         ++point2D_idx) {
+      const Point2D& point2D = image.Point2D(point2D_idx);
+      if (!point2D.HasPoint3D() ||
+          !config_.IsInPointSubset(point2D.point3D_id)) {
+        continue;
+      }
+      num_observations += 1;
+      point3D_num_observations_[point2D.point3D_id] += 1;
+      observations.push_back(
+          {image_id, point2D_idx, point2D.point3D_id, ResidualType::REPROJ});
+    }
+    if (num_observations > 0) {
+      camera_ids_.insert(image.CameraId());
+      image_ids.insert(image_id);
+    }
+  }
+
+  const auto add_point_observations = [&](const point3D_t point3D_id) {
+    const Point3D& point3D = reconstruction->Point3D(point3D_id);
+    if (point3D_num_observations_[point3D_id] == point3D.track.Length()) {
+      return;
+    }
+    for (const auto& track_el : point3D.track.Elements()) {
+      if (config_.HasImage(track_el.image_id)) {
+        continue;
+      }
+      point3D_num_observations_[point3D_id] += 1;
+      const camera_t camera_id =
+          reconstruction->Image(track_el.image_id).CameraId();
+      if (camera_ids_.count(camera_id) == 0) {
+        camera_ids_.insert(camera_id);
+        config_.SetConstantCamIntrinsics(camera_id);
+      }
+      observations.push_back({track_el.image_id,
+                              track_el.point2D_idx,
+                              point3D_id,
+                              ResidualType::REPROJ});
+      image_ids.insert(track_el.image_id);
+    }
+  };
+  for (const point3D_t point3D_id : config_.VariablePoints()) {
+    add_point_observations(point3D_id);
+  }
+  for (const point3D_t point3D_id : config_.ConstantPoints()) {
+    add_point_observations(point3D_id);
+  }
+
+  if (options_.enable_refraction) {
+    for (auto& observation : observations) {
+      const camera_t camera_id =
+          reconstruction->Image(observation.image_id).CameraId();
+      observation.type = HasConstantRefracCamera(camera_id)
+                             ? ResidualType::REFRAC_CONSTANT_CAMERA
+                             : ResidualType::REFRAC;
+    }
+  }
+
+  if (!IsCacheValid(observations, *reconstruction)) {
+    Reset();
+  }
+
+  // The precomputed refracted rays are outdated, if the camera was refined
+  // since they were computed.
+  std::unordered_set<camera_t> changed_refrac_camera_ids;
+  for (const auto& refrac_camera_params : refrac_camera_params_) {
+    const Camera& camera =
+        reconstruction->Camera(refrac_camera_params.first);
+    std::vector<double> params = camera.params;
+    params.insert(
+        params.end(), camera.refrac_params.begin(), camera.refrac_params.end());
+    if (params != refrac_camera_params.second) {
+      changed_refrac_camera_ids.insert(refrac_camera_params.first);
+    }
+  }
+
+  // The translation parameter block is recreated, if its constant position
+  // indices changed, since the manifold of a parameter block can only be set
+  // once in older versions of Ceres-Solver.
+  for (const image_t image_id : image_ids) {
+    std::vector<int> constant_position_idxs;
+    if (config_.HasConstantCamPositions(image_id)) {
+      constant_position_idxs = config_.ConstantCamPositions(image_id);
+    }
+    const auto it = constant_cam_positions_.find(image_id);
+    if (it == constant_cam_positions_.end()) {
+      constant_cam_positions_.emplace(image_id, constant_position_idxs);
+    } else if (it->second != constant_position_idxs) {
+      double* cam_from_world_translation =
+          reconstruction->Image(image_id).CamFromWorld().translation.data();
+      if (problem_->HasParameterBlock(cam_from_world_translation)) {
+        problem_->RemoveParameterBlock(cam_from_world_translation);
+      }
+      residuals_.erase(image_id);
+      it->second = constant_position_idxs;
+    }
+  }
+
+  // Reuse the residual blocks of unchanged observations.
+  std::vector<const Observation*> new_observations;
+  for (const auto& observation : observations) {
+    auto image_residuals_it = residuals_.find(observation.image_id);
+    if (image_residuals_it != residuals_.end()) {
+      auto residual_it =
+          image_residuals_it->second.find(observation.point2D_idx);
+      if (residual_it != image_residuals_it->second.end() &&
+          residual_it->second.point3D_id == observation.point3D_id &&
+          residual_it->second.type == observation.type &&
+          (observation.type != ResidualType::REFRAC_CONSTANT_CAMERA ||
+           changed_refrac_camera_ids.count(
+               reconstruction->Image(observation.image_id).CameraId()) ==
+               0)) {
+        residual_it->second.generation = generation_;
+        continue;
+      }
+    }
+    new_observations.push_back(&observation);
+  }
+
+  // Remove the residual blocks of observations that left the configuration
+  // and the points without observations, before any new parameter blocks are
+  // added, which might reuse the memory of deleted points.
+  for (auto image_residuals_it = residuals_.begin();
+       image_residuals_it != residuals_.end();) {
+    auto& image_residuals = image_residuals_it->second;
+    for (auto residual_it = image_residuals.begin();
+         residual_it != image_residuals.end();) {
+      if (residual_it->second.generation != generation_) {
+        problem_->RemoveResidualBlock(residual_it->second.residual_block_id);
+        residual_it = image_residuals.erase(residual_it);
+      } else {
+        ++residual_it;
+      }
+    }
+    if (image_residuals.empty()) {
+      image_residuals_it = residuals_.erase(image_residuals_it);
+    } else {
+      ++image_residuals_it;
+    }
+  }
+  for (auto point3D_it = points3D_.begin(); point3D_it != points3D_.end();) {
+    if (point3D_num_observations_.count(point3D_it->first) == 0) {
+      if (problem_->HasParameterBlock(point3D_it->second)) {
+        problem_->RemoveParameterBlock(point3D_it->second);
+      }
+      point3D_it = points3D_.erase(point3D_it);
+    } else {
+      ++point3D_it;
+    }
+  }
+
+  for (const Observation* observation : new_observations) {
+    AddObservationToProblem(*observation, reconstruction);
+  }
+
+  if (problem_->NumResiduals() == 0) {
+    return false;
+  }
+
+  SetParameterBlocksConstantOrVariable(image_ids, reconstruction);
+
+  ceres::Solver::Options solver_options =
+      CreateSolverOptions(AnalyzeProblemStructure(*reconstruction),
+                          *reconstruction);
+  AddConvergenceCallback(reconstruction, &solver_options);
+
+  std::string solver_error;
+  CHECK(solver_options.IsValid(&solver_error)) << solver_error;
+
+  {
+    COLMAP_TRACE_SCOPE("ceres::Solve");
+    ceres::Solve(solver_options, problem_.get(), &summary_);
+  }
+  ReportIterations();
+  COLMAP_METRIC_HISTOGRAM("Bundle adjustment time [s]",
+                          summary_.total_time_in_seconds);
+
+  if (options_.print_summary) {
+    PrintHeading2("Bundle adjustment report");
+    PrintSolverSummary(summary_);
+  }
+
+  TearDown(reconstruction);
+
+  return true;
+}
+
+bool PersistentBundleAdjuster::IsCacheValid(
+    const std::vector<Observation>& observations,
+    const Reconstruction& reconstruction) const {
+  for (const auto& observation : observations) {
+    const Image& image = reconstruction.Image(observation.image_id);
+    const auto rotation_it = cam_from_world_rotations_.find(image.ImageId());
+    if (rotation_it != cam_from_world_rotations_.end() &&
+        rotation_it->second != image.CamFromWorld().rotation.coeffs().data()) {
+      return false;
+    }
+    const auto camera_it = camera_params_.find(image.CameraId());
+    if (camera_it != camera_params_.end() &&
+        camera_it->second !=
+            reconstruction.Camera(image.CameraId()).params.data()) {
+      return false;
+    }
+    const auto point3D_it = points3D_.find(observation.point3D_id);
+    if (point3D_it != points3D_.end() &&
+        point3D_it->second !=
+            reconstruction.Point3D(observation.point3D_id).xyz.data()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void PersistentBundleAdjuster::AddObservationToProblem(
+    const Observation& observation, Reconstruction* reconstruction) {
+  Image& image = reconstruction->Image(observation.image_id);
+  Camera& camera = reconstruction->Camera(image.CameraId());
+  Point3D& point3D = reconstruction->Point3D(observation.point3D_id);
+  const Point2D& point2D = image.Point2D(observation.point2D_idx);
+
+  double* cam_from_world_rotation =
+      image.CamFromWorld().rotation.coeffs().data();
+  double* cam_from_world_translation = image.CamFromWorld().translation.data();
+  if (!problem_->HasParameterBlock(cam_from_world_rotation)) {
+    problem_->AddParameterBlock(cam_from_world_rotation, 4);
+    SetQuaternionManifold(problem_.get(), cam_from_world_rotation);
+    cam_from_world_rotations_[image.ImageId()] = cam_from_world_rotation;
+  }
+  if (!problem_->HasParameterBlock(cam_from_world_translation)) {
+    problem_->AddParameterBlock(cam_from_world_translation, 3);
+    const std::vector<int>& constant_position_idxs =
+        constant_cam_positions_.at(image.ImageId());
+    if (!constant_position_idxs.empty()) {
+      SetSubsetManifold(3,
+                        constant_position_idxs,
+                        problem_.get(),
+                        cam_from_world_translation);
+    }
+  }
+
+  const bool constant_camera = !options_.refine_focal_length &&
+                               !options_.refine_principal_point &&
+                               !options_.refine_extra_params;
+  if (observation.type != ResidualType::REFRAC_CONSTANT_CAMERA &&
+      !problem_->HasParameterBlock(camera.params.data())) {
+    problem_->AddParameterBlock(camera.params.data(),
+                                static_cast<int>(camera.params.size()));
+    if (!constant_camera) {
+      SetCameraParamsManifold(&camera);
+    }
+    camera_params_[camera.camera_id] = camera.params.data();
+  }
+  if (observation.type == ResidualType::REFRAC &&
+      !problem_->HasParameterBlock(camera.refrac_params.data())) {
+    problem_->AddParameterBlock(camera.refrac_params.data(),
+                                static_cast<int>(camera.refrac_params.size()));
+    if (options_.refine_refrac_params) {
+      SetRefracParamsManifold(&camera);
+    }
+  }
+
+  ceres::CostFunction* cost_function = nullptr;
+  ceres::ResidualBlockId residual_block_id = nullptr;
+  switch (observation.type) {
+    case ResidualType::REPROJ: {
+      switch (camera.model_id) {
+#define CAMERA_MODEL_CASE(CameraModel)                                        \
+  case CameraModel::model_id:                                                 \
+    cost_function = ReprojErrorCostFunction<CameraModel>::Create(point2D.xy); \
+    break;
+
+        CAMERA_MODEL_SWITCH_CASES
+
+#undef CAMERA_MODEL_CASE
+      }
+      residual_block_id =
+          problem_->AddResidualBlock(cost_function,
+                                     loss_function_.get(),
+                                     cam_from_world_rotation,
+                                     cam_from_world_translation,
+                                     point3D.xyz.data(),
+                                     camera.params.data());
+      break;
+    }
+    case ResidualType::REFRAC: {
+#define CAMERA_COMBINATION_MODEL_CASE(CameraRefracModel, CameraModel)          \
+  if (camera.model_id == CameraModel::model_id &&                              \
+      camera.refrac_model_id == CameraRefracModel::refrac_model_id) {          \
+    cost_function =                                                            \
+        ReprojErrorRefracCostFunction<CameraRefracModel, CameraModel>::Create( \
+            point2D.xy);                                                       \
+  } else
+
+      CAMERA_COMBINATION_MODEL_IF_ELSE_CASES
+
+#undef CAMERA_COMBINATION_MODEL_CASE
+
+      residual_block_id =
+          problem_->AddResidualBlock(cost_function,
+                                     loss_function_.get(),
+                                     cam_from_world_rotation,
+                                     cam_from_world_translation,
+                                     point3D.xyz.data(),
+                                     camera.params.data(),
+                                     camera.refrac_params.data());
+      break;
+    }
+    case ResidualType::REFRAC_CONSTANT_CAMERA: {
+      const Ray3D ray_refrac = camera.CamFromImgRefrac(point2D.xy);
+      cost_function = ReprojErrorRefracConstantCameraCostFunction::Create(
+          camera.VirtualCameraCenter(ray_refrac),
+          ray_refrac.dir.hnormalized(),
+          camera.params[0]);
+      residual_block_id =
+          problem_->AddResidualBlock(cost_function,
+                                     loss_function_.get(),
+                                     cam_from_world_rotation,
+                                     cam_from_world_translation,
+                                     point3D.xyz.data());
+
+      std::vector<double>& params = refrac_camera_params_[camera.camera_id];
+      params = camera.params;
+      params.insert(params.end(),
+                    camera.refrac_params.begin(),
+                    camera.refrac_params.end());
+      break;
+    }
+  }
+
+  Residual& residual =
+      residuals_[observation.image_id][observation.point2D_idx];
+  residual.point3D_id = observation.point3D_id;
+  residual.type = observation.type;
+  residual.residual_block_id = residual_block_id;
+  residual.generation = generation_;
+  points3D_[observation.point3D_id] = point3D.xyz.data();
+}
+
+void PersistentBundleAdjuster::SetParameterBlocksConstantOrVariable(
+    const std::unordered_set<image_t>& image_ids,
+    Reconstruction* reconstruction) {
+  for (const image_t image_id : image_ids) {
+    Image& image = reconstruction->Image(image_id);
+    // CostFunction assumes unit quaternions.
+    image.CamFromWorld().rotation.normalize();
+    double* cam_from_world_rotation =
+        image.CamFromWorld().rotation.coeffs().data();
+    double* cam_from_world_translation =
+        image.CamFromWorld().translation.data();
+    if (!options_.refine_extrinsics || !config_.HasImage(image_id) ||
+        config_.HasConstantCamPose(image_id)) {
+      problem_->SetParameterBlockConstant(cam_from_world_rotation);
+      problem_->SetParameterBlockConstant(cam_from_world_translation);
+    } else {
+      problem_->SetParameterBlockVariable(cam_from_world_rotation);
+      problem_->SetParameterBlockVariable(cam_from_world_translation);
+    }
+  }
+
+  const bool constant_camera = !options_.refine_focal_length &&
+                               !options_.refine_principal_point &&
+                               !options_.refine_extra_params;
+  for (const camera_t camera_id : camera_ids_) {
+    if (HasConstantRefracCamera(camera_id)) {
+      continue;
+    }
+    Camera& camera = reconstruction->Camera(camera_id);
+    if (constant_camera || config_.HasConstantCamIntrinsics(camera_id)) {
+      problem_->SetParameterBlockConstant(camera.params.data());
+    } else {
+      problem_->SetParameterBlockVariable(camera.params.data());
+    }
+    if (options_.enable_refraction) {
+      if (options_.refine_refrac_params) {
+        problem_->SetParameterBlockVariable(camera.refrac_params.data());
+      } else {
+        problem_->SetParameterBlockConstant(camera.refrac_params.data());
+      }
+    }
+  }
+
+  for (const auto& point3D_num_observations : point3D_num_observations_) {
+    const point3D_t point3D_id = point3D_num_observations.first;
+    Point3D& point3D = reconstruction->Point3D(point3D_id);
+    if (!problem_->HasParameterBlock(point3D.xyz.data())) {
+      continue;
+    }
+    if (config_.HasConstantPoint(point3D_id) ||
+        point3D.track.Length() > point3D_num_observations.second) {
+      problem_->SetParameterBlockConstant(point3D.xyz.data());
+    } else {
+      problem_->SetParameterBlockVariable(point3D.xyz.data());
+    }
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// RefracCalibrationBundleAdjuster
+////////////////////////////////////////////////////////////////////////////////
+
+RefracCalibrationBundleAdjuster::RefracCalibrationBundleAdjuster(
+    const BundleAdjustmentOptions& options,
+    const BundleAdjustmentConfig& config)
+    : BundleAdjuster(options, config) {
+  CHECK(options_.enable_refraction);
+  CHECK(options_.refine_refrac_params);
+}
+
+bool RefracCalibrationBundleAdjuster::Solve(Reconstruction* reconstruction) {
+  COLMAP_TRACE_SCOPE("RefracCalibrationBundleAdjuster::Solve");
+  CHECK_NOTNULL(reconstruction);
+
+  BundleAdjustmentOptions ba_options = options_;
+  ba_options.refine_refrac_params = false;
+  if (ba_options.adaptive_termination) {
+    ba_options.SetStage(BundleAdjustmentOptions::Stage::REFRAC_CALIBRATION);
+  }
+
+  for (int iter = 0; iter < options_.refrac_calibration_max_num_iterations;
+       ++iter) {
+    const double refrac_params_change = SolveRefracParams(reconstruction);
+
+    BundleAdjuster bundle_adjuster(ba_options, config_);
+    if (!bundle_adjuster.Solve(reconstruction)) {
+      return false;
+    }
+    summary_ = bundle_adjuster.Summary();
+
+    if (options_.print_summary) {
+      LOG(INFO) << "Refractive calibration iteration " << iter + 1
+                << ": relative change of refractive parameters "
+                << refrac_params_change;
+    }
+
+    if (refrac_params_change < options_.refrac_calibration_tolerance) {
+      break;
+    }
+  }
+
+  return true;
+}
+
+double RefracCalibrationBundleAdjuster::SolveRefracParams(
+    Reconstruction* reconstruction) {
+  ceres::Problem::Options problem_options;
+  problem_options.loss_function_ownership = ceres::DO_NOT_TAKE_OWNERSHIP;
+  problem_ = std::make_unique<ceres::Problem>(problem_options);
+  camera_ids_.clear();
+  point3D_num_observations_.clear();
+
+  for (const image_t image_id : config_.Images()) {
+    const Camera& camera =
+        reconstruction->Camera(reconstruction->Image(image_id).CameraId());
+    if (camera.IsCameraRefractive()) {
+      camera_ids_.insert(camera.camera_id);
+    }
+  }
+
+  std::unordered_map<camera_t, std::vector<double>> prev_refrac_params;
+  for (const camera_t camera_id : camera_ids_) {
+    prev_refrac_params.emplace(camera_id,
+                               reconstruction->Camera(camera_id).refrac_params);
+  }
+
+  const auto loss_function =
+      std::unique_ptr<ceres::LossFunction>(options_.CreateLossFunction());
+
+  auto ordering = std::make_shared<ceres::ParameterBlockOrdering>();
+  for (const point3D_t point3D_id : SubsamplePoints(*reconstruction)) {
+    Point3D& point3D = reconstruction->Point3D(point3D_id);
+
+    // Points with a single observation do not constrain the refraction.
+    std::vector<TrackElement> track_els;
+    for (const auto& track_el : point3D.track.Elements()) {
+      const camera_t camera_id =
+          reconstruction->Image(track_el.image_id).CameraId();
+      if (camera_ids_.count(camera_id) > 0) {
+        track_els.push_back(track_el);
+      }
+    }
+    if (track_els.size() < 2) {
+      continue;
+    }
+
+    for (const auto& track_el : track_els) {
+      Image& image = reconstruction->Image(track_el.image_id);
+      Camera& camera = reconstruction->Camera(image.CameraId());
+      const Point2D& point2D = image.Point2D(track_el.point2D_idx);
+
+      // CostFunction assumes unit quaternions.
+      image.CamFromWorld().rotation.normalize();
+
+      ceres::CostFunction* cost_function = nullptr;
+
+#define CAMERA_COMBINATION_MODEL_CASE(CameraRefracModel, CameraModel) \
+  if (camera.model_id == CameraModel::model_id &&                     \
+      camera.refrac_model_id == CameraRefracModel::refrac_model_id) { \
+    cost_function = ReprojErrorRefracConstantPoseCostFunction<        \
+        CameraRefracModel,                                            \
+        CameraModel>::Create(image.CamFromWorld(), point2D.xy);       \
+  } else
+
+      CAMERA_COMBINATION_MODEL_IF_ELSE_CASES
+
+#undef CAMERA_COMBINATION_MODEL_CASE
+
+      problem_->AddResidualBlock(cost_function,
+                                 loss_function.get(),
+                                 point3D.xyz.data(),
+                                 camera.params.data(),
+                                 camera.refrac_params.data());
+      point3D_num_observations_[point3D_id] += 1;
+    }
+
+    if (config_.HasConstantPoint(point3D_id)) {
+      problem_->SetParameterBlockConstant(point3D.xyz.data());
+    }
+    ordering->AddElementToGroup(point3D.xyz.data(), 0);
+  }
+
+  if (problem_->NumResiduals() == 0) {
+    return 0;
+  }
+
+  for (const camera_t camera_id : camera_ids_) {
+    Camera& camera = reconstruction->Camera(camera_id);
+    if (!problem_->HasParameterBlock(camera.params.data())) {
+      continue;
+    }
+    problem_->SetParameterBlockConstant(camera.params.data());
+    SetRefracParamsManifold(&camera);
+    ordering->AddElementToGroup(camera.params.data(), 1);
+    ordering->AddElementToGroup(camera.refrac_params.data(), 1);
+  }
+
+  // The reduced camera system only consists of the refractive parameters, so
+  // that the dense Schur complement is small.
+  ceres::Solver::Options solver_options = options_.solver_options;
+  solver_options.linear_solver_type = ceres::DENSE_SCHUR;
+  solver_options.linear_solver_ordering = ordering;
+  solver_options.num_threads =
+      GetEffectiveNumThreads(solver_options.num_threads);
+#if CERES_VERSION_MAJOR < 2
+  solver_options.num_linear_solver_threads = solver_options.num_threads;
+#endif  // CERES_VERSION_MAJOR
+
+  // The camera poses are constant, such that only the decrease of the cost
+  // is monitored by the adaptive termination.
+  std::unique_ptr<BundleAdjustmentConvergenceCallback> convergence_callback;
+  if (options_.adaptive_termination) {
+    BundleAdjustmentOptions refrac_options = options_;
+    refrac_options.SetStage(
+        BundleAdjustmentOptions::Stage::REFRAC_CALIBRATION);
+    convergence_callback =
+        std::make_unique<BundleAdjustmentConvergenceCallback>(
+            refrac_options,
+            std::vector<std::pair<const double*, const double*>>());
+    solver_options.callbacks.push_back(convergence_callback.get());
+  }
+
+  std::string solver_error;
+  CHECK(solver_options.IsValid(&solver_error)) << solver_error;
+
+  ceres::Solver::Summary summary;
+  ceres::Solve(solver_options, problem_.get(), &summary);
+  COLMAP_METRIC_HISTOGRAM("Refractive calibration iterations",
+                          summary.iterations.size());
+
+  if (options_.print_summary) {
+    PrintHeading2("Refractive calibration report");
+    PrintSolverSummary(summary);
+  }
+
+  double max_refrac_params_change = 0;
+  for (const auto& camera_refrac_params : prev_refrac_params) {
+    const camera_t camera_id = camera_refrac_params.first;
+    const Eigen::Map<const Eigen::VectorXd> prev(
+        camera_refrac_params.second.data(), camera_refrac_params.second.size());
+    const Eigen::Map<const Eigen::VectorXd> curr(
+        reconstruction->Camera(camera_id).refrac_params.data(), prev.size());
+    const double change =
+        (curr - prev).norm() / std::max(prev.norm(), 1e-12);
+    max_refrac_params_change = std::max(max_refrac_params_change, change);
+    reconstruction->SetModifiedCamera(camera_id);
+  }
+
+  for (const auto& point3D_num_observations : point3D_num_observations_) {
+    reconstruction->SetModifiedPoint3D(point3D_num_observations.first);
+  }
+
+  return max_refrac_params_change;
+}
+
+std::vector<point3D_t> RefracCalibrationBundleAdjuster::SubsamplePoints(
+    const Reconstruction& reconstruction) const {
+  std::unordered_set<point3D_t> point3D_ids;
+  for (const image_t image_id : config_.Images()) {
+    for (const Point2D& point2D : reconstruction.Image(image_id).Points2D()) {
+      if (point2D.HasPoint3D() && config_.IsInPointSubset(point2D.point3D_id)) {
+        point3D_ids.insert(point2D.point3D_id);
+      }
+    }
+  }
+  point3D_ids.insert(config_.VariablePoints().begin(),
+                     config_.VariablePoints().end());
+
+  // Sort the points for a deterministic subsample, in which the points are
+  // approximately uniformly distributed over the reconstruction.
+  std::vector<point3D_t> sorted_point3D_ids(point3D_ids.begin(),
+                                            point3D_ids.end());
+  std::sort(sorted_point3D_ids.begin(), sorted_point3D_ids.end());
+
+  size_t num_observations = 0;
+  for (const point3D_t point3D_id : sorted_point3D_ids) {
+    num_observations += reconstruction.Point3D(point3D_id).track.Length();
+  }
+
+  const size_t max_num_observations =
+      static_cast<size_t>(options_.refrac_calibration_max_num_observations);
+  if (num_observations <= max_num_observations) {
+    return sorted_point3D_ids;
+  }
+
+  const double sampling_rate =
+      static_cast<double>(max_num_observations) / num_observations;
+  std::vector<point3D_t> subsampled_point3D_ids;
+  subsampled_point3D_ids.reserve(
+      static_cast<size_t>(sampling_rate * sorted_point3D_ids.size()) + 1);
+  for (size_t i = 0; i < sorted_point3D_ids.size(); ++i) {
+    if (std::floor((i + 1) * sampling_rate) > std::floor(i * sampling_rate)) {
+      subsampled_point3D_ids.push_back(sorted_point3D_ids[i]);
+    }
+  }
+
+  return subsampled_point3D_ids;
+}
+
+size_t AdjustPoints3D(const BundleAdjustmentOptions& options,
+                      const std::vector<point3D_t>& point3D_ids,
+                      const int num_threads,
+                      Reconstruction* reconstruction) {
+  COLMAP_TRACE_SCOPE("AdjustPoints3D");
+  CHECK_NOTNULL(reconstruction);
+  CHECK(options.Check());
+
+  // Every problem only has a single parameter block of three parameters.
+  ceres::Solver::Options solver_options = options.solver_options;
+  solver_options.linear_solver_type = ceres::DENSE_QR;
+  solver_options.minimizer_progress_to_stdout = false;
+  solver_options.logging_type = ceres::LoggingType::SILENT;
+  solver_options.num_threads = 1;
+#if CERES_VERSION_MAJOR < 2
+  solver_options.num_linear_solver_threads = 1;
+#endif  // CERES_VERSION_MAJOR
+
+  std::vector<char> adjusted(point3D_ids.size(), false);
+
+  ThreadPool thread_pool(GetEffectiveNumThreads(num_threads));
+  const int64_t kGrainSize = 64;
+  thread_pool.ParallelFor(
+      0, point3D_ids.size(), kGrainSize, [&](const int64_t i) {
+        Point3D& point3D = reconstruction->Point3D(point3D_ids[i]);
+        if (point3D.track.Length() < 2) {
+          return;
+        }
+
+        Eigen::Vector3d xyz = point3D.xyz;
+
+        ceres::Problem problem;
+        ceres::LossFunction* loss_function = options.CreateLossFunction();
+
+        // The camera parameters are constant, but copied for every
+        // observation, such that the problems never share parameter blocks.
+        std::vector<std::vector<double>> cameras_params;
+        cameras_params.reserve(point3D.track.Length());
+
+        for (const auto& track_el : point3D.track.Elements()) {
+          const Image& image = reconstruction->Image(track_el.image_id);
+          const Camera& camera = reconstruction->Camera(image.CameraId());
+          const Point2D& point2D = image.Point2D(track_el.point2D_idx);
+
+          ceres::CostFunction* cost_function = nullptr;
+
+          if (!options.enable_refraction) {
+            // Non-refractive case.
+            switch (camera.model_id) {
+#define CAMERA_MODEL_CASE(CameraModel)                                        \
+  case CameraModel::model_id:                                                 \
+    cost_function = ReprojErrorConstantPoseCostFunction<CameraModel>::Create( \
+        image.CamFromWorld(), point2D.xy);                                    \
+    break;
+
+              CAMERA_MODEL_SWITCH_CASES
+
+#undef CAMERA_MODEL_CASE
+            }
+
+            cameras_params.push_back(camera.params);
+            double* camera_params = cameras_params.back().data();
+            problem.AddResidualBlock(
+                cost_function, loss_function, xyz.data(), camera_params);
+            problem.SetParameterBlockConstant(camera_params);
+          } else {
+            // Refractive case, where the refracted rays are constant.
+            const Ray3D ray_refrac = camera.CamFromImgRefrac(point2D.xy);
+            cost_function =
+                ReprojErrorRefracConstantPoseCameraCostFunction::Create(
+                    image.CamFromWorld(),
+                    camera.VirtualCameraCenter(ray_refrac),
+                    ray_refrac.dir.hnormalized(),
+                    camera.params[0]);
+            problem.AddResidualBlock(cost_function, loss_function, xyz.data());
+          }
+        }
+
+        ceres::Solver::Summary summary;
+        ceres::Solve(solver_options, &problem, &summary);
+        if (summary.IsSolutionUsable()) {
+          point3D.xyz = xyz;
+          adjusted[i] = true;
+        }
+      });
+
+  return std::count(adjusted.begin(), adjusted.end(), true);
+}
+
 void PrintSolverSummary(const ceres::Solver::Summary& summary) {
   std::ostringstream log;
   log << "\n";
@@ -1113,6 +2649,13 @@ void PrintSolverSummary(const ceres::Solver::Summary& summary) {
   log << std::right << std::setw(16) << "Time : ";
   log << std::left << summary.total_time_in_seconds << " [s]\n";
 
+  log << std::right << std::setw(16) << "Linear solver : ";
+  log << std::left
+      << ceres::LinearSolverTypeToString(summary.linear_solver_type_used)
+      << ", "
+      << ceres::PreconditionerTypeToString(summary.preconditioner_type_used)
+      << " (" << summary.linear_solver_time_in_seconds << " [s])\n";
+
   log << std::right << std::setw(16) << "Initial cost : ";
   log << std::right << std::setprecision(6)
       << std::sqrt(summary.initial_cost / summary.num_residuals_reduced)
@@ -35,6 +35,8 @@
 
 #include <memory>
 #include <unordered_set>
+#include <utility>
+#include <vector>
 
 #include <Eigen/Core>
 #include <ceres/ceres.h>
@@ -72,11 +74,13 @@ struct BundleAdjustmentOptions {
   // Whether to use pose prior in reconstruction.
   bool use_pose_prior = false;
 
-  // Whether to use global pose prior std in bundle adjustment.
+  // Whether to weight all pose priors by the global pose prior std instead of
+  // the full covariance of the individual pose priors. Pose priors without
+  // covariance are always weighted by the global pose prior std.
   bool use_global_pose_prior_std = true;
 
-  // BA pose prior standard deviation. This is used to weight the importance of
-  // pose prior in BA.
+  // BA pose prior standard deviation of the rotation and translation
+  // residuals. This is used to weight the importance of pose prior in BA.
   std::vector<double> pose_prior_std;
 
   // Whether to optimize prior_from_cam during bundle adjustment.
@@ -88,6 +92,61 @@ struct BundleAdjustmentOptions {
   // Which refractive parameters to optimize during the reconstruction.
   bool refine_refrac_params = false;
 
+  // Whether to calibrate the refractive parameters in two stages, see
+  // `RefracCalibrationBundleAdjuster`. The calibration alternates between
+  // bundle adjustment with constant refractive parameters and an optimization
+  // of the refractive parameters over a subset of at most
+  // `refrac_calibration_max_num_observations` observations, until the relative
+  // change of the refractive parameters falls below the tolerance.
+  bool refrac_calibration_two_stage = false;
+  int refrac_calibration_max_num_iterations = 10;
+  int refrac_calibration_max_num_observations = 50000;
+  double refrac_calibration_tolerance = 1e-5;
+
+  // Whether to trace the refracted rays of the refractive residuals with
+  // variable camera poses in single precision, see
+  // `ReprojErrorRefracMixedPrecisionCostFunction`. The residuals and Jacobians
+  // are still accumulated in double precision.
+  bool refrac_mixed_precision = false;
+
+  // Whether to solve the linear systems of larger problems on the GPU using
+  // the CUDA backends of Ceres-Solver. Falls back to the CPU solvers if
+  // Ceres-Solver was built without CUDA support.
+  bool use_gpu = false;
+
+  // Index of the GPU used for bundle adjustment. If -1, the best available
+  // GPU is selected automatically.
+  std::string gpu_index = "-1";
+
+  // Minimum number of images to use the GPU. Smaller problems are solved
+  // faster on the CPU due to the overhead of transferring data to the GPU.
+  int min_num_images_gpu_solver = 50;
+
+  // Maximum number of images for which the dense and sparse direct solvers
+  // are used on the GPU. Larger problems use the iterative solver.
+  int max_num_images_direct_dense_gpu_solver = 200;
+  int max_num_images_direct_sparse_gpu_solver = 4000;
+
+  // Stage of the reconstruction in which the bundle adjustment is solved. The
+  // stage selects the preset of the adaptive termination, see `SetStage`, and
+  // the number of solver iterations is reported to the tracing per stage.
+  enum class Stage { DEFAULT, LOCAL, GLOBAL, HYBRID_FINAL, REFRAC_CALIBRATION };
+  Stage stage = Stage::DEFAULT;
+
+  // Whether to terminate the solver adaptively, see
+  // `BundleAdjustmentConvergenceCallback`. An iteration is converged if the
+  // relative decrease of the cost is below `adaptive_cost_tolerance`, and the
+  // maximum rotation update [deg] and translation update, relative to the
+  // median distance of the cameras from the origin, of the variable camera
+  // poses are below the respective tolerances. The solver terminates after
+  // `adaptive_num_converged_iterations` consecutive converged iterations or
+  // at the latest after `max_num_iterations` of the solver options.
+  bool adaptive_termination = false;
+  double adaptive_cost_tolerance = 1e-5;
+  double adaptive_rotation_tolerance = 1e-4;
+  double adaptive_translation_tolerance = 1e-5;
+  int adaptive_num_converged_iterations = 2;
+
   // Ceres-Solver options.
   ceres::Solver::Options solver_options;
 
@@ -110,9 +169,99 @@ struct BundleAdjustmentOptions {
   // takes ownership of the loss function.
   ceres::LossFunction* CreateLossFunction() const;
 
+  // Set the stage and the tolerances of the adaptive termination to the
+  // preset of the stage. Local bundle adjustment is refined by later global
+  // bundle adjustments and terminates early, while the final bundle
+  // adjustment of the hybrid mapper determines the accuracy of the result and
+  // uses the strictest tolerances. The inner bundle adjustments of the
+  // refractive calibration are repeated until the refractive parameters
+  // converge, such that each of them can terminate early.
+  void SetStage(Stage stage);
+
   bool Check() const;
 };
 
+// Name of the histogram of the number of solver iterations of the stage.
+const char* BundleAdjustmentIterationsMetricName(
+    BundleAdjustmentOptions::Stage stage);
+
+// Adaptive termination of the solver according to the convergence policy of
+// the bundle adjustment options, see `BundleAdjustmentOptions`. The camera
+// poses are read in every iteration, which requires
+// `update_state_every_iteration` in the solver options. Without camera poses,
+// only the decrease of the cost is considered.
+class BundleAdjustmentConvergenceCallback : public ceres::IterationCallback {
+ public:
+  // The poses are given by the pointers to their rotation quaternions and
+  // translations, which are the parameter blocks in the problem.
+  BundleAdjustmentConvergenceCallback(
+      const BundleAdjustmentOptions& options,
+      std::vector<std::pair<const double*, const double*>> poses);
+
+  ceres::CallbackReturnType operator()(
+      const ceres::IterationSummary& summary) override;
+
+  // Whether the solver was terminated by the callback.
+  bool Converged() const;
+
+ private:
+  // Compute the maximum rotation and translation update since the previous
+  // call and store the current poses.
+  void UpdatePoses(double* max_rotation_update,
+                   double* max_translation_update);
+
+  const double cost_tolerance_;
+  const double rotation_tolerance_;
+  const double translation_tolerance_;
+  const int num_converged_iterations_;
+  const std::vector<std::pair<const double*, const double*>> poses_;
+  // Rotation quaternion and translation of the poses in the previous
+  // iteration, stored as 7 consecutive values per pose.
+  std::vector<double> prev_poses_;
+  double translation_scale_;
+  int num_consecutive_converged_iterations_;
+  bool converged_;
+};
+
+// Structure of a bundle adjustment problem, from which the linear solver,
+// the preconditioner, and the threading are chosen.
+struct BundleAdjustmentProblemStructure {
+  // Number of images and 3D points in the problem.
+  size_t num_images = 0;
+  size_t num_points = 0;
+
+  // Number of residuals in the problem.
+  size_t num_residuals = 0;
+
+  // Number of image pairs observing a common variable 3D point, i.e., the
+  // number of non-zero off-diagonal blocks in the reduced camera system.
+  size_t num_covisible_image_pairs = 0;
+
+  // Whether variable parameter blocks are shared by many images, e.g., the
+  // intrinsics or refractive parameters of a camera, the prior_from_cam
+  // transformation, or the relative poses of a camera rig. These add dense
+  // rows to the reduced camera system and connect all images observed by
+  // them in the visibility graph.
+  bool has_shared_blocks = false;
+
+  // Whether refractive or pose prior residuals are part of the problem.
+  bool has_refrac_residuals = false;
+  bool has_pose_prior_residuals = false;
+
+  // Fraction of non-zero off-diagonal blocks in the reduced camera system.
+  double VisibilityDensity() const;
+
+  // Average number of images covisible with an image.
+  double AvgNumCovisibleImages() const;
+};
+
+// Choose the linear solver, the preconditioner, and the number of threads
+// for a problem with the given structure.
+void ConfigureBundleAdjustmentSolver(
+    const BundleAdjustmentOptions& options,
+    const BundleAdjustmentProblemStructure& structure,
+    ceres::Solver::Options* solver_options);
+
 // Configuration container to setup bundle adjustment problems.
 class BundleAdjustmentConfig {
  public:
@@ -165,6 +314,18 @@ class BundleAdjustmentConfig {
   void RemoveVariablePoint(point3D_t point3D_id);
   void RemoveConstantPoint(point3D_t point3D_id);
 
+  // Restrict the observations of the added images to a subset of the 3D
+  // points, e.g., to refine the camera poses on a spatially uniform subset of
+  // the points in a reduced bundle adjustment. The other points are neither
+  // refined nor do they constrain the poses. By default, the observations of
+  // all points are added.
+  void SetPointSubset(std::unordered_set<point3D_t> point3D_ids);
+  void ClearPointSubset();
+  bool HasPointSubset() const;
+  // Whether the observations of the point are added, i.e., whether no subset
+  // is set or the point is part of the subset.
+  bool IsInPointSubset(point3D_t point3D_id) const;
+
   // Access configuration data.
   const std::unordered_set<image_t>& Images() const;
   const std::unordered_set<point3D_t>& VariablePoints() const;
@@ -178,6 +339,54 @@ class BundleAdjustmentConfig {
   std::unordered_set<point3D_t> constant_point3D_ids_;
   std::unordered_set<image_t> constant_cam_poses_;
   std::unordered_map<image_t, std::vector<int>> constant_cam_positions_;
+  bool has_point_subset_ = false;
+  std::unordered_set<point3D_t> point_subset_;
+};
+
+// Compute the square-root information matrix of the residuals of the absolute
+// pose error cost functions from the covariance of the measured pose, given in
+// the order [qw, qx, qy, qz, tx, ty, tz]. The covariance is propagated to first
+// order onto the 3-DOF rotation and translation residuals, which avoids the
+// inversion of the rank-deficient quaternion covariance. Returns false if the
+// propagated covariance is not positive definite.
+bool ComputePosePriorSqrtInformation(const Rigid3d& tform_measured,
+                                     const Eigen::Matrix7d& tform_measured_cov,
+                                     Eigen::Matrix6d* sqrt_information);
+
+// Cache for the square-root information matrices of the pose priors of the
+// images, such that the prior covariances are only transformed and factorized
+// once across many bundle adjustments of the same reconstruction. An entry is
+// recomputed if the pose prior, its covariance, or the prior_from_cam
+// transform changed.
+class PosePriorInformationCache {
+ public:
+  // Get the square-root information of the pose prior of the image in the
+  // frame used by the bundle adjuster, i.e. prior_from_world if
+  // refine_prior_from_cam and otherwise cam_from_world. Returns false if the
+  // image has no valid prior covariance.
+  bool SqrtInformation(const Image& image,
+                       const Rigid3d& prior_from_cam,
+                       bool refine_prior_from_cam,
+                       Eigen::Matrix6d* sqrt_information);
+
+  void Clear();
+
+ private:
+  struct Entry {
+    Rigid3d prior_from_world;
+    Eigen::Matrix7d prior_from_world_cov;
+    Rigid3d prior_from_cam;
+    bool refine_prior_from_cam = false;
+    bool valid = false;
+    Eigen::Matrix6d sqrt_information;
+  };
+
+  std::unordered_map<image_t,
+                     Entry,
+                     std::hash<image_t>,
+                     std::equal_to<image_t>,
+                     Eigen::aligned_allocator<std::pair<const image_t, Entry>>>
+      entries_;
 };
 
 // Bundle adjustment based on Ceres-Solver. Enables most flexible configurations
@@ -192,10 +401,18 @@ class BundleAdjuster {
   // Get the Ceres solver summary for the last call to `Solve`.
   const ceres::Solver::Summary& Summary() const;
 
+  // Get the Ceres problem of the last call to `Solve`, e.g., to estimate the
+  // covariances of the refined parameters.
+  ceres::Problem* Problem();
+
+  // Set the cache of the pose prior information matrices, which must outlive
+  // the bundle adjuster. Without a cache, the information matrices are
+  // computed for every bundle adjustment.
+  void SetPosePriorInformationCache(PosePriorInformationCache* cache);
+
  private:
   void SetUp(Reconstruction* reconstruction,
              ceres::LossFunction* loss_function);
-  void TearDown(Reconstruction* reconstruction);
 
   void AddImageToProblem(image_t image_id,
                          Reconstruction* reconstruction,
@@ -206,15 +423,51 @@ class BundleAdjuster {
                          ceres::LossFunction* loss_function);
 
  protected:
+  // Report the refined parameters to the change tracking of the
+  // reconstruction.
+  void TearDown(Reconstruction* reconstruction);
+
+  // Whether the intrinsics and refractive parameters of the camera are fixed,
+  // such that the refracted rays of its observations are constant and can be
+  // precomputed.
+  bool HasConstantRefracCamera(camera_t camera_id) const;
+
   void ParameterizeCameras(Reconstruction* reconstruction);
   void ParameterizePoints(Reconstruction* reconstruction);
 
+  // Set the manifolds of the variable intrinsic and refractive parameters of
+  // the camera, whose parameter blocks must be part of the problem.
+  void SetCameraParamsManifold(Camera* camera);
+  void SetRefracParamsManifold(Camera* camera);
+
+  // Analyze the structure of the set up problem.
+  BundleAdjustmentProblemStructure AnalyzeProblemStructure(
+      const Reconstruction& reconstruction) const;
+
+  // Create the solver options for the set up problem. For the Schur based
+  // solvers, the 3D points are explicitly eliminated first, which avoids
+  // computing the elimination ordering in Ceres and ensures that shared
+  // parameter blocks are never chosen for elimination.
+  ceres::Solver::Options CreateSolverOptions(
+      const BundleAdjustmentProblemStructure& structure,
+      const Reconstruction& reconstruction) const;
+
+  // Add the callback of the adaptive termination to the solver options, if
+  // enabled, which monitors the variable camera poses of the set up problem.
+  void AddConvergenceCallback(Reconstruction* reconstruction,
+                              ceres::Solver::Options* solver_options);
+
+  // Report the number of iterations of the last solve to the tracing.
+  void ReportIterations() const;
+
   const BundleAdjustmentOptions options_;
   BundleAdjustmentConfig config_;
   std::unique_ptr<ceres::Problem> problem_;
   ceres::Solver::Summary summary_;
   std::unordered_set<camera_t> camera_ids_;
   std::unordered_map<point3D_t, size_t> point3D_num_observations_;
+  PosePriorInformationCache* pose_prior_information_cache_;
+  std::unique_ptr<BundleAdjustmentConvergenceCallback> convergence_callback_;
 };
 
 class RigBundleAdjuster : public BundleAdjuster {
@@ -254,6 +507,20 @@ class RigBundleAdjuster : public BundleAdjuster {
                          Reconstruction* reconstruction,
                          ceres::LossFunction* loss_function);
 
+  // Add the refractive residual of an observation. If `cam_from_world` is
+  // given, the camera pose is constant. Otherwise, the pose is composed of
+  // the variable rig and rig-relative poses, where the rig pose is null for
+  // images without a camera rig.
+  void AddRefracResidual(const Eigen::Vector2d& point2D,
+                         Camera* camera,
+                         const Rigid3d* cam_from_world,
+                         double* cam_from_rig_rotation,
+                         double* cam_from_rig_translation,
+                         double* rig_from_world_rotation,
+                         double* rig_from_world_translation,
+                         double* point3D,
+                         ceres::LossFunction* loss_function);
+
   void ComputeCameraRigPoses(const Reconstruction& reconstruction,
                              const std::vector<CameraRig>& camera_rigs);
 
@@ -275,6 +542,129 @@ class RigBundleAdjuster : public BundleAdjuster {
   std::unordered_set<double*> parameterized_quats_;
 };
 
+// Bundle adjuster that keeps its problem between calls to `Solve` for a
+// sequence of overlapping configurations, e.g., the local bundles of
+// incremental mapping. Only the residual blocks of observations that enter
+// the configuration are created and the ones of observations that leave it
+// are removed, while the parameter blocks of the remaining images, cameras,
+// and points are reused and only set constant or variable as configured.
+// Constant camera poses are modeled as constant parameter blocks instead of
+// dedicated cost functions. Pose priors are not supported, see
+// `IsSupported`. The options must not change between calls.
+class PersistentBundleAdjuster : public BundleAdjuster {
+ public:
+  explicit PersistentBundleAdjuster(const BundleAdjustmentOptions& options);
+
+  // Whether the bundle adjustment options are supported.
+  static bool IsSupported(const BundleAdjustmentOptions& options);
+
+  // Adjust the given configuration of the reconstruction. Cached parameter
+  // blocks are validated against the memory of the reconstruction and the
+  // problem is reset, if the reconstruction was replaced in the meantime.
+  bool Solve(const BundleAdjustmentConfig& config,
+             Reconstruction* reconstruction);
+
+  // Discard the cached problem.
+  void Reset();
+
+ private:
+  enum class ResidualType {
+    REPROJ,
+    REFRAC,
+    // Refracted ray of the observation is precomputed, since the intrinsics
+    // and refractive parameters of the camera are constant.
+    REFRAC_CONSTANT_CAMERA,
+  };
+
+  struct Observation {
+    image_t image_id;
+    point2D_t point2D_idx;
+    point3D_t point3D_id;
+    ResidualType type;
+  };
+
+  struct Residual {
+    point3D_t point3D_id;
+    ResidualType type;
+    ceres::ResidualBlockId residual_block_id;
+    size_t generation;
+  };
+
+  // Whether the cached parameter blocks of the observations still point to
+  // the memory of the reconstruction.
+  bool IsCacheValid(const std::vector<Observation>& observations,
+                    const Reconstruction& reconstruction) const;
+
+  void AddObservationToProblem(const Observation& observation,
+                               Reconstruction* reconstruction);
+
+  void SetParameterBlocksConstantOrVariable(
+      const std::unordered_set<image_t>& image_ids,
+      Reconstruction* reconstruction);
+
+  std::unique_ptr<ceres::LossFunction> loss_function_;
+
+  // Incremented with every call to `Solve` to detect unused residual blocks.
+  size_t generation_;
+
+  // Residual blocks of the problem by image and point2D index.
+  std::unordered_map<image_t, std::unordered_map<point2D_t, Residual>>
+      residuals_;
+
+  // Parameter blocks of the problem, which are used to detect if the
+  // reconstruction was replaced.
+  std::unordered_map<image_t, const double*> cam_from_world_rotations_;
+  std::unordered_map<camera_t, const double*> camera_params_;
+  std::unordered_map<point3D_t, double*> points3D_;
+
+  // Constant position indices of the translation parameter blocks.
+  std::unordered_map<image_t, std::vector<int>> constant_cam_positions_;
+
+  // Camera and refractive parameters, from which the refracted rays of the
+  // residuals of type REFRAC_CONSTANT_CAMERA were precomputed.
+  std::unordered_map<camera_t, std::vector<double>> refrac_camera_params_;
+};
+
+// Bundle adjuster that calibrates the refractive parameters of the cameras in
+// two alternating stages instead of refining them jointly with all other
+// parameters. As the refractive parameters are shared by all observations of
+// a camera, they otherwise densely couple all images in the reduced camera
+// system. The first stage refines the refractive parameters with constant
+// camera poses and intrinsics over a subsample of the 3D points, whose
+// positions are eliminated by the Schur complement. The second stage is a
+// regular bundle adjustment with constant refractive parameters, in which the
+// refracted rays of cameras with constant intrinsics are precomputed.
+class RefracCalibrationBundleAdjuster : public BundleAdjuster {
+ public:
+  RefracCalibrationBundleAdjuster(const BundleAdjustmentOptions& options,
+                                  const BundleAdjustmentConfig& config);
+
+  // Alternate between both stages until convergence. The summary is the one
+  // of the last bundle adjustment stage.
+  bool Solve(Reconstruction* reconstruction);
+
+ private:
+  // Refine the refractive parameters of the refractive cameras of the
+  // configured images and return their maximum relative change.
+  double SolveRefracParams(Reconstruction* reconstruction);
+
+  // Select an evenly spaced subsample of the 3D points observed by the
+  // configured images with a total of at most
+  // `refrac_calibration_max_num_observations` observations.
+  std::vector<point3D_t> SubsamplePoints(
+      const Reconstruction& reconstruction) const;
+};
+
+// Refine the given 3D points with constant camera poses and intrinsics, e.g.,
+// after triangulating a model with known poses. The points are then
+// independent of each other, such that every point is adjusted in its own
+// small problem and the points are adjusted in parallel instead of in a joint
+// bundle adjustment. Returns the number of adjusted points.
+size_t AdjustPoints3D(const BundleAdjustmentOptions& options,
+                      const std::vector<point3D_t>& point3D_ids,
+                      int num_threads,
+                      Reconstruction* reconstruction);
+
 void PrintSolverSummary(const ceres::Solver::Summary& summary);
 
 }  // namespace colmap
@@ -33,6 +33,7 @@
 #include "colmap/scene/correspondence_graph.h"
 #include "colmap/scene/projection.h"
 #include "colmap/sensor/models.h"
+#include "colmap/sensor/models_refrac.h"
 
 #include <gtest/gtest.h>
 
@@ -215,6 +216,118 @@ TEST(BundleAdjustment, ConfigNumObservations) {
   EXPECT_EQ(config.NumResiduals(reconstruction), 800);
 }
 
+TEST(BundleAdjustment, ConfigureSolver) {
+  BundleAdjustmentOptions options;
+  options.min_num_residuals_for_multi_threading = 1000;
+
+  BundleAdjustmentProblemStructure structure;
+  structure.num_images = 10;
+  structure.num_residuals = 100;
+  structure.num_covisible_image_pairs = 45;
+  EXPECT_EQ(structure.VisibilityDensity(), 1.0);
+  EXPECT_EQ(structure.AvgNumCovisibleImages(), 9.0);
+
+  ceres::Solver::Options solver_options = options.solver_options;
+  ConfigureBundleAdjustmentSolver(options, structure, &solver_options);
+  EXPECT_EQ(solver_options.linear_solver_type, ceres::DENSE_SCHUR);
+  EXPECT_EQ(solver_options.num_threads, 1);
+
+  // Medium-sized problem, in which all images see each other.
+  structure.num_images = 150;
+  structure.num_residuals = 10000;
+  structure.num_covisible_image_pairs = 150 * 149 / 2;
+  solver_options = options.solver_options;
+  ConfigureBundleAdjustmentSolver(options, structure, &solver_options);
+  EXPECT_EQ(solver_options.linear_solver_type, ceres::DENSE_SCHUR);
+  EXPECT_GE(solver_options.num_threads, 1);
+
+  // Large problem with sparse visibility, e.g., a sequential survey.
+  structure.num_images = 3000;
+  structure.num_covisible_image_pairs = 3000 * 5;
+  solver_options = options.solver_options;
+  solver_options.sparse_linear_algebra_library_type = ceres::NO_SPARSE;
+  ConfigureBundleAdjustmentSolver(options, structure, &solver_options);
+  EXPECT_EQ(solver_options.linear_solver_type, ceres::ITERATIVE_SCHUR);
+  EXPECT_EQ(solver_options.preconditioner_type, ceres::SCHUR_JACOBI);
+  solver_options = options.solver_options;
+  if (solver_options.sparse_linear_algebra_library_type != ceres::NO_SPARSE) {
+    ConfigureBundleAdjustmentSolver(options, structure, &solver_options);
+    EXPECT_EQ(solver_options.linear_solver_type, ceres::SPARSE_SCHUR);
+  }
+
+  // Large problem with dense visibility and shared parameter blocks.
+  structure.num_images = 6000;
+  structure.num_covisible_image_pairs = 6000 * 100;
+  structure.has_shared_blocks = true;
+  solver_options = options.solver_options;
+  ConfigureBundleAdjustmentSolver(options, structure, &solver_options);
+  EXPECT_EQ(solver_options.linear_solver_type, ceres::ITERATIVE_SCHUR);
+  EXPECT_EQ(solver_options.preconditioner_type, ceres::SCHUR_JACOBI);
+}
+
+TEST(BundleAdjustment, PosePriorSqrtInformation) {
+  Rigid3d tform_measured;
+  Eigen::Matrix7d tform_measured_cov = Eigen::Matrix7d::Zero();
+  Eigen::Matrix6d sqrt_information;
+  EXPECT_FALSE(ComputePosePriorSqrtInformation(
+      tform_measured, tform_measured_cov, &sqrt_information));
+
+  // The covariance of the quaternion is rank-deficient in the direction of the
+  // real part, which does not affect the residuals at the identity rotation.
+  tform_measured_cov.diagonal() << 0, 1e-4, 4e-4, 9e-4, 1, 4, 9;
+  EXPECT_TRUE(ComputePosePriorSqrtInformation(
+      tform_measured, tform_measured_cov, &sqrt_information));
+  Eigen::Matrix6d expected_sqrt_information = Eigen::Matrix6d::Zero();
+  expected_sqrt_information.diagonal() << 50, 25, 50.0 / 3.0, 1, 0.5,
+      1.0 / 3.0;
+  EXPECT_LT((sqrt_information - expected_sqrt_information).norm(), 1e-9);
+
+  // The translation residuals are correlated with the rotation residuals.
+  tform_measured = Rigid3d(Eigen::Quaterniond(Eigen::AngleAxisd(
+                               0.3, Eigen::Vector3d(1, 2, 3).normalized())),
+                           Eigen::Vector3d(1, 2, 3));
+  EXPECT_TRUE(ComputePosePriorSqrtInformation(
+      tform_measured, tform_measured_cov, &sqrt_information));
+  EXPECT_TRUE(sqrt_information.allFinite());
+  EXPECT_NE(sqrt_information(3, 1), 0);
+}
+
+TEST(BundleAdjustment, PosePriorInformationCache) {
+  Image image;
+  image.SetImageId(1);
+  image.CamFromWorldPrior().translation = Eigen::Vector3d(1, 2, 3);
+
+  PosePriorInformationCache cache;
+  Eigen::Matrix6d sqrt_information;
+  EXPECT_FALSE(cache.SqrtInformation(
+      image, Rigid3d(), /*refine_prior_from_cam=*/true, &sqrt_information));
+
+  image.CamFromWorldPriorCov().diagonal() << 0, 1e-4, 1e-4, 1e-4, 1, 1, 1;
+  EXPECT_TRUE(cache.SqrtInformation(
+      image, Rigid3d(), /*refine_prior_from_cam=*/true, &sqrt_information));
+  Eigen::Matrix6d expected_sqrt_information;
+  EXPECT_TRUE(ComputePosePriorSqrtInformation(image.CamFromWorldPrior(),
+                                              image.CamFromWorldPriorCov(),
+                                              &expected_sqrt_information));
+  EXPECT_EQ(sqrt_information, expected_sqrt_information);
+
+  // The covariance is transformed into the camera frame.
+  const Rigid3d prior_from_cam(Eigen::Quaterniond::Identity(),
+                               Eigen::Vector3d(0, 0, 1));
+  EXPECT_TRUE(cache.SqrtInformation(image,
+                                    prior_from_cam,
+                                    /*refine_prior_from_cam=*/false,
+                                    &sqrt_information));
+  EXPECT_TRUE(sqrt_information.allFinite());
+  EXPECT_NE(sqrt_information, expected_sqrt_information);
+
+  image.CamFromWorldPriorCov().setZero();
+  EXPECT_FALSE(cache.SqrtInformation(image,
+                                     prior_from_cam,
+                                     /*refine_prior_from_cam=*/false,
+                                     &sqrt_information));
+}
+
 TEST(BundleAdjustment, TwoView) {
   Reconstruction reconstruction;
   GenerateReconstruction(2, 100, &reconstruction);
@@ -437,6 +550,55 @@ TEST(BundleAdjustment, ConstantPoints) {
   }
 }
 
+TEST(BundleAdjustment, PointSubset) {
+  Reconstruction reconstruction;
+  GenerateReconstruction(2, 100, &reconstruction);
+  const auto orig_reconstruction = reconstruction;
+
+  std::unordered_set<point3D_t> point3D_ids;
+  for (const auto& point3D : reconstruction.Points3D()) {
+    if (point3D_ids.size() < 50) {
+      point3D_ids.insert(point3D.first);
+    }
+  }
+
+  BundleAdjustmentConfig config;
+  config.AddImage(0);
+  config.AddImage(1);
+  config.SetConstantCamPose(0);
+  config.SetConstantCamPositions(1, {0});
+  config.SetPointSubset(point3D_ids);
+  EXPECT_TRUE(config.HasPointSubset());
+  EXPECT_EQ(config.NumResiduals(reconstruction), 200);
+
+  BundleAdjustmentOptions options;
+  BundleAdjuster bundle_adjuster(options, config);
+  ASSERT_TRUE(bundle_adjuster.Solve(&reconstruction));
+
+  const auto summary = bundle_adjuster.Summary();
+
+  // 50 points, 2 images, 2 residuals per point per image
+  EXPECT_EQ(summary.num_residuals_reduced, 200);
+  // 50 x 3 point parameters
+  // + 5 image parameters (pose of second image)
+  // + 2 x 2 camera parameters
+  EXPECT_EQ(summary.num_effective_parameters_reduced, 159);
+
+  for (const auto& point3D : reconstruction.Points3D()) {
+    if (point3D_ids.count(point3D.first) > 0) {
+      CheckVariablePoint(point3D.second,
+                         orig_reconstruction.Point3D(point3D.first));
+    } else {
+      CheckConstantPoint(point3D.second,
+                         orig_reconstruction.Point3D(point3D.first));
+    }
+  }
+
+  config.ClearPointSubset();
+  EXPECT_FALSE(config.HasPointSubset());
+  EXPECT_EQ(config.NumResiduals(reconstruction), 400);
+}
+
 TEST(BundleAdjustment, VariableImage) {
   Reconstruction reconstruction;
   GenerateReconstruction(3, 100, &reconstruction);
@@ -643,6 +805,191 @@ TEST(BundleAdjustment, ConstantExtraParam) {
   }
 }
 
+TEST(BundleAdjustment, PersistentProblem) {
+  Reconstruction reconstruction;
+  GenerateReconstruction(4, 100, &reconstruction);
+  Reconstruction orig_reconstruction = reconstruction;
+  Reconstruction ref_reconstruction = reconstruction;
+
+  std::vector<BundleAdjustmentConfig> configs(3);
+  configs[0].AddImage(0);
+  configs[0].AddImage(1);
+  configs[0].AddImage(2);
+  configs[0].SetConstantCamPose(0);
+  configs[0].SetConstantCamPositions(1, {0});
+  configs[1].AddImage(1);
+  configs[1].AddImage(2);
+  configs[1].AddImage(3);
+  configs[1].SetConstantCamPose(1);
+  configs[1].SetConstantCamPositions(2, {0});
+  configs[1].SetConstantCamIntrinsics(3);
+  configs[2] = configs[1];
+  for (auto& config : configs) {
+    for (const auto& point3D : reconstruction.Points3D()) {
+      config.AddVariablePoint(point3D.first);
+    }
+  }
+  configs[2].RemoveVariablePoint(0);
+  configs[2].AddConstantPoint(0);
+
+  BundleAdjustmentOptions options;
+  options.print_summary = false;
+  PersistentBundleAdjuster bundle_adjuster(options);
+  for (const auto& config : configs) {
+    ASSERT_TRUE(bundle_adjuster.Solve(config, &reconstruction));
+    const auto& summary = bundle_adjuster.Summary();
+
+    BundleAdjuster ref_bundle_adjuster(options, config);
+    ASSERT_TRUE(ref_bundle_adjuster.Solve(&ref_reconstruction));
+    const auto& ref_summary = ref_bundle_adjuster.Summary();
+
+    EXPECT_NE(summary.termination_type, ceres::FAILURE);
+    EXPECT_EQ(summary.num_residuals, ref_summary.num_residuals);
+    EXPECT_EQ(summary.num_effective_parameters_reduced,
+              ref_summary.num_effective_parameters_reduced);
+    EXPECT_NEAR(summary.initial_cost,
+                ref_summary.initial_cost,
+                1e-6 * ref_summary.initial_cost);
+    EXPECT_NEAR(summary.final_cost,
+                ref_summary.final_cost,
+                1e-6 * ref_summary.final_cost);
+  }
+
+  // Image 0 and camera 3 are only observed through the variable points.
+  CheckConstantImage(reconstruction.Image(0), orig_reconstruction.Image(0));
+  CheckConstantCamera(reconstruction.Camera(3), orig_reconstruction.Camera(3));
+}
+
+TEST(BundleAdjustment, RefracCalibrationTwoStage) {
+  Reconstruction reconstruction;
+  GenerateReconstruction(4, 100, &reconstruction);
+
+  // Make all cameras refractive and replace the observations by the exact
+  // refractive projections of the 3D points.
+  for (const auto& image : reconstruction.Images()) {
+    Camera& camera = reconstruction.Camera(image.second.CameraId());
+    camera.refrac_model_id = FlatPort::refrac_model_id;
+    camera.refrac_params = {0.0, 0.0, 1.0, 0.05, 0.007, 1.0, 1.52, 1.33};
+    for (const auto& point3D : reconstruction.Points3D()) {
+      for (const auto& track_el : point3D.second.track.Elements()) {
+        if (track_el.image_id == image.first) {
+          reconstruction.Image(image.first).Point2DXY(track_el.point2D_idx) =
+              camera.ImgFromCamRefrac(image.second.CamFromWorld() *
+                                      point3D.second.xyz);
+        }
+      }
+    }
+    camera.refrac_params[3] = 0.1;
+  }
+
+  const Reconstruction orig_reconstruction = reconstruction;
+
+  BundleAdjustmentConfig config;
+  config.AddImage(0);
+  config.AddImage(1);
+  config.AddImage(2);
+  config.AddImage(3);
+  config.SetConstantCamPose(0);
+  config.SetConstantCamPositions(1, {0});
+
+  BundleAdjustmentOptions options;
+  options.print_summary = false;
+  options.enable_refraction = true;
+  options.refine_refrac_params = true;
+  options.refrac_calibration_two_stage = true;
+  options.refrac_calibration_max_num_observations = 200;
+  RefracCalibrationBundleAdjuster bundle_adjuster(options, config);
+  ASSERT_TRUE(bundle_adjuster.Solve(&reconstruction));
+
+  const auto summary = bundle_adjuster.Summary();
+
+  // The refractive parameters are constant in the last bundle adjustment.
+  EXPECT_NE(summary.termination_type, ceres::FAILURE);
+  EXPECT_EQ(summary.num_residuals_reduced, 800);
+
+  CheckConstantImage(reconstruction.Image(0), orig_reconstruction.Image(0));
+  CheckConstantXImage(reconstruction.Image(1), orig_reconstruction.Image(1));
+
+  for (camera_t camera_id = 0; camera_id < 4; ++camera_id) {
+    const Camera& camera = reconstruction.Camera(camera_id);
+    const Camera& orig_camera = orig_reconstruction.Camera(camera_id);
+    EXPECT_NE(camera.refrac_params[3], orig_camera.refrac_params[3]);
+    // Only the optimizable refractive parameters are refined.
+    EXPECT_EQ(camera.refrac_params[7], orig_camera.refrac_params[7]);
+  }
+}
+
+TEST(BundleAdjustment, RefracMixedPrecision) {
+  Reconstruction reconstruction;
+  GenerateReconstruction(4, 100, &reconstruction);
+
+  // Make all cameras refractive and replace the observations by the exact
+  // refractive projections of the 3D points.
+  for (const auto& image : reconstruction.Images()) {
+    Camera& camera = reconstruction.Camera(image.second.CameraId());
+    camera.refrac_model_id = FlatPort::refrac_model_id;
+    camera.refrac_params = {0.0, 0.0, 1.0, 0.05, 0.007, 1.0, 1.52, 1.33};
+    for (const auto& point3D : reconstruction.Points3D()) {
+      for (const auto& track_el : point3D.second.track.Elements()) {
+        if (track_el.image_id == image.first) {
+          reconstruction.Image(image.first).Point2DXY(track_el.point2D_idx) =
+              camera.ImgFromCamRefrac(image.second.CamFromWorld() *
+                                      point3D.second.xyz);
+        }
+      }
+    }
+  }
+
+  const Reconstruction orig_reconstruction = reconstruction;
+  for (const point3D_t point3D_id : reconstruction.Point3DIds()) {
+    reconstruction.Point3D(point3D_id).xyz += 0.01 * Eigen::Vector3d::Random();
+  }
+
+  BundleAdjustmentConfig config;
+  config.AddImage(0);
+  config.AddImage(1);
+  config.AddImage(2);
+  config.AddImage(3);
+  config.SetConstantCamPose(0);
+  config.SetConstantCamPositions(1, {0});
+
+  BundleAdjustmentOptions options;
+  options.print_summary = false;
+  options.enable_refraction = true;
+
+  Reconstruction double_reconstruction = reconstruction;
+  BundleAdjuster double_bundle_adjuster(options, config);
+  ASSERT_TRUE(double_bundle_adjuster.Solve(&double_reconstruction));
+
+  options.refrac_mixed_precision = true;
+  BundleAdjuster bundle_adjuster(options, config);
+  ASSERT_TRUE(bundle_adjuster.Solve(&reconstruction));
+
+  const auto summary = bundle_adjuster.Summary();
+  EXPECT_NE(summary.termination_type, ceres::FAILURE);
+  EXPECT_EQ(summary.num_residuals_reduced, 800);
+  EXPECT_LT(summary.final_cost, 1e-4);
+
+  // The single precision ray tracing only slightly affects the accuracy of
+  // the reconstruction.
+  for (const auto& point3D : reconstruction.Points3D()) {
+    EXPECT_LT((point3D.second.xyz -
+               orig_reconstruction.Point3D(point3D.first).xyz)
+                  .norm(),
+              1e-3);
+    EXPECT_LT((point3D.second.xyz -
+               double_reconstruction.Point3D(point3D.first).xyz)
+                  .norm(),
+              1e-4);
+  }
+  for (image_t image_id = 1; image_id < 4; ++image_id) {
+    EXPECT_LT((reconstruction.Image(image_id).ProjectionCenter() -
+               double_reconstruction.Image(image_id).ProjectionCenter())
+                  .norm(),
+              1e-4);
+  }
+}
+
 TEST(BundleAdjustment, RigTwoView) {
   Reconstruction reconstruction;
   GenerateReconstruction(2, 100, &reconstruction);
@@ -847,5 +1194,126 @@ TEST(BundleAdjustment, RigFourViewPartial) {
   }
 }
 
+TEST(BundleAdjustment, AdjustPoints3D) {
+  Reconstruction reconstruction;
+  GenerateReconstruction(3, 100, &reconstruction);
+  const auto orig_reconstruction = reconstruction;
+
+  const point3D_t constant_point3D_id = 1;
+  std::vector<point3D_t> point3D_ids;
+  for (const auto& point3D : reconstruction.Points3D()) {
+    if (point3D.first != constant_point3D_id) {
+      point3D_ids.push_back(point3D.first);
+    }
+  }
+
+  EXPECT_EQ(AdjustPoints3D(BundleAdjustmentOptions(),
+                           point3D_ids,
+                           /*num_threads=*/2,
+                           &reconstruction),
+            point3D_ids.size());
+
+  for (const auto& image : reconstruction.Images()) {
+    CheckConstantCamera(reconstruction.Camera(image.second.CameraId()),
+                        orig_reconstruction.Camera(image.second.CameraId()));
+    CheckConstantImage(image.second, orig_reconstruction.Image(image.first));
+  }
+
+  for (const auto& point3D : reconstruction.Points3D()) {
+    if (point3D.first == constant_point3D_id) {
+      CheckConstantPoint(point3D.second,
+                         orig_reconstruction.Point3D(point3D.first));
+    } else {
+      CheckVariablePoint(point3D.second,
+                         orig_reconstruction.Point3D(point3D.first));
+    }
+  }
+}
+
+TEST(BundleAdjustmentOptions, SetStage) {
+  BundleAdjustmentOptions options;
+  options.SetStage(BundleAdjustmentOptions::Stage::LOCAL);
+  EXPECT_EQ(options.stage, BundleAdjustmentOptions::Stage::LOCAL);
+  const double local_cost_tolerance = options.adaptive_cost_tolerance;
+  options.SetStage(BundleAdjustmentOptions::Stage::HYBRID_FINAL);
+  EXPECT_EQ(options.stage, BundleAdjustmentOptions::Stage::HYBRID_FINAL);
+  EXPECT_LT(options.adaptive_cost_tolerance, local_cost_tolerance);
+  EXPECT_TRUE(options.Check());
+}
+
+TEST(BundleAdjustmentConvergenceCallback, Nominal) {
+  BundleAdjustmentOptions options;
+  options.adaptive_cost_tolerance = 1e-3;
+  options.adaptive_rotation_tolerance = 1e-2;
+  options.adaptive_translation_tolerance = 1e-3;
+  options.adaptive_num_converged_iterations = 2;
+
+  Rigid3d cam_from_world(Eigen::Quaterniond::Identity(),
+                         Eigen::Vector3d(0, 0, 10));
+  BundleAdjustmentConvergenceCallback callback(
+      options,
+      {{cam_from_world.rotation.coeffs().data(),
+        cam_from_world.translation.data()}});
+
+  ceres::IterationSummary summary;
+  summary.iteration = 0;
+  summary.cost = 1;
+  EXPECT_EQ(callback(summary), ceres::SOLVER_CONTINUE);
+
+  // Large decrease of the cost.
+  summary.iteration = 1;
+  summary.step_is_successful = true;
+  summary.cost = 0.5;
+  summary.cost_change = 0.5;
+  EXPECT_EQ(callback(summary), ceres::SOLVER_CONTINUE);
+
+  // Small decrease of the cost but large update of the pose, where the
+  // translation tolerance is relative to the distance from the origin.
+  summary.iteration = 2;
+  summary.cost = 0.5;
+  summary.cost_change = 1e-6;
+  cam_from_world.translation.x() = 0.1;
+  EXPECT_EQ(callback(summary), ceres::SOLVER_CONTINUE);
+
+  summary.iteration = 3;
+  cam_from_world.translation.x() = 0.105;
+  EXPECT_EQ(callback(summary), ceres::SOLVER_CONTINUE);
+  EXPECT_FALSE(callback.Converged());
+
+  // Unsuccessful steps do not count as converged iterations.
+  summary.iteration = 4;
+  summary.step_is_successful = false;
+  EXPECT_EQ(callback(summary), ceres::SOLVER_CONTINUE);
+
+  summary.iteration = 5;
+  summary.step_is_successful = true;
+  EXPECT_EQ(callback(summary), ceres::SOLVER_TERMINATE_SUCCESSFULLY);
+  EXPECT_TRUE(callback.Converged());
+}
+
+TEST(BundleAdjustment, AdaptiveTermination) {
+  Reconstruction reconstruction;
+  GenerateReconstruction(3, 100, &reconstruction);
+
+  BundleAdjustmentConfig config;
+  config.AddImage(0);
+  config.AddImage(1);
+  config.AddImage(2);
+  config.SetConstantCamPose(0);
+  config.SetConstantCamPositions(1, {0});
+
+  BundleAdjustmentOptions options;
+  options.print_summary = false;
+  options.solver_options.max_num_iterations = 1000;
+  options.adaptive_termination = true;
+  options.SetStage(BundleAdjustmentOptions::Stage::LOCAL);
+  BundleAdjuster bundle_adjuster(options, config);
+  ASSERT_TRUE(bundle_adjuster.Solve(&reconstruction));
+
+  const auto& summary = bundle_adjuster.Summary();
+  EXPECT_NE(summary.termination_type, ceres::FAILURE);
+  EXPECT_LT(summary.iterations.size(), 1000);
+}
+
 }  // namespace
 }  // namespace colmap
@@ -34,9 +34,14 @@
 #include "colmap/geometry/pose.h"
 #include "colmap/image/line.h"
 #include "colmap/image/undistortion.h"
+#include "colmap/math/random.h"
 #include "colmap/optim/ransac.h"
 #include "colmap/util/logging.h"
 #include "colmap/util/misc.h"
+#include "colmap/util/threading.h"
+
+#include <algorithm>
+#include <future>
 
 namespace colmap {
 namespace {
@@ -142,6 +147,111 @@ Eigen::Vector3d FindBestConsensusAxis(const std::vector<Eigen::Vector3d>& axes,
   return best_axis;
 }
 
+// Complete the frame from its first two axes and project it to the closest
+// orthonormal frame.
+Eigen::Matrix3d OrthonormalizeFrame(Eigen::Matrix3d frame) {
+  frame.col(2) = frame.col(0).cross(frame.col(1));
+  Eigen::JacobiSVD<Eigen::Matrix3d> svd(
+      frame, Eigen::ComputeFullV | Eigen::ComputeFullU);
+  return svd.matrixU() * svd.matrixV().transpose();
+}
+
+struct VanishingPoints {
+  // The directions of the horizontal and vertical vanishing points in the
+  // camera frame, which are only valid for a positive number of inliers.
+  Eigen::Vector3d horizontal_axis = Eigen::Vector3d::Zero();
+  Eigen::Vector3d vertical_axis = Eigen::Vector3d::Zero();
+  size_t num_horizontal_inliers = 0;
+  size_t num_vertical_inliers = 0;
+};
+
+// Detect the horizontal and vertical vanishing points in the image undistorted
+// to at most `max_image_size`. The distorted image is downsampled before the
+// undistortion, such that the cost does not depend on the original image size.
+// Refractive cameras are undistorted from the original size, since their
+// projection tables are computed for it.
+VanishingPoints DetectVanishingPoints(
+    const ManhattanWorldFrameEstimationOptions& options,
+    const Bitmap& bitmap,
+    const Camera& camera,
+    const int max_image_size) {
+  UndistortCameraOptions undistortion_options;
+  undistortion_options.max_image_size = max_image_size;
+
+  Bitmap undistorted_bitmap;
+  Camera undistorted_camera;
+  const int image_size = std::max(bitmap.Width(), bitmap.Height());
+  if (image_size > max_image_size && !camera.IsCameraRefractive()) {
+    Camera downsampled_camera = camera;
+    downsampled_camera.Rescale(static_cast<double>(max_image_size) /
+                               image_size);
+    Bitmap downsampled_bitmap = bitmap.Clone();
+    downsampled_bitmap.Rescale(static_cast<int>(downsampled_camera.width),
+                               static_cast<int>(downsampled_camera.height));
+    UndistortImage(undistortion_options,
+                   downsampled_bitmap,
+                   downsampled_camera,
+                   &undistorted_bitmap,
+                   &undistorted_camera);
+  } else {
+    UndistortImage(undistortion_options,
+                   bitmap,
+                   camera,
+                   &undistorted_bitmap,
+                   &undistorted_camera);
+  }
+
+  const std::vector<LineSegment> line_segments =
+      DetectLineSegments(undistorted_bitmap, options.min_line_length);
+  const std::vector<LineSegmentOrientation> line_orientations =
+      ClassifyLineSegmentOrientations(line_segments,
+                                      options.line_orientation_tolerance);
+
+  std::vector<LineSegment> horizontal_line_segments;
+  std::vector<LineSegment> vertical_line_segments;
+  std::vector<Eigen::Vector3d> horizontal_lines;
+  std::vector<Eigen::Vector3d> vertical_lines;
+  for (size_t i = 0; i < line_segments.size(); ++i) {
+    const auto& line_segment = line_segments[i];
+    const Eigen::Vector3d line_segment_start = line_segment.start.homogeneous();
+    const Eigen::Vector3d line_segment_end = line_segment.end.homogeneous();
+    const Eigen::Vector3d line = line_segment_start.cross(line_segment_end);
+    if (line_orientations[i] == LineSegmentOrientation::HORIZONTAL) {
+      horizontal_line_segments.push_back(line_segment);
+      horizontal_lines.push_back(line);
+    } else if (line_orientations[i] == LineSegmentOrientation::VERTICAL) {
+      vertical_line_segments.push_back(line_segment);
+      vertical_lines.push_back(line);
+    }
+  }
+
+  RANSACOptions ransac_options;
+  ransac_options.max_error = options.max_line_vp_distance;
+  RANSAC<VanishingPointEstimator> ransac(ransac_options);
+  const auto horizontal_report =
+      ransac.Estimate(horizontal_line_segments, horizontal_lines);
+  const auto vertical_report =
+      ransac.Estimate(vertical_line_segments, vertical_lines);
+
+  const Eigen::Matrix3d inv_calib_matrix =
+      undistorted_camera.CalibrationMatrix().inverse();
+
+  VanishingPoints vanishing_points;
+  if (horizontal_report.success) {
+    vanishing_points.horizontal_axis =
+        (inv_calib_matrix * horizontal_report.model).normalized();
+    vanishing_points.num_horizontal_inliers =
+        horizontal_report.support.num_inliers;
+  }
+  if (vertical_report.success) {
+    vanishing_points.vertical_axis =
+        (inv_calib_matrix * vertical_report.model).normalized();
+    vanishing_points.num_vertical_inliers =
+        vertical_report.support.num_inliers;
+  }
+  return vanishing_points;
+}
+
 }  // namespace
 
 Eigen::Vector3d EstimateGravityVectorFromImageOrientation(
@@ -160,115 +270,116 @@ Eigen::Matrix3d EstimateManhattanWorldFrame(
     const ManhattanWorldFrameEstimationOptions& options,
     const Reconstruction& reconstruction,
     const std::string& image_path) {
-  std::vector<Eigen::Vector3d> rightward_axes;
-  std::vector<Eigen::Vector3d> downward_axes;
-  for (size_t i = 0; i < reconstruction.NumRegImages(); ++i) {
-    const auto image_id = reconstruction.RegImageIds()[i];
+  // Process the images in random order, such that the early termination does
+  // not only consider a part of the scene, if the images were taken in
+  // sequence.
+  std::vector<image_t> image_ids = reconstruction.RegImageIds();
+  Shuffle(static_cast<uint32_t>(image_ids.size()), &image_ids);
+
+  const bool refine = options.coarse_max_image_size > 0 &&
+                      options.coarse_max_image_size < options.max_image_size;
+  const auto detect_vanishing_points = [&](const image_t image_id) {
     const auto& image = reconstruction.Image(image_id);
     const auto& camera = reconstruction.Camera(image.CameraId());
-
-    PrintHeading1(StringPrintf("Processing image %s (%d / %d)",
-                               image.Name().c_str(),
-                               i + 1,
-                               reconstruction.NumRegImages()));
-
-    LOG(INFO) << "Reading image...";
-
-    colmap::Bitmap bitmap;
-    CHECK(bitmap.Read(colmap::JoinPaths(image_path, image.Name())));
-
-    LOG(INFO) << "Undistorting image...";
-
-    UndistortCameraOptions undistortion_options;
-    undistortion_options.max_image_size = options.max_image_size;
-
-    Bitmap undistorted_bitmap;
-    Camera undistorted_camera;
-    UndistortImage(undistortion_options,
-                   bitmap,
-                   camera,
-                   &undistorted_bitmap,
-                   &undistorted_camera);
-
-    LOG(INFO) << "Detecting lines...";
-
-    const std::vector<LineSegment> line_segments =
-        DetectLineSegments(undistorted_bitmap, options.min_line_length);
-    const std::vector<LineSegmentOrientation> line_orientations =
-        ClassifyLineSegmentOrientations(line_segments,
-                                        options.line_orientation_tolerance);
-
-    LOG(INFO) << StringPrintf(" %d", line_segments.size());
-
-    std::vector<LineSegment> horizontal_line_segments;
-    std::vector<LineSegment> vertical_line_segments;
-    std::vector<Eigen::Vector3d> horizontal_lines;
-    std::vector<Eigen::Vector3d> vertical_lines;
-    for (size_t i = 0; i < line_segments.size(); ++i) {
-      const auto& line_segment = line_segments[i];
-      const Eigen::Vector3d line_segment_start =
-          line_segment.start.homogeneous();
-      const Eigen::Vector3d line_segment_end = line_segment.end.homogeneous();
-      const Eigen::Vector3d line = line_segment_start.cross(line_segment_end);
-      if (line_orientations[i] == LineSegmentOrientation::HORIZONTAL) {
-        horizontal_line_segments.push_back(line_segment);
-        horizontal_lines.push_back(line);
-      } else if (line_orientations[i] == LineSegmentOrientation::VERTICAL) {
-        vertical_line_segments.push_back(line_segment);
-        vertical_lines.push_back(line);
+    Bitmap bitmap;
+    CHECK(bitmap.Read(JoinPaths(image_path, image.Name()), /*as_rgb=*/false));
+    if (refine) {
+      const VanishingPoints vanishing_points = DetectVanishingPoints(
+          options, bitmap, camera, options.coarse_max_image_size);
+      if (vanishing_points.num_horizontal_inliers >=
+              static_cast<size_t>(options.min_num_vp_inliers) &&
+          vanishing_points.num_vertical_inliers >=
+              static_cast<size_t>(options.min_num_vp_inliers)) {
+        return vanishing_points;
       }
     }
+    return DetectVanishingPoints(
+        options, bitmap, camera, options.max_image_size);
+  };
+
+  // Keep a bounded number of images in flight, such that the decoding of the
+  // next images overlaps with the composition of the axes and no work is
+  // wasted beyond the early termination.
+  std::vector<std::future<VanishingPoints>> futures(image_ids.size());
+  ThreadPool thread_pool(GetEffectiveNumThreads(options.num_threads));
+  const size_t num_prefetch = 2 * thread_pool.NumThreads();
+  for (size_t i = 0; i < std::min(num_prefetch, image_ids.size()); ++i) {
+    futures[i] = thread_pool.AddTask(detect_vanishing_points, image_ids[i]);
+  }
 
-    LOG(INFO) << StringPrintf(" (%d horizontal, %d vertical)",
-                              horizontal_lines.size(),
-                              vertical_lines.size());
-
-    LOG(INFO) << "Estimating vanishing points...";
-
-    RANSACOptions ransac_options;
-    ransac_options.max_error = options.max_line_vp_distance;
-    RANSAC<VanishingPointEstimator> ransac(ransac_options);
-    const auto horizontal_report =
-        ransac.Estimate(horizontal_line_segments, horizontal_lines);
-    const auto vertical_report =
-        ransac.Estimate(vertical_line_segments, vertical_lines);
-
-    LOG(INFO) << StringPrintf(" (%d horizontal inliers, %d vertical inliers)",
-                              horizontal_report.support.num_inliers,
-                              vertical_report.support.num_inliers);
+  std::vector<Eigen::Vector3d> rightward_axes;
+  std::vector<Eigen::Vector3d> downward_axes;
+  Eigen::Vector3d prev_rightward_axis = Eigen::Vector3d::Zero();
+  Eigen::Vector3d prev_downward_axis = Eigen::Vector3d::Zero();
+  size_t next_convergence_check =
+      static_cast<size_t>(std::max(options.min_num_images, 1));
+  for (size_t i = 0; i < image_ids.size(); ++i) {
+    const VanishingPoints vanishing_points = futures[i].get();
+    if (i + num_prefetch < image_ids.size()) {
+      futures[i + num_prefetch] = thread_pool.AddTask(
+          detect_vanishing_points, image_ids[i + num_prefetch]);
+    }
 
-    LOG(INFO) << "Composing coordinate axes...";
+    const auto& image = reconstruction.Image(image_ids[i]);
+    LOG(INFO) << StringPrintf(
+        "Processed image %s (%d / %d) with %d horizontal and %d vertical "
+        "inliers",
+        image.Name().c_str(),
+        i + 1,
+        image_ids.size(),
+        vanishing_points.num_horizontal_inliers,
+        vanishing_points.num_vertical_inliers);
 
-    const Eigen::Matrix3d inv_calib_matrix =
-        undistorted_camera.CalibrationMatrix().inverse();
     const Eigen::Quaterniond world_from_cam_rotation =
         image.CamFromWorld().rotation.inverse();
 
-    if (horizontal_report.success) {
+    if (vanishing_points.num_horizontal_inliers > 0) {
       Eigen::Vector3d horizontal_axis_in_world =
-          world_from_cam_rotation *
-          (inv_calib_matrix * horizontal_report.model).normalized();
+          world_from_cam_rotation * vanishing_points.horizontal_axis;
       // Make sure all axes point into the same direction.
       if (rightward_axes.size() > 0 &&
           rightward_axes[0].dot(horizontal_axis_in_world) < 0) {
         horizontal_axis_in_world = -horizontal_axis_in_world;
       }
       rightward_axes.push_back(horizontal_axis_in_world);
-      LOG(INFO) << "Horizontal: " << horizontal_axis_in_world.transpose();
     }
 
-    if (vertical_report.success) {
-      const Eigen::Vector3d vertical_axis_in_cam =
-          (inv_calib_matrix * vertical_report.model).normalized();
+    if (vanishing_points.num_vertical_inliers > 0) {
       Eigen::Vector3d vertical_axis_in_world =
-          (world_from_cam_rotation * vertical_axis_in_cam).normalized();
+          (world_from_cam_rotation * vanishing_points.vertical_axis)
+              .normalized();
       // Make sure axis points downwards in the image, assuming that the image
       // was taken in upright orientation.
       if (vertical_axis_in_world.dot(Eigen::Vector3d(0, 1, 0)) < 0) {
         vertical_axis_in_world = -vertical_axis_in_world;
       }
       downward_axes.push_back(vertical_axis_in_world);
-      LOG(INFO) << "Vertical: " << vertical_axis_in_world.transpose();
+    }
+
+    if (options.min_num_images <= 0 || i + 1 < next_convergence_check) {
+      continue;
+    }
+
+    next_convergence_check = i + 1 + (i + 1) / 4;
+    const Eigen::Vector3d rightward_axis =
+        FindBestConsensusAxis(rightward_axes, options.max_axis_distance)
+            .normalized();
+    const Eigen::Vector3d downward_axis =
+        FindBestConsensusAxis(downward_axes, options.max_axis_distance)
+            .normalized();
+    const bool converged =
+        !rightward_axes.empty() && !downward_axes.empty() &&
+        1 - rightward_axis.dot(prev_rightward_axis) <=
+            options.convergence_axis_distance &&
+        1 - downward_axis.dot(prev_downward_axis) <=
+            options.convergence_axis_distance;
+    prev_rightward_axis = rightward_axis;
+    prev_downward_axis = downward_axis;
+    if (converged) {
+      LOG(INFO) << StringPrintf("Axes converged after %d / %d images",
+                                i + 1,
+                                image_ids.size());
+      break;
     }
   }
 
@@ -291,12 +402,7 @@ Eigen::Matrix3d EstimateManhattanWorldFrame(
   LOG(INFO) << "Found downward axis: " << frame.col(1).transpose();
 
   if (rightward_axes.size() > 0 && downward_axes.size() > 0) {
-    frame.col(2) = frame.col(0).cross(frame.col(1));
-    Eigen::JacobiSVD<Eigen::Matrix3d> svd(
-        frame, Eigen::ComputeFullV | Eigen::ComputeFullU);
-    const Eigen::Matrix3d orthonormal_frame =
-        svd.matrixU() * Eigen::Matrix3d::Identity() * svd.matrixV().transpose();
-    frame = orthonormal_frame;
+    frame = OrthonormalizeFrame(frame);
   }
 
   LOG(INFO) << "Found orthonormal frame:\n" << frame;
@@ -304,6 +410,40 @@ Eigen::Matrix3d EstimateManhattanWorldFrame(
   return frame;
 }
 
+Eigen::Matrix3d EstimatePosePriorFrame(const Reconstruction& reconstruction,
+                                       const double max_axis_distance) {
+  // The prior world axes of every image, given by the columns of the rotation
+  // from the prior world to the world.
+  std::vector<Eigen::Vector3d> x_axes;
+  std::vector<Eigen::Vector3d> y_axes;
+  for (const auto image_id : reconstruction.RegImageIds()) {
+    const auto& image = reconstruction.Image(image_id);
+    const Eigen::Quaterniond& prior_from_prior_world_rotation =
+        image.CamFromWorldPrior().rotation;
+    if (!prior_from_prior_world_rotation.coeffs().array().isFinite().all()) {
+      continue;
+    }
+    const Eigen::Matrix3d world_from_prior_world =
+        (image.CamFromWorld().rotation.inverse() *
+         prior_from_prior_world_rotation.normalized())
+            .toRotationMatrix();
+    x_axes.push_back(world_from_prior_world.col(0));
+    y_axes.push_back(world_from_prior_world.col(1));
+  }
+
+  LOG(INFO) << StringPrintf("Found %d images with rotation prior",
+                            x_axes.size());
+
+  if (x_axes.empty()) {
+    return Eigen::Matrix3d::Zero();
+  }
+
+  Eigen::Matrix3d frame;
+  frame.col(0) = FindBestConsensusAxis(x_axes, max_axis_distance);
+  frame.col(1) = FindBestConsensusAxis(y_axes, max_axis_distance);
+  return OrthonormalizeFrame(frame);
+}
+
 void AlignToPrincipalPlane(Reconstruction* reconstruction, Sim3d* tform) {
   // Perform SVD on the 3D points to estimate the ground plane basis
   const Eigen::Vector3d centroid = reconstruction->ComputeCentroid(0.0, 1.0);
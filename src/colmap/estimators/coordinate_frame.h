@@ -47,6 +47,20 @@ struct ManhattanWorldFrameEstimationOptions {
   double max_line_vp_distance = 0.5;
   // The maximum cosine distance between estimated axes to be inliers.
   double max_axis_distance = 0.05;
+  // The maximum image size of the first, coarse line detection. Images whose
+  // vanishing points have fewer than `min_num_vp_inliers` line inliers at this
+  // size are detected again at `max_image_size`. Disabled if non-positive.
+  int coarse_max_image_size = 512;
+  int min_num_vp_inliers = 20;
+  // Stop processing further images once the consensus axes of at least
+  // `min_num_images` images changed by less than the cosine distance
+  // `convergence_axis_distance`, which is checked whenever the number of
+  // processed images grew by a quarter. Disabled if `min_num_images` is
+  // non-positive.
+  int min_num_images = 100;
+  double convergence_axis_distance = 1e-5;
+  // The number of threads to process images in parallel.
+  int num_threads = -1;
 };
 
 // Estimate gravity vector by assuming gravity-aligned image orientation, i.e.
@@ -62,12 +76,23 @@ Eigen::Vector3d EstimateGravityVectorFromImageOrientation(
 // estimated coordinate frame will be given in the columns of the returned
 // matrix. If one axis could not be determined, the respective column will be
 // zero. The axes are specified in the world coordinate system in the order
-// rightward, downward, forward.
+// rightward, downward, forward. The images are processed in parallel and in
+// random order, such that the estimation can terminate early for large
+// reconstructions once the axes converged.
 Eigen::Matrix3d EstimateManhattanWorldFrame(
     const ManhattanWorldFrameEstimationOptions& options,
     const Reconstruction& reconstruction,
     const std::string& image_path);
 
+// Estimate the coordinate frame of the pose priors of the images, e.g., given
+// by the navigation of a vehicle, from the consensus of the registered images
+// with a rotation prior without reading any images. The camera frame is
+// assumed to coincide with the prior frame. The axes of the prior world
+// coordinate system are given in the world coordinate system in the columns of
+// the returned matrix, which is zero if no image has a rotation prior.
+Eigen::Matrix3d EstimatePosePriorFrame(const Reconstruction& reconstruction,
+                                       double max_axis_distance = 0.05);
+
 // Aligns the reconstruction to the plane defined by running PCA on the 3D
 // points. The model centroid is at the origin of the new coordinate system
 // and the X axis is the first principal component with the Y axis being the
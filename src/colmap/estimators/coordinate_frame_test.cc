@@ -51,6 +51,37 @@ TEST(CoordinateFrame, EstimateManhattanWorldFrame) {
       Eigen::Matrix3d::Zero());
 }
 
+TEST(CoordinateFrame, EstimatePosePriorFrame) {
+  Reconstruction reconstruction;
+  EXPECT_EQ(EstimatePosePriorFrame(reconstruction), Eigen::Matrix3d::Zero());
+
+  const Eigen::Quaterniond world_from_prior_world(
+      Eigen::AngleAxisd(0.3, Eigen::Vector3d(1, 2, 3).normalized()));
+  for (image_t image_id = 1; image_id <= 5; ++image_id) {
+    Image image;
+    image.SetImageId(image_id);
+    image.SetRegistered(true);
+    image.CamFromWorld() = Rigid3d(
+        Eigen::Quaterniond(Eigen::AngleAxisd(0.1 * image_id,
+                                             Eigen::Vector3d::UnitY())),
+        Eigen::Vector3d(image_id, 0, 0));
+    if (image_id == 1) {
+      // Images without rotation prior are ignored.
+    } else if (image_id == 2) {
+      // Outlier rotation prior.
+      image.CamFromWorldPrior().rotation =
+          Eigen::Quaterniond(Eigen::AngleAxisd(1, Eigen::Vector3d::UnitX()));
+    } else {
+      image.CamFromWorldPrior().rotation =
+          image.CamFromWorld().rotation * world_from_prior_world;
+    }
+    reconstruction.AddImage(image);
+  }
+
+  EXPECT_TRUE(EstimatePosePriorFrame(reconstruction)
+                  .isApprox(world_from_prior_world.toRotationMatrix(), 1e-6));
+}
+
 TEST(CoordinateFrame, AlignToPrincipalPlane) {
   // Start with reconstruction containing points on the Y-Z plane and cameras
   // "above" the plane on the positive X axis. After alignment the points should
@@ -29,6 +29,7 @@
 
 #pragma once
 
+#include "colmap/geometry/pose.h"
 #include "colmap/geometry/rigid3.h"
 #include "colmap/sensor/ray3d.h"
 #include "colmap/util/eigen_alignment.h"
@@ -511,6 +512,216 @@ class RelativePoseError6DoFCostFunction {
   const Eigen::Matrix6d sqrt_information_;
 };
 
+// Same as `RelativePoseError6DoFCostFunction` with analytic instead of
+// automatic derivatives, which is considerably faster for large pose graphs.
+// The Jacobians w.r.t. the quaternions are only valid in their tangent space,
+// i.e., the quaternion parameters must use a quaternion manifold.
+class RelativePoseError6DoFAnalyticCostFunction
+    : public ceres::SizedCostFunction<6, 4, 3, 4, 3> {
+ public:
+  RelativePoseError6DoFAnalyticCostFunction(
+      const Rigid3d& cam2_from_cam1_measured,
+      const Eigen::Matrix6d& sqrt_information)
+      : cam2_from_cam1_measured_(cam2_from_cam1_measured),
+        sqrt_information_(sqrt_information) {}
+
+  static ceres::CostFunction* Create(const Rigid3d& cam2_from_cam1_measured,
+                                     const Eigen::Matrix6d& sqrt_information) {
+    return new RelativePoseError6DoFAnalyticCostFunction(
+        cam2_from_cam1_measured, sqrt_information);
+  }
+
+  bool Evaluate(double const* const* parameters,
+                double* residuals,
+                double** jacobians) const override {
+    const Eigen::Map<const Eigen::Quaterniond> cam1_from_world_rotation(
+        parameters[0]);
+    const Eigen::Map<const Eigen::Vector3d> cam1_from_world_translation(
+        parameters[1]);
+    const Eigen::Map<const Eigen::Quaterniond> cam2_from_world_rotation(
+        parameters[2]);
+    const Eigen::Map<const Eigen::Vector3d> cam2_from_world_translation(
+        parameters[3]);
+
+    // For unit quaternions, the residuals are identical to the ones of
+    // `RelativePoseError6DoFCostFunction` but expressed in a form with simpler
+    // derivatives, using measured_from_estimated * cam2_from_cam1 = measured.
+    const Eigen::Quaterniond cam1_from_cam2_rotation =
+        cam1_from_world_rotation * cam2_from_world_rotation.conjugate();
+    const Eigen::Quaterniond measured_from_estimated_rotation =
+        cam2_from_cam1_measured_.rotation * cam1_from_cam2_rotation;
+    const Eigen::Vector3d rotated_cam2_from_world_translation =
+        measured_from_estimated_rotation * cam2_from_world_translation;
+
+    Eigen::Map<Eigen::Vector6d> residuals_map(residuals);
+    residuals_map.head<3>() = 2.0 * measured_from_estimated_rotation.vec();
+    residuals_map.tail<3>() =
+        cam2_from_cam1_measured_.translation +
+        cam2_from_cam1_measured_.rotation * cam1_from_world_translation -
+        rotated_cam2_from_world_translation;
+    residuals_map.applyOnTheLeft(sqrt_information_);
+
+    if (jacobians == nullptr) {
+      return true;
+    }
+
+    // Derivative of the rotated vector w.r.t. the quaternion coefficients.
+    const Eigen::Vector3d& vec = cam2_from_world_translation;
+    const Eigen::Vector3d quat_vec = measured_from_estimated_rotation.vec();
+    const double quat_w = measured_from_estimated_rotation.w();
+    Eigen::Matrix<double, 3, 4> d_rotated_d_quat;
+    d_rotated_d_quat.leftCols<3>() =
+        -2.0 * quat_w * CrossProductMatrix(vec) +
+        2.0 * (quat_vec * vec.transpose() +
+               quat_vec.dot(vec) * Eigen::Matrix3d::Identity() -
+               2.0 * vec * quat_vec.transpose());
+    d_rotated_d_quat.col(3) = 2.0 * quat_vec.cross(vec);
+
+    auto SetRotationJacobian = [&](const Eigen::Matrix4d& d_quat_d_param,
+                                   double* jacobian) {
+      Eigen::Map<Eigen::Matrix<double, 6, 4, Eigen::RowMajor>> jacobian_map(
+          jacobian);
+      jacobian_map.topRows<3>() = 2.0 * d_quat_d_param.topRows<3>();
+      jacobian_map.bottomRows<3>() = -d_rotated_d_quat * d_quat_d_param;
+      jacobian_map.applyOnTheLeft(sqrt_information_);
+    };
+
+    if (jacobians[0] != nullptr) {
+      SetRotationJacobian(
+          LeftQuaternionProductMatrix(cam2_from_cam1_measured_.rotation) *
+              RightQuaternionProductMatrix(
+                  cam2_from_world_rotation.conjugate()),
+          jacobians[0]);
+    }
+
+    if (jacobians[1] != nullptr) {
+      Eigen::Map<Eigen::Matrix<double, 6, 3, Eigen::RowMajor>> jacobian_map(
+          jacobians[1]);
+      jacobian_map.topRows<3>().setZero();
+      jacobian_map.bottomRows<3>() =
+          cam2_from_cam1_measured_.rotation.toRotationMatrix();
+      jacobian_map.applyOnTheLeft(sqrt_information_);
+    }
+
+    if (jacobians[2] != nullptr) {
+      const Eigen::Vector4d conjugate_sign(-1, -1, -1, 1);
+      SetRotationJacobian(
+          LeftQuaternionProductMatrix(cam2_from_cam1_measured_.rotation *
+                                      cam1_from_world_rotation) *
+              conjugate_sign.asDiagonal(),
+          jacobians[2]);
+    }
+
+    if (jacobians[3] != nullptr) {
+      Eigen::Map<Eigen::Matrix<double, 6, 3, Eigen::RowMajor>> jacobian_map(
+          jacobians[3]);
+      jacobian_map.topRows<3>().setZero();
+      jacobian_map.bottomRows<3>() =
+          -measured_from_estimated_rotation.toRotationMatrix();
+      jacobian_map.applyOnTheLeft(sqrt_information_);
+    }
+
+    return true;
+  }
+
+ private:
+  // Matrices of the quaternion products lhs * rhs as linear functions of rhs
+  // and lhs, respectively, in Eigen's (x, y, z, w) coefficient order.
+  static Eigen::Matrix4d LeftQuaternionProductMatrix(
+      const Eigen::Quaterniond& lhs) {
+    Eigen::Matrix4d matrix;
+    matrix.topLeftCorner<3, 3>() =
+        lhs.w() * Eigen::Matrix3d::Identity() + CrossProductMatrix(lhs.vec());
+    matrix.topRightCorner<3, 1>() = lhs.vec();
+    matrix.bottomLeftCorner<1, 3>() = -lhs.vec().transpose();
+    matrix(3, 3) = lhs.w();
+    return matrix;
+  }
+
+  static Eigen::Matrix4d RightQuaternionProductMatrix(
+      const Eigen::Quaterniond& rhs) {
+    Eigen::Matrix4d matrix;
+    matrix.topLeftCorner<3, 3>() =
+        rhs.w() * Eigen::Matrix3d::Identity() - CrossProductMatrix(rhs.vec());
+    matrix.topRightCorner<3, 1>() = rhs.vec();
+    matrix.bottomLeftCorner<1, 3>() = -rhs.vec().transpose();
+    matrix(3, 3) = rhs.w();
+    return matrix;
+  }
+
+  const Rigid3d cam2_from_cam1_measured_;
+  const Eigen::Matrix6d sqrt_information_;
+};
+
+// Cost function for the relative rotation of two cameras in rotation
+// averaging. The residual is the angle-axis vector of the rotation error for
+// small errors.
+class RelativeRotationErrorCostFunction {
+ public:
+  explicit RelativeRotationErrorCostFunction(
+      const Eigen::Quaterniond& cam2_from_cam1_measured)
+      : cam2_from_cam1_measured_(cam2_from_cam1_measured) {}
+
+  static ceres::CostFunction* Create(
+      const Eigen::Quaterniond& cam2_from_cam1_measured) {
+    return new ceres::
+        AutoDiffCostFunction<RelativeRotationErrorCostFunction, 3, 4, 4>(
+            new RelativeRotationErrorCostFunction(cam2_from_cam1_measured));
+  }
+
+  template <typename T>
+  bool operator()(const T* const cam1_from_world_rotation,
+                  const T* const cam2_from_world_rotation,
+                  T* residuals) const {
+    const Eigen::Quaternion<T> measured_from_estimated_rotation =
+        cam2_from_cam1_measured_.cast<T>() *
+        EigenQuaternionMap<T>(cam1_from_world_rotation) *
+        EigenQuaternionMap<T>(cam2_from_world_rotation).inverse();
+    Eigen::Map<Eigen::Matrix<T, 3, 1>> residuals_map(residuals);
+    residuals_map = T(2.0) * measured_from_estimated_rotation.vec();
+    return true;
+  }
+
+ private:
+  const Eigen::Quaterniond cam2_from_cam1_measured_;
+};
+
+// Cost function for the relative translation of two cameras in translation
+// averaging, as in "Robust Camera Location Estimation by Convex Programming"
+// (Ozyesil and Singer, CVPR 2015). Given the measured unit direction from the
+// projection center of camera 1 to the one of camera 2 in the world frame, the
+// residual is the difference of the baseline and the scaled direction. The
+// scale is a parameter, which must be bounded from below or kept constant to
+// avoid the trivial solution of coinciding projection centers.
+class RelativeTranslationErrorCostFunction {
+ public:
+  explicit RelativeTranslationErrorCostFunction(
+      const Eigen::Vector3d& direction_measured)
+      : direction_measured_(direction_measured) {}
+
+  static ceres::CostFunction* Create(
+      const Eigen::Vector3d& direction_measured) {
+    return new ceres::
+        AutoDiffCostFunction<RelativeTranslationErrorCostFunction, 3, 3, 3, 1>(
+            new RelativeTranslationErrorCostFunction(direction_measured));
+  }
+
+  template <typename T>
+  bool operator()(const T* const proj_center1,
+                  const T* const proj_center2,
+                  const T* const scale,
+                  T* residuals) const {
+    Eigen::Map<Eigen::Matrix<T, 3, 1>> residuals_map(residuals);
+    residuals_map = EigenVector3Map<T>(proj_center2) -
+                    EigenVector3Map<T>(proj_center1) -
+                    scale[0] * direction_measured_.cast<T>();
+    return true;
+  }
+
+ private:
+  const Eigen::Vector3d direction_measured_;
+};
+
 // Cost function for smooth motion constraint.
 class SmoothMotionCostFunction {
  public:
@@ -649,6 +860,187 @@ class ReprojErrorRefracCostFunction {
   const double observed_y_;
 };
 
+// Same as `ReprojErrorRefracCostFunction` with mixed-precision analytic
+// instead of automatic derivatives. The back-projection through the camera
+// model and the projection into the virtual camera are evaluated in double
+// precision, whereas the tracing of the ray through the refractive interface
+// and the intersection with the refraction axis, which dominate the cost of the
+// evaluation, are differentiated in single precision w.r.t. the direction of
+// the back-projected ray and the refractive parameters. The residuals and the
+// Jacobians are accumulated in double precision by the chain rule. The
+// Jacobian w.r.t. the quaternion assumes a unit quaternion.
+template <typename CameraRefracModel, typename CameraModel>
+class ReprojErrorRefracMixedPrecisionCostFunction
+    : public ceres::SizedCostFunction<2,
+                                      4,
+                                      3,
+                                      3,
+                                      CameraModel::num_params,
+                                      CameraRefracModel::num_params> {
+ public:
+  explicit ReprojErrorRefracMixedPrecisionCostFunction(
+      const Eigen::Vector2d& point2D)
+      : observed_x_(point2D(0)), observed_y_(point2D(1)) {}
+
+  static ceres::CostFunction* Create(const Eigen::Vector2d& point2D) {
+    return new ReprojErrorRefracMixedPrecisionCostFunction(point2D);
+  }
+
+  bool Evaluate(double const* const* parameters,
+                double* residuals,
+                double** jacobians) const override {
+    constexpr int kNumCamParams = CameraModel::num_params;
+    constexpr int kNumRefracParams = CameraRefracModel::num_params;
+    typedef ceres::Jet<double, kNumCamParams> CamJet;
+    typedef ceres::Jet<float, 3 + kNumRefracParams> RayJet;
+
+    const EigenQuaternionMap<double> cam_from_world_rotation(parameters[0]);
+    const EigenVector3Map<double> cam_from_world_translation(parameters[1]);
+    const EigenVector3Map<double> point3D(parameters[2]);
+    const double* camera_params = parameters[3];
+    const double* refrac_params = parameters[4];
+
+    // Back-project the observation in double precision.
+    CamJet camera_params_jet[kNumCamParams];
+    for (int i = 0; i < kNumCamParams; ++i) {
+      camera_params_jet[i] = CamJet(camera_params[i], i);
+    }
+    Eigen::Matrix<CamJet, 3, 1> cam_dir;
+    CameraModel::CamFromImg(camera_params_jet,
+                            CamJet(observed_x_),
+                            CamJet(observed_y_),
+                            &cam_dir(0),
+                            &cam_dir(1),
+                            &cam_dir(2));
+    cam_dir.normalize();
+
+    // Trace the ray through the interface in single precision.
+    Eigen::Matrix<RayJet, 3, 1> ray_ori = Eigen::Matrix<RayJet, 3, 1>::Zero();
+    Eigen::Matrix<RayJet, 3, 1> ray_dir;
+    for (int i = 0; i < 3; ++i) {
+      ray_dir(i) = RayJet(static_cast<float>(cam_dir(i).a), i);
+    }
+    RayJet refrac_params_jet[kNumRefracParams];
+    for (int i = 0; i < kNumRefracParams; ++i) {
+      refrac_params_jet[i] =
+          RayJet(static_cast<float>(refrac_params[i]), 3 + i);
+    }
+    CameraRefracModel::RefractRay(refrac_params_jet, &ray_ori, &ray_dir);
+
+    Eigen::Matrix<RayJet, 3, 1> refrac_axis;
+    CameraRefracModel::RefractionAxis(refrac_params_jet, &refrac_axis);
+
+    // The refracted ray and the refraction axis are coplanar by construction,
+    // such that the distance of their closest points only reflects the
+    // rounding errors of the single precision evaluation.
+    Eigen::Matrix<RayJet, 3, 1> virtual_cam_center;
+    IntersectLinesWithTolerance<RayJet>(
+        Eigen::Matrix<RayJet, 3, 1>::Zero(),
+        -refrac_axis,
+        ray_ori,
+        -ray_dir,
+        virtual_cam_center,
+        RayJet(std::numeric_limits<float>::max()));
+    const Eigen::Matrix<RayJet, 2, 1> cam_point = ray_dir.hnormalized();
+
+    // Values and Jacobian of the virtual camera center and the normalized
+    // image coordinates of the refracted ray w.r.t. the direction of the
+    // back-projected ray and the refractive parameters.
+    Eigen::Matrix<double, 5, 1> ray;
+    Eigen::Matrix<double, 5, 3 + kNumRefracParams> ray_jacobian;
+    for (int i = 0; i < 3; ++i) {
+      ray(i) = virtual_cam_center(i).a;
+      ray_jacobian.row(i) =
+          virtual_cam_center(i).v.template cast<double>().transpose();
+    }
+    for (int i = 0; i < 2; ++i) {
+      ray(3 + i) = cam_point(i).a;
+      ray_jacobian.row(3 + i) =
+          cam_point(i).v.template cast<double>().transpose();
+    }
+
+    // Project into the virtual camera in double precision.
+    const Eigen::Vector3d point3D_in_cam =
+        cam_from_world_rotation * point3D + cam_from_world_translation;
+    const Eigen::Vector3d point3D_in_virtual =
+        point3D_in_cam - ray.head<3>();
+    const double f = camera_params[0];
+    const double inv_z = 1.0 / point3D_in_virtual(2);
+    const Eigen::Vector2d projection = point3D_in_virtual.head<2>() * inv_z;
+    const Eigen::Vector2d normalized_residuals = projection - ray.tail<2>();
+    Eigen::Map<Eigen::Vector2d> residuals_map(residuals);
+    residuals_map = f * normalized_residuals;
+
+    if (jacobians == nullptr) {
+      return true;
+    }
+
+    const double f_inv_z = f * inv_z;
+    Eigen::Matrix<double, 2, 3> d_residuals_d_point;
+    d_residuals_d_point << f_inv_z, 0, -f_inv_z * projection(0), 0, f_inv_z,
+        -f_inv_z * projection(1);
+
+    if (jacobians[0] != nullptr) {
+      // Derivative of the rotated point w.r.t. the quaternion coefficients.
+      const Eigen::Vector3d quat_vec = cam_from_world_rotation.vec();
+      const double quat_w = cam_from_world_rotation.w();
+      Eigen::Matrix<double, 3, 4> d_rotated_d_quat;
+      d_rotated_d_quat.leftCols<3>() =
+          -2.0 * quat_w * CrossProductMatrix(point3D) +
+          2.0 * (quat_vec * point3D.transpose() +
+                 quat_vec.dot(point3D) * Eigen::Matrix3d::Identity() -
+                 2.0 * point3D * quat_vec.transpose());
+      d_rotated_d_quat.col(3) = 2.0 * quat_vec.cross(point3D);
+      Eigen::Map<Eigen::Matrix<double, 2, 4, Eigen::RowMajor>> jacobian_map(
+          jacobians[0]);
+      jacobian_map = d_residuals_d_point * d_rotated_d_quat;
+    }
+
+    if (jacobians[1] != nullptr) {
+      Eigen::Map<Eigen::Matrix<double, 2, 3, Eigen::RowMajor>> jacobian_map(
+          jacobians[1]);
+      jacobian_map = d_residuals_d_point;
+    }
+
+    if (jacobians[2] != nullptr) {
+      Eigen::Map<Eigen::Matrix<double, 2, 3, Eigen::RowMajor>> jacobian_map(
+          jacobians[2]);
+      jacobian_map =
+          d_residuals_d_point * cam_from_world_rotation.toRotationMatrix();
+    }
+
+    Eigen::Matrix<double, 2, 5> d_residuals_d_ray;
+    d_residuals_d_ray.leftCols<3>() = -d_residuals_d_point;
+    d_residuals_d_ray.rightCols<2>() = -f * Eigen::Matrix2d::Identity();
+
+    if (jacobians[3] != nullptr) {
+      Eigen::Matrix<double, 3, kNumCamParams> d_cam_dir_d_params;
+      for (int i = 0; i < 3; ++i) {
+        d_cam_dir_d_params.row(i) = cam_dir(i).v.transpose();
+      }
+      Eigen::Map<Eigen::Matrix<double, 2, kNumCamParams, Eigen::RowMajor>>
+          jacobian_map(jacobians[3]);
+      jacobian_map = d_residuals_d_ray * ray_jacobian.template leftCols<3>() *
+                     d_cam_dir_d_params;
+      // The focal length additionally scales the residuals.
+      jacobian_map.col(0) += normalized_residuals;
+    }
+
+    if (jacobians[4] != nullptr) {
+      Eigen::Map<Eigen::Matrix<double, 2, kNumRefracParams, Eigen::RowMajor>>
+          jacobian_map(jacobians[4]);
+      jacobian_map =
+          d_residuals_d_ray * ray_jacobian.template rightCols<kNumRefracParams>();
+    }
+
+    return true;
+  }
+
+ private:
+  const double observed_x_;
+  const double observed_y_;
+};
+
 // Refractive Bundle adjustment cost function for variable
 // camera calibration and point parameters, and fixed camera pose.
 template <typename CameraRefracModel, typename CameraModel>
@@ -731,6 +1123,213 @@ class ReprojErrorRefracConstantPoseCostFunction {
   const double observed_y_;
 };
 
+// Refractive bundle adjustment cost function for variable camera pose and
+// point parameters, and fixed camera calibration and refractive parameters.
+//
+// With fixed parameters, the refracted ray of the observation is constant. The
+// ray is therefore traced through the interface only once and the residual
+// reduces to the reprojection error in the virtual pinhole camera, which is
+// centered at `virtual_cam_center` and observes the ray with the normalized
+// image coordinates `cam_point`. The residuals are identical to the ones of
+// `ReprojErrorRefracCostFunction` for the same fixed parameters.
+class ReprojErrorRefracConstantCameraCostFunction {
+ public:
+  ReprojErrorRefracConstantCameraCostFunction(
+      const Eigen::Vector3d& virtual_cam_center,
+      const Eigen::Vector2d& cam_point,
+      const double focal_length)
+      : virtual_cam_center_x_(virtual_cam_center(0)),
+        virtual_cam_center_y_(virtual_cam_center(1)),
+        virtual_cam_center_z_(virtual_cam_center(2)),
+        cam_point_x_(cam_point(0)),
+        cam_point_y_(cam_point(1)),
+        focal_length_(focal_length) {}
+
+  static ceres::CostFunction* Create(const Eigen::Vector3d& virtual_cam_center,
+                                     const Eigen::Vector2d& cam_point,
+                                     const double focal_length) {
+    return (new ceres::AutoDiffCostFunction<
+            ReprojErrorRefracConstantCameraCostFunction,
+            2,
+            4,
+            3,
+            3>(new ReprojErrorRefracConstantCameraCostFunction(
+        virtual_cam_center, cam_point, focal_length)));
+  }
+
+  template <typename T>
+  bool operator()(const T* const cam_from_world_rotation,
+                  const T* const cam_from_world_translation,
+                  const T* const point3D,
+                  T* residuals) const {
+    const Eigen::Matrix<T, 3, 1> point3D_in_virtual =
+        EigenQuaternionMap<T>(cam_from_world_rotation) *
+            EigenVector3Map<T>(point3D) +
+        EigenVector3Map<T>(cam_from_world_translation) -
+        Eigen::Matrix<T, 3, 1>(T(virtual_cam_center_x_),
+                               T(virtual_cam_center_y_),
+                               T(virtual_cam_center_z_));
+    residuals[0] =
+        T(focal_length_) *
+        (point3D_in_virtual[0] / point3D_in_virtual[2] - T(cam_point_x_));
+    residuals[1] =
+        T(focal_length_) *
+        (point3D_in_virtual[1] / point3D_in_virtual[2] - T(cam_point_y_));
+    return true;
+  }
+
+ private:
+  const double virtual_cam_center_x_;
+  const double virtual_cam_center_y_;
+  const double virtual_cam_center_z_;
+  const double cam_point_x_;
+  const double cam_point_y_;
+  const double focal_length_;
+};
+
+// Refractive bundle adjustment cost function for variable point parameters,
+// and fixed camera pose, calibration and refractive parameters. See
+// `ReprojErrorRefracConstantCameraCostFunction` for details.
+class ReprojErrorRefracConstantPoseCameraCostFunction {
+ public:
+  ReprojErrorRefracConstantPoseCameraCostFunction(
+      const Rigid3d& cam_from_world,
+      const Eigen::Vector3d& virtual_cam_center,
+      const Eigen::Vector2d& cam_point,
+      const double focal_length)
+      : cam_from_world_(cam_from_world),
+        virtual_cam_center_x_(virtual_cam_center(0)),
+        virtual_cam_center_y_(virtual_cam_center(1)),
+        virtual_cam_center_z_(virtual_cam_center(2)),
+        cam_point_x_(cam_point(0)),
+        cam_point_y_(cam_point(1)),
+        focal_length_(focal_length) {}
+
+  static ceres::CostFunction* Create(const Rigid3d& cam_from_world,
+                                     const Eigen::Vector3d& virtual_cam_center,
+                                     const Eigen::Vector2d& cam_point,
+                                     const double focal_length) {
+    return (new ceres::AutoDiffCostFunction<
+            ReprojErrorRefracConstantPoseCameraCostFunction,
+            2,
+            3>(new ReprojErrorRefracConstantPoseCameraCostFunction(
+        cam_from_world, virtual_cam_center, cam_point, focal_length)));
+  }
+
+  template <typename T>
+  bool operator()(const T* const point3D, T* residuals) const {
+    const Eigen::Matrix<T, 3, 1> point3D_in_virtual =
+        cam_from_world_.rotation.cast<T>() * EigenVector3Map<T>(point3D) +
+        cam_from_world_.translation.cast<T>() -
+        Eigen::Matrix<T, 3, 1>(T(virtual_cam_center_x_),
+                               T(virtual_cam_center_y_),
+                               T(virtual_cam_center_z_));
+    residuals[0] =
+        T(focal_length_) *
+        (point3D_in_virtual[0] / point3D_in_virtual[2] - T(cam_point_x_));
+    residuals[1] =
+        T(focal_length_) *
+        (point3D_in_virtual[1] / point3D_in_virtual[2] - T(cam_point_y_));
+    return true;
+  }
+
+ private:
+  const Rigid3d& cam_from_world_;
+  const double virtual_cam_center_x_;
+  const double virtual_cam_center_y_;
+  const double virtual_cam_center_z_;
+  const double cam_point_x_;
+  const double cam_point_y_;
+  const double focal_length_;
+};
+
+// Refractive rig bundle adjustment cost function for variable camera pose,
+// calibration, refractive, and point parameters. Analogous to
+// `RigReprojErrorCostFunction`, the point is first transformed into the local
+// system of the camera rig and then into the local system of the camera within
+// the rig, before it is projected through the refractive interface of the
+// camera as in `ReprojErrorRefracCostFunction`.
+template <typename CameraRefracModel, typename CameraModel>
+class RigReprojErrorRefracCostFunction {
+ public:
+  explicit RigReprojErrorRefracCostFunction(const Eigen::Vector2d& point2D)
+      : observed_x_(point2D(0)), observed_y_(point2D(1)) {}
+
+  static ceres::CostFunction* Create(const Eigen::Vector2d& point2D) {
+    return (new ceres::AutoDiffCostFunction<
+            RigReprojErrorRefracCostFunction<CameraRefracModel, CameraModel>,
+            2,
+            4,
+            3,
+            4,
+            3,
+            3,
+            CameraModel::num_params,
+            CameraRefracModel::num_params>(
+        new RigReprojErrorRefracCostFunction(point2D)));
+  }
+
+  template <typename T>
+  bool operator()(const T* const cam_from_rig_rotation,
+                  const T* const cam_from_rig_translation,
+                  const T* const rig_from_world_rotation,
+                  const T* const rig_from_world_translation,
+                  const T* const point3D,
+                  const T* const camera_params,
+                  const T* const refrac_params,
+                  T* residuals) const {
+    const Eigen::Matrix<T, 3, 1> point3D_in_cam =
+        EigenQuaternionMap<T>(cam_from_rig_rotation) *
+            (EigenQuaternionMap<T>(rig_from_world_rotation) *
+                 EigenVector3Map<T>(point3D) +
+             EigenVector3Map<T>(rig_from_world_translation)) +
+        EigenVector3Map<T>(cam_from_rig_translation);
+
+    // Compute the refracted ray.
+    Eigen::Matrix<T, 3, 1> ray_ori;
+    Eigen::Matrix<T, 3, 1> ray_dir;
+    CameraRefracModel::template CamFromImg<CameraModel, T>(camera_params,
+                                                           refrac_params,
+                                                           T(observed_x_),
+                                                           T(observed_y_),
+                                                           &ray_ori,
+                                                           &ray_dir);
+
+    // The virtual camera is centered on the refraction axis, where it is
+    // intersected by the refracted ray, and has the same orientation as the
+    // real camera.
+    Eigen::Matrix<T, 3, 1> refrac_axis;
+    CameraRefracModel::RefractionAxis(refrac_params, &refrac_axis);
+
+    Eigen::Matrix<T, 3, 1> virtual_cam_center;
+    IntersectLinesWithTolerance<T>(Eigen::Matrix<T, 3, 1>::Zero(),
+                                   -refrac_axis,
+                                   ray_ori,
+                                   -ray_dir,
+                                   virtual_cam_center);
+
+    const Eigen::Matrix<T, 2, 1> cam_point = ray_dir.hnormalized();
+
+    const T f = camera_params[0];
+    const T c1 = T(observed_x_) - f * cam_point[0];
+    const T c2 = T(observed_y_) - f * cam_point[1];
+
+    // Finally, do simple pinhole projection.
+    const Eigen::Matrix<T, 3, 1> point3D_in_virtual =
+        point3D_in_cam - virtual_cam_center;
+
+    residuals[0] = f * point3D_in_virtual[0] / point3D_in_virtual[2] + c1;
+    residuals[1] = f * point3D_in_virtual[1] / point3D_in_virtual[2] + c2;
+    residuals[0] -= T(observed_x_);
+    residuals[1] -= T(observed_y_);
+    return true;
+  }
+
+ private:
+  const double observed_x_;
+  const double observed_y_;
+};
+
 // Cost function for refining generalized relative pose based on the
 // Sampson-Error.
 //
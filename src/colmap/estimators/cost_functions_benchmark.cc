@@ -0,0 +1,102 @@
+#include "colmap/estimators/cost_functions.h"
+#include "colmap/sensor/models.h"
+#include "colmap/sensor/models_refrac.h"
+
+#include <memory>
+#include <type_traits>
+
+#include <benchmark/benchmark.h>
+
+namespace colmap {
+namespace {
+
+const std::vector<double> kCameraParams = {
+    1500, 1510, 1000, 750, 0.01, -0.01, 0.001, 0.001};
+const std::vector<double> kFlatPortParams = {
+    0.0099975, -0.019995, 0.99975009, 0.05, 0.007, 1.003, 1.473, 1.333};
+const std::vector<double> kDomePortParams = {
+    0.00042007, 0.00366894, 0.0283927, 0.05, 0.007, 1.003, 1.473, 1.333};
+
+// Evaluate the cost function for the residuals only (arg = 0) or also for the
+// Jacobians w.r.t. all parameter blocks (arg = 1).
+void EvaluateCostFunction(benchmark::State& state,
+                          const ceres::CostFunction& cost_function,
+                          const std::vector<double>& camera_params,
+                          const std::vector<double>& refrac_params) {
+  const Eigen::Quaterniond cam_from_world_rotation(
+      Eigen::AngleAxisd(0.1, Eigen::Vector3d(1, -1, 2).normalized()));
+  const Eigen::Vector3d cam_from_world_translation(0.1, -0.2, 0.3);
+  const Eigen::Vector3d point3D(-0.5, -0.3, 2);
+  const double* parameters[5] = {cam_from_world_rotation.coeffs().data(),
+                                 cam_from_world_translation.data(),
+                                 point3D.data(),
+                                 camera_params.data(),
+                                 refrac_params.data()};
+
+  const std::vector<int32_t>& parameter_block_sizes =
+      cost_function.parameter_block_sizes();
+  std::vector<std::vector<double>> jacobians;
+  std::vector<double*> jacobian_ptrs;
+  for (const int32_t parameter_block_size : parameter_block_sizes) {
+    jacobians.emplace_back(2 * parameter_block_size);
+  }
+  for (auto& jacobian : jacobians) {
+    jacobian_ptrs.push_back(jacobian.data());
+  }
+
+  double residuals[2];
+  const bool compute_jacobians = state.range(0) != 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(cost_function.Evaluate(
+        parameters,
+        residuals,
+        compute_jacobians ? jacobian_ptrs.data() : nullptr));
+    benchmark::ClobberMemory();
+  }
+}
+
+void BM_ReprojErrorCostFunction(benchmark::State& state) {
+  const std::unique_ptr<ceres::CostFunction> cost_function(
+      ReprojErrorCostFunction<OpenCVCameraModel>::Create(
+          Eigen::Vector2d(300, 200)));
+  EvaluateCostFunction(state, *cost_function, kCameraParams, {});
+}
+BENCHMARK(BM_ReprojErrorCostFunction)->Arg(0)->Arg(1);
+
+template <typename CameraRefracModel>
+void BM_ReprojErrorRefracCostFunction(benchmark::State& state) {
+  const std::unique_ptr<ceres::CostFunction> cost_function(
+      ReprojErrorRefracCostFunction<CameraRefracModel, OpenCVCameraModel>::
+          Create(Eigen::Vector2d(300, 200)));
+  EvaluateCostFunction(state,
+                       *cost_function,
+                       kCameraParams,
+                       std::is_same<CameraRefracModel, FlatPort>::value
+                           ? kFlatPortParams
+                           : kDomePortParams);
+}
+BENCHMARK_TEMPLATE(BM_ReprojErrorRefracCostFunction, FlatPort)->Arg(0)->Arg(1);
+BENCHMARK_TEMPLATE(BM_ReprojErrorRefracCostFunction, DomePort)->Arg(0)->Arg(1);
+
+template <typename CameraRefracModel>
+void BM_ReprojErrorRefracMixedPrecisionCostFunction(benchmark::State& state) {
+  const std::unique_ptr<ceres::CostFunction> cost_function(
+      ReprojErrorRefracMixedPrecisionCostFunction<CameraRefracModel,
+                                                  OpenCVCameraModel>::
+          Create(Eigen::Vector2d(300, 200)));
+  EvaluateCostFunction(state,
+                       *cost_function,
+                       kCameraParams,
+                       std::is_same<CameraRefracModel, FlatPort>::value
+                           ? kFlatPortParams
+                           : kDomePortParams);
+}
+BENCHMARK_TEMPLATE(BM_ReprojErrorRefracMixedPrecisionCostFunction, FlatPort)
+    ->Arg(0)
+    ->Arg(1);
+BENCHMARK_TEMPLATE(BM_ReprojErrorRefracMixedPrecisionCostFunction, DomePort)
+    ->Arg(0)
+    ->Arg(1);
+
+}  // namespace
+}  // namespace colmap
@@ -30,7 +30,9 @@
 #include "colmap/estimators/cost_functions.h"
 
 #include "colmap/geometry/pose.h"
+#include "colmap/scene/camera.h"
 #include "colmap/sensor/models.h"
+#include "colmap/sensor/models_refrac.h"
 
 #include <gtest/gtest.h>
 
@@ -211,5 +213,329 @@ TEST(BundleAdjustment, RelativePose) {
   EXPECT_EQ(residuals[0], 0.5);
 }
 
+TEST(BundleAdjustment, RefracConstantCameraAbsolutePose) {
+  Camera camera =
+      Camera::CreateFromModelName(1, "SIMPLE_PINHOLE", 1000.0, 1000, 800);
+  camera.refrac_model_id = FlatPort::refrac_model_id;
+  camera.refrac_params = {0.1, 0.05, 0.99, 0.05, 0.007, 1.0, 1.52, 1.33};
+  Eigen::Map<Eigen::Vector3d>(camera.refrac_params.data()).normalize();
+
+  const Eigen::Vector2d point2D(300, 200);
+  const Ray3D ray_refrac = camera.CamFromImgRefrac(point2D);
+  std::unique_ptr<ceres::CostFunction> refrac_cost_function(
+      ReprojErrorRefracCostFunction<FlatPort, SimplePinholeCameraModel>::Create(
+          point2D));
+  std::unique_ptr<ceres::CostFunction> cost_function(
+      ReprojErrorRefracConstantCameraCostFunction::Create(
+          camera.VirtualCameraCenter(ray_refrac),
+          ray_refrac.dir.hnormalized(),
+          camera.params[0]));
+
+  double cam_from_world_rotation[4] = {0, 0, 0, 1};
+  double cam_from_world_translation[3] = {0.1, -0.2, 0.3};
+  double point3D[3] = {-0.5, -0.3, 2};
+  double refrac_residuals[2];
+  double residuals[2];
+  const double* refrac_parameters[5] = {cam_from_world_rotation,
+                                        cam_from_world_translation,
+                                        point3D,
+                                        camera.params.data(),
+                                        camera.refrac_params.data()};
+  const double* parameters[3] = {
+      cam_from_world_rotation, cam_from_world_translation, point3D};
+
+  for (int i = 0; i < 3; ++i) {
+    point3D[i] += 0.2;
+    EXPECT_TRUE(refrac_cost_function->Evaluate(
+        refrac_parameters, refrac_residuals, nullptr));
+    EXPECT_TRUE(cost_function->Evaluate(parameters, residuals, nullptr));
+    EXPECT_NEAR(residuals[0], refrac_residuals[0], 1e-8);
+    EXPECT_NEAR(residuals[1], refrac_residuals[1], 1e-8);
+  }
+}
+
+TEST(BundleAdjustment, RefracConstantPoseCameraAbsolutePose) {
+  Camera camera =
+      Camera::CreateFromModelName(1, "SIMPLE_PINHOLE", 1000.0, 1000, 800);
+  camera.refrac_model_id = DomePort::refrac_model_id;
+  camera.refrac_params = {0.001, 0.001, 0.02, 0.05, 0.007, 1.0, 1.52, 1.33};
+
+  const Rigid3d cam_from_world(Eigen::Quaterniond::Identity(),
+                               Eigen::Vector3d(0.1, -0.2, 0.3));
+  const Eigen::Vector2d point2D(300, 200);
+  const Ray3D ray_refrac = camera.CamFromImgRefrac(point2D);
+  std::unique_ptr<ceres::CostFunction> refrac_cost_function(
+      ReprojErrorRefracConstantPoseCostFunction<
+          DomePort,
+          SimplePinholeCameraModel>::Create(cam_from_world, point2D));
+  std::unique_ptr<ceres::CostFunction> cost_function(
+      ReprojErrorRefracConstantPoseCameraCostFunction::Create(
+          cam_from_world,
+          camera.VirtualCameraCenter(ray_refrac),
+          ray_refrac.dir.hnormalized(),
+          camera.params[0]));
+
+  double point3D[3] = {-0.5, -0.3, 2};
+  double refrac_residuals[2];
+  double residuals[2];
+  const double* refrac_parameters[3] = {
+      point3D, camera.params.data(), camera.refrac_params.data()};
+  const double* parameters[1] = {point3D};
+
+  for (int i = 0; i < 3; ++i) {
+    point3D[i] += 0.2;
+    EXPECT_TRUE(refrac_cost_function->Evaluate(
+        refrac_parameters, refrac_residuals, nullptr));
+    EXPECT_TRUE(cost_function->Evaluate(parameters, residuals, nullptr));
+    EXPECT_NEAR(residuals[0], refrac_residuals[0], 1e-8);
+    EXPECT_NEAR(residuals[1], refrac_residuals[1], 1e-8);
+  }
+}
+
+TEST(BundleAdjustment, RefracRig) {
+  Camera camera =
+      Camera::CreateFromModelName(1, "SIMPLE_PINHOLE", 1000.0, 1000, 800);
+  camera.refrac_model_id = FlatPort::refrac_model_id;
+  camera.refrac_params = {0.1, 0.05, 0.99, 0.05, 0.007, 1.0, 1.52, 1.33};
+  Eigen::Map<Eigen::Vector3d>(camera.refrac_params.data()).normalize();
+
+  const Eigen::Vector2d point2D(300, 200);
+  std::unique_ptr<ceres::CostFunction> refrac_cost_function(
+      ReprojErrorRefracCostFunction<FlatPort, SimplePinholeCameraModel>::Create(
+          point2D));
+  std::unique_ptr<ceres::CostFunction> cost_function(
+      RigReprojErrorRefracCostFunction<FlatPort,
+                                       SimplePinholeCameraModel>::Create(
+          point2D));
+
+  const Rigid3d cam_from_rig(
+      Eigen::Quaterniond(Eigen::AngleAxisd(0.1, Eigen::Vector3d::UnitY())),
+      Eigen::Vector3d(-0.2, 0, 0));
+  const Rigid3d rig_from_world(
+      Eigen::Quaterniond(Eigen::AngleAxisd(-0.2, Eigen::Vector3d::UnitX())),
+      Eigen::Vector3d(0.1, -0.2, 0.3));
+  const Rigid3d cam_from_world = cam_from_rig * rig_from_world;
+
+  double point3D[3] = {-0.5, -0.3, 2};
+  double refrac_residuals[2];
+  double residuals[2];
+  const double* refrac_parameters[5] = {
+      cam_from_world.rotation.coeffs().data(),
+      cam_from_world.translation.data(),
+      point3D,
+      camera.params.data(),
+      camera.refrac_params.data()};
+  const double* parameters[7] = {cam_from_rig.rotation.coeffs().data(),
+                                 cam_from_rig.translation.data(),
+                                 rig_from_world.rotation.coeffs().data(),
+                                 rig_from_world.translation.data(),
+                                 point3D,
+                                 camera.params.data(),
+                                 camera.refrac_params.data()};
+
+  for (int i = 0; i < 3; ++i) {
+    point3D[i] += 0.2;
+    EXPECT_TRUE(refrac_cost_function->Evaluate(
+        refrac_parameters, refrac_residuals, nullptr));
+    EXPECT_TRUE(cost_function->Evaluate(parameters, residuals, nullptr));
+    EXPECT_NEAR(residuals[0], refrac_residuals[0], 1e-6);
+    EXPECT_NEAR(residuals[1], refrac_residuals[1], 1e-6);
+  }
+}
+
+template <typename CameraRefracModel, typename CameraModel>
+void TestRefracMixedPrecision(const std::vector<double>& camera_params,
+                              const std::vector<double>& refrac_params) {
+  const Eigen::Vector2d point2D(300, 200);
+  std::unique_ptr<ceres::CostFunction> autodiff_cost_function(
+      ReprojErrorRefracCostFunction<CameraRefracModel, CameraModel>::Create(
+          point2D));
+  std::unique_ptr<ceres::CostFunction> cost_function(
+      ReprojErrorRefracMixedPrecisionCostFunction<CameraRefracModel,
+                                                  CameraModel>::
+          Create(point2D));
+
+  const Eigen::Quaterniond cam_from_world_rotation(
+      Eigen::AngleAxisd(0.1, Eigen::Vector3d(1, -1, 2).normalized()));
+  const Eigen::Vector3d cam_from_world_translation(0.1, -0.2, 0.3);
+  double point3D[3] = {-0.5, -0.3, 2};
+  const double* parameters[5] = {cam_from_world_rotation.coeffs().data(),
+                                 cam_from_world_translation.data(),
+                                 point3D,
+                                 camera_params.data(),
+                                 refrac_params.data()};
+
+  const int kNumCamParams = CameraModel::num_params;
+  const int kNumRefracParams = CameraRefracModel::num_params;
+  const std::vector<int> parameter_block_sizes = {
+      4, 3, 3, kNumCamParams, kNumRefracParams};
+
+  for (int i = 0; i < 3; ++i) {
+    point3D[i] += 0.2;
+
+    double autodiff_residuals[2];
+    double residuals[2];
+    std::vector<std::vector<double>> autodiff_jacobians;
+    std::vector<std::vector<double>> jacobians;
+    std::vector<double*> autodiff_jacobian_ptrs;
+    std::vector<double*> jacobian_ptrs;
+    for (const int parameter_block_size : parameter_block_sizes) {
+      autodiff_jacobians.emplace_back(2 * parameter_block_size);
+      jacobians.emplace_back(2 * parameter_block_size);
+    }
+    for (size_t j = 0; j < parameter_block_sizes.size(); ++j) {
+      autodiff_jacobian_ptrs.push_back(autodiff_jacobians[j].data());
+      jacobian_ptrs.push_back(jacobians[j].data());
+    }
+
+    EXPECT_TRUE(autodiff_cost_function->Evaluate(
+        parameters, autodiff_residuals, autodiff_jacobian_ptrs.data()));
+    EXPECT_TRUE(
+        cost_function->Evaluate(parameters, residuals, jacobian_ptrs.data()));
+
+    // The single precision ray tracing limits the accuracy to a small
+    // fraction of a pixel.
+    EXPECT_NEAR(residuals[0], autodiff_residuals[0], 1e-3);
+    EXPECT_NEAR(residuals[1], autodiff_residuals[1], 1e-3);
+    for (size_t j = 0; j < parameter_block_sizes.size(); ++j) {
+      for (size_t k = 0; k < jacobians[j].size(); ++k) {
+        EXPECT_NEAR(jacobians[j][k],
+                    autodiff_jacobians[j][k],
+                    1e-3 * std::max(1.0, std::abs(autodiff_jacobians[j][k])));
+      }
+    }
+
+    EXPECT_TRUE(cost_function->Evaluate(parameters, residuals, nullptr));
+    EXPECT_NEAR(residuals[0], autodiff_residuals[0], 1e-3);
+    EXPECT_NEAR(residuals[1], autodiff_residuals[1], 1e-3);
+  }
+}
+
+TEST(BundleAdjustment, RefracMixedPrecision) {
+  std::vector<double> flat_port_params = {
+      0.1, 0.05, 0.99, 0.05, 0.007, 1.0, 1.52, 1.33};
+  Eigen::Map<Eigen::Vector3d>(flat_port_params.data()).normalize();
+  const std::vector<double> dome_port_params = {
+      0.001, 0.001, 0.02, 0.05, 0.007, 1.0, 1.52, 1.33};
+
+  TestRefracMixedPrecision<FlatPort, SimplePinholeCameraModel>(
+      {1000, 500, 400}, flat_port_params);
+  TestRefracMixedPrecision<FlatPort, SimpleRadialCameraModel>(
+      {1000, 500, 400, 0.01}, flat_port_params);
+  TestRefracMixedPrecision<DomePort, SimplePinholeCameraModel>(
+      {1000, 500, 400}, dome_port_params);
+  TestRefracMixedPrecision<DomePort, OpenCVCameraModel>(
+      {1000, 1010, 500, 400, 0.01, -0.01, 0.001, 0.001}, dome_port_params);
+}
+
+TEST(PoseGraph, RelativePoseError6DoFAnalytic) {
+  const Rigid3d cam2_from_cam1_measured(Eigen::Quaterniond::UnitRandom(),
+                                        Eigen::Vector3d::Random());
+  Eigen::Matrix6d sqrt_information = Eigen::Matrix6d::Identity();
+  sqrt_information.diagonal() += Eigen::Vector6d::Random().cwiseAbs();
+  std::unique_ptr<ceres::CostFunction> autodiff_cost_function(
+      RelativePoseError6DoFCostFunction::Create(cam2_from_cam1_measured,
+                                                sqrt_information));
+  std::unique_ptr<ceres::CostFunction> cost_function(
+      RelativePoseError6DoFAnalyticCostFunction::Create(
+          cam2_from_cam1_measured, sqrt_information));
+
+  Eigen::Quaterniond cam1_from_world_rotation =
+      Eigen::Quaterniond::UnitRandom();
+  Eigen::Vector3d cam1_from_world_translation = Eigen::Vector3d::Random();
+  Eigen::Quaterniond cam2_from_world_rotation =
+      Eigen::Quaterniond::UnitRandom();
+  Eigen::Vector3d cam2_from_world_translation = Eigen::Vector3d::Random();
+  const double* parameters[4] = {cam1_from_world_rotation.coeffs().data(),
+                                 cam1_from_world_translation.data(),
+                                 cam2_from_world_rotation.coeffs().data(),
+                                 cam2_from_world_translation.data()};
+
+  Eigen::Vector6d autodiff_residuals;
+  Eigen::Vector6d residuals;
+  Eigen::Matrix<double, 6, 4, Eigen::RowMajor> autodiff_jacobians_rotation[2];
+  Eigen::Matrix<double, 6, 4, Eigen::RowMajor> jacobians_rotation[2];
+  Eigen::Matrix<double, 6, 3, Eigen::RowMajor>
+      autodiff_jacobians_translation[2];
+  Eigen::Matrix<double, 6, 3, Eigen::RowMajor> jacobians_translation[2];
+  double* autodiff_jacobians[4] = {autodiff_jacobians_rotation[0].data(),
+                                   autodiff_jacobians_translation[0].data(),
+                                   autodiff_jacobians_rotation[1].data(),
+                                   autodiff_jacobians_translation[1].data()};
+  double* jacobians[4] = {jacobians_rotation[0].data(),
+                          jacobians_translation[0].data(),
+                          jacobians_rotation[1].data(),
+                          jacobians_translation[1].data()};
+  EXPECT_TRUE(autodiff_cost_function->Evaluate(
+      parameters, autodiff_residuals.data(), autodiff_jacobians));
+  EXPECT_TRUE(
+      cost_function->Evaluate(parameters, residuals.data(), jacobians));
+
+  EXPECT_LT((residuals - autodiff_residuals).norm(), 1e-8);
+  for (int i = 0; i < 2; ++i) {
+    EXPECT_LT(
+        (jacobians_translation[i] - autodiff_jacobians_translation[i]).norm(),
+        1e-8);
+  }
+
+  // The rotation Jacobians must only agree in the tangent space of the
+  // quaternions, which is orthogonal to the quaternion coefficients.
+  const Eigen::Vector4d quaternions[2] = {cam1_from_world_rotation.coeffs(),
+                                          cam2_from_world_rotation.coeffs()};
+  for (int i = 0; i < 2; ++i) {
+    for (int j = 0; j < 10; ++j) {
+      Eigen::Vector4d tangent = Eigen::Vector4d::Random();
+      tangent -= tangent.dot(quaternions[i]) * quaternions[i];
+      EXPECT_LT((jacobians_rotation[i] * tangent -
+                 autodiff_jacobians_rotation[i] * tangent)
+                    .norm(),
+                1e-8);
+    }
+  }
+
+  EXPECT_TRUE(cost_function->Evaluate(parameters, residuals.data(), nullptr));
+  EXPECT_LT((residuals - autodiff_residuals).norm(), 1e-8);
+}
+
+TEST(RotationAveraging, RelativeRotationError) {
+  const Eigen::Quaterniond cam1_from_world_rotation =
+      Eigen::Quaterniond::UnitRandom();
+  const Eigen::Quaterniond cam2_from_world_rotation =
+      Eigen::Quaterniond::UnitRandom();
+  std::unique_ptr<ceres::CostFunction> cost_function(
+      RelativeRotationErrorCostFunction::Create(
+          cam2_from_world_rotation * cam1_from_world_rotation.inverse()));
+  const double* parameters[2] = {cam1_from_world_rotation.coeffs().data(),
+                                 cam2_from_world_rotation.coeffs().data()};
+  Eigen::Vector3d residuals;
+  EXPECT_TRUE(cost_function->Evaluate(parameters, residuals.data(), nullptr));
+  EXPECT_LT(residuals.norm(), 1e-12);
+
+  // The residual is the angle-axis vector of small rotation errors.
+  const Eigen::Vector3d error(0, 0, 1e-3);
+  cost_function.reset(RelativeRotationErrorCostFunction::Create(
+      Eigen::Quaterniond(Eigen::AngleAxisd(error.norm(), error.normalized())) *
+      cam2_from_world_rotation * cam1_from_world_rotation.inverse()));
+  EXPECT_TRUE(cost_function->Evaluate(parameters, residuals.data(), nullptr));
+  EXPECT_LT((residuals - error).norm(), 1e-9);
+}
+
+TEST(TranslationAveraging, RelativeTranslationError) {
+  std::unique_ptr<ceres::CostFunction> cost_function(
+      RelativeTranslationErrorCostFunction::Create(Eigen::Vector3d(1, 0, 0)));
+  const Eigen::Vector3d proj_center1(1, 2, 3);
+  const Eigen::Vector3d proj_center2(3, 2, 3);
+  double scale = 2;
+  const double* parameters[3] = {
+      proj_center1.data(), proj_center2.data(), &scale};
+  Eigen::Vector3d residuals;
+  EXPECT_TRUE(cost_function->Evaluate(parameters, residuals.data(), nullptr));
+  EXPECT_EQ(residuals, Eigen::Vector3d::Zero());
+
+  scale = 1;
+  EXPECT_TRUE(cost_function->Evaluate(parameters, residuals.data(), nullptr));
+  EXPECT_EQ(residuals, Eigen::Vector3d(1, 0, 0));
+}
+
 }  // namespace
 }  // namespace colmap
@@ -0,0 +1,546 @@
+#include "colmap/estimators/covariance.h"
+
+#include "colmap/geometry/pose.h"
+#include "colmap/util/logging.h"
+#include "colmap/util/misc.h"
+#include "colmap/util/threading.h"
+
+#include <algorithm>
+#include <numeric>
+#include <unordered_set>
+
+#include <Eigen/Eigenvalues>
+#include <Eigen/SparseCholesky>
+
+namespace colmap {
+namespace {
+
+int ParameterBlockTangentSize(const ceres::Problem& problem,
+                              const double* values) {
+#if CERES_VERSION_MAJOR >= 3 || \
+    (CERES_VERSION_MAJOR == 2 && CERES_VERSION_MINOR >= 1)
+  return problem.ParameterBlockTangentSize(values);
+#else
+  return problem.ParameterBlockLocalSize(values);
+#endif
+}
+
+// Jacobian of the parameter block w.r.t. its tangent space.
+Eigen::MatrixXd TangentSpaceJacobian(const ceres::Problem& problem,
+                                     const double* values) {
+  Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>
+      jacobian(problem.ParameterBlockSize(values),
+               ParameterBlockTangentSize(problem, values));
+#if CERES_VERSION_MAJOR >= 3 || \
+    (CERES_VERSION_MAJOR == 2 && CERES_VERSION_MINOR >= 1)
+  const ceres::Manifold* manifold = problem.GetManifold(values);
+  if (manifold == nullptr) {
+    jacobian.setIdentity();
+  } else {
+    CHECK(manifold->PlusJacobian(values, jacobian.data()));
+  }
+#else
+  const ceres::LocalParameterization* parameterization =
+      problem.GetParameterization(values);
+  if (parameterization == nullptr) {
+    jacobian.setIdentity();
+  } else {
+    CHECK(parameterization->ComputeJacobian(values, jacobian.data()));
+  }
+#endif
+  return jacobian;
+}
+
+// Copy the Jacobian into a sparse matrix with sorted column indices, as the
+// columns of the residual blocks are in the order of their parameter blocks.
+Eigen::SparseMatrix<double, Eigen::RowMajor> CRSToSparseMatrix(
+    const ceres::CRSMatrix& crs_matrix) {
+  Eigen::SparseMatrix<double, Eigen::RowMajor> matrix(crs_matrix.num_rows,
+                                                      crs_matrix.num_cols);
+  matrix.reserve(crs_matrix.values.size());
+  std::vector<std::pair<int, double>> row_entries;
+  for (int row = 0; row < crs_matrix.num_rows; ++row) {
+    row_entries.clear();
+    for (int idx = crs_matrix.rows[row]; idx < crs_matrix.rows[row + 1];
+         ++idx) {
+      row_entries.emplace_back(crs_matrix.cols[idx], crs_matrix.values[idx]);
+    }
+    std::sort(row_entries.begin(), row_entries.end());
+    matrix.startVec(row);
+    for (const auto& entry : row_entries) {
+      matrix.insertBack(row, entry.first) = entry.second;
+    }
+  }
+  matrix.finalize();
+  return matrix;
+}
+
+// Invert the normal equations of a 3D point. Returns false if the point is not
+// fully constrained, in which case its observations do not constrain the
+// cameras after its elimination.
+bool InvertPointHessian(const Eigen::Matrix3d& hessian,
+                        Eigen::Matrix3d* inv_hessian) {
+  const Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> eigen_solver(hessian);
+  if (eigen_solver.info() != Eigen::Success) {
+    return false;
+  }
+  const Eigen::Vector3d& eigenvalues = eigen_solver.eigenvalues();
+  if (eigenvalues(0) <= 1e-12 * eigenvalues(2)) {
+    return false;
+  }
+  *inv_hessian = eigen_solver.eigenvectors() *
+                 eigenvalues.cwiseInverse().asDiagonal() *
+                 eigen_solver.eigenvectors().transpose();
+  return true;
+}
+
+}  // namespace
+
+////////////////////////////////////////////////////////////////////////////////
+// SparseSelectedInverse
+////////////////////////////////////////////////////////////////////////////////
+
+bool SparseSelectedInverse::Compute(const Eigen::SparseMatrix<double>& matrix) {
+  CHECK_EQ(matrix.rows(), matrix.cols());
+  const int num_rows = matrix.rows();
+
+  const Eigen::SimplicialLDLT<Eigen::SparseMatrix<double>,
+                              Eigen::Lower,
+                              Eigen::AMDOrdering<int>>
+      ldlt(matrix);
+  if (ldlt.info() != Eigen::Success) {
+    return false;
+  }
+
+  const Eigen::VectorXd& diag = ldlt.vectorD();
+  if (!diag.allFinite() || (diag.array() <= 0).any()) {
+    return false;
+  }
+
+  perm_.resize(num_rows);
+  for (int i = 0; i < num_rows; ++i) {
+    perm_[i] = ldlt.permutationP().indices()(i);
+  }
+
+  // The pattern of the inverse is the pattern of the unit lower triangular
+  // factor L of the permuted matrix P * A * P^T = L * D * L^T.
+  const Eigen::SparseMatrix<double>& factor =
+      ldlt.matrixL().nestedExpression();
+  col_ptrs_.assign(num_rows + 1, 0);
+  for (int col = 0; col < num_rows; ++col) {
+    int num_entries = 1;
+    for (Eigen::SparseMatrix<double>::InnerIterator it(factor, col); it;
+         ++it) {
+      if (it.row() > col) {
+        num_entries += 1;
+      }
+    }
+    col_ptrs_[col + 1] = col_ptrs_[col] + num_entries;
+  }
+
+  row_idxs_.resize(col_ptrs_[num_rows]);
+  values_.assign(col_ptrs_[num_rows], 0);
+  std::vector<double> factor_values(col_ptrs_[num_rows], 0);
+  std::vector<std::pair<int, double>> col_entries;
+  for (int col = 0; col < num_rows; ++col) {
+    col_entries.clear();
+    for (Eigen::SparseMatrix<double>::InnerIterator it(factor, col); it;
+         ++it) {
+      if (it.row() > col) {
+        col_entries.emplace_back(it.row(), it.value());
+      }
+    }
+    std::sort(col_entries.begin(), col_entries.end());
+    int idx = col_ptrs_[col];
+    row_idxs_[idx] = col;
+    for (const auto& entry : col_entries) {
+      idx += 1;
+      row_idxs_[idx] = entry.first;
+      factor_values[idx] = entry.second;
+    }
+  }
+
+  // Takahashi recursion Z = D^-1 * L^-1 + (I - L^T) * Z for the inverse Z in
+  // reverse column order. The pattern of the factor is closed under the
+  // recursion, i.e., the entries of the inverse required by a column are in
+  // the pattern of the already processed columns.
+  for (int col = num_rows - 1; col >= 0; --col) {
+    const int begin = col_ptrs_[col] + 1;
+    const int end = col_ptrs_[col + 1];
+    for (int i = begin; i < end; ++i) {
+      double value = 0;
+      for (int k = begin; k < end; ++k) {
+        const double* inv_coeff = FindPermutedCoeff(row_idxs_[k], row_idxs_[i]);
+        CHECK_NOTNULL(inv_coeff);
+        value -= factor_values[k] * (*inv_coeff);
+      }
+      values_[i] = value;
+    }
+    double value = 1.0 / diag(col);
+    for (int k = begin; k < end; ++k) {
+      value -= factor_values[k] * values_[k];
+    }
+    values_[col_ptrs_[col]] = value;
+  }
+
+  return true;
+}
+
+bool SparseSelectedInverse::Coeff(const int row,
+                                  const int col,
+                                  double* value) const {
+  CHECK_GE(row, 0);
+  CHECK_LT(row, static_cast<int>(perm_.size()));
+  CHECK_GE(col, 0);
+  CHECK_LT(col, static_cast<int>(perm_.size()));
+  const double* coeff = FindPermutedCoeff(perm_[row], perm_[col]);
+  if (coeff == nullptr) {
+    return false;
+  }
+  *value = *coeff;
+  return true;
+}
+
+bool SparseSelectedInverse::Block(const std::vector<int>& rows,
+                                  const std::vector<int>& cols,
+                                  Eigen::MatrixXd* block) const {
+  block->resize(rows.size(), cols.size());
+  for (size_t i = 0; i < rows.size(); ++i) {
+    for (size_t j = 0; j < cols.size(); ++j) {
+      if (!Coeff(rows[i], cols[j], &(*block)(i, j))) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+const double* SparseSelectedInverse::FindPermutedCoeff(int row,
+                                                       int col) const {
+  if (row < col) {
+    std::swap(row, col);
+  }
+  const int begin = col_ptrs_[col];
+  if (row == col) {
+    return &values_[begin];
+  }
+  const auto row_idxs_begin = row_idxs_.begin() + begin + 1;
+  const auto row_idxs_end = row_idxs_.begin() + col_ptrs_[col + 1];
+  const auto it = std::lower_bound(row_idxs_begin, row_idxs_end, row);
+  if (it == row_idxs_end || *it != row) {
+    return nullptr;
+  }
+  return &values_[it - row_idxs_.begin()];
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// BundleAdjustmentCovarianceEstimator
+////////////////////////////////////////////////////////////////////////////////
+
+bool BundleAdjustmentCovarianceOptions::Check() const {
+  CHECK_OPTION_GE(num_threads, -1);
+  CHECK_OPTION_GE(damping, 0);
+  return true;
+}
+
+BundleAdjustmentCovarianceEstimator::BundleAdjustmentCovarianceEstimator(
+    const BundleAdjustmentCovarianceOptions& options,
+    ceres::Problem* problem,
+    const Reconstruction* reconstruction)
+    : options_(options), problem_(problem), reconstruction_(reconstruction) {
+  CHECK(options_.Check());
+  CHECK_NOTNULL(problem_);
+  CHECK_NOTNULL(reconstruction_);
+}
+
+bool BundleAdjustmentCovarianceEstimator::Compute() {
+  pose_blocks_.clear();
+
+  // The variable 3D points, which are eliminated, are followed by all other
+  // variable parameter blocks in the columns of the Jacobian.
+  std::vector<double*> parameter_blocks;
+  for (const auto& point3D : reconstruction_->Points3D()) {
+    double* xyz = const_cast<double*>(point3D.second.xyz.data());
+    if (problem_->HasParameterBlock(xyz) &&
+        !problem_->IsParameterBlockConstant(xyz)) {
+      CHECK_EQ(ParameterBlockTangentSize(*problem_, xyz), 3);
+      parameter_blocks.push_back(xyz);
+    }
+  }
+
+  const int num_points = parameter_blocks.size();
+  const int num_point_params = 3 * num_points;
+
+  const std::unordered_set<double*> point_blocks(parameter_blocks.begin(),
+                                                 parameter_blocks.end());
+  std::vector<double*> problem_parameter_blocks;
+  problem_->GetParameterBlocks(&problem_parameter_blocks);
+  std::unordered_map<const double*, int> reduced_cols;
+  int num_reduced_params = 0;
+  for (double* parameter_block : problem_parameter_blocks) {
+    if (point_blocks.count(parameter_block) > 0 ||
+        problem_->IsParameterBlockConstant(parameter_block)) {
+      continue;
+    }
+    const int tangent_size =
+        ParameterBlockTangentSize(*problem_, parameter_block);
+    if (tangent_size == 0) {
+      continue;
+    }
+    parameter_blocks.push_back(parameter_block);
+    reduced_cols.emplace(parameter_block, num_reduced_params);
+    num_reduced_params += tangent_size;
+  }
+
+  if (num_reduced_params == 0) {
+    return false;
+  }
+
+  ThreadPool thread_pool(GetEffectiveNumThreads(options_.num_threads));
+  const int num_chunks = thread_pool.NumThreads();
+
+  // Jacobian w.r.t. the tangent spaces of the parameter blocks.
+  ceres::Problem::EvaluateOptions evaluate_options;
+  evaluate_options.parameter_blocks = parameter_blocks;
+  evaluate_options.num_threads = num_chunks;
+  double cost = 0;
+  ceres::CRSMatrix crs_jacobian;
+  if (!problem_->Evaluate(
+          evaluate_options, &cost, nullptr, nullptr, &crs_jacobian)) {
+    return false;
+  }
+  const Eigen::SparseMatrix<double, Eigen::RowMajor> jacobian =
+      CRSToSparseMatrix(crs_jacobian);
+
+  // Normal equations J^T * J accumulated over chunks of residuals.
+  std::vector<Eigen::SparseMatrix<double>> chunk_hessians(num_chunks);
+  const int num_residuals = jacobian.rows();
+  for (int chunk_idx = 0; chunk_idx < num_chunks; ++chunk_idx) {
+    thread_pool.AddTask([&, chunk_idx]() {
+      const int begin = chunk_idx * num_residuals / num_chunks;
+      const int end = (chunk_idx + 1) * num_residuals / num_chunks;
+      const Eigen::SparseMatrix<double, Eigen::RowMajor> chunk_jacobian =
+          jacobian.middleRows(begin, end - begin);
+      chunk_hessians[chunk_idx] =
+          Eigen::SparseMatrix<double>(chunk_jacobian.transpose()) *
+          chunk_jacobian;
+    });
+  }
+  thread_pool.Wait();
+
+  Eigen::SparseMatrix<double> hessian = chunk_hessians[0];
+  for (int chunk_idx = 1; chunk_idx < num_chunks; ++chunk_idx) {
+    hessian += chunk_hessians[chunk_idx];
+    chunk_hessians[chunk_idx].resize(0, 0);
+  }
+  chunk_hessians.clear();
+
+  const Eigen::SparseMatrix<double> hessian_reduced_cols =
+      hessian.rightCols(num_reduced_params);
+  Eigen::SparseMatrix<double> hessian_reduced =
+      hessian_reduced_cols.bottomRows(num_reduced_params);
+  const Eigen::SparseMatrix<double, Eigen::RowMajor> hessian_points_reduced =
+      hessian_reduced_cols.topRows(num_point_params);
+
+  // Schur complement of the points accumulated over chunks of points, whose
+  // normal equations are 3x3 blocks on the diagonal of the Hessian.
+  std::vector<Eigen::SparseMatrix<double>> chunk_schurs(num_chunks);
+  for (int chunk_idx = 0; chunk_idx < num_chunks; ++chunk_idx) {
+    thread_pool.AddTask([&, chunk_idx]() {
+      const int begin = chunk_idx * num_points / num_chunks;
+      const int end = (chunk_idx + 1) * num_points / num_chunks;
+      std::vector<Eigen::Triplet<double>> triplets;
+      triplets.reserve(9 * (end - begin));
+      for (int point_idx = begin; point_idx < end; ++point_idx) {
+        Eigen::Matrix3d point_hessian = Eigen::Matrix3d::Zero();
+        for (int i = 0; i < 3; ++i) {
+          for (Eigen::SparseMatrix<double>::InnerIterator it(
+                   hessian, 3 * point_idx + i);
+               it;
+               ++it) {
+            if (it.row() >= 3 * point_idx && it.row() < 3 * point_idx + 3) {
+              point_hessian(it.row() - 3 * point_idx, i) = it.value();
+            }
+          }
+        }
+        Eigen::Matrix3d inv_point_hessian;
+        if (!InvertPointHessian(point_hessian, &inv_point_hessian)) {
+          continue;
+        }
+        const int offset = 3 * (point_idx - begin);
+        for (int i = 0; i < 3; ++i) {
+          for (int j = 0; j < 3; ++j) {
+            triplets.emplace_back(
+                offset + i, offset + j, inv_point_hessian(i, j));
+          }
+        }
+      }
+      Eigen::SparseMatrix<double, Eigen::RowMajor> inv_points_hessian(
+          3 * (end - begin), 3 * (end - begin));
+      inv_points_hessian.setFromTriplets(triplets.begin(), triplets.end());
+      const Eigen::SparseMatrix<double, Eigen::RowMajor>
+          chunk_hessian_points_reduced =
+              hessian_points_reduced.middleRows(3 * begin, 3 * (end - begin));
+      const Eigen::SparseMatrix<double, Eigen::RowMajor> chunk_product =
+          inv_points_hessian * chunk_hessian_points_reduced;
+      const Eigen::SparseMatrix<double> chunk_hessian_reduced_points =
+          chunk_hessian_points_reduced.transpose();
+      chunk_schurs[chunk_idx] = chunk_hessian_reduced_points * chunk_product;
+    });
+  }
+  thread_pool.Wait();
+
+  for (int chunk_idx = 0; chunk_idx < num_chunks; ++chunk_idx) {
+    hessian_reduced -= chunk_schurs[chunk_idx];
+  }
+  chunk_schurs.clear();
+
+  if (options_.damping > 0) {
+    Eigen::SparseMatrix<double> identity(num_reduced_params,
+                                         num_reduced_params);
+    identity.setIdentity();
+    hessian_reduced += options_.damping * identity;
+  }
+
+  if (!selected_inverse_.Compute(hessian_reduced)) {
+    return false;
+  }
+
+  for (const auto& image : reconstruction_->Images()) {
+    const Rigid3d& cam_from_world = image.second.CamFromWorld();
+    PoseBlock pose_block;
+    const double* rotation = cam_from_world.rotation.coeffs().data();
+    const auto rotation_col = reduced_cols.find(rotation);
+    if (rotation_col != reduced_cols.end()) {
+      // Rotations are parameterized by a quaternion manifold.
+      CHECK_EQ(ParameterBlockTangentSize(*problem_, rotation), 3);
+      pose_block.rotation_col = rotation_col->second;
+    }
+    const auto translation_col =
+        reduced_cols.find(cam_from_world.translation.data());
+    if (translation_col != reduced_cols.end()) {
+      pose_block.translation_col = translation_col->second;
+      pose_block.translation_jacobian =
+          TangentSpaceJacobian(*problem_, cam_from_world.translation.data());
+    }
+    if (pose_block.rotation_col >= 0 || pose_block.translation_col >= 0) {
+      pose_blocks_.emplace(image.first, std::move(pose_block));
+    }
+  }
+
+  return true;
+}
+
+bool BundleAdjustmentCovarianceEstimator::HasPose(
+    const image_t image_id) const {
+  return pose_blocks_.count(image_id) > 0;
+}
+
+Eigen::Matrix6d BundleAdjustmentCovarianceEstimator::PoseCovariance(
+    const image_t image_id) const {
+  const auto pose_block = pose_blocks_.find(image_id);
+  if (pose_block == pose_blocks_.end()) {
+    return Eigen::Matrix6d::Zero();
+  }
+
+  Eigen::MatrixXd jacobian;
+  std::vector<int> cols;
+  PoseJacobian(pose_block->second, &jacobian, &cols);
+
+  // The diagonal blocks are always in the pattern of the selected inverse.
+  Eigen::MatrixXd tangent_cov;
+  CHECK(selected_inverse_.Block(cols, cols, &tangent_cov));
+
+  return jacobian * tangent_cov * jacobian.transpose();
+}
+
+bool BundleAdjustmentCovarianceEstimator::PoseCrossCovariance(
+    const image_t image_id1,
+    const image_t image_id2,
+    Eigen::Matrix6d* cov) const {
+  const auto pose_block1 = pose_blocks_.find(image_id1);
+  const auto pose_block2 = pose_blocks_.find(image_id2);
+  if (pose_block1 == pose_blocks_.end() || pose_block2 == pose_blocks_.end()) {
+    // The pose of at least one image is constant.
+    cov->setZero();
+    return true;
+  }
+
+  Eigen::MatrixXd jacobian1;
+  std::vector<int> cols1;
+  PoseJacobian(pose_block1->second, &jacobian1, &cols1);
+
+  Eigen::MatrixXd jacobian2;
+  std::vector<int> cols2;
+  PoseJacobian(pose_block2->second, &jacobian2, &cols2);
+
+  Eigen::MatrixXd tangent_cross_cov;
+  if (!selected_inverse_.Block(cols1, cols2, &tangent_cross_cov)) {
+    return false;
+  }
+
+  *cov = jacobian1 * tangent_cross_cov * jacobian2.transpose();
+  return true;
+}
+
+void BundleAdjustmentCovarianceEstimator::PoseJacobian(
+    const PoseBlock& pose_block,
+    Eigen::MatrixXd* jacobian,
+    std::vector<int>* cols) const {
+  const int rotation_size = pose_block.rotation_col >= 0 ? 3 : 0;
+  const int translation_size = pose_block.translation_col >= 0
+                                   ? pose_block.translation_jacobian.cols()
+                                   : 0;
+
+  jacobian->setZero(6, rotation_size + translation_size);
+  cols->clear();
+
+  if (rotation_size > 0) {
+    // The quaternion manifold rotates by twice the norm of its tangent vector.
+    jacobian->block(0, 0, 3, 3) = 2 * Eigen::Matrix3d::Identity();
+    for (int i = 0; i < 3; ++i) {
+      cols->push_back(pose_block.rotation_col + i);
+    }
+  }
+
+  if (translation_size > 0) {
+    jacobian->block(3, rotation_size, 3, translation_size) =
+        pose_block.translation_jacobian;
+    for (int i = 0; i < translation_size; ++i) {
+      cols->push_back(pose_block.translation_col + i);
+    }
+  }
+}
+
+Eigen::Matrix6d RelativePoseCovariance(const Rigid3d& cam1_from_world,
+                                       const Rigid3d& cam2_from_world,
+                                       const Eigen::Matrix6d& cov1,
+                                       const Eigen::Matrix6d& cov2,
+                                       const Eigen::Matrix6d& cross_cov12) {
+  const Rigid3d cam2_from_cam1 = cam2_from_world * Inverse(cam1_from_world);
+  const Eigen::Matrix3d rotation = cam2_from_cam1.rotation.toRotationMatrix();
+  const Eigen::Matrix3d center_cross = CrossProductMatrix(
+      cam2_from_world.translation - cam2_from_cam1.translation);
+
+  // Jacobians of the perturbation of the relative pose w.r.t. the
+  // perturbations of the two poses.
+  Eigen::Matrix6d jacobian1;
+  jacobian1.topLeftCorner<3, 3>() = -rotation;
+  jacobian1.topRightCorner<3, 3>().setZero();
+  jacobian1.bottomLeftCorner<3, 3>() = -center_cross * rotation;
+  jacobian1.bottomRightCorner<3, 3>() = -rotation;
+
+  Eigen::Matrix6d jacobian2;
+  jacobian2.topLeftCorner<3, 3>().setIdentity();
+  jacobian2.topRightCorner<3, 3>().setZero();
+  jacobian2.bottomLeftCorner<3, 3>() = center_cross;
+  jacobian2.bottomRightCorner<3, 3>().setIdentity();
+
+  const Eigen::Matrix6d cross_term =
+      jacobian1 * cross_cov12 * jacobian2.transpose();
+  return jacobian1 * cov1 * jacobian1.transpose() +
+         jacobian2 * cov2 * jacobian2.transpose() + cross_term +
+         cross_term.transpose();
+}
+
+}  // namespace colmap
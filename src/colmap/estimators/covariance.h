@@ -0,0 +1,138 @@
+#pragma once
+
+#include "colmap/geometry/rigid3.h"
+#include "colmap/scene/reconstruction.h"
+#include "colmap/util/types.h"
+
+#include <unordered_map>
+#include <vector>
+
+#include <Eigen/Core>
+#include <Eigen/SparseCore>
+#include <ceres/ceres.h>
+
+namespace colmap {
+
+// Selected inversion of a sparse symmetric positive definite matrix. All
+// entries of the inverse in the sparsity pattern of the Cholesky factor of the
+// fill-reducing permuted matrix are computed by the recursion of Takahashi et
+// al., "Formation of a sparse bus impedance matrix and its application to
+// short circuit study", 1973, without computing the dense inverse. The pattern
+// contains the pattern of the matrix itself, e.g., the diagonal blocks and
+// the blocks of all covisible images of a reduced camera system.
+class SparseSelectedInverse {
+ public:
+  // Factorize the matrix and compute the selected inverse. Only the lower
+  // triangular part of the matrix is used. Returns false if the matrix is not
+  // positive definite.
+  bool Compute(const Eigen::SparseMatrix<double>& matrix);
+
+  // Get the entry of the inverse. Returns false if it is not in the pattern.
+  bool Coeff(int row, int col, double* value) const;
+
+  // Get the block of the inverse with the given rows and columns. Returns
+  // false if any of its entries is not in the pattern.
+  bool Block(const std::vector<int>& rows,
+             const std::vector<int>& cols,
+             Eigen::MatrixXd* block) const;
+
+ private:
+  // Find the entry of the inverse of the permuted matrix in its lower
+  // triangular part or return null if it is not in the pattern.
+  const double* FindPermutedCoeff(int row, int col) const;
+
+  // Index of the rows and columns in the permuted matrix.
+  std::vector<int> perm_;
+
+  // Lower triangular part of the inverse of the permuted matrix in compressed
+  // column format. The first entry of each column is the diagonal entry
+  // followed by the off-diagonal entries in increasing row order.
+  std::vector<int> col_ptrs_;
+  std::vector<int> row_idxs_;
+  std::vector<double> values_;
+};
+
+struct BundleAdjustmentCovarianceOptions {
+  // Number of threads for the evaluation of the Jacobian and the Schur
+  // complement.
+  int num_threads = -1;
+
+  // Damping added to the diagonal of the reduced camera system, e.g., to
+  // regularize problems without a fixed gauge.
+  double damping = 0.0;
+
+  bool Check() const;
+};
+
+// Estimation of the marginal covariances of the camera poses of a bundle
+// adjustment problem, e.g., as set up by `BundleAdjuster`. The 3D points are
+// eliminated by the Schur complement, which is accumulated block-sparse and in
+// parallel over the points, and the pose covariances are the blocks of the
+// inverse of the resulting reduced camera system, which are obtained by sparse
+// selected inversion. All other variable parameters of the problem, e.g.,
+// intrinsic and refractive camera parameters, are marginalized as well. In
+// contrast to `ceres::Covariance`, neither the dense reduced camera system nor
+// its dense inverse are computed.
+//
+// The covariances are given w.r.t. the perturbation of the pose
+// cam_from_world = (exp(dr) * R, t + dt) with the rotation vector dr in the
+// order [dr, dt]. The rows and columns of constant pose parameters are zero.
+class BundleAdjustmentCovarianceEstimator {
+ public:
+  BundleAdjustmentCovarianceEstimator(
+      const BundleAdjustmentCovarianceOptions& options,
+      ceres::Problem* problem,
+      const Reconstruction* reconstruction);
+
+  // Compute the covariances at the current parameters of the problem.
+  // Returns false if the reduced camera system is singular.
+  bool Compute();
+
+  // Whether the pose of the image has variable parameters in the problem.
+  bool HasPose(image_t image_id) const;
+
+  // Get the marginal covariance of the pose of the image.
+  Eigen::Matrix6d PoseCovariance(image_t image_id) const;
+
+  // Get the cross-covariance of the poses of two images, i.e., E[d1 * d2^T]
+  // for the perturbations d1 and d2 of the poses. It is only available for
+  // images that are connected in the reduced camera system, e.g., covisible
+  // images, and otherwise false is returned.
+  bool PoseCrossCovariance(image_t image_id1,
+                           image_t image_id2,
+                           Eigen::Matrix6d* cov) const;
+
+ private:
+  struct PoseBlock {
+    // First column of the rotation and translation in the reduced camera
+    // system, or -1 if constant.
+    int rotation_col = -1;
+    int translation_col = -1;
+    // Jacobian of the translation w.r.t. its tangent space.
+    Eigen::MatrixXd translation_jacobian;
+  };
+
+  // Jacobian of the pose perturbation w.r.t. the variable parameters of the
+  // pose and their columns in the reduced camera system.
+  void PoseJacobian(const PoseBlock& pose_block,
+                    Eigen::MatrixXd* jacobian,
+                    std::vector<int>* cols) const;
+
+  const BundleAdjustmentCovarianceOptions options_;
+  ceres::Problem* problem_;
+  const Reconstruction* reconstruction_;
+  std::unordered_map<image_t, PoseBlock> pose_blocks_;
+  SparseSelectedInverse selected_inverse_;
+};
+
+// Propagate the covariances of the poses of two images to the covariance of
+// their relative pose cam2_from_cam1 = cam2_from_world * inv(cam1_from_world),
+// where all covariances are w.r.t. the perturbation of
+// `BundleAdjustmentCovarianceEstimator`.
+Eigen::Matrix6d RelativePoseCovariance(const Rigid3d& cam1_from_world,
+                                       const Rigid3d& cam2_from_world,
+                                       const Eigen::Matrix6d& cov1,
+                                       const Eigen::Matrix6d& cov2,
+                                       const Eigen::Matrix6d& cross_cov12);
+
+}  // namespace colmap
@@ -0,0 +1,242 @@
+#include "colmap/estimators/covariance.h"
+
+#include "colmap/estimators/bundle_adjustment.h"
+#include "colmap/math/random.h"
+#include "colmap/scene/synthetic.h"
+
+#include <gtest/gtest.h>
+
+namespace colmap {
+namespace {
+
+TEST(SparseSelectedInverse, Compute) {
+  SetPRNGSeed(0);
+
+  const int kNumRows = 30;
+  Eigen::MatrixXd dense_matrix = Eigen::MatrixXd::Zero(kNumRows, kNumRows);
+  for (int i = 0; i < kNumRows; ++i) {
+    dense_matrix(i, i) = 10;
+    if (i + 1 < kNumRows) {
+      dense_matrix(i, i + 1) = dense_matrix(i + 1, i) =
+          RandomUniformReal(-1.0, 1.0);
+    }
+    const int j = RandomUniformInteger(0, kNumRows - 1);
+    if (i != j) {
+      dense_matrix(i, j) = dense_matrix(j, i) = RandomUniformReal(-1.0, 1.0);
+    }
+  }
+
+  const Eigen::SparseMatrix<double> matrix = dense_matrix.sparseView();
+  const Eigen::MatrixXd dense_inverse = dense_matrix.inverse();
+
+  SparseSelectedInverse selected_inverse;
+  ASSERT_TRUE(selected_inverse.Compute(matrix));
+
+  // All entries in the pattern of the matrix are available.
+  for (int col = 0; col < matrix.outerSize(); ++col) {
+    for (Eigen::SparseMatrix<double>::InnerIterator it(matrix, col); it;
+         ++it) {
+      double value = 0;
+      ASSERT_TRUE(selected_inverse.Coeff(it.row(), col, &value));
+      EXPECT_NEAR(value, dense_inverse(it.row(), col), 1e-12);
+    }
+  }
+
+  Eigen::MatrixXd block;
+  ASSERT_TRUE(selected_inverse.Block({2, 3}, {3, 2}, &block));
+  EXPECT_NEAR(block(0, 0), dense_inverse(2, 3), 1e-12);
+  EXPECT_NEAR(block(0, 1), dense_inverse(2, 2), 1e-12);
+  EXPECT_NEAR(block(1, 0), dense_inverse(3, 3), 1e-12);
+  EXPECT_NEAR(block(1, 1), dense_inverse(3, 2), 1e-12);
+}
+
+TEST(SparseSelectedInverse, NotPositiveDefinite) {
+  Eigen::MatrixXd dense_matrix = Eigen::MatrixXd::Identity(3, 3);
+  dense_matrix(1, 1) = -1;
+  SparseSelectedInverse selected_inverse;
+  EXPECT_FALSE(selected_inverse.Compute(dense_matrix.sparseView()));
+}
+
+Rigid3d PerturbPose(const Rigid3d& cam_from_world,
+                    const Eigen::Matrix<double, 6, 1>& delta) {
+  const Eigen::Vector3d rotation_delta = delta.head<3>();
+  return Rigid3d(Eigen::Quaterniond(Eigen::AngleAxisd(
+                     rotation_delta.norm(), rotation_delta.normalized())) *
+                     cam_from_world.rotation,
+                 cam_from_world.translation + delta.tail<3>());
+}
+
+Eigen::Matrix<double, 6, 1> PoseDelta(const Rigid3d& cam_from_world,
+                                      const Rigid3d& perturbed) {
+  Eigen::Matrix<double, 6, 1> delta;
+  const Eigen::AngleAxisd rotation_delta(perturbed.rotation *
+                                         cam_from_world.rotation.inverse());
+  delta.head<3>() = rotation_delta.angle() * rotation_delta.axis();
+  delta.tail<3>() = perturbed.translation - cam_from_world.translation;
+  return delta;
+}
+
+TEST(RelativePoseCovariance, Nominal) {
+  const Rigid3d cam1_from_world(
+      Eigen::Quaterniond(Eigen::AngleAxisd(0.3, Eigen::Vector3d(1, 2, 3)
+                                                    .normalized())),
+      Eigen::Vector3d(1, -2, 3));
+  const Rigid3d cam2_from_world(
+      Eigen::Quaterniond(Eigen::AngleAxisd(-0.5, Eigen::Vector3d(-1, 0, 2)
+                                                     .normalized())),
+      Eigen::Vector3d(-2, 0.5, 1));
+  const Rigid3d cam2_from_cam1 = cam2_from_world * Inverse(cam1_from_world);
+
+  // Numeric Jacobian of the relative pose w.r.t. the perturbations of the
+  // poses.
+  const double kEps = 1e-6;
+  Eigen::Matrix<double, 6, 12> jacobian;
+  for (int i = 0; i < 12; ++i) {
+    Eigen::Matrix<double, 6, 1> delta = Eigen::Matrix<double, 6, 1>::Zero();
+    delta(i % 6) = kEps;
+    const Rigid3d perturbed_cam1_from_world =
+        i < 6 ? PerturbPose(cam1_from_world, delta) : cam1_from_world;
+    const Rigid3d perturbed_cam2_from_world =
+        i < 6 ? cam2_from_world : PerturbPose(cam2_from_world, delta);
+    jacobian.col(i) =
+        PoseDelta(cam2_from_cam1,
+                  perturbed_cam2_from_world *
+                      Inverse(perturbed_cam1_from_world)) /
+        kEps;
+  }
+
+  Eigen::Matrix<double, 12, 12> cov = Eigen::Matrix<double, 12, 12>::Random();
+  cov = cov * cov.transpose();
+  const Eigen::Matrix6d cov1 = cov.topLeftCorner<6, 6>();
+  const Eigen::Matrix6d cov2 = cov.bottomRightCorner<6, 6>();
+  const Eigen::Matrix6d cross_cov12 = cov.topRightCorner<6, 6>();
+
+  const Eigen::Matrix6d rel_cov = RelativePoseCovariance(
+      cam1_from_world, cam2_from_world, cov1, cov2, cross_cov12);
+  const Eigen::Matrix6d expected_rel_cov =
+      jacobian * cov * jacobian.transpose();
+  EXPECT_TRUE(rel_cov.isApprox(expected_rel_cov, 1e-4));
+}
+
+TEST(BundleAdjustmentCovarianceEstimator, Nominal) {
+  SetPRNGSeed(0);
+
+  Reconstruction reconstruction;
+  SyntheticDatasetOptions synthetic_dataset_options;
+  synthetic_dataset_options.num_cameras = 2;
+  synthetic_dataset_options.num_images = 5;
+  synthetic_dataset_options.num_points3D = 50;
+  synthetic_dataset_options.point2D_stddev = 0.5;
+  SynthesizeDataset(synthetic_dataset_options, &reconstruction);
+
+  BundleAdjustmentConfig config;
+  for (const image_t image_id : reconstruction.RegImageIds()) {
+    config.AddImage(image_id);
+  }
+  const image_t image_id0 = reconstruction.RegImageIds()[0];
+  const image_t image_id1 = reconstruction.RegImageIds()[1];
+  config.SetConstantCamPose(image_id0);
+  config.SetConstantCamPositions(image_id1, {0});
+
+  BundleAdjustmentOptions options;
+  options.print_summary = false;
+  BundleAdjuster bundle_adjuster(options, config);
+  ASSERT_TRUE(bundle_adjuster.Solve(&reconstruction));
+
+  ceres::Problem* problem = bundle_adjuster.Problem();
+  BundleAdjustmentCovarianceEstimator estimator(
+      BundleAdjustmentCovarianceOptions(), problem, &reconstruction);
+  ASSERT_TRUE(estimator.Compute());
+
+  // Reference covariances from the dense inverse of the normal equations.
+  std::vector<double*> parameter_blocks;
+  problem->GetParameterBlocks(&parameter_blocks);
+  std::vector<double*> variable_parameter_blocks;
+  std::unordered_map<const double*, int> cols;
+  int num_cols = 0;
+  for (double* parameter_block : parameter_blocks) {
+    if (!problem->IsParameterBlockConstant(parameter_block)) {
+      variable_parameter_blocks.push_back(parameter_block);
+      cols.emplace(parameter_block, num_cols);
+#if CERES_VERSION_MAJOR >= 3 || \
+    (CERES_VERSION_MAJOR == 2 && CERES_VERSION_MINOR >= 1)
+      num_cols += problem->ParameterBlockTangentSize(parameter_block);
+#else
+      num_cols += problem->ParameterBlockLocalSize(parameter_block);
+#endif
+    }
+  }
+  ceres::Problem::EvaluateOptions evaluate_options;
+  evaluate_options.parameter_blocks = variable_parameter_blocks;
+  double cost = 0;
+  ceres::CRSMatrix crs_jacobian;
+  ASSERT_TRUE(problem->Evaluate(
+      evaluate_options, &cost, nullptr, nullptr, &crs_jacobian));
+  Eigen::MatrixXd jacobian =
+      Eigen::MatrixXd::Zero(crs_jacobian.num_rows, crs_jacobian.num_cols);
+  for (int row = 0; row < crs_jacobian.num_rows; ++row) {
+    for (int idx = crs_jacobian.rows[row]; idx < crs_jacobian.rows[row + 1];
+         ++idx) {
+      jacobian(row, crs_jacobian.cols[idx]) = crs_jacobian.values[idx];
+    }
+  }
+  const Eigen::MatrixXd dense_cov =
+      (jacobian.transpose() * jacobian).inverse();
+
+  const auto pose_cols = [&](const image_t image_id) {
+    const Rigid3d& cam_from_world =
+        reconstruction.Image(image_id).CamFromWorld();
+    const int rotation_col = cols.at(cam_from_world.rotation.coeffs().data());
+    const int translation_col = cols.at(cam_from_world.translation.data());
+    return std::vector<int>{rotation_col,
+                            rotation_col + 1,
+                            rotation_col + 2,
+                            translation_col,
+                            translation_col + 1,
+                            translation_col + 2};
+  };
+
+  const auto dense_pose_cov = [&](const image_t image_id1,
+                                  const image_t image_id2) {
+    const std::vector<int> cols1 = pose_cols(image_id1);
+    const std::vector<int> cols2 = pose_cols(image_id2);
+    Eigen::Matrix6d cov;
+    for (int i = 0; i < 6; ++i) {
+      for (int j = 0; j < 6; ++j) {
+        // The quaternion manifold rotates by twice the tangent vector.
+        const double scale = (i < 3 ? 2 : 1) * (j < 3 ? 2 : 1);
+        cov(i, j) = scale * dense_cov(cols1[i], cols2[j]);
+      }
+    }
+    return cov;
+  };
+
+  EXPECT_FALSE(estimator.HasPose(image_id0));
+  EXPECT_TRUE(estimator.HasPose(image_id1));
+  EXPECT_EQ(estimator.PoseCovariance(image_id0), Eigen::Matrix6d::Zero());
+  const Eigen::Matrix6d cov1 = estimator.PoseCovariance(image_id1);
+  EXPECT_EQ(cov1.row(3), Eigen::Matrix<double, 1, 6>::Zero());
+  EXPECT_GT(cov1(4, 4), 0);
+
+  for (size_t i = 2; i < reconstruction.RegImageIds().size(); ++i) {
+    const image_t image_id = reconstruction.RegImageIds()[i];
+    ASSERT_TRUE(estimator.HasPose(image_id));
+    const Eigen::Matrix6d cov = estimator.PoseCovariance(image_id);
+    const Eigen::Matrix6d expected_cov = dense_pose_cov(image_id, image_id);
+    EXPECT_TRUE(cov.isApprox(expected_cov, 1e-6));
+
+    const image_t other_image_id = reconstruction.RegImageIds()[i - 1];
+    if (other_image_id == image_id1) {
+      continue;
+    }
+    Eigen::Matrix6d cross_cov;
+    ASSERT_TRUE(
+        estimator.PoseCrossCovariance(image_id, other_image_id, &cross_cov));
+    const Eigen::Matrix6d expected_cross_cov =
+        dense_pose_cov(image_id, other_image_id);
+    EXPECT_TRUE(cross_cov.isApprox(expected_cross_cov, 1e-6));
+  }
+}
+
+}  // namespace
+}  // namespace colmap
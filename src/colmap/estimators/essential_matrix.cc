@@ -30,11 +30,13 @@
 #include "colmap/estimators/essential_matrix.h"
 
 #include "colmap/estimators/utils.h"
+#include "colmap/geometry/pose.h"
 #include "colmap/math/math.h"
 #include "colmap/math/polynomial.h"
 #include "colmap/util/eigen_alignment.h"
 #include "colmap/util/logging.h"
 
+#include <array>
 #include <complex>
 
 #include <Eigen/Geometry>
@@ -42,6 +44,19 @@
 #include <Eigen/SVD>
 
 namespace colmap {
+namespace {
+
+// Multiply two polynomials with coefficients in increasing order of degree.
+Eigen::VectorXd MultiplyPolynomials(const Eigen::VectorXd& poly1,
+                                    const Eigen::VectorXd& poly2) {
+  Eigen::VectorXd poly = Eigen::VectorXd::Zero(poly1.size() + poly2.size() - 1);
+  for (Eigen::Index i = 0; i < poly1.size(); ++i) {
+    poly.segment(i, poly2.size()) += poly1(i) * poly2;
+  }
+  return poly;
+}
+
+}  // namespace
 
 void EssentialMatrixFivePointEstimator::Estimate(
     const std::vector<X_t>& points1,
@@ -103,21 +118,13 @@ void EssentialMatrixFivePointEstimator::Estimate(
   Eigen::Matrix<double, 11, 1> coeffs;
 #include "colmap/estimators/essential_matrix_coeffs.h"
 
-  Eigen::VectorXd roots_real;
-  Eigen::VectorXd roots_imag;
-  if (!FindPolynomialRootsCompanionMatrix(coeffs, &roots_real, &roots_imag)) {
-    return;
-  }
+  Eigen::Matrix<double, 10, 1> roots;
+  const int num_roots = FindRealPolynomialRootsSturm<10>(coeffs, &roots);
 
-  models->reserve(roots_real.size());
-
-  for (Eigen::VectorXd::Index i = 0; i < roots_imag.size(); ++i) {
-    const double kMaxRootImag = 1e-10;
-    if (std::abs(roots_imag(i)) > kMaxRootImag) {
-      continue;
-    }
+  models->reserve(num_roots);
 
-    const double z1 = roots_real(i);
+  for (int i = 0; i < num_roots; ++i) {
+    const double z1 = roots(i);
     const double z2 = z1 * z1;
     const double z3 = z2 * z1;
     const double z4 = z3 * z1;
@@ -218,4 +225,146 @@ void EssentialMatrixEightPointEstimator::Residuals(
   ComputeSquaredSampsonError(points1, points2, E, residuals);
 }
 
+void EssentialMatrixUprightThreePointEstimator::Estimate(
+    const std::vector<X_t>& points1,
+    const std::vector<Y_t>& points2,
+    std::vector<M_t>* models) const {
+  CHECK_EQ(points1.size(), 3);
+  CHECK_EQ(points2.size(), 3);
+  CHECK(models != nullptr);
+
+  models->clear();
+
+  const Eigen::Matrix3d upright1_from_cam1 =
+      ComputeUprightFromCam(gravity_in_cam1);
+  const Eigen::Matrix3d upright2_from_cam2 =
+      ComputeUprightFromCam(gravity_in_cam2);
+
+  std::vector<Eigen::Vector3d> rays1(3);
+  std::vector<Eigen::Vector3d> rays2(3);
+  for (size_t i = 0; i < 3; ++i) {
+    rays1[i] = upright1_from_cam1 * points1[i].homogeneous();
+    rays2[i] = upright2_from_cam2 * points2[i].homogeneous();
+  }
+
+  for (const double angle :
+       ComputeUprightThreePointRotationAngles(rays1, rays2)) {
+    const Eigen::Matrix3d R =
+        Eigen::AngleAxisd(angle, Eigen::Vector3d::UnitZ()).toRotationMatrix();
+
+    // The translation is orthogonal to the normals of the epipolar planes.
+    Eigen::Vector3d normals[3];
+    for (size_t i = 0; i < 3; ++i) {
+      normals[i] = (R * rays1[i]).cross(rays2[i]);
+    }
+    Eigen::Vector3d t = normals[0].cross(normals[1]);
+    for (const Eigen::Vector3d& t_candidate :
+         {normals[0].cross(normals[2]), normals[1].cross(normals[2])}) {
+      if (t_candidate.squaredNorm() > t.squaredNorm()) {
+        t = t_candidate;
+      }
+    }
+    if (t.squaredNorm() < std::numeric_limits<double>::epsilon()) {
+      continue;
+    }
+
+    models->push_back(upright2_from_cam2.transpose() *
+                      CrossProductMatrix(t.normalized()) * R *
+                      upright1_from_cam1);
+  }
+}
+
+void EssentialMatrixUprightThreePointEstimator::Residuals(
+    const std::vector<X_t>& points1,
+    const std::vector<Y_t>& points2,
+    const M_t& E,
+    std::vector<double>* residuals) {
+  ComputeSquaredSampsonError(points1, points2, E, residuals);
+}
+
+Eigen::Matrix3d ComputeUprightFromCam(const Eigen::Vector3d& gravity_in_cam) {
+  CHECK_GT(gravity_in_cam.squaredNorm(), 0);
+  return Eigen::Quaterniond::FromTwoVectors(gravity_in_cam,
+                                            Eigen::Vector3d::UnitZ())
+      .toRotationMatrix();
+}
+
+std::vector<double> ComputeUprightThreePointRotationAngles(
+    const std::vector<Eigen::Vector3d>& rays1,
+    const std::vector<Eigen::Vector3d>& rays2) {
+  CHECK_EQ(rays1.size(), 3);
+  CHECK_EQ(rays2.size(), 3);
+
+  // The normal of the epipolar plane of each correspondence is
+  //
+  //    n_i = (R_z x1_i) x x2_i = cos(angle) P_i + sin(angle) Q_i + W_i
+  //
+  // and the translation must be orthogonal to all normals, such that
+  // det([n_1 n_2 n_3]) = 0. Substituting cos(angle) = (1 - q^2) / (1 + q^2)
+  // and sin(angle) = 2 q / (1 + q^2) with q = tan(angle / 2) and multiplying
+  // by (1 + q^2)^3 yields a polynomial of degree 6 in q.
+  std::array<std::array<Eigen::Vector3d, 3>, 3> basis;
+  for (size_t i = 0; i < 3; ++i) {
+    const Eigen::Vector3d& x1 = rays1[i];
+    basis[i][0] = Eigen::Vector3d(x1(0), x1(1), 0).cross(rays2[i]);
+    basis[i][1] = Eigen::Vector3d(-x1(1), x1(0), 0).cross(rays2[i]);
+    basis[i][2] = Eigen::Vector3d(0, 0, x1(2)).cross(rays2[i]);
+  }
+
+  Eigen::VectorXd cos_poly(3);
+  cos_poly << 1, 0, -1;
+  Eigen::VectorXd sin_poly(2);
+  sin_poly << 0, 2;
+  Eigen::VectorXd one_poly(3);
+  one_poly << 1, 0, 1;
+  const std::array<Eigen::VectorXd, 3> factor_polys = {
+      {cos_poly, sin_poly, one_poly}};
+
+  Eigen::VectorXd poly = Eigen::VectorXd::Zero(7);
+  for (int k0 = 0; k0 < 3; ++k0) {
+    for (int k1 = 0; k1 < 3; ++k1) {
+      for (int k2 = 0; k2 < 3; ++k2) {
+        Eigen::Matrix3d N;
+        N << basis[0][k0], basis[1][k1], basis[2][k2];
+        const Eigen::VectorXd term =
+            MultiplyPolynomials(MultiplyPolynomials(factor_polys[k0],
+                                                    factor_polys[k1]),
+                                factor_polys[k2]);
+        poly.head(term.size()) += N.determinant() * term;
+      }
+    }
+  }
+
+  // Remove vanishing leading coefficients, whose roots are at infinity, i.e.,
+  // at an angle of 180 degrees.
+  const double kEps = 1e-12 * poly.cwiseAbs().maxCoeff();
+  Eigen::Index degree = poly.size() - 1;
+  while (degree > 0 && std::abs(poly(degree)) <= kEps) {
+    degree -= 1;
+  }
+
+  std::vector<double> angles;
+  if (std::abs(poly(degree)) <= kEps) {
+    return angles;
+  }
+  if (degree < 6) {
+    angles.push_back(EIGEN_PI);
+  }
+  if (degree == 0) {
+    return angles;
+  }
+
+  // The vanishing leading coefficients are zeroed, such that the root finder
+  // reduces the degree.
+  Eigen::Matrix<double, 7, 1> coeffs = Eigen::Matrix<double, 7, 1>::Zero();
+  coeffs.tail(degree + 1) = poly.head(degree + 1).reverse();
+  Eigen::Matrix<double, 6, 1> roots;
+  const int num_roots = FindRealPolynomialRootsSturm<6>(coeffs, &roots);
+  for (int i = 0; i < num_roots; ++i) {
+    angles.push_back(2 * std::atan(roots(i)));
+  }
+
+  return angles;
+}
+
 }  // namespace colmap
@@ -122,4 +122,60 @@ class EssentialMatrixEightPointEstimator {
                         std::vector<double>* residuals);
 };
 
+// Essential matrix estimator from corresponding normalized point pairs with
+// known gravity direction in both cameras, e.g., from the roll and pitch of an
+// inertial sensor. The relative rotation is then restricted to rotations about
+// the gravity direction, which leaves 3 degrees of freedom, based on:
+//
+//    F. Fraundorfer, P. Tanskanen, M. Pollefeys, A Minimal Case Solution to
+//    the Calibrated Relative Pose Problem for the Case of Two Known
+//    Orientation Angles, ECCV, 2010.
+//
+// In contrast to the paper, the solver computes the rotation angle as the
+// roots of a univariate polynomial of degree 6 in the tangent of its half.
+class EssentialMatrixUprightThreePointEstimator {
+ public:
+  typedef Eigen::Vector2d X_t;
+  typedef Eigen::Vector2d Y_t;
+  typedef Eigen::Matrix3d M_t;
+
+  // The minimum number of samples needed to estimate a model.
+  static const int kMinNumSamples = 3;
+
+  // The gravity direction in the first and second camera frame. Their norms
+  // are irrelevant, but their signs must be consistent.
+  Eigen::Vector3d gravity_in_cam1 = Eigen::Vector3d::UnitY();
+  Eigen::Vector3d gravity_in_cam2 = Eigen::Vector3d::UnitY();
+
+  // Estimate up to 6 possible essential matrix solutions from a set of
+  // 3 corresponding points.
+  //
+  // @param points1  First set of corresponding points.
+  // @param points2  Second set of corresponding points.
+  //
+  // @return         Up to 6 solutions as a vector of 3x3 essential matrices.
+  void Estimate(const std::vector<X_t>& points1,
+                const std::vector<Y_t>& points2,
+                std::vector<M_t>* models) const;
+
+  // Calculate the residuals of a set of corresponding points and a given
+  // essential matrix, see `EssentialMatrixFivePointEstimator::Residuals`.
+  static void Residuals(const std::vector<X_t>& points1,
+                        const std::vector<Y_t>& points2,
+                        const M_t& E,
+                        std::vector<double>* residuals);
+};
+
+// The rotation from a camera frame to a frame whose z-axis is aligned with
+// the given gravity direction in the camera frame.
+Eigen::Matrix3d ComputeUprightFromCam(const Eigen::Vector3d& gravity_in_cam);
+
+// Compute the rotation angles about the z-axis of the possible relative
+// rotations R_z between two upright frames, i.e., whose z-axes are aligned with
+// gravity, from three corresponding rays x1 and x2 in the upright frames, such
+// that x2' [t]x R_z x1 = 0.
+std::vector<double> ComputeUprightThreePointRotationAngles(
+    const std::vector<Eigen::Vector3d>& rays1,
+    const std::vector<Eigen::Vector3d>& rays2);
+
 }  // namespace colmap
@@ -157,5 +157,58 @@ TEST(EssentialMatrix, EightPoint) {
   EXPECT_TRUE(std::abs(s(2)) < 1e-5);
 }
 
+TEST(EssentialMatrix, UprightThreePoint) {
+  SetPRNGSeed(0);
+  for (int iter = 0; iter < 10; ++iter) {
+    // The cameras are arbitrarily rotated, but the gravity direction, i.e., the
+    // z-axis of the world frame, is known in both cameras.
+    const Rigid3d cam1_from_world(Eigen::Quaterniond::UnitRandom(),
+                                  Eigen::Vector3d::Random());
+    const Eigen::AngleAxisd rotation2_from_1(
+        RandomUniformReal(-0.5, 0.5), Eigen::Vector3d::Random().normalized());
+    const Rigid3d cam2_from_cam1(Eigen::Quaterniond(rotation2_from_1),
+                                 Eigen::Vector3d::Random());
+    const Rigid3d cam2_from_world = cam2_from_cam1 * cam1_from_world;
+
+    std::vector<Eigen::Vector2d> points1;
+    std::vector<Eigen::Vector2d> points2;
+    while (points1.size() < 3) {
+      const Eigen::Vector3d point3D_in_cam1(RandomUniformReal(-1.0, 1.0),
+                                            RandomUniformReal(-1.0, 1.0),
+                                            RandomUniformReal(2.0, 4.0));
+      const Eigen::Vector3d point3D_in_cam2 = cam2_from_cam1 * point3D_in_cam1;
+      if (point3D_in_cam2.z() > 0) {
+        points1.push_back(point3D_in_cam1.hnormalized());
+        points2.push_back(point3D_in_cam2.hnormalized());
+      }
+    }
+
+    EssentialMatrixUprightThreePointEstimator estimator;
+    estimator.gravity_in_cam1 =
+        cam1_from_world.rotation * Eigen::Vector3d::UnitZ();
+    estimator.gravity_in_cam2 =
+        cam2_from_world.rotation * Eigen::Vector3d::UnitZ();
+    std::vector<Eigen::Matrix3d> models;
+    estimator.Estimate(points1, points2, &models);
+
+    const Eigen::Matrix3d expected_E =
+        EssentialMatrixFromPose(cam2_from_cam1).normalized();
+    double min_error = std::numeric_limits<double>::max();
+    for (const Eigen::Matrix3d& E : models) {
+      const Eigen::Matrix3d normalized_E = E.normalized();
+      min_error = std::min({min_error,
+                            (normalized_E - expected_E).norm(),
+                            (normalized_E + expected_E).norm()});
+
+      std::vector<double> residuals;
+      estimator.Residuals(points1, points2, E, &residuals);
+      for (const double residual : residuals) {
+        EXPECT_LT(residual, 1e-12);
+      }
+    }
+    EXPECT_LT(min_error, 1e-6);
+  }
+}
+
 }  // namespace
 }  // namespace colmap
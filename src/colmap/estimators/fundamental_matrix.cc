@@ -110,21 +110,13 @@ void FundamentalMatrixSevenPointEstimator::Estimate(
               f1(8) * (f2(0) * f2(4) - f2(1) * f2(3));
   coeffs(3) = f2(0) * t3 - f2(1) * t4 + f2(2) * t5;
 
-  Eigen::VectorXd roots_real;
-  Eigen::VectorXd roots_imag;
-  if (!FindPolynomialRootsCompanionMatrix(coeffs, &roots_real, &roots_imag)) {
-    return;
-  }
-
-  models->reserve(roots_real.size());
+  Eigen::Vector3d roots;
+  const int num_roots = FindRealCubicPolynomialRoots(coeffs, &roots);
 
-  for (Eigen::VectorXd::Index i = 0; i < roots_real.size(); ++i) {
-    const double kMaxRootImag = 1e-10;
-    if (std::abs(roots_imag(i)) > kMaxRootImag) {
-      continue;
-    }
+  models->reserve(num_roots);
 
-    const double lambda = roots_real(i);
+  for (int i = 0; i < num_roots; ++i) {
+    const double lambda = roots(i);
     const double mu = 1;
 
     Eigen::MatrixXd F = lambda * f1 + mu * f2;
@@ -29,7 +29,9 @@
 
 #include "colmap/estimators/generalized_absolute_pose.h"
 
+#include "colmap/estimators/essential_matrix.h"
 #include "colmap/estimators/generalized_absolute_pose_coeffs.h"
+#include "colmap/geometry/pose.h"
 #include "colmap/math/polynomial.h"
 #include "colmap/util/logging.h"
 
@@ -89,9 +91,8 @@ Eigen::Vector3d PointFromPlueckerLineAndDepth(const Eigen::Vector6d& pluecker,
 //    B_fi = q_i x q_i' + lambda_i * q_i.
 //
 Eigen::Matrix<double, 3, 6> ComputePolynomialCoefficients(
-    const std::vector<Eigen::Vector6d>& plueckers,
+    const std::array<Eigen::Vector6d, 3>& plueckers,
     const std::vector<Eigen::Vector3d>& points3D) {
-  CHECK_EQ(plueckers.size(), 3);
   CHECK_EQ(points3D.size(), 3);
 
   Eigen::Matrix<double, 3, 6> K;
@@ -130,101 +131,83 @@ int SolveQuadratic(const double b, const double c, double* roots) {
   }
 }
 
-// Given lambda_j, return the values for lambda_i, where:
+// Given lambda_j, return the at most 2 positive values for lambda_i, where:
 //     k1 lambda_i^2 + (k2 lambda_j + k3) lambda_i
 //      + k4 lambda_j^2 + k5 lambda_j + k6          = 0.
-void ComputeLambdaValues(const Eigen::Matrix<double, 3, 6>::ConstRowXpr& k,
-                         const double lambda_j,
-                         std::vector<double>* lambdas_i) {
+int ComputeLambdaValues(const Eigen::Matrix<double, 3, 6>::ConstRowXpr& k,
+                        const double lambda_j,
+                        double* lambdas_i) {
   // Note that we solve x^2 + bx + c = 0, since k(0) is one.
   double roots[2];
   const int num_solutions =
       SolveQuadratic(k(1) * lambda_j + k(2),
                      lambda_j * (k(3) * lambda_j + k(4)) + k(5),
                      roots);
+  int num_lambdas = 0;
   for (int i = 0; i < num_solutions; ++i) {
     if (roots[i] > 0) {
-      lambdas_i->push_back(roots[i]);
+      lambdas_i[num_lambdas] = roots[i];
+      num_lambdas += 1;
     }
   }
+  return num_lambdas;
 }
 
 // Given the coefficients of the polynomial system return the depths of the
 // points along the Pluecker lines. Use Sylvester resultant to get and 8th
 // degree polynomial for lambda_3 and back-substite in the original equations.
-std::vector<Eigen::Vector3d> ComputeDepthsSylvester(
-    const Eigen::Matrix<double, 3, 6>& K) {
+void ComputeDepthsSylvester(const Eigen::Matrix<double, 3, 6>& K,
+                            std::vector<Eigen::Vector3d>* depths) {
+  depths->clear();
+
   const Eigen::Matrix<double, 9, 1> coeffs = ComputeDepthsSylvesterCoeffs(K);
 
-  Eigen::VectorXd roots_real;
-  Eigen::VectorXd roots_imag;
-  if (!FindPolynomialRootsCompanionMatrix(coeffs, &roots_real, &roots_imag)) {
-    return std::vector<Eigen::Vector3d>();
-  }
+  Eigen::Matrix<double, 8, 1> roots;
+  const int num_roots = FindRealPolynomialRootsSturm<8>(coeffs, &roots);
 
   // Back-substitute every lambda_3 to the system of equations.
-  std::vector<Eigen::Vector3d> depths;
-  depths.reserve(roots_real.size());
-  for (Eigen::VectorXd::Index i = 0; i < roots_real.size(); ++i) {
-    const double kMaxRootImagRatio = 1e-3;
-    if (std::abs(roots_imag(i)) > kMaxRootImagRatio * std::abs(roots_real(i))) {
-      continue;
-    }
-
-    const double lambda_3 = roots_real(i);
+  for (int i = 0; i < num_roots; ++i) {
+    const double lambda_3 = roots(i);
     if (lambda_3 <= 0) {
       continue;
     }
 
-    std::vector<double> lambdas_2;
-    ComputeLambdaValues(K.row(2), lambda_3, &lambdas_2);
+    double lambdas_2[2];
+    const int num_lambdas_2 =
+        ComputeLambdaValues(K.row(2), lambda_3, lambdas_2);
 
     // Now we have two depths, lambda_2 and lambda_3. From the two remaining
     // equations, we must get the same lambda_1, otherwise the solution is
     // invalid.
-    for (const double lambda_2 : lambdas_2) {
-      std::vector<double> lambdas_1_1;
-      ComputeLambdaValues(K.row(0), lambda_2, &lambdas_1_1);
-      std::vector<double> lambdas_1_2;
-      ComputeLambdaValues(K.row(1), lambda_3, &lambdas_1_2);
-      for (const double lambda_1_1 : lambdas_1_1) {
-        for (const double lambda_1_2 : lambdas_1_2) {
+    for (int i2 = 0; i2 < num_lambdas_2; ++i2) {
+      const double lambda_2 = lambdas_2[i2];
+      double lambdas_1_1[2];
+      const int num_lambdas_1_1 =
+          ComputeLambdaValues(K.row(0), lambda_2, lambdas_1_1);
+      double lambdas_1_2[2];
+      const int num_lambdas_1_2 =
+          ComputeLambdaValues(K.row(1), lambda_3, lambdas_1_2);
+      for (int i11 = 0; i11 < num_lambdas_1_1; ++i11) {
+        for (int i12 = 0; i12 < num_lambdas_1_2; ++i12) {
+          const double lambda_1_1 = lambdas_1_1[i11];
+          const double lambda_1_2 = lambdas_1_2[i12];
           const double kMaxLambdaRatio = 1e-2;
           if (std::abs(lambda_1_1 - lambda_1_2) <
               kMaxLambdaRatio * std::max(lambda_1_1, lambda_1_2)) {
             const double lambda_1 = (lambda_1_1 + lambda_1_2) / 2;
-            depths.emplace_back(lambda_1, lambda_2, lambda_3);
+            depths->emplace_back(lambda_1, lambda_2, lambda_3);
           }
         }
       }
     }
   }
-
-  return depths;
 }
 
-}  // namespace
-
-void GP3PEstimator::Estimate(const std::vector<X_t>& points2D,
-                             const std::vector<Y_t>& points3D,
-                             std::vector<M_t>* models) {
-  CHECK_EQ(points2D.size(), 3);
-  CHECK_EQ(points3D.size(), 3);
-  CHECK(models != nullptr);
-
-  models->clear();
-
-  if (CheckCollinearPoints(points3D[0], points3D[1], points3D[2])) {
-    return;
-  }
-
-  // Transform 2D points into compact Pluecker line representation.
-  std::vector<Eigen::Vector6d> plueckers(3);
-  for (size_t i = 0; i < 3; ++i) {
-    plueckers[i] = ComposePlueckerLine(Inverse(points2D[i].cam_from_rig),
-                                       points2D[i].ray_in_cam);
-  }
-
+// Estimate the rig_from_world poses from the Pluecker lines of three
+// observations in the generalized camera and their corresponding 3D points.
+void EstimateFromPlueckerLines(const std::array<Eigen::Vector6d, 3>& plueckers,
+                               const std::vector<Eigen::Vector3d>& points3D,
+                               std::vector<Rigid3d>* models) {
   if (CheckParallelRays(plueckers[0].head<3>(),
                         plueckers[1].head<3>(),
                         plueckers[2].head<3>())) {
@@ -235,8 +218,10 @@ void GP3PEstimator::Estimate(const std::vector<X_t>& points2D,
   const Eigen::Matrix<double, 3, 6> K =
       ComputePolynomialCoefficients(plueckers, points3D);
 
-  // Compute the depths along the Pluecker lines of the observations.
-  const std::vector<Eigen::Vector3d> depths = ComputeDepthsSylvester(K);
+  // Compute the depths along the Pluecker lines of the observations. The
+  // buffer is reused across calls to avoid heap allocations in the RANSAC loop.
+  thread_local std::vector<Eigen::Vector3d> depths;
+  ComputeDepthsSylvester(K, &depths);
   if (depths.empty()) {
     return;
   }
@@ -267,6 +252,31 @@ void GP3PEstimator::Estimate(const std::vector<X_t>& points2D,
   }
 }
 
+}  // namespace
+
+void GP3PEstimator::Estimate(const std::vector<X_t>& points2D,
+                             const std::vector<Y_t>& points3D,
+                             std::vector<M_t>* models) {
+  CHECK_EQ(points2D.size(), 3);
+  CHECK_EQ(points3D.size(), 3);
+  CHECK(models != nullptr);
+
+  models->clear();
+
+  if (CheckCollinearPoints(points3D[0], points3D[1], points3D[2])) {
+    return;
+  }
+
+  // Transform 2D points into compact Pluecker line representation.
+  std::array<Eigen::Vector6d, 3> plueckers;
+  for (size_t i = 0; i < 3; ++i) {
+    plueckers[i] = ComposePlueckerLine(Inverse(points2D[i].cam_from_rig),
+                                       points2D[i].ray_in_cam);
+  }
+
+  EstimateFromPlueckerLines(plueckers, points3D, models);
+}
+
 void GP3PEstimator::Residuals(const std::vector<X_t>& points2D,
                               const std::vector<Y_t>& points3D,
                               const M_t& rig_from_world,
@@ -295,4 +305,124 @@ void GP3PEstimator::Residuals(const std::vector<X_t>& points2D,
   }
 }
 
+void GP3PRayEstimator::Estimate(const std::vector<X_t>& rays,
+                                const std::vector<Y_t>& points3D,
+                                std::vector<M_t>* models) {
+  CHECK_EQ(rays.size(), 3);
+  CHECK_EQ(points3D.size(), 3);
+  CHECK(models != nullptr);
+
+  models->clear();
+
+  if (CheckCollinearPoints(points3D[0], points3D[1], points3D[2])) {
+    return;
+  }
+
+  std::array<Eigen::Vector6d, 3> plueckers;
+  for (size_t i = 0; i < 3; ++i) {
+    const Eigen::Vector3d direction = rays[i].direction.normalized();
+    plueckers[i] << direction, rays[i].origin.cross(direction);
+  }
+
+  EstimateFromPlueckerLines(plueckers, points3D, models);
+}
+
+void GP3PRayEstimator::Residuals(const std::vector<X_t>& rays,
+                                 const std::vector<Y_t>& points3D,
+                                 const M_t& rig_from_world,
+                                 std::vector<double>* residuals) {
+  CHECK_EQ(rays.size(), points3D.size());
+  residuals->resize(rays.size(), 0);
+  const Eigen::Matrix3x4d rig_from_world_matrix = rig_from_world.ToMatrix();
+  for (size_t i = 0; i < rays.size(); ++i) {
+    const Eigen::Vector3d point3D_in_ray =
+        rig_from_world_matrix * points3D[i].homogeneous() - rays[i].origin;
+    // Check if 3D point is in front of the origin of the ray.
+    if (point3D_in_ray.z() > std::numeric_limits<double>::epsilon()) {
+      (*residuals)[i] =
+          (point3D_in_ray.hnormalized() - rays[i].direction.hnormalized())
+              .squaredNorm();
+    } else {
+      (*residuals)[i] = std::numeric_limits<double>::max();
+    }
+  }
+}
+
+void UprightGP2PEstimator::Estimate(const std::vector<X_t>& rays,
+                                    const std::vector<Y_t>& points3D,
+                                    std::vector<M_t>* models) const {
+  CHECK_EQ(rays.size(), 2);
+  CHECK_EQ(points3D.size(), 2);
+  CHECK(models != nullptr);
+
+  models->clear();
+
+  const Eigen::Matrix3d upright_from_rig =
+      ComputeUprightFromCam(gravity_in_rig);
+
+  // In the upright frame, the rotation R_z about the z-axis is parameterized by
+  // c = cos(angle) and s = sin(angle), such that the constraint that the 3D
+  // point lies on the ray
+  //
+  //    d x (R_z X + t - o) = 0
+  //
+  // is linear in the unknowns (c, s, t) and yields 2 independent equations per
+  // correspondence. The solutions of the 6x5 linear system form a line, which
+  // intersects the unit circle c^2 + s^2 = 1 in up to 2 points.
+  Eigen::Matrix<double, 6, 5> A;
+  Eigen::Matrix<double, 6, 1> b;
+  for (size_t i = 0; i < 2; ++i) {
+    const Eigen::Matrix3d direction_x =
+        CrossProductMatrix(upright_from_rig * rays[i].direction);
+    const Eigen::Vector3d& X = points3D[i];
+    A.block<3, 1>(3 * i, 0) = direction_x * Eigen::Vector3d(X(0), X(1), 0);
+    A.block<3, 1>(3 * i, 1) = direction_x * Eigen::Vector3d(-X(1), X(0), 0);
+    A.block<3, 3>(3 * i, 2) = direction_x;
+    b.segment<3>(3 * i) =
+        direction_x *
+        (upright_from_rig * rays[i].origin - Eigen::Vector3d(0, 0, X(2)));
+  }
+
+  const Eigen::JacobiSVD<Eigen::Matrix<double, 6, 5>> svd(
+      A, Eigen::ComputeFullU | Eigen::ComputeFullV);
+  const Eigen::Matrix<double, 5, 1> singular_values = svd.singularValues();
+  if (singular_values(3) <= 1e-10 * singular_values(0)) {
+    return;
+  }
+
+  // The particular solution in the 4-dimensional row space and the nullspace.
+  Eigen::Matrix<double, 5, 1> x0 = Eigen::Matrix<double, 5, 1>::Zero();
+  for (int i = 0; i < 4; ++i) {
+    x0 += svd.matrixU().col(i).dot(b) / singular_values(i) *
+          svd.matrixV().col(i);
+  }
+  const Eigen::Matrix<double, 5, 1> x1 = svd.matrixV().col(4);
+
+  Eigen::VectorXd coeffs(3);
+  coeffs << x1.head<2>().squaredNorm(), 2 * x0.head<2>().dot(x1.head<2>()),
+      x0.head<2>().squaredNorm() - 1;
+  Eigen::VectorXd lambdas;
+  Eigen::VectorXd lambdas_imag;
+  if (!FindQuadraticPolynomialRoots(coeffs, &lambdas, &lambdas_imag) ||
+      (lambdas_imag.array() != 0).any()) {
+    return;
+  }
+
+  const Eigen::Matrix3d rig_from_upright = upright_from_rig.transpose();
+  for (Eigen::Index i = 0; i < lambdas.size(); ++i) {
+    const Eigen::Matrix<double, 5, 1> x = x0 + lambdas(i) * x1;
+    Eigen::Matrix3d R_z;
+    R_z << x(0), -x(1), 0, x(1), x(0), 0, 0, 0, 1;
+    models->emplace_back(Eigen::Quaterniond(rig_from_upright * R_z),
+                         rig_from_upright * x.tail<3>());
+  }
+}
+
+void UprightGP2PEstimator::Residuals(const std::vector<X_t>& rays,
+                                     const std::vector<Y_t>& points3D,
+                                     const M_t& rig_from_world,
+                                     std::vector<double>* residuals) {
+  GP3PRayEstimator::Residuals(rays, points3D, rig_from_world, residuals);
+}
+
 }  // namespace colmap
@@ -88,4 +88,77 @@ class GP3PEstimator {
                  std::vector<double>* residuals);
 };
 
+// Solver for the Generalized P3P problem as in GP3PEstimator, where the
+// observations are given directly as rays in the frame of the generalized
+// camera. This avoids composing the relative camera poses for every sample
+// and residual evaluation, e.g., for the virtual cameras of refractive cameras.
+class GP3PRayEstimator {
+ public:
+  // A ray with its origin and direction in the frame of the generalized
+  // camera. The direction must not be parallel to the xy-plane of the frame.
+  struct X_t {
+    Eigen::Vector3d origin;
+    Eigen::Vector3d direction;
+  };
+
+  // The observed 3D feature points in the world frame.
+  typedef Eigen::Vector3d Y_t;
+  // The estimated rig_from_world pose of the generalized camera.
+  typedef Rigid3d M_t;
+
+  // The minimum number of samples needed to estimate a model.
+  static const int kMinNumSamples = 3;
+
+  // Estimate the most probable solution of the GP3P problem from a set of
+  // three ray-3D point correspondences.
+  static void Estimate(const std::vector<X_t>& rays,
+                       const std::vector<Y_t>& points3D,
+                       std::vector<M_t>* models);
+
+  // Calculate the squared reprojection error in normalized coordinates of a
+  // camera with the orientation of the generalized camera that is centered at
+  // the origin of the ray.
+  static void Residuals(const std::vector<X_t>& rays,
+                        const std::vector<Y_t>& points3D,
+                        const M_t& rig_from_world,
+                        std::vector<double>* residuals);
+};
+
+// Solver for the generalized absolute pose problem with known gravity
+// direction in the frame of the generalized camera, e.g., from the roll and
+// pitch of an inertial sensor. The z-axis of the world frame must be parallel
+// to gravity, such that the unknown rotation is restricted to rotations about
+// gravity and the pose has 4 degrees of freedom, which are estimated from 2
+// ray-3D point correspondences, see:
+//
+//    Z. Kukelova, M. Bujnak, T. Pajdla, Closed-form solutions to minimal
+//    absolute pose problems with known vertical direction, ACCV, 2010.
+//
+// The observations are given as in GP3PRayEstimator, where a central camera
+// has rays with zero origin.
+class UprightGP2PEstimator {
+ public:
+  typedef GP3PRayEstimator::X_t X_t;
+  typedef GP3PRayEstimator::Y_t Y_t;
+  typedef GP3PRayEstimator::M_t M_t;
+
+  // The minimum number of samples needed to estimate a model.
+  static const int kMinNumSamples = 2;
+
+  // The gravity direction, i.e., the direction of the z-axis of the world
+  // frame, in the frame of the generalized camera.
+  Eigen::Vector3d gravity_in_rig = Eigen::Vector3d::UnitZ();
+
+  // Estimate up to 2 solutions from a set of two ray-3D point correspondences.
+  void Estimate(const std::vector<X_t>& rays,
+                const std::vector<Y_t>& points3D,
+                std::vector<M_t>* models) const;
+
+  // Calculate the residuals, see `GP3PRayEstimator::Residuals`.
+  static void Residuals(const std::vector<X_t>& rays,
+                        const std::vector<Y_t>& points3D,
+                        const M_t& rig_from_world,
+                        std::vector<double>* residuals);
+};
+
 }  // namespace colmap
@@ -0,0 +1,124 @@
+#include "colmap/estimators/generalized_absolute_pose.h"
+#include "colmap/estimators/generalized_pose.h"
+#include "colmap/geometry/rigid3.h"
+#include "colmap/math/random.h"
+#include "colmap/scene/camera.h"
+
+#include <benchmark/benchmark.h>
+
+namespace colmap {
+namespace {
+
+// Observations of a refractive camera, where every correspondence is observed
+// by its own virtual camera, as in the registration of refractive images.
+struct RefractiveCameraProblem {
+  Rigid3d cam_from_world;
+  std::vector<Eigen::Vector2d> points2D;
+  std::vector<Eigen::Vector3d> points3D;
+  VirtualPinholeCameras virtual_cameras;
+  std::vector<GP3PEstimator::X_t> rays;
+};
+
+RefractiveCameraProblem BuildRefractiveCameraProblem(const size_t num_points) {
+  SetPRNGSeed(0);
+
+  Camera camera =
+      Camera::CreateFromModelName(1, "SIMPLE_PINHOLE", 1000.0, 1000, 800);
+  camera.refrac_model_id = CameraRefracModelId::kFlatPort;
+  camera.refrac_params = {0.1, 0.05, 0.99, 0.05, 0.007, 1.0, 1.52, 1.33};
+  Eigen::Map<Eigen::Vector3d>(camera.refrac_params.data()).normalize();
+
+  RefractiveCameraProblem problem;
+  problem.cam_from_world =
+      Rigid3d(Eigen::Quaterniond(1, 0.1, -0.05, 0.02).normalized(),
+              Eigen::Vector3d(0.5, -0.2, 0.3));
+  const Rigid3d world_from_cam = Inverse(problem.cam_from_world);
+  for (size_t i = 0; i < num_points; ++i) {
+    const Eigen::Vector2d point2D(RandomUniformReal(0.0, 1000.0),
+                                  RandomUniformReal(0.0, 800.0));
+    const double depth = RandomUniformReal(1.0, 5.0);
+    problem.points2D.push_back(point2D);
+    problem.points3D.push_back(world_from_cam *
+                               camera.CamFromImgRefracPoint(point2D, depth));
+  }
+  camera.ComputeVirtuals(problem.points2D, &problem.virtual_cameras);
+
+  for (size_t i = 0; i < num_points; ++i) {
+    GP3PEstimator::X_t ray;
+    ray.cam_from_rig = problem.virtual_cameras.VirtualFromReal(i);
+    ray.ray_in_cam = problem.virtual_cameras.CamFromImg(i, problem.points2D[i])
+                         .homogeneous()
+                         .normalized();
+    problem.rays.push_back(ray);
+  }
+
+  return problem;
+}
+
+void BM_GP3PEstimate(benchmark::State& state) {
+  const RefractiveCameraProblem problem =
+      BuildRefractiveCameraProblem(GP3PEstimator::kMinNumSamples);
+  std::vector<GP3PEstimator::M_t> models;
+  for (auto _ : state) {
+    GP3PEstimator::Estimate(problem.rays, problem.points3D, &models);
+    benchmark::DoNotOptimize(models.data());
+  }
+}
+BENCHMARK(BM_GP3PEstimate);
+
+void BM_GP3PResiduals(benchmark::State& state) {
+  const RefractiveCameraProblem problem =
+      BuildRefractiveCameraProblem(state.range(0));
+  GP3PEstimator estimator;
+  estimator.residual_type =
+      static_cast<GP3PEstimator::ResidualType>(state.range(1));
+  std::vector<double> residuals;
+  for (auto _ : state) {
+    estimator.Residuals(
+        problem.rays, problem.points3D, problem.cam_from_world, &residuals);
+    benchmark::DoNotOptimize(residuals.data());
+  }
+  state.SetItemsProcessed(state.iterations() * problem.rays.size());
+}
+BENCHMARK(BM_GP3PResiduals)
+    ->Args({1000,
+            static_cast<int>(GP3PEstimator::ResidualType::CosineDistance)})
+    ->Args({1000,
+            static_cast<int>(GP3PEstimator::ResidualType::ReprojectionError)});
+
+// The full RANSAC estimation with 20% outliers, as used in the registration of
+// refractive images.
+void BM_EstimateGeneralizedAbsolutePoseRefrac(benchmark::State& state) {
+  RefractiveCameraProblem problem =
+      BuildRefractiveCameraProblem(state.range(0));
+  for (size_t i = 0; i < problem.points2D.size(); i += 5) {
+    problem.points2D[i] += Eigen::Vector2d(50, -50);
+  }
+
+  RANSACOptions ransac_options;
+  ransac_options.max_error = 2;
+  ransac_options.min_inlier_ratio = 0.4;
+  ransac_options.confidence = 0.99999;
+
+  Rigid3d cam_from_world;
+  size_t num_inliers;
+  std::vector<char> inlier_mask;
+  for (auto _ : state) {
+    // Reset the seed, such that all iterations sample the same hypotheses.
+    state.PauseTiming();
+    SetPRNGSeed(0);
+    state.ResumeTiming();
+    benchmark::DoNotOptimize(
+        EstimateGeneralizedAbsolutePose(ransac_options,
+                                        problem.points2D,
+                                        problem.points3D,
+                                        problem.virtual_cameras,
+                                        &cam_from_world,
+                                        &num_inliers,
+                                        &inlier_mask));
+  }
+}
+BENCHMARK(BM_EstimateGeneralizedAbsolutePoseRefrac)->Arg(100)->Arg(1000);
+
+}  // namespace
+}  // namespace colmap
@@ -31,6 +31,7 @@
 
 #include "colmap/geometry/pose.h"
 #include "colmap/geometry/rigid3.h"
+#include "colmap/math/random.h"
 #include "colmap/optim/ransac.h"
 #include "colmap/util/eigen_alignment.h"
 
@@ -118,5 +119,112 @@ TEST(GeneralizedAbsolutePose, Estimate) {
   }
 }
 
+TEST(GeneralizedAbsolutePose, EstimateFromRays) {
+  std::vector<Eigen::Vector3d> points3D;
+  points3D.emplace_back(1, 1, 1);
+  points3D.emplace_back(0, 1, 1);
+  points3D.emplace_back(3, 1.0, 4);
+  points3D.emplace_back(3, 1.1, 4);
+  points3D.emplace_back(3, 1.2, 4);
+  points3D.emplace_back(3, 1.3, 4);
+  points3D.emplace_back(3, 1.4, 4);
+  points3D.emplace_back(2, 1, 7);
+
+  auto points3D_faulty = points3D;
+  for (size_t i = 0; i < points3D.size(); ++i) {
+    points3D_faulty[i](0) = 20;
+  }
+
+  // NOLINTNEXTLINE(clang-analyzer-security.FloatLoopCounter)
+  for (double qx = 0; qx < 1; qx += 0.2) {
+    // NOLINTNEXTLINE(clang-analyzer-security.FloatLoopCounter)
+    for (double tx = 0; tx < 1; tx += 0.1) {
+      const Rigid3d rig_from_world(
+          Eigen::Quaterniond(1, qx, 0, 0).normalized(),
+          Eigen::Vector3d(tx, 0, 0));
+
+      // Rays with different origins in the rig frame.
+      std::vector<GP3PRayEstimator::X_t> rays;
+      for (size_t i = 0; i < points3D.size(); ++i) {
+        rays.emplace_back();
+        rays.back().origin = Eigen::Vector3d(0, 0.1 * (i % 3) - 0.1, 0);
+        rays.back().direction =
+            (rig_from_world * points3D[i] - rays.back().origin).normalized();
+      }
+
+      RANSACOptions options;
+      options.max_error = 1e-5;
+      RANSAC<GP3PRayEstimator> ransac(options);
+      const auto report = ransac.Estimate(rays, points3D);
+
+      EXPECT_TRUE(report.success);
+      EXPECT_LT((rig_from_world.ToMatrix() - report.model.ToMatrix()).norm(),
+                1e-2)
+          << report.model.ToMatrix() << "\n\n"
+          << rig_from_world.ToMatrix();
+
+      // Test residuals of exact points.
+      std::vector<double> residuals;
+      ransac.estimator.Residuals(rays, points3D, report.model, &residuals);
+      for (size_t i = 0; i < residuals.size(); ++i) {
+        EXPECT_LT(residuals[i], 1e-10);
+      }
+
+      // Test residuals of faulty points.
+      ransac.estimator.Residuals(
+          rays, points3D_faulty, report.model, &residuals);
+      for (size_t i = 0; i < residuals.size(); ++i) {
+        EXPECT_GT(residuals[i], 1e-10);
+      }
+    }
+  }
+}
+
+TEST(GeneralizedAbsolutePose, EstimateUpright) {
+  SetPRNGSeed(0);
+  for (int iter = 0; iter < 10; ++iter) {
+    const Rigid3d rig_from_world(Eigen::Quaterniond::UnitRandom(),
+                                 Eigen::Vector3d::Random());
+    const Rigid3d world_from_rig = Inverse(rig_from_world);
+
+    // Rays with different origins in the rig frame.
+    std::vector<GP3PRayEstimator::X_t> rays(10);
+    std::vector<Eigen::Vector3d> points3D(rays.size());
+    for (size_t i = 0; i < rays.size(); ++i) {
+      rays[i].origin = 0.1 * Eigen::Vector3d::Random();
+      rays[i].direction = Eigen::Vector3d(RandomUniformReal(-0.5, 0.5),
+                                          RandomUniformReal(-0.5, 0.5),
+                                          1);
+      points3D[i] = world_from_rig * (rays[i].origin +
+                                      RandomUniformReal(1.0, 5.0) *
+                                          rays[i].direction);
+    }
+
+    UprightGP2PEstimator estimator;
+    estimator.gravity_in_rig =
+        rig_from_world.rotation * Eigen::Vector3d::UnitZ();
+    std::vector<Rigid3d> models;
+    estimator.Estimate({rays[0], rays[1]}, {points3D[0], points3D[1]}, &models);
+
+    double min_error = std::numeric_limits<double>::max();
+    for (const Rigid3d& model : models) {
+      min_error = std::min(
+          min_error,
+          (rig_from_world.ToMatrix() - model.ToMatrix()).norm());
+    }
+    EXPECT_LT(min_error, 1e-6);
+
+    RANSACOptions options;
+    options.max_error = 1e-5;
+    RANSAC<UprightGP2PEstimator> ransac(options);
+    ransac.estimator.gravity_in_rig = estimator.gravity_in_rig;
+    const auto report = ransac.Estimate(rays, points3D);
+    EXPECT_TRUE(report.success);
+    EXPECT_EQ(report.support.num_inliers, rays.size());
+    EXPECT_LT((rig_from_world.ToMatrix() - report.model.ToMatrix()).norm(),
+              1e-6);
+  }
+}
+
 }  // namespace
 }  // namespace colmap
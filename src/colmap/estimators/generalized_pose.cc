@@ -96,6 +96,140 @@ std::vector<size_t> ComputeUniquePointIds(
   return unique_point3D_ids;
 }
 
+bool EstimateGeneralizedAbsolutePoseFromRigPoints(
+    const RANSACOptions& options,
+    const std::vector<GP3PEstimator::X_t>& rig_points2D,
+    const std::vector<Eigen::Vector3d>& points3D,
+    const double max_error_cam,
+    Rigid3d* rig_from_world,
+    size_t* num_inliers,
+    std::vector<char>* inlier_mask) {
+  // Associate unique ids to each 3D point.
+  // Needed for UniqueInlierSupportMeasurer to avoid counting the same
+  // 3D point multiple times due to FoV overlap in rig.
+  // TODO(sarlinpe): Allow passing unique_point3D_ids as argument.
+  const std::vector<size_t> unique_point3D_ids =
+      ComputeUniquePointIds(points3D);
+
+  RANSACOptions options_copy(options);
+  options_copy.max_error = max_error_cam;
+
+  RANSAC<GP3PEstimator, UniqueInlierSupportMeasurer> ransac(options_copy);
+  ransac.support_measurer.SetUniqueSampleIds(unique_point3D_ids);
+  ransac.estimator.residual_type =
+      GP3PEstimator::ResidualType::ReprojectionError;
+  const auto report = ransac.Estimate(rig_points2D, points3D);
+  if (!report.success) {
+    return false;
+  }
+  *rig_from_world = report.model;
+  *num_inliers = report.support.num_unique_inliers;
+  *inlier_mask = report.inlier_mask;
+  return true;
+}
+
+// The rays of the correspondences observed by virtual cameras in the frame of
+// the real camera, whose orientation is shared by all virtual cameras.
+std::vector<GP3PRayEstimator::X_t> ComputeVirtualCameraRays(
+    const std::vector<Eigen::Vector2d>& points2D,
+    const VirtualPinholeCameras& virtual_cameras) {
+  std::vector<GP3PRayEstimator::X_t> rays(points2D.size());
+  for (size_t i = 0; i < points2D.size(); i++) {
+    rays[i].origin = virtual_cameras.centers[i];
+    rays[i].direction =
+        virtual_cameras.CamFromImg(i, points2D[i]).homogeneous();
+  }
+  return rays;
+}
+
+template <typename Report>
+bool ExtractGeneralizedAbsolutePose(const Report& report,
+                                    Rigid3d* rig_from_world,
+                                    size_t* num_inliers,
+                                    std::vector<char>* inlier_mask) {
+  if (!report.success) {
+    return false;
+  }
+  *rig_from_world = report.model;
+  *num_inliers = report.support.num_unique_inliers;
+  *inlier_mask = report.inlier_mask;
+  return true;
+}
+
+// The upright solver is used if the gravity direction in the frame of the
+// generalized camera is non-zero.
+bool EstimateGeneralizedAbsolutePoseFromRays(
+    const RANSACOptions& options,
+    const std::vector<GP3PRayEstimator::X_t>& rays,
+    const std::vector<Eigen::Vector3d>& points3D,
+    const Eigen::Vector3d& gravity_in_rig,
+    Rigid3d* rig_from_world,
+    size_t* num_inliers,
+    std::vector<char>* inlier_mask) {
+  const std::vector<size_t> unique_point3D_ids =
+      ComputeUniquePointIds(points3D);
+
+  if (gravity_in_rig != Eigen::Vector3d::Zero()) {
+    RANSAC<UprightGP2PEstimator, UniqueInlierSupportMeasurer> ransac(options);
+    ransac.estimator.gravity_in_rig = gravity_in_rig;
+    ransac.support_measurer.SetUniqueSampleIds(unique_point3D_ids);
+    return ExtractGeneralizedAbsolutePose(ransac.Estimate(rays, points3D),
+                                          rig_from_world,
+                                          num_inliers,
+                                          inlier_mask);
+  }
+
+  RANSAC<GP3PRayEstimator, UniqueInlierSupportMeasurer> ransac(options);
+  ransac.support_measurer.SetUniqueSampleIds(unique_point3D_ids);
+  return ExtractGeneralizedAbsolutePose(ransac.Estimate(rays, points3D),
+                                        rig_from_world,
+                                        num_inliers,
+                                        inlier_mask);
+}
+
+bool SolveGeneralizedAbsolutePoseProblem(
+    const AbsolutePoseRefinementOptions& options,
+    ceres::Problem* problem,
+    Rigid3d* rig_from_world,
+    Eigen::Matrix6d* rig_from_world_cov) {
+  double* rig_from_world_rotation = rig_from_world->rotation.coeffs().data();
+  double* rig_from_world_translation = rig_from_world->translation.data();
+
+  ceres::Solver::Options solver_options;
+  solver_options.gradient_tolerance = options.gradient_tolerance;
+  solver_options.max_num_iterations = options.max_num_iterations;
+  solver_options.linear_solver_type = ceres::DENSE_QR;
+  solver_options.logging_type = ceres::LoggingType::SILENT;
+
+  // The overhead of creating threads is too large.
+  solver_options.num_threads = 1;
+#if CERES_VERSION_MAJOR < 2
+  solver_options.num_linear_solver_threads = 1;
+#endif  // CERES_VERSION_MAJOR
+
+  ceres::Solver::Summary summary;
+  ceres::Solve(solver_options, problem, &summary);
+
+  if (options.print_summary) {
+    PrintHeading2("Pose refinement report");
+    PrintSolverSummary(summary);
+  }
+
+  if (problem->NumResiduals() > 0 && rig_from_world_cov != nullptr) {
+    ceres::Covariance::Options options;
+    ceres::Covariance covariance(options);
+    std::vector<const double*> parameter_blocks = {rig_from_world_rotation,
+                                                   rig_from_world_translation};
+    if (!covariance.Compute(parameter_blocks, problem)) {
+      return false;
+    }
+    covariance.GetCovarianceMatrixInTangentSpace(parameter_blocks,
+                                                 rig_from_world_cov->data());
+  }
+
+  return summary.IsSolutionUsable();
+}
+
 }  // namespace
 
 bool EstimateGeneralizedAbsolutePose(
@@ -127,31 +261,79 @@ bool EstimateGeneralizedAbsolutePose(
     rig_points2D[i].cam_from_rig = cams_from_rig[camera_idx];
   }
 
-  // Associate unique ids to each 3D point.
-  // Needed for UniqueInlierSupportMeasurer to avoid counting the same
-  // 3D point multiple times due to FoV overlap in rig.
-  // TODO(sarlinpe): Allow passing unique_point3D_ids as argument.
-  const std::vector<size_t> unique_point3D_ids =
-      ComputeUniquePointIds(points3D);
-
   // Average of the errors over the cameras, weighted by the number of
   // correspondences
+  const double max_error_cam =
+      ComputeMaxErrorInCamera(camera_idxs, cameras, options.max_error);
+
+  return EstimateGeneralizedAbsolutePoseFromRigPoints(options,
+                                                      rig_points2D,
+                                                      points3D,
+                                                      max_error_cam,
+                                                      rig_from_world,
+                                                      num_inliers,
+                                                      inlier_mask);
+}
+
+bool EstimateGeneralizedAbsolutePose(
+    const RANSACOptions& options,
+    const std::vector<Eigen::Vector2d>& points2D,
+    const std::vector<Eigen::Vector3d>& points3D,
+    const VirtualPinholeCameras& virtual_cameras,
+    Rigid3d* cam_from_world,
+    size_t* num_inliers,
+    std::vector<char>* inlier_mask,
+    const Eigen::Vector3d& gravity_in_cam) {
+  CHECK_EQ(points2D.size(), points3D.size());
+  CHECK_EQ(points2D.size(), virtual_cameras.Size());
+  CHECK_GT(options.max_error, 0.0);
+  options.Check();
+  if (points2D.size() == 0) {
+    return false;
+  }
+
   RANSACOptions options_copy(options);
   options_copy.max_error =
-      ComputeMaxErrorInCamera(camera_idxs, cameras, options.max_error);
+      virtual_cameras.CamFromImgThreshold(options.max_error);
+
+  return EstimateGeneralizedAbsolutePoseFromRays(
+      options_copy,
+      ComputeVirtualCameraRays(points2D, virtual_cameras),
+      points3D,
+      gravity_in_cam,
+      cam_from_world,
+      num_inliers,
+      inlier_mask);
+}
 
-  RANSAC<GP3PEstimator, UniqueInlierSupportMeasurer> ransac(options_copy);
-  ransac.support_measurer.SetUniqueSampleIds(unique_point3D_ids);
-  ransac.estimator.residual_type =
-      GP3PEstimator::ResidualType::ReprojectionError;
-  const auto report = ransac.Estimate(rig_points2D, points3D);
-  if (!report.success) {
+bool EstimateGeneralizedAbsolutePose(
+    const RANSACOptions& options,
+    const std::vector<Eigen::Vector3d>& ray_origins,
+    const std::vector<Eigen::Vector3d>& ray_directions,
+    const std::vector<Eigen::Vector3d>& points3D,
+    Rigid3d* rig_from_world,
+    size_t* num_inliers,
+    std::vector<char>* inlier_mask) {
+  CHECK_EQ(ray_origins.size(), points3D.size());
+  CHECK_EQ(ray_directions.size(), points3D.size());
+  options.Check();
+  if (points3D.size() == 0) {
     return false;
   }
-  *rig_from_world = report.model;
-  *num_inliers = report.support.num_unique_inliers;
-  *inlier_mask = report.inlier_mask;
-  return true;
+
+  std::vector<GP3PRayEstimator::X_t> rays(points3D.size());
+  for (size_t i = 0; i < points3D.size(); i++) {
+    rays[i].origin = ray_origins[i];
+    rays[i].direction = ray_directions[i];
+  }
+
+  return EstimateGeneralizedAbsolutePoseFromRays(options,
+                                                 rays,
+                                                 points3D,
+                                                 Eigen::Vector3d::Zero(),
+                                                 rig_from_world,
+                                                 num_inliers,
+                                                 inlier_mask);
 }
 
 bool RefineGeneralizedAbsolutePose(const AbsolutePoseRefinementOptions& options,
@@ -274,39 +456,151 @@ bool RefineGeneralizedAbsolutePose(const AbsolutePoseRefinementOptions& options,
     }
   }
 
-  ceres::Solver::Options solver_options;
-  solver_options.gradient_tolerance = options.gradient_tolerance;
-  solver_options.max_num_iterations = options.max_num_iterations;
-  solver_options.linear_solver_type = ceres::DENSE_QR;
-  solver_options.logging_type = ceres::LoggingType::SILENT;
+  return SolveGeneralizedAbsolutePoseProblem(
+      options, &problem, rig_from_world, rig_from_world_cov);
+}
 
-  // The overhead of creating threads is too large.
-  solver_options.num_threads = 1;
-#if CERES_VERSION_MAJOR < 2
-  solver_options.num_linear_solver_threads = 1;
-#endif  // CERES_VERSION_MAJOR
+bool RefineGeneralizedAbsolutePose(
+    const AbsolutePoseRefinementOptions& options,
+    const std::vector<char>& inlier_mask,
+    const std::vector<Eigen::Vector2d>& points2D,
+    const std::vector<Eigen::Vector3d>& points3D,
+    const VirtualPinholeCameras& virtual_cameras,
+    Rigid3d* cam_from_world,
+    Eigen::Matrix6d* cam_from_world_cov) {
+  CHECK_EQ(points2D.size(), inlier_mask.size());
+  CHECK_EQ(points2D.size(), points3D.size());
+  CHECK_EQ(points2D.size(), virtual_cameras.Size());
+  CHECK(!options.refine_focal_length && !options.refine_extra_params)
+      << "The intrinsics of virtual cameras cannot be refined";
+  options.Check();
 
-  ceres::Solver::Summary summary;
-  ceres::Solve(solver_options, &problem, &summary);
+  const auto loss_function =
+      std::make_unique<ceres::CauchyLoss>(options.loss_function_scale);
 
-  if (options.print_summary) {
-    PrintHeading2("Pose refinement report");
-    PrintSolverSummary(summary);
+  double* cam_from_world_rotation = cam_from_world->rotation.coeffs().data();
+  double* cam_from_world_translation = cam_from_world->translation.data();
+
+  // All parameters except for the pose are constant, but the cost function
+  // requires mutable parameter blocks. The buffers are reserved upfront, such
+  // that the pointers to their elements remain valid.
+  const size_t num_inliers =
+      std::count(inlier_mask.begin(), inlier_mask.end(), true);
+  std::vector<Eigen::Vector3d> points3D_copy;
+  std::vector<Rigid3d> virtuals_from_real;
+  std::vector<double> virtual_cameras_params;
+  points3D_copy.reserve(num_inliers);
+  virtuals_from_real.reserve(num_inliers);
+  virtual_cameras_params.reserve(3 * num_inliers);
+
+  ceres::Problem::Options problem_options;
+  problem_options.loss_function_ownership = ceres::DO_NOT_TAKE_OWNERSHIP;
+  ceres::Problem problem(problem_options);
+
+  for (size_t i = 0; i < points2D.size(); ++i) {
+    // Skip outlier observations
+    if (!inlier_mask[i]) {
+      continue;
+    }
+
+    points3D_copy.push_back(points3D[i]);
+    virtuals_from_real.push_back(virtual_cameras.VirtualFromReal(i));
+    virtual_cameras_params.push_back(virtual_cameras.focal_length);
+    virtual_cameras_params.push_back(virtual_cameras.principal_points[i].x());
+    virtual_cameras_params.push_back(virtual_cameras.principal_points[i].y());
+
+    double* point3D = points3D_copy.back().data();
+    double* virtual_from_real_rotation =
+        virtuals_from_real.back().rotation.coeffs().data();
+    double* virtual_from_real_translation =
+        virtuals_from_real.back().translation.data();
+    double* camera_params =
+        &virtual_cameras_params[virtual_cameras_params.size() - 3];
+
+    problem.AddResidualBlock(
+        RigReprojErrorCostFunction<SimplePinholeCameraModel>::Create(
+            points2D[i]),
+        loss_function.get(),
+        virtual_from_real_rotation,
+        virtual_from_real_translation,
+        cam_from_world_rotation,
+        cam_from_world_translation,
+        point3D,
+        camera_params);
+    problem.SetParameterBlockConstant(virtual_from_real_rotation);
+    problem.SetParameterBlockConstant(virtual_from_real_translation);
+    problem.SetParameterBlockConstant(point3D);
+    problem.SetParameterBlockConstant(camera_params);
   }
 
-  if (problem.NumResiduals() > 0 && rig_from_world_cov != nullptr) {
-    ceres::Covariance::Options options;
-    ceres::Covariance covariance(options);
-    std::vector<const double*> parameter_blocks = {rig_from_world_rotation,
-                                                   rig_from_world_translation};
-    if (!covariance.Compute(parameter_blocks, &problem)) {
-      return false;
+  if (problem.NumResiduals() > 0) {
+    SetQuaternionManifold(&problem, cam_from_world_rotation);
+  }
+
+  return SolveGeneralizedAbsolutePoseProblem(
+      options, &problem, cam_from_world, cam_from_world_cov);
+}
+
+bool RefineGeneralizedAbsolutePoseLocally(
+    const AbsolutePoseRefinementOptions& options,
+    const double max_error,
+    const std::vector<Eigen::Vector2d>& points2D,
+    const std::vector<Eigen::Vector3d>& points3D,
+    const VirtualPinholeCameras& virtual_cameras,
+    Rigid3d* cam_from_world,
+    std::vector<char>* inlier_mask) {
+  CHECK_GT(max_error, 0.0);
+  CHECK_EQ(points2D.size(), inlier_mask->size());
+
+  if (!RefineGeneralizedAbsolutePose(options,
+                                     *inlier_mask,
+                                     points2D,
+                                     points3D,
+                                     virtual_cameras,
+                                     cam_from_world)) {
+    return false;
+  }
+
+  const std::vector<GP3PRayEstimator::X_t> rays =
+      ComputeVirtualCameraRays(points2D, virtual_cameras);
+  const double max_squared_error =
+      std::pow(virtual_cameras.CamFromImgThreshold(max_error), 2);
+
+  size_t num_inliers =
+      std::count(inlier_mask->begin(), inlier_mask->end(), true);
+  std::vector<double> residuals;
+  std::vector<char> local_inlier_mask(points2D.size());
+
+  const size_t kMaxNumLocalTrials = 10;
+  for (size_t local_num_trials = 0; local_num_trials < kMaxNumLocalTrials;
+       ++local_num_trials) {
+    GP3PRayEstimator::Residuals(rays, points3D, *cam_from_world, &residuals);
+    size_t local_num_inliers = 0;
+    for (size_t i = 0; i < residuals.size(); ++i) {
+      local_inlier_mask[i] = residuals[i] <= max_squared_error;
+      local_num_inliers += local_inlier_mask[i];
     }
-    covariance.GetCovarianceMatrixInTangentSpace(parameter_blocks,
-                                                 rig_from_world_cov->data());
+
+    if (local_num_inliers <= num_inliers) {
+      break;
+    }
+
+    Rigid3d local_cam_from_world = *cam_from_world;
+    if (!RefineGeneralizedAbsolutePose(options,
+                                       local_inlier_mask,
+                                       points2D,
+                                       points3D,
+                                       virtual_cameras,
+                                       &local_cam_from_world)) {
+      break;
+    }
+
+    *cam_from_world = local_cam_from_world;
+    inlier_mask->swap(local_inlier_mask);
+    num_inliers = local_num_inliers;
   }
 
-  return summary.IsSolutionUsable();
+  return true;
 }
 
 }  // namespace colmap
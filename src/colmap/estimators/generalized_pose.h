@@ -65,6 +65,54 @@ bool EstimateGeneralizedAbsolutePose(
     size_t* num_inliers,
     std::vector<char>* inlier_mask);
 
+// Estimate absolute pose of a refractive camera from 2D-3D correspondences,
+// where each correspondence is observed by its own virtual camera.
+//
+// @param options              RANSAC options.
+// @param points2D             Corresponding 2D points.
+// @param points3D             Corresponding 3D points.
+// @param virtual_cameras      Virtual camera of each correspondence.
+// @param cam_from_world       Estimated pose of the real camera.
+// @param num_inliers          Number of inliers in RANSAC.
+// @param inlier_mask          Inlier mask for 2D-3D correspondences.
+// @param gravity_in_cam       Direction of the z-axis of the world frame in
+//                             the real camera frame. If non-zero, the pose
+//                             is estimated with the upright two-point solver.
+//
+// @return                     Whether pose is estimated successfully.
+bool EstimateGeneralizedAbsolutePose(
+    const RANSACOptions& options,
+    const std::vector<Eigen::Vector2d>& points2D,
+    const std::vector<Eigen::Vector3d>& points3D,
+    const VirtualPinholeCameras& virtual_cameras,
+    Rigid3d* cam_from_world,
+    size_t* num_inliers,
+    std::vector<char>* inlier_mask,
+    const Eigen::Vector3d& gravity_in_cam = Eigen::Vector3d::Zero());
+
+// Estimate absolute pose of a generalized camera from ray-3D correspondences,
+// where the rays are given in the frame of the generalized camera. The error
+// threshold of the options is in normalized coordinates of a camera with the
+// orientation of the generalized camera centered at the origin of each ray.
+//
+// @param options              RANSAC options.
+// @param ray_origins          Origin of the ray of each correspondence.
+// @param ray_directions       Direction of the ray of each correspondence.
+// @param points3D             Corresponding 3D points.
+// @param rig_from_world       Estimated rig from world pose.
+// @param num_inliers          Number of inliers in RANSAC.
+// @param inlier_mask          Inlier mask for ray-3D correspondences.
+//
+// @return                     Whether pose is estimated successfully.
+bool EstimateGeneralizedAbsolutePose(
+    const RANSACOptions& options,
+    const std::vector<Eigen::Vector3d>& ray_origins,
+    const std::vector<Eigen::Vector3d>& ray_directions,
+    const std::vector<Eigen::Vector3d>& points3D,
+    Rigid3d* rig_from_world,
+    size_t* num_inliers,
+    std::vector<char>* inlier_mask);
+
 // Refine generalized absolute pose (optionally focal lengths)
 // from 2D-3D correspondences.
 //
@@ -93,4 +141,52 @@ bool RefineGeneralizedAbsolutePose(
     std::vector<Camera>* cameras,
     Eigen::Matrix6d* rig_from_world_cov = nullptr);
 
+// Refine absolute pose of a refractive camera from 2D-3D correspondences,
+// where each correspondence is observed by its own virtual camera. The
+// intrinsics of the virtual cameras are kept constant, i.e. the options must
+// not enable the refinement of focal length or extra parameters.
+//
+// @param options              Refinement options.
+// @param inlier_mask          Inlier mask for 2D-3D correspondences.
+// @param points2D             Corresponding 2D points.
+// @param points3D             Corresponding 3D points.
+// @param virtual_cameras      Virtual camera of each correspondence.
+// @param cam_from_world       Estimated pose of the real camera.
+// @param cam_from_world_cov   Estimated 6x6 covariance matrix of
+//                             the rotation (as axis-angle, in tangent space)
+//                             and translation terms (optional).
+//
+// @return                     Whether the solution is usable.
+bool RefineGeneralizedAbsolutePose(
+    const AbsolutePoseRefinementOptions& options,
+    const std::vector<char>& inlier_mask,
+    const std::vector<Eigen::Vector2d>& points2D,
+    const std::vector<Eigen::Vector3d>& points3D,
+    const VirtualPinholeCameras& virtual_cameras,
+    Rigid3d* cam_from_world,
+    Eigen::Matrix6d* cam_from_world_cov = nullptr);
+
+// Refine absolute pose of a refractive camera as above and locally optimize
+// its inliers, i.e. the inliers are recomputed with the refined pose and the
+// pose is refined again on the new inliers as long as their number increases.
+//
+// @param options              Refinement options.
+// @param max_error            Maximum reprojection error in pixels of inliers.
+// @param points2D             Corresponding 2D points.
+// @param points3D             Corresponding 3D points.
+// @param virtual_cameras      Virtual camera of each correspondence.
+// @param cam_from_world       Estimated pose of the real camera.
+// @param inlier_mask          Inlier mask for 2D-3D correspondences, which is
+//                             updated with the locally optimized inliers.
+//
+// @return                     Whether the solution is usable.
+bool RefineGeneralizedAbsolutePoseLocally(
+    const AbsolutePoseRefinementOptions& options,
+    double max_error,
+    const std::vector<Eigen::Vector2d>& points2D,
+    const std::vector<Eigen::Vector3d>& points3D,
+    const VirtualPinholeCameras& virtual_cameras,
+    Rigid3d* cam_from_world,
+    std::vector<char>* inlier_mask);
+
 }  // namespace colmap
@@ -37,6 +37,7 @@
 #include "colmap/scene/reconstruction.h"
 #include "colmap/scene/synthetic.h"
 
+#include <algorithm>
 #include <numeric>
 
 #include <gtest/gtest.h>
@@ -84,6 +85,38 @@ GeneralizedCameraProblem BuildGeneralizedCameraProblem() {
   return problem;
 }
 
+struct RefractiveCameraProblem {
+  Rigid3d gt_cam_from_world;
+  std::vector<Eigen::Vector2d> points2D;
+  std::vector<Eigen::Vector3d> points3D;
+  VirtualPinholeCameras virtual_cameras;
+};
+
+RefractiveCameraProblem BuildRefractiveCameraProblem() {
+  Camera camera =
+      Camera::CreateFromModelName(1, "SIMPLE_PINHOLE", 1000.0, 1000, 800);
+  camera.refrac_model_id = CameraRefracModelId::kFlatPort;
+  camera.refrac_params = {0.1, 0.05, 0.99, 0.05, 0.007, 1.0, 1.52, 1.33};
+  Eigen::Map<Eigen::Vector3d>(camera.refrac_params.data()).normalize();
+
+  RefractiveCameraProblem problem;
+  problem.gt_cam_from_world =
+      Rigid3d(Eigen::Quaterniond::UnitRandom(), Eigen::Vector3d::Random());
+  const Rigid3d world_from_cam = Inverse(problem.gt_cam_from_world);
+
+  const size_t kNumPoints = 50;
+  for (size_t i = 0; i < kNumPoints; ++i) {
+    const Eigen::Vector2d point2D(RandomUniformReal(0.0, 1000.0),
+                                  RandomUniformReal(0.0, 800.0));
+    const double depth = RandomUniformReal(1.0, 5.0);
+    problem.points2D.push_back(point2D);
+    problem.points3D.push_back(world_from_cam *
+                               camera.CamFromImgRefracPoint(point2D, depth));
+  }
+  camera.ComputeVirtuals(problem.points2D, &problem.virtual_cameras);
+  return problem;
+}
+
 TEST(EstimateGeneralizedAbsolutePose, Nominal) {
   GeneralizedCameraProblem problem = BuildGeneralizedCameraProblem();
   const size_t num_points = problem.points2D.size();
@@ -168,5 +201,129 @@ TEST(RefineGeneralizedAbsolutePose, Nominal) {
             1e-6);
 }
 
+TEST(EstimateGeneralizedAbsolutePose, VirtualPinholeCameras) {
+  RefractiveCameraProblem problem = BuildRefractiveCameraProblem();
+
+  RANSACOptions ransac_options;
+  ransac_options.max_error = 2;
+
+  Rigid3d cam_from_world;
+  size_t num_inliers;
+  std::vector<char> inlier_mask;
+  EXPECT_TRUE(EstimateGeneralizedAbsolutePose(ransac_options,
+                                              problem.points2D,
+                                              problem.points3D,
+                                              problem.virtual_cameras,
+                                              &cam_from_world,
+                                              &num_inliers,
+                                              &inlier_mask));
+  EXPECT_EQ(num_inliers, problem.points2D.size());
+  EXPECT_LT(problem.gt_cam_from_world.rotation.angularDistance(
+                cam_from_world.rotation),
+            1e-6);
+  EXPECT_LT((problem.gt_cam_from_world.translation - cam_from_world.translation)
+                .norm(),
+            1e-6);
+}
+
+TEST(RefineGeneralizedAbsolutePose, VirtualPinholeCameras) {
+  RefractiveCameraProblem problem = BuildRefractiveCameraProblem();
+  const std::vector<char> gt_inlier_mask(problem.points2D.size(), true);
+
+  const double rotation_noise_degree = 1;
+  const double translation_noise = 0.1;
+  const Rigid3d cam_from_gt_cam(Eigen::Quaterniond(Eigen::AngleAxisd(
+                                    DegToRad(rotation_noise_degree),
+                                    Eigen::Vector3d::Random().normalized())),
+                                Eigen::Vector3d::Random() * translation_noise);
+  Rigid3d cam_from_world = cam_from_gt_cam * problem.gt_cam_from_world;
+
+  AbsolutePoseRefinementOptions options;
+  options.refine_focal_length = false;
+  options.refine_extra_params = false;
+  EXPECT_TRUE(RefineGeneralizedAbsolutePose(options,
+                                            gt_inlier_mask,
+                                            problem.points2D,
+                                            problem.points3D,
+                                            problem.virtual_cameras,
+                                            &cam_from_world));
+  EXPECT_LT(problem.gt_cam_from_world.rotation.angularDistance(
+                cam_from_world.rotation),
+            1e-6);
+  EXPECT_LT((problem.gt_cam_from_world.translation - cam_from_world.translation)
+                .norm(),
+            1e-6);
+}
+
+TEST(EstimateGeneralizedAbsolutePose, Rays) {
+  RefractiveCameraProblem problem = BuildRefractiveCameraProblem();
+
+  std::vector<Eigen::Vector3d> ray_origins;
+  std::vector<Eigen::Vector3d> ray_directions;
+  for (size_t i = 0; i < problem.points2D.size(); ++i) {
+    ray_origins.push_back(problem.virtual_cameras.centers[i]);
+    ray_directions.push_back(
+        problem.virtual_cameras.CamFromImg(i, problem.points2D[i])
+            .homogeneous()
+            .normalized());
+  }
+
+  RANSACOptions ransac_options;
+  ransac_options.max_error = 1e-3;
+
+  Rigid3d cam_from_world;
+  size_t num_inliers;
+  std::vector<char> inlier_mask;
+  EXPECT_TRUE(EstimateGeneralizedAbsolutePose(ransac_options,
+                                              ray_origins,
+                                              ray_directions,
+                                              problem.points3D,
+                                              &cam_from_world,
+                                              &num_inliers,
+                                              &inlier_mask));
+  EXPECT_EQ(num_inliers, problem.points2D.size());
+  EXPECT_LT(problem.gt_cam_from_world.rotation.angularDistance(
+                cam_from_world.rotation),
+            1e-6);
+  EXPECT_LT((problem.gt_cam_from_world.translation - cam_from_world.translation)
+                .norm(),
+            1e-6);
+}
+
+TEST(RefineGeneralizedAbsolutePoseLocally, VirtualPinholeCameras) {
+  RefractiveCameraProblem problem = BuildRefractiveCameraProblem();
+
+  // Only a subset of the correspondences is initially marked as inliers.
+  std::vector<char> inlier_mask(problem.points2D.size(), false);
+  for (size_t i = 0; i < inlier_mask.size(); i += 2) {
+    inlier_mask[i] = true;
+  }
+
+  const Rigid3d cam_from_gt_cam(
+      Eigen::Quaterniond(Eigen::AngleAxisd(
+          DegToRad(1.0), Eigen::Vector3d::Random().normalized())),
+      Eigen::Vector3d::Random() * 0.1);
+  Rigid3d cam_from_world = cam_from_gt_cam * problem.gt_cam_from_world;
+
+  AbsolutePoseRefinementOptions options;
+  options.refine_focal_length = false;
+  options.refine_extra_params = false;
+  EXPECT_TRUE(RefineGeneralizedAbsolutePoseLocally(options,
+                                                   /*max_error=*/1,
+                                                   problem.points2D,
+                                                   problem.points3D,
+                                                   problem.virtual_cameras,
+                                                   &cam_from_world,
+                                                   &inlier_mask));
+  EXPECT_EQ(std::count(inlier_mask.begin(), inlier_mask.end(), true),
+            problem.points2D.size());
+  EXPECT_LT(problem.gt_cam_from_world.rotation.angularDistance(
+                cam_from_world.rotation),
+            1e-6);
+  EXPECT_LT((problem.gt_cam_from_world.translation - cam_from_world.translation)
+                .norm(),
+            1e-6);
+}
+
 }  // namespace
 }  // namespace colmap
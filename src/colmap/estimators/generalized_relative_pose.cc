@@ -427,10 +427,16 @@ void GR6PEstimator::Estimate(const std::vector<X_t>& points1,
 
   models->clear();
 
-  std::vector<Eigen::Vector3d> proj_centers1(points1.size());
-  std::vector<Eigen::Vector3d> proj_centers2(points1.size());
-  std::vector<Eigen::Vector6d> plueckers1(points1.size());
-  std::vector<Eigen::Vector6d> plueckers2(points1.size());
+  // The scratch buffers are reused across calls to avoid heap allocations in
+  // the RANSAC loop.
+  thread_local std::vector<Eigen::Vector3d> proj_centers1;
+  thread_local std::vector<Eigen::Vector3d> proj_centers2;
+  thread_local std::vector<Eigen::Vector6d> plueckers1;
+  thread_local std::vector<Eigen::Vector6d> plueckers2;
+  proj_centers1.resize(points1.size());
+  proj_centers2.resize(points1.size());
+  plueckers1.resize(points1.size());
+  plueckers2.resize(points1.size());
   for (size_t i = 0; i < points1.size(); ++i) {
     ComposePlueckerData(Inverse(points1[i].cam_from_rig),
                         points1[i].ray_in_cam,
@@ -33,6 +33,7 @@
 #include "colmap/estimators/bundle_adjustment.h"
 #include "colmap/estimators/cost_functions.h"
 #include "colmap/estimators/essential_matrix.h"
+#include "colmap/estimators/generalized_absolute_pose.h"
 #include "colmap/geometry/essential_matrix.h"
 #include "colmap/geometry/pose.h"
 #include "colmap/math/matrix.h"
@@ -82,6 +83,29 @@ bool EstimateAbsolutePose(const AbsolutePoseEstimationOptions& options,
                           std::vector<char>* inlier_mask) {
   options.Check();
 
+  if (!options.estimate_focal_length &&
+      options.gravity_in_cam != Eigen::Vector3d::Zero()) {
+    std::vector<UprightGP2PEstimator::X_t> rays(points2D.size());
+    for (size_t i = 0; i < points2D.size(); ++i) {
+      rays[i].origin.setZero();
+      rays[i].direction = camera->CamFromImg(points2D[i]).homogeneous();
+    }
+
+    auto custom_options = options.ransac_options;
+    custom_options.max_error =
+        camera->CamFromImgThreshold(options.ransac_options.max_error);
+    RANSAC<UprightGP2PEstimator> ransac(custom_options);
+    ransac.estimator.gravity_in_rig = options.gravity_in_cam;
+    const auto report = ransac.Estimate(rays, points3D);
+    *num_inliers = report.support.num_inliers;
+    *inlier_mask = report.inlier_mask;
+    if (!report.success || *num_inliers == 0) {
+      return false;
+    }
+    *cam_from_world = report.model;
+    return true;
+  }
+
   std::vector<double> focal_length_factors;
   if (options.estimate_focal_length) {
     // Generate focal length factors using a quadratic function,
@@ -111,13 +135,19 @@ bool EstimateAbsolutePose(const AbsolutePoseEstimationOptions& options,
   ThreadPool thread_pool(std::min(
       options.num_threads, static_cast<int>(focal_length_factors.size())));
 
+  // The focal lengths are already evaluated concurrently.
+  RANSACOptions ransac_options = options.ransac_options;
+  if (focal_length_factors.size() > 1) {
+    ransac_options.num_threads = 1;
+  }
+
   for (size_t i = 0; i < focal_length_factors.size(); ++i) {
     futures[i] = thread_pool.AddTask(EstimateAbsolutePoseKernel,
                                      *camera,
                                      focal_length_factors[i],
                                      points2D,
                                      points3D,
-                                     options.ransac_options,
+                                     ransac_options,
                                      &reports[i]);
   }
 
@@ -63,6 +63,13 @@ struct AbsolutePoseEstimationOptions {
   // Number of threads for parallel estimation of focal length.
   int num_threads = ThreadPool::kMaxNumThreads;
 
+  // The direction of the z-axis of the world frame in the camera frame, e.g.,
+  // from the roll and pitch of an inertial sensor, if the world frame is
+  // aligned with gravity. If non-zero, the pose is estimated with the upright
+  // two-point solver, which only estimates the rotation about gravity. Not
+  // used when estimating the focal length.
+  Eigen::Vector3d gravity_in_cam = Eigen::Vector3d::Zero();
+
   // Options used for P3P RANSAC.
   RANSACOptions ransac_options;
 
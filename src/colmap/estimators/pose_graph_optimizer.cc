@@ -1,16 +1,29 @@
 #include "colmap/estimators/pose_graph_optimizer.h"
 
 #include "colmap/estimators/cost_functions.h"
+#include "colmap/util/logging.h"
 #include "colmap/util/misc.h"
 #include "colmap/util/threading.h"
 
 namespace colmap {
 
+bool PoseGraphOptimizer::Options::Check() const {
+  CHECK_OPTION_GT(max_num_iterations, 0);
+  CHECK_OPTION_GE(num_threads, -1);
+  CHECK_OPTION_GE(incremental_num_hops, 0);
+  return true;
+}
+
 PoseGraphOptimizer::PoseGraphOptimizer(
     const std::shared_ptr<Reconstruction>& reconstruction)
-    : reconstruction_(reconstruction) {
+    : PoseGraphOptimizer(Options(), reconstruction) {}
+
+PoseGraphOptimizer::PoseGraphOptimizer(
+    const Options& options,
+    const std::shared_ptr<Reconstruction>& reconstruction)
+    : options_(options), reconstruction_(reconstruction) {
+  CHECK(options_.Check());
   CHECK_NOTNULL(reconstruction_);
-  CHECK(!problem_) << "Cannot use the same PoseGraphOptimizer multiple times";
 
   ceres::Problem::Options problem_options;
   problem_options.loss_function_ownership = ceres::DO_NOT_TAKE_OWNERSHIP;
@@ -41,6 +54,8 @@ void PoseGraphOptimizer::AddAbsolutePose(const image_t image_id,
                              cam_from_world_translation);
 
   SetQuaternionManifold(problem_.get(), cam_from_world_rotation);
+
+  AddConstraint({image_id});
 }
 
 void PoseGraphOptimizer::AddRelativePose(const image_t image_id1,
@@ -69,9 +84,14 @@ void PoseGraphOptimizer::AddRelativePose(const image_t image_id1,
   double* cam2_from_world_translation =
       image2.CamFromWorld().translation.data();
 
-  ceres::CostFunction* cost_function =
-      RelativePoseError6DoFCostFunction::Create(cam2_from_cam1_measured,
-                                                sqrt_information);
+  ceres::CostFunction* cost_function = nullptr;
+  if (options_.use_analytic_jacobians) {
+    cost_function = RelativePoseError6DoFAnalyticCostFunction::Create(
+        cam2_from_cam1_measured, sqrt_information);
+  } else {
+    cost_function = RelativePoseError6DoFCostFunction::Create(
+        cam2_from_cam1_measured, sqrt_information);
+  }
 
   problem_->AddResidualBlock(cost_function,
                              loss_function,
@@ -82,6 +102,8 @@ void PoseGraphOptimizer::AddRelativePose(const image_t image_id1,
 
   SetQuaternionManifold(problem_.get(), cam1_from_world_rotation);
   SetQuaternionManifold(problem_.get(), cam2_from_world_rotation);
+
+  AddConstraint({image_id1, image_id2});
 }
 
 void PoseGraphOptimizer::AddSmoothMotion(const image_t image_id1,
@@ -133,6 +155,8 @@ void PoseGraphOptimizer::AddSmoothMotion(const image_t image_id1,
   SetQuaternionManifold(problem_.get(), cam1_from_world_rotation);
   SetQuaternionManifold(problem_.get(), cam2_from_world_rotation);
   SetQuaternionManifold(problem_.get(), cam3_from_world_rotation);
+
+  AddConstraint({image_id1, image_id2, image_id3});
 }
 
 bool PoseGraphOptimizer::Solve() {
@@ -141,15 +165,14 @@ bool PoseGraphOptimizer::Solve() {
   }
 
   const double kEpsilon = 1e-10;
-  const size_t kMaxNumIterations = 300;
 
   ceres::Solver::Options solver_options;
-  solver_options.minimizer_progress_to_stdout = true;
-  solver_options.max_num_iterations = kMaxNumIterations;
+  solver_options.minimizer_progress_to_stdout = options_.print_progress;
+  solver_options.max_num_iterations = options_.max_num_iterations;
   solver_options.function_tolerance = 1e-2 * kEpsilon;
   solver_options.gradient_tolerance = 1e-2 * kEpsilon;
   solver_options.parameter_tolerance = 1e-2 * kEpsilon;
-  solver_options.linear_solver_type = ceres::SPARSE_NORMAL_CHOLESKY;
+  solver_options.linear_solver_type = options_.linear_solver_type;
 
   const int kMinNumResidualsForMultiThreading = 500;
 
@@ -159,9 +182,10 @@ bool PoseGraphOptimizer::Solve() {
     solver_options.num_linear_solver_threads = 1;
 #endif  // CERES_VERSION_MAJOR
   } else {
-    solver_options.num_threads = GetEffectiveNumThreads(-1);
+    solver_options.num_threads = GetEffectiveNumThreads(options_.num_threads);
 #if CERES_VERSION_MAJOR < 2
-    solver_options.num_linear_solver_threads = GetEffectiveNumThreads(-1);
+    solver_options.num_linear_solver_threads =
+        GetEffectiveNumThreads(options_.num_threads);
 #endif  // CERES_VERSION_MAJOR
   }
 
@@ -173,7 +197,69 @@ bool PoseGraphOptimizer::Solve() {
   PrintHeading2("Pose graph optimizer report");
   LOG(INFO) << summary_.BriefReport();
 
+  new_image_ids_.clear();
+
   return summary_.IsSolutionUsable();
 }
 
+bool PoseGraphOptimizer::SolveIncremental() {
+  if (new_image_ids_.empty()) {
+    return false;
+  }
+
+  // Breadth-first expansion of the images of the new constraints.
+  std::unordered_set<image_t> variable_image_ids = new_image_ids_;
+  std::vector<image_t> frontier(new_image_ids_.begin(), new_image_ids_.end());
+  for (int hop = 0; hop < options_.incremental_num_hops; ++hop) {
+    std::vector<image_t> next_frontier;
+    for (const image_t image_id : frontier) {
+      for (const image_t neighbor_id : image_neighbors_.at(image_id)) {
+        if (variable_image_ids.insert(neighbor_id).second) {
+          next_frontier.push_back(neighbor_id);
+        }
+      }
+    }
+    frontier = std::move(next_frontier);
+  }
+
+  std::vector<double*> constant_params;
+  for (const auto& image : image_neighbors_) {
+    if (variable_image_ids.count(image.first) > 0) {
+      continue;
+    }
+    Rigid3d& cam_from_world =
+        reconstruction_->Image(image.first).CamFromWorld();
+    for (double* params : {cam_from_world.rotation.coeffs().data(),
+                           cam_from_world.translation.data()}) {
+      if (!problem_->IsParameterBlockConstant(params)) {
+        problem_->SetParameterBlockConstant(params);
+        constant_params.push_back(params);
+      }
+    }
+  }
+
+  LOG(INFO) << "Incrementally optimizing " << variable_image_ids.size()
+            << " of " << image_neighbors_.size() << " poses";
+
+  const bool success = Solve();
+
+  for (double* params : constant_params) {
+    problem_->SetParameterBlockVariable(params);
+  }
+
+  return success;
+}
+
+void PoseGraphOptimizer::AddConstraint(const std::vector<image_t>& image_ids) {
+  for (const image_t image_id : image_ids) {
+    std::unordered_set<image_t>& neighbors = image_neighbors_[image_id];
+    for (const image_t other_image_id : image_ids) {
+      if (other_image_id != image_id) {
+        neighbors.insert(other_image_id);
+      }
+    }
+    new_image_ids_.insert(image_id);
+  }
+}
+
 }  // namespace colmap
\ No newline at end of file
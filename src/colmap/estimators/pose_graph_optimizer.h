@@ -4,7 +4,9 @@
 #include "colmap/scene/reconstruction.h"
 
 #include <memory>
+#include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
 #include <Eigen/Core>
 #include <ceres/ceres.h>
@@ -13,7 +15,36 @@ namespace colmap {
 
 class PoseGraphOptimizer {
  public:
-  PoseGraphOptimizer(const std::shared_ptr<Reconstruction>& reconstruction);
+  struct Options {
+    // Linear solver for the normal equations. The sparse Cholesky solvers use
+    // the fill-reducing ordering of the sparse linear algebra library (e.g.
+    // METIS with CHOLMOD), while the iterative solvers scale to larger graphs.
+    ceres::LinearSolverType linear_solver_type = ceres::SPARSE_NORMAL_CHOLESKY;
+
+    // Maximum number of solver iterations.
+    int max_num_iterations = 300;
+
+    // Number of threads, where -1 uses all available threads.
+    int num_threads = -1;
+
+    // Whether to use analytic instead of automatic derivatives for the
+    // relative pose constraints.
+    bool use_analytic_jacobians = true;
+
+    // Whether to print the solver progress.
+    bool print_progress = true;
+
+    // In incremental solving, the number of constraints by which the images
+    // of the new constraints are expanded to determine the optimized poses.
+    int incremental_num_hops = 2;
+
+    bool Check() const;
+  };
+
+  explicit PoseGraphOptimizer(
+      const std::shared_ptr<Reconstruction>& reconstruction);
+  PoseGraphOptimizer(const Options& options,
+                     const std::shared_ptr<Reconstruction>& reconstruction);
 
   void AddAbsolutePose(image_t image_id,
                        const Rigid3d& tform_measured,
@@ -31,12 +62,33 @@ class PoseGraphOptimizer {
                        image_t image_id3,
                        const Eigen::Matrix6d& information,
                        ceres::LossFunction* loss_function);
+
+  // Optimize the poses of all constrained images. Solve can be called
+  // repeatedly, e.g., after adding further constraints, where each call is
+  // warm started from the poses of the previous solution.
   bool Solve();
 
+  // Incrementally optimize the poses after adding new constraints, e.g., for
+  // a mission that is processed while it is still being surveyed. Only the
+  // poses of the images of the constraints added since the last solve and
+  // their neighbors within incremental_num_hops constraints are optimized,
+  // while all other poses are fixed (fixed-lag smoothing). The costs of a
+  // solve thus depend on the size of the update instead of the whole graph.
+  bool SolveIncremental();
+
  protected:
+  // Register a new constraint between the given images.
+  void AddConstraint(const std::vector<image_t>& image_ids);
+
+  const Options options_;
   std::unique_ptr<ceres::Problem> problem_;
   ceres::Solver::Summary summary_;
   std::shared_ptr<Reconstruction> reconstruction_;
+
+  // The images connected by constraints and the images of the constraints
+  // added since the last solve.
+  std::unordered_map<image_t, std::unordered_set<image_t>> image_neighbors_;
+  std::unordered_set<image_t> new_image_ids_;
 };
 
 }  // namespace colmap
\ No newline at end of file
@@ -0,0 +1,135 @@
+// Copyright (c) 2023, ETH Zurich and UNC Chapel Hill.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of ETH Zurich and UNC Chapel Hill nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "colmap/estimators/pose_graph_optimizer.h"
+
+#include "colmap/scene/synthetic.h"
+
+#include <gtest/gtest.h>
+
+namespace colmap {
+namespace {
+
+std::shared_ptr<Reconstruction> GenerateReconstruction(const int num_images) {
+  auto reconstruction = std::make_shared<Reconstruction>();
+  SyntheticDatasetOptions synthetic_dataset_options;
+  synthetic_dataset_options.num_cameras = 1;
+  synthetic_dataset_options.num_images = num_images;
+  synthetic_dataset_options.num_points3D = 10;
+  SynthesizeDataset(synthetic_dataset_options, reconstruction.get());
+  return reconstruction;
+}
+
+void AddRelativePoseChain(const Reconstruction& gt_reconstruction,
+                          const std::vector<image_t>& image_ids,
+                          PoseGraphOptimizer* optimizer) {
+  for (size_t i = 1; i < image_ids.size(); ++i) {
+    const Rigid3d cam2_from_cam1 =
+        gt_reconstruction.Image(image_ids[i]).CamFromWorld() *
+        Inverse(gt_reconstruction.Image(image_ids[i - 1]).CamFromWorld());
+    optimizer->AddRelativePose(image_ids[i - 1],
+                               image_ids[i],
+                               cam2_from_cam1,
+                               Eigen::Matrix6d::Identity(),
+                               /*loss_function=*/nullptr);
+  }
+}
+
+TEST(PoseGraphOptimizer, Solve) {
+  auto reconstruction = GenerateReconstruction(/*num_images=*/5);
+  const Reconstruction gt_reconstruction = *reconstruction;
+  const std::vector<image_t> image_ids = reconstruction->RegImageIds();
+
+  PoseGraphOptimizer optimizer(reconstruction);
+  optimizer.AddAbsolutePose(
+      image_ids[0],
+      gt_reconstruction.Image(image_ids[0]).CamFromWorld(),
+      Eigen::Matrix6d::Identity(),
+      /*loss_function=*/nullptr);
+  AddRelativePoseChain(gt_reconstruction, image_ids, &optimizer);
+
+  for (const image_t image_id : image_ids) {
+    reconstruction->Image(image_id).CamFromWorld().translation +=
+        0.1 * Eigen::Vector3d::Random();
+  }
+
+  EXPECT_TRUE(optimizer.Solve());
+  for (const image_t image_id : image_ids) {
+    EXPECT_LT((reconstruction->Image(image_id).CamFromWorld().translation -
+               gt_reconstruction.Image(image_id).CamFromWorld().translation)
+                  .norm(),
+              1e-6);
+  }
+}
+
+TEST(PoseGraphOptimizer, SolveIncremental) {
+  auto reconstruction = GenerateReconstruction(/*num_images=*/6);
+  const Reconstruction gt_reconstruction = *reconstruction;
+  const std::vector<image_t> image_ids = reconstruction->RegImageIds();
+
+  PoseGraphOptimizer::Options options;
+  options.incremental_num_hops = 1;
+  PoseGraphOptimizer optimizer(options, reconstruction);
+  optimizer.AddAbsolutePose(
+      image_ids[0],
+      gt_reconstruction.Image(image_ids[0]).CamFromWorld(),
+      Eigen::Matrix6d::Identity(),
+      /*loss_function=*/nullptr);
+  AddRelativePoseChain(gt_reconstruction,
+                       {image_ids.begin(), image_ids.end() - 1},
+                       &optimizer);
+  EXPECT_TRUE(optimizer.Solve());
+  EXPECT_FALSE(optimizer.SolveIncremental());
+
+  // Add a new image at a perturbed pose, which is constrained to the last
+  // image of the chain.
+  reconstruction->Image(image_ids.back()).CamFromWorld().translation +=
+      Eigen::Vector3d(0.1, 0.2, 0.3);
+  const Reconstruction prev_reconstruction = *reconstruction;
+  AddRelativePoseChain(gt_reconstruction,
+                       {image_ids[image_ids.size() - 2], image_ids.back()},
+                       &optimizer);
+  EXPECT_TRUE(optimizer.SolveIncremental());
+
+  // Only the new image and its neighbors within one hop are optimized.
+  for (size_t i = 0; i + 3 < image_ids.size(); ++i) {
+    EXPECT_EQ(reconstruction->Image(image_ids[i]).CamFromWorld().translation,
+              prev_reconstruction.Image(image_ids[i])
+                  .CamFromWorld()
+                  .translation);
+  }
+  EXPECT_LT(
+      (reconstruction->Image(image_ids.back()).CamFromWorld().translation -
+       gt_reconstruction.Image(image_ids.back()).CamFromWorld().translation)
+          .norm(),
+      1e-6);
+}
+
+}  // namespace
+}  // namespace colmap
@@ -1,5 +1,6 @@
 #include "colmap/estimators/refrac_relative_pose.h"
 
+#include "colmap/estimators/essential_matrix.h"
 #include "colmap/geometry/essential_matrix.h"
 #include "colmap/geometry/pose.h"
 #include "colmap/geometry/triangulation.h"
@@ -10,6 +11,28 @@
 #include <unsupported/Eigen/KroneckerProduct>
 
 namespace colmap {
+namespace {
+
+// Compose the Pluecker coordinates of the rays of the virtual cameras in the
+// upright frame of the real camera, whose z-axis is aligned with gravity.
+void ComposeUprightPlueckerLines(
+    const std::vector<RefracRelPoseEstimator::X_t>& points,
+    const Eigen::Matrix3d& upright_from_cam,
+    std::vector<Eigen::Vector3d>* rays,
+    std::vector<Eigen::Vector3d>* moments) {
+  rays->resize(points.size());
+  moments->resize(points.size());
+  for (size_t i = 0; i < points.size(); ++i) {
+    const Rigid3d real_from_virtual = Inverse(points[i].virtual_from_real);
+    (*rays)[i] = upright_from_cam *
+                 (real_from_virtual.rotation * points[i].ray_in_virtual);
+    (*moments)[i] =
+        (upright_from_cam * real_from_virtual.translation).cross((*rays)[i]);
+  }
+}
+
+}  // namespace
+
 void RefracRelPoseEstimator::Estimate(const std::vector<X_t>& points1,
                                       const std::vector<Y_t>& points2,
                                       std::vector<M_t>* models) {
@@ -19,25 +42,24 @@ void RefracRelPoseEstimator::Estimate(const std::vector<X_t>& points1,
 
   models->clear();
 
-  // Compute virtual camera centers.
+  // Compute virtual camera centers. The scratch buffers are reused across
+  // calls to avoid heap allocations in the RANSAC loop.
   const size_t kNumPoints = points1.size();
-  std::vector<Eigen::Vector3d> virtual_proj_centers1;
-  std::vector<Eigen::Vector3d> virtual_proj_centers2;
-  virtual_proj_centers1.reserve(kNumPoints);
-  virtual_proj_centers2.reserve(kNumPoints);
+  thread_local std::vector<Eigen::Vector3d> virtual_proj_centers1;
+  thread_local std::vector<Eigen::Vector3d> virtual_proj_centers2;
+  virtual_proj_centers1.resize(kNumPoints);
+  virtual_proj_centers2.resize(kNumPoints);
 
   for (size_t i = 0; i < kNumPoints; ++i) {
-    virtual_proj_centers1.push_back(
-        points1[i].virtual_from_real.rotation.inverse() *
-        -points1[i].virtual_from_real.translation);
-    virtual_proj_centers2.push_back(
-        points2[i].virtual_from_real.rotation.inverse() *
-        -points2[i].virtual_from_real.translation);
+    virtual_proj_centers1[i] = points1[i].virtual_from_real.rotation.inverse() *
+                               -points1[i].virtual_from_real.translation;
+    virtual_proj_centers2[i] = points2[i].virtual_from_real.rotation.inverse() *
+                               -points2[i].virtual_from_real.translation;
   }
 
   // Compose A matrix, see (4.19) on page 9
-  Eigen::MatrixXd A(kNumPoints, 18);
-  A.setZero();
+  thread_local Eigen::Matrix<double, Eigen::Dynamic, 18> A;
+  A.resize(kNumPoints, 18);
 
   for (size_t i = 0; i < kNumPoints; ++i) {
     const Eigen::Matrix3d eye3 = Eigen::Matrix3d::Identity();
@@ -71,17 +93,19 @@ void RefracRelPoseEstimator::Estimate(const std::vector<X_t>& points1,
     A.block<1, 9>(i, 9) = -r2_t * kron1;
   }
 
-  Eigen::MatrixXd AR = A.block(0, 0, kNumPoints, 9);
-  Eigen::MatrixXd AE = A.block(0, 9, kNumPoints, 9);
-  Eigen::MatrixXd ARpinv = AR.completeOrthogonalDecomposition().pseudoInverse();
-  // Eigen::MatrixXd ARpinv = pseudoInverse(AR);
-  Eigen::MatrixXd eye_N(kNumPoints, kNumPoints);
-  eye_N.setIdentity();
-
-  Eigen::MatrixXd B = (AR * ARpinv - eye_N) * AE;
-  Eigen::JacobiSVD<Eigen::MatrixXd> svd(B, Eigen::ComputeFullV);
-
-  Eigen::MatrixXd sol = svd.matrixV().col(8);
+  // Project AE onto the orthogonal complement of the column space of AR, i.e.,
+  // B = (AR * pinv(AR) - I) * AE up to sign, without forming the N x N
+  // projection matrix.
+  const auto AR = A.leftCols<9>();
+  const auto AE = A.rightCols<9>();
+  const Eigen::Matrix<double, 9, 9> ARpinv_AE =
+      AR.completeOrthogonalDecomposition().solve(AE);
+  thread_local Eigen::Matrix<double, Eigen::Dynamic, 9> B;
+  B.noalias() = AE - AR * ARpinv_AE;
+  const Eigen::JacobiSVD<Eigen::Matrix<double, Eigen::Dynamic, 9>> svd(
+      B, Eigen::ComputeFullV);
+
+  const Eigen::Matrix<double, 9, 1> sol = svd.matrixV().col(8);
   const Eigen::Map<const Eigen::Matrix3d> E_raw(sol.data());
 
   // Enforcing the internal constraint that two singular values must be equal
@@ -99,12 +123,11 @@ void RefracRelPoseEstimator::Estimate(const std::vector<X_t>& points1,
   // proj_center by virtual_proj_center).
   Eigen::Matrix3d R_cam1_from_cam2;
   Eigen::Vector3d t_cam1_from_cam2;
-  std::vector<Eigen::Vector3d> points3D;
+  size_t max_num_points3D = 0;
   Eigen::Matrix3d R1;
   Eigen::Matrix3d R2;
   Eigen::Vector3d t;
   DecomposeEssentialMatrix(E, &R1, &R2, &t);
-  points3D.clear();
 
   // Generate all possible projection matrix combinations.
   const std::array<Eigen::Matrix3d, 4> R_cmbs{{R1, R2, R1, R2}};
@@ -117,7 +140,7 @@ void RefracRelPoseEstimator::Estimate(const std::vector<X_t>& points1,
   };
 
   for (size_t i = 0; i < R_cmbs.size(); ++i) {
-    std::vector<Eigen::Vector3d> points3D_cmb;
+    size_t num_points3D = 0;
     // Check cheriality here
 
     const double kMinDepth = std::numeric_limits<double>::epsilon();
@@ -148,30 +171,29 @@ void RefracRelPoseEstimator::Estimate(const std::vector<X_t>& points1,
       if (depth1 > kMinDepth && depth1 < max_depth) {
         const double depth2 = CalculateDepth(virtual_proj_matrix2, point3D);
         if (depth2 > kMinDepth && depth2 < max_depth) {
-          points3D_cmb.push_back(point3D);
+          num_points3D += 1;
         }
       }
     }
 
-    if (points3D_cmb.size() >= points3D.size()) {
+    if (num_points3D >= max_num_points3D) {
       R_cam1_from_cam2 = R_cmbs[i].transpose();
       t_cam1_from_cam2 = t_cmbs[i];
-      points3D = points3D_cmb;
+      max_num_points3D = num_points3D;
     }
   }
 
   // Solve for t.
 
-  A.resize(kNumPoints, 3);
-  A.setZero();
-
-  Eigen::VectorXd b(kNumPoints);
-  b.setZero();
+  thread_local Eigen::MatrixXd A_t;
+  thread_local Eigen::VectorXd b;
+  A_t.resize(kNumPoints, 3);
+  b.resize(kNumPoints);
 
   for (size_t i = 0; i < kNumPoints; ++i) {
-    A.row(i) = points2[i].ray_in_virtual.transpose() *
-               R_cam1_from_cam2.transpose() *
-               CrossProductMatrix(points1[i].ray_in_virtual);
+    A_t.row(i) = points2[i].ray_in_virtual.transpose() *
+                 R_cam1_from_cam2.transpose() *
+                 CrossProductMatrix(points1[i].ray_in_virtual);
 
     b.row(i) = points2[i].ray_in_virtual.transpose() *
                    CrossProductMatrix(virtual_proj_centers2[i]) *
@@ -182,8 +204,8 @@ void RefracRelPoseEstimator::Estimate(const std::vector<X_t>& points1,
                    points1[i].ray_in_virtual;
   }
 
-  Eigen::JacobiSVD<Eigen::MatrixXd> t_svd(
-      A, Eigen::ComputeFullU | Eigen::ComputeFullV);
+  const Eigen::JacobiSVD<Eigen::MatrixXd> t_svd(
+      A_t, Eigen::ComputeThinU | Eigen::ComputeThinV);
   t_cam1_from_cam2 = t_svd.solve(b);
 
   models->push_back(
@@ -213,4 +235,333 @@ void RefracRelPoseEstimator::Residuals(const std::vector<X_t>& points1,
   }
 }
 
+void RefracRelPoseSixPointEstimator::Estimate(
+    const std::vector<X_t>& points1,
+    const std::vector<Y_t>& points2,
+    std::vector<M_t>* models) {
+  CHECK_GE(points1.size(), 6);
+  CHECK_EQ(points1.size(), points2.size());
+  CHECK(models != nullptr);
+
+  models->clear();
+
+  // Compose the Pluecker coordinates of the rays in the real cameras. The
+  // scratch buffers are reused across calls to avoid heap allocations in the
+  // RANSAC loop.
+  const size_t kNumPoints = points1.size();
+  thread_local std::vector<Eigen::Vector3d> rays1;
+  thread_local std::vector<Eigen::Vector3d> rays2;
+  thread_local std::vector<Eigen::Vector3d> moments1;
+  thread_local std::vector<Eigen::Vector3d> moments2;
+  thread_local std::vector<Eigen::Vector2d> normalized_points1;
+  thread_local std::vector<Eigen::Vector2d> normalized_points2;
+  rays1.resize(kNumPoints);
+  rays2.resize(kNumPoints);
+  moments1.resize(kNumPoints);
+  moments2.resize(kNumPoints);
+  normalized_points1.resize(kNumPoints);
+  normalized_points2.resize(kNumPoints);
+  for (size_t i = 0; i < kNumPoints; ++i) {
+    const Rigid3d real_from_virtual1 = Inverse(points1[i].virtual_from_real);
+    const Rigid3d real_from_virtual2 = Inverse(points2[i].virtual_from_real);
+    rays1[i] = real_from_virtual1.rotation * points1[i].ray_in_virtual;
+    rays2[i] = real_from_virtual2.rotation * points2[i].ray_in_virtual;
+    moments1[i] = real_from_virtual1.translation.cross(rays1[i]);
+    moments2[i] = real_from_virtual2.translation.cross(rays2[i]);
+    normalized_points1[i] = rays1[i].hnormalized();
+    normalized_points2[i] = rays2[i].hnormalized();
+  }
+
+  // Evaluates the squared generalized epipolar constraint
+  //
+  //    r2' [t]x R r1 + r2' R m1 + m2' R r1 = 0
+  //
+  // and optionally its normal equations with respect to a left-multiplied
+  // rotation increment and the translation increment.
+  auto ComputeCost = [&](const Eigen::Matrix3d& R,
+                         const Eigen::Vector3d& t,
+                         Eigen::Matrix<double, 6, 6>* H,
+                         Eigen::Matrix<double, 6, 1>* g) {
+    if (H != nullptr) {
+      H->setZero();
+      g->setZero();
+    }
+    double cost = 0;
+    for (size_t i = 0; i < kNumPoints; ++i) {
+      const Eigen::Vector3d R_ray1 = R * rays1[i];
+      const Eigen::Vector3d R_moment1 = R * moments1[i];
+      const Eigen::Vector3d a = rays2[i].cross(t) + moments2[i];
+      const double residual = R_ray1.dot(a) + rays2[i].dot(R_moment1);
+      cost += residual * residual;
+      if (H != nullptr) {
+        Eigen::Matrix<double, 6, 1> J;
+        J.head<3>() = R_ray1.cross(a) + R_moment1.cross(rays2[i]);
+        J.tail<3>() = R_ray1.cross(rays2[i]);
+        *H += J * J.transpose();
+        *g += residual * J;
+      }
+    }
+    return cost;
+  };
+
+  const int kMaxNumIterations = 50;
+  const double kMinCost = 1e-24;
+
+  // The virtual cameras are close to the real camera, such that the central
+  // essential matrix yields the initial rotations.
+  thread_local std::vector<Eigen::Matrix3d> Es;
+  EssentialMatrixFivePointEstimator::Estimate(
+      normalized_points1, normalized_points2, &Es);
+
+  models->reserve(2 * Es.size());
+  for (const Eigen::Matrix3d& E : Es) {
+    Eigen::Matrix3d R1;
+    Eigen::Matrix3d R2;
+    Eigen::Vector3d t_unused;
+    DecomposeEssentialMatrix(E, &R1, &R2, &t_unused);
+
+    for (Eigen::Matrix3d R : {R1, R2}) {
+      // The constraint is linear in the translation for a given rotation.
+      Eigen::Matrix<double, 6, 6> H;
+      Eigen::Matrix<double, 6, 1> g;
+      Eigen::Vector3d t = Eigen::Vector3d::Zero();
+      ComputeCost(R, t, &H, &g);
+      t = -H.bottomRightCorner<3, 3>().ldlt().solve(g.tail<3>());
+
+      // Levenberg-Marquardt refinement of rotation and translation.
+      double lambda = 1e-4;
+      double cost = ComputeCost(R, t, &H, &g);
+      for (int iter = 0; iter < kMaxNumIterations && cost > kMinCost;
+           ++iter) {
+        Eigen::Matrix<double, 6, 6> H_damped = H;
+        H_damped.diagonal() *= 1 + lambda;
+        const Eigen::Matrix<double, 6, 1> delta = -H_damped.ldlt().solve(g);
+        const double angle = delta.head<3>().norm();
+        const Eigen::Matrix3d R_new =
+            (angle > 0 ? Eigen::AngleAxisd(angle, delta.head<3>() / angle)
+                             .toRotationMatrix()
+                       : Eigen::Matrix3d::Identity()) *
+            R;
+        const Eigen::Vector3d t_new = t + delta.tail<3>();
+        if (ComputeCost(R_new, t_new, nullptr, nullptr) < cost) {
+          R = R_new;
+          t = t_new;
+          cost = ComputeCost(R, t, &H, &g);
+          lambda /= 10;
+        } else {
+          lambda *= 10;
+        }
+      }
+
+      if (R.allFinite() && t.allFinite()) {
+        models->emplace_back(Eigen::Quaterniond(R), t);
+      }
+    }
+  }
+}
+
+void RefracRelPoseSixPointEstimator::Residuals(
+    const std::vector<X_t>& points1,
+    const std::vector<Y_t>& points2,
+    const M_t& cam2_from_cam1,
+    std::vector<double>* residuals) {
+  RefracRelPoseEstimator::Residuals(
+      points1, points2, cam2_from_cam1, residuals);
+}
+
+void RefracRelPoseUprightEstimator::Estimate(
+    const std::vector<X_t>& points1,
+    const std::vector<Y_t>& points2,
+    std::vector<M_t>* models) const {
+  CHECK_GE(points1.size(), 8);
+  CHECK_EQ(points1.size(), points2.size());
+  CHECK(models != nullptr);
+
+  models->clear();
+
+  const Eigen::Matrix3d upright1_from_cam1 =
+      ComputeUprightFromCam(gravity_in_cam1);
+  const Eigen::Matrix3d upright2_from_cam2 =
+      ComputeUprightFromCam(gravity_in_cam2);
+
+  thread_local std::vector<Eigen::Vector3d> rays1;
+  thread_local std::vector<Eigen::Vector3d> rays2;
+  thread_local std::vector<Eigen::Vector3d> moments1;
+  thread_local std::vector<Eigen::Vector3d> moments2;
+  ComposeUprightPlueckerLines(points1, upright1_from_cam1, &rays1, &moments1);
+  ComposeUprightPlueckerLines(points2, upright2_from_cam2, &rays2, &moments2);
+
+  // With R = R_z(angle) and t = [tx, ty, tz], the essential matrix is
+  //
+  //    [t]x R = [a, b, ty; -b, a, -tx; d, e, 0]
+  //
+  // where a = -tz sin(angle) and b = -tz cos(angle), such that the generalized
+  // epipolar constraint
+  //
+  //    r2' [t]x R r1 + r2' R m1 + m2' R r1 = 0
+  //
+  // is linear in [a, b, tx, ty, d, e, cos(angle), sin(angle)].
+  const size_t kNumPoints = points1.size();
+  thread_local Eigen::Matrix<double, Eigen::Dynamic, 8> A;
+  thread_local Eigen::VectorXd b;
+  A.resize(kNumPoints, 8);
+  b.resize(kNumPoints);
+  for (size_t i = 0; i < kNumPoints; ++i) {
+    const Eigen::Vector3d& r1 = rays1[i];
+    const Eigen::Vector3d& r2 = rays2[i];
+    const Eigen::Vector3d& m1 = moments1[i];
+    const Eigen::Vector3d& m2 = moments2[i];
+    A(i, 0) = r2(0) * r1(0) + r2(1) * r1(1);
+    A(i, 1) = r2(0) * r1(1) - r2(1) * r1(0);
+    A(i, 2) = -r2(1) * r1(2);
+    A(i, 3) = r2(0) * r1(2);
+    A(i, 4) = r2(2) * r1(0);
+    A(i, 5) = r2(2) * r1(1);
+    A(i, 6) = r2(0) * m1(0) + r2(1) * m1(1) + m2(0) * r1(0) + m2(1) * r1(1);
+    A(i, 7) = r2(1) * m1(0) - r2(0) * m1(1) + m2(1) * r1(0) - m2(0) * r1(1);
+    b(i) = -r2(2) * m1(2) - m2(2) * r1(2);
+  }
+
+  const Eigen::Matrix<double, 8, 1> x =
+      A.colPivHouseholderQr().solve(b);
+  const double norm = x.tail<2>().norm();
+  if (!x.allFinite() ||
+      norm < std::numeric_limits<double>::epsilon()) {
+    return;
+  }
+
+  const double cos_angle = x(6) / norm;
+  const double sin_angle = x(7) / norm;
+  Eigen::Matrix3d R_z;
+  R_z << cos_angle, -sin_angle, 0, sin_angle, cos_angle, 0, 0, 0, 1;
+  const Eigen::Vector3d t(x(2), x(3), -(x(0) * sin_angle + x(1) * cos_angle));
+
+  models->emplace_back(
+      Eigen::Quaterniond(upright2_from_cam2.transpose() * R_z *
+                         upright1_from_cam1),
+      upright2_from_cam2.transpose() * t);
+}
+
+void RefracRelPoseUprightEstimator::Residuals(
+    const std::vector<X_t>& points1,
+    const std::vector<Y_t>& points2,
+    const M_t& cam2_from_cam1,
+    std::vector<double>* residuals) {
+  RefracRelPoseEstimator::Residuals(
+      points1, points2, cam2_from_cam1, residuals);
+}
+
+void RefracRelPoseUprightFourPointEstimator::Estimate(
+    const std::vector<X_t>& points1,
+    const std::vector<Y_t>& points2,
+    std::vector<M_t>* models) const {
+  CHECK_GE(points1.size(), 4);
+  CHECK_EQ(points1.size(), points2.size());
+  CHECK(models != nullptr);
+
+  models->clear();
+
+  const Eigen::Matrix3d upright1_from_cam1 =
+      ComputeUprightFromCam(gravity_in_cam1);
+  const Eigen::Matrix3d upright2_from_cam2 =
+      ComputeUprightFromCam(gravity_in_cam2);
+
+  const size_t kNumPoints = points1.size();
+  thread_local std::vector<Eigen::Vector3d> rays1;
+  thread_local std::vector<Eigen::Vector3d> rays2;
+  thread_local std::vector<Eigen::Vector3d> moments1;
+  thread_local std::vector<Eigen::Vector3d> moments2;
+  ComposeUprightPlueckerLines(points1, upright1_from_cam1, &rays1, &moments1);
+  ComposeUprightPlueckerLines(points2, upright2_from_cam2, &rays2, &moments2);
+
+  // Evaluates the squared generalized epipolar constraint and optionally its
+  // normal equations with respect to the rotation angle increment about the
+  // z-axis and the translation increment, see
+  // `RefracRelPoseSixPointEstimator`.
+  auto ComputeCost = [&](const Eigen::Matrix3d& R,
+                         const Eigen::Vector3d& t,
+                         Eigen::Matrix4d* H,
+                         Eigen::Vector4d* g) {
+    if (H != nullptr) {
+      H->setZero();
+      g->setZero();
+    }
+    double cost = 0;
+    for (size_t i = 0; i < kNumPoints; ++i) {
+      const Eigen::Vector3d R_ray1 = R * rays1[i];
+      const Eigen::Vector3d R_moment1 = R * moments1[i];
+      const Eigen::Vector3d a = rays2[i].cross(t) + moments2[i];
+      const double residual = R_ray1.dot(a) + rays2[i].dot(R_moment1);
+      cost += residual * residual;
+      if (H != nullptr) {
+        Eigen::Vector4d J;
+        J(0) = (R_ray1.cross(a) + R_moment1.cross(rays2[i]))(2);
+        J.tail<3>() = R_ray1.cross(rays2[i]);
+        *H += J * J.transpose();
+        *g += residual * J;
+      }
+    }
+    return cost;
+  };
+
+  const int kMaxNumIterations = 50;
+  const double kMinCost = 1e-24;
+
+  // The virtual cameras are close to the real camera, such that the central
+  // upright solver yields the initial rotation angles.
+  const std::vector<double> angles = ComputeUprightThreePointRotationAngles(
+      {rays1[0], rays1[1], rays1[2]}, {rays2[0], rays2[1], rays2[2]});
+
+  models->reserve(angles.size());
+  for (const double angle : angles) {
+    Eigen::Matrix3d R =
+        Eigen::AngleAxisd(angle, Eigen::Vector3d::UnitZ()).toRotationMatrix();
+
+    // The constraint is linear in the translation for a given rotation.
+    Eigen::Matrix4d H;
+    Eigen::Vector4d g;
+    Eigen::Vector3d t = Eigen::Vector3d::Zero();
+    ComputeCost(R, t, &H, &g);
+    t = -H.bottomRightCorner<3, 3>().ldlt().solve(g.tail<3>());
+
+    // Levenberg-Marquardt refinement of rotation angle and translation.
+    double lambda = 1e-4;
+    double cost = ComputeCost(R, t, &H, &g);
+    for (int iter = 0; iter < kMaxNumIterations && cost > kMinCost; ++iter) {
+      Eigen::Matrix4d H_damped = H;
+      H_damped.diagonal() *= 1 + lambda;
+      const Eigen::Vector4d delta = -H_damped.ldlt().solve(g);
+      const Eigen::Matrix3d R_new =
+          Eigen::AngleAxisd(delta(0), Eigen::Vector3d::UnitZ())
+              .toRotationMatrix() *
+          R;
+      const Eigen::Vector3d t_new = t + delta.tail<3>();
+      if (ComputeCost(R_new, t_new, nullptr, nullptr) < cost) {
+        R = R_new;
+        t = t_new;
+        cost = ComputeCost(R, t, &H, &g);
+        lambda /= 10;
+      } else {
+        lambda *= 10;
+      }
+    }
+
+    if (R.allFinite() && t.allFinite()) {
+      models->emplace_back(
+          Eigen::Quaterniond(upright2_from_cam2.transpose() * R *
+                             upright1_from_cam1),
+          upright2_from_cam2.transpose() * t);
+    }
+  }
+}
+
+void RefracRelPoseUprightFourPointEstimator::Residuals(
+    const std::vector<X_t>& points1,
+    const std::vector<Y_t>& points2,
+    const M_t& cam2_from_cam1,
+    std::vector<double>* residuals) {
+  RefracRelPoseEstimator::Residuals(
+      points1, points2, cam2_from_cam1, residuals);
+}
+
 }  // namespace colmap
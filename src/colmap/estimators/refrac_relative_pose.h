@@ -33,8 +33,8 @@ class RefracRelPoseEstimator {
   // The estimated cam2_from_cam1 relative pose between the cameras.
   typedef Rigid3d M_t;
 
-  // The minimum number of samples needed to estimate a model. I guess it is 17,
-  // not too sure yet.
+  // The minimum number of samples needed to estimate a model. The linear
+  // system of the generalized epipolar constraint has 18 unknowns up to scale.
   static const int kMinNumSamples = 17;
 
   // Estimate the most probable solution of the refractive relative pose problem
@@ -49,4 +49,104 @@ class RefracRelPoseEstimator {
                         const M_t& cam2_from_cam1,
                         std::vector<double>* residuals);
 };
+
+// Solver for the Refractive Relative Pose problem from the minimal number of
+// 6 correspondences. The initial rotations are estimated with the five-point
+// algorithm by approximating the virtual cameras with the real camera, and the
+// poses are then refined on the generalized epipolar constraint of the
+// virtual cameras, which also recovers the scale of the translation. The small
+// sample size makes it the better choice for generating hypotheses in RANSAC,
+// while `RefracRelPoseEstimator` is better suited for the local optimization
+// from many inliers.
+class RefracRelPoseSixPointEstimator {
+ public:
+  typedef RefracRelPoseEstimator::X_t X_t;
+  typedef RefracRelPoseEstimator::Y_t Y_t;
+  typedef RefracRelPoseEstimator::M_t M_t;
+
+  // The minimum number of samples needed to estimate a model.
+  static const int kMinNumSamples = 6;
+
+  // Estimate the possible solutions of the refractive relative pose problem
+  // from a set of 2D-2D point correspondences.
+  static void Estimate(const std::vector<X_t>& points1,
+                       const std::vector<Y_t>& points2,
+                       std::vector<M_t>* models);
+
+  // Calculate the squared Sampson error between corresponding points, see
+  // `RefracRelPoseEstimator::Residuals`.
+  static void Residuals(const std::vector<X_t>& points1,
+                        const std::vector<Y_t>& points2,
+                        const M_t& cam2_from_cam1,
+                        std::vector<double>* residuals);
+};
+
+// Solver for the Refractive Relative Pose problem with known gravity direction
+// in both cameras, e.g., from the roll and pitch of an inertial sensor. The
+// relative rotation is restricted to rotations about gravity, such that the
+// generalized epipolar constraint of `RefracRelPoseEstimator` becomes linear
+// in 8 unknowns with a known inhomogeneous term: the rotation angle as its
+// cosine and sine and the 6 non-zero entries of the essential matrix.
+class RefracRelPoseUprightEstimator {
+ public:
+  typedef RefracRelPoseEstimator::X_t X_t;
+  typedef RefracRelPoseEstimator::Y_t Y_t;
+  typedef RefracRelPoseEstimator::M_t M_t;
+
+  // The minimum number of samples needed to estimate a model.
+  static const int kMinNumSamples = 8;
+
+  // The gravity direction in the first and second real camera frame. Their
+  // norms are irrelevant, but their signs must be consistent.
+  Eigen::Vector3d gravity_in_cam1 = Eigen::Vector3d::UnitY();
+  Eigen::Vector3d gravity_in_cam2 = Eigen::Vector3d::UnitY();
+
+  // Estimate the solution of the refractive relative pose problem from a set
+  // of 2D-2D point correspondences.
+  void Estimate(const std::vector<X_t>& points1,
+                const std::vector<Y_t>& points2,
+                std::vector<M_t>* models) const;
+
+  // Calculate the squared Sampson error between corresponding points, see
+  // `RefracRelPoseEstimator::Residuals`.
+  static void Residuals(const std::vector<X_t>& points1,
+                        const std::vector<Y_t>& points2,
+                        const M_t& cam2_from_cam1,
+                        std::vector<double>* residuals);
+};
+
+// Solver for the Refractive Relative Pose problem with known gravity direction
+// from the minimal number of 4 correspondences, analogous to
+// `RefracRelPoseSixPointEstimator`. The initial rotations are estimated with
+// the upright three-point algorithm by approximating the virtual cameras with
+// the real camera, and the rotation angles and translations are then refined
+// on the generalized epipolar constraint of the virtual cameras.
+class RefracRelPoseUprightFourPointEstimator {
+ public:
+  typedef RefracRelPoseEstimator::X_t X_t;
+  typedef RefracRelPoseEstimator::Y_t Y_t;
+  typedef RefracRelPoseEstimator::M_t M_t;
+
+  // The minimum number of samples needed to estimate a model.
+  static const int kMinNumSamples = 4;
+
+  // The gravity direction in the first and second real camera frame, see
+  // `RefracRelPoseUprightEstimator`.
+  Eigen::Vector3d gravity_in_cam1 = Eigen::Vector3d::UnitY();
+  Eigen::Vector3d gravity_in_cam2 = Eigen::Vector3d::UnitY();
+
+  // Estimate the possible solutions of the refractive relative pose problem
+  // from a set of 2D-2D point correspondences.
+  void Estimate(const std::vector<X_t>& points1,
+                const std::vector<Y_t>& points2,
+                std::vector<M_t>* models) const;
+
+  // Calculate the squared Sampson error between corresponding points, see
+  // `RefracRelPoseEstimator::Residuals`.
+  static void Residuals(const std::vector<X_t>& points1,
+                        const std::vector<Y_t>& points2,
+                        const M_t& cam2_from_cam1,
+                        std::vector<double>* residuals);
+};
+
 }  // namespace colmap
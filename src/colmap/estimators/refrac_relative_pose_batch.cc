@@ -0,0 +1,283 @@
+#include "colmap/estimators/refrac_relative_pose_batch.h"
+
+#include "colmap/optim/random_sampler.h"
+#include "colmap/util/logging.h"
+#include "colmap/util/threading.h"
+
+#include <algorithm>
+#include <memory>
+
+namespace colmap {
+namespace {
+
+typedef RANSAC<RefracRelPoseSixPointEstimator> RefracRelPoseRANSAC;
+
+struct BatchState {
+  std::unique_ptr<RandomSampler> sampler;
+  size_t max_num_trials = 0;
+  size_t dyn_max_num_trials = 0;
+  bool done = false;
+  bool improved = false;
+  // The hypotheses of the current round.
+  std::vector<Rigid3d> models;
+};
+
+void SampleHypotheses(const RefracRelPoseProblem& problem,
+                      const int num_trials_per_round,
+                      BatchState* state,
+                      RefracRelPoseReport* report) {
+  std::vector<RefracRelPoseSixPointEstimator::X_t> X_rand(
+      RefracRelPoseSixPointEstimator::kMinNumSamples);
+  std::vector<RefracRelPoseSixPointEstimator::Y_t> Y_rand(
+      RefracRelPoseSixPointEstimator::kMinNumSamples);
+  std::vector<RefracRelPoseSixPointEstimator::M_t> sample_models;
+
+  state->models.clear();
+  for (int i = 0;
+       i < num_trials_per_round && report->num_trials < state->max_num_trials;
+       ++i) {
+    state->sampler->SampleXY(
+        problem.points1, problem.points2, &X_rand, &Y_rand);
+    RefracRelPoseSixPointEstimator::Estimate(X_rand, Y_rand, &sample_models);
+    state->models.insert(
+        state->models.end(), sample_models.begin(), sample_models.end());
+    report->num_trials += 1;
+  }
+}
+
+void UpdateBestModel(const RefracRelPoseProblem& problem,
+                     const RANSACOptions& options,
+                     BatchState* state,
+                     RefracRelPoseReport* report) {
+  if (!state->improved) {
+    return;
+  }
+
+  const size_t num_samples = problem.points1.size();
+  const double max_residual = problem.max_error * problem.max_error;
+
+  // Recursive local optimization of the best model to expand its inlier set,
+  // see `LORANSAC`.
+  if (report->support.num_inliers >
+          RefracRelPoseSixPointEstimator::kMinNumSamples &&
+      report->support.num_inliers >= RefracRelPoseEstimator::kMinNumSamples) {
+    InlierSupportMeasurer support_measurer;
+    std::vector<double> residuals;
+    std::vector<RefracRelPoseEstimator::X_t> X_inlier;
+    std::vector<RefracRelPoseEstimator::Y_t> Y_inlier;
+    std::vector<RefracRelPoseEstimator::M_t> local_models;
+
+    const size_t kMaxNumLocalTrials = 10;
+    for (size_t local_num_trials = 0; local_num_trials < kMaxNumLocalTrials;
+         ++local_num_trials) {
+      RefracRelPoseEstimator::Residuals(
+          problem.points1, problem.points2, report->model, &residuals);
+      report->num_residuals += num_samples;
+      X_inlier.clear();
+      Y_inlier.clear();
+      for (size_t i = 0; i < num_samples; ++i) {
+        if (residuals[i] <= max_residual) {
+          X_inlier.push_back(problem.points1[i]);
+          Y_inlier.push_back(problem.points2[i]);
+        }
+      }
+
+      RefracRelPoseEstimator::Estimate(X_inlier, Y_inlier, &local_models);
+
+      const size_t prev_best_num_inliers = report->support.num_inliers;
+      for (const auto& local_model : local_models) {
+        RefracRelPoseEstimator::Residuals(
+            problem.points1, problem.points2, local_model, &residuals);
+        report->num_residuals += num_samples;
+        const auto local_support =
+            support_measurer.Evaluate(residuals, max_residual);
+        if (support_measurer.Compare(local_support, report->support)) {
+          report->support = local_support;
+          report->model = local_model;
+        }
+      }
+
+      // Only continue recursive local optimization, if the inlier set size
+      // increased and we thus have a chance to further improve.
+      if (report->support.num_inliers <= prev_best_num_inliers) {
+        break;
+      }
+    }
+  }
+
+  state->dyn_max_num_trials =
+      RefracRelPoseRANSAC::ComputeNumTrials(report->support.num_inliers,
+                                            num_samples,
+                                            options.confidence,
+                                            options.dyn_num_trials_multiplier);
+  state->improved = false;
+}
+
+}  // namespace
+
+void RefracRelPoseScorerCPU::SetProblems(
+    const std::vector<RefracRelPoseProblem>& problems) {
+  problems_ = &problems;
+}
+
+void RefracRelPoseScorerCPU::Score(
+    const std::vector<Rigid3d>& models,
+    const std::vector<size_t>& model_problem_idxs,
+    std::vector<Support>* supports) {
+  CHECK_NOTNULL(problems_);
+  CHECK_EQ(models.size(), model_problem_idxs.size());
+  CHECK_NOTNULL(supports);
+
+  InlierSupportMeasurer support_measurer;
+  std::vector<double> residuals;
+  supports->resize(models.size());
+  for (size_t i = 0; i < models.size(); ++i) {
+    const RefracRelPoseProblem& problem = problems_->at(model_problem_idxs[i]);
+    RefracRelPoseEstimator::Residuals(
+        problem.points1, problem.points2, models[i], &residuals);
+    (*supports)[i] = support_measurer.Evaluate(
+        residuals, problem.max_error * problem.max_error);
+  }
+}
+
+std::vector<RefracRelPoseReport> EstimateRefracRelPoseBatch(
+    const RANSACOptions& options,
+    const int num_trials_per_round,
+    const std::vector<RefracRelPoseProblem>& problems,
+    RefracRelPoseScorer* scorer,
+    const int num_threads) {
+  CHECK_GT(num_trials_per_round, 0);
+  CHECK_NOTNULL(scorer);
+
+  const size_t kNumProblems = problems.size();
+  std::vector<RefracRelPoseReport> reports(kNumProblems);
+  std::vector<BatchState> states(kNumProblems);
+
+  // Determine max_num_trials based on assumed `min_inlier_ratio`, see `RANSAC`.
+  const size_t kNumSamples = 100000;
+  const size_t max_num_trials = std::min<size_t>(
+      options.max_num_trials,
+      RefracRelPoseRANSAC::ComputeNumTrials(
+          static_cast<size_t>(options.min_inlier_ratio * kNumSamples),
+          kNumSamples,
+          options.confidence,
+          options.dyn_num_trials_multiplier));
+  const size_t min_num_trials = options.min_num_trials;
+
+  for (size_t i = 0; i < kNumProblems; ++i) {
+    const RefracRelPoseProblem& problem = problems[i];
+    CHECK_EQ(problem.points1.size(), problem.points2.size());
+    CHECK_GT(problem.max_error, 0);
+    BatchState& state = states[i];
+    if (problem.points1.size() <
+        RefracRelPoseSixPointEstimator::kMinNumSamples) {
+      state.done = true;
+      continue;
+    }
+    state.sampler = std::make_unique<RandomSampler>(
+        RefracRelPoseSixPointEstimator::kMinNumSamples);
+    state.sampler->Initialize(problem.points1.size());
+    state.max_num_trials =
+        std::min<size_t>(max_num_trials, state.sampler->MaxNumSamples());
+    state.dyn_max_num_trials = state.max_num_trials;
+  }
+
+  scorer->SetProblems(problems);
+
+  ThreadPool thread_pool(GetEffectiveNumThreads(num_threads));
+
+  std::vector<Rigid3d> models;
+  std::vector<size_t> model_problem_idxs;
+  std::vector<RefracRelPoseScorer::Support> supports;
+  InlierSupportMeasurer support_measurer;
+
+  while (std::any_of(states.begin(),
+                     states.end(),
+                     [](const BatchState& state) { return !state.done; })) {
+    // Generate the hypotheses of all active problems.
+    for (size_t i = 0; i < kNumProblems; ++i) {
+      if (!states[i].done) {
+        thread_pool.AddTask(SampleHypotheses,
+                            std::cref(problems[i]),
+                            num_trials_per_round,
+                            &states[i],
+                            &reports[i]);
+      }
+    }
+    thread_pool.Wait();
+
+    models.clear();
+    model_problem_idxs.clear();
+    for (size_t i = 0; i < kNumProblems; ++i) {
+      if (!states[i].done) {
+        models.insert(
+            models.end(), states[i].models.begin(), states[i].models.end());
+        model_problem_idxs.resize(models.size(), i);
+      }
+    }
+
+    if (!models.empty()) {
+      scorer->Score(models, model_problem_idxs, &supports);
+      CHECK_EQ(supports.size(), models.size());
+    }
+
+    for (size_t i = 0; i < models.size(); ++i) {
+      const size_t problem_idx = model_problem_idxs[i];
+      RefracRelPoseReport& report = reports[problem_idx];
+      report.num_residuals += problems[problem_idx].points1.size();
+      if (support_measurer.Compare(supports[i], report.support)) {
+        report.support = supports[i];
+        report.model = models[i];
+        states[problem_idx].improved = true;
+      }
+    }
+
+    for (size_t i = 0; i < kNumProblems; ++i) {
+      if (!states[i].done) {
+        thread_pool.AddTask(UpdateBestModel,
+                            std::cref(problems[i]),
+                            std::cref(options),
+                            &states[i],
+                            &reports[i]);
+      }
+    }
+    thread_pool.Wait();
+
+    for (size_t i = 0; i < kNumProblems; ++i) {
+      BatchState& state = states[i];
+      const size_t num_trials = reports[i].num_trials;
+      if (num_trials >= state.max_num_trials ||
+          (num_trials >= state.dyn_max_num_trials &&
+           num_trials >= min_num_trials)) {
+        state.done = true;
+      }
+    }
+  }
+
+  std::vector<double> residuals;
+  for (size_t i = 0; i < kNumProblems; ++i) {
+    const RefracRelPoseProblem& problem = problems[i];
+    RefracRelPoseReport& report = reports[i];
+
+    // No valid model was found.
+    if (report.support.num_inliers <
+        RefracRelPoseSixPointEstimator::kMinNumSamples) {
+      continue;
+    }
+
+    report.success = true;
+
+    // Both estimators share the same residuals.
+    RefracRelPoseEstimator::Residuals(
+        problem.points1, problem.points2, report.model, &residuals);
+    const double max_residual = problem.max_error * problem.max_error;
+    report.inlier_mask.resize(residuals.size());
+    for (size_t j = 0; j < residuals.size(); ++j) {
+      report.inlier_mask[j] = residuals[j] <= max_residual;
+    }
+  }
+
+  return reports;
+}
+
+}  // namespace colmap
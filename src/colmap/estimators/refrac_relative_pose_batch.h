@@ -0,0 +1,82 @@
+#pragma once
+
+#include "colmap/estimators/refrac_relative_pose.h"
+#include "colmap/optim/ransac.h"
+#include "colmap/optim/support_measurement.h"
+
+#include <vector>
+
+namespace colmap {
+
+// Correspondences of one image pair in the batched estimation of refractive
+// relative poses.
+struct RefracRelPoseProblem {
+  std::vector<RefracRelPoseEstimator::X_t> points1;
+  std::vector<RefracRelPoseEstimator::Y_t> points2;
+
+  // Maximum error for a correspondence to be considered as an inlier, which
+  // replaces `RANSACOptions::max_error`, since the error threshold in the
+  // virtual cameras depends on the image pair.
+  double max_error = 0.0;
+};
+
+// Computes the support of relative pose hypotheses of many image pairs at
+// once, such that the residuals can be evaluated in parallel, e.g., on the GPU.
+class RefracRelPoseScorer {
+ public:
+  typedef InlierSupportMeasurer::Support Support;
+
+  virtual ~RefracRelPoseScorer() = default;
+
+  // Set the problems of the following calls to `Score`. The problems must
+  // remain valid until they are replaced.
+  virtual void SetProblems(
+      const std::vector<RefracRelPoseProblem>& problems) = 0;
+
+  // Compute the support of each cam2_from_cam1 model on the correspondences
+  // of the problem with the corresponding index in `model_problem_idxs`.
+  virtual void Score(const std::vector<Rigid3d>& models,
+                     const std::vector<size_t>& model_problem_idxs,
+                     std::vector<Support>* supports) = 0;
+};
+
+// Scorer that evaluates the residuals on the CPU.
+class RefracRelPoseScorerCPU : public RefracRelPoseScorer {
+ public:
+  void SetProblems(const std::vector<RefracRelPoseProblem>& problems) override;
+
+  void Score(const std::vector<Rigid3d>& models,
+             const std::vector<size_t>& model_problem_idxs,
+             std::vector<Support>* supports) override;
+
+ private:
+  const std::vector<RefracRelPoseProblem>* problems_ = nullptr;
+};
+
+typedef RANSAC<RefracRelPoseSixPointEstimator>::Report RefracRelPoseReport;
+
+// Robustly estimate the relative poses of many image pairs with LO-RANSAC,
+// where `RefracRelPoseSixPointEstimator` generates the hypotheses and
+// `RefracRelPoseEstimator` locally optimizes them. The trials of all image
+// pairs are evaluated together in rounds of `num_trials_per_round` trials per
+// pair by the scorer, and a pair stops sampling once it reaches its dynamic
+// maximum number of trials. The local optimization of a pair is performed at
+// the end of each round in which its best model improved. The hypotheses are
+// generated and optimized for the pairs in parallel on `num_threads` threads.
+//
+// @param options               RANSAC options, where `max_error` is replaced
+//                              by the error of each problem.
+// @param num_trials_per_round  The number of trials per pair and round.
+// @param problems              The correspondences of the image pairs.
+// @param scorer                The scorer of the hypotheses.
+// @param num_threads           The number of CPU threads, where -1 uses all.
+//
+// @return                      The RANSAC report of each image pair.
+std::vector<RefracRelPoseReport> EstimateRefracRelPoseBatch(
+    const RANSACOptions& options,
+    int num_trials_per_round,
+    const std::vector<RefracRelPoseProblem>& problems,
+    RefracRelPoseScorer* scorer,
+    int num_threads = 1);
+
+}  // namespace colmap
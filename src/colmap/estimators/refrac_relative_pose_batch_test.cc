@@ -0,0 +1,129 @@
+#include "colmap/estimators/refrac_relative_pose_batch.h"
+
+#include "colmap/geometry/rigid3.h"
+#include "colmap/math/random.h"
+
+#include <gtest/gtest.h>
+
+namespace colmap {
+namespace {
+
+Rigid3d RandomVirtualFromReal() {
+  const Eigen::Vector3d int_normal =
+      Eigen::Vector3d(0.05, 0.02, 1).normalized();
+  return Rigid3d(Eigen::Quaterniond::Identity(),
+                 -RandomUniformReal(0.0, 0.04) * int_normal);
+}
+
+RefracRelPoseProblem GenerateProblem(const Rigid3d& cam2_from_cam1,
+                                     const size_t num_points,
+                                     const size_t num_outliers) {
+  RefracRelPoseProblem problem;
+  problem.max_error = 1e-4;
+  while (problem.points1.size() < num_points) {
+    const Eigen::Vector3d point3D(RandomUniformReal(-2.0, 2.0),
+                                  RandomUniformReal(-2.0, 2.0),
+                                  RandomUniformReal(3.0, 5.0));
+    RefracRelPoseEstimator::X_t point1;
+    point1.virtual_from_real = RandomVirtualFromReal();
+    const Eigen::Vector3d point3D_virtual1 = point1.virtual_from_real * point3D;
+    RefracRelPoseEstimator::Y_t point2;
+    point2.virtual_from_real = RandomVirtualFromReal();
+    const Eigen::Vector3d point3D_virtual2 =
+        point2.virtual_from_real * (cam2_from_cam1 * point3D);
+    if (point3D_virtual1.z() <= 0 || point3D_virtual2.z() <= 0) {
+      continue;
+    }
+    point1.ray_in_virtual = point3D_virtual1.normalized();
+    point2.ray_in_virtual = point3D_virtual2.normalized();
+    problem.points1.push_back(point1);
+    problem.points2.push_back(point2);
+  }
+  for (size_t i = 0; i < num_outliers; ++i) {
+    problem.points2[i].ray_in_virtual =
+        Eigen::Vector3d(
+            RandomUniformReal(-0.5, 0.5), RandomUniformReal(-0.5, 0.5), 1)
+            .normalized();
+  }
+  return problem;
+}
+
+Rigid3d RandomCam2FromCam1() {
+  return Rigid3d(Eigen::Quaterniond(1,
+                                    RandomUniformReal(-0.1, 0.1),
+                                    RandomUniformReal(-0.1, 0.1),
+                                    RandomUniformReal(-0.1, 0.1))
+                     .normalized(),
+                 Eigen::Vector3d(RandomUniformReal(0.4, 0.8),
+                                 RandomUniformReal(-0.2, 0.2),
+                                 RandomUniformReal(-0.1, 0.1)));
+}
+
+TEST(RefracRelPoseScorerCPU, Score) {
+  SetPRNGSeed(0);
+  std::vector<Rigid3d> cams2_from_cams1;
+  std::vector<RefracRelPoseProblem> problems;
+  for (int i = 0; i < 3; ++i) {
+    cams2_from_cams1.push_back(RandomCam2FromCam1());
+    problems.push_back(GenerateProblem(cams2_from_cams1.back(), 50, 10 * i));
+  }
+
+  RefracRelPoseScorerCPU scorer;
+  scorer.SetProblems(problems);
+
+  const std::vector<Rigid3d> models = {
+      cams2_from_cams1[0], cams2_from_cams1[2], cams2_from_cams1[1]};
+  const std::vector<size_t> model_problem_idxs = {0, 2, 0};
+  std::vector<RefracRelPoseScorer::Support> supports;
+  scorer.Score(models, model_problem_idxs, &supports);
+  ASSERT_EQ(supports.size(), models.size());
+  EXPECT_EQ(supports[0].num_inliers, 50);
+  EXPECT_EQ(supports[1].num_inliers, 30);
+  EXPECT_LT(supports[2].num_inliers, 50);
+}
+
+TEST(EstimateRefracRelPoseBatch, Nominal) {
+  SetPRNGSeed(0);
+  const size_t kNumPoints = 200;
+  std::vector<Rigid3d> cams2_from_cams1;
+  std::vector<size_t> num_outliers;
+  std::vector<RefracRelPoseProblem> problems;
+  for (int i = 0; i < 5; ++i) {
+    cams2_from_cams1.push_back(RandomCam2FromCam1());
+    num_outliers.push_back(30 * i);
+    problems.push_back(GenerateProblem(
+        cams2_from_cams1.back(), kNumPoints, num_outliers.back()));
+  }
+  // Image pair with too few correspondences for the minimal solver.
+  problems.push_back(GenerateProblem(RandomCam2FromCam1(), 5, 0));
+
+  RANSACOptions options;
+  options.min_inlier_ratio = 0.3;
+  RefracRelPoseScorerCPU scorer;
+  const std::vector<RefracRelPoseReport> reports =
+      EstimateRefracRelPoseBatch(options,
+                                 /*num_trials_per_round=*/16,
+                                 problems,
+                                 &scorer,
+                                 /*num_threads=*/2);
+  ASSERT_EQ(reports.size(), problems.size());
+
+  for (size_t i = 0; i < cams2_from_cams1.size(); ++i) {
+    const RefracRelPoseReport& report = reports[i];
+    EXPECT_TRUE(report.success);
+    EXPECT_GE(report.support.num_inliers, kNumPoints - num_outliers[i]);
+    ASSERT_EQ(report.inlier_mask.size(), kNumPoints);
+    for (size_t j = num_outliers[i]; j < kNumPoints; ++j) {
+      EXPECT_TRUE(report.inlier_mask[j]);
+    }
+    EXPECT_LT(
+        (report.model.ToMatrix() - cams2_from_cams1[i].ToMatrix()).norm(),
+        1e-4);
+  }
+
+  EXPECT_FALSE(reports.back().success);
+  EXPECT_EQ(reports.back().num_trials, 0);
+}
+
+}  // namespace
+}  // namespace colmap
@@ -0,0 +1,85 @@
+#include "colmap/estimators/refrac_relative_pose.h"
+#include "colmap/geometry/rigid3.h"
+#include "colmap/math/random.h"
+
+#include <benchmark/benchmark.h>
+
+namespace colmap {
+namespace {
+
+// Virtual cameras of a flat port, which are offset from the real camera along
+// the interface normal depending on the refraction of the ray.
+Rigid3d RandomVirtualFromReal() {
+  const Eigen::Vector3d int_normal =
+      Eigen::Vector3d(0.05, 0.02, 1).normalized();
+  return Rigid3d(Eigen::Quaterniond::Identity(),
+                 -RandomUniformReal(0.0, 0.04) * int_normal);
+}
+
+Rigid3d Cam2FromCam1() {
+  return Rigid3d(Eigen::Quaterniond(1, 0.1, -0.05, 0.02).normalized(),
+                 Eigen::Vector3d(-0.8, 0.1, 0.05));
+}
+
+void GenerateCorrespondences(
+    const size_t num_points,
+    std::vector<RefracRelPoseEstimator::X_t>* points1,
+    std::vector<RefracRelPoseEstimator::Y_t>* points2) {
+  SetPRNGSeed(0);
+  const Rigid3d cam2_from_cam1 = Cam2FromCam1();
+  while (points1->size() < num_points) {
+    const Eigen::Vector3d point3D(RandomUniformReal(-2.0, 2.0),
+                                  RandomUniformReal(-2.0, 2.0),
+                                  RandomUniformReal(3.0, 5.0));
+    RefracRelPoseEstimator::X_t point1;
+    point1.virtual_from_real = RandomVirtualFromReal();
+    const Eigen::Vector3d point3D_virtual1 = point1.virtual_from_real * point3D;
+    RefracRelPoseEstimator::Y_t point2;
+    point2.virtual_from_real = RandomVirtualFromReal();
+    const Eigen::Vector3d point3D_virtual2 =
+        point2.virtual_from_real * (cam2_from_cam1 * point3D);
+    if (point3D_virtual1.z() <= 0 || point3D_virtual2.z() <= 0) {
+      continue;
+    }
+    point1.ray_in_virtual = point3D_virtual1.normalized();
+    point2.ray_in_virtual = point3D_virtual2.normalized();
+    points1->push_back(point1);
+    points2->push_back(point2);
+  }
+}
+
+template <typename Estimator>
+void BM_RefracRelPoseEstimate(benchmark::State& state) {
+  std::vector<typename Estimator::X_t> points1;
+  std::vector<typename Estimator::Y_t> points2;
+  GenerateCorrespondences(state.range(0), &points1, &points2);
+  std::vector<typename Estimator::M_t> models;
+  for (auto _ : state) {
+    Estimator::Estimate(points1, points2, &models);
+    benchmark::DoNotOptimize(models.data());
+  }
+}
+BENCHMARK_TEMPLATE(BM_RefracRelPoseEstimate, RefracRelPoseEstimator)
+    ->Arg(RefracRelPoseEstimator::kMinNumSamples)
+    ->Arg(100)
+    ->Arg(1000);
+BENCHMARK_TEMPLATE(BM_RefracRelPoseEstimate, RefracRelPoseSixPointEstimator)
+    ->Arg(RefracRelPoseSixPointEstimator::kMinNumSamples);
+
+void BM_RefracRelPoseResiduals(benchmark::State& state) {
+  std::vector<RefracRelPoseEstimator::X_t> points1;
+  std::vector<RefracRelPoseEstimator::Y_t> points2;
+  GenerateCorrespondences(state.range(0), &points1, &points2);
+  const Rigid3d cam2_from_cam1 = Cam2FromCam1();
+  std::vector<double> residuals;
+  for (auto _ : state) {
+    RefracRelPoseEstimator::Residuals(
+        points1, points2, cam2_from_cam1, &residuals);
+    benchmark::DoNotOptimize(residuals.data());
+  }
+  state.SetItemsProcessed(state.iterations() * points1.size());
+}
+BENCHMARK(BM_RefracRelPoseResiduals)->Arg(1000);
+
+}  // namespace
+}  // namespace colmap
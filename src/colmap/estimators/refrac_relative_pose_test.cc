@@ -0,0 +1,174 @@
+#include "colmap/estimators/refrac_relative_pose.h"
+
+#include "colmap/geometry/rigid3.h"
+#include "colmap/math/random.h"
+#include "colmap/optim/loransac.h"
+
+#include <gtest/gtest.h>
+
+namespace colmap {
+namespace {
+
+// Virtual cameras of a flat port, which are offset from the real camera along
+// the interface normal depending on the refraction of the ray.
+Rigid3d RandomVirtualFromReal() {
+  const Eigen::Vector3d int_normal =
+      Eigen::Vector3d(0.05, 0.02, 1).normalized();
+  return Rigid3d(Eigen::Quaterniond::Identity(),
+                 -RandomUniformReal(0.0, 0.04) * int_normal);
+}
+
+void GenerateCorrespondences(
+    const Rigid3d& cam2_from_cam1,
+    const size_t num_points,
+    std::vector<RefracRelPoseEstimator::X_t>* points1,
+    std::vector<RefracRelPoseEstimator::Y_t>* points2) {
+  while (points1->size() < num_points) {
+    const Eigen::Vector3d point3D(RandomUniformReal(-2.0, 2.0),
+                                  RandomUniformReal(-2.0, 2.0),
+                                  RandomUniformReal(3.0, 5.0));
+    RefracRelPoseEstimator::X_t point1;
+    point1.virtual_from_real = RandomVirtualFromReal();
+    const Eigen::Vector3d point3D_virtual1 = point1.virtual_from_real * point3D;
+    RefracRelPoseEstimator::Y_t point2;
+    point2.virtual_from_real = RandomVirtualFromReal();
+    const Eigen::Vector3d point3D_virtual2 =
+        point2.virtual_from_real * (cam2_from_cam1 * point3D);
+    if (point3D_virtual1.z() <= 0 || point3D_virtual2.z() <= 0) {
+      continue;
+    }
+    point1.ray_in_virtual = point3D_virtual1.normalized();
+    point2.ray_in_virtual = point3D_virtual2.normalized();
+    points1->push_back(point1);
+    points2->push_back(point2);
+  }
+}
+
+TEST(RefracRelPoseSixPointEstimator, Estimate) {
+  SetPRNGSeed(0);
+  const Rigid3d cam2_from_cam1(
+      Eigen::Quaterniond(1, 0.1, -0.05, 0.02).normalized(),
+      Eigen::Vector3d(-0.8, 0.1, 0.05));
+
+  // The refinement from the central initialization does not converge to the
+  // true pose for every sample, which RANSAC compensates for.
+  const int kNumTrials = 100;
+  int num_successes = 0;
+  for (int i = 0; i < kNumTrials; ++i) {
+    std::vector<RefracRelPoseSixPointEstimator::X_t> points1;
+    std::vector<RefracRelPoseSixPointEstimator::Y_t> points2;
+    GenerateCorrespondences(cam2_from_cam1,
+                            RefracRelPoseSixPointEstimator::kMinNumSamples,
+                            &points1,
+                            &points2);
+
+    std::vector<RefracRelPoseSixPointEstimator::M_t> models;
+    RefracRelPoseSixPointEstimator::Estimate(points1, points2, &models);
+
+    // The minimal solver recovers the scale of the translation.
+    for (const auto& model : models) {
+      if ((model.ToMatrix() - cam2_from_cam1.ToMatrix()).norm() < 1e-6) {
+        num_successes += 1;
+        break;
+      }
+    }
+  }
+  EXPECT_GE(num_successes, kNumTrials / 3);
+}
+
+TEST(RefracRelPoseSixPointEstimator, LORANSAC) {
+  SetPRNGSeed(0);
+  const Rigid3d cam2_from_cam1(
+      Eigen::Quaterniond(1, -0.05, 0.1, 0.02).normalized(),
+      Eigen::Vector3d(0.6, -0.2, 0.1));
+
+  const size_t kNumPoints = 200;
+  const size_t kNumOutliers = 120;
+  std::vector<RefracRelPoseSixPointEstimator::X_t> points1;
+  std::vector<RefracRelPoseSixPointEstimator::Y_t> points2;
+  GenerateCorrespondences(cam2_from_cam1, kNumPoints, &points1, &points2);
+  for (size_t i = 0; i < kNumOutliers; ++i) {
+    points2[i].ray_in_virtual = Eigen::Vector3d(RandomUniformReal(-0.5, 0.5),
+                                                RandomUniformReal(-0.5, 0.5),
+                                                1)
+                                    .normalized();
+  }
+
+  RANSACOptions options;
+  options.max_error = 1e-4;
+  options.min_inlier_ratio = 0.3;
+  LORANSAC<RefracRelPoseSixPointEstimator, RefracRelPoseEstimator> ransac(
+      options);
+  const auto report = ransac.Estimate(points1, points2);
+
+  EXPECT_TRUE(report.success);
+  EXPECT_GE(report.support.num_inliers, kNumPoints - kNumOutliers);
+  for (size_t i = kNumOutliers; i < kNumPoints; ++i) {
+    EXPECT_TRUE(report.inlier_mask[i]);
+  }
+  EXPECT_LT((report.model.ToMatrix() - cam2_from_cam1.ToMatrix()).norm(),
+            1e-4);
+}
+
+TEST(RefracRelPoseUprightEstimator, Estimate) {
+  SetPRNGSeed(0);
+  const Eigen::Quaterniond cam1_from_world =
+      Eigen::Quaterniond(1, 0.2, -0.1, 0.05).normalized();
+  const Eigen::Quaterniond cam2_from_world =
+      Eigen::Quaterniond(1, -0.1, 0.3, 0.1).normalized();
+  const Rigid3d cam2_from_cam1(cam2_from_world * cam1_from_world.inverse(),
+                               Eigen::Vector3d(-0.8, 0.1, 0.05));
+
+  std::vector<RefracRelPoseUprightEstimator::X_t> points1;
+  std::vector<RefracRelPoseUprightEstimator::Y_t> points2;
+  GenerateCorrespondences(cam2_from_cam1, 20, &points1, &points2);
+
+  RefracRelPoseUprightEstimator estimator;
+  estimator.gravity_in_cam1 = cam1_from_world * Eigen::Vector3d::UnitY();
+  estimator.gravity_in_cam2 = cam2_from_world * Eigen::Vector3d::UnitY();
+  std::vector<RefracRelPoseUprightEstimator::M_t> models;
+  estimator.Estimate(points1, points2, &models);
+
+  ASSERT_EQ(models.size(), 1);
+  EXPECT_LT((models[0].ToMatrix() - cam2_from_cam1.ToMatrix()).norm(), 1e-6);
+}
+
+TEST(RefracRelPoseUprightFourPointEstimator, Estimate) {
+  SetPRNGSeed(0);
+  const Eigen::Quaterniond cam1_from_world =
+      Eigen::Quaterniond(1, 0.2, -0.1, 0.05).normalized();
+  const Eigen::Quaterniond cam2_from_world =
+      Eigen::Quaterniond(1, -0.1, 0.3, 0.1).normalized();
+  const Rigid3d cam2_from_cam1(cam2_from_world * cam1_from_world.inverse(),
+                               Eigen::Vector3d(-0.8, 0.1, 0.05));
+
+  RefracRelPoseUprightFourPointEstimator estimator;
+  estimator.gravity_in_cam1 = cam1_from_world * Eigen::Vector3d::UnitY();
+  estimator.gravity_in_cam2 = cam2_from_world * Eigen::Vector3d::UnitY();
+
+  const int kNumTrials = 100;
+  int num_successes = 0;
+  for (int i = 0; i < kNumTrials; ++i) {
+    std::vector<RefracRelPoseUprightFourPointEstimator::X_t> points1;
+    std::vector<RefracRelPoseUprightFourPointEstimator::Y_t> points2;
+    GenerateCorrespondences(
+        cam2_from_cam1,
+        RefracRelPoseUprightFourPointEstimator::kMinNumSamples,
+        &points1,
+        &points2);
+
+    std::vector<RefracRelPoseUprightFourPointEstimator::M_t> models;
+    estimator.Estimate(points1, points2, &models);
+
+    for (const auto& model : models) {
+      if ((model.ToMatrix() - cam2_from_cam1.ToMatrix()).norm() < 1e-6) {
+        num_successes += 1;
+        break;
+      }
+    }
+  }
+  EXPECT_GE(num_successes, kNumTrials / 2);
+}
+
+}  // namespace
+}  // namespace colmap
@@ -51,6 +51,11 @@ void TriangulationEstimator::SetResidualType(const ResidualType residual_type) {
   residual_type_ = residual_type;
 }
 
+void TriangulationEstimator::SetEnableRefraction(
+    const bool enable_refraction) {
+  enable_refraction_ = enable_refraction;
+}
+
 void TriangulationEstimator::Estimate(const std::vector<X_t>& point_data,
                                       const std::vector<Y_t>& pose_data,
                                       std::vector<M_t>* models) const {
@@ -60,6 +65,11 @@ void TriangulationEstimator::Estimate(const std::vector<X_t>& point_data,
 
   models->clear();
 
+  if (enable_refraction_) {
+    EstimateFromRays(point_data, models);
+    return;
+  }
+
   if (point_data.size() == 2) {
     // Two-view triangulation.
 
@@ -113,6 +123,47 @@ void TriangulationEstimator::Estimate(const std::vector<X_t>& point_data,
   }
 }
 
+void TriangulationEstimator::EstimateFromRays(
+    const std::vector<X_t>& point_data, std::vector<M_t>* models) const {
+  std::vector<Eigen::Vector3d> ray_origins(point_data.size());
+  std::vector<Eigen::Vector3d> ray_directions(point_data.size());
+  for (size_t i = 0; i < point_data.size(); ++i) {
+    ray_origins[i] = point_data[i].ray_origin;
+    ray_directions[i] = point_data[i].ray_direction;
+  }
+
+  // The midpoint of two rays already has balanced angular errors, while the
+  // multi-view midpoint is biased towards the observations closer to the
+  // point and is refined to approximately minimize the angular errors.
+  const int kNumRefinements = point_data.size() > 2 ? 3 : 0;
+  M_t xyz;
+  if (!TriangulateMidPointFromRays(
+          ray_origins, ray_directions, kNumRefinements, &xyz)) {
+    return;
+  }
+
+  // Check for cheirality constraint, i.e. the point must lie in front of the
+  // refracted rays.
+  for (const auto& point : point_data) {
+    if ((xyz - point.ray_origin).dot(point.ray_direction) <= 0) {
+      return;
+    }
+  }
+
+  // Check for sufficient triangulation angle between the refracted rays.
+  for (size_t i = 0; i < point_data.size(); ++i) {
+    for (size_t j = 0; j < i; ++j) {
+      const double tri_angle = CalculateTriangulationAngle(
+          point_data[i].ray_origin, point_data[j].ray_origin, xyz);
+      if (tri_angle >= min_tri_angle_) {
+        models->resize(1);
+        (*models)[0] = xyz;
+        return;
+      }
+    }
+  }
+}
+
 void TriangulationEstimator::Residuals(const std::vector<X_t>& point_data,
                                        const std::vector<Y_t>& pose_data,
                                        const M_t& xyz,
@@ -127,7 +178,12 @@ void TriangulationEstimator::Residuals(const std::vector<X_t>& point_data,
           CalculateSquaredReprojectionError(point_data[i].point,
                                             xyz,
                                             pose_data[i].proj_matrix,
-                                            *pose_data[i].camera);
+                                            *pose_data[i].camera,
+                                            enable_refraction_);
+    } else if (enable_refraction_) {
+      const double angular_error = CalculateRayAngularError(
+          point_data[i].ray_origin, point_data[i].ray_direction, xyz);
+      (*residuals)[i] = angular_error * angular_error;
     } else if (residual_type_ == ResidualType::ANGULAR_ERROR) {
       const double angular_error = CalculateNormalizedAngularError(
           point_data[i].point_normalized, xyz, pose_data[i].proj_matrix);
@@ -156,8 +212,10 @@ bool EstimateTriangulation(
       ransac(options.ransac_options);
   ransac.estimator.SetMinTriAngle(options.min_tri_angle);
   ransac.estimator.SetResidualType(options.residual_type);
+  ransac.estimator.SetEnableRefraction(options.enable_refraction);
   ransac.local_estimator.SetMinTriAngle(options.min_tri_angle);
   ransac.local_estimator.SetResidualType(options.residual_type);
+  ransac.local_estimator.SetEnableRefraction(options.enable_refraction);
   const auto report = ransac.Estimate(point_data, pose_data);
   if (!report.success) {
     return false;
@@ -47,7 +47,9 @@ namespace colmap {
 //    - All observations must satisfy cheirality constraint.
 //
 // An observation is composed of an image measurement and the corresponding
-// camera pose and calibration.
+// camera pose and calibration. In the refractive case, the point is directly
+// triangulated from the refracted viewing rays of the observations, and the
+// pose data holds the real camera pose and calibration.
 class TriangulationEstimator {
  public:
   enum class ResidualType {
@@ -61,8 +63,12 @@ class TriangulationEstimator {
         : point(point_), point_normalized(point_N_) {}
     // Image observation in pixels. Only needs to be set for REPROJECTION_ERROR.
     Eigen::Vector2d point;
-    // Normalized image observation. Must always be set.
+    // Normalized image observation. Must be set in the non-refractive case.
     Eigen::Vector2d point_normalized;
+    // Refracted viewing ray of the observation in world frame with unit-length
+    // direction. Must be set in the refractive case.
+    Eigen::Vector3d ray_origin;
+    Eigen::Vector3d ray_direction;
   };
 
   struct PoseData {
@@ -86,6 +92,7 @@ class TriangulationEstimator {
   // Specify settings for triangulation estimator.
   void SetMinTriAngle(double min_tri_angle);
   void SetResidualType(ResidualType residual_type);
+  void SetEnableRefraction(bool enable_refraction);
 
   // The minimum number of samples needed to estimate a model.
   static const int kMinNumSamples = 2;
@@ -113,8 +120,13 @@ class TriangulationEstimator {
                  std::vector<double>* residuals) const;
 
  private:
+  // Estimate a 3D point from the refracted viewing rays of the observations.
+  void EstimateFromRays(const std::vector<X_t>& point_data,
+                        std::vector<M_t>* models) const;
+
   ResidualType residual_type_ = ResidualType::REPROJECTION_ERROR;
   double min_tri_angle_ = 0.0;
+  bool enable_refraction_ = false;
 };
 
 struct EstimateTriangulationOptions {
@@ -125,6 +137,10 @@ struct EstimateTriangulationOptions {
   TriangulationEstimator::ResidualType residual_type =
       TriangulationEstimator::ResidualType::ANGULAR_ERROR;
 
+  // Whether to triangulate from the refracted viewing rays of the
+  // observations.
+  bool enable_refraction = false;
+
   // RANSAC options for TriangulationEstimator.
   RANSACOptions ransac_options;
 
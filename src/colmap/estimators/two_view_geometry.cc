@@ -42,15 +42,107 @@
 #include "colmap/geometry/triangulation.h"
 #include "colmap/math/random.h"
 #include "colmap/optim/loransac.h"
+#include "colmap/optim/progressive_sampler.h"
 #include "colmap/optim/ransac.h"
 #include "colmap/scene/camera.h"
 #include "colmap/scene/projection.h"
+#include "colmap/util/endian.h"
 
+#include <algorithm>
+#include <mutex>
+#include <sstream>
+#include <unordered_map>
 #include <unordered_set>
 
 namespace colmap {
 namespace {
 
+bool HasGravity(const TwoViewGeometryOptions& options) {
+  return options.gravity_in_cam1 != Eigen::Vector3d::Zero() &&
+         options.gravity_in_cam2 != Eigen::Vector3d::Zero();
+}
+
+// Copies the report of the upright estimators into the report type of the
+// corresponding general estimators, which share the same model type.
+template <typename SrcReport, typename DstReport>
+void CopyRANSACReport(const SrcReport& src, DstReport* dst) {
+  dst->success = src.success;
+  dst->num_trials = src.num_trials;
+  dst->num_residuals = src.num_residuals;
+  dst->num_sprt_rejections = src.num_sprt_rejections;
+  dst->support = src.support;
+  dst->inlier_mask = src.inlier_mask;
+  dst->model = src.model;
+}
+
+// Whether to sample the matches progressively by their descriptor ratios,
+// which requires the ratios of all matches.
+bool UseProgressiveSampler(const TwoViewGeometryOptions& options,
+                           const FeatureMatches& matches) {
+  return options.use_prosac &&
+         std::all_of(
+             matches.begin(), matches.end(), [](const FeatureMatch& match) {
+               return match.ratio >= 0;
+             });
+}
+
+bool MatchRatioLess(const FeatureMatch& match1, const FeatureMatch& match2) {
+  return match1.ratio < match2.ratio;
+}
+
+// Whether the matches must be sorted by increasing ratio, i.e., decreasing
+// distinctiveness, before progressive sampling.
+bool RequiresSortByRatio(const TwoViewGeometryOptions& options,
+                         const FeatureMatches& matches) {
+  return UseProgressiveSampler(options, matches) &&
+         !std::is_sorted(matches.begin(), matches.end(), MatchRatioLess);
+}
+
+FeatureMatches SortMatchesByRatio(const FeatureMatches& matches) {
+  FeatureMatches sorted_matches = matches;
+  std::stable_sort(
+      sorted_matches.begin(), sorted_matches.end(), MatchRatioLess);
+  return sorted_matches;
+}
+
+// Runs LO-RANSAC with PROSAC sampling or otherwise with uniform sampling. The
+// estimators are initialized by the given function, which is called with the
+// LO-RANSAC instance, and the report is copied into the given report type.
+template <typename Estimator,
+          typename LocalEstimator,
+          typename Report,
+          typename InitEstimators>
+void EstimateLORANSAC(const RANSACOptions& options,
+                      const bool use_prosac,
+                      const std::vector<typename Estimator::X_t>& X,
+                      const std::vector<typename Estimator::Y_t>& Y,
+                      InitEstimators init_estimators,
+                      Report* report) {
+  if (use_prosac) {
+    LORANSAC<Estimator,
+             LocalEstimator,
+             InlierSupportMeasurer,
+             ProgressiveSampler>
+        ransac(options);
+    init_estimators(&ransac);
+    CopyRANSACReport(ransac.Estimate(X, Y), report);
+  } else {
+    LORANSAC<Estimator, LocalEstimator> ransac(options);
+    init_estimators(&ransac);
+    CopyRANSACReport(ransac.Estimate(X, Y), report);
+  }
+}
+
+template <typename Estimator, typename LocalEstimator, typename Report>
+void EstimateLORANSAC(const RANSACOptions& options,
+                      const bool use_prosac,
+                      const std::vector<typename Estimator::X_t>& X,
+                      const std::vector<typename Estimator::Y_t>& Y,
+                      Report* report) {
+  EstimateLORANSAC<Estimator, LocalEstimator>(
+      options, use_prosac, X, Y, [](auto*) {}, report);
+}
+
 FeatureMatches ExtractInlierMatches(const FeatureMatches& matches,
                                     const size_t num_inliers,
                                     const std::vector<char>& inlier_mask) {
@@ -122,9 +214,14 @@ TwoViewGeometry EstimateCalibratedHomography(
 
   // Estimate planar or panoramic model.
 
-  LORANSAC<HomographyMatrixEstimator, HomographyMatrixEstimator> H_ransac(
-      options.ransac_options);
-  const auto H_report = H_ransac.Estimate(matched_points1, matched_points2);
+  const bool use_prosac = UseProgressiveSampler(options, matches);
+  RANSAC<HomographyMatrixEstimator>::Report H_report;
+  EstimateLORANSAC<HomographyMatrixEstimator, HomographyMatrixEstimator>(
+      options.ransac_options,
+      use_prosac,
+      matched_points1,
+      matched_points2,
+      &H_report);
   geometry.H = H_report.model;
 
   if (!H_report.success || H_report.support.num_inliers < min_num_inliers) {
@@ -178,17 +275,25 @@ TwoViewGeometry EstimateUncalibratedTwoViewGeometry(
 
   // Estimate epipolar model.
 
-  LORANSAC<FundamentalMatrixSevenPointEstimator,
-           FundamentalMatrixEightPointEstimator>
-      F_ransac(options.ransac_options);
-  const auto F_report = F_ransac.Estimate(matched_points1, matched_points2);
+  const bool use_prosac = UseProgressiveSampler(options, matches);
+  RANSAC<FundamentalMatrixSevenPointEstimator>::Report F_report;
+  EstimateLORANSAC<FundamentalMatrixSevenPointEstimator,
+                   FundamentalMatrixEightPointEstimator>(options.ransac_options,
+                                                         use_prosac,
+                                                         matched_points1,
+                                                         matched_points2,
+                                                         &F_report);
   geometry.F = F_report.model;
 
   // Estimate planar or panoramic model.
 
-  LORANSAC<HomographyMatrixEstimator, HomographyMatrixEstimator> H_ransac(
-      options.ransac_options);
-  const auto H_report = H_ransac.Estimate(matched_points1, matched_points2);
+  RANSAC<HomographyMatrixEstimator>::Report H_report;
+  EstimateLORANSAC<HomographyMatrixEstimator, HomographyMatrixEstimator>(
+      options.ransac_options,
+      use_prosac,
+      matched_points1,
+      matched_points2,
+      &H_report);
   geometry.H = H_report.model;
 
   if ((!F_report.success && !H_report.success) ||
@@ -284,6 +389,86 @@ TwoViewGeometry EstimateMultipleTwoViewGeometries(
   return multi_geometry;
 }
 
+// Process-wide cache of the best fit non-refractive cameras, which are keyed
+// by `BestFitNonRefracCameraKey`.
+struct BestFitCameraCache {
+  std::mutex mutex;
+  std::unordered_map<std::string, Camera> cameras;
+};
+
+BestFitCameraCache& GetBestFitCameraCache() {
+  static BestFitCameraCache cache;
+  return cache;
+}
+
+Camera ComputeBestFitNonRefracCamera(CameraModelId tgt_model_id,
+                                     const Camera& camera,
+                                     double approx_depth);
+
+// Verify the matches by the rays of their observations, where the rays of the
+// second image are given in the frame of the second camera. Matches are
+// inliers if both rays pass the triangulated point in front of the cameras
+// within the angular error or, for points at infinity, if the rays are
+// parallel within the angular error.
+void VerifyMatchRaysWithKnownPose(
+    const std::vector<Eigen::Vector3d>& ray_origins1,
+    const std::vector<Eigen::Vector3d>& ray_directions1,
+    const std::vector<Eigen::Vector3d>& ray_origins2,
+    const std::vector<Eigen::Vector3d>& ray_directions2,
+    const FeatureMatches& matches,
+    const Rigid3d& cam2_from_cam1,
+    const double max_angular_error,
+    const size_t min_num_inliers,
+    TwoViewGeometry* geometry) {
+  const Rigid3d cam1_from_cam2 = Inverse(cam2_from_cam1);
+
+  std::vector<Eigen::Vector3d> ray_origins(2);
+  std::vector<Eigen::Vector3d> ray_directions(2);
+  std::vector<double> tri_angles;
+  tri_angles.reserve(matches.size());
+  geometry->inlier_matches.clear();
+  geometry->inlier_matches.reserve(matches.size());
+  for (size_t i = 0; i < matches.size(); ++i) {
+    ray_origins[0] = ray_origins1[i];
+    ray_directions[0] = ray_directions1[i];
+    ray_origins[1] = cam1_from_cam2 * ray_origins2[i];
+    ray_directions[1] = cam1_from_cam2.rotation * ray_directions2[i];
+
+    // Without a baseline, the rays of non-parallel directions intersect in
+    // their common origin and only parallel rays are consistent.
+    const double baseline = (ray_origins[1] - ray_origins[0]).norm();
+    const double min_depth = 1e-6 * baseline;
+    const double parallel_error =
+        std::atan2(ray_directions[0].cross(ray_directions[1]).norm(),
+                   ray_directions[0].dot(ray_directions[1]));
+    Eigen::Vector3d point3D;
+    if (baseline > std::numeric_limits<double>::epsilon() &&
+        TriangulateMidPointFromRays(
+            ray_origins, ray_directions, /*num_refinements=*/0, &point3D) &&
+        (point3D - ray_origins[0]).dot(ray_directions[0]) > min_depth &&
+        (point3D - ray_origins[1]).dot(ray_directions[1]) > min_depth &&
+        CalculateRayAngularError(ray_origins[0], ray_directions[0], point3D) <=
+            max_angular_error &&
+        CalculateRayAngularError(ray_origins[1], ray_directions[1], point3D) <=
+            max_angular_error) {
+      geometry->inlier_matches.push_back(matches[i]);
+      tri_angles.push_back(
+          CalculateTriangulationAngle(ray_origins[0], ray_origins[1], point3D));
+    } else if (parallel_error <= max_angular_error) {
+      geometry->inlier_matches.push_back(matches[i]);
+      tri_angles.push_back(0);
+    }
+  }
+
+  geometry->cam2_from_cam1 = cam2_from_cam1;
+  if (geometry->inlier_matches.size() < min_num_inliers) {
+    geometry->config = TwoViewGeometry::ConfigurationType::DEGENERATE;
+    geometry->inlier_matches.clear();
+    return;
+  }
+  geometry->tri_angle = Median(tri_angles);
+}
+
 }  // namespace
 
 bool TwoViewGeometryOptions::Check() const {
@@ -312,6 +497,14 @@ TwoViewGeometry EstimateTwoViewGeometry(
     const std::vector<Eigen::Vector2d>& points2,
     const FeatureMatches& matches,
     const TwoViewGeometryOptions& options) {
+  if (RequiresSortByRatio(options, matches)) {
+    return EstimateTwoViewGeometry(camera1,
+                                   points1,
+                                   camera2,
+                                   points2,
+                                   SortMatchesByRatio(matches),
+                                   options);
+  }
   if (options.multiple_models) {
     return EstimateMultipleTwoViewGeometries(
         camera1, points1, camera2, points2, matches, options);
@@ -423,6 +616,15 @@ TwoViewGeometry EstimateCalibratedTwoViewGeometry(
     const TwoViewGeometryOptions& options) {
   CHECK(options.Check());
 
+  if (RequiresSortByRatio(options, matches)) {
+    return EstimateCalibratedTwoViewGeometry(camera1,
+                                             points1,
+                                             camera2,
+                                             points2,
+                                             SortMatchesByRatio(matches),
+                                             options);
+  }
+
   TwoViewGeometry geometry;
 
   const size_t min_num_inliers = static_cast<size_t>(options.min_num_inliers);
@@ -447,29 +649,55 @@ TwoViewGeometry EstimateCalibratedTwoViewGeometry(
 
   // Estimate epipolar models.
 
+  const bool use_prosac = UseProgressiveSampler(options, matches);
   auto E_ransac_options = options.ransac_options;
   E_ransac_options.max_error =
       (camera1.CamFromImgThreshold(options.ransac_options.max_error) +
        camera2.CamFromImgThreshold(options.ransac_options.max_error)) /
       2;
 
-  LORANSAC<EssentialMatrixFivePointEstimator, EssentialMatrixFivePointEstimator>
-      E_ransac(E_ransac_options);
-  const auto E_report =
-      E_ransac.Estimate(matched_points1_normalized, matched_points2_normalized);
+  RANSAC<EssentialMatrixFivePointEstimator>::Report E_report;
+  if (HasGravity(options)) {
+    EstimateLORANSAC<EssentialMatrixUprightThreePointEstimator,
+                     EssentialMatrixFivePointEstimator>(
+        E_ransac_options,
+        use_prosac,
+        matched_points1_normalized,
+        matched_points2_normalized,
+        [&options](auto* E_ransac) {
+          E_ransac->estimator.gravity_in_cam1 = options.gravity_in_cam1;
+          E_ransac->estimator.gravity_in_cam2 = options.gravity_in_cam2;
+        },
+        &E_report);
+  } else {
+    EstimateLORANSAC<EssentialMatrixFivePointEstimator,
+                     EssentialMatrixFivePointEstimator>(
+        E_ransac_options,
+        use_prosac,
+        matched_points1_normalized,
+        matched_points2_normalized,
+        &E_report);
+  }
   geometry.E = E_report.model;
 
-  LORANSAC<FundamentalMatrixSevenPointEstimator,
-           FundamentalMatrixEightPointEstimator>
-      F_ransac(options.ransac_options);
-  const auto F_report = F_ransac.Estimate(matched_points1, matched_points2);
+  RANSAC<FundamentalMatrixSevenPointEstimator>::Report F_report;
+  EstimateLORANSAC<FundamentalMatrixSevenPointEstimator,
+                   FundamentalMatrixEightPointEstimator>(options.ransac_options,
+                                                         use_prosac,
+                                                         matched_points1,
+                                                         matched_points2,
+                                                         &F_report);
   geometry.F = F_report.model;
 
   // Estimate planar or panoramic model.
 
-  LORANSAC<HomographyMatrixEstimator, HomographyMatrixEstimator> H_ransac(
-      options.ransac_options);
-  const auto H_report = H_ransac.Estimate(matched_points1, matched_points2);
+  RANSAC<HomographyMatrixEstimator>::Report H_report;
+  EstimateLORANSAC<HomographyMatrixEstimator, HomographyMatrixEstimator>(
+      options.ransac_options,
+      use_prosac,
+      matched_points1,
+      matched_points2,
+      &H_report);
   geometry.H = H_report.model;
 
   if ((!E_report.success && !F_report.success && !H_report.success) ||
@@ -636,14 +864,22 @@ bool DetectWatermark(const Camera& camera1,
 
 TwoViewGeometry EstimateRefractiveTwoViewGeometry(
     const std::vector<Eigen::Vector2d>& points1,
-    const std::vector<Camera>& virtual_cameras1,
-    const std::vector<Rigid3d>& virtual_from_reals1,
+    const VirtualPinholeCameras& virtual_cameras1,
     const std::vector<Eigen::Vector2d>& points2,
-    const std::vector<Camera>& virtual_cameras2,
-    const std::vector<Rigid3d>& virtual_from_reals2,
+    const VirtualPinholeCameras& virtual_cameras2,
     const FeatureMatches& matches,
     const TwoViewGeometryOptions& options,
     const bool refine) {
+  if (RequiresSortByRatio(options, matches)) {
+    return EstimateRefractiveTwoViewGeometry(points1,
+                                             virtual_cameras1,
+                                             points2,
+                                             virtual_cameras2,
+                                             SortMatchesByRatio(matches),
+                                             options,
+                                             refine);
+  }
+
   TwoViewGeometry geometry;
 
   const size_t min_num_inliers = static_cast<size_t>(options.min_num_inliers);
@@ -657,18 +893,20 @@ TwoViewGeometry EstimateRefractiveTwoViewGeometry(
   std::vector<GR6PEstimator::Y_t> matched_points2(matches.size());
   for (size_t i = 0; i < matches.size(); ++i) {
     matched_points1[i].cam_from_rig =
-        virtual_from_reals1[matches[i].point2D_idx1];
+        virtual_cameras1.VirtualFromReal(matches[i].point2D_idx1);
     matched_points1[i].ray_in_cam =
-        virtual_cameras1[matches[i].point2D_idx1]
-            .CamFromImg(points1[matches[i].point2D_idx1])
+        virtual_cameras1
+            .CamFromImg(matches[i].point2D_idx1,
+                        points1[matches[i].point2D_idx1])
             .homogeneous()
             .normalized();
 
     matched_points2[i].cam_from_rig =
-        virtual_from_reals2[matches[i].point2D_idx2];
+        virtual_cameras2.VirtualFromReal(matches[i].point2D_idx2);
     matched_points2[i].ray_in_cam =
-        virtual_cameras2[matches[i].point2D_idx2]
-            .CamFromImg(points2[matches[i].point2D_idx2])
+        virtual_cameras2
+            .CamFromImg(matches[i].point2D_idx2,
+                        points2[matches[i].point2D_idx2])
             .homogeneous()
             .normalized();
   }
@@ -677,11 +915,16 @@ TwoViewGeometry EstimateRefractiveTwoViewGeometry(
   // Give it more iterations for RANSAC.
   // ransac_options_copy.max_num_trials *= 10;
   ransac_options_copy.max_error =
-      (virtual_cameras1[0].CamFromImgThreshold(ransac_options_copy.max_error) +
-       virtual_cameras2[0].CamFromImgThreshold(ransac_options_copy.max_error)) /
+      (virtual_cameras1.CamFromImgThreshold(ransac_options_copy.max_error) +
+       virtual_cameras2.CamFromImgThreshold(ransac_options_copy.max_error)) /
       2;
-  LORANSAC<GR6PEstimator, GR6PEstimator> ransac(ransac_options_copy);
-  const auto report = ransac.Estimate(matched_points1, matched_points2);
+  RANSAC<GR6PEstimator>::Report report;
+  EstimateLORANSAC<GR6PEstimator, GR6PEstimator>(
+      ransac_options_copy,
+      UseProgressiveSampler(options, matches),
+      matched_points1,
+      matched_points2,
+      &report);
   geometry.cam2_from_cam1 = report.model;
 
   if (!report.success || report.support.num_inliers < min_num_inliers) {
@@ -721,25 +964,25 @@ TwoViewGeometry EstimateRefractiveTwoViewGeometry(
     const Rigid3d real2_from_world = geometry.cam2_from_cam1;
 
     for (const auto& match : geometry.inlier_matches) {
-      const Camera& virtual_camera1 = virtual_cameras1[match.point2D_idx1];
-      const Camera& virtual_camera2 = virtual_cameras2[match.point2D_idx2];
 
-      inlier_points1_normalized.push_back(
-          virtual_camera1.CamFromImg(points1[match.point2D_idx1]));
-      inlier_points2_normalized.push_back(
-          virtual_camera2.CamFromImg(points2[match.point2D_idx2]));
+      inlier_points1_normalized.push_back(virtual_cameras1.CamFromImg(
+          match.point2D_idx1, points1[match.point2D_idx1]));
+      inlier_points2_normalized.push_back(virtual_cameras2.CamFromImg(
+          match.point2D_idx2, points2[match.point2D_idx2]));
 
       const Rigid3d virtual1_from_world =
-          virtual_from_reals1[match.point2D_idx1] * real1_from_world;
+          virtual_cameras1.VirtualFromReal(match.point2D_idx1) *
+          real1_from_world;
       const Rigid3d virtual2_from_world =
-          virtual_from_reals2[match.point2D_idx2] * real2_from_world;
+          virtual_cameras2.VirtualFromReal(match.point2D_idx2) *
+          real2_from_world;
 
       inlier_virtual_proj_matrix1.push_back(virtual1_from_world.ToMatrix());
       inlier_virtual_proj_matrix2.push_back(virtual2_from_world.ToMatrix());
       inlier_virtual_from_reals1.push_back(
-          virtual_from_reals1[match.point2D_idx1]);
+          virtual_cameras1.VirtualFromReal(match.point2D_idx1));
       inlier_virtual_from_reals2.push_back(
-          virtual_from_reals2[match.point2D_idx2]);
+          virtual_cameras2.VirtualFromReal(match.point2D_idx2));
     }
 
     if (refine) {
@@ -854,6 +1097,21 @@ bool RefineRefractiveTwoViewGeometry(
   return summary.IsSolutionUsable();
 }
 
+std::string BestFitNonRefracCameraKey(const CameraModelId tgt_model_id,
+                                      const Camera& camera,
+                                      const double approx_depth) {
+  std::ostringstream key;
+  WriteBinaryLittleEndian<int>(&key, static_cast<int>(tgt_model_id));
+  WriteBinaryLittleEndian<double>(&key, approx_depth);
+  WriteBinaryLittleEndian<int>(&key, static_cast<int>(camera.model_id));
+  WriteBinaryLittleEndian<uint64_t>(&key, camera.width);
+  WriteBinaryLittleEndian<uint64_t>(&key, camera.height);
+  WriteBinaryLittleEndian<double>(&key, camera.params);
+  WriteBinaryLittleEndian<int>(&key, static_cast<int>(camera.refrac_model_id));
+  WriteBinaryLittleEndian<double>(&key, camera.refrac_params);
+  return key.str();
+}
+
 Camera BestFitNonRefracCamera(const CameraModelId tgt_model_id,
                               const Camera& camera,
                               const double approx_depth) {
@@ -861,6 +1119,51 @@ Camera BestFitNonRefracCamera(const CameraModelId tgt_model_id,
       << "Camera is not refractive, cannot compute the best approximated "
          "non-refractive camera";
 
+  const std::string key =
+      BestFitNonRefracCameraKey(tgt_model_id, camera, approx_depth);
+  BestFitCameraCache& cache = GetBestFitCameraCache();
+  {
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    const auto it = cache.cameras.find(key);
+    if (it != cache.cameras.end()) {
+      Camera tgt_camera = it->second;
+      tgt_camera.camera_id = camera.camera_id;
+      return tgt_camera;
+    }
+  }
+
+  // The fit is computed without holding the lock, such that different cameras
+  // are fitted concurrently. If the same camera was fitted concurrently, the
+  // first fit is kept, so that all callers use the same camera.
+  const Camera tgt_camera =
+      ComputeBestFitNonRefracCamera(tgt_model_id, camera, approx_depth);
+  std::lock_guard<std::mutex> lock(cache.mutex);
+  return cache.cameras.emplace(key, tgt_camera).first->second;
+}
+
+void ReadBestFitNonRefracCameras(const Database& database) {
+  std::vector<std::pair<std::string, Camera>> cameras =
+      database.ReadAllBestFitCameras();
+  BestFitCameraCache& cache = GetBestFitCameraCache();
+  std::lock_guard<std::mutex> lock(cache.mutex);
+  for (auto& camera : cameras) {
+    cache.cameras.emplace(std::move(camera.first), std::move(camera.second));
+  }
+}
+
+void WriteBestFitNonRefracCameras(const Database& database) {
+  BestFitCameraCache& cache = GetBestFitCameraCache();
+  std::lock_guard<std::mutex> lock(cache.mutex);
+  for (const auto& camera : cache.cameras) {
+    database.WriteBestFitCamera(camera.first, camera.second);
+  }
+}
+
+namespace {
+
+Camera ComputeBestFitNonRefracCamera(const CameraModelId tgt_model_id,
+                                     const Camera& camera,
+                                     const double approx_depth) {
   Camera tgt_camera = Camera::CreateFromModelId(camera.camera_id,
                                                 tgt_model_id,
                                                 camera.MeanFocalLength(),
@@ -877,13 +1180,11 @@ Camera BestFitNonRefracCamera(const CameraModelId tgt_model_id,
   const double height = static_cast<double>(tgt_camera.height);
 
   for (size_t i = 0; i < kNumSamples; ++i) {
-    Eigen::Vector2d image_point(RandomUniformReal(0.5, width - 0.5),
-                                RandomUniformReal(0.5, height - 0.5));
-    Eigen::Vector3d world_point =
-        camera.CamFromImgRefracPoint(image_point, approx_depth);
-    points2D[i] = image_point;
-    points3D[i] = world_point;
+    points2D[i] = Eigen::Vector2d(RandomUniformReal(0.5, width - 0.5),
+                                  RandomUniformReal(0.5, height - 0.5));
   }
+  camera.RefracKernel().CamFromImgPoint(
+      kNumSamples, points2D.data(), approx_depth, points3D.data());
 
   const Rigid3d identity_pose = Rigid3d();
 
@@ -946,15 +1247,15 @@ Camera BestFitNonRefracCamera(const CameraModelId tgt_model_id,
   return tgt_camera;
 }
 
+}  // namespace
+
 TwoViewGeometry EstimateRefractiveTwoViewGeometryUseBestFit(
     const Camera& best_fit_camera1,
     const std::vector<Eigen::Vector2d>& points1,
-    const std::vector<Camera>& virtual_cameras1,
-    const std::vector<Rigid3d>& virtual_from_reals1,
+    const VirtualPinholeCameras& virtual_cameras1,
     const Camera& best_fit_camera2,
     const std::vector<Eigen::Vector2d>& points2,
-    const std::vector<Camera>& virtual_cameras2,
-    const std::vector<Rigid3d>& virtual_from_reals2,
+    const VirtualPinholeCameras& virtual_cameras2,
     const FeatureMatches& matches,
     const TwoViewGeometryOptions& options,
     const bool refine) {
@@ -982,18 +1283,16 @@ TwoViewGeometry EstimateRefractiveTwoViewGeometryUseBestFit(
     inlier_virtual_from_reals2.reserve(geometry.inlier_matches.size());
 
     for (const auto& match : geometry.inlier_matches) {
-      const Camera& virtual_camera1 = virtual_cameras1[match.point2D_idx1];
-      const Camera& virtual_camera2 = virtual_cameras2[match.point2D_idx2];
 
-      inlier_points1_normalized.push_back(
-          virtual_camera1.CamFromImg(points1[match.point2D_idx1]));
-      inlier_points2_normalized.push_back(
-          virtual_camera2.CamFromImg(points2[match.point2D_idx2]));
+      inlier_points1_normalized.push_back(virtual_cameras1.CamFromImg(
+          match.point2D_idx1, points1[match.point2D_idx1]));
+      inlier_points2_normalized.push_back(virtual_cameras2.CamFromImg(
+          match.point2D_idx2, points2[match.point2D_idx2]));
 
       inlier_virtual_from_reals1.push_back(
-          virtual_from_reals1[match.point2D_idx1]);
+          virtual_cameras1.VirtualFromReal(match.point2D_idx1));
       inlier_virtual_from_reals2.push_back(
-          virtual_from_reals2[match.point2D_idx2]);
+          virtual_cameras2.VirtualFromReal(match.point2D_idx2));
     }
 
     if (!RefineRefractiveTwoViewGeometry(inlier_points1_normalized,
@@ -1010,57 +1309,130 @@ TwoViewGeometry EstimateRefractiveTwoViewGeometryUseBestFit(
   return geometry;
 }
 
+void ExtractRefracRelPoseCorrespondences(
+    const std::vector<Eigen::Vector2d>& points1,
+    const VirtualPinholeCameras& virtual_cameras1,
+    const std::vector<Eigen::Vector2d>& points2,
+    const VirtualPinholeCameras& virtual_cameras2,
+    const FeatureMatches& matches,
+    std::vector<RefracRelPoseEstimator::X_t>* matched_points1,
+    std::vector<RefracRelPoseEstimator::Y_t>* matched_points2) {
+  matched_points1->resize(matches.size());
+  matched_points2->resize(matches.size());
+  for (size_t i = 0; i < matches.size(); ++i) {
+    (*matched_points1)[i].virtual_from_real =
+        virtual_cameras1.VirtualFromReal(matches[i].point2D_idx1);
+    (*matched_points1)[i].ray_in_virtual =
+        virtual_cameras1
+            .CamFromImg(matches[i].point2D_idx1,
+                        points1[matches[i].point2D_idx1])
+            .homogeneous()
+            .normalized();
+
+    (*matched_points2)[i].virtual_from_real =
+        virtual_cameras2.VirtualFromReal(matches[i].point2D_idx2);
+    (*matched_points2)[i].ray_in_virtual =
+        virtual_cameras2
+            .CamFromImg(matches[i].point2D_idx2,
+                        points2[matches[i].point2D_idx2])
+            .homogeneous()
+            .normalized();
+  }
+}
+
 TwoViewGeometry EstimateRefractiveTwoViewGeometryHu(
     const std::vector<Eigen::Vector2d>& points1,
-    const std::vector<Camera>& virtual_cameras1,
-    const std::vector<Rigid3d>& virtual_from_reals1,
+    const VirtualPinholeCameras& virtual_cameras1,
     const std::vector<Eigen::Vector2d>& points2,
-    const std::vector<Camera>& virtual_cameras2,
-    const std::vector<Rigid3d>& virtual_from_reals2,
+    const VirtualPinholeCameras& virtual_cameras2,
     const FeatureMatches& matches,
     const TwoViewGeometryOptions& options,
     const bool refine) {
-  TwoViewGeometry geometry;
+  if (RequiresSortByRatio(options, matches)) {
+    return EstimateRefractiveTwoViewGeometryHu(points1,
+                                               virtual_cameras1,
+                                               points2,
+                                               virtual_cameras2,
+                                               SortMatchesByRatio(matches),
+                                               options,
+                                               refine);
+  }
 
   const size_t min_num_inliers = static_cast<size_t>(options.min_num_inliers);
   if (matches.size() < min_num_inliers) {
+    TwoViewGeometry geometry;
     geometry.config = TwoViewGeometry::ConfigurationType::DEGENERATE;
     return geometry;
   }
 
   // Extract corresponding points.
-  std::vector<RefracRelPoseEstimator::X_t> matched_points1(matches.size());
-  std::vector<RefracRelPoseEstimator::Y_t> matched_points2(matches.size());
-  for (size_t i = 0; i < matches.size(); ++i) {
-    matched_points1[i].virtual_from_real =
-        virtual_from_reals1[matches[i].point2D_idx1];
-    matched_points1[i].ray_in_virtual =
-        virtual_cameras1[matches[i].point2D_idx1]
-            .CamFromImg(points1[matches[i].point2D_idx1])
-            .homogeneous()
-            .normalized();
-
-    matched_points2[i].virtual_from_real =
-        virtual_from_reals2[matches[i].point2D_idx2];
-    matched_points2[i].ray_in_virtual =
-        virtual_cameras2[matches[i].point2D_idx2]
-            .CamFromImg(points2[matches[i].point2D_idx2])
-            .homogeneous()
-            .normalized();
-  }
+  std::vector<RefracRelPoseEstimator::X_t> matched_points1;
+  std::vector<RefracRelPoseEstimator::Y_t> matched_points2;
+  ExtractRefracRelPoseCorrespondences(points1,
+                                      virtual_cameras1,
+                                      points2,
+                                      virtual_cameras2,
+                                      matches,
+                                      &matched_points1,
+                                      &matched_points2);
 
   RANSACOptions ransac_options_copy = options.ransac_options;
   // Give it more iterations for RANSAC.
   // ransac_options_copy.max_num_trials *= 10;
   ransac_options_copy.max_error =
-      (virtual_cameras1[0].CamFromImgThreshold(ransac_options_copy.max_error) +
-       virtual_cameras2[0].CamFromImgThreshold(ransac_options_copy.max_error)) /
+      (virtual_cameras1.CamFromImgThreshold(ransac_options_copy.max_error) +
+       virtual_cameras2.CamFromImgThreshold(ransac_options_copy.max_error)) /
       2;
-  LORANSAC<RefracRelPoseEstimator, RefracRelPoseEstimator> ransac(
-      ransac_options_copy);
-  const auto report = ransac.Estimate(matched_points1, matched_points2);
+  // The minimal solver generates the hypotheses and the linear solver refines
+  // them from all inliers.
+  const bool use_prosac = UseProgressiveSampler(options, matches);
+  RANSAC<RefracRelPoseSixPointEstimator>::Report report;
+  if (HasGravity(options)) {
+    EstimateLORANSAC<RefracRelPoseUprightFourPointEstimator,
+                     RefracRelPoseUprightEstimator>(
+        ransac_options_copy,
+        use_prosac,
+        matched_points1,
+        matched_points2,
+        [&options](auto* ransac) {
+          ransac->estimator.gravity_in_cam1 = options.gravity_in_cam1;
+          ransac->estimator.gravity_in_cam2 = options.gravity_in_cam2;
+          ransac->local_estimator.gravity_in_cam1 = options.gravity_in_cam1;
+          ransac->local_estimator.gravity_in_cam2 = options.gravity_in_cam2;
+        },
+        &report);
+  } else {
+    EstimateLORANSAC<RefracRelPoseSixPointEstimator, RefracRelPoseEstimator>(
+        ransac_options_copy,
+        use_prosac,
+        matched_points1,
+        matched_points2,
+        &report);
+  }
+
+  return ComposeRefractiveTwoViewGeometry(points1,
+                                          virtual_cameras1,
+                                          points2,
+                                          virtual_cameras2,
+                                          matches,
+                                          options,
+                                          report,
+                                          refine);
+}
+
+TwoViewGeometry ComposeRefractiveTwoViewGeometry(
+    const std::vector<Eigen::Vector2d>& points1,
+    const VirtualPinholeCameras& virtual_cameras1,
+    const std::vector<Eigen::Vector2d>& points2,
+    const VirtualPinholeCameras& virtual_cameras2,
+    const FeatureMatches& matches,
+    const TwoViewGeometryOptions& options,
+    const RANSAC<RefracRelPoseSixPointEstimator>::Report& report,
+    const bool refine) {
+  TwoViewGeometry geometry;
   geometry.cam2_from_cam1 = report.model;
 
+  const size_t min_num_inliers = static_cast<size_t>(options.min_num_inliers);
   if (!report.success || report.support.num_inliers < min_num_inliers) {
     geometry.config = TwoViewGeometry::ConfigurationType::DEGENERATE;
     return geometry;
@@ -1098,25 +1470,25 @@ TwoViewGeometry EstimateRefractiveTwoViewGeometryHu(
     const Rigid3d real2_from_world = geometry.cam2_from_cam1;
 
     for (const auto& match : geometry.inlier_matches) {
-      const Camera& virtual_camera1 = virtual_cameras1[match.point2D_idx1];
-      const Camera& virtual_camera2 = virtual_cameras2[match.point2D_idx2];
 
-      inlier_points1_normalized.push_back(
-          virtual_camera1.CamFromImg(points1[match.point2D_idx1]));
-      inlier_points2_normalized.push_back(
-          virtual_camera2.CamFromImg(points2[match.point2D_idx2]));
+      inlier_points1_normalized.push_back(virtual_cameras1.CamFromImg(
+          match.point2D_idx1, points1[match.point2D_idx1]));
+      inlier_points2_normalized.push_back(virtual_cameras2.CamFromImg(
+          match.point2D_idx2, points2[match.point2D_idx2]));
 
       const Rigid3d virtual1_from_world =
-          virtual_from_reals1[match.point2D_idx1] * real1_from_world;
+          virtual_cameras1.VirtualFromReal(match.point2D_idx1) *
+          real1_from_world;
       const Rigid3d virtual2_from_world =
-          virtual_from_reals2[match.point2D_idx2] * real2_from_world;
+          virtual_cameras2.VirtualFromReal(match.point2D_idx2) *
+          real2_from_world;
 
       inlier_virtual_proj_matrix1.push_back(virtual1_from_world.ToMatrix());
       inlier_virtual_proj_matrix2.push_back(virtual2_from_world.ToMatrix());
       inlier_virtual_from_reals1.push_back(
-          virtual_from_reals1[match.point2D_idx1]);
+          virtual_cameras1.VirtualFromReal(match.point2D_idx1));
       inlier_virtual_from_reals2.push_back(
-          virtual_from_reals2[match.point2D_idx2]);
+          virtual_cameras2.VirtualFromReal(match.point2D_idx2));
     }
 
     if (refine) {
@@ -1184,4 +1556,111 @@ TwoViewGeometry EstimateRefractiveTwoViewGeometryHu(
   return geometry;
 }
 
+TwoViewGeometry EstimateTwoViewGeometryWithKnownPose(
+    const Camera& camera1,
+    const std::vector<Eigen::Vector2d>& points1,
+    const Camera& camera2,
+    const std::vector<Eigen::Vector2d>& points2,
+    const FeatureMatches& matches,
+    const Rigid3d& cam2_from_cam1,
+    const TwoViewGeometryOptions& options) {
+  std::vector<Eigen::Vector3d> ray_origins(matches.size(),
+                                           Eigen::Vector3d::Zero());
+  std::vector<Eigen::Vector3d> ray_directions1(matches.size());
+  std::vector<Eigen::Vector3d> ray_directions2(matches.size());
+  for (size_t i = 0; i < matches.size(); ++i) {
+    ray_directions1[i] = camera1.CamFromImg(points1[matches[i].point2D_idx1])
+                             .homogeneous()
+                             .normalized();
+    ray_directions2[i] = camera2.CamFromImg(points2[matches[i].point2D_idx2])
+                             .homogeneous()
+                             .normalized();
+  }
+
+  const double max_angular_error = std::atan(
+      (camera1.CamFromImgThreshold(options.ransac_options.max_error) +
+       camera2.CamFromImgThreshold(options.ransac_options.max_error)) /
+      2);
+
+  TwoViewGeometry geometry;
+  VerifyMatchRaysWithKnownPose(ray_origins,
+                               ray_directions1,
+                               ray_origins,
+                               ray_directions2,
+                               matches,
+                               cam2_from_cam1,
+                               max_angular_error,
+                               static_cast<size_t>(options.min_num_inliers),
+                               &geometry);
+  if (geometry.config == TwoViewGeometry::ConfigurationType::DEGENERATE) {
+    return geometry;
+  }
+
+  const Eigen::Matrix3d K1 = camera1.CalibrationMatrix();
+  const Eigen::Matrix3d K2 = camera2.CalibrationMatrix();
+  const Eigen::Matrix3d R = cam2_from_cam1.rotation.toRotationMatrix();
+  if (cam2_from_cam1.translation.norm() <=
+      std::numeric_limits<double>::epsilon()) {
+    geometry.config = TwoViewGeometry::ConfigurationType::PANORAMIC;
+    geometry.H = K2 * R * K1.inverse();
+  } else {
+    geometry.config = TwoViewGeometry::ConfigurationType::CALIBRATED;
+    geometry.E = EssentialMatrixFromPose(cam2_from_cam1);
+    geometry.F = K2.transpose().inverse() * geometry.E * K1.inverse();
+  }
+
+  return geometry;
+}
+
+TwoViewGeometry EstimateRefractiveTwoViewGeometryWithKnownPose(
+    const std::vector<Eigen::Vector2d>& points1,
+    const VirtualPinholeCameras& virtual_cameras1,
+    const std::vector<Eigen::Vector2d>& points2,
+    const VirtualPinholeCameras& virtual_cameras2,
+    const FeatureMatches& matches,
+    const Rigid3d& cam2_from_cam1,
+    const TwoViewGeometryOptions& options) {
+  // The virtual cameras are not rotated relative to the real camera, such
+  // that the rays in the virtual cameras are also the rays in the real camera
+  // from the centers of the virtual cameras.
+  std::vector<Eigen::Vector3d> ray_origins1(matches.size());
+  std::vector<Eigen::Vector3d> ray_directions1(matches.size());
+  std::vector<Eigen::Vector3d> ray_origins2(matches.size());
+  std::vector<Eigen::Vector3d> ray_directions2(matches.size());
+  for (size_t i = 0; i < matches.size(); ++i) {
+    const point2D_t point2D_idx1 = matches[i].point2D_idx1;
+    const point2D_t point2D_idx2 = matches[i].point2D_idx2;
+    ray_origins1[i] = virtual_cameras1.centers[point2D_idx1];
+    ray_directions1[i] =
+        virtual_cameras1.CamFromImg(point2D_idx1, points1[point2D_idx1])
+            .homogeneous()
+            .normalized();
+    ray_origins2[i] = virtual_cameras2.centers[point2D_idx2];
+    ray_directions2[i] =
+        virtual_cameras2.CamFromImg(point2D_idx2, points2[point2D_idx2])
+            .homogeneous()
+            .normalized();
+  }
+
+  const double max_angular_error = std::atan(
+      (virtual_cameras1.CamFromImgThreshold(options.ransac_options.max_error) +
+       virtual_cameras2.CamFromImgThreshold(options.ransac_options.max_error)) /
+      2);
+
+  TwoViewGeometry geometry;
+  VerifyMatchRaysWithKnownPose(ray_origins1,
+                               ray_directions1,
+                               ray_origins2,
+                               ray_directions2,
+                               matches,
+                               cam2_from_cam1,
+                               max_angular_error,
+                               static_cast<size_t>(options.min_num_inliers),
+                               &geometry);
+  if (geometry.config != TwoViewGeometry::ConfigurationType::DEGENERATE) {
+    geometry.config = TwoViewGeometry::ConfigurationType::REFRACTIVE;
+  }
+  return geometry;
+}
+
 }  // namespace colmap
@@ -29,13 +29,17 @@
 
 #pragma once
 
+#include "colmap/estimators/refrac_relative_pose.h"
 #include "colmap/feature/types.h"
 #include "colmap/geometry/rigid3.h"
 #include "colmap/optim/ransac.h"
 #include "colmap/scene/camera.h"
+#include "colmap/scene/database.h"
 #include "colmap/scene/two_view_geometry.h"
 #include "colmap/util/logging.h"
 
+#include <string>
+
 namespace colmap {
 
 // Estimation options.
@@ -94,9 +98,23 @@ struct TwoViewGeometryOptions {
   // field will be initialized.
   bool multiple_models = false;
 
+  // Whether to sort the matches by their descriptor ratios and to sample them
+  // progressively with PROSAC instead of uniformly. Only used if the ratios of
+  // all matches are known, i.e., for matches passed directly from the
+  // matcher, since the ratios are not stored in the database.
+  bool use_prosac = false;
+
   // Whether to use refractive camera model in reconstruction.
   bool enable_refraction = false;
 
+  // The gravity direction in the first and second camera frame, e.g., from
+  // the roll and pitch of an inertial sensor. If both are non-zero, the
+  // relative pose is estimated with the upright minimal solvers, which only
+  // estimate the rotation about gravity and thus require fewer samples. Only
+  // used for calibrated and for refractive image pairs on the CPU.
+  Eigen::Vector3d gravity_in_cam1 = Eigen::Vector3d::Zero();
+  Eigen::Vector3d gravity_in_cam2 = Eigen::Vector3d::Zero();
+
   // TwoViewGeometryOptions used to robustly estimate the geometry.
   RANSACOptions ransac_options;
 
@@ -170,11 +188,9 @@ bool DetectWatermark(const Camera& camera1,
 
 TwoViewGeometry EstimateRefractiveTwoViewGeometry(
     const std::vector<Eigen::Vector2d>& points1,
-    const std::vector<Camera>& virtual_cameras1,
-    const std::vector<Rigid3d>& virtual_from_reals1,
+    const VirtualPinholeCameras& virtual_cameras1,
     const std::vector<Eigen::Vector2d>& points2,
-    const std::vector<Camera>& virtual_cameras2,
-    const std::vector<Rigid3d>& virtual_from_reals2,
+    const VirtualPinholeCameras& virtual_cameras2,
     const FeatureMatches& matches,
     const TwoViewGeometryOptions& options,
     bool refine = false);
@@ -189,32 +205,100 @@ bool RefineRefractiveTwoViewGeometry(
 // Compute a best approximated non-refractive camera model of the current
 // refractive camera. This approximation can only work for a certain scene
 // distance, the user should input the target scene depth to approximate.
+// The cameras are cached process-wide by `BestFitNonRefracCameraKey`, such
+// that every refractive camera is only fitted once.
 Camera BestFitNonRefracCamera(CameraModelId tgt_model_id,
                               const Camera& camera,
                               double approx_depth);
 
+// Key of a best fit camera, which consists of the models, dimensions, and
+// parameters of the refractive camera, the target model, and the depth.
+std::string BestFitNonRefracCameraKey(CameraModelId tgt_model_id,
+                                      const Camera& camera,
+                                      double approx_depth);
+
+// Add the best fit cameras stored in the database to the process-wide cache,
+// or store all cached best fit cameras in the database, such that they are
+// reused by all tools working on the database.
+void ReadBestFitNonRefracCameras(const Database& database);
+void WriteBestFitNonRefracCameras(const Database& database);
+
 TwoViewGeometry EstimateRefractiveTwoViewGeometryUseBestFit(
     const Camera& best_fit_camera1,
     const std::vector<Eigen::Vector2d>& points1,
-    const std::vector<Camera>& virtual_cameras1,
-    const std::vector<Rigid3d>& virtual_from_reals1,
+    const VirtualPinholeCameras& virtual_cameras1,
     const Camera& best_fit_camera2,
     const std::vector<Eigen::Vector2d>& points2,
-    const std::vector<Camera>& virtual_cameras2,
-    const std::vector<Rigid3d>& virtual_from_reals2,
+    const VirtualPinholeCameras& virtual_cameras2,
     const FeatureMatches& matches,
     const TwoViewGeometryOptions& options,
     bool refine = false);
 
 TwoViewGeometry EstimateRefractiveTwoViewGeometryHu(
     const std::vector<Eigen::Vector2d>& points1,
-    const std::vector<Camera>& virtual_cameras1,
-    const std::vector<Rigid3d>& virtual_from_reals1,
+    const VirtualPinholeCameras& virtual_cameras1,
     const std::vector<Eigen::Vector2d>& points2,
-    const std::vector<Camera>& virtual_cameras2,
-    const std::vector<Rigid3d>& virtual_from_reals2,
+    const VirtualPinholeCameras& virtual_cameras2,
     const FeatureMatches& matches,
     const TwoViewGeometryOptions& options,
     bool refine = false);
 
+// Extract the rays of the matches in their virtual cameras, as used by
+// `EstimateRefractiveTwoViewGeometryHu`.
+void ExtractRefracRelPoseCorrespondences(
+    const std::vector<Eigen::Vector2d>& points1,
+    const VirtualPinholeCameras& virtual_cameras1,
+    const std::vector<Eigen::Vector2d>& points2,
+    const VirtualPinholeCameras& virtual_cameras2,
+    const FeatureMatches& matches,
+    std::vector<RefracRelPoseEstimator::X_t>* matched_points1,
+    std::vector<RefracRelPoseEstimator::Y_t>* matched_points2);
+
+// Compose the two-view geometry of `EstimateRefractiveTwoViewGeometryHu` from
+// the RANSAC report of the relative pose estimation on the correspondences of
+// `ExtractRefracRelPoseCorrespondences`, e.g., from the batched estimation.
+TwoViewGeometry ComposeRefractiveTwoViewGeometry(
+    const std::vector<Eigen::Vector2d>& points1,
+    const VirtualPinholeCameras& virtual_cameras1,
+    const std::vector<Eigen::Vector2d>& points2,
+    const VirtualPinholeCameras& virtual_cameras2,
+    const FeatureMatches& matches,
+    const TwoViewGeometryOptions& options,
+    const RANSAC<RefracRelPoseSixPointEstimator>::Report& report,
+    bool refine = false);
+
+// Verify the matches of an image pair with known relative pose, e.g., of two
+// cameras in the same snapshot of a calibrated camera rig, instead of robustly
+// estimating the two-view geometry. The matches are inliers if the angular
+// errors of their rays to the triangulated point are below the threshold of
+// `options.ransac_options.max_error` pixels. Pairs with a baseline yield
+// calibrated and pairs without a baseline panoramic geometry.
+//
+// @param camera1         Camera of first image.
+// @param points1         Feature points in first image.
+// @param camera2         Camera of second image.
+// @param points2         Feature points in second image.
+// @param matches         Feature matches between first and second image.
+// @param cam2_from_cam1  Known relative pose between the cameras.
+// @param options         Two-view geometry estimation options.
+TwoViewGeometry EstimateTwoViewGeometryWithKnownPose(
+    const Camera& camera1,
+    const std::vector<Eigen::Vector2d>& points1,
+    const Camera& camera2,
+    const std::vector<Eigen::Vector2d>& points2,
+    const FeatureMatches& matches,
+    const Rigid3d& cam2_from_cam1,
+    const TwoViewGeometryOptions& options);
+
+// Refractive variant of `EstimateTwoViewGeometryWithKnownPose`, where the rays
+// of the matches are given by their virtual cameras.
+TwoViewGeometry EstimateRefractiveTwoViewGeometryWithKnownPose(
+    const std::vector<Eigen::Vector2d>& points1,
+    const VirtualPinholeCameras& virtual_cameras1,
+    const std::vector<Eigen::Vector2d>& points2,
+    const VirtualPinholeCameras& virtual_cameras2,
+    const FeatureMatches& matches,
+    const Rigid3d& cam2_from_cam1,
+    const TwoViewGeometryOptions& options);
+
 }  // namespace colmap
@@ -0,0 +1,107 @@
+#include "colmap/estimators/two_view_geometry.h"
+
+#include "colmap/math/random.h"
+
+#include <gtest/gtest.h>
+
+namespace colmap {
+namespace {
+
+void GenerateKnownPoseProblem(const Camera& camera1,
+                              const Camera& camera2,
+                              const Rigid3d& cam2_from_cam1,
+                              const int num_points,
+                              const int num_outliers,
+                              std::vector<Eigen::Vector2d>* points1,
+                              std::vector<Eigen::Vector2d>* points2,
+                              FeatureMatches* matches) {
+  for (int i = 0; i < num_points + num_outliers; ++i) {
+    const Eigen::Vector3d point3D(RandomUniformReal(-1.0, 1.0),
+                                  RandomUniformReal(-1.0, 1.0),
+                                  RandomUniformReal(4.0, 8.0));
+    points1->push_back(camera1.ImgFromCam(point3D.hnormalized()));
+    if (i < num_points) {
+      points2->push_back(
+          camera2.ImgFromCam((cam2_from_cam1 * point3D).hnormalized()));
+    } else {
+      points2->push_back(Eigen::Vector2d(RandomUniformReal(0.0, 100.0),
+                                         RandomUniformReal(0.0, 100.0)));
+    }
+    matches->emplace_back(i, i);
+  }
+}
+
+TEST(EstimateTwoViewGeometryWithKnownPose, Calibrated) {
+  SetPRNGSeed(0);
+  const Camera camera =
+      Camera::CreateFromModelId(1, CameraModelId::kPinhole, 100, 100, 100);
+  const Rigid3d cam2_from_cam1(
+      Eigen::Quaterniond(Eigen::AngleAxisd(0.1, Eigen::Vector3d::UnitY())),
+      Eigen::Vector3d(-1, 0, 0));
+  std::vector<Eigen::Vector2d> points1;
+  std::vector<Eigen::Vector2d> points2;
+  FeatureMatches matches;
+  GenerateKnownPoseProblem(
+      camera, camera, cam2_from_cam1, 50, 10, &points1, &points2, &matches);
+
+  TwoViewGeometryOptions options;
+  const TwoViewGeometry geometry = EstimateTwoViewGeometryWithKnownPose(
+      camera, points1, camera, points2, matches, cam2_from_cam1, options);
+  EXPECT_EQ(geometry.config, TwoViewGeometry::ConfigurationType::CALIBRATED);
+  EXPECT_GE(geometry.inlier_matches.size(), 50);
+  EXPECT_LT(geometry.inlier_matches.size(), 60);
+  EXPECT_GT(geometry.tri_angle, 0);
+  for (size_t i = 0; i < 50; ++i) {
+    const Eigen::Vector3d point1 = points1[i].homogeneous();
+    const Eigen::Vector3d point2 = points2[i].homogeneous();
+    EXPECT_NEAR(point2.transpose() * geometry.F * point1, 0, 1e-6);
+  }
+
+  // Wrong relative poses do not verify the matches.
+  const TwoViewGeometry wrong_geometry = EstimateTwoViewGeometryWithKnownPose(
+      camera,
+      points1,
+      camera,
+      points2,
+      matches,
+      Rigid3d(Eigen::Quaterniond::Identity(), Eigen::Vector3d(0, 1, 0)),
+      options);
+  EXPECT_EQ(wrong_geometry.config,
+            TwoViewGeometry::ConfigurationType::DEGENERATE);
+  EXPECT_TRUE(wrong_geometry.inlier_matches.empty());
+}
+
+TEST(EstimateTwoViewGeometryWithKnownPose, Panoramic) {
+  SetPRNGSeed(0);
+  const Camera camera =
+      Camera::CreateFromModelId(1, CameraModelId::kPinhole, 100, 100, 100);
+  const Rigid3d cam2_from_cam1(
+      Eigen::Quaterniond(Eigen::AngleAxisd(0.1, Eigen::Vector3d::UnitY())),
+      Eigen::Vector3d::Zero());
+  std::vector<Eigen::Vector2d> points1;
+  std::vector<Eigen::Vector2d> points2;
+  FeatureMatches matches;
+  GenerateKnownPoseProblem(
+      camera, camera, cam2_from_cam1, 50, 0, &points1, &points2, &matches);
+
+  const TwoViewGeometry geometry =
+      EstimateTwoViewGeometryWithKnownPose(camera,
+                                           points1,
+                                           camera,
+                                           points2,
+                                           matches,
+                                           cam2_from_cam1,
+                                           TwoViewGeometryOptions());
+  EXPECT_EQ(geometry.config, TwoViewGeometry::ConfigurationType::PANORAMIC);
+  EXPECT_EQ(geometry.inlier_matches.size(), 50);
+  EXPECT_EQ(geometry.tri_angle, 0);
+  for (size_t i = 0; i < points1.size(); ++i) {
+    EXPECT_LT((points2[i] - (geometry.H * points1[i].homogeneous())
+                                .hnormalized())
+                  .norm(),
+              1e-6);
+  }
+}
+
+}  // namespace
+}  // namespace colmap
@@ -27,6 +27,7 @@
 // ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
 // POSSIBILITY OF SUCH DAMAGE.
 
+#include "colmap/controllers/option_manager.h"
 #include "colmap/exe/database.h"
 #include "colmap/exe/feature.h"
 #include "colmap/exe/gui.h"
@@ -35,8 +36,13 @@
 #include "colmap/exe/mvs.h"
 #include "colmap/exe/sfm.h"
 #include "colmap/exe/vocab_tree.h"
+#include "colmap/scene/database_cache.h"
+#include "colmap/util/tracing.h"
 #include "colmap/util/version.h"
 
+#include <cctype>
+#include <iostream>
+
 namespace {
 
 typedef std::function<int(int, char**)> command_func_t;
@@ -76,6 +82,7 @@ int ShowHelp(
 
   std::cout << "Available commands:" << std::endl;
   std::cout << "  help" << std::endl;
+  std::cout << "  serve" << std::endl;
   for (const auto& command : commands) {
     std::cout << "  " << command.first << std::endl;
   }
@@ -84,6 +91,99 @@ int ShowHelp(
   return EXIT_SUCCESS;
 }
 
+// Split the line of a job into its arguments at whitespace, where double
+// quotes group arguments with whitespace, e.g., paths.
+std::vector<std::string> SplitJobArguments(const std::string& line) {
+  std::vector<std::string> args;
+  std::string arg;
+  bool in_arg = false;
+  bool in_quotes = false;
+  for (const char c : line) {
+    if (c == '"') {
+      in_quotes = !in_quotes;
+      in_arg = true;
+    } else if (!in_quotes && std::isspace(static_cast<unsigned char>(c))) {
+      if (in_arg) {
+        args.push_back(arg);
+        arg.clear();
+        in_arg = false;
+      }
+    } else {
+      arg.push_back(c);
+      in_arg = true;
+    }
+  }
+  if (in_arg) {
+    args.push_back(arg);
+  }
+  return args;
+}
+
+// Run jobs read line by line from the standard input in the same process, so
+// that state is kept warm between the jobs, e.g., the database caches of the
+// mappers and the best fit cameras of refractive matching. Every line holds a
+// command with its options, as on the command-line. After every job, a status
+// line is written to the standard output. The standard input can be connected
+// to a pipe or local socket of a driving process. Jobs with invalid options or
+// `--help` only fail or finish the job instead of exiting the process.
+int RunServer(
+    const char* executable,
+    const std::vector<std::pair<std::string, command_func_t>>& commands) {
+  colmap::DatabaseCache::SetRetainCaches(true);
+  colmap::OptionManager::SetExitOnParse(false);
+
+  LOG(INFO) << "Waiting for jobs, e.g., `mapper --database_path DATABASE "
+               "--image_path IMAGES --output_path MODEL` or `quit`";
+
+  std::string line;
+  while (std::getline(std::cin, line)) {
+    colmap::StringTrim(&line);
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+
+    std::vector<std::string> args = SplitJobArguments(line);
+    if (args[0] == "quit" || args[0] == "exit") {
+      break;
+    }
+
+    command_func_t command_func = nullptr;
+    for (const auto& command : commands) {
+      if (args[0] == command.first) {
+        command_func = command.second;
+        break;
+      }
+    }
+
+    int status = EXIT_FAILURE;
+    if (command_func == nullptr || args[0] == "gui") {
+      LOG(ERROR) << colmap::StringPrintf(
+          "Command `%s` not recognized or not supported as a job.",
+          args[0].c_str());
+    } else {
+      args[0] = executable;
+      std::vector<char*> argv;
+      argv.reserve(args.size());
+      for (std::string& arg : args) {
+        argv.push_back(&arg[0]);
+      }
+      try {
+        status = command_func(static_cast<int>(argv.size()), argv.data());
+      } catch (const colmap::OptionManager::ParseExit& exc) {
+        status = exc.status;
+      }
+      colmap::Tracer::Instance().Stop();
+    }
+
+    std::cout << "colmap serve: status " << status << std::endl;
+  }
+
+  colmap::OptionManager::SetExitOnParse(true);
+  colmap::DatabaseCache::SetRetainCaches(false);
+
+  return EXIT_SUCCESS;
+}
+
 }  // namespace
 
 int main(int argc, char** argv) {
@@ -101,10 +201,15 @@ int main(int argc, char** argv) {
   commands.emplace_back("database_cleaner", &colmap::RunDatabaseCleaner);
   commands.emplace_back("database_creator", &colmap::RunDatabaseCreator);
   commands.emplace_back("database_merger", &colmap::RunDatabaseMerger);
+  commands.emplace_back("database_shard_merger",
+                        &colmap::RunDatabaseShardMerger);
   commands.emplace_back("delaunay_mesher", &colmap::RunDelaunayMesher);
+  commands.emplace_back("descriptor_compressor",
+                        &colmap::RunDescriptorCompressor);
   commands.emplace_back("exhaustive_matcher", &colmap::RunExhaustiveMatcher);
   commands.emplace_back("feature_extractor", &colmap::RunFeatureExtractor);
   commands.emplace_back("feature_importer", &colmap::RunFeatureImporter);
+  commands.emplace_back("global_mapper", &colmap::RunGlobalMapper);
   commands.emplace_back("hierarchical_mapper", &colmap::RunHierarchicalMapper);
   commands.emplace_back("hybrid_mapper", &colmap::RunHybridMapper);
   commands.emplace_back("image_deleter", &colmap::RunImageDeleter);
@@ -130,8 +235,10 @@ int main(int argc, char** argv) {
   commands.emplace_back("point_filtering", &colmap::RunPointFiltering);
   commands.emplace_back("point_triangulator", &colmap::RunPointTriangulator);
   commands.emplace_back("poisson_mesher", &colmap::RunPoissonMesher);
+  commands.emplace_back("pose_prior_matcher", &colmap::RunPosePriorMatcher);
   commands.emplace_back("project_generator", &colmap::RunProjectGenerator);
   commands.emplace_back("rig_bundle_adjuster", &colmap::RunRigBundleAdjuster);
+  commands.emplace_back("rig_matcher", &colmap::RunRigMatcher);
   commands.emplace_back("sequential_matcher", &colmap::RunSequentialMatcher);
   commands.emplace_back("spatial_matcher", &colmap::RunSpatialMatcher);
   commands.emplace_back("stereo_fusion", &colmap::RunStereoFuser);
@@ -147,6 +254,8 @@ int main(int argc, char** argv) {
   const std::string command = argv[1];
   if (command == "help" || command == "-h" || command == "--help") {
     return ShowHelp(commands);
+  } else if (command == "serve") {
+    return RunServer(argv[0], commands);
   } else {
     command_func_t matched_command_func = nullptr;
     for (const auto& command_func : commands) {
@@ -165,7 +274,10 @@ int main(int argc, char** argv) {
       int command_argc = argc - 1;
       char** command_argv = &argv[1];
       command_argv[0] = argv[0];
-      return matched_command_func(command_argc, command_argv);
+      const int status = matched_command_func(command_argc, command_argv);
+      // Write the trace, if enabled by the options of the command.
+      colmap::Tracer::Instance().Stop();
+      return status;
     }
   }
 
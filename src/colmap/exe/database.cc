@@ -104,9 +104,30 @@ int RunDatabaseMerger(int argc, char** argv) {
   Database database1(database_path1);
   Database database2(database_path2);
   Database merged_database(merged_database_path);
+  DatabaseTransaction database_transaction(&merged_database);
   Database::Merge(database1, database2, &merged_database);
 
   return EXIT_SUCCESS;
 }
 
+int RunDatabaseShardMerger(int argc, char** argv) {
+  std::string shard_database_paths;
+
+  OptionManager options;
+  options.AddDatabaseOptions();
+  options.AddRequiredOption("shard_database_paths", &shard_database_paths);
+  options.Parse(argc, argv);
+
+  Database database(*options.database_path);
+  for (const auto& shard_database_path :
+       CSVToVector<std::string>(shard_database_paths)) {
+    LOG(INFO) << "Merging " << shard_database_path;
+    Database shard_database(shard_database_path);
+    DatabaseTransaction database_transaction(&database);
+    Database::MergeMatches(shard_database, &database);
+  }
+
+  return EXIT_SUCCESS;
+}
+
 }  // namespace colmap
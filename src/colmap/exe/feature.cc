@@ -34,6 +34,8 @@
 #include "colmap/controllers/image_reader.h"
 #include "colmap/controllers/option_manager.h"
 #include "colmap/exe/gui.h"
+#include "colmap/feature/product_quantizer.h"
+#include "colmap/math/random.h"
 #include "colmap/sensor/models.h"
 #include "colmap/util/misc.h"
 #include "colmap/util/opengl_utils.h"
@@ -207,13 +209,98 @@ int RunFeatureImporter(int argc, char** argv) {
   }
 
   auto feature_importer =
-      CreateFeatureImporterController(reader_options, import_path);
+      CreateFeatureImporterController(reader_options,
+                                      import_path,
+                                      options.sift_extraction->num_threads);
   feature_importer->Start();
   feature_importer->Wait();
 
   return EXIT_SUCCESS;
 }
 
+int RunDescriptorCompressor(int argc, char** argv) {
+  int num_training_descriptors = 1000000;
+  int num_iterations = 25;
+  int num_threads = -1;
+
+  OptionManager options;
+  options.AddDatabaseOptions();
+  options.AddDefaultOption("num_training_descriptors",
+                           &num_training_descriptors);
+  options.AddDefaultOption("num_iterations", &num_iterations);
+  options.AddDefaultOption("num_threads", &num_threads);
+  options.Parse(argc, argv);
+
+  Database database(*options.database_path);
+
+  const std::vector<Image> images = database.ReadAllImages();
+  const size_t num_descriptors = database.NumDescriptors();
+  if (num_descriptors < ProductQuantizer::kNumCentroids) {
+    LOG(ERROR) << "Not enough descriptors to train the descriptor codebook.";
+    return EXIT_FAILURE;
+  }
+
+  PrintHeading1("Training descriptor codebook");
+
+  // Sample the training descriptors uniformly from all images.
+  const double sampling_prob =
+      std::min(1.0,
+               static_cast<double>(num_training_descriptors) /
+                   static_cast<double>(num_descriptors));
+  std::vector<FeatureDescriptors> sampled_descriptors;
+  size_t num_sampled_descriptors = 0;
+  for (const Image& image : images) {
+    if (!database.ExistsDescriptors(image.ImageId())) {
+      continue;
+    }
+    const FeatureDescriptors descriptors =
+        database.ReadDescriptors(image.ImageId());
+    std::vector<int> sampled_idxs;
+    for (Eigen::Index i = 0; i < descriptors.rows(); ++i) {
+      if (RandomUniformReal(0.0, 1.0) < sampling_prob) {
+        sampled_idxs.push_back(i);
+      }
+    }
+    sampled_descriptors.emplace_back(sampled_idxs.size(), descriptors.cols());
+    for (size_t i = 0; i < sampled_idxs.size(); ++i) {
+      sampled_descriptors.back().row(i) = descriptors.row(sampled_idxs[i]);
+    }
+    num_sampled_descriptors += sampled_idxs.size();
+  }
+
+  FeatureDescriptors training_descriptors(num_sampled_descriptors,
+                                          ProductQuantizer::kDescriptorDim);
+  Eigen::Index row = 0;
+  for (const FeatureDescriptors& descriptors : sampled_descriptors) {
+    training_descriptors.middleRows(row, descriptors.rows()) = descriptors;
+    row += descriptors.rows();
+  }
+  sampled_descriptors.clear();
+
+  LOG(INFO) << StringPrintf("Training on %d descriptors",
+                            training_descriptors.rows());
+  ProductQuantizer quantizer;
+  quantizer.Train(training_descriptors, num_iterations, num_threads);
+
+  PrintHeading1("Encoding descriptors");
+
+  DatabaseTransaction transaction(&database);
+  database.ClearDescriptorCodes();
+  database.WriteDescriptorCodebook(quantizer.Codebook());
+  for (size_t i = 0; i < images.size(); ++i) {
+    const image_t image_id = images[i].ImageId();
+    if (!database.ExistsDescriptors(image_id)) {
+      continue;
+    }
+    LOG(INFO) << StringPrintf(
+        "Encoding image [%d/%d]", i + 1, images.size());
+    database.WriteDescriptorCodes(
+        image_id, quantizer.Encode(database.ReadDescriptors(image_id)));
+  }
+
+  return EXIT_SUCCESS;
+}
+
 int RunExhaustiveMatcher(int argc, char** argv) {
   OptionManager options;
   options.AddDatabaseOptions();
@@ -356,6 +443,72 @@ int RunSpatialMatcher(int argc, char** argv) {
   return EXIT_SUCCESS;
 }
 
+int RunPosePriorMatcher(int argc, char** argv) {
+  OptionManager options;
+  options.AddDatabaseOptions();
+  options.AddPosePriorMatchingOptions();
+  options.Parse(argc, argv);
+
+  if (!VerifySiftGPUParams(options.sift_matching->use_gpu)) {
+    return EXIT_FAILURE;
+  }
+
+  std::unique_ptr<QApplication> app;
+  if (options.sift_matching->use_gpu && kUseOpenGL) {
+    app.reset(new QApplication(argc, argv));
+  }
+
+  auto matcher = CreatePosePriorFeatureMatcher(*options.pose_prior_matching,
+                                               *options.sift_matching,
+                                               *options.two_view_geometry,
+                                               *options.database_path);
+
+  if (options.sift_matching->use_gpu && kUseOpenGL) {
+    RunThreadWithOpenGLContext(matcher.get());
+  } else {
+    matcher->Start();
+    matcher->Wait();
+  }
+
+  return EXIT_SUCCESS;
+}
+
+int RunRigMatcher(int argc, char** argv) {
+  OptionManager options;
+  options.AddDatabaseOptions();
+  options.AddRigMatchingOptions();
+  options.Parse(argc, argv);
+
+  if (!ExistsFile(options.rig_matching->rig_config_path)) {
+    LOG(ERROR) << "Rig configuration does not exist; "
+                  "set RigMatching.rig_config_path.";
+    return EXIT_FAILURE;
+  }
+
+  if (!VerifySiftGPUParams(options.sift_matching->use_gpu)) {
+    return EXIT_FAILURE;
+  }
+
+  std::unique_ptr<QApplication> app;
+  if (options.sift_matching->use_gpu && kUseOpenGL) {
+    app.reset(new QApplication(argc, argv));
+  }
+
+  auto matcher = CreateRigFeatureMatcher(*options.rig_matching,
+                                         *options.sift_matching,
+                                         *options.two_view_geometry,
+                                         *options.database_path);
+
+  if (options.sift_matching->use_gpu && kUseOpenGL) {
+    RunThreadWithOpenGLContext(matcher.get());
+  } else {
+    matcher->Start();
+    matcher->Wait();
+  }
+
+  return EXIT_SUCCESS;
+}
+
 int RunTransitiveMatcher(int argc, char** argv) {
   OptionManager options;
   options.AddDatabaseOptions();
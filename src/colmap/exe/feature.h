@@ -76,8 +76,11 @@ bool VerifyCameraParams(const std::string& camera_model,
 
 int RunFeatureExtractor(int argc, char** argv);
 int RunFeatureImporter(int argc, char** argv);
+int RunDescriptorCompressor(int argc, char** argv);
 int RunExhaustiveMatcher(int argc, char** argv);
 int RunMatchesImporter(int argc, char** argv);
+int RunPosePriorMatcher(int argc, char** argv);
+int RunRigMatcher(int argc, char** argv);
 int RunSequentialMatcher(int argc, char** argv);
 int RunSpatialMatcher(int argc, char** argv);
 int RunTransitiveMatcher(int argc, char** argv);
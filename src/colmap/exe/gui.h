@@ -43,7 +43,10 @@ class QApplication {
 
 namespace colmap {
 
-#if defined(COLMAP_CUDA_ENABLED) || !defined(COLMAP_GUI_ENABLED)
+// Whether GPU threads must run in a QApplication, which owns their OpenGL
+// contexts. This is not the case for CUDA or headless EGL contexts.
+#if defined(COLMAP_CUDA_ENABLED) || defined(COLMAP_EGL_ENABLED) || \
+    !defined(COLMAP_GUI_ENABLED)
 const bool kUseOpenGL = false;
 #else
 const bool kUseOpenGL = true;
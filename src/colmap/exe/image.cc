@@ -201,6 +201,7 @@ int RunImageRectifier(int argc, char** argv) {
   std::string input_path;
   std::string output_path;
   std::string stereo_pairs_list;
+  bool fixed_rig = false;
 
   UndistortCameraOptions undistort_camera_options;
 
@@ -209,12 +210,15 @@ int RunImageRectifier(int argc, char** argv) {
   options.AddRequiredOption("input_path", &input_path);
   options.AddRequiredOption("output_path", &output_path);
   options.AddRequiredOption("stereo_pairs_list", &stereo_pairs_list);
+  options.AddDefaultOption("fixed_rig", &fixed_rig);
   options.AddDefaultOption("blank_pixels",
                            &undistort_camera_options.blank_pixels);
   options.AddDefaultOption("min_scale", &undistort_camera_options.min_scale);
   options.AddDefaultOption("max_scale", &undistort_camera_options.max_scale);
   options.AddDefaultOption("max_image_size",
                            &undistort_camera_options.max_image_size);
+  options.AddDefaultOption("refrac_reference_distance",
+                           &undistort_camera_options.refrac_reference_distance);
   options.Parse(argc, argv);
 
   Reconstruction reconstruction;
@@ -227,7 +231,8 @@ int RunImageRectifier(int argc, char** argv) {
                                  reconstruction,
                                  *options.image_path,
                                  output_path,
-                                 stereo_pairs);
+                                 stereo_pairs,
+                                 fixed_rig);
   rectifier.Start();
   rectifier.Wait();
 
@@ -237,11 +242,17 @@ int RunImageRectifier(int argc, char** argv) {
 int RunImageRegistrator(int argc, char** argv) {
   std::string input_path;
   std::string output_path;
+  bool parallel = false;
+  bool triangulate = false;
+  bool bundle_adjust = false;
 
   OptionManager options;
   options.AddDatabaseOptions();
   options.AddRequiredOption("input_path", &input_path);
   options.AddRequiredOption("output_path", &output_path);
+  options.AddDefaultOption("parallel", &parallel);
+  options.AddDefaultOption("triangulate", &triangulate);
+  options.AddDefaultOption("bundle_adjust", &bundle_adjust);
   options.AddMapperOptions();
   options.Parse(argc, argv);
 
@@ -257,17 +268,19 @@ int RunImageRegistrator(int argc, char** argv) {
 
   PrintHeading1("Loading database");
 
-  std::shared_ptr<DatabaseCache> database_cache;
+  std::shared_ptr<const DatabaseCache> database_cache;
 
   {
     Timer timer;
     timer.Start();
     const size_t min_num_matches =
         static_cast<size_t>(options.mapper->min_num_matches);
-    database_cache = DatabaseCache::Create(Database(*options.database_path),
-                                           min_num_matches,
-                                           options.mapper->ignore_watermarks,
-                                           options.mapper->image_names);
+    database_cache = DatabaseCache::CreateOrRetain(
+        *options.database_path,
+        min_num_matches,
+        options.mapper->ignore_watermarks,
+        options.mapper->image_names,
+        options.mapper->database_cache_path);
     timer.PrintMinutes();
   }
 
@@ -279,18 +292,81 @@ int RunImageRegistrator(int argc, char** argv) {
 
   const auto mapper_options = options.mapper->Mapper();
 
-  for (const auto& image : reconstruction->Images()) {
-    if (image.second.IsRegistered()) {
-      continue;
+  std::vector<image_t> reg_image_ids;
+  if (parallel) {
+    // Localize all images concurrently against the fixed 3D points of the
+    // model. The registered images continue the tracks of their inliers,
+    // such that the remaining images are retried until no more images can be
+    // registered.
+    std::vector<image_t> image_ids;
+    for (const auto& image : reconstruction->Images()) {
+      if (!image.second.IsRegistered()) {
+        image_ids.push_back(image.first);
+      }
     }
 
-    PrintHeading1("Registering image #" + std::to_string(image.first) + " (" +
-                  std::to_string(reconstruction->NumRegImages() + 1) + ")");
+    while (!image_ids.empty()) {
+      PrintHeading1(StringPrintf("Registering %d images (%d)",
+                                 image_ids.size(),
+                                 reconstruction->NumRegImages() + 1));
+
+      const std::vector<image_t> round_reg_image_ids =
+          mapper.RegisterNextImages(mapper_options, image_ids);
+
+      LOG(INFO) << StringPrintf("=> Registered %d / %d images",
+                                round_reg_image_ids.size(),
+                                image_ids.size());
+
+      if (round_reg_image_ids.empty()) {
+        break;
+      }
 
-    LOG(INFO) << "\n=> Image sees " << image.second.NumVisiblePoints3D()
-              << " / " << image.second.NumObservations() << " points";
+      reg_image_ids.insert(reg_image_ids.end(),
+                           round_reg_image_ids.begin(),
+                           round_reg_image_ids.end());
+      image_ids.erase(
+          std::remove_if(image_ids.begin(),
+                         image_ids.end(),
+                         [&](const image_t image_id) {
+                           return reconstruction->IsImageRegistered(image_id);
+                         }),
+          image_ids.end());
+    }
+  } else {
+    for (const auto& image : reconstruction->Images()) {
+      if (image.second.IsRegistered()) {
+        continue;
+      }
+
+      PrintHeading1("Registering image #" + std::to_string(image.first) +
+                    " (" + std::to_string(reconstruction->NumRegImages() + 1) +
+                    ")");
+
+      LOG(INFO) << "\n=> Image sees " << image.second.NumVisiblePoints3D()
+                << " / " << image.second.NumObservations() << " points";
+
+      if (mapper.RegisterNextImage(mapper_options, image.first)) {
+        reg_image_ids.push_back(image.first);
+      }
+    }
+  }
+
+  if (triangulate) {
+    PrintHeading1("Triangulating registered images");
+    const auto tri_options = options.mapper->Triangulation();
+    size_t num_tris = mapper.TriangulateImages(tri_options, reg_image_ids);
+    num_tris += mapper.CompleteTracks(tri_options);
+    num_tris += mapper.MergeTracks(tri_options);
+    LOG(INFO) << "=> Triangulated observations: " << num_tris;
+  }
 
-    mapper.RegisterNextImage(mapper_options, image.first);
+  if (bundle_adjust && !reg_image_ids.empty()) {
+    PrintHeading1("Global bundle adjustment");
+    // The images of the input model are kept fixed.
+    auto ba_mapper_options = mapper_options;
+    ba_mapper_options.fix_existing_images = true;
+    mapper.AdjustGlobalBundle(ba_mapper_options,
+                              options.mapper->GlobalBundleAdjustment());
   }
 
   mapper.EndReconstruction(/*discard=*/false);
@@ -332,6 +408,8 @@ int RunImageUndistorter(int argc, char** argv) {
   options.AddDefaultOption("roi_min_y", &undistort_camera_options.roi_min_y);
   options.AddDefaultOption("roi_max_x", &undistort_camera_options.roi_max_x);
   options.AddDefaultOption("roi_max_y", &undistort_camera_options.roi_max_y);
+  options.AddDefaultOption("refrac_reference_distance",
+                           &undistort_camera_options.refrac_reference_distance);
   options.Parse(argc, argv);
 
   CreateDirIfNotExists(output_path);
@@ -421,6 +499,8 @@ int RunImageUndistorterStandalone(int argc, char** argv) {
   options.AddDefaultOption("roi_min_y", &undistort_camera_options.roi_min_y);
   options.AddDefaultOption("roi_max_x", &undistort_camera_options.roi_max_x);
   options.AddDefaultOption("roi_max_y", &undistort_camera_options.roi_max_y);
+  options.AddDefaultOption("refrac_reference_distance",
+                           &undistort_camera_options.refrac_reference_distance);
   options.Parse(argc, argv);
 
   CreateDirIfNotExists(output_path);
@@ -35,17 +35,31 @@
 #include "colmap/geometry/gps.h"
 #include "colmap/geometry/pose.h"
 #include "colmap/optim/ransac.h"
+#include "colmap/scene/mapped_reconstruction.h"
+#include "colmap/scene/reconstruction_stats.h"
 #include "colmap/util/misc.h"
 #include "colmap/util/threading.h"
 
 namespace colmap {
 namespace {
 
+// Whether the model at the given path only exists in the mapped format, which
+// can then be cropped without materializing the reconstruction.
+bool IsMappedOnlyModel(const std::string& path) {
+  const auto ExistModelFiles = [&path](const std::string& ext) {
+    return ExistsFile(JoinPaths(path, "cameras" + ext)) &&
+           ExistsFile(JoinPaths(path, "images" + ext)) &&
+           ExistsFile(JoinPaths(path, "points3D" + ext));
+  };
+  return !ExistModelFiles(".bin") && !ExistModelFiles(".txt") &&
+         ExistsFile(JoinPaths(path, kMappedReconstructionFileName));
+}
+
 std::vector<std::pair<Eigen::Vector3d, Eigen::Vector3d>>
-ComputeEqualPartsBounds(const Reconstruction& reconstruction,
-                        const Eigen::Vector3i& split) {
+ComputeEqualPartsBounds(
+    const std::pair<Eigen::Vector3d, Eigen::Vector3d>& bbox,
+    const Eigen::Vector3i& split) {
   std::vector<std::pair<Eigen::Vector3d, Eigen::Vector3d>> bounds;
-  const auto bbox = reconstruction.ComputeBoundingBox();
   const Eigen::Vector3d extent = bbox.second - bbox.first;
   const Eigen::Vector3d offset(
       extent(0) / split(0), extent(1) / split(1), extent(2) / split(2));
@@ -171,6 +185,18 @@ void ReadDatabaseCameraLocations(const std::string& database_path,
       ConvertCameraLocations(ref_is_gps, alignment_type, *ref_locations);
 }
 
+void ReadDatabasePosePriors(const std::string& database_path,
+                            Reconstruction* reconstruction) {
+  Database database(database_path);
+  for (const auto& image : database.ReadAllImages()) {
+    if (reconstruction->ExistsImage(image.ImageId()) &&
+        reconstruction->Image(image.ImageId()).Name() == image.Name()) {
+      reconstruction->Image(image.ImageId()).CamFromWorldPrior() =
+          image.CamFromWorldPrior();
+    }
+  }
+}
+
 void WriteComparisonErrorsCSV(const std::string& path,
                               const std::vector<ImageAlignmentError>& errors) {
   std::ofstream file(path, std::ios::trunc);
@@ -216,6 +242,57 @@ void PrintComparisonSummary(std::ostream& out,
   PrintErrorStats(out, proj_center_errors);
 }
 
+// Print the statistics of a reconstruction in the mapped format without
+// materializing its images and 3D points.
+void PrintMappedReconstructionStats(const std::string& path, bool verbose) {
+  const MappedReconstruction mapped(
+      JoinPaths(path, kMappedReconstructionFileName));
+
+  double sum_error = 0;
+  size_t num_errors = 0;
+  for (size_t i = 0; i < mapped.NumPoints3D(); ++i) {
+    const double error = mapped.Point3DRecordAt(i).error;
+    if (error != -1.0) {
+      sum_error += error;
+      num_errors += 1;
+    }
+  }
+
+  LOG(INFO) << StringPrintf("Cameras: %d", mapped.NumCameras());
+  LOG(INFO) << StringPrintf("Images: %d", mapped.NumImages());
+  LOG(INFO) << StringPrintf("Registered images: %d", mapped.NumImages());
+  LOG(INFO) << StringPrintf("Points: %d", mapped.NumPoints3D());
+  LOG(INFO) << StringPrintf("Observations: %d", mapped.NumObservations());
+  const double num_observations = mapped.NumObservations();
+  LOG(INFO) << StringPrintf(
+      "Mean track length: %f",
+      mapped.NumPoints3D() == 0 ? 0.0
+                                : num_observations / mapped.NumPoints3D());
+  LOG(INFO) << StringPrintf(
+      "Mean observations per image: %f",
+      mapped.NumImages() == 0 ? 0.0 : num_observations / mapped.NumImages());
+  LOG(INFO) << StringPrintf("Mean reprojection error: %fpx",
+                            num_errors == 0 ? 0.0 : sum_error / num_errors);
+
+  if (verbose) {
+    PrintHeading2("Cameras");
+    for (size_t i = 0; i < mapped.NumCameras(); ++i) {
+      const Camera camera = mapped.Camera(i);
+      LOG(INFO) << StringPrintf(" - Camera Id: %d, Model Name: %s, Params: %s",
+                                camera.camera_id,
+                                camera.ModelName().c_str(),
+                                camera.ParamsToString().c_str());
+    }
+
+    PrintHeading2("Images");
+    for (size_t i = 0; i < mapped.NumImages(); ++i) {
+      LOG(INFO) << StringPrintf(" - Registered Image Id: %d, Name: %s",
+                                mapped.ImageRecordAt(i).image_id,
+                                mapped.ImageName(i).c_str());
+    }
+  }
+}
+
 }  // namespace
 
 // Align given reconstruction with user provided cameras positions
@@ -418,45 +495,94 @@ int RunModelAligner(int argc, char** argv) {
 int RunModelAnalyzer(int argc, char** argv) {
   std::string path;
   bool verbose = false;
+  ReconstructionStatsOptions stats_options;
 
   OptionManager options;
   options.AddRequiredOption("path", &path);
   options.AddDefaultOption("verbose", &verbose);
+  options.AddDefaultOption("is_refractive", &stats_options.is_refractive);
+  options.AddDefaultOption("num_reproj_error_bins",
+                           &stats_options.num_reproj_error_bins);
+  options.AddDefaultOption("max_reproj_error",
+                           &stats_options.max_reproj_error);
+  options.AddDefaultOption("num_tri_angle_bins",
+                           &stats_options.num_tri_angle_bins);
+  options.AddDefaultOption("max_tri_angle", &stats_options.max_tri_angle);
+  options.AddDefaultOption("coverage_grid_size",
+                           &stats_options.coverage_grid_size);
+  options.AddDefaultOption("num_threads", &stats_options.num_threads);
   options.Parse(argc, argv);
 
+  // Models in the mapped format are analyzed without loading them.
+  if (IsMappedOnlyModel(path)) {
+    PrintMappedReconstructionStats(path, verbose);
+    return EXIT_SUCCESS;
+  }
+
   Reconstruction reconstruction;
   reconstruction.Read(path);
+  if (stats_options.is_refractive) {
+    reconstruction.UpdateRefracProjectionTables();
+    reconstruction.UpdateRefracVirtualCameraTables();
+  }
 
-  LOG(INFO) << StringPrintf("Cameras: %d", reconstruction.NumCameras());
-  LOG(INFO) << StringPrintf("Images: %d", reconstruction.NumImages());
-  LOG(INFO) << StringPrintf("Registered images: %d",
-                            reconstruction.NumRegImages());
-  LOG(INFO) << StringPrintf("Points: %d", reconstruction.NumPoints3D());
-  LOG(INFO) << StringPrintf("Observations: %d",
-                            reconstruction.ComputeNumObservations());
-  LOG(INFO) << StringPrintf("Mean track length: %f",
-                            reconstruction.ComputeMeanTrackLength());
-  LOG(INFO) << StringPrintf(
-      "Mean observations per image: %f",
-      reconstruction.ComputeMeanObservationsPerRegImage());
+  const ReconstructionStats stats =
+      ComputeReconstructionStats(stats_options, reconstruction);
+
+  LOG(INFO) << StringPrintf("Cameras: %d", stats.num_cameras);
+  LOG(INFO) << StringPrintf("Images: %d", stats.num_images);
+  LOG(INFO) << StringPrintf("Registered images: %d", stats.num_reg_images);
+  LOG(INFO) << StringPrintf("Points: %d", stats.num_points3D);
+  LOG(INFO) << StringPrintf("Observations: %d", stats.num_observations);
+  LOG(INFO) << StringPrintf("Mean track length: %f", stats.mean_track_length);
+  LOG(INFO) << StringPrintf("Mean observations per image: %f",
+                            stats.mean_observations_per_reg_image);
   LOG(INFO) << StringPrintf("Mean reprojection error: %fpx",
-                            reconstruction.ComputeMeanReprojectionError());
+                            stats.mean_reproj_error);
+  LOG(INFO) << StringPrintf("Mean observation reprojection error: %fpx",
+                            stats.observations.mean_reproj_error);
+  LOG(INFO) << StringPrintf("Observations behind camera: %d",
+                            stats.observations.num_behind_camera);
+  LOG(INFO) << StringPrintf("Median triangulation angle: %fdeg",
+                            stats.median_tri_angle);
+  LOG(INFO) << "Reprojection error histogram: "
+            << VectorToCSV(stats.observations.reproj_error_histogram);
+  LOG(INFO) << "Triangulation angle histogram: "
+            << VectorToCSV(stats.tri_angle_histogram);
+  LOG(INFO) << "Track length histogram: "
+            << VectorToCSV(stats.track_length_histogram);
 
   // verbose information
   if (verbose) {
     PrintHeading2("Cameras");
-    for (const auto& camera : reconstruction.Cameras()) {
+    for (const CameraStats& camera_stats : stats.cameras) {
+      const Camera& camera = reconstruction.Camera(camera_stats.camera_id);
       LOG(INFO) << StringPrintf(" - Camera Id: %d, Model Name: %s, Params: %s",
-                                camera.first,
-                                camera.second.ModelName().c_str(),
-                                camera.second.ParamsToString().c_str());
+                                camera.camera_id,
+                                camera.ModelName().c_str(),
+                                camera.ParamsToString().c_str());
+      LOG(INFO) << StringPrintf(
+          "   Registered images: %d, Observations: %d, Mean reprojection "
+          "error: %fpx, Histogram: %s",
+          camera_stats.num_reg_images,
+          camera_stats.num_observations,
+          camera_stats.mean_reproj_error,
+          VectorToCSV(camera_stats.reproj_error_histogram).c_str());
     }
 
     PrintHeading2("Images");
-    for (const auto& image_id : reconstruction.RegImageIds()) {
-      LOG(INFO) << StringPrintf(" - Registered Image Id: %d, Name: %s",
-                                image_id,
-                                reconstruction.Image(image_id).Name().c_str());
+    for (const ImageStats& image_stats : stats.images) {
+      LOG(INFO) << StringPrintf(
+          " - Registered Image Id: %d, Name: %s",
+          image_stats.image_id,
+          reconstruction.Image(image_stats.image_id).Name().c_str());
+      LOG(INFO) << StringPrintf(
+          "   Observations: %d, Mean reprojection error: %fpx, "
+          "Coverage: %.2f%%, Histogram: %s",
+          image_stats.num_observations,
+          image_stats.mean_reproj_error,
+          100.0 * image_stats.coverage,
+          VectorToCSV(image_stats.reproj_error_histogram).c_str());
     }
   }
 
@@ -583,9 +709,10 @@ int RunModelConverter(int argc, char** argv) {
   OptionManager options;
   options.AddRequiredOption("input_path", &input_path);
   options.AddRequiredOption("output_path", &output_path);
-  options.AddRequiredOption("output_type",
-                            &output_type,
-                            "{BIN, TXT, NVM, Bundler, VRML, PLY, R3D, CAM}");
+  options.AddRequiredOption(
+      "output_type",
+      &output_type,
+      "{BIN, TXT, MBIN, NVM, Bundler, VRML, PLY, R3D, CAM}");
   options.AddDefaultOption("skip_distortion", &skip_distortion);
   options.Parse(argc, argv);
 
@@ -597,6 +724,8 @@ int RunModelConverter(int argc, char** argv) {
     reconstruction.WriteBinary(output_path);
   } else if (output_type == "txt") {
     reconstruction.WriteText(output_path);
+  } else if (output_type == "mbin") {
+    reconstruction.WriteMapped(output_path);
   } else if (output_type == "nvm") {
     reconstruction.ExportNVM(output_path, skip_distortion);
   } else if (output_type == "bundler") {
@@ -657,8 +786,16 @@ int RunModelCropper(int argc, char** argv) {
     return EXIT_FAILURE;
   }
 
-  Reconstruction reconstruction;
-  reconstruction.Read(input_path);
+  // Mapped models are cropped in a streaming pass over their records.
+  std::unique_ptr<Reconstruction> reconstruction;
+  std::unique_ptr<MappedReconstruction> mapped_reconstruction;
+  if (IsMappedOnlyModel(input_path)) {
+    mapped_reconstruction = std::make_unique<MappedReconstruction>(
+        JoinPaths(input_path, kMappedReconstructionFileName));
+  } else {
+    reconstruction = std::make_unique<Reconstruction>();
+    reconstruction->Read(input_path);
+  }
 
   PrintHeading2("Calculating boundary coordinates");
   std::pair<Eigen::Vector3d, Eigen::Vector3d> bounding_box;
@@ -685,13 +822,22 @@ int RunModelCropper(int argc, char** argv) {
                : Eigen::Vector3d(boundary_elements[3],
                                  boundary_elements[4],
                                  boundary_elements[5]);
+  } else if (mapped_reconstruction) {
+    bounding_box = mapped_reconstruction->ComputeBoundingBox(
+        boundary_elements[0], boundary_elements[1]);
   } else {
-    bounding_box = reconstruction.ComputeBoundingBox(boundary_elements[0],
-                                                     boundary_elements[1]);
+    bounding_box = reconstruction->ComputeBoundingBox(boundary_elements[0],
+                                                      boundary_elements[1]);
   }
 
   PrintHeading2("Cropping reconstruction");
-  reconstruction.Crop(bounding_box).Write(output_path);
+  if (mapped_reconstruction) {
+    mapped_reconstruction->WriteCropBinary(
+        mapped_reconstruction->ComputeCrops({bounding_box}).front(),
+        output_path);
+  } else {
+    reconstruction->Crop(bounding_box).Write(output_path);
+  }
   WriteBoundingBox(output_path, bounding_box);
 
   LOG(INFO) << "=> Cropping succeeded";
@@ -743,24 +889,45 @@ int RunModelMerger(int argc, char** argv) {
 int RunModelOrientationAligner(int argc, char** argv) {
   std::string input_path;
   std::string output_path;
+  std::string image_path;
+  std::string database_path;
   std::string method = "MANHATTAN-WORLD";
 
   ManhattanWorldFrameEstimationOptions frame_estimation_options;
 
   OptionManager options;
-  options.AddImageOptions();
+  options.AddDefaultOption("image_path", &image_path);
+  options.AddDefaultOption("database_path", &database_path);
   options.AddRequiredOption("input_path", &input_path);
   options.AddRequiredOption("output_path", &output_path);
   options.AddDefaultOption(
-      "method", &method, "{MANHATTAN-WORLD, IMAGE-ORIENTATION}");
+      "method", &method, "{MANHATTAN-WORLD, IMAGE-ORIENTATION, POSE-PRIOR}");
   options.AddDefaultOption("max_image_size",
                            &frame_estimation_options.max_image_size);
+  options.AddDefaultOption("coarse_max_image_size",
+                           &frame_estimation_options.coarse_max_image_size);
+  options.AddDefaultOption("min_num_images",
+                           &frame_estimation_options.min_num_images);
+  options.AddDefaultOption("num_threads",
+                           &frame_estimation_options.num_threads);
   options.Parse(argc, argv);
 
   StringToLower(&method);
-  if (method != "manhattan-world" && method != "image-orientation") {
+  if (method != "manhattan-world" && method != "image-orientation" &&
+      method != "pose-prior") {
     LOG(ERROR) << "Invalid `method` - supported values are "
-                  "'MANHATTAN-WORLD' or 'IMAGE-ORIENTATION'.";
+                  "'MANHATTAN-WORLD', 'IMAGE-ORIENTATION', or 'POSE-PRIOR'.";
+    return EXIT_FAILURE;
+  }
+
+  if (method == "manhattan-world" && image_path.empty()) {
+    LOG(ERROR) << "The `MANHATTAN-WORLD` method requires the `image_path`.";
+    return EXIT_FAILURE;
+  }
+
+  if (method == "pose-prior" && database_path.empty()) {
+    LOG(ERROR) << "The `POSE-PRIOR` method requires the `database_path` with "
+                  "the pose priors of the images.";
     return EXIT_FAILURE;
   }
 
@@ -773,7 +940,7 @@ int RunModelOrientationAligner(int argc, char** argv) {
 
   if (method == "manhattan-world") {
     const Eigen::Matrix3d frame = EstimateManhattanWorldFrame(
-        frame_estimation_options, reconstruction, *options.image_path);
+        frame_estimation_options, reconstruction, image_path);
 
     if (frame.col(0).lpNorm<1>() == 0) {
       LOG(INFO) << "Only aligning vertical axis";
@@ -787,6 +954,15 @@ int RunModelOrientationAligner(int argc, char** argv) {
       new_from_old_world.rotation = Eigen::Quaterniond(frame.transpose());
       LOG(INFO) << "Aligning horizontal and vertical axes";
     }
+  } else if (method == "pose-prior") {
+    // The pose priors are not stored in the reconstruction.
+    ReadDatabasePosePriors(database_path, &reconstruction);
+    const Eigen::Matrix3d frame = EstimatePosePriorFrame(reconstruction);
+    if (frame.isZero()) {
+      LOG(ERROR) << "No registered image with a rotation prior";
+      return EXIT_FAILURE;
+    }
+    new_from_old_world.rotation = Eigen::Quaterniond(frame.transpose());
   } else if (method == "image-orientation") {
     const Eigen::Vector3d gravity_axis =
         EstimateGravityVectorFromImageOrientation(reconstruction);
@@ -855,8 +1031,20 @@ int RunModelSplitter(int argc, char** argv) {
   PrintHeading1("Splitting sparse model");
   LOG(INFO) << StringPrintf("=> Using \"%s\" split type", split_type.c_str());
 
-  Reconstruction reconstruction;
-  reconstruction.Read(input_path);
+  // Mapped models are split in a single streaming pass over their records.
+  std::unique_ptr<Reconstruction> reconstruction;
+  std::unique_ptr<MappedReconstruction> mapped_reconstruction;
+  if (IsMappedOnlyModel(input_path)) {
+    mapped_reconstruction = std::make_unique<MappedReconstruction>(
+        JoinPaths(input_path, kMappedReconstructionFileName));
+  } else {
+    reconstruction = std::make_unique<Reconstruction>();
+    reconstruction->Read(input_path);
+  }
+
+  const auto bbox = mapped_reconstruction
+                        ? mapped_reconstruction->ComputeBoundingBox()
+                        : reconstruction->ComputeBoundingBox();
 
   Sim3d tform;
   if (!gps_transform_path.empty()) {
@@ -901,14 +1089,13 @@ int RunModelSplitter(int argc, char** argv) {
       extent(i) = parts[i] * tform.scale;
     }
 
-    const auto bbox = reconstruction.ComputeBoundingBox();
     const Eigen::Vector3d full_extent = bbox.second - bbox.first;
     const Eigen::Vector3i split(
         static_cast<int>(full_extent(0) / extent(0)) + 1,
         static_cast<int>(full_extent(1) / extent(1)) + 1,
         static_cast<int>(full_extent(2) / extent(2)) + 1);
 
-    exact_bounds = ComputeEqualPartsBounds(reconstruction, split);
+    exact_bounds = ComputeEqualPartsBounds(bbox, split);
 
   } else if (split_type == "parts") {
     auto parts = CSVToVector<int>(split_params);
@@ -920,17 +1107,18 @@ int RunModelSplitter(int argc, char** argv) {
         return EXIT_FAILURE;
       }
     }
-    exact_bounds = ComputeEqualPartsBounds(reconstruction, split);
+    exact_bounds = ComputeEqualPartsBounds(bbox, split);
   } else {
     LOG(ERROR) << "Invalid split type: " << split_type;
     return EXIT_FAILURE;
   }
 
   std::vector<std::pair<Eigen::Vector3d, Eigen::Vector3d>> bounds;
-  for (const auto& bbox : exact_bounds) {
+  for (const auto& exact_bbox : exact_bounds) {
     const Eigen::Vector3d padding =
-        (overlap_ratio * (bbox.second - bbox.first));
-    bounds.emplace_back(bbox.first - padding, bbox.second + padding);
+        (overlap_ratio * (exact_bbox.second - exact_bbox.first));
+    bounds.emplace_back(exact_bbox.first - padding,
+                        exact_bbox.second + padding);
   }
 
   PrintHeading2("Applying split and writing reconstructions");
@@ -939,33 +1127,53 @@ int RunModelSplitter(int argc, char** argv) {
 
   const bool use_tile_keys = split_type == "tiles";
 
+  std::vector<MappedReconstruction::Crop> mapped_crops;
+  if (mapped_reconstruction) {
+    mapped_crops = mapped_reconstruction->ComputeCrops(bounds, num_threads);
+  }
+
   auto SplitReconstruction = [&](const int idx) {
-    Reconstruction tile_recon = reconstruction.Crop(bounds[idx]);
+    Reconstruction tile_recon;
+    std::pair<Eigen::Vector3d, Eigen::Vector3d> model_bbox;
+    int tile_num_points;
+    int tile_num_reg_images;
+    if (mapped_reconstruction) {
+      model_bbox = mapped_crops[idx].bbox;
+      tile_num_points = mapped_crops[idx].point3D_idxs.size();
+      tile_num_reg_images = mapped_crops[idx].image_idxs.size();
+    } else {
+      tile_recon = reconstruction->Crop(bounds[idx]);
+      model_bbox = tile_recon.ComputeBoundingBox();
+      tile_num_points = tile_recon.NumPoints3D();
+      tile_num_reg_images = tile_recon.NumRegImages();
+    }
     // calculate area covered by model as proportion of box area
     auto bbox_extent = bounds[idx].second - bounds[idx].first;
-    auto model_bbox = tile_recon.ComputeBoundingBox();
     auto model_extent = model_bbox.second - model_bbox.first;
     double area_ratio =
         (model_extent(0) * model_extent(1)) / (bbox_extent(0) * bbox_extent(1));
-    int tile_num_points = tile_recon.NumPoints3D();
 
     std::string name = use_tile_keys ? tile_keys[idx] : std::to_string(idx);
-    const bool include_tile =
-        area_ratio >= min_area_ratio &&       //
-        tile_num_points >= min_num_points &&  //
-        tile_recon.NumRegImages() >= static_cast<size_t>(min_reg_images);
+    const bool include_tile = area_ratio >= min_area_ratio &&       //
+                              tile_num_points >= min_num_points &&  //
+                              tile_num_reg_images >= min_reg_images;
 
     if (include_tile) {
       LOG(INFO) << StringPrintf(
           "Writing reconstruction %s with %d images, %d points, "
           "and %.2f%% area coverage",
           name.c_str(),
-          tile_recon.NumRegImages(),
+          tile_num_reg_images,
           tile_num_points,
           100.0 * area_ratio);
       const std::string reconstruction_path = JoinPaths(output_path, name);
       CreateDirIfNotExists(reconstruction_path);
-      tile_recon.Write(reconstruction_path);
+      if (mapped_reconstruction) {
+        mapped_reconstruction->WriteCropBinary(mapped_crops[idx],
+                                               reconstruction_path);
+      } else {
+        tile_recon.Write(reconstruction_path);
+      }
       WriteBoundingBox(reconstruction_path, bounds[idx]);
       WriteBoundingBox(reconstruction_path, exact_bounds[idx], "_exact");
 
@@ -974,10 +1182,14 @@ int RunModelSplitter(int argc, char** argv) {
           "Skipping reconstruction %s with %d images, %d points, "
           "and %.2f%% area coverage",
           name.c_str(),
-          tile_recon.NumRegImages(),
+          tile_num_reg_images,
           tile_num_points,
           100.0 * area_ratio);
     }
+
+    if (mapped_reconstruction) {
+      mapped_crops[idx] = MappedReconstruction::Crop();
+    }
   };
 
   ThreadPool thread_pool(GetEffectiveNumThreads(num_threads));
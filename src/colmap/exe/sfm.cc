@@ -31,6 +31,7 @@
 
 #include "colmap/controllers/automatic_reconstruction.h"
 #include "colmap/controllers/bundle_adjustment.h"
+#include "colmap/controllers/global_mapper.h"
 #include "colmap/controllers/hierarchical_mapper.h"
 #include "colmap/controllers/hybrid_mapper.h"
 #include "colmap/controllers/option_manager.h"
@@ -40,9 +41,6 @@
 #include "colmap/util/misc.h"
 #include "colmap/util/opengl_utils.h"
 
-#include <boost/property_tree/json_parser.hpp>
-#include <boost/property_tree/ptree.hpp>
-
 namespace colmap {
 
 int RunAutomaticReconstructor(int argc, char** argv) {
@@ -293,6 +291,57 @@ int RunMapper(int argc, char** argv) {
   return EXIT_SUCCESS;
 }
 
+int RunGlobalMapper(int argc, char** argv) {
+  GlobalMapperController::Options mapper_options;
+  std::string output_path;
+
+  OptionManager options;
+  options.AddDatabaseOptions();
+  options.AddImageOptions();
+  options.AddRequiredOption("output_path", &output_path);
+  options.AddDefaultOption("min_num_inliers",
+                           &mapper_options.global_options.min_num_inliers);
+  options.AddDefaultOption("min_tri_angle",
+                           &mapper_options.global_options.min_tri_angle);
+  options.AddDefaultOption("rotation_loss_scale",
+                           &mapper_options.global_options.rotation_loss_scale);
+  options.AddDefaultOption("max_rotation_error",
+                           &mapper_options.global_options.max_rotation_error);
+  options.AddDefaultOption(
+      "translation_loss_scale",
+      &mapper_options.global_options.translation_loss_scale);
+  options.AddDefaultOption("prior_position_std",
+                           &mapper_options.global_options.prior_position_std);
+  options.AddDefaultOption("max_num_iterations",
+                           &mapper_options.global_options.max_num_iterations);
+  options.AddMapperOptions();
+  options.Parse(argc, argv);
+
+  if (!ExistsDir(output_path)) {
+    LOG(ERROR) << "`output_path` is not a directory.";
+    return EXIT_FAILURE;
+  }
+
+  mapper_options.incremental_options = *options.mapper;
+  mapper_options.image_path = *options.image_path;
+  mapper_options.database_path = *options.database_path;
+
+  auto reconstruction_manager = std::make_shared<ReconstructionManager>();
+  GlobalMapperController global_mapper(mapper_options, reconstruction_manager);
+  global_mapper.Start();
+  global_mapper.Wait();
+
+  if (reconstruction_manager->Size() == 0) {
+    LOG(ERROR) << "failed to create sparse model";
+    return EXIT_FAILURE;
+  }
+
+  reconstruction_manager->Write(output_path);
+  options.Write(JoinPaths(output_path, "project.ini"));
+
+  return EXIT_SUCCESS;
+}
+
 int RunHierarchicalMapper(int argc, char** argv) {
   HierarchicalMapperController::Options mapper_options;
   std::string output_path;
@@ -307,6 +356,9 @@ int RunHierarchicalMapper(int argc, char** argv) {
   options.AddDefaultOption(
       "leaf_max_num_images",
       &mapper_options.clustering_options.leaf_max_num_images);
+  options.AddDefaultOption(
+      "use_kway_partition",
+      &mapper_options.clustering_options.use_kway_partition);
   options.AddMapperOptions();
   options.Parse(argc, argv);
 
@@ -375,6 +427,7 @@ int RunPointTriangulator(int argc, char** argv) {
   std::string output_path;
   bool clear_points = true;
   bool refine_intrinsics = false;
+  bool parallel = false;
 
   OptionManager options;
   options.AddDatabaseOptions();
@@ -391,6 +444,11 @@ int RunPointTriangulator(int argc, char** argv) {
                            &refine_intrinsics,
                            "Whether to refine the intrinsics of the cameras "
                            "(fixing the principal point)");
+  options.AddDefaultOption(
+      "parallel",
+      &parallel,
+      "Whether to triangulate all images in parallel and to refine the points "
+      "independently with fixed cameras instead of a global bundle adjustment");
   options.AddMapperOptions();
   options.Parse(argc, argv);
 
@@ -415,7 +473,8 @@ int RunPointTriangulator(int argc, char** argv) {
                                   output_path,
                                   *options.mapper,
                                   clear_points,
-                                  refine_intrinsics);
+                                  refine_intrinsics,
+                                  parallel);
 }
 
 int RunPointTriangulatorImpl(
@@ -425,25 +484,27 @@ int RunPointTriangulatorImpl(
     const std::string& output_path,
     const IncrementalMapperOptions& mapper_options,
     const bool clear_points,
-    const bool refine_intrinsics) {
+    const bool refine_intrinsics,
+    const bool parallel) {
   PrintHeading1("Loading database");
 
-  std::shared_ptr<DatabaseCache> database_cache;
+  std::shared_ptr<const DatabaseCache> database_cache;
 
   {
     Timer timer;
     timer.Start();
-    const Database database(database_path);
     const size_t min_num_matches =
         static_cast<size_t>(mapper_options.min_num_matches);
-    database_cache = DatabaseCache::Create(database,
-                                           min_num_matches,
-                                           mapper_options.ignore_watermarks,
-                                           mapper_options.image_names);
+    database_cache =
+        DatabaseCache::CreateOrRetain(database_path,
+                                      min_num_matches,
+                                      mapper_options.ignore_watermarks,
+                                      mapper_options.image_names,
+                                      mapper_options.database_cache_path);
 
     if (clear_points) {
       reconstruction->DeleteAllPoints2DAndPoints3D();
-      reconstruction->TranscribeImageIdsToDatabase(database);
+      reconstruction->TranscribeImageIdsToDatabase(Database(database_path));
     }
 
     timer.PrintMinutes();
@@ -463,21 +524,29 @@ int RunPointTriangulatorImpl(
 
   const std::vector<image_t>& reg_image_ids = reconstruction->RegImageIds();
 
-  for (size_t i = 0; i < reg_image_ids.size(); ++i) {
-    const image_t image_id = reg_image_ids[i];
-    const auto& image = reconstruction->Image(image_id);
+  if (parallel) {
+    PrintHeading1(
+        StringPrintf("Triangulating %d images", reg_image_ids.size()));
+    const size_t num_tris =
+        mapper.TriangulateImages(tri_options, reg_image_ids);
+    LOG(INFO) << "=> Triangulated observations: " << num_tris;
+  } else {
+    for (size_t i = 0; i < reg_image_ids.size(); ++i) {
+      const image_t image_id = reg_image_ids[i];
+      const auto& image = reconstruction->Image(image_id);
 
-    PrintHeading1(StringPrintf("Triangulating image #%d (%d)", image_id, i));
+      PrintHeading1(StringPrintf("Triangulating image #%d (%d)", image_id, i));
 
-    const size_t num_existing_points3D = image.NumPoints3D();
+      const size_t num_existing_points3D = image.NumPoints3D();
 
-    LOG(INFO) << "=> Image sees " << num_existing_points3D << " / "
-              << image.NumObservations() << " points";
+      LOG(INFO) << "=> Image sees " << num_existing_points3D << " / "
+                << image.NumObservations() << " points";
 
-    mapper.TriangulateImage(tri_options, image_id);
+      mapper.TriangulateImage(tri_options, image_id);
 
-    LOG(INFO) << "=> Triangulated "
-              << (image.NumPoints3D() - num_existing_points3D) << " points";
+      LOG(INFO) << "=> Triangulated "
+                << (image.NumPoints3D() - num_existing_points3D) << " points";
+    }
   }
 
   //////////////////////////////////////////////////////////////////////////////
@@ -492,6 +561,10 @@ int RunPointTriangulatorImpl(
   // Bundle adjustment
   //////////////////////////////////////////////////////////////////////////////
 
+  // With fixed poses and intrinsics, the points are independent of each other
+  // and are refined individually in parallel.
+  const bool adjust_points_only = parallel && !refine_intrinsics;
+
   auto ba_options = mapper_options.GlobalBundleAdjustment();
   ba_options.refine_focal_length = refine_intrinsics;
   ba_options.refine_principal_point = false;
@@ -510,9 +583,21 @@ int RunPointTriangulatorImpl(
 
     const size_t num_observations = reconstruction->ComputeNumObservations();
 
-    PrintHeading1("Bundle adjustment");
-    BundleAdjuster bundle_adjuster(ba_options, ba_config);
-    CHECK(bundle_adjuster.Solve(reconstruction.get()));
+    if (adjust_points_only) {
+      PrintHeading1("Point refinement");
+      const std::unordered_set<point3D_t> point3D_ids =
+          reconstruction->Point3DIds();
+      const size_t num_adjusted_points = AdjustPoints3D(
+          ba_options,
+          std::vector<point3D_t>(point3D_ids.begin(), point3D_ids.end()),
+          mapper_options.num_threads,
+          reconstruction.get());
+      LOG(INFO) << "=> Refined points: " << num_adjusted_points;
+    } else {
+      PrintHeading1("Bundle adjustment");
+      BundleAdjuster bundle_adjuster(ba_options, ba_config);
+      CHECK(bundle_adjuster.Solve(reconstruction.get()));
+    }
 
     size_t num_changed_observations = 0;
     num_changed_observations += CompleteAndMergeTracks(mapper_options, &mapper);
@@ -526,7 +611,8 @@ int RunPointTriangulatorImpl(
   }
 
   PrintHeading1("Extracting colors");
-  reconstruction->ExtractColorsForAllImages(image_path);
+  reconstruction->ExtractColorsForAllImages(image_path,
+                                            mapper_options.num_threads);
 
   mapper.EndReconstruction(/*discard=*/false);
 
@@ -537,160 +623,29 @@ int RunPointTriangulatorImpl(
 
 namespace {
 
-// Read the configuration of the camera rigs from a JSON file. The input images
-// of a camera rig must be named consistently to assign them to the appropriate
-// camera rig and the respective snapshots.
-//
-// An example configuration of a single camera rig:
-// [
-//   {
-//     "ref_camera_id": 1,
-//     "cameras":
-//     [
-//       {
-//           "camera_id": 1,
-//           "image_prefix": "left1_image"
-//           "cam_from_rig_rotation": [1, 0, 0, 0],
-//           "cam_from_rig_translation": [0, 0, 0]
-//       },
-//       {
-//           "camera_id": 2,
-//           "image_prefix": "left2_image"
-//           "cam_from_rig_rotation": [1, 0, 0, 0],
-//           "cam_from_rig_translation": [0, 0, 1]
-//       },
-//       {
-//           "camera_id": 3,
-//           "image_prefix": "right1_image"
-//           "cam_from_rig_rotation": [1, 0, 0, 0],
-//           "cam_from_rig_translation": [0, 0, 2]
-//       },
-//       {
-//           "camera_id": 4,
-//           "image_prefix": "right2_image"
-//           "cam_from_rig_rotation": [1, 0, 0, 0],
-//           "cam_from_rig_translation": [0, 0, 3]
-//       }
-//     ]
-//   }
-// ]
-//
-// The "camera_id" and "image_prefix" fields are required, whereas the
-// "cam_from_rig_rotation" and "cam_from_rig_translation" fields optionally
-// specify the relative extrinsics of the camera rig in the form of a
-// translation vector and a rotation quaternion (w, x, y, z). If the relative
+// Read the configuration of the camera rigs for the registered images of the
+// reconstruction. Only snapshots with the reference image registered will be
+// added to the bundle adjustment problem. The remaining images will be added
+// with independent poses to the bundle adjustment problem. If the relative
 // extrinsics are not provided then they are automatically inferred from the
 // reconstruction.
-//
-// This file specifies the configuration for a single camera rig and that you
-// could potentially define multiple camera rigs. The rig is composed of 4
-// cameras: all images of the first camera must have "left1_image" as a name
-// prefix, e.g., "left1_image_frame000.png" or "left1_image/frame000.png".
-// Images with the same suffix ("_frame000.png" and "/frame000.png") are
-// assigned to the same snapshot, i.e., they are assumed to be captured at the
-// same time. Only snapshots with the reference image registered will be added
-// to the bundle adjustment problem. The remaining images will be added with
-// independent poses to the bundle adjustment problem. The above configuration
-// could have the following input image file structure:
-//
-//    /path/to/images/...
-//        left1_image/...
-//            frame000.png
-//            frame001.png
-//            frame002.png
-//            ...
-//        left2_image/...
-//            frame000.png
-//            frame001.png
-//            frame002.png
-//            ...
-//        right1_image/...
-//            frame000.png
-//            frame001.png
-//            frame002.png
-//            ...
-//        right2_image/...
-//            frame000.png
-//            frame001.png
-//            frame002.png
-//            ...
-//
 std::vector<CameraRig> ReadCameraRigConfig(const std::string& rig_config_path,
                                            const Reconstruction& reconstruction,
                                            bool estimate_rig_relative_poses) {
-  boost::property_tree::ptree pt;
-  boost::property_tree::read_json(rig_config_path.c_str(), pt);
-
-  std::vector<CameraRig> camera_rigs;
-  for (const auto& rig_config : pt) {
-    CameraRig camera_rig;
-
-    std::vector<std::string> image_prefixes;
-    for (const auto& camera : rig_config.second.get_child("cameras")) {
-      const int camera_id = camera.second.get<int>("camera_id");
-      image_prefixes.push_back(camera.second.get<std::string>("image_prefix"));
-
-      Rigid3d cam_from_rig;
-
-      auto cam_from_rig_rotation_node =
-          camera.second.get_child_optional("cam_from_rig_rotation");
-      if (cam_from_rig_rotation_node) {
-        int index = 0;
-        Eigen::Vector4d cam_from_rig_wxyz;
-        for (const auto& node : cam_from_rig_rotation_node.get()) {
-          cam_from_rig_wxyz[index++] = node.second.get_value<double>();
-        }
-        cam_from_rig.rotation = Eigen::Quaterniond(cam_from_rig_wxyz(0),
-                                                   cam_from_rig_wxyz(1),
-                                                   cam_from_rig_wxyz(2),
-                                                   cam_from_rig_wxyz(3));
-      } else {
-        estimate_rig_relative_poses = true;
-      }
-
-      auto cam_from_rig_translation_node =
-          camera.second.get_child_optional("cam_from_rig_translation");
-      if (cam_from_rig_translation_node) {
-        int index = 0;
-        for (const auto& node : cam_from_rig_translation_node.get()) {
-          cam_from_rig.translation(index++) = node.second.get_value<double>();
-        }
-      } else {
-        estimate_rig_relative_poses = true;
-      }
-
-      camera_rig.AddCamera(camera_id, cam_from_rig);
-    }
-
-    camera_rig.SetRefCameraId(rig_config.second.get<int>("ref_camera_id"));
-
-    std::unordered_map<std::string, std::vector<image_t>> snapshots;
-    for (const auto image_id : reconstruction.RegImageIds()) {
-      const auto& image = reconstruction.Image(image_id);
-      for (const auto& image_prefix : image_prefixes) {
-        if (StringContains(image.Name(), image_prefix)) {
-          const std::string image_suffix =
-              StringGetAfter(image.Name(), image_prefix);
-          snapshots[image_suffix].push_back(image_id);
-        }
-      }
-    }
-
-    for (const auto& snapshot : snapshots) {
-      bool has_ref_camera = false;
-      for (const auto image_id : snapshot.second) {
-        const auto& image = reconstruction.Image(image_id);
-        if (image.CameraId() == camera_rig.RefCameraId()) {
-          has_ref_camera = true;
-          break;
-        }
-      }
+  std::vector<Image> reg_images;
+  reg_images.reserve(reconstruction.NumRegImages());
+  for (const auto image_id : reconstruction.RegImageIds()) {
+    reg_images.push_back(reconstruction.Image(image_id));
+  }
 
-      if (has_ref_camera) {
-        camera_rig.AddSnapshot(snapshot.second);
-      }
-    }
+  bool has_cams_from_rigs = true;
+  std::vector<CameraRig> camera_rigs = colmap::ReadCameraRigConfig(
+      rig_config_path, reg_images, &has_cams_from_rigs);
+  if (!has_cams_from_rigs) {
+    estimate_rig_relative_poses = true;
+  }
 
+  for (auto& camera_rig : camera_rigs) {
     camera_rig.Check(reconstruction);
     if (estimate_rig_relative_poses) {
       PrintHeading2("Estimating relative rig poses");
@@ -700,8 +655,6 @@ std::vector<CameraRig> ReadCameraRigConfig(const std::string& rig_config_path,
         return std::vector<CameraRig>();
       }
     }
-
-    camera_rigs.push_back(camera_rig);
   }
 
   return camera_rigs;
@@ -774,20 +727,40 @@ int RunHybridMapper(int argc, char** argv) {
   options.AddDefaultOption(
       "leaf_max_num_images",
       &mapper_options.clustering_options.leaf_max_num_images);
+  options.AddDefaultOption(
+      "use_kway_partition",
+      &mapper_options.clustering_options.use_kway_partition);
+  options.AddDefaultOption(
+      "use_pose_priors", &mapper_options.clustering_options.use_pose_priors);
+  options.AddDefaultOption(
+      "prior_altitude", &mapper_options.clustering_options.prior_altitude);
   options.AddDefaultOption("num_workers", &mapper_options.num_workers);
+  options.AddDefaultOption("max_memory_usage_mb",
+                           &mapper_options.max_memory_usage_mb);
   options.AddDefaultOption("max_num_weak_area_revisit",
                            &mapper_options.max_num_weak_area_revisit);
   options.AddDefaultOption("re_max_num_images",
                            &mapper_options.re_max_num_images);
   options.AddDefaultOption("re_max_distance", &mapper_options.re_max_distance);
+  options.AddDefaultOption("re_max_overlap_ratio",
+                           &mapper_options.re_max_overlap_ratio);
+  options.AddDefaultOption("re_reuse_poses", &mapper_options.re_reuse_poses);
   options.AddDefaultOption("pgo_rel_pose_multi",
                            &mapper_options.pgo_rel_pose_multi);
+  options.AddDefaultOption("pgo_use_pose_covariance",
+                           &mapper_options.pgo_use_pose_covariance);
   options.AddDefaultOption("pgo_abs_pose_multi",
                            &mapper_options.pgo_abs_pose_multi);
   options.AddDefaultOption("pgo_smooth_multi",
                            &mapper_options.pgo_smooth_multi);
+  options.AddDefaultOption("pgo_linear_solver_type",
+                           &mapper_options.pgo_linear_solver_type);
+  options.AddDefaultOption("pgo_use_analytic_jacobians",
+                           &mapper_options.pgo_use_analytic_jacobians);
   options.AddDefaultOption("show_pgo_result", &mapper_options.show_pgo_result);
   options.AddDefaultOption("show_clusters", &mapper_options.show_clusters);
+  options.AddDefaultOption("checkpoint_path", &mapper_options.checkpoint_path);
+  options.AddDefaultOption("resume", &mapper_options.resume);
   options.AddMapperOptions();
   options.Parse(argc, argv);
 
@@ -41,11 +41,13 @@ int RunPointTriangulatorImpl(
     const std::string& output_path,
     const IncrementalMapperOptions& mapper_options,
     bool clear_points,
-    bool refine_intrinsics);
+    bool refine_intrinsics,
+    bool parallel = false);
 
 int RunAutomaticReconstructor(int argc, char** argv);
 int RunBundleAdjuster(int argc, char** argv);
 int RunColorExtractor(int argc, char** argv);
+int RunGlobalMapper(int argc, char** argv);
 int RunMapper(int argc, char** argv);
 int RunHierarchicalMapper(int argc, char** argv);
 int RunPointFiltering(int argc, char** argv);
@@ -120,6 +120,7 @@ int RunVocabTreeBuilder(int argc, char** argv) {
   std::string vocab_tree_path;
   retrieval::VisualIndex<>::BuildOptions build_options;
   int max_num_images = -1;
+  bool mapped_format = false;
 
   OptionManager options;
   options.AddDatabaseOptions();
@@ -129,6 +130,9 @@ int RunVocabTreeBuilder(int argc, char** argv) {
   options.AddDefaultOption("branching", &build_options.branching);
   options.AddDefaultOption("num_iterations", &build_options.num_iterations);
   options.AddDefaultOption("max_num_images", &max_num_images);
+  options.AddDefaultOption("use_gpu", &build_options.use_gpu);
+  options.AddDefaultOption("gpu_index", &build_options.gpu_index);
+  options.AddDefaultOption("mapped_format", &mapped_format);
   options.Parse(argc, argv);
 
   LOG(INFO) << "Loading descriptors...";
@@ -146,7 +150,11 @@ int RunVocabTreeBuilder(int argc, char** argv) {
             << visual_index.NumVisualWords() << " visual words";
 
   LOG(INFO) << "Saving index to file...";
-  visual_index.Write(vocab_tree_path);
+  if (mapped_format) {
+    visual_index.WriteMapped(vocab_tree_path);
+  } else {
+    visual_index.Write(vocab_tree_path);
+  }
 
   return EXIT_SUCCESS;
 }
@@ -158,6 +166,7 @@ int RunVocabTreeRetriever(int argc, char** argv) {
   std::string output_index_path;
   retrieval::VisualIndex<>::QueryOptions query_options;
   int max_num_features = -1;
+  bool mapped_format = false;
 
   OptionManager options;
   options.AddDatabaseOptions();
@@ -172,8 +181,15 @@ int RunVocabTreeRetriever(int argc, char** argv) {
   options.AddDefaultOption("num_images_after_verification",
                            &query_options.num_images_after_verification);
   options.AddDefaultOption("max_num_features", &max_num_features);
+  options.AddDefaultOption("use_gpu", &query_options.use_gpu);
+  options.AddDefaultOption("gpu_index", &query_options.gpu_index);
+  options.AddDefaultOption("mapped_format", &mapped_format);
   options.Parse(argc, argv);
 
+  retrieval::VisualIndex<>::IndexOptions index_options;
+  index_options.use_gpu = query_options.use_gpu;
+  index_options.gpu_index = query_options.gpu_index;
+
   retrieval::VisualIndex<> visual_index;
   visual_index.Read(vocab_tree_path);
 
@@ -208,7 +224,7 @@ int RunVocabTreeRetriever(int argc, char** argv) {
       ExtractTopScaleFeatures(&keypoints, &descriptors, max_num_features);
     }
 
-    visual_index.Add(retrieval::VisualIndex<>::IndexOptions(),
+    visual_index.Add(index_options,
                      database_images[i].ImageId(),
                      keypoints,
                      descriptors);
@@ -222,7 +238,11 @@ int RunVocabTreeRetriever(int argc, char** argv) {
   // Optionally save the indexing data for the database images (as well as the
   // original vocabulary tree data) to speed up future indexing.
   if (!output_index_path.empty()) {
-    visual_index.Write(output_index_path);
+    if (mapped_format) {
+      visual_index.WriteMapped(output_index_path);
+    } else {
+      visual_index.Write(output_index_path);
+    }
   }
 
   if (query_images.empty()) {
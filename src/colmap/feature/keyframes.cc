@@ -0,0 +1,127 @@
+#include "colmap/feature/keyframes.h"
+
+#include "colmap/feature/utils.h"
+#include "colmap/util/logging.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+namespace colmap {
+
+bool KeyframeSelectionOptions::Check() const {
+  CHECK_OPTION_GT(max_num_features, 0);
+  CHECK_OPTION_GT(max_ratio, 0);
+  CHECK_OPTION_LE(max_ratio, 1);
+  CHECK_OPTION_GE(min_overlap, 0);
+  CHECK_OPTION_LE(min_overlap, 1);
+  CHECK_OPTION_GT(max_flow, 0);
+  CHECK_OPTION_GE(max_num_skipped_frames, 0);
+  return true;
+}
+
+KeyframeSelector::KeyframeSelector(const KeyframeSelectionOptions& options)
+    : options_(options) {
+  CHECK(options_.Check());
+}
+
+bool KeyframeSelector::Next(const FeatureKeypoints& keypoints,
+                            const FeatureDescriptors& descriptors,
+                            const int width,
+                            const int height) {
+  CHECK_EQ(keypoints.size(), descriptors.rows());
+
+  FeatureKeypoints top_keypoints = keypoints;
+  FeatureDescriptors top_descriptors = descriptors;
+  ExtractTopScaleFeatures(
+      &top_keypoints, &top_descriptors, options_.max_num_features);
+  FeatureDescriptorsFloat top_descriptors_float =
+      top_descriptors.cast<float>();
+
+  last_overlap_ = 0;
+  last_flow_ = 0;
+  if (has_keyframe_ && keyframe_descriptors_.rows() > 0 &&
+      top_descriptors_float.rows() > 0) {
+    // Squared distances of all pairs of features as |x|^2 + |y|^2 - 2 x^T y.
+    Eigen::MatrixXf dists =
+        -2 * top_descriptors_float * keyframe_descriptors_.transpose();
+    dists.colwise() += top_descriptors_float.rowwise().squaredNorm();
+    dists.rowwise() +=
+        keyframe_descriptors_.rowwise().squaredNorm().transpose();
+
+    std::vector<Eigen::Index> keyframe_best_idxs(dists.cols());
+    for (Eigen::Index j = 0; j < dists.cols(); ++j) {
+      dists.col(j).minCoeff(&keyframe_best_idxs[j]);
+    }
+
+    const double squared_max_ratio = options_.max_ratio * options_.max_ratio;
+    std::vector<double> flows;
+    flows.reserve(dists.rows());
+    for (Eigen::Index i = 0; i < dists.rows(); ++i) {
+      Eigen::Index best_idx = -1;
+      float best_dist = std::numeric_limits<float>::max();
+      float second_best_dist = std::numeric_limits<float>::max();
+      for (Eigen::Index j = 0; j < dists.cols(); ++j) {
+        const float dist = std::max(dists(i, j), 0.0f);
+        if (dist < best_dist) {
+          second_best_dist = best_dist;
+          best_dist = dist;
+          best_idx = j;
+        } else if (dist < second_best_dist) {
+          second_best_dist = dist;
+        }
+      }
+
+      if (best_dist >= squared_max_ratio * second_best_dist ||
+          keyframe_best_idxs[best_idx] != i) {
+        continue;
+      }
+
+      const FeatureKeypoint& keypoint = top_keypoints[i];
+      const FeatureKeypoint& keyframe_keypoint = keyframe_keypoints_[best_idx];
+      flows.push_back(std::hypot(keypoint.x - keyframe_keypoint.x,
+                                 keypoint.y - keyframe_keypoint.y));
+    }
+
+    last_overlap_ =
+        static_cast<double>(flows.size()) / keyframe_descriptors_.rows();
+    if (!flows.empty()) {
+      std::nth_element(
+          flows.begin(), flows.begin() + flows.size() / 2, flows.end());
+      last_flow_ = flows[flows.size() / 2] / std::hypot(width, height);
+    }
+  }
+
+  const bool is_keyframe = !has_keyframe_ ||
+                           last_overlap_ < options_.min_overlap ||
+                           last_flow_ > options_.max_flow ||
+                           (options_.max_num_skipped_frames > 0 &&
+                            num_skipped_frames_ >=
+                                options_.max_num_skipped_frames);
+  if (is_keyframe) {
+    has_keyframe_ = true;
+    num_skipped_frames_ = 0;
+    keyframe_keypoints_ = std::move(top_keypoints);
+    keyframe_descriptors_ = std::move(top_descriptors_float);
+  } else {
+    num_skipped_frames_ += 1;
+  }
+
+  return is_keyframe;
+}
+
+void KeyframeSelector::Reset() {
+  has_keyframe_ = false;
+  num_skipped_frames_ = 0;
+  last_overlap_ = 0;
+  last_flow_ = 0;
+  keyframe_keypoints_.clear();
+  keyframe_descriptors_.resize(0, 0);
+}
+
+double KeyframeSelector::LastOverlap() const { return last_overlap_; }
+
+double KeyframeSelector::LastFlow() const { return last_flow_; }
+
+}  // namespace colmap
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "colmap/feature/types.h"
+
+namespace colmap {
+
+struct KeyframeSelectionOptions {
+  // The number of largest-scale features of every frame, which are matched
+  // against the features of the last keyframe.
+  int max_num_features = 512;
+
+  // The maximum distance ratio between the first and second best match.
+  double max_ratio = 0.8;
+
+  // A frame becomes a new keyframe, if the fraction of the features of the
+  // last keyframe, which are matched in the frame, drops below this value.
+  double min_overlap = 0.5;
+
+  // A frame becomes a new keyframe, if the median displacement of its matched
+  // features relative to the last keyframe exceeds this fraction of the image
+  // diagonal.
+  double max_flow = 0.05;
+
+  // The maximum number of consecutive non-keyframes, after which the next
+  // frame is selected as keyframe regardless of its overlap. Set to 0 to not
+  // limit the number of non-keyframes.
+  int max_num_skipped_frames = 30;
+
+  bool Check() const;
+};
+
+// Select the keyframes of a sequence of video frames, whose consecutive frames
+// are mostly redundant. Every frame is matched against the last keyframe by
+// mutual nearest neighbor matching of their largest-scale features, and
+// becomes a new keyframe once either the feature overlap drops too low or the
+// optical flow of the matched features grows too large.
+class KeyframeSelector {
+ public:
+  explicit KeyframeSelector(const KeyframeSelectionOptions& options);
+
+  // Whether the next frame of the sequence is a keyframe. The first frame is
+  // always a keyframe.
+  bool Next(const FeatureKeypoints& keypoints,
+            const FeatureDescriptors& descriptors,
+            int width,
+            int height);
+
+  // Start a new sequence, whose first frame is a keyframe.
+  void Reset();
+
+  // The overlap and the relative optical flow of the last frame with respect
+  // to the preceding keyframe.
+  double LastOverlap() const;
+  double LastFlow() const;
+
+ private:
+  const KeyframeSelectionOptions options_;
+  bool has_keyframe_ = false;
+  int num_skipped_frames_ = 0;
+  double last_overlap_ = 0;
+  double last_flow_ = 0;
+  FeatureKeypoints keyframe_keypoints_;
+  FeatureDescriptorsFloat keyframe_descriptors_;
+};
+
+}  // namespace colmap
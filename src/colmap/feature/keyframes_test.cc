@@ -0,0 +1,102 @@
+#include "colmap/feature/keyframes.h"
+
+#include "colmap/math/random.h"
+
+#include <gtest/gtest.h>
+
+namespace colmap {
+namespace {
+
+constexpr int kWidth = 640;
+constexpr int kHeight = 480;
+
+void CreateRandomFeatures(const int num_features,
+                          FeatureKeypoints* keypoints,
+                          FeatureDescriptors* descriptors) {
+  keypoints->resize(num_features);
+  descriptors->resize(num_features, 128);
+  for (int i = 0; i < num_features; ++i) {
+    (*keypoints)[i] =
+        FeatureKeypoint(RandomUniformReal<float>(0, kWidth),
+                        RandomUniformReal<float>(0, kHeight),
+                        RandomUniformReal<float>(1, 10),
+                        0);
+    for (int k = 0; k < 128; ++k) {
+      (*descriptors)(i, k) = RandomUniformInteger<int>(0, 255);
+    }
+  }
+}
+
+FeatureKeypoints ShiftKeypoints(const FeatureKeypoints& keypoints,
+                                const float shift) {
+  FeatureKeypoints shifted_keypoints = keypoints;
+  for (auto& keypoint : shifted_keypoints) {
+    keypoint.x += shift;
+  }
+  return shifted_keypoints;
+}
+
+TEST(KeyframeSelector, Nominal) {
+  SetPRNGSeed(0);
+  FeatureKeypoints keypoints;
+  FeatureDescriptors descriptors;
+  CreateRandomFeatures(100, &keypoints, &descriptors);
+
+  KeyframeSelectionOptions options;
+  options.max_flow = 0.05;
+  KeyframeSelector selector(options);
+  EXPECT_TRUE(selector.Next(keypoints, descriptors, kWidth, kHeight));
+
+  // Small motion of the same features.
+  EXPECT_FALSE(selector.Next(
+      ShiftKeypoints(keypoints, 10), descriptors, kWidth, kHeight));
+  EXPECT_EQ(selector.LastOverlap(), 1);
+  EXPECT_NEAR(selector.LastFlow(), 10.0 / 800.0, 1e-6);
+
+  // Large motion of the same features.
+  EXPECT_TRUE(selector.Next(
+      ShiftKeypoints(keypoints, 50), descriptors, kWidth, kHeight));
+  EXPECT_NEAR(selector.LastFlow(), 50.0 / 800.0, 1e-6);
+  EXPECT_FALSE(selector.Next(
+      ShiftKeypoints(keypoints, 60), descriptors, kWidth, kHeight));
+
+  // Only a fraction of the features overlap.
+  FeatureKeypoints other_keypoints;
+  FeatureDescriptors other_descriptors;
+  CreateRandomFeatures(100, &other_keypoints, &other_descriptors);
+  other_descriptors.topRows(40) = descriptors.topRows(40);
+  std::copy(keypoints.begin(), keypoints.begin() + 40, other_keypoints.begin());
+  EXPECT_TRUE(selector.Next(
+      ShiftKeypoints(other_keypoints, 50), other_descriptors, kWidth, kHeight));
+  EXPECT_EQ(selector.LastOverlap(), 0.4);
+
+  // A new sequence starts with a keyframe.
+  selector.Reset();
+  EXPECT_TRUE(selector.Next(keypoints, descriptors, kWidth, kHeight));
+}
+
+TEST(KeyframeSelector, MaxNumSkippedFrames) {
+  SetPRNGSeed(0);
+  FeatureKeypoints keypoints;
+  FeatureDescriptors descriptors;
+  CreateRandomFeatures(100, &keypoints, &descriptors);
+
+  KeyframeSelectionOptions options;
+  options.max_num_skipped_frames = 2;
+  KeyframeSelector selector(options);
+  for (int i = 0; i < 9; ++i) {
+    EXPECT_EQ(selector.Next(keypoints, descriptors, kWidth, kHeight),
+              i % 3 == 0);
+  }
+}
+
+TEST(KeyframeSelector, NoFeatures) {
+  KeyframeSelector selector(KeyframeSelectionOptions{});
+  EXPECT_TRUE(
+      selector.Next(FeatureKeypoints(), FeatureDescriptors(), kWidth, kHeight));
+  EXPECT_TRUE(
+      selector.Next(FeatureKeypoints(), FeatureDescriptors(), kWidth, kHeight));
+}
+
+}  // namespace
+}  // namespace colmap
@@ -30,6 +30,7 @@
 #pragma once
 
 #include "colmap/estimators/two_view_geometry.h"
+#include "colmap/feature/product_quantizer.h"
 #include "colmap/feature/types.h"
 
 #include <memory>
@@ -59,6 +60,33 @@ class FeatureMatcher {
       const std::shared_ptr<const FeatureDescriptors>& descriptors1,
       const std::shared_ptr<const FeatureDescriptors>& descriptors2,
       TwoViewGeometry* two_view_geometry) = 0;
+
+  // Guided matching of a refractive image pair, whose correspondences lie on
+  // epipolar curves instead of lines. The curves are sampled from the relative
+  // pose of a two-view geometry with `REFRACTIVE` configuration and the
+  // cameras, and only features in a band of `max_error` pixels around the
+  // curves are matched.
+  virtual void MatchGuidedRefrac(
+      const TwoViewGeometryOptions& options,
+      const Camera& camera1,
+      const Camera& camera2,
+      const std::shared_ptr<const FeatureKeypoints>& keypoints1,
+      const std::shared_ptr<const FeatureKeypoints>& keypoints2,
+      const std::shared_ptr<const FeatureDescriptors>& descriptors1,
+      const std::shared_ptr<const FeatureDescriptors>& descriptors2,
+      TwoViewGeometry* two_view_geometry) = 0;
+
+  // Approximate matching of product-quantized descriptors, whose nearest
+  // neighbor candidates are searched on their codes. Depending on the matcher
+  // options, the candidates are re-ranked by the exact distances of their raw
+  // descriptors, or the descriptors are ignored.
+  virtual void MatchQuantized(
+      const ProductQuantizer& quantizer,
+      const std::shared_ptr<const FeatureDescriptors>& codes1,
+      const std::shared_ptr<const FeatureDescriptors>& codes2,
+      const std::shared_ptr<const FeatureDescriptors>& descriptors1,
+      const std::shared_ptr<const FeatureDescriptors>& descriptors2,
+      FeatureMatches* matches) = 0;
 };
 
 }  // namespace colmap
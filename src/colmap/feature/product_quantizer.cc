@@ -0,0 +1,161 @@
+#include "colmap/feature/product_quantizer.h"
+
+#include "colmap/math/random.h"
+#include "colmap/util/logging.h"
+#include "colmap/util/threading.h"
+
+#include <algorithm>
+#include <numeric>
+
+namespace colmap {
+namespace {
+
+typedef Eigen::Matrix<float,
+                      Eigen::Dynamic,
+                      ProductQuantizer::kSubspaceDim,
+                      Eigen::RowMajor>
+    SubspaceMatrix;
+
+// Assigns the subvectors to their nearest centroids, where the squared
+// distances are computed in blocks as |c|^2 - 2 x^T c.
+void AssignNearestCentroids(const SubspaceMatrix& subvectors,
+                            const SubspaceMatrix& centroids,
+                            std::vector<int>* assignments) {
+  constexpr Eigen::Index kBlockSize = 4096;
+  const Eigen::RowVectorXf squared_norms =
+      centroids.rowwise().squaredNorm().transpose();
+  assignments->resize(subvectors.rows());
+  Eigen::MatrixXf dists;
+  for (Eigen::Index begin = 0; begin < subvectors.rows(); begin += kBlockSize) {
+    const Eigen::Index size = std::min(kBlockSize, subvectors.rows() - begin);
+    dists.noalias() =
+        -2.0f * subvectors.middleRows(begin, size) * centroids.transpose();
+    dists.rowwise() += squared_norms;
+    for (Eigen::Index i = 0; i < size; ++i) {
+      dists.row(i).minCoeff(&(*assignments)[begin + i]);
+    }
+  }
+}
+
+}  // namespace
+
+constexpr int ProductQuantizer::kDescriptorDim;
+constexpr int ProductQuantizer::kNumSubspaces;
+constexpr int ProductQuantizer::kSubspaceDim;
+constexpr int ProductQuantizer::kNumCentroids;
+
+ProductQuantizer::ProductQuantizer(const FeatureDescriptors& codebook)
+    : codebook_(codebook), codebook_int_(codebook.cast<int>()) {
+  CHECK_EQ(codebook_.rows(), kNumCentroids);
+  CHECK_EQ(codebook_.cols(), kDescriptorDim);
+}
+
+void ProductQuantizer::Train(const FeatureDescriptors& descriptors,
+                             const int num_iterations,
+                             const int num_threads) {
+  CHECK_EQ(descriptors.cols(), kDescriptorDim);
+  CHECK_GE(descriptors.rows(), kNumCentroids);
+  CHECK_GT(num_iterations, 0);
+
+  // The random initialization is drawn upfront, since the random number
+  // generator must not be used concurrently.
+  std::vector<int> init_idxs(descriptors.rows());
+  std::iota(init_idxs.begin(), init_idxs.end(), 0);
+  Shuffle(kNumCentroids, &init_idxs);
+
+  codebook_.resize(kNumCentroids, kDescriptorDim);
+
+  ThreadPool thread_pool(std::min(GetEffectiveNumThreads(num_threads),
+                                  static_cast<int>(kNumSubspaces)));
+  thread_pool.ParallelFor(0, kNumSubspaces, 1, [&](const int s) {
+    const SubspaceMatrix subvectors =
+        descriptors.middleCols(s * kSubspaceDim, kSubspaceDim).cast<float>();
+
+    SubspaceMatrix centroids(kNumCentroids, kSubspaceDim);
+    for (int c = 0; c < kNumCentroids; ++c) {
+      centroids.row(c) = subvectors.row(init_idxs[c]);
+    }
+
+    std::vector<int> assignments;
+    std::vector<int> cluster_sizes(kNumCentroids);
+    for (int iter = 0; iter < num_iterations; ++iter) {
+      AssignNearestCentroids(subvectors, centroids, &assignments);
+      const SubspaceMatrix prev_centroids = centroids;
+      centroids.setZero();
+      std::fill(cluster_sizes.begin(), cluster_sizes.end(), 0);
+      for (Eigen::Index i = 0; i < subvectors.rows(); ++i) {
+        centroids.row(assignments[i]) += subvectors.row(i);
+        cluster_sizes[assignments[i]] += 1;
+      }
+      for (int c = 0; c < kNumCentroids; ++c) {
+        if (cluster_sizes[c] > 0) {
+          centroids.row(c) /= cluster_sizes[c];
+        } else {
+          // Empty clusters keep their previous centroid.
+          centroids.row(c) = prev_centroids.row(c);
+        }
+      }
+    }
+
+    codebook_.middleCols(s * kSubspaceDim, kSubspaceDim) =
+        centroids.array().round().cwiseMax(0.0f).cwiseMin(255.0f)
+            .cast<uint8_t>();
+  });
+
+  codebook_int_ = codebook_.cast<int>();
+}
+
+const FeatureDescriptors& ProductQuantizer::Codebook() const {
+  return codebook_;
+}
+
+FeatureDescriptors ProductQuantizer::Encode(
+    const FeatureDescriptors& descriptors) const {
+  CHECK_EQ(codebook_.rows(), kNumCentroids);
+  CHECK_EQ(descriptors.cols(), kDescriptorDim);
+  FeatureDescriptors codes(descriptors.rows(), kNumSubspaces);
+  std::vector<int> assignments;
+  for (int s = 0; s < kNumSubspaces; ++s) {
+    AssignNearestCentroids(
+        descriptors.middleCols(s * kSubspaceDim, kSubspaceDim).cast<float>(),
+        codebook_.middleCols(s * kSubspaceDim, kSubspaceDim).cast<float>(),
+        &assignments);
+    for (Eigen::Index i = 0; i < descriptors.rows(); ++i) {
+      codes(i, s) = static_cast<uint8_t>(assignments[i]);
+    }
+  }
+  return codes;
+}
+
+FeatureDescriptors ProductQuantizer::Decode(
+    const FeatureDescriptors& codes) const {
+  CHECK_EQ(codebook_.rows(), kNumCentroids);
+  CHECK_EQ(codes.cols(), kNumSubspaces);
+  FeatureDescriptors descriptors(codes.rows(), kDescriptorDim);
+  for (Eigen::Index i = 0; i < codes.rows(); ++i) {
+    for (int s = 0; s < kNumSubspaces; ++s) {
+      descriptors.block<1, kSubspaceDim>(i, s * kSubspaceDim) =
+          codebook_.block<1, kSubspaceDim>(codes(i, s), s * kSubspaceDim);
+    }
+  }
+  return descriptors;
+}
+
+void ProductQuantizer::ComputeDotProductTable(const uint8_t* descriptor,
+                                              DotProductTable* table) const {
+  CHECK_EQ(codebook_int_.rows(), kNumCentroids);
+  for (int s = 0; s < kNumSubspaces; ++s) {
+    const uint8_t* subvector = descriptor + s * kSubspaceDim;
+    for (int c = 0; c < kNumCentroids; ++c) {
+      const int* centroid = codebook_int_.data() + c * kDescriptorDim +
+                            s * kSubspaceDim;
+      int dot_product = 0;
+      for (int d = 0; d < kSubspaceDim; ++d) {
+        dot_product += subvector[d] * centroid[d];
+      }
+      (*table)(s, c) = dot_product;
+    }
+  }
+}
+
+}  // namespace colmap
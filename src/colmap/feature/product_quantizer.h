@@ -0,0 +1,76 @@
+#pragma once
+
+#include "colmap/feature/types.h"
+
+#include <Eigen/Core>
+
+namespace colmap {
+
+// Product quantizer of 128-dimensional SIFT descriptors, which splits a
+// descriptor into 16 subvectors of 8 dimensions and replaces every subvector
+// by the index of its nearest centroid in the codebook of its subspace. A
+// descriptor is thereby compressed from 128 to 16 bytes.
+//
+// Codes are compared with a query descriptor by asymmetric distance
+// computation (ADC): the dot products of the query subvectors with all
+// centroids are tabulated once per query, and the approximate dot product with
+// a code is then the sum of 16 table lookups. Queries, which are only given as
+// codes, are decoded to their centroids before tabulation.
+class ProductQuantizer {
+ public:
+  static constexpr int kDescriptorDim = 128;
+  static constexpr int kNumSubspaces = 16;
+  static constexpr int kSubspaceDim = kDescriptorDim / kNumSubspaces;
+  static constexpr int kNumCentroids = 256;
+
+  // Dot products of the subvectors of a query descriptor with the centroids
+  // of their subspaces.
+  typedef Eigen::Matrix<int, kNumSubspaces, kNumCentroids, Eigen::RowMajor>
+      DotProductTable;
+
+  ProductQuantizer() = default;
+
+  // Create the quantizer from a codebook of 256 x 128 values, whose row i
+  // concatenates the i-th centroids of all subspaces.
+  explicit ProductQuantizer(const FeatureDescriptors& codebook);
+
+  // Learn the codebook with k-means clustering in every subspace.
+  void Train(const FeatureDescriptors& descriptors,
+             int num_iterations = 25,
+             int num_threads = -1);
+
+  const FeatureDescriptors& Codebook() const;
+
+  // Compress the descriptors to a matrix of N x 16 codes and back.
+  FeatureDescriptors Encode(const FeatureDescriptors& descriptors) const;
+  FeatureDescriptors Decode(const FeatureDescriptors& codes) const;
+
+  // Tabulate the query descriptor of 128 values for ADC.
+  void ComputeDotProductTable(const uint8_t* descriptor,
+                              DotProductTable* table) const;
+
+  // Approximate dot product of the tabulated query with a code of 16 values.
+  inline int ApproximateDotProduct(const DotProductTable& table,
+                                   const uint8_t* code) const;
+
+ private:
+  FeatureDescriptors codebook_;
+  // The codebook converted once for the tabulation of the queries.
+  Eigen::Matrix<int, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>
+      codebook_int_;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Implementation
+////////////////////////////////////////////////////////////////////////////////
+
+int ProductQuantizer::ApproximateDotProduct(const DotProductTable& table,
+                                            const uint8_t* code) const {
+  int dot_product = 0;
+  for (int s = 0; s < kNumSubspaces; ++s) {
+    dot_product += table(s, code[s]);
+  }
+  return dot_product;
+}
+
+}  // namespace colmap
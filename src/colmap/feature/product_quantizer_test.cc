@@ -0,0 +1,75 @@
+#include "colmap/feature/product_quantizer.h"
+
+#include "colmap/math/random.h"
+
+#include <gtest/gtest.h>
+
+namespace colmap {
+namespace {
+
+FeatureDescriptors CreateRandomDescriptors(const int num_descriptors) {
+  FeatureDescriptors descriptors(num_descriptors, 128);
+  for (Eigen::Index i = 0; i < descriptors.rows(); ++i) {
+    for (Eigen::Index k = 0; k < descriptors.cols(); ++k) {
+      descriptors(i, k) = RandomUniformInteger<int>(0, 255);
+    }
+  }
+  return descriptors;
+}
+
+TEST(ProductQuantizer, EncodeDecode) {
+  SetPRNGSeed(0);
+  const FeatureDescriptors descriptors = CreateRandomDescriptors(1000);
+  ProductQuantizer quantizer;
+  quantizer.Train(descriptors, /*num_iterations=*/5);
+  EXPECT_EQ(quantizer.Codebook().rows(), ProductQuantizer::kNumCentroids);
+  EXPECT_EQ(quantizer.Codebook().cols(), ProductQuantizer::kDescriptorDim);
+
+  const FeatureDescriptors codes = quantizer.Encode(descriptors);
+  EXPECT_EQ(codes.rows(), descriptors.rows());
+  EXPECT_EQ(codes.cols(), ProductQuantizer::kNumSubspaces);
+
+  // The centroids of the codebook are encoded exactly.
+  const ProductQuantizer read_quantizer(quantizer.Codebook());
+  const FeatureDescriptors centroid_codes =
+      read_quantizer.Encode(quantizer.Codebook());
+  EXPECT_EQ(read_quantizer.Decode(centroid_codes), quantizer.Codebook());
+
+  // Every subvector is decoded to its nearest centroid, which is at least as
+  // close as the centroid of any other code.
+  const FeatureDescriptors decoded_descriptors = quantizer.Decode(codes);
+  const Eigen::MatrixXf error =
+      (decoded_descriptors.cast<float>() - descriptors.cast<float>());
+  FeatureDescriptors other_codes = codes;
+  other_codes.array() += 1;
+  const Eigen::MatrixXf other_error =
+      (quantizer.Decode(other_codes).cast<float>() - descriptors.cast<float>());
+  for (Eigen::Index i = 0; i < descriptors.rows(); ++i) {
+    for (int s = 0; s < ProductQuantizer::kNumSubspaces; ++s) {
+      EXPECT_LE(error.row(i).segment(8 * s, 8).squaredNorm(),
+                other_error.row(i).segment(8 * s, 8).squaredNorm());
+    }
+  }
+}
+
+TEST(ProductQuantizer, ApproximateDotProduct) {
+  SetPRNGSeed(0);
+  const FeatureDescriptors descriptors = CreateRandomDescriptors(500);
+  ProductQuantizer quantizer;
+  quantizer.Train(descriptors, /*num_iterations=*/2);
+  const FeatureDescriptors codes = quantizer.Encode(descriptors);
+  const FeatureDescriptors decoded_descriptors = quantizer.Decode(codes);
+
+  ProductQuantizer::DotProductTable table;
+  for (Eigen::Index i = 0; i < 10; ++i) {
+    quantizer.ComputeDotProductTable(descriptors.row(i).data(), &table);
+    for (Eigen::Index j = 0; j < descriptors.rows(); ++j) {
+      EXPECT_EQ(quantizer.ApproximateDotProduct(table, codes.row(j).data()),
+                descriptors.row(i).cast<int>().dot(
+                    decoded_descriptors.row(j).cast<int>()));
+    }
+  }
+}
+
+}  // namespace
+}  // namespace colmap
@@ -32,6 +32,7 @@
 #include "colmap/feature/utils.h"
 #include "colmap/math/math.h"
 #include "colmap/util/cuda.h"
+#include "colmap/util/endian.h"
 #include "colmap/util/logging.h"
 #include "colmap/util/misc.h"
 #include "colmap/util/opengl_utils.h"
@@ -48,9 +49,15 @@
 #include "thirdparty/VLFeat/covdet.h"
 #include "thirdparty/VLFeat/sift.h"
 
+#include <algorithm>
 #include <array>
 #include <fstream>
+#include <functional>
+#include <limits>
+#include <list>
 #include <memory>
+#include <mutex>
+#include <unordered_map>
 
 #include <Eigen/Geometry>
 #include <flann/flann.hpp>
@@ -60,9 +67,13 @@ namespace colmap {
 bool SiftExtractionOptions::Check() const {
   if (use_gpu) {
     CHECK_OPTION_GT(CSVToVector<int>(gpu_index).size(), 0);
+    CHECK_OPTION_GT(num_threads_per_gpu, 0);
   }
   CHECK_OPTION_GT(max_image_size, 0);
   CHECK_OPTION_GT(max_num_features, 0);
+  CHECK_OPTION_GE(feature_grid_cell_size, 0);
+  CHECK_OPTION_GT(max_num_features_per_cell, 0);
+  CHECK_OPTION_GE(min_image_contrast, 0.0);
   CHECK_OPTION_GT(octave_resolution, 0);
   CHECK_OPTION_GT(peak_threshold, 0.0);
   CHECK_OPTION_GT(edge_threshold, 0.0);
@@ -78,10 +89,20 @@ bool SiftExtractionOptions::Check() const {
 bool SiftMatchingOptions::Check() const {
   if (use_gpu) {
     CHECK_OPTION_GT(CSVToVector<int>(gpu_index).size(), 0);
+    CHECK_OPTION_GT(num_threads_per_gpu, 0);
   }
   CHECK_OPTION_GT(max_ratio, 0.0);
   CHECK_OPTION_GT(max_distance, 0.0);
   CHECK_OPTION_GT(max_num_matches, 0);
+  CHECK_OPTION_GT(refrac_guided_min_depth, 0.0);
+  CHECK_OPTION_GT(refrac_guided_max_depth, refrac_guided_min_depth);
+  CHECK_OPTION_GE(refrac_guided_num_samples, 2);
+  CHECK_OPTION_GE(flann_index_cache_size_mb, 0.0);
+  CHECK_OPTION_GE(gpu_descriptor_cache_size_mb, 0.0);
+  CHECK_OPTION_GE(descriptor_codes_num_candidates, 0);
+  CHECK_OPTION_GT(num_shards, 0);
+  CHECK_OPTION_GE(shard_index, 0);
+  CHECK_OPTION_LT(shard_index, num_shards);
   return true;
 }
 
@@ -111,6 +132,21 @@ FeatureDescriptors TransformVLFeatToUBCFeatureDescriptors(
   return ubc_descriptors;
 }
 
+// Convert the grey bitmap to a row-major array of intensities in [0, 1]. The
+// array is reused between images, so that it is not reallocated per image.
+void BitmapToNormalizedFloatArray(const Bitmap& bitmap,
+                                  std::vector<float>* data) {
+  CHECK(bitmap.IsGrey());
+  data->resize(static_cast<size_t>(bitmap.Width()) * bitmap.Height());
+  float* data_ptr = data->data();
+  for (int y = 0; y < bitmap.Height(); ++y) {
+    const uint8_t* line = bitmap.GetScanline(y);
+    for (int x = 0; x < bitmap.Width(); ++x) {
+      *data_ptr++ = static_cast<float>(line[x]) / 255.0f;
+    }
+  }
+}
+
 class SiftCPUFeatureExtractor : public FeatureExtractor {
  public:
   using VlSiftType = std::unique_ptr<VlSiftFilt, void (*)(VlSiftFilt*)>;
@@ -159,12 +195,9 @@ class SiftCPUFeatureExtractor : public FeatureExtractor {
     bool first_octave = true;
     while (true) {
       if (first_octave) {
-        const std::vector<uint8_t> data_uint8 = bitmap.ConvertToRowMajorArray();
-        std::vector<float> data_float(data_uint8.size());
-        for (size_t i = 0; i < data_uint8.size(); ++i) {
-          data_float[i] = static_cast<float>(data_uint8[i]) / 255.0f;
-        }
-        if (vl_sift_process_first_octave(sift_.get(), data_float.data())) {
+        BitmapToNormalizedFloatArray(bitmap, &data_float_buffer_);
+        if (vl_sift_process_first_octave(sift_.get(),
+                                         data_float_buffer_.data())) {
           break;
         }
         first_octave = false;
@@ -307,6 +340,7 @@ class SiftCPUFeatureExtractor : public FeatureExtractor {
  private:
   const SiftExtractionOptions options_;
   VlSiftType sift_;
+  std::vector<float> data_float_buffer_;
 };
 
 class CovariantSiftCPUFeatureExtractor : public FeatureExtractor {
@@ -346,15 +380,11 @@ class CovariantSiftCPUFeatureExtractor : public FeatureExtractor {
     vl_covdet_set_peak_threshold(covdet.get(), options_.peak_threshold);
     vl_covdet_set_edge_threshold(covdet.get(), options_.edge_threshold);
 
-    {
-      const std::vector<uint8_t> data_uint8 = bitmap.ConvertToRowMajorArray();
-      std::vector<float> data_float(data_uint8.size());
-      for (size_t i = 0; i < data_uint8.size(); ++i) {
-        data_float[i] = static_cast<float>(data_uint8[i]) / 255.0f;
-      }
-      vl_covdet_put_image(
-          covdet.get(), data_float.data(), bitmap.Width(), bitmap.Height());
-    }
+    BitmapToNormalizedFloatArray(bitmap, &data_float_buffer_);
+    vl_covdet_put_image(covdet.get(),
+                        data_float_buffer_.data(),
+                        bitmap.Width(),
+                        bitmap.Height());
 
     vl_covdet_detect(covdet.get(), options_.max_num_features);
 
@@ -511,6 +541,7 @@ class CovariantSiftCPUFeatureExtractor : public FeatureExtractor {
 
  private:
   const SiftExtractionOptions options_;
+  std::vector<float> data_float_buffer_;
 };
 
 #if defined(COLMAP_GPU_ENABLED)
@@ -518,6 +549,19 @@ class CovariantSiftCPUFeatureExtractor : public FeatureExtractor {
 // at the same time, since SiftGPU internally uses static variables.
 static std::map<int, std::unique_ptr<std::mutex>> sift_gpu_mutexes_;
 
+// Returns the mutex of the given GPU and creates it on first use. Multiple
+// threads may share the same GPU, so access to the map itself is serialized.
+std::mutex& GetSiftGPUMutex(
+    std::map<int, std::unique_ptr<std::mutex>>* gpu_mutexes, int gpu_index) {
+  static std::mutex gpu_mutexes_mutex;
+  std::lock_guard<std::mutex> lock(gpu_mutexes_mutex);
+  std::unique_ptr<std::mutex>& gpu_mutex = (*gpu_mutexes)[gpu_index];
+  if (gpu_mutex == nullptr) {
+    gpu_mutex = std::make_unique<std::mutex>();
+  }
+  return *gpu_mutex;
+}
+
 class SiftGPUFeatureExtractor : public FeatureExtractor {
  public:
   explicit SiftGPUFeatureExtractor(const SiftExtractionOptions& options)
@@ -622,9 +666,7 @@ class SiftGPUFeatureExtractor : public FeatureExtractor {
                                     sift_gpu_args_cstr.data());
 
     extractor->sift_gpu_.gpu_index = gpu_indices[0];
-    if (sift_gpu_mutexes_.count(gpu_indices[0]) == 0) {
-      sift_gpu_mutexes_.emplace(gpu_indices[0], std::make_unique<std::mutex>());
-    }
+    GetSiftGPUMutex(&sift_gpu_mutexes_, gpu_indices[0]);
 
     if (extractor->sift_gpu_.VerifyContextGL() !=
         SiftGPU::SIFTGPU_FULL_SUPPORTED) {
@@ -647,14 +689,15 @@ class SiftGPUFeatureExtractor : public FeatureExtractor {
     CHECK_EQ(options_.max_image_size * compensation_factor,
              sift_gpu_.GetMaxDimension());
 
-    std::lock_guard<std::mutex> lock(*sift_gpu_mutexes_[sift_gpu_.gpu_index]);
+    std::lock_guard<std::mutex> lock(
+        GetSiftGPUMutex(&sift_gpu_mutexes_, sift_gpu_.gpu_index));
 
     // Note, that this produces slightly different results than using SiftGPU
     // directly for RGB->GRAY conversion, since it uses different weights.
-    const std::vector<uint8_t> bitmap_raw_bits = bitmap.ConvertToRawBits();
+    bitmap.ConvertToRawBits(&raw_bits_buffer_);
     const int code = sift_gpu_.RunSIFT(bitmap.ScanWidth(),
                                        bitmap.Height(),
-                                       bitmap_raw_bits.data(),
+                                       raw_bits_buffer_.data(),
                                        GL_LUMINANCE,
                                        GL_UNSIGNED_BYTE);
 
@@ -700,105 +743,194 @@ class SiftGPUFeatureExtractor : public FeatureExtractor {
   const SiftExtractionOptions options_;
   SiftGPU sift_gpu_;
   std::vector<SiftKeypoint> keypoints_buffer_;
+  std::vector<uint8_t> raw_bits_buffer_;
 };
 #endif  // COLMAP_GPU_ENABLED
 
+// Computes the standard deviation of the grey intensities of the image.
+double ComputeImageContrast(const Bitmap& bitmap) {
+  CHECK(bitmap.IsGrey());
+  const int num_pixels = bitmap.Width() * bitmap.Height();
+  if (num_pixels == 0) {
+    return 0;
+  }
+
+  double sum = 0;
+  double squared_sum = 0;
+  for (int y = 0; y < bitmap.Height(); ++y) {
+    const uint8_t* line = bitmap.GetScanline(y);
+    for (int x = 0; x < bitmap.Width(); ++x) {
+      sum += line[x];
+      squared_sum += line[x] * line[x];
+    }
+  }
+
+  const double mean = sum / num_pixels;
+  return std::sqrt(std::max(0.0, squared_sum / num_pixels - mean * mean));
+}
+
+// Skips low-contrast images and spatially buckets the features of another
+// extractor, such that the number of features adapts to the image content.
+class AdaptiveSiftFeatureExtractor : public FeatureExtractor {
+ public:
+  AdaptiveSiftFeatureExtractor(const SiftExtractionOptions& options,
+                               std::unique_ptr<FeatureExtractor> extractor)
+      : options_(options), extractor_(std::move(extractor)) {
+    CHECK(options_.Check());
+    CHECK_NOTNULL(extractor_);
+  }
+
+  bool Extract(const Bitmap& bitmap,
+               FeatureKeypoints* keypoints,
+               FeatureDescriptors* descriptors) override {
+    CHECK_NOTNULL(keypoints);
+    CHECK_NOTNULL(descriptors);
+
+    if (options_.min_image_contrast > 0 &&
+        ComputeImageContrast(bitmap) < options_.min_image_contrast) {
+      keypoints->clear();
+      descriptors->resize(0, 128);
+      return true;
+    }
+
+    if (!extractor_->Extract(bitmap, keypoints, descriptors)) {
+      return false;
+    }
+
+    if (options_.feature_grid_cell_size > 0) {
+      ExtractGridTopScaleFeatures(keypoints,
+                                  descriptors,
+                                  options_.feature_grid_cell_size,
+                                  options_.max_num_features_per_cell);
+    }
+
+    return true;
+  }
+
+ private:
+  const SiftExtractionOptions options_;
+  std::unique_ptr<FeatureExtractor> extractor_;
+};
+
 }  // namespace
 
 std::unique_ptr<FeatureExtractor> CreateSiftFeatureExtractor(
     const SiftExtractionOptions& options) {
+  std::unique_ptr<FeatureExtractor> extractor;
   if (options.estimate_affine_shape || options.domain_size_pooling ||
       options.force_covariant_extractor) {
-    return CovariantSiftCPUFeatureExtractor::Create(options);
+    extractor = CovariantSiftCPUFeatureExtractor::Create(options);
   } else if (options.use_gpu) {
 #if defined(COLMAP_GPU_ENABLED)
-    return SiftGPUFeatureExtractor::Create(options);
-#else
-    return nullptr;
+    extractor = SiftGPUFeatureExtractor::Create(options);
 #endif  // COLMAP_GPU_ENABLED
   } else {
-    return SiftCPUFeatureExtractor::Create(options);
+    extractor = SiftCPUFeatureExtractor::Create(options);
   }
+
+  if (extractor != nullptr && (options.feature_grid_cell_size > 0 ||
+                               options.min_image_contrast > 0)) {
+    extractor = std::make_unique<AdaptiveSiftFeatureExtractor>(
+        options, std::move(extractor));
+  }
+
+  return extractor;
 }
 
 namespace {
 
-size_t FindBestMatchesOneWayBruteForce(const Eigen::MatrixXi& dists,
-                                       const float max_ratio,
-                                       const float max_distance,
-                                       std::vector<int>* matches) {
+// The two largest descriptor dot products of a query descriptor, i.e., the two
+// smallest descriptor distances, and the index of the best one.
+struct BestMatchCandidates {
+  int best_idx = -1;
+  int best_dist = 0;
+  int second_best_dist = 0;
+
+  inline void Update(const int idx, const int dist) {
+    if (dist > best_dist) {
+      best_idx = idx;
+      second_best_dist = best_dist;
+      best_dist = dist;
+    } else if (dist > second_best_dist) {
+      second_best_dist = dist;
+    }
+  }
+};
+
+// Returns the index of the best match or -1, if the best match does not pass
+// the distance or ratio test. The ratio of the distances is returned for
+// accepted matches.
+int SelectBestMatch(const BestMatchCandidates& candidates,
+                    const float max_ratio,
+                    const float max_distance,
+                    float* ratio) {
   // SIFT descriptor vectors are normalized to length 512.
   const float kDistNorm = 1.0f / (512.0f * 512.0f);
 
-  size_t num_matches = 0;
-  matches->resize(dists.rows(), -1);
+  // Check if any match found.
+  if (candidates.best_idx == -1) {
+    return -1;
+  }
 
-  for (Eigen::Index i1 = 0; i1 < dists.rows(); ++i1) {
-    int best_i2 = -1;
-    int best_dist = 0;
-    int second_best_dist = 0;
-    for (Eigen::Index i2 = 0; i2 < dists.cols(); ++i2) {
-      const int dist = dists(i1, i2);
-      if (dist > best_dist) {
-        best_i2 = i2;
-        second_best_dist = best_dist;
-        best_dist = dist;
-      } else if (dist > second_best_dist) {
-        second_best_dist = dist;
-      }
-    }
+  const float best_dist_normed =
+      std::acos(std::min(kDistNorm * candidates.best_dist, 1.0f));
 
-    // Check if any match found.
-    if (best_i2 == -1) {
-      continue;
-    }
+  // Check if match distance passes threshold.
+  if (best_dist_normed > max_distance) {
+    return -1;
+  }
 
-    const float best_dist_normed =
-        std::acos(std::min(kDistNorm * best_dist, 1.0f));
+  const float second_best_dist_normed =
+      std::acos(std::min(kDistNorm * candidates.second_best_dist, 1.0f));
 
-    // Check if match distance passes threshold.
-    if (best_dist_normed > max_distance) {
-      continue;
-    }
+  // Check if match passes ratio test. Keep this comparison >= in order to
+  // ensure that the case of best == second_best is detected.
+  if (best_dist_normed >= max_ratio * second_best_dist_normed) {
+    return -1;
+  }
 
-    const float second_best_dist_normed =
-        std::acos(std::min(kDistNorm * second_best_dist, 1.0f));
+  *ratio = best_dist_normed / second_best_dist_normed;
 
-    // Check if match passes ratio test. Keep this comparison >= in order to
-    // ensure that the case of best == second_best is detected.
-    if (best_dist_normed >= max_ratio * second_best_dist_normed) {
-      continue;
-    }
+  return candidates.best_idx;
+}
 
-    num_matches += 1;
-    (*matches)[i1] = best_i2;
+size_t SelectBestMatches(const std::vector<BestMatchCandidates>& candidates,
+                         const float max_ratio,
+                         const float max_distance,
+                         std::vector<int>* matches,
+                         std::vector<float>* ratios) {
+  size_t num_matches = 0;
+  matches->resize(candidates.size(), -1);
+  ratios->resize(candidates.size(), -1.0f);
+  for (size_t i = 0; i < candidates.size(); ++i) {
+    (*matches)[i] = SelectBestMatch(
+        candidates[i], max_ratio, max_distance, &(*ratios)[i]);
+    if ((*matches)[i] != -1) {
+      num_matches += 1;
+    }
   }
-
   return num_matches;
 }
 
-void FindBestMatchesBruteForce(const Eigen::MatrixXi& dists,
-                               const float max_ratio,
-                               const float max_distance,
-                               const bool cross_check,
-                               FeatureMatches* matches) {
+// Collects the one-way matches or, if matches21 is given, only the matches
+// that are mutual best matches in both directions. The matches keep the ratios
+// of the first direction.
+void CollectBestMatches(const std::vector<int>& matches12,
+                        const std::vector<float>& ratios12,
+                        const size_t num_matches12,
+                        const std::vector<int>* matches21,
+                        const size_t num_matches21,
+                        FeatureMatches* matches) {
   matches->clear();
-
-  std::vector<int> matches12;
-  const size_t num_matches12 = FindBestMatchesOneWayBruteForce(
-      dists, max_ratio, max_distance, &matches12);
-
-  if (cross_check) {
-    std::vector<int> matches21;
-    const size_t num_matches21 = FindBestMatchesOneWayBruteForce(
-        dists.transpose(), max_ratio, max_distance, &matches21);
+  if (matches21 != nullptr) {
     matches->reserve(std::min(num_matches12, num_matches21));
     for (size_t i1 = 0; i1 < matches12.size(); ++i1) {
-      if (matches12[i1] != -1 && matches21[matches12[i1]] != -1 &&
-          matches21[matches12[i1]] == static_cast<int>(i1)) {
+      if (matches12[i1] != -1 && (*matches21)[matches12[i1]] != -1 &&
+          (*matches21)[matches12[i1]] == static_cast<int>(i1)) {
         FeatureMatch match;
         match.point2D_idx1 = i1;
         match.point2D_idx2 = matches12[i1];
+        match.ratio = ratios12[i1];
         matches->push_back(match);
       }
     }
@@ -809,12 +941,204 @@ void FindBestMatchesBruteForce(const Eigen::MatrixXi& dists,
         FeatureMatch match;
         match.point2D_idx1 = i1;
         match.point2D_idx2 = matches12[i1];
+        match.ratio = ratios12[i1];
         matches->push_back(match);
       }
     }
   }
 }
 
+// Exhaustive matching of the descriptors, which computes the dot products of
+// blocks of descriptors with a vectorized matrix product and directly selects
+// the two best candidates of each descriptor, so that the full distance matrix
+// is never stored. The products are computed in single precision, which is
+// exact, since the sum of 128 products of 8-bit values is below 2^24.
+void FindBestMatchesBruteForce(const FeatureDescriptors& descriptors1,
+                               const FeatureDescriptors& descriptors2,
+                               const float max_ratio,
+                               const float max_distance,
+                               const bool cross_check,
+                               FeatureMatches* matches) {
+  CHECK_EQ(descriptors1.cols(), 128);
+  CHECK_EQ(descriptors2.cols(), 128);
+
+  constexpr Eigen::Index kBlockSize1 = 256;
+  constexpr Eigen::Index kBlockSize2 = 1024;
+
+  const Eigen::Index num_descriptors1 = descriptors1.rows();
+  const Eigen::Index num_descriptors2 = descriptors2.rows();
+
+  const Eigen::Matrix<float, Eigen::Dynamic, 128, Eigen::RowMajor>
+      descriptors1_float = descriptors1.cast<float>();
+  const Eigen::Matrix<float, Eigen::Dynamic, 128, Eigen::RowMajor>
+      descriptors2_float = descriptors2.cast<float>();
+
+  std::vector<BestMatchCandidates> candidates12(num_descriptors1);
+  std::vector<BestMatchCandidates> candidates21(
+      cross_check ? num_descriptors2 : 0);
+
+  // Both loops visit the descriptors in increasing order, such that the first
+  // of multiple equally good candidates is selected.
+  Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> dists;
+  for (Eigen::Index begin1 = 0; begin1 < num_descriptors1;
+       begin1 += kBlockSize1) {
+    const Eigen::Index size1 =
+        std::min(kBlockSize1, num_descriptors1 - begin1);
+    for (Eigen::Index begin2 = 0; begin2 < num_descriptors2;
+         begin2 += kBlockSize2) {
+      const Eigen::Index size2 =
+          std::min(kBlockSize2, num_descriptors2 - begin2);
+      dists.noalias() =
+          descriptors1_float.middleRows(begin1, size1) *
+          descriptors2_float.middleRows(begin2, size2).transpose();
+      for (Eigen::Index i1 = 0; i1 < size1; ++i1) {
+        BestMatchCandidates& candidates = candidates12[begin1 + i1];
+        for (Eigen::Index i2 = 0; i2 < size2; ++i2) {
+          const int dist = static_cast<int>(dists(i1, i2));
+          candidates.Update(begin2 + i2, dist);
+          if (cross_check) {
+            candidates21[begin2 + i2].Update(begin1 + i1, dist);
+          }
+        }
+      }
+    }
+  }
+
+  std::vector<int> matches12;
+  std::vector<float> ratios12;
+  const size_t num_matches12 = SelectBestMatches(
+      candidates12, max_ratio, max_distance, &matches12, &ratios12);
+
+  if (cross_check) {
+    std::vector<int> matches21;
+    std::vector<float> ratios21;
+    const size_t num_matches21 = SelectBestMatches(
+        candidates21, max_ratio, max_distance, &matches21, &ratios21);
+    CollectBestMatches(matches12,
+                       ratios12,
+                       num_matches12,
+                       &matches21,
+                       num_matches21,
+                       matches);
+  } else {
+    CollectBestMatches(
+        matches12, ratios12, num_matches12, nullptr, 0, matches);
+  }
+}
+
+// Finds the two best candidates of every query descriptor among the codes of
+// the other image by asymmetric distance computation. If the raw descriptors
+// of the other image are given, the `num_candidates` approximately best
+// candidates are re-ranked by their exact dot products.
+void FindBestCandidatesQuantized(const ProductQuantizer& quantizer,
+                                 const FeatureDescriptors& queries,
+                                 const FeatureDescriptors& codes,
+                                 const FeatureDescriptors* descriptors,
+                                 const int num_candidates,
+                                 std::vector<BestMatchCandidates>* candidates) {
+  candidates->assign(queries.rows(), BestMatchCandidates());
+
+  // Min-heap of the approximate dot products and indices of the candidates.
+  typedef std::pair<int, int> Candidate;
+  const std::greater<Candidate> heap_compare;
+  std::vector<Candidate> heap;
+  heap.reserve(num_candidates);
+
+  ProductQuantizer::DotProductTable table;
+  for (Eigen::Index i = 0; i < queries.rows(); ++i) {
+    quantizer.ComputeDotProductTable(queries.row(i).data(), &table);
+    BestMatchCandidates& query_candidates = (*candidates)[i];
+
+    if (descriptors == nullptr) {
+      for (Eigen::Index j = 0; j < codes.rows(); ++j) {
+        query_candidates.Update(
+            j, quantizer.ApproximateDotProduct(table, codes.row(j).data()));
+      }
+      continue;
+    }
+
+    heap.clear();
+    for (Eigen::Index j = 0; j < codes.rows(); ++j) {
+      const int dist =
+          quantizer.ApproximateDotProduct(table, codes.row(j).data());
+      if (heap.size() < static_cast<size_t>(num_candidates)) {
+        heap.emplace_back(dist, j);
+        std::push_heap(heap.begin(), heap.end(), heap_compare);
+      } else if (dist > heap.front().first) {
+        std::pop_heap(heap.begin(), heap.end(), heap_compare);
+        heap.back() = Candidate(dist, j);
+        std::push_heap(heap.begin(), heap.end(), heap_compare);
+      }
+    }
+
+    // Visit the candidates in increasing order, such that the first of
+    // multiple equally good candidates is selected as in exhaustive matching.
+    std::sort(heap.begin(), heap.end(), [](const Candidate& candidate1,
+                                           const Candidate& candidate2) {
+      return candidate1.second < candidate2.second;
+    });
+    for (const Candidate& candidate : heap) {
+      query_candidates.Update(
+          candidate.second,
+          queries.row(i).cast<int>().dot(
+              descriptors->row(candidate.second).cast<int>()));
+    }
+  }
+}
+
+// Matching of product-quantized descriptors, where the queries are either the
+// raw descriptors, whose candidates are re-ranked, or the decoded codes.
+void FindBestMatchesQuantized(const ProductQuantizer& quantizer,
+                              const FeatureDescriptors& queries1,
+                              const FeatureDescriptors& codes1,
+                              const FeatureDescriptors* descriptors1,
+                              const FeatureDescriptors& queries2,
+                              const FeatureDescriptors& codes2,
+                              const FeatureDescriptors* descriptors2,
+                              const SiftMatchingOptions& options,
+                              FeatureMatches* matches) {
+  // The ratio test requires at least the two best candidates.
+  const int num_candidates =
+      std::max(options.descriptor_codes_num_candidates, 2);
+
+  std::vector<BestMatchCandidates> candidates12;
+  FindBestCandidatesQuantized(
+      quantizer, queries1, codes2, descriptors2, num_candidates, &candidates12);
+  std::vector<int> matches12;
+  std::vector<float> ratios12;
+  const size_t num_matches12 = SelectBestMatches(candidates12,
+                                                 options.max_ratio,
+                                                 options.max_distance,
+                                                 &matches12,
+                                                 &ratios12);
+
+  if (options.cross_check) {
+    std::vector<BestMatchCandidates> candidates21;
+    FindBestCandidatesQuantized(quantizer,
+                                queries2,
+                                codes1,
+                                descriptors1,
+                                num_candidates,
+                                &candidates21);
+    std::vector<int> matches21;
+    std::vector<float> ratios21;
+    const size_t num_matches21 = SelectBestMatches(candidates21,
+                                                   options.max_ratio,
+                                                   options.max_distance,
+                                                   &matches21,
+                                                   &ratios21);
+    CollectBestMatches(matches12,
+                       ratios12,
+                       num_matches12,
+                       &matches21,
+                       num_matches21,
+                       matches);
+  } else {
+    CollectBestMatches(
+        matches12, ratios12, num_matches12, nullptr, 0, matches);
+  }
+}
+
 Eigen::MatrixXi ComputeSiftDistanceMatrix(
     const FeatureKeypoints* keypoints1,
     const FeatureKeypoints* keypoints2,
@@ -902,12 +1226,14 @@ size_t FindBestMatchesOneWayFLANN(
         distances,
     const float max_ratio,
     const float max_distance,
-    std::vector<int>* matches) {
+    std::vector<int>* matches,
+    std::vector<float>* ratios) {
   // SIFT descriptor vectors are normalized to length 512.
   const float kDistNorm = 1.0f / (512.0f * 512.0f);
 
   size_t num_matches = 0;
   matches->resize(indices.rows(), -1);
+  ratios->resize(indices.rows(), -1.0f);
 
   for (int d1_idx = 0; d1_idx < indices.rows(); ++d1_idx) {
     int best_i2 = -1;
@@ -949,6 +1275,7 @@ size_t FindBestMatchesOneWayFLANN(
 
     num_matches += 1;
     (*matches)[d1_idx] = best_i2;
+    (*ratios)[d1_idx] = best_dist_normed / second_best_dist_normed;
   }
 
   return num_matches;
@@ -970,13 +1297,23 @@ void FindBestMatchesFlann(
   matches->clear();
 
   std::vector<int> matches12;
-  const size_t num_matches12 = FindBestMatchesOneWayFLANN(
-      indices_1to2, distances_1to2, max_ratio, max_distance, &matches12);
+  std::vector<float> ratios12;
+  const size_t num_matches12 = FindBestMatchesOneWayFLANN(indices_1to2,
+                                                          distances_1to2,
+                                                          max_ratio,
+                                                          max_distance,
+                                                          &matches12,
+                                                          &ratios12);
 
   if (cross_check && indices_2to1.rows()) {
     std::vector<int> matches21;
-    const size_t num_matches21 = FindBestMatchesOneWayFLANN(
-        indices_2to1, distances_2to1, max_ratio, max_distance, &matches21);
+    std::vector<float> ratios21;
+    const size_t num_matches21 = FindBestMatchesOneWayFLANN(indices_2to1,
+                                                            distances_2to1,
+                                                            max_ratio,
+                                                            max_distance,
+                                                            &matches21,
+                                                            &ratios21);
     matches->reserve(std::min(num_matches12, num_matches21));
     for (size_t i1 = 0; i1 < matches12.size(); ++i1) {
       if (matches12[i1] != -1 && matches21[matches12[i1]] != -1 &&
@@ -984,6 +1321,7 @@ void FindBestMatchesFlann(
         FeatureMatch match;
         match.point2D_idx1 = i1;
         match.point2D_idx2 = matches12[i1];
+        match.ratio = ratios12[i1];
         matches->push_back(match);
       }
     }
@@ -994,17 +1332,430 @@ void FindBestMatchesFlann(
         FeatureMatch match;
         match.point2D_idx1 = i1;
         match.point2D_idx2 = matches12[i1];
+        match.ratio = ratios12[i1];
         matches->push_back(match);
       }
     }
   }
 }
 
+Ray3D CamFromImgRay(const Camera& camera, const Eigen::Vector2d& image_point) {
+  if (camera.IsCameraRefractive()) {
+    return camera.CamFromImgRefrac(image_point);
+  }
+  return Ray3D(Eigen::Vector3d::Zero(),
+               camera.CamFromImg(image_point).homogeneous().normalized());
+}
+
+Eigen::Vector2d ImgFromCamPoint(const Camera& camera,
+                                const Eigen::Vector3d& cam_point) {
+  if (camera.IsCameraRefractive()) {
+    return camera.ImgFromCamRefrac(cam_point);
+  }
+  return camera.ImgFromCam(cam_point.hnormalized());
+}
+
+// Clip the segment to the rectangle, returns false if it lies outside.
+bool ClipSegment(const Eigen::Vector2d& min_point,
+                 const Eigen::Vector2d& max_point,
+                 Eigen::Vector2d* start,
+                 Eigen::Vector2d* end) {
+  const Eigen::Vector2d delta = *end - *start;
+  double t_min = 0;
+  double t_max = 1;
+  for (int d = 0; d < 2; ++d) {
+    if (std::abs(delta(d)) < std::numeric_limits<double>::epsilon()) {
+      if ((*start)(d) < min_point(d) || (*start)(d) > max_point(d)) {
+        return false;
+      }
+      continue;
+    }
+    double t1 = (min_point(d) - (*start)(d)) / delta(d);
+    double t2 = (max_point(d) - (*start)(d)) / delta(d);
+    if (t1 > t2) {
+      std::swap(t1, t2);
+    }
+    t_min = std::max(t_min, t1);
+    t_max = std::min(t_max, t2);
+    if (t_min > t_max) {
+      return false;
+    }
+  }
+  const Eigen::Vector2d clipped_start = *start + t_min * delta;
+  *end = *start + t_max * delta;
+  *start = clipped_start;
+  return true;
+}
+
+double SquaredDistanceToSegment(const Eigen::Vector2d& point,
+                                const Eigen::Vector2d& start,
+                                const Eigen::Vector2d& end) {
+  const Eigen::Vector2d delta = end - start;
+  const double length_sq = delta.squaredNorm();
+  if (length_sq == 0) {
+    return (point - start).squaredNorm();
+  }
+  const double t =
+      std::min(1.0, std::max(0.0, (point - start).dot(delta) / length_sq));
+  return (point - (start + t * delta)).squaredNorm();
+}
+
+// Find the keypoints in the second image within a band of `max_error` pixels
+// around the epipolar curve of every keypoint in the first image. The epipolar
+// curve of a refractive image pair is the projection of the refracted ray of
+// the keypoint into the second image, which is sampled uniformly in inverse
+// depth and approximated by line segments.
+std::vector<std::vector<int>> FindRefracGuidedCandidates(
+    const SiftMatchingOptions& options,
+    const double max_error,
+    const Camera& camera1,
+    const Camera& camera2,
+    const FeatureKeypoints& keypoints1,
+    const FeatureKeypoints& keypoints2,
+    const Rigid3d& cam2_from_cam1) {
+  std::vector<std::vector<int>> candidates(keypoints1.size());
+  if (keypoints1.empty() || keypoints2.empty()) {
+    return candidates;
+  }
+
+  // Hash the keypoints of the second image into a regular grid, whose cells
+  // are at least as large as the band.
+  Eigen::Vector2d min_point(keypoints2[0].x, keypoints2[0].y);
+  Eigen::Vector2d max_point = min_point;
+  for (const auto& keypoint : keypoints2) {
+    min_point = min_point.cwiseMin(Eigen::Vector2d(keypoint.x, keypoint.y));
+    max_point = max_point.cwiseMax(Eigen::Vector2d(keypoint.x, keypoint.y));
+  }
+  const double cell_size = std::max(max_error, 1.0);
+  const int num_cols =
+      static_cast<int>((max_point.x() - min_point.x()) / cell_size) + 1;
+  const int num_rows =
+      static_cast<int>((max_point.y() - min_point.y()) / cell_size) + 1;
+  std::vector<std::vector<int>> grid(num_cols * num_rows);
+  for (size_t i2 = 0; i2 < keypoints2.size(); ++i2) {
+    const int col =
+        static_cast<int>((keypoints2[i2].x - min_point.x()) / cell_size);
+    const int row =
+        static_cast<int>((keypoints2[i2].y - min_point.y()) / cell_size);
+    grid[row * num_cols + col].push_back(static_cast<int>(i2));
+  }
+
+  const Eigen::Vector2d clip_min_point =
+      min_point - Eigen::Vector2d::Constant(max_error);
+  const Eigen::Vector2d clip_max_point =
+      max_point + Eigen::Vector2d::Constant(max_error);
+  const double max_error_sq = max_error * max_error;
+  const double min_inv_depth = 1.0 / options.refrac_guided_max_depth;
+  const double max_inv_depth = 1.0 / options.refrac_guided_min_depth;
+
+  std::vector<int> visited(keypoints2.size(), -1);
+  std::vector<Eigen::Vector2d> curve;
+  curve.reserve(options.refrac_guided_num_samples);
+
+  for (size_t i1 = 0; i1 < keypoints1.size(); ++i1) {
+    const Ray3D ray1 = CamFromImgRay(
+        camera1, Eigen::Vector2d(keypoints1[i1].x, keypoints1[i1].y));
+    if (!ray1.dir.allFinite()) {
+      continue;
+    }
+
+    curve.clear();
+    for (int k = 0; k < options.refrac_guided_num_samples; ++k) {
+      const double inv_depth =
+          max_inv_depth - (max_inv_depth - min_inv_depth) * k /
+                              (options.refrac_guided_num_samples - 1);
+      const Eigen::Vector3d point2 = cam2_from_cam1 * ray1.At(1 / inv_depth);
+      if (point2.z() <= 0) {
+        continue;
+      }
+      const Eigen::Vector2d image_point2 = ImgFromCamPoint(camera2, point2);
+      if (image_point2.allFinite()) {
+        curve.push_back(image_point2);
+      }
+    }
+
+    if (curve.size() == 1) {
+      curve.push_back(curve.front());
+    }
+
+    for (size_t k = 1; k < curve.size(); ++k) {
+      Eigen::Vector2d start = curve[k - 1];
+      Eigen::Vector2d end = curve[k];
+      if (!ClipSegment(clip_min_point, clip_max_point, &start, &end)) {
+        continue;
+      }
+
+      // Split the segment into pieces no longer than the cell size, such that
+      // only the cells in the neighborhood of every piece are visited.
+      const int num_pieces = std::max(
+          1, static_cast<int>(std::ceil((end - start).norm() / cell_size)));
+      for (int piece = 0; piece < num_pieces; ++piece) {
+        const Eigen::Vector2d piece_start =
+            start + (end - start) * piece / num_pieces;
+        const Eigen::Vector2d piece_end =
+            start + (end - start) * (piece + 1) / num_pieces;
+        const Eigen::Vector2d piece_min =
+            piece_start.cwiseMin(piece_end) - min_point;
+        const Eigen::Vector2d piece_max =
+            piece_start.cwiseMax(piece_end) - min_point;
+        const int min_col = std::max(
+            0, static_cast<int>(std::floor((piece_min.x() - max_error) /
+                                           cell_size)));
+        const int max_col = std::min(
+            num_cols - 1,
+            static_cast<int>(
+                std::floor((piece_max.x() + max_error) / cell_size)));
+        const int min_row = std::max(
+            0, static_cast<int>(std::floor((piece_min.y() - max_error) /
+                                           cell_size)));
+        const int max_row = std::min(
+            num_rows - 1,
+            static_cast<int>(
+                std::floor((piece_max.y() + max_error) / cell_size)));
+        for (int row = min_row; row <= max_row; ++row) {
+          for (int col = min_col; col <= max_col; ++col) {
+            for (const int i2 : grid[row * num_cols + col]) {
+              if (visited[i2] == static_cast<int>(i1)) {
+                continue;
+              }
+              const Eigen::Vector2d point2(keypoints2[i2].x, keypoints2[i2].y);
+              if (SquaredDistanceToSegment(point2, piece_start, piece_end) <=
+                  max_error_sq) {
+                visited[i2] = static_cast<int>(i1);
+                candidates[i1].push_back(i2);
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+
+  return candidates;
+}
+
+// Guided matching of a refractive image pair, where the descriptor distances
+// are only computed for the candidates on the epipolar curves and the best
+// matches are found among the candidates.
+void MatchGuidedRefracCandidates(const SiftMatchingOptions& options,
+                                 const TwoViewGeometryOptions& geometry_options,
+                                 const Camera& camera1,
+                                 const Camera& camera2,
+                                 const FeatureKeypoints& keypoints1,
+                                 const FeatureKeypoints& keypoints2,
+                                 const FeatureDescriptors& descriptors1,
+                                 const FeatureDescriptors& descriptors2,
+                                 TwoViewGeometry* two_view_geometry) {
+  CHECK_EQ(descriptors1.rows(), keypoints1.size());
+  CHECK_EQ(descriptors2.rows(), keypoints2.size());
+
+  const std::vector<std::vector<int>> candidates_1to2 =
+      FindRefracGuidedCandidates(options,
+                                 geometry_options.ransac_options.max_error,
+                                 camera1,
+                                 camera2,
+                                 keypoints1,
+                                 keypoints2,
+                                 two_view_geometry->cam2_from_cam1);
+
+  std::vector<std::vector<int>> candidates_2to1(keypoints2.size());
+  size_t max_num_candidates_1to2 = 0;
+  for (size_t i1 = 0; i1 < candidates_1to2.size(); ++i1) {
+    max_num_candidates_1to2 =
+        std::max(max_num_candidates_1to2, candidates_1to2[i1].size());
+    for (const int i2 : candidates_1to2[i1]) {
+      candidates_2to1[i2].push_back(static_cast<int>(i1));
+    }
+  }
+  size_t max_num_candidates_2to1 = 0;
+  for (const auto& candidates : candidates_2to1) {
+    max_num_candidates_2to1 =
+        std::max(max_num_candidates_2to1, candidates.size());
+  }
+
+  const Eigen::Matrix<int, Eigen::Dynamic, 128> descriptors1_int =
+      descriptors1.cast<int>();
+  const Eigen::Matrix<int, Eigen::Dynamic, 128> descriptors2_int =
+      descriptors2.cast<int>();
+
+  // Missing candidates have zero distance, which never results in a match.
+  Eigen::Matrix<int, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>
+      indices_1to2 = Eigen::MatrixXi::Zero(keypoints1.size(),
+                                           max_num_candidates_1to2);
+  Eigen::Matrix<int, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>
+      distances_1to2 = indices_1to2;
+  Eigen::Matrix<int, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>
+      indices_2to1 = Eigen::MatrixXi::Zero(keypoints2.size(),
+                                           max_num_candidates_2to1);
+  Eigen::Matrix<int, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>
+      distances_2to1 = indices_2to1;
+
+  for (size_t i1 = 0; i1 < candidates_1to2.size(); ++i1) {
+    for (size_t k = 0; k < candidates_1to2[i1].size(); ++k) {
+      const int i2 = candidates_1to2[i1][k];
+      indices_1to2(i1, k) = i2;
+      distances_1to2(i1, k) =
+          descriptors1_int.row(i1).dot(descriptors2_int.row(i2));
+    }
+  }
+  for (size_t i2 = 0; i2 < candidates_2to1.size(); ++i2) {
+    for (size_t k = 0; k < candidates_2to1[i2].size(); ++k) {
+      const int i1 = candidates_2to1[i2][k];
+      indices_2to1(i2, k) = i1;
+      distances_2to1(i2, k) =
+          descriptors1_int.row(i1).dot(descriptors2_int.row(i2));
+    }
+  }
+
+  FindBestMatchesFlann(indices_1to2,
+                       distances_1to2,
+                       indices_2to1,
+                       distances_2to1,
+                       options.max_ratio,
+                       options.max_distance,
+                       options.cross_check,
+                       &two_view_geometry->inlier_matches);
+}
+
+using FlannIndexType = flann::Index<flann::L2<uint8_t>>;
+
+constexpr size_t kNumTreesInFlannForest = 4;
+
+std::shared_ptr<const FlannIndexType> BuildFlannIndex(
+    const FeatureDescriptors& descriptors) {
+  CHECK_EQ(descriptors.cols(), 128);
+  if (descriptors.rows() == 0) {
+    // Flann is not happy when the input has no descriptors.
+    return nullptr;
+  }
+  const flann::Matrix<uint8_t> descriptors_matrix(
+      const_cast<uint8_t*>(descriptors.data()), descriptors.rows(), 128);
+  auto index = std::make_shared<FlannIndexType>(
+      descriptors_matrix, flann::KDTreeIndexParams(kNumTreesInFlannForest));
+  index->buildIndex();
+  return index;
+}
+
+// Least recently used cache of FLANN indices, which is shared by all CPU
+// matchers, such that the index of an image is only built once, even if its
+// pairs are not matched in sequential order or by different threads. The
+// indices reference the memory of their descriptors, so an index is only
+// reused as long as its descriptors are alive, e.g., in the descriptor cache
+// of the matching controller. The cache is cleared once the last CPU matcher
+// is destroyed.
+class FlannIndexCache {
+ public:
+  static FlannIndexCache& Instance() {
+    static FlannIndexCache cache;
+    return cache;
+  }
+
+  void RegisterMatcher() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    num_matchers_ += 1;
+  }
+
+  void DeregisterMatcher() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    CHECK_GT(num_matchers_, 0);
+    num_matchers_ -= 1;
+    if (num_matchers_ == 0) {
+      entries_list_.clear();
+      entries_map_.clear();
+      num_bytes_ = 0;
+    }
+  }
+
+  std::shared_ptr<const FlannIndexType> GetIndex(
+      const std::shared_ptr<const FeatureDescriptors>& descriptors,
+      const size_t max_num_bytes) {
+    CHECK_NOTNULL(descriptors);
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      const auto it = entries_map_.find(descriptors.get());
+      if (it != entries_map_.end()) {
+        if (it->second->descriptors.lock() == descriptors) {
+          entries_list_.splice(
+              entries_list_.begin(), entries_list_, it->second);
+          return it->second->index;
+        }
+        // The descriptors of the entry were released and their memory reused.
+        Erase(it);
+      }
+    }
+
+    // Build the index without holding the lock, so that other threads can
+    // concurrently build or retrieve their indices.
+    std::shared_ptr<const FlannIndexType> index =
+        BuildFlannIndex(*descriptors);
+
+    // Approximate memory of the kd-trees, excluding the descriptors.
+    const size_t num_bytes =
+        descriptors->rows() * kNumTreesInFlannForest * 64 * sizeof(uint8_t);
+    if (num_bytes > max_num_bytes) {
+      return index;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto it = entries_map_.find(descriptors.get());
+    if (it != entries_map_.end()) {
+      Erase(it);
+    }
+    entries_list_.push_front({descriptors, index, num_bytes});
+    entries_map_.emplace(descriptors.get(), entries_list_.begin());
+    num_bytes_ += num_bytes;
+    while (num_bytes_ > max_num_bytes) {
+      Erase(entries_map_.find(entries_list_.back().key));
+    }
+
+    return index;
+  }
+
+ private:
+  struct Entry {
+    Entry(const std::shared_ptr<const FeatureDescriptors>& descriptors,
+          std::shared_ptr<const FlannIndexType> index,
+          const size_t num_bytes)
+        : key(descriptors.get()),
+          descriptors(descriptors),
+          index(std::move(index)),
+          num_bytes(num_bytes) {}
+    const FeatureDescriptors* key;
+    std::weak_ptr<const FeatureDescriptors> descriptors;
+    std::shared_ptr<const FlannIndexType> index;
+    size_t num_bytes;
+  };
+
+  using EntryMap =
+      std::unordered_map<const FeatureDescriptors*, std::list<Entry>::iterator>;
+
+  void Erase(const EntryMap::iterator& it) {
+    num_bytes_ -= it->second->num_bytes;
+    entries_list_.erase(it->second);
+    entries_map_.erase(it);
+  }
+
+  std::mutex mutex_;
+  size_t num_matchers_ = 0;
+  size_t num_bytes_ = 0;
+  std::list<Entry> entries_list_;
+  EntryMap entries_map_;
+};
+
 class SiftCPUFeatureMatcher : public FeatureMatcher {
  public:
   explicit SiftCPUFeatureMatcher(const SiftMatchingOptions& options)
       : options_(options) {
     CHECK(options_.Check());
+    FlannIndexCache::Instance().RegisterMatcher();
+  }
+
+  ~SiftCPUFeatureMatcher() override {
+    // Release the indices before the cache is possibly cleared.
+    flann_index1_.reset();
+    flann_index2_.reset();
+    FlannIndexCache::Instance().DeregisterMatcher();
   }
 
   static std::unique_ptr<FeatureMatcher> Create(
@@ -1021,13 +1772,13 @@ class SiftCPUFeatureMatcher : public FeatureMatcher {
     if (descriptors1 != nullptr) {
       CHECK_EQ(descriptors1->cols(), 128);
       descriptors1_ = descriptors1;
-      flann_index1_ = BuildFlannIndex(*descriptors1_);
+      flann_index1_.reset();
     }
 
     if (descriptors2 != nullptr) {
       CHECK_EQ(descriptors2->cols(), 128);
       descriptors2_ = descriptors2;
-      flann_index2_ = BuildFlannIndex(*descriptors2_);
+      flann_index2_.reset();
     }
 
     CHECK_NOTNULL(descriptors1_);
@@ -1038,9 +1789,8 @@ class SiftCPUFeatureMatcher : public FeatureMatcher {
     }
 
     if (options_.brute_force_cpu_matcher) {
-      const Eigen::MatrixXi distances = ComputeSiftDistanceMatrix(
-          nullptr, nullptr, *descriptors1_, *descriptors2_, nullptr);
-      FindBestMatchesBruteForce(distances,
+      FindBestMatchesBruteForce(*descriptors1_,
+                                *descriptors2_,
                                 options_.max_ratio,
                                 options_.max_distance,
                                 options_.cross_check,
@@ -1048,6 +1798,13 @@ class SiftCPUFeatureMatcher : public FeatureMatcher {
       return;
     }
 
+    if (flann_index1_ == nullptr) {
+      flann_index1_ = GetFlannIndex(descriptors1_);
+    }
+    if (flann_index2_ == nullptr) {
+      flann_index2_ = GetFlannIndex(descriptors2_);
+    }
+
     Eigen::Matrix<int, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>
         indices_1to2;
     Eigen::Matrix<int, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>
@@ -1096,7 +1853,7 @@ class SiftCPUFeatureMatcher : public FeatureMatcher {
       CHECK_EQ(descriptors1->cols(), 128);
       keypoints1_ = keypoints1;
       descriptors1_ = descriptors1;
-      flann_index1_ = BuildFlannIndex(*descriptors1_);
+      flann_index1_.reset();
     }
 
     if (descriptors2 != nullptr) {
@@ -1105,7 +1862,7 @@ class SiftCPUFeatureMatcher : public FeatureMatcher {
       CHECK_EQ(descriptors2->cols(), 128);
       keypoints2_ = keypoints2;
       descriptors2_ = descriptors2;
-      flann_index2_ = BuildFlannIndex(*descriptors2_);
+      flann_index2_.reset();
     }
 
     const float max_residual =
@@ -1179,23 +1936,133 @@ class SiftCPUFeatureMatcher : public FeatureMatcher {
                          &two_view_geometry->inlier_matches);
   }
 
- private:
-  using FlannIndexType = flann::Index<flann::L2<uint8_t>>;
+  void MatchGuidedRefrac(
+      const TwoViewGeometryOptions& options,
+      const Camera& camera1,
+      const Camera& camera2,
+      const std::shared_ptr<const FeatureKeypoints>& keypoints1,
+      const std::shared_ptr<const FeatureKeypoints>& keypoints2,
+      const std::shared_ptr<const FeatureDescriptors>& descriptors1,
+      const std::shared_ptr<const FeatureDescriptors>& descriptors2,
+      TwoViewGeometry* two_view_geometry) override {
+    CHECK_NOTNULL(two_view_geometry);
+    two_view_geometry->inlier_matches.clear();
 
-  static std::unique_ptr<FlannIndexType> BuildFlannIndex(
-      const FeatureDescriptors& descriptors) {
-    CHECK_EQ(descriptors.cols(), 128);
-    if (descriptors.rows() == 0) {
-      // Flann is not happy when the input has no descriptors.
-      return nullptr;
+    if (descriptors1 != nullptr) {
+      CHECK_NOTNULL(keypoints1);
+      CHECK_EQ(descriptors1->cols(), 128);
+      keypoints1_ = keypoints1;
+      descriptors1_ = descriptors1;
+      flann_index1_.reset();
+    }
+
+    if (descriptors2 != nullptr) {
+      CHECK_NOTNULL(keypoints2);
+      CHECK_EQ(descriptors2->cols(), 128);
+      keypoints2_ = keypoints2;
+      descriptors2_ = descriptors2;
+      flann_index2_.reset();
+    }
+
+    if (two_view_geometry->config != TwoViewGeometry::REFRACTIVE) {
+      return;
+    }
+
+    MatchGuidedRefracCandidates(options_,
+                                options,
+                                camera1,
+                                camera2,
+                                *keypoints1_,
+                                *keypoints2_,
+                                *descriptors1_,
+                                *descriptors2_,
+                                two_view_geometry);
+  }
+
+  void MatchQuantized(
+      const ProductQuantizer& quantizer,
+      const std::shared_ptr<const FeatureDescriptors>& codes1,
+      const std::shared_ptr<const FeatureDescriptors>& codes2,
+      const std::shared_ptr<const FeatureDescriptors>& descriptors1,
+      const std::shared_ptr<const FeatureDescriptors>& descriptors2,
+      FeatureMatches* matches) override {
+    CHECK_NOTNULL(matches);
+    matches->clear();
+
+    // Without re-ranking, the decoded codes are the queries.
+    const bool rerank = options_.descriptor_codes_num_candidates > 0;
+
+    if (codes1 != nullptr) {
+      CHECK_EQ(codes1->cols(), ProductQuantizer::kNumSubspaces);
+      codes1_ = codes1;
+      if (!rerank) {
+        decoded_descriptors1_ = quantizer.Decode(*codes1_);
+      }
+    }
+
+    if (codes2 != nullptr) {
+      CHECK_EQ(codes2->cols(), ProductQuantizer::kNumSubspaces);
+      codes2_ = codes2;
+      if (!rerank) {
+        decoded_descriptors2_ = quantizer.Decode(*codes2_);
+      }
+    }
+
+    CHECK_NOTNULL(codes1_);
+    CHECK_NOTNULL(codes2_);
+
+    if (rerank) {
+      if (descriptors1 != nullptr) {
+        CHECK_EQ(descriptors1->cols(), 128);
+        descriptors1_ = descriptors1;
+        flann_index1_.reset();
+      }
+      if (descriptors2 != nullptr) {
+        CHECK_EQ(descriptors2->cols(), 128);
+        descriptors2_ = descriptors2;
+        flann_index2_.reset();
+      }
+      CHECK_NOTNULL(descriptors1_);
+      CHECK_NOTNULL(descriptors2_);
+      CHECK_EQ(descriptors1_->rows(), codes1_->rows());
+      CHECK_EQ(descriptors2_->rows(), codes2_->rows());
+    }
+
+    if (codes1_->rows() == 0 || codes2_->rows() == 0) {
+      return;
+    }
+
+    if (rerank) {
+      FindBestMatchesQuantized(quantizer,
+                               *descriptors1_,
+                               *codes1_,
+                               descriptors1_.get(),
+                               *descriptors2_,
+                               *codes2_,
+                               descriptors2_.get(),
+                               options_,
+                               matches);
+    } else {
+      FindBestMatchesQuantized(quantizer,
+                               decoded_descriptors1_,
+                               *codes1_,
+                               nullptr,
+                               decoded_descriptors2_,
+                               *codes2_,
+                               nullptr,
+                               options_,
+                               matches);
     }
-    const flann::Matrix<uint8_t> descriptors_matrix(
-        const_cast<uint8_t*>(descriptors.data()), descriptors.rows(), 128);
-    constexpr size_t kNumTreesInForest = 4;
-    auto index = std::make_unique<FlannIndexType>(
-        descriptors_matrix, flann::KDTreeIndexParams(kNumTreesInForest));
-    index->buildIndex();
-    return index;
+  }
+
+ private:
+  // Returns the index of the given descriptors, which is only built, if it is
+  // not in the cache shared with the other matchers.
+  std::shared_ptr<const FlannIndexType> GetFlannIndex(
+      const std::shared_ptr<const FeatureDescriptors>& descriptors) const {
+    return FlannIndexCache::Instance().GetIndex(
+        descriptors,
+        static_cast<size_t>(options_.flann_index_cache_size_mb * 1024 * 1024));
   }
 
   const SiftMatchingOptions options_;
@@ -1203,8 +2070,13 @@ class SiftCPUFeatureMatcher : public FeatureMatcher {
   std::shared_ptr<const FeatureKeypoints> keypoints2_;
   std::shared_ptr<const FeatureDescriptors> descriptors1_;
   std::shared_ptr<const FeatureDescriptors> descriptors2_;
-  std::unique_ptr<FlannIndexType> flann_index1_;
-  std::unique_ptr<FlannIndexType> flann_index2_;
+  // The indices are only retrieved when needed by unguided matching.
+  std::shared_ptr<const FlannIndexType> flann_index1_;
+  std::shared_ptr<const FlannIndexType> flann_index2_;
+  std::shared_ptr<const FeatureDescriptors> codes1_;
+  std::shared_ptr<const FeatureDescriptors> codes2_;
+  FeatureDescriptors decoded_descriptors1_;
+  FeatureDescriptors decoded_descriptors2_;
 };
 
 #if defined(COLMAP_GPU_ENABLED)
@@ -1275,10 +2147,12 @@ class SiftGPUFeatureMatcher : public FeatureMatcher {
 #endif  // COLMAP_CUDA_ENABLED
 
     matcher->sift_match_gpu_.gpu_index = gpu_indices[0];
-    if (sift_match_gpu_mutexes_.count(gpu_indices[0]) == 0) {
-      sift_match_gpu_mutexes_.emplace(gpu_indices[0],
-                                      std::make_unique<std::mutex>());
-    }
+    GetSiftGPUMutex(&sift_match_gpu_mutexes_, gpu_indices[0]);
+
+    matcher->max_cached_descriptors_bytes_ = static_cast<size_t>(
+        options.gpu_descriptor_cache_size_mb * 1024 * 1024);
+    matcher->sift_match_gpu_.SetDescriptorCacheSize(
+        matcher->max_cached_descriptors_bytes_);
 
     return matcher;
   }
@@ -1290,27 +2164,32 @@ class SiftGPUFeatureMatcher : public FeatureMatcher {
     matches->clear();
 
     std::lock_guard<std::mutex> lock(
-        *sift_match_gpu_mutexes_[sift_match_gpu_.gpu_index]);
+        GetSiftGPUMutex(&sift_match_gpu_mutexes_, sift_match_gpu_.gpu_index));
 
     if (descriptors1 != nullptr) {
       CHECK_EQ(descriptors1->cols(), 128);
       WarnIfMaxNumMatchesReachedGPU(*descriptors1);
-      sift_match_gpu_.SetDescriptors(
-          0, descriptors1->rows(), descriptors1->data());
+      sift_match_gpu_.SetDescriptors(0,
+                                     descriptors1->rows(),
+                                     descriptors1->data(),
+                                     CachedDescriptorsId(descriptors1));
     }
 
     if (descriptors2 != nullptr) {
       CHECK_EQ(descriptors2->cols(), 128);
       WarnIfMaxNumMatchesReachedGPU(*descriptors2);
-      sift_match_gpu_.SetDescriptors(
-          1, descriptors2->rows(), descriptors2->data());
+      sift_match_gpu_.SetDescriptors(1,
+                                     descriptors2->rows(),
+                                     descriptors2->data(),
+                                     CachedDescriptorsId(descriptors2));
     }
 
-    matches->resize(static_cast<size_t>(options_.max_num_matches));
+    // SiftGPU returns pairs of indices without the ratios of the matches.
+    match_buffer_.resize(2 * static_cast<size_t>(options_.max_num_matches));
 
     const int num_matches = sift_match_gpu_.GetSiftMatch(
         options_.max_num_matches,
-        reinterpret_cast<uint32_t(*)[2]>(matches->data()),
+        reinterpret_cast<uint32_t(*)[2]>(match_buffer_.data()),
         static_cast<float>(options_.max_distance),
         static_cast<float>(options_.max_ratio),
         options_.cross_check);
@@ -1319,10 +2198,9 @@ class SiftGPUFeatureMatcher : public FeatureMatcher {
       LOG(ERROR) << "Feature matching failed. This is probably caused by "
                     "insufficient GPU memory. Consider reducing the maximum "
                     "number of features and/or matches.";
-      matches->clear();
     } else {
-      CHECK_LE(num_matches, matches->size());
-      matches->resize(num_matches);
+      CHECK_LE(num_matches, options_.max_num_matches);
+      CopyMatchBuffer(num_matches, matches);
     }
   }
 
@@ -1333,48 +2211,13 @@ class SiftGPUFeatureMatcher : public FeatureMatcher {
       const std::shared_ptr<const FeatureDescriptors>& descriptors1,
       const std::shared_ptr<const FeatureDescriptors>& descriptors2,
       TwoViewGeometry* two_view_geometry) override {
-    static_assert(offsetof(FeatureKeypoint, x) == 0 * sizeof(float),
-                  "Invalid keypoint format");
-    static_assert(offsetof(FeatureKeypoint, y) == 1 * sizeof(float),
-                  "Invalid keypoint format");
-    static_assert(sizeof(FeatureKeypoint) == 6 * sizeof(float),
-                  "Invalid keypoint format");
-
     CHECK_NOTNULL(two_view_geometry);
     two_view_geometry->inlier_matches.clear();
 
     std::lock_guard<std::mutex> lock(
-        *sift_match_gpu_mutexes_[sift_match_gpu_.gpu_index]);
+        GetSiftGPUMutex(&sift_match_gpu_mutexes_, sift_match_gpu_.gpu_index));
 
-    constexpr size_t kFeatureShapeNumElems = 4;
-
-    if (descriptors1 != nullptr) {
-      CHECK_NOTNULL(keypoints1);
-      CHECK_EQ(descriptors1->rows(), keypoints1->size());
-      CHECK_EQ(descriptors1->cols(), 128);
-      WarnIfMaxNumMatchesReachedGPU(*descriptors1);
-      const size_t kIndex = 0;
-      sift_match_gpu_.SetDescriptors(
-          kIndex, descriptors1->rows(), descriptors1->data());
-      sift_match_gpu_.SetFeautreLocation(
-          kIndex,
-          reinterpret_cast<const float*>(keypoints1->data()),
-          kFeatureShapeNumElems);
-    }
-
-    if (descriptors2 != nullptr) {
-      CHECK_NOTNULL(keypoints2);
-      CHECK_EQ(descriptors2->rows(), keypoints2->size());
-      CHECK_EQ(descriptors2->cols(), 128);
-      WarnIfMaxNumMatchesReachedGPU(*descriptors2);
-      const size_t kIndex = 1;
-      sift_match_gpu_.SetDescriptors(
-          kIndex, descriptors2->rows(), descriptors2->data());
-      sift_match_gpu_.SetFeautreLocation(
-          kIndex,
-          reinterpret_cast<const float*>(keypoints2->data()),
-          kFeatureShapeNumElems);
-    }
+    SetGuidedFeatures(keypoints1, keypoints2, descriptors1, descriptors2);
 
     Eigen::Matrix<float, 3, 3, Eigen::RowMajor> F;
     Eigen::Matrix<float, 3, 3, Eigen::RowMajor> H;
@@ -1396,16 +2239,14 @@ class SiftGPUFeatureMatcher : public FeatureMatcher {
 
     CHECK(F_ptr != nullptr || H_ptr != nullptr);
 
-    two_view_geometry->inlier_matches.resize(
-        static_cast<size_t>(options_.max_num_matches));
+    match_buffer_.resize(2 * static_cast<size_t>(options_.max_num_matches));
 
     const float max_residual = static_cast<float>(
         options.ransac_options.max_error * options.ransac_options.max_error);
 
     const int num_matches = sift_match_gpu_.GetGuidedSiftMatch(
         options_.max_num_matches,
-        reinterpret_cast<uint32_t(*)[2]>(
-            two_view_geometry->inlier_matches.data()),
+        reinterpret_cast<uint32_t(*)[2]>(match_buffer_.data()),
         H_ptr,
         F_ptr,
         static_cast<float>(options_.max_distance),
@@ -1418,14 +2259,195 @@ class SiftGPUFeatureMatcher : public FeatureMatcher {
       LOG(ERROR) << "Feature matching failed. This is probably caused by "
                     "insufficient GPU memory. Consider reducing the maximum "
                     "number of features.";
-      two_view_geometry->inlier_matches.clear();
     } else {
-      CHECK_LE(num_matches, two_view_geometry->inlier_matches.size());
-      two_view_geometry->inlier_matches.resize(num_matches);
+      CHECK_LE(num_matches, options_.max_num_matches);
+      CopyMatchBuffer(num_matches, &two_view_geometry->inlier_matches);
+    }
+  }
+
+  void MatchGuidedRefrac(
+      const TwoViewGeometryOptions& options,
+      const Camera& camera1,
+      const Camera& camera2,
+      const std::shared_ptr<const FeatureKeypoints>& keypoints1,
+      const std::shared_ptr<const FeatureKeypoints>& keypoints2,
+      const std::shared_ptr<const FeatureDescriptors>& descriptors1,
+      const std::shared_ptr<const FeatureDescriptors>& descriptors2,
+      TwoViewGeometry* two_view_geometry) override {
+    CHECK_NOTNULL(two_view_geometry);
+    two_view_geometry->inlier_matches.clear();
+
+    {
+      // The features are uploaded, such that the GPU state stays consistent
+      // with the features of later calls that pass a nullptr.
+      std::lock_guard<std::mutex> lock(
+          GetSiftGPUMutex(&sift_match_gpu_mutexes_, sift_match_gpu_.gpu_index));
+      SetGuidedFeatures(keypoints1, keypoints2, descriptors1, descriptors2);
     }
+
+    if (two_view_geometry->config != TwoViewGeometry::REFRACTIVE) {
+      return;
+    }
+
+    // SiftGPU only supports guided matching with a fundamental matrix or a
+    // homography, hence the refractive epipolar curves are matched on the CPU.
+    MatchGuidedRefracCandidates(options_,
+                                options,
+                                camera1,
+                                camera2,
+                                *keypoints1_,
+                                *keypoints2_,
+                                *descriptors1_,
+                                *descriptors2_,
+                                two_view_geometry);
+  }
+
+  void MatchQuantized(
+      const ProductQuantizer& quantizer,
+      const std::shared_ptr<const FeatureDescriptors>& codes1,
+      const std::shared_ptr<const FeatureDescriptors>& codes2,
+      const std::shared_ptr<const FeatureDescriptors>& descriptors1,
+      const std::shared_ptr<const FeatureDescriptors>& descriptors2,
+      FeatureMatches* matches) override {
+    // SiftGPU cannot search with distance tables, hence the codes are decoded
+    // and their nearest neighbors are searched exhaustively on the GPU. The
+    // decoded descriptors are temporary and not cached on the GPU.
+    const bool cache_descriptors = cache_descriptors_;
+    cache_descriptors_ = false;
+    std::shared_ptr<const FeatureDescriptors> decoded_descriptors1;
+    if (codes1 != nullptr) {
+      decoded_descriptors1 =
+          std::make_shared<FeatureDescriptors>(quantizer.Decode(*codes1));
+    }
+    std::shared_ptr<const FeatureDescriptors> decoded_descriptors2;
+    if (codes2 != nullptr) {
+      decoded_descriptors2 =
+          std::make_shared<FeatureDescriptors>(quantizer.Decode(*codes2));
+    }
+
+    Match(decoded_descriptors1, decoded_descriptors2, matches);
+    cache_descriptors_ = cache_descriptors;
+
+    if (options_.descriptor_codes_num_candidates == 0) {
+      return;
+    }
+
+    // The GPU only returns the best candidate, whose exact distance is
+    // checked with the raw descriptors instead of re-ranking.
+    if (descriptors1 != nullptr) {
+      descriptors1_ = descriptors1;
+    }
+    if (descriptors2 != nullptr) {
+      descriptors2_ = descriptors2;
+    }
+    CHECK_NOTNULL(descriptors1_);
+    CHECK_NOTNULL(descriptors2_);
+
+    // SIFT descriptor vectors are normalized to length 512.
+    const int min_dot_product = static_cast<int>(
+        std::ceil(512.0 * 512.0 * std::cos(options_.max_distance)));
+    matches->erase(
+        std::remove_if(matches->begin(),
+                       matches->end(),
+                       [&](const FeatureMatch& match) {
+                         return descriptors1_->row(match.point2D_idx1)
+                                    .cast<int>()
+                                    .dot(descriptors2_->row(match.point2D_idx2)
+                                             .cast<int>()) < min_dot_product;
+                       }),
+        matches->end());
   }
 
  private:
+  void SetGuidedFeatures(
+      const std::shared_ptr<const FeatureKeypoints>& keypoints1,
+      const std::shared_ptr<const FeatureKeypoints>& keypoints2,
+      const std::shared_ptr<const FeatureDescriptors>& descriptors1,
+      const std::shared_ptr<const FeatureDescriptors>& descriptors2) {
+    static_assert(offsetof(FeatureKeypoint, x) == 0 * sizeof(float),
+                  "Invalid keypoint format");
+    static_assert(offsetof(FeatureKeypoint, y) == 1 * sizeof(float),
+                  "Invalid keypoint format");
+    static_assert(sizeof(FeatureKeypoint) == 6 * sizeof(float),
+                  "Invalid keypoint format");
+
+    constexpr size_t kFeatureShapeNumElems = 4;
+
+    if (descriptors1 != nullptr) {
+      CHECK_NOTNULL(keypoints1);
+      CHECK_EQ(descriptors1->rows(), keypoints1->size());
+      CHECK_EQ(descriptors1->cols(), 128);
+      WarnIfMaxNumMatchesReachedGPU(*descriptors1);
+      const size_t kIndex = 0;
+      sift_match_gpu_.SetDescriptors(kIndex,
+                                     descriptors1->rows(),
+                                     descriptors1->data(),
+                                     CachedDescriptorsId(descriptors1));
+      sift_match_gpu_.SetFeautreLocation(
+          kIndex,
+          reinterpret_cast<const float*>(keypoints1->data()),
+          kFeatureShapeNumElems);
+      keypoints1_ = keypoints1;
+      descriptors1_ = descriptors1;
+    }
+
+    if (descriptors2 != nullptr) {
+      CHECK_NOTNULL(keypoints2);
+      CHECK_EQ(descriptors2->rows(), keypoints2->size());
+      CHECK_EQ(descriptors2->cols(), 128);
+      WarnIfMaxNumMatchesReachedGPU(*descriptors2);
+      const size_t kIndex = 1;
+      sift_match_gpu_.SetDescriptors(kIndex,
+                                     descriptors2->rows(),
+                                     descriptors2->data(),
+                                     CachedDescriptorsId(descriptors2));
+      sift_match_gpu_.SetFeautreLocation(
+          kIndex,
+          reinterpret_cast<const float*>(keypoints2->data()),
+          kFeatureShapeNumElems);
+      keypoints2_ = keypoints2;
+      descriptors2_ = descriptors2;
+    }
+  }
+
+  // Identifier of the descriptors in the resident descriptor cache of SiftGPU
+  // or -1, if they are not cached. The descriptors are retained as long as
+  // they have an identifier, such that their address identifies them.
+  int CachedDescriptorsId(
+      const std::shared_ptr<const FeatureDescriptors>& descriptors) {
+    if (!cache_descriptors_ || max_cached_descriptors_bytes_ == 0) {
+      return -1;
+    }
+
+    for (auto it = cached_descriptors_.begin(); it != cached_descriptors_.end();
+         ++it) {
+      if (it->first == descriptors) {
+        cached_descriptors_.splice(
+            cached_descriptors_.begin(), cached_descriptors_, it);
+        return it->second;
+      }
+    }
+
+    const size_t num_bytes = descriptors->size();
+    while (!cached_descriptors_.empty() &&
+           cached_descriptors_bytes_ + num_bytes >
+               max_cached_descriptors_bytes_) {
+      cached_descriptors_bytes_ -= cached_descriptors_.back().first->size();
+      cached_descriptors_.pop_back();
+    }
+    cached_descriptors_bytes_ += num_bytes;
+    cached_descriptors_.emplace_front(descriptors, next_descriptors_id_++);
+    return cached_descriptors_.front().second;
+  }
+
+  void CopyMatchBuffer(const int num_matches, FeatureMatches* matches) const {
+    matches->resize(num_matches);
+    for (int i = 0; i < num_matches; ++i) {
+      (*matches)[i].point2D_idx1 = match_buffer_[2 * i];
+      (*matches)[i].point2D_idx2 = match_buffer_[2 * i + 1];
+    }
+  }
+
   void WarnIfMaxNumMatchesReachedGPU(const FeatureDescriptors& descriptors) {
     if (sift_match_gpu_.GetMaxSift() < descriptors.rows()) {
       LOG(WARNING) << StringPrintf(
@@ -1438,6 +2460,21 @@ class SiftGPUFeatureMatcher : public FeatureMatcher {
 
   const SiftMatchingOptions options_;
   SiftMatchGPU sift_match_gpu_;
+  std::vector<uint32_t> match_buffer_;
+  // The features of the last guided matching, kept on the CPU for the guided
+  // matching of refractive image pairs.
+  std::shared_ptr<const FeatureKeypoints> keypoints1_;
+  std::shared_ptr<const FeatureKeypoints> keypoints2_;
+  std::shared_ptr<const FeatureDescriptors> descriptors1_;
+  std::shared_ptr<const FeatureDescriptors> descriptors2_;
+  // The descriptors with an identifier in the resident descriptor cache of
+  // SiftGPU, most recently used first. SiftGPU treats 0 as unset.
+  bool cache_descriptors_ = true;
+  size_t max_cached_descriptors_bytes_ = 0;
+  size_t cached_descriptors_bytes_ = 0;
+  int next_descriptors_id_ = 1;
+  std::list<std::pair<std::shared_ptr<const FeatureDescriptors>, int>>
+      cached_descriptors_;
 };
 #endif  // COLMAP_GPU_ENABLED
 
@@ -1511,4 +2548,56 @@ void LoadSiftFeaturesFromTextFile(const std::string& path,
   }
 }
 
+void LoadSiftFeaturesFromBinaryFile(const std::string& path,
+                                    FeatureKeypoints* keypoints,
+                                    FeatureDescriptors* descriptors) {
+  CHECK_NOTNULL(keypoints);
+  CHECK_NOTNULL(descriptors);
+
+  std::ifstream file(path, std::ios::binary);
+  CHECK(file.is_open()) << path;
+
+  const size_t num_features = ReadBinaryLittleEndian<uint64_t>(&file);
+  const size_t dim = ReadBinaryLittleEndian<uint64_t>(&file);
+  CHECK_EQ(dim, 128) << "SIFT features must have 128 dimensions";
+
+  std::vector<float> keypoint_data(6 * num_features);
+  ReadBinaryLittleEndian<float>(&file, &keypoint_data);
+  keypoints->resize(num_features);
+  for (size_t i = 0; i < num_features; ++i) {
+    const float* data = &keypoint_data[6 * i];
+    (*keypoints)[i] =
+        FeatureKeypoint(data[0], data[1], data[2], data[3], data[4], data[5]);
+  }
+
+  // The descriptors are stored in the row-major order of the matrix.
+  descriptors->resize(num_features, dim);
+  file.read(reinterpret_cast<char*>(descriptors->data()),
+            num_features * dim * sizeof(uint8_t));
+  CHECK(file) << "Unexpected end of file " << path;
+}
+
+void WriteSiftFeaturesToBinaryFile(const std::string& path,
+                                   const FeatureKeypoints& keypoints,
+                                   const FeatureDescriptors& descriptors) {
+  CHECK_EQ(keypoints.size(), descriptors.rows());
+  CHECK_EQ(descriptors.cols(), 128);
+
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  CHECK(file.is_open()) << path;
+
+  WriteBinaryLittleEndian<uint64_t>(&file, keypoints.size());
+  WriteBinaryLittleEndian<uint64_t>(&file, descriptors.cols());
+  for (const auto& keypoint : keypoints) {
+    WriteBinaryLittleEndian<float>(&file, keypoint.x);
+    WriteBinaryLittleEndian<float>(&file, keypoint.y);
+    WriteBinaryLittleEndian<float>(&file, keypoint.a11);
+    WriteBinaryLittleEndian<float>(&file, keypoint.a12);
+    WriteBinaryLittleEndian<float>(&file, keypoint.a21);
+    WriteBinaryLittleEndian<float>(&file, keypoint.a22);
+  }
+  file.write(reinterpret_cast<const char*>(descriptors.data()),
+             descriptors.size() * sizeof(uint8_t));
+}
+
 }  //  namespace colmap
@@ -45,12 +45,33 @@ struct SiftExtractionOptions {
   // you should separate multiple GPU indices by comma, e.g., "0,1,2,3".
   std::string gpu_index = "-1";
 
+  // Number of extraction threads per GPU. All threads take the next image from
+  // a shared queue, so that faster GPUs process more images. With more than
+  // one thread per GPU, reading and preparing the data of one image overlaps
+  // with the extraction of another image at the cost of more GPU memory.
+  int num_threads_per_gpu = 1;
+
   // Maximum image size, otherwise image will be down-scaled.
   int max_image_size = 3200;
 
   // Maximum number of features to detect, keeping larger-scale features.
   int max_num_features = 8192;
 
+  // Optional spatial bucketing of the features. If the cell size is positive,
+  // the image is divided into square cells of the given size in pixels and
+  // only the max_num_features_per_cell largest-scale features are kept per
+  // cell. This limits the number of features in strongly textured images and
+  // thereby the matching cost, while keeping the features in weakly textured
+  // regions of the image.
+  int feature_grid_cell_size = 0;
+  int max_num_features_per_cell = 64;
+
+  // Images whose standard deviation of the grey intensities in the range
+  // [0, 255] is below this threshold are considered featureless and are
+  // skipped without running the detector, e.g., open-water frames. Disabled
+  // if not positive.
+  double min_image_contrast = 0.0;
+
   // First octave in the pyramid, i.e. -1 upsamples the image by one level.
   int first_octave = -1;
 
@@ -132,6 +153,10 @@ struct SiftMatchingOptions {
   // you should separate multiple GPU indices by comma, e.g., "0,1,2,3".
   std::string gpu_index = "-1";
 
+  // Number of matching threads per GPU, see
+  // `SiftExtractionOptions::num_threads_per_gpu`.
+  int num_threads_per_gpu = 1;
+
   // Maximum distance ratio between first and second best match.
   double max_ratio = 0.8;
 
@@ -147,9 +172,52 @@ struct SiftMatchingOptions {
   // Whether to perform guided matching, if geometric verification succeeds.
   bool guided_matching = false;
 
+  // Depth range and number of depth samples along the refracted ray of a
+  // keypoint, from which its epipolar curve is sampled in guided matching of
+  // refractive image pairs.
+  double refrac_guided_min_depth = 0.1;
+  double refrac_guided_max_depth = 50.0;
+  int refrac_guided_num_samples = 32;
+
   // Whether to use brute-force instead of FLANN based CPU matching.
   bool brute_force_cpu_matcher = false;
 
+  // Maximum memory of the FLANN indices, which are cached and shared between
+  // the CPU matching threads, such that the index of an image is only built
+  // once for all its pairs. Disabled if 0.
+  double flann_index_cache_size_mb = 256.0;
+
+  // Maximum GPU memory of the descriptors, which are kept resident on the GPU
+  // of each matching thread, such that the descriptors of an image are only
+  // uploaded once for all its pairs in a block. Only supported by the CUDA
+  // matcher and disabled if 0.
+  double gpu_descriptor_cache_size_mb = 256.0;
+
+  // Whether to match the product-quantized descriptor codes instead of the raw
+  // descriptors in unguided matching, see `ProductQuantizer`. The codes are
+  // computed from the raw descriptors with the `descriptor_compressor`.
+  bool use_descriptor_codes = false;
+
+  // Number of nearest neighbor candidates of the approximate search on the
+  // descriptor codes, which are re-ranked by the exact distances of their raw
+  // descriptors. If 0, the raw descriptors are not read and the matches are
+  // selected by their approximate distances, which reduces the descriptor data
+  // read from the database by a factor of 8.
+  int descriptor_codes_num_candidates = 5;
+
+  // Number of shards, into which the matching is split, and the index of the
+  // shard matched by this process. Every shard matches every `num_shards`-th
+  // batch of image pairs, such that multiple nodes can match one dataset in
+  // parallel, each into its own copy of the database. The matches of the
+  // shards are then combined with the `database_shard_merger`.
+  int num_shards = 1;
+  int shard_index = 0;
+
+  // Whether to store the inlier matches of the two-view geometries in the
+  // compact, bit-packed encoding of the database, which reduces their size
+  // typically by a factor of 3 but cannot be read by older versions.
+  bool compact_inlier_matches = false;
+
   bool Check() const;
 };
 
@@ -177,4 +245,22 @@ void LoadSiftFeaturesFromTextFile(const std::string& path,
                                   FeatureKeypoints* keypoints,
                                   FeatureDescriptors* descriptors);
 
+// Load keypoints and descriptors from a binary file, which is much faster to
+// parse than the text format for large numbers of features. The file has the
+// following layout in little-endian byte order:
+//
+//    uint64_t:               NUM_FEATURES
+//    uint64_t:               DIM
+//    NUM_FEATURES x 6 float: X Y A_11 A_12 A_21 A_22
+//    NUM_FEATURES x DIM uint8_t: D_1 D_2 D_3 ... D_DIM
+//
+// where A_IJ is the affine shape of the keypoint, see `FeatureKeypoint`, which
+// is the identity for keypoints without shape, and DIM must be 128.
+void LoadSiftFeaturesFromBinaryFile(const std::string& path,
+                                    FeatureKeypoints* keypoints,
+                                    FeatureDescriptors* descriptors);
+void WriteSiftFeaturesToBinaryFile(const std::string& path,
+                                   const FeatureKeypoints& keypoints,
+                                   const FeatureDescriptors& descriptors);
+
 }  // namespace colmap
@@ -0,0 +1,90 @@
+#include "colmap/feature/sift.h"
+#include "colmap/feature/utils.h"
+#include "colmap/math/random.h"
+
+#include <cmath>
+
+#include <benchmark/benchmark.h>
+
+namespace colmap {
+namespace {
+
+FeatureDescriptors CreateRandomFeatureDescriptors(const size_t num_features,
+                                                  const unsigned seed) {
+  SetPRNGSeed(seed);
+  FeatureDescriptorsFloat descriptors(num_features, 128);
+  for (size_t i = 0; i < num_features; ++i) {
+    for (size_t j = 0; j < 128; ++j) {
+      descriptors(i, j) = std::pow(RandomUniformReal(0.0f, 1.0f), 2);
+    }
+  }
+  L2NormalizeFeatureDescriptors(&descriptors);
+  return FeatureDescriptorsToUnsignedByte(descriptors);
+}
+
+// Matching with the brute-force CPU matcher (arg 1 = 1), which computes the
+// full descriptor distance matrix, or with the FLANN index (arg 1 = 0).
+void BM_SiftCPUFeatureMatcherMatch(benchmark::State& state) {
+  const auto descriptors1 = std::make_shared<FeatureDescriptors>(
+      CreateRandomFeatureDescriptors(state.range(0), 1));
+  const auto descriptors2 = std::make_shared<FeatureDescriptors>(
+      CreateRandomFeatureDescriptors(state.range(0), 2));
+
+  SiftMatchingOptions options;
+  options.use_gpu = false;
+  options.brute_force_cpu_matcher = state.range(1) != 0;
+  // Do not reuse the indices of previous iterations.
+  options.flann_index_cache_size_mb = 0;
+  auto matcher = CreateSiftFeatureMatcher(options);
+
+  FeatureMatches matches;
+  for (auto _ : state) {
+    matcher->Match(descriptors1, descriptors2, &matches);
+    benchmark::DoNotOptimize(matches.data());
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0) *
+                          state.range(0));
+}
+BENCHMARK(BM_SiftCPUFeatureMatcherMatch)
+    ->Args({1024, 0})
+    ->Args({1024, 1})
+    ->Args({4096, 0})
+    ->Args({4096, 1})
+    ->Unit(benchmark::kMillisecond);
+
+// Guided matching, which computes the descriptor distance matrix of all pairs
+// that pass the geometric filter, i.e., all pairs in this benchmark.
+void BM_SiftCPUFeatureMatcherMatchGuided(benchmark::State& state) {
+  const auto keypoints1 = std::make_shared<FeatureKeypoints>(state.range(0));
+  const auto keypoints2 = std::make_shared<FeatureKeypoints>(state.range(0));
+  const auto descriptors1 = std::make_shared<FeatureDescriptors>(
+      CreateRandomFeatureDescriptors(state.range(0), 1));
+  const auto descriptors2 = std::make_shared<FeatureDescriptors>(
+      CreateRandomFeatureDescriptors(state.range(0), 2));
+
+  SiftMatchingOptions options;
+  options.use_gpu = false;
+  auto matcher = CreateSiftFeatureMatcher(options);
+
+  TwoViewGeometry two_view_geometry;
+  for (auto _ : state) {
+    two_view_geometry.config = TwoViewGeometry::PLANAR_OR_PANORAMIC;
+    two_view_geometry.H = Eigen::Matrix3d::Identity();
+    matcher->MatchGuided(TwoViewGeometryOptions(),
+                         keypoints1,
+                         keypoints2,
+                         descriptors1,
+                         descriptors2,
+                         &two_view_geometry);
+    benchmark::DoNotOptimize(two_view_geometry.inlier_matches.data());
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0) *
+                          state.range(0));
+}
+BENCHMARK(BM_SiftCPUFeatureMatcherMatchGuided)
+    ->Arg(1024)
+    ->Arg(4096)
+    ->Unit(benchmark::kMillisecond);
+
+}  // namespace
+}  // namespace colmap
@@ -39,7 +39,9 @@
 #include "colmap/feature/utils.h"
 #include "colmap/math/math.h"
 #include "colmap/math/random.h"
+#include "colmap/sensor/models_refrac.h"
 #include "colmap/util/opengl_utils.h"
+#include "colmap/util/testing.h"
 
 #include "thirdparty/SiftGPU/SiftGPU.h"
 
@@ -88,6 +90,32 @@ TEST(ExtractSiftFeaturesCPU, Nominal) {
   }
 }
 
+TEST(ExtractSiftFeaturesCPU, Adaptive) {
+  Bitmap bitmap;
+  CreateImageWithSquare(256, &bitmap);
+
+  SiftExtractionOptions options;
+  options.use_gpu = false;
+  options.feature_grid_cell_size = 64;
+  options.max_num_features_per_cell = 1;
+  auto extractor = CreateSiftFeatureExtractor(options);
+
+  FeatureKeypoints keypoints;
+  FeatureDescriptors descriptors;
+  EXPECT_TRUE(extractor->Extract(bitmap, &keypoints, &descriptors));
+  EXPECT_GT(keypoints.size(), 0);
+  EXPECT_LT(keypoints.size(), 22);
+  EXPECT_EQ(descriptors.rows(), keypoints.size());
+
+  // The contrast of the test image is about 62.
+  options.min_image_contrast = 100;
+  extractor = CreateSiftFeatureExtractor(options);
+  EXPECT_TRUE(extractor->Extract(bitmap, &keypoints, &descriptors));
+  EXPECT_EQ(keypoints.size(), 0);
+  EXPECT_EQ(descriptors.rows(), 0);
+  EXPECT_EQ(descriptors.cols(), 128);
+}
+
 TEST(ExtractCovariantSiftFeaturesCPU, Nominal) {
   Bitmap bitmap;
   CreateImageWithSquare(256, &bitmap);
@@ -366,6 +394,108 @@ TEST(SiftCPUFeatureMatcher, Nominal) {
   EXPECT_EQ(matches.size(), 0);
 }
 
+TEST(SiftCPUFeatureMatcher, SharedFlannIndexCache) {
+  const auto descriptors1 =
+      std::make_shared<FeatureDescriptors>(CreateRandomFeatureDescriptors(50));
+  const auto descriptors2 =
+      std::make_shared<FeatureDescriptors>(descriptors1->colwise().reverse());
+  const auto descriptors3 =
+      std::make_shared<FeatureDescriptors>(CreateRandomFeatureDescriptors(50));
+
+  for (const double cache_size_mb : {0.0, 0.01, 256.0}) {
+    SiftMatchingOptions options;
+    options.use_gpu = false;
+    options.flann_index_cache_size_mb = cache_size_mb;
+    auto matcher1 = CreateSiftFeatureMatcher(options);
+    auto matcher2 = CreateSiftFeatureMatcher(options);
+
+    // Match the pairs in non-sequential order with different matchers.
+    FeatureMatches matches12;
+    matcher1->Match(descriptors1, descriptors2, &matches12);
+    FeatureMatches matches13;
+    matcher2->Match(descriptors1, descriptors3, &matches13);
+    FeatureMatches matches21;
+    matcher1->Match(descriptors2, descriptors1, &matches21);
+    FeatureMatches matches12_repeated;
+    matcher2->Match(descriptors1, descriptors2, &matches12_repeated);
+
+    EXPECT_EQ(matches12.size(), 50);
+    EXPECT_EQ(matches21.size(), 50);
+    CheckEqualMatches(matches12, matches12_repeated);
+  }
+}
+
+TEST(SiftCPUFeatureMatcher, MatchRatios) {
+  const auto descriptors1 =
+      std::make_shared<FeatureDescriptors>(CreateRandomFeatureDescriptors(50));
+  const auto descriptors2 =
+      std::make_shared<FeatureDescriptors>(descriptors1->colwise().reverse());
+
+  for (const bool brute_force : {false, true}) {
+    SiftMatchingOptions options;
+    options.use_gpu = false;
+    options.brute_force_cpu_matcher = brute_force;
+    FeatureMatches matches;
+    CreateSiftFeatureMatcher(options)->Match(
+        descriptors1, descriptors2, &matches);
+    EXPECT_EQ(matches.size(), 50);
+    for (const FeatureMatch& match : matches) {
+      EXPECT_GE(match.ratio, 0);
+      EXPECT_LT(match.ratio, options.max_ratio);
+    }
+  }
+}
+
+TEST(SiftCPUFeatureMatcher, MatchQuantized) {
+  const auto descriptors1 =
+      std::make_shared<FeatureDescriptors>(CreateRandomFeatureDescriptors(300));
+  const auto descriptors2 =
+      std::make_shared<FeatureDescriptors>(descriptors1->colwise().reverse());
+  ProductQuantizer quantizer;
+  quantizer.Train(*descriptors1, /*num_iterations=*/5);
+  const auto codes1 =
+      std::make_shared<FeatureDescriptors>(quantizer.Encode(*descriptors1));
+  const auto codes2 =
+      std::make_shared<FeatureDescriptors>(quantizer.Encode(*descriptors2));
+  const auto empty_descriptors = std::make_shared<FeatureDescriptors>(0, 128);
+  const auto empty_codes = std::make_shared<FeatureDescriptors>(0, 16);
+
+  SiftMatchingOptions options;
+  options.use_gpu = false;
+  options.brute_force_cpu_matcher = true;
+  FeatureMatches matches_bf;
+  CreateSiftFeatureMatcher(options)->Match(
+      descriptors1, descriptors2, &matches_bf);
+  EXPECT_EQ(matches_bf.size(), 300);
+
+  for (const int num_candidates : {300, 5, 0}) {
+    options.descriptor_codes_num_candidates = num_candidates;
+    auto matcher = CreateSiftFeatureMatcher(options);
+
+    FeatureMatches matches;
+    matcher->MatchQuantized(
+        quantizer, codes1, codes2, descriptors1, descriptors2, &matches);
+    if (num_candidates == 300) {
+      // Re-ranking all candidates is exact.
+      CheckEqualMatches(matches_bf, matches);
+    } else {
+      EXPECT_EQ(matches.size(), 300);
+      for (const FeatureMatch& match : matches) {
+        EXPECT_EQ(match.point2D_idx2, 299 - match.point2D_idx1);
+      }
+    }
+
+    FeatureMatches matches_repeated;
+    matcher->MatchQuantized(
+        quantizer, nullptr, nullptr, nullptr, nullptr, &matches_repeated);
+    CheckEqualMatches(matches, matches_repeated);
+
+    matcher->MatchQuantized(
+        quantizer, empty_codes, nullptr, empty_descriptors, nullptr, &matches);
+    EXPECT_TRUE(matches.empty());
+  }
+}
+
 TEST(SiftCPUFeatureMatcherFlannVsBruteForce, Nominal) {
   SiftMatchingOptions match_options;
   match_options.max_num_matches = 1000;
@@ -544,6 +674,88 @@ TEST(MatchGuidedSiftFeaturesCPU, Nominal) {
   EXPECT_EQ(two_view_geometry.inlier_matches.size(), 0);
 }
 
+TEST(MatchGuidedRefracSiftFeaturesCPU, Nominal) {
+  Camera camera =
+      Camera::CreateFromModelName(1, "SIMPLE_PINHOLE", 1000.0, 1000, 800);
+  camera.refrac_model_id = FlatPort::refrac_model_id;
+  camera.refrac_params = {0.1, 0.05, 0.99, 0.05, 0.007, 1.0, 1.52, 1.33};
+  Eigen::Map<Eigen::Vector3d>(camera.refrac_params.data()).normalize();
+
+  TwoViewGeometry two_view_geometry;
+  two_view_geometry.config = TwoViewGeometry::REFRACTIVE;
+  two_view_geometry.cam2_from_cam1 =
+      Rigid3d(Eigen::Quaterniond(1, 0.02, -0.05, 0.01).normalized(),
+              Eigen::Vector3d(-0.5, 0.05, 0.02));
+
+  const size_t kNumPoints = 20;
+  auto keypoints1 = std::make_shared<FeatureKeypoints>();
+  auto keypoints2 = std::make_shared<FeatureKeypoints>();
+  while (keypoints1->size() < kNumPoints) {
+    const Eigen::Vector3d point3D(RandomUniformReal(-1.0, 1.0),
+                                  RandomUniformReal(-1.0, 1.0),
+                                  RandomUniformReal(3.0, 6.0));
+    const Eigen::Vector2d point2D1 = camera.ImgFromCamRefrac(point3D);
+    const Eigen::Vector2d point2D2 =
+        camera.ImgFromCamRefrac(two_view_geometry.cam2_from_cam1 * point3D);
+    if (point2D1.x() < 0 || point2D1.x() > camera.width ||
+        point2D1.y() < 0 || point2D1.y() > camera.height ||
+        point2D2.x() < 0 || point2D2.x() > camera.width ||
+        point2D2.y() < 0 || point2D2.y() > camera.height) {
+      continue;
+    }
+    keypoints1->emplace_back(point2D1.x(), point2D1.y());
+    keypoints2->emplace_back(point2D2.x(), point2D2.y());
+  }
+  const auto descriptors1 = std::make_shared<FeatureDescriptors>(
+      CreateRandomFeatureDescriptors(kNumPoints));
+  const auto descriptors2 = std::make_shared<FeatureDescriptors>(*descriptors1);
+
+  SiftMatchingOptions options;
+  options.use_gpu = false;
+  auto matcher = CreateSiftFeatureMatcher(options);
+
+  matcher->MatchGuidedRefrac(TwoViewGeometryOptions(),
+                             camera,
+                             camera,
+                             keypoints1,
+                             keypoints2,
+                             descriptors1,
+                             descriptors2,
+                             &two_view_geometry);
+  EXPECT_EQ(two_view_geometry.inlier_matches.size(), kNumPoints);
+  for (const auto& match : two_view_geometry.inlier_matches) {
+    EXPECT_EQ(match.point2D_idx1, match.point2D_idx2);
+  }
+
+  // Move a keypoint away from its epipolar curve.
+  (*keypoints2)[0].x += 50;
+  (*keypoints2)[0].y += 50;
+  matcher->MatchGuidedRefrac(TwoViewGeometryOptions(),
+                             camera,
+                             camera,
+                             keypoints1,
+                             keypoints2,
+                             descriptors1,
+                             descriptors2,
+                             &two_view_geometry);
+  EXPECT_EQ(two_view_geometry.inlier_matches.size(), kNumPoints - 1);
+  for (const auto& match : two_view_geometry.inlier_matches) {
+    EXPECT_NE(match.point2D_idx1, 0);
+  }
+
+  // Non-refractive two-view geometries are not matched.
+  two_view_geometry.config = TwoViewGeometry::CALIBRATED;
+  matcher->MatchGuidedRefrac(TwoViewGeometryOptions(),
+                             camera,
+                             camera,
+                             nullptr,
+                             nullptr,
+                             nullptr,
+                             nullptr,
+                             &two_view_geometry);
+  EXPECT_EQ(two_view_geometry.inlier_matches.size(), 0);
+}
+
 TEST(MatchSiftFeaturesGPU, Nominal) {
   char app_name[] = "Test";
   int argc = 1;
@@ -610,6 +822,54 @@ TEST(MatchSiftFeaturesGPU, Nominal) {
   RunThreadWithOpenGLContext(&thread);
 }
 
+TEST(MatchSiftFeaturesGPU, DescriptorCache) {
+  char app_name[] = "Test";
+  int argc = 1;
+  char* argv[] = {app_name};
+  QApplication app(argc, argv);
+
+  class TestThread : public Thread {
+   private:
+    void Run() {
+      opengl_context_.MakeCurrent();
+      // The cache is disabled, fits two of the descriptor sets, such that
+      // they are evicted and uploaded again, or fits all descriptor sets.
+      for (const double cache_size_mb : {0.0, 0.001, 1.0}) {
+        SiftMatchingOptions options;
+        options.use_gpu = true;
+        options.max_num_matches = 1000;
+        options.gpu_descriptor_cache_size_mb = cache_size_mb;
+        auto matcher = CHECK_NOTNULL(CreateSiftFeatureMatcher(options));
+
+        std::vector<std::shared_ptr<FeatureDescriptors>> descriptors;
+        for (int i = 0; i < 4; ++i) {
+          descriptors.push_back(std::make_shared<FeatureDescriptors>(
+              CreateRandomFeatureDescriptors(3)));
+        }
+
+        FeatureMatches matches;
+        for (int k = 0; k < 3; ++k) {
+          for (size_t i = 0; i < descriptors.size(); ++i) {
+            for (size_t j = 0; j < descriptors.size(); ++j) {
+              matcher->Match(descriptors[i], descriptors[j], &matches);
+              if (i == j) {
+                EXPECT_EQ(matches.size(), 3);
+                for (const auto& match : matches) {
+                  EXPECT_EQ(match.point2D_idx1, match.point2D_idx2);
+                }
+              }
+            }
+          }
+        }
+      }
+    }
+    OpenGLContextManager opengl_context_;
+  };
+
+  TestThread thread;
+  RunThreadWithOpenGLContext(&thread);
+}
+
 TEST(MatchSiftFeaturesCPUvsGPU, Nominal) {
   char app_name[] = "Test";
   int argc = 1;
@@ -860,5 +1120,29 @@ TEST(MatchGuidedSiftFeaturesGPU, Nominal) {
   RunThreadWithOpenGLContext(&thread);
 }
 
+TEST(SiftFeaturesBinaryFile, Nominal) {
+  const FeatureKeypoints keypoints = {FeatureKeypoint(1, 2),
+                                      FeatureKeypoint(3, 4, 2, 0.5),
+                                      FeatureKeypoint(5, 6, 1, 2, 3, 4)};
+  const FeatureDescriptors descriptors = CreateRandomFeatureDescriptors(3);
+
+  const std::string path = CreateTestDir() + "/features.bin";
+  WriteSiftFeaturesToBinaryFile(path, keypoints, descriptors);
+
+  FeatureKeypoints read_keypoints;
+  FeatureDescriptors read_descriptors;
+  LoadSiftFeaturesFromBinaryFile(path, &read_keypoints, &read_descriptors);
+  ASSERT_EQ(read_keypoints.size(), keypoints.size());
+  for (size_t i = 0; i < keypoints.size(); ++i) {
+    EXPECT_EQ(read_keypoints[i].x, keypoints[i].x);
+    EXPECT_EQ(read_keypoints[i].y, keypoints[i].y);
+    EXPECT_EQ(read_keypoints[i].a11, keypoints[i].a11);
+    EXPECT_EQ(read_keypoints[i].a12, keypoints[i].a12);
+    EXPECT_EQ(read_keypoints[i].a21, keypoints[i].a21);
+    EXPECT_EQ(read_keypoints[i].a22, keypoints[i].a22);
+  }
+  EXPECT_EQ(read_descriptors, descriptors);
+}
+
 }  // namespace
 }  // namespace colmap
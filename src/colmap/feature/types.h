@@ -93,6 +93,11 @@ struct FeatureMatch {
 
   // Feature index in second image.
   point2D_t point2D_idx2 = kInvalidPoint2DIdx;
+
+  // Ratio of the normalized descriptor distances of the best and second best
+  // match, where lower is more distinctive, or negative if unknown. The ratio
+  // is only kept in memory and not stored in the database.
+  float ratio = -1.0f;
 };
 
 typedef std::vector<FeatureMatch> FeatureMatches;
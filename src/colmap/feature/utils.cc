@@ -102,4 +102,76 @@ void ExtractTopScaleFeatures(FeatureKeypoints* keypoints,
   *descriptors = std::move(top_scale_descriptors);
 }
 
+void ExtractGridTopScaleFeatures(FeatureKeypoints* keypoints,
+                                 FeatureDescriptors* descriptors,
+                                 const int cell_size,
+                                 const size_t max_num_features_per_cell) {
+  CHECK_EQ(keypoints->size(), descriptors->rows());
+  CHECK_GT(cell_size, 0);
+  CHECK_GT(max_num_features_per_cell, 0);
+
+  struct GridFeature {
+    int64_t cell_x;
+    int64_t cell_y;
+    float scale;
+    size_t index;
+  };
+
+  std::vector<GridFeature> grid_features(keypoints->size());
+  for (size_t i = 0; i < keypoints->size(); ++i) {
+    const FeatureKeypoint& keypoint = (*keypoints)[i];
+    GridFeature& grid_feature = grid_features[i];
+    grid_feature.cell_x =
+        static_cast<int64_t>(std::floor(keypoint.x / cell_size));
+    grid_feature.cell_y =
+        static_cast<int64_t>(std::floor(keypoint.y / cell_size));
+    grid_feature.scale = keypoint.ComputeScale();
+    grid_feature.index = i;
+  }
+
+  // Sort the features by cell and then by decreasing scale.
+  std::sort(grid_features.begin(),
+            grid_features.end(),
+            [](const GridFeature& feature1, const GridFeature& feature2) {
+              if (feature1.cell_y != feature2.cell_y) {
+                return feature1.cell_y < feature2.cell_y;
+              } else if (feature1.cell_x != feature2.cell_x) {
+                return feature1.cell_x < feature2.cell_x;
+              } else {
+                return feature1.scale > feature2.scale;
+              }
+            });
+
+  std::vector<size_t> retained_indices;
+  retained_indices.reserve(grid_features.size());
+  size_t num_cell_features = 0;
+  for (size_t i = 0; i < grid_features.size(); ++i) {
+    if (i == 0 || grid_features[i].cell_x != grid_features[i - 1].cell_x ||
+        grid_features[i].cell_y != grid_features[i - 1].cell_y) {
+      num_cell_features = 0;
+    }
+    if (num_cell_features < max_num_features_per_cell) {
+      retained_indices.push_back(grid_features[i].index);
+      num_cell_features += 1;
+    }
+  }
+
+  if (retained_indices.size() == keypoints->size()) {
+    return;
+  }
+
+  std::sort(retained_indices.begin(), retained_indices.end());
+
+  FeatureKeypoints retained_keypoints(retained_indices.size());
+  FeatureDescriptors retained_descriptors(retained_indices.size(),
+                                          descriptors->cols());
+  for (size_t i = 0; i < retained_indices.size(); ++i) {
+    retained_keypoints[i] = (*keypoints)[retained_indices[i]];
+    retained_descriptors.row(i) = descriptors->row(retained_indices[i]);
+  }
+
+  *keypoints = std::move(retained_keypoints);
+  *descriptors = std::move(retained_descriptors);
+}
+
 }  // namespace colmap
@@ -57,4 +57,13 @@ void ExtractTopScaleFeatures(FeatureKeypoints* keypoints,
                              FeatureDescriptors* descriptors,
                              size_t num_features);
 
+// Extract the descriptors corresponding to the largest-scale features in each
+// cell of a regular grid with square cells of the given size in pixels. This
+// limits the feature density in textured regions without removing the features
+// in weakly textured regions. The order of the retained features is preserved.
+void ExtractGridTopScaleFeatures(FeatureKeypoints* keypoints,
+                                 FeatureDescriptors* descriptors,
+                                 int cell_size,
+                                 size_t max_num_features_per_cell);
+
 }  // namespace colmap
@@ -110,5 +110,41 @@ TEST(ExtractTopScaleFeatures, Nominal) {
   EXPECT_EQ(top_descriptors6, descriptors);
 }
 
+TEST(ExtractGridTopScaleFeatures, Nominal) {
+  FeatureKeypoints keypoints = {FeatureKeypoint(1, 1, 3, 0),
+                                FeatureKeypoint(2, 2, 4, 0),
+                                FeatureKeypoint(3, 3, 1, 0),
+                                FeatureKeypoint(15, 1, 2, 0),
+                                FeatureKeypoint(5, 15, 1, 0)};
+  const FeatureDescriptors descriptors = FeatureDescriptors::Random(5, 128);
+
+  auto grid_keypoints1 = keypoints;
+  auto grid_descriptors1 = descriptors;
+  ExtractGridTopScaleFeatures(&grid_keypoints1, &grid_descriptors1, 10, 1);
+  ASSERT_EQ(grid_keypoints1.size(), 3);
+  EXPECT_EQ(grid_keypoints1[0].x, keypoints[1].x);
+  EXPECT_EQ(grid_keypoints1[1].x, keypoints[3].x);
+  EXPECT_EQ(grid_keypoints1[2].x, keypoints[4].x);
+  ASSERT_EQ(grid_descriptors1.rows(), 3);
+  EXPECT_EQ(grid_descriptors1.row(0), descriptors.row(1));
+  EXPECT_EQ(grid_descriptors1.row(1), descriptors.row(3));
+  EXPECT_EQ(grid_descriptors1.row(2), descriptors.row(4));
+
+  auto grid_keypoints2 = keypoints;
+  auto grid_descriptors2 = descriptors;
+  ExtractGridTopScaleFeatures(&grid_keypoints2, &grid_descriptors2, 10, 2);
+  ASSERT_EQ(grid_keypoints2.size(), 4);
+  EXPECT_EQ(grid_keypoints2[0].x, keypoints[0].x);
+  EXPECT_EQ(grid_keypoints2[1].x, keypoints[1].x);
+  EXPECT_EQ(grid_descriptors2.row(0), descriptors.row(0));
+  EXPECT_EQ(grid_descriptors2.row(1), descriptors.row(1));
+
+  auto grid_keypoints3 = keypoints;
+  auto grid_descriptors3 = descriptors;
+  ExtractGridTopScaleFeatures(&grid_keypoints3, &grid_descriptors3, 100, 5);
+  EXPECT_EQ(grid_keypoints3.size(), 5);
+  EXPECT_EQ(grid_descriptors3, descriptors);
+}
+
 }  // namespace
 }  // namespace colmap
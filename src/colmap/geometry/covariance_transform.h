@@ -1,40 +1,77 @@
 #pragma once
 
 #include "colmap/geometry/rigid3.h"
+#include "colmap/util/logging.h"
 #include "colmap/util/types.h"
 
+#include <cmath>
+#include <limits>
 #include <vector>
 
+#include <Eigen/Cholesky>
+#include <Eigen/StdVector>
+
 namespace colmap {
 
+// Unscented transform of a mean and covariance from a kSrcDim-dimensional to
+// a kDstDim-dimensional space. All sigma points are of fixed size, such that a
+// transformation does not allocate any memory.
+template <int kSrcDim, int kDstDim>
 class UnscentedTransform {
  public:
-  struct WeightedSigmaPoint {
-    Eigen::VectorXd point;
-    double weight_mean;
-    double weight_cov;
-  };
+  typedef Eigen::Matrix<double, kSrcDim, 1> SrcVector;
+  typedef Eigen::Matrix<double, kSrcDim, kSrcDim> SrcMatrix;
+  typedef Eigen::Matrix<double, kDstDim, 1> DstVector;
+  typedef Eigen::Matrix<double, kDstDim, kDstDim> DstMatrix;
+
+  typedef std::vector<SrcVector, Eigen::aligned_allocator<SrcVector>>
+      SrcVectors;
+  typedef std::vector<SrcMatrix, Eigen::aligned_allocator<SrcMatrix>>
+      SrcMatrices;
+  typedef std::vector<DstVector, Eigen::aligned_allocator<DstVector>>
+      DstVectors;
+  typedef std::vector<DstMatrix, Eigen::aligned_allocator<DstMatrix>>
+      DstMatrices;
+
+  static const int kNumSigmaPoints = 2 * kSrcDim + 1;
 
   explicit UnscentedTransform(const double alpha = 0.001,
                               const double beta = 2.0,
                               const double kappa = 0.0);
+  virtual ~UnscentedTransform() = default;
 
   inline void SetAlpha(const double alpha);
   inline void SetBeta(const double beta);
   inline void SetKappa(const double kappa);
 
+  // Transform a batch of means and covariances, e.g., of all pose priors of a
+  // mission. The i-th entry of success is set to whether the i-th
+  // transformation succeeded.
+  void TransformBatch(const SrcVectors& src_means,
+                      const SrcMatrices& src_covs,
+                      DstVectors* dst_means,
+                      DstMatrices* dst_covs,
+                      std::vector<char>* success) const;
+
  protected:
-  virtual bool TransformPoint(const Eigen::VectorXd& src,
-                              Eigen::VectorXd& dst) const = 0;
+  typedef Eigen::Matrix<double, kSrcDim, kNumSigmaPoints> SrcSigmaPoints;
+
+  virtual bool TransformPoint(const SrcVector& src, DstVector& dst) const = 0;
 
-  bool ComputeSigmaPoints(const Eigen::VectorXd& src_mean,
-                          const Eigen::MatrixXd& src_cov,
-                          std::vector<WeightedSigmaPoint>& sigma_points) const;
+  // Compute the sigma points in the columns of sigma_points and their weights
+  // for the mean and covariance. The weights of all but the first sigma
+  // point are identical.
+  bool ComputeSigmaPoints(const SrcVector& src_mean,
+                          const SrcMatrix& src_cov,
+                          SrcSigmaPoints& sigma_points,
+                          double& weight_mean0,
+                          double& weight_cov0,
+                          double& weight_i) const;
 
-  bool TransformImpl(const Eigen::VectorXd& src_mean,
-                     const Eigen::MatrixXd& src_cov,
-                     Eigen::VectorXd& dst_mean,
-                     Eigen::MatrixXd& dst_cov) const;
+  bool TransformImpl(const SrcVector& src_mean,
+                     const SrcMatrix& src_cov,
+                     DstVector& dst_mean,
+                     DstMatrix& dst_cov) const;
   // The alpha parameter determines the spread of the sigma points
   double alpha_;
 
@@ -50,7 +87,7 @@ class UnscentedTransform {
 // Transform covariance reprensented by Euler angle into quaternion
 // representation. Euler angles are 3D vector with Rx, Ry, Rz in [rad]. The
 // rotation order is ZYX: R = Rz * Ry * Rx;
-class CovEulerZYXToQuaternion : public UnscentedTransform {
+class CovEulerZYXToQuaternion : public UnscentedTransform<3, 4> {
  public:
   explicit CovEulerZYXToQuaternion();
   bool Transform(const Eigen::Vector3d& euler_src,
@@ -59,11 +96,10 @@ class CovEulerZYXToQuaternion : public UnscentedTransform {
                  Eigen::Matrix4d& cov_dst) const;
 
  protected:
-  bool TransformPoint(const Eigen::VectorXd& src,
-                      Eigen::VectorXd& dst) const override;
+  bool TransformPoint(const SrcVector& src, DstVector& dst) const override;
 };
 
-class CovQuaternionToEulerZYX : public UnscentedTransform {
+class CovQuaternionToEulerZYX : public UnscentedTransform<4, 3> {
  public:
   explicit CovQuaternionToEulerZYX();
   bool Transform(const Eigen::Quaterniond& quat_src,
@@ -72,11 +108,10 @@ class CovQuaternionToEulerZYX : public UnscentedTransform {
                  Eigen::Matrix3d& cov_dst) const;
 
  protected:
-  bool TransformPoint(const Eigen::VectorXd& src,
-                      Eigen::VectorXd& dst) const override;
+  bool TransformPoint(const SrcVector& src, DstVector& dst) const override;
 };
 
-class CovRigid3dInverse : public UnscentedTransform {
+class CovRigid3dInverse : public UnscentedTransform<7, 7> {
  public:
   explicit CovRigid3dInverse();
 
@@ -86,11 +121,10 @@ class CovRigid3dInverse : public UnscentedTransform {
                  Eigen::Matrix7d& cov_dst) const;
 
  protected:
-  bool TransformPoint(const Eigen::VectorXd& src,
-                      Eigen::VectorXd& dst) const override;
+  bool TransformPoint(const SrcVector& src, DstVector& dst) const override;
 };
 
-class CovRigid3dTransform : public UnscentedTransform {
+class CovRigid3dTransform : public UnscentedTransform<14, 7> {
  public:
   explicit CovRigid3dTransform();
 
@@ -102,18 +136,160 @@ class CovRigid3dTransform : public UnscentedTransform {
                  Eigen::Matrix7d& cov_dst) const;
 
  protected:
-  bool TransformPoint(const Eigen::VectorXd& src,
-                      Eigen::VectorXd& dst) const override;
+  bool TransformPoint(const SrcVector& src, DstVector& dst) const override;
 };
 
+// Convert between rigid transforms and their vector representation
+// [qw, qx, qy, qz, tx, ty, tz], in which their covariances are given.
+Eigen::Matrix<double, 7, 1> Rigid3dToVector(const Rigid3d& tform);
+Rigid3d VectorToRigid3d(const Eigen::Matrix<double, 7, 1>& vec);
+
 ////////////////////////////////////////////////////////////////////////////////
 // Implementation
 ////////////////////////////////////////////////////////////////////////////////
 
-void UnscentedTransform::SetAlpha(const double alpha) { alpha_ = alpha; }
+template <int kSrcDim, int kDstDim>
+UnscentedTransform<kSrcDim, kDstDim>::UnscentedTransform(const double alpha,
+                                                         const double beta,
+                                                         const double kappa)
+    : alpha_(alpha), beta_(beta), kappa_(kappa) {}
+
+template <int kSrcDim, int kDstDim>
+void UnscentedTransform<kSrcDim, kDstDim>::SetAlpha(const double alpha) {
+  alpha_ = alpha;
+}
+
+template <int kSrcDim, int kDstDim>
+void UnscentedTransform<kSrcDim, kDstDim>::SetBeta(const double beta) {
+  beta_ = beta;
+}
+
+template <int kSrcDim, int kDstDim>
+void UnscentedTransform<kSrcDim, kDstDim>::SetKappa(const double kappa) {
+  kappa_ = kappa;
+}
+
+template <int kSrcDim, int kDstDim>
+void UnscentedTransform<kSrcDim, kDstDim>::TransformBatch(
+    const SrcVectors& src_means,
+    const SrcMatrices& src_covs,
+    DstVectors* dst_means,
+    DstMatrices* dst_covs,
+    std::vector<char>* success) const {
+  CHECK_EQ(src_means.size(), src_covs.size());
+  CHECK_NOTNULL(dst_means);
+  CHECK_NOTNULL(dst_covs);
+  CHECK_NOTNULL(success);
+
+  const size_t num_transforms = src_means.size();
+  dst_means->resize(num_transforms);
+  dst_covs->resize(num_transforms);
+  success->resize(num_transforms);
+  for (size_t i = 0; i < num_transforms; ++i) {
+    (*success)[i] = TransformImpl(
+        src_means[i], src_covs[i], (*dst_means)[i], (*dst_covs)[i]);
+  }
+}
+
+template <int kSrcDim, int kDstDim>
+bool UnscentedTransform<kSrcDim, kDstDim>::ComputeSigmaPoints(
+    const SrcVector& src_mean,
+    const SrcMatrix& src_cov,
+    SrcSigmaPoints& sigma_points,
+    double& weight_mean0,
+    double& weight_cov0,
+    double& weight_i) const {
+  const double dbl_dim = static_cast<double>(kSrcDim);
+  const double alpha2 = alpha_ * alpha_;
+  const double lambda = alpha2 * (dbl_dim + kappa_) - dbl_dim;
+  const double dim_plus_lambda = alpha2 * (dbl_dim + kappa_);
+
+  // Numerically very unstable without normalization !!!
+  double factor = src_cov.trace();
+  SrcMatrix normalized_cov = src_cov / factor;
+  // Enforce positive definiteness by adding epislon to diagonal elements.
+  const double eps_fac = 2.0 * std::numeric_limits<double>::epsilon();
+  normalized_cov.diagonal().array() += eps_fac;
+
+  factor *= dim_plus_lambda;
+  factor = std::sqrt(factor);
+  const SrcMatrix sqrt_cov =
+      factor * SrcMatrix(normalized_cov.llt().matrixL());
+
+  // Compute sigma points.
+  sigma_points.col(0) = src_mean;
+  sigma_points.template middleCols<kSrcDim>(1) =
+      sqrt_cov.colwise() + src_mean;
+  sigma_points.template rightCols<kSrcDim>() =
+      (-sqrt_cov).colwise() + src_mean;
+
+  weight_mean0 = lambda / dim_plus_lambda;
+  weight_cov0 = lambda / dim_plus_lambda + 1.0 - alpha2 + beta_;
+  weight_i = 1.0 / (2.0 * dim_plus_lambda);
+
+  return true;
+}
+
+template <int kSrcDim, int kDstDim>
+bool UnscentedTransform<kSrcDim, kDstDim>::TransformImpl(
+    const SrcVector& src_mean,
+    const SrcMatrix& src_cov,
+    DstVector& dst_mean,
+    DstMatrix& dst_cov) const {
+  if (src_cov.trace() < std::numeric_limits<double>::epsilon()) {
+    // Zero covariance matrix.
+    if (!TransformPoint(src_mean, dst_mean)) {
+      return false;
+    }
+    dst_cov.setZero();
+    return true;
+  }
+
+  // Check result dimension.
+  if (!TransformPoint(src_mean, dst_mean)) {
+    // Transformation of the mean failed, returning false.
+    return false;
+  }
+
+  // Compute sigma points.
+  SrcSigmaPoints sigma_points;
+  double weight_mean0;
+  double weight_cov0;
+  double weight_i;
+  if (!ComputeSigmaPoints(src_mean,
+                          src_cov,
+                          sigma_points,
+                          weight_mean0,
+                          weight_cov0,
+                          weight_i)) {
+    return false;
+  }
+
+  // Transform sigma points and compute the new mean and new covariance.
+  Eigen::Matrix<double, kDstDim, kNumSigmaPoints> dst_sigma_points;
+  for (int i = 0; i < kNumSigmaPoints; ++i) {
+    DstVector dst_sigma_point;
+    if (!TransformPoint(sigma_points.col(i), dst_sigma_point)) {
+      return false;
+    }
+    dst_sigma_points.col(i) = dst_sigma_point;
+  }
+
+  // Compute the weighted mean.
+  dst_mean = weight_mean0 * dst_sigma_points.col(0) +
+             weight_i * dst_sigma_points.template rightCols<2 * kSrcDim>()
+                            .rowwise()
+                            .sum();
 
-void UnscentedTransform::SetBeta(const double beta) { beta_ = beta; }
+  // Compute the covariance.
+  const Eigen::Matrix<double, kDstDim, kNumSigmaPoints> diffs =
+      dst_sigma_points.colwise() - dst_mean;
+  dst_cov = weight_cov0 * diffs.col(0) * diffs.col(0).transpose() +
+            weight_i * diffs.template rightCols<2 * kSrcDim>() *
+                diffs.template rightCols<2 * kSrcDim>().transpose();
 
-void UnscentedTransform::SetKappa(const double kappa) { kappa_ = kappa; }
+  // Finally check if the new covariance is valid.
+  return !dst_cov.hasNaN();
+}
 
-};  // namespace colmap
\ No newline at end of file
+}  // namespace colmap
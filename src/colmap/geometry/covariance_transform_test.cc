@@ -0,0 +1,129 @@
+// Copyright (c) 2023, ETH Zurich and UNC Chapel Hill.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of ETH Zurich and UNC Chapel Hill nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "colmap/geometry/covariance_transform.h"
+
+#include "colmap/geometry/pose.h"
+
+#include <gtest/gtest.h>
+
+namespace colmap {
+namespace {
+
+TEST(CovEulerZYXToQuaternion, ZeroCovariance) {
+  const Eigen::Vector3d euler(0.1, -0.2, 0.3);
+  Eigen::Quaterniond quat;
+  Eigen::Matrix4d cov;
+  CovEulerZYXToQuaternion cov_tform;
+  EXPECT_TRUE(
+      cov_tform.Transform(euler, Eigen::Matrix3d::Zero(), quat, cov));
+  EXPECT_TRUE(quat.isApprox(Eigen::Quaterniond(
+      EulerAnglesToRotationMatrix(euler(0), euler(1), euler(2)))));
+  EXPECT_EQ(cov, Eigen::Matrix4d::Zero());
+}
+
+TEST(CovEulerZYXToQuaternion, TransformBatch) {
+  CovEulerZYXToQuaternion::SrcVectors eulers;
+  CovEulerZYXToQuaternion::SrcMatrices euler_covs;
+  for (int i = 0; i < 10; ++i) {
+    eulers.emplace_back(0.1 * i, -0.05 * i, 0.2 * i);
+    euler_covs.push_back((1e-4 * (i + 1)) * Eigen::Matrix3d::Identity());
+  }
+
+  CovEulerZYXToQuaternion cov_tform;
+  CovEulerZYXToQuaternion::DstVectors qvecs;
+  CovEulerZYXToQuaternion::DstMatrices qvec_covs;
+  std::vector<char> success;
+  cov_tform.TransformBatch(eulers, euler_covs, &qvecs, &qvec_covs, &success);
+  ASSERT_EQ(success.size(), eulers.size());
+
+  for (size_t i = 0; i < eulers.size(); ++i) {
+    EXPECT_TRUE(success[i]);
+    Eigen::Quaterniond quat;
+    Eigen::Matrix4d cov;
+    EXPECT_TRUE(cov_tform.Transform(eulers[i], euler_covs[i], quat, cov));
+    EXPECT_TRUE(quat.coeffs().isApprox(
+        Eigen::Quaterniond(qvecs[i](0), qvecs[i](1), qvecs[i](2), qvecs[i](3))
+            .normalized()
+            .coeffs()));
+    EXPECT_EQ(cov, qvec_covs[i]);
+  }
+}
+
+TEST(CovRigid3dInverse, Nominal) {
+  const Rigid3d tform(Eigen::Quaterniond(EulerAnglesToRotationMatrix(
+                          0.1, 0.2, 0.3)),
+                      Eigen::Vector3d(1, 2, 3));
+  Eigen::Matrix7d cov = Eigen::Matrix7d::Zero();
+  cov.block<3, 3>(4, 4) = Eigen::Matrix3d::Identity();
+
+  Rigid3d inv_tform;
+  Eigen::Matrix7d inv_cov;
+  CovRigid3dInverse cov_tform;
+  EXPECT_TRUE(cov_tform.Transform(tform, cov, inv_tform, inv_cov));
+  const Rigid3d expected_inv_tform = Inverse(tform);
+  EXPECT_TRUE(
+      inv_tform.rotation.isApprox(expected_inv_tform.rotation, 1e-6));
+  EXPECT_TRUE(
+      inv_tform.translation.isApprox(expected_inv_tform.translation, 1e-6));
+  // The translation is only rotated, such that its isotropic covariance is
+  // preserved.
+  const Eigen::Matrix4d inv_rotation_cov = inv_cov.topLeftCorner<4, 4>();
+  const Eigen::Matrix3d inv_translation_cov =
+      inv_cov.bottomRightCorner<3, 3>();
+  EXPECT_TRUE(
+      inv_translation_cov.isApprox(Eigen::Matrix3d::Identity(), 1e-6));
+  EXPECT_LT(inv_rotation_cov.norm(), 1e-6);
+}
+
+TEST(CovRigid3dTransform, ZeroCovariance) {
+  const Rigid3d tform(Eigen::Quaterniond(EulerAnglesToRotationMatrix(
+                          0.1, 0.2, 0.3)),
+                      Eigen::Vector3d(1, 2, 3));
+  const Rigid3d dst_from_src(Eigen::Quaterniond(EulerAnglesToRotationMatrix(
+                                 -0.3, 0.1, 0.5)),
+                             Eigen::Vector3d(-1, 0, 2));
+
+  Rigid3d tform_dst;
+  Eigen::Matrix7d cov_dst;
+  CovRigid3dTransform cov_tform;
+  EXPECT_TRUE(cov_tform.Transform(tform,
+                                  Eigen::Matrix7d::Zero(),
+                                  dst_from_src,
+                                  Eigen::Matrix7d::Zero(),
+                                  tform_dst,
+                                  cov_dst));
+  const Rigid3d expected_tform_dst = dst_from_src * tform;
+  EXPECT_TRUE(tform_dst.rotation.isApprox(expected_tform_dst.rotation));
+  EXPECT_TRUE(tform_dst.translation.isApprox(expected_tform_dst.translation));
+  EXPECT_EQ(cov_dst, Eigen::Matrix7d::Zero());
+}
+
+}  // namespace
+}  // namespace colmap
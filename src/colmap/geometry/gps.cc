@@ -30,8 +30,35 @@
 #include "colmap/geometry/gps.h"
 
 #include "colmap/math/math.h"
+#include "colmap/util/logging.h"
 
 namespace colmap {
+namespace {
+
+using RowMajorMatrixX3d =
+    Eigen::Matrix<double, Eigen::Dynamic, 3, Eigen::RowMajor>;
+
+Eigen::ArrayX3d VectorsToArray(const std::vector<Eigen::Vector3d>& vectors) {
+  return Eigen::Map<const RowMajorMatrixX3d>(
+             vectors.empty() ? nullptr : vectors[0].data(), vectors.size(), 3)
+      .array();
+}
+
+std::vector<Eigen::Vector3d> ArrayToVectors(const Eigen::ArrayX3d& array) {
+  std::vector<Eigen::Vector3d> vectors(array.rows());
+  if (!vectors.empty()) {
+    Eigen::Map<RowMajorMatrixX3d>(vectors[0].data(), vectors.size(), 3) =
+        array.matrix();
+  }
+  return vectors;
+}
+
+Eigen::ArrayXd Atan2(const Eigen::ArrayXd& y, const Eigen::ArrayXd& x) {
+  return y.binaryExpr(
+      x, [](const double y, const double x) { return std::atan2(y, x); });
+}
+
+}  // namespace
 
 GPSTransform::GPSTransform(const int ellipsoid) {
   switch (ellipsoid) {
@@ -56,67 +83,16 @@ GPSTransform::GPSTransform(const int ellipsoid) {
 
 std::vector<Eigen::Vector3d> GPSTransform::EllToXYZ(
     const std::vector<Eigen::Vector3d>& ell) const {
-  std::vector<Eigen::Vector3d> xyz(ell.size());
-
-  for (size_t i = 0; i < ell.size(); ++i) {
-    const double lat = DegToRad(ell[i](0));
-    const double lon = DegToRad(ell[i](1));
-    const double alt = ell[i](2);
-
-    const double sin_lat = std::sin(lat);
-    const double sin_lon = std::sin(lon);
-    const double cos_lat = std::cos(lat);
-    const double cos_lon = std::cos(lon);
-
-    // Normalized radius
-    const double N = a_ / std::sqrt(1 - e2_ * sin_lat * sin_lat);
-
-    xyz[i](0) = (N + alt) * cos_lat * cos_lon;
-    xyz[i](1) = (N + alt) * cos_lat * sin_lon;
-    xyz[i](2) = (N * (1 - e2_) + alt) * sin_lat;
-  }
-
-  return xyz;
+  Eigen::ArrayX3d xyz;
+  EllToXYZ(VectorsToArray(ell), &xyz);
+  return ArrayToVectors(xyz);
 }
 
 std::vector<Eigen::Vector3d> GPSTransform::XYZToEll(
     const std::vector<Eigen::Vector3d>& xyz) const {
-  std::vector<Eigen::Vector3d> ell(xyz.size());
-
-  for (size_t i = 0; i < ell.size(); ++i) {
-    const double x = xyz[i](0);
-    const double y = xyz[i](1);
-    const double z = xyz[i](2);
-
-    const double radius_xy = std::sqrt(x * x + y * y);
-    const double kEps = 1e-12;
-
-    // Latitude
-    double lat = std::atan2(z, radius_xy);
-    double alt = 0.0;
-
-    for (size_t j = 0; j < 100; ++j) {
-      const double sin_lat0 = std::sin(lat);
-      const double N = a_ / std::sqrt(1 - e2_ * sin_lat0 * sin_lat0);
-      const double prev_alt = alt;
-      alt = radius_xy / std::cos(lat) - N;
-      const double prev_lat = lat;
-      lat = std::atan((z / radius_xy) * 1 / (1 - e2_ * N / (N + alt)));
-
-      if (std::abs(prev_lat - lat) < kEps && std::abs(prev_alt - alt) < kEps) {
-        break;
-      }
-    }
-
-    ell[i](0) = RadToDeg(lat);
-
-    // Longitude
-    ell[i](1) = RadToDeg(std::atan2(y, x));
-    // Alt
-    ell[i](2) = alt;
-  }
-
-  return ell;
+  Eigen::ArrayX3d ell;
+  XYZToEll(VectorsToArray(xyz), &ell);
+  return ArrayToVectors(ell);
 }
 
 std::vector<Eigen::Vector3d> GPSTransform::EllToENU(
@@ -133,27 +109,15 @@ std::vector<Eigen::Vector3d> GPSTransform::XYZToENU(
     const std::vector<Eigen::Vector3d>& xyz,
     const double lat0,
     const double lon0) const {
-  std::vector<Eigen::Vector3d> enu(xyz.size());
-
-  // https://en.wikipedia.org/wiki/Geographic_coordinate_conversion#From_ECEF_to_ENU
-
-  // ECEF to ENU Rot :
-  const double cos_lat0 = std::cos(DegToRad(lat0));
-  const double sin_lat0 = std::sin(DegToRad(lat0));
-
-  const double cos_lon0 = std::cos(DegToRad(lon0));
-  const double sin_lon0 = std::sin(DegToRad(lon0));
-
-  Eigen::Matrix3d R;
-  R << -sin_lon0, cos_lon0, 0., -sin_lat0 * cos_lon0, -sin_lat0 * sin_lon0,
-      cos_lat0, cos_lat0 * cos_lon0, cos_lat0 * sin_lon0, sin_lat0;
-
-  // Convert ECEF to ENU coords. (w.r.t. ECEF ref == xyz[0])
-  for (size_t i = 0; i < xyz.size(); ++i) {
-    enu[i] = R * (xyz[i] - xyz[0]);
+  if (xyz.empty()) {
+    return {};
   }
 
-  return enu;
+  // Convert ECEF to ENU coords. (w.r.t. ECEF ref == xyz[0])
+  Eigen::ArrayX3d enu;
+  XYZToLocal(
+      ENUFromXYZRotation(lat0, lon0), xyz[0], VectorsToArray(xyz), &enu);
+  return ArrayToVectors(enu);
 }
 
 std::vector<Eigen::Vector3d> GPSTransform::ENUToEll(
@@ -169,32 +133,14 @@ std::vector<Eigen::Vector3d> GPSTransform::ENUToXYZ(
     const double lat0,
     const double lon0,
     const double alt0) const {
-  std::vector<Eigen::Vector3d> xyz(enu.size());
-
   // ECEF ref (origin)
   const Eigen::Vector3d xyz_ref =
       EllToXYZ({Eigen::Vector3d(lat0, lon0, alt0)})[0];
 
-  // ENU to ECEF Rot :
-  const double cos_lat0 = std::cos(DegToRad(lat0));
-  const double sin_lat0 = std::sin(DegToRad(lat0));
-
-  const double cos_lon0 = std::cos(DegToRad(lon0));
-  const double sin_lon0 = std::sin(DegToRad(lon0));
-
-  Eigen::Matrix3d R;
-  R << -sin_lon0, cos_lon0, 0., -sin_lat0 * cos_lon0, -sin_lat0 * sin_lon0,
-      cos_lat0, cos_lat0 * cos_lon0, cos_lat0 * sin_lon0, sin_lat0;
-
-  // R is ECEF to ENU so Transpose to get inverse
-  R.transposeInPlace();
-
-  // Convert ENU to ECEF coords.
-  for (size_t i = 0; i < enu.size(); ++i) {
-    xyz[i] = (R * enu[i]) + xyz_ref;
-  }
-
-  return xyz;
+  Eigen::ArrayX3d xyz;
+  LocalToXYZ(
+      ENUFromXYZRotation(lat0, lon0), xyz_ref, VectorsToArray(enu), &xyz);
+  return ArrayToVectors(xyz);
 }
 
 std::vector<Eigen::Vector3d> GPSTransform::EllToNED(
@@ -213,29 +159,14 @@ std::vector<Eigen::Vector3d> GPSTransform::XYZToNED(
     const double lat0,
     const double lon0,
     const double alt0) const {
-  std::vector<Eigen::Vector3d> ned(xyz.size());
-
-  // https://en.wikipedia.org/wiki/Local_tangent_plane_coordinates
-
-  // ECEF to NED Rot :
-  const double cos_lat0 = std::cos(DegToRad(lat0));
-  const double sin_lat0 = std::sin(DegToRad(lat0));
-
-  const double cos_lon0 = std::cos(DegToRad(lon0));
-  const double sin_lon0 = std::sin(DegToRad(lon0));
-
-  Eigen::Matrix3d R;
-  R << -sin_lat0 * cos_lon0, -sin_lat0 * sin_lon0, cos_lat0, -sin_lon0,
-      cos_lon0, 0, -cos_lat0 * cos_lon0, -cos_lat0 * sin_lon0, -sin_lat0;
-
-  // Convert ECEF to ENU coords. (w.r.t. ECEF ref == EllToXYZ(lat0, lon0, alt0))
+  // Convert ECEF to NED coords. (w.r.t. ECEF ref == EllToXYZ(lat0, lon0, alt0))
   const Eigen::Vector3d xyz_ref =
       EllToXYZ({Eigen::Vector3d(lat0, lon0, alt0)})[0];
-  for (size_t i = 0; i < xyz.size(); ++i) {
-    ned[i] = R * (xyz[i] - xyz_ref);
-  }
 
-  return ned;
+  Eigen::ArrayX3d ned;
+  XYZToLocal(
+      NEDFromXYZRotation(lat0, lon0), xyz_ref, VectorsToArray(xyz), &ned);
+  return ArrayToVectors(ned);
 }
 
 std::vector<Eigen::Vector3d> GPSTransform::NEDToEll(
@@ -251,13 +182,84 @@ std::vector<Eigen::Vector3d> GPSTransform::NEDToXYZ(
     const double lat0,
     const double lon0,
     const double alt0) const {
-  std::vector<Eigen::Vector3d> xyz(ned.size());
-
   // ECEF ref (origin)
   const Eigen::Vector3d xyz_ref =
       EllToXYZ({Eigen::Vector3d(lat0, lon0, alt0)})[0];
 
-  // NED to ECEF Rot :
+  Eigen::ArrayX3d xyz;
+  LocalToXYZ(
+      NEDFromXYZRotation(lat0, lon0), xyz_ref, VectorsToArray(ned), &xyz);
+  return ArrayToVectors(xyz);
+}
+
+void GPSTransform::EllToXYZ(const Eigen::ArrayX3d& ell,
+                            Eigen::ArrayX3d* xyz) const {
+  CHECK_NOTNULL(xyz);
+
+  const Eigen::ArrayXd lat = ell.col(0) * DegToRad(1.0);
+  const Eigen::ArrayXd lon = ell.col(1) * DegToRad(1.0);
+  const Eigen::ArrayXd sin_lat = lat.sin();
+  const Eigen::ArrayXd cos_lat = lat.cos();
+
+  // Normalized radius
+  const Eigen::ArrayXd N = a_ / (1 - e2_ * sin_lat.square()).sqrt();
+  const Eigen::ArrayXd radius_xy = (N + ell.col(2)) * cos_lat;
+
+  xyz->resize(ell.rows(), 3);
+  xyz->col(0) = radius_xy * lon.cos();
+  xyz->col(1) = radius_xy * lon.sin();
+  xyz->col(2) = (N * (1 - e2_) + ell.col(2)) * sin_lat;
+}
+
+void GPSTransform::XYZToEll(const Eigen::ArrayX3d& xyz,
+                            Eigen::ArrayX3d* ell) const {
+  CHECK_NOTNULL(ell);
+
+  // Bowring's closed-form approximation of the latitude, see "The accuracy of
+  // geodetic latitude and height equations", Survey Review, 1985.
+  const double ep2 = (a_ * a_ - b_ * b_) / (b_ * b_);
+
+  const Eigen::ArrayXd z = xyz.col(2);
+  const Eigen::ArrayXd radius_xy =
+      (xyz.col(0).square() + xyz.col(1).square()).sqrt();
+
+  // Parametric latitude.
+  const Eigen::ArrayXd theta = Atan2(a_ * z, b_ * radius_xy);
+  const Eigen::ArrayXd sin_theta = theta.sin();
+  const Eigen::ArrayXd cos_theta = theta.cos();
+
+  const Eigen::ArrayXd lat =
+      Atan2(z + ep2 * b_ * sin_theta.cube(),
+            radius_xy - e2_ * a_ * cos_theta.cube());
+  const Eigen::ArrayXd sin_lat = lat.sin();
+  const Eigen::ArrayXd cos_lat = lat.cos();
+  const Eigen::ArrayXd N = a_ / (1 - e2_ * sin_lat.square()).sqrt();
+
+  ell->resize(xyz.rows(), 3);
+  ell->col(0) = lat * RadToDeg(1.0);
+  ell->col(1) = Atan2(xyz.col(1), xyz.col(0)) * RadToDeg(1.0);
+  // Altitude, which is stable at the poles, unlike radius_xy / cos_lat - N.
+  ell->col(2) = radius_xy * cos_lat + z * sin_lat - a_ * a_ / N;
+}
+
+Eigen::Matrix3d GPSTransform::ENUFromXYZRotation(const double lat0,
+                                                 const double lon0) {
+  // https://en.wikipedia.org/wiki/Geographic_coordinate_conversion#From_ECEF_to_ENU
+  const double cos_lat0 = std::cos(DegToRad(lat0));
+  const double sin_lat0 = std::sin(DegToRad(lat0));
+
+  const double cos_lon0 = std::cos(DegToRad(lon0));
+  const double sin_lon0 = std::sin(DegToRad(lon0));
+
+  Eigen::Matrix3d R;
+  R << -sin_lon0, cos_lon0, 0., -sin_lat0 * cos_lon0, -sin_lat0 * sin_lon0,
+      cos_lat0, cos_lat0 * cos_lon0, cos_lat0 * sin_lon0, sin_lat0;
+  return R;
+}
+
+Eigen::Matrix3d GPSTransform::NEDFromXYZRotation(const double lat0,
+                                                 const double lon0) {
+  // https://en.wikipedia.org/wiki/Local_tangent_plane_coordinates
   const double cos_lat0 = std::cos(DegToRad(lat0));
   const double sin_lat0 = std::sin(DegToRad(lat0));
 
@@ -267,16 +269,27 @@ std::vector<Eigen::Vector3d> GPSTransform::NEDToXYZ(
   Eigen::Matrix3d R;
   R << -sin_lat0 * cos_lon0, -sin_lat0 * sin_lon0, cos_lat0, -sin_lon0,
       cos_lon0, 0, -cos_lat0 * cos_lon0, -cos_lat0 * sin_lon0, -sin_lat0;
+  return R;
+}
 
-  // R is ECEF to NED so Transpose to get inverse
-  R.transposeInPlace();
-
-  // Convert NED to ECEF coords.
-  for (size_t i = 0; i < ned.size(); ++i) {
-    xyz[i] = (R * ned[i]) + xyz_ref;
-  }
+void GPSTransform::XYZToLocal(const Eigen::Matrix3d& local_from_xyz,
+                              const Eigen::Vector3d& origin_xyz,
+                              const Eigen::ArrayX3d& xyz,
+                              Eigen::ArrayX3d* local) {
+  CHECK_NOTNULL(local);
+  *local = ((xyz.matrix().rowwise() - origin_xyz.transpose()) *
+            local_from_xyz.transpose())
+               .array();
+}
 
-  return xyz;
+void GPSTransform::LocalToXYZ(const Eigen::Matrix3d& local_from_xyz,
+                              const Eigen::Vector3d& origin_xyz,
+                              const Eigen::ArrayX3d& local,
+                              Eigen::ArrayX3d* xyz) {
+  CHECK_NOTNULL(xyz);
+  // The rotation is orthonormal, such that its inverse is the transpose.
+  *xyz = ((local.matrix() * local_from_xyz).rowwise() + origin_xyz.transpose())
+             .array();
 }
 
 }  // namespace colmap
@@ -97,6 +97,33 @@ class GPSTransform {
                                         double lon0,
                                         double alt0) const;
 
+  // Batched conversions of N coordinates, which are stored in the rows of an
+  // N x 3 array. Since the array is column-major, the latitudes, longitudes,
+  // and altitudes (or x, y, z) are each contiguous and the trigonometric
+  // functions are evaluated on whole columns, which Eigen vectorizes. The
+  // conversion to ellipsoidal coordinates uses the closed-form approximation
+  // of Bowring, which is accurate to well below a millimeter for altitudes
+  // within +/-10km of the ellipsoid, instead of an iterative solution.
+  void EllToXYZ(const Eigen::ArrayX3d& ell, Eigen::ArrayX3d* xyz) const;
+  void XYZToEll(const Eigen::ArrayX3d& xyz, Eigen::ArrayX3d* ell) const;
+
+  // Rotations from ECEF to the ENU or NED frame with origin at latitude lat0
+  // and longitude lon0 in degrees, which can be computed once per origin and
+  // reused for all batches converted to the same frame.
+  static Eigen::Matrix3d ENUFromXYZRotation(double lat0, double lon0);
+  static Eigen::Matrix3d NEDFromXYZRotation(double lat0, double lon0);
+
+  // Batched conversions between ECEF and a local frame, e.g., ENU or NED,
+  // given by its rotation from ECEF and the ECEF coordinates of its origin.
+  static void XYZToLocal(const Eigen::Matrix3d& local_from_xyz,
+                         const Eigen::Vector3d& origin_xyz,
+                         const Eigen::ArrayX3d& xyz,
+                         Eigen::ArrayX3d* local);
+  static void LocalToXYZ(const Eigen::Matrix3d& local_from_xyz,
+                         const Eigen::Vector3d& origin_xyz,
+                         const Eigen::ArrayX3d& local,
+                         Eigen::ArrayX3d* xyz);
+
  private:
   // Semimajor axis.
   double a_;
@@ -420,5 +420,73 @@ TEST(GPS, NEDToXYZ) {
   }
 }
 
+TEST(GPS, BatchEllToXYZ) {
+  Eigen::ArrayX3d ell(3, 3);
+  ell << 48 + 8. / 60 + 51.70361 / 3600, 11 + 34. / 60 + 10.51777 / 3600,
+      561.1851, -33.8688, 151.2093, -12.5, 89.5, -120.0, 8848.0;
+
+  GPSTransform gps_tform(GPSTransform::WGS84);
+
+  Eigen::ArrayX3d xyz;
+  gps_tform.EllToXYZ(ell, &xyz);
+  ASSERT_EQ(xyz.rows(), ell.rows());
+  for (int i = 0; i < ell.rows(); ++i) {
+    const Eigen::Vector3d ref_xyz =
+        gps_tform.EllToXYZ({ell.row(i).transpose().matrix()})[0];
+    EXPECT_TRUE(xyz.row(i).transpose().matrix().isApprox(ref_xyz, 1e-12));
+  }
+
+  Eigen::ArrayX3d ell2;
+  gps_tform.XYZToEll(xyz, &ell2);
+  ASSERT_EQ(ell2.rows(), ell.rows());
+  for (int i = 0; i < ell.rows(); ++i) {
+    EXPECT_NEAR(ell2(i, 0), ell(i, 0), 1e-9);
+    EXPECT_NEAR(ell2(i, 1), ell(i, 1), 1e-9);
+    EXPECT_NEAR(ell2(i, 2), ell(i, 2), 1e-3);
+  }
+
+  gps_tform.EllToXYZ(Eigen::ArrayX3d(0, 3), &xyz);
+  EXPECT_EQ(xyz.rows(), 0);
+  EXPECT_TRUE(gps_tform.XYZToEll({}).empty());
+}
+
+TEST(GPS, BatchXYZToLocal) {
+  std::vector<Eigen::Vector3d> ell;
+  ell.emplace_back(48 + 8. / 60 + 51.70361 / 3600,
+                   11 + 34. / 60 + 10.51777 / 3600,
+                   561.1851);
+  ell.emplace_back(48 + 8. / 60 + 52.40575 / 3600,
+                   11 + 34. / 60 + 11.77179 / 3600,
+                   561.1509);
+
+  GPSTransform gps_tform(GPSTransform::WGS84);
+
+  const double lat0 = ell[0](0);
+  const double lon0 = ell[0](1);
+  const double alt0 = ell[0](2);
+  const auto xyz = gps_tform.EllToXYZ(ell);
+  const auto ref_ned = gps_tform.XYZToNED(xyz, lat0, lon0, alt0);
+
+  Eigen::ArrayX3d xyz_array(xyz.size(), 3);
+  for (size_t i = 0; i < xyz.size(); ++i) {
+    xyz_array.row(i) = xyz[i].transpose().array();
+  }
+
+  const Eigen::Matrix3d ned_from_xyz =
+      GPSTransform::NEDFromXYZRotation(lat0, lon0);
+  EXPECT_TRUE((ned_from_xyz * ned_from_xyz.transpose())
+                  .isApprox(Eigen::Matrix3d::Identity()));
+
+  Eigen::ArrayX3d ned;
+  GPSTransform::XYZToLocal(ned_from_xyz, xyz[0], xyz_array, &ned);
+  for (size_t i = 0; i < xyz.size(); ++i) {
+    EXPECT_LT((ned.row(i).transpose().matrix() - ref_ned[i]).norm(), 1e-6);
+  }
+
+  Eigen::ArrayX3d xyz_array2;
+  GPSTransform::LocalToXYZ(ned_from_xyz, xyz[0], ned, &xyz_array2);
+  EXPECT_TRUE(xyz_array2.isApprox(xyz_array, 1e-12));
+}
+
 }  // namespace
 }  // namespace colmap
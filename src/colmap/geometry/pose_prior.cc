@@ -3,7 +3,13 @@
 #include "colmap/geometry/covariance_transform.h"
 #include "colmap/geometry/gps.h"
 #include "colmap/geometry/pose.h"
+#include "colmap/util/logging.h"
 #include "colmap/util/misc.h"
+#include "colmap/util/threading.h"
+
+#include <algorithm>
+#include <future>
+#include <numeric>
 
 namespace colmap {
 namespace {
@@ -15,180 +21,377 @@ PosePrior::PosePrior() : lat0_(kNaN), lon0_(kNaN), depth0_(kNaN) {}
 bool PosePrior::Read(const std::string& path,
                      Rigid3d* prior_from_world,
                      Eigen::Matrix7d* prior_from_world_cov) {
+  std::vector<Rigid3d> prior_from_worlds;
+  std::vector<Eigen::Matrix7d> prior_from_world_covs;
+  std::vector<char> success;
+  ReadBatch({path}, &prior_from_worlds, &prior_from_world_covs, &success);
+  if (!success[0]) {
+    return false;
+  }
+  *prior_from_world = prior_from_worlds[0];
+  *prior_from_world_cov = prior_from_world_covs[0];
+  return true;
+}
+
+void PosePrior::ReadBatch(const std::vector<std::string>& paths,
+                          std::vector<Rigid3d>* prior_from_world,
+                          std::vector<Eigen::Matrix7d>* prior_from_world_cov,
+                          std::vector<char>* success) {
+  CHECK_NOTNULL(success);
+
+  const size_t num_paths = paths.size();
+  std::vector<Record> records(num_paths);
+  success->assign(num_paths, false);
+  for (size_t i = 0; i < num_paths; ++i) {
+    (*success)[i] = ReadRecord(paths[i], &records[i]);
+  }
+
+  ConvertRecords(records, *success, prior_from_world, prior_from_world_cov);
+}
+
+bool PosePrior::ReadNavigationLog(
+    const std::string& path,
+    const std::vector<double>& timestamps,
+    std::vector<Rigid3d>* prior_from_world,
+    std::vector<Eigen::Matrix7d>* prior_from_world_cov,
+    std::vector<char>* success,
+    const int num_threads) {
+  CHECK_NOTNULL(success);
+
   if (!ExistsFile(path)) {
     return false;
   }
 
-  std::ifstream file(path);
-  std::string csv_header, csv;
-  std::getline(file, csv_header);
+  // Read the whole log at once and parse the samples in parallel.
+  const std::vector<std::string> lines = ReadTextFileLines(path);
+  if (lines.empty()) {
+    return false;
+  }
 
-  auto csv_header_values = CSVToVector<std::string>(csv_header);
+  const Columns columns = ParseHeader(lines[0]);
+  if (!columns.has_time) {
+    LOG(ERROR) << "Navigation log " << path << " has no time column";
+    return false;
+  }
 
-  // For newer Girona 500 datasets, like e.g. Anton248, Anton250, Luise258. Use
-  // this code below:
-  auto iter_lon = std::distance(csv_header_values.begin(),
-                                std::find(csv_header_values.begin(),
-                                          csv_header_values.end(),
-                                          "Longitude [deg]"));
-  auto iter_lat = std::distance(csv_header_values.begin(),
-                                std::find(csv_header_values.begin(),
-                                          csv_header_values.end(),
-                                          "Latitude [deg]"));
-  // In the AUV-mapping scenario, we extract depth instead of altitude since
-  // the altitude is a relative measure of distance from the vehicle body to the
-  // object's surface.
-  auto iter_depth = std::distance(
-      csv_header_values.begin(),
-      std::find(
-          csv_header_values.begin(), csv_header_values.end(), "Depth [m]"));
-  auto iter_yaw = std::distance(
-      csv_header_values.begin(),
-      std::find(
-          csv_header_values.begin(), csv_header_values.end(), "Yaw [rad]"));
-  auto iter_pitch = std::distance(
-      csv_header_values.begin(),
-      std::find(
-          csv_header_values.begin(), csv_header_values.end(), "Pitch [rad]"));
-  auto iter_roll = std::distance(
-      csv_header_values.begin(),
-      std::find(
-          csv_header_values.begin(), csv_header_values.end(), "Roll [rad]"));
+  const size_t num_samples = lines.size() - 1;
+  std::vector<double> sample_times(num_samples);
+  std::vector<Record> samples(num_samples);
 
-  // Particularly, GEOMAR's robots measure position covariance in NED coordinate
-  // system.
-  auto iter_north_std = std::distance(
-      csv_header_values.begin(),
-      std::find(
-          csv_header_values.begin(), csv_header_values.end(), "North SD [m]"));
-  auto iter_east_std = std::distance(
-      csv_header_values.begin(),
-      std::find(
-          csv_header_values.begin(), csv_header_values.end(), "East SD [m]"));
-  auto iter_depth_std = std::distance(
-      csv_header_values.begin(),
-      std::find(
-          csv_header_values.begin(), csv_header_values.end(), "Depth SD [m]"));
-
-  auto iter_yaw_std = std::distance(
-      csv_header_values.begin(),
-      std::find(
-          csv_header_values.begin(), csv_header_values.end(), "Yaw SD [rad]"));
-  auto iter_pitch_std = std::distance(csv_header_values.begin(),
-                                      std::find(csv_header_values.begin(),
-                                                csv_header_values.end(),
-                                                "Pitch SD [rad]"));
-  auto iter_roll_std = std::distance(
-      csv_header_values.begin(),
-      std::find(
-          csv_header_values.begin(), csv_header_values.end(), "Roll SD [rad]"));
-  std::getline(file, csv);
+  ThreadPool thread_pool(GetEffectiveNumThreads(num_threads));
+  const size_t num_tasks =
+      std::min(num_samples, static_cast<size_t>(thread_pool.NumThreads()));
+  std::vector<std::future<void>> futures;
+  futures.reserve(num_tasks);
+  for (size_t task_idx = 0; task_idx < num_tasks; ++task_idx) {
+    const size_t begin = task_idx * num_samples / num_tasks;
+    const size_t end = (task_idx + 1) * num_samples / num_tasks;
+    futures.push_back(thread_pool.AddTask([&, begin, end]() {
+      for (size_t i = begin; i < end; ++i) {
+        const std::vector<std::string> csv_values =
+            CSVToVector<std::string>(lines[i + 1]);
+        sample_times[i] = std::stold(csv_values.at(columns.time));
+        ParseRecord(csv_values, columns, &samples[i]);
+      }
+    }));
+  }
+  // Rethrows parsing errors, as for the per-image files.
+  for (auto& future : futures) {
+    future.get();
+  }
+
+  // Sorted time index of the samples.
+  std::vector<size_t> sample_idxs(num_samples);
+  std::iota(sample_idxs.begin(), sample_idxs.end(), 0);
+  std::sort(sample_idxs.begin(),
+            sample_idxs.end(),
+            [&sample_times](const size_t idx1, const size_t idx2) {
+              return sample_times[idx1] < sample_times[idx2];
+            });
+  std::vector<double> sorted_sample_times(num_samples);
+  for (size_t i = 0; i < num_samples; ++i) {
+    sorted_sample_times[i] = sample_times[sample_idxs[i]];
+  }
+
+  // Interpolate the samples at the timestamps. Timestamps outside of the log
+  // have no prior.
+  const size_t num_timestamps = timestamps.size();
+  std::vector<Record> records(num_timestamps);
+  success->assign(num_timestamps, false);
+  for (size_t i = 0; i < num_timestamps; ++i) {
+    const double timestamp = timestamps[i];
+    if (num_samples == 0 || timestamp < sorted_sample_times.front() ||
+        timestamp > sorted_sample_times.back()) {
+      continue;
+    }
+
+    const size_t next_idx = std::min<size_t>(
+        std::upper_bound(sorted_sample_times.begin(),
+                         sorted_sample_times.end(),
+                         timestamp) -
+            sorted_sample_times.begin(),
+        num_samples - 1);
+    const size_t prev_idx = next_idx > 0 ? next_idx - 1 : 0;
+    const double time_diff =
+        sorted_sample_times[next_idx] - sorted_sample_times[prev_idx];
+    const double alpha =
+        time_diff > 0
+            ? (timestamp - sorted_sample_times[prev_idx]) / time_diff
+            : 0.0;
+    records[i] = InterpolateRecords(samples[sample_idxs[prev_idx]],
+                                    samples[sample_idxs[next_idx]],
+                                    alpha);
+    (*success)[i] = true;
+  }
+
+  ConvertRecords(records, *success, prior_from_world, prior_from_world_cov);
+
+  return true;
+}
+
+PosePrior::Record PosePrior::InterpolateRecords(const Record& record1,
+                                                const Record& record2,
+                                                const double alpha) {
+  const auto lerp = [alpha](const double value1, const double value2) {
+    return (1.0 - alpha) * value1 + alpha * value2;
+  };
+
+  Record record;
+  record.lat = lerp(record1.lat, record2.lat);
+  record.lon = lerp(record1.lon, record2.lon);
+  record.depth = lerp(record1.depth, record2.depth);
+
+  // Interpolate the orientation on the rotation manifold, which correctly
+  // handles the wrap-around of the angles.
+  const Eigen::Quaterniond rotation1(
+      EulerAnglesToRotationMatrix(record1.roll, record1.pitch, record1.yaw));
+  const Eigen::Quaterniond rotation2(
+      EulerAnglesToRotationMatrix(record2.roll, record2.pitch, record2.yaw));
+  RotationMatrixToEulerAngles(
+      rotation1.slerp(alpha, rotation2).toRotationMatrix(),
+      &record.roll,
+      &record.pitch,
+      &record.yaw);
+
+  record.has_std = record1.has_std && record2.has_std;
+  record.north_std = lerp(record1.north_std, record2.north_std);
+  record.east_std = lerp(record1.east_std, record2.east_std);
+  record.depth_std = lerp(record1.depth_std, record2.depth_std);
+  record.yaw_std = lerp(record1.yaw_std, record2.yaw_std);
+  record.pitch_std = lerp(record1.pitch_std, record2.pitch_std);
+  record.roll_std = lerp(record1.roll_std, record2.roll_std);
+
+  return record;
+}
 
-  auto csv_values = CSVToVector<std::string>(csv);
+void PosePrior::ConvertRecords(
+    const std::vector<Record>& records,
+    const std::vector<char>& valid,
+    std::vector<Rigid3d>* prior_from_world,
+    std::vector<Eigen::Matrix7d>* prior_from_world_cov) {
+  CHECK_EQ(records.size(), valid.size());
+  CHECK_NOTNULL(prior_from_world);
+  CHECK_NOTNULL(prior_from_world_cov);
 
-  double lat = std::stold(csv_values.at(iter_lat).c_str());
-  double lon = std::stold(csv_values.at(iter_lon).c_str());
-  double depth = -std::stold(csv_values.at(iter_depth).c_str());
-  double yaw = std::stold(csv_values.at(iter_yaw).c_str());
-  double pitch = std::stold(csv_values.at(iter_pitch).c_str());
-  double roll = std::stold(csv_values.at(iter_roll).c_str());
+  const size_t num_records = records.size();
+  prior_from_world->assign(num_records, Rigid3d());
+  prior_from_world_cov->assign(num_records, Eigen::Matrix7d::Zero());
 
-  // World from prior.
-  Rigid3d world_from_prior;
+  std::vector<Eigen::Vector3d> ells;
+  ells.reserve(num_records);
+  for (size_t i = 0; i < num_records; ++i) {
+    if (!valid[i]) {
+      continue;
+    }
+    ells.emplace_back(records[i].lat, records[i].lon, records[i].depth);
+    if (std::isnan(lat0_) && std::isnan(lon0_) && std::isnan(depth0_)) {
+      lat0_ = records[i].lat;
+      lon0_ = records[i].lon;
+      depth0_ = records[i].depth;
+    }
+  }
 
-  if (std::isnan(lat0_) && std::isnan(lon0_) && std::isnan(depth0_)) {
-    lat0_ = lat;
-    lon0_ = lon;
-    depth0_ = depth;
+  if (ells.empty()) {
+    return;
   }
 
   // Converting GPS coordinate system to NED coordinate system.
   GPSTransform gps_transform;
+  const std::vector<Eigen::Vector3d> neds =
+      gps_transform.EllToNED(ells, lat0_, lon0_, depth0_);
 
-  std::vector<Eigen::Vector3d> ells(1);
-  ells[0](0) = lat;
-  ells[0](1) = lon;
-  ells[0](2) = depth;
+  // Rotational covariances of the priors with standard deviations.
+  std::vector<size_t> cov_idxs;
+  CovEulerZYXToQuaternion::SrcVectors eulers;
+  CovEulerZYXToQuaternion::SrcMatrices euler_covs;
 
-  const auto ned = gps_transform.EllToNED(ells, lat0_, lon0_, depth0_)[0];
-  world_from_prior.translation.x() = ned(0);
-  world_from_prior.translation.y() = ned(1);
-  world_from_prior.translation.z() = ned(2);
+  std::vector<Rigid3d> world_from_priors(num_records);
+  size_t ned_idx = 0;
+  for (size_t i = 0; i < num_records; ++i) {
+    if (!valid[i]) {
+      continue;
+    }
 
-  // Read yaw, pitch, roll and compute the rotation:
-  // yaw: rotation around Z-axis
-  // pitch: rotation around Y-axis
-  // roll: rotation around X-axis
-  // Rotation matrix is computed as: R = Rz * Ry * Rx ("ZYX" order)
-  // Note: This rotation matrix rotates a point in the prior coordinate
-  // system to the world coordinate system
+    const Record& record = records[i];
+    Rigid3d& world_from_prior = world_from_priors[i];
+    world_from_prior.translation = neds[ned_idx++];
 
-  world_from_prior.rotation =
-      Eigen::Quaterniond(EulerAnglesToRotationMatrix(roll, pitch, yaw));
-  *prior_from_world = Inverse(world_from_prior);
+    // Read yaw, pitch, roll and compute the rotation:
+    // yaw: rotation around Z-axis
+    // pitch: rotation around Y-axis
+    // roll: rotation around X-axis
+    // Rotation matrix is computed as: R = Rz * Ry * Rx ("ZYX" order)
+    // Note: This rotation matrix rotates a point in the prior coordinate
+    // system to the world coordinate system
+    world_from_prior.rotation = Eigen::Quaterniond(
+        EulerAnglesToRotationMatrix(record.roll, record.pitch, record.yaw));
+    (*prior_from_world)[i] = Inverse(world_from_prior);
 
-  prior_from_world_cov->setZero();
+    if (record.has_std) {
+      cov_idxs.push_back(i);
+      eulers.emplace_back(record.roll, record.pitch, record.yaw);
+      Eigen::Matrix3d euler_cov = Eigen::Matrix3d::Zero();
+      euler_cov(0, 0) = std::pow(record.roll_std, 2);
+      euler_cov(1, 1) = std::pow(record.pitch_std, 2);
+      euler_cov(2, 2) = std::pow(record.yaw_std, 2);
+      euler_covs.push_back(euler_cov);
+    }
+  }
 
-  // Now read covariances if available.
-  bool read_cov = true;
-  if (iter_north_std == iter_east_std || iter_north_std == iter_depth_std ||
-      iter_north_std == iter_yaw_std || iter_north_std == iter_roll_std ||
-      iter_north_std == iter_pitch_std) {
-    read_cov = false;
+  if (cov_idxs.empty()) {
+    return;
   }
 
-  if (read_cov) {
-    double n_std = std::stold(csv_values.at(iter_north_std).c_str());
-    double e_std = std::stold(csv_values.at(iter_east_std).c_str());
-    double d_std = std::stold(csv_values.at(iter_depth_std).c_str());
-    double yaw_std = std::stold(csv_values.at(iter_yaw_std).c_str());
-    double pitch_std = std::stold(csv_values.at(iter_pitch_std).c_str());
-    double roll_std = std::stold(csv_values.at(iter_roll_std).c_str());
+  // Transform the rotational covariances into quaternion representation.
+  CovEulerZYXToQuaternion::DstVectors qvecs;
+  CovEulerZYXToQuaternion::DstMatrices qvec_covs;
+  std::vector<char> qvec_success;
+  CovEulerZYXToQuaternion cov_tform_euler2quat;
+  cov_tform_euler2quat.TransformBatch(
+      eulers, euler_covs, &qvecs, &qvec_covs, &qvec_success);
+
+  // Now invert the covariances of `world_from_prior` to `prior_from_world`.
+  std::vector<size_t> inverse_idxs;
+  CovRigid3dInverse::SrcVectors world_from_prior_vecs;
+  CovRigid3dInverse::SrcMatrices world_from_prior_covs;
+  for (size_t k = 0; k < cov_idxs.size(); ++k) {
+    if (!qvec_success[k]) {
+      continue;
+    }
+
+    const size_t i = cov_idxs[k];
+    const Record& record = records[i];
+    inverse_idxs.push_back(i);
+
+    Eigen::Matrix<double, 7, 1> world_from_prior_vec;
+    world_from_prior_vec.head<4>() = qvecs[k].normalized();
+    world_from_prior_vec.tail<3>() = world_from_priors[i].translation;
+    world_from_prior_vecs.push_back(world_from_prior_vec);
 
     // Positional covariance.
-    Eigen::Matrix3d trans_world_from_prior_cov = Eigen::Matrix3d::Identity();
-    trans_world_from_prior_cov(0, 0) = std::pow(n_std, 2);
-    trans_world_from_prior_cov(1, 1) = std::pow(e_std, 2);
-    trans_world_from_prior_cov(2, 2) = std::pow(d_std, 2);
-
-    // Rotational covariance.
-    Eigen::Vector3d euler(roll, pitch, yaw);
-    Eigen::Matrix3d euler_cov = Eigen::Matrix3d::Identity();
-    euler_cov(0, 0) = std::pow(roll_std, 2);
-    euler_cov(1, 1) = std::pow(pitch_std, 2);
-    euler_cov(2, 2) = std::pow(yaw_std, 2);
-
-    Eigen::Matrix4d rot_world_from_prior_cov;
-
-    CovEulerZYXToQuaternion cov_tform_euler2quat;
-    if (!cov_tform_euler2quat.Transform(euler,
-                                        euler_cov,
-                                        world_from_prior.rotation,
-                                        rot_world_from_prior_cov)) {
-      prior_from_world_cov->setZero();
-
-    } else {
-      Eigen::Matrix7d world_from_prior_cov = Eigen::Matrix7d::Zero();
-      world_from_prior_cov.block<4, 4>(0, 0) = rot_world_from_prior_cov;
-      world_from_prior_cov.block<3, 3>(4, 4) = trans_world_from_prior_cov;
-
-      // Now invert `world_from_prior` to `prior_from_world`.
-
-      CovRigid3dInverse cov_tform_invert_rigid3d;
-      Eigen::Vector4d qvec_dst;
-      Eigen::Vector3d tvec_dst;
-      Rigid3d tform_dst;
-      Eigen::Matrix7d cov_dst;
-      if (!cov_tform_invert_rigid3d.Transform(
-              world_from_prior, world_from_prior_cov, tform_dst, cov_dst)) {
-        prior_from_world_cov->setZero();
-      } else {
-        *prior_from_world_cov = cov_dst;
-      }
+    Eigen::Matrix7d world_from_prior_cov = Eigen::Matrix7d::Zero();
+    world_from_prior_cov.block<4, 4>(0, 0) = qvec_covs[k];
+    world_from_prior_cov(4, 4) = std::pow(record.north_std, 2);
+    world_from_prior_cov(5, 5) = std::pow(record.east_std, 2);
+    world_from_prior_cov(6, 6) = std::pow(record.depth_std, 2);
+    world_from_prior_covs.push_back(world_from_prior_cov);
+  }
+
+  CovRigid3dInverse::DstVectors prior_from_world_vecs;
+  CovRigid3dInverse::DstMatrices prior_from_world_covs;
+  std::vector<char> inverse_success;
+  CovRigid3dInverse cov_tform_invert_rigid3d;
+  cov_tform_invert_rigid3d.TransformBatch(world_from_prior_vecs,
+                                          world_from_prior_covs,
+                                          &prior_from_world_vecs,
+                                          &prior_from_world_covs,
+                                          &inverse_success);
+  for (size_t k = 0; k < inverse_idxs.size(); ++k) {
+    if (inverse_success[k]) {
+      (*prior_from_world_cov)[inverse_idxs[k]] = prior_from_world_covs[k];
     }
   }
+}
 
+bool PosePrior::ReadRecord(const std::string& path, Record* record) {
+  if (!ExistsFile(path)) {
+    return false;
+  }
+
+  std::ifstream file(path);
+  std::string csv_header, csv;
+  std::getline(file, csv_header);
+  std::getline(file, csv);
   file.close();
+
+  ParseRecord(CSVToVector<std::string>(csv), ParseHeader(csv_header), record);
   return true;
 }
-}  // namespace colmap
\ No newline at end of file
+
+PosePrior::Columns PosePrior::ParseHeader(const std::string& csv_header) {
+  const std::vector<std::string> csv_header_values =
+      CSVToVector<std::string>(csv_header);
+  const auto find_column = [&csv_header_values](const std::string& name) {
+    return static_cast<size_t>(std::distance(
+        csv_header_values.begin(),
+        std::find(csv_header_values.begin(), csv_header_values.end(), name)));
+  };
+
+  Columns columns;
+  // For newer Girona 500 datasets, like e.g. Anton248, Anton250, Luise258. Use
+  // this code below:
+  columns.lon = find_column("Longitude [deg]");
+  columns.lat = find_column("Latitude [deg]");
+  // In the AUV-mapping scenario, we extract depth instead of altitude since
+  // the altitude is a relative measure of distance from the vehicle body to the
+  // object's surface.
+  columns.depth = find_column("Depth [m]");
+  columns.yaw = find_column("Yaw [rad]");
+  columns.pitch = find_column("Pitch [rad]");
+  columns.roll = find_column("Roll [rad]");
+
+  // Particularly, GEOMAR's robots measure position covariance in NED coordinate
+  // system.
+  columns.north_std = find_column("North SD [m]");
+  columns.east_std = find_column("East SD [m]");
+  columns.depth_std = find_column("Depth SD [m]");
+  columns.yaw_std = find_column("Yaw SD [rad]");
+  columns.pitch_std = find_column("Pitch SD [rad]");
+  columns.roll_std = find_column("Roll SD [rad]");
+
+  // Only in navigation logs.
+  columns.time = find_column("Time [s]");
+
+  const size_t num_columns = csv_header_values.size();
+  columns.has_std =
+      columns.north_std < num_columns && columns.east_std < num_columns &&
+      columns.depth_std < num_columns && columns.yaw_std < num_columns &&
+      columns.pitch_std < num_columns && columns.roll_std < num_columns;
+  columns.has_time = columns.time < num_columns;
+
+  return columns;
+}
+
+void PosePrior::ParseRecord(const std::vector<std::string>& csv_values,
+                            const Columns& columns,
+                            Record* record) {
+  record->lat = std::stold(csv_values.at(columns.lat));
+  record->lon = std::stold(csv_values.at(columns.lon));
+  record->depth = -std::stold(csv_values.at(columns.depth));
+  record->yaw = std::stold(csv_values.at(columns.yaw));
+  record->pitch = std::stold(csv_values.at(columns.pitch));
+  record->roll = std::stold(csv_values.at(columns.roll));
+
+  // Now read covariances if available.
+  record->has_std = columns.has_std;
+  if (record->has_std) {
+    record->north_std = std::stold(csv_values.at(columns.north_std));
+    record->east_std = std::stold(csv_values.at(columns.east_std));
+    record->depth_std = std::stold(csv_values.at(columns.depth_std));
+    record->yaw_std = std::stold(csv_values.at(columns.yaw_std));
+    record->pitch_std = std::stold(csv_values.at(columns.pitch_std));
+    record->roll_std = std::stold(csv_values.at(columns.roll_std));
+  }
+}
+
+}  // namespace colmap
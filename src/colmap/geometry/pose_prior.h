@@ -2,6 +2,9 @@
 
 #include "colmap/geometry/rigid3.h"
 
+#include <string>
+#include <vector>
+
 namespace colmap {
 
 // Simple class to read pose prior from csv files
@@ -13,10 +16,83 @@ class PosePrior {
             Rigid3d* prior_from_world,
             Eigen::Matrix7d* prior_from_world_cov);
 
+  // Read the pose priors of many files at once, e.g., of all images of a
+  // mission, which propagates the covariances of all priors in a batch. The
+  // i-th entry of success is set to whether the i-th file could be read. The
+  // origin of the world frame is the position of the first read prior.
+  void ReadBatch(const std::vector<std::string>& paths,
+                 std::vector<Rigid3d>* prior_from_world,
+                 std::vector<Eigen::Matrix7d>* prior_from_world_cov,
+                 std::vector<char>* success);
+
+  // Read a single navigation log, which contains the columns of the pose
+  // prior files and a "Time [s]" column with one row per navigation sample,
+  // and interpolate the pose priors at the given timestamps. The rows are
+  // parsed in parallel and need not be sorted by time. The i-th entry of
+  // success is set to whether the i-th timestamp lies within the time range
+  // of the log. Returns false if the log could not be read.
+  bool ReadNavigationLog(const std::string& path,
+                         const std::vector<double>& timestamps,
+                         std::vector<Rigid3d>* prior_from_world,
+                         std::vector<Eigen::Matrix7d>* prior_from_world_cov,
+                         std::vector<char>* success,
+                         int num_threads = -1);
+
  private:
+  // Navigation data of a single csv file.
+  struct Record {
+    double lat = 0;
+    double lon = 0;
+    double depth = 0;
+    double yaw = 0;
+    double pitch = 0;
+    double roll = 0;
+    bool has_std = false;
+    double north_std = 0;
+    double east_std = 0;
+    double depth_std = 0;
+    double yaw_std = 0;
+    double pitch_std = 0;
+    double roll_std = 0;
+  };
+
+  // Indices of the columns in a csv file.
+  struct Columns {
+    size_t lat = 0;
+    size_t lon = 0;
+    size_t depth = 0;
+    size_t yaw = 0;
+    size_t pitch = 0;
+    size_t roll = 0;
+    size_t north_std = 0;
+    size_t east_std = 0;
+    size_t depth_std = 0;
+    size_t yaw_std = 0;
+    size_t pitch_std = 0;
+    size_t roll_std = 0;
+    size_t time = 0;
+    bool has_std = false;
+    bool has_time = false;
+  };
+
+  static bool ReadRecord(const std::string& path, Record* record);
+  static Columns ParseHeader(const std::string& csv_header);
+  static void ParseRecord(const std::vector<std::string>& csv_values,
+                          const Columns& columns,
+                          Record* record);
+  static Record InterpolateRecords(const Record& record1,
+                                   const Record& record2,
+                                   double alpha);
+
+  // Convert the valid records to pose priors in the local NED frame.
+  void ConvertRecords(const std::vector<Record>& records,
+                      const std::vector<char>& valid,
+                      std::vector<Rigid3d>* prior_from_world,
+                      std::vector<Eigen::Matrix7d>* prior_from_world_cov);
+
   double lat0_;
   double lon0_;
   double depth0_;
 };
 
-}  // namespace colmap
\ No newline at end of file
+}  // namespace colmap
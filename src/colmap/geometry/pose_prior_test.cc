@@ -0,0 +1,123 @@
+// Copyright (c) 2023, ETH Zurich and UNC Chapel Hill.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of ETH Zurich and UNC Chapel Hill nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "colmap/geometry/pose_prior.h"
+
+#include "colmap/geometry/pose.h"
+#include "colmap/util/testing.h"
+
+#include <fstream>
+
+#include <gtest/gtest.h>
+
+namespace colmap {
+namespace {
+
+const char kHeader[] =
+    "Time [s],Latitude [deg],Longitude [deg],Depth [m],Roll [rad],Pitch "
+    "[rad],Yaw [rad],North SD [m],East SD [m],Depth SD [m],Roll SD "
+    "[rad],Pitch SD [rad],Yaw SD [rad]";
+
+TEST(PosePrior, Read) {
+  const std::string path = CreateTestDir() + "/prior.csv";
+  {
+    std::ofstream file(path);
+    file << kHeader << std::endl;
+    file << "0,10,20,5,0.1,0.2,0.3,1,1,1,0.01,0.01,0.01" << std::endl;
+  }
+
+  PosePrior pose_prior;
+  Rigid3d prior_from_world;
+  Eigen::Matrix7d prior_from_world_cov;
+  EXPECT_FALSE(pose_prior.Read(
+      path + ".missing", &prior_from_world, &prior_from_world_cov));
+  EXPECT_TRUE(
+      pose_prior.Read(path, &prior_from_world, &prior_from_world_cov));
+
+  // The first prior defines the origin.
+  const Rigid3d world_from_prior = Inverse(prior_from_world);
+  EXPECT_LT(world_from_prior.translation.norm(), 1e-6);
+  EXPECT_TRUE(world_from_prior.rotation.isApprox(
+      Eigen::Quaterniond(EulerAnglesToRotationMatrix(0.1, 0.2, 0.3))));
+  EXPECT_GT(prior_from_world_cov.trace(), 0);
+}
+
+TEST(PosePrior, ReadNavigationLog) {
+  const std::string path = CreateTestDir() + "/navigation.csv";
+  {
+    // The samples are not sorted by time.
+    std::ofstream file(path);
+    file << kHeader << std::endl;
+    file << "2,10.001,20,7,0,0,3.0,1,1,3,0.01,0.01,0.01" << std::endl;
+    file << "0,10,20,5,0,0,3.0,1,1,1,0.01,0.01,0.01" << std::endl;
+    file << "1,10,20,6,0,0,-3.0,1,1,2,0.01,0.01,0.01" << std::endl;
+  }
+
+  PosePrior pose_prior;
+  std::vector<Rigid3d> prior_from_world;
+  std::vector<Eigen::Matrix7d> prior_from_world_cov;
+  std::vector<char> success;
+  EXPECT_FALSE(pose_prior.ReadNavigationLog(path + ".missing",
+                                            {0.0},
+                                            &prior_from_world,
+                                            &prior_from_world_cov,
+                                            &success));
+  EXPECT_TRUE(pose_prior.ReadNavigationLog(path,
+                                           {-1.0, 0.0, 0.5, 2.0, 3.0},
+                                           &prior_from_world,
+                                           &prior_from_world_cov,
+                                           &success,
+                                           /*num_threads=*/2));
+  ASSERT_EQ(success.size(), 5);
+  EXPECT_FALSE(success[0]);
+  EXPECT_TRUE(success[1]);
+  EXPECT_TRUE(success[2]);
+  EXPECT_TRUE(success[3]);
+  EXPECT_FALSE(success[4]);
+
+  // The depth is interpolated linearly and the origin is at the first valid
+  // timestamp.
+  const Rigid3d world_from_prior1 = Inverse(prior_from_world[1]);
+  const Rigid3d world_from_prior2 = Inverse(prior_from_world[2]);
+  EXPECT_LT(world_from_prior1.translation.norm(), 1e-6);
+  EXPECT_NEAR(world_from_prior2.translation.z(), 0.5, 1e-6);
+
+  // The yaw is interpolated across the wrap-around at pi.
+  const double expected_yaw2 = 3.0 + 0.5 * (2 * M_PI - 6.0);
+  const Eigen::Quaterniond expected_rotation2(
+      Eigen::AngleAxisd(expected_yaw2, Eigen::Vector3d::UnitZ()));
+  EXPECT_LT(world_from_prior2.rotation.angularDistance(expected_rotation2),
+            1e-6);
+
+  EXPECT_GT(prior_from_world_cov[2].trace(), 0);
+  EXPECT_EQ(prior_from_world_cov[0], Eigen::Matrix7d::Zero());
+}
+
+}  // namespace
+}  // namespace colmap
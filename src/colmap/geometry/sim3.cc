@@ -60,4 +60,19 @@ Sim3d Sim3d::FromFile(const std::string& path) {
   return t;
 }
 
+void TransformPoints(const Sim3d& b_from_a,
+                     const Points3DSoA& points_in_a,
+                     Points3DSoA* points_in_b) {
+  CHECK_NOTNULL(points_in_b);
+  CHECK_NE(&points_in_a, points_in_b);
+  const Eigen::Matrix3x4d matrix = b_from_a.ToMatrix();
+  points_in_b->resize(3, points_in_a.cols());
+  for (int row = 0; row < 3; ++row) {
+    points_in_b->row(row).array() =
+        matrix(row, 0) * points_in_a.row(0).array() +
+        matrix(row, 1) * points_in_a.row(1).array() +
+        matrix(row, 2) * points_in_a.row(2).array() + matrix(row, 3);
+  }
+}
+
 }  // namespace colmap
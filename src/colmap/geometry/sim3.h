@@ -100,6 +100,18 @@ inline Eigen::Vector3d operator*(const Sim3d& t, const Eigen::Vector3d& x) {
   return t.scale * (t.rotation * x) + t.translation;
 }
 
+// Batch of 3D points stored as a structure of arrays, i.e., the rows hold the
+// x, y, and z coordinates of all points and the columns are the points.
+using Points3DSoA = Eigen::Matrix<double, 3, Eigen::Dynamic, Eigen::RowMajor>;
+
+// Apply the transform to a batch of points as a scaled rotation matrix and a
+// translation, which is vectorized over the contiguous coordinates of the
+// points, instead of rotating every point by the quaternion. The input and
+// output batches must not be the same.
+void TransformPoints(const Sim3d& b_from_a,
+                     const Points3DSoA& points_in_a,
+                     Points3DSoA* points_in_b);
+
 // Concatenate transforms such one can write expressions like:
 //      d_from_a = d_from_c * c_from_b * b_from_a
 inline Sim3d operator*(const Sim3d& c_from_b, const Sim3d& b_from_a) {
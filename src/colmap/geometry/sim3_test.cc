@@ -142,6 +142,21 @@ TEST(Sim3d, Compose) {
   EXPECT_LT((d_from_a * x_in_a - x_in_d).norm(), 1e-6);
 }
 
+TEST(Sim3d, TransformPoints) {
+  const Sim3d b_from_a = TestSim3d();
+  const Points3DSoA points_in_a = Points3DSoA::Random(3, 37);
+  Points3DSoA points_in_b;
+  TransformPoints(b_from_a, points_in_a, &points_in_b);
+  ASSERT_EQ(points_in_b.cols(), points_in_a.cols());
+  for (int i = 0; i < points_in_a.cols(); ++i) {
+    const Eigen::Vector3d point_in_a = points_in_a.col(i);
+    EXPECT_LT((points_in_b.col(i) - b_from_a * point_in_a).norm(), 1e-12);
+  }
+
+  TransformPoints(b_from_a, Points3DSoA(3, 0), &points_in_b);
+  EXPECT_EQ(points_in_b.cols(), 0);
+}
+
 TEST(Sim3d, ToFromFile) {
   const std::string path = CreateTestDir() + "/file.txt";
   const Sim3d written = TestSim3d();
@@ -127,6 +127,63 @@ std::vector<Eigen::Vector3d> TriangulateOptimalPoints(
   return points3D;
 }
 
+bool TriangulateMidPointFromRays(
+    const std::vector<Eigen::Vector3d>& ray_origins,
+    const std::vector<Eigen::Vector3d>& ray_directions,
+    const int num_refinements,
+    Eigen::Vector3d* point3D) {
+  CHECK_EQ(ray_origins.size(), ray_directions.size());
+  CHECK_GE(ray_origins.size(), 2);
+  CHECK_GE(num_refinements, 0);
+  CHECK_NOTNULL(point3D);
+
+  for (int iter = 0; iter <= num_refinements; ++iter) {
+    // The squared distance of the point to the ray i is given by
+    // (X - o_i)^T (I - d_i d_i^T) (X - o_i), such that the normal equations
+    // are sum_i w_i (I - d_i d_i^T) X = sum_i w_i (I - d_i d_i^T) o_i.
+    Eigen::Matrix3d A = Eigen::Matrix3d::Zero();
+    Eigen::Vector3d b = Eigen::Vector3d::Zero();
+    for (size_t i = 0; i < ray_origins.size(); ++i) {
+      double weight = 1.0;
+      if (iter > 0) {
+        const double squared_dist = (*point3D - ray_origins[i]).squaredNorm();
+        if (squared_dist == 0.0) {
+          continue;
+        }
+        weight = 1.0 / squared_dist;
+      }
+      const Eigen::Matrix3d projection =
+          weight * (Eigen::Matrix3d::Identity() -
+                    ray_directions[i] * ray_directions[i].transpose());
+      A += projection;
+      b += projection * ray_origins[i];
+    }
+
+    const Eigen::LDLT<Eigen::Matrix3d> ldlt(A);
+    if (ldlt.info() != Eigen::Success || !ldlt.isPositive() ||
+        std::abs(ldlt.vectorD().minCoeff()) <=
+            1e-12 * std::abs(ldlt.vectorD().maxCoeff())) {
+      // Only the initial estimate must succeed, a failed refinement keeps
+      // the previous estimate.
+      return iter > 0;
+    }
+
+    *point3D = ldlt.solve(b);
+  }
+
+  return true;
+}
+
+double CalculateRayAngularError(const Eigen::Vector3d& ray_origin,
+                                const Eigen::Vector3d& ray_direction,
+                                const Eigen::Vector3d& point3D) {
+  const Eigen::Vector3d point_direction = point3D - ray_origin;
+  // Using atan2 of the cross and dot products is more accurate than acos for
+  // small angles.
+  return std::atan2(point_direction.cross(ray_direction).norm(),
+                    point_direction.dot(ray_direction));
+}
+
 double CalculateTriangulationAngle(const Eigen::Vector3d& proj_center1,
                                    const Eigen::Vector3d& proj_center2,
                                    const Eigen::Vector3d& point3D) {
@@ -102,6 +102,36 @@ std::vector<Eigen::Vector3d> TriangulateOptimalPoints(
     const std::vector<Eigen::Vector2d>& points1,
     const std::vector<Eigen::Vector2d>& points2);
 
+// Triangulate point from multiple world-space rays, e.g., the refracted rays of
+// the observations transformed by the inverse of `CamFromWorld`, by solving
+// the linear least-squares problem of the point with the minimum sum of
+// squared distances to the rays. For two rays, this is the midpoint of the
+// shortest segment between them.
+//
+// @param ray_origins         Origins of the rays in world frame.
+// @param ray_directions      Unit-length directions of the rays in world frame.
+// @param num_refinements     Number of iteratively reweighted least-squares
+//                            refinements of the point, where the distance to
+//                            each ray is divided by the distance of the point
+//                            to the ray origin, which approximately minimizes
+//                            the sum of squared angular errors.
+// @param point3D             Triangulated 3D point.
+//
+// @return                    Whether the rays are not degenerate, i.e., not
+//                            all parallel.
+bool TriangulateMidPointFromRays(
+    const std::vector<Eigen::Vector3d>& ray_origins,
+    const std::vector<Eigen::Vector3d>& ray_directions,
+    int num_refinements,
+    Eigen::Vector3d* point3D);
+
+// Calculate the angle in radians between a ray and the direction from the ray
+// origin to the point. This avoids the virtual camera of the observation in
+// the refractive case.
+double CalculateRayAngularError(const Eigen::Vector3d& ray_origin,
+                                const Eigen::Vector3d& ray_direction,
+                                const Eigen::Vector3d& point3D);
+
 // Calculate angle in radians between the two rays of a triangulated point.
 double CalculateTriangulationAngle(const Eigen::Vector3d& proj_center1,
                                    const Eigen::Vector3d& proj_center2,
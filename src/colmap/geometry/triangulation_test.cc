@@ -72,6 +72,59 @@ TEST(TriangulatePoint, Nominal) {
   }
 }
 
+TEST(TriangulateMidPointFromRays, Nominal) {
+  const Eigen::Vector3d point3D(0.1, -0.2, 3);
+  const std::vector<Eigen::Vector3d> ray_origins = {
+      Eigen::Vector3d(0, 0, 0),
+      Eigen::Vector3d(1, 0, 0.1),
+      Eigen::Vector3d(-0.5, 0.5, 0.2),
+  };
+  std::vector<Eigen::Vector3d> ray_directions;
+  for (const Eigen::Vector3d& ray_origin : ray_origins) {
+    ray_directions.push_back((point3D - ray_origin).normalized());
+  }
+
+  for (int num_refinements = 0; num_refinements < 3; ++num_refinements) {
+    Eigen::Vector3d tri_point3D;
+    EXPECT_TRUE(TriangulateMidPointFromRays(
+        ray_origins, ray_directions, num_refinements, &tri_point3D));
+    EXPECT_LT((point3D - tri_point3D).norm(), 1e-10);
+  }
+
+  // Midpoint of the shortest segment between two skew rays.
+  Eigen::Vector3d tri_point3D;
+  EXPECT_TRUE(TriangulateMidPointFromRays(
+      {Eigen::Vector3d(0, 0, 0), Eigen::Vector3d(0, 1, 1)},
+      {Eigen::Vector3d(1, 0, 0), Eigen::Vector3d(0, 0, 1)},
+      /*num_refinements=*/0,
+      &tri_point3D));
+  EXPECT_LT((tri_point3D - Eigen::Vector3d(0, 0.5, 0)).norm(), 1e-10);
+
+  // Parallel rays.
+  EXPECT_FALSE(TriangulateMidPointFromRays(
+      {Eigen::Vector3d(0, 0, 0), Eigen::Vector3d(1, 0, 0)},
+      {Eigen::Vector3d(0, 0, 1), Eigen::Vector3d(0, 0, 1)},
+      /*num_refinements=*/2,
+      &tri_point3D));
+}
+
+TEST(CalculateRayAngularError, Nominal) {
+  const Eigen::Vector3d ray_origin(1, 0, 0);
+  const Eigen::Vector3d ray_direction(0, 0, 1);
+  EXPECT_NEAR(CalculateRayAngularError(
+                  ray_origin, ray_direction, Eigen::Vector3d(1, 0, 2)),
+              0,
+              1e-10);
+  EXPECT_NEAR(CalculateRayAngularError(
+                  ray_origin, ray_direction, Eigen::Vector3d(2, 0, 1)),
+              M_PI / 4,
+              1e-10);
+  EXPECT_NEAR(CalculateRayAngularError(
+                  ray_origin, ray_direction, Eigen::Vector3d(1, 0, -1)),
+              M_PI,
+              1e-10);
+}
+
 TEST(CalculateTriangulationAngle, Nominal) {
   const Eigen::Vector3d tvec1(0, 0, 0);
   const Eigen::Vector3d tvec2(0, 1, 0);
@@ -0,0 +1,252 @@
+// Copyright (c) 2023, ETH Zurich and UNC Chapel Hill.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of ETH Zurich and UNC Chapel Hill nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "colmap/image/preprocessing.h"
+
+#include "colmap/util/logging.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+namespace colmap {
+
+bool ImagePreprocessingOptions::IsEnabled() const {
+  return color_compensation || !vignetting_path.empty() || clahe;
+}
+
+bool ImagePreprocessingOptions::Check() const {
+  CHECK_OPTION_GT(clahe_clip_limit, 0.0);
+  CHECK_OPTION_GT(clahe_num_tiles, 0);
+  return true;
+}
+
+void CompensateColorAttenuation(Bitmap* bitmap) {
+  CHECK_NOTNULL(bitmap);
+  if (!bitmap->IsRGB()) {
+    return;
+  }
+
+  const int width = bitmap->Width();
+  const int height = bitmap->Height();
+  if (width == 0 || height == 0) {
+    return;
+  }
+
+  double sum_r = 0;
+  double sum_g = 0;
+  double sum_b = 0;
+  BitmapColor<uint8_t> color;
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      bitmap->GetPixel(x, y, &color);
+      sum_r += color.r;
+      sum_g += color.g;
+      sum_b += color.b;
+    }
+  }
+
+  const double mean = (sum_r + sum_g + sum_b) / 3;
+  const double scale_r = sum_r > 0 ? mean / sum_r : 1;
+  const double scale_g = sum_g > 0 ? mean / sum_g : 1;
+  const double scale_b = sum_b > 0 ? mean / sum_b : 1;
+
+  const auto ScaleChannel = [](const uint8_t value, const double scale) {
+    return static_cast<uint8_t>(std::min(255.0, std::round(value * scale)));
+  };
+
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      bitmap->GetPixel(x, y, &color);
+      color.r = ScaleChannel(color.r, scale_r);
+      color.g = ScaleChannel(color.g, scale_g);
+      color.b = ScaleChannel(color.b, scale_b);
+      bitmap->SetPixel(x, y, color);
+    }
+  }
+}
+
+void CorrectVignetting(const Bitmap& vignetting, Bitmap* bitmap) {
+  CHECK_NOTNULL(bitmap);
+  CHECK(vignetting.IsGrey());
+  CHECK_GT(vignetting.Width(), 0);
+  CHECK_GT(vignetting.Height(), 0);
+
+  BitmapColor<uint8_t> color;
+
+  uint8_t max_illumination = 0;
+  for (int y = 0; y < vignetting.Height(); ++y) {
+    for (int x = 0; x < vignetting.Width(); ++x) {
+      vignetting.GetPixel(x, y, &color);
+      max_illumination = std::max(max_illumination, color.r);
+    }
+  }
+
+  if (max_illumination == 0) {
+    return;
+  }
+
+  const double scale_x =
+      static_cast<double>(vignetting.Width()) / bitmap->Width();
+  const double scale_y =
+      static_cast<double>(vignetting.Height()) / bitmap->Height();
+
+  const auto ScaleChannel = [](const uint8_t value, const double gain) {
+    return static_cast<uint8_t>(std::min(255.0, std::round(value * gain)));
+  };
+
+  BitmapColor<uint8_t> illumination;
+  for (int y = 0; y < bitmap->Height(); ++y) {
+    const int vignetting_y = std::min(static_cast<int>((y + 0.5) * scale_y),
+                                      vignetting.Height() - 1);
+    for (int x = 0; x < bitmap->Width(); ++x) {
+      const int vignetting_x = std::min(static_cast<int>((x + 0.5) * scale_x),
+                                        vignetting.Width() - 1);
+      vignetting.GetPixel(vignetting_x, vignetting_y, &illumination);
+      const double gain = static_cast<double>(max_illumination) /
+                          std::max<uint8_t>(illumination.r, 1);
+      bitmap->GetPixel(x, y, &color);
+      color.r = ScaleChannel(color.r, gain);
+      color.g = ScaleChannel(color.g, gain);
+      color.b = ScaleChannel(color.b, gain);
+      bitmap->SetPixel(x, y, color);
+    }
+  }
+}
+
+void EqualizeHistogramCLAHE(const double clip_limit,
+                            const int num_tiles,
+                            Bitmap* bitmap) {
+  CHECK_NOTNULL(bitmap);
+  CHECK(bitmap->IsGrey());
+  CHECK_GT(clip_limit, 0);
+  CHECK_GT(num_tiles, 0);
+
+  const int width = bitmap->Width();
+  const int height = bitmap->Height();
+  if (width == 0 || height == 0) {
+    return;
+  }
+
+  const int num_tiles_x = std::min(num_tiles, width);
+  const int num_tiles_y = std::min(num_tiles, height);
+
+  const std::vector<uint8_t> values = bitmap->ConvertToRowMajorArray();
+
+  constexpr int kNumBins = 256;
+  std::vector<std::array<uint8_t, kNumBins>> tile_mappings(num_tiles_x *
+                                                           num_tiles_y);
+  for (int tile_y = 0; tile_y < num_tiles_y; ++tile_y) {
+    const int y_begin = tile_y * height / num_tiles_y;
+    const int y_end = (tile_y + 1) * height / num_tiles_y;
+    for (int tile_x = 0; tile_x < num_tiles_x; ++tile_x) {
+      const int x_begin = tile_x * width / num_tiles_x;
+      const int x_end = (tile_x + 1) * width / num_tiles_x;
+
+      std::array<int, kNumBins> histogram;
+      histogram.fill(0);
+      for (int y = y_begin; y < y_end; ++y) {
+        for (int x = x_begin; x < x_end; ++x) {
+          histogram[values[y * width + x]] += 1;
+        }
+      }
+
+      // Clip the histogram and redistribute the excess uniformly.
+      const int num_pixels = (x_end - x_begin) * (y_end - y_begin);
+      const int max_bin_height =
+          std::max(1, static_cast<int>(clip_limit * num_pixels / kNumBins));
+      int num_excess = 0;
+      for (int& bin_height : histogram) {
+        if (bin_height > max_bin_height) {
+          num_excess += bin_height - max_bin_height;
+          bin_height = max_bin_height;
+        }
+      }
+      for (int bin = 0; bin < kNumBins; ++bin) {
+        histogram[bin] +=
+            num_excess / kNumBins + (bin < num_excess % kNumBins ? 1 : 0);
+      }
+
+      // Equalize the clipped histogram.
+      std::array<uint8_t, kNumBins>& tile_mapping =
+          tile_mappings[tile_y * num_tiles_x + tile_x];
+      int cumulative_height = 0;
+      for (int bin = 0; bin < kNumBins; ++bin) {
+        cumulative_height += histogram[bin];
+        tile_mapping[bin] = static_cast<uint8_t>(
+            std::round((kNumBins - 1.0) * cumulative_height / num_pixels));
+      }
+    }
+  }
+
+  // Returns the two neighboring tiles and the interpolation weight of the
+  // second tile for the given pixel coordinate.
+  const auto InterpolateTiles = [](const int coord,
+                                   const int size,
+                                   const int num_tiles,
+                                   int* tile1,
+                                   int* tile2,
+                                   double* weight2) {
+    const double tile = (coord + 0.5) * num_tiles / size - 0.5;
+    *tile1 = std::min(std::max(static_cast<int>(std::floor(tile)), 0),
+                      num_tiles - 1);
+    *tile2 = std::min(*tile1 + 1, num_tiles - 1);
+    *weight2 = std::min(std::max(tile - *tile1, 0.0), 1.0);
+  };
+
+  BitmapColor<uint8_t> color;
+  for (int y = 0; y < height; ++y) {
+    int tile_y1;
+    int tile_y2;
+    double weight_y2;
+    InterpolateTiles(y, height, num_tiles_y, &tile_y1, &tile_y2, &weight_y2);
+    for (int x = 0; x < width; ++x) {
+      int tile_x1;
+      int tile_x2;
+      double weight_x2;
+      InterpolateTiles(x, width, num_tiles_x, &tile_x1, &tile_x2, &weight_x2);
+      const uint8_t value = values[y * width + x];
+      const double value11 =
+          tile_mappings[tile_y1 * num_tiles_x + tile_x1][value];
+      const double value12 =
+          tile_mappings[tile_y1 * num_tiles_x + tile_x2][value];
+      const double value21 =
+          tile_mappings[tile_y2 * num_tiles_x + tile_x1][value];
+      const double value22 =
+          tile_mappings[tile_y2 * num_tiles_x + tile_x2][value];
+      const double value1 = (1 - weight_x2) * value11 + weight_x2 * value12;
+      const double value2 = (1 - weight_x2) * value21 + weight_x2 * value22;
+      color.r = static_cast<uint8_t>(
+          std::round((1 - weight_y2) * value1 + weight_y2 * value2));
+      bitmap->SetPixel(x, y, color);
+    }
+  }
+}
+
+}  // namespace colmap
@@ -0,0 +1,87 @@
+// Copyright (c) 2023, ETH Zurich and UNC Chapel Hill.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of ETH Zurich and UNC Chapel Hill nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include "colmap/sensor/bitmap.h"
+
+#include <string>
+
+namespace colmap {
+
+// Optional preprocessing of images before feature extraction, e.g., to enhance
+// the contrast of turbid underwater images.
+struct ImagePreprocessingOptions {
+  // Whether to compensate the wavelength-dependent attenuation of the water
+  // column by scaling the color channels to equal means (gray-world
+  // assumption). The images are then read in color and converted to grey
+  // after the compensation.
+  bool color_compensation = false;
+
+  // Optional path to a folder with vignetting calibrations, which contains a
+  // grey image "<camera_id>.png" per camera. The intensity of the calibration
+  // image is proportional to the relative illumination of the sensor. Images
+  // of cameras without a calibration are not corrected.
+  std::string vignetting_path = "";
+
+  // Whether to equalize the contrast with contrast limited adaptive histogram
+  // equalization (CLAHE).
+  bool clahe = false;
+
+  // Maximum height of the histogram bins relative to the mean bin height.
+  double clahe_clip_limit = 2.0;
+
+  // Number of tiles in each image dimension, for which the histograms are
+  // computed independently.
+  int clahe_num_tiles = 8;
+
+  // Whether any preprocessing step is enabled.
+  bool IsEnabled() const;
+
+  bool Check() const;
+};
+
+// Scale the color channels of an RGB image such that their means are equal.
+// This compensates the stronger attenuation of red light in water. Grey images
+// are left unchanged.
+void CompensateColorAttenuation(Bitmap* bitmap);
+
+// Divide the image by the relative illumination of the given grey vignetting
+// calibration, where the brightest pixel of the calibration is not attenuated.
+// The calibration is sampled at the relative pixel position, so it can have a
+// different resolution than the image.
+void CorrectVignetting(const Bitmap& vignetting, Bitmap* bitmap);
+
+// Contrast limited adaptive histogram equalization of a grey image. The
+// histograms of the num_tiles x num_tiles tiles are clipped at clip_limit
+// times the mean bin height before equalization, and the resulting mappings
+// are bilinearly interpolated between the tile centers.
+void EqualizeHistogramCLAHE(double clip_limit, int num_tiles, Bitmap* bitmap);
+
+}  // namespace colmap
@@ -0,0 +1,141 @@
+// Copyright (c) 2023, ETH Zurich and UNC Chapel Hill.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of ETH Zurich and UNC Chapel Hill nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "colmap/image/preprocessing.h"
+
+#include <gtest/gtest.h>
+
+namespace colmap {
+namespace {
+
+TEST(ImagePreprocessingOptions, IsEnabled) {
+  ImagePreprocessingOptions options;
+  EXPECT_FALSE(options.IsEnabled());
+  EXPECT_TRUE(options.Check());
+  options.clahe = true;
+  EXPECT_TRUE(options.IsEnabled());
+  options.clahe_num_tiles = 0;
+  EXPECT_FALSE(options.Check());
+}
+
+TEST(CompensateColorAttenuation, Nominal) {
+  Bitmap bitmap;
+  bitmap.Allocate(4, 3, true);
+  bitmap.Fill(BitmapColor<uint8_t>(20, 100, 120));
+  CompensateColorAttenuation(&bitmap);
+  BitmapColor<uint8_t> color;
+  for (int y = 0; y < bitmap.Height(); ++y) {
+    for (int x = 0; x < bitmap.Width(); ++x) {
+      EXPECT_TRUE(bitmap.GetPixel(x, y, &color));
+      EXPECT_EQ(color, BitmapColor<uint8_t>(80, 80, 80));
+    }
+  }
+}
+
+TEST(CompensateColorAttenuation, Grey) {
+  Bitmap bitmap;
+  bitmap.Allocate(4, 3, false);
+  bitmap.Fill(BitmapColor<uint8_t>(20));
+  CompensateColorAttenuation(&bitmap);
+  BitmapColor<uint8_t> color;
+  EXPECT_TRUE(bitmap.GetPixel(1, 1, &color));
+  EXPECT_EQ(color.r, 20);
+}
+
+TEST(CorrectVignetting, Nominal) {
+  Bitmap vignetting;
+  vignetting.Allocate(2, 1, false);
+  vignetting.SetPixel(0, 0, BitmapColor<uint8_t>(100));
+  vignetting.SetPixel(1, 0, BitmapColor<uint8_t>(200));
+
+  Bitmap bitmap;
+  bitmap.Allocate(4, 2, false);
+  bitmap.Fill(BitmapColor<uint8_t>(50));
+  CorrectVignetting(vignetting, &bitmap);
+
+  BitmapColor<uint8_t> color;
+  for (int y = 0; y < bitmap.Height(); ++y) {
+    EXPECT_TRUE(bitmap.GetPixel(0, y, &color));
+    EXPECT_EQ(color.r, 100);
+    EXPECT_TRUE(bitmap.GetPixel(1, y, &color));
+    EXPECT_EQ(color.r, 100);
+    EXPECT_TRUE(bitmap.GetPixel(2, y, &color));
+    EXPECT_EQ(color.r, 50);
+    EXPECT_TRUE(bitmap.GetPixel(3, y, &color));
+    EXPECT_EQ(color.r, 50);
+  }
+}
+
+TEST(EqualizeHistogramCLAHE, IncreasesContrast) {
+  Bitmap bitmap;
+  bitmap.Allocate(64, 64, false);
+  for (int y = 0; y < bitmap.Height(); ++y) {
+    for (int x = 0; x < bitmap.Width(); ++x) {
+      bitmap.SetPixel(x, y, BitmapColor<uint8_t>(100 + (x + y) % 16));
+    }
+  }
+
+  EqualizeHistogramCLAHE(/*clip_limit=*/40, /*num_tiles=*/4, &bitmap);
+
+  uint8_t min_value = 255;
+  uint8_t max_value = 0;
+  BitmapColor<uint8_t> color;
+  for (int y = 0; y < bitmap.Height(); ++y) {
+    for (int x = 0; x < bitmap.Width(); ++x) {
+      EXPECT_TRUE(bitmap.GetPixel(x, y, &color));
+      min_value = std::min(min_value, color.r);
+      max_value = std::max(max_value, color.r);
+    }
+  }
+
+  EXPECT_GT(max_value - min_value, 15);
+}
+
+TEST(EqualizeHistogramCLAHE, MonotonicWithinTile) {
+  Bitmap bitmap;
+  bitmap.Allocate(16, 1, false);
+  for (int x = 0; x < bitmap.Width(); ++x) {
+    bitmap.SetPixel(x, 0, BitmapColor<uint8_t>(x));
+  }
+
+  EqualizeHistogramCLAHE(/*clip_limit=*/1, /*num_tiles=*/1, &bitmap);
+
+  BitmapColor<uint8_t> prev_color;
+  EXPECT_TRUE(bitmap.GetPixel(0, 0, &prev_color));
+  for (int x = 1; x < bitmap.Width(); ++x) {
+    BitmapColor<uint8_t> color;
+    EXPECT_TRUE(bitmap.GetPixel(x, 0, &color));
+    EXPECT_GT(color.r, prev_color.r);
+    prev_color = color;
+  }
+  EXPECT_EQ(prev_color.r, 255);
+}
+
+}  // namespace
+}  // namespace colmap
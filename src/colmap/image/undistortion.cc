@@ -150,6 +150,123 @@ void WriteCOLMAPCommands(const bool geometric,
         << std::endl;
 }
 
+// Compute the remap tables of the cameras of the images. The tables of
+// refractive cameras are always computed, because tracing their rays is
+// expensive. The tables of the other cameras are only computed, if they are
+// shared by multiple images, so that per-image cameras do not hold a table.
+std::unordered_map<camera_t, UndistortionMap> ComputeUndistortionMaps(
+    const UndistortCameraOptions& options,
+    const Reconstruction& reconstruction,
+    const std::vector<image_t>& image_ids) {
+  std::unordered_map<camera_t, size_t> num_camera_images;
+  for (const image_t image_id : image_ids) {
+    num_camera_images[reconstruction.Image(image_id).CameraId()] += 1;
+  }
+
+  std::unordered_map<camera_t, UndistortionMap> undistortion_maps;
+  for (const auto& num_images : num_camera_images) {
+    const Camera& camera = reconstruction.Camera(num_images.first);
+    if (camera.IsCameraRefractive() || num_images.second > 1) {
+      undistortion_maps.emplace(camera.camera_id,
+                                ComputeUndistortionMap(options, camera));
+    }
+  }
+  return undistortion_maps;
+}
+
+// Undistort the image with the precomputed remap table of its camera, if
+// available, or otherwise directly with the camera model.
+void UndistortImageWithMaps(
+    const UndistortCameraOptions& options,
+    const std::unordered_map<camera_t, UndistortionMap>& undistortion_maps,
+    const Bitmap& distorted_bitmap,
+    const Camera& distorted_camera,
+    Bitmap* undistorted_bitmap,
+    Camera* undistorted_camera) {
+  const auto map = undistortion_maps.find(distorted_camera.camera_id);
+  if (map == undistortion_maps.end()) {
+    UndistortImage(options,
+                   distorted_bitmap,
+                   distorted_camera,
+                   undistorted_bitmap,
+                   undistorted_camera);
+    return;
+  }
+
+  CHECK_EQ(distorted_camera.width, distorted_bitmap.Width());
+  CHECK_EQ(distorted_camera.height, distorted_bitmap.Height());
+  *undistorted_camera = map->second.undistorted_camera;
+  UndistortImageWithMap(map->second, distorted_bitmap, undistorted_bitmap);
+}
+
+// Compute the remap table of the undistorted camera, whose normalized image
+// points are first transformed by the homography `H`. The identity yields the
+// plain undistortion and a rectifying homography the stereo rectification.
+UndistortionMap ComputeRemapTable(const UndistortCameraOptions& options,
+                                  const Camera& distorted_camera,
+                                  const Camera& undistorted_camera,
+                                  const Eigen::Matrix3d& H,
+                                  const int num_threads) {
+  UndistortionMap map;
+  map.undistorted_camera = undistorted_camera;
+
+  const bool is_refractive = distorted_camera.IsCameraRefractive();
+  Camera remap_camera = map.undistorted_camera;
+  if (!is_refractive &&
+      (remap_camera.width != distorted_camera.width ||
+       remap_camera.height != distorted_camera.height)) {
+    remap_camera.Rescale(distorted_camera.width, distorted_camera.height);
+  }
+
+  map.width = static_cast<int>(remap_camera.width);
+  map.height = static_cast<int>(remap_camera.height);
+  map.source_points.resize(remap_camera.width * remap_camera.height);
+
+  // Project the viewing ray of each remapped pixel into the distorted camera.
+  // For refractive cameras, the point at the reference distance on the ray is
+  // projected through the refractive interface. The rows are independent and
+  // the (refractive) projection is expensive, so they are computed in
+  // parallel.
+  const auto ComputeRow = [&](const int y) {
+    Eigen::Vector2f* row_source_points = &map.source_points[y * map.width];
+    std::vector<Eigen::Vector3d> row_points_in_cam;
+    if (is_refractive) {
+      row_points_in_cam.reserve(map.width);
+    }
+    for (int x = 0; x < map.width; ++x) {
+      // Camera models assume that the upper left pixel center is (0.5, 0.5).
+      const Eigen::Vector2d cam_point =
+          (H * remap_camera.CamFromImg(Eigen::Vector2d(x + 0.5, y + 0.5))
+                   .homogeneous())
+              .hnormalized();
+      if (is_refractive) {
+        row_points_in_cam.push_back(options.refrac_reference_distance *
+                                    cam_point.homogeneous().normalized());
+      } else {
+        row_source_points[x] =
+            distorted_camera.ImgFromCam(cam_point).cast<float>();
+      }
+    }
+    if (is_refractive) {
+      // Project the whole row at once to resolve the refractive model once.
+      std::vector<Eigen::Vector2d> row_image_points;
+      distorted_camera.ImgFromCamRefracBatch(row_points_in_cam,
+                                             &row_image_points);
+      for (int x = 0; x < map.width; ++x) {
+        row_source_points[x] = row_image_points[x].cast<float>();
+      }
+    }
+  };
+
+  ThreadPool thread_pool(num_threads);
+  for (int y = 0; y < map.height; ++y) {
+    thread_pool.AddTask(ComputeRow, y);
+  }
+  thread_pool.Wait();
+
+  return map;
+}
+
 }  // namespace
 
 COLMAPUndistorter::COLMAPUndistorter(const UndistortCameraOptions& options,
@@ -183,6 +300,11 @@ void COLMAPUndistorter::Run() {
   reconstruction_.CreateImageDirs(
       JoinPaths(output_path_, "stereo/consistency_graphs"));
 
+  undistortion_maps_ = ComputeUndistortionMaps(
+      options_,
+      reconstruction_,
+      image_ids_.empty() ? reconstruction_.RegImageIds() : image_ids_);
+
   ThreadPool thread_pool;
   std::vector<std::future<bool>> futures;
   futures.reserve(reconstruction_.NumRegImages());
@@ -250,8 +372,8 @@ bool COLMAPUndistorter::Undistort(const image_t image_id) const {
 
   // Check if the image is already undistorted and copy from source if no
   // scaling is needed
-  if (camera.IsUndistorted() && options_.max_image_size < 0 &&
-      ExistsFile(input_image_path)) {
+  if (camera.IsUndistorted() && !camera.IsCameraRefractive() &&
+      options_.max_image_size < 0 && ExistsFile(input_image_path)) {
     LOG(INFO) << "Undistorted image found; copying to location: "
               << output_image_path;
     FileCopy(input_image_path, output_image_path, copy_type_);
@@ -263,11 +385,12 @@ bool COLMAPUndistorter::Undistort(const image_t image_id) const {
     return false;
   }
 
-  UndistortImage(options_,
-                 distorted_bitmap,
-                 camera,
-                 &undistorted_bitmap,
-                 &undistorted_camera);
+  UndistortImageWithMaps(options_,
+                         undistortion_maps_,
+                         distorted_bitmap,
+                         camera,
+                         &undistorted_bitmap,
+                         &undistorted_camera);
   return undistorted_bitmap.Write(output_image_path);
 }
 
@@ -319,6 +442,9 @@ void PMVSUndistorter::Run() {
   CreateDirIfNotExists(JoinPaths(output_path_, "pmvs/visualize"));
   CreateDirIfNotExists(JoinPaths(output_path_, "pmvs/models"));
 
+  undistortion_maps_ = ComputeUndistortionMaps(
+      options_, reconstruction_, reconstruction_.RegImageIds());
+
   ThreadPool thread_pool;
   std::vector<std::future<bool>> futures;
   futures.reserve(reconstruction_.NumRegImages());
@@ -385,11 +511,12 @@ bool PMVSUndistorter::Undistort(const size_t reg_image_idx) const {
 
   Bitmap undistorted_bitmap;
   Camera undistorted_camera;
-  UndistortImage(options_,
-                 distorted_bitmap,
-                 camera,
-                 &undistorted_bitmap,
-                 &undistorted_camera);
+  UndistortImageWithMaps(options_,
+                         undistortion_maps_,
+                         distorted_bitmap,
+                         camera,
+                         &undistorted_bitmap,
+                         &undistorted_camera);
 
   WriteProjectionMatrix(proj_matrix_path, undistorted_camera, image, "CONTOUR");
   return undistorted_bitmap.Write(output_image_path);
@@ -551,6 +678,9 @@ CMPMVSUndistorter::CMPMVSUndistorter(const UndistortCameraOptions& options,
 void CMPMVSUndistorter::Run() {
   PrintHeading1("Image undistortion (CMP-MVS)");
 
+  undistortion_maps_ = ComputeUndistortionMaps(
+      options_, reconstruction_, reconstruction_.RegImageIds());
+
   ThreadPool thread_pool;
   std::vector<std::future<bool>> futures;
   futures.reserve(reconstruction_.NumRegImages());
@@ -592,11 +722,12 @@ bool CMPMVSUndistorter::Undistort(const size_t reg_image_idx) const {
 
   Bitmap undistorted_bitmap;
   Camera undistorted_camera;
-  UndistortImage(options_,
-                 distorted_bitmap,
-                 camera,
-                 &undistorted_bitmap,
-                 &undistorted_camera);
+  UndistortImageWithMaps(options_,
+                         undistortion_maps_,
+                         distorted_bitmap,
+                         camera,
+                         &undistorted_bitmap,
+                         &undistorted_camera);
 
   WriteProjectionMatrix(proj_matrix_path, undistorted_camera, image, "CONTOUR");
   return undistorted_bitmap.Write(output_image_path);
@@ -669,16 +800,22 @@ StereoImageRectifier::StereoImageRectifier(
     const Reconstruction& reconstruction,
     const std::string& image_path,
     const std::string& output_path,
-    const std::vector<std::pair<image_t, image_t>>& stereo_pairs)
+    const std::vector<std::pair<image_t, image_t>>& stereo_pairs,
+    const bool fixed_rig)
     : options_(options),
       image_path_(image_path),
       output_path_(output_path),
       stereo_pairs_(stereo_pairs),
-      reconstruction_(reconstruction) {}
+      reconstruction_(reconstruction),
+      fixed_rig_(fixed_rig) {}
 
 void StereoImageRectifier::Run() {
   PrintHeading1("Stereo rectification");
 
+  if (fixed_rig_) {
+    ComputeRigMaps();
+  }
+
   ThreadPool thread_pool;
   std::vector<std::future<void>> futures;
   futures.reserve(stereo_pairs_.size());
@@ -703,6 +840,50 @@ void StereoImageRectifier::Run() {
   GetTimer().PrintMinutes();
 }
 
+void StereoImageRectifier::ComputeRigMaps() {
+  std::map<CameraPair, std::vector<Rigid3d>> rig_cam2_from_cam1s;
+  for (const auto& stereo_pair : stereo_pairs_) {
+    const Image& image1 = reconstruction_.Image(stereo_pair.first);
+    const Image& image2 = reconstruction_.Image(stereo_pair.second);
+    rig_cam2_from_cam1s[CameraPair(image1.CameraId(), image2.CameraId())]
+        .push_back(image2.CamFromWorld() * Inverse(image1.CamFromWorld()));
+  }
+
+  rig_maps_.clear();
+  for (const auto& cam2_from_cam1s : rig_cam2_from_cam1s) {
+    // Average the relative poses to reduce the noise of the individually
+    // estimated image poses.
+    std::vector<Eigen::Quaterniond> rotations;
+    rotations.reserve(cam2_from_cam1s.second.size());
+    Eigen::Vector3d mean_translation = Eigen::Vector3d::Zero();
+    for (const Rigid3d& cam2_from_cam1 : cam2_from_cam1s.second) {
+      rotations.push_back(cam2_from_cam1.rotation);
+      mean_translation += cam2_from_cam1.translation;
+    }
+    mean_translation /= cam2_from_cam1s.second.size();
+    const Rigid3d mean_cam2_from_cam1(
+        AverageQuaternions(rotations,
+                           std::vector<double>(rotations.size(), 1.0)),
+        mean_translation);
+
+    LOG(INFO) << StringPrintf(
+        "Computing rectification maps for cameras %d and %d (%d pairs)",
+        cam2_from_cam1s.first.first,
+        cam2_from_cam1s.first.second,
+        cam2_from_cam1s.second.size());
+
+    RectificationMaps& maps = rig_maps_[cam2_from_cam1s.first];
+    ComputeStereoRectificationMaps(
+        options_,
+        reconstruction_.Camera(cam2_from_cam1s.first.first),
+        reconstruction_.Camera(cam2_from_cam1s.first.second),
+        mean_cam2_from_cam1,
+        &maps.map1,
+        &maps.map2,
+        &maps.Q);
+  }
+}
+
 void StereoImageRectifier::Rectify(const image_t image_id1,
                                    const image_t image_id2) const {
   const Image& image1 = reconstruction_.Image(image_id1);
@@ -737,23 +918,54 @@ void StereoImageRectifier::Rectify(const image_t image_id1,
     return;
   }
 
-  const Rigid3d cam2_from_cam1 =
-      image2.CamFromWorld() * Inverse(image1.CamFromWorld());
+  CHECK_EQ(camera1.width, distorted_bitmap1.Width());
+  CHECK_EQ(camera1.height, distorted_bitmap1.Height());
+  CHECK_EQ(camera2.width, distorted_bitmap2.Width());
+  CHECK_EQ(camera2.height, distorted_bitmap2.Height());
 
   Bitmap undistorted_bitmap1;
   Bitmap undistorted_bitmap2;
-  Camera undistorted_camera;
   Eigen::Matrix4d Q;
-  RectifyAndUndistortStereoImages(options_,
-                                  distorted_bitmap1,
-                                  distorted_bitmap2,
-                                  camera1,
-                                  camera2,
-                                  cam2_from_cam1,
-                                  &undistorted_bitmap1,
-                                  &undistorted_bitmap2,
-                                  &undistorted_camera,
-                                  &Q);
+  const auto rig_maps =
+      rig_maps_.find(CameraPair(image1.CameraId(), image2.CameraId()));
+  if (rig_maps != rig_maps_.end()) {
+    UndistortImageWithMap(
+        rig_maps->second.map1, distorted_bitmap1, &undistorted_bitmap1);
+    UndistortImageWithMap(
+        rig_maps->second.map2, distorted_bitmap2, &undistorted_bitmap2);
+    Q = rig_maps->second.Q;
+  } else {
+    const Rigid3d cam2_from_cam1 =
+        image2.CamFromWorld() * Inverse(image1.CamFromWorld());
+    if (camera1.IsCameraRefractive() || camera2.IsCameraRefractive()) {
+      // The pairs are already rectified in parallel, so the tables are
+      // computed on the calling thread.
+      UndistortionMap map1;
+      UndistortionMap map2;
+      ComputeStereoRectificationMaps(options_,
+                                     camera1,
+                                     camera2,
+                                     cam2_from_cam1,
+                                     &map1,
+                                     &map2,
+                                     &Q,
+                                     /*num_threads=*/1);
+      UndistortImageWithMap(map1, distorted_bitmap1, &undistorted_bitmap1);
+      UndistortImageWithMap(map2, distorted_bitmap2, &undistorted_bitmap2);
+    } else {
+      Camera undistorted_camera;
+      RectifyAndUndistortStereoImages(options_,
+                                      distorted_bitmap1,
+                                      distorted_bitmap2,
+                                      camera1,
+                                      camera2,
+                                      cam2_from_cam1,
+                                      &undistorted_bitmap1,
+                                      &undistorted_bitmap2,
+                                      &undistorted_camera,
+                                      &Q);
+    }
+  }
 
   undistorted_bitmap1.Write(output_image1_path);
   undistorted_bitmap2.Write(output_image2_path);
@@ -777,6 +989,22 @@ Camera UndistortCamera(const UndistortCameraOptions& options,
   CHECK_LE(options.roi_max_y, 1.0);
   CHECK_LT(options.roi_min_x, options.roi_max_x);
   CHECK_LT(options.roi_min_y, options.roi_max_y);
+  CHECK_GT(options.refrac_reference_distance, 0.0);
+
+  // Refractive cameras are undistorted via the points on their refracted rays
+  // at the reference distance, which are imaged by the undistorted camera.
+  const bool is_refractive = camera.IsCameraRefractive();
+  const CameraRefracKernel refrac_kernel =
+      is_refractive ? camera.RefracKernel() : CameraRefracKernel();
+  const auto CamFromImg = [&](const Eigen::Vector2d& image_point) {
+    if (is_refractive) {
+      return refrac_kernel
+          .CamFromImgPoint(image_point, options.refrac_reference_distance)
+          .hnormalized()
+          .eval();
+    }
+    return camera.CamFromImg(image_point);
+  };
 
   Camera undistorted_camera;
   undistorted_camera.model_id = PinholeCameraModel::model_id;
@@ -830,8 +1058,9 @@ Camera UndistortCamera(const UndistortCameraOptions& options,
   }
 
   // Scale the image such the the boundary of the undistorted image.
-  if (roi_enabled || (camera.model_id != SimplePinholeCameraModel::model_id &&
-                      camera.model_id != PinholeCameraModel::model_id)) {
+  if (roi_enabled || is_refractive ||
+      (camera.model_id != SimplePinholeCameraModel::model_id &&
+       camera.model_id != PinholeCameraModel::model_id)) {
     // Determine min/max coordinates along top / bottom image border.
 
     double left_min_x = std::numeric_limits<double>::max();
@@ -842,14 +1071,14 @@ Camera UndistortCamera(const UndistortCameraOptions& options,
     for (size_t y = roi_min_y; y < roi_max_y; ++y) {
       // Left border.
       const Eigen::Vector2d point1_in_cam =
-          camera.CamFromImg(Eigen::Vector2d(0.5, y + 0.5));
+          CamFromImg(Eigen::Vector2d(0.5, y + 0.5));
       const Eigen::Vector2d undistorted_point1 =
           undistorted_camera.ImgFromCam(point1_in_cam);
       left_min_x = std::min(left_min_x, undistorted_point1(0));
       left_max_x = std::max(left_max_x, undistorted_point1(0));
       // Right border.
       const Eigen::Vector2d point2_in_cam =
-          camera.CamFromImg(Eigen::Vector2d(camera.width - 0.5, y + 0.5));
+          CamFromImg(Eigen::Vector2d(camera.width - 0.5, y + 0.5));
       const Eigen::Vector2d undistorted_point2 =
           undistorted_camera.ImgFromCam(point2_in_cam);
       right_min_x = std::min(right_min_x, undistorted_point2(0));
@@ -866,14 +1095,14 @@ Camera UndistortCamera(const UndistortCameraOptions& options,
     for (size_t x = roi_min_x; x < roi_max_x; ++x) {
       // Top border.
       const Eigen::Vector2d point1_in_cam =
-          camera.CamFromImg(Eigen::Vector2d(x + 0.5, 0.5));
+          CamFromImg(Eigen::Vector2d(x + 0.5, 0.5));
       const Eigen::Vector2d undistorted_point1 =
           undistorted_camera.ImgFromCam(point1_in_cam);
       top_min_y = std::min(top_min_y, undistorted_point1(1));
       top_max_y = std::max(top_max_y, undistorted_point1(1));
       // Bottom border.
       const Eigen::Vector2d point2_in_cam =
-          camera.CamFromImg(Eigen::Vector2d(x + 0.5, camera.height - 0.5));
+          CamFromImg(Eigen::Vector2d(x + 0.5, camera.height - 0.5));
       const Eigen::Vector2d undistorted_point2 =
           undistorted_camera.ImgFromCam(point2_in_cam);
       bottom_min_y = std::min(bottom_min_y, undistorted_point2(1));
@@ -951,6 +1180,14 @@ void UndistortImage(const UndistortCameraOptions& options,
   CHECK_EQ(distorted_camera.width, distorted_bitmap.Width());
   CHECK_EQ(distorted_camera.height, distorted_bitmap.Height());
 
+  if (distorted_camera.IsCameraRefractive()) {
+    const UndistortionMap map =
+        ComputeUndistortionMap(options, distorted_camera);
+    *undistorted_camera = map.undistorted_camera;
+    UndistortImageWithMap(map, distorted_bitmap, undistorted_bitmap);
+    return;
+  }
+
   *undistorted_camera = UndistortCamera(options, distorted_camera);
   undistorted_bitmap->Allocate(static_cast<int>(undistorted_camera->width),
                                static_cast<int>(undistorted_camera->height),
@@ -963,11 +1200,40 @@ void UndistortImage(const UndistortCameraOptions& options,
                           undistorted_bitmap);
 }
 
+UndistortionMap ComputeUndistortionMap(const UndistortCameraOptions& options,
+                                       const Camera& distorted_camera,
+                                       const int num_threads) {
+  return ComputeRemapTable(options,
+                           distorted_camera,
+                           UndistortCamera(options, distorted_camera),
+                           Eigen::Matrix3d::Identity(),
+                           num_threads);
+}
+
+void UndistortImageWithMap(const UndistortionMap& map,
+                           const Bitmap& distorted_bitmap,
+                           Bitmap* undistorted_bitmap,
+                           const int num_threads) {
+  undistorted_bitmap->Allocate(
+      map.width, map.height, distorted_bitmap.IsRGB());
+  distorted_bitmap.CloneMetadata(undistorted_bitmap);
+
+  WarpImageWithRemap(
+      map.source_points, distorted_bitmap, undistorted_bitmap, num_threads);
+
+  if (static_cast<size_t>(map.width) != map.undistorted_camera.width ||
+      static_cast<size_t>(map.height) != map.undistorted_camera.height) {
+    undistorted_bitmap->Rescale(
+        static_cast<int>(map.undistorted_camera.width),
+        static_cast<int>(map.undistorted_camera.height));
+  }
+}
+
 void UndistortReconstruction(const UndistortCameraOptions& options,
                              Reconstruction* reconstruction) {
   const auto distorted_cameras = reconstruction->Cameras();
   for (const auto& camera : distorted_cameras) {
-    if (camera.second.IsUndistorted()) {
+    if (camera.second.IsUndistorted() && !camera.second.IsCameraRefractive()) {
       continue;
     }
     reconstruction->Camera(camera.first) =
@@ -978,11 +1244,27 @@ void UndistortReconstruction(const UndistortCameraOptions& options,
     auto& image = reconstruction->Image(distorted_image.first);
     const auto& distorted_camera = distorted_cameras.at(image.CameraId());
     const auto& undistorted_camera = reconstruction->Camera(image.CameraId());
-    for (point2D_t point2D_idx = 0; point2D_idx < image.NumPoints2D();
-         ++point2D_idx) {
-      auto& point2D = image.Point2D(point2D_idx);
-      point2D.xy = undistorted_camera.ImgFromCam(
-          distorted_camera.CamFromImg(point2D.xy));
+    const bool is_refractive = distorted_camera.IsCameraRefractive();
+    const CameraRefracKernel refrac_kernel =
+        is_refractive ? distorted_camera.RefracKernel() : CameraRefracKernel();
+    if (is_refractive) {
+      // Back-project the contiguous image coordinates in one batch.
+      std::vector<Eigen::Vector3d> points_in_cam(image.NumPoints2D());
+      refrac_kernel.CamFromImgPoint(image.NumPoints2D(),
+                                    image.Points2DXY().data(),
+                                    options.refrac_reference_distance,
+                                    points_in_cam.data());
+      for (point2D_t point2D_idx = 0; point2D_idx < image.NumPoints2D();
+           ++point2D_idx) {
+        image.Point2DXY(point2D_idx) = undistorted_camera.ImgFromCam(
+            points_in_cam[point2D_idx].hnormalized());
+      }
+    } else {
+      for (point2D_t point2D_idx = 0; point2D_idx < image.NumPoints2D();
+           ++point2D_idx) {
+        Eigen::Vector2d& xy = image.Point2DXY(point2D_idx);
+        xy = undistorted_camera.ImgFromCam(distorted_camera.CamFromImg(xy));
+      }
     }
   }
 }
@@ -1093,4 +1375,39 @@ void RectifyAndUndistortStereoImages(const UndistortCameraOptions& options,
                                         undistorted_image2);
 }
 
+void ComputeStereoRectificationMaps(const UndistortCameraOptions& options,
+                                    const Camera& distorted_camera1,
+                                    const Camera& distorted_camera2,
+                                    const Rigid3d& cam2_from_cam1,
+                                    UndistortionMap* map1,
+                                    UndistortionMap* map2,
+                                    Eigen::Matrix4d* Q,
+                                    const int num_threads) {
+  CHECK_NOTNULL(map1);
+  CHECK_NOTNULL(map2);
+
+  const Camera undistorted_camera =
+      UndistortCamera(options, distorted_camera1);
+
+  Eigen::Matrix3d H1;
+  Eigen::Matrix3d H2;
+  RectifyStereoCameras(
+      undistorted_camera, undistorted_camera, cam2_from_cam1, &H1, &H2, Q);
+
+  // The homographies map undistorted to rectified pixels, whereas the remap
+  // tables require the inverse mapping between normalized image points.
+  const Eigen::Matrix3d K = undistorted_camera.CalibrationMatrix();
+  const Eigen::Matrix3d K_inv = K.inverse();
+  *map1 = ComputeRemapTable(options,
+                            distorted_camera1,
+                            undistorted_camera,
+                            K_inv * H1.inverse() * K,
+                            num_threads);
+  *map2 = ComputeRemapTable(options,
+                            distorted_camera2,
+                            undistorted_camera,
+                            K_inv * H2.inverse() * K,
+                            num_threads);
+}
+
 }  // namespace colmap
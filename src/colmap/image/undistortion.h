@@ -35,6 +35,8 @@
 #include "colmap/util/misc.h"
 #include "colmap/util/threading.h"
 
+#include <map>
+
 namespace colmap {
 
 struct UndistortCameraOptions {
@@ -57,6 +59,33 @@ struct UndistortCameraOptions {
   double roi_min_y = 0.0;
   double roi_max_x = 1.0;
   double roi_max_y = 1.0;
+
+  // Refractive cameras are undistorted into a pinhole camera located at the
+  // center of the real camera. The pinhole and refracted viewing rays of a
+  // pixel intersect at this distance from the camera center, such that scene
+  // points at this distance are imaged at the same pixels as in the refractive
+  // camera. It should be set to the typical scene distance of the images.
+  double refrac_reference_distance = 1.0;
+};
+
+// Remap table from the pixels of an undistorted camera to the pixels of a
+// distorted camera. The table only depends on the camera, so that it can be
+// computed once and shared by all images of the camera.
+struct UndistortionMap {
+  // The undistorted pinhole camera.
+  Camera undistorted_camera;
+
+  // Dimensions of the table. Refractive cameras are remapped directly into the
+  // undistorted camera, see `UndistortCameraOptions`. Other cameras are
+  // remapped in the resolution of the distorted camera to avoid aliasing and
+  // then rescaled, as in `WarpImageBetweenCameras`.
+  int width = 0;
+  int height = 0;
+
+  // Row-major locations of the remapped pixels in the distorted image, where
+  // pixel centers have coordinates (0.5, 0.5). The locations are NaN for
+  // pixels without a refracted ray, e.g. due to total reflection.
+  std::vector<Eigen::Vector2f> source_points;
 };
 
 // Undistort images and export undistorted cameras, as required by the
@@ -88,6 +117,7 @@ class COLMAPUndistorter : public Thread {
   const Reconstruction& reconstruction_;
   const std::vector<image_t> image_ids_;
   std::vector<std::string> image_names_;
+  std::unordered_map<camera_t, UndistortionMap> undistortion_maps_;
 };
 
 // Undistort images and prepare data for CMVS/PMVS.
@@ -113,6 +143,7 @@ class PMVSUndistorter : public Thread {
   std::string image_path_;
   std::string output_path_;
   const Reconstruction& reconstruction_;
+  std::unordered_map<camera_t, UndistortionMap> undistortion_maps_;
 };
 
 // Undistort images and prepare data for CMP-MVS.
@@ -132,6 +163,7 @@ class CMPMVSUndistorter : public Thread {
   std::string image_path_;
   std::string output_path_;
   const Reconstruction& reconstruction_;
+  std::unordered_map<camera_t, UndistortionMap> undistortion_maps_;
 };
 
 // Undistort images and export undistorted cameras without the need for a
@@ -156,7 +188,13 @@ class PureImageUndistorter : public Thread {
   const std::vector<std::pair<std::string, Camera>>& image_names_and_cameras_;
 };
 
-// Rectify stereo image pairs.
+// Rectify stereo image pairs. Pairs of refractive cameras are rectified with
+// remap tables into the refractive undistortion, see `UndistortCameraOptions`.
+//
+// If `fixed_rig` is set, the stereo pairs are assumed to be captured by stereo
+// rigs with fixed calibration. The remap tables are then computed only once per
+// pair of cameras from the average relative pose of its stereo pairs and shared
+// by all of them, which avoids evaluating the camera models for every pair.
 class StereoImageRectifier : public Thread {
  public:
   StereoImageRectifier(
@@ -164,11 +202,21 @@ class StereoImageRectifier : public Thread {
       const Reconstruction& reconstruction,
       const std::string& image_path,
       const std::string& output_path,
-      const std::vector<std::pair<image_t, image_t>>& stereo_pairs);
+      const std::vector<std::pair<image_t, image_t>>& stereo_pairs,
+      bool fixed_rig = false);
 
  private:
+  typedef std::pair<camera_t, camera_t> CameraPair;
+
+  struct RectificationMaps {
+    UndistortionMap map1;
+    UndistortionMap map2;
+    Eigen::Matrix4d Q;
+  };
+
   void Run();
 
+  void ComputeRigMaps();
   void Rectify(image_t image_id1, image_t image_id2) const;
 
   UndistortCameraOptions options_;
@@ -176,6 +224,13 @@ class StereoImageRectifier : public Thread {
   std::string output_path_;
   const std::vector<std::pair<image_t, image_t>>& stereo_pairs_;
   const Reconstruction& reconstruction_;
+  const bool fixed_rig_;
+  std::map<CameraPair,
+           RectificationMaps,
+           std::less<CameraPair>,
+           Eigen::aligned_allocator<
+               std::pair<const CameraPair, RectificationMaps>>>
+      rig_maps_;
 };
 
 // Undistort camera by resizing the image and shifting the principal point.
@@ -195,6 +250,9 @@ class StereoImageRectifier : public Thread {
 // The relative location of the principal point of the distorted camera is
 // preserved. The scaling of the image dimensions is subject to the `min_scale`,
 // `max_scale`, and `max_image_size` constraints.
+//
+// Refractive cameras are undistorted into a pinhole camera that coincides with
+// the refractive camera at `refrac_reference_distance`.
 Camera UndistortCamera(const UndistortCameraOptions& options,
                        const Camera& camera);
 
@@ -207,6 +265,18 @@ void UndistortImage(const UndistortCameraOptions& options,
                     Bitmap* undistorted_image,
                     Camera* undistorted_camera);
 
+// Compute the remap table of a camera into its undistorted pinhole camera,
+// where the rows are computed on `num_threads` threads.
+UndistortionMap ComputeUndistortionMap(const UndistortCameraOptions& options,
+                                       const Camera& distorted_camera,
+                                       int num_threads = -1);
+
+// Undistort image with the precomputed remap table of its camera.
+void UndistortImageWithMap(const UndistortionMap& map,
+                           const Bitmap& distorted_image,
+                           Bitmap* undistorted_image,
+                           int num_threads = 1);
+
 // Undistort all cameras in the reconstruction and accordingly all
 // observations in their corresponding images.
 void UndistortReconstruction(const UndistortCameraOptions& options,
@@ -224,6 +294,20 @@ void RectifyStereoCameras(const Camera& camera1,
                           Eigen::Matrix3d* H2,
                           Eigen::Matrix4d* Q);
 
+// Compute the remap tables that rectify and undistort the images of a stereo
+// pair with the given geometry, as in `RectifyAndUndistortStereoImages`. Both
+// tables share the undistorted camera and can be applied with
+// `UndistortImageWithMap`. In contrast to the former, refractive cameras are
+// remapped into their refractive undistortion.
+void ComputeStereoRectificationMaps(const UndistortCameraOptions& options,
+                                    const Camera& distorted_camera1,
+                                    const Camera& distorted_camera2,
+                                    const Rigid3d& cam2_from_cam1,
+                                    UndistortionMap* map1,
+                                    UndistortionMap* map2,
+                                    Eigen::Matrix4d* Q,
+                                    int num_threads = -1);
+
 // Rectify and undistort the stereo image pair using the given geometry.
 void RectifyAndUndistortStereoImages(const UndistortCameraOptions& options,
                                      const Bitmap& distorted_image1,
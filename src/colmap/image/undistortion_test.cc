@@ -30,6 +30,7 @@
 #include "colmap/image/undistortion.h"
 
 #include "colmap/geometry/pose.h"
+#include "colmap/sensor/models_refrac.h"
 
 #include <gtest/gtest.h>
 
@@ -219,6 +220,135 @@ TEST(UndistortReconstruction, Nominal) {
   }
 }
 
+TEST(UndistortReconstruction, Refractive) {
+  Camera camera =
+      Camera::CreateFromModelName(1, "SIMPLE_PINHOLE", 100.0, 100, 80);
+  camera.refrac_model_id = FlatPort::refrac_model_id;
+  camera.refrac_params = {0.1, 0.05, 0.99, 0.05, 0.007, 1.0, 1.52, 1.33};
+  Eigen::Map<Eigen::Vector3d>(camera.refrac_params.data()).normalize();
+
+  Reconstruction reconstruction;
+  reconstruction.AddCamera(camera);
+  Image image;
+  image.SetImageId(1);
+  image.SetCameraId(1);
+  image.SetName("image1");
+  image.SetPoints2D({Eigen::Vector2d(20.0, 30.0), Eigen::Vector2d(60.0, 50.0)});
+  reconstruction.AddImage(image);
+  reconstruction.RegisterImage(1);
+
+  UndistortCameraOptions options;
+  options.refrac_reference_distance = 2.0;
+  UndistortReconstruction(options, &reconstruction);
+  const Camera& undistorted_camera = reconstruction.Camera(1);
+  EXPECT_EQ(undistorted_camera.ModelName(), "PINHOLE");
+  EXPECT_FALSE(undistorted_camera.IsCameraRefractive());
+
+  // The undistorted observations are the projections of the points at the
+  // reference distance on the refracted rays of the original observations.
+  for (point2D_t point2D_idx = 0; point2D_idx < image.NumPoints2D();
+       ++point2D_idx) {
+    const Eigen::Vector3d point_in_cam = camera.CamFromImgRefracPoint(
+        image.Point2D(point2D_idx).xy, options.refrac_reference_distance);
+    EXPECT_NEAR(point_in_cam.norm(), options.refrac_reference_distance, 1e-6);
+    EXPECT_LT((reconstruction.Image(1).Point2D(point2D_idx).xy -
+               undistorted_camera.ImgFromCam(point_in_cam.hnormalized()))
+                  .norm(),
+              1e-6);
+  }
+}
+
+TEST(ComputeUndistortionMap, Nominal) {
+  UndistortCameraOptions options;
+  options.blank_pixels = 1;
+
+  Camera distorted_camera =
+      Camera::CreateFromModelName(1, "SIMPLE_RADIAL", 100, 100, 100);
+  distorted_camera.params[3] = 0.5;
+
+  const UndistortionMap map = ComputeUndistortionMap(options, distorted_camera);
+  // The remapping is performed in the resolution of the distorted camera.
+  EXPECT_EQ(map.width, distorted_camera.width);
+  EXPECT_EQ(map.height, distorted_camera.height);
+  EXPECT_EQ(map.source_points.size(),
+            distorted_camera.width * distorted_camera.height);
+
+  Bitmap distorted_image;
+  distorted_image.Allocate(100, 100, false);
+  for (int y = 0; y < distorted_image.Height(); ++y) {
+    for (int x = 0; x < distorted_image.Width(); ++x) {
+      distorted_image.SetPixel(x, y, BitmapColor<uint8_t>(x + y));
+    }
+  }
+
+  Bitmap undistorted_image;
+  Camera undistorted_camera;
+  UndistortImage(options,
+                 distorted_image,
+                 distorted_camera,
+                 &undistorted_image,
+                 &undistorted_camera);
+
+  // The precomputed table must reproduce the direct undistortion.
+  Bitmap map_undistorted_image;
+  UndistortImageWithMap(map, distorted_image, &map_undistorted_image);
+  EXPECT_EQ(map.undistorted_camera.ParamsToString(),
+            undistorted_camera.ParamsToString());
+  ASSERT_EQ(map_undistorted_image.Width(), undistorted_image.Width());
+  ASSERT_EQ(map_undistorted_image.Height(), undistorted_image.Height());
+  for (int y = 0; y < undistorted_image.Height(); ++y) {
+    for (int x = 0; x < undistorted_image.Width(); ++x) {
+      BitmapColor<uint8_t> color;
+      BitmapColor<uint8_t> map_color;
+      EXPECT_TRUE(undistorted_image.GetPixel(x, y, &color));
+      EXPECT_TRUE(map_undistorted_image.GetPixel(x, y, &map_color));
+      EXPECT_LE(std::abs(static_cast<int>(color.r) - map_color.r), 1);
+    }
+  }
+}
+
+TEST(ComputeUndistortionMap, Refractive) {
+  Camera camera =
+      Camera::CreateFromModelName(1, "SIMPLE_PINHOLE", 100.0, 100, 80);
+  camera.refrac_model_id = FlatPort::refrac_model_id;
+  camera.refrac_params = {0.1, 0.05, 0.99, 0.05, 0.007, 1.0, 1.52, 1.33};
+  Eigen::Map<Eigen::Vector3d>(camera.refrac_params.data()).normalize();
+
+  UndistortCameraOptions options;
+  options.refrac_reference_distance = 2.0;
+  const UndistortionMap map = ComputeUndistortionMap(options, camera);
+  const Camera& undistorted_camera = map.undistorted_camera;
+  EXPECT_EQ(undistorted_camera.ModelName(), "PINHOLE");
+  EXPECT_EQ(map.width, undistorted_camera.width);
+  EXPECT_EQ(map.height, undistorted_camera.height);
+  ASSERT_EQ(map.source_points.size(),
+            undistorted_camera.width * undistorted_camera.height);
+
+  // Tracing the refracted ray of the source pixel to the reference distance
+  // must yield a point on the viewing ray of the undistorted pixel.
+  for (size_t y = 0; y < undistorted_camera.height; y += 7) {
+    for (size_t x = 0; x < undistorted_camera.width; x += 7) {
+      const Eigen::Vector2f& source_point =
+          map.source_points[y * undistorted_camera.width + x];
+      ASSERT_TRUE(source_point.allFinite());
+      const Eigen::Vector3d point_in_cam = camera.CamFromImgRefracPoint(
+          source_point.cast<double>(), options.refrac_reference_distance);
+      EXPECT_LT((undistorted_camera.ImgFromCam(point_in_cam.hnormalized()) -
+                 Eigen::Vector2d(x + 0.5, y + 0.5))
+                    .norm(),
+                1e-2);
+    }
+  }
+
+  Bitmap distorted_bitmap;
+  distorted_bitmap.Allocate(camera.width, camera.height, true);
+  distorted_bitmap.Fill(BitmapColor<uint8_t>(255, 0, 0));
+  Bitmap undistorted_bitmap;
+  UndistortImageWithMap(map, distorted_bitmap, &undistorted_bitmap);
+  EXPECT_EQ(undistorted_bitmap.Width(), undistorted_camera.width);
+  EXPECT_EQ(undistorted_bitmap.Height(), undistorted_camera.height);
+}
+
 TEST(RectifyStereoCameras, Nominal) {
   Camera camera1;
   camera1 = Camera::CreateFromModelName(1, "PINHOLE", 1, 1, 1);
@@ -252,5 +382,65 @@ TEST(RectifyStereoCameras, Nominal) {
   EXPECT_TRUE(Q.isApprox(Q_ref, 1e-5));
 }
 
+TEST(ComputeStereoRectificationMaps, Nominal) {
+  const Camera camera1 =
+      Camera::CreateFromModelName(1, "SIMPLE_RADIAL", 100.0, 100, 80);
+  const Camera camera2 =
+      Camera::CreateFromModelName(2, "SIMPLE_RADIAL", 110.0, 100, 80);
+  const Rigid3d cam2_from_cam1(
+      Eigen::Quaterniond(EulerAnglesToRotationMatrix(0.01, 0.02, 0.03)),
+      Eigen::Vector3d(-1, 0.1, 0.05));
+
+  UndistortCameraOptions options;
+  UndistortionMap map1;
+  UndistortionMap map2;
+  Eigen::Matrix4d Q;
+  ComputeStereoRectificationMaps(
+      options, camera1, camera2, cam2_from_cam1, &map1, &map2, &Q);
+
+  const Camera undistorted_camera = UndistortCamera(options, camera1);
+  Eigen::Matrix3d H1;
+  Eigen::Matrix3d H2;
+  Eigen::Matrix4d Q_ref;
+  RectifyStereoCameras(
+      undistorted_camera, undistorted_camera, cam2_from_cam1, &H1, &H2, &Q_ref);
+  EXPECT_TRUE(Q.isApprox(Q_ref));
+  EXPECT_EQ(map1.undistorted_camera.params, undistorted_camera.params);
+  EXPECT_EQ(map2.undistorted_camera.params, undistorted_camera.params);
+
+  // The remap tables must map the rectified pixels through the inverse
+  // homographies into the distorted images.
+  const auto CheckMap = [&undistorted_camera](const UndistortionMap& map,
+                                              const Camera& camera,
+                                              const Eigen::Matrix3d& H) {
+    Camera remap_camera = undistorted_camera;
+    remap_camera.Rescale(map.width, map.height);
+    ASSERT_EQ(map.source_points.size(),
+              remap_camera.width * remap_camera.height);
+    for (int y = 0; y < map.height; y += 7) {
+      for (int x = 0; x < map.width; x += 7) {
+        const Eigen::Vector2d undistorted_point = undistorted_camera.ImgFromCam(
+            remap_camera.CamFromImg(Eigen::Vector2d(x + 0.5, y + 0.5)));
+        const Eigen::Vector2d source_point = camera.ImgFromCam(
+            undistorted_camera.CamFromImg(
+                (H.inverse() * undistorted_point.homogeneous()).hnormalized()));
+        EXPECT_LT((map.source_points[y * map.width + x].cast<double>() -
+                   source_point)
+                      .norm(),
+                  1e-3);
+      }
+    }
+  };
+  CheckMap(map1, camera1, H1);
+  CheckMap(map2, camera2, H2);
+
+  Bitmap distorted_bitmap;
+  distorted_bitmap.Allocate(camera1.width, camera1.height, false);
+  Bitmap rectified_bitmap;
+  UndistortImageWithMap(map1, distorted_bitmap, &rectified_bitmap);
+  EXPECT_EQ(rectified_bitmap.Width(), undistorted_camera.width);
+  EXPECT_EQ(rectified_bitmap.Height(), undistorted_camera.height);
+}
+
 }  // namespace
 }  // namespace colmap
@@ -31,6 +31,7 @@
 
 #include "colmap/util/eigen_alignment.h"
 #include "colmap/util/logging.h"
+#include "colmap/util/threading.h"
 
 #include "thirdparty/VLFeat/imopv.h"
 
@@ -176,6 +177,51 @@ void WarpImageWithHomographyBetweenCameras(const Eigen::Matrix3d& H,
   }
 }
 
+void WarpImageWithRemap(const std::vector<Eigen::Vector2f>& source_points,
+                        const Bitmap& source_image,
+                        Bitmap* target_image,
+                        const int num_threads) {
+  CHECK_NOTNULL(target_image);
+  CHECK_GT(target_image->Width(), 0);
+  CHECK_GT(target_image->Height(), 0);
+  CHECK_EQ(source_image.IsRGB(), target_image->IsRGB());
+  CHECK_EQ(source_points.size(),
+           static_cast<size_t>(target_image->Width()) *
+               static_cast<size_t>(target_image->Height()));
+
+  const int width = target_image->Width();
+  const auto WarpRow = [&](const int y) {
+    const Eigen::Vector2f* row_source_points = &source_points[y * width];
+    for (int x = 0; x < width; ++x) {
+      const Eigen::Vector2f& source_point = row_source_points[x];
+      BitmapColor<float> color;
+      if (source_point.allFinite() &&
+          source_image.InterpolateBilinear(
+              source_point.x() - 0.5, source_point.y() - 0.5, &color)) {
+        target_image->SetPixel(x, y, color.Cast<uint8_t>());
+      } else {
+        target_image->SetPixel(x, y, BitmapColor<uint8_t>(0));
+      }
+    }
+  };
+
+  const int num_eff_threads =
+      std::min(GetEffectiveNumThreads(num_threads), target_image->Height());
+  if (num_eff_threads <= 1) {
+    for (int y = 0; y < target_image->Height(); ++y) {
+      WarpRow(y);
+    }
+    return;
+  }
+
+  // The rows are written to disjoint memory, so they can be warped in parallel.
+  ThreadPool thread_pool(num_eff_threads);
+  for (int y = 0; y < target_image->Height(); ++y) {
+    thread_pool.AddTask(WarpRow, y);
+  }
+  thread_pool.Wait();
+}
+
 void ResampleImageBilinear(const float* data,
                            const int rows,
                            const int cols,
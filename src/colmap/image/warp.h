@@ -59,6 +59,17 @@ void WarpImageWithHomographyBetweenCameras(const Eigen::Matrix3d& H,
                                            const Bitmap& source_image,
                                            Bitmap* target_image);
 
+// Warp an image with a precomputed row-major remap table, which stores the
+// source pixel for each pixel in the target image. Note that the pixel centers
+// are assumed to have coordinates (0.5, 0.5) and that target pixels with
+// non-finite source coordinates are set to black. The target image must be
+// allocated with as many pixels as there are entries in the table. The rows of
+// the target image are warped in parallel on `num_threads` threads.
+void WarpImageWithRemap(const std::vector<Eigen::Vector2f>& source_points,
+                        const Bitmap& source_image,
+                        Bitmap* target_image,
+                        int num_threads = 1);
+
 // Resample row-major image using bilinear interpolation.
 void ResampleImageBilinear(const float* data,
                            int rows,
@@ -216,6 +216,28 @@ TEST(Warp, WarpImageWithHomographyBetweenCamerasTransposed) {
   CheckBitmapsTransposed(source_image_rgb, target_image_rgb);
 }
 
+TEST(Warp, WarpImageWithRemapIdentity) {
+  std::vector<Eigen::Vector2f> source_points;
+  source_points.reserve(100 * 80);
+  for (int y = 0; y < 80; ++y) {
+    for (int x = 0; x < 100; ++x) {
+      source_points.emplace_back(x + 0.5f, y + 0.5f);
+    }
+  }
+
+  for (const bool as_rgb : {false, true}) {
+    Bitmap source_image;
+    GenerateRandomBitmap(100, 80, as_rgb, &source_image);
+    for (const int num_threads : {1, 4}) {
+      Bitmap target_image;
+      target_image.Allocate(100, 80, as_rgb);
+      WarpImageWithRemap(
+          source_points, source_image, &target_image, num_threads);
+      CheckBitmapsEqual(source_image, target_image);
+    }
+  }
+}
+
 TEST(Warp, ResampleImageBilinear) {
   std::vector<float> image(16);
   for (size_t i = 0; i < image.size(); ++i) {
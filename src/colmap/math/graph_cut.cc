@@ -178,7 +178,8 @@ void ComputeMinGraphCutStoerWagner(
 std::unordered_map<int, int> ComputeNormalizedMinGraphCut(
     const std::vector<std::pair<int, int>>& edges,
     const std::vector<int>& weights,
-    const int num_parts) {
+    const int num_parts,
+    const double max_imbalance) {
   CHECK(!edges.empty());
   CHECK_EQ(edges.size(), weights.size());
   CHECK_GT(num_parts, 0);
@@ -192,6 +193,10 @@ std::unordered_map<int, int> ComputeNormalizedMinGraphCut(
   idx_t metisOptions[METIS_NOPTIONS];
   METIS_SetDefaultOptions(metisOptions);
 
+  // Metis expects the maximum allowed load imbalance as a factor.
+  real_t ubfactor = static_cast<real_t>(1 + max_imbalance);
+  real_t* ubvec = max_imbalance >= 0 ? &ubfactor : nullptr;
+
   std::vector<idx_t> cut_labels(graph.nvtxs, -1);
   const int metisResult = METIS_PartGraphKway(&graph.nvtxs,
                                               /*ncon=*/&ncon,
@@ -202,7 +207,7 @@ std::unordered_map<int, int> ComputeNormalizedMinGraphCut(
                                               graph.adjwgt,
                                               &nparts,
                                               /*tpwgts=*/nullptr,
-                                              /*ubvec=*/nullptr,
+                                              ubvec,
                                               metisOptions,
                                               &edgecut,
                                               cut_labels.data());
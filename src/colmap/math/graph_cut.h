@@ -50,10 +50,14 @@ void ComputeMinGraphCutStoerWagner(
 
 // Compute the normalized min-cut of an undirected graph using Metis.
 // Partitions the graph into clusters and returns the cluster labels per vertex.
+// The multilevel k-way partitioning balances the number of vertices per
+// cluster up to the maximum imbalance, e.g., 0.03 allows clusters with 3% more
+// vertices than the average, or the default of Metis if negative.
 std::unordered_map<int, int> ComputeNormalizedMinGraphCut(
     const std::vector<std::pair<int, int>>& edges,
     const std::vector<int>& weights,
-    int num_parts);
+    int num_parts,
+    double max_imbalance = -1);
 
 // Compute the minimum graph cut of a directed S-T graph using the
 // Boykov-Kolmogorov max-flow min-cut algorithm, as descibed in:
@@ -32,6 +32,9 @@
 #include "colmap/util/eigen_alignment.h"
 #include "colmap/util/logging.h"
 
+#include <algorithm>
+#include <cmath>
+
 #include <Eigen/Eigenvalues>
 
 namespace colmap {
@@ -59,6 +62,95 @@ Eigen::VectorXd RemoveTrailingZeros(const Eigen::VectorXd& coeffs) {
   return coeffs.head(coeffs.size() - num_zeros);
 }
 
+// Find the real roots of a * x^2 + b * x + c = 0 without cancellation.
+int FindRealQuadraticRoots(const double a,
+                           const double b,
+                           const double c,
+                           double* roots) {
+  if (a == 0) {
+    if (b == 0) {
+      return 0;
+    }
+    roots[0] = -c / b;
+    return 1;
+  }
+
+  const double d = b * b - 4 * a * c;
+  if (d < 0) {
+    return 0;
+  }
+
+  const double q = -0.5 * (b + std::copysign(std::sqrt(d), b));
+  if (q == 0) {
+    roots[0] = 0;
+    return 1;
+  }
+  roots[0] = q / a;
+  roots[1] = c / q;
+  return 2;
+}
+
+// Polish a root of the monic polynomial of the given degree by Newton's
+// method, where steps are only taken if they reduce the residual, e.g., not
+// close to multiple roots.
+double PolishMonicPolynomialRoot(const double* coeffs,
+                                 const int degree,
+                                 double x) {
+  const int kNumIterations = 3;
+  for (int iter = 0; iter < kNumIterations; ++iter) {
+    double value = 1;
+    double derivative = 0;
+    for (int i = 1; i <= degree; ++i) {
+      derivative = derivative * x + value;
+      value = value * x + coeffs[i];
+    }
+    if (derivative == 0) {
+      break;
+    }
+    const double next_x = x - value / derivative;
+    double next_value = 1;
+    for (int i = 1; i <= degree; ++i) {
+      next_value = next_value * next_x + coeffs[i];
+    }
+    if (std::abs(next_value) >= std::abs(value)) {
+      break;
+    }
+    x = next_x;
+  }
+  return x;
+}
+
+// Whether the roots satisfy the polynomial up to the rounding errors of its
+// evaluation, which fails for the closed-form solutions of ill-conditioned
+// polynomials, e.g., with roots of very different magnitudes.
+bool AreAccurateRoots(const double* coeffs,
+                      const int degree,
+                      const int num_roots,
+                      const double* roots) {
+  const double kMaxRelativeResidual = 1e-8;
+  for (int i = 0; i < num_roots; ++i) {
+    const double x = roots[i];
+    double value = coeffs[0];
+    double magnitude = std::abs(coeffs[0]);
+    for (int j = 1; j <= degree; ++j) {
+      value = value * x + coeffs[j];
+      magnitude = magnitude * std::abs(x) + std::abs(coeffs[j]);
+    }
+    if (!(std::abs(value) <= kMaxRelativeResidual * magnitude)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Invert the non-zero roots of the reversed polynomial and sort them.
+void InvertRoots(const int num_roots, double* roots) {
+  for (int i = 0; i < num_roots; ++i) {
+    roots[i] = 1 / roots[i];
+  }
+  std::sort(roots, roots + num_roots);
+}
+
 }  // namespace
 
 bool FindLinearPolynomialRoots(const Eigen::VectorXd& coeffs,
@@ -274,4 +366,162 @@ bool FindPolynomialRootsCompanionMatrix(const Eigen::VectorXd& coeffs_all,
   return true;
 }
 
+int FindRealCubicPolynomialRoots(const Eigen::Vector4d& coeffs,
+                                 Eigen::Vector3d* roots) {
+  if (coeffs(0) == 0) {
+    const int num_roots = FindRealQuadraticRoots(
+        coeffs(1), coeffs(2), coeffs(3), roots->data());
+    std::sort(roots->data(), roots->data() + num_roots);
+    return num_roots;
+  }
+
+  // If the roots are large on average, the roots of the reversed polynomial
+  // are their inverses and are found more accurately.
+  if (std::abs(coeffs(0)) < std::abs(coeffs(3))) {
+    const int num_roots =
+        FindRealCubicPolynomialRoots(coeffs.reverse(), roots);
+    InvertRoots(num_roots, roots->data());
+    return num_roots;
+  }
+
+  const double monic_coeffs[4] = {1,
+                                  coeffs(1) / coeffs(0),
+                                  coeffs(2) / coeffs(0),
+                                  coeffs(3) / coeffs(0)};
+  const double a = monic_coeffs[1];
+  const double b = monic_coeffs[2];
+  const double c = monic_coeffs[3];
+
+  // Substitute x = t - a / 3 to obtain the depressed cubic t^3 + p * t + q.
+  const double a2 = a * a;
+  const double p = b - a2 / 3;
+  const double q = a * (2 * a2 - 9 * b) / 27 + c;
+  const double shift = -a / 3;
+  const double d = q * q / 4 + p * p * p / 27;
+
+  // Find one real root in closed form and then the other roots from the
+  // deflated quadratic, which is more accurate than the closed-form solution
+  // for roots of different magnitudes.
+  double root;
+  if (d > 0) {
+    // The larger summand of Cardano's formula avoids cancellation.
+    const double u = std::cbrt(-q / 2 - std::copysign(std::sqrt(d), q));
+    root = u - p / (3 * u) + shift;
+  } else if (p == 0) {
+    root = shift;
+  } else {
+    const double r = 2 * std::sqrt(-p / 3);
+    const double phi =
+        std::acos(std::max(-1.0, std::min(1.0, 3 * q / (p * r)))) / 3;
+    root = r * std::cos(phi) + shift;
+  }
+  root = PolishMonicPolynomialRoot(monic_coeffs, 3, root);
+
+  // Deflate to (x - root) * (x^2 + e * x + f) from the constant coefficient
+  // for roots of large and from the leading coefficients for roots of small
+  // magnitude to avoid cancellation.
+  double e;
+  double f;
+  if (root * root > std::abs(b)) {
+    f = -c / root;
+    e = (f - b) / root;
+  } else {
+    e = a + root;
+    f = b + root * e;
+  }
+  (*roots)(0) = root;
+  const int num_roots =
+      1 + FindRealQuadraticRoots(1, e, f, roots->data() + 1);
+  for (int i = 1; i < num_roots; ++i) {
+    (*roots)(i) = PolishMonicPolynomialRoot(monic_coeffs, 3, (*roots)(i));
+  }
+  if (!AreAccurateRoots(monic_coeffs, 3, num_roots, roots->data())) {
+    return FindRealPolynomialRootsSturm<3>(coeffs, roots);
+  }
+  std::sort(roots->data(), roots->data() + num_roots);
+
+  return num_roots;
+}
+
+int FindRealQuarticPolynomialRoots(const Eigen::Matrix<double, 5, 1>& coeffs,
+                                   Eigen::Vector4d* roots) {
+  if (coeffs(0) == 0) {
+    Eigen::Vector3d cubic_roots;
+    const int num_roots =
+        FindRealCubicPolynomialRoots(coeffs.tail<4>(), &cubic_roots);
+    roots->head<3>() = cubic_roots;
+    return num_roots;
+  }
+
+  if (std::abs(coeffs(0)) < std::abs(coeffs(4))) {
+    const int num_roots =
+        FindRealQuarticPolynomialRoots(coeffs.reverse(), roots);
+    InvertRoots(num_roots, roots->data());
+    return num_roots;
+  }
+
+  const double monic_coeffs[5] = {1,
+                                  coeffs(1) / coeffs(0),
+                                  coeffs(2) / coeffs(0),
+                                  coeffs(3) / coeffs(0),
+                                  coeffs(4) / coeffs(0)};
+  const double b = monic_coeffs[1];
+  const double c = monic_coeffs[2];
+  const double d = monic_coeffs[3];
+  const double e = monic_coeffs[4];
+
+  // Substitute x = y - b / 4 to obtain the depressed quartic
+  // y^4 + p * y^2 + q * y + r.
+  const double b2 = b * b;
+  const double p = c - 3 * b2 / 8;
+  const double q = d - b * c / 2 + b2 * b / 8;
+  const double r = e - b * d / 4 + b2 * c / 16 - 3 * b2 * b2 / 256;
+  const double shift = -b / 4;
+
+  double y[4];
+  int num_roots = 0;
+
+  // Solve the resolvent cubic for m > 0, such that the depressed quartic
+  // factors into two quadratics as (y^2 + p / 2 + m)^2 - 2 * m *
+  // (y - q / (4 * m))^2.
+  double m = 0;
+  if (q != 0) {
+    Eigen::Vector3d resolvent_roots;
+    const int num_resolvent_roots = FindRealCubicPolynomialRoots(
+        Eigen::Vector4d(8, 8 * p, 2 * p * p - 8 * r, -q * q),
+        &resolvent_roots);
+    if (num_resolvent_roots > 0) {
+      m = resolvent_roots(num_resolvent_roots - 1);
+    }
+  }
+
+  if (m > 0) {
+    const double s = std::sqrt(2 * m);
+    const double t = q / (2 * s);
+    num_roots += FindRealQuadraticRoots(1, -s, p / 2 + m + t, y + num_roots);
+    num_roots += FindRealQuadraticRoots(1, s, p / 2 + m - t, y + num_roots);
+  } else {
+    // Biquadratic equation in z = y^2.
+    double z[2];
+    const int num_z = FindRealQuadraticRoots(1, p, r, z);
+    for (int i = 0; i < num_z; ++i) {
+      if (z[i] >= 0) {
+        const double sqrt_z = std::sqrt(z[i]);
+        y[num_roots++] = -sqrt_z;
+        y[num_roots++] = sqrt_z;
+      }
+    }
+  }
+
+  for (int i = 0; i < num_roots; ++i) {
+    (*roots)(i) = PolishMonicPolynomialRoot(monic_coeffs, 4, y[i] + shift);
+  }
+  if (!AreAccurateRoots(monic_coeffs, 4, num_roots, roots->data())) {
+    return FindRealPolynomialRootsSturm<4>(coeffs, roots);
+  }
+  std::sort(roots->data(), roots->data() + num_roots);
+
+  return num_roots;
+}
+
 }  // namespace colmap
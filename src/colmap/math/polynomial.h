@@ -31,6 +31,9 @@
 
 #include "colmap/util/eigen_alignment.h"
 
+#include <algorithm>
+#include <cmath>
+
 #include <Eigen/Core>
 
 namespace colmap {
@@ -84,6 +87,38 @@ bool FindPolynomialRootsCompanionMatrix(const Eigen::VectorXd& coeffs,
                                         Eigen::VectorXd* real,
                                         Eigen::VectorXd* imag);
 
+// Find the real roots of a cubic polynomial in closed form using Cardano's
+// formula or, if there are three real roots, the trigonometric solution. The
+// roots are polished by Newton's method and returned in ascending order, where
+// the number of real roots is returned. Leading zero coefficients reduce the
+// degree of the polynomial.
+int FindRealCubicPolynomialRoots(const Eigen::Vector4d& coeffs,
+                                 Eigen::Vector3d* roots);
+
+// Find the real roots of a quartic polynomial in closed form using Ferrari's
+// method with the largest real root of the resolvent cubic. The roots are
+// polished by Newton's method and returned in ascending order, where the
+// number of real roots is returned. Leading zero coefficients reduce the
+// degree of the polynomial.
+int FindRealQuarticPolynomialRoots(const Eigen::Matrix<double, 5, 1>& coeffs,
+                                   Eigen::Vector4d* roots);
+
+// Find the distinct real roots of a polynomial of fixed degree N by isolating
+// them through bisection with the Sturm sequence of the polynomial and then
+// polishing them by safeguarded Newton iterations, based on:
+//
+//    D. Nister, "An efficient solution to the five-point relative pose
+//    problem", PAMI 2004.
+//
+// In contrast to the companion matrix method, the root finder only operates on
+// the stack and does not compute the complex roots, which makes it several
+// times faster for the polynomials of the minimal solvers. The roots are
+// returned in ascending order, where the number of real roots is returned.
+// Leading zero coefficients reduce the degree of the polynomial.
+template <int N>
+int FindRealPolynomialRootsSturm(const Eigen::Matrix<double, N + 1, 1>& coeffs,
+                                 Eigen::Matrix<double, N, 1>* roots);
+
 ////////////////////////////////////////////////////////////////////////////////
 // Implementation
 ////////////////////////////////////////////////////////////////////////////////
@@ -97,4 +132,268 @@ T EvaluatePolynomial(const Eigen::VectorXd& coeffs, const T& x) {
   return value;
 }
 
+namespace internal {
+
+// The Sturm sequence of a monic polynomial of degree at most N, where the
+// number of sign changes of the sequence at x and y with x < y is the number
+// of distinct real roots in (x, y].
+template <int N>
+class SturmSequence {
+ public:
+  SturmSequence(const double* coeffs, int degree);
+
+  // Evaluate the polynomial and its derivative at x.
+  void Evaluate(double x, double* value, double* derivative) const;
+
+  int NumSignChanges(double x) const;
+
+  // Find the roots in (lower, upper] in ascending order by bisection.
+  void IsolateRoots(double lower,
+                    double upper,
+                    int lower_sign_changes,
+                    int upper_sign_changes,
+                    double* roots,
+                    int* num_roots) const;
+
+ private:
+  // Polish the only distinct root in (lower, upper].
+  double PolishRoot(double lower, double upper, int lower_sign_changes) const;
+
+  double polys_[N + 1][N + 1];
+  int degrees_[N + 1];
+  int num_polys_;
+};
+
+template <int N>
+SturmSequence<N>::SturmSequence(const double* coeffs, const int degree) {
+  degrees_[0] = degree;
+  for (int i = 0; i <= degree; ++i) {
+    polys_[0][i] = coeffs[i];
+  }
+  degrees_[1] = degree - 1;
+  for (int i = 0; i < degree; ++i) {
+    polys_[1][i] = (degree - i) * coeffs[i];
+  }
+  num_polys_ = 2;
+
+  // The next polynomial is the negated remainder of the division of the two
+  // previous polynomials. A vanishing remainder terminates the sequence with
+  // the greatest common divisor of the polynomial and its derivative, which
+  // leaves the number of sign changes unaffected. Small coefficients are not
+  // truncated, since they typically carry the sign of the sequence close to
+  // ill-separated roots.
+  while (num_polys_ <= N && degrees_[num_polys_ - 1] > 0) {
+    const int dividend_degree = degrees_[num_polys_ - 2];
+    const int divisor_degree = degrees_[num_polys_ - 1];
+    const double* divisor = polys_[num_polys_ - 1];
+    double remainder[N + 1];
+    for (int i = 0; i <= dividend_degree; ++i) {
+      remainder[i] = polys_[num_polys_ - 2][i];
+    }
+    for (int i = 0; i <= dividend_degree - divisor_degree; ++i) {
+      const double factor = remainder[i] / divisor[0];
+      for (int j = 0; j <= divisor_degree; ++j) {
+        remainder[i + j] -= factor * divisor[j];
+      }
+    }
+
+    int offset = dividend_degree - divisor_degree + 1;
+    while (offset <= dividend_degree && remainder[offset] == 0) {
+      offset += 1;
+    }
+    if (offset > dividend_degree) {
+      break;
+    }
+
+    double max_abs_coeff = 0;
+    for (int i = offset; i <= dividend_degree; ++i) {
+      max_abs_coeff = std::max(max_abs_coeff, std::abs(remainder[i]));
+    }
+    double* poly = polys_[num_polys_];
+    degrees_[num_polys_] = dividend_degree - offset;
+    for (int i = offset; i <= dividend_degree; ++i) {
+      poly[i - offset] = -remainder[i] / max_abs_coeff;
+    }
+    num_polys_ += 1;
+  }
+}
+
+template <int N>
+void SturmSequence<N>::Evaluate(const double x,
+                                double* value,
+                                double* derivative) const {
+  *value = polys_[0][0];
+  *derivative = 0;
+  for (int i = 1; i <= degrees_[0]; ++i) {
+    *derivative = *derivative * x + *value;
+    *value = *value * x + polys_[0][i];
+  }
+}
+
+template <int N>
+int SturmSequence<N>::NumSignChanges(const double x) const {
+  int num_sign_changes = 0;
+  double prev_value = 0;
+  for (int k = 0; k < num_polys_; ++k) {
+    double value = polys_[k][0];
+    for (int i = 1; i <= degrees_[k]; ++i) {
+      value = value * x + polys_[k][i];
+    }
+    if (value != 0) {
+      if (prev_value * value < 0) {
+        num_sign_changes += 1;
+      }
+      prev_value = value;
+    }
+  }
+  return num_sign_changes;
+}
+
+template <int N>
+void SturmSequence<N>::IsolateRoots(const double lower,
+                                    const double upper,
+                                    const int lower_sign_changes,
+                                    const int upper_sign_changes,
+                                    double* roots,
+                                    int* num_roots) const {
+  const int num_interval_roots = lower_sign_changes - upper_sign_changes;
+  if (num_interval_roots <= 0 || *num_roots >= N) {
+    return;
+  }
+
+  if (num_interval_roots == 1) {
+    roots[(*num_roots)++] = PolishRoot(lower, upper, lower_sign_changes);
+    return;
+  }
+
+  // Roots closer than the tolerance are returned as a single root.
+  const double kTolerance = 1e-12;
+  const double mid = 0.5 * (lower + upper);
+  if (upper - lower <= kTolerance * (1 + std::abs(mid))) {
+    roots[(*num_roots)++] = mid;
+    return;
+  }
+
+  const int mid_sign_changes = NumSignChanges(mid);
+  IsolateRoots(
+      lower, mid, lower_sign_changes, mid_sign_changes, roots, num_roots);
+  IsolateRoots(
+      mid, upper, mid_sign_changes, upper_sign_changes, roots, num_roots);
+}
+
+template <int N>
+double SturmSequence<N>::PolishRoot(double lower,
+                                    double upper,
+                                    int lower_sign_changes) const {
+  const int kMaxNumIterations = 100;
+  const double kTolerance = 1e-15;
+
+  double lower_value;
+  double upper_value;
+  double derivative;
+  Evaluate(lower, &lower_value, &derivative);
+  Evaluate(upper, &upper_value, &derivative);
+  if (upper_value == 0) {
+    return upper;
+  }
+
+  // The bracket is shrunk, if its lower end is a root of another interval.
+  for (int iter = 0; iter < kMaxNumIterations && lower_value == 0; ++iter) {
+    const double mid = 0.5 * (lower + upper);
+    const int mid_sign_changes = NumSignChanges(mid);
+    if (mid_sign_changes < lower_sign_changes) {
+      upper = mid;
+      Evaluate(upper, &upper_value, &derivative);
+      if (upper_value == 0) {
+        return upper;
+      }
+    } else {
+      lower = mid;
+      lower_sign_changes = mid_sign_changes;
+      Evaluate(lower, &lower_value, &derivative);
+    }
+  }
+
+  // Roots of even multiplicity do not change the sign of the polynomial and
+  // are only found by bisection.
+  if (lower_value * upper_value > 0) {
+    for (int iter = 0; iter < kMaxNumIterations &&
+                       upper - lower > kTolerance * (1 + std::abs(lower));
+         ++iter) {
+      const double mid = 0.5 * (lower + upper);
+      const int mid_sign_changes = NumSignChanges(mid);
+      if (mid_sign_changes < lower_sign_changes) {
+        upper = mid;
+      } else {
+        lower = mid;
+        lower_sign_changes = mid_sign_changes;
+      }
+    }
+    return 0.5 * (lower + upper);
+  }
+
+  // Newton iterations, which fall back to bisection if they leave the
+  // bracket of the root.
+  double x = 0.5 * (lower + upper);
+  for (int iter = 0; iter < kMaxNumIterations; ++iter) {
+    double value;
+    Evaluate(x, &value, &derivative);
+    if (value == 0) {
+      return x;
+    }
+    if ((value < 0) == (lower_value < 0)) {
+      lower = x;
+    } else {
+      upper = x;
+    }
+    double next_x = x - value / derivative;
+    if (!(next_x > lower && next_x < upper)) {
+      next_x = 0.5 * (lower + upper);
+    }
+    if (std::abs(next_x - x) <= kTolerance * (1 + std::abs(x))) {
+      return next_x;
+    }
+    x = next_x;
+  }
+  return x;
+}
+
+}  // namespace internal
+
+template <int N>
+int FindRealPolynomialRootsSturm(const Eigen::Matrix<double, N + 1, 1>& coeffs,
+                                 Eigen::Matrix<double, N, 1>* roots) {
+  static_assert(N >= 1, "The polynomial must at least be linear");
+
+  int first = 0;
+  while (first <= N && coeffs(first) == 0) {
+    first += 1;
+  }
+  const int degree = N - first;
+  if (degree <= 0) {
+    return 0;
+  }
+
+  // Normalize the polynomial and bound the magnitude of its roots by the
+  // Cauchy bound.
+  double monic_coeffs[N + 1];
+  double bound = 0;
+  monic_coeffs[0] = 1;
+  for (int i = 1; i <= degree; ++i) {
+    monic_coeffs[i] = coeffs(first + i) / coeffs(first);
+    bound = std::max(bound, std::abs(monic_coeffs[i]));
+  }
+  bound += 1;
+
+  const internal::SturmSequence<N> sturm_sequence(monic_coeffs, degree);
+  int num_roots = 0;
+  sturm_sequence.IsolateRoots(-bound,
+                              bound,
+                              sturm_sequence.NumSignChanges(-bound),
+                              sturm_sequence.NumSignChanges(bound),
+                              roots->data(),
+                              &num_roots);
+  return num_roots;
+}
+
 }  // namespace colmap
@@ -29,6 +29,11 @@
 
 #include "colmap/math/polynomial.h"
 
+#include "colmap/math/random.h"
+
+#include <algorithm>
+#include <vector>
+
 #include <gtest/gtest.h>
 
 namespace colmap {
@@ -199,5 +204,95 @@ TEST(FindPolynomialRootsCompanionMatrixZeroSolution, Nominal) {
   EXPECT_TRUE(imag.isApprox(ref_imag, 1e-6));
 }
 
+TEST(FindRealCubicPolynomialRoots, Nominal) {
+  Eigen::Vector3d roots;
+  // (x - 1) * (x - 2) * (x + 3).
+  EXPECT_EQ(FindRealCubicPolynomialRoots(Eigen::Vector4d(2, 0, -14, 12),
+                                         &roots),
+            3);
+  EXPECT_TRUE(roots.isApprox(Eigen::Vector3d(-3, 1, 2), 1e-12));
+  // (x - 2) * (x^2 + 1).
+  EXPECT_EQ(
+      FindRealCubicPolynomialRoots(Eigen::Vector4d(1, -2, 1, -2), &roots), 1);
+  EXPECT_NEAR(roots(0), 2, 1e-12);
+  // x^3.
+  EXPECT_EQ(FindRealCubicPolynomialRoots(Eigen::Vector4d(1, 0, 0, 0), &roots),
+            1);
+  EXPECT_EQ(roots(0), 0);
+  // Quadratic (x - 1) * (x - 3).
+  EXPECT_EQ(
+      FindRealCubicPolynomialRoots(Eigen::Vector4d(0, 1, -4, 3), &roots), 2);
+  EXPECT_TRUE(roots.head<2>().isApprox(Eigen::Vector2d(1, 3), 1e-12));
+}
+
+TEST(FindRealQuarticPolynomialRoots, Nominal) {
+  Eigen::Vector4d roots;
+  // (x - 1) * (x - 2) * (x + 3) * (x + 0.5).
+  Eigen::Matrix<double, 5, 1> coeffs;
+  coeffs << 1, 0.5, -7, 2.5, 3;
+  EXPECT_EQ(FindRealQuarticPolynomialRoots(coeffs, &roots), 4);
+  EXPECT_TRUE(roots.isApprox(Eigen::Vector4d(-3, -0.5, 1, 2), 1e-12));
+  // (x^2 - 4) * (x^2 + 1).
+  coeffs << 2, 0, -6, 0, -8;
+  EXPECT_EQ(FindRealQuarticPolynomialRoots(coeffs, &roots), 2);
+  EXPECT_TRUE(roots.head<2>().isApprox(Eigen::Vector2d(-2, 2), 1e-12));
+  // (x^2 + 1) * (x^2 + 2 * x + 2).
+  coeffs << 1, 2, 3, 2, 2;
+  EXPECT_EQ(FindRealQuarticPolynomialRoots(coeffs, &roots), 0);
+  // Cubic (x - 1) * (x - 2) * (x + 3).
+  coeffs << 0, 1, 0, -7, 6;
+  EXPECT_EQ(FindRealQuarticPolynomialRoots(coeffs, &roots), 3);
+  EXPECT_TRUE(roots.head<3>().isApprox(Eigen::Vector3d(-3, 1, 2), 1e-12));
+}
+
+TEST(FindRealPolynomialRootsSturm, Nominal) {
+  Eigen::Matrix<double, 4, 1> roots;
+  Eigen::Matrix<double, 5, 1> coeffs;
+  coeffs << 1, 0.5, -7, 2.5, 3;
+  EXPECT_EQ(FindRealPolynomialRootsSturm<4>(coeffs, &roots), 4);
+  EXPECT_TRUE(roots.isApprox(Eigen::Vector4d(-3, -0.5, 1, 2), 1e-12));
+  // Only the real roots of the reference polynomial.
+  coeffs << 10, -5, 3, -3, 1;
+  EXPECT_EQ(FindRealPolynomialRootsSturm<4>(coeffs, &roots), 0);
+  coeffs << 10, -5, 3, -3, 0;
+  EXPECT_EQ(FindRealPolynomialRootsSturm<4>(coeffs, &roots), 2);
+  EXPECT_NEAR(roots(0), 0, 1e-12);
+  EXPECT_NEAR(roots(1), 0.692438, 1e-6);
+  // Double root (x - 1)^2 * (x + 2) with leading zero.
+  coeffs << 0, 1, 0, -3, 2;
+  EXPECT_EQ(FindRealPolynomialRootsSturm<4>(coeffs, &roots), 2);
+  EXPECT_NEAR(roots(0), -2, 1e-12);
+  EXPECT_NEAR(roots(1), 1, 1e-6);
+  coeffs << 0, 0, 0, 0, 1;
+  EXPECT_EQ(FindRealPolynomialRootsSturm<4>(coeffs, &roots), 0);
+}
+
+TEST(FindRealPolynomialRootsSturm, CompanionMatrix) {
+  SetPRNGSeed(0);
+  for (int i = 0; i < 100; ++i) {
+    Eigen::Matrix<double, 11, 1> coeffs;
+    for (int j = 0; j < coeffs.size(); ++j) {
+      coeffs(j) = RandomUniformReal<double>(-10, 10);
+    }
+    Eigen::VectorXd real;
+    Eigen::VectorXd imag;
+    ASSERT_TRUE(FindPolynomialRootsCompanionMatrix(coeffs, &real, &imag));
+    std::vector<double> ref_roots;
+    for (Eigen::Index j = 0; j < real.size(); ++j) {
+      if (imag(j) == 0) {
+        ref_roots.push_back(real(j));
+      }
+    }
+    std::sort(ref_roots.begin(), ref_roots.end());
+
+    Eigen::Matrix<double, 10, 1> roots;
+    ASSERT_EQ(FindRealPolynomialRootsSturm<10>(coeffs, &roots),
+              ref_roots.size());
+    for (size_t j = 0; j < ref_roots.size(); ++j) {
+      EXPECT_NEAR(roots(j), ref_roots[j], 1e-8 * (1 + std::abs(roots(j))));
+    }
+  }
+}
+
 }  // namespace
 }  // namespace colmap
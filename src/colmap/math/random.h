@@ -30,8 +30,12 @@
 #pragma once
 
 #include "colmap/util/logging.h"
+#include "colmap/util/threading.h"
 
+#include <algorithm>
 #include <chrono>
+#include <cstdint>
+#include <limits>
 #include <memory>
 #include <random>
 #include <thread>
@@ -48,6 +52,12 @@ extern int kDefaultPRNGSeed;
 //               is used as the seed.
 void SetPRNGSeed(unsigned seed = kDefaultPRNGSeed);
 
+// Get the PRNG of the current thread or, in deterministic execution, the PRNG
+// of the current task stream, see `SetDeterministicExecution`. The PRNG of a
+// stream is seeded with the default seed and the stream identifier, such that
+// the random numbers of a task do not depend on the thread that executes it.
+inline std::mt19937& GetPRNG();
+
 // Generate uniformly distributed random integer number.
 //
 // This implementation is unbiased and thread-safe in contrast to `rand()`.
@@ -78,40 +88,160 @@ T RandomGaussian(T mean, T stddev);
 template <typename T>
 void Shuffle(uint32_t num_to_shuffle, std::vector<T>* elems);
 
+// Lightweight 32-bit permuted congruential generator (PCG-XSH-RR) by
+// O'Neill, "PCG: A Family of Simple Fast Space-Efficient Statistically Good
+// Algorithms for Random Number Generation", 2014.
+//
+// In contrast to the Mersenne Twister behind `GetPRNG`, its state is only 16
+// bytes and a draw is a multiplication and a few shifts. It is meant to be
+// owned by hot loops, e.g., the RANSAC samplers, which seed it once from
+// `GetPRNG` using `RandomPCG32Seed`, such that the seeding and the
+// deterministic execution mode of the global PRNG still apply.
+class PCG32 {
+ public:
+  typedef uint32_t result_type;
+
+  PCG32() = default;
+  explicit PCG32(uint64_t seed, uint64_t stream = 0);
+
+  void Seed(uint64_t seed, uint64_t stream = 0);
+
+  static constexpr result_type min() { return 0; }
+  static constexpr result_type max() { return UINT32_MAX; }
+
+  inline result_type operator()();
+
+  // Generate a uniformly distributed random integer in [0, bound) without
+  // modulo bias using the multiply-shift method by Lemire, "Fast Random
+  // Integer Generation in an Interval", 2019, which only rarely rejects a draw.
+  inline uint32_t Bounded(uint32_t bound);
+
+ private:
+  uint64_t state_ = 0x853c49e6748fea9bULL;
+  uint64_t increment_ = 0xda3e39cb94b95bdbULL;
+};
+
+// Draw a 64-bit seed for a `PCG32` from the PRNG returned by `GetPRNG`.
+inline uint64_t RandomPCG32Seed();
+
+// Draw `num_samples` unique random integers in [0, num_values) in uniformly
+// random order without rejection using the permutation variant of the
+// algorithm by Floyd, see Bentley and Floyd, "Programming Pearls: A Sample of
+// Brilliance", 1987. The number of operations grows quadratically with the
+// number of samples, so it is meant for small samples, e.g., the minimal
+// samples of RANSAC.
+//
+// @param num_values   Number of values to sample from.
+// @param num_samples  Number of samples not larger than the number of values.
+// @param prng         Generator to draw the samples.
+// @param samples      Array of at least `num_samples` elements.
+inline void RandomUniqueIntegers(size_t num_values,
+                                 size_t num_samples,
+                                 PCG32* prng,
+                                 size_t* samples);
+
 ////////////////////////////////////////////////////////////////////////////////
 // Implementation
 ////////////////////////////////////////////////////////////////////////////////
 
-template <typename T>
-T RandomUniformInteger(const T min, const T max) {
+std::mt19937& GetPRNG() {
+  if (IsDeterministicExecution()) {
+    ScopedTaskStream* stream = ScopedTaskStream::Current();
+    if (stream != nullptr) {
+      if (stream->PRNG() == nullptr) {
+        stream->PRNG() = std::make_unique<std::mt19937>(
+            static_cast<std::mt19937::result_type>(MixTaskStreamIds(
+                static_cast<unsigned>(kDefaultPRNGSeed), stream->Id())));
+      }
+      return *stream->PRNG();
+    }
+  }
+
   if (PRNG == nullptr) {
     SetPRNGSeed();
   }
+  return *PRNG;
+}
+
+inline PCG32::PCG32(const uint64_t seed, const uint64_t stream) {
+  Seed(seed, stream);
+}
+
+inline void PCG32::Seed(const uint64_t seed, const uint64_t stream) {
+  state_ = 0;
+  increment_ = (stream << 1) | 1;
+  (*this)();
+  state_ += seed;
+  (*this)();
+}
 
+PCG32::result_type PCG32::operator()() {
+  const uint64_t state = state_;
+  state_ = state * 6364136223846793005ULL + increment_;
+  const uint32_t xorshifted =
+      static_cast<uint32_t>(((state >> 18) ^ state) >> 27);
+  const uint32_t rotation = static_cast<uint32_t>(state >> 59);
+  return (xorshifted >> rotation) | (xorshifted << ((32 - rotation) & 31));
+}
+
+uint32_t PCG32::Bounded(const uint32_t bound) {
+  uint64_t product = static_cast<uint64_t>((*this)()) * bound;
+  uint32_t low = static_cast<uint32_t>(product);
+  if (low < bound) {
+    const uint32_t threshold = (0u - bound) % bound;
+    while (low < threshold) {
+      product = static_cast<uint64_t>((*this)()) * bound;
+      low = static_cast<uint32_t>(product);
+    }
+  }
+  return static_cast<uint32_t>(product >> 32);
+}
+
+uint64_t RandomPCG32Seed() {
+  std::mt19937& prng = GetPRNG();
+  const uint64_t high = prng();
+  return (high << 32) | prng();
+}
+
+void RandomUniqueIntegers(const size_t num_values,
+                          const size_t num_samples,
+                          PCG32* prng,
+                          size_t* samples) {
+  CHECK_LE(num_samples, num_values);
+  CHECK_LE(num_values, std::numeric_limits<uint32_t>::max());
+  // For every j, draw a random value in [0, j]. A new value is prepended to the
+  // sample, whereas j is inserted after the value, if it was already drawn.
+  for (size_t i = 0, j = num_values - num_samples; i < num_samples; ++i, ++j) {
+    const size_t value = prng->Bounded(static_cast<uint32_t>(j + 1));
+    size_t* pos = std::find(samples, samples + i, value);
+    if (pos == samples + i) {
+      std::copy_backward(samples, samples + i, samples + i + 1);
+      samples[0] = value;
+    } else {
+      std::copy_backward(pos + 1, samples + i, samples + i + 1);
+      pos[1] = j;
+    }
+  }
+}
+
+template <typename T>
+T RandomUniformInteger(const T min, const T max) {
   std::uniform_int_distribution<T> distribution(min, max);
 
-  return distribution(*PRNG);
+  return distribution(GetPRNG());
 }
 
 template <typename T>
 T RandomUniformReal(const T min, const T max) {
-  if (PRNG == nullptr) {
-    SetPRNGSeed();
-  }
-
   std::uniform_real_distribution<T> distribution(min, max);
 
-  return distribution(*PRNG);
+  return distribution(GetPRNG());
 }
 
 template <typename T>
 T RandomGaussian(const T mean, const T stddev) {
-  if (PRNG == nullptr) {
-    SetPRNGSeed();
-  }
-
   std::normal_distribution<T> distribution(mean, stddev);
-  return distribution(*PRNG);
+  return distribution(GetPRNG());
 }
 
 template <typename T>
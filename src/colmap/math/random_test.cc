@@ -30,9 +30,12 @@
 #include "colmap/math/random.h"
 
 #include "colmap/math/math.h"
+#include "colmap/util/threading.h"
 
+#include <algorithm>
 #include <numeric>
 #include <thread>
+#include <vector>
 
 #include <gtest/gtest.h>
 
@@ -111,6 +114,102 @@ TEST(RandomGaussian, Nominal) {
   EXPECT_LE(std::abs(StdDev(values) - kSigma), 1e-2);
 }
 
+TEST(DeterministicExecution, ThreadPool) {
+  SetDeterministicExecution(true);
+  auto DrawNumbers = [](const int num_threads) {
+    ThreadPool pool(num_threads);
+    ScopedTaskStream stream(0);
+    std::vector<int> numbers(1000);
+    pool.ParallelFor(0, numbers.size(), 10, [&](const int64_t i) {
+      numbers[i] = RandomUniformInteger(0, 10000);
+    });
+    return numbers;
+  };
+  const std::vector<int> numbers = DrawNumbers(1);
+  EXPECT_EQ(DrawNumbers(3), numbers);
+  EXPECT_EQ(DrawNumbers(8), numbers);
+  SetDeterministicExecution(false);
+}
+
+TEST(DeterministicExecution, ScopedTaskStream) {
+  SetDeterministicExecution(true);
+  auto DrawNumbers = []() {
+    ScopedTaskStream stream(7);
+    std::vector<int> numbers;
+    for (size_t i = 0; i < 100; ++i) {
+      numbers.push_back(RandomUniformInteger(0, 10000));
+    }
+    return numbers;
+  };
+  const std::vector<int> numbers = DrawNumbers();
+  // Independent of the state of the PRNG of the current thread.
+  RandomUniformInteger(0, 10000);
+  EXPECT_EQ(DrawNumbers(), numbers);
+  std::vector<int> thread_numbers;
+  std::thread thread([&]() { thread_numbers = DrawNumbers(); });
+  thread.join();
+  EXPECT_EQ(thread_numbers, numbers);
+  SetDeterministicExecution(false);
+}
+
+TEST(PCG32, Nominal) {
+  PCG32 prng1(42);
+  PCG32 prng2(42);
+  PCG32 prng3(42, 1);
+  size_t num_equal_streams = 0;
+  for (int i = 0; i < 100; ++i) {
+    const uint32_t value = prng1();
+    EXPECT_EQ(value, prng2());
+    if (value == prng3()) {
+      num_equal_streams += 1;
+    }
+  }
+  EXPECT_LT(num_equal_streams, 100);
+}
+
+TEST(PCG32, Bounded) {
+  PCG32 prng(RandomPCG32Seed());
+  std::vector<int> counts(7, 0);
+  for (int i = 0; i < 7000; ++i) {
+    const uint32_t value = prng.Bounded(7);
+    ASSERT_LT(value, 7);
+    counts[value] += 1;
+  }
+  for (const int count : counts) {
+    EXPECT_GT(count, 800);
+    EXPECT_LT(count, 1200);
+  }
+  EXPECT_EQ(prng.Bounded(1), 0);
+}
+
+TEST(RandomUniqueIntegers, Nominal) {
+  PCG32 prng(RandomPCG32Seed());
+  std::vector<size_t> samples(4);
+  RandomUniqueIntegers(0, 0, &prng, samples.data());
+  RandomUniqueIntegers(4, 4, &prng, samples.data());
+  std::sort(samples.begin(), samples.end());
+  EXPECT_EQ(samples, (std::vector<size_t>{0, 1, 2, 3}));
+
+  // Every value is equally likely at every position of the sample.
+  std::vector<std::vector<int>> counts(3, std::vector<int>(6, 0));
+  for (int i = 0; i < 6000; ++i) {
+    RandomUniqueIntegers(6, 3, &prng, samples.data());
+    for (int j = 0; j < 3; ++j) {
+      ASSERT_LT(samples[j], 6);
+      counts[j][samples[j]] += 1;
+    }
+    EXPECT_NE(samples[0], samples[1]);
+    EXPECT_NE(samples[0], samples[2]);
+    EXPECT_NE(samples[1], samples[2]);
+  }
+  for (const auto& position_counts : counts) {
+    for (const int count : position_counts) {
+      EXPECT_GT(count, 800);
+      EXPECT_LT(count, 1200);
+    }
+  }
+}
+
 TEST(ShuffleNone, Nominal) {
   SetPRNGSeed();
   std::vector<int> numbers(0);
@@ -0,0 +1,304 @@
+#pragma once
+
+#include "colmap/mvs/mat.h"
+#include "colmap/util/endian.h"
+#include "colmap/util/logging.h"
+
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace colmap {
+namespace mvs {
+
+// On-disk format of a matrix that can be read block by block, so that reading
+// a region of the matrix only touches the blocks that intersect the region.
+// The file format is
+//
+//    <width>&<height>&<depth>&<block_size>&<block(0, 0)><block(0, 1)>...
+//
+// where the blocks of block_size x block_size pixels are stored in row-major
+// order and each block stores all slices in the planar layout of `Mat`. The
+// blocks at the right and bottom border are zero-padded to the full size.
+template <typename T>
+void WriteBlockedMat(const Mat<T>& mat,
+                     size_t block_size,
+                     const std::string& path);
+
+template <typename T>
+class BlockedMatReader {
+ public:
+  // Read the header of the file.
+  explicit BlockedMatReader(const std::string& path);
+
+  size_t GetWidth() const;
+  size_t GetHeight() const;
+  size_t GetDepth() const;
+  size_t GetBlockSize() const;
+  size_t GetNumBlockRows() const;
+  size_t GetNumBlockCols() const;
+
+  // Read the block in the planar layout [slice][row][col] of the block.
+  std::vector<T> ReadBlock(size_t block_row, size_t block_col) const;
+
+  // Read the region of the given size starting at the given pixel.
+  Mat<T> ReadRegion(size_t row, size_t col, size_t height, size_t width) const;
+
+ private:
+  std::string path_;
+  size_t width_ = 0;
+  size_t height_ = 0;
+  size_t depth_ = 0;
+  size_t block_size_ = 0;
+  std::streamoff data_offset_ = 0;
+};
+
+// Read-only view of a matrix, whose blocks are fetched on first access and
+// kept alive by the view. A fully loaded matrix is viewed as a single block.
+// Note that the view is not thread-safe.
+template <typename T>
+class BlockedMatView {
+ public:
+  using BlockGetter = std::function<std::shared_ptr<const std::vector<T>>(
+      size_t block_row, size_t block_col)>;
+
+  BlockedMatView() = default;
+  BlockedMatView(size_t width,
+                 size_t height,
+                 size_t depth,
+                 size_t block_width,
+                 size_t block_height,
+                 BlockGetter block_getter);
+  explicit BlockedMatView(std::shared_ptr<const Mat<T>> mat);
+
+  size_t GetWidth() const;
+  size_t GetHeight() const;
+  size_t GetDepth() const;
+
+  T Get(size_t row, size_t col, size_t slice = 0) const;
+
+ private:
+  size_t width_ = 0;
+  size_t height_ = 0;
+  size_t depth_ = 0;
+  size_t block_width_ = 0;
+  size_t block_height_ = 0;
+  size_t num_block_cols_ = 0;
+  BlockGetter block_getter_;
+  mutable std::vector<std::shared_ptr<const std::vector<T>>> blocks_;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Implementation
+////////////////////////////////////////////////////////////////////////////////
+
+template <typename T>
+void WriteBlockedMat(const Mat<T>& mat,
+                     const size_t block_size,
+                     const std::string& path) {
+  CHECK_GT(block_size, 0);
+  std::ofstream file(path, std::ios::binary);
+  CHECK(file.is_open()) << path;
+  file << mat.GetWidth() << "&" << mat.GetHeight() << "&" << mat.GetDepth()
+       << "&" << block_size << "&";
+
+  std::vector<T> block(block_size * block_size * mat.GetDepth());
+  for (size_t block_row = 0; block_row * block_size < mat.GetHeight();
+       ++block_row) {
+    for (size_t block_col = 0; block_col * block_size < mat.GetWidth();
+         ++block_col) {
+      std::fill(block.begin(), block.end(), 0);
+      const size_t row_begin = block_row * block_size;
+      const size_t col_begin = block_col * block_size;
+      const size_t row_end = std::min(row_begin + block_size, mat.GetHeight());
+      const size_t col_end = std::min(col_begin + block_size, mat.GetWidth());
+      for (size_t slice = 0; slice < mat.GetDepth(); ++slice) {
+        for (size_t row = row_begin; row < row_end; ++row) {
+          for (size_t col = col_begin; col < col_end; ++col) {
+            block[(slice * block_size + row - row_begin) * block_size + col -
+                  col_begin] = mat.Get(row, col, slice);
+          }
+        }
+      }
+      WriteBinaryLittleEndian<T>(&file, block);
+    }
+  }
+  file.close();
+}
+
+template <typename T>
+BlockedMatReader<T>::BlockedMatReader(const std::string& path) : path_(path) {
+  std::ifstream file(path_, std::ios::binary);
+  CHECK(file.is_open()) << path_;
+
+  char unused_char;
+  file >> width_ >> unused_char >> height_ >> unused_char >> depth_ >>
+      unused_char >> block_size_ >> unused_char;
+  CHECK_GT(width_, 0) << path_;
+  CHECK_GT(height_, 0) << path_;
+  CHECK_GT(depth_, 0) << path_;
+  CHECK_GT(block_size_, 0) << path_;
+  data_offset_ = file.tellg();
+}
+
+template <typename T>
+size_t BlockedMatReader<T>::GetWidth() const {
+  return width_;
+}
+
+template <typename T>
+size_t BlockedMatReader<T>::GetHeight() const {
+  return height_;
+}
+
+template <typename T>
+size_t BlockedMatReader<T>::GetDepth() const {
+  return depth_;
+}
+
+template <typename T>
+size_t BlockedMatReader<T>::GetBlockSize() const {
+  return block_size_;
+}
+
+template <typename T>
+size_t BlockedMatReader<T>::GetNumBlockRows() const {
+  return (height_ + block_size_ - 1) / block_size_;
+}
+
+template <typename T>
+size_t BlockedMatReader<T>::GetNumBlockCols() const {
+  return (width_ + block_size_ - 1) / block_size_;
+}
+
+template <typename T>
+std::vector<T> BlockedMatReader<T>::ReadBlock(const size_t block_row,
+                                              const size_t block_col) const {
+  CHECK_LT(block_row, GetNumBlockRows());
+  CHECK_LT(block_col, GetNumBlockCols());
+
+  std::ifstream file(path_, std::ios::binary);
+  CHECK(file.is_open()) << path_;
+
+  const size_t block_num_elems = block_size_ * block_size_ * depth_;
+  const size_t block_idx = block_row * GetNumBlockCols() + block_col;
+  file.seekg(data_offset_ + static_cast<std::streamoff>(
+                                block_idx * block_num_elems * sizeof(T)));
+
+  std::vector<T> block(block_num_elems);
+  ReadBinaryLittleEndian<T>(&file, &block);
+  CHECK(file.good()) << path_;
+  return block;
+}
+
+template <typename T>
+Mat<T> BlockedMatReader<T>::ReadRegion(const size_t row,
+                                       const size_t col,
+                                       const size_t height,
+                                       const size_t width) const {
+  CHECK_LE(row + height, height_);
+  CHECK_LE(col + width, width_);
+
+  Mat<T> region(width, height, depth_);
+  if (width == 0 || height == 0) {
+    return region;
+  }
+
+  for (size_t block_row = row / block_size_;
+       block_row <= (row + height - 1) / block_size_;
+       ++block_row) {
+    for (size_t block_col = col / block_size_;
+         block_col <= (col + width - 1) / block_size_;
+         ++block_col) {
+      const std::vector<T> block = ReadBlock(block_row, block_col);
+      const size_t row_begin = std::max(row, block_row * block_size_);
+      const size_t col_begin = std::max(col, block_col * block_size_);
+      const size_t row_end =
+          std::min(row + height, (block_row + 1) * block_size_);
+      const size_t col_end =
+          std::min(col + width, (block_col + 1) * block_size_);
+      for (size_t slice = 0; slice < depth_; ++slice) {
+        for (size_t r = row_begin; r < row_end; ++r) {
+          for (size_t c = col_begin; c < col_end; ++c) {
+            region.Set(r - row,
+                       c - col,
+                       slice,
+                       block[(slice * block_size_ + r % block_size_) *
+                                 block_size_ +
+                             c % block_size_]);
+          }
+        }
+      }
+    }
+  }
+
+  return region;
+}
+
+template <typename T>
+BlockedMatView<T>::BlockedMatView(const size_t width,
+                                  const size_t height,
+                                  const size_t depth,
+                                  const size_t block_width,
+                                  const size_t block_height,
+                                  BlockGetter block_getter)
+    : width_(width),
+      height_(height),
+      depth_(depth),
+      block_width_(block_width),
+      block_height_(block_height),
+      num_block_cols_((width + block_width - 1) / block_width),
+      block_getter_(std::move(block_getter)) {
+  CHECK_GT(block_width_, 0);
+  CHECK_GT(block_height_, 0);
+  const size_t num_block_rows = (height + block_height - 1) / block_height;
+  blocks_.resize(num_block_rows * num_block_cols_);
+}
+
+template <typename T>
+BlockedMatView<T>::BlockedMatView(std::shared_ptr<const Mat<T>> mat)
+    : width_(mat->GetWidth()),
+      height_(mat->GetHeight()),
+      depth_(mat->GetDepth()),
+      block_width_(mat->GetWidth()),
+      block_height_(mat->GetHeight()),
+      num_block_cols_(1) {
+  // The single block shares the ownership of the matrix.
+  blocks_.emplace_back(mat, &mat->GetData());
+}
+
+template <typename T>
+size_t BlockedMatView<T>::GetWidth() const {
+  return width_;
+}
+
+template <typename T>
+size_t BlockedMatView<T>::GetHeight() const {
+  return height_;
+}
+
+template <typename T>
+size_t BlockedMatView<T>::GetDepth() const {
+  return depth_;
+}
+
+template <typename T>
+T BlockedMatView<T>::Get(const size_t row,
+                         const size_t col,
+                         const size_t slice) const {
+  const size_t block_row = row / block_height_;
+  const size_t block_col = col / block_width_;
+  auto& block = blocks_[block_row * num_block_cols_ + block_col];
+  if (!block) {
+    block = block_getter_(block_row, block_col);
+  }
+  return (*block)[(slice * block_height_ + row - block_row * block_height_) *
+                      block_width_ +
+                  col - block_col * block_width_];
+}
+
+}  // namespace mvs
+}  // namespace colmap
@@ -0,0 +1,124 @@
+#include "colmap/mvs/blocked_mat.h"
+
+#include "colmap/util/testing.h"
+
+#include <memory>
+
+#include <gtest/gtest.h>
+
+namespace colmap {
+namespace mvs {
+namespace {
+
+Mat<float> CreateMat(const size_t width,
+                     const size_t height,
+                     const size_t depth) {
+  Mat<float> mat(width, height, depth);
+  for (size_t slice = 0; slice < depth; ++slice) {
+    for (size_t row = 0; row < height; ++row) {
+      for (size_t col = 0; col < width; ++col) {
+        mat.Set(row, col, slice, slice * 10000 + row * 100 + col);
+      }
+    }
+  }
+  return mat;
+}
+
+TEST(BlockedMat, WriteRead) {
+  const std::string path = CreateTestDir() + "/mat.bin";
+  const Mat<float> mat = CreateMat(11, 7, 3);
+  WriteBlockedMat(mat, 4, path);
+
+  const BlockedMatReader<float> reader(path);
+  EXPECT_EQ(reader.GetWidth(), 11);
+  EXPECT_EQ(reader.GetHeight(), 7);
+  EXPECT_EQ(reader.GetDepth(), 3);
+  EXPECT_EQ(reader.GetBlockSize(), 4);
+  EXPECT_EQ(reader.GetNumBlockRows(), 2);
+  EXPECT_EQ(reader.GetNumBlockCols(), 3);
+
+  // The border blocks are zero-padded.
+  const std::vector<float> block = reader.ReadBlock(1, 2);
+  ASSERT_EQ(block.size(), 4 * 4 * 3);
+  EXPECT_EQ(block[0], mat.Get(4, 8, 0));
+  EXPECT_EQ(block[2], mat.Get(4, 10, 0));
+  EXPECT_EQ(block[3], 0);
+  EXPECT_EQ(block[2 * 4 + 1], mat.Get(6, 9, 0));
+  EXPECT_EQ(block[3 * 4], 0);
+  EXPECT_EQ(block[(2 * 4 + 1) * 4 + 2], mat.Get(5, 10, 2));
+
+  const Mat<float> full = reader.ReadRegion(0, 0, 7, 11);
+  EXPECT_EQ(full.GetData(), mat.GetData());
+
+  const Mat<float> region = reader.ReadRegion(2, 3, 4, 6);
+  EXPECT_EQ(region.GetWidth(), 6);
+  EXPECT_EQ(region.GetHeight(), 4);
+  EXPECT_EQ(region.GetDepth(), 3);
+  for (size_t slice = 0; slice < 3; ++slice) {
+    for (size_t row = 0; row < 4; ++row) {
+      for (size_t col = 0; col < 6; ++col) {
+        EXPECT_EQ(region.Get(row, col, slice),
+                  mat.Get(row + 2, col + 3, slice));
+      }
+    }
+  }
+}
+
+TEST(BlockedMatView, Blocks) {
+  const std::string path = CreateTestDir() + "/mat.bin";
+  const Mat<float> mat = CreateMat(11, 7, 3);
+  WriteBlockedMat(mat, 4, path);
+
+  const BlockedMatReader<float> reader(path);
+  int num_reads = 0;
+  const BlockedMatView<float> view(
+      reader.GetWidth(),
+      reader.GetHeight(),
+      reader.GetDepth(),
+      reader.GetBlockSize(),
+      reader.GetBlockSize(),
+      [&](const size_t block_row, const size_t block_col) {
+        num_reads += 1;
+        return std::make_shared<const std::vector<float>>(
+            reader.ReadBlock(block_row, block_col));
+      });
+  EXPECT_EQ(view.GetWidth(), 11);
+  EXPECT_EQ(view.GetHeight(), 7);
+  EXPECT_EQ(view.GetDepth(), 3);
+  EXPECT_EQ(num_reads, 0);
+
+  EXPECT_EQ(view.Get(5, 9, 2), mat.Get(5, 9, 2));
+  EXPECT_EQ(num_reads, 1);
+  EXPECT_EQ(view.Get(4, 8, 0), mat.Get(4, 8, 0));
+  EXPECT_EQ(num_reads, 1);
+
+  for (size_t slice = 0; slice < 3; ++slice) {
+    for (size_t row = 0; row < 7; ++row) {
+      for (size_t col = 0; col < 11; ++col) {
+        EXPECT_EQ(view.Get(row, col, slice), mat.Get(row, col, slice));
+      }
+    }
+  }
+  EXPECT_EQ(num_reads, 6);
+}
+
+TEST(BlockedMatView, Mat) {
+  auto mat = std::make_shared<const Mat<float>>(CreateMat(5, 3, 2));
+  const BlockedMatView<float> view(mat);
+  EXPECT_EQ(view.GetWidth(), 5);
+  EXPECT_EQ(view.GetHeight(), 3);
+  EXPECT_EQ(view.GetDepth(), 2);
+  // The view keeps the matrix alive.
+  mat.reset();
+  for (size_t slice = 0; slice < 2; ++slice) {
+    for (size_t row = 0; row < 3; ++row) {
+      for (size_t col = 0; col < 5; ++col) {
+        EXPECT_EQ(view.Get(row, col, slice), slice * 10000 + row * 100 + col);
+      }
+    }
+  }
+}
+
+}  // namespace
+}  // namespace mvs
+}  // namespace colmap
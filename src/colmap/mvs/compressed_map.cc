@@ -0,0 +1,411 @@
+#include "colmap/mvs/compressed_map.h"
+
+#include "colmap/util/endian.h"
+#include "colmap/util/logging.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <vector>
+
+#include <lz4.h>
+
+namespace colmap {
+namespace mvs {
+namespace {
+
+const char kMagic[4] = {'C', 'M', 'A', 'P'};
+const uint32_t kVersion = 1;
+
+// The number of rows of a tile, such that typical maps have enough tiles to
+// be decoded in parallel.
+const size_t kTileRows = 64;
+
+// The code 0 marks invalid pixels and the codes 1..kMaxCode valid values.
+const uint32_t kMaxCode = std::numeric_limits<uint16_t>::max();
+
+enum class MapType : uint32_t { DEPTH = 0, NORMAL = 1 };
+
+struct TileHeader {
+  // The quantization range of the depth tiles.
+  float min_value = 0;
+  float max_value = 0;
+  uint64_t num_bytes = 0;
+};
+
+struct CompressedMap {
+  MapType type = MapType::DEPTH;
+  size_t width = 0;
+  size_t height = 0;
+  size_t tile_rows = 0;
+  std::vector<TileHeader> tiles;
+  std::vector<char> data;
+};
+
+uint16_t Quantize(const float value) {
+  const float clamped = std::min(std::max(value, 0.0f), 1.0f);
+  return static_cast<uint16_t>(1 + std::lround(clamped * (kMaxCode - 1)));
+}
+
+float Dequantize(const uint16_t code) {
+  return static_cast<float>(code - 1) / (kMaxCode - 1);
+}
+
+float SignNotZero(const float value) { return value < 0 ? -1.0f : 1.0f; }
+
+// Compress the codes after shuffling their low and high bytes into separate
+// planes, which compresses better because the high bytes of neighboring
+// pixels are mostly equal.
+std::vector<char> CompressCodes(const std::vector<uint16_t>& codes) {
+  const size_t num_codes = codes.size();
+  CHECK_LE(2 * num_codes, std::numeric_limits<int>::max());
+  std::vector<char> shuffled(2 * num_codes);
+  for (size_t i = 0; i < num_codes; ++i) {
+    shuffled[i] = static_cast<char>(codes[i] & 0xFF);
+    shuffled[num_codes + i] = static_cast<char>(codes[i] >> 8);
+  }
+
+  const int num_shuffled_bytes = static_cast<int>(shuffled.size());
+  std::vector<char> compressed(LZ4_compressBound(num_shuffled_bytes));
+  const int num_bytes =
+      LZ4_compress_default(shuffled.data(),
+                           compressed.data(),
+                           num_shuffled_bytes,
+                           static_cast<int>(compressed.size()));
+  CHECK_GT(num_bytes, 0);
+  compressed.resize(num_bytes);
+  return compressed;
+}
+
+void DecompressCodes(const char* data,
+                     const size_t num_bytes,
+                     std::vector<uint16_t>* codes) {
+  const size_t num_codes = codes->size();
+  std::vector<unsigned char> shuffled(2 * num_codes);
+  const int num_shuffled_bytes =
+      LZ4_decompress_safe(data,
+                          reinterpret_cast<char*>(shuffled.data()),
+                          static_cast<int>(num_bytes),
+                          static_cast<int>(shuffled.size()));
+  CHECK_EQ(num_shuffled_bytes, static_cast<int>(shuffled.size()))
+      << "Corrupt compressed map";
+  for (size_t i = 0; i < num_codes; ++i) {
+    (*codes)[i] = static_cast<uint16_t>(shuffled[i] |
+                                        (shuffled[num_codes + i] << 8));
+  }
+}
+
+TileHeader EncodeDepthTile(const float* depths,
+                           const size_t num_pixels,
+                           std::vector<uint16_t>* codes) {
+  float min_log_depth = std::numeric_limits<float>::max();
+  float max_log_depth = std::numeric_limits<float>::lowest();
+  for (size_t i = 0; i < num_pixels; ++i) {
+    if (depths[i] > 0 && std::isfinite(depths[i])) {
+      const float log_depth = std::log(depths[i]);
+      min_log_depth = std::min(min_log_depth, log_depth);
+      max_log_depth = std::max(max_log_depth, log_depth);
+    }
+  }
+
+  TileHeader tile;
+  if (min_log_depth <= max_log_depth) {
+    tile.min_value = min_log_depth;
+    tile.max_value = max_log_depth;
+  }
+
+  const float range = tile.max_value - tile.min_value;
+  codes->resize(num_pixels);
+  for (size_t i = 0; i < num_pixels; ++i) {
+    if (depths[i] > 0 && std::isfinite(depths[i])) {
+      (*codes)[i] =
+          range > 0 ? Quantize((std::log(depths[i]) - tile.min_value) / range)
+                    : 1;
+    } else {
+      (*codes)[i] = 0;
+    }
+  }
+
+  return tile;
+}
+
+void DecodeDepthTile(const TileHeader& tile,
+                     const std::vector<uint16_t>& codes,
+                     float* depths) {
+  const float range = tile.max_value - tile.min_value;
+  for (size_t i = 0; i < codes.size(); ++i) {
+    depths[i] = codes[i] == 0
+                    ? 0.0f
+                    : std::exp(tile.min_value + Dequantize(codes[i]) * range);
+  }
+}
+
+// Octahedral encoding of the normals, see "A Survey of Efficient
+// Representations for Independent Unit Vectors", Cigolle et al., 2014.
+void EncodeNormalTile(const float* normals,
+                      const size_t num_pixels,
+                      const size_t slice_size,
+                      std::vector<uint16_t>* codes) {
+  codes->resize(2 * num_pixels);
+  for (size_t i = 0; i < num_pixels; ++i) {
+    const float x = normals[i];
+    const float y = normals[slice_size + i];
+    const float z = normals[2 * slice_size + i];
+    const float l1_norm = std::abs(x) + std::abs(y) + std::abs(z);
+    if (!(l1_norm > 0) || !std::isfinite(l1_norm)) {
+      (*codes)[i] = 0;
+      (*codes)[num_pixels + i] = 0;
+      continue;
+    }
+
+    float u = x / l1_norm;
+    float v = y / l1_norm;
+    if (z < 0) {
+      const float folded_u = (1 - std::abs(v)) * SignNotZero(u);
+      v = (1 - std::abs(u)) * SignNotZero(v);
+      u = folded_u;
+    }
+
+    (*codes)[i] = Quantize(0.5f * (u + 1));
+    (*codes)[num_pixels + i] = Quantize(0.5f * (v + 1));
+  }
+}
+
+void DecodeNormalTile(const std::vector<uint16_t>& codes,
+                      const size_t slice_size,
+                      float* normals) {
+  const size_t num_pixels = codes.size() / 2;
+  for (size_t i = 0; i < num_pixels; ++i) {
+    float x = 0;
+    float y = 0;
+    float z = 0;
+    if (codes[i] != 0 || codes[num_pixels + i] != 0) {
+      x = 2 * Dequantize(codes[i]) - 1;
+      y = 2 * Dequantize(codes[num_pixels + i]) - 1;
+      z = 1 - std::abs(x) - std::abs(y);
+      if (z < 0) {
+        const float unfolded_x = (1 - std::abs(y)) * SignNotZero(x);
+        y = (1 - std::abs(x)) * SignNotZero(y);
+        x = unfolded_x;
+      }
+      const float norm = std::sqrt(x * x + y * y + z * z);
+      x /= norm;
+      y /= norm;
+      z /= norm;
+    }
+    normals[i] = x;
+    normals[slice_size + i] = y;
+    normals[2 * slice_size + i] = z;
+  }
+}
+
+// Encode the tiles of pixels [begin, end) with the given function and write
+// the compressed map to the file.
+void WriteCompressedMap(
+    const MapType type,
+    const size_t width,
+    const size_t height,
+    const std::function<TileHeader(
+        size_t begin, size_t end, std::vector<uint16_t>* codes)>& encode_tile,
+    const std::string& path) {
+  const size_t num_tiles = (height + kTileRows - 1) / kTileRows;
+  std::vector<TileHeader> tiles(num_tiles);
+  std::vector<std::vector<char>> compressed_tiles(num_tiles);
+  std::vector<uint16_t> codes;
+  for (size_t tile_idx = 0; tile_idx < num_tiles; ++tile_idx) {
+    const size_t begin = tile_idx * kTileRows * width;
+    const size_t end = std::min(height, (tile_idx + 1) * kTileRows) * width;
+    tiles[tile_idx] = encode_tile(begin, end, &codes);
+    compressed_tiles[tile_idx] = CompressCodes(codes);
+    tiles[tile_idx].num_bytes = compressed_tiles[tile_idx].size();
+  }
+
+  std::ofstream file(path, std::ios::binary);
+  CHECK(file.is_open()) << path;
+  file.write(kMagic, sizeof(kMagic));
+  WriteBinaryLittleEndian<uint32_t>(&file, kVersion);
+  WriteBinaryLittleEndian<uint32_t>(&file, static_cast<uint32_t>(type));
+  WriteBinaryLittleEndian<uint64_t>(&file, width);
+  WriteBinaryLittleEndian<uint64_t>(&file, height);
+  WriteBinaryLittleEndian<uint32_t>(&file, kTileRows);
+  WriteBinaryLittleEndian<uint32_t>(&file, num_tiles);
+  for (const auto& tile : tiles) {
+    WriteBinaryLittleEndian<float>(&file, tile.min_value);
+    WriteBinaryLittleEndian<float>(&file, tile.max_value);
+    WriteBinaryLittleEndian<uint64_t>(&file, tile.num_bytes);
+  }
+  for (const auto& compressed_tile : compressed_tiles) {
+    file.write(compressed_tile.data(), compressed_tile.size());
+  }
+  CHECK(file.good()) << path;
+}
+
+CompressedMap ReadCompressedMap(const std::string& path,
+                                const MapType type) {
+  std::ifstream file(path, std::ios::binary);
+  CHECK(file.is_open()) << path;
+
+  char magic[sizeof(kMagic)];
+  file.read(magic, sizeof(magic));
+  CHECK(file.good() && std::memcmp(magic, kMagic, sizeof(kMagic)) == 0)
+      << path;
+  CHECK_EQ(ReadBinaryLittleEndian<uint32_t>(&file), kVersion) << path;
+
+  CompressedMap map;
+  map.type = static_cast<MapType>(ReadBinaryLittleEndian<uint32_t>(&file));
+  CHECK(map.type == type) << "Unexpected map type: " << path;
+  map.width = ReadBinaryLittleEndian<uint64_t>(&file);
+  map.height = ReadBinaryLittleEndian<uint64_t>(&file);
+  map.tile_rows = ReadBinaryLittleEndian<uint32_t>(&file);
+  CHECK_GT(map.width, 0) << path;
+  CHECK_GT(map.height, 0) << path;
+  CHECK_GT(map.tile_rows, 0) << path;
+
+  map.tiles.resize(ReadBinaryLittleEndian<uint32_t>(&file));
+  CHECK_EQ(map.tiles.size(), (map.height + map.tile_rows - 1) / map.tile_rows)
+      << path;
+  size_t num_bytes = 0;
+  for (auto& tile : map.tiles) {
+    tile.min_value = ReadBinaryLittleEndian<float>(&file);
+    tile.max_value = ReadBinaryLittleEndian<float>(&file);
+    tile.num_bytes = ReadBinaryLittleEndian<uint64_t>(&file);
+    num_bytes += tile.num_bytes;
+  }
+
+  // Read all tiles at once, so that only the decoding is done per tile.
+  map.data.resize(num_bytes);
+  file.read(map.data.data(), num_bytes);
+  CHECK(file.good()) << path;
+
+  return map;
+}
+
+// Decompress the tiles of the map and decode the pixels [begin, end) of each
+// tile with the given function, in parallel if a thread pool is given.
+void DecodeTiles(const CompressedMap& map,
+                 const size_t num_channels,
+                 ThreadPool* thread_pool,
+                 const std::function<void(const TileHeader& tile,
+                                          size_t begin,
+                                          const std::vector<uint16_t>& codes)>&
+                     decode_tile) {
+  const size_t num_tiles = map.tiles.size();
+  std::vector<size_t> offsets(num_tiles, 0);
+  for (size_t tile_idx = 1; tile_idx < num_tiles; ++tile_idx) {
+    offsets[tile_idx] =
+        offsets[tile_idx - 1] + map.tiles[tile_idx - 1].num_bytes;
+  }
+
+  const auto DecodeTile = [&](const int64_t tile_idx) {
+    const TileHeader& tile = map.tiles[tile_idx];
+    const size_t begin = tile_idx * map.tile_rows * map.width;
+    const size_t end =
+        std::min(map.height, (tile_idx + 1) * map.tile_rows) * map.width;
+    std::vector<uint16_t> codes(num_channels * (end - begin));
+    DecompressCodes(
+        map.data.data() + offsets[tile_idx], tile.num_bytes, &codes);
+    decode_tile(tile, begin, codes);
+  };
+
+  if (thread_pool == nullptr) {
+    for (size_t tile_idx = 0; tile_idx < num_tiles; ++tile_idx) {
+      DecodeTile(tile_idx);
+    }
+  } else {
+    thread_pool->ParallelFor(0, num_tiles, 1, DecodeTile);
+  }
+}
+
+}  // namespace
+
+void WriteCompressedDepthMap(const DepthMap& depth_map,
+                             const std::string& path) {
+  const float* depths = depth_map.GetPtr();
+  WriteCompressedMap(
+      MapType::DEPTH,
+      depth_map.GetWidth(),
+      depth_map.GetHeight(),
+      [depths](const size_t begin,
+               const size_t end,
+               std::vector<uint16_t>* codes) {
+        return EncodeDepthTile(depths + begin, end - begin, codes);
+      },
+      path);
+}
+
+void WriteCompressedNormalMap(const NormalMap& normal_map,
+                              const std::string& path) {
+  const float* normals = normal_map.GetPtr();
+  const size_t slice_size = normal_map.GetWidth() * normal_map.GetHeight();
+  WriteCompressedMap(
+      MapType::NORMAL,
+      normal_map.GetWidth(),
+      normal_map.GetHeight(),
+      [normals, slice_size](const size_t begin,
+                            const size_t end,
+                            std::vector<uint16_t>* codes) {
+        EncodeNormalTile(normals + begin, end - begin, slice_size, codes);
+        return TileHeader();
+      },
+      path);
+}
+
+bool IsCompressedMap(const std::string& path) {
+  std::ifstream file(path, std::ios::binary);
+  CHECK(file.is_open()) << path;
+  char magic[sizeof(kMagic)];
+  file.read(magic, sizeof(magic));
+  return file.good() && std::memcmp(magic, kMagic, sizeof(kMagic)) == 0;
+}
+
+void ReadDepthMap(const std::string& path,
+                  DepthMap* depth_map,
+                  ThreadPool* thread_pool) {
+  CHECK_NOTNULL(depth_map);
+  if (!IsCompressedMap(path)) {
+    depth_map->Read(path);
+    return;
+  }
+
+  const CompressedMap map = ReadCompressedMap(path, MapType::DEPTH);
+  *depth_map = DepthMap(map.width, map.height, -1.0f, -1.0f);
+  float* depths = depth_map->GetPtr();
+  DecodeTiles(map,
+              /*num_channels=*/1,
+              thread_pool,
+              [depths](const TileHeader& tile,
+                       const size_t begin,
+                       const std::vector<uint16_t>& codes) {
+                DecodeDepthTile(tile, codes, depths + begin);
+              });
+}
+
+void ReadNormalMap(const std::string& path,
+                   NormalMap* normal_map,
+                   ThreadPool* thread_pool) {
+  CHECK_NOTNULL(normal_map);
+  if (!IsCompressedMap(path)) {
+    normal_map->Read(path);
+    return;
+  }
+
+  const CompressedMap map = ReadCompressedMap(path, MapType::NORMAL);
+  *normal_map = NormalMap(map.width, map.height);
+  float* normals = normal_map->GetPtr();
+  const size_t slice_size = map.width * map.height;
+  DecodeTiles(map,
+              /*num_channels=*/2,
+              thread_pool,
+              [normals, slice_size](const TileHeader& tile,
+                                    const size_t begin,
+                                    const std::vector<uint16_t>& codes) {
+                DecodeNormalTile(codes, slice_size, normals + begin);
+              });
+}
+
+}  // namespace mvs
+}  // namespace colmap
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "colmap/mvs/depth_map.h"
+#include "colmap/mvs/normal_map.h"
+#include "colmap/util/threading.h"
+
+#include <string>
+
+namespace colmap {
+namespace mvs {
+
+// Compressed on-disk format of depth and normal maps, which is at most about
+// half the size of the raw format of `Mat::Write` and faster to read.
+// The maps are split into tiles of rows, which are compressed independently
+// with LZ4 and can thus be decoded in parallel. Each pixel is quantized to
+// 16 bits per channel before compression:
+//
+//  - Depths are quantized logarithmically between the minimum and maximum
+//    depth of the tile, such that the relative error is bounded by about
+//    (log(max_depth) - log(min_depth)) / 131068. Non-positive or non-finite
+//    depths are invalid and read as zero.
+//
+//  - Normals are stored in octahedral encoding with two channels and read as
+//    unit vectors, with an angular error below 1e-4 radians. Zero or
+//    non-finite normals are read as zero.
+//
+// The file format is
+//
+//    CMAP<version><type><width><height><tile_rows><num_tiles>
+//    <tile header 0>...<tile header N-1><tile 0>...<tile N-1>
+//
+// where each tile header stores the quantization range and the number of
+// compressed bytes of the tile.
+void WriteCompressedDepthMap(const DepthMap& depth_map,
+                             const std::string& path);
+void WriteCompressedNormalMap(const NormalMap& normal_map,
+                              const std::string& path);
+
+// Whether the file at the given path is in the compressed format.
+bool IsCompressedMap(const std::string& path);
+
+// Read a depth or normal map in either the raw or the compressed format. The
+// tiles of compressed maps are decoded in parallel, if a thread pool is given.
+void ReadDepthMap(const std::string& path,
+                  DepthMap* depth_map,
+                  ThreadPool* thread_pool = nullptr);
+void ReadNormalMap(const std::string& path,
+                   NormalMap* normal_map,
+                   ThreadPool* thread_pool = nullptr);
+
+}  // namespace mvs
+}  // namespace colmap
@@ -0,0 +1,156 @@
+#include "colmap/mvs/compressed_map.h"
+
+#include "colmap/util/testing.h"
+
+#include <cmath>
+#include <limits>
+
+#include <Eigen/Geometry>
+#include <gtest/gtest.h>
+
+namespace colmap {
+namespace mvs {
+namespace {
+
+DepthMap CreateDepthMap(const size_t width, const size_t height) {
+  DepthMap depth_map(width, height, -1.0f, -1.0f);
+  for (size_t row = 0; row < height; ++row) {
+    for (size_t col = 0; col < width; ++col) {
+      depth_map.Set(row, col, 1.0f + 0.1f * row + 0.01f * col);
+    }
+  }
+  // Invalid depths.
+  depth_map.Set(0, 0, 0.0f);
+  depth_map.Set(1, 2, -1.0f);
+  depth_map.Set(2, 1, std::numeric_limits<float>::quiet_NaN());
+  return depth_map;
+}
+
+NormalMap CreateNormalMap(const size_t width, const size_t height) {
+  NormalMap normal_map(width, height);
+  for (size_t row = 0; row < height; ++row) {
+    for (size_t col = 0; col < width; ++col) {
+      const Eigen::Vector3f normal =
+          Eigen::Vector3f(std::sin(0.1f * row + 1.0f),
+                          std::cos(0.3f * col),
+                          std::sin(0.2f * (row + col)))
+              .normalized();
+      for (int d = 0; d < 3; ++d) {
+        normal_map.Set(row, col, d, normal(d));
+      }
+    }
+  }
+  // Zero normal.
+  for (int d = 0; d < 3; ++d) {
+    normal_map.Set(1, 1, d, 0.0f);
+  }
+  return normal_map;
+}
+
+void ExpectEqualDepthMaps(const DepthMap& depth_map1,
+                          const DepthMap& depth_map2) {
+  ASSERT_EQ(depth_map1.GetWidth(), depth_map2.GetWidth());
+  ASSERT_EQ(depth_map1.GetHeight(), depth_map2.GetHeight());
+  for (size_t row = 0; row < depth_map1.GetHeight(); ++row) {
+    for (size_t col = 0; col < depth_map1.GetWidth(); ++col) {
+      const float depth = depth_map1.Get(row, col);
+      if (depth > 0 && std::isfinite(depth)) {
+        EXPECT_NEAR(depth_map2.Get(row, col), depth, 1e-4 * depth);
+      } else {
+        EXPECT_EQ(depth_map2.Get(row, col), 0.0f);
+      }
+    }
+  }
+}
+
+TEST(CompressedMap, DepthMap) {
+  const std::string path = CreateTestDir() + "/depth_map.bin";
+  const DepthMap depth_map = CreateDepthMap(50, 150);
+  WriteCompressedDepthMap(depth_map, path);
+  EXPECT_TRUE(IsCompressedMap(path));
+
+  DepthMap read_depth_map;
+  ReadDepthMap(path, &read_depth_map);
+  ExpectEqualDepthMaps(depth_map, read_depth_map);
+}
+
+TEST(CompressedMap, ConstantDepthMap) {
+  const std::string path = CreateTestDir() + "/depth_map.bin";
+  DepthMap depth_map(10, 5, -1.0f, -1.0f);
+  depth_map.Fill(2.5f);
+  WriteCompressedDepthMap(depth_map, path);
+
+  DepthMap read_depth_map;
+  ReadDepthMap(path, &read_depth_map);
+  ExpectEqualDepthMaps(depth_map, read_depth_map);
+}
+
+TEST(CompressedMap, NormalMap) {
+  const std::string path = CreateTestDir() + "/normal_map.bin";
+  const NormalMap normal_map = CreateNormalMap(40, 130);
+  WriteCompressedNormalMap(normal_map, path);
+  EXPECT_TRUE(IsCompressedMap(path));
+
+  NormalMap read_normal_map;
+  ReadNormalMap(path, &read_normal_map);
+  ASSERT_EQ(read_normal_map.GetWidth(), normal_map.GetWidth());
+  ASSERT_EQ(read_normal_map.GetHeight(), normal_map.GetHeight());
+  ASSERT_EQ(read_normal_map.GetDepth(), 3);
+  for (size_t row = 0; row < normal_map.GetHeight(); ++row) {
+    for (size_t col = 0; col < normal_map.GetWidth(); ++col) {
+      Eigen::Vector3f normal;
+      Eigen::Vector3f read_normal;
+      normal_map.GetSlice(row, col, normal.data());
+      read_normal_map.GetSlice(row, col, read_normal.data());
+      if (normal.norm() == 0) {
+        EXPECT_EQ(read_normal, Eigen::Vector3f::Zero());
+      } else {
+        EXPECT_NEAR(read_normal.norm(), 1, 1e-6);
+        EXPECT_LT(normal.cross(read_normal).norm(), 1e-4);
+      }
+    }
+  }
+}
+
+TEST(CompressedMap, ReadRawMaps) {
+  const std::string test_dir = CreateTestDir();
+  const DepthMap depth_map = CreateDepthMap(20, 10);
+  depth_map.Write(test_dir + "/depth_map.bin");
+  EXPECT_FALSE(IsCompressedMap(test_dir + "/depth_map.bin"));
+  DepthMap read_depth_map;
+  ReadDepthMap(test_dir + "/depth_map.bin", &read_depth_map);
+  EXPECT_EQ(read_depth_map.GetWidth(), depth_map.GetWidth());
+  EXPECT_EQ(read_depth_map.GetHeight(), depth_map.GetHeight());
+  EXPECT_EQ(read_depth_map.Get(3, 4), depth_map.Get(3, 4));
+
+  const NormalMap normal_map = CreateNormalMap(20, 10);
+  normal_map.Write(test_dir + "/normal_map.bin");
+  EXPECT_FALSE(IsCompressedMap(test_dir + "/normal_map.bin"));
+  NormalMap read_normal_map;
+  ReadNormalMap(test_dir + "/normal_map.bin", &read_normal_map);
+  EXPECT_EQ(read_normal_map.GetData(), normal_map.GetData());
+}
+
+TEST(CompressedMap, ParallelDecode) {
+  const std::string test_dir = CreateTestDir();
+  const DepthMap depth_map = CreateDepthMap(30, 300);
+  const NormalMap normal_map = CreateNormalMap(30, 300);
+  WriteCompressedDepthMap(depth_map, test_dir + "/depth_map.bin");
+  WriteCompressedNormalMap(normal_map, test_dir + "/normal_map.bin");
+
+  DepthMap depth_map1;
+  DepthMap depth_map2;
+  NormalMap normal_map1;
+  NormalMap normal_map2;
+  ThreadPool thread_pool(4);
+  ReadDepthMap(test_dir + "/depth_map.bin", &depth_map1);
+  ReadDepthMap(test_dir + "/depth_map.bin", &depth_map2, &thread_pool);
+  ReadNormalMap(test_dir + "/normal_map.bin", &normal_map1);
+  ReadNormalMap(test_dir + "/normal_map.bin", &normal_map2, &thread_pool);
+  EXPECT_EQ(depth_map1.GetData(), depth_map2.GetData());
+  EXPECT_EQ(normal_map1.GetData(), normal_map2.GetData());
+}
+
+}  // namespace
+}  // namespace mvs
+}  // namespace colmap
@@ -32,12 +32,22 @@
 #include "colmap/util/logging.h"
 #include "colmap/util/misc.h"
 
+#include <algorithm>
 #include <fstream>
 #include <numeric>
+#include <unordered_map>
 
 namespace colmap {
 namespace mvs {
 
+namespace {
+
+// The third field of the header, which distinguishes the formats.
+const int kListFormat = 1;
+const int kPackedFormat = 2;
+
+}  // namespace
+
 const int ConsistencyGraph::kNoConsistentImageIds = -1;
 
 ConsistencyGraph::ConsistencyGraph() {}
@@ -49,14 +59,67 @@ ConsistencyGraph::ConsistencyGraph(const size_t width,
   InitializeMap(width, height);
 }
 
+ConsistencyGraph::ConsistencyGraph(const size_t width,
+                                   const size_t height,
+                                   const std::vector<int>& data,
+                                   const std::vector<int>& src_image_idxs)
+    : width_(width),
+      height_(height),
+      src_image_idxs_(src_image_idxs),
+      num_mask_words_(std::max<size_t>(1, (src_image_idxs.size() + 31) / 32)) {
+  std::unordered_map<int, int> src_image_idx_to_bit;
+  for (size_t i = 0; i < src_image_idxs_.size(); ++i) {
+    src_image_idx_to_bit.emplace(src_image_idxs_[i], i);
+  }
+
+  // Offsets of the pixels in the list, which is not necessarily sorted.
+  data_ = data;
+  InitializeMap(width, height);
+
+  row_offsets_.reserve(height + 1);
+  row_offsets_.push_back(0);
+  std::vector<uint32_t> mask(num_mask_words_);
+  for (size_t row = 0; row < height; ++row) {
+    for (size_t col = 0; col < width; ++col) {
+      std::fill(mask.begin(), mask.end(), 0);
+      const int index = map_(row, col);
+      if (index != kNoConsistentImageIds) {
+        for (int i = 0; i < data_.at(index); ++i) {
+          const int bit = src_image_idx_to_bit.at(data_.at(index + 1 + i));
+          mask[bit / 32] |= 1u << (bit % 32);
+        }
+      }
+
+      // Extend the previous run of the row, if it has the same bitmask.
+      if (col > 0 && std::equal(mask.begin(),
+                                mask.end(),
+                                run_masks_.end() - num_mask_words_)) {
+        run_ends_.back() += 1;
+      } else {
+        run_ends_.push_back(col + 1);
+        run_masks_.insert(run_masks_.end(), mask.begin(), mask.end());
+      }
+    }
+    row_offsets_.push_back(run_ends_.size());
+  }
+
+  std::vector<int>().swap(data_);
+  map_.resize(0, 0);
+}
+
+bool ConsistencyGraph::IsPacked() const { return !row_offsets_.empty(); }
+
 size_t ConsistencyGraph::GetNumBytes() const {
-  return (data_.size() + map_.size()) * sizeof(int);
+  return (data_.size() + map_.size() + src_image_idxs_.size()) * sizeof(int) +
+         (row_offsets_.size() + run_ends_.size() + run_masks_.size()) *
+             sizeof(uint32_t);
 }
 
 void ConsistencyGraph::GetImageIdxs(const int row,
                                     const int col,
                                     int* num_images,
                                     const int** image_idxs) const {
+  CHECK(!IsPacked());
   const int index = map_(row, col);
   if (index == kNoConsistentImageIds) {
     *num_images = 0;
@@ -67,27 +130,83 @@ void ConsistencyGraph::GetImageIdxs(const int row,
   }
 }
 
+void ConsistencyGraph::GetImageIdxs(const int row,
+                                    const int col,
+                                    std::vector<int>* image_idxs) const {
+  image_idxs->clear();
+  if (IsPacked()) {
+    const uint32_t* mask = GetImageMask(row, col);
+    for (size_t i = 0; i < src_image_idxs_.size(); ++i) {
+      if (mask[i / 32] & (1u << (i % 32))) {
+        image_idxs->push_back(src_image_idxs_[i]);
+      }
+    }
+  } else {
+    int num_images;
+    const int* idxs;
+    GetImageIdxs(row, col, &num_images, &idxs);
+    image_idxs->assign(idxs, idxs + num_images);
+  }
+}
+
+const std::vector<int>& ConsistencyGraph::SrcImageIdxs() const {
+  return src_image_idxs_;
+}
+
+size_t ConsistencyGraph::NumMaskWords() const { return num_mask_words_; }
+
+const uint32_t* ConsistencyGraph::GetImageMask(const int row,
+                                               const int col) const {
+  CHECK(IsPacked());
+  const auto run_begin = run_ends_.begin() + row_offsets_[row];
+  const auto run_end = run_ends_.begin() + row_offsets_[row + 1];
+  const size_t run_idx =
+      std::upper_bound(run_begin, run_end, static_cast<uint32_t>(col)) -
+      run_ends_.begin();
+  return &run_masks_[run_idx * num_mask_words_];
+}
+
 void ConsistencyGraph::Read(const std::string& path) {
   std::fstream text_file(path, std::ios::in | std::ios::binary);
   CHECK(text_file.is_open()) << path;
 
   size_t width = 0;
   size_t height = 0;
-  size_t depth = 0;
+  int format = 0;
   char unused_char;
 
-  text_file >> width >> unused_char >> height >> unused_char >> depth >>
+  text_file >> width >> unused_char >> height >> unused_char >> format >>
       unused_char;
   const std::streampos pos = text_file.tellg();
   text_file.close();
 
   CHECK_GT(width, 0);
   CHECK_GT(height, 0);
-  CHECK_GT(depth, 0);
+  CHECK(format == kListFormat || format == kPackedFormat) << path;
 
   std::fstream binary_file(path, std::ios::in | std::ios::binary);
   CHECK(binary_file.is_open()) << path;
 
+  if (format == kPackedFormat) {
+    binary_file.seekg(pos);
+    width_ = width;
+    height_ = height;
+    src_image_idxs_.resize(ReadBinaryLittleEndian<int>(&binary_file));
+    ReadBinaryLittleEndian<int>(&binary_file, &src_image_idxs_);
+    num_mask_words_ =
+        std::max<size_t>(1, (src_image_idxs_.size() + 31) / 32);
+    row_offsets_.resize(height + 1);
+    ReadBinaryLittleEndian<uint32_t>(&binary_file, &row_offsets_);
+    run_ends_.resize(row_offsets_.back());
+    ReadBinaryLittleEndian<uint32_t>(&binary_file, &run_ends_);
+    run_masks_.resize(run_ends_.size() * num_mask_words_);
+    ReadBinaryLittleEndian<uint32_t>(&binary_file, &run_masks_);
+    binary_file.close();
+    data_.clear();
+    map_.resize(0, 0);
+    return;
+  }
+
   binary_file.seekg(0, std::ios::end);
   const size_t num_bytes = binary_file.tellg() - pos;
 
@@ -103,13 +222,27 @@ void ConsistencyGraph::Read(const std::string& path) {
 void ConsistencyGraph::Write(const std::string& path) const {
   std::fstream text_file(path, std::ios::out);
   CHECK(text_file.is_open()) << path;
-  text_file << map_.cols() << "&" << map_.rows() << "&" << 1 << "&";
+  if (IsPacked()) {
+    text_file << width_ << "&" << height_ << "&" << kPackedFormat << "&";
+  } else {
+    text_file << map_.cols() << "&" << map_.rows() << "&" << kListFormat
+              << "&";
+  }
   text_file.close();
 
   std::fstream binary_file(path,
                            std::ios::out | std::ios::binary | std::ios::app);
   CHECK(binary_file.is_open()) << path;
-  WriteBinaryLittleEndian<int>(&binary_file, data_);
+  if (IsPacked()) {
+    WriteBinaryLittleEndian<int>(&binary_file,
+                                 static_cast<int>(src_image_idxs_.size()));
+    WriteBinaryLittleEndian<int>(&binary_file, src_image_idxs_);
+    WriteBinaryLittleEndian<uint32_t>(&binary_file, row_offsets_);
+    WriteBinaryLittleEndian<uint32_t>(&binary_file, run_ends_);
+    WriteBinaryLittleEndian<uint32_t>(&binary_file, run_masks_);
+  } else {
+    WriteBinaryLittleEndian<int>(&binary_file, data_);
+  }
   binary_file.close();
 }
 
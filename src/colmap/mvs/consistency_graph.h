@@ -49,18 +49,46 @@ namespace mvs {
 // N is the number of consistent images, followed by the N image indices.
 // Note that only pixels are listed which are not filtered and that the
 // consistency graph is only filled if filtering is enabled.
+//
+// Alternatively, the consistency graph can be stored in a packed format, in
+// which the consistent images of a pixel are a bitmask over the source images
+// of the reference image, whose number is limited by the maximum number of
+// source images. Every row of the image is run-length encoded as runs of
+// pixels with the same bitmask, such that the bitmask of a pixel is found by
+// a binary search over the runs of its row without decoding the graph.
 class ConsistencyGraph {
  public:
   ConsistencyGraph();
   ConsistencyGraph(size_t width, size_t height, const std::vector<int>& data);
 
+  // Pack the consistency graph given in the list format, where all image
+  // indices in `data` must be contained in `src_image_idxs`.
+  ConsistencyGraph(size_t width,
+                   size_t height,
+                   const std::vector<int>& data,
+                   const std::vector<int>& src_image_idxs);
+
+  bool IsPacked() const;
+
   size_t GetNumBytes() const;
 
+  // Get the consistent images of a pixel in the list format.
   void GetImageIdxs(int row,
                     int col,
                     int* num_images,
                     const int** image_idxs) const;
 
+  // Get the consistent images of a pixel in either format, where the images
+  // of the packed format are ordered as the source images.
+  void GetImageIdxs(int row, int col, std::vector<int>* image_idxs) const;
+
+  // The source images of the packed format, where the consistency of the
+  // source image `SrcImageIdxs()[i]` is given by the bit `i % 32` of the word
+  // `i / 32` of the bitmask. The bitmask has `NumMaskWords()` words.
+  const std::vector<int>& SrcImageIdxs() const;
+  size_t NumMaskWords() const;
+  const uint32_t* GetImageMask(int row, int col) const;
+
   void Read(const std::string& path);
   void Write(const std::string& path) const;
 
@@ -70,6 +98,17 @@ class ConsistencyGraph {
   const static int kNoConsistentImageIds;
   std::vector<int> data_;
   Eigen::MatrixXi map_;
+
+  // The packed format, where the runs of row r are in the range
+  // [row_offsets_[r], row_offsets_[r + 1]) and the run i ends before the
+  // column run_ends_[i] with the bitmask at run_masks_[i * num_mask_words_].
+  size_t width_ = 0;
+  size_t height_ = 0;
+  std::vector<int> src_image_idxs_;
+  size_t num_mask_words_ = 0;
+  std::vector<uint32_t> row_offsets_;
+  std::vector<uint32_t> run_ends_;
+  std::vector<uint32_t> run_masks_;
 };
 
 }  // namespace mvs
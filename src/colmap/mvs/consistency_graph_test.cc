@@ -29,6 +29,9 @@
 
 #include "colmap/mvs/consistency_graph.h"
 
+#include "colmap/util/misc.h"
+#include "colmap/util/testing.h"
+
 #include <gtest/gtest.h>
 
 namespace colmap {
@@ -96,6 +99,90 @@ TEST(ConsistencyGraph, Full) {
   EXPECT_EQ(consistency_graph.GetNumBytes(), 48);
 }
 
+void ExpectEqualImageIdxs(const ConsistencyGraph& consistency_graph1,
+                          const ConsistencyGraph& consistency_graph2,
+                          const int width,
+                          const int height) {
+  std::vector<int> image_idxs1;
+  std::vector<int> image_idxs2;
+  for (int row = 0; row < height; ++row) {
+    for (int col = 0; col < width; ++col) {
+      consistency_graph1.GetImageIdxs(row, col, &image_idxs1);
+      consistency_graph2.GetImageIdxs(row, col, &image_idxs2);
+      EXPECT_EQ(image_idxs1, image_idxs2);
+    }
+  }
+}
+
+TEST(ConsistencyGraph, Packed) {
+  const std::vector<int> data = {
+      0, 0, 3, 5, 7, 33, 1, 0, 3, 5, 7, 33, 2, 1, 1, 100, 0, 1, 0};
+  const std::vector<int> src_image_idxs = {5, 7, 33, 100};
+  const ConsistencyGraph consistency_graph(3, 2, data);
+  const ConsistencyGraph packed_consistency_graph(
+      3, 2, data, src_image_idxs);
+  EXPECT_FALSE(consistency_graph.IsPacked());
+  EXPECT_TRUE(packed_consistency_graph.IsPacked());
+  EXPECT_EQ(packed_consistency_graph.SrcImageIdxs(), src_image_idxs);
+  EXPECT_EQ(packed_consistency_graph.NumMaskWords(), 1);
+  ExpectEqualImageIdxs(consistency_graph, packed_consistency_graph, 3, 2);
+
+  EXPECT_EQ(*packed_consistency_graph.GetImageMask(0, 0), 0b0111);
+  EXPECT_EQ(*packed_consistency_graph.GetImageMask(0, 1), 0b0111);
+  EXPECT_EQ(*packed_consistency_graph.GetImageMask(0, 2), 0);
+  EXPECT_EQ(*packed_consistency_graph.GetImageMask(1, 0), 0);
+  EXPECT_EQ(*packed_consistency_graph.GetImageMask(1, 2), 0b1000);
+
+  // Both rows are encoded as two runs.
+  EXPECT_EQ(packed_consistency_graph.GetNumBytes(),
+            4 * sizeof(int) + (3 + 4 + 4) * sizeof(uint32_t));
+}
+
+TEST(ConsistencyGraph, PackedManySourceImages) {
+  std::vector<int> src_image_idxs;
+  for (int i = 0; i < 70; ++i) {
+    src_image_idxs.push_back(2 * i);
+  }
+  const std::vector<int> data = {0, 0, 3, 0, 66, 138, 1, 1, 1, 64};
+  const ConsistencyGraph consistency_graph(2, 2, data);
+  const ConsistencyGraph packed_consistency_graph(
+      2, 2, data, src_image_idxs);
+  EXPECT_EQ(packed_consistency_graph.NumMaskWords(), 3);
+  ExpectEqualImageIdxs(consistency_graph, packed_consistency_graph, 2, 2);
+  const uint32_t* mask = packed_consistency_graph.GetImageMask(0, 0);
+  EXPECT_EQ(mask[0], 1u);
+  EXPECT_EQ(mask[1], 1u << 1);
+  EXPECT_EQ(mask[2], 1u << 5);
+}
+
+TEST(ConsistencyGraph, ReadWrite) {
+  const std::string test_dir = CreateTestDir();
+  const std::vector<int> data = {
+      0, 0, 3, 5, 7, 33, 1, 0, 3, 5, 7, 33, 2, 1, 1, 100, 0, 1, 0};
+  const ConsistencyGraph consistency_graph(3, 2, data);
+  const ConsistencyGraph packed_consistency_graph(
+      3, 2, data, {5, 7, 33, 100});
+
+  const std::string path = JoinPaths(test_dir, "consistency_graph.bin");
+  consistency_graph.Write(path);
+  ConsistencyGraph read_consistency_graph;
+  read_consistency_graph.Read(path);
+  EXPECT_FALSE(read_consistency_graph.IsPacked());
+  EXPECT_EQ(read_consistency_graph.GetNumBytes(),
+            consistency_graph.GetNumBytes());
+  ExpectEqualImageIdxs(consistency_graph, read_consistency_graph, 3, 2);
+
+  const std::string packed_path =
+      JoinPaths(test_dir, "packed_consistency_graph.bin");
+  packed_consistency_graph.Write(packed_path);
+  ConsistencyGraph read_packed_consistency_graph;
+  read_packed_consistency_graph.Read(packed_path);
+  EXPECT_TRUE(read_packed_consistency_graph.IsPacked());
+  EXPECT_EQ(read_packed_consistency_graph.GetNumBytes(),
+            packed_consistency_graph.GetNumBytes());
+  ExpectEqualImageIdxs(consistency_graph, read_packed_consistency_graph, 3, 2);
+}
+
 }  // namespace
 }  // namespace mvs
 }  // namespace colmap
@@ -31,6 +31,7 @@
 
 #include "colmap/util/eigen_alignment.h"
 #include "colmap/util/misc.h"
+#include "colmap/util/tracing.h"
 
 #include <Eigen/Geometry>
 
@@ -38,6 +39,26 @@ namespace colmap {
 namespace mvs {
 namespace internal {
 
+// Grid step in pixels of the virtual cameras of refractive images. The virtual
+// cameras vary smoothly, so that the interpolation error is negligible while
+// the maps only take a fraction of the memory of the depth maps.
+const size_t kVirtualCameraMapStep = 4;
+
+// Overlap of neighboring tiles as a fraction of the tile size. The points of
+// the pixels fused in a tile may extend into the neighboring tiles by this
+// overlap. It must be less than half the tile size, so that the extended tiles
+// with the same parity of their grid position are disjoint.
+const float kTileOverlap = 0.25f;
+
+// Percentiles of the sparse points used as the bounds of the tile grid, so
+// that a few outliers do not inflate the tiles.
+const float kTileGridMinPercentile = 0.01f;
+const float kTileGridMaxPercentile = 0.99f;
+
+// Number of overlapping images that are prefetched whenever the fusion moves
+// on to the next image.
+const int kNumPrefetchImages = 4;
+
 template <typename T>
 float Median(std::vector<T>* elems) {
   CHECK(!elems->empty());
@@ -93,8 +114,12 @@ void StereoFusionOptions::Print() const {
   PrintOption(max_depth_error);
   PrintOption(max_normal_error);
   PrintOption(check_num_images);
+  PrintOption(enable_refraction);
+  PrintOption(num_tiles);
   PrintOption(use_cache);
   PrintOption(cache_size);
+  PrintOption(block_size);
+  PrintOption(cache_images);
   const auto& bbox_min = bounding_box.first.transpose().eval();
   const auto& bbox_max = bounding_box.second.transpose().eval();
   PrintOption(bbox_min);
@@ -110,7 +135,9 @@ bool StereoFusionOptions::Check() const {
   CHECK_OPTION_GE(max_depth_error, 0);
   CHECK_OPTION_GE(max_normal_error, 0);
   CHECK_OPTION_GT(check_num_images, 0);
+  CHECK_OPTION_GE(num_tiles, 0);
   CHECK_OPTION_GT(cache_size, 0);
+  CHECK_OPTION_GE(block_size, 0);
   return true;
 }
 
@@ -160,9 +187,14 @@ void StereoFusion::Run() {
   workspace_options.max_image_size = options_.max_image_size;
   workspace_options.image_as_rgb = true;
   workspace_options.cache_size = options_.cache_size;
+  workspace_options.cache_images = options_.cache_images;
   workspace_options.workspace_path = workspace_path_;
   workspace_options.workspace_format = workspace_format_;
   workspace_options.input_type = input_type_;
+  // Only the tiles access the maps through views, see `FusionTile`.
+  if (options_.use_cache && options_.num_tiles > 0) {
+    workspace_options.block_size = options_.block_size;
+  }
 
   const auto image_names = ReadTextFileLines(JoinPaths(
       workspace_path_, workspace_options.stereo_folder, "fusion.cfg"));
@@ -175,6 +207,12 @@ void StereoFusion::Run() {
     num_threads = GetEffectiveNumThreads(options_.num_threads);
   }
 
+  // Tiles can be fused concurrently, also when using the cache, since the
+  // tiles keep the data they access alive.
+  if (options_.num_tiles > 0) {
+    num_threads = GetEffectiveNumThreads(options_.num_threads);
+  }
+
   if (IsStopped()) {
     GetTimer().PrintMinutes();
     return;
@@ -203,6 +241,23 @@ void StereoFusion::Run() {
   P_.resize(model.images.size());
   inv_P_.resize(model.images.size());
   inv_R_.resize(model.images.size());
+  virtual_camera_maps_.clear();
+  virtual_camera_maps_.resize(model.images.size());
+  cam_from_world_.resize(model.images.size());
+
+  if (workspace_options.block_size > 0) {
+    LOG(INFO) << "Writing blocked depth and normal maps...";
+    ThreadPool thread_pool(num_threads);
+    for (const auto& image_name : image_names) {
+      const int image_idx = model.GetImageIdx(image_name);
+      if (workspace_->HasDepthMap(image_idx) &&
+          workspace_->HasNormalMap(image_idx)) {
+        thread_pool.AddTask(
+            [this, image_idx]() { workspace_->WriteBlockedMaps(image_idx); });
+      }
+    }
+    thread_pool.Wait();
+  }
 
   for (const auto& image_name : image_names) {
     const int image_idx = model.GetImageIdx(image_name);
@@ -217,7 +272,8 @@ void StereoFusion::Run() {
     }
 
     const auto& image = model.images.at(image_idx);
-    const auto& depth_map = workspace_->GetDepthMap(image_idx);
+    // The view of blocked maps only reads the header of the depth map.
+    const auto depth_map = workspace_->GetDepthMapView(image_idx);
 
     used_images_.at(image_idx) = true;
 
@@ -246,75 +302,105 @@ void StereoFusion::Run() {
         Eigen::Map<const Eigen::Matrix<float, 3, 3, Eigen::RowMajor>>(
             image.GetR())
             .transpose();
+
+    if (options_.enable_refraction && image.IsRefractive()) {
+      Image depth_map_image = image;
+      depth_map_image.Rescale(bitmap_scales_.at(image_idx).first,
+                              bitmap_scales_.at(image_idx).second);
+      virtual_camera_maps_.at(image_idx) =
+          VirtualCameraMap(depth_map_image, internal::kVirtualCameraMapStep);
+      cam_from_world_.at(image_idx).leftCols<3>() =
+          Eigen::Map<const Eigen::Matrix<float, 3, 3, Eigen::RowMajor>>(
+              image.GetR());
+      cam_from_world_.at(image_idx).col(3) =
+          Eigen::Map<const Eigen::Vector3f>(image.GetT());
+    }
   }
 
-  LOG(INFO) << StringPrintf("Starting fusion with %d threads", num_threads);
-  ThreadPool thread_pool(num_threads);
+  if (IsDeterministicExecution() && options_.num_tiles == 0 &&
+      num_threads > 1) {
+    LOG(WARNING) << "The fused points depend on the scheduling of the threads, "
+                    "because only the tiled fusion is deterministic.";
+  }
 
-  // Using a row stride of 10 to avoid starting parallel processing in rows that
-  // are too close to each other which may lead to duplicated work, since nearby
-  // pixels are likely to get fused into the same point.
-  const int kRowStride = 10;
-  auto ProcessImageRows = [&, this](const int row_start,
-                                    const int height,
-                                    const int width,
-                                    const int image_idx,
-                                    const Mat<char>& fused_pixel_mask) {
-    const int row_end = std::min(height, row_start + kRowStride);
-    for (int row = row_start; row < row_end; ++row) {
-      for (int col = 0; col < width; ++col) {
-        if (fused_pixel_mask.Get(row, col) > 0) {
-          continue;
+  if (options_.num_tiles > 0) {
+    RunTiled(num_threads);
+  } else {
+    LOG(INFO) << StringPrintf("Starting fusion with %d threads", num_threads);
+    ThreadPool thread_pool(num_threads);
+
+    // Using a row stride of 10 to avoid starting parallel processing in rows
+    // that are too close to each other which may lead to duplicated work, since
+    // nearby pixels are likely to get fused into the same point.
+    const int kRowStride = 10;
+    auto ProcessImageRows = [&, this](const int row_start,
+                                      const int height,
+                                      const int width,
+                                      const int image_idx,
+                                      const Mat<char>& fused_pixel_mask) {
+      const int row_end = std::min(height, row_start + kRowStride);
+      for (int row = row_start; row < row_end; ++row) {
+        for (int col = 0; col < width; ++col) {
+          if (fused_pixel_mask.Get(row, col) > 0) {
+            continue;
+          }
+          const int thread_id = thread_pool.GetThreadIndex();
+          Fuse(thread_id, image_idx, row, col);
         }
-        const int thread_id = thread_pool.GetThreadIndex();
-        Fuse(thread_id, image_idx, row, col);
       }
-    }
-  };
+    };
+
+    size_t num_fused_images = 0;
+    for (int image_idx = 0; image_idx >= 0;
+         image_idx = internal::FindNextImage(
+             overlapping_images_, used_images_, fused_images_, image_idx)) {
+      if (IsStopped()) {
+        break;
+      }
 
-  size_t num_fused_images = 0;
-  size_t total_fused_points = 0;
-  for (int image_idx = 0; image_idx >= 0;
-       image_idx = internal::FindNextImage(
-           overlapping_images_, used_images_, fused_images_, image_idx)) {
-    if (IsStopped()) {
-      break;
-    }
+      Timer timer;
+      timer.Start();
 
-    Timer timer;
-    timer.Start();
+      LOG(INFO) << StringPrintf("Fusing image [%d/%d] with index %d",
+                                num_fused_images + 1,
+                                model.images.size(),
+                                image_idx)
+                << std::flush;
 
-    LOG(INFO) << StringPrintf("Fusing image [%d/%d] with index %d",
-                              num_fused_images + 1,
-                              model.images.size(),
-                              image_idx)
-              << std::flush;
+      PrefetchOverlappingImages(image_idx, used_images_, fused_images_);
 
-    const int width = depth_map_sizes_.at(image_idx).first;
-    const int height = depth_map_sizes_.at(image_idx).second;
-    const auto& fused_pixel_mask = fused_pixel_masks_.at(image_idx);
+      const int width = depth_map_sizes_.at(image_idx).first;
+      const int height = depth_map_sizes_.at(image_idx).second;
+      const auto& fused_pixel_mask = fused_pixel_masks_.at(image_idx);
 
-    for (int row_start = 0; row_start < height; row_start += kRowStride) {
-      thread_pool.AddTask(ProcessImageRows,
-                          row_start,
-                          height,
-                          width,
-                          image_idx,
-                          fused_pixel_mask);
-    }
-    thread_pool.Wait();
+      for (int row_start = 0; row_start < height; row_start += kRowStride) {
+        thread_pool.AddTask(ProcessImageRows,
+                            row_start,
+                            height,
+                            width,
+                            image_idx,
+                            fused_pixel_mask);
+      }
+      thread_pool.Wait();
 
-    num_fused_images += 1;
-    fused_images_.at(image_idx) = true;
+      num_fused_images += 1;
+      fused_images_.at(image_idx) = true;
 
-    total_fused_points = 0;
-    for (const auto& task_fused_points : task_fused_points_) {
-      total_fused_points += task_fused_points.size();
+      size_t num_fused_points = 0;
+      for (const auto& task_fused_points : task_fused_points_) {
+        num_fused_points += task_fused_points.size();
+      }
+      LOG(INFO) << StringPrintf(
+          " in %.3fs (%d points)", timer.ElapsedSeconds(), num_fused_points);
+      COLMAP_METRIC_COUNTER("Fused images", 1);
+      COLMAP_METRIC_GAUGE("Fused points", num_fused_points);
     }
-    LOG(INFO) << StringPrintf(
-        " in %.3fs (%d points)", timer.ElapsedSeconds(), total_fused_points);
   }
 
+  size_t total_fused_points = 0;
+  for (const auto& task_fused_points : task_fused_points_) {
+    total_fused_points += task_fused_points.size();
+  }
   fused_points_.reserve(total_fused_points);
   fused_points_visibility_.reserve(total_fused_points);
   for (size_t thread_id = 0; thread_id < task_fused_points_.size();
@@ -342,6 +428,121 @@ void StereoFusion::Run() {
   GetTimer().PrintMinutes();
 }
 
+void StereoFusion::RunTiled(const int num_threads) {
+  InitTileGrid();
+
+  const int num_tiles = tile_grid_size_.prod();
+  LOG(INFO) << StringPrintf(
+      "Starting tiled fusion with %d threads and %dx%dx%d tiles",
+      num_threads,
+      tile_grid_size_.x(),
+      tile_grid_size_.y(),
+      tile_grid_size_.z());
+
+  ThreadPool thread_pool(num_threads);
+
+  // Determine the tiles containing unfused pixels of each image and the
+  // bounding boxes of these pixels, so that the tiles only visit the pixels,
+  // and with blocked maps only read the blocks, of their regions.
+  std::vector<std::vector<std::pair<int, Eigen::AlignedBox2i>>>
+      image_tile_regions(used_images_.size());
+  auto FindImageTiles = [&, this](const int image_idx) {
+    const auto depth_map = workspace_->GetDepthMapView(image_idx);
+    const auto& fused_pixel_mask = fused_pixel_masks_.at(image_idx);
+    std::vector<Eigen::AlignedBox2i> regions(num_tiles);
+    for (size_t row = 0; row < depth_map.GetHeight(); ++row) {
+      for (size_t col = 0; col < depth_map.GetWidth(); ++col) {
+        const float depth = depth_map.Get(row, col);
+        if (depth <= 0.0f || fused_pixel_mask.Get(row, col) > 0) {
+          continue;
+        }
+        regions[GetTileIdx(BackProjectPixel(image_idx, row, col, depth))]
+            .extend(Eigen::Vector2i(col, row));
+      }
+    }
+    for (int tile_idx = 0; tile_idx < num_tiles; ++tile_idx) {
+      if (!regions[tile_idx].isEmpty()) {
+        image_tile_regions[image_idx].emplace_back(tile_idx,
+                                                   regions[tile_idx]);
+      }
+    }
+  };
+
+  for (size_t image_idx = 0; image_idx < used_images_.size(); ++image_idx) {
+    if (used_images_[image_idx]) {
+      thread_pool.AddTask(FindImageTiles, image_idx);
+    }
+  }
+  thread_pool.Wait();
+
+  std::vector<std::vector<int>> tile_image_idxs(num_tiles);
+  std::vector<std::unordered_map<int, Eigen::AlignedBox2i>> tile_image_regions(
+      num_tiles);
+  for (size_t image_idx = 0; image_idx < image_tile_regions.size();
+       ++image_idx) {
+    for (const auto& tile_region : image_tile_regions[image_idx]) {
+      tile_image_idxs[tile_region.first].push_back(image_idx);
+      tile_image_regions[tile_region.first].emplace(image_idx,
+                                                    tile_region.second);
+    }
+  }
+  image_tile_regions.clear();
+
+  task_fused_points_.clear();
+  task_fused_points_visibility_.clear();
+  task_fused_points_.resize(num_tiles);
+  task_fused_points_visibility_.resize(num_tiles);
+
+  // The tiles are fused in groups of tiles with the same parity of their grid
+  // position. The extended tiles of a group are disjoint, so that its tiles
+  // fuse disjoint sets of pixels and can be fused concurrently. The result is
+  // therefore independent of the number of threads.
+  const int kNumTileGroups = 8;
+  for (int group_idx = 0; group_idx < kNumTileGroups; ++group_idx) {
+    if (IsStopped()) {
+      break;
+    }
+
+    Timer timer;
+    timer.Start();
+
+    int num_group_tiles = 0;
+    for (int tile_idx = 0; tile_idx < num_tiles; ++tile_idx) {
+      const int i = tile_idx % tile_grid_size_.x();
+      const int j = (tile_idx / tile_grid_size_.x()) % tile_grid_size_.y();
+      const int k = tile_idx / (tile_grid_size_.x() * tile_grid_size_.y());
+      if ((i % 2) + 2 * (j % 2) + 4 * (k % 2) != group_idx ||
+          tile_image_idxs[tile_idx].empty()) {
+        continue;
+      }
+      thread_pool.AddTask(
+          [this, tile_idx, &tile_image_idxs, &tile_image_regions]() {
+            FuseTile(tile_idx,
+                     std::move(tile_image_idxs[tile_idx]),
+                     std::move(tile_image_regions[tile_idx]));
+          });
+      num_group_tiles += 1;
+    }
+    thread_pool.Wait();
+
+    if (num_group_tiles == 0) {
+      continue;
+    }
+
+    size_t num_fused_points = 0;
+    for (const auto& task_fused_points : task_fused_points_) {
+      num_fused_points += task_fused_points.size();
+    }
+    LOG(INFO) << StringPrintf(
+        "Fused tile group [%d/%d] with %d tiles in %.3fs (%d points)",
+        group_idx + 1,
+        kNumTileGroups,
+        num_group_tiles,
+        timer.ElapsedSeconds(),
+        num_fused_points);
+  }
+}
+
 void StereoFusion::InitFusedPixelMask(int image_idx,
                                       size_t width,
                                       size_t height) {
@@ -368,28 +569,110 @@ void StereoFusion::InitFusedPixelMask(int image_idx,
   }
 }
 
-void StereoFusion::Fuse(const int thread_id,
+void StereoFusion::InitTileGrid() {
+  const auto& points = workspace_->GetModel().points;
+  if (points.empty()) {
+    LOG(WARNING) << "Fusing a single tile, because the sparse model is empty.";
+    tile_grid_origin_.setZero();
+    tile_grid_size_.setOnes();
+    tile_size_ = 1.0f;
+    return;
+  }
+
+  Eigen::Vector3f min_bound;
+  Eigen::Vector3f max_bound;
+  std::vector<float> coords(points.size());
+  for (int d = 0; d < 3; ++d) {
+    for (size_t i = 0; i < points.size(); ++i) {
+      coords[i] = d == 0 ? points[i].x : (d == 1 ? points[i].y : points[i].z);
+    }
+    const size_t min_idx =
+        internal::kTileGridMinPercentile * (coords.size() - 1);
+    const size_t max_idx =
+        internal::kTileGridMaxPercentile * (coords.size() - 1);
+    std::nth_element(coords.begin(), coords.begin() + min_idx, coords.end());
+    min_bound(d) = coords[min_idx];
+    std::nth_element(coords.begin(), coords.begin() + max_idx, coords.end());
+    max_bound(d) = coords[max_idx];
+  }
+
+  const Eigen::Vector3f extent = max_bound - min_bound;
+  tile_grid_origin_ = min_bound;
+  tile_size_ = std::max(extent.maxCoeff() / options_.num_tiles,
+                        std::numeric_limits<float>::epsilon());
+  for (int d = 0; d < 3; ++d) {
+    tile_grid_size_(d) =
+        std::max(1, static_cast<int>(std::ceil(extent(d) / tile_size_)));
+  }
+}
+
+void StereoFusion::FuseTile(
+    const int tile_idx,
+    std::vector<int> image_idxs,
+    std::unordered_map<int, Eigen::AlignedBox2i> image_regions) {
+  FusionTile tile;
+  tile.grid_idx.x() = tile_idx % tile_grid_size_.x();
+  tile.grid_idx.y() = (tile_idx / tile_grid_size_.x()) % tile_grid_size_.y();
+  tile.grid_idx.z() = tile_idx / (tile_grid_size_.x() * tile_grid_size_.y());
+  tile.image_idxs = std::move(image_idxs);
+  tile.image_regions = std::move(image_regions);
+  tile.used_images.resize(used_images_.size(), false);
+  tile.fused_images.resize(used_images_.size(), false);
+  for (const int image_idx : tile.image_idxs) {
+    tile.used_images[image_idx] = true;
+  }
+
+  for (int image_idx = tile.image_idxs.front(); image_idx >= 0;
+       image_idx = internal::FindNextImage(overlapping_images_,
+                                           tile.used_images,
+                                           tile.fused_images,
+                                           image_idx)) {
+    if (IsStopped()) {
+      break;
+    }
+
+    PrefetchOverlappingImages(image_idx, tile.used_images, tile.fused_images);
+
+    // Only pixels whose points lie in the tile are reference pixels, the
+    // pixels in the overlap are left to the neighboring tiles. The mask of
+    // the other pixels may concurrently be written by the neighboring tiles,
+    // so it is only read for the pixels of this tile.
+    const auto& region = tile.image_regions.at(image_idx);
+    const auto& fused_pixel_mask = fused_pixel_masks_.at(image_idx);
+    for (int row = region.min().y(); row <= region.max().y(); ++row) {
+      for (int col = region.min().x(); col <= region.max().x(); ++col) {
+        const float depth = GetDepth(image_idx, row, col, &tile);
+        if (depth <= 0.0f ||
+            GetTileIdx(BackProjectPixel(image_idx, row, col, depth)) !=
+                tile_idx ||
+            fused_pixel_mask.Get(row, col) > 0) {
+          continue;
+        }
+        Fuse(tile_idx, image_idx, row, col, &tile);
+      }
+    }
+
+    tile.fused_images[image_idx] = true;
+  }
+}
+
+void StereoFusion::Fuse(const int task_idx,
                         const int image_idx,
                         const int row,
-                        const int col) {
+                        const int col,
+                        FusionTile* tile) {
   // Next points to fuse.
   std::vector<FusionData> fusion_queue;
   fusion_queue.emplace_back(image_idx, row, col, 0);
 
-  Eigen::Vector4f fused_ref_point = Eigen::Vector4f::Zero();
+  Eigen::Vector3f fused_ref_point = Eigen::Vector3f::Zero();
   Eigen::Vector3f fused_ref_normal = Eigen::Vector3f::Zero();
 
   // Points of different pixels of the currently point to be fused.
-  std::vector<float> fused_point_x;
-  std::vector<float> fused_point_y;
-  std::vector<float> fused_point_z;
-  std::vector<float> fused_point_nx;
-  std::vector<float> fused_point_ny;
-  std::vector<float> fused_point_nz;
-  std::vector<uint8_t> fused_point_r;
-  std::vector<uint8_t> fused_point_g;
-  std::vector<uint8_t> fused_point_b;
-  std::unordered_set<int> fused_point_visibility;
+  FusedPixels fused_pixels;
+
+  const auto& fused_images =
+      tile != nullptr ? tile->fused_images : fused_images_;
 
   while (!fusion_queue.empty()) {
     const auto data = fusion_queue.back();
@@ -400,17 +683,23 @@ void StereoFusion::Fuse(const int thread_id,
 
     fusion_queue.pop_back();
 
-    // Check if pixel already fused.
-    auto& fused_pixel_mask = fused_pixel_masks_.at(image_idx);
-    if (fused_pixel_mask.Get(row, col) > 0) {
+    const float depth = GetDepth(image_idx, row, col, tile);
+
+    // Pixels with negative depth are filtered.
+    if (depth <= 0.0f) {
       continue;
     }
 
-    const auto& depth_map = workspace_->GetDepthMap(image_idx);
-    const float depth = depth_map.Get(row, col);
+    // Determine 3D location of current depth value. In tiled fusion, the
+    // pixel is owned by the tile whose extended tile contains its point, so
+    // its mask entry must not be accessed by any other tile.
+    const Eigen::Vector3f xyz = BackProjectPixel(image_idx, row, col, depth);
+    if (tile != nullptr && !IsInExtendedTile(*tile, xyz)) {
+      continue;
+    }
 
-    // Pixels with negative depth are filtered.
-    if (depth <= 0.0f) {
+    // Check if pixel already fused.
+    if (fused_pixel_masks_.at(image_idx).Get(row, col) > 0) {
       continue;
     }
 
@@ -418,7 +707,10 @@ void StereoFusion::Fuse(const int thread_id,
     // pixel has already been added and we need to check for consistency.
     if (traversal_depth > 0) {
       // Project reference point into current view.
-      const Eigen::Vector3f proj = P_.at(image_idx) * fused_ref_point;
+      Eigen::Vector3f proj;
+      if (!ProjectPoint(image_idx, fused_ref_point, &proj)) {
+        continue;
+      }
 
       // Depth error of reference depth with current depth.
       const float depth_error = std::abs((proj(2) - depth) / depth);
@@ -427,8 +719,8 @@ void StereoFusion::Fuse(const int thread_id,
       }
 
       // Reprojection error reference point in the current view.
-      const float col_diff = proj(0) / proj(2) - col;
-      const float row_diff = proj(1) / proj(2) - row;
+      const float col_diff = proj(0) - col;
+      const float row_diff = proj(1) - row;
       const float squared_reproj_error =
           col_diff * col_diff + row_diff * row_diff;
       if (squared_reproj_error > max_squared_reproj_error_) {
@@ -437,11 +729,8 @@ void StereoFusion::Fuse(const int thread_id,
     }
 
     // Determine normal direction in global reference frame.
-    const auto& normal_map = workspace_->GetNormalMap(image_idx);
     const Eigen::Vector3f normal =
-        inv_R_.at(image_idx) * Eigen::Vector3f(normal_map.Get(row, col, 0),
-                                               normal_map.Get(row, col, 1),
-                                               normal_map.Get(row, col, 2));
+        inv_R_.at(image_idx) * GetNormal(image_idx, row, col, tile);
 
     // Check for consistent normal direction with reference normal.
     if (traversal_depth > 0) {
@@ -451,49 +740,19 @@ void StereoFusion::Fuse(const int thread_id,
       }
     }
 
-    // Determine 3D location of current depth value.
-    const Eigen::Vector3f xyz =
-        inv_P_.at(image_idx) *
-        Eigen::Vector4f(col * depth, row * depth, depth, 1.0f);
-
-    // Read the color of the pixel.
-    BitmapColor<uint8_t> color;
-    const auto& bitmap_scale = bitmap_scales_.at(image_idx);
-    workspace_->GetBitmap(image_idx).InterpolateNearestNeighbor(
-        col / bitmap_scale.first, row / bitmap_scale.second, &color);
-
-    // Set the current pixel as visited.
-    fused_pixel_mask.Set(row, col, 1);
-
-    // Pixels out of bounds are filtered
-    if (xyz(0) < options_.bounding_box.first(0) ||
-        xyz(1) < options_.bounding_box.first(1) ||
-        xyz(2) < options_.bounding_box.first(2) ||
-        xyz(0) > options_.bounding_box.second(0) ||
-        xyz(1) > options_.bounding_box.second(1) ||
-        xyz(2) > options_.bounding_box.second(2)) {
+    // Accumulate statistics for fused point.
+    if (!FusePixel(image_idx, row, col, xyz, normal, tile, &fused_pixels)) {
       continue;
     }
 
-    // Accumulate statistics for fused point.
-    fused_point_x.push_back(xyz(0));
-    fused_point_y.push_back(xyz(1));
-    fused_point_z.push_back(xyz(2));
-    fused_point_nx.push_back(normal(0));
-    fused_point_ny.push_back(normal(1));
-    fused_point_nz.push_back(normal(2));
-    fused_point_r.push_back(color.r);
-    fused_point_g.push_back(color.g);
-    fused_point_b.push_back(color.b);
-    fused_point_visibility.insert(image_idx);
-
     // Remember the first pixel as the reference.
     if (traversal_depth == 0) {
-      fused_ref_point = Eigen::Vector4f(xyz(0), xyz(1), xyz(2), 1.0f);
+      fused_ref_point = xyz;
       fused_ref_normal = normal;
     }
 
-    if (fused_point_x.size() >= static_cast<size_t>(options_.max_num_pixels)) {
+    if (fused_pixels.x.size() >=
+        static_cast<size_t>(options_.max_num_pixels)) {
       break;
     }
 
@@ -503,16 +762,16 @@ void StereoFusion::Fuse(const int thread_id,
 
     for (const auto next_image_idx : overlapping_images_.at(image_idx)) {
       if (!used_images_.at(next_image_idx) ||
-          fused_images_.at(next_image_idx)) {
+          fused_images.at(next_image_idx)) {
         continue;
       }
 
-      const Eigen::Vector3f next_proj =
-          P_.at(next_image_idx) * xyz.homogeneous();
-      const int next_col =
-          static_cast<int>(std::round(next_proj(0) / next_proj(2)));
-      const int next_row =
-          static_cast<int>(std::round(next_proj(1) / next_proj(2)));
+      Eigen::Vector3f next_proj;
+      if (!ProjectPoint(next_image_idx, xyz, &next_proj)) {
+        continue;
+      }
+      const int next_col = static_cast<int>(std::round(next_proj(0)));
+      const int next_row = static_cast<int>(std::round(next_proj(1)));
 
       const auto& depth_map_size = depth_map_sizes_.at(next_image_idx);
       if (next_col < 0 || next_row < 0 || next_col >= depth_map_size.first ||
@@ -524,38 +783,213 @@ void StereoFusion::Fuse(const int thread_id,
     }
   }
 
-  const size_t num_pixels = fused_point_x.size();
-  if (num_pixels >= static_cast<size_t>(options_.min_num_pixels)) {
-    PlyPoint fused_point;
+  AddFusedPoint(task_idx, &fused_pixels);
+}
+
+bool StereoFusion::FusePixel(const int image_idx,
+                             const int row,
+                             const int col,
+                             const Eigen::Vector3f& xyz,
+                             const Eigen::Vector3f& normal,
+                             FusionTile* tile,
+                             FusedPixels* pixels) {
+  // Read the color of the pixel.
+  BitmapColor<uint8_t> color;
+  const auto& bitmap_scale = bitmap_scales_.at(image_idx);
+  GetBitmap(image_idx, tile).InterpolateNearestNeighbor(
+      col / bitmap_scale.first, row / bitmap_scale.second, &color);
+
+  // Set the current pixel as visited.
+  fused_pixel_masks_.at(image_idx).Set(row, col, 1);
+
+  // Pixels out of bounds are filtered
+  if (xyz(0) < options_.bounding_box.first(0) ||
+      xyz(1) < options_.bounding_box.first(1) ||
+      xyz(2) < options_.bounding_box.first(2) ||
+      xyz(0) > options_.bounding_box.second(0) ||
+      xyz(1) > options_.bounding_box.second(1) ||
+      xyz(2) > options_.bounding_box.second(2)) {
+    return false;
+  }
+
+  pixels->x.push_back(xyz(0));
+  pixels->y.push_back(xyz(1));
+  pixels->z.push_back(xyz(2));
+  pixels->nx.push_back(normal(0));
+  pixels->ny.push_back(normal(1));
+  pixels->nz.push_back(normal(2));
+  pixels->r.push_back(color.r);
+  pixels->g.push_back(color.g);
+  pixels->b.push_back(color.b);
+  pixels->visibility.insert(image_idx);
+  return true;
+}
 
-    Eigen::Vector3f fused_normal;
-    fused_normal.x() = internal::Median(&fused_point_nx);
-    fused_normal.y() = internal::Median(&fused_point_ny);
-    fused_normal.z() = internal::Median(&fused_point_nz);
-    const float fused_normal_norm = fused_normal.norm();
-    if (fused_normal_norm < std::numeric_limits<float>::epsilon()) {
-      return;
+void StereoFusion::AddFusedPoint(const int task_idx, FusedPixels* pixels) {
+  const size_t num_pixels = pixels->x.size();
+  if (num_pixels == 0 ||
+      num_pixels < static_cast<size_t>(options_.min_num_pixels)) {
+    return;
+  }
+
+  PlyPoint fused_point;
+
+  Eigen::Vector3f fused_normal;
+  fused_normal.x() = internal::Median(&pixels->nx);
+  fused_normal.y() = internal::Median(&pixels->ny);
+  fused_normal.z() = internal::Median(&pixels->nz);
+  const float fused_normal_norm = fused_normal.norm();
+  if (fused_normal_norm < std::numeric_limits<float>::epsilon()) {
+    return;
+  }
+
+  fused_point.x = internal::Median(&pixels->x);
+  fused_point.y = internal::Median(&pixels->y);
+  fused_point.z = internal::Median(&pixels->z);
+
+  fused_point.nx = fused_normal.x() / fused_normal_norm;
+  fused_point.ny = fused_normal.y() / fused_normal_norm;
+  fused_point.nz = fused_normal.z() / fused_normal_norm;
+
+  fused_point.r =
+      TruncateCast<float, uint8_t>(std::round(internal::Median(&pixels->r)));
+  fused_point.g =
+      TruncateCast<float, uint8_t>(std::round(internal::Median(&pixels->g)));
+  fused_point.b =
+      TruncateCast<float, uint8_t>(std::round(internal::Median(&pixels->b)));
+
+  task_fused_points_[task_idx].push_back(fused_point);
+  task_fused_points_visibility_[task_idx].emplace_back(
+      pixels->visibility.begin(), pixels->visibility.end());
+}
+
+const Bitmap& StereoFusion::GetBitmap(const int image_idx, FusionTile* tile) {
+  if (tile == nullptr) {
+    return workspace_->GetBitmap(image_idx);
+  }
+  auto& bitmap = tile->bitmaps[image_idx];
+  if (!bitmap) {
+    bitmap = workspace_->GetBitmapPtr(image_idx);
+  }
+  return *bitmap;
+}
+
+float StereoFusion::GetDepth(const int image_idx,
+                             const int row,
+                             const int col,
+                             FusionTile* tile) {
+  if (tile == nullptr) {
+    return workspace_->GetDepthMap(image_idx).Get(row, col);
+  }
+  auto depth_map = tile->depth_maps.find(image_idx);
+  if (depth_map == tile->depth_maps.end()) {
+    depth_map = tile->depth_maps
+                    .emplace(image_idx, workspace_->GetDepthMapView(image_idx))
+                    .first;
+  }
+  return depth_map->second.Get(row, col);
+}
+
+Eigen::Vector3f StereoFusion::GetNormal(const int image_idx,
+                                        const int row,
+                                        const int col,
+                                        FusionTile* tile) {
+  if (tile == nullptr) {
+    const auto& normal_map = workspace_->GetNormalMap(image_idx);
+    return Eigen::Vector3f(normal_map.Get(row, col, 0),
+                           normal_map.Get(row, col, 1),
+                           normal_map.Get(row, col, 2));
+  }
+  auto normal_map = tile->normal_maps.find(image_idx);
+  if (normal_map == tile->normal_maps.end()) {
+    normal_map =
+        tile->normal_maps
+            .emplace(image_idx, workspace_->GetNormalMapView(image_idx))
+            .first;
+  }
+  return Eigen::Vector3f(normal_map->second.Get(row, col, 0),
+                         normal_map->second.Get(row, col, 1),
+                         normal_map->second.Get(row, col, 2));
+}
+
+void StereoFusion::PrefetchOverlappingImages(
+    const int image_idx,
+    const std::vector<char>& used_images,
+    const std::vector<char>& fused_images) {
+  std::vector<int> prefetch_image_idxs;
+  for (const int overlapping_image_idx : overlapping_images_.at(image_idx)) {
+    if (prefetch_image_idxs.size() >=
+        static_cast<size_t>(internal::kNumPrefetchImages)) {
+      break;
     }
+    if (used_images.at(overlapping_image_idx) &&
+        !fused_images.at(overlapping_image_idx)) {
+      prefetch_image_idxs.push_back(overlapping_image_idx);
+    }
+  }
+  workspace_->Prefetch(prefetch_image_idxs);
+}
+
+int StereoFusion::GetTileIdx(const Eigen::Vector3f& xyz) const {
+  const Eigen::Vector3f grid_coord = (xyz - tile_grid_origin_) / tile_size_;
+  Eigen::Vector3i grid_idx;
+  for (int d = 0; d < 3; ++d) {
+    // Clamp before the conversion to avoid overflows for distant points.
+    grid_idx(d) = static_cast<int>(std::floor(std::min(
+        std::max(grid_coord(d), 0.0f), tile_grid_size_(d) - 1.0f)));
+  }
+  return (grid_idx.z() * tile_grid_size_.y() + grid_idx.y()) *
+             tile_grid_size_.x() +
+         grid_idx.x();
+}
 
-    fused_point.x = internal::Median(&fused_point_x);
-    fused_point.y = internal::Median(&fused_point_y);
-    fused_point.z = internal::Median(&fused_point_z);
+bool StereoFusion::IsInExtendedTile(const FusionTile& tile,
+                                    const Eigen::Vector3f& xyz) const {
+  // The tiles at the border of the grid extend to infinity.
+  const Eigen::Vector3f grid_coord = (xyz - tile_grid_origin_) / tile_size_;
+  for (int d = 0; d < 3; ++d) {
+    const int grid_idx = tile.grid_idx(d);
+    if ((grid_idx > 0 && grid_coord(d) < grid_idx - internal::kTileOverlap) ||
+        (grid_idx < tile_grid_size_(d) - 1 &&
+         grid_coord(d) >= grid_idx + 1 + internal::kTileOverlap)) {
+      return false;
+    }
+  }
+  return true;
+}
 
-    fused_point.nx = fused_normal.x() / fused_normal_norm;
-    fused_point.ny = fused_normal.y() / fused_normal_norm;
-    fused_point.nz = fused_normal.z() / fused_normal_norm;
+bool StereoFusion::ProjectPoint(const int image_idx,
+                                const Eigen::Vector3f& xyz,
+                                Eigen::Vector3f* proj) const {
+  const auto& virtual_camera_map = virtual_camera_maps_[image_idx];
+  if (virtual_camera_map.IsEmpty()) {
+    *proj = P_[image_idx] * xyz.homogeneous();
+    proj->head<2>() /= proj->z();
+    return true;
+  }
 
-    fused_point.r = TruncateCast<float, uint8_t>(
-        std::round(internal::Median(&fused_point_r)));
-    fused_point.g = TruncateCast<float, uint8_t>(
-        std::round(internal::Median(&fused_point_g)));
-    fused_point.b = TruncateCast<float, uint8_t>(
-        std::round(internal::Median(&fused_point_b)));
+  const Eigen::Vector3f point = cam_from_world_[image_idx] * xyz.homogeneous();
+  Eigen::Vector2f xy;
+  if (!virtual_camera_map.ImgFromCam(point, &xy)) {
+    return false;
+  }
+  *proj = Eigen::Vector3f(xy.x(), xy.y(), point.z());
+  return true;
+}
 
-    task_fused_points_[thread_id].push_back(fused_point);
-    task_fused_points_visibility_[thread_id].emplace_back(
-        fused_point_visibility.begin(), fused_point_visibility.end());
+Eigen::Vector3f StereoFusion::BackProjectPixel(const int image_idx,
+                                               const int row,
+                                               const int col,
+                                               const float depth) const {
+  const auto& virtual_camera_map = virtual_camera_maps_[image_idx];
+  if (virtual_camera_map.IsEmpty()) {
+    return inv_P_[image_idx] *
+           Eigen::Vector4f(col * depth, row * depth, depth, 1.0f);
   }
+
+  const Eigen::Vector3f point =
+      virtual_camera_map.CamFromImgPoint(col, row, depth);
+  return inv_R_[image_idx] * (point - cam_from_world_[image_idx].col(3));
 }
 
 void WritePointsVisibility(
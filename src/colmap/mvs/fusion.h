@@ -30,11 +30,13 @@
 #pragma once
 
 #include "colmap/math/math.h"
+#include "colmap/mvs/blocked_mat.h"
 #include "colmap/mvs/depth_map.h"
 #include "colmap/mvs/image.h"
 #include "colmap/mvs/mat.h"
 #include "colmap/mvs/model.h"
 #include "colmap/mvs/normal_map.h"
+#include "colmap/mvs/virtual_camera_map.h"
 #include "colmap/mvs/workspace.h"
 #include "colmap/util/cache.h"
 #include "colmap/util/eigen_alignment.h"
@@ -42,10 +44,13 @@
 #include "colmap/util/threading.h"
 
 #include <cfloat>
+#include <memory>
+#include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
 #include <Eigen/Core>
+#include <Eigen/Geometry>
 
 namespace colmap {
 namespace mvs {
@@ -81,6 +86,20 @@ struct StereoFusionOptions {
   // Number of overlapping images to transitively check for fusing points.
   int check_num_images = 50;
 
+  // Whether to fuse the depth maps of refractive PatchMatch stereo. Pixels of
+  // refractive images are back-projected along their refracted viewing rays
+  // and the depth is the z-coordinate of the point in the camera frame.
+  bool enable_refraction = false;
+
+  // Number of tiles along the longest axis of the bounding box of the sparse
+  // model for spatially partitioned fusion, where the other axes are split
+  // into tiles of the same size. Non-adjacent tiles are fused concurrently,
+  // also when using the cache, and the result does not depend on the number
+  // of threads. If zero, the images are fused one after the other, where the
+  // rows of an image are fused concurrently, such that the result depends on
+  // the scheduling of the threads even in deterministic execution.
+  int num_tiles = 0;
+
   // Flag indicating whether to use LRU cache or pre-load all data
   bool use_cache = false;
 
@@ -91,6 +110,17 @@ struct StereoFusionOptions {
   // consume a lot of memory, if the consistency graph is dense.
   double cache_size = 32.0;
 
+  // Block size in pixels of the blocked copies of the depth and normal maps,
+  // which are written next to the maps before the tiled fusion with the cache.
+  // The tiles then only read and cache the blocks of the pixels they visit,
+  // which reduces the memory footprint for wide neighborhoods of images. If
+  // zero, the full maps are read.
+  int block_size = 0;
+
+  // Whether to cache the rescaled images in a raw format in the workspace, so
+  // that later runs skip decoding them, see `Workspace::Options`.
+  bool cache_images = false;
+
   std::pair<Eigen::Vector3f, Eigen::Vector3f> bounding_box =
       std::make_pair(Eigen::Vector3f(-FLT_MAX, -FLT_MAX, -FLT_MAX),
                      Eigen::Vector3f(FLT_MAX, FLT_MAX, FLT_MAX));
@@ -114,9 +144,99 @@ class StereoFusion : public Thread {
   const std::vector<std::vector<int>>& GetFusedPointsVisibility() const;
 
  private:
+  // Spatial tile of the tiled fusion and the state of its fusion, which is
+  // separate from the other tiles except for the fused pixel masks.
+  struct FusionTile {
+    // Position of the tile in the tile grid.
+    Eigen::Vector3i grid_idx = Eigen::Vector3i::Zero();
+    // Images with unfused pixels in the tile, sorted by index, and the images
+    // whose pixels in the tile have been fused.
+    std::vector<int> image_idxs;
+    // Bounding boxes of the pixels of the images whose points lie in the tile.
+    std::unordered_map<int, Eigen::AlignedBox2i> image_regions;
+    std::vector<char> used_images;
+    std::vector<char> fused_images;
+    // The workspace data of the visited images is kept alive, even if it is
+    // evicted from the cache by other tiles in the meantime.
+    std::unordered_map<int, std::shared_ptr<const Bitmap>> bitmaps;
+    std::unordered_map<int, BlockedMatView<float>> depth_maps;
+    std::unordered_map<int, BlockedMatView<float>> normal_maps;
+  };
+
+  // The pixels fused into a point.
+  struct FusedPixels {
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<float> z;
+    std::vector<float> nx;
+    std::vector<float> ny;
+    std::vector<float> nz;
+    std::vector<uint8_t> r;
+    std::vector<uint8_t> g;
+    std::vector<uint8_t> b;
+    std::unordered_set<int> visibility;
+  };
+
   void Run();
+  void RunTiled(int num_threads);
   void InitFusedPixelMask(int image_idx, size_t width, size_t height);
-  void Fuse(int thread_id, int image_idx, int row, int col);
+  void InitTileGrid();
+  void FuseTile(int tile_idx,
+                std::vector<int> image_idxs,
+                std::unordered_map<int, Eigen::AlignedBox2i> image_regions);
+  // Fuse the pixel into a point, which is added to the fused points of the
+  // task, i.e., the thread or the tile. In tiled fusion, only pixels whose
+  // points lie in the tile extended by its overlap are fused.
+  void Fuse(int task_idx,
+            int image_idx,
+            int row,
+            int col,
+            FusionTile* tile = nullptr);
+
+  // Mark the pixel with the given point and normal as fused and add it to the
+  // fused pixels, unless its point lies outside of the bounding box. Returns
+  // whether the pixel was added.
+  bool FusePixel(int image_idx,
+                 int row,
+                 int col,
+                 const Eigen::Vector3f& xyz,
+                 const Eigen::Vector3f& normal,
+                 FusionTile* tile,
+                 FusedPixels* pixels);
+  // Add the point of the fused pixels to the fused points of the task, if
+  // there are enough pixels.
+  void AddFusedPoint(int task_idx, FusedPixels* pixels);
+
+  // Access the workspace data through the tile, if given.
+  const Bitmap& GetBitmap(int image_idx, FusionTile* tile);
+  float GetDepth(int image_idx, int row, int col, FusionTile* tile);
+  Eigen::Vector3f GetNormal(int image_idx, int row, int col, FusionTile* tile);
+
+  // Asynchronously read the first unfused overlapping images of the image
+  // into the workspace cache.
+  void PrefetchOverlappingImages(int image_idx,
+                                 const std::vector<char>& used_images,
+                                 const std::vector<char>& fused_images);
+
+  // Index of the tile that contains the point. Points outside of the tile grid
+  // belong to the closest tile.
+  int GetTileIdx(const Eigen::Vector3f& xyz) const;
+  // Check whether the point lies in the tile extended by its overlap.
+  bool IsInExtendedTile(const FusionTile& tile,
+                        const Eigen::Vector3f& xyz) const;
+
+  // Project the point into the depth map of the image, where the last
+  // component of `proj` is the depth of the point. Returns false if the
+  // refractive projection fails.
+  bool ProjectPoint(int image_idx,
+                    const Eigen::Vector3f& xyz,
+                    Eigen::Vector3f* proj) const;
+
+  // Back-project the pixel of the depth map with the given depth.
+  Eigen::Vector3f BackProjectPixel(int image_idx,
+                                   int row,
+                                   int col,
+                                   float depth) const;
 
   const StereoFusionOptions options_;
   const std::string workspace_path_;
@@ -131,13 +251,25 @@ class StereoFusion : public Thread {
   std::vector<char> fused_images_;
   std::vector<std::vector<int>> overlapping_images_;
   // Contains image masks of pre-masked and already fused pixels.
-  // Initialized from image masks if provided in StereoFusionOptions.
+  // Initialized from image masks if provided in StereoFusionOptions. In tiled
+  // fusion, the entry of a pixel is only read and written by the tile whose
+  // extended tile contains the point of the pixel. The extended tiles fused
+  // concurrently are disjoint, so that the tiles access disjoint entries.
   std::vector<Mat<char>> fused_pixel_masks_;
   std::vector<std::pair<int, int>> depth_map_sizes_;
   std::vector<std::pair<float, float>> bitmap_scales_;
   std::vector<Eigen::Matrix<float, 3, 4, Eigen::RowMajor>> P_;
   std::vector<Eigen::Matrix<float, 3, 4, Eigen::RowMajor>> inv_P_;
   std::vector<Eigen::Matrix<float, 3, 3, Eigen::RowMajor>> inv_R_;
+  // Virtual cameras at the resolution of the depth maps and the world to
+  // camera transformations, only set for refractive images.
+  std::vector<VirtualCameraMap> virtual_camera_maps_;
+  std::vector<Eigen::Matrix<float, 3, 4, Eigen::RowMajor>> cam_from_world_;
+
+  // Regular grid of cubic tiles over the bounding box of the sparse model.
+  Eigen::Vector3f tile_grid_origin_ = Eigen::Vector3f::Zero();
+  Eigen::Vector3i tile_grid_size_ = Eigen::Vector3i::Ones();
+  float tile_size_ = 0;
 
   struct FusionData {
     int image_idx = kInvalidImageId;
@@ -158,6 +290,7 @@ class StereoFusion : public Thread {
   std::vector<PlyPoint> fused_points_;
   std::vector<std::vector<int>> fused_points_visibility_;
 
+  // Fused points of each thread or, in tiled fusion, of each tile.
   std::vector<std::vector<PlyPoint>> task_fused_points_;
   std::vector<std::vector<std::vector<int>>> task_fused_points_visibility_;
 };
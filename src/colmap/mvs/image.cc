@@ -29,6 +29,7 @@
 
 #include "colmap/mvs/image.h"
 
+#include "colmap/scene/camera.h"
 #include "colmap/scene/projection.h"
 #include "colmap/util/eigen_alignment.h"
 #include "colmap/util/logging.h"
@@ -60,6 +61,155 @@ void Image::SetBitmap(const Bitmap& bitmap) {
   CHECK_EQ(height_, bitmap_.Height());
 }
 
+void Image::SetRefracCamera(const Camera& camera) {
+  CHECK(camera.IsCameraRefractive());
+  CHECK_EQ(camera.width, width_);
+  CHECK_EQ(camera.height, height_);
+  refrac_camera_ = std::make_shared<const Camera>(camera);
+}
+
+void Image::ComputeVirtualCameras(const size_t step,
+                                  std::vector<float>* data,
+                                  size_t* grid_width,
+                                  size_t* grid_height) const {
+  CHECK_GT(step, 0);
+  CHECK_GT(width_, 0);
+  CHECK_GT(height_, 0);
+  CHECK_NOTNULL(data);
+  CHECK_NOTNULL(grid_width);
+  CHECK_NOTNULL(grid_height);
+
+  *grid_width = (width_ + step - 2) / step + 1;
+  *grid_height = (height_ + step - 2) / step + 1;
+  const size_t num_grid_points = *grid_width * *grid_height;
+  data->resize(kNumVirtualCameraParams * num_grid_points);
+
+  std::vector<Eigen::Vector2d> points2D(*grid_width);
+  for (size_t c = 0; c < *grid_width; ++c) {
+    points2D[c].x() = c * step;
+  }
+
+  VirtualPinholeCameras virtual_cameras;
+  virtual_cameras.Resize(*grid_width);
+
+  for (size_t r = 0; r < *grid_height; ++r) {
+    const double y = r * step;
+    for (auto& point2D : points2D) {
+      point2D.y() = y;
+    }
+
+    if (refrac_camera_ != nullptr) {
+      // Centers are not set for rays without an intersection with the
+      // refraction axis, i.e. rays parallel to the axis.
+      std::fill(virtual_cameras.centers.begin(),
+                virtual_cameras.centers.end(),
+                Eigen::Vector3d::Zero());
+      refrac_camera_->ComputeVirtuals(points2D, &virtual_cameras);
+    }
+
+    for (size_t c = 0; c < *grid_width; ++c) {
+      Eigen::Vector2d ray;
+      Eigen::Vector3d center;
+      if (refrac_camera_ != nullptr) {
+        ray = virtual_cameras.CamFromImg(c, points2D[c]);
+        center = virtual_cameras.centers[c];
+      } else {
+        ray.x() = (points2D[c].x() - K_[2]) / K_[0];
+        ray.y() = (points2D[c].y() - K_[5]) / K_[4];
+        center.setZero();
+      }
+
+      float* grid_data = data->data() + r * *grid_width + c;
+      grid_data[0 * num_grid_points] = ray.x();
+      grid_data[1 * num_grid_points] = ray.y();
+      grid_data[2 * num_grid_points] = center.x();
+      grid_data[3 * num_grid_points] = center.y();
+      grid_data[4 * num_grid_points] = center.z();
+    }
+  }
+}
+
+bool Image::ProjectPoint(const float X[3],
+                         const bool enable_refraction,
+                         float* col,
+                         float* row,
+                         float* depth) const {
+  const Eigen::Map<const Eigen::Matrix<float, 3, 3, Eigen::RowMajor>> R(R_);
+  const Eigen::Vector3f cam_point =
+      R * Eigen::Map<const Eigen::Vector3f>(X) +
+      Eigen::Map<const Eigen::Vector3f>(T_);
+  if (cam_point.z() <= 0) {
+    return false;
+  }
+
+  if (enable_refraction && refrac_camera_ != nullptr) {
+    const Eigen::Vector2d image_point =
+        refrac_camera_->ImgFromCamRefrac(cam_point.cast<double>());
+    if (!image_point.allFinite()) {
+      return false;
+    }
+    *col = image_point.x();
+    *row = image_point.y();
+  } else {
+    const Eigen::Map<const Eigen::Matrix<float, 3, 3, Eigen::RowMajor>> K(K_);
+    const Eigen::Vector3f image_point = K * cam_point;
+    *col = image_point.x() / image_point.z();
+    *row = image_point.y() / image_point.z();
+  }
+
+  *depth = cam_point.z();
+  return true;
+}
+
+void Image::BackprojectPoint(const float col,
+                             const float row,
+                             const float depth,
+                             const bool enable_refraction,
+                             float X[3]) const {
+  Eigen::Vector3f cam_point;
+  if (enable_refraction && refrac_camera_ != nullptr) {
+    const Ray3D ray =
+        refrac_camera_->CamFromImgRefrac(Eigen::Vector2d(col, row));
+    cam_point = ray.At((depth - ray.ori.z()) / ray.dir.z()).cast<float>();
+  } else {
+    cam_point = Eigen::Vector3f(
+        depth * (col - K_[2]) / K_[0], depth * (row - K_[5]) / K_[4], depth);
+  }
+
+  const Eigen::Map<const Eigen::Matrix<float, 3, 3, Eigen::RowMajor>> R(R_);
+  Eigen::Map<Eigen::Vector3f> X_m(X);
+  X_m = R.transpose() * (cam_point - Eigen::Map<const Eigen::Vector3f>(T_));
+}
+
+Image Image::Crop(const size_t col,
+                  const size_t row,
+                  const size_t width,
+                  const size_t height) const {
+  CHECK_LE(col + width, width_);
+  CHECK_LE(row + height, height_);
+
+  float K[9];
+  memcpy(K, K_, 9 * sizeof(float));
+  K[2] -= col;
+  K[5] -= row;
+  Image cropped(path_, width, height, K, R_, T_);
+
+  if (bitmap_.Data() != nullptr) {
+    cropped.bitmap_ = bitmap_.Crop(col, row, width, height);
+  }
+
+  if (refrac_camera_ != nullptr) {
+    auto refrac_camera = std::make_shared<Camera>(*refrac_camera_);
+    refrac_camera->width = width;
+    refrac_camera->height = height;
+    refrac_camera->SetPrincipalPointX(refrac_camera->PrincipalPointX() - col);
+    refrac_camera->SetPrincipalPointY(refrac_camera->PrincipalPointY() - row);
+    cropped.refrac_camera_ = std::move(refrac_camera);
+  }
+
+  return cropped;
+}
+
 void Image::Rescale(const float factor) { Rescale(factor, factor); }
 
 void Image::Rescale(const float factor_x, const float factor_y) {
@@ -79,6 +229,12 @@ void Image::Rescale(const float factor_x, const float factor_y) {
   ComposeProjectionMatrix(K_, R_, T_, P_);
   ComposeInverseProjectionMatrix(K_, R_, T_, inv_P_);
 
+  if (refrac_camera_ != nullptr) {
+    auto refrac_camera = std::make_shared<Camera>(*refrac_camera_);
+    refrac_camera->Rescale(new_width, new_height);
+    refrac_camera_ = std::move(refrac_camera);
+  }
+
   width_ = new_width;
   height_ = new_height;
 }
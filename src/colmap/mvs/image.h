@@ -33,12 +33,18 @@
 
 #include <cstdint>
 #include <fstream>
+#include <memory>
 #include <set>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
 namespace colmap {
+
+// Note that this header is included by Cuda code and must therefore not
+// include the camera header and its Eigen dependencies.
+class Camera;
+
 namespace mvs {
 
 class Image {
@@ -65,6 +71,49 @@ class Image {
   inline const float* GetInvP() const;
   inline const float* GetViewingDirection() const;
 
+  // Set the refractive camera of the image. The camera must have the same
+  // dimensions as the image and it is rescaled together with the image.
+  void SetRefracCamera(const Camera& camera);
+  inline bool IsRefractive() const;
+
+  // Compute the per-pixel virtual pinhole cameras of the image on a regular
+  // grid with the given step in pixels. The grid point (i, j) corresponds to
+  // the pixel (i * step, j * step) and the grid covers the entire image, so
+  // that the last grid points may lie beyond the image border. The output is
+  // stored in planar layout [slice][row][col]
+  // with the 5 slices {v_x, v_y, c_x, c_y, c_z}, where c + t * (v_x, v_y, 1)
+  // is the refracted viewing ray of the pixel in the camera frame. For
+  // non-refractive images, c is zero and v is given by the calibration.
+  static const int kNumVirtualCameraParams = 5;
+  void ComputeVirtualCameras(size_t step,
+                             std::vector<float>* data,
+                             size_t* grid_width,
+                             size_t* grid_height) const;
+
+  // Project a world point into the image, where the depth is the
+  // z-coordinate of the point in the camera frame, as in the depth maps. The
+  // projection traces the refraction of refractive images, if enabled, and
+  // otherwise uses the pinhole calibration. Returns false, if the point lies
+  // behind the camera or has no valid projection.
+  bool ProjectPoint(const float X[3],
+                    bool enable_refraction,
+                    float* col,
+                    float* row,
+                    float* depth) const;
+
+  // Back-project a pixel at the given depth into the world, which is the
+  // inverse of `ProjectPoint`.
+  void BackprojectPoint(float col,
+                        float row,
+                        float depth,
+                        bool enable_refraction,
+                        float X[3]) const;
+
+  // Crop the region of the given size with the top-left pixel (col, row) to a
+  // new image, whose calibration and refractive camera are shifted to the
+  // region. The region must lie inside the image.
+  Image Crop(size_t col, size_t row, size_t width, size_t height) const;
+
   void Rescale(float factor);
   void Rescale(float factor_x, float factor_y);
   void Downsize(size_t max_width, size_t max_height);
@@ -79,6 +128,7 @@ class Image {
   float P_[12];
   float inv_P_[12];
   Bitmap bitmap_;
+  std::shared_ptr<const Camera> refrac_camera_;
 };
 
 void ComputeRelativePose(const float R1[9],
@@ -126,5 +176,7 @@ const float* Image::GetInvP() const { return inv_P_; }
 
 const float* Image::GetViewingDirection() const { return &R_[6]; }
 
+bool Image::IsRefractive() const { return refrac_camera_ != nullptr; }
+
 }  // namespace mvs
 }  // namespace colmap
@@ -0,0 +1,201 @@
+#include "colmap/mvs/image.h"
+
+#include "colmap/scene/camera.h"
+#include "colmap/sensor/models_refrac.h"
+
+#include <Eigen/Core>
+#include <gtest/gtest.h>
+
+namespace colmap {
+namespace mvs {
+namespace {
+
+Image CreateImage(const Camera& camera) {
+  const Eigen::Matrix<float, 3, 3, Eigen::RowMajor> K =
+      camera.CalibrationMatrix().cast<float>();
+  const Eigen::Matrix<float, 3, 3, Eigen::RowMajor> R =
+      Eigen::Matrix<float, 3, 3, Eigen::RowMajor>::Identity();
+  const Eigen::Vector3f T = Eigen::Vector3f::Zero();
+  return Image("", camera.width, camera.height, K.data(), R.data(), T.data());
+}
+
+TEST(Image, ComputeVirtualCamerasPinhole) {
+  const Camera camera =
+      Camera::CreateFromModelName(1, "PINHOLE", 100.0, 10, 8);
+  const Image image = CreateImage(camera);
+  EXPECT_FALSE(image.IsRefractive());
+
+  std::vector<float> data;
+  size_t grid_width = 0;
+  size_t grid_height = 0;
+  image.ComputeVirtualCameras(4, &data, &grid_width, &grid_height);
+  EXPECT_EQ(grid_width, 4);
+  EXPECT_EQ(grid_height, 3);
+  ASSERT_EQ(data.size(),
+            Image::kNumVirtualCameraParams * grid_width * grid_height);
+
+  const size_t num_grid_points = grid_width * grid_height;
+  for (size_t r = 0; r < grid_height; ++r) {
+    for (size_t c = 0; c < grid_width; ++c) {
+      const Eigen::Vector2d ray =
+          camera.CamFromImg(Eigen::Vector2d(c * 4.0, r * 4.0));
+      const float* grid_data = data.data() + r * grid_width + c;
+      EXPECT_NEAR(grid_data[0 * num_grid_points], ray.x(), 1e-6);
+      EXPECT_NEAR(grid_data[1 * num_grid_points], ray.y(), 1e-6);
+      EXPECT_EQ(grid_data[2 * num_grid_points], 0);
+      EXPECT_EQ(grid_data[3 * num_grid_points], 0);
+      EXPECT_EQ(grid_data[4 * num_grid_points], 0);
+    }
+  }
+}
+
+void TestComputeVirtualCamerasRefrac(const Camera& camera) {
+  Image image = CreateImage(camera);
+  image.SetRefracCamera(camera);
+  EXPECT_TRUE(image.IsRefractive());
+
+  std::vector<float> data;
+  size_t grid_width = 0;
+  size_t grid_height = 0;
+  image.ComputeVirtualCameras(1, &data, &grid_width, &grid_height);
+  EXPECT_EQ(grid_width, camera.width);
+  EXPECT_EQ(grid_height, camera.height);
+
+  // The refracted viewing ray must pass through the virtual camera center.
+  const size_t num_grid_points = grid_width * grid_height;
+  for (size_t r = 0; r < grid_height; r += 7) {
+    for (size_t c = 0; c < grid_width; c += 7) {
+      const float* grid_data = data.data() + r * grid_width + c;
+      const Eigen::Vector2d ray(grid_data[0 * num_grid_points],
+                                grid_data[1 * num_grid_points]);
+      const Eigen::Vector3d center(grid_data[2 * num_grid_points],
+                                   grid_data[3 * num_grid_points],
+                                   grid_data[4 * num_grid_points]);
+      for (const double depth : {0.5, 2.0, 10.0}) {
+        const Eigen::Vector3d point =
+            camera.CamFromImgRefracPoint(Eigen::Vector2d(c, r), depth);
+        EXPECT_LT(((point - center).hnormalized() - ray).norm(), 1e-5);
+      }
+    }
+  }
+
+  // The refractive camera is rescaled together with the image.
+  image.Rescale(0.5);
+  EXPECT_TRUE(image.IsRefractive());
+  image.ComputeVirtualCameras(1, &data, &grid_width, &grid_height);
+  EXPECT_EQ(grid_width, image.GetWidth());
+  EXPECT_EQ(grid_height, image.GetHeight());
+}
+
+TEST(Image, ComputeVirtualCamerasFlatPort) {
+  Camera camera =
+      Camera::CreateFromModelName(1, "SIMPLE_PINHOLE", 100.0, 100, 80);
+  camera.refrac_model_id = FlatPort::refrac_model_id;
+  camera.refrac_params = {0.1, 0.05, 0.99, 0.05, 0.007, 1.0, 1.52, 1.33};
+  Eigen::Map<Eigen::Vector3d>(camera.refrac_params.data()).normalize();
+  TestComputeVirtualCamerasRefrac(camera);
+}
+
+TEST(Image, ComputeVirtualCamerasDomePort) {
+  Camera camera =
+      Camera::CreateFromModelName(1, "SIMPLE_PINHOLE", 100.0, 100, 80);
+  camera.refrac_model_id = DomePort::refrac_model_id;
+  camera.refrac_params = {0.001, 0.001, 0.002, 0.05, 0.007, 1.0, 1.52, 1.33};
+  TestComputeVirtualCamerasRefrac(camera);
+}
+
+TEST(Image, ProjectPoint) {
+  Camera camera =
+      Camera::CreateFromModelName(1, "SIMPLE_PINHOLE", 100.0, 100, 80);
+  Image image = CreateImage(camera);
+
+  float col = 0;
+  float row = 0;
+  float depth = 0;
+  const float X[3] = {0.2f, -0.1f, 2.0f};
+  EXPECT_TRUE(image.ProjectPoint(X, true, &col, &row, &depth));
+  EXPECT_NEAR(col, 50 + 100 * 0.1, 1e-4);
+  EXPECT_NEAR(row, 40 - 100 * 0.05, 1e-4);
+  EXPECT_EQ(depth, 2.0f);
+
+  const float X_behind[3] = {0.2f, -0.1f, -2.0f};
+  EXPECT_FALSE(image.ProjectPoint(X_behind, true, &col, &row, &depth));
+
+  camera.refrac_model_id = FlatPort::refrac_model_id;
+  camera.refrac_params = {0.1, 0.05, 0.99, 0.05, 0.007, 1.0, 1.52, 1.33};
+  Eigen::Map<Eigen::Vector3d>(camera.refrac_params.data()).normalize();
+  image.SetRefracCamera(camera);
+
+  // The refracted viewing ray of the projection passes through the point.
+  EXPECT_TRUE(image.ProjectPoint(X, true, &col, &row, &depth));
+  EXPECT_EQ(depth, 2.0f);
+  const Ray3D ray = camera.CamFromImgRefrac(Eigen::Vector2d(col, row));
+  const Eigen::Vector3d point = ray.At((depth - ray.ori.z()) / ray.dir.z());
+  EXPECT_LT((point - Eigen::Vector3d(0.2, -0.1, 2.0)).norm(), 1e-4);
+
+  // Without refraction, the pinhole calibration is used.
+  EXPECT_TRUE(image.ProjectPoint(X, false, &col, &row, &depth));
+  EXPECT_NEAR(col, 60, 1e-4);
+  EXPECT_NEAR(row, 35, 1e-4);
+}
+
+TEST(Image, BackprojectPoint) {
+  Camera camera =
+      Camera::CreateFromModelName(1, "SIMPLE_PINHOLE", 100.0, 100, 80);
+  Image image = CreateImage(camera);
+  for (const bool refractive : {false, true}) {
+    if (refractive) {
+      camera.refrac_model_id = FlatPort::refrac_model_id;
+      camera.refrac_params = {0.1, 0.05, 0.99, 0.05, 0.007, 1.0, 1.52, 1.33};
+      Eigen::Map<Eigen::Vector3d>(camera.refrac_params.data()).normalize();
+      image.SetRefracCamera(camera);
+    }
+    float X[3];
+    image.BackprojectPoint(20, 30, 2, true, X);
+    float col = 0;
+    float row = 0;
+    float depth = 0;
+    EXPECT_TRUE(image.ProjectPoint(X, true, &col, &row, &depth));
+    EXPECT_NEAR(col, 20, 1e-3);
+    EXPECT_NEAR(row, 30, 1e-3);
+    EXPECT_NEAR(depth, 2, 1e-5);
+  }
+}
+
+TEST(Image, Crop) {
+  Camera camera =
+      Camera::CreateFromModelName(1, "SIMPLE_PINHOLE", 100.0, 100, 80);
+  camera.refrac_model_id = FlatPort::refrac_model_id;
+  camera.refrac_params = {0.1, 0.05, 0.99, 0.05, 0.007, 1.0, 1.52, 1.33};
+  Eigen::Map<Eigen::Vector3d>(camera.refrac_params.data()).normalize();
+  Image image = CreateImage(camera);
+  image.SetRefracCamera(camera);
+
+  const Image cropped_image = image.Crop(10, 20, 30, 40);
+  EXPECT_EQ(cropped_image.GetWidth(), 30);
+  EXPECT_EQ(cropped_image.GetHeight(), 40);
+  EXPECT_TRUE(cropped_image.IsRefractive());
+
+  const float X[3] = {0.2f, -0.1f, 2.0f};
+  for (const bool enable_refraction : {false, true}) {
+    float col = 0;
+    float row = 0;
+    float depth = 0;
+    EXPECT_TRUE(image.ProjectPoint(X, enable_refraction, &col, &row, &depth));
+    float cropped_col = 0;
+    float cropped_row = 0;
+    float cropped_depth = 0;
+    EXPECT_TRUE(cropped_image.ProjectPoint(X,
+                                           enable_refraction,
+                                           &cropped_col,
+                                           &cropped_row,
+                                           &cropped_depth));
+    EXPECT_NEAR(cropped_col, col - 10, 1e-3);
+    EXPECT_NEAR(cropped_row, row - 20, 1e-3);
+    EXPECT_EQ(cropped_depth, depth);
+  }
+}
+
+}  // namespace
+}  // namespace mvs
+}  // namespace colmap
@@ -29,7 +29,14 @@
 
 #include "colmap/mvs/meshing.h"
 
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdio>
 #include <fstream>
+#include <limits>
+#include <memory>
+#include <numeric>
 #include <unordered_map>
 #include <vector>
 
@@ -100,6 +107,7 @@ bool PoissonMeshingOptions::Check() const {
   CHECK_OPTION_GE(trim, 0);
   CHECK_OPTION_GE(num_threads, -1);
   CHECK_OPTION_NE(num_threads, 0);
+  CHECK_OPTION_GE(chunk_overlap, 0);
   return true;
 }
 
@@ -113,16 +121,209 @@ bool DelaunayMeshingOptions::Check() const {
   CHECK_OPTION_GE(max_side_length_factor, 0);
   CHECK_OPTION_GE(max_side_length_percentile, 0);
   CHECK_OPTION_LE(max_side_length_percentile, 100);
+  CHECK_OPTION_GE(block_overlap, 0);
   CHECK_OPTION_GE(num_threads, -1);
   CHECK_OPTION_NE(num_threads, 0);
   return true;
 }
 
-bool PoissonMeshing(const PoissonMeshingOptions& options,
-                    const std::string& input_path,
-                    const std::string& output_path) {
-  CHECK(options.Check());
+// Recursive spatial partitioning of points into blocks, which splits the
+// points at the median of the longest axis of their bounds, until every block
+// has at most the given number of points. The blocks have half-open bounds.
+class PointBlockPartition {
+ public:
+  PointBlockPartition(const std::vector<Eigen::Vector3f>& positions,
+                      const size_t max_num_points)
+      : positions_(positions) {
+    CHECK_GT(max_num_points, 0);
+    root_.point_idxs.resize(positions_.size());
+    std::iota(root_.point_idxs.begin(), root_.point_idxs.end(), 0);
+    for (const auto& position : positions_) {
+      root_.bounds.extend(position);
+    }
+    // Points on the maximum bounds are inside the half-open bounds of the root.
+    root_.bounds.max() += Eigen::Vector3f::Constant(
+        std::numeric_limits<float>::epsilon() *
+        (1 + root_.bounds.max().cwiseAbs().maxCoeff()));
+    Split(max_num_points, &root_);
+  }
+
+  size_t NumBlocks() const { return blocks_.size(); }
+
+  const Eigen::AlignedBox3f& Bounds() const { return root_.bounds; }
+
+  const Eigen::AlignedBox3f& BlockBounds(const size_t block_idx) const {
+    return blocks_.at(block_idx)->bounds;
+  }
+
+  // The bounds of the block enlarged by the overlap relative to its extent.
+  Eigen::AlignedBox3f OverlapBlockBounds(const size_t block_idx,
+                                         const double overlap) const {
+    const Eigen::AlignedBox3f& bounds = BlockBounds(block_idx);
+    const Eigen::Vector3f margin = overlap * bounds.sizes();
+    return Eigen::AlignedBox3f(bounds.min() - margin, bounds.max() + margin);
+  }
+
+  // Find the indices of all points inside the given bounds.
+  std::vector<size_t> FindPoints(const Eigen::AlignedBox3f& bounds) const {
+    std::vector<size_t> point_idxs;
+    FindPoints(root_, bounds, &point_idxs);
+    return point_idxs;
+  }
+
+  // Only keep the faces of the mesh with their centroid inside the block.
+  PlyMesh CropToBlock(const size_t block_idx, const PlyMesh& mesh) const {
+    const Eigen::AlignedBox3f& bounds = BlockBounds(block_idx);
+    PlyMesh cropped_mesh;
+    cropped_mesh.vertices = mesh.vertices;
+    for (const auto& face : mesh.faces) {
+      const auto& vertex1 = mesh.vertices[face.vertex_idx1];
+      const auto& vertex2 = mesh.vertices[face.vertex_idx2];
+      const auto& vertex3 = mesh.vertices[face.vertex_idx3];
+      const Eigen::Vector3f centroid =
+          (Eigen::Vector3f(vertex1.x, vertex1.y, vertex1.z) +
+           Eigen::Vector3f(vertex2.x, vertex2.y, vertex2.z) +
+           Eigen::Vector3f(vertex3.x, vertex3.y, vertex3.z)) /
+          3.0f;
+      if ((centroid.array() >= bounds.min().array()).all() &&
+          (centroid.array() < bounds.max().array()).all()) {
+        cropped_mesh.faces.push_back(face);
+      }
+    }
+    return cropped_mesh;
+  }
+
+ private:
+  struct Node {
+    Eigen::AlignedBox3f bounds;
+    int split_axis = -1;
+    std::unique_ptr<Node> left;
+    std::unique_ptr<Node> right;
+    std::vector<size_t> point_idxs;
+  };
+
+  void Split(const size_t max_num_points, Node* node) {
+    if (node->point_idxs.size() <= max_num_points) {
+      blocks_.push_back(node);
+      return;
+    }
+
+    int axis;
+    node->bounds.sizes().maxCoeff(&axis);
+
+    auto& point_idxs = node->point_idxs;
+    const auto median_it = point_idxs.begin() + point_idxs.size() / 2;
+    std::nth_element(point_idxs.begin(),
+                     median_it,
+                     point_idxs.end(),
+                     [&](const size_t point_idx1, const size_t point_idx2) {
+                       return positions_[point_idx1][axis] <
+                              positions_[point_idx2][axis];
+                     });
+    const float split = positions_[*median_it][axis];
+
+    // The points on the splitting plane belong to the right child.
+    const auto split_it = std::partition(
+        point_idxs.begin(), point_idxs.end(), [&](const size_t point_idx) {
+          return positions_[point_idx][axis] < split;
+        });
+
+    // All points lie on the splitting plane, which cannot be split further.
+    if (split_it == point_idxs.begin()) {
+      blocks_.push_back(node);
+      return;
+    }
+
+    node->split_axis = axis;
+    node->left = std::make_unique<Node>();
+    node->right = std::make_unique<Node>();
+    node->left->bounds = node->bounds;
+    node->left->bounds.max()[axis] = split;
+    node->right->bounds = node->bounds;
+    node->right->bounds.min()[axis] = split;
+    node->left->point_idxs.assign(point_idxs.begin(), split_it);
+    node->right->point_idxs.assign(split_it, point_idxs.end());
+    point_idxs.clear();
+    point_idxs.shrink_to_fit();
+
+    Split(max_num_points, node->left.get());
+    Split(max_num_points, node->right.get());
+  }
 
+  void FindPoints(const Node& node,
+                  const Eigen::AlignedBox3f& bounds,
+                  std::vector<size_t>* point_idxs) const {
+    if (!node.bounds.intersects(bounds)) {
+      return;
+    }
+    if (node.split_axis == -1) {
+      for (const size_t point_idx : node.point_idxs) {
+        if (bounds.contains(positions_[point_idx])) {
+          point_idxs->push_back(point_idx);
+        }
+      }
+      return;
+    }
+    FindPoints(*node.left, bounds, point_idxs);
+    FindPoints(*node.right, bounds, point_idxs);
+  }
+
+  const std::vector<Eigen::Vector3f>& positions_;
+  Node root_;
+  std::vector<const Node*> blocks_;
+};
+
+// Merge the meshes of the blocks into a single mesh, where the vertices of
+// the blocks with the same position are merged and unused vertices are
+// removed. The block meshes are cleared to reduce the peak memory usage.
+PlyMesh MergeBlockPlyMeshes(std::vector<PlyMesh>* block_meshes) {
+  constexpr size_t kInvalidVertexIdx = std::numeric_limits<size_t>::max();
+
+  struct VertexHash {
+    size_t operator()(const std::array<float, 3>& vertex) const {
+      size_t hash = 0;
+      for (const float coord : vertex) {
+        hash ^= std::hash<float>()(coord) + 0x9e3779b9 + (hash << 6) +
+                (hash >> 2);
+      }
+      return hash;
+    }
+  };
+
+  PlyMesh mesh;
+  std::unordered_map<std::array<float, 3>, size_t, VertexHash> vertex_idxs;
+  std::vector<size_t> block_vertex_idxs;
+  for (PlyMesh& block_mesh : *block_meshes) {
+    block_vertex_idxs.assign(block_mesh.vertices.size(), kInvalidVertexIdx);
+    auto MergeVertex = [&](const size_t block_vertex_idx) {
+      size_t& vertex_idx = block_vertex_idxs[block_vertex_idx];
+      if (vertex_idx == kInvalidVertexIdx) {
+        const auto& vertex = block_mesh.vertices[block_vertex_idx];
+        const auto it = vertex_idxs.emplace(
+            std::array<float, 3>{{vertex.x, vertex.y, vertex.z}},
+            mesh.vertices.size());
+        if (it.second) {
+          mesh.vertices.push_back(vertex);
+        }
+        vertex_idx = it.first->second;
+      }
+      return vertex_idx;
+    };
+    for (const auto& face : block_mesh.faces) {
+      mesh.faces.emplace_back(MergeVertex(face.vertex_idx1),
+                              MergeVertex(face.vertex_idx2),
+                              MergeVertex(face.vertex_idx3));
+    }
+    block_mesh = PlyMesh();
+  }
+
+  return mesh;
+}
+
+bool RunPoissonRecon(const PoissonMeshingOptions& options,
+                     const int depth,
+                     const std::string& input_path,
+                     const std::string& output_path) {
   std::vector<std::string> args;
 
   args.push_back("./binary");
@@ -137,7 +338,7 @@ bool PoissonMeshing(const PoissonMeshingOptions& options,
   args.push_back(std::to_string(options.point_weight));
 
   args.push_back("--depth");
-  args.push_back(std::to_string(options.depth));
+  args.push_back(std::to_string(depth));
 
   if (options.color > 0) {
     args.push_back("--color");
@@ -193,6 +394,122 @@ bool PoissonMeshing(const PoissonMeshingOptions& options,
                         const_cast<char**>(args_cstr.data())) == EXIT_SUCCESS;
 }
 
+// Poisson reconstruction of spatially partitioned chunks. The points of every
+// chunk in its bounds enlarged by the overlap are written to a temporary file
+// next to the output in parallel. The chunks are then reconstructed and
+// trimmed one after the other, since PoissonRecon and SurfaceTrimmer keep
+// their command line parameters in global state, but each reconstruction is
+// itself parallelized. Finally, every chunk only keeps the faces with their
+// centroid inside its bounds and the chunks are merged into a single mesh.
+bool ChunkedPoissonMeshing(const PoissonMeshingOptions& options,
+                           const std::string& input_path,
+                           const std::string& output_path) {
+  std::vector<PlyPoint> points = ReadPly(input_path);
+  if (points.size() <= static_cast<size_t>(options.max_chunk_num_points)) {
+    return RunPoissonRecon(options, options.depth, input_path, output_path);
+  }
+
+  std::vector<Eigen::Vector3f> positions;
+  positions.reserve(points.size());
+  for (const auto& point : points) {
+    positions.emplace_back(point.x, point.y, point.z);
+  }
+
+  const PointBlockPartition partition(positions,
+                                      options.max_chunk_num_points);
+  const size_t num_chunks = partition.NumBlocks();
+
+  LOG(INFO) << StringPrintf(
+      "Partitioned %d points into %d chunks", points.size(), num_chunks);
+
+  // Size of the finest voxels of the given depth for the entire scene.
+  const double voxel_size =
+      partition.Bounds().sizes().maxCoeff() / std::pow(2.0, options.depth);
+
+  std::vector<std::string> chunk_paths(num_chunks);
+  std::vector<int> chunk_depths(num_chunks);
+  ThreadPool thread_pool(GetEffectiveNumThreads(options.num_threads));
+  for (size_t chunk_idx = 0; chunk_idx < num_chunks; ++chunk_idx) {
+    thread_pool.AddTask([&, chunk_idx]() {
+      const Eigen::AlignedBox3f bounds =
+          partition.OverlapBlockBounds(chunk_idx, options.chunk_overlap);
+      const std::vector<size_t> point_idxs = partition.FindPoints(bounds);
+      if (point_idxs.empty()) {
+        return;
+      }
+
+      std::vector<PlyPoint> chunk_points;
+      chunk_points.reserve(point_idxs.size());
+      for (const size_t point_idx : point_idxs) {
+        chunk_points.push_back(points[point_idx]);
+      }
+
+      chunk_paths[chunk_idx] = StringPrintf(
+          "%s.chunk%d.ply", output_path.c_str(), static_cast<int>(chunk_idx));
+      WriteBinaryPlyPoints(chunk_paths[chunk_idx], chunk_points);
+
+      chunk_depths[chunk_idx] = std::max(
+          1,
+          std::min(options.depth,
+                   static_cast<int>(std::ceil(std::log2(
+                       bounds.sizes().maxCoeff() / voxel_size)))));
+    });
+  }
+  thread_pool.Wait();
+
+  points.clear();
+  points.shrink_to_fit();
+
+  std::vector<PlyMesh> chunk_meshes(num_chunks);
+  bool success = true;
+  for (size_t chunk_idx = 0; chunk_idx < num_chunks; ++chunk_idx) {
+    const std::string& chunk_path = chunk_paths[chunk_idx];
+    if (chunk_path.empty()) {
+      continue;
+    }
+
+    if (success) {
+      LOG(INFO) << StringPrintf("Reconstructing chunk [%d/%d] at depth %d",
+                                chunk_idx + 1,
+                                num_chunks,
+                                chunk_depths[chunk_idx]);
+      const std::string mesh_path = chunk_path + ".mesh.ply";
+      success = RunPoissonRecon(
+          options, chunk_depths[chunk_idx], chunk_path, mesh_path);
+      if (success) {
+        chunk_meshes[chunk_idx] =
+            partition.CropToBlock(chunk_idx, ReadPlyMesh(mesh_path));
+      }
+      std::remove(mesh_path.c_str());
+    }
+
+    std::remove(chunk_path.c_str());
+  }
+
+  if (!success) {
+    return false;
+  }
+
+  LOG(INFO) << "Merging chunks...";
+  WriteBinaryPlyMesh(output_path,
+                     MergeBlockPlyMeshes(&chunk_meshes),
+                     /*write_rgb=*/options.color > 0);
+
+  return true;
+}
+
+bool PoissonMeshing(const PoissonMeshingOptions& options,
+                    const std::string& input_path,
+                    const std::string& output_path) {
+  CHECK(options.Check());
+
+  if (options.max_chunk_num_points > 0) {
+    return ChunkedPoissonMeshing(options, input_path, output_path);
+  }
+
+  return RunPoissonRecon(options, options.depth, input_path, output_path);
+}
+
 #if defined(COLMAP_CGAL_ENABLED)
 
 K::Point_3 EigenToCGAL(const Eigen::Vector3f& point) {
@@ -217,7 +534,7 @@ class DelaunayMeshingInput {
     uint32_t num_visible_images = 0;
   };
 
-  std::unordered_map<camera_t, Camera> cameras;
+  DenseIdMap<camera_t, Camera> cameras;
   std::vector<Image> images;
   std::vector<Point> points;
 
@@ -474,38 +791,244 @@ struct DelaunayMeshingEdgeWeightComputer {
   double distance_normalization_;
 };
 
+// Result of an intersection computed in floating point arithmetic, which is
+// uncertain if the ray passes near an edge of the triangle or is parallel to
+// its plane, such that rounding errors could change the result.
+enum class InexactIntersection { HIT, MISS, UNCERTAIN };
+
+// Intersect the ray origin + t * direction for t in [0, max_t] with the
+// triangle using the algorithm of Moeller and Trumbore.
+InexactIntersection IntersectRayTriangleInexact(const K::Point_3& origin,
+                                                const K::Vector_3& direction,
+                                                const double max_t,
+                                                const K::Triangle_3& triangle,
+                                                K::Point_3* point) {
+  constexpr double kTolerance = 1e-7;
+  const K::Vector_3 edge1 = triangle[1] - triangle[0];
+  const K::Vector_3 edge2 = triangle[2] - triangle[0];
+  const K::Vector_3 p = CGAL::cross_product(direction, edge2);
+  const double det = edge1 * p;
+  const double scale = std::sqrt(edge1.squared_length() *
+                                 edge2.squared_length() *
+                                 direction.squared_length());
+  if (std::abs(det) <= kTolerance * scale) {
+    return InexactIntersection::UNCERTAIN;
+  }
+
+  const double inv_det = 1.0 / det;
+  const K::Vector_3 s = origin - triangle[0];
+  const double u = inv_det * (s * p);
+  const K::Vector_3 q = CGAL::cross_product(s, edge1);
+  const double v = inv_det * (direction * q);
+  const double t = inv_det * (edge2 * q);
+  const double w = 1.0 - u - v;
+
+  // The barycentric coordinates and the ray parameter must be clearly inside
+  // or clearly outside of their ranges for a certain result.
+  const double min_margin = std::min({u, v, w, t, max_t - t});
+  if (min_margin > kTolerance) {
+    *point = origin + t * direction;
+    return InexactIntersection::HIT;
+  } else if (min_margin < -kTolerance) {
+    return InexactIntersection::MISS;
+  }
+  return InexactIntersection::UNCERTAIN;
+}
+
+// Bounding volume hierarchy over the hull facets of a Delaunay triangulation,
+// which finds the hull facets that a ray segment possibly intersects without
+// checking all hull facets.
+class HullFacetBVH {
+ public:
+  HullFacetBVH() = default;
+
+  explicit HullFacetBVH(const std::vector<Eigen::AlignedBox3d>& boxes)
+      : boxes_(boxes), idxs_(boxes.size()) {
+    std::iota(idxs_.begin(), idxs_.end(), 0);
+    // Enlarge the boxes, such that the inexact segment-box tests are
+    // conservative.
+    for (auto& box : boxes_) {
+      const double margin =
+          1e-9 * (1 + box.max().cwiseAbs().maxCoeff() +
+                  box.min().cwiseAbs().maxCoeff());
+      box.min().array() -= margin;
+      box.max().array() += margin;
+    }
+    if (!idxs_.empty()) {
+      nodes_.reserve(2 * idxs_.size() / kMaxLeafSize + 1);
+      Build(0, idxs_.size());
+    }
+  }
+
+  // Find the indices of the facets, whose boxes intersect the segment, in
+  // increasing order.
+  void Query(const Eigen::Vector3d& start,
+             const Eigen::Vector3d& end,
+             std::vector<size_t>* facet_idxs) const {
+    facet_idxs->clear();
+    if (nodes_.empty()) {
+      return;
+    }
+    const Eigen::Vector3d direction = end - start;
+    const Eigen::Vector3d inv_direction = direction.cwiseInverse();
+    std::vector<int> stack = {0};
+    while (!stack.empty()) {
+      const Node& node = nodes_[stack.back()];
+      stack.pop_back();
+      if (!IntersectsBox(node.box, start, inv_direction)) {
+        continue;
+      }
+      if (node.left == -1) {
+        for (size_t i = node.begin; i < node.end; ++i) {
+          if (IntersectsBox(boxes_[idxs_[i]], start, inv_direction)) {
+            facet_idxs->push_back(idxs_[i]);
+          }
+        }
+      } else {
+        stack.push_back(node.left);
+        stack.push_back(node.right);
+      }
+    }
+    std::sort(facet_idxs->begin(), facet_idxs->end());
+  }
+
+ private:
+  static constexpr size_t kMaxLeafSize = 4;
+
+  struct Node {
+    Eigen::AlignedBox3d box;
+    int left = -1;
+    int right = -1;
+    size_t begin = 0;
+    size_t end = 0;
+  };
+
+  // Slab test of the segment start + t * direction for t in [0, 1].
+  static bool IntersectsBox(const Eigen::AlignedBox3d& box,
+                            const Eigen::Vector3d& start,
+                            const Eigen::Vector3d& inv_direction) {
+    double t_min = 0;
+    double t_max = 1;
+    for (int d = 0; d < 3; ++d) {
+      if (std::isinf(inv_direction(d))) {
+        if (start(d) < box.min()(d) || start(d) > box.max()(d)) {
+          return false;
+        }
+        continue;
+      }
+      double t1 = (box.min()(d) - start(d)) * inv_direction(d);
+      double t2 = (box.max()(d) - start(d)) * inv_direction(d);
+      if (t1 > t2) {
+        std::swap(t1, t2);
+      }
+      t_min = std::max(t_min, t1);
+      t_max = std::min(t_max, t2);
+      if (t_min > t_max) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Recursively split the facets at the median of their box centers along
+  // the longest axis of the bounds of the centers.
+  int Build(const size_t begin, const size_t end) {
+    const int node_idx = static_cast<int>(nodes_.size());
+    nodes_.emplace_back();
+    Eigen::AlignedBox3d box;
+    Eigen::AlignedBox3d center_box;
+    for (size_t i = begin; i < end; ++i) {
+      box.extend(boxes_[idxs_[i]]);
+      center_box.extend(boxes_[idxs_[i]].center());
+    }
+    nodes_[node_idx].box = box;
+    nodes_[node_idx].begin = begin;
+    nodes_[node_idx].end = end;
+    if (end - begin <= kMaxLeafSize) {
+      return node_idx;
+    }
+
+    int axis;
+    center_box.sizes().maxCoeff(&axis);
+    const size_t mid = begin + (end - begin) / 2;
+    std::nth_element(idxs_.begin() + begin,
+                     idxs_.begin() + mid,
+                     idxs_.begin() + end,
+                     [this, axis](const size_t idx1, const size_t idx2) {
+                       return boxes_[idx1].center()(axis) <
+                              boxes_[idx2].center()(axis);
+                     });
+    const int left = Build(begin, mid);
+    const int right = Build(mid, end);
+    nodes_[node_idx].left = left;
+    nodes_[node_idx].right = right;
+    return node_idx;
+  }
+
+  std::vector<Eigen::AlignedBox3d> boxes_;
+  std::vector<size_t> idxs_;
+  std::vector<Node> nodes_;
+};
+
+Eigen::Vector3d CGALToEigenDouble(const K::Point_3& point) {
+  return Eigen::Vector3d(point.x(), point.y(), point.z());
+}
+
 // Ray caster through the cells of a Delaunay triangulation. The tracing locates
 // the cell of the ray origin and then iteratively intersects the ray with all
 // facets of the current cell and advances to the neighboring cell of the
 // intersected facet. Note that the ray can also pass through outside of the
 // hull of the triangulation, i.e. lie within the infinite cells/facets.
-// The ray caster collects the intersected facets along the ray.
+// The ray caster collects the intersected facets along the ray. If
+// accelerated, the hull facets are found through a bounding volume hierarchy
+// and the facets are intersected in floating point arithmetic, which falls
+// back to the exact computation for uncertain results.
 struct DelaunayTriangulationRayCaster {
   struct Intersection {
     Delaunay::Facet facet;
     double target_distance_squared = 0.0;
   };
 
-  explicit DelaunayTriangulationRayCaster(const Delaunay& triangulation)
-      : triangulation_(triangulation) {
+  explicit DelaunayTriangulationRayCaster(const Delaunay& triangulation,
+                                          const bool accelerate = false)
+      : triangulation_(triangulation), accelerate_(accelerate) {
     FindHullFacets();
   }
 
-  void CastRaySegment(const K::Segment_3& ray_segment,
-                      std::vector<Intersection>* intersections) const {
+  // Cast the ray segment from the origin, whose cell can be given, e.g., if
+  // multiple rays share the same origin. Otherwise, the cell is located.
+  void CastRaySegment(
+      const K::Segment_3& ray_segment,
+      std::vector<Intersection>* intersections,
+      Delaunay::Cell_handle origin_cell = Delaunay::Cell_handle()) const {
     intersections->clear();
 
     Delaunay::Cell_handle next_cell =
-        triangulation_.locate(ray_segment.start());
+        origin_cell == Delaunay::Cell_handle()
+            ? triangulation_.locate(ray_segment.start())
+            : origin_cell;
+
+    std::vector<size_t> hull_facet_idxs;
+    if (accelerate_) {
+      hull_facet_bvh_.Query(CGALToEigenDouble(ray_segment.start()),
+                            CGALToEigenDouble(ray_segment.end()),
+                            &hull_facet_idxs);
+    }
 
     bool next_cell_found = true;
     while (next_cell_found) {
       next_cell_found = false;
 
       if (triangulation_.is_infinite(next_cell)) {
-        // Linearly check all hull facets for intersection.
+        // Check all hull facets for intersection, or only the ones whose
+        // bounds intersect the segment in the accelerated mode.
+
+        const size_t num_hull_facets =
+            accelerate_ ? hull_facet_idxs.size() : hull_facets_.size();
+        for (size_t j = 0; j < num_hull_facets; ++j) {
+          const Delaunay::Facet& hull_facet =
+              hull_facets_[accelerate_ ? hull_facet_idxs[j] : j];
 
-        for (const auto& hull_facet : hull_facets_) {
           // Check if the ray origin is infront of the facet.
           const K::Triangle_3 triangle = triangulation_.triangle(hull_facet);
           if (CGAL::orientation(
@@ -516,8 +1039,7 @@ struct DelaunayTriangulationRayCaster {
 
           // Check if the segment intersects the facet.
           K::Point_3 intersection_point;
-          if (!CGAL::assign(intersection_point,
-                            CGAL::intersection(ray_segment, triangle))) {
+          if (!Intersect(ray_segment, triangle, &intersection_point)) {
             continue;
           }
 
@@ -555,8 +1077,7 @@ struct DelaunayTriangulationRayCaster {
 
           // Check if the segment intersects the facet.
           K::Point_3 intersection_point;
-          if (!CGAL::assign(intersection_point,
-                            CGAL::intersection(ray_segment, triangle))) {
+          if (!Intersect(ray_segment, triangle, &intersection_point)) {
             continue;
           }
 
@@ -583,6 +1104,37 @@ struct DelaunayTriangulationRayCaster {
     }
   }
 
+  // Intersect the segment or the ray with the triangle.
+  bool Intersect(const K::Segment_3& segment,
+                 const K::Triangle_3& triangle,
+                 K::Point_3* point) const {
+    if (accelerate_) {
+      const InexactIntersection result = IntersectRayTriangleInexact(
+          segment.start(), segment.to_vector(), 1.0, triangle, point);
+      if (result != InexactIntersection::UNCERTAIN) {
+        return result == InexactIntersection::HIT;
+      }
+    }
+    return CGAL::assign(*point, CGAL::intersection(segment, triangle));
+  }
+
+  bool Intersect(const K::Ray_3& ray,
+                 const K::Triangle_3& triangle,
+                 K::Point_3* point) const {
+    if (accelerate_) {
+      const InexactIntersection result =
+          IntersectRayTriangleInexact(ray.source(),
+                                      ray.to_vector(),
+                                      std::numeric_limits<double>::max(),
+                                      triangle,
+                                      point);
+      if (result != InexactIntersection::UNCERTAIN) {
+        return result == InexactIntersection::HIT;
+      }
+    }
+    return CGAL::assign(*point, CGAL::intersection(ray, triangle));
+  }
+
  private:
   // Find all finite facets of infinite cells.
   void FindHullFacets() {
@@ -597,10 +1149,26 @@ struct DelaunayTriangulationRayCaster {
         }
       }
     }
+
+    if (accelerate_) {
+      std::vector<Eigen::AlignedBox3d> hull_facet_boxes;
+      hull_facet_boxes.reserve(hull_facets_.size());
+      for (const auto& hull_facet : hull_facets_) {
+        const K::Triangle_3 triangle = triangulation_.triangle(hull_facet);
+        Eigen::AlignedBox3d box;
+        for (int i = 0; i < 3; ++i) {
+          box.extend(CGALToEigenDouble(triangle[i]));
+        }
+        hull_facet_boxes.push_back(box);
+      }
+      hull_facet_bvh_ = HullFacetBVH(hull_facet_boxes);
+    }
   }
 
   const Delaunay& triangulation_;
+  const bool accelerate_;
   std::vector<Delaunay::Facet> hull_facets_;
+  HullFacetBVH hull_facet_bvh_;
 };
 
 // Implementation of geometry visualized in Figure 9 in P. Labatut, J‐P. Pons,
@@ -684,6 +1252,52 @@ void WriteDelaunayTriangulationPly(const std::string& path,
   }
 }
 
+// Interleave the bits of the quantized coordinates in [0, 1024)^3.
+uint32_t MortonCode(const Eigen::Vector3f& coords) {
+  uint32_t code = 0;
+  for (int d = 0; d < 3; ++d) {
+    const uint32_t value = static_cast<uint32_t>(
+        std::min(std::max(coords(d), 0.0f), 1023.0f));
+    for (int bit = 0; bit < 10; ++bit) {
+      code |= ((value >> bit) & 1u) << (3 * bit + d);
+    }
+  }
+  return code;
+}
+
+// Sort the points of the visibility rays of an image by the Morton code of
+// their viewing directions, if the visibility is accelerated or the rays are
+// subsampled, and subsample them evenly to at most the maximum number of rays.
+std::vector<size_t> SortVisibilityRays(const Eigen::Vector3f& proj_center,
+                                       const DelaunayMeshingInput& input_data,
+                                       const std::vector<size_t>& point_idxs,
+                                       const DelaunayMeshingOptions& options) {
+  if (!options.accelerate_visibility && options.max_num_visibility_rays <= 0) {
+    return point_idxs;
+  }
+
+  std::vector<std::pair<uint32_t, size_t>> codes;
+  codes.reserve(point_idxs.size());
+  for (const size_t point_idx : point_idxs) {
+    const Eigen::Vector3f direction =
+        (input_data.points[point_idx].position - proj_center).normalized();
+    codes.emplace_back(
+        MortonCode(511.5f * (direction + Eigen::Vector3f::Ones())), point_idx);
+  }
+  std::sort(codes.begin(), codes.end());
+
+  const size_t max_num_rays = options.max_num_visibility_rays > 0
+                                  ? options.max_num_visibility_rays
+                                  : codes.size();
+  const size_t num_rays = std::min(codes.size(), max_num_rays);
+  std::vector<size_t> sorted_point_idxs;
+  sorted_point_idxs.reserve(num_rays);
+  for (size_t i = 0; i < num_rays; ++i) {
+    sorted_point_idxs.push_back(codes[i * codes.size() / num_rays].second);
+  }
+  return sorted_point_idxs;
+}
+
 struct DelaunayCellData {
   DelaunayCellData() : DelaunayCellData(-1) {}
   explicit DelaunayCellData(const int index)
@@ -697,10 +1311,19 @@ struct DelaunayCellData {
   std::array<float, 4> edge_weights;
 };
 
+PlyMesh BlockDelaunayMeshing(const DelaunayMeshingOptions& options,
+                             const DelaunayMeshingInput& input_data);
+
 PlyMesh DelaunayMeshing(const DelaunayMeshingOptions& options,
                         const DelaunayMeshingInput& input_data) {
   CHECK(options.Check());
 
+  if (options.max_block_num_points > 0 &&
+      input_data.points.size() >
+          static_cast<size_t>(options.max_block_num_points)) {
+    return BlockDelaunayMeshing(options, input_data);
+  }
+
   // Create a delaunay triangulation of all input points.
   LOG(INFO) << "Triangulating points...";
   const auto triangulation = input_data.CreateSubSampledDelaunayTriangulation(
@@ -708,7 +1331,8 @@ PlyMesh DelaunayMeshing(const DelaunayMeshingOptions& options,
 
   // Helper class to efficiently trace rays through the triangulation.
   LOG(INFO) << "Initializing ray tracer...";
-  const DelaunayTriangulationRayCaster ray_caster(triangulation);
+  const DelaunayTriangulationRayCaster ray_caster(
+      triangulation, options.accelerate_visibility);
 
   // Helper class to efficiently compute edge weights in the s-t graph.
   const DelaunayMeshingEdgeWeightComputer edge_weight_computer(
@@ -746,13 +1370,29 @@ PlyMesh DelaunayMeshing(const DelaunayMeshingOptions& options,
     // Intersections between viewing rays and Delaunay triangulation.
     std::vector<DelaunayTriangulationRayCaster::Intersection> intersections;
 
+    // All rays of the image start in the same cell.
+    const Delaunay::Cell_handle image_cell =
+        options.accelerate_visibility ? triangulation.locate(image_position)
+                                      : Delaunay::Cell_handle();
+
+    // Cast the rays in the order of their directions, such that consecutive
+    // rays traverse mostly the same cells, and subsample them evenly over
+    // this order, if there are more rays than the maximum.
+    const std::vector<size_t> point_idxs = SortVisibilityRays(
+        image.proj_center, input_data, image.point_idxs, options);
+    const double sampling_weight =
+        static_cast<double>(image.point_idxs.size()) /
+        std::max<size_t>(1, point_idxs.size());
+
     // Iterate through all image observations and integrate them into the graph.
-    for (const auto& point_idx : image.point_idxs) {
+    for (const auto& point_idx : point_idxs) {
       const auto& point = input_data.points[point_idx];
 
       // Likelihood of the point observation.
-      const double alpha = edge_weight_computer.ComputeVisibilityProb(
-          point.num_visible_images * point.num_visible_images);
+      const double alpha =
+          sampling_weight *
+          edge_weight_computer.ComputeVisibilityProb(point.num_visible_images *
+                                                     point.num_visible_images);
 
       const K::Point_3 point_position = EigenToCGAL(point.position);
       const K::Ray_3 viewing_ray = K::Ray_3(image_position, point_position);
@@ -767,7 +1407,8 @@ PlyMesh DelaunayMeshing(const DelaunayMeshingOptions& options,
       ray_caster.CastRaySegment(
           K::Segment_3(image_position,
                        point_position - viewing_direction_epsilon),
-          &intersections);
+          &intersections,
+          image_cell);
 
       // Accumulate source weights for cell containing image.
       if (!intersections.empty()) {
@@ -791,8 +1432,16 @@ PlyMesh DelaunayMeshing(const DelaunayMeshingOptions& options,
         // the observed point. Then accumulate the edge weight of that facet
         // and accumulate the sink weight of the cell behind that facet.
 
+        // The traversal of the ray ended next to the point, which makes the
+        // last cell a good starting point to locate the point.
         const Delaunay::Cell_handle behind_point_cell =
-            triangulation.locate(point_position + viewing_direction_epsilon);
+            (options.accelerate_visibility && !intersections.empty())
+                ? triangulation.locate(
+                      point_position + viewing_direction_epsilon,
+                      intersections.back().facet.first->neighbor(
+                          intersections.back().facet.second))
+                : triangulation.locate(point_position +
+                                       viewing_direction_epsilon);
 
         int behind_neighbor_idx = -1;
         double behind_distance_squared = 0.0;
@@ -801,8 +1450,7 @@ PlyMesh DelaunayMeshing(const DelaunayMeshingOptions& options,
               triangulation.triangle(behind_point_cell, neighbor_idx);
 
           K::Point_3 inter_point;
-          if (CGAL::assign(inter_point,
-                           CGAL::intersection(viewing_ray, triangle))) {
+          if (ray_caster.Intersect(viewing_ray, triangle, &inter_point)) {
             const double distance_squared =
                 (inter_point - point_position).squared_length();
             if (distance_squared > behind_distance_squared) {
@@ -1014,6 +1662,101 @@ PlyMesh DelaunayMeshing(const DelaunayMeshingOptions& options,
   return mesh;
 }
 
+// Extract the input of a block with the given points, where the images only
+// observe the points inside the block.
+DelaunayMeshingInput ExtractDelaunayMeshingBlockInput(
+    const DelaunayMeshingInput& input_data,
+    const std::vector<size_t>& point_idxs) {
+  DelaunayMeshingInput block_input_data;
+  block_input_data.cameras = input_data.cameras;
+
+  std::unordered_map<size_t, size_t> point_idx_to_block_idx;
+  point_idx_to_block_idx.reserve(point_idxs.size());
+  block_input_data.points.reserve(point_idxs.size());
+  for (const size_t point_idx : point_idxs) {
+    point_idx_to_block_idx.emplace(point_idx, block_input_data.points.size());
+    block_input_data.points.push_back(input_data.points[point_idx]);
+  }
+
+  for (const auto& image : input_data.images) {
+    DelaunayMeshingInput::Image block_image;
+    for (const size_t point_idx : image.point_idxs) {
+      const auto it = point_idx_to_block_idx.find(point_idx);
+      if (it != point_idx_to_block_idx.end()) {
+        block_image.point_idxs.push_back(it->second);
+      }
+    }
+    if (block_image.point_idxs.empty()) {
+      continue;
+    }
+    block_image.camera_id = image.camera_id;
+    block_image.proj_matrix = image.proj_matrix;
+    block_image.proj_center = image.proj_center;
+    block_input_data.images.push_back(std::move(block_image));
+  }
+
+  return block_input_data;
+}
+
+// Delaunay meshing of spatially partitioned blocks. The blocks are meshed in
+// parallel from the points in their bounds enlarged by the overlap. Every
+// block only keeps the faces whose centroid is inside its bounds and the
+// vertices of the blocks are merged by their position, since they are input
+// points shared by the overlapping blocks. Note that the triangulations of
+// neighboring blocks can differ at their boundary, which leaves small cracks
+// in the stitched mesh, if the overlap is too small.
+PlyMesh BlockDelaunayMeshing(const DelaunayMeshingOptions& options,
+                             const DelaunayMeshingInput& input_data) {
+  std::vector<Eigen::Vector3f> positions;
+  positions.reserve(input_data.points.size());
+  for (const auto& point : input_data.points) {
+    positions.push_back(point.position);
+  }
+
+  const PointBlockPartition partition(positions, options.max_block_num_points);
+  const size_t num_blocks = partition.NumBlocks();
+
+  LOG(INFO) << StringPrintf("Partitioned %d points into %d blocks",
+                            positions.size(),
+                            num_blocks);
+
+  // The threads are distributed over the concurrently meshed blocks.
+  const int num_threads = GetEffectiveNumThreads(options.num_threads);
+  const int num_block_threads =
+      std::min(num_threads, static_cast<int>(num_blocks));
+  DelaunayMeshingOptions block_options = options;
+  block_options.max_block_num_points = -1;
+  block_options.num_threads = std::max(1, num_threads / num_block_threads);
+
+  std::vector<PlyMesh> block_meshes(num_blocks);
+  ThreadPool thread_pool(num_block_threads);
+  for (size_t block_idx = 0; block_idx < num_blocks; ++block_idx) {
+    thread_pool.AddTask([&, block_idx]() {
+      const std::vector<size_t> point_idxs = partition.FindPoints(
+          partition.OverlapBlockBounds(block_idx, options.block_overlap));
+      if (point_idxs.size() < 4) {
+        return;
+      }
+
+      block_meshes[block_idx] = partition.CropToBlock(
+          block_idx,
+          DelaunayMeshing(
+              block_options,
+              ExtractDelaunayMeshingBlockInput(input_data, point_idxs)));
+
+      LOG(INFO) << StringPrintf("Meshed block [%d/%d] with %d faces",
+                                block_idx + 1,
+                                num_blocks,
+                                block_meshes[block_idx].faces.size());
+    });
+  }
+  thread_pool.Wait();
+
+  LOG(INFO) << "Stitching blocks...";
+
+  return MergeBlockPlyMeshes(&block_meshes);
+}
+
 void SparseDelaunayMeshing(const DelaunayMeshingOptions& options,
                            const std::string& input_path,
                            const std::string& output_path) {
@@ -61,6 +61,19 @@ struct PoissonMeshingOptions {
   // The number of threads used for the Poisson reconstruction.
   int num_threads = -1;
 
+  // Maximum number of points per chunk for the meshing of large scenes. If
+  // positive, the points are recursively partitioned into spatial chunks with
+  // at most this number of points, which are reconstructed independently,
+  // trimmed, and merged into a single mesh. The depth of every chunk is chosen
+  // such that its resolution matches the resolution of the given depth for
+  // the entire scene. A non-positive value reconstructs all points at once.
+  int max_chunk_num_points = -1;
+
+  // Overlap of neighboring chunks relative to their extent. Every chunk is
+  // reconstructed from the points in its enlarged bounds, but only keeps the
+  // faces with their centroid inside its own bounds.
+  double chunk_overlap = 0.1;
+
   bool Check() const;
 };
 
@@ -93,6 +106,35 @@ struct DelaunayMeshingOptions {
   double max_side_length_factor = 25.0;
   double max_side_length_percentile = 95.0;
 
+  // Maximum number of points per block for the meshing of large scenes. If
+  // positive, the points are recursively partitioned into spatial blocks with
+  // at most this number of points, which are triangulated and graph-cut in
+  // parallel and then stitched into a single mesh. The memory of a block is
+  // thereby bounded independent of the size of the scene. A non-positive value
+  // triangulates all points at once.
+  int max_block_num_points = -1;
+
+  // Overlap of neighboring blocks relative to their extent. Every block is
+  // meshed with the points in its enlarged bounds, but only keeps the faces
+  // with their centroid inside its own bounds.
+  double block_overlap = 0.1;
+
+  // Whether to accelerate the casting of the visibility rays through the
+  // Delaunay triangulation. The rays of an image are cast in spatially
+  // coherent order from the cell of the image, which is only located once,
+  // the hull facets are found through a bounding volume hierarchy, and the
+  // facets are intersected in floating point arithmetic with a fallback to
+  // the exact computation near degenerate configurations. The weights of the
+  // graph-cut are the same as without acceleration.
+  bool accelerate_visibility = false;
+
+  // Maximum number of visibility rays cast per image. If positive, the rays
+  // of an image are subsampled evenly over their spatial order and their
+  // weights are scaled by the inverse sampling rate, such that the expected
+  // weights of the graph-cut remain the same. A non-positive value casts all
+  // rays.
+  int max_num_visibility_rays = -1;
+
   // The number of threads to use for reconstruction. Default is all threads.
   int num_threads = -1;
 
@@ -30,18 +30,149 @@
 #include "colmap/mvs/patch_match.h"
 
 #include "colmap/math/math.h"
+#include "colmap/mvs/compressed_map.h"
 #include "colmap/mvs/consistency_graph.h"
 #include "colmap/mvs/patch_match_cuda.h"
+#include "colmap/mvs/patch_match_scheduler.h"
+#include "colmap/mvs/sparse_depth_prior.h"
 #include "colmap/mvs/workspace.h"
 #include "colmap/util/misc.h"
 
+#include <condition_variable>
+#include <limits>
+#include <mutex>
 #include <numeric>
 #include <unordered_set>
 
+#include <Eigen/Core>
+
 #define PrintOption(option) LOG(INFO) << #option ": " << option << std::endl
 
 namespace colmap {
 namespace mvs {
+namespace {
+
+// Upsample the map to the given size by nearest neighbor interpolation, which
+// in contrast to bilinear interpolation does not blend the depths and normals
+// across discontinuities.
+Mat<float> UpsampleNearest(const Mat<float>& mat,
+                           const size_t width,
+                           const size_t height) {
+  Mat<float> upsampled(width, height, mat.GetDepth());
+  for (size_t row = 0; row < height; ++row) {
+    const size_t src_row = std::min(
+        (2 * row + 1) * mat.GetHeight() / (2 * height), mat.GetHeight() - 1);
+    for (size_t col = 0; col < width; ++col) {
+      const size_t src_col = std::min(
+          (2 * col + 1) * mat.GetWidth() / (2 * width), mat.GetWidth() - 1);
+      for (size_t slice = 0; slice < mat.GetDepth(); ++slice) {
+        upsampled.Set(row, col, slice, mat.Get(src_row, src_col, slice));
+      }
+    }
+  }
+  return upsampled;
+}
+
+// Crop the region of the given size with the top-left pixel (col, row).
+template <typename T>
+Mat<T> CropMat(const Mat<T>& mat,
+               const size_t col,
+               const size_t row,
+               const size_t width,
+               const size_t height) {
+  CHECK_LE(col + width, mat.GetWidth());
+  CHECK_LE(row + height, mat.GetHeight());
+  Mat<T> cropped(width, height, mat.GetDepth());
+  for (size_t r = 0; r < height; ++r) {
+    for (size_t c = 0; c < width; ++c) {
+      for (size_t slice = 0; slice < mat.GetDepth(); ++slice) {
+        cropped.Set(r, c, slice, mat.Get(row + r, col + c, slice));
+      }
+    }
+  }
+  return cropped;
+}
+
+// Compute the region of the source image, which observes the reference image
+// within the depth range. The region is the bounding box of the projections
+// of samples on the border of the reference image at several depths, which
+// is extended by a margin for the patch window. Returns false, if the region
+// is empty.
+bool ComputeSrcImageRegion(const PatchMatchOptions& options,
+                           const Image& ref_image,
+                           const Image& src_image,
+                           int* col,
+                           int* row,
+                           int* width,
+                           int* height) {
+  const int kNumBorderSamples = 8;
+  const int kMinMargin = 16;
+  const float depths[3] = {
+      static_cast<float>(options.depth_min),
+      static_cast<float>(std::sqrt(options.depth_min * options.depth_max)),
+      static_cast<float>(options.depth_max)};
+
+  std::vector<Eigen::Vector2f> border_points;
+  border_points.reserve(4 * kNumBorderSamples);
+  const float ref_width = ref_image.GetWidth() - 1;
+  const float ref_height = ref_image.GetHeight() - 1;
+  for (int i = 0; i < kNumBorderSamples; ++i) {
+    const float t = static_cast<float>(i) / kNumBorderSamples;
+    border_points.emplace_back(t * ref_width, 0);
+    border_points.emplace_back(ref_width, t * ref_height);
+    border_points.emplace_back((1 - t) * ref_width, ref_height);
+    border_points.emplace_back(0, (1 - t) * ref_height);
+  }
+
+  float col_min = std::numeric_limits<float>::max();
+  float row_min = std::numeric_limits<float>::max();
+  float col_max = std::numeric_limits<float>::lowest();
+  float row_max = std::numeric_limits<float>::lowest();
+  for (const auto& border_point : border_points) {
+    for (const float depth : depths) {
+      float X[3];
+      ref_image.BackprojectPoint(border_point.x(),
+                                 border_point.y(),
+                                 depth,
+                                 /*enable_refraction=*/false,
+                                 X);
+      float src_col = 0;
+      float src_row = 0;
+      float src_depth = 0;
+      if (!src_image.ProjectPoint(X,
+                                  /*enable_refraction=*/false,
+                                  &src_col,
+                                  &src_row,
+                                  &src_depth)) {
+        // The projection of the frustum is unbounded, if it is partially
+        // behind the source camera.
+        *col = 0;
+        *row = 0;
+        *width = src_image.GetWidth();
+        *height = src_image.GetHeight();
+        return true;
+      }
+      col_min = std::min(col_min, src_col);
+      row_min = std::min(row_min, src_row);
+      col_max = std::max(col_max, src_col);
+      row_max = std::max(row_max, src_row);
+    }
+  }
+
+  const int margin =
+      std::max(options.window_radius * options.window_step, kMinMargin);
+  *col = std::max(static_cast<int>(std::floor(col_min)) - margin, 0);
+  *row = std::max(static_cast<int>(std::floor(row_min)) - margin, 0);
+  const int col_end = std::min(static_cast<int>(std::ceil(col_max)) + margin,
+                               static_cast<int>(src_image.GetWidth()));
+  const int row_end = std::min(static_cast<int>(std::ceil(row_max)) + margin,
+                               static_cast<int>(src_image.GetHeight()));
+  *width = col_end - *col;
+  *height = row_end - *row;
+  return *width > 0 && *height > 0;
+}
+
+}  // namespace
 
 PatchMatch::PatchMatch(const PatchMatchOptions& options, const Problem& problem)
     : options_(options), problem_(problem) {}
@@ -52,6 +183,7 @@ void PatchMatchOptions::Print() const {
   PrintHeading2("PatchMatchOptions");
   PrintOption(max_image_size);
   PrintOption(gpu_index);
+  PrintOption(num_problems_per_gpu);
   PrintOption(depth_min);
   PrintOption(depth_max);
   PrintOption(window_radius);
@@ -63,6 +195,13 @@ void PatchMatchOptions::Print() const {
   PrintOption(min_triangulation_angle);
   PrintOption(incident_angle_sigma);
   PrintOption(num_iterations);
+  PrintOption(num_coarse_levels);
+  PrintOption(num_coarse_to_fine_iterations);
+  PrintOption(max_tile_size);
+  PrintOption(tile_overlap);
+  PrintOption(init_from_sparse_points);
+  PrintOption(sparse_prior_cell_size);
+  PrintOption(sparse_prior_depth_margin);
   PrintOption(geom_consistency);
   PrintOption(geom_consistency_regularizer);
   PrintOption(geom_consistency_max_cost);
@@ -72,6 +211,10 @@ void PatchMatchOptions::Print() const {
   PrintOption(filter_min_num_consistent);
   PrintOption(filter_geom_consistency_max_cost);
   PrintOption(write_consistency_graph);
+  PrintOption(pack_consistency_graph);
+  PrintOption(write_compressed_maps);
+  PrintOption(pipeline_geom_consistency);
+  PrintOption(cache_images);
   PrintOption(allow_missing_files);
 }
 
@@ -149,6 +292,23 @@ void PatchMatch::Check() const {
     CHECK_EQ(ref_image.GetWidth(), ref_normal_map.GetWidth());
     CHECK_EQ(ref_image.GetHeight(), ref_normal_map.GetHeight());
   }
+
+  CHECK_EQ(problem_.init_depth_map == nullptr,
+           problem_.init_normal_map == nullptr);
+  if (problem_.init_depth_map != nullptr) {
+    const Image& ref_image = problem_.images->at(problem_.ref_image_idx);
+    CHECK_EQ(ref_image.GetWidth(), problem_.init_depth_map->GetWidth());
+    CHECK_EQ(ref_image.GetHeight(), problem_.init_depth_map->GetHeight());
+    CHECK_EQ(ref_image.GetWidth(), problem_.init_normal_map->GetWidth());
+    CHECK_EQ(ref_image.GetHeight(), problem_.init_normal_map->GetHeight());
+  }
+
+  if (problem_.init_depth_ranges != nullptr) {
+    const Image& ref_image = problem_.images->at(problem_.ref_image_idx);
+    CHECK_EQ(ref_image.GetWidth(), problem_.init_depth_ranges->GetWidth());
+    CHECK_EQ(ref_image.GetHeight(), problem_.init_depth_ranges->GetHeight());
+    CHECK_EQ(problem_.init_depth_ranges->GetDepth(), 2);
+  }
 }
 
 void PatchMatch::Run() {
@@ -156,27 +316,327 @@ void PatchMatch::Run() {
 
   Check();
 
-  patch_match_cuda_ = std::make_unique<PatchMatchCuda>(options_, problem_);
+  const Image& ref_image = problem_.images->at(problem_.ref_image_idx);
+  if (options_.max_tile_size > 0 &&
+      (ref_image.GetWidth() > static_cast<size_t>(options_.max_tile_size) ||
+       ref_image.GetHeight() > static_cast<size_t>(options_.max_tile_size))) {
+    RunTiled();
+    return;
+  }
+
+  RunProblem(options_, problem_);
+}
+
+void PatchMatch::RunProblem(const PatchMatchOptions& options,
+                            const Problem& problem) {
+  if (options.num_coarse_levels > 0 && !options.geom_consistency) {
+    RunCoarseToFine(options, problem);
+    return;
+  }
+
+  Problem init_problem = problem;
+  Mat<float> init_depth_ranges;
+  if (ComputeInitDepthRanges(init_problem, &init_depth_ranges)) {
+    init_problem.init_depth_ranges = &init_depth_ranges;
+  }
+
+  patch_match_cuda_ = std::make_unique<PatchMatchCuda>(options, init_problem);
   patch_match_cuda_->Run();
 }
 
+void PatchMatch::RunCoarseToFine(const PatchMatchOptions& options,
+                                 const Problem& problem) {
+  std::vector<int> image_idxs = problem.src_image_idxs;
+  image_idxs.push_back(problem.ref_image_idx);
+
+  DepthMap init_depth_map;
+  NormalMap init_normal_map;
+  Mat<float> init_depth_ranges;
+  for (int level = options.num_coarse_levels; level >= 0; --level) {
+    PatchMatchOptions level_options = options;
+    Problem level_problem = problem;
+
+    // Only the images of the problem are rescaled, since the others have no
+    // bitmaps and are not used by the problem.
+    std::vector<Image> level_images;
+    if (level > 0) {
+      level_images = *problem.images;
+      for (const int image_idx : image_idxs) {
+        level_images.at(image_idx).Rescale(1.0f / (1 << level));
+      }
+      level_problem.images = &level_images;
+      // Filtered pixels would leave holes in the initialization of the next
+      // finer level, so the maps are only filtered at the finest level.
+      level_options.filter = false;
+    }
+
+    const Image& ref_image =
+        level_problem.images->at(level_problem.ref_image_idx);
+    LOG(INFO) << StringPrintf("Coarse-to-fine level %d (%dx%d)",
+                              level,
+                              static_cast<int>(ref_image.GetWidth()),
+                              static_cast<int>(ref_image.GetHeight()));
+
+    if (level < options.num_coarse_levels) {
+      init_depth_map = DepthMap(UpsampleNearest(init_depth_map,
+                                                ref_image.GetWidth(),
+                                                ref_image.GetHeight()),
+                                init_depth_map.GetDepthMin(),
+                                init_depth_map.GetDepthMax());
+      init_normal_map = NormalMap(UpsampleNearest(
+          init_normal_map, ref_image.GetWidth(), ref_image.GetHeight()));
+      level_problem.init_depth_map = &init_depth_map;
+      level_problem.init_normal_map = &init_normal_map;
+      level_options.num_iterations = options.num_coarse_to_fine_iterations;
+    } else if (ComputeInitDepthRanges(level_problem, &init_depth_ranges)) {
+      level_problem.init_depth_ranges = &init_depth_ranges;
+    }
+
+    patch_match_cuda_ =
+        std::make_unique<PatchMatchCuda>(level_options, level_problem);
+    patch_match_cuda_->Run();
+
+    if (level > 0) {
+      init_depth_map = patch_match_cuda_->GetDepthMap();
+      init_normal_map = patch_match_cuda_->GetNormalMap();
+      // The coarse level must not outlive its rescaled images.
+      patch_match_cuda_.reset();
+    }
+  }
+}
+
+void PatchMatch::RunTiled() {
+  const Image& ref_image = problem_.images->at(problem_.ref_image_idx);
+  const int width = ref_image.GetWidth();
+  const int height = ref_image.GetHeight();
+  const int core_size = options_.max_tile_size - 2 * options_.tile_overlap;
+  const int num_tiles_x = (width + core_size - 1) / core_size;
+  const int num_tiles_y = (height + core_size - 1) / core_size;
+
+  tiled_depth_map_ =
+      DepthMap(width, height, options_.depth_min, options_.depth_max);
+  tiled_normal_map_ = NormalMap(width, height);
+  tiled_consistent_image_idxs_.clear();
+
+  for (int tile_y = 0; tile_y < num_tiles_y; ++tile_y) {
+    for (int tile_x = 0; tile_x < num_tiles_x; ++tile_x) {
+      // The core of the tile is kept, while its overlap with the neighboring
+      // tiles only provides context for the propagation of the depths.
+      const int core_col = tile_x * core_size;
+      const int core_row = tile_y * core_size;
+      const int core_width = std::min(core_size, width - core_col);
+      const int core_height = std::min(core_size, height - core_row);
+      const int tile_col = std::max(core_col - options_.tile_overlap, 0);
+      const int tile_row = std::max(core_row - options_.tile_overlap, 0);
+      const int tile_width =
+          std::min(core_col + core_width + options_.tile_overlap, width) -
+          tile_col;
+      const int tile_height =
+          std::min(core_row + core_height + options_.tile_overlap, height) -
+          tile_row;
+
+      LOG(INFO) << StringPrintf("Tile %d / %d at (%d, %d) (%dx%d)",
+                                tile_y * num_tiles_x + tile_x + 1,
+                                num_tiles_x * num_tiles_y,
+                                tile_col,
+                                tile_row,
+                                tile_width,
+                                tile_height);
+
+      // Only the images of the problem are cropped, all others are empty.
+      std::vector<Image> tile_images(problem_.images->size());
+      std::vector<DepthMap> tile_depth_maps;
+      std::vector<NormalMap> tile_normal_maps;
+      if (options_.geom_consistency) {
+        tile_depth_maps.resize(problem_.images->size());
+        tile_normal_maps.resize(problem_.images->size());
+      }
+
+      Problem tile_problem = problem_;
+      tile_problem.images = &tile_images;
+      tile_problem.depth_maps = &tile_depth_maps;
+      tile_problem.normal_maps = &tile_normal_maps;
+      tile_problem.src_image_idxs.clear();
+
+      const int ref_image_idx = problem_.ref_image_idx;
+      tile_images[ref_image_idx] =
+          ref_image.Crop(tile_col, tile_row, tile_width, tile_height);
+      if (options_.geom_consistency) {
+        const DepthMap& depth_map = problem_.depth_maps->at(ref_image_idx);
+        tile_depth_maps[ref_image_idx] = DepthMap(
+            CropMat(depth_map, tile_col, tile_row, tile_width, tile_height),
+            depth_map.GetDepthMin(),
+            depth_map.GetDepthMax());
+        tile_normal_maps[ref_image_idx] =
+            NormalMap(CropMat(problem_.normal_maps->at(ref_image_idx),
+                              tile_col,
+                              tile_row,
+                              tile_width,
+                              tile_height));
+      }
+
+      DepthMap tile_init_depth_map;
+      NormalMap tile_init_normal_map;
+      if (problem_.init_depth_map != nullptr) {
+        tile_init_depth_map = DepthMap(CropMat(*problem_.init_depth_map,
+                                               tile_col,
+                                               tile_row,
+                                               tile_width,
+                                               tile_height),
+                                       problem_.init_depth_map->GetDepthMin(),
+                                       problem_.init_depth_map->GetDepthMax());
+        tile_init_normal_map = NormalMap(CropMat(*problem_.init_normal_map,
+                                                 tile_col,
+                                                 tile_row,
+                                                 tile_width,
+                                                 tile_height));
+        tile_problem.init_depth_map = &tile_init_depth_map;
+        tile_problem.init_normal_map = &tile_init_normal_map;
+      }
+
+      // Only the regions of the source images, which observe the tile, are
+      // loaded and the source images without any overlap are skipped.
+      for (const int src_image_idx : problem_.src_image_idxs) {
+        const Image& src_image = problem_.images->at(src_image_idx);
+        int src_col = 0;
+        int src_row = 0;
+        int src_width = 0;
+        int src_height = 0;
+        if (!ComputeSrcImageRegion(options_,
+                                   tile_images[ref_image_idx],
+                                   src_image,
+                                   &src_col,
+                                   &src_row,
+                                   &src_width,
+                                   &src_height)) {
+          continue;
+        }
+        tile_problem.src_image_idxs.push_back(src_image_idx);
+        tile_images[src_image_idx] =
+            src_image.Crop(src_col, src_row, src_width, src_height);
+        if (options_.geom_consistency) {
+          const DepthMap& depth_map = problem_.depth_maps->at(src_image_idx);
+          tile_depth_maps[src_image_idx] = DepthMap(
+              CropMat(depth_map, src_col, src_row, src_width, src_height),
+              depth_map.GetDepthMin(),
+              depth_map.GetDepthMax());
+        }
+      }
+
+      if (tile_problem.src_image_idxs.empty()) {
+        LOG(WARNING) << "Skipping tile without overlapping source images";
+        continue;
+      }
+
+      PatchMatchOptions tile_options = options_;
+      tile_options.filter_min_num_consistent =
+          std::min(static_cast<int>(tile_problem.src_image_idxs.size()),
+                   tile_options.filter_min_num_consistent);
+
+      RunProblem(tile_options, tile_problem);
+
+      // Stitch the cores of the tiles.
+      const int core_offset_x = core_col - tile_col;
+      const int core_offset_y = core_row - tile_row;
+      const DepthMap tile_depth_map = patch_match_cuda_->GetDepthMap();
+      const NormalMap tile_normal_map = patch_match_cuda_->GetNormalMap();
+      for (int row = 0; row < core_height; ++row) {
+        for (int col = 0; col < core_width; ++col) {
+          tiled_depth_map_.Set(
+              core_row + row,
+              core_col + col,
+              tile_depth_map.Get(core_offset_y + row, core_offset_x + col));
+          for (int d = 0; d < 3; ++d) {
+            tiled_normal_map_.Set(core_row + row,
+                                  core_col + col,
+                                  d,
+                                  tile_normal_map.Get(core_offset_y + row,
+                                                      core_offset_x + col,
+                                                      d));
+          }
+        }
+      }
+
+      // The consistent images are listed per pixel as col, row, N, and the N
+      // image indices, see `ConsistencyGraph`.
+      const std::vector<int> tile_consistent_image_idxs =
+          patch_match_cuda_->GetConsistentImageIdxs();
+      for (size_t i = 0; i < tile_consistent_image_idxs.size();) {
+        const int col = tile_consistent_image_idxs[i] - core_offset_x;
+        const int row = tile_consistent_image_idxs[i + 1] - core_offset_y;
+        const int num_images = tile_consistent_image_idxs[i + 2];
+        if (col >= 0 && row >= 0 && col < core_width && row < core_height) {
+          tiled_consistent_image_idxs_.push_back(core_col + col);
+          tiled_consistent_image_idxs_.push_back(core_row + row);
+          tiled_consistent_image_idxs_.insert(
+              tiled_consistent_image_idxs_.end(),
+              tile_consistent_image_idxs.begin() + i + 2,
+              tile_consistent_image_idxs.begin() + i + 3 + num_images);
+        }
+        i += 3 + num_images;
+      }
+
+      // The tile must not outlive its cropped images.
+      patch_match_cuda_.reset();
+    }
+  }
+
+  tiled_ = true;
+}
+
+bool PatchMatch::ComputeInitDepthRanges(const Problem& problem,
+                                        Mat<float>* depth_ranges) const {
+  if (!options_.init_from_sparse_points || options_.geom_consistency ||
+      problem.points == nullptr || problem.init_depth_map != nullptr) {
+    return false;
+  }
+
+  SparseDepthPriorOptions prior_options;
+  prior_options.cell_size = options_.sparse_prior_cell_size;
+  prior_options.depth_margin = options_.sparse_prior_depth_margin;
+  prior_options.depth_min = options_.depth_min;
+  prior_options.depth_max = options_.depth_max;
+  *depth_ranges =
+      ComputeSparseDepthPriors(prior_options,
+                               problem.images->at(problem.ref_image_idx),
+                               problem.ref_image_idx,
+                               *problem.points);
+  return true;
+}
+
 DepthMap PatchMatch::GetDepthMap() const {
+  if (tiled_) {
+    return tiled_depth_map_;
+  }
   return patch_match_cuda_->GetDepthMap();
 }
 
 NormalMap PatchMatch::GetNormalMap() const {
+  if (tiled_) {
+    return tiled_normal_map_;
+  }
   return patch_match_cuda_->GetNormalMap();
 }
 
 Mat<float> PatchMatch::GetSelProbMap() const {
+  CHECK(!tiled_) << "The selection probabilities of tiled reference images "
+                    "are not retained";
   return patch_match_cuda_->GetSelProbMap();
 }
 
 ConsistencyGraph PatchMatch::GetConsistencyGraph() const {
   const auto& ref_image = problem_.images->at(problem_.ref_image_idx);
-  return ConsistencyGraph(ref_image.GetWidth(),
-                          ref_image.GetHeight(),
-                          patch_match_cuda_->GetConsistentImageIdxs());
+  const std::vector<int> consistent_image_idxs =
+      tiled_ ? tiled_consistent_image_idxs_
+             : patch_match_cuda_->GetConsistentImageIdxs();
+  if (options_.pack_consistency_graph) {
+    return ConsistencyGraph(ref_image.GetWidth(),
+                            ref_image.GetHeight(),
+                            consistent_image_idxs,
+                            problem_.src_image_idxs);
+  }
+  return ConsistencyGraph(
+      ref_image.GetWidth(), ref_image.GetHeight(), consistent_image_idxs);
 }
 
 PatchMatchController::PatchMatchController(const PatchMatchOptions& options,
@@ -205,26 +665,130 @@ void PatchMatchController::Run() {
     auto photometric_options = options_;
     photometric_options.geom_consistency = false;
     photometric_options.filter = false;
-
-    for (size_t problem_idx = 0; problem_idx < problems_.size();
-         ++problem_idx) {
-      thread_pool_->AddTask(&PatchMatchController::ProcessProblem,
-                            this,
-                            photometric_options,
-                            problem_idx);
+    if (options_.pipeline_geom_consistency) {
+      ProcessProblemsPipelined(photometric_options);
+      GetTimer().PrintMinutes();
+      return;
     }
-
-    thread_pool_->Wait();
+    ProcessProblems(photometric_options);
   }
 
+  ProcessProblems(options_);
+
+  GetTimer().PrintMinutes();
+}
+
+std::vector<std::vector<int>> PatchMatchController::GetProblemImageIdxs()
+    const {
+  std::vector<std::vector<int>> problem_image_idxs(problems_.size());
   for (size_t problem_idx = 0; problem_idx < problems_.size(); ++problem_idx) {
-    thread_pool_->AddTask(
-        &PatchMatchController::ProcessProblem, this, options_, problem_idx);
+    const auto& problem = problems_[problem_idx];
+    problem_image_idxs[problem_idx] = problem.src_image_idxs;
+    problem_image_idxs[problem_idx].push_back(problem.ref_image_idx);
+  }
+  return problem_image_idxs;
+}
+
+void PatchMatchController::ProcessProblems(const PatchMatchOptions& options) {
+  const std::vector<std::vector<int>> problem_image_idxs =
+      GetProblemImageIdxs();
+
+  const int num_workers = static_cast<int>(gpu_indices_.size());
+  PatchMatchScheduler scheduler(problem_image_idxs, num_workers);
+  for (int worker_idx = 0; worker_idx < num_workers; ++worker_idx) {
+    thread_pool_->AddTask([&, worker_idx]() {
+      int problem_idx;
+      while ((problem_idx = scheduler.Next(worker_idx)) != -1) {
+        const int next_problem_idx = scheduler.PeekNext(worker_idx);
+        ProcessProblem(options,
+                       problem_idx,
+                       next_problem_idx == -1
+                           ? std::vector<int>()
+                           : problem_image_idxs[next_problem_idx]);
+      }
+    });
   }
 
   thread_pool_->Wait();
+}
 
-  GetTimer().PrintMinutes();
+void PatchMatchController::ProcessProblemsPipelined(
+    const PatchMatchOptions& photometric_options) {
+  const std::vector<std::vector<int>> problem_image_idxs =
+      GetProblemImageIdxs();
+
+  const int num_workers = static_cast<int>(gpu_indices_.size());
+  PatchMatchScheduler photometric_scheduler(problem_image_idxs, num_workers);
+  PatchMatchScheduler geometric_scheduler(problem_image_idxs, num_workers);
+
+  const auto is_geometric_ready = [&](const int problem_idx) {
+    for (const int image_idx : problem_image_idxs[problem_idx]) {
+      if (!workspace_->HasCachedMaps(image_idx)) {
+        return false;
+      }
+    }
+    return true;
+  };
+
+  std::mutex photometric_mutex;
+  std::condition_variable photometric_finished_condition;
+  size_t num_photometric_finished = 0;
+
+  for (int worker_idx = 0; worker_idx < num_workers; ++worker_idx) {
+    thread_pool_->AddTask([&, worker_idx]() {
+      while (true) {
+        int problem_idx =
+            geometric_scheduler.NextReady(worker_idx, is_geometric_ready);
+        if (problem_idx != -1) {
+          ProcessProblem(options_, problem_idx, {});
+          continue;
+        }
+
+        problem_idx = photometric_scheduler.Next(worker_idx);
+        if (problem_idx != -1) {
+          const int next_problem_idx =
+              photometric_scheduler.PeekNext(worker_idx);
+          ProcessProblem(photometric_options,
+                         problem_idx,
+                         next_problem_idx == -1
+                             ? std::vector<int>()
+                             : problem_image_idxs[next_problem_idx]);
+          {
+            std::lock_guard<std::mutex> lock(photometric_mutex);
+            num_photometric_finished += 1;
+          }
+          photometric_finished_condition.notify_all();
+          continue;
+        }
+
+        // All photometric problems are scheduled, but the photometric
+        // problems of the other workers might still make geometric problems
+        // ready, so wait for them to finish.
+        std::unique_lock<std::mutex> lock(photometric_mutex);
+        if (num_photometric_finished == problems_.size()) {
+          break;
+        }
+        const size_t prev_num_photometric_finished = num_photometric_finished;
+        photometric_finished_condition.wait(lock, [&]() {
+          return num_photometric_finished != prev_num_photometric_finished;
+        });
+      }
+
+      // The photometric maps of the remaining geometric problems were evicted
+      // from the cache and are read back from disk.
+      int problem_idx;
+      while ((problem_idx = geometric_scheduler.Next(worker_idx)) != -1) {
+        const int next_problem_idx = geometric_scheduler.PeekNext(worker_idx);
+        ProcessProblem(options_,
+                       problem_idx,
+                       next_problem_idx == -1
+                           ? std::vector<int>()
+                           : problem_image_idxs[next_problem_idx]);
+      }
+    });
+  }
+
+  thread_pool_->Wait();
 }
 
 void PatchMatchController::ReadWorkspace() {
@@ -242,6 +806,7 @@ void PatchMatchController::ReadWorkspace() {
   workspace_options.max_image_size = options_.max_image_size;
   workspace_options.image_as_rgb = false;
   workspace_options.cache_size = options_.cache_size;
+  workspace_options.cache_images = options_.cache_images;
   workspace_options.workspace_path = workspace_path_;
   workspace_options.workspace_format = workspace_format_;
   workspace_options.input_type = options_.geom_consistency ? "photometric" : "";
@@ -401,10 +966,23 @@ void PatchMatchController::ReadGpuIndices() {
     gpu_indices_.resize(num_cuda_devices);
     std::iota(gpu_indices_.begin(), gpu_indices_.end(), 0);
   }
+
+  // Each worker thread processes one problem at a time on its GPU.
+  CHECK_GT(options_.num_problems_per_gpu, 0);
+  std::vector<int> worker_gpu_indices;
+  worker_gpu_indices.reserve(gpu_indices_.size() *
+                             options_.num_problems_per_gpu);
+  for (const int gpu_index : gpu_indices_) {
+    worker_gpu_indices.insert(
+        worker_gpu_indices.end(), options_.num_problems_per_gpu, gpu_index);
+  }
+  gpu_indices_ = std::move(worker_gpu_indices);
 }
 
-void PatchMatchController::ProcessProblem(const PatchMatchOptions& options,
-                                          const size_t problem_idx) {
+void PatchMatchController::ProcessProblem(
+    const PatchMatchOptions& options,
+    const size_t problem_idx,
+    const std::vector<int>& prefetch_image_idxs) {
   if (IsStopped()) {
     return;
   }
@@ -469,6 +1047,9 @@ void PatchMatchController::ProcessProblem(const PatchMatchOptions& options,
   problem.images = &images;
   problem.depth_maps = &depth_maps;
   problem.normal_maps = &normal_maps;
+  if (patch_match_options.init_from_sparse_points) {
+    problem.points = &model.points;
+  }
 
   {
     // Collect all used images in current problem.
@@ -521,6 +1102,22 @@ void PatchMatchController::ProcessProblem(const PatchMatchOptions& options,
     problem.src_image_idxs = src_image_idxs;
   }
 
+  {
+    // Read the inputs of the next problem into the cache of the workspace
+    // while the kernels of the current problem are running.
+    std::vector<int> existing_image_idxs;
+    for (const int image_idx : prefetch_image_idxs) {
+      if (ExistsFile(workspace_->GetBitmapPath(image_idx)) &&
+          (!options.geom_consistency ||
+           (ExistsFile(workspace_->GetDepthMapPath(image_idx)) &&
+            ExistsFile(workspace_->GetNormalMapPath(image_idx))))) {
+        existing_image_idxs.push_back(image_idx);
+      }
+    }
+    workspace_->Prefetch(existing_image_idxs,
+                         /*prefetch_maps=*/options.geom_consistency);
+  }
+
   problem.Print();
   patch_match_options.Print();
 
@@ -532,11 +1129,26 @@ void PatchMatchController::ProcessProblem(const PatchMatchOptions& options,
                             output_type.c_str(),
                             image_name.c_str());
 
-  patch_match.GetDepthMap().Write(depth_map_path);
-  patch_match.GetNormalMap().Write(normal_map_path);
+  auto depth_map = std::make_shared<DepthMap>(patch_match.GetDepthMap());
+  auto normal_map = std::make_shared<NormalMap>(patch_match.GetNormalMap());
+  if (options.write_compressed_maps) {
+    WriteCompressedDepthMap(*depth_map, depth_map_path);
+    WriteCompressedNormalMap(*normal_map, normal_map_path);
+  } else {
+    depth_map->Write(depth_map_path);
+    normal_map->Write(normal_map_path);
+  }
   if (options.write_consistency_graph) {
     patch_match.GetConsistencyGraph().Write(consistency_graph_path);
   }
+
+  // Keep the photometric maps for the pipelined geometric pass. They are
+  // cached after writing them, so that they can always be read back.
+  if (options_.geom_consistency && options_.pipeline_geom_consistency &&
+      !options.geom_consistency) {
+    workspace_->SetMaps(
+        problem.ref_image_idx, std::move(depth_map), std::move(normal_map));
+  }
 }
 
 }  // namespace mvs
@@ -49,9 +49,9 @@ namespace mvs {
 // arises from the shared memory implementation.
 const static size_t kMaxPatchMatchWindowRadius = 32;
 
+class CachedWorkspace;
 class ConsistencyGraph;
 class PatchMatchCuda;
-class Workspace;
 
 struct PatchMatchOptions {
   // Maximum image size in either dimension.
@@ -61,6 +61,11 @@ struct PatchMatchOptions {
   // you should separate multiple GPU indices by comma, e.g., "0,1,2,3".
   std::string gpu_index = "-1";
 
+  // Number of problems processed concurrently on each GPU. Small images do not
+  // saturate the GPU with a single problem, so that the kernels and transfers
+  // of multiple problems are overlapped on separate streams.
+  int num_problems_per_gpu = 1;
+
   // Depth range in which to randomly sample depth hypotheses.
   double depth_min = -1.0f;
   double depth_max = -1.0f;
@@ -95,6 +100,43 @@ struct PatchMatchOptions {
   // of four sweeps from left to right, top to bottom, and vice versa.
   int num_iterations = 5;
 
+  // Number of coarse levels for the coarse-to-fine estimation of the
+  // photometric depth and normal maps, where every level halves the image
+  // resolution. Only the coarsest level runs the full `num_iterations`, while
+  // every finer level is initialized by upsampling the maps of the previous
+  // level and only runs `num_coarse_to_fine_iterations`. A value of 0 disables
+  // the coarse-to-fine estimation.
+  int num_coarse_levels = 0;
+
+  // Number of coordinate descent iterations at the levels initialized from
+  // the upsampled maps of the next coarser level.
+  int num_coarse_to_fine_iterations = 2;
+
+  // Maximum width and height of the tiles of the reference image. Larger
+  // reference images are processed in overlapping tiles, each with only the
+  // regions of the source images that observe the tile within the depth
+  // range, so that the GPU memory is bounded by the tile size instead of the
+  // image size. A value of -1 disables the tiling.
+  int max_tile_size = -1;
+
+  // Number of pixels, by which the tiles are extended on each side to overlap
+  // their neighbors. Only the depths and normals of a tile outside of its
+  // overlap are kept, so the overlap should cover the patch window and the
+  // propagation of the depths across the tile borders.
+  int tile_overlap = 64;
+
+  // Whether to initialize the photometric depths around the projected sparse
+  // points of the reference image instead of uniformly within the depth
+  // range, see `ComputeSparseDepthPriors`. The random depth hypotheses of each
+  // pixel are then sampled in a range around the depths of the nearby sparse
+  // points, which converges in fewer iterations for narrow depth bands.
+  bool init_from_sparse_points = false;
+
+  // Size of the grid cells in pixels, in which the sparse points are
+  // rasterized, and the relative margin of their depth ranges.
+  int sparse_prior_cell_size = 16;
+  double sparse_prior_depth_margin = 0.1;
+
   // Whether to add a regularized geometric consistency term to the cost
   // function. If true, the `depth_maps` and `normal_maps` must not be null.
   bool geom_consistency = true;
@@ -131,12 +173,34 @@ struct PatchMatchOptions {
   // of memory, if the consistency graph is dense.
   double cache_size = 32.0;
 
+  // Whether to cache the rescaled images in a raw format in the workspace, so
+  // that later runs skip decoding them, see `Workspace::Options`.
+  bool cache_images = false;
+
   // Whether to tolerate missing images/maps in the problem setup
   bool allow_missing_files = false;
 
   // Whether to write the consistency graph.
   bool write_consistency_graph = false;
 
+  // Whether to write the consistency graph in the packed format, which stores
+  // the consistent images of every pixel as a run-length encoded bitmask over
+  // the source images, see `ConsistencyGraph`.
+  bool pack_consistency_graph = false;
+
+  // Whether to write the depth and normal maps in the compressed format, see
+  // `WriteCompressedDepthMap`, which is smaller and faster to read but lossy.
+  bool write_compressed_maps = false;
+
+  // Whether to pipeline the photometric and the geometric pass, if
+  // `geom_consistency` is enabled. The photometric depth and normal maps are
+  // kept in the cache of the workspace, see `cache_size`, and the geometric
+  // pass of a reference image starts as soon as the photometric maps of all
+  // its images are cached instead of after the photometric pass of all
+  // images. The photometric maps are still written, so that the maps evicted
+  // from the cache can be read back.
+  bool pipeline_geom_consistency = false;
+
   void Print() const;
   bool Check() const {
     if (depth_min != -1.0f || depth_max != -1.0f) {
@@ -147,6 +211,7 @@ struct PatchMatchOptions {
                     static_cast<int>(kMaxPatchMatchWindowRadius));
     CHECK_OPTION_GT(sigma_color, 0.0f);
     CHECK_OPTION_GT(window_radius, 0);
+    CHECK_OPTION_GT(num_problems_per_gpu, 0);
     CHECK_OPTION_GT(window_step, 0);
     CHECK_OPTION_LE(window_step, 2);
     CHECK_OPTION_GT(num_samples, 0);
@@ -155,6 +220,14 @@ struct PatchMatchOptions {
     CHECK_OPTION_LT(min_triangulation_angle, 180.0f);
     CHECK_OPTION_GT(incident_angle_sigma, 0.0f);
     CHECK_OPTION_GT(num_iterations, 0);
+    CHECK_OPTION_GE(num_coarse_levels, 0);
+    CHECK_OPTION_GT(num_coarse_to_fine_iterations, 0);
+    if (max_tile_size != -1) {
+      CHECK_OPTION_GE(tile_overlap, 0);
+      CHECK_OPTION_GT(max_tile_size, 2 * tile_overlap);
+    }
+    CHECK_OPTION_GT(sparse_prior_cell_size, 0);
+    CHECK_OPTION_GE(sparse_prior_depth_margin, 0.0f);
     CHECK_OPTION_GE(geom_consistency_regularizer, 0.0f);
     CHECK_OPTION_GE(geom_consistency_max_cost, 0.0f);
     CHECK_OPTION_GE(filter_min_ncc, -1.0f);
@@ -189,6 +262,22 @@ class PatchMatch {
     // Input normal maps for the geometric consistency term.
     std::vector<NormalMap>* normal_maps = nullptr;
 
+    // Optional initial depth and normal maps of the reference image for the
+    // photometric consistency term. If null, the maps are initialized
+    // randomly. Ignored, if the geometric consistency term is enabled.
+    const DepthMap* init_depth_map = nullptr;
+    const NormalMap* init_normal_map = nullptr;
+
+    // Optional sparse points of the model, which are projected into the
+    // reference image to compute the per-pixel depth ranges of the random
+    // initialization, if `init_from_sparse_points` is enabled.
+    const std::vector<Model::Point>* points = nullptr;
+
+    // Optional per-pixel depth ranges of the reference image as the two
+    // slices {depth_min, depth_max}, in which the random initial depths are
+    // sampled. Ignored, if initial depth and normal maps are given.
+    const Mat<float>* init_depth_ranges = nullptr;
+
     // Print the configuration to stdout.
     void Print() const;
   };
@@ -209,9 +298,33 @@ class PatchMatch {
   Mat<float> GetSelProbMap() const;
 
  private:
+  // Estimate the maps of the problem, optionally from coarse to fine.
+  void RunProblem(const PatchMatchOptions& options, const Problem& problem);
+
+  // Estimate the photometric maps from the coarsest to the finest level.
+  void RunCoarseToFine(const PatchMatchOptions& options,
+                       const Problem& problem);
+
+  // Estimate the maps in overlapping tiles of the reference image and stitch
+  // them, see `PatchMatchOptions::max_tile_size`.
+  void RunTiled();
+
+  // Compute the per-pixel depth ranges of the random initialization from the
+  // sparse points of the problem. Returns false, if the depths are not
+  // initialized from the sparse points.
+  bool ComputeInitDepthRanges(const Problem& problem,
+                              Mat<float>* depth_ranges) const;
+
   const PatchMatchOptions options_;
   const Problem problem_;
   std::unique_ptr<PatchMatchCuda> patch_match_cuda_;
+
+  // The stitched maps and consistent images of the tiles, if the reference
+  // image is processed in tiles.
+  bool tiled_ = false;
+  DepthMap tiled_depth_map_;
+  NormalMap tiled_normal_map_;
+  std::vector<int> tiled_consistent_image_idxs_;
 };
 
 // This thread processes all problems in a workspace. A workspace has the
@@ -258,7 +371,20 @@ class PatchMatchController : public Thread {
   void ReadWorkspace();
   void ReadProblems();
   void ReadGpuIndices();
-  void ProcessProblem(const PatchMatchOptions& options, size_t problem_idx);
+  // The images of every problem, i.e., its source and reference images.
+  std::vector<std::vector<int>> GetProblemImageIdxs() const;
+  // Process all problems with one worker per GPU, see `PatchMatchScheduler`.
+  void ProcessProblems(const PatchMatchOptions& options);
+  // Process the photometric and the geometric pass of all problems in a
+  // pipeline, see `PatchMatchOptions::pipeline_geom_consistency`. Whenever
+  // the photometric maps of all images of a problem are cached, the worker
+  // processes its geometric pass before the next photometric problem.
+  void ProcessProblemsPipelined(const PatchMatchOptions& photometric_options);
+  // Process the problem and prefetch the given images of the problem that is
+  // likely processed next, while the current problem is processed.
+  void ProcessProblem(const PatchMatchOptions& options,
+                      size_t problem_idx,
+                      const std::vector<int>& prefetch_image_idxs);
 
   const PatchMatchOptions options_;
   const std::string workspace_path_;
@@ -268,7 +394,7 @@ class PatchMatchController : public Thread {
 
   std::unique_ptr<ThreadPool> thread_pool_;
   std::mutex workspace_mutex_;
-  std::unique_ptr<Workspace> workspace_;
+  std::unique_ptr<CachedWorkspace> workspace_;
   std::vector<PatchMatch::Problem> problems_;
   std::vector<int> gpu_indices_;
   std::vector<std::pair<float, float>> depth_ranges_;
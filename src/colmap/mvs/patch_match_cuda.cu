@@ -53,10 +53,15 @@
 namespace colmap {
 namespace mvs {
 
-// Calibration of reference image as {fx, cx, fy, cy}.
-__constant__ float ref_K[4];
-// Calibration of reference image as {1/fx, -cx/fx, 1/fy, -cy/fy}.
-__constant__ float ref_inv_K[4];
+// Calibration of the reference image in its current rotation. It is passed to
+// the kernels by value instead of residing in constant memory, since multiple
+// problems may run concurrently on the same device.
+struct RefCalibration {
+  // Calibration as {fx, cx, fy, cy}.
+  float K[4];
+  // Calibration as {1/fx, -cx/fx, 1/fy, -cy/fy}.
+  float inv_K[4];
+};
 
 __device__ inline void Mat33DotVec3(const float mat[9],
                                     const float vec[3],
@@ -84,8 +89,7 @@ __device__ inline float GenerateRandomDepth(const float depth_min,
   return curand_uniform(rand_state) * (depth_max - depth_min) + depth_min;
 }
 
-__device__ inline void GenerateRandomNormal(const int row,
-                                            const int col,
+__device__ inline void GenerateRandomNormal(const float view_ray[3],
                                             curandState* rand_state,
                                             float normal[3]) {
   // Unbiased sampling of normal, according to George Marsaglia, "Choosing a
@@ -105,9 +109,6 @@ __device__ inline void GenerateRandomNormal(const int row,
   normal[2] = 1.0f - 2.0f * s;
 
   // Make sure normal is looking away from camera.
-  const float view_ray[3] = {ref_inv_K[0] * col + ref_inv_K[1],
-                             ref_inv_K[2] * row + ref_inv_K[3],
-                             1.0f};
   if (DotProduct3(normal, view_ray) > 0) {
     normal[0] = -normal[0];
     normal[1] = -normal[1];
@@ -123,8 +124,7 @@ __device__ inline float PerturbDepth(const float perturbation,
   return GenerateRandomDepth(depth_min, depth_max, rand_state);
 }
 
-__device__ inline void PerturbNormal(const int row,
-                                     const int col,
+__device__ inline void PerturbNormal(const float view_ray[3],
                                      const float perturbation,
                                      const float normal[3],
                                      curandState* rand_state,
@@ -159,14 +159,10 @@ __device__ inline void PerturbNormal(const int row,
 
   // Make sure the perturbed normal is still looking in the same direction as
   // the viewing direction, otherwise try again but with smaller perturbation.
-  const float view_ray[3] = {ref_inv_K[0] * col + ref_inv_K[1],
-                             ref_inv_K[2] * row + ref_inv_K[3],
-                             1.0f};
   if (DotProduct3(perturbed_normal, view_ray) >= 0.0f) {
     const int kMaxNumTrials = 3;
     if (num_trials < kMaxNumTrials) {
-      PerturbNormal(row,
-                    col,
+      PerturbNormal(view_ray,
                     0.5f * perturbation,
                     normal,
                     rand_state,
@@ -188,7 +184,8 @@ __device__ inline void PerturbNormal(const int row,
   perturbed_normal[2] *= inv_norm;
 }
 
-__device__ inline void ComputePointAtDepth(const float row,
+__device__ inline void ComputePointAtDepth(const float ref_inv_K[4],
+                                           const float row,
                                            const float col,
                                            const float depth,
                                            float point[3]) {
@@ -197,10 +194,21 @@ __device__ inline void ComputePointAtDepth(const float row,
   point[2] = depth;
 }
 
+// Compute the viewing ray with unit z-component of a reference pixel.
+__device__ inline void ComputeViewRay(const float ref_inv_K[4],
+                                      const int row,
+                                      const int col,
+                                      float view_ray[3]) {
+  view_ray[0] = ref_inv_K[0] * col + ref_inv_K[1];
+  view_ray[1] = ref_inv_K[2] * row + ref_inv_K[3];
+  view_ray[2] = 1.0f;
+}
+
 // Transfer depth on plane from viewing ray at row1 to row2. The returned
 // depth is the intersection of the viewing ray through row2 with the plane
 // at row1 defined by the given depth and normal.
-__device__ inline float PropagateDepth(const float depth1,
+__device__ inline float PropagateDepth(const float ref_inv_K[4],
+                                       const float depth1,
                                        const float normal1[3],
                                        const float row1,
                                        const float row2) {
@@ -260,8 +268,58 @@ __device__ inline void ComputeViewingAngles(
   *cos_triangulation_angle = DotProduct3(SX, point) * RX_inv_norm * SX_inv_norm;
 }
 
+// Compose the homography induced by the plane at the given depth and normal of
+// the reference pixel, where the source calibration K is given as {fx, cx, fy,
+// cy} and the inverse reference calibration as {1/fx, -cx/fx, 1/fy, -cy/fy}.
+__device__ inline void ComposeHomography(const float K[4],
+                                         const float R[9],
+                                         const float T[3],
+                                         const float inv_K_ref[4],
+                                         const int row,
+                                         const int col,
+                                         const float depth,
+                                         const float normal[3],
+                                         float H[9]) {
+  // Distance to the plane.
+  const float dist =
+      depth * (normal[0] * (inv_K_ref[0] * col + inv_K_ref[1]) +
+               normal[1] * (inv_K_ref[2] * row + inv_K_ref[3]) + normal[2]);
+  const float inv_dist = 1.0f / dist;
+
+  const float inv_dist_N0 = inv_dist * normal[0];
+  const float inv_dist_N1 = inv_dist * normal[1];
+  const float inv_dist_N2 = inv_dist * normal[2];
+
+  // Homography as H = K * (R - T * n' / d) * Kref^-1.
+  H[0] = inv_K_ref[0] * (K[0] * (R[0] + inv_dist_N0 * T[0]) +
+                         K[1] * (R[6] + inv_dist_N0 * T[2]));
+  H[1] = inv_K_ref[2] * (K[0] * (R[1] + inv_dist_N1 * T[0]) +
+                         K[1] * (R[7] + inv_dist_N1 * T[2]));
+  H[2] = K[0] * (R[2] + inv_dist_N2 * T[0]) +
+         K[1] * (R[8] + inv_dist_N2 * T[2]) +
+         inv_K_ref[1] * (K[0] * (R[0] + inv_dist_N0 * T[0]) +
+                         K[1] * (R[6] + inv_dist_N0 * T[2])) +
+         inv_K_ref[3] * (K[0] * (R[1] + inv_dist_N1 * T[0]) +
+                         K[1] * (R[7] + inv_dist_N1 * T[2]));
+  H[3] = inv_K_ref[0] * (K[2] * (R[3] + inv_dist_N0 * T[1]) +
+                         K[3] * (R[6] + inv_dist_N0 * T[2]));
+  H[4] = inv_K_ref[2] * (K[2] * (R[4] + inv_dist_N1 * T[1]) +
+                         K[3] * (R[7] + inv_dist_N1 * T[2]));
+  H[5] = K[2] * (R[5] + inv_dist_N2 * T[1]) +
+         K[3] * (R[8] + inv_dist_N2 * T[2]) +
+         inv_K_ref[1] * (K[2] * (R[3] + inv_dist_N0 * T[1]) +
+                         K[3] * (R[6] + inv_dist_N0 * T[2])) +
+         inv_K_ref[3] * (K[2] * (R[4] + inv_dist_N1 * T[1]) +
+                         K[3] * (R[7] + inv_dist_N1 * T[2]));
+  H[6] = inv_K_ref[0] * (R[6] + inv_dist_N0 * T[2]);
+  H[7] = inv_K_ref[2] * (R[7] + inv_dist_N1 * T[2]);
+  H[8] = R[8] + inv_K_ref[1] * (R[6] + inv_dist_N0 * T[2]) +
+         inv_K_ref[3] * (R[7] + inv_dist_N1 * T[2]) + inv_dist_N2 * T[2];
+}
+
 __device__ inline void ComposeHomography(
     const cudaTextureObject_t poses_texture,
+    const float ref_inv_K[4],
     const int image_idx,
     const int row,
     const int col,
@@ -286,41 +344,7 @@ __device__ inline void ComposeHomography(
     T[i] = tex2D<float>(poses_texture, i + 13, image_idx);
   }
 
-  // Distance to the plane.
-  const float dist =
-      depth * (normal[0] * (ref_inv_K[0] * col + ref_inv_K[1]) +
-               normal[1] * (ref_inv_K[2] * row + ref_inv_K[3]) + normal[2]);
-  const float inv_dist = 1.0f / dist;
-
-  const float inv_dist_N0 = inv_dist * normal[0];
-  const float inv_dist_N1 = inv_dist * normal[1];
-  const float inv_dist_N2 = inv_dist * normal[2];
-
-  // Homography as H = K * (R - T * n' / d) * Kref^-1.
-  H[0] = ref_inv_K[0] * (K[0] * (R[0] + inv_dist_N0 * T[0]) +
-                         K[1] * (R[6] + inv_dist_N0 * T[2]));
-  H[1] = ref_inv_K[2] * (K[0] * (R[1] + inv_dist_N1 * T[0]) +
-                         K[1] * (R[7] + inv_dist_N1 * T[2]));
-  H[2] = K[0] * (R[2] + inv_dist_N2 * T[0]) +
-         K[1] * (R[8] + inv_dist_N2 * T[2]) +
-         ref_inv_K[1] * (K[0] * (R[0] + inv_dist_N0 * T[0]) +
-                         K[1] * (R[6] + inv_dist_N0 * T[2])) +
-         ref_inv_K[3] * (K[0] * (R[1] + inv_dist_N1 * T[0]) +
-                         K[1] * (R[7] + inv_dist_N1 * T[2]));
-  H[3] = ref_inv_K[0] * (K[2] * (R[3] + inv_dist_N0 * T[1]) +
-                         K[3] * (R[6] + inv_dist_N0 * T[2]));
-  H[4] = ref_inv_K[2] * (K[2] * (R[4] + inv_dist_N1 * T[1]) +
-                         K[3] * (R[7] + inv_dist_N1 * T[2]));
-  H[5] = K[2] * (R[5] + inv_dist_N2 * T[1]) +
-         K[3] * (R[8] + inv_dist_N2 * T[2]) +
-         ref_inv_K[1] * (K[2] * (R[3] + inv_dist_N0 * T[1]) +
-                         K[3] * (R[6] + inv_dist_N0 * T[2])) +
-         ref_inv_K[3] * (K[2] * (R[4] + inv_dist_N1 * T[1]) +
-                         K[3] * (R[7] + inv_dist_N1 * T[2]));
-  H[6] = ref_inv_K[0] * (R[6] + inv_dist_N0 * T[2]);
-  H[7] = ref_inv_K[2] * (R[7] + inv_dist_N1 * T[2]);
-  H[8] = R[8] + ref_inv_K[1] * (R[6] + inv_dist_N0 * T[2]) +
-         ref_inv_K[3] * (R[7] + inv_dist_N1 * T[2]) + inv_dist_N2 * T[2];
+  ComposeHomography(K, R, T, ref_inv_K, row, col, depth, normal, H);
 }
 
 // Each thread in the current warp / thread block reads in 3 columns of the
@@ -415,11 +439,13 @@ struct PhotoConsistencyCostComputer {
       const cudaTextureObject_t ref_image_texture,
       const cudaTextureObject_t src_images_texture,
       const cudaTextureObject_t poses_texture,
+      const RefCalibration& ref_calib,
       const float sigma_spatial,
       const float sigma_color)
       : local_ref_image(ref_image_texture),
         src_images_texture_(src_images_texture),
         poses_texture_(poses_texture),
+        ref_calib_(ref_calib),
         bilateral_weight_computer_(sigma_spatial, sigma_color) {}
 
   // Maximum photo consistency cost as 1 - min(NCC).
@@ -451,8 +477,14 @@ struct PhotoConsistencyCostComputer {
 
   __device__ inline float Compute() const {
     float tform[9];
-    ComposeHomography(
-        poses_texture_, src_image_idx, row, col, depth, normal, tform);
+    ComposeHomography(poses_texture_,
+                      ref_calib_.inv_K,
+                      src_image_idx,
+                      row,
+                      col,
+                      depth,
+                      normal,
+                      tform);
 
     float tform_step[8];
     for (int i = 0; i < 8; ++i) {
@@ -553,12 +585,14 @@ struct PhotoConsistencyCostComputer {
  private:
   const cudaTextureObject_t src_images_texture_;
   const cudaTextureObject_t poses_texture_;
+  const RefCalibration& ref_calib_;
   const BilateralWeightComputer bilateral_weight_computer_;
 };
 
 __device__ inline float ComputeGeomConsistencyCost(
     const cudaTextureObject_t poses_texture,
     const cudaTextureObject_t src_depth_maps_texture,
+    const RefCalibration& ref_calib,
     const float row,
     const float col,
     const float depth,
@@ -576,7 +610,7 @@ __device__ inline float ComputeGeomConsistencyCost(
 
   // Project point in reference image to world.
   float forward_point[3];
-  ComputePointAtDepth(row, col, depth, forward_point);
+  ComputePointAtDepth(ref_calib.inv_K, row, col, depth, forward_point);
 
   // Project world point to source image.
   const float inv_forward_z =
@@ -612,10 +646,10 @@ __device__ inline float ComputeGeomConsistencyCost(
   // Project world point back to reference image.
   const float backward_col =
       inv_backward_point_z *
-      (ref_K[0] * backward_point_x + ref_K[1] * backward_point_z);
+      (ref_calib.K[0] * backward_point_x + ref_calib.K[1] * backward_point_z);
   const float backward_row =
       inv_backward_point_z *
-      (ref_K[2] * backward_point_y + ref_K[3] * backward_point_z);
+      (ref_calib.K[2] * backward_point_y + ref_calib.K[3] * backward_point_z);
 
   // Return truncated reprojection error between original observation and
   // the forward-backward projected observation.
@@ -790,15 +824,36 @@ class LikelihoodComputer {
   const float ncc_norm_factor_;
 };
 
+// Sample the initial depth of each pixel uniformly in its depth range, where
+// the ranges are stored as the two slices {depth_min, depth_max}.
+__global__ void InitDepthMapInRanges(GpuMat<float> depth_map,
+                                     GpuMat<curandState> rand_state_map,
+                                     const GpuMat<float> depth_ranges) {
+  const int row = blockDim.y * blockIdx.y + threadIdx.y;
+  const int col = blockDim.x * blockIdx.x + threadIdx.x;
+  if (col < depth_map.GetWidth() && row < depth_map.GetHeight()) {
+    curandState rand_state = rand_state_map.Get(row, col);
+    depth_map.Set(row,
+                  col,
+                  GenerateRandomDepth(depth_ranges.Get(row, col, 0),
+                                      depth_ranges.Get(row, col, 1),
+                                      &rand_state));
+    rand_state_map.Set(row, col, rand_state);
+  }
+}
+
 // Rotate normals by 90deg around z-axis in counter-clockwise direction.
 __global__ void InitNormalMap(GpuMat<float> normal_map,
-                              GpuMat<curandState> rand_state_map) {
+                              GpuMat<curandState> rand_state_map,
+                              const RefCalibration ref_calib) {
   const int row = blockDim.y * blockIdx.y + threadIdx.y;
   const int col = blockDim.x * blockIdx.x + threadIdx.x;
   if (col < normal_map.GetWidth() && row < normal_map.GetHeight()) {
     curandState rand_state = rand_state_map.Get(row, col);
+    float view_ray[3];
+    ComputeViewRay(ref_calib.inv_K, row, col, view_ray);
     float normal[3];
-    GenerateRandomNormal(row, col, &rand_state, normal);
+    GenerateRandomNormal(view_ray, &rand_state, normal);
     normal_map.SetSlice(row, col, normal);
     rand_state_map.Set(row, col, rand_state);
   }
@@ -828,6 +883,7 @@ __global__ void ComputeInitialCost(GpuMat<float> cost_map,
                                    const GpuMat<float> ref_squared_sum_image,
                                    const cudaTextureObject_t src_images_texture,
                                    const cudaTextureObject_t poses_texture,
+                                   const RefCalibration ref_calib,
                                    const float sigma_spatial,
                                    const float sigma_color) {
   const int col = blockDim.x * blockIdx.x + threadIdx.x;
@@ -837,6 +893,7 @@ __global__ void ComputeInitialCost(GpuMat<float> cost_map,
   PhotoConsistencyCostComputerType pcc_computer(ref_image_texture,
                                                 src_images_texture,
                                                 poses_texture,
+                                                ref_calib,
                                                 sigma_spatial,
                                                 sigma_color);
   pcc_computer.col = col;
@@ -908,6 +965,7 @@ __global__ void SweepFromTopToBottom(
     const cudaTextureObject_t src_images_texture,
     const cudaTextureObject_t src_depth_maps_texture,
     const cudaTextureObject_t poses_texture,
+    const RefCalibration ref_calib,
     const SweepOptions options) {
   const int col = blockDim.x * blockIdx.x + threadIdx.x;
 
@@ -955,6 +1013,7 @@ __global__ void SweepFromTopToBottom(
   PhotoConsistencyCostComputerType pcc_computer(ref_image_texture,
                                                 src_images_texture,
                                                 poses_texture,
+                                                ref_calib,
                                                 options.sigma_spatial,
                                                 options.sigma_color);
   pcc_computer.col = col;
@@ -1002,8 +1061,11 @@ __global__ void SweepFromTopToBottom(
     // of the normal of the previous ray. This helps to better estimate
     // the depth of very oblique structures, i.e. pixels whose normal direction
     // is significantly different from their viewing direction.
-    prev_param_state.depth = PropagateDepth(
-        prev_param_state.depth, prev_param_state.normal, row - 1, row);
+    prev_param_state.depth = PropagateDepth(ref_calib.inv_K,
+                                            prev_param_state.depth,
+                                            prev_param_state.normal,
+                                            row - 1,
+                                            row);
 
     // Read parameters for current pixel from previous sweep.
     curr_param_state.depth = depth_map.Get(row, col);
@@ -1012,8 +1074,9 @@ __global__ void SweepFromTopToBottom(
     // Generate random parameters.
     rand_param_state.depth =
         PerturbDepth(options.perturbation, curr_param_state.depth, &rand_state);
-    PerturbNormal(row,
-                  col,
+    float view_ray[3];
+    ComputeViewRay(ref_calib.inv_K, row, col, view_ray);
+    PerturbNormal(view_ray,
                   options.perturbation * M_PI,
                   curr_param_state.normal,
                   &rand_state,
@@ -1023,7 +1086,8 @@ __global__ void SweepFromTopToBottom(
     // modulate selection probabilities with priors.
 
     float point[3];
-    ComputePointAtDepth(row, col, curr_param_state.depth, point);
+    ComputePointAtDepth(
+        ref_calib.inv_K, row, col, curr_param_state.depth, point);
 
     for (int image_idx = 0; image_idx < cost_map.GetDepth(); ++image_idx) {
       const float cost = cost_map.Get(row, col, image_idx);
@@ -1049,6 +1113,7 @@ __global__ void SweepFromTopToBottom(
 
       float H[9];
       ComposeHomography(poses_texture,
+                        ref_calib.inv_K,
                         image_idx,
                         row,
                         col,
@@ -1105,6 +1170,7 @@ __global__ void SweepFromTopToBottom(
             options.geom_consistency_regularizer *
             ComputeGeomConsistencyCost(poses_texture,
                                        src_depth_maps_texture,
+                                       ref_calib,
                                        row,
                                        col,
                                        depths[0],
@@ -1121,6 +1187,7 @@ __global__ void SweepFromTopToBottom(
               options.geom_consistency_regularizer *
               ComputeGeomConsistencyCost(poses_texture,
                                          src_depth_maps_texture,
+                                         ref_calib,
                                          row,
                                          col,
                                          depths[i],
@@ -1168,7 +1235,7 @@ __global__ void SweepFromTopToBottom(
       int num_consistent = 0;
 
       float best_point[3];
-      ComputePointAtDepth(row, col, best_depth, best_point);
+      ComputePointAtDepth(ref_calib.inv_K, row, col, best_depth, best_point);
 
       const float min_ncc_prob =
           likelihood_computer.ComputeNCCProb(1.0f - options.filter_min_ncc);
@@ -1197,6 +1264,7 @@ __global__ void SweepFromTopToBottom(
         } else if (!kFilterPhotoConsistency) {
           if (ComputeGeomConsistencyCost(poses_texture,
                                          src_depth_maps_texture,
+                                         ref_calib,
                                          row,
                                          col,
                                          best_depth,
@@ -1210,6 +1278,7 @@ __global__ void SweepFromTopToBottom(
           if (sel_prob_map.Get(row, col, image_idx) >= min_ncc_prob &&
               ComputeGeomConsistencyCost(poses_texture,
                                          src_depth_maps_texture,
+                                         ref_calib,
                                          row,
                                          col,
                                          best_depth,
@@ -1245,6 +1314,15 @@ __global__ void SweepFromTopToBottom(
   }
 }
 
+RefCalibration MakeRefCalibration(const float K[4], const float inv_K[4]) {
+  RefCalibration ref_calib;
+  for (int i = 0; i < 4; ++i) {
+    ref_calib.K[i] = K[i];
+    ref_calib.inv_K[i] = inv_K[i];
+  }
+  return ref_calib;
+}
+
 PatchMatchCuda::PatchMatchCuda(const PatchMatchOptions& options,
                                const PatchMatch::Problem& problem)
     : options_(options),
@@ -1356,6 +1434,9 @@ void PatchMatchCuda::RunWithWindowSizeAndStep() {
   CudaTimer total_timer;
   CudaTimer init_timer;
 
+  const RefCalibration ref_calib =
+      MakeRefCalibration(ref_K_host_[0], ref_inv_K_host_[0]);
+
   ComputeCudaConfig();
   ComputeInitialCost<kWindowSize, kWindowStep>
       <<<sweep_grid_size_, sweep_block_size_>>>(*cost_map_,
@@ -1366,6 +1447,7 @@ void PatchMatchCuda::RunWithWindowSizeAndStep() {
                                                 *ref_image_->squared_sum_image,
                                                 src_images_texture_->GetObj(),
                                                 poses_texture_[0]->GetObj(),
+                                                ref_calib,
                                                 options_.sigma_spatial,
                                                 options_.sigma_color);
   CUDA_SYNC_AND_CHECK();
@@ -1409,6 +1491,10 @@ void PatchMatchCuda::RunWithWindowSizeAndStep() {
 
       const bool last_sweep = iter == options_.num_iterations - 1 && sweep == 3;
 
+      const RefCalibration rotated_ref_calib =
+          MakeRefCalibration(ref_K_host_[rotation_in_half_pi_],
+                             ref_inv_K_host_[rotation_in_half_pi_]);
+
 #define CALL_SWEEP_FUNC                                   \
   SweepFromTopToBottom<kWindowSize,                       \
                        kWindowStep,                       \
@@ -1432,6 +1518,7 @@ void PatchMatchCuda::RunWithWindowSizeAndStep() {
               ? 0                                         \
               : src_depth_maps_texture_->GetObj(),        \
           poses_texture_[rotation_in_half_pi_]->GetObj(), \
+          rotated_ref_calib,                              \
           sweep_options);
 
       if (last_sweep) {
@@ -1673,15 +1760,6 @@ void PatchMatchCuda::InitTransforms() {
     ref_inv_K_host_[i][3] = -ref_K_host_[i][3] / ref_K_host_[i][2];
   }
 
-  // Bind 0 degrees version to constant global memory.
-  CUDA_SAFE_CALL(cudaMemcpyToSymbol(
-      ref_K, ref_K_host_[0], sizeof(float) * 4, 0, cudaMemcpyHostToDevice));
-  CUDA_SAFE_CALL(cudaMemcpyToSymbol(ref_inv_K,
-                                    ref_inv_K_host_[0],
-                                    sizeof(float) * 4,
-                                    0,
-                                    cudaMemcpyHostToDevice));
-
   //////////////////////////////////////////////////////////////////////////////
   // Generate rotated versions of camera poses.
   //////////////////////////////////////////////////////////////////////////////
@@ -1757,11 +1835,25 @@ void PatchMatchCuda::InitWorkspaceMemory() {
   rand_state_map_.reset(new GpuMatPRNG(ref_width_, ref_height_));
 
   depth_map_.reset(new GpuMat<float>(ref_width_, ref_height_));
+  ComputeCudaConfig();
+
   if (options_.geom_consistency) {
     const DepthMap& init_depth_map =
         problem_.depth_maps->at(problem_.ref_image_idx);
     depth_map_->CopyToDevice(init_depth_map.GetPtr(),
                              init_depth_map.GetWidth() * sizeof(float));
+  } else if (problem_.init_depth_map != nullptr) {
+    depth_map_->CopyToDevice(problem_.init_depth_map->GetPtr(),
+                             problem_.init_depth_map->GetWidth() *
+                                 sizeof(float));
+  } else if (problem_.init_depth_ranges != nullptr) {
+    GpuMat<float> init_depth_ranges(ref_width_, ref_height_, 2);
+    init_depth_ranges.CopyToDevice(
+        problem_.init_depth_ranges->GetPtr(),
+        problem_.init_depth_ranges->GetWidth() * sizeof(float));
+    InitDepthMapInRanges<<<elem_wise_grid_size_, elem_wise_block_size_>>>(
+        *depth_map_, *rand_state_map_, init_depth_ranges);
+    CUDA_SYNC_AND_CHECK();
   } else {
     depth_map_->FillWithRandomNumbers(
         options_.depth_min, options_.depth_max, *rand_state_map_);
@@ -1789,16 +1881,21 @@ void PatchMatchCuda::InitWorkspaceMemory() {
 
   consistency_mask_.reset(new GpuMat<uint8_t>(0, 0, 0));
 
-  ComputeCudaConfig();
-
   if (options_.geom_consistency) {
     const NormalMap& init_normal_map =
         problem_.normal_maps->at(problem_.ref_image_idx);
     normal_map_->CopyToDevice(init_normal_map.GetPtr(),
                               init_normal_map.GetWidth() * sizeof(float));
+  } else if (problem_.init_normal_map != nullptr) {
+    normal_map_->CopyToDevice(problem_.init_normal_map->GetPtr(),
+                              problem_.init_normal_map->GetWidth() *
+                                  sizeof(float));
   } else {
     InitNormalMap<<<elem_wise_grid_size_, elem_wise_block_size_>>>(
-        *normal_map_, *rand_state_map_);
+        *normal_map_,
+        *rand_state_map_,
+        MakeRefCalibration(ref_K_host_[rotation_in_half_pi_],
+                           ref_inv_K_host_[rotation_in_half_pi_]));
   }
 }
 
@@ -1868,18 +1965,6 @@ void PatchMatchCuda::Rotate() {
     cost_map_.swap(rotated_cost_map);
   }
 
-  // Rotate calibration.
-  CUDA_SAFE_CALL(cudaMemcpyToSymbol(ref_K,
-                                    ref_K_host_[rotation_in_half_pi_],
-                                    sizeof(float) * 4,
-                                    0,
-                                    cudaMemcpyHostToDevice));
-  CUDA_SAFE_CALL(cudaMemcpyToSymbol(ref_inv_K,
-                                    ref_inv_K_host_[rotation_in_half_pi_],
-                                    sizeof(float) * 4,
-                                    0,
-                                    cudaMemcpyHostToDevice));
-
   // Recompute Cuda configuration for rotated reference image.
   ComputeCudaConfig();
 }
@@ -0,0 +1,113 @@
+#include "colmap/mvs/patch_match_scheduler.h"
+
+#include "colmap/util/logging.h"
+
+namespace colmap {
+namespace mvs {
+
+PatchMatchScheduler::PatchMatchScheduler(
+    std::vector<std::vector<int>> problem_image_idxs, const int num_workers)
+    : problem_image_idxs_(std::move(problem_image_idxs)),
+      scheduled_(problem_image_idxs_.size(), false),
+      num_scheduled_(0),
+      prev_problem_idxs_(num_workers, -1) {
+  CHECK_GT(num_workers, 0);
+  for (size_t problem_idx = 0; problem_idx < problem_image_idxs_.size();
+       ++problem_idx) {
+    for (const int image_idx : problem_image_idxs_[problem_idx]) {
+      image_problem_idxs_[image_idx].push_back(problem_idx);
+    }
+  }
+}
+
+int PatchMatchScheduler::Next(const int worker_idx) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const int problem_idx = FindNext(worker_idx);
+  if (problem_idx != -1) {
+    scheduled_[problem_idx] = true;
+    num_scheduled_ += 1;
+  }
+  prev_problem_idxs_.at(worker_idx) = problem_idx;
+  return problem_idx;
+}
+
+int PatchMatchScheduler::PeekNext(const int worker_idx) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return FindNext(worker_idx);
+}
+
+int PatchMatchScheduler::NextReady(const int worker_idx,
+                                   const std::function<bool(int)>& is_ready) {
+  CHECK(is_ready);
+  std::lock_guard<std::mutex> lock(mutex_);
+  const int problem_idx = FindNext(worker_idx, is_ready);
+  if (problem_idx != -1) {
+    scheduled_[problem_idx] = true;
+    num_scheduled_ += 1;
+    prev_problem_idxs_.at(worker_idx) = problem_idx;
+  }
+  return problem_idx;
+}
+
+int PatchMatchScheduler::FindNext(
+    const int worker_idx, const std::function<bool(int)>& is_ready) const {
+  if (num_scheduled_ == scheduled_.size()) {
+    return -1;
+  }
+
+  const int prev_problem_idx = prev_problem_idxs_.at(worker_idx);
+
+  // Find the unscheduled problem, whose images are most similar to the images
+  // of the previous problem of the worker in terms of their intersection over
+  // union. Ties are resolved by the order of the configuration.
+  if (prev_problem_idx != -1) {
+    const std::vector<int>& prev_image_idxs =
+        problem_image_idxs_[prev_problem_idx];
+    std::unordered_map<int, int> num_shared_images;
+    for (const int image_idx : prev_image_idxs) {
+      for (const int problem_idx : image_problem_idxs_.at(image_idx)) {
+        if (!scheduled_[problem_idx]) {
+          num_shared_images[problem_idx] += 1;
+        }
+      }
+    }
+
+    int best_problem_idx = -1;
+    double best_similarity = 0;
+    for (const auto& problem : num_shared_images) {
+      if (is_ready && !is_ready(problem.first)) {
+        continue;
+      }
+      const double similarity =
+          static_cast<double>(problem.second) /
+          (prev_image_idxs.size() + problem_image_idxs_[problem.first].size() -
+           problem.second);
+      if (similarity > best_similarity ||
+          (similarity == best_similarity && problem.first < best_problem_idx)) {
+        best_problem_idx = problem.first;
+        best_similarity = similarity;
+      }
+    }
+
+    if (best_problem_idx != -1) {
+      return best_problem_idx;
+    }
+  }
+
+  // Otherwise, continue with the first unscheduled problem after the start of
+  // the worker's part of the configuration.
+  const size_t num_problems = scheduled_.size();
+  const size_t start_problem_idx =
+      worker_idx * num_problems / prev_problem_idxs_.size();
+  for (size_t i = 0; i < num_problems; ++i) {
+    const size_t problem_idx = (start_problem_idx + i) % num_problems;
+    if (!scheduled_[problem_idx] && (!is_ready || is_ready(problem_idx))) {
+      return problem_idx;
+    }
+  }
+
+  return -1;
+}
+
+}  // namespace mvs
+}  // namespace colmap
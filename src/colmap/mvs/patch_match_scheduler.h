@@ -0,0 +1,55 @@
+#pragma once
+
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace colmap {
+namespace mvs {
+
+// Schedules patch match problems to multiple workers, e.g., one per GPU, such
+// that consecutive problems of a worker share as many images as possible.
+// Every worker starts at an evenly spaced problem of the configuration and
+// then greedily continues with the unscheduled problem, whose images are most
+// similar to the images of its previous problem. For sequentially captured
+// images, the workers thereby traverse separate parts of the sequence, which
+// keeps their images in the cache of the workspace. The scheduler is
+// thread-safe.
+class PatchMatchScheduler {
+ public:
+  // The images of every problem, i.e., its reference and source images.
+  PatchMatchScheduler(std::vector<std::vector<int>> problem_image_idxs,
+                      int num_workers);
+
+  // Schedule the next problem of the worker or return -1, if all problems
+  // have been scheduled.
+  int Next(int worker_idx);
+
+  // The problem that would currently be scheduled next for the worker without
+  // scheduling it, e.g., to prefetch its images. Returns -1, if all problems
+  // have been scheduled.
+  int PeekNext(int worker_idx) const;
+
+  // Schedule the next problem of the worker among the problems, for which
+  // `is_ready` returns true, in the same order as `Next`. Returns -1, if no
+  // unscheduled problem is ready.
+  int NextReady(int worker_idx, const std::function<bool(int)>& is_ready);
+
+ private:
+  // Find the next unscheduled problem of the worker, for which `is_ready`
+  // returns true, or any unscheduled problem if `is_ready` is empty.
+  int FindNext(int worker_idx,
+               const std::function<bool(int)>& is_ready = {}) const;
+
+  const std::vector<std::vector<int>> problem_image_idxs_;
+  std::unordered_map<int, std::vector<int>> image_problem_idxs_;
+
+  mutable std::mutex mutex_;
+  std::vector<char> scheduled_;
+  size_t num_scheduled_;
+  std::vector<int> prev_problem_idxs_;
+};
+
+}  // namespace mvs
+}  // namespace colmap
@@ -0,0 +1,96 @@
+#include "colmap/mvs/patch_match_scheduler.h"
+
+#include <algorithm>
+
+#include <gtest/gtest.h>
+
+namespace colmap {
+namespace mvs {
+namespace {
+
+TEST(PatchMatchScheduler, Empty) {
+  PatchMatchScheduler scheduler({}, 2);
+  EXPECT_EQ(scheduler.PeekNext(0), -1);
+  EXPECT_EQ(scheduler.Next(0), -1);
+  EXPECT_EQ(scheduler.Next(1), -1);
+}
+
+TEST(PatchMatchScheduler, SingleWorker) {
+  // The problems of a sequence in shuffled order with two source images on
+  // either side of the reference image.
+  const std::vector<int> ref_image_idxs = {0, 5, 2, 7, 1, 4, 6, 3};
+  std::vector<std::vector<int>> problem_image_idxs;
+  for (const int ref_image_idx : ref_image_idxs) {
+    problem_image_idxs.push_back({ref_image_idx});
+    for (int image_idx = std::max(0, ref_image_idx - 2);
+         image_idx <= std::min(7, ref_image_idx + 2);
+         ++image_idx) {
+      if (image_idx != ref_image_idx) {
+        problem_image_idxs.back().push_back(image_idx);
+      }
+    }
+  }
+
+  PatchMatchScheduler scheduler(problem_image_idxs, 1);
+  std::vector<int> scheduled_ref_image_idxs;
+  for (size_t i = 0; i < ref_image_idxs.size(); ++i) {
+    const int problem_idx = scheduler.PeekNext(0);
+    EXPECT_EQ(scheduler.Next(0), problem_idx);
+    scheduled_ref_image_idxs.push_back(ref_image_idxs.at(problem_idx));
+  }
+  EXPECT_EQ(scheduler.PeekNext(0), -1);
+  EXPECT_EQ(scheduler.Next(0), -1);
+
+  // The problems are scheduled along the sequence.
+  EXPECT_EQ(scheduled_ref_image_idxs,
+            std::vector<int>({0, 1, 2, 3, 4, 5, 6, 7}));
+}
+
+TEST(PatchMatchScheduler, MultipleWorkers) {
+  // Two disconnected parts of the configuration.
+  const std::vector<std::vector<int>> problem_image_idxs = {
+      {0, 1}, {1, 0}, {2, 3}, {3, 2}};
+  PatchMatchScheduler scheduler(problem_image_idxs, 2);
+  EXPECT_EQ(scheduler.Next(0), 0);
+  EXPECT_EQ(scheduler.Next(1), 2);
+  EXPECT_EQ(scheduler.Next(0), 1);
+  EXPECT_EQ(scheduler.Next(1), 3);
+  EXPECT_EQ(scheduler.Next(0), -1);
+  EXPECT_EQ(scheduler.Next(1), -1);
+}
+
+TEST(PatchMatchScheduler, UnsharedImages) {
+  const std::vector<std::vector<int>> problem_image_idxs = {{0}, {1}, {2}};
+  PatchMatchScheduler scheduler(problem_image_idxs, 1);
+  EXPECT_EQ(scheduler.Next(0), 0);
+  EXPECT_EQ(scheduler.Next(0), 1);
+  EXPECT_EQ(scheduler.Next(0), 2);
+  EXPECT_EQ(scheduler.Next(0), -1);
+}
+
+TEST(PatchMatchScheduler, NextReady) {
+  const std::vector<std::vector<int>> problem_image_idxs = {
+      {0, 1}, {1, 0, 2}, {2, 1, 3}, {3, 2}};
+  PatchMatchScheduler scheduler(problem_image_idxs, 1);
+  std::vector<bool> ready(problem_image_idxs.size(), false);
+  const auto is_ready = [&ready](const int problem_idx) {
+    return ready.at(problem_idx);
+  };
+  EXPECT_EQ(scheduler.NextReady(0, is_ready), -1);
+  ready[2] = true;
+  EXPECT_EQ(scheduler.NextReady(0, is_ready), 2);
+  // Problem 3 is most similar to the previous problem but not ready.
+  ready[0] = true;
+  ready[1] = true;
+  EXPECT_EQ(scheduler.NextReady(0, is_ready), 1);
+  EXPECT_EQ(scheduler.NextReady(0, is_ready), 0);
+  EXPECT_EQ(scheduler.NextReady(0, is_ready), -1);
+  ready[3] = true;
+  EXPECT_EQ(scheduler.NextReady(0, is_ready), 3);
+  EXPECT_EQ(scheduler.NextReady(0, is_ready), -1);
+  EXPECT_EQ(scheduler.Next(0), -1);
+}
+
+}  // namespace
+}  // namespace mvs
+}  // namespace colmap
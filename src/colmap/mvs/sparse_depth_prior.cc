@@ -0,0 +1,174 @@
+#include "colmap/mvs/sparse_depth_prior.h"
+
+#include "colmap/util/logging.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace colmap {
+namespace mvs {
+
+bool SparseDepthPriorOptions::Check() const {
+  CHECK_OPTION_GT(cell_size, 0);
+  CHECK_OPTION_GE(depth_margin, 0);
+  CHECK_OPTION_GT(depth_min, 0);
+  CHECK_OPTION_LE(depth_min, depth_max);
+  return true;
+}
+
+Mat<float> ComputeSparseDepthPriors(const SparseDepthPriorOptions& options,
+                                    const Image& image,
+                                    const int image_idx,
+                                    const std::vector<Model::Point>& points) {
+  CHECK(options.Check());
+
+  const int width = image.GetWidth();
+  const int height = image.GetHeight();
+  const int grid_width = (width + options.cell_size - 1) / options.cell_size;
+  const int grid_height = (height + options.cell_size - 1) / options.cell_size;
+  const int num_cells = grid_width * grid_height;
+
+  // Rasterize the depths of the projected points into the grid.
+  std::vector<float> point_depth_min(num_cells,
+                                     std::numeric_limits<float>::max());
+  std::vector<float> point_depth_max(num_cells, 0);
+  for (const auto& point : points) {
+    if (std::find(point.track.begin(), point.track.end(), image_idx) ==
+        point.track.end()) {
+      continue;
+    }
+    const float X[3] = {point.x, point.y, point.z};
+    float col = 0;
+    float row = 0;
+    float depth = 0;
+    if (!image.ProjectPoint(
+            X, options.enable_refraction, &col, &row, &depth)) {
+      continue;
+    }
+    const int pixel_col = std::round(col);
+    const int pixel_row = std::round(row);
+    if (pixel_col < 0 || pixel_row < 0 || pixel_col >= width ||
+        pixel_row >= height) {
+      continue;
+    }
+    const int cell_idx = (pixel_row / options.cell_size) * grid_width +
+                         pixel_col / options.cell_size;
+    point_depth_min[cell_idx] = std::min(point_depth_min[cell_idx], depth);
+    point_depth_max[cell_idx] = std::max(point_depth_max[cell_idx], depth);
+  }
+
+  // Each cell spans the depths of the points in its 3x3 neighborhood, so that
+  // the ranges cover depth changes across the cell borders. Cells without
+  // points in their neighborhood are filled ring by ring from their filled
+  // neighbors and store the number of rings as their distance.
+  std::vector<float> cell_depth_min(num_cells,
+                                    std::numeric_limits<float>::max());
+  std::vector<float> cell_depth_max(num_cells, 0);
+  std::vector<int> cell_dists(num_cells, -1);
+
+  const auto UpdateFromNeighbors = [&](const int cell_row,
+                                       const int cell_col,
+                                       const std::vector<float>& depth_min,
+                                       const std::vector<float>& depth_max,
+                                       const std::vector<int>* dists,
+                                       const int dist) {
+    const int cell_idx = cell_row * grid_width + cell_col;
+    for (int row = std::max(cell_row - 1, 0);
+         row <= std::min(cell_row + 1, grid_height - 1);
+         ++row) {
+      for (int col = std::max(cell_col - 1, 0);
+           col <= std::min(cell_col + 1, grid_width - 1);
+           ++col) {
+        const int neighbor_idx = row * grid_width + col;
+        if (depth_max[neighbor_idx] == 0 ||
+            (dists != nullptr && (*dists)[neighbor_idx] != dist - 1)) {
+          continue;
+        }
+        cell_depth_min[cell_idx] =
+            std::min(cell_depth_min[cell_idx], depth_min[neighbor_idx]);
+        cell_depth_max[cell_idx] =
+            std::max(cell_depth_max[cell_idx], depth_max[neighbor_idx]);
+        cell_dists[cell_idx] = dist;
+      }
+    }
+  };
+
+  bool has_empty_cells = false;
+  for (int cell_row = 0; cell_row < grid_height; ++cell_row) {
+    for (int cell_col = 0; cell_col < grid_width; ++cell_col) {
+      UpdateFromNeighbors(
+          cell_row, cell_col, point_depth_min, point_depth_max, nullptr, 0);
+      has_empty_cells |= cell_dists[cell_row * grid_width + cell_col] == -1;
+    }
+  }
+
+  for (int dist = 1; has_empty_cells; ++dist) {
+    // The cells of the previous ring are not modified by the current ring,
+    // so that the ring can be filled in place.
+    has_empty_cells = false;
+    bool has_new_cells = false;
+    for (int cell_row = 0; cell_row < grid_height; ++cell_row) {
+      for (int cell_col = 0; cell_col < grid_width; ++cell_col) {
+        const int cell_idx = cell_row * grid_width + cell_col;
+        if (cell_dists[cell_idx] != -1) {
+          continue;
+        }
+        UpdateFromNeighbors(cell_row,
+                            cell_col,
+                            cell_depth_min,
+                            cell_depth_max,
+                            &cell_dists,
+                            dist);
+        if (cell_dists[cell_idx] == -1) {
+          has_empty_cells = true;
+        } else {
+          has_new_cells = true;
+        }
+      }
+    }
+    if (!has_new_cells) {
+      break;
+    }
+  }
+
+  // Extend the ranges by the margin in log space and clamp them to the global
+  // range, which is also used, if there are no points at all.
+  const float global_depth_min = options.depth_min;
+  const float global_depth_max = options.depth_max;
+  std::vector<float> cell_ranges(2 * num_cells);
+  for (int cell_idx = 0; cell_idx < num_cells; ++cell_idx) {
+    float& depth_min = cell_ranges[2 * cell_idx];
+    float& depth_max = cell_ranges[2 * cell_idx + 1];
+    depth_min = global_depth_min;
+    depth_max = global_depth_max;
+    if (cell_dists[cell_idx] == -1) {
+      continue;
+    }
+    const float margin =
+        1.0f + options.depth_margin * (1 + cell_dists[cell_idx]);
+    const float prior_depth_min =
+        std::max(cell_depth_min[cell_idx] / margin, global_depth_min);
+    const float prior_depth_max =
+        std::min(cell_depth_max[cell_idx] * margin, global_depth_max);
+    if (prior_depth_min <= prior_depth_max) {
+      depth_min = prior_depth_min;
+      depth_max = prior_depth_max;
+    }
+  }
+
+  Mat<float> depth_priors(width, height, 2);
+  for (int row = 0; row < height; ++row) {
+    for (int col = 0; col < width; ++col) {
+      const int cell_idx =
+          (row / options.cell_size) * grid_width + col / options.cell_size;
+      depth_priors.Set(row, col, 0, cell_ranges[2 * cell_idx]);
+      depth_priors.Set(row, col, 1, cell_ranges[2 * cell_idx + 1]);
+    }
+  }
+
+  return depth_priors;
+}
+
+}  // namespace mvs
+}  // namespace colmap
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "colmap/mvs/image.h"
+#include "colmap/mvs/mat.h"
+#include "colmap/mvs/model.h"
+
+#include <vector>
+
+namespace colmap {
+namespace mvs {
+
+struct SparseDepthPriorOptions {
+  // Size of the square grid cells in pixels, in which the depths of the
+  // projected sparse points are collected.
+  int cell_size = 16;
+
+  // Relative margin by which the depth range of the sparse points in a cell
+  // is extended. Cells without sparse points inherit the ranges of their
+  // neighbors and the margin grows by this value with every cell of distance
+  // to the nearest sparse point.
+  double depth_margin = 0.1;
+
+  // Global depth range, to which the per-pixel ranges are clamped and which
+  // is used for images without any projected sparse points.
+  double depth_min = -1.0;
+  double depth_max = -1.0;
+
+  // Whether to trace the refraction of refractive images, see
+  // `Image::ProjectPoint`.
+  bool enable_refraction = false;
+
+  bool Check() const;
+};
+
+// Compute per-pixel depth ranges of the image from the projections of the
+// sparse points observed by the image, which are used as priors for the
+// initialization of PatchMatch. The ranges are stored as a map with the two
+// slices {depth_min, depth_max}. The depths of the sparse points are
+// rasterized into a grid of cells, so that each cell spans the depths of the
+// points in its neighborhood, and empty cells are filled from their nearest
+// non-empty cells with a margin that grows with the distance to them.
+Mat<float> ComputeSparseDepthPriors(const SparseDepthPriorOptions& options,
+                                    const Image& image,
+                                    int image_idx,
+                                    const std::vector<Model::Point>& points);
+
+}  // namespace mvs
+}  // namespace colmap
@@ -0,0 +1,113 @@
+#include "colmap/mvs/sparse_depth_prior.h"
+
+#include <Eigen/Core>
+#include <gtest/gtest.h>
+
+namespace colmap {
+namespace mvs {
+namespace {
+
+Image CreateImage(const size_t width, const size_t height) {
+  const Eigen::Matrix<float, 3, 3, Eigen::RowMajor> K =
+      (Eigen::Matrix<float, 3, 3, Eigen::RowMajor>() << 100,
+       0,
+       width / 2.0f,
+       0,
+       100,
+       height / 2.0f,
+       0,
+       0,
+       1)
+          .finished();
+  const Eigen::Matrix<float, 3, 3, Eigen::RowMajor> R =
+      Eigen::Matrix<float, 3, 3, Eigen::RowMajor>::Identity();
+  const Eigen::Vector3f T = Eigen::Vector3f::Zero();
+  return Image("", width, height, K.data(), R.data(), T.data());
+}
+
+Model::Point CreatePoint(const float col,
+                         const float row,
+                         const float depth,
+                         const std::vector<int>& track) {
+  Model::Point point;
+  point.x = (col - 32) / 100 * depth;
+  point.y = (row - 24) / 100 * depth;
+  point.z = depth;
+  point.track = track;
+  return point;
+}
+
+SparseDepthPriorOptions CreateOptions() {
+  SparseDepthPriorOptions options;
+  options.cell_size = 8;
+  options.depth_margin = 0.1;
+  options.depth_min = 0.5;
+  options.depth_max = 20;
+  return options;
+}
+
+TEST(ComputeSparseDepthPriors, Nominal) {
+  const Image image = CreateImage(64, 48);
+  const std::vector<Model::Point> points = {
+      CreatePoint(4, 4, 2, {0, 1}),
+      CreatePoint(5, 6, 3, {0}),
+      // Not observed by the image.
+      CreatePoint(20, 4, 10, {1}),
+      // Outside of the image.
+      CreatePoint(70, 4, 10, {0}),
+  };
+
+  const SparseDepthPriorOptions options = CreateOptions();
+  const Mat<float> priors =
+      ComputeSparseDepthPriors(options, image, 0, points);
+  ASSERT_EQ(priors.GetWidth(), 64);
+  ASSERT_EQ(priors.GetHeight(), 48);
+  ASSERT_EQ(priors.GetDepth(), 2);
+
+  // The cell of the points and its neighbors span the depths of the points.
+  for (const int col : {0, 7, 8, 15}) {
+    EXPECT_NEAR(priors.Get(4, col, 0), 2 / 1.1, 1e-5);
+    EXPECT_NEAR(priors.Get(4, col, 1), 3 * 1.1, 1e-5);
+  }
+
+  // The margin grows with the distance to the nearest points.
+  EXPECT_NEAR(priors.Get(4, 16, 0), 2 / 1.2, 1e-5);
+  EXPECT_NEAR(priors.Get(4, 16, 1), 3 * 1.2, 1e-5);
+  EXPECT_NEAR(priors.Get(4, 24, 0), 2 / 1.3, 1e-5);
+  EXPECT_NEAR(priors.Get(40, 24, 0), 2 / 1.5, 1e-5);
+  EXPECT_NEAR(priors.Get(40, 24, 1), 3 * 1.5, 1e-5);
+  EXPECT_NEAR(priors.Get(47, 63, 0), 2 / 1.7, 1e-5);
+  EXPECT_NEAR(priors.Get(47, 63, 1), 3 * 1.7, 1e-5);
+}
+
+TEST(ComputeSparseDepthPriors, NoPoints) {
+  const Image image = CreateImage(64, 48);
+  const std::vector<Model::Point> points = {CreatePoint(4, 4, 2, {1})};
+  const SparseDepthPriorOptions options = CreateOptions();
+  const Mat<float> priors =
+      ComputeSparseDepthPriors(options, image, 0, points);
+  for (size_t row = 0; row < priors.GetHeight(); ++row) {
+    for (size_t col = 0; col < priors.GetWidth(); ++col) {
+      EXPECT_EQ(priors.Get(row, col, 0), options.depth_min);
+      EXPECT_EQ(priors.Get(row, col, 1), options.depth_max);
+    }
+  }
+}
+
+TEST(ComputeSparseDepthPriors, ClampToGlobalRange) {
+  const Image image = CreateImage(64, 48);
+  const std::vector<Model::Point> points = {CreatePoint(4, 4, 19, {0}),
+                                            CreatePoint(60, 44, 30, {0})};
+  const SparseDepthPriorOptions options = CreateOptions();
+  const Mat<float> priors =
+      ComputeSparseDepthPriors(options, image, 0, points);
+  EXPECT_NEAR(priors.Get(4, 4, 0), 19 / 1.1, 1e-5);
+  EXPECT_EQ(priors.Get(4, 4, 1), options.depth_max);
+  // Ranges outside of the global range fall back to the global range.
+  EXPECT_EQ(priors.Get(44, 60, 0), options.depth_min);
+  EXPECT_EQ(priors.Get(44, 60, 1), options.depth_max);
+}
+
+}  // namespace
+}  // namespace mvs
+}  // namespace colmap
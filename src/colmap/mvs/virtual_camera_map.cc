@@ -0,0 +1,155 @@
+#include "colmap/mvs/virtual_camera_map.h"
+
+#include "colmap/util/logging.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include <Eigen/Geometry>
+
+namespace colmap {
+namespace mvs {
+namespace {
+
+// The virtual cameras vary smoothly over the image, so that the Newton
+// iteration of the projection typically converges within a few iterations.
+// The threshold is in pixels and well above the float precision of the image
+// coordinates.
+const int kMaxNumProjectionIterations = 10;
+const float kProjectionConvergenceThreshold = 1e-2f;
+
+// Index of the first grid point of the cell used for the interpolation.
+size_t ClampGridIndex(const float grid_coord, const size_t grid_size) {
+  if (grid_coord <= 0 || grid_size < 2) {
+    return 0;
+  }
+  return std::min(static_cast<size_t>(grid_coord), grid_size - 2);
+}
+
+}  // namespace
+
+VirtualCameraMap::VirtualCameraMap()
+    : width_(0),
+      height_(0),
+      step_(0),
+      grid_width_(0),
+      grid_height_(0),
+      fx_(0),
+      fy_(0),
+      cx_(0),
+      cy_(0) {}
+
+VirtualCameraMap::VirtualCameraMap(const Image& image, const size_t step)
+    : width_(image.GetWidth()), height_(image.GetHeight()), step_(step) {
+  CHECK_GT(step_, 0);
+  const float* K = image.GetK();
+  fx_ = K[0];
+  fy_ = K[4];
+  cx_ = K[2];
+  cy_ = K[5];
+  image.ComputeVirtualCameras(step_, &data_, &grid_width_, &grid_height_);
+}
+
+void VirtualCameraMap::Interpolate(const float col,
+                                   const float row,
+                                   Eigen::Vector2f* view_ray,
+                                   Eigen::Vector3f* center) const {
+  Interpolate(col, row, view_ray, center, nullptr);
+}
+
+void VirtualCameraMap::Interpolate(const float col,
+                                   const float row,
+                                   Eigen::Vector2f* view_ray,
+                                   Eigen::Vector3f* center,
+                                   Eigen::Matrix2f* view_ray_jacobian) const {
+  // Points beyond the grid are linearly extrapolated from the border cells,
+  // so that the projection also converges for points close to the border.
+  const float grid_col = col / step_;
+  const float grid_row = row / step_;
+  const size_t c0 = ClampGridIndex(grid_col, grid_width_);
+  const size_t r0 = ClampGridIndex(grid_row, grid_height_);
+  const size_t c1 = std::min(c0 + 1, grid_width_ - 1);
+  const size_t r1 = std::min(r0 + 1, grid_height_ - 1);
+  const float tc = grid_col - c0;
+  const float tr = grid_row - r0;
+
+  const float w00 = (1 - tc) * (1 - tr);
+  const float w01 = tc * (1 - tr);
+  const float w10 = (1 - tc) * tr;
+  const float w11 = tc * tr;
+  const size_t idx00 = r0 * grid_width_ + c0;
+  const size_t idx01 = r0 * grid_width_ + c1;
+  const size_t idx10 = r1 * grid_width_ + c0;
+  const size_t idx11 = r1 * grid_width_ + c1;
+
+  const size_t num_grid_points = grid_width_ * grid_height_;
+  float values[Image::kNumVirtualCameraParams];
+  for (int i = 0; i < Image::kNumVirtualCameraParams; ++i) {
+    const float* slice = data_.data() + i * num_grid_points;
+    values[i] = w00 * slice[idx00] + w01 * slice[idx01] + w10 * slice[idx10] +
+                w11 * slice[idx11];
+  }
+
+  *view_ray = Eigen::Vector2f(values[0], values[1]);
+  *center = Eigen::Vector3f(values[2], values[3], values[4]);
+
+  if (view_ray_jacobian != nullptr) {
+    for (int i = 0; i < 2; ++i) {
+      const float* slice = data_.data() + i * num_grid_points;
+      (*view_ray_jacobian)(i, 0) = ((1 - tr) * (slice[idx01] - slice[idx00]) +
+                                    tr * (slice[idx11] - slice[idx10])) /
+                                   step_;
+      (*view_ray_jacobian)(i, 1) = ((1 - tc) * (slice[idx10] - slice[idx00]) +
+                                    tc * (slice[idx11] - slice[idx01])) /
+                                   step_;
+    }
+  }
+}
+
+Eigen::Vector3f VirtualCameraMap::CamFromImgPoint(const float col,
+                                                  const float row,
+                                                  const float depth) const {
+  Eigen::Vector2f view_ray;
+  Eigen::Vector3f center;
+  Interpolate(col, row, &view_ray, &center);
+  return center + (depth - center.z()) * view_ray.homogeneous();
+}
+
+bool VirtualCameraMap::ImgFromCam(const Eigen::Vector3f& point,
+                                  Eigen::Vector2f* xy) const {
+  Eigen::Vector2f view_ray;
+  Eigen::Vector3f center;
+  Eigen::Matrix2f view_ray_jacobian;
+  *xy = Eigen::Vector2f(cx_, cy_);
+  for (int i = 0; i < kMaxNumProjectionIterations; ++i) {
+    Interpolate(xy->x(), xy->y(), &view_ray, &center, &view_ray_jacobian);
+    const Eigen::Vector3f ray = point - center;
+    if (ray.z() <= 0) {
+      return false;
+    }
+
+    // Newton step on the difference between the viewing ray through the point
+    // and of the current virtual camera, neglecting the comparably small
+    // change of the virtual camera centers. The calibration of the pinhole
+    // camera is used for degenerate grids.
+    const Eigen::Vector2f residual = ray.hnormalized() - view_ray;
+    Eigen::Vector2f delta;
+    if (std::abs(view_ray_jacobian.determinant()) >
+        std::numeric_limits<float>::epsilon() / (fx_ * fy_)) {
+      delta = view_ray_jacobian.inverse() * residual;
+    } else {
+      delta = Eigen::Vector2f(fx_ * residual.x(), fy_ * residual.y());
+    }
+
+    *xy += delta;
+    if (std::abs(delta.x()) < kProjectionConvergenceThreshold &&
+        std::abs(delta.y()) < kProjectionConvergenceThreshold) {
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace mvs
+}  // namespace colmap
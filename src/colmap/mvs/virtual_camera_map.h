@@ -0,0 +1,84 @@
+#pragma once
+
+#include "colmap/mvs/image.h"
+
+#include <vector>
+
+#include <Eigen/Core>
+
+namespace colmap {
+namespace mvs {
+
+// Per-pixel virtual pinhole cameras of an image, see
+// `Image::ComputeVirtualCameras`. The virtual cameras are sampled on a regular
+// grid and bilinearly interpolated in between, which makes back-projection and
+// projection with refractive cameras about as cheap as with pinhole cameras.
+//
+// Depths follow the convention of the refractive PatchMatch stereo, i.e., the
+// depth of a pixel is the z-coordinate of its point in the camera frame.
+class VirtualCameraMap {
+ public:
+  VirtualCameraMap();
+
+  // Sample the virtual cameras of the image every `step` pixels.
+  VirtualCameraMap(const Image& image, size_t step);
+
+  inline size_t GetWidth() const;
+  inline size_t GetHeight() const;
+  inline size_t GetStep() const;
+  inline bool IsEmpty() const;
+
+  // Interpolate the virtual camera at the given image point, where the
+  // refracted viewing ray is `center + t * (view_ray, 1)`.
+  void Interpolate(float col,
+                   float row,
+                   Eigen::Vector2f* view_ray,
+                   Eigen::Vector3f* center) const;
+
+  // Compute the point in the camera frame along the refracted viewing ray of
+  // the image point with the given depth.
+  Eigen::Vector3f CamFromImgPoint(float col, float row, float depth) const;
+
+  // Project the point from the camera frame to the image plane by Newton
+  // iteration over the virtual cameras, starting from the projection through
+  // the virtual camera at the principal point. Returns false if the point is
+  // behind the camera or the iteration does not converge.
+  bool ImgFromCam(const Eigen::Vector3f& point, Eigen::Vector2f* xy) const;
+
+ private:
+  // Additionally computes the Jacobian of the interpolated viewing ray with
+  // respect to the image point, if not null.
+  void Interpolate(float col,
+                   float row,
+                   Eigen::Vector2f* view_ray,
+                   Eigen::Vector3f* center,
+                   Eigen::Matrix2f* view_ray_jacobian) const;
+
+  size_t width_;
+  size_t height_;
+  size_t step_;
+  size_t grid_width_;
+  size_t grid_height_;
+  // Focal lengths and principal point of the calibration.
+  float fx_;
+  float fy_;
+  float cx_;
+  float cy_;
+  // Virtual cameras in the planar layout of `Image::ComputeVirtualCameras`.
+  std::vector<float> data_;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Implementation
+////////////////////////////////////////////////////////////////////////////////
+
+size_t VirtualCameraMap::GetWidth() const { return width_; }
+
+size_t VirtualCameraMap::GetHeight() const { return height_; }
+
+size_t VirtualCameraMap::GetStep() const { return step_; }
+
+bool VirtualCameraMap::IsEmpty() const { return data_.empty(); }
+
+}  // namespace mvs
+}  // namespace colmap
@@ -0,0 +1,110 @@
+#include "colmap/mvs/virtual_camera_map.h"
+
+#include "colmap/scene/camera.h"
+#include "colmap/sensor/models_refrac.h"
+
+#include <Eigen/Core>
+#include <gtest/gtest.h>
+
+namespace colmap {
+namespace mvs {
+namespace {
+
+Image CreateImage(const Camera& camera) {
+  const Eigen::Matrix<float, 3, 3, Eigen::RowMajor> K =
+      camera.CalibrationMatrix().cast<float>();
+  const Eigen::Matrix<float, 3, 3, Eigen::RowMajor> R =
+      Eigen::Matrix<float, 3, 3, Eigen::RowMajor>::Identity();
+  const Eigen::Vector3f T = Eigen::Vector3f::Zero();
+  return Image("", camera.width, camera.height, K.data(), R.data(), T.data());
+}
+
+TEST(VirtualCameraMap, Empty) {
+  const VirtualCameraMap map;
+  EXPECT_TRUE(map.IsEmpty());
+  EXPECT_EQ(map.GetWidth(), 0);
+  EXPECT_EQ(map.GetHeight(), 0);
+}
+
+TEST(VirtualCameraMap, Pinhole) {
+  const Camera camera =
+      Camera::CreateFromModelName(1, "PINHOLE", 100.0, 100, 80);
+  const VirtualCameraMap map(CreateImage(camera), 4);
+  EXPECT_FALSE(map.IsEmpty());
+  EXPECT_EQ(map.GetWidth(), camera.width);
+  EXPECT_EQ(map.GetHeight(), camera.height);
+  EXPECT_EQ(map.GetStep(), 4);
+
+  for (float row = 0; row < camera.height; row += 3.5f) {
+    for (float col = 0; col < camera.width; col += 3.5f) {
+      const Eigen::Vector3f point = map.CamFromImgPoint(col, row, 2.0f);
+      const Eigen::Vector3f expected_point =
+          2.0f * camera.CamFromImg(Eigen::Vector2d(col, row))
+                     .homogeneous()
+                     .cast<float>();
+      EXPECT_LT((point - expected_point).norm(), 1e-5);
+
+      Eigen::Vector2f xy;
+      EXPECT_TRUE(map.ImgFromCam(point, &xy));
+      EXPECT_LT((xy - Eigen::Vector2f(col, row)).norm(), 1e-3);
+    }
+  }
+
+  Eigen::Vector2f xy;
+  EXPECT_FALSE(map.ImgFromCam(Eigen::Vector3f(0.1f, 0.2f, -1.0f), &xy));
+}
+
+void TestRefracCamera(const Camera& camera) {
+  Image image = CreateImage(camera);
+  image.SetRefracCamera(camera);
+  const VirtualCameraMap map(image, 4);
+
+  for (double row = 0; row < camera.height; row += 3.5) {
+    for (double col = 0; col < camera.width; col += 3.5) {
+      for (const double depth : {0.5, 2.0, 10.0}) {
+        // The depth is the z-coordinate and not the distance of the point.
+        const Eigen::Vector3d ray_point =
+            camera.CamFromImgRefracPoint(Eigen::Vector2d(col, row), 1.0);
+        const Eigen::Vector3d far_ray_point =
+            camera.CamFromImgRefracPoint(Eigen::Vector2d(col, row), 100.0);
+        const Eigen::Vector3d ray_dir = far_ray_point - ray_point;
+        const Eigen::Vector3d expected_point =
+            ray_point + (depth - ray_point.z()) / ray_dir.z() * ray_dir;
+
+        const Eigen::Vector3f point = map.CamFromImgPoint(col, row, depth);
+        EXPECT_NEAR(point.z(), depth, 1e-5);
+        EXPECT_LT((point.cast<double>() - expected_point).norm(), 1e-3 * depth);
+
+        Eigen::Vector2f xy;
+        EXPECT_TRUE(map.ImgFromCam(point, &xy));
+        EXPECT_LT((xy.cast<double>() - Eigen::Vector2d(col, row)).norm(), 0.02);
+
+        const Eigen::Vector2d exact_xy =
+            camera.ImgFromCamRefrac(expected_point);
+        EXPECT_TRUE(map.ImgFromCam(expected_point.cast<float>(), &xy));
+        EXPECT_LT((xy.cast<double>() - exact_xy).norm(), 0.1);
+      }
+    }
+  }
+}
+
+TEST(VirtualCameraMap, FlatPort) {
+  Camera camera =
+      Camera::CreateFromModelName(1, "SIMPLE_PINHOLE", 100.0, 100, 80);
+  camera.refrac_model_id = FlatPort::refrac_model_id;
+  camera.refrac_params = {0.1, 0.05, 0.99, 0.05, 0.007, 1.0, 1.52, 1.33};
+  Eigen::Map<Eigen::Vector3d>(camera.refrac_params.data()).normalize();
+  TestRefracCamera(camera);
+}
+
+TEST(VirtualCameraMap, DomePort) {
+  Camera camera =
+      Camera::CreateFromModelName(1, "SIMPLE_PINHOLE", 100.0, 100, 80);
+  camera.refrac_model_id = DomePort::refrac_model_id;
+  camera.refrac_params = {0.001, 0.001, 0.002, 0.05, 0.007, 1.0, 1.52, 1.33};
+  TestRefracCamera(camera);
+}
+
+}  // namespace
+}  // namespace mvs
+}  // namespace colmap
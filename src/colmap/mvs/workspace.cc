@@ -29,12 +29,105 @@
 
 #include "colmap/mvs/workspace.h"
 
+#include "colmap/mvs/compressed_map.h"
 #include "colmap/util/threading.h"
 
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <functional>
 #include <numeric>
+#include <sstream>
+#include <thread>
 
 namespace colmap {
 namespace mvs {
+namespace {
+
+// Reading the images is mostly bound by the disk, so that few threads suffice
+// to prefetch the images ahead of the fusion.
+const int kNumPrefetchThreads = 2;
+
+// Whether the blocked copy of the map exists with the given block size and
+// was written after the map.
+bool IsBlockedMatUpToDate(const std::string& path,
+                          const std::string& blocked_path,
+                          const int block_size) {
+  if (!ExistsFile(blocked_path) ||
+      boost::filesystem::last_write_time(blocked_path) <
+          boost::filesystem::last_write_time(path)) {
+    return false;
+  }
+  return BlockedMatReader<float>(blocked_path).GetBlockSize() ==
+         static_cast<size_t>(block_size);
+}
+
+// The cached bitmaps store the header "width&height&channels&" followed by the
+// rows of the pixels without padding, which are copied as is.
+bool ReadRawBitmap(const std::string& path, Bitmap* bitmap) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file.is_open()) {
+    return false;
+  }
+
+  int width = 0;
+  int height = 0;
+  int channels = 0;
+  char unused_char;
+  file >> width >> unused_char >> height >> unused_char >> channels >>
+      unused_char;
+  if (!file || width <= 0 || height <= 0 || (channels != 1 && channels != 3)) {
+    return false;
+  }
+
+  if (!bitmap->Allocate(width, height, channels == 3)) {
+    return false;
+  }
+  const size_t row_size = static_cast<size_t>(width) * channels;
+  for (int y = 0; y < height; ++y) {
+    file.read(reinterpret_cast<char*>(bitmap->GetScanline(y)), row_size);
+  }
+  return static_cast<bool>(file);
+}
+
+void WriteRawBitmap(const std::string& path, const Bitmap& bitmap) {
+  CreateDirIfNotExists(GetParentDir(path), /*recursive=*/true);
+
+  // Write the bitmap under a name unique to the thread and then rename it,
+  // such that concurrent readers never see partially written bitmaps.
+  std::ostringstream tmp_path;
+  tmp_path << path << "."
+           << std::hash<std::thread::id>()(std::this_thread::get_id())
+           << ".tmp";
+  {
+    std::ofstream file(tmp_path.str(), std::ios::binary);
+    if (!file.is_open()) {
+      LOG(WARNING) << "Failed to write cached bitmap " << tmp_path.str();
+      return;
+    }
+    file << bitmap.Width() << "&" << bitmap.Height() << "&"
+         << bitmap.Channels() << "&";
+    const size_t row_size =
+        static_cast<size_t>(bitmap.Width()) * bitmap.Channels();
+    for (int y = 0; y < bitmap.Height(); ++y) {
+      file.write(reinterpret_cast<const char*>(bitmap.GetScanline(y)),
+                 row_size);
+    }
+  }
+  if (std::rename(tmp_path.str().c_str(), path.c_str()) != 0) {
+    std::remove(tmp_path.str().c_str());
+  }
+}
+
+// The cache is split evenly between the images and the blocks of the maps.
+size_t GetNumCacheBytes(const Workspace::Options& options) {
+  const size_t num_bytes =
+      static_cast<size_t>(1024.0 * 1024.0 * 1024.0 * options.cache_size);
+  return options.block_size > 0 ? std::max<size_t>(num_bytes / 2, 1)
+                                : num_bytes;
+}
+
+}  // namespace
 
 Workspace::Workspace(const Options& options) : options_(options) {
   StringToLower(&options_.input_type);
@@ -49,6 +142,8 @@ Workspace::Workspace(const Options& options) : options_(options) {
       JoinPaths(options_.workspace_path, options_.stereo_folder, "depth_maps"));
   normal_map_path_ = EnsureTrailingSlash(JoinPaths(
       options_.workspace_path, options_.stereo_folder, "normal_maps"));
+  image_cache_path_ = EnsureTrailingSlash(JoinPaths(
+      options_.workspace_path, options_.stereo_folder, "image_cache"));
 }
 
 std::string Workspace::GetFileName(const int image_idx) const {
@@ -57,40 +152,85 @@ std::string Workspace::GetFileName(const int image_idx) const {
       "%s.%s.bin", image_name.c_str(), options_.input_type.c_str());
 }
 
+std::string Workspace::GetBlockedFileName(const int image_idx) const {
+  // The blocked maps are rescaled to the maximum image size.
+  const auto& image_name = model_.GetImageName(image_idx);
+  if (options_.max_image_size > 0) {
+    return StringPrintf("%s.%s.blocked%d.bin",
+                        image_name.c_str(),
+                        options_.input_type.c_str(),
+                        options_.max_image_size);
+  }
+  return StringPrintf(
+      "%s.%s.blocked.bin", image_name.c_str(), options_.input_type.c_str());
+}
+
+void Workspace::ReadBitmap(const int image_idx, Bitmap* bitmap) const {
+  const std::string bitmap_path = GetBitmapPath(image_idx);
+  const size_t width = model_.images.at(image_idx).GetWidth();
+  const size_t height = model_.images.at(image_idx).GetHeight();
+
+  std::string cached_bitmap_path;
+  if (options_.cache_images) {
+    cached_bitmap_path = GetCachedBitmapPath(image_idx);
+    if (ExistsFile(cached_bitmap_path) &&
+        boost::filesystem::last_write_time(cached_bitmap_path) >=
+            boost::filesystem::last_write_time(bitmap_path) &&
+        ReadRawBitmap(cached_bitmap_path, bitmap) &&
+        static_cast<size_t>(bitmap->Width()) == width &&
+        static_cast<size_t>(bitmap->Height()) == height &&
+        bitmap->IsRGB() == options_.image_as_rgb) {
+      return;
+    }
+  }
+
+  bitmap->Read(bitmap_path, options_.image_as_rgb);
+  if (options_.max_image_size > 0) {
+    bitmap->Rescale((int)width, (int)height);
+  }
+
+  if (options_.cache_images) {
+    WriteRawBitmap(cached_bitmap_path, *bitmap);
+  }
+}
+
 void Workspace::Load(const std::vector<std::string>& image_names) {
   const size_t num_images = model_.images.size();
   bitmaps_.resize(num_images);
   depth_maps_.resize(num_images);
   normal_maps_.resize(num_images);
 
+  // The tiles of compressed maps are decoded on the same thread pool, whose
+  // workers run pending tasks while waiting for the tiles.
+  const int num_threads = GetEffectiveNumThreads(options_.num_threads);
+  ThreadPool thread_pool(num_threads);
+
   auto LoadWorkspaceData = [&, this](const int image_idx) {
     const size_t width = model_.images.at(image_idx).GetWidth();
     const size_t height = model_.images.at(image_idx).GetHeight();
 
     // Read and rescale bitmap
-    bitmaps_[image_idx] = std::make_unique<Bitmap>();
-    bitmaps_[image_idx]->Read(GetBitmapPath(image_idx), options_.image_as_rgb);
-    if (options_.max_image_size > 0) {
-      bitmaps_[image_idx]->Rescale((int)width, (int)height);
-    }
+    bitmaps_[image_idx] = std::make_shared<Bitmap>();
+    ReadBitmap(image_idx, bitmaps_[image_idx].get());
 
     // Read and rescale depth map
-    depth_maps_[image_idx] = std::make_unique<DepthMap>();
-    depth_maps_[image_idx]->Read(GetDepthMapPath(image_idx));
+    depth_maps_[image_idx] = std::make_shared<DepthMap>();
+    ReadDepthMap(
+        GetDepthMapPath(image_idx), depth_maps_[image_idx].get(), &thread_pool);
     if (options_.max_image_size > 0) {
       depth_maps_[image_idx]->Downsize(width, height);
     }
 
     // Read and rescale normal map
-    normal_maps_[image_idx] = std::make_unique<NormalMap>();
-    normal_maps_[image_idx]->Read(GetNormalMapPath(image_idx));
+    normal_maps_[image_idx] = std::make_shared<NormalMap>();
+    ReadNormalMap(GetNormalMapPath(image_idx),
+                  normal_maps_[image_idx].get(),
+                  &thread_pool);
     if (options_.max_image_size > 0) {
       normal_maps_[image_idx]->Downsize(width, height);
     }
   };
 
-  const int num_threads = GetEffectiveNumThreads(options_.num_threads);
-  ThreadPool thread_pool(num_threads);
   Timer timer;
   timer.Start();
 
@@ -122,6 +262,58 @@ const NormalMap& Workspace::GetNormalMap(const int image_idx) {
   return *normal_maps_[image_idx];
 }
 
+std::shared_ptr<const Bitmap> Workspace::GetBitmapPtr(const int image_idx) {
+  return bitmaps_[image_idx];
+}
+
+std::shared_ptr<const DepthMap> Workspace::GetDepthMapPtr(
+    const int image_idx) {
+  return depth_maps_[image_idx];
+}
+
+std::shared_ptr<const NormalMap> Workspace::GetNormalMapPtr(
+    const int image_idx) {
+  return normal_maps_[image_idx];
+}
+
+BlockedMatView<float> Workspace::GetDepthMapView(const int image_idx) {
+  return BlockedMatView<float>(GetDepthMapPtr(image_idx));
+}
+
+BlockedMatView<float> Workspace::GetNormalMapView(const int image_idx) {
+  return BlockedMatView<float>(GetNormalMapPtr(image_idx));
+}
+
+void Workspace::WriteBlockedMaps(const int image_idx) const {
+  CHECK_GT(options_.block_size, 0);
+  const size_t width = model_.images.at(image_idx).GetWidth();
+  const size_t height = model_.images.at(image_idx).GetHeight();
+
+  if (!IsBlockedMatUpToDate(GetDepthMapPath(image_idx),
+                            GetBlockedDepthMapPath(image_idx),
+                            options_.block_size)) {
+    DepthMap depth_map;
+    ReadDepthMap(GetDepthMapPath(image_idx), &depth_map);
+    if (options_.max_image_size > 0) {
+      depth_map.Downsize(width, height);
+    }
+    WriteBlockedMat(
+        depth_map, options_.block_size, GetBlockedDepthMapPath(image_idx));
+  }
+
+  if (!IsBlockedMatUpToDate(GetNormalMapPath(image_idx),
+                            GetBlockedNormalMapPath(image_idx),
+                            options_.block_size)) {
+    NormalMap normal_map;
+    ReadNormalMap(GetNormalMapPath(image_idx), &normal_map);
+    if (options_.max_image_size > 0) {
+      normal_map.Downsize(width, height);
+    }
+    WriteBlockedMat(
+        normal_map, options_.block_size, GetBlockedNormalMapPath(image_idx));
+  }
+}
+
 std::string Workspace::GetBitmapPath(const int image_idx) const {
   return model_.images.at(image_idx).GetPath();
 }
@@ -134,6 +326,29 @@ std::string Workspace::GetNormalMapPath(const int image_idx) const {
   return normal_map_path_ + GetFileName(image_idx);
 }
 
+std::string Workspace::GetBlockedDepthMapPath(const int image_idx) const {
+  return depth_map_path_ + GetBlockedFileName(image_idx);
+}
+
+std::string Workspace::GetBlockedNormalMapPath(const int image_idx) const {
+  return normal_map_path_ + GetBlockedFileName(image_idx);
+}
+
+std::string Workspace::GetCachedBitmapPath(const int image_idx) const {
+  // The cached bitmaps are rescaled to the maximum image size.
+  const auto& image_name = model_.GetImageName(image_idx);
+  const char* color = options_.image_as_rgb ? "rgb" : "gray";
+  if (options_.max_image_size > 0) {
+    return StringPrintf("%s%s.%s%d.bin",
+                        image_cache_path_.c_str(),
+                        image_name.c_str(),
+                        color,
+                        options_.max_image_size);
+  }
+  return StringPrintf(
+      "%s%s.%s.bin", image_cache_path_.c_str(), image_name.c_str(), color);
+}
+
 bool Workspace::HasBitmap(const int image_idx) const {
   return ExistsFile(GetBitmapPath(image_idx));
 }
@@ -166,53 +381,228 @@ CachedWorkspace::CachedImage& CachedWorkspace::CachedImage::operator=(
 
 CachedWorkspace::CachedWorkspace(const Options& options)
     : Workspace(options),
-      cache_((size_t)(1024.0 * 1024.0 * 1024.0 * options.cache_size),
-             [](const int) { return CachedImage(); }) {}
+      cache_(GetNumCacheBytes(options),
+             [](const int) { return CachedImage(); }),
+      block_cache_(GetNumCacheBytes(options),
+                   [](const uint64_t) { return CachedBlock(); }),
+      decode_thread_pool_(std::make_unique<ThreadPool>(
+          GetEffectiveNumThreads(options.num_threads))) {}
+
+void CachedWorkspace::ClearCache() {
+  {
+    std::lock_guard<std::mutex> lock(cache_mutex_);
+    cache_.Clear();
+  }
+  std::lock_guard<std::mutex> lock(block_cache_mutex_);
+  block_cache_.Clear();
+}
 
 const Bitmap& CachedWorkspace::GetBitmap(const int image_idx) {
+  return *GetBitmapPtr(image_idx);
+}
+
+const DepthMap& CachedWorkspace::GetDepthMap(const int image_idx) {
+  return *GetDepthMapPtr(image_idx);
+}
+
+const NormalMap& CachedWorkspace::GetNormalMap(const int image_idx) {
+  return *GetNormalMapPtr(image_idx);
+}
+
+std::shared_ptr<const Bitmap> CachedWorkspace::GetBitmapPtr(
+    const int image_idx) {
+  {
+    std::lock_guard<std::mutex> lock(cache_mutex_);
+    const auto& cached_image = cache_.GetMutable(image_idx);
+    if (cached_image.bitmap) {
+      return cached_image.bitmap;
+    }
+  }
+
+  auto bitmap = std::make_shared<Bitmap>();
+  ReadBitmap(image_idx, bitmap.get());
+
+  // Another thread may have read the same bitmap in the meantime.
+  std::lock_guard<std::mutex> lock(cache_mutex_);
   auto& cached_image = cache_.GetMutable(image_idx);
   if (!cached_image.bitmap) {
-    cached_image.bitmap = std::make_unique<Bitmap>();
-    cached_image.bitmap->Read(GetBitmapPath(image_idx), options_.image_as_rgb);
-    if (options_.max_image_size > 0) {
-      cached_image.bitmap->Rescale(model_.images.at(image_idx).GetWidth(),
-                                   model_.images.at(image_idx).GetHeight());
-    }
+    cached_image.bitmap = std::move(bitmap);
     cached_image.num_bytes += cached_image.bitmap->NumBytes();
     cache_.UpdateNumBytes(image_idx);
   }
-  return *cached_image.bitmap;
+  return cached_image.bitmap;
 }
 
-const DepthMap& CachedWorkspace::GetDepthMap(const int image_idx) {
+std::shared_ptr<const DepthMap> CachedWorkspace::GetDepthMapPtr(
+    const int image_idx) {
+  {
+    std::lock_guard<std::mutex> lock(cache_mutex_);
+    const auto& cached_image = cache_.GetMutable(image_idx);
+    if (cached_image.depth_map) {
+      return cached_image.depth_map;
+    }
+  }
+
+  auto depth_map = std::make_shared<DepthMap>();
+  ReadDepthMap(GetDepthMapPath(image_idx),
+               depth_map.get(),
+               decode_thread_pool_.get());
+  if (options_.max_image_size > 0) {
+    depth_map->Downsize(model_.images.at(image_idx).GetWidth(),
+                        model_.images.at(image_idx).GetHeight());
+  }
+
+  std::lock_guard<std::mutex> lock(cache_mutex_);
   auto& cached_image = cache_.GetMutable(image_idx);
   if (!cached_image.depth_map) {
-    cached_image.depth_map = std::make_unique<DepthMap>();
-    cached_image.depth_map->Read(GetDepthMapPath(image_idx));
-    if (options_.max_image_size > 0) {
-      cached_image.depth_map->Downsize(model_.images.at(image_idx).GetWidth(),
-                                       model_.images.at(image_idx).GetHeight());
-    }
+    cached_image.depth_map = std::move(depth_map);
     cached_image.num_bytes += cached_image.depth_map->GetNumBytes();
     cache_.UpdateNumBytes(image_idx);
   }
-  return *cached_image.depth_map;
+  return cached_image.depth_map;
 }
 
-const NormalMap& CachedWorkspace::GetNormalMap(const int image_idx) {
+std::shared_ptr<const NormalMap> CachedWorkspace::GetNormalMapPtr(
+    const int image_idx) {
+  {
+    std::lock_guard<std::mutex> lock(cache_mutex_);
+    const auto& cached_image = cache_.GetMutable(image_idx);
+    if (cached_image.normal_map) {
+      return cached_image.normal_map;
+    }
+  }
+
+  auto normal_map = std::make_shared<NormalMap>();
+  ReadNormalMap(GetNormalMapPath(image_idx),
+                normal_map.get(),
+                decode_thread_pool_.get());
+  if (options_.max_image_size > 0) {
+    normal_map->Downsize(model_.images.at(image_idx).GetWidth(),
+                         model_.images.at(image_idx).GetHeight());
+  }
+
+  std::lock_guard<std::mutex> lock(cache_mutex_);
   auto& cached_image = cache_.GetMutable(image_idx);
   if (!cached_image.normal_map) {
-    cached_image.normal_map = std::make_unique<NormalMap>();
-    cached_image.normal_map->Read(GetNormalMapPath(image_idx));
-    if (options_.max_image_size > 0) {
-      cached_image.normal_map->Downsize(
-          model_.images.at(image_idx).GetWidth(),
-          model_.images.at(image_idx).GetHeight());
-    }
+    cached_image.normal_map = std::move(normal_map);
     cached_image.num_bytes += cached_image.normal_map->GetNumBytes();
     cache_.UpdateNumBytes(image_idx);
   }
-  return *cached_image.normal_map;
+  return cached_image.normal_map;
+}
+
+BlockedMatView<float> CachedWorkspace::GetDepthMapView(const int image_idx) {
+  return GetMapView(image_idx, MapType::DEPTH);
+}
+
+BlockedMatView<float> CachedWorkspace::GetNormalMapView(const int image_idx) {
+  return GetMapView(image_idx, MapType::NORMAL);
+}
+
+void CachedWorkspace::Prefetch(const std::vector<int>& image_idxs,
+                               const bool prefetch_maps) {
+  std::lock_guard<std::mutex> lock(prefetch_mutex_);
+  if (!prefetch_thread_pool_) {
+    prefetch_thread_pool_ = std::make_unique<ThreadPool>(kNumPrefetchThreads);
+  }
+
+  for (const int image_idx : image_idxs) {
+    if (!prefetch_image_idxs_.insert(image_idx).second) {
+      continue;
+    }
+    prefetch_thread_pool_->AddTask([this, image_idx, prefetch_maps]() {
+      GetBitmapPtr(image_idx);
+      if (prefetch_maps && options_.block_size <= 0) {
+        GetDepthMapPtr(image_idx);
+        GetNormalMapPtr(image_idx);
+      }
+      std::lock_guard<std::mutex> lock(prefetch_mutex_);
+      prefetch_image_idxs_.erase(image_idx);
+    });
+  }
+}
+
+void CachedWorkspace::SetMaps(const int image_idx,
+                              std::shared_ptr<const DepthMap> depth_map,
+                              std::shared_ptr<const NormalMap> normal_map) {
+  CHECK_NOTNULL(depth_map);
+  CHECK_NOTNULL(normal_map);
+  std::lock_guard<std::mutex> lock(cache_mutex_);
+  auto& cached_image = cache_.GetMutable(image_idx);
+  if (cached_image.depth_map) {
+    cached_image.num_bytes -= cached_image.depth_map->GetNumBytes();
+  }
+  if (cached_image.normal_map) {
+    cached_image.num_bytes -= cached_image.normal_map->GetNumBytes();
+  }
+  cached_image.depth_map = std::move(depth_map);
+  cached_image.normal_map = std::move(normal_map);
+  cached_image.num_bytes += cached_image.depth_map->GetNumBytes() +
+                            cached_image.normal_map->GetNumBytes();
+  cache_.UpdateNumBytes(image_idx);
+}
+
+bool CachedWorkspace::HasCachedMaps(const int image_idx) {
+  std::lock_guard<std::mutex> lock(cache_mutex_);
+  const CachedImage* cached_image = cache_.Peek(image_idx);
+  return cached_image != nullptr && cached_image->depth_map &&
+         cached_image->normal_map;
+}
+
+BlockedMatView<float> CachedWorkspace::GetMapView(const int image_idx,
+                                                  const MapType map_type) {
+  const std::string blocked_path = map_type == MapType::DEPTH
+                                       ? GetBlockedDepthMapPath(image_idx)
+                                       : GetBlockedNormalMapPath(image_idx);
+  if (options_.block_size <= 0 || !ExistsFile(blocked_path)) {
+    if (map_type == MapType::DEPTH) {
+      return BlockedMatView<float>(GetDepthMapPtr(image_idx));
+    } else {
+      return BlockedMatView<float>(GetNormalMapPtr(image_idx));
+    }
+  }
+
+  auto reader = std::make_shared<const BlockedMatReader<float>>(blocked_path);
+  return BlockedMatView<float>(
+      reader->GetWidth(),
+      reader->GetHeight(),
+      reader->GetDepth(),
+      reader->GetBlockSize(),
+      reader->GetBlockSize(),
+      [this, reader, image_idx, map_type](const size_t block_row,
+                                          const size_t block_col) {
+        return GetBlock(*reader, image_idx, map_type, block_row, block_col);
+      });
+}
+
+std::shared_ptr<const std::vector<float>> CachedWorkspace::GetBlock(
+    const BlockedMatReader<float>& reader,
+    const int image_idx,
+    const MapType map_type,
+    const size_t block_row,
+    const size_t block_col) {
+  const uint64_t block_idx = block_row * reader.GetNumBlockCols() + block_col;
+  const uint64_t key = (static_cast<uint64_t>(image_idx) << 33) |
+                       (static_cast<uint64_t>(map_type) << 32) | block_idx;
+  {
+    std::lock_guard<std::mutex> lock(block_cache_mutex_);
+    if (block_cache_.Exists(key)) {
+      return block_cache_.Get(key).data;
+    }
+  }
+
+  auto data = std::make_shared<const std::vector<float>>(
+      reader.ReadBlock(block_row, block_col));
+
+  // Another thread may have read the same block in the meantime.
+  std::lock_guard<std::mutex> lock(block_cache_mutex_);
+  if (block_cache_.Exists(key)) {
+    return block_cache_.Get(key).data;
+  }
+  CachedBlock block;
+  block.data = std::move(data);
+  block_cache_.Set(key, block);
+  return block.data;
 }
 
 void ImportPMVSWorkspace(const Workspace& workspace,
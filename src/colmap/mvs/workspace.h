@@ -29,6 +29,7 @@
 
 #pragma once
 
+#include "colmap/mvs/blocked_mat.h"
 #include "colmap/mvs/consistency_graph.h"
 #include "colmap/mvs/depth_map.h"
 #include "colmap/mvs/model.h"
@@ -36,8 +37,12 @@
 #include "colmap/sensor/bitmap.h"
 #include "colmap/util/cache.h"
 #include "colmap/util/misc.h"
+#include "colmap/util/threading.h"
 
+#include <cstdint>
 #include <memory>
+#include <mutex>
+#include <unordered_set>
 
 namespace colmap {
 namespace mvs {
@@ -57,6 +62,18 @@ class Workspace {
     // Whether to read image as RGB or gray scale.
     bool image_as_rgb = true;
 
+    // If positive, the cached workspace reads the depth and normal maps in
+    // square blocks of this size in pixels from blocked copies of the maps,
+    // see `WriteBlockedMaps`, and only caches the blocks that are accessed.
+    int block_size = 0;
+
+    // Whether to cache the rescaled bitmaps in a raw format in the
+    // `image_cache` folder of the stereo folder. Later reads with the same
+    // maximum image size and color mode then skip decoding and rescaling the
+    // images, e.g., across the photometric and geometric pass of the stereo
+    // and the fusion. Outdated cached bitmaps are replaced.
+    bool cache_images = false;
+
     // Location and type of workspace.
     std::string workspace_path;
     std::string workspace_format;
@@ -78,10 +95,34 @@ class Workspace {
   virtual const DepthMap& GetDepthMap(int image_idx);
   virtual const NormalMap& GetNormalMap(int image_idx);
 
+  // Thread-safe access to the data. The returned data stays valid while it is
+  // referenced, even if it is evicted from a cache in the meantime.
+  virtual std::shared_ptr<const Bitmap> GetBitmapPtr(int image_idx);
+  virtual std::shared_ptr<const DepthMap> GetDepthMapPtr(int image_idx);
+  virtual std::shared_ptr<const NormalMap> GetNormalMapPtr(int image_idx);
+
+  // Views of the depth and normal maps, which wrap the full maps by default.
+  // The views must not outlive the workspace.
+  virtual BlockedMatView<float> GetDepthMapView(int image_idx);
+  virtual BlockedMatView<float> GetNormalMapView(int image_idx);
+
+  // Asynchronously read the data of the images into the cache, if any. The
+  // depth and normal maps are only read if `prefetch_maps` is true.
+  virtual void Prefetch(const std::vector<int>& image_idxs,
+                        bool prefetch_maps = true) {}
+
+  // Write the blocked copies of the depth and normal map with the block size
+  // of the options, unless they are up to date. The maps are read without
+  // caching them. Must not be called concurrently for the same image.
+  void WriteBlockedMaps(int image_idx) const;
+
   // Get paths to bitmap, depth map, normal map and consistency graph.
   std::string GetBitmapPath(int image_idx) const;
   std::string GetDepthMapPath(int image_idx) const;
   std::string GetNormalMapPath(int image_idx) const;
+  std::string GetBlockedDepthMapPath(int image_idx) const;
+  std::string GetBlockedNormalMapPath(int image_idx) const;
+  std::string GetCachedBitmapPath(int image_idx) const;
 
   // Return whether bitmap, depth map, normal map, and consistency graph exist.
   bool HasBitmap(int image_idx) const;
@@ -90,6 +131,11 @@ class Workspace {
 
  protected:
   std::string GetFileName(int image_idx) const;
+  std::string GetBlockedFileName(int image_idx) const;
+
+  // Read the bitmap rescaled to the size of the image in the model, either
+  // from the image cache or by decoding and rescaling the image.
+  void ReadBitmap(int image_idx, Bitmap* bitmap) const;
 
   Options options_;
   Model model_;
@@ -97,9 +143,10 @@ class Workspace {
  private:
   std::string depth_map_path_;
   std::string normal_map_path_;
-  std::vector<std::unique_ptr<Bitmap>> bitmaps_;
-  std::vector<std::unique_ptr<DepthMap>> depth_maps_;
-  std::vector<std::unique_ptr<NormalMap>> normal_maps_;
+  std::string image_cache_path_;
+  std::vector<std::shared_ptr<Bitmap>> bitmaps_;
+  std::vector<std::shared_ptr<DepthMap>> depth_maps_;
+  std::vector<std::shared_ptr<NormalMap>> normal_maps_;
 };
 
 class CachedWorkspace : public Workspace {
@@ -108,13 +155,52 @@ class CachedWorkspace : public Workspace {
 
   void Load(const std::vector<std::string>& image_names) override {}
 
-  inline void ClearCache() { cache_.Clear(); }
+  void ClearCache();
 
   const Bitmap& GetBitmap(int image_idx) override;
   const DepthMap& GetDepthMap(int image_idx) override;
   const NormalMap& GetNormalMap(int image_idx) override;
 
+  // The data is read without holding the lock of the cache, so that multiple
+  // threads can read different images concurrently.
+  std::shared_ptr<const Bitmap> GetBitmapPtr(int image_idx) override;
+  std::shared_ptr<const DepthMap> GetDepthMapPtr(int image_idx) override;
+  std::shared_ptr<const NormalMap> GetNormalMapPtr(int image_idx) override;
+
+  // The views read the blocks through a separate cache, if the blocked maps
+  // have been written. Otherwise, they wrap the cached full maps.
+  BlockedMatView<float> GetDepthMapView(int image_idx) override;
+  BlockedMatView<float> GetNormalMapView(int image_idx) override;
+
+  // Read the bitmaps and, without blocked maps, the depth and normal maps of
+  // the images in a background thread. Images that are already queued are
+  // skipped.
+  void Prefetch(const std::vector<int>& image_idxs,
+                bool prefetch_maps = true) override;
+
+  // Insert the depth and normal map of the image into the cache, e.g., right
+  // after computing them, so that they are not read back from disk. The maps
+  // must have the size of the image in the model.
+  void SetMaps(int image_idx,
+               std::shared_ptr<const DepthMap> depth_map,
+               std::shared_ptr<const NormalMap> normal_map);
+
+  // Whether the depth and normal map of the image are in the cache. This does
+  // not mark the image as recently used.
+  bool HasCachedMaps(int image_idx);
+
  private:
+  enum class MapType { DEPTH = 0, NORMAL = 1 };
+
+  BlockedMatView<float> GetMapView(int image_idx, MapType map_type);
+
+  std::shared_ptr<const std::vector<float>> GetBlock(
+      const BlockedMatReader<float>& reader,
+      int image_idx,
+      MapType map_type,
+      size_t block_row,
+      size_t block_col);
+
   class CachedImage {
    public:
     CachedImage() {}
@@ -122,15 +208,36 @@ class CachedWorkspace : public Workspace {
     CachedImage& operator=(CachedImage&& other) noexcept;
     inline size_t NumBytes() const { return num_bytes; }
     size_t num_bytes = 0;
-    std::unique_ptr<Bitmap> bitmap;
-    std::unique_ptr<DepthMap> depth_map;
-    std::unique_ptr<NormalMap> normal_map;
+    std::shared_ptr<const Bitmap> bitmap;
+    std::shared_ptr<const DepthMap> depth_map;
+    std::shared_ptr<const NormalMap> normal_map;
 
    private:
     NON_COPYABLE(CachedImage)
   };
 
+  struct CachedBlock {
+    inline size_t NumBytes() const {
+      return data ? data->size() * sizeof(float) : 0;
+    }
+    std::shared_ptr<const std::vector<float>> data;
+  };
+
+  std::mutex cache_mutex_;
   MemoryConstrainedLRUCache<int, CachedImage> cache_;
+
+  // Blocks of the depth and normal maps by image, map type, and block index.
+  std::mutex block_cache_mutex_;
+  MemoryConstrainedLRUCache<uint64_t, CachedBlock> block_cache_;
+
+  // Decodes the tiles of compressed depth and normal maps in parallel.
+  std::unique_ptr<ThreadPool> decode_thread_pool_;
+
+  std::mutex prefetch_mutex_;
+  std::unordered_set<int> prefetch_image_idxs_;
+  // Destroyed first, so that running prefetch tasks finish before the caches
+  // are destroyed.
+  std::unique_ptr<ThreadPool> prefetch_thread_pool_;
 };
 
 // Import a PMVS workspace into the COLMAP workspace format. Only images in the
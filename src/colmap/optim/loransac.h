@@ -71,6 +71,11 @@ class LORANSAC : public RANSAC<Estimator, SupportMeasurer, Sampler> {
 
  private:
   using RANSAC<Estimator, SupportMeasurer, Sampler>::options_;
+  using RANSAC<Estimator, SupportMeasurer, Sampler>::InitializeSPRT;
+  using RANSAC<Estimator, SupportMeasurer, Sampler>::ComputeResiduals;
+  using RANSAC<Estimator, SupportMeasurer, Sampler>::UpdateSPRT;
+  using RANSAC<Estimator, SupportMeasurer, Sampler>::InitializeParallel;
+  using RANSAC<Estimator, SupportMeasurer, Sampler>::NextParallelSample;
 };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -122,8 +127,13 @@ LORANSAC<Estimator, LocalEstimator, SupportMeasurer, Sampler>::Estimate(
   std::vector<typename Estimator::X_t> X_rand(Estimator::kMinNumSamples);
   std::vector<typename Estimator::Y_t> Y_rand(Estimator::kMinNumSamples);
   std::vector<typename Estimator::M_t> sample_models;
+  std::vector<typename SupportMeasurer::Support> sample_supports;
   std::vector<typename LocalEstimator::M_t> local_models;
 
+  const auto parallel_state = InitializeParallel();
+  const auto sprt_state =
+      parallel_state ? nullptr : InitializeSPRT(num_samples);
+
   sampler.Initialize(num_samples);
 
   size_t max_num_trials =
@@ -138,17 +148,42 @@ LORANSAC<Estimator, LocalEstimator, SupportMeasurer, Sampler>::Estimate(
       break;
     }
 
-    sampler.SampleXY(X, Y, &X_rand, &Y_rand);
-
-    // Estimate model for current subset.
-    estimator.Estimate(X_rand, Y_rand, &sample_models);
+    if (parallel_state) {
+      NextParallelSample(X,
+                         Y,
+                         max_residual,
+                         max_num_trials - report.num_trials,
+                         parallel_state.get(),
+                         &sample_models,
+                         &sample_supports,
+                         &report);
+    } else {
+      sampler.SampleXY(X, Y, &X_rand, &Y_rand);
+
+      // Estimate model for current subset.
+      estimator.Estimate(X_rand, Y_rand, &sample_models);
+    }
 
     // Iterate through all estimated models
-    for (const auto& sample_model : sample_models) {
-      estimator.Residuals(X, Y, sample_model, &residuals);
-      CHECK_EQ(residuals.size(), num_samples);
-
-      const auto support = support_measurer.Evaluate(residuals, max_residual);
+    for (size_t model_idx = 0; model_idx < sample_models.size(); ++model_idx) {
+      const auto& sample_model = sample_models[model_idx];
+
+      typename SupportMeasurer::Support support;
+      if (parallel_state) {
+        support = sample_supports[model_idx];
+      } else {
+        if (!ComputeResiduals(X,
+                              Y,
+                              sample_model,
+                              max_residual,
+                              sprt_state.get(),
+                              &residuals,
+                              &report)) {
+          continue;
+        }
+        CHECK_EQ(residuals.size(), num_samples);
+        support = support_measurer.Evaluate(residuals, max_residual);
+      }
 
       // Do local optimization if better than all previous subsets.
       if (support_measurer.Compare(support, best_support)) {
@@ -156,6 +191,14 @@ LORANSAC<Estimator, LocalEstimator, SupportMeasurer, Sampler>::Estimate(
         best_model = sample_model;
         best_model_is_local = false;
 
+        // The residuals of the parallel evaluation are not kept, so they are
+        // only recomputed for the rare improvements of the best model.
+        if (parallel_state) {
+          estimator.Residuals(X, Y, sample_model, &residuals);
+          CHECK_EQ(residuals.size(), num_samples);
+          report.num_residuals += num_samples;
+        }
+
         // Estimate locally optimized model from inliers.
         if (support.num_inliers > Estimator::kMinNumSamples &&
             support.num_inliers >= LocalEstimator::kMinNumSamples) {
@@ -182,6 +225,7 @@ LORANSAC<Estimator, LocalEstimator, SupportMeasurer, Sampler>::Estimate(
             for (const auto& local_model : local_models) {
               local_estimator.Residuals(X, Y, local_model, &residuals);
               CHECK_EQ(residuals.size(), num_samples);
+              report.num_residuals += num_samples;
 
               const auto local_support =
                   support_measurer.Evaluate(residuals, max_residual);
@@ -207,6 +251,11 @@ LORANSAC<Estimator, LocalEstimator, SupportMeasurer, Sampler>::Estimate(
           }
         }
 
+        if (sprt_state) {
+          sprt_state->best_num_inliers = best_support.num_inliers;
+          UpdateSPRT(num_samples, report, sprt_state.get());
+        }
+
         dyn_max_num_trials =
             RANSAC<Estimator, SupportMeasurer, Sampler>::ComputeNumTrials(
                 best_support.num_inliers,
@@ -103,5 +103,99 @@ TEST(LORANSAC, SimilarityTransform) {
   EXPECT_LT(matrix_diff, 1e-6);
 }
 
+TEST(LORANSAC, SimilarityTransformSPRT) {
+  SetPRNGSeed(0);
+
+  const size_t num_samples = 1000;
+  const size_t num_outliers = 400;
+
+  const Sim3d expectedTgtFromSrc(
+      2, Eigen::Quaterniond::UnitRandom(), Eigen::Vector3d(100, 10, 10));
+
+  std::vector<Eigen::Vector3d> src;
+  std::vector<Eigen::Vector3d> tgt;
+  for (size_t i = 0; i < num_samples; ++i) {
+    src.emplace_back(i, std::sqrt(i) + 2, std::sqrt(2 * i + 2));
+    tgt.push_back(expectedTgtFromSrc * src.back());
+  }
+
+  for (size_t i = 0; i < num_outliers; ++i) {
+    tgt[i] = Eigen::Vector3d(RandomUniformReal(-3000.0, -2000.0),
+                             RandomUniformReal(-4000.0, -3000.0),
+                             RandomUniformReal(-5000.0, -4000.0));
+  }
+
+  RANSACOptions options;
+  options.max_error = 10;
+  options.use_sprt = true;
+  LORANSAC<SimilarityTransformEstimator<3>, SimilarityTransformEstimator<3>>
+      ransac(options);
+  const auto report = ransac.Estimate(src, tgt);
+
+  EXPECT_TRUE(report.success);
+  EXPECT_GT(report.num_trials, 0);
+  EXPECT_GT(report.num_sprt_rejections, 0);
+
+  EXPECT_EQ(report.support.num_inliers, num_samples - num_outliers);
+  for (size_t i = 0; i < num_samples; ++i) {
+    EXPECT_EQ(report.inlier_mask[i], i >= num_outliers);
+  }
+
+  const double matrix_diff =
+      (expectedTgtFromSrc.ToMatrix() - report.model).norm();
+  EXPECT_LT(matrix_diff, 1e-6);
+}
+
+TEST(LORANSAC, SimilarityTransformParallel) {
+  SetPRNGSeed(0);
+
+  const size_t num_samples = 1000;
+  const size_t num_outliers = 400;
+
+  const Sim3d expectedTgtFromSrc(
+      2, Eigen::Quaterniond::UnitRandom(), Eigen::Vector3d(100, 10, 10));
+
+  std::vector<Eigen::Vector3d> src;
+  std::vector<Eigen::Vector3d> tgt;
+  for (size_t i = 0; i < num_samples; ++i) {
+    src.emplace_back(i, std::sqrt(i) + 2, std::sqrt(2 * i + 2));
+    tgt.push_back(expectedTgtFromSrc * src.back());
+  }
+
+  for (size_t i = 0; i < num_outliers; ++i) {
+    tgt[i] = Eigen::Vector3d(RandomUniformReal(-3000.0, -2000.0),
+                             RandomUniformReal(-4000.0, -3000.0),
+                             RandomUniformReal(-5000.0, -4000.0));
+  }
+
+  const auto Estimate = [&](const int num_threads) {
+    RANSACOptions options;
+    options.max_error = 10;
+    options.num_threads = num_threads;
+    LORANSAC<SimilarityTransformEstimator<3>, SimilarityTransformEstimator<3>>
+        ransac(options);
+    SetPRNGSeed(1);
+    return ransac.Estimate(src, tgt);
+  };
+
+  // The parallel evaluation of the same samples yields the sequential result.
+  const auto report = Estimate(1);
+  for (const int num_threads : {2, 4}) {
+    const auto parallel_report = Estimate(num_threads);
+    EXPECT_TRUE(parallel_report.success);
+    EXPECT_EQ(parallel_report.num_trials, report.num_trials);
+    EXPECT_EQ(parallel_report.support.num_inliers, report.support.num_inliers);
+    EXPECT_EQ(parallel_report.support.residual_sum,
+              report.support.residual_sum);
+    EXPECT_EQ(parallel_report.inlier_mask, report.inlier_mask);
+    EXPECT_EQ(parallel_report.model, report.model);
+  }
+
+  EXPECT_EQ(report.support.num_inliers, num_samples - num_outliers);
+  const double matrix_diff =
+      (expectedTgtFromSrc.ToMatrix() - report.model).norm();
+  EXPECT_LT(matrix_diff, 1e-6);
+}
+
 }  // namespace
 }  // namespace colmap
@@ -29,9 +29,6 @@
 
 #include "colmap/optim/progressive_sampler.h"
 
-#include "colmap/math/random.h"
-#include "colmap/util/misc.h"
-
 #include <numeric>
 
 namespace colmap {
@@ -61,6 +58,8 @@ void ProgressiveSampler::Initialize(const size_t total_num_samples) {
   for (size_t i = 0; i < num_samples_; ++i) {
     T_n_ *= static_cast<double>(num_samples_ - i) / (total_num_samples_ - i);
   }
+
+  prng_.Seed(RandomPCG32Seed());
 }
 
 size_t ProgressiveSampler::MaxNumSamples() {
@@ -70,7 +69,6 @@ size_t ProgressiveSampler::MaxNumSamples() {
 void ProgressiveSampler::Sample(std::vector<size_t>* sampled_idxs) {
   t_ += 1;
 
-  sampled_idxs->clear();
   sampled_idxs->reserve(num_samples_);
 
   // Compute T_n_p_ using recurrent relation in equation 3 (second part).
@@ -91,16 +89,11 @@ void ProgressiveSampler::Sample(std::vector<size_t>* sampled_idxs) {
   }
 
   // Draw semi-random samples as described in algorithm 1.
-  for (size_t i = 0; i < num_random_samples; ++i) {
-    while (true) {
-      const size_t random_idx =
-          RandomUniformInteger<uint32_t>(0, max_random_sample_idx);
-      if (!VectorContainsValue(*sampled_idxs, random_idx)) {
-        sampled_idxs->push_back(random_idx);
-        break;
-      }
-    }
-  }
+  sampled_idxs->resize(num_random_samples);
+  RandomUniqueIntegers(max_random_sample_idx + 1,
+                       num_random_samples,
+                       &prng_,
+                       sampled_idxs->data());
 
   // In progressive sampling mode, the last element is mandatory.
   if (T_n_p_ >= t_) {
@@ -29,6 +29,7 @@
 
 #pragma once
 
+#include "colmap/math/random.h"
 #include "colmap/optim/sampler.h"
 
 namespace colmap {
@@ -63,6 +64,8 @@ class ProgressiveSampler : public Sampler {
   // Variables defined in equation 3.
   double T_n_;
   double T_n_p_;
+
+  PCG32 prng_;
 };
 
 }  // namespace colmap
@@ -29,19 +29,22 @@
 
 #include "colmap/optim/random_sampler.h"
 
-#include "colmap/math/random.h"
-
 #include <numeric>
 
 namespace colmap {
 
 RandomSampler::RandomSampler(const size_t num_samples)
-    : num_samples_(num_samples) {}
+    : num_samples_(num_samples), total_num_samples_(0) {}
 
 void RandomSampler::Initialize(const size_t total_num_samples) {
   CHECK_LE(num_samples_, total_num_samples);
-  sample_idxs_.resize(total_num_samples);
-  std::iota(sample_idxs_.begin(), sample_idxs_.end(), 0);
+  CHECK_LE(total_num_samples, std::numeric_limits<uint32_t>::max());
+  total_num_samples_ = total_num_samples;
+  if (num_samples_ > kMaxNumFloydSamples) {
+    sample_idxs_.resize(total_num_samples);
+    std::iota(sample_idxs_.begin(), sample_idxs_.end(), 0);
+  }
+  prng_.Seed(RandomPCG32Seed());
 }
 
 size_t RandomSampler::MaxNumSamples() {
@@ -49,10 +52,19 @@ size_t RandomSampler::MaxNumSamples() {
 }
 
 void RandomSampler::Sample(std::vector<size_t>* sampled_idxs) {
-  Shuffle(static_cast<uint32_t>(num_samples_), &sample_idxs_);
-
   sampled_idxs->resize(num_samples_);
+
+  if (num_samples_ <= kMaxNumFloydSamples) {
+    RandomUniqueIntegers(
+        total_num_samples_, num_samples_, &prng_, sampled_idxs->data());
+    return;
+  }
+
+  const uint32_t last_idx = static_cast<uint32_t>(total_num_samples_ - 1);
   for (size_t i = 0; i < num_samples_; ++i) {
+    const size_t j =
+        i + prng_.Bounded(static_cast<uint32_t>(last_idx - i + 1));
+    std::swap(sample_idxs_[i], sample_idxs_[j]);
     (*sampled_idxs)[i] = sample_idxs_[i];
   }
 }
@@ -29,12 +29,18 @@
 
 #pragma once
 
+#include "colmap/math/random.h"
 #include "colmap/optim/sampler.h"
 
 namespace colmap {
 
 // Random sampler for RANSAC-based methods.
 //
+// Small samples, e.g., the minimal samples of RANSAC, are drawn without
+// rejection and without touching an array of all indices, see
+// `RandomUniqueIntegers`, whereas larger samples are drawn by partial
+// Fisher-Yates shuffling.
+//
 // Note that a separate sampler should be instantiated per thread.
 class RandomSampler : public Sampler {
  public:
@@ -47,8 +53,14 @@ class RandomSampler : public Sampler {
   void Sample(std::vector<size_t>* sampled_idxs) override;
 
  private:
+  // Maximum number of samples drawn with `RandomUniqueIntegers`, whose number
+  // of operations grows quadratically with the number of samples.
+  static const size_t kMaxNumFloydSamples = 16;
+
   const size_t num_samples_;
+  size_t total_num_samples_;
   std::vector<size_t> sample_idxs_;
+  PCG32 prng_;
 };
 
 }  // namespace colmap
@@ -29,6 +29,7 @@
 
 #include "colmap/optim/random_sampler.h"
 
+#include <algorithm>
 #include <unordered_set>
 
 #include <gtest/gtest.h>
@@ -62,5 +63,36 @@ TEST(RandomSampler, EqualSamples) {
   }
 }
 
+TEST(RandomSampler, ManySamples) {
+  RandomSampler sampler(20);
+  sampler.Initialize(30);
+  for (size_t i = 0; i < 100; ++i) {
+    std::vector<size_t> samples;
+    sampler.Sample(&samples);
+    EXPECT_EQ(samples.size(), 20);
+    EXPECT_EQ(std::unordered_set<size_t>(samples.begin(), samples.end()).size(),
+              20);
+    EXPECT_LT(*std::max_element(samples.begin(), samples.end()), 30);
+  }
+}
+
+TEST(RandomSampler, Uniform) {
+  RandomSampler sampler(2);
+  sampler.Initialize(5);
+  std::vector<int> counts(5, 0);
+  for (size_t i = 0; i < 5000; ++i) {
+    std::vector<size_t> samples;
+    sampler.Sample(&samples);
+    for (const size_t sample : samples) {
+      ASSERT_LT(sample, 5);
+      counts[sample] += 1;
+    }
+  }
+  for (const int count : counts) {
+    EXPECT_GT(count, 1800);
+    EXPECT_LT(count, 2200);
+  }
+}
+
 }  // namespace
 }  // namespace colmap
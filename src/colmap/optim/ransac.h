@@ -29,11 +29,17 @@
 
 #pragma once
 
+#include "colmap/math/random.h"
 #include "colmap/optim/random_sampler.h"
+#include "colmap/optim/sprt.h"
 #include "colmap/optim/support_measurement.h"
 #include "colmap/util/logging.h"
+#include "colmap/util/threading.h"
 
+#include <algorithm>
 #include <cfloat>
+#include <memory>
+#include <numeric>
 #include <random>
 #include <stdexcept>
 #include <vector>
@@ -61,6 +67,28 @@ struct RANSACOptions {
   int min_num_trials = 0;
   int max_num_trials = std::numeric_limits<int>::max();
 
+  // Whether to verify the models with the Sequential Probability Ratio Test,
+  // see `SPRT`. The residuals of a model are then computed in chunks of
+  // randomly ordered samples and bad models are rejected after a few chunks,
+  // which pays off for estimators with expensive residuals. The test is
+  // initialized with `min_inlier_ratio` and adapts to the inlier ratio of the
+  // best model and to the inlier ratio of the rejected models. Note that also
+  // good models are rejected with a small probability.
+  bool use_sprt = false;
+
+  // The ratio of the time it takes to estimate the models from a random
+  // sample over the time it takes to compute one residual.
+  double sprt_eval_time_ratio = 200;
+
+  // Number of threads to estimate and score the models of one estimation,
+  // where -1 uses all available threads. This pays off for single expensive
+  // estimations, whereas many estimations should rather run concurrently with
+  // one thread each. The samples are drawn in batches and the models of a
+  // batch are evaluated in parallel, but merged in the order of the samples,
+  // such that the result equals the sequential result for the same samples.
+  // The SPRT is only used by the sequential evaluation.
+  int num_threads = 1;
+
   void Check() const {
     CHECK_GT(max_error, 0);
     CHECK_GE(min_inlier_ratio, 0);
@@ -68,6 +96,7 @@ struct RANSACOptions {
     CHECK_GE(confidence, 0);
     CHECK_LE(confidence, 1);
     CHECK_LE(min_num_trials, max_num_trials);
+    CHECK_GT(sprt_eval_time_ratio, 0);
   }
 };
 
@@ -83,6 +112,11 @@ class RANSAC {
     // The number of RANSAC trials / iterations.
     size_t num_trials = 0;
 
+    // The number of computed residuals over all models and the number of
+    // models rejected by the SPRT before computing all their residuals.
+    size_t num_residuals = 0;
+    size_t num_sprt_rejections = 0;
+
     // The support of the estimated model.
     typename SupportMeasurer::Support support;
 
@@ -128,6 +162,76 @@ class RANSAC {
   SupportMeasurer support_measurer;
 
  protected:
+  // State of the SPRT during one estimation.
+  struct SPRTState {
+    explicit SPRTState(const SPRT::Options& options) : sprt(options) {}
+    SPRT sprt;
+    // Random order in which the samples are evaluated.
+    std::vector<size_t> sample_idxs;
+    std::vector<typename Estimator::X_t> X_chunk;
+    std::vector<typename Estimator::Y_t> Y_chunk;
+    std::vector<double> chunk_residuals;
+    // The number of inliers of the best model so far.
+    size_t best_num_inliers = 0;
+    // Sum of the inlier ratios of the evaluated samples of rejected models.
+    double sum_rejected_inlier_ratios = 0;
+  };
+
+  // Initialize the SPRT for the given number of samples, if enabled.
+  std::unique_ptr<SPRTState> InitializeSPRT(size_t num_samples) const;
+
+  // Compute the residuals of the model from the estimator. With the SPRT, the
+  // computation stops once the model is rejected, in which case false is
+  // returned and the residuals are incomplete.
+  bool ComputeResiduals(const std::vector<typename Estimator::X_t>& X,
+                        const std::vector<typename Estimator::Y_t>& Y,
+                        const typename Estimator::M_t& model,
+                        double max_residual,
+                        SPRTState* sprt_state,
+                        std::vector<double>* residuals,
+                        Report* report);
+
+  // Adapt the SPRT to the inlier ratio of the best model and the estimated
+  // inlier ratio of bad models.
+  void UpdateSPRT(size_t num_samples,
+                  const Report& report,
+                  SPRTState* sprt_state) const;
+
+  // State of the parallel evaluation of the models during one estimation.
+  struct ParallelState {
+    explicit ParallelState(int num_threads) : thread_pool(num_threads) {}
+    ThreadPool thread_pool;
+    // Copies of the estimator and support measurer per thread.
+    std::vector<Estimator> estimators;
+    std::vector<SupportMeasurer> support_measurers;
+    std::vector<std::vector<double>> residuals;
+    // The samples of the current batch with their models and supports.
+    std::vector<std::vector<typename Estimator::X_t>> X_rand;
+    std::vector<std::vector<typename Estimator::Y_t>> Y_rand;
+    std::vector<std::vector<typename Estimator::M_t>> models;
+    std::vector<std::vector<typename SupportMeasurer::Support>> supports;
+    size_t num_batch_samples = 0;
+    size_t next_batch_sample_idx = 0;
+  };
+
+  // Initialize the parallel evaluation, if more than one thread is used.
+  std::unique_ptr<ParallelState> InitializeParallel() const;
+
+  // Advance to the next sample of the parallel evaluation. If the current
+  // batch is exhausted, the next batch of at most `max_num_batch_samples`
+  // samples is drawn sequentially, since the samplers are not thread-safe,
+  // and their models are estimated and scored in parallel. The models and
+  // supports of the sample are swapped into the output vectors.
+  void NextParallelSample(
+      const std::vector<typename Estimator::X_t>& X,
+      const std::vector<typename Estimator::Y_t>& Y,
+      double max_residual,
+      size_t max_num_batch_samples,
+      ParallelState* parallel_state,
+      std::vector<typename Estimator::M_t>* sample_models,
+      std::vector<typename SupportMeasurer::Support>* sample_supports,
+      Report* report);
+
   RANSACOptions options_;
 };
 
@@ -204,9 +308,14 @@ RANSAC<Estimator, SupportMeasurer, Sampler>::Estimate(
 
   std::vector<double> residuals(num_samples);
 
+  const auto parallel_state = InitializeParallel();
+  const auto sprt_state =
+      parallel_state ? nullptr : InitializeSPRT(num_samples);
+
   std::vector<typename Estimator::X_t> X_rand(Estimator::kMinNumSamples);
   std::vector<typename Estimator::Y_t> Y_rand(Estimator::kMinNumSamples);
   std::vector<typename Estimator::M_t> sample_models;
+  std::vector<typename SupportMeasurer::Support> sample_supports;
 
   sampler.Initialize(num_samples);
 
@@ -222,23 +331,53 @@ RANSAC<Estimator, SupportMeasurer, Sampler>::Estimate(
       break;
     }
 
-    sampler.SampleXY(X, Y, &X_rand, &Y_rand);
-
-    // Estimate model for current subset.
-    estimator.Estimate(X_rand, Y_rand, &sample_models);
+    if (parallel_state) {
+      NextParallelSample(X,
+                         Y,
+                         max_residual,
+                         max_num_trials - report.num_trials,
+                         parallel_state.get(),
+                         &sample_models,
+                         &sample_supports,
+                         &report);
+    } else {
+      sampler.SampleXY(X, Y, &X_rand, &Y_rand);
+
+      // Estimate model for current subset.
+      estimator.Estimate(X_rand, Y_rand, &sample_models);
+    }
 
     // Iterate through all estimated models.
-    for (const auto& sample_model : sample_models) {
-      estimator.Residuals(X, Y, sample_model, &residuals);
-      CHECK_EQ(residuals.size(), num_samples);
-
-      const auto support = support_measurer.Evaluate(residuals, max_residual);
+    for (size_t model_idx = 0; model_idx < sample_models.size(); ++model_idx) {
+      const auto& sample_model = sample_models[model_idx];
+
+      typename SupportMeasurer::Support support;
+      if (parallel_state) {
+        support = sample_supports[model_idx];
+      } else {
+        if (!ComputeResiduals(X,
+                              Y,
+                              sample_model,
+                              max_residual,
+                              sprt_state.get(),
+                              &residuals,
+                              &report)) {
+          continue;
+        }
+        CHECK_EQ(residuals.size(), num_samples);
+        support = support_measurer.Evaluate(residuals, max_residual);
+      }
 
       // Save as best subset if better than all previous subsets.
       if (support_measurer.Compare(support, best_support)) {
         best_support = support;
         best_model = sample_model;
 
+        if (sprt_state) {
+          sprt_state->best_num_inliers = best_support.num_inliers;
+          UpdateSPRT(num_samples, report, sprt_state.get());
+        }
+
         dyn_max_num_trials =
             ComputeNumTrials(best_support.num_inliers,
                              num_samples,
@@ -279,4 +418,203 @@ RANSAC<Estimator, SupportMeasurer, Sampler>::Estimate(
   return report;
 }
 
+template <typename Estimator, typename SupportMeasurer, typename Sampler>
+std::unique_ptr<
+    typename RANSAC<Estimator, SupportMeasurer, Sampler>::SPRTState>
+RANSAC<Estimator, SupportMeasurer, Sampler>::InitializeSPRT(
+    const size_t num_samples) const {
+  if (!options_.use_sprt) {
+    return nullptr;
+  }
+
+  SPRT::Options sprt_options;
+  sprt_options.epsilon = std::max(options_.min_inlier_ratio,
+                                  2 * sprt_options.delta);
+  sprt_options.eval_time_ratio = options_.sprt_eval_time_ratio;
+  auto sprt_state = std::make_unique<SPRTState>(sprt_options);
+
+  sprt_state->sample_idxs.resize(num_samples);
+  std::iota(sprt_state->sample_idxs.begin(),
+            sprt_state->sample_idxs.end(),
+            0);
+  Shuffle(static_cast<uint32_t>(num_samples), &sprt_state->sample_idxs);
+
+  return sprt_state;
+}
+
+template <typename Estimator, typename SupportMeasurer, typename Sampler>
+bool RANSAC<Estimator, SupportMeasurer, Sampler>::ComputeResiduals(
+    const std::vector<typename Estimator::X_t>& X,
+    const std::vector<typename Estimator::Y_t>& Y,
+    const typename Estimator::M_t& model,
+    const double max_residual,
+    SPRTState* sprt_state,
+    std::vector<double>* residuals,
+    Report* report) {
+  if (sprt_state == nullptr) {
+    estimator.Residuals(X, Y, model, residuals);
+    report->num_residuals += X.size();
+    return true;
+  }
+
+  // Small chunks, since bad models are typically rejected after a few dozens
+  // of samples, while the overhead per chunk is negligible compared to the
+  // estimators with expensive residuals.
+  const size_t kChunkSize = 16;
+
+  const size_t num_samples = X.size();
+  residuals->resize(num_samples);
+
+  double likelihood_ratio = 1;
+  size_t num_inliers = 0;
+  size_t num_eval_samples = 0;
+  for (size_t begin = 0; begin < num_samples; begin += kChunkSize) {
+    const size_t end = std::min(begin + kChunkSize, num_samples);
+    sprt_state->X_chunk.clear();
+    sprt_state->Y_chunk.clear();
+    for (size_t i = begin; i < end; ++i) {
+      sprt_state->X_chunk.push_back(X[sprt_state->sample_idxs[i]]);
+      sprt_state->Y_chunk.push_back(Y[sprt_state->sample_idxs[i]]);
+    }
+
+    estimator.Residuals(sprt_state->X_chunk,
+                        sprt_state->Y_chunk,
+                        model,
+                        &sprt_state->chunk_residuals);
+    CHECK_EQ(sprt_state->chunk_residuals.size(), end - begin);
+    report->num_residuals += end - begin;
+    for (size_t i = begin; i < end; ++i) {
+      (*residuals)[sprt_state->sample_idxs[i]] =
+          sprt_state->chunk_residuals[i - begin];
+    }
+
+    if (!sprt_state->sprt.Evaluate(sprt_state->chunk_residuals,
+                                   max_residual,
+                                   &likelihood_ratio,
+                                   &num_inliers,
+                                   &num_eval_samples)) {
+      report->num_sprt_rejections += 1;
+      sprt_state->sum_rejected_inlier_ratios +=
+          static_cast<double>(num_inliers) / num_eval_samples;
+      UpdateSPRT(num_samples, *report, sprt_state);
+      return false;
+    }
+  }
+
+  return true;
+}
+
+template <typename Estimator, typename SupportMeasurer, typename Sampler>
+void RANSAC<Estimator, SupportMeasurer, Sampler>::UpdateSPRT(
+    const size_t num_samples,
+    const Report& report,
+    SPRTState* sprt_state) const {
+  SPRT::Options sprt_options = sprt_state->sprt.GetOptions();
+
+  // The a priori inlier ratio is a lower bound for the good models.
+  const double epsilon =
+      std::max(static_cast<double>(sprt_state->best_num_inliers) / num_samples,
+               options_.min_inlier_ratio);
+
+  // Bad models are consistent with a few samples by chance. The estimate is
+  // only used once enough models have been rejected.
+  const size_t kMinNumRejections = 10;
+  double delta = sprt_options.delta;
+  if (report.num_sprt_rejections >= kMinNumRejections) {
+    delta = sprt_state->sum_rejected_inlier_ratios / report.num_sprt_rejections;
+  }
+
+  // The test is only meaningful, if good models are more consistent with the
+  // samples than bad models. Small changes are ignored to avoid recomputing
+  // the decision threshold after every rejection.
+  const double kMinRelChange = 0.05;
+  if (delta <= 0 || epsilon <= 2 * delta ||
+      (std::abs(epsilon - sprt_options.epsilon) <=
+           kMinRelChange * sprt_options.epsilon &&
+       std::abs(delta - sprt_options.delta) <=
+           kMinRelChange * sprt_options.delta)) {
+    return;
+  }
+
+  sprt_options.epsilon = epsilon;
+  sprt_options.delta = delta;
+  sprt_state->sprt.Update(sprt_options);
+}
+
+template <typename Estimator, typename SupportMeasurer, typename Sampler>
+std::unique_ptr<
+    typename RANSAC<Estimator, SupportMeasurer, Sampler>::ParallelState>
+RANSAC<Estimator, SupportMeasurer, Sampler>::InitializeParallel() const {
+  const int num_threads = GetEffectiveNumThreads(options_.num_threads);
+  if (num_threads <= 1) {
+    return nullptr;
+  }
+
+  auto parallel_state = std::make_unique<ParallelState>(num_threads);
+  parallel_state->estimators.resize(num_threads, estimator);
+  parallel_state->support_measurers.resize(num_threads, support_measurer);
+  parallel_state->residuals.resize(num_threads);
+
+  // A few samples per thread balance the load, while only few models are
+  // evaluated beyond the final number of trials.
+  const size_t kNumBatchSamplesPerThread = 2;
+  const size_t max_num_batch_samples = kNumBatchSamplesPerThread * num_threads;
+  parallel_state->X_rand.resize(
+      max_num_batch_samples,
+      std::vector<typename Estimator::X_t>(Estimator::kMinNumSamples));
+  parallel_state->Y_rand.resize(
+      max_num_batch_samples,
+      std::vector<typename Estimator::Y_t>(Estimator::kMinNumSamples));
+  parallel_state->models.resize(max_num_batch_samples);
+  parallel_state->supports.resize(max_num_batch_samples);
+
+  return parallel_state;
+}
+
+template <typename Estimator, typename SupportMeasurer, typename Sampler>
+void RANSAC<Estimator, SupportMeasurer, Sampler>::NextParallelSample(
+    const std::vector<typename Estimator::X_t>& X,
+    const std::vector<typename Estimator::Y_t>& Y,
+    const double max_residual,
+    const size_t max_num_batch_samples,
+    ParallelState* parallel_state,
+    std::vector<typename Estimator::M_t>* sample_models,
+    std::vector<typename SupportMeasurer::Support>* sample_supports,
+    Report* report) {
+  ParallelState& state = *parallel_state;
+  if (state.next_batch_sample_idx == state.num_batch_samples) {
+    state.num_batch_samples =
+        std::min(state.X_rand.size(), max_num_batch_samples);
+    state.next_batch_sample_idx = 0;
+    for (size_t i = 0; i < state.num_batch_samples; ++i) {
+      sampler.SampleXY(X, Y, &state.X_rand[i], &state.Y_rand[i]);
+    }
+
+    state.thread_pool.ParallelFor(
+        0, state.num_batch_samples, 1, [&](const int64_t i) {
+          const int thread_idx = state.thread_pool.GetThreadIndex();
+          Estimator& thread_estimator = state.estimators[thread_idx];
+          std::vector<double>& residuals = state.residuals[thread_idx];
+          thread_estimator.Estimate(
+              state.X_rand[i], state.Y_rand[i], &state.models[i]);
+          state.supports[i].clear();
+          for (const auto& model : state.models[i]) {
+            thread_estimator.Residuals(X, Y, model, &residuals);
+            CHECK_EQ(residuals.size(), X.size());
+            state.supports[i].push_back(
+                state.support_measurers[thread_idx].Evaluate(residuals,
+                                                             max_residual));
+          }
+        });
+
+    for (size_t i = 0; i < state.num_batch_samples; ++i) {
+      report->num_residuals += state.models[i].size() * X.size();
+    }
+  }
+
+  std::swap(*sample_models, state.models[state.next_batch_sample_idx]);
+  std::swap(*sample_supports, state.supports[state.next_batch_sample_idx]);
+  state.next_batch_sample_idx += 1;
+}
+
 }  // namespace colmap
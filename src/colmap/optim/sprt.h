@@ -63,11 +63,23 @@ class SPRT {
 
   void Update(const Options& options);
 
+  const Options& GetOptions() const;
+
   bool Evaluate(const std::vector<double>& residuals,
                 double max_residual,
                 size_t* num_inliers,
                 size_t* num_eval_samples);
 
+  // Continue the evaluation of a model with the next residuals, if the
+  // residuals are computed in chunks. The likelihood ratio must be initialized
+  // to 1 and the number of inliers and evaluated samples to 0 for the first
+  // chunk. Returns false as soon as the model is rejected.
+  bool Evaluate(const std::vector<double>& residuals,
+                double max_residual,
+                double* likelihood_ratio,
+                size_t* num_inliers,
+                size_t* num_eval_samples) const;
+
  private:
   void UpdateDecisionThreshold();
 
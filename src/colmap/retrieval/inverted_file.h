@@ -39,6 +39,7 @@
 #include <algorithm>
 #include <bitset>
 #include <cstdint>
+#include <cstring>
 #include <fstream>
 #include <unordered_map>
 #include <unordered_set>
@@ -67,13 +68,30 @@ class InvertedFile {
     USABLE = 0x03,
   };
 
+  // Fixed-size record of the inverted file in the memory-mapped format, which
+  // references the compressed entries by their byte offset.
+  struct MappedRecord {
+    uint8_t status;
+    uint8_t padding1[3];
+    float idf_weight;
+    uint32_t num_entries;
+    uint32_t padding2;
+    uint64_t entries_offset;
+    uint64_t entries_num_bytes;
+  };
+
   InvertedFile();
 
   // The number of added entries.
   size_t NumEntries() const;
 
-  // Return all entries in the file.
-  const std::vector<EntryType>& GetEntries() const;
+  // Call the function for all entries in the file. Mapped entries are decoded
+  // on the fly, such that the reference is only valid during the call.
+  template <typename Func>
+  void ForEachEntry(const Func& func) const;
+
+  // Whether the entries and thresholds reference memory-mapped data.
+  bool IsMapped() const;
 
   // Whether the Hamming embedding was computed for this file.
   bool HasHammingEmbedding() const;
@@ -96,6 +114,8 @@ class InvertedFile {
 
   // Sorts the inverted file entries in ascending order of image ids. This is
   // required for efficient scoring and must be called before ScoreFeature.
+  // Only the entries added since the last sorting are sorted and merged into
+  // the previously sorted entries, which takes linear time for few new entries.
   void SortEntries();
 
   // Clear all entries in this file.
@@ -112,6 +132,10 @@ class InvertedFile {
   // Compute the idf-weight for this inverted file.
   void ComputeIDFWeight(int num_total_images);
 
+  // Update the idf-weight for a changed number of total images, if the images
+  // in this inverted file did not change since the weight was computed.
+  void UpdateIDFWeight(int prev_num_total_images, int num_total_images);
+
   // Return the idf-weight of this inverted file.
   float IDFWeight() const;
 
@@ -125,6 +149,28 @@ class InvertedFile {
   void ScoreFeature(const DescType& descriptor,
                     std::vector<ImageScore>* image_scores) const;
 
+  // Pack the sorted entries into contiguous arrays of the dense indices of
+  // their images and of their binary signatures as 64-bit words, which are
+  // scored with vectorized popcounts. Mapped files are not packed and files
+  // with images without an index are left unpacked.
+  void PackEntries(const std::unordered_map<int, int>& image_idxs);
+
+  // Split the entries into consecutive ranges of about max_num_entries, such
+  // that no image is split across ranges and long files can be scored in
+  // parallel. Unpacked files are a single range.
+  void SplitEntries(size_t max_num_entries,
+                    std::vector<std::pair<size_t, size_t>>* ranges) const;
+
+  // Score the entries in the range [begin, end) for the binary descriptor of a
+  // query feature and add the scores to the dense image scores. The images
+  // with votes are marked in `voted`.
+  void ScoreFeature(const std::bitset<kEmbeddingDim>& bin_descriptor,
+                    size_t begin,
+                    size_t end,
+                    const std::unordered_map<int, int>& image_idxs,
+                    float* scores,
+                    uint8_t* voted) const;
+
   // Get the identifiers of all indexed images in this file.
   void GetImageIds(std::unordered_set<int>* ids) const;
 
@@ -139,19 +185,49 @@ class InvertedFile {
   void Read(std::ifstream* ifs);
   void Write(std::ofstream* ofs) const;
 
+  // Reference the record, the kEmbeddingDim thresholds, and the compressed
+  // entries of the memory-mapped format, which must stay valid until the file
+  // is reset or read. Modifications first copy the mapped data into memory.
+  void ReadMapped(const MappedRecord& record,
+                  const float* thresholds,
+                  const uint8_t* entries_data);
+
+  // Append the compressed entries sorted by image identifier to the given data
+  // and write the record and the thresholds of the memory-mapped format.
+  void WriteMapped(MappedRecord* record,
+                   float* thresholds,
+                   std::vector<uint8_t>* entries_data) const;
+
  private:
+  // Copy mapped entries and thresholds into memory before modifications.
+  void Unmap();
+
+  bool IsPacked() const;
+  void ClearPackedEntries();
+
   // Whether the inverted file is initialized.
   uint8_t status_;
 
   // The inverse document frequency weight of this inverted file.
   float idf_weight_;
 
-  // The entries of the inverted file system.
+  // The entries of the inverted file system, of which the first entries are
+  // sorted and the others were added since the last sorting.
   std::vector<EntryType> entries_;
+  size_t num_sorted_entries_;
 
   // The thresholds used for Hamming embedding.
   DescType thresholds_;
 
+  // The packed dense image indices and binary signatures of the entries.
+  std::vector<int> packed_image_idxs_;
+  std::vector<uint64_t> packed_signatures_;
+
+  // The memory-mapped thresholds and compressed entries, if mapped.
+  const float* mapped_thresholds_;
+  const uint8_t* mapped_entries_data_;
+  size_t num_mapped_entries_;
+
   // The functor to derive a voting weight from a Hamming distance.
   static const HammingDistWeightFunctor<kEmbeddingDim>
       hamming_dist_weight_functor_;
@@ -167,7 +243,12 @@ const HammingDistWeightFunctor<kEmbeddingDim>
 
 template <int kEmbeddingDim>
 InvertedFile<kEmbeddingDim>::InvertedFile()
-    : status_(UNUSABLE), idf_weight_(0.0f) {
+    : status_(UNUSABLE),
+      idf_weight_(0.0f),
+      num_sorted_entries_(0),
+      mapped_thresholds_(nullptr),
+      mapped_entries_data_(nullptr),
+      num_mapped_entries_(0) {
   static_assert(kEmbeddingDim % 8 == 0,
                 "Dimensionality of projected space needs to"
                 " be a multiple of 8.");
@@ -180,13 +261,30 @@ InvertedFile<kEmbeddingDim>::InvertedFile()
 
 template <int kEmbeddingDim>
 size_t InvertedFile<kEmbeddingDim>::NumEntries() const {
-  return entries_.size();
+  return IsMapped() ? num_mapped_entries_ : entries_.size();
 }
 
 template <int kEmbeddingDim>
-const std::vector<typename InvertedFile<kEmbeddingDim>::EntryType>&
-InvertedFile<kEmbeddingDim>::GetEntries() const {
-  return entries_;
+template <typename Func>
+void InvertedFile<kEmbeddingDim>::ForEachEntry(const Func& func) const {
+  if (IsMapped()) {
+    const uint8_t* data = mapped_entries_data_;
+    EntryType entry;
+    entry.image_id = 0;
+    for (size_t i = 0; i < num_mapped_entries_; ++i) {
+      entry.ReadCompressed(entry.image_id, &data);
+      func(entry);
+    }
+  } else {
+    for (const auto& entry : entries_) {
+      func(entry);
+    }
+  }
+}
+
+template <int kEmbeddingDim>
+bool InvertedFile<kEmbeddingDim>::IsMapped() const {
+  return mapped_thresholds_ != nullptr;
 }
 
 template <int kEmbeddingDim>
@@ -211,28 +309,46 @@ void InvertedFile<kEmbeddingDim>::AddEntry(const int image_id,
                                            const GeomType& geometry) {
   CHECK_GE(image_id, 0);
   CHECK_EQ(descriptor.size(), kEmbeddingDim);
+  Unmap();
   EntryType entry;
   entry.image_id = image_id;
   entry.feature_idx = feature_idx;
   entry.geometry = geometry;
   ConvertToBinaryDescriptor(descriptor, &entry.descriptor);
   entries_.push_back(entry);
+  ClearPackedEntries();
   status_ &= ~ENTRIES_SORTED;
 }
 
 template <int kEmbeddingDim>
 void InvertedFile<kEmbeddingDim>::SortEntries() {
-  std::sort(entries_.begin(),
-            entries_.end(),
-            [](const EntryType& entry1, const EntryType& entry2) {
-              return entry1.image_id < entry2.image_id;
-            });
+  // Mapped entries are always sorted.
+  if (IsMapped()) {
+    status_ |= ENTRIES_SORTED;
+    return;
+  }
+  if (EntriesSorted()) {
+    return;
+  }
+  const auto CompareImageIds = [](const EntryType& entry1,
+                                  const EntryType& entry2) {
+    return entry1.image_id < entry2.image_id;
+  };
+  const auto new_entries_begin = entries_.begin() + num_sorted_entries_;
+  std::sort(new_entries_begin, entries_.end(), CompareImageIds);
+  std::inplace_merge(
+      entries_.begin(), new_entries_begin, entries_.end(), CompareImageIds);
+  num_sorted_entries_ = entries_.size();
+  ClearPackedEntries();
   status_ |= ENTRIES_SORTED;
 }
 
 template <int kEmbeddingDim>
 void InvertedFile<kEmbeddingDim>::ClearEntries() {
+  Unmap();
   entries_.clear();
+  num_sorted_entries_ = 0;
+  ClearPackedEntries();
   status_ &= ~ENTRIES_SORTED;
 }
 
@@ -241,6 +357,12 @@ void InvertedFile<kEmbeddingDim>::Reset() {
   status_ = UNUSABLE;
   idf_weight_ = 0.0f;
   entries_.clear();
+  num_sorted_entries_ = 0;
+  ClearPackedEntries();
+  mapped_thresholds_ = nullptr;
+  mapped_entries_data_ = nullptr;
+  num_mapped_entries_ = 0;
+  thresholds_.resize(kEmbeddingDim);
   thresholds_.setZero();
 }
 
@@ -249,14 +371,16 @@ void InvertedFile<kEmbeddingDim>::ConvertToBinaryDescriptor(
     const DescType& descriptor,
     std::bitset<kEmbeddingDim>* binary_descriptor) const {
   CHECK_EQ(descriptor.size(), kEmbeddingDim);
+  const float* thresholds =
+      IsMapped() ? mapped_thresholds_ : thresholds_.data();
   for (int i = 0; i < kEmbeddingDim; ++i) {
-    (*binary_descriptor)[i] = descriptor[i] > thresholds_[i];
+    (*binary_descriptor)[i] = descriptor[i] > thresholds[i];
   }
 }
 
 template <int kEmbeddingDim>
 void InvertedFile<kEmbeddingDim>::ComputeIDFWeight(const int num_total_images) {
-  if (entries_.empty()) {
+  if (NumEntries() == 0) {
     return;
   }
 
@@ -267,6 +391,18 @@ void InvertedFile<kEmbeddingDim>::ComputeIDFWeight(const int num_total_images) {
                          static_cast<double>(image_ids.size()));
 }
 
+template <int kEmbeddingDim>
+void InvertedFile<kEmbeddingDim>::UpdateIDFWeight(
+    const int prev_num_total_images, const int num_total_images) {
+  if (NumEntries() == 0) {
+    return;
+  }
+
+  CHECK_GT(prev_num_total_images, 0);
+  idf_weight_ += std::log(static_cast<double>(num_total_images) /
+                          static_cast<double>(prev_num_total_images));
+}
+
 template <int kEmbeddingDim>
 float InvertedFile<kEmbeddingDim>::IDFWeight() const {
   return idf_weight_;
@@ -280,6 +416,8 @@ void InvertedFile<kEmbeddingDim>::ComputeHammingEmbedding(
     return;
   }
 
+  Unmap();
+
   std::vector<float> elements(num_descriptors);
   for (int n = 0; n < kEmbeddingDim; ++n) {
     for (int i = 0; i < num_descriptors; ++i) {
@@ -288,6 +426,7 @@ void InvertedFile<kEmbeddingDim>::ComputeHammingEmbedding(
     thresholds_[n] = Median(elements);
   }
 
+  ClearPackedEntries();
   status_ |= HAS_EMBEDDING;
 }
 
@@ -302,7 +441,7 @@ void InvertedFile<kEmbeddingDim>::ScoreFeature(
     return;
   }
 
-  if (entries_.size() == 0) {
+  if (NumEntries() == 0) {
     return;
   }
 
@@ -312,13 +451,13 @@ void InvertedFile<kEmbeddingDim>::ScoreFeature(
   ConvertToBinaryDescriptor(descriptor, &bin_descriptor);
 
   ImageScore image_score;
-  image_score.image_id = entries_.front().image_id;
+  image_score.image_id = -1;
   image_score.score = 0.0f;
   int num_image_votes = 0;
 
   // Note that this assumes that the entries are sorted using SortEntries
   // according to their image identifiers.
-  for (const auto& entry : entries_) {
+  ForEachEntry([&](const EntryType& entry) {
     if (image_score.image_id < entry.image_id) {
       if (num_image_votes > 0) {
         // Finalizes the voting since we now know how many features from
@@ -345,7 +484,7 @@ void InvertedFile<kEmbeddingDim>::ScoreFeature(
       image_score.score += hamming_dist_weight_functor_(hamming_dist);
       num_image_votes += 1;
     }
-  }
+  });
 
   // Add the voting for the largest image_id in the entries.
   if (num_image_votes > 0) {
@@ -355,27 +494,158 @@ void InvertedFile<kEmbeddingDim>::ScoreFeature(
   }
 }
 
+template <int kEmbeddingDim>
+void InvertedFile<kEmbeddingDim>::PackEntries(
+    const std::unordered_map<int, int>& image_idxs) {
+  ClearPackedEntries();
+  if (kEmbeddingDim > 64 || IsMapped() || !EntriesSorted()) {
+    return;
+  }
+
+  packed_image_idxs_.reserve(entries_.size());
+  packed_signatures_.reserve(entries_.size());
+  for (const auto& entry : entries_) {
+    const auto image_idx = image_idxs.find(entry.image_id);
+    if (image_idx == image_idxs.end()) {
+      ClearPackedEntries();
+      return;
+    }
+    packed_image_idxs_.push_back(image_idx->second);
+    packed_signatures_.push_back(entry.descriptor.to_ullong());
+  }
+}
+
+template <int kEmbeddingDim>
+void InvertedFile<kEmbeddingDim>::SplitEntries(
+    const size_t max_num_entries,
+    std::vector<std::pair<size_t, size_t>>* ranges) const {
+  CHECK_GT(max_num_entries, 0);
+  ranges->clear();
+  const size_t num_entries = NumEntries();
+  if (num_entries == 0) {
+    return;
+  }
+  if (!IsPacked()) {
+    ranges->emplace_back(0, num_entries);
+    return;
+  }
+
+  size_t begin = 0;
+  while (begin < num_entries) {
+    size_t end = std::min(begin + max_num_entries, num_entries);
+    // Extend the range to the end of the entries of its last image.
+    while (end < num_entries &&
+           packed_image_idxs_[end] == packed_image_idxs_[end - 1]) {
+      ++end;
+    }
+    ranges->emplace_back(begin, end);
+    begin = end;
+  }
+}
+
+template <int kEmbeddingDim>
+void InvertedFile<kEmbeddingDim>::ScoreFeature(
+    const std::bitset<kEmbeddingDim>& bin_descriptor,
+    const size_t begin,
+    const size_t end,
+    const std::unordered_map<int, int>& image_idxs,
+    float* scores,
+    uint8_t* voted) const {
+  if (!IsUsable() || begin >= end) {
+    return;
+  }
+
+  const float squared_idf_weight = idf_weight_ * idf_weight_;
+
+  int image_idx = -1;
+  float image_score = 0.0f;
+  int num_image_votes = 0;
+
+  // Applies the burstiness normalization, cf. ScoreFeature above.
+  const auto FinalizeImage = [&]() {
+    if (num_image_votes > 0 && image_idx >= 0) {
+      image_score /= std::sqrt(static_cast<float>(num_image_votes));
+      image_score *= squared_idf_weight;
+      scores[image_idx] += image_score;
+      voted[image_idx] = 1;
+    }
+    image_score = 0.0f;
+    num_image_votes = 0;
+  };
+
+  const auto VoteImage = [&](const size_t hamming_dist) {
+    if (hamming_dist <= hamming_dist_weight_functor_.kMaxHammingDistance) {
+      image_score += hamming_dist_weight_functor_(hamming_dist);
+      num_image_votes += 1;
+    }
+  };
+
+  if (!IsPacked()) {
+    CHECK_EQ(begin, 0);
+    CHECK_EQ(end, NumEntries());
+    int image_id = -1;
+    ForEachEntry([&](const EntryType& entry) {
+      if (image_id < entry.image_id) {
+        FinalizeImage();
+        image_id = entry.image_id;
+        const auto it = image_idxs.find(image_id);
+        image_idx = it == image_idxs.end() ? -1 : it->second;
+      }
+      VoteImage((bin_descriptor ^ entry.descriptor).count());
+    });
+    FinalizeImage();
+    return;
+  }
+
+  CHECK_LE(end, packed_signatures_.size());
+
+  // The Hamming distances are computed in blocks in a separate loop without
+  // branches, such that the popcounts are vectorized.
+  const size_t kBlockSize = 256;
+  uint8_t hamming_dists[kBlockSize];
+  const uint64_t signature = bin_descriptor.to_ullong();
+  for (size_t block_begin = begin; block_begin < end;
+       block_begin += kBlockSize) {
+    const size_t block_size = std::min(kBlockSize, end - block_begin);
+    const uint64_t* signatures = packed_signatures_.data() + block_begin;
+    for (size_t i = 0; i < block_size; ++i) {
+      hamming_dists[i] =
+          static_cast<uint8_t>(PopCount64(signatures[i] ^ signature));
+    }
+
+    const int* entry_image_idxs = packed_image_idxs_.data() + block_begin;
+    for (size_t i = 0; i < block_size; ++i) {
+      if (entry_image_idxs[i] != image_idx) {
+        FinalizeImage();
+        image_idx = entry_image_idxs[i];
+      }
+      VoteImage(hamming_dists[i]);
+    }
+  }
+  FinalizeImage();
+}
+
 template <int kEmbeddingDim>
 void InvertedFile<kEmbeddingDim>::GetImageIds(
     std::unordered_set<int>* ids) const {
-  for (const EntryType& entry : entries_) {
-    ids->insert(entry.image_id);
-  }
+  ForEachEntry([ids](const EntryType& entry) { ids->insert(entry.image_id); });
 }
 
 template <int kEmbeddingDim>
 void InvertedFile<kEmbeddingDim>::ComputeImageSelfSimilarities(
     std::unordered_map<int, double>* self_similarities) const {
   const double squared_idf_weight = idf_weight_ * idf_weight_;
-  for (const auto& entry : entries_) {
+  ForEachEntry([&](const EntryType& entry) {
     (*self_similarities)[entry.image_id] += squared_idf_weight;
-  }
+  });
 }
 
 template <int kEmbeddingDim>
 void InvertedFile<kEmbeddingDim>::Read(std::ifstream* ifs) {
   CHECK(ifs->is_open());
 
+  Reset();
+
   ifs->read(reinterpret_cast<char*>(&status_), sizeof(uint8_t));
   ifs->read(reinterpret_cast<char*>(&idf_weight_), sizeof(float));
 
@@ -390,6 +660,7 @@ void InvertedFile<kEmbeddingDim>::Read(std::ifstream* ifs) {
   for (uint32_t i = 0; i < num_entries; ++i) {
     entries_[i].Read(ifs);
   }
+  num_sorted_entries_ = EntriesSorted() ? entries_.size() : 0;
 }
 
 template <int kEmbeddingDim>
@@ -399,16 +670,98 @@ void InvertedFile<kEmbeddingDim>::Write(std::ofstream* ofs) const {
   ofs->write(reinterpret_cast<const char*>(&status_), sizeof(uint8_t));
   ofs->write(reinterpret_cast<const char*>(&idf_weight_), sizeof(float));
 
+  const float* thresholds =
+      IsMapped() ? mapped_thresholds_ : thresholds_.data();
   for (int i = 0; i < kEmbeddingDim; ++i) {
-    ofs->write(reinterpret_cast<const char*>(&thresholds_[i]), sizeof(float));
+    ofs->write(reinterpret_cast<const char*>(&thresholds[i]), sizeof(float));
   }
 
-  const uint32_t num_entries = static_cast<uint32_t>(entries_.size());
+  const uint32_t num_entries = static_cast<uint32_t>(NumEntries());
   ofs->write(reinterpret_cast<const char*>(&num_entries), sizeof(uint32_t));
 
-  for (uint32_t i = 0; i < num_entries; ++i) {
-    entries_[i].Write(ofs);
+  ForEachEntry([ofs](const EntryType& entry) { entry.Write(ofs); });
+}
+
+template <int kEmbeddingDim>
+void InvertedFile<kEmbeddingDim>::ReadMapped(const MappedRecord& record,
+                                             const float* thresholds,
+                                             const uint8_t* entries_data) {
+  Reset();
+  status_ = record.status;
+  idf_weight_ = record.idf_weight;
+  mapped_thresholds_ = CHECK_NOTNULL(thresholds);
+  mapped_entries_data_ = entries_data;
+  num_mapped_entries_ = record.num_entries;
+  // Release the memory of the unmapped thresholds.
+  thresholds_.resize(0);
+}
+
+template <int kEmbeddingDim>
+void InvertedFile<kEmbeddingDim>::WriteMapped(
+    MappedRecord* record,
+    float* thresholds,
+    std::vector<uint8_t>* entries_data) const {
+  std::memset(record, 0, sizeof(MappedRecord));
+  record->status = status_ | ENTRIES_SORTED;
+  record->idf_weight = idf_weight_;
+  record->num_entries = static_cast<uint32_t>(NumEntries());
+  record->entries_offset = entries_data->size();
+
+  std::memcpy(thresholds,
+              IsMapped() ? mapped_thresholds_ : thresholds_.data(),
+              kEmbeddingDim * sizeof(float));
+
+  int prev_image_id = 0;
+  const auto WriteEntry = [&](const EntryType& entry) {
+    entry.WriteCompressed(prev_image_id, entries_data);
+    prev_image_id = entry.image_id;
+  };
+  if (IsMapped() || EntriesSorted()) {
+    ForEachEntry(WriteEntry);
+  } else {
+    std::vector<EntryType> sorted_entries = entries_;
+    std::stable_sort(sorted_entries.begin(),
+                     sorted_entries.end(),
+                     [](const EntryType& entry1, const EntryType& entry2) {
+                       return entry1.image_id < entry2.image_id;
+                     });
+    for (const auto& entry : sorted_entries) {
+      WriteEntry(entry);
+    }
+  }
+
+  record->entries_num_bytes = entries_data->size() - record->entries_offset;
+}
+
+template <int kEmbeddingDim>
+bool InvertedFile<kEmbeddingDim>::IsPacked() const {
+  return !packed_signatures_.empty();
+}
+
+template <int kEmbeddingDim>
+void InvertedFile<kEmbeddingDim>::ClearPackedEntries() {
+  packed_image_idxs_.clear();
+  packed_signatures_.clear();
+}
+
+template <int kEmbeddingDim>
+void InvertedFile<kEmbeddingDim>::Unmap() {
+  if (!IsMapped()) {
+    return;
   }
+
+  std::vector<EntryType> entries;
+  entries.reserve(num_mapped_entries_);
+  ForEachEntry(
+      [&entries](const EntryType& entry) { entries.push_back(entry); });
+  entries_ = std::move(entries);
+  num_sorted_entries_ = entries_.size();
+
+  thresholds_ = Eigen::Map<const DescType>(mapped_thresholds_, kEmbeddingDim);
+
+  mapped_thresholds_ = nullptr;
+  mapped_entries_data_ = nullptr;
+  num_mapped_entries_ = 0;
 }
 
 }  // namespace retrieval
@@ -30,9 +30,13 @@
 #pragma once
 
 #include "colmap/retrieval/geometry.h"
+#include "colmap/util/logging.h"
 
 #include <bitset>
+#include <cstdint>
+#include <cstring>
 #include <fstream>
+#include <vector>
 
 namespace colmap {
 namespace retrieval {
@@ -45,6 +49,14 @@ struct InvertedFileEntry {
   void Read(std::istream* ifs);
   void Write(std::ostream* ofs) const;
 
+  // Read/write the entry in the compressed format of memory-mapped inverted
+  // files. The image identifier is delta-encoded relative to the previous entry
+  // of the sorted inverted file and the identifiers are stored as
+  // variable-length integers, followed by the geometry and the binary
+  // signature in (N + 7) / 8 bytes.
+  void ReadCompressed(int prev_image_id, const uint8_t** data);
+  void WriteCompressed(int prev_image_id, std::vector<uint8_t>* data) const;
+
   // The identifier of the image this entry is associated with.
   int image_id = -1;
 
@@ -62,6 +74,26 @@ struct InvertedFileEntry {
 // Implementation
 ////////////////////////////////////////////////////////////////////////////////
 
+inline uint32_t ReadVarUInt32(const uint8_t** data) {
+  uint32_t value = 0;
+  int shift = 0;
+  uint8_t byte;
+  do {
+    byte = *((*data)++);
+    value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+    shift += 7;
+  } while (byte & 0x80);
+  return value;
+}
+
+inline void WriteVarUInt32(uint32_t value, std::vector<uint8_t>* data) {
+  while (value >= 0x80) {
+    data->push_back(static_cast<uint8_t>(value | 0x80));
+    value >>= 7;
+  }
+  data->push_back(static_cast<uint8_t>(value));
+}
+
 template <int N>
 void InvertedFileEntry<N>::Read(std::istream* ifs) {
   static_assert(N <= 64, "Dimensionality too large");
@@ -104,5 +136,46 @@ void InvertedFileEntry<N>::Write(std::ostream* ofs) const {
   ofs->write(reinterpret_cast<const char*>(&descriptor_data), sizeof(uint64_t));
 }
 
+template <int N>
+void InvertedFileEntry<N>::ReadCompressed(const int prev_image_id,
+                                          const uint8_t** data) {
+  static_assert(N <= 64, "Dimensionality too large");
+  static_assert(sizeof(FeatureGeometry) == 16, "Geometry type size mismatch");
+
+  image_id = prev_image_id + static_cast<int>(ReadVarUInt32(data));
+  feature_idx = static_cast<int>(ReadVarUInt32(data));
+
+  std::memcpy(&geometry, *data, sizeof(FeatureGeometry));
+  *data += sizeof(FeatureGeometry);
+
+  uint64_t descriptor_data = 0;
+  for (int i = 0; i < (N + 7) / 8; ++i) {
+    descriptor_data |= static_cast<uint64_t>(*((*data)++)) << (8 * i);
+  }
+  descriptor = std::bitset<N>(descriptor_data);
+}
+
+template <int N>
+void InvertedFileEntry<N>::WriteCompressed(const int prev_image_id,
+                                           std::vector<uint8_t>* data) const {
+  static_assert(N <= 64, "Dimensionality too large");
+  static_assert(sizeof(FeatureGeometry) == 16, "Geometry type size mismatch");
+  CHECK_GE(image_id, prev_image_id);
+  CHECK_GE(feature_idx, 0);
+
+  WriteVarUInt32(static_cast<uint32_t>(image_id - prev_image_id), data);
+  WriteVarUInt32(static_cast<uint32_t>(feature_idx), data);
+
+  const uint8_t* geometry_data = reinterpret_cast<const uint8_t*>(&geometry);
+  data->insert(
+      data->end(), geometry_data, geometry_data + sizeof(FeatureGeometry));
+
+  const uint64_t descriptor_data =
+      static_cast<uint64_t>(descriptor.to_ullong());
+  for (int i = 0; i < (N + 7) / 8; ++i) {
+    data->push_back(static_cast<uint8_t>(descriptor_data >> (8 * i)));
+  }
+}
+
 }  // namespace retrieval
 }  // namespace colmap
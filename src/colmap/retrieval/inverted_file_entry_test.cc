@@ -73,6 +73,48 @@ TEST(InvertedFileEntry, ReadWrite) {
   }
 }
 
+TEST(InvertedFileEntry, ReadWriteCompressed) {
+  std::vector<InvertedFileEntry<10>> entries(3);
+  entries[0].image_id = 5;
+  entries[0].feature_idx = 0;
+  entries[1].image_id = 5;
+  entries[1].feature_idx = 300;
+  entries[2].image_id = 100000;
+  entries[2].feature_idx = 123456;
+  for (size_t i = 0; i < entries.size(); ++i) {
+    entries[i].geometry.x = 0.1f * i;
+    entries[i].geometry.y = -0.2f * i;
+    entries[i].geometry.scale = 1.5f;
+    entries[i].geometry.orientation = 0.3f;
+    entries[i].descriptor = std::bitset<10>(0x2A5 + i);
+  }
+
+  std::vector<uint8_t> data;
+  int prev_image_id = 0;
+  for (const auto& entry : entries) {
+    entry.WriteCompressed(prev_image_id, &data);
+    prev_image_id = entry.image_id;
+  }
+  // Small deltas and feature indices are stored in single bytes.
+  EXPECT_LT(data.size(), entries.size() * (8 + 16 + 8));
+
+  const uint8_t* data_ptr = data.data();
+  prev_image_id = 0;
+  for (const auto& entry : entries) {
+    InvertedFileEntry<10> read_entry;
+    read_entry.ReadCompressed(prev_image_id, &data_ptr);
+    prev_image_id = read_entry.image_id;
+    EXPECT_EQ(entry.image_id, read_entry.image_id);
+    EXPECT_EQ(entry.feature_idx, read_entry.feature_idx);
+    EXPECT_EQ(entry.geometry.x, read_entry.geometry.x);
+    EXPECT_EQ(entry.geometry.y, read_entry.geometry.y);
+    EXPECT_EQ(entry.geometry.scale, read_entry.geometry.scale);
+    EXPECT_EQ(entry.geometry.orientation, read_entry.geometry.orientation);
+    EXPECT_EQ(entry.descriptor, read_entry.descriptor);
+  }
+  EXPECT_EQ(data_ptr, data.data() + data.size());
+}
+
 }  // namespace
 }  // namespace retrieval
 }  // namespace colmap
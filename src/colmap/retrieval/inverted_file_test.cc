@@ -0,0 +1,162 @@
+#include "colmap/retrieval/inverted_file.h"
+
+#include "colmap/math/random.h"
+
+#include <gtest/gtest.h>
+
+namespace colmap {
+namespace retrieval {
+namespace {
+
+const int kNumImages = 10;
+
+void CreateInvertedFile(InvertedFile<64>* inverted_file) {
+  SetPRNGSeed(0);
+  inverted_file->Reset();
+  for (int image_id = kNumImages - 1; image_id >= 0; --image_id) {
+    // Leave some images without entries.
+    const int num_entries = image_id % 3 == 0 ? 0 : 2 * image_id + 1;
+    for (int i = 0; i < num_entries; ++i) {
+      Eigen::VectorXf descriptor(64);
+      for (int k = 0; k < 64; ++k) {
+        descriptor(k) = RandomGaussian(0.0f, 1.0f);
+      }
+      inverted_file->AddEntry(
+          image_id, i, descriptor, FeatureGeometry());
+    }
+  }
+  inverted_file->SortEntries();
+  inverted_file->ComputeIDFWeight(2 * kNumImages);
+}
+
+std::unordered_map<int, int> ImageIdxs() {
+  // Dense indices in reverse order of the image identifiers.
+  std::unordered_map<int, int> image_idxs;
+  for (int image_id = 0; image_id < kNumImages; ++image_id) {
+    image_idxs.emplace(image_id, kNumImages - 1 - image_id);
+  }
+  return image_idxs;
+}
+
+TEST(InvertedFile, SplitEntries) {
+  InvertedFile<64> inverted_file;
+  CreateInvertedFile(&inverted_file);
+
+  std::vector<std::pair<size_t, size_t>> ranges;
+  inverted_file.SplitEntries(5, &ranges);
+  ASSERT_EQ(ranges.size(), 1);
+  EXPECT_EQ(ranges[0].first, 0);
+  EXPECT_EQ(ranges[0].second, inverted_file.NumEntries());
+
+  inverted_file.PackEntries(ImageIdxs());
+  inverted_file.SplitEntries(5, &ranges);
+  EXPECT_GT(ranges.size(), 1);
+  std::vector<int> image_ids;
+  inverted_file.ForEachEntry(
+      [&image_ids](const InvertedFile<64>::EntryType& entry) {
+        image_ids.push_back(entry.image_id);
+      });
+  size_t end = 0;
+  for (const auto& range : ranges) {
+    EXPECT_EQ(range.first, end);
+    EXPECT_LT(range.first, range.second);
+    // Ranges are only extended to the end of the entries of their last image.
+    EXPECT_TRUE(range.second - range.first <= 5 ||
+                image_ids[range.first + 4] == image_ids[range.second - 1]);
+    if (range.first > 0) {
+      EXPECT_NE(image_ids[range.first - 1], image_ids[range.first]);
+    }
+    end = range.second;
+  }
+  EXPECT_EQ(end, inverted_file.NumEntries());
+}
+
+TEST(InvertedFile, ScoreFeatureDense) {
+  const std::unordered_map<int, int> image_idxs = ImageIdxs();
+  for (const bool packed : {false, true}) {
+    InvertedFile<64> inverted_file;
+    CreateInvertedFile(&inverted_file);
+    if (packed) {
+      inverted_file.PackEntries(image_idxs);
+    }
+
+    for (int query = 0; query < 5; ++query) {
+      Eigen::VectorXf descriptor(64);
+      for (int k = 0; k < 64; ++k) {
+        descriptor(k) = RandomGaussian(0.0f, 1.0f);
+      }
+      std::vector<ImageScore> image_scores;
+      inverted_file.ScoreFeature(descriptor, &image_scores);
+
+      std::bitset<64> bin_descriptor;
+      inverted_file.ConvertToBinaryDescriptor(descriptor, &bin_descriptor);
+
+      std::vector<std::pair<size_t, size_t>> ranges;
+      inverted_file.SplitEntries(4, &ranges);
+      EXPECT_EQ(ranges.size() > 1, packed);
+      std::vector<float> scores(kNumImages, 0.0f);
+      std::vector<uint8_t> voted(kNumImages, 0);
+      for (const auto& range : ranges) {
+        inverted_file.ScoreFeature(bin_descriptor,
+                                   range.first,
+                                   range.second,
+                                   image_idxs,
+                                   scores.data(),
+                                   voted.data());
+      }
+
+      int num_voted = 0;
+      for (const uint8_t image_voted : voted) {
+        num_voted += image_voted;
+      }
+      EXPECT_EQ(num_voted, image_scores.size());
+      for (const auto& image_score : image_scores) {
+        const int image_idx = image_idxs.at(image_score.image_id);
+        EXPECT_TRUE(voted[image_idx]);
+        EXPECT_EQ(scores[image_idx], image_score.score);
+      }
+    }
+  }
+}
+
+TEST(InvertedFile, SortEntriesIncrementally) {
+  InvertedFile<64> inverted_file;
+  CreateInvertedFile(&inverted_file);
+  const size_t num_entries = inverted_file.NumEntries();
+
+  // Add entries of new images in between and after the sorted entries.
+  const Eigen::VectorXf descriptor = Eigen::VectorXf::Zero(64);
+  for (const int image_id : {kNumImages + 1, 3, kNumImages, 3, 0}) {
+    inverted_file.AddEntry(image_id, 0, descriptor, FeatureGeometry());
+  }
+  EXPECT_FALSE(inverted_file.EntriesSorted());
+  inverted_file.SortEntries();
+  EXPECT_TRUE(inverted_file.EntriesSorted());
+  EXPECT_EQ(inverted_file.NumEntries(), num_entries + 5);
+
+  std::vector<int> image_ids;
+  inverted_file.ForEachEntry(
+      [&image_ids](const InvertedFile<64>::EntryType& entry) {
+        image_ids.push_back(entry.image_id);
+      });
+  EXPECT_TRUE(std::is_sorted(image_ids.begin(), image_ids.end()));
+  EXPECT_EQ(std::count(image_ids.begin(), image_ids.end(), 3), 2);
+  EXPECT_EQ(image_ids.back(), kNumImages + 1);
+}
+
+TEST(InvertedFile, UpdateIDFWeight) {
+  InvertedFile<64> inverted_file;
+  CreateInvertedFile(&inverted_file);
+  inverted_file.UpdateIDFWeight(2 * kNumImages, 3 * kNumImages);
+  const float idf_weight = inverted_file.IDFWeight();
+  inverted_file.ComputeIDFWeight(3 * kNumImages);
+  EXPECT_NEAR(idf_weight, inverted_file.IDFWeight(), 1e-6);
+
+  InvertedFile<64> empty_inverted_file;
+  empty_inverted_file.UpdateIDFWeight(2, 3);
+  EXPECT_EQ(empty_inverted_file.IDFWeight(), 0);
+}
+
+}  // namespace
+}  // namespace retrieval
+}  // namespace colmap
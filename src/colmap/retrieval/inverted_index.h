@@ -32,10 +32,12 @@
 #include "colmap/math/random.h"
 #include "colmap/retrieval/inverted_file.h"
 #include "colmap/util/eigen_alignment.h"
+#include "colmap/util/threading.h"
 
 #include <algorithm>
 #include <bitset>
 #include <cstdint>
+#include <cstring>
 #include <fstream>
 #include <unordered_map>
 #include <unordered_set>
@@ -70,9 +72,21 @@ class InvertedIndex {
   void Initialize(int num_words);
 
   // Finalizes the inverted index by sorting each inverted file such that all
-  // entries are in ascending order of image ids.
+  // entries are in ascending order of image ids and packing the entries for
+  // efficient scoring.
   void Finalize();
 
+  // Incrementally update a finalized inverted index after adding the entries
+  // of new images, such that only the modified inverted files are sorted and
+  // packed. The idf-weights of the other inverted files are updated for the
+  // new number of images and only the normalization constants of the new
+  // images are computed. Since the idf-weights change with the number of
+  // images, the normalization constants of all images are recomputed once the
+  // number of images grew by the fraction kMaxImageGrowth since their last
+  // full computation, such that the amortized cost is proportional to the
+  // modified inverted files. The index is finalized if it was not before.
+  void Update();
+
   // Generate projection matrix for Hamming embedding.
   void GenerateHammingEmbeddingProjection();
 
@@ -91,10 +105,14 @@ class InvertedIndex {
   // Clear all index entries.
   void ClearEntries();
 
-  // Query the inverted file and return a list of sorted images.
+  // Query the inverted file and return a list of scored images. The scores
+  // are accumulated in dense arrays over the indexed images. If the query
+  // visits many entries, the inverted files are scored by multiple threads,
+  // where long inverted files are split into multiple ranges of entries.
   void Query(const DescType& descriptors,
              const Eigen::MatrixXi& word_ids,
-             std::vector<ImageScore>* image_scores) const;
+             std::vector<ImageScore>* image_scores,
+             int num_threads = 1) const;
 
   void ConvertToBinaryDescriptor(
       int word_id,
@@ -105,7 +123,7 @@ class InvertedIndex {
 
   void FindMatches(int word_id,
                    const std::unordered_set<int>& image_ids,
-                   std::vector<const EntryType*>* matches) const;
+                   std::vector<EntryType>* matches) const;
 
   // Compute the self-similarity for the image.
   float ComputeSelfSimilarity(const Eigen::MatrixXi& word_ids) const;
@@ -117,8 +135,53 @@ class InvertedIndex {
   void Read(std::ifstream* ifs);
   void Write(std::ofstream* ofs) const;
 
+  // Read/write the inverted index in the memory-mapped format. The inverted
+  // files reference the given data in place, which must outlive the index.
+  // The layout, in native little endian and aligned to 8 bytes, is:
+  //
+  //    MappedHeader
+  //    float[kEmbeddingDim * kDescDim]     Hamming embedding projection
+  //    {int32_t, float}[num_images]        Image normalization constants
+  //    MappedRecord[num_words]             Inverted file records
+  //    float[num_words * kEmbeddingDim]    Hamming embedding thresholds
+  //    uint8_t[]                           Compressed inverted file entries
+  void ReadMapped(const char* data, size_t num_bytes);
+  void WriteMapped(std::ostream* ofs) const;
+
  private:
+  struct MappedHeader {
+    int32_t num_words;
+    int32_t embedding_dim;
+    int32_t desc_dim;
+    int32_t num_images;
+    uint64_t records_offset;
+    uint64_t thresholds_offset;
+    uint64_t entries_offset;
+    uint64_t entries_num_bytes;
+  };
+
+  // A range of entries of an inverted file to score for a query feature.
+  struct ScoringTask {
+    int word_id;
+    std::bitset<kEmbeddingDim> bin_descriptor;
+    size_t begin;
+    size_t end;
+  };
+
+  // Maximum number of entries scored by a single task.
+  static const size_t kMaxNumTaskEntries;
+  // Minimum number of entries in a query to score in parallel.
+  static const size_t kMinNumParallelEntries;
+  // Relative growth of the number of images after which Update recomputes
+  // the normalization constants of all images.
+  static const double kMaxImageGrowth;
+
   void ComputeWeightsAndNormalizationConstants();
+  static float ComputeNormalizationConstant(double self_similarity);
+
+  // Assign dense indices to the images with normalization constants and pack
+  // the inverted files accordingly.
+  void UpdateImageIdxs(bool pack_entries);
 
   // The individual inverted indices.
   std::vector<InvertedFile<kEmbeddingDim>,
@@ -129,6 +192,15 @@ class InvertedIndex {
   // normalize the votes.
   std::unordered_map<int, float> normalization_constants_;
 
+  // The number of images when all normalization constants were computed.
+  size_t num_normalized_images_;
+
+  // The images with normalization constants in the order of their dense
+  // indices, their dense indices, and their normalization constants.
+  std::vector<int> image_ids_;
+  std::unordered_map<int, int> image_idxs_;
+  std::vector<float> image_normalization_constants_;
+
   // The projection matrix used to project SIFT descriptors.
   ProjMatrixType proj_matrix_;
 };
@@ -142,7 +214,22 @@ const int InvertedIndex<kDescType, kDescDim, kEmbeddingDim>::kInvalidWordId =
     std::numeric_limits<int>::max();
 
 template <typename kDescType, int kDescDim, int kEmbeddingDim>
-InvertedIndex<kDescType, kDescDim, kEmbeddingDim>::InvertedIndex() {
+const size_t
+    InvertedIndex<kDescType, kDescDim, kEmbeddingDim>::kMaxNumTaskEntries =
+        64 * 1024;
+
+template <typename kDescType, int kDescDim, int kEmbeddingDim>
+const size_t
+    InvertedIndex<kDescType, kDescDim, kEmbeddingDim>::kMinNumParallelEntries =
+        1024 * 1024;
+
+template <typename kDescType, int kDescDim, int kEmbeddingDim>
+const double
+    InvertedIndex<kDescType, kDescDim, kEmbeddingDim>::kMaxImageGrowth = 0.25;
+
+template <typename kDescType, int kDescDim, int kEmbeddingDim>
+InvertedIndex<kDescType, kDescDim, kEmbeddingDim>::InvertedIndex()
+    : num_normalized_images_(0) {
   proj_matrix_.resize(kEmbeddingDim, kDescDim);
   proj_matrix_.setIdentity();
 }
@@ -171,6 +258,84 @@ void InvertedIndex<kDescType, kDescDim, kEmbeddingDim>::Finalize() {
   }
 
   ComputeWeightsAndNormalizationConstants();
+  UpdateImageIdxs(/*pack_entries=*/true);
+}
+
+template <typename kDescType, int kDescDim, int kEmbeddingDim>
+void InvertedIndex<kDescType, kDescDim, kEmbeddingDim>::Update() {
+  CHECK_GT(NumVisualWords(), 0);
+
+  const size_t prev_num_images = image_ids_.size();
+  if (prev_num_images == 0) {
+    Finalize();
+    return;
+  }
+
+  // Sort the modified inverted files and find the new images.
+  std::vector<int> updated_word_ids;
+  std::unordered_set<int> new_image_ids;
+  for (int word_id = 0; word_id < NumVisualWords(); ++word_id) {
+    auto& inverted_file = inverted_files_[word_id];
+    if (inverted_file.EntriesSorted()) {
+      continue;
+    }
+    inverted_file.SortEntries();
+    updated_word_ids.push_back(word_id);
+    inverted_file.ForEachEntry([&](const EntryType& entry) {
+      if (image_idxs_.count(entry.image_id) == 0) {
+        new_image_ids.insert(entry.image_id);
+      }
+    });
+  }
+
+  const size_t num_images = prev_num_images + new_image_ids.size();
+  if (num_images >
+      (1.0 + kMaxImageGrowth) * static_cast<double>(num_normalized_images_)) {
+    Finalize();
+    return;
+  }
+
+  std::vector<bool> updated_words(NumVisualWords(), false);
+  for (const int word_id : updated_word_ids) {
+    updated_words[word_id] = true;
+    inverted_files_[word_id].ComputeIDFWeight(num_images);
+  }
+  if (num_images != prev_num_images) {
+    for (int word_id = 0; word_id < NumVisualWords(); ++word_id) {
+      if (!updated_words[word_id]) {
+        inverted_files_[word_id].UpdateIDFWeight(prev_num_images, num_images);
+      }
+    }
+  }
+
+  // The new images only have entries in the modified inverted files.
+  std::unordered_map<int, double> self_similarities(new_image_ids.size());
+  for (const int word_id : updated_word_ids) {
+    const auto& inverted_file = inverted_files_[word_id];
+    const double squared_idf_weight =
+        inverted_file.IDFWeight() * inverted_file.IDFWeight();
+    inverted_file.ForEachEntry([&](const EntryType& entry) {
+      if (new_image_ids.count(entry.image_id)) {
+        self_similarities[entry.image_id] += squared_idf_weight;
+      }
+    });
+  }
+
+  std::vector<int> sorted_new_image_ids(new_image_ids.begin(),
+                                        new_image_ids.end());
+  std::sort(sorted_new_image_ids.begin(), sorted_new_image_ids.end());
+  for (const int image_id : sorted_new_image_ids) {
+    const float normalization_constant =
+        ComputeNormalizationConstant(self_similarities[image_id]);
+    normalization_constants_[image_id] = normalization_constant;
+    image_idxs_.emplace(image_id, static_cast<int>(image_ids_.size()));
+    image_ids_.push_back(image_id);
+    image_normalization_constants_.push_back(normalization_constant);
+  }
+
+  for (const int word_id : updated_word_ids) {
+    inverted_files_[word_id].PackEntries(image_idxs_);
+  }
 }
 
 template <typename kDescType, int kDescDim, int kEmbeddingDim>
@@ -244,7 +409,8 @@ template <typename kDescType, int kDescDim, int kEmbeddingDim>
 void InvertedIndex<kDescType, kDescDim, kEmbeddingDim>::Query(
     const DescType& descriptors,
     const Eigen::MatrixXi& word_ids,
-    std::vector<ImageScore>* image_scores) const {
+    std::vector<ImageScore>* image_scores,
+    const int num_threads) const {
   CHECK_EQ(descriptors.cols(), kDescDim);
 
   image_scores->clear();
@@ -256,9 +422,9 @@ void InvertedIndex<kDescType, kDescDim, kEmbeddingDim>::Query(
     normalization_weight = 1.0f / std::sqrt(self_similarity);
   }
 
-  std::unordered_map<int, int> score_map;
-  std::vector<ImageScore> inverted_file_scores;
-
+  std::vector<ScoringTask> tasks;
+  std::vector<std::pair<size_t, size_t>> ranges;
+  size_t num_total_entries = 0;
   for (typename DescType::Index i = 0; i < descriptors.rows(); ++i) {
     const ProjDescType proj_descriptor =
         proj_matrix_ * descriptors.row(i).transpose().template cast<float>();
@@ -268,28 +434,85 @@ void InvertedIndex<kDescType, kDescDim, kEmbeddingDim>::Query(
         continue;
       }
 
-      inverted_files_.at(word_id).ScoreFeature(proj_descriptor,
-                                               &inverted_file_scores);
-
-      for (const ImageScore& score : inverted_file_scores) {
-        const auto score_map_it = score_map.find(score.image_id);
-        if (score_map_it == score_map.end()) {
-          // Image not found in another inverted file.
-          score_map.emplace(score.image_id,
-                            static_cast<int>(image_scores->size()));
-          image_scores->push_back(score);
-        } else {
-          // Image already found in another inverted file, so accumulate.
-          (*image_scores).at(score_map_it->second).score += score.score;
-        }
+      const auto& inverted_file = inverted_files_.at(word_id);
+      if (!inverted_file.IsUsable()) {
+        continue;
+      }
+
+      ScoringTask task;
+      task.word_id = word_id;
+      inverted_file.ConvertToBinaryDescriptor(proj_descriptor,
+                                              &task.bin_descriptor);
+      inverted_file.SplitEntries(kMaxNumTaskEntries, &ranges);
+      for (const auto& range : ranges) {
+        task.begin = range.first;
+        task.end = range.second;
+        tasks.push_back(task);
+        num_total_entries += range.second - range.first;
+      }
+    }
+  }
+
+  // Partition the tasks into consecutive groups with a similar number of
+  // entries, which are scored into separate dense scores.
+  int num_groups = 1;
+  if (num_total_entries >= kMinNumParallelEntries) {
+    num_groups = std::min(GetEffectiveNumThreads(num_threads),
+                          static_cast<int>(tasks.size()));
+  }
+
+  std::vector<size_t> group_begins(num_groups + 1, tasks.size());
+  group_begins[0] = 0;
+  size_t num_group_entries = 0;
+  int next_group_idx = 1;
+  for (size_t i = 0; i < tasks.size() && next_group_idx < num_groups; ++i) {
+    num_group_entries += tasks[i].end - tasks[i].begin;
+    if (num_group_entries * num_groups >= num_total_entries * next_group_idx) {
+      group_begins[next_group_idx++] = i + 1;
+    }
+  }
+
+  const size_t num_images = image_ids_.size();
+  std::vector<std::vector<float>> scores(num_groups);
+  std::vector<std::vector<uint8_t>> voted(num_groups);
+
+  const auto ScoreGroup = [&](const int64_t group_idx) {
+    scores[group_idx].assign(num_images, 0.0f);
+    voted[group_idx].assign(num_images, 0);
+    for (size_t i = group_begins[group_idx]; i < group_begins[group_idx + 1];
+         ++i) {
+      const ScoringTask& task = tasks[i];
+      inverted_files_[task.word_id].ScoreFeature(task.bin_descriptor,
+                                                 task.begin,
+                                                 task.end,
+                                                 image_idxs_,
+                                                 scores[group_idx].data(),
+                                                 voted[group_idx].data());
+    }
+  };
+
+  if (num_groups == 1) {
+    ScoreGroup(0);
+  } else {
+    ThreadPool thread_pool(num_groups);
+    thread_pool.ParallelFor(0, num_groups, 1, ScoreGroup);
+    for (int group_idx = 1; group_idx < num_groups; ++group_idx) {
+      for (size_t image_idx = 0; image_idx < num_images; ++image_idx) {
+        scores[0][image_idx] += scores[group_idx][image_idx];
+        voted[0][image_idx] |= voted[group_idx][image_idx];
       }
     }
   }
 
   // Normalization.
-  for (ImageScore& score : *image_scores) {
-    score.score *=
-        normalization_weight * normalization_constants_.at(score.image_id);
+  for (size_t image_idx = 0; image_idx < num_images; ++image_idx) {
+    if (voted[0][image_idx]) {
+      ImageScore image_score;
+      image_score.image_id = image_ids_[image_idx];
+      image_score.score = scores[0][image_idx] * normalization_weight *
+                          image_normalization_constants_[image_idx];
+      image_scores->push_back(image_score);
+    }
   }
 }
 
@@ -315,14 +538,13 @@ template <typename kDescType, int kDescDim, int kEmbeddingDim>
 void InvertedIndex<kDescType, kDescDim, kEmbeddingDim>::FindMatches(
     const int word_id,
     const std::unordered_set<int>& image_ids,
-    std::vector<const EntryType*>* matches) const {
+    std::vector<EntryType>* matches) const {
   matches->clear();
-  const auto& entries = inverted_files_.at(word_id).GetEntries();
-  for (const auto& entry : entries) {
+  inverted_files_.at(word_id).ForEachEntry([&](const EntryType& entry) {
     if (image_ids.count(entry.image_id)) {
-      matches->emplace_back(&entry);
+      matches->push_back(entry);
     }
-  }
+  });
 }
 
 template <typename kDescType, int kDescDim, int kEmbeddingDim>
@@ -387,6 +609,9 @@ void InvertedIndex<kDescType, kDescDim, kEmbeddingDim>::Read(
     ifs->read(reinterpret_cast<char*>(&value), sizeof(float));
     normalization_constants_[image_id] = value;
   }
+  num_normalized_images_ = normalization_constants_.size();
+
+  UpdateImageIdxs(/*pack_entries=*/true);
 }
 
 template <typename kDescType, int kDescDim, int kEmbeddingDim>
@@ -421,6 +646,136 @@ void InvertedIndex<kDescType, kDescDim, kEmbeddingDim>::Write(
   }
 }
 
+template <typename kDescType, int kDescDim, int kEmbeddingDim>
+void InvertedIndex<kDescType, kDescDim, kEmbeddingDim>::ReadMapped(
+    const char* data, const size_t num_bytes) {
+  CHECK_GE(num_bytes, sizeof(MappedHeader));
+  MappedHeader header;
+  std::memcpy(&header, data, sizeof(MappedHeader));
+  CHECK_GT(header.num_words, 0);
+  CHECK_EQ(header.embedding_dim, kEmbeddingDim)
+      << "The length of the binary strings should be " << kEmbeddingDim
+      << " but is " << header.embedding_dim
+      << ". The indices are not compatible!";
+  CHECK_EQ(header.desc_dim, kDescDim);
+  CHECK_GE(header.num_images, 0);
+  CHECK_LE(header.entries_offset + header.entries_num_bytes, num_bytes);
+
+  const char* proj_data = data + sizeof(MappedHeader);
+  for (int i = 0; i < kEmbeddingDim; ++i) {
+    for (int j = 0; j < kDescDim; ++j) {
+      std::memcpy(&proj_matrix_(i, j), proj_data, sizeof(float));
+      proj_data += sizeof(float);
+    }
+  }
+
+  const char* constants_data = proj_data;
+  normalization_constants_.clear();
+  normalization_constants_.reserve(header.num_images);
+  for (int32_t i = 0; i < header.num_images; ++i) {
+    int32_t image_id;
+    float value;
+    std::memcpy(&image_id, constants_data, sizeof(int32_t));
+    std::memcpy(&value, constants_data + sizeof(int32_t), sizeof(float));
+    constants_data += sizeof(int32_t) + sizeof(float);
+    normalization_constants_[image_id] = value;
+  }
+  num_normalized_images_ = normalization_constants_.size();
+
+  typedef typename InvertedFile<kEmbeddingDim>::MappedRecord MappedRecord;
+  const MappedRecord* records =
+      reinterpret_cast<const MappedRecord*>(data + header.records_offset);
+  const float* thresholds =
+      reinterpret_cast<const float*>(data + header.thresholds_offset);
+  const uint8_t* entries_data =
+      reinterpret_cast<const uint8_t*>(data + header.entries_offset);
+
+  Initialize(header.num_words);
+  for (int i = 0; i < header.num_words; ++i) {
+    CHECK_LE(records[i].entries_offset + records[i].entries_num_bytes,
+             header.entries_num_bytes);
+    inverted_files_[i].ReadMapped(records[i],
+                                  thresholds + i * kEmbeddingDim,
+                                  entries_data + records[i].entries_offset);
+  }
+
+  UpdateImageIdxs(/*pack_entries=*/false);
+}
+
+template <typename kDescType, int kDescDim, int kEmbeddingDim>
+void InvertedIndex<kDescType, kDescDim, kEmbeddingDim>::WriteMapped(
+    std::ostream* ofs) const {
+  const std::streamoff section_offset = ofs->tellp();
+  const auto AlignOffset = [](const uint64_t offset) {
+    return (offset + 7) / 8 * 8;
+  };
+
+  MappedHeader header;
+  std::memset(&header, 0, sizeof(MappedHeader));
+  header.num_words = NumVisualWords();
+  header.embedding_dim = kEmbeddingDim;
+  header.desc_dim = kDescDim;
+  header.num_images = static_cast<int32_t>(normalization_constants_.size());
+  const uint64_t constants_end =
+      sizeof(MappedHeader) + kEmbeddingDim * kDescDim * sizeof(float) +
+      header.num_images * (sizeof(int32_t) + sizeof(float));
+  header.records_offset = AlignOffset(constants_end);
+  typedef typename InvertedFile<kEmbeddingDim>::MappedRecord MappedRecord;
+  std::vector<MappedRecord> records(header.num_words);
+  header.thresholds_offset =
+      header.records_offset + records.size() * sizeof(MappedRecord);
+  std::vector<float> thresholds(header.num_words * kEmbeddingDim, 0.0f);
+  header.entries_offset = AlignOffset(header.thresholds_offset +
+                                      thresholds.size() * sizeof(float));
+
+  // Write everything up to the compressed entries with the final sizes.
+  ofs->write(reinterpret_cast<const char*>(&header), sizeof(MappedHeader));
+  for (int i = 0; i < kEmbeddingDim; ++i) {
+    for (int j = 0; j < kDescDim; ++j) {
+      ofs->write(reinterpret_cast<const char*>(&proj_matrix_(i, j)),
+                 sizeof(float));
+    }
+  }
+  for (const auto& constant : normalization_constants_) {
+    const int32_t image_id = constant.first;
+    ofs->write(reinterpret_cast<const char*>(&image_id), sizeof(int32_t));
+    ofs->write(reinterpret_cast<const char*>(&constant.second), sizeof(float));
+  }
+  const char kPadding[8] = {0};
+  ofs->write(kPadding, header.records_offset - constants_end);
+  ofs->write(reinterpret_cast<const char*>(records.data()),
+             records.size() * sizeof(MappedRecord));
+  ofs->write(reinterpret_cast<const char*>(thresholds.data()),
+             thresholds.size() * sizeof(float));
+  ofs->write(kPadding,
+             header.entries_offset - header.thresholds_offset -
+                 thresholds.size() * sizeof(float));
+
+  // Compress and write the entries of one inverted file at a time.
+  std::vector<uint8_t> entries_data;
+  for (int i = 0; i < header.num_words; ++i) {
+    entries_data.clear();
+    inverted_files_[i].WriteMapped(
+        &records[i], thresholds.data() + i * kEmbeddingDim, &entries_data);
+    records[i].entries_offset = header.entries_num_bytes;
+    ofs->write(reinterpret_cast<const char*>(entries_data.data()),
+               entries_data.size());
+    header.entries_num_bytes += entries_data.size();
+  }
+  const std::streamoff section_end = ofs->tellp();
+
+  // Write the header, records, and thresholds.
+  ofs->seekp(section_offset);
+  ofs->write(reinterpret_cast<const char*>(&header), sizeof(MappedHeader));
+  ofs->seekp(section_offset + header.records_offset);
+  ofs->write(reinterpret_cast<const char*>(records.data()),
+             records.size() * sizeof(MappedRecord));
+  ofs->write(reinterpret_cast<const char*>(thresholds.data()),
+             thresholds.size() * sizeof(float));
+  ofs->seekp(section_end);
+  CHECK(ofs->good());
+}
+
 template <typename kDescType, int kDescDim, int kEmbeddingDim>
 void InvertedIndex<kDescType, kDescDim, kEmbeddingDim>::
     ComputeWeightsAndNormalizationConstants() {
@@ -439,11 +794,45 @@ void InvertedIndex<kDescType, kDescDim, kEmbeddingDim>::
   normalization_constants_.clear();
   normalization_constants_.reserve(image_ids.size());
   for (const auto& self_similarity : self_similarities) {
-    if (self_similarity.second > 0.0) {
-      normalization_constants_[self_similarity.first] =
-          static_cast<float>(1.0 / std::sqrt(self_similarity.second));
-    } else {
-      normalization_constants_[self_similarity.first] = 0.0f;
+    normalization_constants_[self_similarity.first] =
+        ComputeNormalizationConstant(self_similarity.second);
+  }
+  num_normalized_images_ = normalization_constants_.size();
+}
+
+template <typename kDescType, int kDescDim, int kEmbeddingDim>
+float InvertedIndex<kDescType, kDescDim, kEmbeddingDim>::
+    ComputeNormalizationConstant(const double self_similarity) {
+  if (self_similarity > 0.0) {
+    return static_cast<float>(1.0 / std::sqrt(self_similarity));
+  } else {
+    return 0.0f;
+  }
+}
+
+template <typename kDescType, int kDescDim, int kEmbeddingDim>
+void InvertedIndex<kDescType, kDescDim, kEmbeddingDim>::UpdateImageIdxs(
+    const bool pack_entries) {
+  image_ids_.clear();
+  image_ids_.reserve(normalization_constants_.size());
+  for (const auto& constant : normalization_constants_) {
+    image_ids_.push_back(constant.first);
+  }
+  std::sort(image_ids_.begin(), image_ids_.end());
+
+  image_idxs_.clear();
+  image_idxs_.reserve(image_ids_.size());
+  image_normalization_constants_.resize(image_ids_.size());
+  for (size_t image_idx = 0; image_idx < image_ids_.size(); ++image_idx) {
+    const int image_id = image_ids_[image_idx];
+    image_idxs_.emplace(image_id, static_cast<int>(image_idx));
+    image_normalization_constants_[image_idx] =
+        normalization_constants_.at(image_id);
+  }
+
+  if (pack_entries) {
+    for (auto& inverted_file : inverted_files_) {
+      inverted_file.PackEntries(image_idxs_);
     }
   }
 }
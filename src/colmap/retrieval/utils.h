@@ -30,7 +30,13 @@
 #pragma once
 
 #include <array>
+#include <bitset>
 #include <cmath>
+#include <cstdint>
+
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#endif
 
 namespace colmap {
 namespace retrieval {
@@ -40,6 +46,18 @@ struct ImageScore {
   float score = 0.0f;
 };
 
+// Number of set bits, which compiles to the popcount instruction if supported
+// and is vectorized in loops, e.g., with AVX-512 VPOPCNTQ.
+inline int PopCount64(const uint64_t value) {
+#if defined(_MSC_VER) && defined(_M_X64)
+  return static_cast<int>(__popcnt64(value));
+#elif defined(__GNUC__) || defined(__clang__)
+  return __builtin_popcountll(value);
+#else
+  return static_cast<int>(std::bitset<64>(value).count());
+#endif
+}
+
 // Implements the weighting function used to derive a voting weight from the
 // Hamming distance of two binary signatures. See Eqn. 4 in
 // Arandjelovic, Zisserman. DisLocation: Scalable descriptor distinctiveness for
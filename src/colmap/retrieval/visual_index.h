@@ -37,11 +37,22 @@
 #include "colmap/util/eigen_alignment.h"
 #include "colmap/util/endian.h"
 #include "colmap/util/logging.h"
+#include "colmap/util/mapped_file.h"
+#include "colmap/util/threading.h"
+
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
 
 #include <Eigen/Core>
 #include <boost/heap/fibonacci_heap.hpp>
 #include <flann/flann.hpp>
 
+#if defined(COLMAP_CUDA_ENABLED)
+#include "colmap/retrieval/visual_word_quantizer_cuda.h"
+#endif
+
 namespace colmap {
 namespace retrieval {
 
@@ -74,6 +85,14 @@ class VisualIndex {
 
     // The number of threads used in the index.
     int num_threads = kMaxNumThreads;
+
+    // Whether to assign the visual words on the GPU by exhaustive search
+    // instead of the approximate search on the CPU. Only supported for
+    // uint8_t descriptors with at most 128 dimensions.
+    bool use_gpu = false;
+
+    // Index of the GPU used for the visual word assignment.
+    int gpu_index = -1;
   };
 
   struct QueryOptions {
@@ -92,6 +111,14 @@ class VisualIndex {
 
     // The number of threads used in the index.
     int num_threads = kMaxNumThreads;
+
+    // Whether to assign the visual words on the GPU by exhaustive search
+    // instead of the approximate search on the CPU. Only supported for
+    // uint8_t descriptors with at most 128 dimensions.
+    bool use_gpu = false;
+
+    // Index of the GPU used for the visual word assignment.
+    int gpu_index = -1;
   };
 
   struct BuildOptions {
@@ -113,10 +140,17 @@ class VisualIndex {
 
     // The number of threads used in the index.
     int num_threads = kMaxNumThreads;
+
+    // Whether to assign the visual words on the GPU by exhaustive search
+    // instead of the approximate search on the CPU. Only supported for
+    // uint8_t descriptors with at most 128 dimensions.
+    bool use_gpu = false;
+
+    // Index of the GPU used for the visual word assignment.
+    int gpu_index = -1;
   };
 
   VisualIndex();
-  ~VisualIndex();
 
   size_t NumVisualWords() const;
 
@@ -143,16 +177,76 @@ class VisualIndex {
   // Prepare the index after adding images and before querying.
   void Prepare();
 
+  // Update a prepared index after adding images, such that the new images can
+  // be queried without preparing the whole index again, e.g., when images are
+  // added continuously during acquisition. Only the inverted files of the new
+  // images are sorted and the normalization of the previous images is only
+  // recomputed after their number grew significantly, see InvertedIndex. The
+  // index is prepared if it was never prepared before.
+  void Update();
+
   // Build a visual index from a set of training descriptors by quantizing the
   // descriptor space into visual words and compute their Hamming embedding.
   void Build(const BuildOptions& options, const DescType& descriptors);
 
   // Read and write the visual index. This can be done for an index with and
-  // without indexed images.
+  // without indexed images. Read detects the memory-mapped format.
   void Read(const std::string& path);
   void Write(const std::string& path);
 
+  // Read and write the visual index in the memory-mapped format, where the
+  // visual words and the compressed inverted files are queried in place, such
+  // that reading is fast, the pages are shared between concurrent processes,
+  // and only the inverted files of queried words are paged in. The layout, in
+  // native little endian and aligned to 8 bytes, is:
+  //
+  //    MappedHeader
+  //    kDescType[num_words * kDescDim]     Visual words
+  //    uint8_t[]                           Serialized visual word search index
+  //    int32_t[num_images]                 Identifiers of indexed images
+  //    uint8_t[]                           Inverted index, see InvertedIndex
+  //
+  // Readers reject files of other versions. Adding images copies only the
+  // modified inverted files into memory. The file must not be overwritten
+  // while it is mapped.
+  static const uint32_t kMappedVersion = 1;
+  static bool IsMappedFile(const std::string& path);
+  void ReadMapped(const std::string& path);
+  void WriteMapped(const std::string& path);
+
  private:
+  struct MappedHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t desc_type_size;
+    int32_t desc_dim;
+    int32_t embedding_dim;
+    uint32_t prepared;
+    uint32_t padding;
+    uint64_t num_words;
+    uint64_t words_offset;
+    uint64_t search_index_offset;
+    uint64_t search_index_num_bytes;
+    uint64_t image_ids_offset;
+    uint64_t num_image_ids;
+    uint64_t inverted_index_offset;
+    uint64_t inverted_index_num_bytes;
+  };
+
+  static const char kMappedMagic[8];
+
+  // The matches of a query or database feature with their weights.
+  typedef std::vector<
+      std::pair<float, std::pair<const EntryType*, const EntryType*>>>
+      OrderedMatchListType;
+  typedef std::unordered_map<int, OrderedMatchListType> OrderedMatchMapType;
+
+  // Select 1-to-1 matches between the query and database features of an
+  // image from their weighted matches in both directions.
+  static void FindOneToOneMatches(OrderedMatchMapType* query_matches,
+                                  OrderedMatchMapType* db_matches,
+                                  std::vector<FeatureGeometryMatch>* matches);
+
   // Quantize the descriptor space into visual words.
   void Quantize(const BuildOptions& options, const DescType& descriptors);
 
@@ -164,16 +258,36 @@ class VisualIndex {
                            Eigen::MatrixXi* word_ids) const;
 
   // Find the nearest neighbor visual words for the given descriptors.
-  Eigen::MatrixXi FindWordIds(const DescType& descriptors,
-                              int num_neighbors,
-                              int num_checks,
-                              int num_threads) const;
+  template <typename Options>
+  Eigen::MatrixXi FindWordIds(const Options& options,
+                              const DescType& descriptors,
+                              int num_neighbors) const;
+
+  // Find the nearest neighbor visual words on the GPU. Returns false if the
+  // descriptors are not supported or CUDA is not enabled.
+  bool FindWordIdsGPU(const DescType& descriptors,
+                      int num_neighbors,
+                      int gpu_index,
+                      Eigen::MatrixXi* word_ids) const;
 
   // The search structure on the quantized descriptor space.
   flann::AutotunedIndex<flann::L2<kDescType>> visual_word_index_;
 
-  // The centroids of the visual words.
+  // The centroids of the visual words, which reference either the owned data
+  // or the mapped file.
   flann::Matrix<kDescType> visual_words_;
+  std::vector<kDescType> visual_words_data_;
+
+  // The memory-mapped index referenced by the visual words and inverted index.
+  std::unique_ptr<MappedFile> mapped_file_;
+
+#if defined(COLMAP_CUDA_ENABLED)
+  // The visual words resident on the GPU, which are uploaded on first use.
+  // Queries are issued from multiple threads and share the quantizer.
+  mutable std::unique_ptr<VisualWordQuantizerCUDA> gpu_quantizer_;
+  mutable int gpu_quantizer_index_ = -1;
+  mutable std::mutex gpu_quantizer_mutex_;
+#endif
 
   // The inverted index of the database.
   InvertedIndexType inverted_index_;
@@ -194,11 +308,11 @@ VisualIndex<kDescType, kDescDim, kEmbeddingDim>::VisualIndex()
     : prepared_(false) {}
 
 template <typename kDescType, int kDescDim, int kEmbeddingDim>
-VisualIndex<kDescType, kDescDim, kEmbeddingDim>::~VisualIndex() {
-  if (visual_words_.ptr() != nullptr) {
-    delete[] visual_words_.ptr();
-  }
-}
+const char VisualIndex<kDescType, kDescDim, kEmbeddingDim>::kMappedMagic[8] = {
+    'C', 'O', 'L', 'V', 'I', 'D', 'X', '\0'};
+
+template <typename kDescType, int kDescDim, int kEmbeddingDim>
+const uint32_t VisualIndex<kDescType, kDescDim, kEmbeddingDim>::kMappedVersion;
 
 template <typename kDescType, int kDescDim, int kEmbeddingDim>
 size_t VisualIndex<kDescType, kDescDim, kEmbeddingDim>::NumVisualWords() const {
@@ -226,10 +340,8 @@ void VisualIndex<kDescType, kDescDim, kEmbeddingDim>::Add(
     return;
   }
 
-  const Eigen::MatrixXi word_ids = FindWordIds(descriptors,
-                                               options.num_neighbors,
-                                               options.num_checks,
-                                               options.num_threads);
+  const Eigen::MatrixXi word_ids =
+      FindWordIds(options, descriptors, options.num_neighbors);
 
   for (typename DescType::Index i = 0; i < descriptors.rows(); ++i) {
     const auto& descriptor = descriptors.row(i);
@@ -285,19 +397,14 @@ void VisualIndex<kDescType, kDescDim, kEmbeddingDim>::Query(
     image_ids.insert(image_score.image_id);
   }
 
-  // Find matches for top-ranked images
-  typedef std::vector<
-      std::pair<float, std::pair<const EntryType*, const EntryType*>>>
-      OrderedMatchListType;
-
   // Reference our matches (with their lowest distance) for both
   // {query feature => db feature} and vice versa.
-  std::unordered_map<int, std::unordered_map<int, OrderedMatchListType>>
-      query_to_db_matches;
-  std::unordered_map<int, std::unordered_map<int, OrderedMatchListType>>
-      db_to_query_matches;
+  std::unordered_map<int, OrderedMatchMapType> query_to_db_matches;
+  std::unordered_map<int, OrderedMatchMapType> db_to_query_matches;
 
-  std::vector<const EntryType*> word_matches;
+  std::vector<EntryType> word_matches;
+  // Stable storage of the matched database entries.
+  std::deque<EntryType> db_entries;
 
   std::vector<EntryType> query_entries;  // Convert query features, too.
   query_entries.reserve(descriptors.rows());
@@ -337,18 +444,20 @@ void VisualIndex<kDescType, kDescDim, kEmbeddingDim>::Query(
 
         for (const auto& match : word_matches) {
           const size_t hamming_dist =
-              (query_entries[i].descriptor ^ match->descriptor).count();
+              (query_entries[i].descriptor ^ match.descriptor).count();
 
           if (hamming_dist <= hamming_dist_weight_functor.kMaxHammingDistance) {
             const float dist =
                 hamming_dist_weight_functor(hamming_dist) * squared_idf_weight;
 
-            auto& feature_matches = image_matches[match->image_id];
-            const auto feature_match = feature_matches.find(match->feature_idx);
+            auto& feature_matches = image_matches[match.image_id];
+            const auto feature_match = feature_matches.find(match.feature_idx);
 
             if (feature_match == feature_matches.end() ||
                 feature_match->first < dist) {
-              feature_matches[match->feature_idx] = std::make_pair(dist, match);
+              db_entries.push_back(match);
+              feature_matches[match.feature_idx] =
+                  std::make_pair(dist, &db_entries.back());
             }
           }
         }
@@ -373,130 +482,45 @@ void VisualIndex<kDescType, kDescDim, kEmbeddingDim>::Query(
     }
   }
 
-  // Verify top-ranked images using the found matches.
-  for (auto& image_score : *image_scores) {
-    auto& query_matches = query_to_db_matches[image_score.image_id];
-    auto& db_matches = db_to_query_matches[image_score.image_id];
+  // Find the 1-to-1 matches of the top-ranked images in parallel.
+  const size_t num_verified_images = image_scores->size();
+  std::vector<OrderedMatchMapType*> image_query_matches(num_verified_images);
+  std::vector<OrderedMatchMapType*> image_db_matches(num_verified_images);
+  for (size_t i = 0; i < num_verified_images; ++i) {
+    const int image_id = (*image_scores)[i].image_id;
+    image_query_matches[i] = &query_to_db_matches[image_id];
+    image_db_matches[i] = &db_to_query_matches[image_id];
+  }
 
+  std::vector<std::vector<FeatureGeometryMatch>> image_matches(
+      num_verified_images);
+  const auto FindImageMatches = [&](const int64_t i) {
     // No matches found.
-    if (query_matches.empty()) {
-      continue;
+    if (image_query_matches[i]->empty()) {
+      return;
     }
+    FindOneToOneMatches(
+        image_query_matches[i], image_db_matches[i], &image_matches[i]);
+  };
 
-    // Enforce 1-to-1 matching: Build Fibonacci heaps for the query and database
-    // features, ordered by the minimum number of matches per feature. We'll
-    // select these matches one at a time. For convenience, we'll also pre-sort
-    // the matched feature lists by matching score.
-
-    typedef boost::heap::fibonacci_heap<std::pair<int, int>> FibonacciHeapType;
-    FibonacciHeapType query_heap;
-    FibonacciHeapType db_heap;
-    std::unordered_map<int, typename FibonacciHeapType::handle_type>
-        query_heap_handles;
-    std::unordered_map<int, typename FibonacciHeapType::handle_type>
-        db_heap_handles;
-
-    for (auto& match_data : query_matches) {
-      std::sort(
-          match_data.second.begin(),
-          match_data.second.end(),
-          std::greater<
-              std::pair<float,
-                        std::pair<const EntryType*, const EntryType*>>>());
-
-      query_heap_handles[match_data.first] = query_heap.push(std::make_pair(
-          -static_cast<int>(match_data.second.size()), match_data.first));
-    }
-
-    for (auto& match_data : db_matches) {
-      std::sort(
-          match_data.second.begin(),
-          match_data.second.end(),
-          std::greater<
-              std::pair<float,
-                        std::pair<const EntryType*, const EntryType*>>>());
-
-      db_heap_handles[match_data.first] = db_heap.push(std::make_pair(
-          -static_cast<int>(match_data.second.size()), match_data.first));
-    }
-
-    // Keep tabs on what features have been already matched.
-    std::vector<FeatureGeometryMatch> matches;
-
-    auto db_top = db_heap.top();  // (-num_available_matches, feature_idx)
-    auto query_top = query_heap.top();
-
-    while (!db_heap.empty() && !query_heap.empty()) {
-      // Take the query or database feature with the smallest number of
-      // available matches.
-      const bool use_query =
-          (query_top.first >= db_top.first) && !query_heap.empty();
-
-      // Find the best matching feature that hasn't already been matched.
-      auto& heap1 = (use_query) ? query_heap : db_heap;
-      auto& heap2 = (use_query) ? db_heap : query_heap;
-      auto& handles1 = (use_query) ? query_heap_handles : db_heap_handles;
-      auto& handles2 = (use_query) ? db_heap_handles : query_heap_handles;
-      auto& matches1 = (use_query) ? query_matches : db_matches;
-      auto& matches2 = (use_query) ? db_matches : query_matches;
-
-      const auto idx1 = heap1.top().second;
-      heap1.pop();
-
-      // Entries that have been matched (or processed and subsequently ignored)
-      // get their handles removed.
-      if (handles1.count(idx1) > 0) {
-        handles1.erase(idx1);
-
-        bool match_found = false;
-
-        // The matches have been ordered by Hamming distance, already --
-        // select the lowest available match.
-        for (auto& entry2 : matches1[idx1]) {
-          const auto idx2 = (use_query) ? entry2.second.second->feature_idx
-                                        : entry2.second.first->feature_idx;
-
-          if (handles2.count(idx2) > 0) {
-            if (!match_found) {
-              match_found = true;
-              FeatureGeometryMatch match;
-              match.geometry1 = entry2.second.first->geometry;
-              match.geometry2 = entry2.second.second->geometry;
-              matches.push_back(match);
-
-              handles2.erase(idx2);
-
-              // Remove this feature from consideration for all other features
-              // that matched to it.
-              for (auto& entry1 : matches2[idx2]) {
-                const auto other_idx1 = (use_query)
-                                            ? entry1.second.first->feature_idx
-                                            : entry1.second.second->feature_idx;
-                if (handles1.count(other_idx1) > 0) {
-                  (*handles1[other_idx1]).first += 1;
-                  heap1.increase(handles1[other_idx1]);
-                }
-              }
-            } else {
-              (*handles2[idx2]).first += 1;
-              heap2.increase(handles2[idx2]);
-            }
-          }
-        }
-      }
-
-      if (!query_heap.empty()) {
-        query_top = query_heap.top();
-      }
-
-      if (!db_heap.empty()) {
-        db_top = db_heap.top();
-      }
+  const int num_threads =
+      std::min(GetEffectiveNumThreads(options.num_threads),
+               static_cast<int>(num_verified_images));
+  if (num_threads <= 1) {
+    for (size_t i = 0; i < num_verified_images; ++i) {
+      FindImageMatches(i);
     }
+  } else {
+    ThreadPool thread_pool(num_threads);
+    thread_pool.ParallelFor(0, num_verified_images, 1, FindImageMatches);
+  }
 
-    // Finally, run verification for the current image.
-    VoteAndVerifyOptions vote_and_verify_options;
-    image_score.score += VoteAndVerify(vote_and_verify_options, matches);
+  // Verify the top-ranked images in a batch.
+  VoteAndVerifyOptions vote_and_verify_options;
+  const std::vector<int> num_inliers =
+      VoteAndVerify(vote_and_verify_options, image_matches, num_threads);
+  for (size_t i = 0; i < num_verified_images; ++i) {
+    (*image_scores)[i].score += num_inliers[i];
   }
 
   // Re-rank the images using the spatial verification scores.
@@ -519,12 +543,135 @@ void VisualIndex<kDescType, kDescDim, kEmbeddingDim>::Query(
   }
 }
 
+template <typename kDescType, int kDescDim, int kEmbeddingDim>
+void VisualIndex<kDescType, kDescDim, kEmbeddingDim>::FindOneToOneMatches(
+    OrderedMatchMapType* query_matches,
+    OrderedMatchMapType* db_matches,
+    std::vector<FeatureGeometryMatch>* matches) {
+  // Enforce 1-to-1 matching: Build Fibonacci heaps for the query and database
+  // features, ordered by the minimum number of matches per feature. We'll
+  // select these matches one at a time. For convenience, we'll also pre-sort
+  // the matched feature lists by matching score.
+
+  typedef boost::heap::fibonacci_heap<std::pair<int, int>> FibonacciHeapType;
+  FibonacciHeapType query_heap;
+  FibonacciHeapType db_heap;
+  std::unordered_map<int, typename FibonacciHeapType::handle_type>
+      query_heap_handles;
+  std::unordered_map<int, typename FibonacciHeapType::handle_type>
+      db_heap_handles;
+
+  for (auto& match_data : *query_matches) {
+    std::sort(
+        match_data.second.begin(),
+        match_data.second.end(),
+        std::greater<
+            std::pair<float,
+                      std::pair<const EntryType*, const EntryType*>>>());
+
+    query_heap_handles[match_data.first] = query_heap.push(std::make_pair(
+        -static_cast<int>(match_data.second.size()), match_data.first));
+  }
+
+  for (auto& match_data : *db_matches) {
+    std::sort(
+        match_data.second.begin(),
+        match_data.second.end(),
+        std::greater<
+            std::pair<float,
+                      std::pair<const EntryType*, const EntryType*>>>());
+
+    db_heap_handles[match_data.first] = db_heap.push(std::make_pair(
+        -static_cast<int>(match_data.second.size()), match_data.first));
+  }
+
+  // Keep tabs on what features have been already matched.
+  matches->clear();
+
+  auto db_top = db_heap.top();  // (-num_available_matches, feature_idx)
+  auto query_top = query_heap.top();
+
+  while (!db_heap.empty() && !query_heap.empty()) {
+    // Take the query or database feature with the smallest number of
+    // available matches.
+    const bool use_query =
+        (query_top.first >= db_top.first) && !query_heap.empty();
+
+    // Find the best matching feature that hasn't already been matched.
+    auto& heap1 = (use_query) ? query_heap : db_heap;
+    auto& heap2 = (use_query) ? db_heap : query_heap;
+    auto& handles1 = (use_query) ? query_heap_handles : db_heap_handles;
+    auto& handles2 = (use_query) ? db_heap_handles : query_heap_handles;
+    auto& matches1 = (use_query) ? *query_matches : *db_matches;
+    auto& matches2 = (use_query) ? *db_matches : *query_matches;
+
+    const auto idx1 = heap1.top().second;
+    heap1.pop();
+
+    // Entries that have been matched (or processed and subsequently ignored)
+    // get their handles removed.
+    if (handles1.count(idx1) > 0) {
+      handles1.erase(idx1);
+
+      bool match_found = false;
+
+      // The matches have been ordered by Hamming distance, already --
+      // select the lowest available match.
+      for (auto& entry2 : matches1[idx1]) {
+        const auto idx2 = (use_query) ? entry2.second.second->feature_idx
+                                      : entry2.second.first->feature_idx;
+
+        if (handles2.count(idx2) > 0) {
+          if (!match_found) {
+            match_found = true;
+            FeatureGeometryMatch match;
+            match.geometry1 = entry2.second.first->geometry;
+            match.geometry2 = entry2.second.second->geometry;
+            matches->push_back(match);
+
+            handles2.erase(idx2);
+
+            // Remove this feature from consideration for all other features
+            // that matched to it.
+            for (auto& entry1 : matches2[idx2]) {
+              const auto other_idx1 = (use_query)
+                                          ? entry1.second.first->feature_idx
+                                          : entry1.second.second->feature_idx;
+              if (handles1.count(other_idx1) > 0) {
+                (*handles1[other_idx1]).first += 1;
+                heap1.increase(handles1[other_idx1]);
+              }
+            }
+          } else {
+            (*handles2[idx2]).first += 1;
+            heap2.increase(handles2[idx2]);
+          }
+        }
+      }
+    }
+
+    if (!query_heap.empty()) {
+      query_top = query_heap.top();
+    }
+
+    if (!db_heap.empty()) {
+      db_top = db_heap.top();
+    }
+  }
+}
+
 template <typename kDescType, int kDescDim, int kEmbeddingDim>
 void VisualIndex<kDescType, kDescDim, kEmbeddingDim>::Prepare() {
   inverted_index_.Finalize();
   prepared_ = true;
 }
 
+template <typename kDescType, int kDescDim, int kEmbeddingDim>
+void VisualIndex<kDescType, kDescDim, kEmbeddingDim>::Update() {
+  inverted_index_.Update();
+  prepared_ = true;
+}
+
 template <typename kDescType, int kDescDim, int kEmbeddingDim>
 void VisualIndex<kDescType, kDescDim, kEmbeddingDim>::Build(
     const BuildOptions& options, const DescType& descriptors) {
@@ -542,41 +689,48 @@ void VisualIndex<kDescType, kDescDim, kEmbeddingDim>::Build(
   // Initialize a new inverted index.
   inverted_index_ = InvertedIndexType();
   inverted_index_.Initialize(NumVisualWords());
+  mapped_file_.reset();
 
   // Generate descriptor projection matrix.
   inverted_index_.GenerateHammingEmbeddingProjection();
 
   // Learn the Hamming embedding.
   const int kNumNeighbors = 1;
-  const Eigen::MatrixXi word_ids = FindWordIds(
-      descriptors, kNumNeighbors, options.num_checks, options.num_threads);
+  const Eigen::MatrixXi word_ids =
+      FindWordIds(options, descriptors, kNumNeighbors);
   inverted_index_.ComputeHammingEmbedding(descriptors, word_ids);
 }
 
 template <typename kDescType, int kDescDim, int kEmbeddingDim>
 void VisualIndex<kDescType, kDescDim, kEmbeddingDim>::Read(
     const std::string& path) {
+  if (IsMappedFile(path)) {
+    ReadMapped(path);
+    return;
+  }
+
   long int file_offset = 0;
 
   // Read the visual words.
 
   {
-    if (visual_words_.ptr() != nullptr) {
-      delete[] visual_words_.ptr();
-    }
-
     std::ifstream file(path, std::ios::binary);
     CHECK(file.is_open()) << path;
     const uint64_t rows = ReadBinaryLittleEndian<uint64_t>(&file);
     const uint64_t cols = ReadBinaryLittleEndian<uint64_t>(&file);
-    kDescType* visual_words_data = new kDescType[rows * cols];
+    visual_words_data_.resize(rows * cols);
     for (size_t i = 0; i < rows * cols; ++i) {
-      visual_words_data[i] = ReadBinaryLittleEndian<kDescType>(&file);
+      visual_words_data_[i] = ReadBinaryLittleEndian<kDescType>(&file);
     }
-    visual_words_ = flann::Matrix<kDescType>(visual_words_data, rows, cols);
+    visual_words_ =
+        flann::Matrix<kDescType>(visual_words_data_.data(), rows, cols);
     file_offset = file.tellg();
   }
 
+#if defined(COLMAP_CUDA_ENABLED)
+  gpu_quantizer_.reset();
+#endif
+
   // Read the visual words search index.
 
   visual_word_index_ =
@@ -605,6 +759,8 @@ void VisualIndex<kDescType, kDescDim, kEmbeddingDim>::Read(
     inverted_index_.Read(&file);
   }
 
+  mapped_file_.reset();
+
   image_ids_.clear();
   inverted_index_.GetImageIds(&image_ids_);
 }
@@ -648,6 +804,175 @@ void VisualIndex<kDescType, kDescDim, kEmbeddingDim>::Write(
   }
 }
 
+template <typename kDescType, int kDescDim, int kEmbeddingDim>
+bool VisualIndex<kDescType, kDescDim, kEmbeddingDim>::IsMappedFile(
+    const std::string& path) {
+  std::ifstream file(path, std::ios::binary);
+  CHECK(file.is_open()) << path;
+  char magic[sizeof(kMappedMagic)];
+  file.read(magic, sizeof(magic));
+  return file.gcount() == sizeof(magic) &&
+         std::memcmp(magic, kMappedMagic, sizeof(magic)) == 0;
+}
+
+template <typename kDescType, int kDescDim, int kEmbeddingDim>
+void VisualIndex<kDescType, kDescDim, kEmbeddingDim>::ReadMapped(
+    const std::string& path) {
+  CHECK(IsLittleEndian())
+      << "The mapped format is only supported on little endian platforms";
+
+  auto mapped_file = std::make_unique<MappedFile>(path);
+  const char* data = mapped_file->Data();
+  const size_t num_bytes = mapped_file->Size();
+
+  MappedHeader header;
+  CHECK_GE(num_bytes, sizeof(MappedHeader)) << path;
+  std::memcpy(&header, data, sizeof(MappedHeader));
+  CHECK_EQ(std::memcmp(header.magic, kMappedMagic, sizeof(kMappedMagic)), 0)
+      << path << " is not a mapped visual index";
+  CHECK_EQ(header.version, kMappedVersion)
+      << "Unsupported mapped visual index version";
+  CHECK_EQ(header.desc_type_size, sizeof(kDescType));
+  CHECK_EQ(header.desc_dim, kDescDim);
+  CHECK_EQ(header.embedding_dim, kEmbeddingDim);
+  CHECK_LE(
+      header.words_offset + header.num_words * kDescDim * sizeof(kDescType),
+      num_bytes);
+  CHECK_LE(header.image_ids_offset + header.num_image_ids * sizeof(int32_t),
+           num_bytes);
+  CHECK_LE(header.inverted_index_offset + header.inverted_index_num_bytes,
+           num_bytes);
+
+  // Reference the visual words in place.
+
+  visual_words_ = flann::Matrix<kDescType>(
+      const_cast<kDescType*>(
+          reinterpret_cast<const kDescType*>(data + header.words_offset)),
+      header.num_words,
+      kDescDim);
+  std::vector<kDescType>().swap(visual_words_data_);
+
+#if defined(COLMAP_CUDA_ENABLED)
+  gpu_quantizer_.reset();
+#endif
+
+  // Read the visual words search index.
+
+  visual_word_index_ =
+      flann::AutotunedIndex<flann::L2<kDescType>>(visual_words_);
+
+  {
+    FILE* fin = nullptr;
+#ifdef _MSC_VER
+    CHECK_EQ(fopen_s(&fin, path.c_str(), "rb"), 0);
+#else
+    fin = fopen(path.c_str(), "rb");
+#endif
+    CHECK_NOTNULL(fin);
+    fseek(fin, static_cast<long>(header.search_index_offset), SEEK_SET);
+    visual_word_index_.loadIndex(fin);
+    fclose(fin);
+  }
+
+  // Reference the inverted index in place.
+
+  inverted_index_.ReadMapped(data + header.inverted_index_offset,
+                             header.inverted_index_num_bytes);
+
+  image_ids_.clear();
+  image_ids_.reserve(header.num_image_ids);
+  for (uint64_t i = 0; i < header.num_image_ids; ++i) {
+    int32_t image_id;
+    std::memcpy(&image_id,
+                data + header.image_ids_offset + i * sizeof(int32_t),
+                sizeof(int32_t));
+    image_ids_.insert(image_id);
+  }
+
+  prepared_ = header.prepared != 0;
+  mapped_file_ = std::move(mapped_file);
+}
+
+template <typename kDescType, int kDescDim, int kEmbeddingDim>
+void VisualIndex<kDescType, kDescDim, kEmbeddingDim>::WriteMapped(
+    const std::string& path) {
+  CHECK(IsLittleEndian())
+      << "The mapped format is only supported on little endian platforms";
+  CHECK_NOTNULL(visual_words_.ptr());
+
+  const auto WritePadding = [](std::ostream* stream) {
+    const char kPadding[8] = {0};
+    const std::streamoff offset = stream->tellp();
+    stream->write(kPadding, (8 - offset % 8) % 8);
+  };
+
+  MappedHeader header;
+  std::memset(&header, 0, sizeof(MappedHeader));
+  std::memcpy(header.magic, kMappedMagic, sizeof(kMappedMagic));
+  header.version = kMappedVersion;
+  header.desc_type_size = sizeof(kDescType);
+  header.desc_dim = kDescDim;
+  header.embedding_dim = kEmbeddingDim;
+  header.prepared = prepared_ ? 1 : 0;
+  header.num_words = visual_words_.rows;
+
+  // Write the visual words.
+
+  {
+    std::ofstream file(path, std::ios::binary);
+    CHECK(file.is_open()) << path;
+    file.write(reinterpret_cast<const char*>(&header), sizeof(MappedHeader));
+    WritePadding(&file);
+    header.words_offset = file.tellp();
+    file.write(reinterpret_cast<const char*>(visual_words_.ptr()),
+               visual_words_.rows * visual_words_.cols * sizeof(kDescType));
+    WritePadding(&file);
+  }
+
+  // Write the visual words search index.
+
+  {
+    FILE* fout = nullptr;
+#ifdef _MSC_VER
+    CHECK_EQ(fopen_s(&fout, path.c_str(), "ab"), 0);
+#else
+    fout = fopen(path.c_str(), "ab");
+#endif
+    CHECK_NOTNULL(fout);
+    fseek(fout, 0, SEEK_END);
+    header.search_index_offset = ftell(fout);
+    visual_word_index_.saveIndex(fout);
+    header.search_index_num_bytes = ftell(fout) - header.search_index_offset;
+    fclose(fout);
+  }
+
+  // Write the image identifiers and the inverted index.
+
+  {
+    std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+    CHECK(file.is_open()) << path;
+    file.seekp(0, std::ios::end);
+    WritePadding(&file);
+
+    std::vector<int32_t> image_ids(image_ids_.begin(), image_ids_.end());
+    std::sort(image_ids.begin(), image_ids.end());
+    header.image_ids_offset = file.tellp();
+    header.num_image_ids = image_ids.size();
+    file.write(reinterpret_cast<const char*>(image_ids.data()),
+               image_ids.size() * sizeof(int32_t));
+    WritePadding(&file);
+
+    header.inverted_index_offset = file.tellp();
+    inverted_index_.WriteMapped(&file);
+    header.inverted_index_num_bytes =
+        static_cast<uint64_t>(file.tellp()) - header.inverted_index_offset;
+
+    file.seekp(0, std::ios::beg);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(MappedHeader));
+    CHECK(file.good()) << path;
+  }
+}
+
 template <typename kDescType, int kDescDim, int kEmbeddingDim>
 void VisualIndex<kDescType, kDescDim, kEmbeddingDim>::Quantize(
     const BuildOptions& options, const DescType& descriptors) {
@@ -677,21 +1002,21 @@ void VisualIndex<kDescType, kDescDim, kEmbeddingDim>::Quantize(
   CHECK_LE(num_centers, options.num_visual_words);
 
   const size_t visual_word_data_size = num_centers * descriptors.cols();
-  kDescType* visual_words_data = new kDescType[visual_word_data_size];
+  visual_words_data_.resize(visual_word_data_size);
   for (size_t i = 0; i < visual_word_data_size; ++i) {
     if (std::is_integral<kDescType>::value) {
-      visual_words_data[i] = std::round(centers_data[i]);
+      visual_words_data_[i] = std::round(centers_data[i]);
     } else {
-      visual_words_data[i] = centers_data[i];
+      visual_words_data_[i] = centers_data[i];
     }
   }
 
-  if (visual_words_.ptr() != nullptr) {
-    delete[] visual_words_.ptr();
-  }
-
   visual_words_ = flann::Matrix<kDescType>(
-      visual_words_data, num_centers, descriptors.cols());
+      visual_words_data_.data(), num_centers, descriptors.cols());
+
+#if defined(COLMAP_CUDA_ENABLED)
+  gpu_quantizer_.reset();
+#endif
 }
 
 template <typename kDescType, int kDescDim, int kEmbeddingDim>
@@ -707,11 +1032,9 @@ void VisualIndex<kDescType, kDescDim, kEmbeddingDim>::QueryAndFindWordIds(
     return;
   }
 
-  *word_ids = FindWordIds(descriptors,
-                          options.num_neighbors,
-                          options.num_checks,
-                          options.num_threads);
-  inverted_index_.Query(descriptors, *word_ids, image_scores);
+  *word_ids = FindWordIds(options, descriptors, options.num_neighbors);
+  inverted_index_.Query(
+      descriptors, *word_ids, image_scores, options.num_threads);
 
   auto SortFunc = [](const ImageScore& score1, const ImageScore& score2) {
     return score1.score > score2.score;
@@ -734,16 +1057,24 @@ void VisualIndex<kDescType, kDescDim, kEmbeddingDim>::QueryAndFindWordIds(
 }
 
 template <typename kDescType, int kDescDim, int kEmbeddingDim>
+template <typename Options>
 Eigen::MatrixXi VisualIndex<kDescType, kDescDim, kEmbeddingDim>::FindWordIds(
+    const Options& options,
     const DescType& descriptors,
-    const int num_neighbors,
-    const int num_checks,
-    const int num_threads) const {
+    const int num_neighbors) const {
   static_assert(DescType::IsRowMajor, "Descriptors must be row-major");
 
   CHECK_GT(descriptors.rows(), 0);
   CHECK_GT(num_neighbors, 0);
 
+  if (options.use_gpu) {
+    Eigen::MatrixXi word_ids;
+    if (FindWordIdsGPU(
+            descriptors, num_neighbors, options.gpu_index, &word_ids)) {
+      return word_ids;
+    }
+  }
+
   Eigen::Matrix<size_t, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>
       word_ids(descriptors.rows(), num_neighbors);
   word_ids.setConstant(InvertedIndexType::kInvalidWordId);
@@ -763,11 +1094,11 @@ Eigen::MatrixXi VisualIndex<kDescType, kDescDim, kEmbeddingDim>::FindWordIds(
       descriptors.rows(),
       descriptors.cols());
 
-  flann::SearchParams search_params(num_checks);
-  if (num_threads < 0) {
+  flann::SearchParams search_params(options.num_checks);
+  if (options.num_threads < 0) {
     search_params.cores = std::thread::hardware_concurrency();
   } else {
-    search_params.cores = num_threads;
+    search_params.cores = options.num_threads;
   }
   if (search_params.cores <= 0) {
     search_params.cores = 1;
@@ -779,5 +1110,47 @@ Eigen::MatrixXi VisualIndex<kDescType, kDescDim, kEmbeddingDim>::FindWordIds(
   return word_ids.cast<int>();
 }
 
+template <typename kDescType, int kDescDim, int kEmbeddingDim>
+bool VisualIndex<kDescType, kDescDim, kEmbeddingDim>::FindWordIdsGPU(
+    const DescType& descriptors,
+    const int num_neighbors,
+    const int gpu_index,
+    Eigen::MatrixXi* word_ids) const {
+#if defined(COLMAP_CUDA_ENABLED)
+  if (!std::is_same<kDescType, uint8_t>::value ||
+      descriptors.cols() > VisualWordQuantizerCUDA::kMaxDim ||
+      num_neighbors > VisualWordQuantizerCUDA::kMaxNumNeighbors) {
+    return false;
+  }
+
+  Eigen::Matrix<int, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>
+      gpu_word_ids(descriptors.rows(), num_neighbors);
+  {
+    std::lock_guard<std::mutex> lock(gpu_quantizer_mutex_);
+    if (!gpu_quantizer_ || gpu_quantizer_index_ != gpu_index) {
+      gpu_quantizer_ = std::make_unique<VisualWordQuantizerCUDA>(gpu_index);
+      gpu_quantizer_->SetVisualWords(
+          reinterpret_cast<const uint8_t*>(visual_words_.ptr()),
+          visual_words_.rows,
+          visual_words_.cols);
+      gpu_quantizer_index_ = gpu_index;
+    }
+    gpu_quantizer_->FindWordIds(
+        reinterpret_cast<const uint8_t*>(descriptors.data()),
+        descriptors.rows(),
+        descriptors.cols(),
+        num_neighbors,
+        gpu_word_ids.data());
+  }
+
+  *word_ids = gpu_word_ids.unaryExpr([](const int word_id) {
+    return word_id == -1 ? InvertedIndexType::kInvalidWordId : word_id;
+  });
+  return true;
+#else
+  return false;
+#endif
+}
+
 }  // namespace retrieval
 }  // namespace colmap
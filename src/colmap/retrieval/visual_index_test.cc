@@ -29,6 +29,8 @@
 
 #include "colmap/retrieval/visual_index.h"
 
+#include "colmap/util/testing.h"
+
 #include <gtest/gtest.h>
 
 namespace colmap {
@@ -99,6 +101,81 @@ void TestVocabTreeType() {
     EXPECT_EQ(image_scores[0].image_id, 1);
     EXPECT_EQ(image_scores[1].image_id, 2);
     EXPECT_GT(image_scores[0].score, image_scores[1].score);
+
+    // The mapped index is queried in place with identical results.
+    const std::string mapped_path =
+        CreateTestDir() + "/visual_index_mapped.bin";
+    visual_index.WriteMapped(mapped_path);
+    EXPECT_TRUE(VisualIndexType::IsMappedFile(mapped_path));
+    VisualIndexType mapped_visual_index;
+    mapped_visual_index.Read(mapped_path);
+    EXPECT_EQ(mapped_visual_index.NumVisualWords(), 100);
+    EXPECT_TRUE(mapped_visual_index.ImageIndexed(1));
+    EXPECT_TRUE(mapped_visual_index.ImageIndexed(2));
+    std::vector<ImageScore> mapped_image_scores;
+    query_options.num_images_after_verification = 2;
+    mapped_visual_index.Query(
+        query_options, keypoints1, descriptors1, &mapped_image_scores);
+    visual_index.Query(query_options, keypoints1, descriptors1, &image_scores);
+    ASSERT_EQ(mapped_image_scores.size(), image_scores.size());
+    for (size_t i = 0; i < image_scores.size(); ++i) {
+      EXPECT_EQ(mapped_image_scores[i].image_id, image_scores[i].image_id);
+      EXPECT_EQ(mapped_image_scores[i].score, image_scores[i].score);
+    }
+
+    query_options.num_images_after_verification = 0;
+
+    // Images added to the mapped index are also found.
+    mapped_visual_index.Add(index_options, 3, keypoints1, descriptors1);
+    mapped_visual_index.Prepare();
+    mapped_visual_index.Query(query_options, descriptors1, &image_scores);
+    EXPECT_EQ(image_scores.size(), 3);
+
+    // The mapped and the regular format can be converted.
+    const std::string path = CreateTestDir() + "/visual_index_unmapped.bin";
+    mapped_visual_index.Write(path);
+    EXPECT_FALSE(VisualIndexType::IsMappedFile(path));
+    VisualIndexType read_visual_index;
+    read_visual_index.Read(path);
+    EXPECT_EQ(read_visual_index.NumVisualWords(), 100);
+    EXPECT_TRUE(read_visual_index.ImageIndexed(3));
+  }
+
+  {
+    // Images added incrementally are found without preparing the index.
+    typename VisualIndexType::DescType descriptors =
+        VisualIndexType::DescType::Random(1000, kDescDim);
+    VisualIndexType visual_index;
+    typename VisualIndexType::BuildOptions build_options;
+    build_options.num_visual_words = 100;
+    build_options.branching = 10;
+    visual_index.Build(build_options, descriptors);
+
+    typename VisualIndexType::IndexOptions index_options;
+    typename VisualIndexType::QueryOptions query_options;
+    std::vector<typename VisualIndexType::DescType> image_descriptors;
+    std::vector<ImageScore> image_scores;
+    const int kNumImages = 10;
+    for (int image_id = 0; image_id < kNumImages; ++image_id) {
+      typename VisualIndexType::GeomType keypoints(50);
+      image_descriptors.push_back(
+          VisualIndexType::DescType::Random(50, kDescDim));
+      visual_index.Add(
+          index_options, image_id, keypoints, image_descriptors.back());
+      visual_index.Update();
+      visual_index.Query(
+          query_options, image_descriptors.back(), &image_scores);
+      EXPECT_EQ(image_scores.size(), image_id + 1);
+      EXPECT_EQ(image_scores[0].image_id, image_id);
+    }
+
+    visual_index.Prepare();
+    for (int image_id = 0; image_id < kNumImages; ++image_id) {
+      visual_index.Query(
+          query_options, image_descriptors[image_id], &image_scores);
+      EXPECT_EQ(image_scores.size(), kNumImages);
+      EXPECT_EQ(image_scores[0].image_id, image_id);
+    }
   }
 }
 
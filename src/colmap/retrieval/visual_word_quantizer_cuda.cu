@@ -0,0 +1,254 @@
+#include "colmap/retrieval/visual_word_quantizer_cuda.h"
+
+#include "colmap/util/cuda.h"
+#include "colmap/util/cudacc.h"
+#include "colmap/util/logging.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <vector>
+
+#include <cuda_runtime.h>
+
+namespace colmap {
+namespace retrieval {
+namespace {
+
+// The descriptors are packed into 4 bytes per integer and zero-padded to the
+// maximum dimensionality, which does not change their distances.
+const int kNumPackedDims = VisualWordQuantizerCUDA::kMaxDim / 4;
+const int kBlockSize = 128;
+const int kWordTileSize = 64;
+const int kBatchSize = 64 * 1024;
+
+template <typename T>
+class DeviceBuffer {
+ public:
+  DeviceBuffer() = default;
+  DeviceBuffer(const DeviceBuffer&) = delete;
+  DeviceBuffer& operator=(const DeviceBuffer&) = delete;
+
+  ~DeviceBuffer() {
+    if (ptr_ != nullptr) {
+      cudaFree(ptr_);
+    }
+  }
+
+  T* Get() const { return ptr_; }
+
+  void Resize(const size_t size) {
+    if (size > capacity_) {
+      if (ptr_ != nullptr) {
+        CUDA_SAFE_CALL(cudaFree(ptr_));
+      }
+      CUDA_SAFE_CALL(cudaMalloc((void**)&ptr_, size * sizeof(T)));
+      capacity_ = size;
+    }
+  }
+
+  void Upload(const T* data, const size_t size) {
+    Resize(size);
+    if (size > 0) {
+      CUDA_SAFE_CALL(
+          cudaMemcpy(ptr_, data, size * sizeof(T), cudaMemcpyHostToDevice));
+    }
+  }
+
+  void Download(const size_t size, T* data) const {
+    CHECK_LE(size, capacity_);
+    if (size > 0) {
+      CUDA_SAFE_CALL(
+          cudaMemcpy(data, ptr_, size * sizeof(T), cudaMemcpyDeviceToHost));
+    }
+  }
+
+ private:
+  T* ptr_ = nullptr;
+  size_t capacity_ = 0;
+};
+
+__device__ inline unsigned int DotProductAccumulate(const unsigned int a,
+                                                    const unsigned int b,
+                                                    const unsigned int c) {
+#if __CUDA_ARCH__ >= 610
+  return __dp4a(a, b, c);
+#else
+  return c + (a & 0xFF) * (b & 0xFF) + ((a >> 8) & 0xFF) * ((b >> 8) & 0xFF) +
+         ((a >> 16) & 0xFF) * ((b >> 16) & 0xFF) + (a >> 24) * (b >> 24);
+#endif
+}
+
+// Each thread finds the nearest words of one descriptor. The squared distance
+// |d|^2 - 2 d^T w + |w|^2 is ranked without the constant |d|^2.
+__global__ void FindWordIdsKernel(const unsigned int* descriptors,
+                                  const int num_descriptors,
+                                  const unsigned int* words,
+                                  const int* word_norms,
+                                  const int num_words,
+                                  const int num_neighbors,
+                                  int* word_ids) {
+  const int descriptor_idx = blockIdx.x * kBlockSize + threadIdx.x;
+  const bool is_valid = descriptor_idx < num_descriptors;
+
+  unsigned int descriptor[kNumPackedDims];
+  for (int k = 0; k < kNumPackedDims; ++k) {
+    descriptor[k] =
+        is_valid ? descriptors[descriptor_idx * kNumPackedDims + k] : 0;
+  }
+
+  int best_dists[VisualWordQuantizerCUDA::kMaxNumNeighbors];
+  int best_word_ids[VisualWordQuantizerCUDA::kMaxNumNeighbors];
+  for (int n = 0; n < num_neighbors; ++n) {
+    best_dists[n] = INT_MAX;
+    best_word_ids[n] = -1;
+  }
+
+  __shared__ unsigned int word_tile[kWordTileSize * kNumPackedDims];
+  __shared__ int word_norm_tile[kWordTileSize];
+
+  for (int tile_begin = 0; tile_begin < num_words;
+       tile_begin += kWordTileSize) {
+    const int tile_size = min(kWordTileSize, num_words - tile_begin);
+    for (int i = threadIdx.x; i < tile_size * kNumPackedDims;
+         i += kBlockSize) {
+      word_tile[i] = words[tile_begin * kNumPackedDims + i];
+    }
+    for (int i = threadIdx.x; i < tile_size; i += kBlockSize) {
+      word_norm_tile[i] = word_norms[tile_begin + i];
+    }
+    __syncthreads();
+
+    for (int w = 0; w < tile_size; ++w) {
+      unsigned int dot = 0;
+      for (int k = 0; k < kNumPackedDims; ++k) {
+        dot = DotProductAccumulate(
+            descriptor[k], word_tile[w * kNumPackedDims + k], dot);
+      }
+      const int dist = word_norm_tile[w] - 2 * static_cast<int>(dot);
+      if (dist < best_dists[num_neighbors - 1]) {
+        int n = num_neighbors - 1;
+        while (n > 0 && best_dists[n - 1] > dist) {
+          best_dists[n] = best_dists[n - 1];
+          best_word_ids[n] = best_word_ids[n - 1];
+          --n;
+        }
+        best_dists[n] = dist;
+        best_word_ids[n] = tile_begin + w;
+      }
+    }
+    __syncthreads();
+  }
+
+  if (is_valid) {
+    for (int n = 0; n < num_neighbors; ++n) {
+      word_ids[descriptor_idx * num_neighbors + n] = best_word_ids[n];
+    }
+  }
+}
+
+void PackDescriptors(const uint8_t* descriptors,
+                     const int num_descriptors,
+                     const int dim,
+                     std::vector<unsigned int>* packed_descriptors) {
+  packed_descriptors->assign(
+      static_cast<size_t>(num_descriptors) * kNumPackedDims, 0);
+  for (int i = 0; i < num_descriptors; ++i) {
+    std::memcpy(packed_descriptors->data() +
+                    static_cast<size_t>(i) * kNumPackedDims,
+                descriptors + static_cast<size_t>(i) * dim,
+                dim);
+  }
+}
+
+}  // namespace
+
+const int VisualWordQuantizerCUDA::kMaxDim;
+const int VisualWordQuantizerCUDA::kMaxNumNeighbors;
+
+struct VisualWordQuantizerCUDA::DeviceBuffers {
+  DeviceBuffer<unsigned int> words;
+  DeviceBuffer<int> word_norms;
+  DeviceBuffer<unsigned int> descriptors;
+  DeviceBuffer<int> word_ids;
+};
+
+VisualWordQuantizerCUDA::VisualWordQuantizerCUDA(const int gpu_index) {
+  SetBestCudaDevice(gpu_index);
+  CUDA_SAFE_CALL(cudaGetDevice(&device_));
+  buffers_ = std::make_unique<DeviceBuffers>();
+}
+
+VisualWordQuantizerCUDA::~VisualWordQuantizerCUDA() {
+  cudaSetDevice(device_);
+  buffers_.reset();
+}
+
+void VisualWordQuantizerCUDA::SetVisualWords(const uint8_t* words,
+                                             const int num_words,
+                                             const int dim) {
+  CHECK_GE(num_words, 0);
+  CHECK_GT(dim, 0);
+  CHECK_LE(dim, kMaxDim);
+
+  std::vector<unsigned int> packed_words;
+  PackDescriptors(words, num_words, dim, &packed_words);
+
+  std::vector<int> word_norms(num_words, 0);
+  for (int i = 0; i < num_words; ++i) {
+    for (int k = 0; k < dim; ++k) {
+      const int value = words[static_cast<size_t>(i) * dim + k];
+      word_norms[i] += value * value;
+    }
+  }
+
+  CUDA_SAFE_CALL(cudaSetDevice(device_));
+  buffers_->words.Upload(packed_words.data(), packed_words.size());
+  buffers_->word_norms.Upload(word_norms.data(), word_norms.size());
+  num_words_ = num_words;
+  dim_ = dim;
+}
+
+int VisualWordQuantizerCUDA::NumVisualWords() const { return num_words_; }
+
+void VisualWordQuantizerCUDA::FindWordIds(const uint8_t* descriptors,
+                                          const int num_descriptors,
+                                          const int dim,
+                                          const int num_neighbors,
+                                          int* word_ids) {
+  CHECK_EQ(dim, dim_);
+  CHECK_GT(num_neighbors, 0);
+  CHECK_LE(num_neighbors, kMaxNumNeighbors);
+
+  CUDA_SAFE_CALL(cudaSetDevice(device_));
+
+  std::vector<unsigned int> packed_descriptors;
+  for (int batch_begin = 0; batch_begin < num_descriptors;
+       batch_begin += kBatchSize) {
+    const int batch_size = std::min(kBatchSize, num_descriptors - batch_begin);
+    PackDescriptors(descriptors + static_cast<size_t>(batch_begin) * dim,
+                    batch_size,
+                    dim,
+                    &packed_descriptors);
+    buffers_->descriptors.Upload(packed_descriptors.data(),
+                                 packed_descriptors.size());
+    buffers_->word_ids.Resize(static_cast<size_t>(batch_size) * num_neighbors);
+
+    const int num_blocks = (batch_size + kBlockSize - 1) / kBlockSize;
+    FindWordIdsKernel<<<num_blocks, kBlockSize>>>(buffers_->descriptors.Get(),
+                                                  batch_size,
+                                                  buffers_->words.Get(),
+                                                  buffers_->word_norms.Get(),
+                                                  num_words_,
+                                                  num_neighbors,
+                                                  buffers_->word_ids.Get());
+    CUDA_SYNC_AND_CHECK();
+
+    buffers_->word_ids.Download(
+        static_cast<size_t>(batch_size) * num_neighbors,
+        word_ids + static_cast<size_t>(batch_begin) * num_neighbors);
+  }
+}
+
+}  // namespace retrieval
+}  // namespace colmap
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+
+namespace colmap {
+namespace retrieval {
+
+// Assigns descriptors to their nearest visual words on the GPU by exhaustive
+// search. The visual words stay resident on the GPU and the descriptors are
+// processed in batches, where each thread block computes the distances of a
+// tile of descriptors to tiles of visual words in shared memory and keeps the
+// nearest words of each descriptor in registers, such that the full distance
+// matrix is never stored. In contrast to the approximate search of the CPU
+// index, the nearest words are exact. The quantizer can be used from multiple
+// threads, but not concurrently.
+class VisualWordQuantizerCUDA {
+ public:
+  // Maximum descriptor dimensionality and number of neighbors.
+  static const int kMaxDim = 128;
+  static const int kMaxNumNeighbors = 16;
+
+  explicit VisualWordQuantizerCUDA(int gpu_index = -1);
+  ~VisualWordQuantizerCUDA();
+
+  // Upload the row-major visual words.
+  void SetVisualWords(const uint8_t* words, int num_words, int dim);
+
+  int NumVisualWords() const;
+
+  // Find the identifiers of the `num_neighbors` nearest visual words of the
+  // row-major descriptors, sorted by increasing distance. The identifiers are
+  // written row-major to `word_ids` and are -1 if there are fewer words.
+  void FindWordIds(const uint8_t* descriptors,
+                   int num_descriptors,
+                   int dim,
+                   int num_neighbors,
+                   int* word_ids);
+
+ private:
+  struct DeviceBuffers;
+  std::unique_ptr<DeviceBuffers> buffers_;
+  int device_ = 0;
+  int num_words_ = 0;
+  int dim_ = 0;
+};
+
+}  // namespace retrieval
+}  // namespace colmap
@@ -0,0 +1,107 @@
+#include "colmap/retrieval/visual_word_quantizer_cuda.h"
+
+#include "colmap/util/cuda.h"
+
+#include <algorithm>
+#include <numeric>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace colmap {
+namespace retrieval {
+namespace {
+
+std::vector<uint8_t> RandomDescriptors(const int num_descriptors,
+                                       const int dim,
+                                       const int seed) {
+  std::mt19937 prng(seed);
+  std::uniform_int_distribution<int> distribution(0, 255);
+  std::vector<uint8_t> descriptors(num_descriptors * dim);
+  for (auto& value : descriptors) {
+    value = distribution(prng);
+  }
+  return descriptors;
+}
+
+// Returns the word identifiers sorted by distance with ties broken by index.
+std::vector<int> BruteForceWordIds(const std::vector<uint8_t>& descriptors,
+                                   const std::vector<uint8_t>& words,
+                                   const int dim,
+                                   const int num_neighbors) {
+  const int num_descriptors = descriptors.size() / dim;
+  const int num_words = words.size() / dim;
+  std::vector<int> word_ids(num_descriptors * num_neighbors, -1);
+  for (int i = 0; i < num_descriptors; ++i) {
+    std::vector<int> dists(num_words, 0);
+    for (int j = 0; j < num_words; ++j) {
+      for (int k = 0; k < dim; ++k) {
+        const int diff = static_cast<int>(descriptors[i * dim + k]) -
+                         static_cast<int>(words[j * dim + k]);
+        dists[j] += diff * diff;
+      }
+    }
+    std::vector<int> idxs(num_words);
+    std::iota(idxs.begin(), idxs.end(), 0);
+    std::stable_sort(idxs.begin(), idxs.end(), [&](const int a, const int b) {
+      return dists[a] < dists[b];
+    });
+    for (int n = 0; n < std::min(num_neighbors, num_words); ++n) {
+      word_ids[i * num_neighbors + n] = idxs[n];
+    }
+  }
+  return word_ids;
+}
+
+TEST(VisualWordQuantizerCUDA, FindWordIds) {
+  if (GetNumCudaDevices() == 0) {
+    GTEST_SKIP() << "No CUDA device available";
+  }
+
+  for (const int dim : {128, 64, 5}) {
+    const int kNumWords = 300;
+    const int kNumDescriptors = 1000;
+    const int kNumNeighbors = 3;
+    const std::vector<uint8_t> words = RandomDescriptors(kNumWords, dim, 0);
+    const std::vector<uint8_t> descriptors =
+        RandomDescriptors(kNumDescriptors, dim, 1);
+
+    VisualWordQuantizerCUDA quantizer;
+    quantizer.SetVisualWords(words.data(), kNumWords, dim);
+    EXPECT_EQ(quantizer.NumVisualWords(), kNumWords);
+
+    std::vector<int> word_ids(kNumDescriptors * kNumNeighbors);
+    quantizer.FindWordIds(descriptors.data(),
+                          kNumDescriptors,
+                          dim,
+                          kNumNeighbors,
+                          word_ids.data());
+    EXPECT_EQ(word_ids,
+              BruteForceWordIds(descriptors, words, dim, kNumNeighbors));
+  }
+}
+
+TEST(VisualWordQuantizerCUDA, FewerWordsThanNeighbors) {
+  if (GetNumCudaDevices() == 0) {
+    GTEST_SKIP() << "No CUDA device available";
+  }
+
+  const int kDim = 128;
+  const std::vector<uint8_t> words = RandomDescriptors(2, kDim, 0);
+  const std::vector<uint8_t> descriptors = RandomDescriptors(10, kDim, 1);
+
+  VisualWordQuantizerCUDA quantizer;
+  quantizer.SetVisualWords(words.data(), 2, kDim);
+  std::vector<int> word_ids(10 * 4);
+  quantizer.FindWordIds(descriptors.data(), 10, kDim, 4, word_ids.data());
+  EXPECT_EQ(word_ids, BruteForceWordIds(descriptors, words, kDim, 4));
+  for (int i = 0; i < 10; ++i) {
+    EXPECT_EQ(word_ids[i * 4 + 2], -1);
+    EXPECT_EQ(word_ids[i * 4 + 3], -1);
+  }
+}
+
+}  // namespace
+}  // namespace retrieval
+}  // namespace colmap
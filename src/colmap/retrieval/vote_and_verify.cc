@@ -34,6 +34,7 @@
 #include "colmap/optim/ransac.h"
 #include "colmap/util/eigen_alignment.h"
 #include "colmap/util/logging.h"
+#include "colmap/util/threading.h"
 
 #include <array>
 #include <unordered_map>
@@ -105,6 +106,73 @@ class VotingBin {
   FeatureGeometryTransform sum_tform_;
 };
 
+// Buffers of Vote-and-Verify, which are reused across multiple sets of matches
+// to avoid reallocations.
+struct VoteAndVerifyBuffers {
+  // Initialize the voting histogram for the given options.
+  void Setup(const VoteAndVerifyOptions& options) {
+    const Eigen::Vector4i dims(options.num_angle_bins,
+                               options.num_scale_bins,
+                               options.num_trans_bins,
+                               options.num_trans_bins);
+    if (level_dims.size() == static_cast<size_t>(options.num_levels) &&
+        level_dims[0] == dims) {
+      return;
+    }
+
+    level_dims.resize(options.num_levels);
+    level_offsets.resize(options.num_levels);
+    size_t num_coarse_bins = 0;
+    for (int level = 0; level < options.num_levels; ++level) {
+      for (int d = 0; d < 4; ++d) {
+        level_dims[level](d) = ((dims(d) - 1) >> level) + 1;
+      }
+      level_offsets[level] = num_coarse_bins;
+      if (level > 0) {
+        num_coarse_bins += level_dims[level].prod();
+      }
+    }
+    coarse_num_votes.assign(num_coarse_bins, 0);
+    voted_coarse_bin_idxs.clear();
+  }
+
+  size_t CoarseBinIndex(const int level,
+                        const int n_a,
+                        const int n_s,
+                        const int n_x,
+                        const int n_y) const {
+    const Eigen::Vector4i& dims = level_dims[level];
+    return level_offsets[level] + n_a +
+           dims(0) * (n_s + dims(1) * (n_x + dims(2) * n_y));
+  }
+
+  void Reset() {
+    bins.clear();
+    for (const size_t idx : voted_coarse_bin_idxs) {
+      coarse_num_votes[idx] = 0;
+    }
+    voted_coarse_bin_idxs.clear();
+  }
+
+  // The occupied bins at the finest level of the voting histogram.
+  std::unordered_map<size_t, VotingBin> bins;
+
+  // The dense numbers of votes at the coarser levels of the voting histogram,
+  // their dimensions and offsets, and the voted bins to reset.
+  std::vector<Eigen::Vector4i> level_dims;
+  std::vector<size_t> level_offsets;
+  std::vector<int> coarse_num_votes;
+  std::vector<size_t> voted_coarse_bin_idxs;
+
+  std::vector<std::pair<size_t, float>> bin_scores;
+  std::vector<int> inlier_idxs;
+  std::vector<int> best_inlier_idxs;
+  std::vector<Eigen::Vector2d> best_inlier_points1;
+  std::vector<Eigen::Vector2d> best_inlier_points2;
+  std::vector<std::pair<float, float>> inlier_coords;
+  Eigen::Matrix<int, Eigen::Dynamic, Eigen::Dynamic> eff_inlier_bins;
+};
+
 // Compute the difference in scale between the two features when aligning them
 // with the given transformation.
 float ComputeScaleError(const FeatureGeometry& feature1,
@@ -168,12 +236,14 @@ size_t ComputeEffectiveInlierCount(
     const std::vector<FeatureGeometryMatch>& matches,
     const float max_transfer_error,
     const float max_scale_error,
-    const int num_bins) {
+    const int num_bins,
+    VoteAndVerifyBuffers* buffers) {
   CHECK_GT(max_transfer_error, 0);
   CHECK_GT(max_scale_error, 0);
   CHECK_GT(num_bins, 0);
 
-  std::vector<std::pair<float, float>> inlier_coords;
+  std::vector<std::pair<float, float>>& inlier_coords = buffers->inlier_coords;
+  inlier_coords.clear();
   inlier_coords.reserve(matches.size());
 
   float min_x = std::numeric_limits<float>::max();
@@ -201,8 +271,9 @@ size_t ComputeEffectiveInlierCount(
   const float scale_x = num_bins / (max_x - min_x);
   const float scale_y = num_bins / (max_y - min_y);
 
-  Eigen::Matrix<int, Eigen::Dynamic, Eigen::Dynamic> counter(num_bins,
-                                                             num_bins);
+  Eigen::Matrix<int, Eigen::Dynamic, Eigen::Dynamic>& counter =
+      buffers->eff_inlier_bins;
+  counter.resize(num_bins, num_bins);
   counter.setZero();
 
   for (const auto& coord : inlier_coords) {
@@ -215,10 +286,7 @@ size_t ComputeEffectiveInlierCount(
   return counter.sum();
 }
 
-}  // namespace
-
-int VoteAndVerify(const VoteAndVerifyOptions& options,
-                  const std::vector<FeatureGeometryMatch>& matches) {
+void CheckVoteAndVerifyOptions(const VoteAndVerifyOptions& options) {
   CHECK_GT(options.num_levels, 0);
   CHECK_GT(options.num_transformations, 0);
   CHECK_GT(options.num_trans_bins, 0);
@@ -232,7 +300,11 @@ int VoteAndVerify(const VoteAndVerifyOptions& options,
   CHECK_GE(options.confidence, 0);
   CHECK_LE(options.confidence, 1);
   CHECK_GT(options.num_eff_inlier_bins, 0);
+}
 
+int VoteAndVerify(const VoteAndVerifyOptions& options,
+                  const std::vector<FeatureGeometryMatch>& matches,
+                  VoteAndVerifyBuffers* buffers) {
   const size_t num_matches = matches.size();
   if (num_matches < AffineTransformEstimator::kMinNumSamples) {
     return 0;
@@ -250,10 +322,10 @@ int VoteAndVerify(const VoteAndVerifyOptions& options,
   // Fill the multi-resolution voting histogram.
   //////////////////////////////////////////////////////////////////////////////
 
-  std::vector<std::unordered_map<size_t, VotingBin>> bins(options.num_levels);
-  for (auto& levelBins : bins) {
-    levelBins.reserve(num_matches);
-  }
+  buffers->Setup(options);
+  buffers->Reset();
+  auto& bins = buffers->bins;
+  bins.reserve(num_matches);
 
   for (const auto& match : matches) {
     const auto T =
@@ -282,22 +354,24 @@ int VoteAndVerify(const VoteAndVerifyOptions& options,
     int n_a = std::min(static_cast<int>(a * options.num_angle_bins),
                        static_cast<int>(options.num_angle_bins - 1));
 
-    for (int level = 0; level < options.num_levels; ++level) {
-      const size_t index =
-          n_a + options.num_angle_bins *
-                    (n_s + options.num_scale_bins *
-                               (n_x + options.num_trans_bins * n_y));
-
-      if (level == 0) {
-        bins[level][index].SetCoord(Eigen::Vector4i(n_a, n_s, n_x, n_y));
-      }
-
-      bins[level][index].Vote(T);
+    const size_t index =
+        n_a + options.num_angle_bins *
+                  (n_s + options.num_scale_bins *
+                             (n_x + options.num_trans_bins * n_y));
+    VotingBin& bin = bins[index];
+    bin.SetCoord(Eigen::Vector4i(n_a, n_s, n_x, n_y));
+    bin.Vote(T);
 
+    for (int level = 1; level < options.num_levels; ++level) {
       n_x >>= 1;
       n_y >>= 1;
       n_s >>= 1;
       n_a >>= 1;
+      const size_t coarse_index =
+          buffers->CoarseBinIndex(level, n_a, n_s, n_x, n_y);
+      if (buffers->coarse_num_votes[coarse_index]++ == 0) {
+        buffers->voted_coarse_bin_idxs.push_back(coarse_index);
+      }
     }
   }
 
@@ -305,9 +379,10 @@ int VoteAndVerify(const VoteAndVerifyOptions& options,
   // Compute the multi-resolution scores for all occupied bins.
   //////////////////////////////////////////////////////////////////////////////
 
-  std::vector<std::pair<int, float>> bin_scores;
-  bin_scores.reserve(bins[0].size());
-  for (const auto& bin : bins[0]) {
+  auto& bin_scores = buffers->bin_scores;
+  bin_scores.clear();
+  bin_scores.reserve(bins.size());
+  for (const auto& bin : bins) {
     if (bin.second.GetNumVotes() >= options.min_num_votes) {
       const Eigen::Vector4i& coord = bin.second.GetCoord();
       int n_a = coord(0);
@@ -321,11 +396,9 @@ int VoteAndVerify(const VoteAndVerifyOptions& options,
         n_y >>= 1;
         n_s >>= 1;
         n_a >>= 1;
-        const uint64_t index =
-            n_a + options.num_angle_bins *
-                      (n_s + options.num_scale_bins *
-                                 (n_x + options.num_trans_bins * n_y));
-        score += bins[level][index].GetNumVotes() * level_weight;
+        score += buffers->coarse_num_votes[buffers->CoarseBinIndex(
+                     level, n_a, n_s, n_x, n_y)] *
+                 level_weight;
         level_weight *= 0.5f;
       }
       bin_scores.emplace_back(bin.first, score);
@@ -342,8 +415,8 @@ int VoteAndVerify(const VoteAndVerifyOptions& options,
   std::partial_sort(bin_scores.begin(),
                     bin_scores.begin() + num_transformations,
                     bin_scores.end(),
-                    [](const std::pair<int, float>& score1,
-                       const std::pair<int, float>& score2) {
+                    [](const std::pair<size_t, float>& score1,
+                       const std::pair<size_t, float>& score2) {
                       return score1.second > score2.second;
                     });
 
@@ -353,11 +426,12 @@ int VoteAndVerify(const VoteAndVerifyOptions& options,
 
   size_t max_num_trials = std::numeric_limits<size_t>::max();
   TwoWayTransform best_tform;
-  std::vector<int> inlier_idxs;
+  std::vector<int>& inlier_idxs = buffers->inlier_idxs;
   size_t best_num_inliers = 0;
-  std::vector<int> best_inlier_idxs;
+  std::vector<int>& best_inlier_idxs = buffers->best_inlier_idxs;
+  best_inlier_idxs.clear();
   for (size_t i = 0; i < num_transformations && i < max_num_trials; ++i) {
-    const VotingBin& bin = bins[0].at(bin_scores[i].first);
+    const VotingBin& bin = bins.at(bin_scores[i].first);
     const TwoWayTransform tform(bin.GetMeanTransformation());
     ComputeInliers(tform,
                    matches,
@@ -395,8 +469,12 @@ int VoteAndVerify(const VoteAndVerifyOptions& options,
   if (options.local_optimization && best_num_inliers > 0) {
     // Collect matching inlier points.
     const size_t num_inliers = best_inlier_idxs.size();
-    std::vector<Eigen::Vector2d> best_inlier_points1(num_inliers);
-    std::vector<Eigen::Vector2d> best_inlier_points2(num_inliers);
+    std::vector<Eigen::Vector2d>& best_inlier_points1 =
+        buffers->best_inlier_points1;
+    std::vector<Eigen::Vector2d>& best_inlier_points2 =
+        buffers->best_inlier_points2;
+    best_inlier_points1.resize(num_inliers);
+    best_inlier_points2.resize(num_inliers);
     for (size_t i = 0; i < num_inliers; ++i) {
       const auto& match = matches.at(best_inlier_idxs[i]);
       best_inlier_points1[i] =
@@ -444,11 +522,47 @@ int VoteAndVerify(const VoteAndVerifyOptions& options,
                                                    matches,
                                                    options.max_transfer_error,
                                                    options.max_scale_error,
-                                                   options.num_eff_inlier_bins);
+                                                   options.num_eff_inlier_bins,
+                                                   buffers);
   }
 
   return best_num_inliers;
 }
 
+}  // namespace
+
+int VoteAndVerify(const VoteAndVerifyOptions& options,
+                  const std::vector<FeatureGeometryMatch>& matches) {
+  CheckVoteAndVerifyOptions(options);
+  VoteAndVerifyBuffers buffers;
+  return VoteAndVerify(options, matches, &buffers);
+}
+
+std::vector<int> VoteAndVerify(
+    const VoteAndVerifyOptions& options,
+    const std::vector<std::vector<FeatureGeometryMatch>>& matches,
+    const int num_threads) {
+  CheckVoteAndVerifyOptions(options);
+
+  std::vector<int> num_inliers(matches.size(), 0);
+  const int num_eff_threads = std::min(GetEffectiveNumThreads(num_threads),
+                                       static_cast<int>(matches.size()));
+  if (num_eff_threads <= 1) {
+    VoteAndVerifyBuffers buffers;
+    for (size_t i = 0; i < matches.size(); ++i) {
+      num_inliers[i] = VoteAndVerify(options, matches[i], &buffers);
+    }
+    return num_inliers;
+  }
+
+  ThreadPool thread_pool(num_eff_threads);
+  std::vector<VoteAndVerifyBuffers> buffers(num_eff_threads);
+  thread_pool.ParallelFor(0, matches.size(), 1, [&](const int64_t i) {
+    num_inliers[i] = VoteAndVerify(
+        options, matches[i], &buffers[thread_pool.GetThreadIndex()]);
+  });
+  return num_inliers;
+}
+
 }  // namespace retrieval
 }  // namespace colmap
@@ -31,6 +31,8 @@
 
 #include "colmap/retrieval/geometry.h"
 
+#include <vector>
+
 namespace colmap {
 namespace retrieval {
 
@@ -79,5 +81,14 @@ struct VoteAndVerifyOptions {
 int VoteAndVerify(const VoteAndVerifyOptions& options,
                   const std::vector<FeatureGeometryMatch>& matches);
 
+// Compute the effective inlier counts for the matches of a batch of images,
+// e.g., the top ranked images of a retrieval, which are verified in parallel.
+// The voting histogram and other buffers are allocated once per thread and
+// reused across the images.
+std::vector<int> VoteAndVerify(
+    const VoteAndVerifyOptions& options,
+    const std::vector<std::vector<FeatureGeometryMatch>>& matches,
+    int num_threads);
+
 }  // namespace retrieval
 }  // namespace colmap
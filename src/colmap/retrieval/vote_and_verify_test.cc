@@ -107,6 +107,28 @@ TEST(VoteAndVerify, EffectiveInliers) {
   EXPECT_GT(num_inliers, 0.8 * kNumInliers);
 }
 
+TEST(VoteAndVerify, Batch) {
+  std::vector<std::vector<FeatureGeometryMatch>> matches;
+  std::vector<int> expected_num_inliers;
+  for (const bool eff_inlier_count : {false, true}) {
+    VoteAndVerifyOptions options;
+    options.eff_inlier_count = eff_inlier_count;
+    matches.clear();
+    expected_num_inliers.clear();
+    for (const size_t num_inliers : {0, 10, 100, 50, 3}) {
+      matches.push_back(SynthesizeData(num_inliers, 50).matches);
+      expected_num_inliers.push_back(VoteAndVerify(options, matches.back()));
+    }
+    matches.emplace_back();
+    expected_num_inliers.push_back(0);
+
+    for (const int num_threads : {1, 4}) {
+      EXPECT_EQ(VoteAndVerify(options, matches, num_threads),
+                expected_num_inliers);
+    }
+  }
+}
+
 }  // namespace
 }  // namespace retrieval
 }  // namespace colmap
@@ -34,6 +34,7 @@
 #include "colmap/util/logging.h"
 #include "colmap/util/misc.h"
 
+#include <algorithm>
 #include <iomanip>
 
 namespace colmap {
@@ -171,6 +172,56 @@ void Camera::Rescale(const size_t new_width, const size_t new_height) {
   }
 }
 
+void Camera::BuildRefracProjectionTable(
+    const RefracProjectionTableOptions& options) {
+  CHECK(IsCameraRefractive());
+  auto table = std::make_shared<RefracProjectionTable>();
+  table->Build(options,
+               model_id,
+               refrac_model_id,
+               width,
+               height,
+               params,
+               refrac_params);
+  refrac_projection_table = std::move(table);
+}
+
+void Camera::ImgFromCamRefracBatch(
+    const std::vector<Eigen::Vector3d>& cam_points,
+    std::vector<Eigen::Vector2d>* image_points) const {
+  CHECK_NOTNULL(image_points);
+  image_points->resize(cam_points.size());
+  const CameraRefracKernel kernel = RefracKernel();
+  if (!HasValidRefracProjectionTable()) {
+    kernel.ImgFromCam(
+        cam_points.size(), cam_points.data(), image_points->data());
+    return;
+  }
+
+  for (size_t i = 0; i < cam_points.size(); ++i) {
+    Eigen::Vector2d& image_point = (*image_points)[i];
+    if (refrac_projection_table->InitialGuess(cam_points[i], &image_point)) {
+      kernel.RefineImgFromCam(1, &cam_points[i], &image_point);
+    } else {
+      kernel.ImgFromCam(1, &cam_points[i], &image_point);
+    }
+  }
+}
+
+void Camera::BuildRefracVirtualCameraTable(
+    const RefracVirtualCameraTableOptions& options) {
+  CHECK(IsCameraRefractive());
+  auto table = std::make_shared<RefracVirtualCameraTable>();
+  table->Build(options,
+               model_id,
+               refrac_model_id,
+               width,
+               height,
+               params,
+               refrac_params);
+  refrac_virtual_camera_table = std::move(table);
+}
+
 const std::vector<size_t>& Camera::OptimizableRefracParamsIdxs() const {
   return CameraRefracModelOptimizableParamsIdxs(refrac_model_id);
 }
@@ -211,6 +262,17 @@ void Camera::ComputeVirtual(const Eigen::Vector2d& point2D,
                             Rigid3d& virtual_from_real) const {
   const Eigen::Quaterniond virtual_from_real_rotation(1.0, 0.0, 0.0, 0.0);
 
+  double center_offset;
+  Eigen::Vector2d dir;
+  if (HasValidRefracVirtualCameraTable() &&
+      refrac_virtual_camera_table->Interpolate(point2D, &center_offset, &dir)) {
+    virtual_from_real = Rigid3d(
+        virtual_from_real_rotation,
+        -center_offset * refrac_virtual_camera_table->RefractionAxis());
+    virtual_camera = VirtualCamera(point2D, dir);
+    return;
+  }
+
   const Ray3D ray_refrac = CamFromImgRefrac(point2D);
   const Eigen::Vector3d virtual_cam_center = VirtualCameraCenter(ray_refrac);
   virtual_from_real = Rigid3d(virtual_from_real_rotation,
@@ -233,4 +295,112 @@ void Camera::ComputeVirtuals(const std::vector<Eigen::Vector2d>& points2D,
   }
 }
 
+void Camera::ComputeVirtuals(const std::vector<Eigen::Vector2d>& points2D,
+                             VirtualPinholeCameras* virtual_cameras) const {
+  CHECK_NOTNULL(virtual_cameras);
+  virtual_cameras->focal_length = MeanFocalLength();
+  virtual_cameras->Resize(points2D.size());
+
+  // Interpolate the virtual cameras from the table, if available, and only
+  // trace the rays of the points which are not covered by the table.
+  std::vector<size_t> point_idxs;
+  std::vector<Eigen::Vector2d> traced_points2D;
+  if (HasValidRefracVirtualCameraTable()) {
+    const Eigen::Vector3d& refrac_axis =
+        refrac_virtual_camera_table->RefractionAxis();
+    double center_offset;
+    Eigen::Vector2d dir;
+    for (size_t i = 0; i < points2D.size(); ++i) {
+      if (refrac_virtual_camera_table->Interpolate(
+              points2D[i], &center_offset, &dir)) {
+        virtual_cameras->centers[i] = center_offset * refrac_axis;
+        virtual_cameras->principal_points[i] =
+            points2D[i] - virtual_cameras->focal_length * dir;
+      } else {
+        point_idxs.push_back(i);
+        traced_points2D.push_back(points2D[i]);
+      }
+    }
+    if (traced_points2D.empty()) {
+      return;
+    }
+  }
+
+  const std::vector<Eigen::Vector2d>& batch_points2D =
+      point_idxs.empty() ? points2D : traced_points2D;
+
+  Ray3DBatch rays_refrac;
+  CamFromImgRefracBatch(batch_points2D, &rays_refrac);
+
+  Eigen::ArrayX3d centers;
+  Eigen::Array<bool, Eigen::Dynamic, 1> is_intersect;
+  IntersectLinesWithToleranceBatch(Eigen::Vector3d::Zero(),
+                                   RefractionAxis(),
+                                   rays_refrac.oris,
+                                   -rays_refrac.dirs,
+                                   &centers,
+                                   &is_intersect);
+
+  for (size_t k = 0; k < batch_points2D.size(); ++k) {
+    const size_t i = point_idxs.empty() ? k : point_idxs[k];
+    if (is_intersect(k)) {
+      virtual_cameras->centers[i] = centers.row(k).transpose();
+    }
+    const Eigen::Vector3d dir = rays_refrac.dirs.row(k).transpose();
+    virtual_cameras->principal_points[i] =
+        points2D[i] - virtual_cameras->focal_length * dir.hnormalized();
+  }
+}
+
+double Camera::DomePortCenteringError(const double distance,
+                                     const int grid_size) const {
+  CHECK(refrac_model_id == CameraRefracModelId::kDomePort);
+  CHECK_GT(distance, 0);
+  CHECK_GT(grid_size, 0);
+
+  double max_error = 0;
+  for (int i = 0; i < grid_size; ++i) {
+    for (int j = 0; j < grid_size; ++j) {
+      const Eigen::Vector2d point2D((j + 0.5) / grid_size * width,
+                                    (i + 0.5) / grid_size * height);
+      const Eigen::Vector3d point3D =
+          CamFromImgRefracPoint(point2D, distance);
+      // Skip the totally reflected rays, which are never observed.
+      if (!point3D.allFinite() || point3D.z() <= 0) {
+        continue;
+      }
+      max_error = std::max(
+          max_error, (ImgFromCam(point3D.hnormalized()) - point2D).norm());
+    }
+  }
+
+  return max_error;
+}
+
+std::vector<bool> Camera::RefracValidityMask() const {
+  std::vector<bool> mask(width * height, true);
+  if (!IsCameraRefractive()) {
+    return mask;
+  }
+
+  std::vector<Eigen::Vector2d> row_points2D(width);
+  Ray3DBatch rays_refrac;
+  for (size_t y = 0; y < height; ++y) {
+    for (size_t x = 0; x < width; ++x) {
+      row_points2D[x] = Eigen::Vector2d(x + 0.5, y + 0.5);
+    }
+    CamFromImgRefracBatch(row_points2D, &rays_refrac);
+    for (size_t x = 0; x < width; ++x) {
+      mask[y * width + x] = rays_refrac.oris.row(x).allFinite() &&
+                            rays_refrac.dirs.row(x).allFinite();
+    }
+  }
+
+  return mask;
+}
+
+size_t Camera::MemoryUsage() const {
+  return VectorMemoryUsage(params) + VectorMemoryUsage(refrac_params);
+}
+
 }  // namespace colmap
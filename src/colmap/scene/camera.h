@@ -33,9 +33,12 @@
 #include "colmap/sensor/models.h"
 #include "colmap/sensor/models_refrac.h"
 #include "colmap/sensor/ray3d.h"
+#include "colmap/sensor/refrac_projection_table.h"
+#include "colmap/sensor/refrac_virtual_camera_table.h"
 #include "colmap/util/eigen_alignment.h"
 #include "colmap/util/types.h"
 
+#include <memory>
 #include <vector>
 
 #include <Eigen/Geometry>
@@ -43,6 +46,39 @@
 
 namespace colmap {
 
+// Simple pinhole virtual cameras of a refractive camera, stored as a
+// structure-of-arrays. Every observation of a refractive camera is described by
+// a virtual camera with the same orientation as the real camera, whose center
+// lies on the refraction axis and which observes the refracted ray
+// perspectively. All virtual cameras of a real camera share the same focal
+// length, only the principal point and the center vary per observation.
+struct VirtualPinholeCameras {
+  // The focal length shared by all virtual cameras.
+  double focal_length = 0.0;
+
+  // The principal points of the virtual cameras.
+  std::vector<Eigen::Vector2d> principal_points;
+
+  // The centers of the virtual cameras in the real camera frame.
+  std::vector<Eigen::Vector3d> centers;
+
+  inline size_t Size() const;
+
+  // Resize the buffers. Their capacity is retained, so that reusing the same
+  // object for multiple images does not reallocate memory.
+  inline void Resize(size_t num_cameras);
+
+  // Project point in image plane of a virtual camera to world / infinity.
+  inline Eigen::Vector2d CamFromImg(size_t idx,
+                                    const Eigen::Vector2d& image_point) const;
+
+  // Convert pixel threshold in image plane to camera frame.
+  inline double CamFromImgThreshold(double threshold) const;
+
+  // The transformation from the real to a virtual camera frame.
+  inline Rigid3d VirtualFromReal(size_t idx) const;
+};
+
 // Camera class that holds the intrinsic parameters. Cameras may be shared
 // between multiple images, e.g., if the same "physical" camera took multiple
 // pictures with the exact same lens and intrinsics (focal length, etc.).
@@ -75,6 +111,18 @@ struct Camera {
   // e.g. manually provided or extracted from EXIF
   bool has_prior_focal_length = false;
 
+  // Optional precomputed table to accelerate the refractive projection in
+  // `ImgFromCamRefrac`. The table is shared between copies of the camera and
+  // it is only used if it was built for the current parameters of the camera,
+  // i.e. it must be rebuilt after changing `params` or `refrac_params`.
+  std::shared_ptr<const RefracProjectionTable> refrac_projection_table;
+
+  // Optional precomputed table to accelerate `ComputeVirtual(s)`, which is
+  // shared and invalidated in the same way as the projection table. Note that
+  // the interpolated virtual cameras are approximate, see
+  // `RefracVirtualCameraTable`.
+  std::shared_ptr<const RefracVirtualCameraTable> refrac_virtual_camera_table;
+
   // Initialize parameters for given camera model and focal length, and set
   // the principal point to be the image center.
   static Camera CreateFromModelId(camera_t camera_id,
@@ -167,6 +215,11 @@ struct Camera {
   // -nan))
   inline Ray3D CamFromImgRefrac(const Eigen::Vector2d& image_point) const;
 
+  // Project a batch of points in image plane to rays using refractive camera
+  // model, where the refraction is traced for all rays at once.
+  inline void CamFromImgRefracBatch(
+      const std::vector<Eigen::Vector2d>& image_points, Ray3DBatch* rays) const;
+
   // Project point in image plane to world given a depth.
   inline Eigen::Vector3d CamFromImgRefracPoint(
       const Eigen::Vector2d& image_point, double depth) const;
@@ -179,6 +232,34 @@ struct Camera {
   inline Eigen::Vector2d ImgFromCamRefrac(
       const Eigen::Vector3d& cam_point) const;
 
+  // Project a batch of points from camera frame to image plane using
+  // refractive camera model, where the model is resolved once for all points.
+  void ImgFromCamRefracBatch(const std::vector<Eigen::Vector3d>& cam_points,
+                             std::vector<Eigen::Vector2d>* image_points) const;
+
+  // Resolve the refractive camera model once for bulk loops over points, see
+  // `CameraRefracKernel`. The kernel references the parameters of the camera
+  // and must not outlive them. Note that it does not use the projection table.
+  inline CameraRefracKernel RefracKernel() const;
+
+  // Build the refractive projection table for the current parameters.
+  void BuildRefracProjectionTable(
+      const RefracProjectionTableOptions& options =
+          RefracProjectionTableOptions());
+
+  // Check whether the refractive projection table is built for the current
+  // parameters of the camera.
+  inline bool HasValidRefracProjectionTable() const;
+
+  // Build the virtual camera table for the current parameters.
+  void BuildRefracVirtualCameraTable(
+      const RefracVirtualCameraTableOptions& options =
+          RefracVirtualCameraTableOptions());
+
+  // Check whether the virtual camera table is built for the current
+  // parameters of the camera.
+  inline bool HasValidRefracVirtualCameraTable() const;
+
   // Rescale camera dimensions and accordingly the focal length and
   // and the principal point.
   void Rescale(double scale);
@@ -204,12 +285,56 @@ struct Camera {
   void ComputeVirtuals(const std::vector<Eigen::Vector2d>& points2D,
                        std::vector<Camera>& virtual_cameras,
                        std::vector<Rigid3d>& virtual_from_reals) const;
+
+  // Compute the virtual cameras of all points in a single pass. In contrast
+  // to the version above, this does not allocate memory per point and the
+  // buffers of `virtual_cameras` are reused between calls.
+  void ComputeVirtuals(const std::vector<Eigen::Vector2d>& points2D,
+                       VirtualPinholeCameras* virtual_cameras) const;
+
+  // The maximum error in pixels of approximating a dome port by a perfectly
+  // centered dome port, whose projection reduces to the perspective camera
+  // model. The error is evaluated for the points at the given distance from
+  // the camera center, which are observed on a regular grid of image points.
+  double DomePortCenteringError(double distance, int grid_size = 16) const;
+
+  // Compute the mask of the image pixels, whose rays leave the refractive
+  // housing. Rays that are totally reflected or miss an interface have no
+  // finite refracted direction and are invalid. The pixels are evaluated at
+  // their centers and the mask is stored in row-major order. All pixels of a
+  // non-refractive camera are valid.
+  std::vector<bool> RefracValidityMask() const;
+
+  // The heap memory in bytes allocated by the parameters of the camera. The
+  // refractive tables are shared between copies and not included.
+  size_t MemoryUsage() const;
 };
 
 ////////////////////////////////////////////////////////////////////////////////
 // Implementation
 ////////////////////////////////////////////////////////////////////////////////
 
+size_t VirtualPinholeCameras::Size() const { return centers.size(); }
+
+void VirtualPinholeCameras::Resize(const size_t num_cameras) {
+  principal_points.resize(num_cameras);
+  centers.resize(num_cameras);
+}
+
+Eigen::Vector2d VirtualPinholeCameras::CamFromImg(
+    const size_t idx, const Eigen::Vector2d& image_point) const {
+  return (image_point - principal_points[idx]) / focal_length;
+}
+
+double VirtualPinholeCameras::CamFromImgThreshold(
+    const double threshold) const {
+  return threshold / focal_length;
+}
+
+Rigid3d VirtualPinholeCameras::VirtualFromReal(const size_t idx) const {
+  return Rigid3d(Eigen::Quaterniond::Identity(), -centers[idx]);
+}
+
 const std::string& Camera::ModelName() const {
   return CameraModelIdToName(model_id);
 }
@@ -334,6 +459,12 @@ Ray3D Camera::CamFromImgRefrac(const Eigen::Vector2d& image_point) const {
       model_id, refrac_model_id, params, refrac_params, image_point);
 }
 
+void Camera::CamFromImgRefracBatch(
+    const std::vector<Eigen::Vector2d>& image_points, Ray3DBatch* rays) const {
+  CameraRefracModelCamFromImgBatch(
+      model_id, refrac_model_id, params, refrac_params, image_points, rays);
+}
+
 Eigen::Vector3d Camera::CamFromImgRefracPoint(
     const Eigen::Vector2d& image_point, const double depth) const {
   return CameraRefracModelCamFromImgPoint(
@@ -342,8 +473,28 @@ Eigen::Vector3d Camera::CamFromImgRefracPoint(
 
 Eigen::Vector2d Camera::ImgFromCamRefrac(
     const Eigen::Vector3d& cam_point) const {
+  if (HasValidRefracProjectionTable()) {
+    return refrac_projection_table->ImgFromCam(cam_point);
+  }
   return CameraRefracModelImgFromCam(
       model_id, refrac_model_id, params, refrac_params, cam_point);
 }
 
+CameraRefracKernel Camera::RefracKernel() const {
+  return CameraRefracModelKernel(
+      model_id, refrac_model_id, params, refrac_params);
+}
+
+bool Camera::HasValidRefracProjectionTable() const {
+  return refrac_projection_table &&
+         refrac_projection_table->IsValidFor(
+             model_id, refrac_model_id, params, refrac_params);
+}
+
+bool Camera::HasValidRefracVirtualCameraTable() const {
+  return refrac_virtual_camera_table &&
+         refrac_virtual_camera_table->IsValidFor(
+             model_id, refrac_model_id, params, refrac_params);
+}
+
 }  // namespace colmap
@@ -0,0 +1,80 @@
+#include "colmap/math/random.h"
+#include "colmap/scene/camera.h"
+
+#include <benchmark/benchmark.h>
+
+namespace colmap {
+namespace {
+
+Camera CreateRefracCamera() {
+  Camera camera =
+      Camera::CreateFromModelName(1, "OPENCV", 1500.0, 2000, 1500);
+  camera.refrac_model_id = FlatPort::refrac_model_id;
+  camera.refrac_params = {0.01, -0.02, 1, 0.05, 0.007, 1.003, 1.473, 1.333};
+  Eigen::Map<Eigen::Vector3d>(camera.refrac_params.data()).normalize();
+  return camera;
+}
+
+std::vector<Eigen::Vector2d> RandomPoints2D(const Camera& camera,
+                                            const int num_points) {
+  SetPRNGSeed(0);
+  std::vector<Eigen::Vector2d> points2D(num_points);
+  for (auto& point2D : points2D) {
+    point2D = Eigen::Vector2d(
+        RandomUniformReal<double>(0, camera.width),
+        RandomUniformReal<double>(0, camera.height));
+  }
+  return points2D;
+}
+
+void BM_CameraComputeVirtuals(benchmark::State& state) {
+  const Camera camera = CreateRefracCamera();
+  const std::vector<Eigen::Vector2d> points2D =
+      RandomPoints2D(camera, state.range(0));
+  VirtualPinholeCameras virtual_cameras;
+  for (auto _ : state) {
+    camera.ComputeVirtuals(points2D, &virtual_cameras);
+    benchmark::DoNotOptimize(virtual_cameras.centers.data());
+  }
+  state.SetItemsProcessed(state.iterations() * points2D.size());
+}
+BENCHMARK(BM_CameraComputeVirtuals)->Arg(64)->Arg(1024)->Arg(16384);
+
+// The previous interface, which allocates a camera per point.
+void BM_CameraComputeVirtualsPerCamera(benchmark::State& state) {
+  const Camera camera = CreateRefracCamera();
+  const std::vector<Eigen::Vector2d> points2D =
+      RandomPoints2D(camera, state.range(0));
+  std::vector<Camera> virtual_cameras;
+  std::vector<Rigid3d> virtual_from_reals;
+  for (auto _ : state) {
+    camera.ComputeVirtuals(points2D, virtual_cameras, virtual_from_reals);
+    benchmark::DoNotOptimize(virtual_from_reals.data());
+  }
+  state.SetItemsProcessed(state.iterations() * points2D.size());
+}
+BENCHMARK(BM_CameraComputeVirtualsPerCamera)->Arg(64)->Arg(1024)->Arg(16384);
+
+// Projection with (arg = 1) or without (arg = 0) the refractive projection
+// table.
+void BM_CameraImgFromCamRefrac(benchmark::State& state) {
+  Camera camera = CreateRefracCamera();
+  if (state.range(0)) {
+    camera.BuildRefracProjectionTable();
+  }
+  std::vector<Eigen::Vector3d> cam_points;
+  for (const auto& point2D : RandomPoints2D(camera, 1024)) {
+    cam_points.push_back(
+        camera.CamFromImgRefracPoint(point2D, RandomUniformReal(1.0, 5.0)));
+  }
+  for (auto _ : state) {
+    for (const auto& cam_point : cam_points) {
+      benchmark::DoNotOptimize(camera.ImgFromCamRefrac(cam_point));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * cam_points.size());
+}
+BENCHMARK(BM_CameraImgFromCamRefrac)->Arg(0)->Arg(1);
+
+}  // namespace
+}  // namespace colmap
@@ -31,6 +31,12 @@
 
 #include "colmap/util/misc.h"
 
+#include <map>
+#include <set>
+
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+
 namespace colmap {
 
 CameraRig::CameraRig() {}
@@ -111,6 +117,11 @@ Rigid3d& CameraRig::CamFromRig(const camera_t camera_id) {
   return cams_from_rigs_.at(camera_id);
 }
 
+Rigid3d CameraRig::Cam2FromCam1(const camera_t camera_id1,
+                                const camera_t camera_id2) const {
+  return CamFromRig(camera_id2) * Inverse(CamFromRig(camera_id1));
+}
+
 double CameraRig::ComputeRigFromWorldScale(
     const Reconstruction& reconstruction) const {
   CHECK_GT(NumSnapshots(), 0);
@@ -234,4 +245,146 @@ Rigid3d CameraRig::ComputeRigFromWorld(
                  rig_from_world_translations /= snapshot.size());
 }
 
+std::vector<CameraRig> ReadCameraRigConfig(const std::string& rig_config_path,
+                                           const std::vector<Image>& images,
+                                           bool* has_cams_from_rigs) {
+  boost::property_tree::ptree pt;
+  boost::property_tree::read_json(rig_config_path.c_str(), pt);
+
+  if (has_cams_from_rigs != nullptr) {
+    *has_cams_from_rigs = true;
+  }
+
+  std::vector<CameraRig> camera_rigs;
+  for (const auto& rig_config : pt) {
+    CameraRig camera_rig;
+
+    std::vector<std::string> image_prefixes;
+    for (const auto& camera : rig_config.second.get_child("cameras")) {
+      const int camera_id = camera.second.get<int>("camera_id");
+      image_prefixes.push_back(camera.second.get<std::string>("image_prefix"));
+
+      Rigid3d cam_from_rig;
+
+      auto cam_from_rig_rotation_node =
+          camera.second.get_child_optional("cam_from_rig_rotation");
+      if (cam_from_rig_rotation_node) {
+        int index = 0;
+        Eigen::Vector4d cam_from_rig_wxyz;
+        for (const auto& node : cam_from_rig_rotation_node.get()) {
+          cam_from_rig_wxyz[index++] = node.second.get_value<double>();
+        }
+        cam_from_rig.rotation = Eigen::Quaterniond(cam_from_rig_wxyz(0),
+                                                   cam_from_rig_wxyz(1),
+                                                   cam_from_rig_wxyz(2),
+                                                   cam_from_rig_wxyz(3));
+      } else if (has_cams_from_rigs != nullptr) {
+        *has_cams_from_rigs = false;
+      }
+
+      auto cam_from_rig_translation_node =
+          camera.second.get_child_optional("cam_from_rig_translation");
+      if (cam_from_rig_translation_node) {
+        int index = 0;
+        for (const auto& node : cam_from_rig_translation_node.get()) {
+          cam_from_rig.translation(index++) = node.second.get_value<double>();
+        }
+      } else if (has_cams_from_rigs != nullptr) {
+        *has_cams_from_rigs = false;
+      }
+
+      camera_rig.AddCamera(camera_id, cam_from_rig);
+    }
+
+    camera_rig.SetRefCameraId(rig_config.second.get<int>("ref_camera_id"));
+
+    std::map<std::string, std::vector<const Image*>> snapshots;
+    for (const auto& image : images) {
+      for (const auto& image_prefix : image_prefixes) {
+        if (StringContains(image.Name(), image_prefix)) {
+          const std::string image_suffix =
+              StringGetAfter(image.Name(), image_prefix);
+          snapshots[image_suffix].push_back(&image);
+        }
+      }
+    }
+
+    for (const auto& snapshot : snapshots) {
+      bool has_ref_camera = false;
+      std::vector<image_t> image_ids;
+      image_ids.reserve(snapshot.second.size());
+      for (const Image* image : snapshot.second) {
+        if (image->CameraId() == camera_rig.RefCameraId()) {
+          has_ref_camera = true;
+        }
+        image_ids.push_back(image->ImageId());
+      }
+
+      if (has_ref_camera) {
+        camera_rig.AddSnapshot(image_ids);
+      }
+    }
+
+    camera_rigs.push_back(camera_rig);
+  }
+
+  return camera_rigs;
+}
+
+void GenerateCameraRigImagePairs(
+    const CameraRig& camera_rig,
+    const size_t snapshot_idx,
+    const std::unordered_map<image_t, camera_t>& image_camera_ids,
+    const int overlap,
+    const bool quadratic_overlap,
+    const std::unordered_set<camera_t>& inter_snapshot_camera_ids,
+    const bool inter_snapshot_cross_camera,
+    std::vector<std::pair<image_t, image_t>>* intra_snapshot_pairs,
+    std::vector<std::pair<image_t, image_t>>* inter_snapshot_pairs) {
+  const std::vector<std::vector<image_t>>& snapshots = camera_rig.Snapshots();
+  CHECK_LT(snapshot_idx, snapshots.size());
+  CHECK_GE(overlap, 0);
+  CHECK_NOTNULL(intra_snapshot_pairs)->clear();
+  CHECK_NOTNULL(inter_snapshot_pairs)->clear();
+
+  const std::vector<image_t>& snapshot = snapshots[snapshot_idx];
+  for (size_t i = 0; i < snapshot.size(); ++i) {
+    for (size_t j = i + 1; j < snapshot.size(); ++j) {
+      intra_snapshot_pairs->emplace_back(snapshot[i], snapshot[j]);
+    }
+  }
+
+  std::set<size_t> other_snapshot_idxs;
+  for (int i = 1; i <= overlap; ++i) {
+    other_snapshot_idxs.insert(snapshot_idx + i);
+    if (quadratic_overlap && i < 64) {
+      other_snapshot_idxs.insert(snapshot_idx + (1ull << i));
+    }
+  }
+
+  const auto is_inter_snapshot_camera = [&](const camera_t camera_id) {
+    return inter_snapshot_camera_ids.empty() ||
+           inter_snapshot_camera_ids.count(camera_id) > 0;
+  };
+
+  for (const size_t other_snapshot_idx : other_snapshot_idxs) {
+    if (other_snapshot_idx >= snapshots.size()) {
+      break;
+    }
+    for (const image_t image_id1 : snapshot) {
+      const camera_t camera_id1 = image_camera_ids.at(image_id1);
+      if (!is_inter_snapshot_camera(camera_id1)) {
+        continue;
+      }
+      for (const image_t image_id2 : snapshots[other_snapshot_idx]) {
+        const camera_t camera_id2 = image_camera_ids.at(image_id2);
+        if (is_inter_snapshot_camera(camera_id2) &&
+            (inter_snapshot_cross_camera || camera_id1 == camera_id2)) {
+          inter_snapshot_pairs->emplace_back(image_id1, image_id2);
+        }
+      }
+    }
+  }
+}
+
 }  // namespace colmap
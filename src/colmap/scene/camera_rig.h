@@ -34,7 +34,10 @@
 #include "colmap/scene/reconstruction.h"
 #include "colmap/util/types.h"
 
+#include <string>
 #include <unordered_map>
+#include <unordered_set>
+#include <utility>
 #include <vector>
 
 namespace colmap {
@@ -84,6 +87,9 @@ class CameraRig {
   const Rigid3d& CamFromRig(camera_t camera_id) const;
   Rigid3d& CamFromRig(camera_t camera_id);
 
+  // Get the relative pose between two cameras in the rig.
+  Rigid3d Cam2FromCam1(camera_t camera_id1, camera_t camera_id2) const;
+
   // Compute the scaling factor from the world scale of the reconstruction to
   // the camera rig scale by averaging over the distances between the projection
   // centers. Note that this assumes that there is at least one camera pair in
@@ -108,4 +114,106 @@ class CameraRig {
   std::vector<std::vector<image_t>> snapshots_;
 };
 
+// Read the configuration of the camera rigs from a JSON file. The input images
+// of a camera rig must be named consistently to assign them to the appropriate
+// camera rig and the respective snapshots.
+//
+// An example configuration of a single camera rig:
+// [
+//   {
+//     "ref_camera_id": 1,
+//     "cameras":
+//     [
+//       {
+//           "camera_id": 1,
+//           "image_prefix": "left1_image"
+//           "cam_from_rig_rotation": [1, 0, 0, 0],
+//           "cam_from_rig_translation": [0, 0, 0]
+//       },
+//       {
+//           "camera_id": 2,
+//           "image_prefix": "left2_image"
+//           "cam_from_rig_rotation": [1, 0, 0, 0],
+//           "cam_from_rig_translation": [0, 0, 1]
+//       },
+//       {
+//           "camera_id": 3,
+//           "image_prefix": "right1_image"
+//           "cam_from_rig_rotation": [1, 0, 0, 0],
+//           "cam_from_rig_translation": [0, 0, 2]
+//       },
+//       {
+//           "camera_id": 4,
+//           "image_prefix": "right2_image"
+//           "cam_from_rig_rotation": [1, 0, 0, 0],
+//           "cam_from_rig_translation": [0, 0, 3]
+//       }
+//     ]
+//   }
+// ]
+//
+// The "camera_id" and "image_prefix" fields are required, whereas the
+// "cam_from_rig_rotation" and "cam_from_rig_translation" fields optionally
+// specify the relative extrinsics of the camera rig in the form of a
+// translation vector and a rotation quaternion (w, x, y, z). If the relative
+// extrinsics are not provided, `has_cams_from_rigs` is set to false and they
+// must be inferred, e.g., from a reconstruction with `ComputeCamsFromRigs`.
+//
+// This file specifies the configuration for a single camera rig and that you
+// could potentially define multiple camera rigs. The rig is composed of 4
+// cameras: all images of the first camera must have "left1_image" as a name
+// prefix, e.g., "left1_image_frame000.png" or "left1_image/frame000.png".
+// Images with the same suffix ("_frame000.png" and "/frame000.png") are
+// assigned to the same snapshot, i.e., they are assumed to be captured at the
+// same time. The snapshots are ordered by their suffix, i.e., in the order of
+// acquisition for sequentially numbered frames. Only snapshots with an image
+// of the reference camera are added to the rig. The above configuration could
+// have the following input image file structure:
+//
+//    /path/to/images/...
+//        left1_image/...
+//            frame000.png
+//            frame001.png
+//            frame002.png
+//            ...
+//        left2_image/...
+//            frame000.png
+//            frame001.png
+//            frame002.png
+//            ...
+//        right1_image/...
+//            frame000.png
+//            frame001.png
+//            frame002.png
+//            ...
+//        right2_image/...
+//            frame000.png
+//            frame001.png
+//            frame002.png
+//            ...
+//
+std::vector<CameraRig> ReadCameraRigConfig(const std::string& rig_config_path,
+                                           const std::vector<Image>& images,
+                                           bool* has_cams_from_rigs = nullptr);
+
+// Generate the image pairs of a snapshot of the camera rig for feature
+// matching, which avoids the redundant pairs of matching the images of all
+// cameras independently. All images within the snapshot are paired, where
+// the relative pose of the cameras is known from the rig. Images of different
+// snapshots are paired with the next `overlap` snapshots and, if
+// `quadratic_overlap`, with the snapshots at offsets of powers of two. These
+// inter-snapshot pairs are only generated between images of the cameras in
+// `inter_snapshot_camera_ids` (all cameras if empty) and, unless
+// `inter_snapshot_cross_camera`, only between images of the same camera.
+void GenerateCameraRigImagePairs(
+    const CameraRig& camera_rig,
+    size_t snapshot_idx,
+    const std::unordered_map<image_t, camera_t>& image_camera_ids,
+    int overlap,
+    bool quadratic_overlap,
+    const std::unordered_set<camera_t>& inter_snapshot_camera_ids,
+    bool inter_snapshot_cross_camera,
+    std::vector<std::pair<image_t, image_t>>* intra_snapshot_pairs,
+    std::vector<std::pair<image_t, image_t>>* inter_snapshot_pairs);
+
 }  // namespace colmap
@@ -29,6 +29,11 @@
 
 #include "colmap/scene/camera_rig.h"
 
+#include "colmap/util/misc.h"
+#include "colmap/util/testing.h"
+
+#include <fstream>
+
 #include <gtest/gtest.h>
 
 namespace colmap {
@@ -308,5 +313,121 @@ TEST(CameraRig, ComputeRigFromWorld) {
   EXPECT_EQ(rig_from_world.translation, Eigen::Vector3d(0, -1, -2));
 }
 
+TEST(CameraRig, Cam2FromCam1) {
+  CameraRig camera_rig;
+  const Rigid3d cam_from_rig1(Eigen::Quaterniond(0.5, 0.5, 0.5, 0.5),
+                              Eigen::Vector3d(0, 1, 2));
+  const Rigid3d cam_from_rig2(Eigen::Quaterniond::Identity(),
+                              Eigen::Vector3d(3, 4, 5));
+  camera_rig.AddCamera(0, cam_from_rig1);
+  camera_rig.AddCamera(1, cam_from_rig2);
+  const Rigid3d cam2_from_cam1 = camera_rig.Cam2FromCam1(0, 1);
+  const Eigen::Vector3d point_in_rig(1, -2, 3);
+  EXPECT_LT((cam2_from_cam1 * (cam_from_rig1 * point_in_rig) -
+             cam_from_rig2 * point_in_rig)
+                .norm(),
+            1e-12);
+}
+
+TEST(CameraRig, ReadCameraRigConfig) {
+  const std::string test_dir = CreateTestDir();
+  const std::string rig_config_path = JoinPaths(test_dir, "rig_config.json");
+  {
+    std::ofstream file(rig_config_path);
+    file << "[{\"ref_camera_id\": 1, \"cameras\": ["
+         << "{\"camera_id\": 1, \"image_prefix\": \"left/\","
+         << " \"cam_from_rig_rotation\": [1, 0, 0, 0],"
+         << " \"cam_from_rig_translation\": [0, 0, 0]},"
+         << "{\"camera_id\": 2, \"image_prefix\": \"right/\"}]}]";
+  }
+
+  std::vector<Image> images;
+  const std::vector<std::string> image_names = {
+      "right/frame001.png", "left/frame001.png", "left/frame000.png",
+      "right/frame000.png", "right/frame002.png"};
+  for (size_t i = 0; i < image_names.size(); ++i) {
+    Image image;
+    image.SetImageId(i + 1);
+    image.SetCameraId(image_names[i][0] == 'l' ? 1 : 2);
+    image.SetName(image_names[i]);
+    images.push_back(image);
+  }
+
+  bool has_cams_from_rigs = true;
+  const std::vector<CameraRig> camera_rigs =
+      ReadCameraRigConfig(rig_config_path, images, &has_cams_from_rigs);
+  EXPECT_FALSE(has_cams_from_rigs);
+  ASSERT_EQ(camera_rigs.size(), 1);
+  EXPECT_EQ(camera_rigs[0].NumCameras(), 2);
+  EXPECT_EQ(camera_rigs[0].RefCameraId(), 1);
+  // The snapshots are ordered by their suffix and the snapshot without an
+  // image of the reference camera is skipped.
+  ASSERT_EQ(camera_rigs[0].NumSnapshots(), 2);
+  EXPECT_EQ(camera_rigs[0].Snapshots()[0], (std::vector<image_t>{3, 4}));
+  EXPECT_EQ(camera_rigs[0].Snapshots()[1], (std::vector<image_t>{1, 2}));
+}
+
+TEST(CameraRig, GenerateCameraRigImagePairs) {
+  CameraRig camera_rig;
+  camera_rig.AddCamera(1, Rigid3d());
+  camera_rig.AddCamera(2, Rigid3d());
+  camera_rig.AddCamera(3, Rigid3d());
+  std::unordered_map<image_t, camera_t> image_camera_ids;
+  const int kNumSnapshots = 6;
+  for (int i = 0; i < kNumSnapshots; ++i) {
+    std::vector<image_t> image_ids;
+    for (camera_t camera_id = 1; camera_id <= 3; ++camera_id) {
+      const image_t image_id = 3 * i + camera_id;
+      image_camera_ids.emplace(image_id, camera_id);
+      image_ids.push_back(image_id);
+    }
+    camera_rig.AddSnapshot(image_ids);
+  }
+
+  std::vector<std::pair<image_t, image_t>> intra_snapshot_pairs;
+  std::vector<std::pair<image_t, image_t>> inter_snapshot_pairs;
+  GenerateCameraRigImagePairs(camera_rig,
+                              /*snapshot_idx=*/0,
+                              image_camera_ids,
+                              /*overlap=*/1,
+                              /*quadratic_overlap=*/false,
+                              /*inter_snapshot_camera_ids=*/{},
+                              /*inter_snapshot_cross_camera=*/false,
+                              &intra_snapshot_pairs,
+                              &inter_snapshot_pairs);
+  EXPECT_EQ(intra_snapshot_pairs,
+            (std::vector<std::pair<image_t, image_t>>{{1, 2}, {1, 3}, {2, 3}}));
+  EXPECT_EQ(inter_snapshot_pairs,
+            (std::vector<std::pair<image_t, image_t>>{{1, 4}, {2, 5}, {3, 6}}));
+
+  GenerateCameraRigImagePairs(camera_rig,
+                              /*snapshot_idx=*/0,
+                              image_camera_ids,
+                              /*overlap=*/2,
+                              /*quadratic_overlap=*/true,
+                              /*inter_snapshot_camera_ids=*/{1},
+                              /*inter_snapshot_cross_camera=*/false,
+                              &intra_snapshot_pairs,
+                              &inter_snapshot_pairs);
+  EXPECT_EQ(intra_snapshot_pairs.size(), 3);
+  // Offsets 1, 2 and 4 for the first camera only.
+  EXPECT_EQ(
+      inter_snapshot_pairs,
+      (std::vector<std::pair<image_t, image_t>>{{1, 4}, {1, 7}, {1, 13}}));
+
+  GenerateCameraRigImagePairs(camera_rig,
+                              /*snapshot_idx=*/kNumSnapshots - 2,
+                              image_camera_ids,
+                              /*overlap=*/3,
+                              /*quadratic_overlap=*/false,
+                              /*inter_snapshot_camera_ids=*/{1, 2},
+                              /*inter_snapshot_cross_camera=*/true,
+                              &intra_snapshot_pairs,
+                              &inter_snapshot_pairs);
+  EXPECT_EQ(inter_snapshot_pairs,
+            (std::vector<std::pair<image_t, image_t>>{
+                {13, 16}, {13, 17}, {14, 16}, {14, 17}}));
+}
+
 }  // namespace
 }  // namespace colmap
@@ -177,6 +177,47 @@ TEST(Camera, TestVerifyRefracParams) {
   EXPECT_FALSE(camera.VerifyRefracParams());
 }
 
+TEST(Camera, DomePortCenteringError) {
+  Camera camera = Camera::CreateFromModelId(
+      1, SimplePinholeCameraModel::model_id, 1000, 1000, 800);
+  camera.refrac_model_id = DomePort::refrac_model_id;
+  camera.refrac_params = {0, 0, 0, 0.05, 0.007, 1.0, 1.52, 1.33};
+  EXPECT_NEAR(camera.DomePortCenteringError(1.0), 0, 1e-6);
+
+  camera.refrac_params[0] = 0.0001;
+  const double error = camera.DomePortCenteringError(0.5);
+  EXPECT_GT(error, 0.1);
+  EXPECT_GT(camera.DomePortCenteringError(5.0), 0.1);
+
+  // The error grows approximately linearly with the decentering.
+  camera.refrac_params[0] = 0.002;
+  EXPECT_GT(camera.DomePortCenteringError(0.5), 10 * error);
+}
+
+TEST(Camera, RefracValidityMask) {
+  Camera camera = Camera::CreateFromModelId(
+      1, SimplePinholeCameraModel::model_id, 100, 400, 300);
+  EXPECT_EQ(camera.RefracValidityMask(),
+            std::vector<bool>(camera.width * camera.height, true));
+
+  // Rays beyond the critical angle of ~41.8 degrees are totally reflected at
+  // the interface to the optically thinner outer medium.
+  camera.refrac_model_id = FlatPort::refrac_model_id;
+  camera.refrac_params = {0, 0, 1, 0.05, 0.01, 1.5, 1.5, 1.0};
+  const std::vector<bool> mask = camera.RefracValidityMask();
+  ASSERT_EQ(mask.size(), camera.width * camera.height);
+  const auto is_valid = [&](const size_t x, const size_t y) {
+    return mask[y * camera.width + x];
+  };
+  EXPECT_TRUE(is_valid(200, 150));
+  EXPECT_TRUE(is_valid(270, 150));
+  EXPECT_TRUE(is_valid(200, 90));
+  EXPECT_FALSE(is_valid(300, 150));
+  EXPECT_FALSE(is_valid(200, 40));
+  EXPECT_FALSE(is_valid(0, 0));
+  EXPECT_FALSE(is_valid(399, 299));
+}
+
 TEST(Camera, IsUndistorted) {
   Camera camera = Camera::CreateFromModelId(
       1, SimplePinholeCameraModel::model_id, 1.0, 1, 1);
@@ -316,6 +357,151 @@ TEST(Camera, ImgFromCam) {
   EXPECT_EQ(camera.ImgFromCam(Eigen::Vector2d(-0.5, -0.5))(1), 0.0);
 }
 
+TEST(Camera, RefracProjectionTable) {
+  Camera camera =
+      Camera::CreateFromModelName(1, "SIMPLE_PINHOLE", 1000.0, 1000, 800);
+  camera.refrac_model_id = DomePort::refrac_model_id;
+  camera.refrac_params = {0.001, 0.001, 0.02, 0.05, 0.007, 1.0, 1.52, 1.33};
+  EXPECT_FALSE(camera.HasValidRefracProjectionTable());
+
+  const Eigen::Vector3d cam_point(0.3, -0.2, 2.0);
+  const Eigen::Vector2d image_point = camera.ImgFromCamRefrac(cam_point);
+
+  camera.BuildRefracProjectionTable();
+  EXPECT_TRUE(camera.HasValidRefracProjectionTable());
+  EXPECT_LT((camera.ImgFromCamRefrac(cam_point) - image_point).norm(), 1e-6);
+
+  // Copies share the table.
+  Camera camera_copy = camera;
+  EXPECT_TRUE(camera_copy.HasValidRefracProjectionTable());
+
+  // Changing the parameters invalidates the table.
+  camera_copy.refrac_params[3] = 0.06;
+  EXPECT_FALSE(camera_copy.HasValidRefracProjectionTable());
+  EXPECT_TRUE(camera.HasValidRefracProjectionTable());
+  camera_copy.SetFocalLength(1100.0);
+  camera_copy.BuildRefracProjectionTable();
+  EXPECT_TRUE(camera_copy.HasValidRefracProjectionTable());
+  EXPECT_FALSE(camera.refrac_projection_table ==
+               camera_copy.refrac_projection_table);
+}
+
+TEST(Camera, ImgFromCamRefracBatch) {
+  Camera camera =
+      Camera::CreateFromModelName(1, "SIMPLE_PINHOLE", 1000.0, 1000, 800);
+  camera.refrac_model_id = DomePort::refrac_model_id;
+  camera.refrac_params = {0.001, 0.001, 0.02, 0.05, 0.007, 1.0, 1.52, 1.33};
+
+  const std::vector<Eigen::Vector3d> cam_points = {
+      {0.3, -0.2, 2.0}, {0.0, 0.0, 1.0}, {-0.5, 0.4, 3.0}};
+  std::vector<Eigen::Vector2d> image_points;
+  camera.ImgFromCamRefracBatch(cam_points, &image_points);
+  ASSERT_EQ(image_points.size(), cam_points.size());
+  for (size_t i = 0; i < cam_points.size(); ++i) {
+    EXPECT_EQ(image_points[i], camera.ImgFromCamRefrac(cam_points[i]));
+    EXPECT_EQ(camera.RefracKernel().CamFromImgPoint(image_points[i], 1.0),
+              camera.CamFromImgRefracPoint(image_points[i], 1.0));
+  }
+
+  camera.BuildRefracProjectionTable();
+  std::vector<Eigen::Vector2d> table_image_points;
+  camera.ImgFromCamRefracBatch(cam_points, &table_image_points);
+  ASSERT_EQ(table_image_points.size(), cam_points.size());
+  for (size_t i = 0; i < cam_points.size(); ++i) {
+    EXPECT_LT((table_image_points[i] - image_points[i]).norm(), 1e-6);
+  }
+}
+
+TEST(Camera, ComputeVirtuals) {
+  Camera camera =
+      Camera::CreateFromModelName(1, "SIMPLE_PINHOLE", 1000.0, 1000, 800);
+  camera.refrac_model_id = FlatPort::refrac_model_id;
+  camera.refrac_params = {0.1, 0.05, 0.99, 0.05, 0.007, 1.0, 1.52, 1.33};
+  Eigen::Map<Eigen::Vector3d>(camera.refrac_params.data()).normalize();
+
+  const std::vector<Eigen::Vector2d> points2D = {
+      {10.0, 20.0}, {500.0, 400.0}, {950.0, 780.0}};
+
+  std::vector<Camera> virtual_cameras;
+  std::vector<Rigid3d> virtual_from_reals;
+  camera.ComputeVirtuals(points2D, virtual_cameras, virtual_from_reals);
+
+  VirtualPinholeCameras virtual_pinholes;
+  camera.ComputeVirtuals(points2D, &virtual_pinholes);
+  ASSERT_EQ(virtual_pinholes.Size(), points2D.size());
+  EXPECT_EQ(virtual_pinholes.focal_length, camera.MeanFocalLength());
+  EXPECT_EQ(virtual_pinholes.CamFromImgThreshold(1.0),
+            virtual_cameras[0].CamFromImgThreshold(1.0));
+
+  for (size_t i = 0; i < points2D.size(); ++i) {
+    EXPECT_LT((virtual_pinholes.CamFromImg(i, points2D[i]) -
+               virtual_cameras[i].CamFromImg(points2D[i]))
+                  .norm(),
+              1e-12);
+    const Rigid3d virtual_from_real = virtual_pinholes.VirtualFromReal(i);
+    EXPECT_TRUE(virtual_from_real.rotation.isApprox(
+        virtual_from_reals[i].rotation, 1e-12));
+    EXPECT_LT((virtual_from_real.translation -
+               virtual_from_reals[i].translation)
+                  .norm(),
+              1e-12);
+  }
+
+  // Reusing the buffers with fewer points shrinks the size.
+  camera.ComputeVirtuals({points2D[0]}, &virtual_pinholes);
+  EXPECT_EQ(virtual_pinholes.Size(), 1);
+}
+
+TEST(Camera, RefracVirtualCameraTable) {
+  Camera camera =
+      Camera::CreateFromModelName(1, "SIMPLE_PINHOLE", 1000.0, 1000, 800);
+  camera.refrac_model_id = FlatPort::refrac_model_id;
+  camera.refrac_params = {0.1, 0.05, 0.99, 0.05, 0.007, 1.0, 1.52, 1.33};
+  Eigen::Map<Eigen::Vector3d>(camera.refrac_params.data()).normalize();
+  EXPECT_FALSE(camera.HasValidRefracVirtualCameraTable());
+
+  // The last point is outside of the image and not covered by the table.
+  const std::vector<Eigen::Vector2d> points2D = {
+      {10.0, 20.0}, {500.0, 400.0}, {950.0, 780.0}, {1010.0, 400.0}};
+  VirtualPinholeCameras exact_pinholes;
+  camera.ComputeVirtuals(points2D, &exact_pinholes);
+
+  camera.BuildRefracVirtualCameraTable();
+  EXPECT_TRUE(camera.HasValidRefracVirtualCameraTable());
+
+  VirtualPinholeCameras virtual_pinholes;
+  camera.ComputeVirtuals(points2D, &virtual_pinholes);
+  ASSERT_EQ(virtual_pinholes.Size(), points2D.size());
+  for (size_t i = 0; i < points2D.size(); ++i) {
+    EXPECT_LT((virtual_pinholes.principal_points[i] -
+               exact_pinholes.principal_points[i])
+                  .norm(),
+              1e-2);
+    EXPECT_LT((virtual_pinholes.centers[i] - exact_pinholes.centers[i]).norm(),
+              1e-6);
+
+    Camera virtual_camera;
+    Rigid3d virtual_from_real;
+    camera.ComputeVirtual(points2D[i], virtual_camera, virtual_from_real);
+    EXPECT_LT((Eigen::Vector2d(virtual_camera.PrincipalPointX(),
+                               virtual_camera.PrincipalPointY()) -
+               virtual_pinholes.principal_points[i])
+                  .norm(),
+              1e-12);
+    EXPECT_LT(
+        (virtual_from_real.translation + virtual_pinholes.centers[i]).norm(),
+        1e-12);
+  }
+  EXPECT_EQ(virtual_pinholes.principal_points.back(),
+            exact_pinholes.principal_points.back());
+
+  // Changing the parameters invalidates the table.
+  Camera camera_copy = camera;
+  camera_copy.SetFocalLength(1100.0);
+  EXPECT_FALSE(camera_copy.HasValidRefracVirtualCameraTable());
+  EXPECT_TRUE(camera.HasValidRefracVirtualCameraTable());
+}
+
 TEST(Camera, Rescale) {
   Camera camera = Camera::CreateFromModelName(1, "SIMPLE_PINHOLE", 1.0, 1, 1);
   camera.Rescale(2.0);
@@ -30,21 +30,58 @@
 #include "colmap/scene/correspondence_graph.h"
 
 #include "colmap/geometry/pose.h"
+#include "colmap/util/endian.h"
+#include "colmap/util/misc.h"
 #include "colmap/util/string.h"
+#include "colmap/util/threading.h"
 
 #include <map>
 #include <set>
+#include <unordered_set>
 
 namespace colmap {
+namespace {
+
+// Version of the binary format, to be increased on any change of the format.
+const uint64_t kBinaryFormatVersion = 1;
+
+// Write/read a contiguous array of plain values at once on little endian
+// machines, which is much faster than element-wise for large arrays.
+template <typename T>
+void WriteBinaryLittleEndianArray(std::ostream* stream,
+                                  const std::vector<T>& data) {
+  if (IsLittleEndian()) {
+    stream->write(reinterpret_cast<const char*>(data.data()),
+                  data.size() * sizeof(T));
+  } else {
+    WriteBinaryLittleEndian<T>(stream, data);
+  }
+}
+
+template <typename T>
+void ReadBinaryLittleEndianArray(std::istream* stream, std::vector<T>* data) {
+  if (IsLittleEndian()) {
+    stream->read(reinterpret_cast<char*>(data->data()),
+                 data->size() * sizeof(T));
+  } else {
+    ReadBinaryLittleEndian<T>(stream, data);
+  }
+}
+
+}  // namespace
 
 std::unordered_map<image_pair_t, point2D_t>
 CorrespondenceGraph::NumCorrespondencesBetweenImages() const {
   std::unordered_map<image_pair_t, point2D_t> num_corrs_between_images;
-  num_corrs_between_images.reserve(image_pairs_.size());
+  num_corrs_between_images.reserve(NumImagePairs());
   for (const auto& image_pair : image_pairs_) {
     num_corrs_between_images.emplace(image_pair.first,
                                      image_pair.second.num_correspondences);
   }
+  for (const auto& image_pair : sorted_image_pairs_) {
+    num_corrs_between_images.emplace(image_pair.first,
+                                     image_pair.second.num_correspondences);
+  }
   return num_corrs_between_images;
 }
 
@@ -52,45 +89,198 @@ void CorrespondenceGraph::Finalize() {
   CHECK(!finalized_);
   finalized_ = true;
 
-  // Flatten all correspondences, remove images without observations.
+  // Count number of correspondences and observations, remove images without
+  // observations.
+  size_t num_total_corrs = 0;
   for (auto it = images_.begin(); it != images_.end();) {
-    // Count number of correspondences and observations.
     it->second.num_observations = 0;
-    size_t num_total_corrs = 0;
+    size_t num_image_corrs = 0;
     for (auto& corr : it->second.corrs) {
-      num_total_corrs += corr.size();
+      num_image_corrs += corr.size();
       if (!corr.empty()) {
         it->second.num_observations += 1;
       }
     }
 
     // Erase image without observations.
-    if (num_total_corrs == 0) {
+    if (num_image_corrs == 0) {
       images_.erase(it++);
       continue;
     }
 
-    // Reshuffle correspondences into flattened vector.
-    const point2D_t num_points2D = it->second.corrs.size();
-    it->second.flat_corrs.reserve(num_total_corrs);
-    it->second.flat_corr_begs.resize(num_points2D + 1);
+    num_total_corrs += num_image_corrs;
+    ++it;
+  }
+
+  // Reshuffle correspondences into one flattened vector in the order of the
+  // image identifiers, such that the layout is deterministic.
+  std::vector<image_t> image_ids;
+  image_ids.reserve(images_.size());
+  for (const auto& image : images_) {
+    image_ids.push_back(image.first);
+  }
+  std::sort(image_ids.begin(), image_ids.end());
+
+  flat_corrs_.reserve(num_total_corrs);
+  for (const image_t image_id : image_ids) {
+    struct Image& image = images_.at(image_id);
+    const point2D_t num_points2D = image.corrs.size();
+    image.flat_corrs_beg = flat_corrs_.size();
+    image.flat_corr_begs.resize(num_points2D + 1);
     for (point2D_t point2D_idx = 0; point2D_idx < num_points2D; ++point2D_idx) {
-      it->second.flat_corr_begs[point2D_idx] = it->second.flat_corrs.size();
-      std::vector<Correspondence>& corrs = it->second.corrs[point2D_idx];
-      it->second.flat_corrs.insert(
-          it->second.flat_corrs.end(), corrs.begin(), corrs.end());
+      image.flat_corr_begs[point2D_idx] =
+          flat_corrs_.size() - image.flat_corrs_beg;
+      std::vector<Correspondence>& corrs = image.corrs[point2D_idx];
+      flat_corrs_.insert(flat_corrs_.end(), corrs.begin(), corrs.end());
     }
-    it->second.flat_corr_begs[num_points2D] = it->second.flat_corrs.size();
-
-    // Ensure we reserved enough space before insertion.
-    CHECK_EQ(it->second.flat_corrs.size(), num_total_corrs);
+    image.flat_corr_begs[num_points2D] =
+        flat_corrs_.size() - image.flat_corrs_beg;
 
     // Deallocate original data.
-    it->second.corrs.clear();
-    it->second.corrs.shrink_to_fit();
+    image.corrs.clear();
+    image.corrs.shrink_to_fit();
+  }
 
-    ++it;
+  // Ensure we reserved enough space before insertion.
+  CHECK_EQ(flat_corrs_.size(), num_total_corrs);
+
+  // Move image pairs into sorted table.
+  sorted_image_pairs_.assign(image_pairs_.begin(), image_pairs_.end());
+  std::sort(sorted_image_pairs_.begin(),
+            sorted_image_pairs_.end(),
+            [](const std::pair<image_pair_t, ImagePair>& image_pair1,
+               const std::pair<image_pair_t, ImagePair>& image_pair2) {
+              return image_pair1.first < image_pair2.first;
+            });
+  image_pairs_.clear();
+}
+
+size_t CorrespondenceGraph::MemoryUsage() const {
+  size_t memory_usage = images_.MemoryUsage() +
+                        HashTableMemoryUsage(image_pairs_) +
+                        VectorMemoryUsage(sorted_image_pairs_) +
+                        VectorMemoryUsage(flat_corrs_);
+  for (const auto& image : images_) {
+    memory_usage += VectorMemoryUsage(image.second.corrs) +
+                    VectorMemoryUsage(image.second.flat_corr_begs);
+    for (const auto& point_corrs : image.second.corrs) {
+      memory_usage += VectorMemoryUsage(point_corrs);
+    }
+  }
+  return memory_usage;
+}
+
+void CorrespondenceGraph::Write(std::ostream* stream) const {
+  CHECK(finalized_);
+
+  WriteBinaryLittleEndian<uint64_t>(stream, kBinaryFormatVersion);
+
+  std::vector<image_t> image_ids;
+  image_ids.reserve(images_.size());
+  for (const auto& image : images_) {
+    image_ids.push_back(image.first);
+  }
+  std::sort(image_ids.begin(), image_ids.end());
+
+  WriteBinaryLittleEndian<uint64_t>(stream, image_ids.size());
+  for (const image_t image_id : image_ids) {
+    const struct Image& image = images_.at(image_id);
+    WriteBinaryLittleEndian<image_t>(stream, image_id);
+    WriteBinaryLittleEndian<point2D_t>(stream, image.num_observations);
+    WriteBinaryLittleEndian<point2D_t>(stream, image.num_correspondences);
+    WriteBinaryLittleEndian<uint64_t>(stream, image.flat_corrs_beg);
+    WriteBinaryLittleEndian<uint64_t>(stream, image.flat_corr_begs.size());
+    WriteBinaryLittleEndianArray<point2D_t>(stream, image.flat_corr_begs);
+  }
+
+  static_assert(sizeof(Correspondence) == sizeof(image_t) + sizeof(point2D_t),
+                "Correspondence must be tightly packed");
+  WriteBinaryLittleEndian<uint64_t>(stream, flat_corrs_.size());
+  if (IsLittleEndian()) {
+    stream->write(reinterpret_cast<const char*>(flat_corrs_.data()),
+                  flat_corrs_.size() * sizeof(Correspondence));
+  } else {
+    for (const auto& corr : flat_corrs_) {
+      WriteBinaryLittleEndian<image_t>(stream, corr.image_id);
+      WriteBinaryLittleEndian<point2D_t>(stream, corr.point2D_idx);
+    }
+  }
+
+  WriteBinaryLittleEndian<uint64_t>(stream, sorted_image_pairs_.size());
+  for (const auto& image_pair : sorted_image_pairs_) {
+    WriteBinaryLittleEndian<image_pair_t>(stream, image_pair.first);
+    WriteBinaryLittleEndian<point2D_t>(stream,
+                                       image_pair.second.num_correspondences);
+  }
+}
+
+bool CorrespondenceGraph::Read(std::istream* stream) {
+  CHECK(!finalized_);
+  CHECK(images_.empty());
+
+  if (ReadBinaryLittleEndian<uint64_t>(stream) != kBinaryFormatVersion ||
+      !stream->good()) {
+    return false;
+  }
+
+  std::vector<std::pair<image_t, Image>> images(
+      ReadBinaryLittleEndian<uint64_t>(stream));
+  for (auto& image : images) {
+    image.first = ReadBinaryLittleEndian<image_t>(stream);
+    image.second.num_observations = ReadBinaryLittleEndian<point2D_t>(stream);
+    image.second.num_correspondences =
+        ReadBinaryLittleEndian<point2D_t>(stream);
+    image.second.flat_corrs_beg = ReadBinaryLittleEndian<uint64_t>(stream);
+    image.second.flat_corr_begs.resize(
+        ReadBinaryLittleEndian<uint64_t>(stream));
+    ReadBinaryLittleEndianArray<point2D_t>(stream,
+                                           &image.second.flat_corr_begs);
+    if (!stream->good() || image.second.flat_corr_begs.empty()) {
+      return false;
+    }
+  }
+
+  std::vector<Correspondence> flat_corrs(
+      ReadBinaryLittleEndian<uint64_t>(stream));
+  if (IsLittleEndian()) {
+    stream->read(reinterpret_cast<char*>(flat_corrs.data()),
+                 flat_corrs.size() * sizeof(Correspondence));
+  } else {
+    for (auto& corr : flat_corrs) {
+      corr.image_id = ReadBinaryLittleEndian<image_t>(stream);
+      corr.point2D_idx = ReadBinaryLittleEndian<point2D_t>(stream);
+    }
+  }
+
+  std::vector<std::pair<image_pair_t, ImagePair>> sorted_image_pairs(
+      ReadBinaryLittleEndian<uint64_t>(stream));
+  for (auto& image_pair : sorted_image_pairs) {
+    image_pair.first = ReadBinaryLittleEndian<image_pair_t>(stream);
+    image_pair.second.num_correspondences =
+        ReadBinaryLittleEndian<point2D_t>(stream);
   }
+
+  if (stream->fail()) {
+    return false;
+  }
+
+  // Make sure that all correspondence ranges are within bounds.
+  for (const auto& image : images) {
+    if (image.second.flat_corrs_beg + image.second.flat_corr_begs.back() >
+        flat_corrs.size()) {
+      return false;
+    }
+  }
+
+  images_.reserve(images.size());
+  for (auto& image : images) {
+    images_.emplace(image.first, std::move(image.second));
+  }
+  flat_corrs_ = std::move(flat_corrs);
+  sorted_image_pairs_ = std::move(sorted_image_pairs);
+  finalized_ = true;
+
+  return true;
 }
 
 void CorrespondenceGraph::AddImage(const image_t image_id,
@@ -185,16 +375,141 @@ void CorrespondenceGraph::AddCorrespondences(const image_t image_id1,
   }
 }
 
+void CorrespondenceGraph::AddCorrespondences(
+    const std::vector<std::pair<image_t, image_t>>& image_pairs,
+    const std::vector<FeatureMatches>& matches,
+    const int num_threads) {
+  CHECK_EQ(image_pairs.size(), matches.size());
+
+  ThreadPool thread_pool(num_threads);
+  const size_t num_pairs = image_pairs.size();
+  const size_t chunk_size =
+      std::max<size_t>(1, (num_pairs + thread_pool.NumThreads() - 1) /
+                              thread_pool.NumThreads());
+
+  // Validate the matches of each image pair. Invalid and duplicate matches
+  // only depend on the other matches of the same image pair, so the image
+  // pairs are independent of each other.
+  std::vector<char> valid_pairs(num_pairs, 0);
+  std::vector<std::vector<char>> valid_matches(num_pairs);
+  std::vector<point2D_t> num_valid_matches(num_pairs, 0);
+  for (size_t begin = 0; begin < num_pairs; begin += chunk_size) {
+    const size_t end = std::min(begin + chunk_size, num_pairs);
+    thread_pool.AddTask([&, begin, end]() {
+      std::unordered_set<point2D_t> point2D_idxs1;
+      std::unordered_set<point2D_t> point2D_idxs2;
+      for (size_t i = begin; i < end; ++i) {
+        const image_t image_id1 = image_pairs[i].first;
+        const image_t image_id2 = image_pairs[i].second;
+        if (image_id1 == image_id2) {
+          LOG(WARNING) << "Cannot use self-matches for image_id="
+                       << image_id1;
+          continue;
+        }
+
+        valid_pairs[i] = 1;
+        const size_t num_points2D1 = images_.at(image_id1).corrs.size();
+        const size_t num_points2D2 = images_.at(image_id2).corrs.size();
+        point2D_idxs1.clear();
+        point2D_idxs2.clear();
+        valid_matches[i].resize(matches[i].size(), 0);
+        for (size_t j = 0; j < matches[i].size(); ++j) {
+          const FeatureMatch& match = matches[i][j];
+          if (match.point2D_idx1 >= num_points2D1 ||
+              match.point2D_idx2 >= num_points2D2) {
+            LOG(WARNING) << StringPrintf(
+                "Invalid correspondence between point2D_idx=%d in "
+                "image_id=%d and point2D_idx=%d in image_id=%d",
+                match.point2D_idx1,
+                image_id1,
+                match.point2D_idx2,
+                image_id2);
+          } else if (point2D_idxs1.count(match.point2D_idx1) > 0 ||
+                     point2D_idxs2.count(match.point2D_idx2) > 0) {
+            LOG(WARNING) << StringPrintf(
+                "Duplicate correspondence between "
+                "point2D_idx=%d in image_id=%d and point2D_idx=%d in "
+                "image_id=%d",
+                match.point2D_idx1,
+                image_id1,
+                match.point2D_idx2,
+                image_id2);
+          } else {
+            point2D_idxs1.insert(match.point2D_idx1);
+            point2D_idxs2.insert(match.point2D_idx2);
+            valid_matches[i][j] = 1;
+            num_valid_matches[i] += 1;
+          }
+        }
+      }
+    });
+  }
+  thread_pool.Wait();
+
+  // Assign the images to shards, such that every image is only modified by
+  // the thread of its shard. All threads visit the image pairs in the same
+  // order, so the order of correspondences does not depend on the threads.
+  std::unordered_map<image_t, int> image_id_to_shard;
+  image_id_to_shard.reserve(images_.size());
+  for (const auto& image : images_) {
+    image_id_to_shard.emplace(image.first,
+                              image_id_to_shard.size() %
+                                  thread_pool.NumThreads());
+  }
+
+  for (size_t shard = 0; shard < thread_pool.NumThreads(); ++shard) {
+    thread_pool.AddTask([&, shard]() {
+      for (size_t i = 0; i < num_pairs; ++i) {
+        if (!valid_pairs[i]) {
+          continue;
+        }
+        const image_t image_id1 = image_pairs[i].first;
+        const image_t image_id2 = image_pairs[i].second;
+        if (image_id_to_shard.at(image_id1) == static_cast<int>(shard)) {
+          struct Image& image1 = images_.at(image_id1);
+          image1.num_correspondences += num_valid_matches[i];
+          for (size_t j = 0; j < matches[i].size(); ++j) {
+            if (valid_matches[i][j]) {
+              image1.corrs[matches[i][j].point2D_idx1].emplace_back(
+                  image_id2, matches[i][j].point2D_idx2);
+            }
+          }
+        }
+        if (image_id_to_shard.at(image_id2) == static_cast<int>(shard)) {
+          struct Image& image2 = images_.at(image_id2);
+          image2.num_correspondences += num_valid_matches[i];
+          for (size_t j = 0; j < matches[i].size(); ++j) {
+            if (valid_matches[i][j]) {
+              image2.corrs[matches[i][j].point2D_idx2].emplace_back(
+                  image_id1, matches[i][j].point2D_idx1);
+            }
+          }
+        }
+      }
+    });
+  }
+  thread_pool.Wait();
+
+  for (size_t i = 0; i < num_pairs; ++i) {
+    if (valid_pairs[i]) {
+      image_pairs_[Database::ImagePairToPairId(image_pairs[i].first,
+                                               image_pairs[i].second)]
+          .num_correspondences += num_valid_matches[i];
+    }
+  }
+}
+
 CorrespondenceGraph::CorrespondenceRange
 CorrespondenceGraph::FindCorrespondences(const image_t image_id,
                                          const point2D_t point2D_idx) const {
   CHECK(finalized_);
   const point2D_t next_point2D_idx = point2D_idx + 1;
   const Image& image = images_.at(image_id);
+  const Correspondence* image_corrs = flat_corrs_.data() + image.flat_corrs_beg;
   const Correspondence* beg =
-      image.flat_corrs.data() + image.flat_corr_begs.at(point2D_idx);
+      image_corrs + image.flat_corr_begs.at(point2D_idx);
   const Correspondence* end =
-      image.flat_corrs.data() + image.flat_corr_begs.at(next_point2D_idx);
+      image_corrs + image.flat_corr_begs.at(next_point2D_idx);
   return CorrespondenceRange{beg, end};
 }
 
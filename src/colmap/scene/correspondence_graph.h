@@ -30,8 +30,11 @@
 #pragma once
 
 #include "colmap/scene/database.h"
+#include "colmap/util/dense_id_map.h"
 #include "colmap/util/types.h"
 
+#include <algorithm>
+#include <iostream>
 #include <unordered_map>
 #include <vector>
 
@@ -86,14 +89,26 @@ class CorrespondenceGraph {
   std::unordered_map<image_pair_t, point2D_t> NumCorrespondencesBetweenImages()
       const;
 
+  // Estimate the heap memory in bytes allocated by the correspondence graph.
+  size_t MemoryUsage() const;
+
   // Finalize the database manager.
   //
   // - Calculates the number of observations per image by counting the number
   //   of image points that have at least one correspondence.
   // - Deletes images without observations, as they are useless for SfM.
-  // - Shrinks the correspondence vectors to their size to save memory.
+  // - Flattens the correspondences of all images into one contiguous array
+  //   and the image pairs into a sorted table to save memory and improve
+  //   the memory locality of lookups.
   void Finalize();
 
+  // Write/read the finalized correspondence graph in binary format, such that
+  // it does not have to be rebuilt from the matches in the database, e.g., on
+  // repeated runs over the same database. Read returns false if the stream
+  // does not contain a valid correspondence graph.
+  void Write(std::ostream* stream) const;
+  bool Read(std::istream* stream);
+
   // Add new image to the correspondence graph.
   void AddImage(image_t image_id, size_t num_points2D);
 
@@ -105,6 +120,15 @@ class CorrespondenceGraph {
                           image_t image_id2,
                           const FeatureMatches& matches);
 
+  // Add correspondences between many image pairs using multiple threads. The
+  // matches are validated per image pair in parallel and each thread then only
+  // inserts the correspondences of its own shard of images, with the same
+  // result as calling the above function for each image pair in order.
+  void AddCorrespondences(
+      const std::vector<std::pair<image_t, image_t>>& image_pairs,
+      const std::vector<FeatureMatches>& matches,
+      int num_threads = -1);
+
   // Find range of correspondences of an image observation to all other images.
   CorrespondenceRange FindCorrespondences(image_t image_id,
                                           point2D_t point2D_idx) const;
@@ -152,12 +176,13 @@ class CorrespondenceGraph {
     // Correspondences to other images per image point.
     // Added correspondences before Finalize().
     std::vector<std::vector<Correspondence>> corrs;
-    // Flattened correspondences after Finalize().
-    std::vector<Correspondence> flat_corrs;
-    // For each point, determines the beginning of the correspondences in the
-    // flat_corrs vector. The end of point i is determined by the beginning of
+    // Beginning of the correspondences of this image in the flat_corrs_
+    // vector of all images after Finalize().
+    size_t flat_corrs_beg = 0;
+    // For each point, determines the beginning of its correspondences relative
+    // to flat_corrs_beg. The end of point i is determined by the beginning of
     // the next point. The length of this vector is num_points2D + 1, where the
-    // last element is equivalent to the size of flat_corrs.
+    // last element is equivalent to the number of correspondences of the image.
     std::vector<point2D_t> flat_corr_begs;
   };
 
@@ -167,8 +192,13 @@ class CorrespondenceGraph {
   };
 
   bool finalized_ = false;
-  std::unordered_map<image_t, Image> images_;
+  DenseIdMap<image_t, Image> images_;
+  // Image pairs with added correspondences before Finalize().
   std::unordered_map<image_pair_t, ImagePair> image_pairs_;
+  // Image pairs sorted by their identifier after Finalize().
+  std::vector<std::pair<image_pair_t, ImagePair>> sorted_image_pairs_;
+  // Flattened correspondences of all images after Finalize().
+  std::vector<Correspondence> flat_corrs_;
 };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -178,7 +208,7 @@ class CorrespondenceGraph {
 size_t CorrespondenceGraph::NumImages() const { return images_.size(); }
 
 size_t CorrespondenceGraph::NumImagePairs() const {
-  return image_pairs_.size();
+  return finalized_ ? sorted_image_pairs_.size() : image_pairs_.size();
 }
 
 bool CorrespondenceGraph::ExistsImage(const image_t image_id) const {
@@ -199,6 +229,18 @@ point2D_t CorrespondenceGraph::NumCorrespondencesBetweenImages(
     const image_t image_id1, const image_t image_id2) const {
   const image_pair_t pair_id =
       Database::ImagePairToPairId(image_id1, image_id2);
+  if (finalized_) {
+    const auto it = std::lower_bound(
+        sorted_image_pairs_.begin(),
+        sorted_image_pairs_.end(),
+        pair_id,
+        [](const std::pair<image_pair_t, ImagePair>& image_pair,
+           const image_pair_t pair_id) { return image_pair.first < pair_id; });
+    if (it == sorted_image_pairs_.end() || it->first != pair_id) {
+      return 0;
+    }
+    return it->second.num_correspondences;
+  }
   const auto it = image_pairs_.find(pair_id);
   if (it == image_pairs_.end()) {
     return 0;
@@ -29,6 +29,8 @@
 
 #include "colmap/scene/correspondence_graph.h"
 
+#include <sstream>
+
 #include <gtest/gtest.h>
 
 namespace colmap {
@@ -236,6 +238,100 @@ TEST(CorrespondenceGraph, ThreeView) {
             2);
 }
 
+TEST(CorrespondenceGraph, AddCorrespondencesParallel) {
+  const std::vector<std::pair<image_t, image_t>> image_pairs = {
+      {0, 1}, {0, 2}, {2, 1}, {3, 3}, {1, 3}};
+  const std::vector<FeatureMatches> matches = {{{0, 0}, {1, 1}, {1, 2}},
+                                               {{0, 0}, {20, 1}},
+                                               {{0, 1}, {3, 3}},
+                                               {{0, 1}},
+                                               {}};
+  CorrespondenceGraph correspondence_graph;
+  CorrespondenceGraph parallel_correspondence_graph;
+  for (const image_t image_id : {0, 1, 2, 3}) {
+    correspondence_graph.AddImage(image_id, 10);
+    parallel_correspondence_graph.AddImage(image_id, 10);
+  }
+  for (size_t i = 0; i < image_pairs.size(); ++i) {
+    correspondence_graph.AddCorrespondences(
+        image_pairs[i].first, image_pairs[i].second, matches[i]);
+  }
+  parallel_correspondence_graph.AddCorrespondences(
+      image_pairs, matches, /*num_threads=*/3);
+  correspondence_graph.Finalize();
+  parallel_correspondence_graph.Finalize();
+
+  EXPECT_EQ(parallel_correspondence_graph.NumImages(),
+            correspondence_graph.NumImages());
+  EXPECT_EQ(parallel_correspondence_graph.NumImagePairs(),
+            correspondence_graph.NumImagePairs());
+  EXPECT_EQ(parallel_correspondence_graph.NumCorrespondencesBetweenImages(),
+            correspondence_graph.NumCorrespondencesBetweenImages());
+  for (const image_t image_id : {0, 1, 2}) {
+    EXPECT_EQ(parallel_correspondence_graph.NumObservationsForImage(image_id),
+              correspondence_graph.NumObservationsForImage(image_id));
+    EXPECT_EQ(
+        parallel_correspondence_graph.NumCorrespondencesForImage(image_id),
+        correspondence_graph.NumCorrespondencesForImage(image_id));
+    for (point2D_t point2D_idx = 0; point2D_idx < 10; ++point2D_idx) {
+      std::vector<CorrespondenceGraph::Correspondence> corrs;
+      std::vector<CorrespondenceGraph::Correspondence> parallel_corrs;
+      correspondence_graph.ExtractCorrespondences(
+          image_id, point2D_idx, &corrs);
+      parallel_correspondence_graph.ExtractCorrespondences(
+          image_id, point2D_idx, &parallel_corrs);
+      ASSERT_EQ(parallel_corrs.size(), corrs.size());
+      for (size_t i = 0; i < corrs.size(); ++i) {
+        EXPECT_EQ(parallel_corrs[i].image_id, corrs[i].image_id);
+        EXPECT_EQ(parallel_corrs[i].point2D_idx, corrs[i].point2D_idx);
+      }
+    }
+  }
+}
+
+TEST(CorrespondenceGraph, ReadWrite) {
+  CorrespondenceGraph correspondence_graph;
+  correspondence_graph.AddImage(0, 10);
+  correspondence_graph.AddImage(1, 10);
+  correspondence_graph.AddImage(2, 10);
+  correspondence_graph.AddImage(3, 10);
+  correspondence_graph.AddCorrespondences(0, 1, {{0, 0}});
+  correspondence_graph.AddCorrespondences(2, 0, {{1, 0}, {3, 4}});
+  correspondence_graph.Finalize();
+
+  std::stringstream stream;
+  correspondence_graph.Write(&stream);
+  CorrespondenceGraph read_correspondence_graph;
+  EXPECT_TRUE(read_correspondence_graph.Read(&stream));
+
+  EXPECT_EQ(read_correspondence_graph.NumImages(), 3);
+  EXPECT_FALSE(read_correspondence_graph.ExistsImage(3));
+  EXPECT_EQ(read_correspondence_graph.NumImagePairs(), 2);
+  EXPECT_EQ(read_correspondence_graph.NumCorrespondencesBetweenImages(),
+            correspondence_graph.NumCorrespondencesBetweenImages());
+  EXPECT_EQ(read_correspondence_graph.NumCorrespondencesBetweenImages(0, 2), 2);
+  for (const image_t image_id : {0, 1, 2}) {
+    EXPECT_EQ(read_correspondence_graph.NumObservationsForImage(image_id),
+              correspondence_graph.NumObservationsForImage(image_id));
+    EXPECT_EQ(read_correspondence_graph.NumCorrespondencesForImage(image_id),
+              correspondence_graph.NumCorrespondencesForImage(image_id));
+  }
+  const FeatureMatches matches =
+      read_correspondence_graph.FindCorrespondencesBetweenImages(2, 0);
+  ASSERT_EQ(matches.size(), 2);
+  EXPECT_EQ(matches[0].point2D_idx1, 1);
+  EXPECT_EQ(matches[0].point2D_idx2, 0);
+  EXPECT_EQ(matches[1].point2D_idx1, 3);
+  EXPECT_EQ(matches[1].point2D_idx2, 4);
+  std::vector<CorrespondenceGraph::Correspondence> corrs;
+  read_correspondence_graph.ExtractCorrespondences(0, 0, &corrs);
+  EXPECT_EQ(corrs.size(), 2);
+
+  std::stringstream invalid_stream("invalid");
+  CorrespondenceGraph invalid_correspondence_graph;
+  EXPECT_FALSE(invalid_correspondence_graph.Read(&invalid_stream));
+}
+
 TEST(CorrespondenceGraph, OutOfBounds) {
   CorrespondenceGraph correspondence_graph;
   correspondence_graph.AddImage(0, 10);
@@ -278,5 +374,25 @@ TEST(CorrespondenceGraph, Duplicate) {
             3);
 }
 
+TEST(CorrespondenceGraph, MemoryUsage) {
+  CorrespondenceGraph correspondence_graph;
+  const size_t empty_memory_usage = correspondence_graph.MemoryUsage();
+  correspondence_graph.AddImage(0, 10);
+  correspondence_graph.AddImage(1, 10);
+  FeatureMatches matches(5);
+  for (size_t i = 0; i < matches.size(); ++i) {
+    matches[i].point2D_idx1 = i;
+    matches[i].point2D_idx2 = i;
+  }
+  correspondence_graph.AddCorrespondences(0, 1, matches);
+  EXPECT_GT(correspondence_graph.MemoryUsage(),
+            empty_memory_usage + 2 * matches.size() *
+                                     sizeof(CorrespondenceGraph::Correspondence));
+  correspondence_graph.Finalize();
+  EXPECT_GE(correspondence_graph.MemoryUsage(),
+            empty_memory_usage + 2 * matches.size() *
+                                     sizeof(CorrespondenceGraph::Correspondence));
+}
+
 }  // namespace
 }  // namespace colmap
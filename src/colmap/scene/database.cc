@@ -33,8 +33,10 @@
 #include "colmap/util/string.h"
 #include "colmap/util/version.h"
 
+#include <algorithm>
 #include <fstream>
 #include <memory>
+#include <type_traits>
 
 namespace colmap {
 namespace {
@@ -64,32 +66,6 @@ FeatureKeypointsBlob FeatureKeypointsToBlob(const FeatureKeypoints& keypoints) {
   return blob;
 }
 
-FeatureKeypoints FeatureKeypointsFromBlob(const FeatureKeypointsBlob& blob) {
-  FeatureKeypoints keypoints(static_cast<size_t>(blob.rows()));
-  if (blob.cols() == 2) {
-    for (FeatureKeypointsBlob::Index i = 0; i < blob.rows(); ++i) {
-      keypoints[i] = FeatureKeypoint(blob(i, 0), blob(i, 1));
-    }
-  } else if (blob.cols() == 4) {
-    for (FeatureKeypointsBlob::Index i = 0; i < blob.rows(); ++i) {
-      keypoints[i] =
-          FeatureKeypoint(blob(i, 0), blob(i, 1), blob(i, 2), blob(i, 3));
-    }
-  } else if (blob.cols() == 6) {
-    for (FeatureKeypointsBlob::Index i = 0; i < blob.rows(); ++i) {
-      keypoints[i] = FeatureKeypoint(blob(i, 0),
-                                     blob(i, 1),
-                                     blob(i, 2),
-                                     blob(i, 3),
-                                     blob(i, 4),
-                                     blob(i, 5));
-    }
-  } else {
-    LOG(FATAL) << "Keypoint format not supported";
-  }
-  return keypoints;
-}
-
 FeatureMatchesBlob FeatureMatchesToBlob(const FeatureMatches& matches) {
   const FeatureMatchesBlob::Index kNumCols = 2;
   FeatureMatchesBlob blob(matches.size(), kNumCols);
@@ -110,6 +86,173 @@ FeatureMatches FeatureMatchesFromBlob(const FeatureMatchesBlob& blob) {
   return matches;
 }
 
+// Value of the `cols` column, which marks the compact encoding of the inlier
+// matches of two-view geometries, while the `rows` column still stores the
+// number of matches. The matches are sorted by `point2D_idx1`. The blob starts
+// with a header word with the first `point2D_idx1` in the lower 32 bits and
+// the bit widths of the following two packed sequences in the next bytes: the
+// differences between consecutive `point2D_idx1` and all `point2D_idx2`.
+const size_t kCompactFeatureMatchesCols = 0;
+
+int NumBitsOfValue(const uint32_t value) {
+  int num_bits = 0;
+  while (num_bits < 32 && (value >> num_bits) != 0) {
+    num_bits += 1;
+  }
+  return num_bits;
+}
+
+void PackBits(const std::vector<uint32_t>& values,
+              const int num_bits,
+              size_t bit_offset,
+              uint64_t* words) {
+  if (num_bits == 0) {
+    return;
+  }
+  for (const uint32_t value : values) {
+    const size_t word_idx = bit_offset / 64;
+    const int shift = bit_offset % 64;
+    words[word_idx] |= static_cast<uint64_t>(value) << shift;
+    if (shift + num_bits > 64) {
+      words[word_idx + 1] |= static_cast<uint64_t>(value) >> (64 - shift);
+    }
+    bit_offset += num_bits;
+  }
+}
+
+// The loop is free of branches, such that the compiler can vectorize it. The
+// words must be padded by one word after the last packed value.
+void UnpackBits(const uint64_t* words,
+                const size_t bit_offset,
+                const int num_bits,
+                const size_t num_values,
+                uint32_t* values) {
+  const uint64_t mask =
+      (num_bits == 0) ? 0 : (~static_cast<uint64_t>(0) >> (64 - num_bits));
+  for (size_t i = 0; i < num_values; ++i) {
+    const size_t bit = bit_offset + i * num_bits;
+    const size_t word_idx = bit / 64;
+    const int shift = bit % 64;
+    values[i] = static_cast<uint32_t>(
+        ((words[word_idx] >> shift) |
+         ((words[word_idx + 1] << 1) << (63 - shift))) &
+        mask);
+  }
+}
+
+std::vector<uint64_t> FeatureMatchesToCompactBlob(FeatureMatches matches) {
+  std::sort(matches.begin(),
+            matches.end(),
+            [](const FeatureMatch& match1, const FeatureMatch& match2) {
+              return std::make_pair(match1.point2D_idx1, match1.point2D_idx2) <
+                     std::make_pair(match2.point2D_idx1, match2.point2D_idx2);
+            });
+
+  const size_t num_matches = matches.size();
+  std::vector<uint32_t> idx1_deltas(num_matches > 0 ? num_matches - 1 : 0);
+  std::vector<uint32_t> idxs2(num_matches);
+  uint32_t max_idx1_delta = 0;
+  uint32_t max_idx2 = 0;
+  for (size_t i = 0; i < num_matches; ++i) {
+    if (i > 0) {
+      idx1_deltas[i - 1] =
+          matches[i].point2D_idx1 - matches[i - 1].point2D_idx1;
+      max_idx1_delta = std::max(max_idx1_delta, idx1_deltas[i - 1]);
+    }
+    idxs2[i] = matches[i].point2D_idx2;
+    max_idx2 = std::max(max_idx2, idxs2[i]);
+  }
+
+  const int num_bits1 = NumBitsOfValue(max_idx1_delta);
+  const int num_bits2 = NumBitsOfValue(max_idx2);
+  const size_t num_bits =
+      idx1_deltas.size() * num_bits1 + idxs2.size() * num_bits2;
+
+  std::vector<uint64_t> blob(1 + (num_bits + 63) / 64, 0);
+  blob[0] = static_cast<uint64_t>(num_matches > 0 ? matches[0].point2D_idx1
+                                                  : 0) |
+            (static_cast<uint64_t>(num_bits1) << 32) |
+            (static_cast<uint64_t>(num_bits2) << 40);
+  PackBits(idx1_deltas, num_bits1, 0, blob.data() + 1);
+  PackBits(idxs2, num_bits2, idx1_deltas.size() * num_bits1, blob.data() + 1);
+  return blob;
+}
+
+FeatureMatches FeatureMatchesFromCompactBlob(const void* data,
+                                             const size_t num_bytes,
+                                             const size_t num_matches) {
+  CHECK_GE(num_bytes, sizeof(uint64_t));
+  CHECK_EQ(num_bytes % sizeof(uint64_t), 0);
+
+  // Copy into aligned and padded words, since the SQLite blob is neither.
+  const size_t num_words = num_bytes / sizeof(uint64_t);
+  std::vector<uint64_t> words(num_words + 1, 0);
+  memcpy(words.data(), data, num_bytes);
+
+  const uint32_t first_idx1 = static_cast<uint32_t>(words[0]);
+  const int num_bits1 = static_cast<int>((words[0] >> 32) & 0xFF);
+  const int num_bits2 = static_cast<int>((words[0] >> 40) & 0xFF);
+  CHECK_LE(num_bits1, 32);
+  CHECK_LE(num_bits2, 32);
+
+  const size_t num_deltas = num_matches > 0 ? num_matches - 1 : 0;
+  const size_t num_bits = num_deltas * num_bits1 + num_matches * num_bits2;
+  CHECK_EQ(num_words, 1 + (num_bits + 63) / 64);
+
+  std::vector<uint32_t> idxs(num_deltas + num_matches);
+  UnpackBits(words.data() + 1, 0, num_bits1, num_deltas, idxs.data());
+  UnpackBits(words.data() + 1,
+             num_deltas * num_bits1,
+             num_bits2,
+             num_matches,
+             idxs.data() + num_deltas);
+
+  FeatureMatches matches(num_matches);
+  point2D_t point2D_idx1 = first_idx1;
+  for (size_t i = 0; i < num_matches; ++i) {
+    if (i > 0) {
+      point2D_idx1 += idxs[i - 1];
+    }
+    matches[i].point2D_idx1 = point2D_idx1;
+    matches[i].point2D_idx2 = idxs[num_deltas + i];
+  }
+  return matches;
+}
+
+// Read the inlier matches of a two-view geometry in either encoding directly
+// from the blob in the SQLite result row.
+FeatureMatches ReadInlierMatchesBlob(sqlite3_stmt* sql_stmt,
+                                     const int rc,
+                                     const int col) {
+  CHECK_GE(col, 0);
+
+  if (rc != SQLITE_ROW) {
+    return FeatureMatches();
+  }
+
+  const size_t rows =
+      static_cast<size_t>(sqlite3_column_int64(sql_stmt, col + 0));
+  const size_t cols =
+      static_cast<size_t>(sqlite3_column_int64(sql_stmt, col + 1));
+  const void* data = sqlite3_column_blob(sql_stmt, col + 2);
+  const size_t num_bytes =
+      static_cast<size_t>(sqlite3_column_bytes(sql_stmt, col + 2));
+
+  if (cols == kCompactFeatureMatchesCols) {
+    return FeatureMatchesFromCompactBlob(data, num_bytes, rows);
+  }
+
+  CHECK_EQ(cols, 2);
+  CHECK_EQ(rows * cols * sizeof(point2D_t), num_bytes);
+  const point2D_t* idxs = static_cast<const point2D_t*>(data);
+  FeatureMatches matches(rows);
+  for (size_t i = 0; i < rows; ++i, idxs += 2) {
+    matches[i].point2D_idx1 = idxs[0];
+    matches[i].point2D_idx2 = idxs[1];
+  }
+  return matches;
+}
+
 template <typename MatrixType>
 MatrixType ReadStaticMatrixBlob(sqlite3_stmt* sql_stmt,
                                 const int rc,
@@ -176,6 +319,52 @@ MatrixType ReadDynamicMatrixBlob(sqlite3_stmt* sql_stmt,
   return matrix;
 }
 
+// Read the keypoints directly from the blob in the SQLite result row, without
+// first copying the blob into an intermediate matrix. Keypoints with full
+// affine shape have the same memory layout as the blob and are copied at once.
+FeatureKeypoints ReadFeatureKeypointsBlob(sqlite3_stmt* sql_stmt,
+                                          const int rc,
+                                          const int col) {
+  CHECK_GE(col, 0);
+
+  if (rc != SQLITE_ROW) {
+    return FeatureKeypoints();
+  }
+
+  const size_t rows =
+      static_cast<size_t>(sqlite3_column_int64(sql_stmt, col + 0));
+  const size_t cols =
+      static_cast<size_t>(sqlite3_column_int64(sql_stmt, col + 1));
+
+  const float* data =
+      static_cast<const float*>(sqlite3_column_blob(sql_stmt, col + 2));
+  const size_t num_bytes =
+      static_cast<size_t>(sqlite3_column_bytes(sql_stmt, col + 2));
+  CHECK_EQ(rows * cols * sizeof(float), num_bytes);
+
+  FeatureKeypoints keypoints(rows);
+  if (cols == 2) {
+    for (size_t i = 0; i < rows; ++i, data += 2) {
+      keypoints[i] = FeatureKeypoint(data[0], data[1]);
+    }
+  } else if (cols == 4) {
+    for (size_t i = 0; i < rows; ++i, data += 4) {
+      keypoints[i] = FeatureKeypoint(data[0], data[1], data[2], data[3]);
+    }
+  } else if (cols == 6) {
+    static_assert(sizeof(FeatureKeypoint) == 6 * sizeof(float) &&
+                      std::is_trivially_copyable<FeatureKeypoint>::value,
+                  "FeatureKeypoint must have the memory layout of the blob");
+    if (num_bytes > 0) {
+      memcpy(keypoints.data(), data, num_bytes);
+    }
+  } else {
+    LOG(FATAL) << "Keypoint format not supported";
+  }
+
+  return keypoints;
+}
+
 template <typename MatrixType>
 void WriteStaticMatrixBlob(sqlite3_stmt* sql_stmt,
                            const MatrixType& matrix,
@@ -274,6 +463,9 @@ Image ReadImageRow(sqlite3_stmt* sql_stmt, int rc) {
   return image;
 }
 
+// The codebook table holds a single row with this identifier.
+const sqlite3_int64 kDescriptorCodebookId = 1;
+
 }  // namespace
 
 const size_t Database::kMaxNumImages =
@@ -285,11 +477,14 @@ std::mutex Database::update_schema_mutex_;
 
 Database::Database() : database_(nullptr) {}
 
-Database::Database(const std::string& path) : Database() { Open(path); }
+Database::Database(const std::string& path, const bool read_only)
+    : Database() {
+  Open(path, read_only);
+}
 
 Database::~Database() { Close(); }
 
-void Database::Open(const std::string& path) {
+void Database::Open(const std::string& path, const bool read_only) {
   Close();
 
   // SQLITE_OPEN_NOMUTEX specifies that the connection should not have a
@@ -299,18 +494,27 @@ void Database::Open(const std::string& path) {
   SQLITE3_CALL(sqlite3_open_v2(
       path.c_str(),
       &database_,
-      SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_NOMUTEX,
+      (read_only ? SQLITE_OPEN_READONLY
+                 : SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE) |
+          SQLITE_OPEN_NOMUTEX,
       nullptr));
 
+  // Store temporary tables and indices in memory
+  SQLITE3_EXEC(database_, "PRAGMA temp_store=MEMORY", nullptr);
+
+  if (read_only) {
+    // The tables must have been created and updated by a writer before.
+    PrepareSQLStatements();
+    return;
+  }
+
   // Don't wait for the operating system to write the changes to disk
   SQLITE3_EXEC(database_, "PRAGMA synchronous=OFF", nullptr);
 
-  // Use faster journaling mode
+  // Use faster journaling mode, which also lets readers proceed concurrently
+  // with a writer.
   SQLITE3_EXEC(database_, "PRAGMA journal_mode=WAL", nullptr);
 
-  // Store temporary tables and indices in memory
-  SQLITE3_EXEC(database_, "PRAGMA temp_store=MEMORY", nullptr);
-
   // Disabled by default
   SQLITE3_EXEC(database_, "PRAGMA foreign_keys=ON", nullptr);
 
@@ -325,15 +529,23 @@ void Database::Open(const std::string& path) {
 void Database::Close() {
   if (database_ != nullptr) {
     FinalizeSQLStatements();
-    if (database_cleared_) {
+    // Rewriting large databases is slow, so only vacuum if the cleared pages
+    // were not already released by the auto vacuum.
+    if (database_cleared_ && CountFreePages() > 0) {
       SQLITE3_EXEC(database_, "VACUUM", nullptr);
-      database_cleared_ = false;
     }
+    database_cleared_ = false;
     sqlite3_close_v2(database_);
     database_ = nullptr;
   }
 }
 
+std::string Database::Path() const {
+  CHECK_NOTNULL(database_);
+  const char* path = sqlite3_db_filename(database_, "main");
+  return path == nullptr ? "" : path;
+}
+
 bool Database::ExistsCamera(const camera_t camera_id) const {
   return ExistsRowId(sql_stmt_exists_camera_, camera_id);
 }
@@ -354,6 +566,15 @@ bool Database::ExistsDescriptors(const image_t image_id) const {
   return ExistsRowId(sql_stmt_exists_descriptors_, image_id);
 }
 
+bool Database::ExistsDescriptorCodes(const image_t image_id) const {
+  return ExistsRowId(sql_stmt_exists_descriptor_codes_, image_id);
+}
+
+bool Database::ExistsDescriptorCodebook() const {
+  return ExistsRowId(sql_stmt_exists_descriptor_codebook_,
+                     kDescriptorCodebookId);
+}
+
 bool Database::ExistsMatches(const image_t image_id1,
                              const image_t image_id2) const {
   return ExistsRowId(sql_stmt_exists_matches_,
@@ -480,16 +701,35 @@ std::vector<Image> Database::ReadAllImages() const {
   return images;
 }
 
+std::vector<image_t> Database::ReadImageIdsWithFeatures() const {
+  const std::string sql =
+      "SELECT keypoints.image_id FROM keypoints INNER JOIN descriptors ON "
+      "keypoints.image_id = descriptors.image_id;";
+
+  sqlite3_stmt* sql_stmt;
+  SQLITE3_CALL(sqlite3_prepare_v2(database_, sql.c_str(), -1, &sql_stmt, 0));
+
+  std::vector<image_t> image_ids;
+  while (SQLITE3_CALL(sqlite3_step(sql_stmt)) == SQLITE_ROW) {
+    image_ids.push_back(
+        static_cast<image_t>(sqlite3_column_int64(sql_stmt, 0)));
+  }
+
+  SQLITE3_CALL(sqlite3_finalize(sql_stmt));
+
+  return image_ids;
+}
+
 FeatureKeypoints Database::ReadKeypoints(const image_t image_id) const {
   SQLITE3_CALL(sqlite3_bind_int64(sql_stmt_read_keypoints_, 1, image_id));
 
   const int rc = SQLITE3_CALL(sqlite3_step(sql_stmt_read_keypoints_));
-  const FeatureKeypointsBlob blob = ReadDynamicMatrixBlob<FeatureKeypointsBlob>(
-      sql_stmt_read_keypoints_, rc, 0);
+  FeatureKeypoints keypoints =
+      ReadFeatureKeypointsBlob(sql_stmt_read_keypoints_, rc, 0);
 
   SQLITE3_CALL(sqlite3_reset(sql_stmt_read_keypoints_));
 
-  return FeatureKeypointsFromBlob(blob);
+  return keypoints;
 }
 
 FeatureDescriptors Database::ReadDescriptors(const image_t image_id) const {
@@ -504,6 +744,33 @@ FeatureDescriptors Database::ReadDescriptors(const image_t image_id) const {
   return descriptors;
 }
 
+FeatureDescriptors Database::ReadDescriptorCodes(const image_t image_id) const {
+  SQLITE3_CALL(
+      sqlite3_bind_int64(sql_stmt_read_descriptor_codes_, 1, image_id));
+
+  const int rc = SQLITE3_CALL(sqlite3_step(sql_stmt_read_descriptor_codes_));
+  FeatureDescriptors codes = ReadDynamicMatrixBlob<FeatureDescriptors>(
+      sql_stmt_read_descriptor_codes_, rc, 0);
+
+  SQLITE3_CALL(sqlite3_reset(sql_stmt_read_descriptor_codes_));
+
+  return codes;
+}
+
+FeatureDescriptors Database::ReadDescriptorCodebook() const {
+  SQLITE3_CALL(sqlite3_bind_int64(
+      sql_stmt_read_descriptor_codebook_, 1, kDescriptorCodebookId));
+
+  const int rc =
+      SQLITE3_CALL(sqlite3_step(sql_stmt_read_descriptor_codebook_));
+  FeatureDescriptors codebook = ReadDynamicMatrixBlob<FeatureDescriptors>(
+      sql_stmt_read_descriptor_codebook_, rc, 0);
+
+  SQLITE3_CALL(sqlite3_reset(sql_stmt_read_descriptor_codebook_));
+
+  return codebook;
+}
+
 FeatureMatches Database::ReadMatches(image_t image_id1,
                                      image_t image_id2) const {
   const image_pair_t pair_id = ImagePairToPairId(image_id1, image_id2);
@@ -551,8 +818,8 @@ TwoViewGeometry Database::ReadTwoViewGeometry(const image_t image_id1,
 
   TwoViewGeometry two_view_geometry;
 
-  FeatureMatchesBlob blob = ReadDynamicMatrixBlob<FeatureMatchesBlob>(
-      sql_stmt_read_two_view_geometry_, rc, 0);
+  two_view_geometry.inlier_matches =
+      ReadInlierMatchesBlob(sql_stmt_read_two_view_geometry_, rc, 0);
 
   two_view_geometry.config = static_cast<int>(
       sqlite3_column_int64(sql_stmt_read_two_view_geometry_, 3));
@@ -570,10 +837,13 @@ TwoViewGeometry Database::ReadTwoViewGeometry(const image_t image_id1,
   two_view_geometry.cam2_from_cam1.translation =
       ReadStaticMatrixBlob<Eigen::Vector3d>(
           sql_stmt_read_two_view_geometry_, rc, 8);
+  if (rc == SQLITE_ROW) {
+    two_view_geometry.tri_angle =
+        sqlite3_column_double(sql_stmt_read_two_view_geometry_, 9);
+  }
 
   SQLITE3_CALL(sqlite3_reset(sql_stmt_read_two_view_geometry_));
 
-  two_view_geometry.inlier_matches = FeatureMatchesFromBlob(blob);
   two_view_geometry.F.transposeInPlace();
   two_view_geometry.E.transposeInPlace();
   two_view_geometry.H.transposeInPlace();
@@ -588,6 +858,10 @@ TwoViewGeometry Database::ReadTwoViewGeometry(const image_t image_id1,
 void Database::ReadTwoViewGeometries(
     std::vector<image_pair_t>* image_pair_ids,
     std::vector<TwoViewGeometry>* two_view_geometries) const {
+  const size_t num_verified_image_pairs = NumVerifiedImagePairs();
+  image_pair_ids->reserve(num_verified_image_pairs);
+  two_view_geometries->reserve(num_verified_image_pairs);
+
   int rc;
   while ((rc = SQLITE3_CALL(sqlite3_step(
               sql_stmt_read_two_view_geometries_))) == SQLITE_ROW) {
@@ -597,9 +871,8 @@ void Database::ReadTwoViewGeometries(
 
     TwoViewGeometry two_view_geometry;
 
-    const FeatureMatchesBlob blob = ReadDynamicMatrixBlob<FeatureMatchesBlob>(
-        sql_stmt_read_two_view_geometries_, rc, 1);
-    two_view_geometry.inlier_matches = FeatureMatchesFromBlob(blob);
+    two_view_geometry.inlier_matches =
+        ReadInlierMatchesBlob(sql_stmt_read_two_view_geometries_, rc, 1);
 
     two_view_geometry.config = static_cast<int>(
         sqlite3_column_int64(sql_stmt_read_two_view_geometries_, 4));
@@ -617,17 +890,84 @@ void Database::ReadTwoViewGeometries(
     two_view_geometry.cam2_from_cam1.translation =
         ReadStaticMatrixBlob<Eigen::Vector3d>(
             sql_stmt_read_two_view_geometries_, rc, 9);
+    two_view_geometry.tri_angle =
+        sqlite3_column_double(sql_stmt_read_two_view_geometries_, 10);
 
     two_view_geometry.F.transposeInPlace();
     two_view_geometry.E.transposeInPlace();
     two_view_geometry.H.transposeInPlace();
 
-    two_view_geometries->push_back(two_view_geometry);
+    two_view_geometries->push_back(std::move(two_view_geometry));
   }
 
   SQLITE3_CALL(sqlite3_reset(sql_stmt_read_two_view_geometries_));
 }
 
+void Database::ReadTwoViewGeometryPoses(
+    std::vector<image_pair_t>* image_pair_ids,
+    std::vector<TwoViewGeometry>* two_view_geometries) const {
+  int rc;
+  while ((rc = SQLITE3_CALL(sqlite3_step(
+              sql_stmt_read_two_view_geometry_poses_))) == SQLITE_ROW) {
+    image_pair_ids->push_back(static_cast<image_pair_t>(
+        sqlite3_column_int64(sql_stmt_read_two_view_geometry_poses_, 0)));
+
+    TwoViewGeometry two_view_geometry;
+    two_view_geometry.config = static_cast<int>(
+        sqlite3_column_int64(sql_stmt_read_two_view_geometry_poses_, 1));
+    const Eigen::Vector4d quat_wxyz = ReadStaticMatrixBlob<Eigen::Vector4d>(
+        sql_stmt_read_two_view_geometry_poses_, rc, 2);
+    two_view_geometry.cam2_from_cam1.rotation = Eigen::Quaterniond(
+        quat_wxyz(0), quat_wxyz(1), quat_wxyz(2), quat_wxyz(3));
+    two_view_geometry.cam2_from_cam1.translation =
+        ReadStaticMatrixBlob<Eigen::Vector3d>(
+            sql_stmt_read_two_view_geometry_poses_, rc, 3);
+    two_view_geometry.tri_angle =
+        sqlite3_column_double(sql_stmt_read_two_view_geometry_poses_, 4);
+
+    two_view_geometries->push_back(std::move(two_view_geometry));
+  }
+
+  SQLITE3_CALL(sqlite3_reset(sql_stmt_read_two_view_geometry_poses_));
+}
+
+std::vector<std::pair<std::string, Camera>> Database::ReadAllBestFitCameras()
+    const {
+  std::vector<std::pair<std::string, Camera>> cameras;
+
+  while (SQLITE3_CALL(sqlite3_step(sql_stmt_read_best_fit_cameras_)) ==
+         SQLITE_ROW) {
+    const std::string key(
+        static_cast<const char*>(
+            sqlite3_column_blob(sql_stmt_read_best_fit_cameras_, 0)),
+        static_cast<size_t>(
+            sqlite3_column_bytes(sql_stmt_read_best_fit_cameras_, 0)));
+
+    Camera camera;
+    camera.model_id = static_cast<CameraModelId>(
+        sqlite3_column_int64(sql_stmt_read_best_fit_cameras_, 1));
+    camera.width = static_cast<size_t>(
+        sqlite3_column_int64(sql_stmt_read_best_fit_cameras_, 2));
+    camera.height = static_cast<size_t>(
+        sqlite3_column_int64(sql_stmt_read_best_fit_cameras_, 3));
+
+    const size_t num_params_bytes = static_cast<size_t>(
+        sqlite3_column_bytes(sql_stmt_read_best_fit_cameras_, 4));
+    const size_t num_params = num_params_bytes / sizeof(double);
+    CHECK_EQ(num_params, CameraModelNumParams(camera.model_id));
+    camera.params.resize(num_params, 0.);
+    memcpy(camera.params.data(),
+           sqlite3_column_blob(sql_stmt_read_best_fit_cameras_, 4),
+           num_params_bytes);
+
+    cameras.emplace_back(key, std::move(camera));
+  }
+
+  SQLITE3_CALL(sqlite3_reset(sql_stmt_read_best_fit_cameras_));
+
+  return cameras;
+}
+
 void Database::ReadTwoViewGeometryNumInliers(
     std::vector<std::pair<image_t, image_t>>* image_pairs,
     std::vector<int>* num_inliers) const {
@@ -761,6 +1101,26 @@ void Database::WriteDescriptors(const image_t image_id,
   SQLITE3_CALL(sqlite3_reset(sql_stmt_write_descriptors_));
 }
 
+void Database::WriteDescriptorCodes(const image_t image_id,
+                                    const FeatureDescriptors& codes) const {
+  SQLITE3_CALL(
+      sqlite3_bind_int64(sql_stmt_write_descriptor_codes_, 1, image_id));
+  WriteDynamicMatrixBlob(sql_stmt_write_descriptor_codes_, codes, 2);
+
+  SQLITE3_CALL(sqlite3_step(sql_stmt_write_descriptor_codes_));
+  SQLITE3_CALL(sqlite3_reset(sql_stmt_write_descriptor_codes_));
+}
+
+void Database::WriteDescriptorCodebook(
+    const FeatureDescriptors& codebook) const {
+  SQLITE3_CALL(sqlite3_bind_int64(
+      sql_stmt_write_descriptor_codebook_, 1, kDescriptorCodebookId));
+  WriteDynamicMatrixBlob(sql_stmt_write_descriptor_codebook_, codebook, 2);
+
+  SQLITE3_CALL(sqlite3_step(sql_stmt_write_descriptor_codebook_));
+  SQLITE3_CALL(sqlite3_reset(sql_stmt_write_descriptor_codebook_));
+}
+
 void Database::WriteMatches(const image_t image_id1,
                             const image_t image_id2,
                             const FeatureMatches& matches) const {
@@ -799,9 +1159,27 @@ void Database::WriteTwoViewGeometry(
     two_view_geometry_ptr = swapped_two_view_geometry.get();
   }
 
-  const FeatureMatchesBlob inlier_matches =
-      FeatureMatchesToBlob(two_view_geometry_ptr->inlier_matches);
-  WriteDynamicMatrixBlob(sql_stmt_write_two_view_geometry_, inlier_matches, 2);
+  // The blobs must live until `sqlite3_step` is called on the statement.
+  const FeatureMatches& matches = two_view_geometry_ptr->inlier_matches;
+  FeatureMatchesBlob inlier_matches;
+  std::vector<uint64_t> compact_inlier_matches;
+  if (compact_inlier_matches_ && !matches.empty()) {
+    compact_inlier_matches = FeatureMatchesToCompactBlob(matches);
+    SQLITE3_CALL(sqlite3_bind_int64(
+        sql_stmt_write_two_view_geometry_, 2, matches.size()));
+    SQLITE3_CALL(sqlite3_bind_int64(
+        sql_stmt_write_two_view_geometry_, 3, kCompactFeatureMatchesCols));
+    SQLITE3_CALL(sqlite3_bind_blob(
+        sql_stmt_write_two_view_geometry_,
+        4,
+        reinterpret_cast<const char*>(compact_inlier_matches.data()),
+        static_cast<int>(compact_inlier_matches.size() * sizeof(uint64_t)),
+        SQLITE_STATIC));
+  } else {
+    inlier_matches = FeatureMatchesToBlob(matches);
+    WriteDynamicMatrixBlob(
+        sql_stmt_write_two_view_geometry_, inlier_matches, 2);
+  }
 
   SQLITE3_CALL(sqlite3_bind_int64(
       sql_stmt_write_two_view_geometry_, 5, two_view_geometry_ptr->config));
@@ -839,10 +1217,48 @@ void Database::WriteTwoViewGeometry(
         sql_stmt_write_two_view_geometry_, Eigen::MatrixXd(0, 0), 10);
   }
 
+  SQLITE3_CALL(
+      sqlite3_bind_double(sql_stmt_write_two_view_geometry_,
+                          11,
+                          two_view_geometry_ptr->inlier_matches.empty()
+                              ? -1
+                              : two_view_geometry_ptr->tri_angle));
+
   SQLITE3_CALL(sqlite3_step(sql_stmt_write_two_view_geometry_));
   SQLITE3_CALL(sqlite3_reset(sql_stmt_write_two_view_geometry_));
 }
 
+void Database::WriteBestFitCamera(const std::string& key,
+                                  const Camera& camera) const {
+  SQLITE3_CALL(sqlite3_bind_blob(sql_stmt_write_best_fit_camera_,
+                                 1,
+                                 key.data(),
+                                 static_cast<int>(key.size()),
+                                 SQLITE_STATIC));
+  SQLITE3_CALL(sqlite3_bind_int64(sql_stmt_write_best_fit_camera_,
+                                  2,
+                                  static_cast<sqlite3_int64>(camera.model_id)));
+  SQLITE3_CALL(sqlite3_bind_int64(sql_stmt_write_best_fit_camera_,
+                                  3,
+                                  static_cast<sqlite3_int64>(camera.width)));
+  SQLITE3_CALL(sqlite3_bind_int64(sql_stmt_write_best_fit_camera_,
+                                  4,
+                                  static_cast<sqlite3_int64>(camera.height)));
+  const size_t num_params_bytes = sizeof(double) * camera.params.size();
+  SQLITE3_CALL(sqlite3_bind_blob(sql_stmt_write_best_fit_camera_,
+                                 5,
+                                 camera.params.data(),
+                                 static_cast<int>(num_params_bytes),
+                                 SQLITE_STATIC));
+
+  SQLITE3_CALL(sqlite3_step(sql_stmt_write_best_fit_camera_));
+  SQLITE3_CALL(sqlite3_reset(sql_stmt_write_best_fit_camera_));
+}
+
+void Database::SetCompactInlierMatches(const bool compact_inlier_matches) {
+  compact_inlier_matches_ = compact_inlier_matches;
+}
+
 void Database::UpdateCamera(const Camera& camera) const {
   SQLITE3_CALL(sqlite3_bind_int64(
       sql_stmt_update_camera_, 1, static_cast<sqlite3_int64>(camera.model_id)));
@@ -934,6 +1350,7 @@ void Database::DeleteInlierMatches(const image_t image_id1,
 void Database::ClearAllTables() const {
   ClearMatches();
   ClearTwoViewGeometries();
+  ClearDescriptorCodes();
   ClearDescriptors();
   ClearKeypoints();
   ClearImages();
@@ -947,6 +1364,13 @@ void Database::ClearCameras() const {
 }
 
 void Database::ClearImages() const {
+  // Clear the dependent tables first, since deleting them in one statement is
+  // much faster than deleting their rows one by one through the foreign keys.
+  // Note that the descriptor codebook does not depend on the images.
+  SQLITE3_CALL(sqlite3_step(sql_stmt_clear_descriptor_codes_));
+  SQLITE3_CALL(sqlite3_reset(sql_stmt_clear_descriptor_codes_));
+  ClearDescriptors();
+  ClearKeypoints();
   SQLITE3_CALL(sqlite3_step(sql_stmt_clear_images_));
   SQLITE3_CALL(sqlite3_reset(sql_stmt_clear_images_));
   database_cleared_ = true;
@@ -958,6 +1382,14 @@ void Database::ClearDescriptors() const {
   database_cleared_ = true;
 }
 
+void Database::ClearDescriptorCodes() const {
+  SQLITE3_CALL(sqlite3_step(sql_stmt_clear_descriptor_codes_));
+  SQLITE3_CALL(sqlite3_reset(sql_stmt_clear_descriptor_codes_));
+  SQLITE3_CALL(sqlite3_step(sql_stmt_clear_descriptor_codebook_));
+  SQLITE3_CALL(sqlite3_reset(sql_stmt_clear_descriptor_codebook_));
+  database_cleared_ = true;
+}
+
 void Database::ClearKeypoints() const {
   SQLITE3_CALL(sqlite3_step(sql_stmt_clear_keypoints_));
   SQLITE3_CALL(sqlite3_reset(sql_stmt_clear_keypoints_));
@@ -979,106 +1411,65 @@ void Database::ClearTwoViewGeometries() const {
 void Database::Merge(const Database& database1,
                      const Database& database2,
                      Database* merged_database) {
-  // Merge the cameras.
-
-  std::unordered_map<camera_t, camera_t> new_camera_ids1;
-  for (const auto& camera : database1.ReadAllCameras()) {
-    const camera_t new_camera_id = merged_database->WriteCamera(camera);
-    new_camera_ids1.emplace(camera.camera_id, new_camera_id);
-  }
-
-  std::unordered_map<camera_t, camera_t> new_camera_ids2;
-  for (const auto& camera : database2.ReadAllCameras()) {
-    const camera_t new_camera_id = merged_database->WriteCamera(camera);
-    new_camera_ids2.emplace(camera.camera_id, new_camera_id);
-  }
-
-  // Merge the images.
-
-  std::unordered_map<image_t, image_t> new_image_ids1;
-  for (auto& image : database1.ReadAllImages()) {
-    image.SetCameraId(new_camera_ids1.at(image.CameraId()));
-    CHECK(!merged_database->ExistsImageWithName(image.Name()))
-        << "The two databases must not contain images with the same name, but "
-           "the there are images with name "
-        << image.Name() << " in both databases";
-    const image_t new_image_id = merged_database->WriteImage(image);
-    new_image_ids1.emplace(image.ImageId(), new_image_id);
-    const auto keypoints = database1.ReadKeypoints(image.ImageId());
-    const auto descriptors = database1.ReadDescriptors(image.ImageId());
-    merged_database->WriteKeypoints(new_image_id, keypoints);
-    merged_database->WriteDescriptors(new_image_id, descriptors);
+  for (const Database* database : {&database1, &database2}) {
+    for (const auto& image : database->ReadAllImages()) {
+      CHECK(!merged_database->ExistsImageWithName(image.Name()))
+          << "The two databases must not contain images with the same name, "
+             "but the there are images with name "
+          << image.Name() << " in both databases";
+    }
+    merged_database->AppendDatabase(*database);
   }
+}
 
-  std::unordered_map<image_t, image_t> new_image_ids2;
-  for (auto& image : database2.ReadAllImages()) {
-    image.SetCameraId(new_camera_ids2.at(image.CameraId()));
-    CHECK(!merged_database->ExistsImageWithName(image.Name()))
-        << "The two databases must not contain images with the same name, but "
-           "the there are images with name "
-        << image.Name() << " in both databases";
-    const image_t new_image_id = merged_database->WriteImage(image);
-    new_image_ids2.emplace(image.ImageId(), new_image_id);
-    const auto keypoints = database2.ReadKeypoints(image.ImageId());
-    const auto descriptors = database2.ReadDescriptors(image.ImageId());
-    merged_database->WriteKeypoints(new_image_id, keypoints);
-    merged_database->WriteDescriptors(new_image_id, descriptors);
+void Database::MergeMatches(const Database& shard_database,
+                            Database* database) {
+  std::unordered_map<image_t, image_t> new_image_ids;
+  bool same_image_ids = true;
+  for (const auto& image : shard_database.ReadAllImages()) {
+    CHECK(database->ExistsImageWithName(image.Name()))
+        << "Image with name " << image.Name()
+        << " of the shard does not exist in the database";
+    const image_t new_image_id =
+        database->ReadImageWithName(image.Name()).ImageId();
+    new_image_ids.emplace(image.ImageId(), new_image_id);
+    same_image_ids &= new_image_id == image.ImageId();
   }
 
-  // Merge the matches.
-
-  for (const auto& matches : database1.ReadAllMatches()) {
-    image_t image_id1, image_id2;
-    Database::PairIdToImagePair(matches.first, &image_id1, &image_id2);
-
-    const image_t new_image_id1 = new_image_ids1.at(image_id1);
-    const image_t new_image_id2 = new_image_ids1.at(image_id2);
-
-    merged_database->WriteMatches(new_image_id1, new_image_id2, matches.second);
+  // The shard is usually a copy of the database, so that the rows can be
+  // copied without decoding them and without holding them in memory.
+  if (same_image_ids) {
+    database->CopyTable(shard_database, "matches", {}, /*skip_existing=*/true);
+    database->CopyTable(
+        shard_database, "two_view_geometries", {}, /*skip_existing=*/true);
+    return;
   }
 
-  for (const auto& matches : database2.ReadAllMatches()) {
+  for (const auto& matches : shard_database.ReadAllMatches()) {
     image_t image_id1, image_id2;
     Database::PairIdToImagePair(matches.first, &image_id1, &image_id2);
 
-    const image_t new_image_id1 = new_image_ids2.at(image_id1);
-    const image_t new_image_id2 = new_image_ids2.at(image_id2);
-
-    merged_database->WriteMatches(new_image_id1, new_image_id2, matches.second);
-  }
-
-  // Merge the two-view geometries.
+    const image_t new_image_id1 = new_image_ids.at(image_id1);
+    const image_t new_image_id2 = new_image_ids.at(image_id2);
 
-  {
-    std::vector<image_pair_t> image_pair_ids;
-    std::vector<TwoViewGeometry> two_view_geometries;
-    database1.ReadTwoViewGeometries(&image_pair_ids, &two_view_geometries);
-
-    for (size_t i = 0; i < two_view_geometries.size(); ++i) {
-      image_t image_id1, image_id2;
-      Database::PairIdToImagePair(image_pair_ids[i], &image_id1, &image_id2);
-
-      const image_t new_image_id1 = new_image_ids1.at(image_id1);
-      const image_t new_image_id2 = new_image_ids1.at(image_id2);
-
-      merged_database->WriteTwoViewGeometry(
-          new_image_id1, new_image_id2, two_view_geometries[i]);
+    if (!database->ExistsMatches(new_image_id1, new_image_id2)) {
+      database->WriteMatches(new_image_id1, new_image_id2, matches.second);
     }
   }
 
-  {
-    std::vector<image_pair_t> image_pair_ids;
-    std::vector<TwoViewGeometry> two_view_geometries;
-    database2.ReadTwoViewGeometries(&image_pair_ids, &two_view_geometries);
+  std::vector<image_pair_t> image_pair_ids;
+  std::vector<TwoViewGeometry> two_view_geometries;
+  shard_database.ReadTwoViewGeometries(&image_pair_ids, &two_view_geometries);
 
-    for (size_t i = 0; i < two_view_geometries.size(); ++i) {
-      image_t image_id1, image_id2;
-      Database::PairIdToImagePair(image_pair_ids[i], &image_id1, &image_id2);
+  for (size_t i = 0; i < two_view_geometries.size(); ++i) {
+    image_t image_id1, image_id2;
+    Database::PairIdToImagePair(image_pair_ids[i], &image_id1, &image_id2);
 
-      const image_t new_image_id1 = new_image_ids2.at(image_id1);
-      const image_t new_image_id2 = new_image_ids2.at(image_id2);
+    const image_t new_image_id1 = new_image_ids.at(image_id1);
+    const image_t new_image_id2 = new_image_ids.at(image_id2);
 
-      merged_database->WriteTwoViewGeometry(
+    if (!database->ExistsInlierMatches(new_image_id1, new_image_id2)) {
+      database->WriteTwoViewGeometry(
           new_image_id1, new_image_id2, two_view_geometries[i]);
     }
   }
@@ -1138,6 +1529,16 @@ void Database::PrepareSQLStatements() {
       database_, sql.c_str(), -1, &sql_stmt_exists_descriptors_, 0));
   sql_stmts_.push_back(sql_stmt_exists_descriptors_);
 
+  sql = "SELECT 1 FROM descriptor_codes WHERE image_id = ?;";
+  SQLITE3_CALL(sqlite3_prepare_v2(
+      database_, sql.c_str(), -1, &sql_stmt_exists_descriptor_codes_, 0));
+  sql_stmts_.push_back(sql_stmt_exists_descriptor_codes_);
+
+  sql = "SELECT 1 FROM descriptor_codebook WHERE codebook_id = ?;";
+  SQLITE3_CALL(sqlite3_prepare_v2(
+      database_, sql.c_str(), -1, &sql_stmt_exists_descriptor_codebook_, 0));
+  sql_stmts_.push_back(sql_stmt_exists_descriptor_codebook_);
+
   sql = "SELECT 1 FROM matches WHERE pair_id = ?;";
   SQLITE3_CALL(sqlite3_prepare_v2(
       database_, sql.c_str(), -1, &sql_stmt_exists_matches_, 0));
@@ -1226,6 +1627,18 @@ void Database::PrepareSQLStatements() {
       database_, sql.c_str(), -1, &sql_stmt_read_descriptors_, 0));
   sql_stmts_.push_back(sql_stmt_read_descriptors_);
 
+  sql = "SELECT rows, cols, data FROM descriptor_codes WHERE image_id = ?;";
+  SQLITE3_CALL(sqlite3_prepare_v2(
+      database_, sql.c_str(), -1, &sql_stmt_read_descriptor_codes_, 0));
+  sql_stmts_.push_back(sql_stmt_read_descriptor_codes_);
+
+  sql =
+      "SELECT rows, cols, data FROM descriptor_codebook WHERE codebook_id = "
+      "?;";
+  SQLITE3_CALL(sqlite3_prepare_v2(
+      database_, sql.c_str(), -1, &sql_stmt_read_descriptor_codebook_, 0));
+  sql_stmts_.push_back(sql_stmt_read_descriptor_codebook_);
+
   sql = "SELECT rows, cols, data FROM matches WHERE pair_id = ?;";
   SQLITE3_CALL(sqlite3_prepare_v2(
       database_, sql.c_str(), -1, &sql_stmt_read_matches_, 0));
@@ -1237,17 +1650,29 @@ void Database::PrepareSQLStatements() {
   sql_stmts_.push_back(sql_stmt_read_matches_all_);
 
   sql =
-      "SELECT rows, cols, data, config, F, E, H, qvec, tvec FROM "
+      "SELECT rows, cols, data, config, F, E, H, qvec, tvec, tri_angle FROM "
       "two_view_geometries WHERE pair_id = ?;";
   SQLITE3_CALL(sqlite3_prepare_v2(
       database_, sql.c_str(), -1, &sql_stmt_read_two_view_geometry_, 0));
   sql_stmts_.push_back(sql_stmt_read_two_view_geometry_);
 
-  sql = "SELECT * FROM two_view_geometries WHERE rows > 0;";
+  sql =
+      "SELECT pair_id, rows, cols, data, config, F, E, H, qvec, tvec, "
+      "tri_angle FROM two_view_geometries WHERE rows > 0;";
   SQLITE3_CALL(sqlite3_prepare_v2(
       database_, sql.c_str(), -1, &sql_stmt_read_two_view_geometries_, 0));
   sql_stmts_.push_back(sql_stmt_read_two_view_geometries_);
 
+  sql =
+      "SELECT pair_id, config, qvec, tvec, tri_angle FROM "
+      "two_view_geometries WHERE rows > 0 AND tri_angle >= 0;";
+  SQLITE3_CALL(sqlite3_prepare_v2(database_,
+                                  sql.c_str(),
+                                  -1,
+                                  &sql_stmt_read_two_view_geometry_poses_,
+                                  0));
+  sql_stmts_.push_back(sql_stmt_read_two_view_geometry_poses_);
+
   sql = "SELECT pair_id, rows FROM two_view_geometries WHERE rows > 0;";
   SQLITE3_CALL(sqlite3_prepare_v2(database_,
                                   sql.c_str(),
@@ -1256,6 +1681,11 @@ void Database::PrepareSQLStatements() {
                                   0));
   sql_stmts_.push_back(sql_stmt_read_two_view_geometry_num_inliers_);
 
+  sql = "SELECT key, model, width, height, params FROM best_fit_cameras;";
+  SQLITE3_CALL(sqlite3_prepare_v2(
+      database_, sql.c_str(), -1, &sql_stmt_read_best_fit_cameras_, 0));
+  sql_stmts_.push_back(sql_stmt_read_best_fit_cameras_);
+
   //////////////////////////////////////////////////////////////////////////////
   // write_*
   //////////////////////////////////////////////////////////////////////////////
@@ -1270,6 +1700,20 @@ void Database::PrepareSQLStatements() {
       database_, sql.c_str(), -1, &sql_stmt_write_descriptors_, 0));
   sql_stmts_.push_back(sql_stmt_write_descriptors_);
 
+  sql =
+      "INSERT INTO descriptor_codes(image_id, rows, cols, data) "
+      "VALUES(?, ?, ?, ?);";
+  SQLITE3_CALL(sqlite3_prepare_v2(
+      database_, sql.c_str(), -1, &sql_stmt_write_descriptor_codes_, 0));
+  sql_stmts_.push_back(sql_stmt_write_descriptor_codes_);
+
+  sql =
+      "INSERT OR REPLACE INTO descriptor_codebook(codebook_id, rows, cols, "
+      "data) VALUES(?, ?, ?, ?);";
+  SQLITE3_CALL(sqlite3_prepare_v2(
+      database_, sql.c_str(), -1, &sql_stmt_write_descriptor_codebook_, 0));
+  sql_stmts_.push_back(sql_stmt_write_descriptor_codebook_);
+
   sql = "INSERT INTO matches(pair_id, rows, cols, data) VALUES(?, ?, ?, ?);";
   SQLITE3_CALL(sqlite3_prepare_v2(
       database_, sql.c_str(), -1, &sql_stmt_write_matches_, 0));
@@ -1277,11 +1721,18 @@ void Database::PrepareSQLStatements() {
 
   sql =
       "INSERT INTO two_view_geometries(pair_id, rows, cols, data, config, F, "
-      "E, H, qvec, tvec) VALUES(?, ?, ?, ?, ?, ?, ?, ?, ?, ?);";
+      "E, H, qvec, tvec, tri_angle) VALUES(?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?);";
   SQLITE3_CALL(sqlite3_prepare_v2(
       database_, sql.c_str(), -1, &sql_stmt_write_two_view_geometry_, 0));
   sql_stmts_.push_back(sql_stmt_write_two_view_geometry_);
 
+  sql =
+      "INSERT OR REPLACE INTO best_fit_cameras(key, model, width, height, "
+      "params) VALUES(?, ?, ?, ?, ?);";
+  SQLITE3_CALL(sqlite3_prepare_v2(
+      database_, sql.c_str(), -1, &sql_stmt_write_best_fit_camera_, 0));
+  sql_stmts_.push_back(sql_stmt_write_best_fit_camera_);
+
   //////////////////////////////////////////////////////////////////////////////
   // delete_*
   //////////////////////////////////////////////////////////////////////////////
@@ -1313,6 +1764,16 @@ void Database::PrepareSQLStatements() {
       database_, sql.c_str(), -1, &sql_stmt_clear_descriptors_, 0));
   sql_stmts_.push_back(sql_stmt_clear_descriptors_);
 
+  sql = "DELETE FROM descriptor_codes;";
+  SQLITE3_CALL(sqlite3_prepare_v2(
+      database_, sql.c_str(), -1, &sql_stmt_clear_descriptor_codes_, 0));
+  sql_stmts_.push_back(sql_stmt_clear_descriptor_codes_);
+
+  sql = "DELETE FROM descriptor_codebook;";
+  SQLITE3_CALL(sqlite3_prepare_v2(
+      database_, sql.c_str(), -1, &sql_stmt_clear_descriptor_codebook_, 0));
+  sql_stmts_.push_back(sql_stmt_clear_descriptor_codebook_);
+
   sql = "DELETE FROM keypoints;";
   SQLITE3_CALL(sqlite3_prepare_v2(
       database_, sql.c_str(), -1, &sql_stmt_clear_keypoints_, 0));
@@ -1340,8 +1801,10 @@ void Database::CreateTables() const {
   CreateImageTable();
   CreateKeypointsTable();
   CreateDescriptorsTable();
+  CreateDescriptorCodesTables();
   CreateMatchesTable();
   CreateTwoViewGeometriesTable();
+  CreateBestFitCamerasTable();
 }
 
 void Database::CreateCameraTable() const {
@@ -1405,6 +1868,23 @@ void Database::CreateDescriptorsTable() const {
   SQLITE3_EXEC(database_, sql.c_str(), nullptr);
 }
 
+void Database::CreateDescriptorCodesTables() const {
+  const std::string sql =
+      "CREATE TABLE IF NOT EXISTS descriptor_codes"
+      "   (image_id  INTEGER  PRIMARY KEY  NOT NULL,"
+      "    rows      INTEGER               NOT NULL,"
+      "    cols      INTEGER               NOT NULL,"
+      "    data      BLOB,"
+      "FOREIGN KEY(image_id) REFERENCES images(image_id) ON DELETE CASCADE);"
+      "CREATE TABLE IF NOT EXISTS descriptor_codebook"
+      "   (codebook_id  INTEGER  PRIMARY KEY  NOT NULL,"
+      "    rows         INTEGER               NOT NULL,"
+      "    cols         INTEGER               NOT NULL,"
+      "    data         BLOB);";
+
+  SQLITE3_EXEC(database_, sql.c_str(), nullptr);
+}
+
 void Database::CreateMatchesTable() const {
   const std::string sql =
       "CREATE TABLE IF NOT EXISTS matches"
@@ -1433,11 +1913,24 @@ void Database::CreateTwoViewGeometriesTable() const {
         "    E        BLOB,"
         "    H        BLOB,"
         "    qvec     BLOB,"
-        "    tvec     BLOB);";
+        "    tvec     BLOB,"
+        "    tri_angle REAL                 NOT NULL DEFAULT -1);";
     SQLITE3_EXEC(database_, sql.c_str(), nullptr);
   }
 }
 
+void Database::CreateBestFitCamerasTable() const {
+  const std::string sql =
+      "CREATE TABLE IF NOT EXISTS best_fit_cameras"
+      "   (key     BLOB     PRIMARY KEY  NOT NULL,"
+      "    model   INTEGER               NOT NULL,"
+      "    width   INTEGER               NOT NULL,"
+      "    height  INTEGER               NOT NULL,"
+      "    params  BLOB);";
+
+  SQLITE3_EXEC(database_, sql.c_str(), nullptr);
+}
+
 void Database::UpdateSchema() const {
   if (!ExistsColumn("two_view_geometries", "F")) {
     SQLITE3_EXEC(database_,
@@ -1469,6 +1962,13 @@ void Database::UpdateSchema() const {
                  nullptr);
   }
 
+  if (!ExistsColumn("two_view_geometries", "tri_angle")) {
+    SQLITE3_EXEC(database_,
+                 "ALTER TABLE two_view_geometries ADD COLUMN tri_angle REAL "
+                 "NOT NULL DEFAULT -1;",
+                 nullptr);
+  }
+
   // Update user version number.
   std::unique_lock<std::mutex> lock(update_schema_mutex_);
   const std::string update_user_version_sql =
@@ -1598,6 +2098,22 @@ size_t Database::SumColumn(const std::string& column,
   return sum;
 }
 
+size_t Database::CountFreePages() const {
+  sqlite3_stmt* sql_stmt;
+  SQLITE3_CALL(sqlite3_prepare_v2(
+      database_, "PRAGMA freelist_count;", -1, &sql_stmt, 0));
+
+  size_t count = 0;
+  const int rc = SQLITE3_CALL(sqlite3_step(sql_stmt));
+  if (rc == SQLITE_ROW) {
+    count = static_cast<size_t>(sqlite3_column_int64(sql_stmt, 0));
+  }
+
+  SQLITE3_CALL(sqlite3_finalize(sql_stmt));
+
+  return count;
+}
+
 size_t Database::MaxColumn(const std::string& column,
                            const std::string& table) const {
   const std::string sql =
@@ -1617,6 +2133,90 @@ size_t Database::MaxColumn(const std::string& column,
   return max;
 }
 
+void Database::AppendDatabase(const Database& database) {
+  // The ids of the appended cameras and images are offset by the maximum ids
+  // in this database. The offset preserves the order of the image ids, so that
+  // the pair ids are offset as well and the matches need not be swapped.
+  const sqlite3_int64 camera_id_offset = MaxColumn("camera_id", "cameras");
+  const sqlite3_int64 image_id_offset = MaxColumn("image_id", "images");
+  CHECK_LT(image_id_offset + database.MaxColumn("image_id", "images"),
+           kMaxNumImages);
+  const sqlite3_int64 pair_id_offset =
+      image_id_offset * (static_cast<sqlite3_int64>(kMaxNumImages) + 1);
+
+  CopyTable(database, "cameras", {{"camera_id", camera_id_offset}});
+  CopyTable(database,
+            "images",
+            {{"image_id", image_id_offset}, {"camera_id", camera_id_offset}});
+  CopyTable(database, "keypoints", {{"image_id", image_id_offset}});
+  CopyTable(database, "descriptors", {{"image_id", image_id_offset}});
+  CopyTable(database, "matches", {{"pair_id", pair_id_offset}});
+  CopyTable(database, "two_view_geometries", {{"pair_id", pair_id_offset}});
+}
+
+void Database::CopyTable(
+    const Database& database,
+    const std::string& table,
+    const std::unordered_map<std::string, sqlite3_int64>& column_offsets,
+    const bool skip_existing) const {
+  std::vector<std::string> columns;
+  {
+    const std::string sql =
+        StringPrintf("PRAGMA table_info(%s);", table.c_str());
+    sqlite3_stmt* sql_stmt;
+    SQLITE3_CALL(sqlite3_prepare_v2(database_, sql.c_str(), -1, &sql_stmt, 0));
+    while (SQLITE3_CALL(sqlite3_step(sql_stmt)) == SQLITE_ROW) {
+      columns.emplace_back(
+          reinterpret_cast<const char*>(sqlite3_column_text(sql_stmt, 1)));
+    }
+    SQLITE3_CALL(sqlite3_finalize(sql_stmt));
+  }
+
+  std::string column_list;
+  std::string value_list;
+  for (const auto& column : columns) {
+    column_list += (column_list.empty() ? "" : ", ") + column;
+    value_list += value_list.empty() ? "?" : ", ?";
+  }
+  const std::string select_sql =
+      StringPrintf("SELECT %s FROM %s;", column_list.c_str(), table.c_str());
+  const std::string insert_sql =
+      StringPrintf("INSERT %sINTO %s (%s) VALUES (%s);",
+                   skip_existing ? "OR IGNORE " : "",
+                   table.c_str(),
+                   column_list.c_str(),
+                   value_list.c_str());
+
+  sqlite3_stmt* select_stmt;
+  SQLITE3_CALL(sqlite3_prepare_v2(
+      database.database_, select_sql.c_str(), -1, &select_stmt, 0));
+  sqlite3_stmt* insert_stmt;
+  SQLITE3_CALL(
+      sqlite3_prepare_v2(database_, insert_sql.c_str(), -1, &insert_stmt, 0));
+
+  // Copy the values row by row, so that only a single row is held in memory.
+  while (SQLITE3_CALL(sqlite3_step(select_stmt)) == SQLITE_ROW) {
+    for (size_t i = 0; i < columns.size(); ++i) {
+      const int idx = static_cast<int>(i);
+      const auto offset = column_offsets.find(columns[i]);
+      if (offset == column_offsets.end()) {
+        SQLITE3_CALL(sqlite3_bind_value(
+            insert_stmt, idx + 1, sqlite3_column_value(select_stmt, idx)));
+      } else {
+        SQLITE3_CALL(sqlite3_bind_int64(
+            insert_stmt,
+            idx + 1,
+            sqlite3_column_int64(select_stmt, idx) + offset->second));
+      }
+    }
+    SQLITE3_CALL(sqlite3_step(insert_stmt));
+    SQLITE3_CALL(sqlite3_reset(insert_stmt));
+  }
+
+  SQLITE3_CALL(sqlite3_finalize(insert_stmt));
+  SQLITE3_CALL(sqlite3_finalize(select_stmt));
+}
+
 DatabaseTransaction::DatabaseTransaction(Database* database)
     : database_(database), database_lock_(database->transaction_mutex_) {
   CHECK_NOTNULL(database_);
@@ -1625,4 +2225,21 @@ DatabaseTransaction::DatabaseTransaction(Database* database)
 
 DatabaseTransaction::~DatabaseTransaction() { database_->EndTransaction(); }
 
+DatabaseReaderPool::DatabaseReaderPool(const Database* database)
+    : database_(CHECK_NOTNULL(database)), path_(database->Path()) {}
+
+bool DatabaseReaderPool::IsShared() const { return path_.empty(); }
+
+const Database& DatabaseReaderPool::Reader() {
+  if (IsShared()) {
+    return *database_;
+  }
+  std::lock_guard<std::mutex> lock(readers_mutex_);
+  std::unique_ptr<Database>& reader = readers_[std::this_thread::get_id()];
+  if (!reader) {
+    reader = std::make_unique<Database>(path_, /*read_only=*/true);
+  }
+  return *reader;
+}
+
 }  // namespace colmap
@@ -36,7 +36,10 @@
 #include "colmap/util/eigen_alignment.h"
 #include "colmap/util/types.h"
 
+#include <memory>
 #include <mutex>
+#include <string>
+#include <thread>
 #include <unordered_map>
 #include <vector>
 
@@ -64,14 +67,21 @@ class Database {
   const static std::string kInMemoryDatabasePath;
 
   Database();
-  explicit Database(const std::string& path);
+  explicit Database(const std::string& path, bool read_only = false);
   ~Database();
 
   // Open and close database. The same database should not be opened
-  // concurrently in multiple threads or processes.
-  void Open(const std::string& path);
+  // concurrently in multiple threads or processes, unless all but one of the
+  // connections are read-only. Read-only connections neither create nor
+  // update the tables and only see the committed changes of other
+  // connections.
+  void Open(const std::string& path, bool read_only = false);
   void Close();
 
+  // The absolute path of the opened database or an empty string for in-memory
+  // databases, which cannot be opened by multiple connections.
+  std::string Path() const;
+
   // Check if entry already exists in database. For image pairs, the order of
   // `image_id1` and `image_id2` does not matter.
   bool ExistsCamera(camera_t camera_id) const;
@@ -79,6 +89,8 @@ class Database {
   bool ExistsImageWithName(const std::string& name) const;
   bool ExistsKeypoints(image_t image_id) const;
   bool ExistsDescriptors(image_t image_id) const;
+  bool ExistsDescriptorCodes(image_t image_id) const;
+  bool ExistsDescriptorCodebook() const;
   bool ExistsMatches(image_t image_id1, image_t image_id2) const;
   bool ExistsInlierMatches(image_t image_id1, image_t image_id2) const;
 
@@ -146,9 +158,18 @@ class Database {
   Image ReadImageWithName(const std::string& name) const;
   std::vector<Image> ReadAllImages() const;
 
+  // The identifiers of all images with both keypoints and descriptors, which
+  // are read in a single query, e.g., to resume feature extraction.
+  std::vector<image_t> ReadImageIdsWithFeatures() const;
+
   FeatureKeypoints ReadKeypoints(image_t image_id) const;
   FeatureDescriptors ReadDescriptors(image_t image_id) const;
 
+  // Product-quantized descriptors of an image and the codebook shared by all
+  // images, see `ProductQuantizer`.
+  FeatureDescriptors ReadDescriptorCodes(image_t image_id) const;
+  FeatureDescriptors ReadDescriptorCodebook() const;
+
   FeatureMatches ReadMatches(image_t image_id1, image_t image_id2) const;
   std::vector<std::pair<image_pair_t, FeatureMatches>> ReadAllMatches() const;
 
@@ -158,6 +179,16 @@ class Database {
       std::vector<image_pair_t>* image_pair_ids,
       std::vector<TwoViewGeometry>* two_view_geometries) const;
 
+  // Read the relative poses and triangulation angles of all image pairs, for
+  // which they were estimated during matching, without the inlier matches.
+  void ReadTwoViewGeometryPoses(
+      std::vector<image_pair_t>* image_pair_ids,
+      std::vector<TwoViewGeometry>* two_view_geometries) const;
+
+  // Best fit non-refractive cameras of refractive cameras by their key, see
+  // `BestFitNonRefracCamera`. The camera identifiers are not stored.
+  std::vector<std::pair<std::string, Camera>> ReadAllBestFitCameras() const;
+
   // Read all image pairs that have an entry in the `NumVerifiedImagePairs`
   // table with at least one inlier match and their number of inlier matches.
   void ReadTwoViewGeometryNumInliers(
@@ -179,6 +210,10 @@ class Database {
                       const FeatureKeypoints& keypoints) const;
   void WriteDescriptors(image_t image_id,
                         const FeatureDescriptors& descriptors) const;
+  void WriteDescriptorCodes(image_t image_id,
+                            const FeatureDescriptors& codes) const;
+  // Replaces the existing codebook, which invalidates all existing codes.
+  void WriteDescriptorCodebook(const FeatureDescriptors& codebook) const;
   void WriteMatches(image_t image_id1,
                     image_t image_id2,
                     const FeatureMatches& matches) const;
@@ -186,6 +221,15 @@ class Database {
                             image_t image_id2,
                             const TwoViewGeometry& two_view_geometry) const;
 
+  // Whether to write the inlier matches of two-view geometries in a compact,
+  // bit-packed encoding, in which they are sorted by their first index. Both
+  // encodings are read transparently, but databases with compact inlier
+  // matches cannot be read by older versions.
+  void SetCompactInlierMatches(bool compact_inlier_matches);
+
+  // Add or replace the best fit camera with the given key.
+  void WriteBestFitCamera(const std::string& key, const Camera& camera) const;
+
   // Update an existing camera in the database. The user is responsible for
   // making sure that the entry already exists.
   void UpdateCamera(const Camera& camera) const;
@@ -206,12 +250,16 @@ class Database {
   // Clear the entire cameras table
   void ClearCameras() const;
 
-  // Clear the entire images, keypoints, and descriptors tables
+  // Clear the entire images, keypoints, descriptors, and descriptor codes
+  // tables
   void ClearImages() const;
 
   // Clear the entire descriptors table
   void ClearDescriptors() const;
 
+  // Clear the entire descriptor codes and codebook tables
+  void ClearDescriptorCodes() const;
+
   // Clear the entire keypoints table
   void ClearKeypoints() const;
 
@@ -221,11 +269,20 @@ class Database {
   // Clear the entire inlier matches table.
   void ClearTwoViewGeometries() const;
 
-  // Merge two databases into a single, new database.
+  // Merge two databases into a single, new database. The rows of the
+  // databases are copied in a streaming fashion without decoding them, where
+  // the camera and image ids of the second database are offset by the maximum
+  // ids of the first database.
   static void Merge(const Database& database1,
                     const Database& database2,
                     Database* merged_database);
 
+  // Merge the matches and two-view geometries of a shard into the database,
+  // where the shard is a copy of the database matched with a subset of the
+  // image pairs. Images are associated by their names and image pairs, which
+  // already exist in the database, are not overwritten.
+  static void MergeMatches(const Database& shard_database, Database* database);
+
  private:
   friend class DatabaseTransaction;
 
@@ -248,8 +305,10 @@ class Database {
   void CreateImageTable() const;
   void CreateKeypointsTable() const;
   void CreateDescriptorsTable() const;
+  void CreateDescriptorCodesTables() const;
   void CreateMatchesTable() const;
   void CreateTwoViewGeometriesTable() const;
+  void CreateBestFitCamerasTable() const;
 
   void UpdateSchema() const;
 
@@ -265,6 +324,21 @@ class Database {
   size_t CountRowsForEntry(sqlite3_stmt* sql_stmt, sqlite3_int64 row_id) const;
   size_t SumColumn(const std::string& column, const std::string& table) const;
   size_t MaxColumn(const std::string& column, const std::string& table) const;
+  size_t CountFreePages() const;
+
+  // Append the cameras, images, features, and matches of the given database,
+  // where the camera and image ids are offset by the maximum ids in this
+  // database. The rows are copied without decoding them.
+  void AppendDatabase(const Database& database);
+
+  // Copy all rows of the table from the given database into this database,
+  // where the given integer columns are offset. Existing rows with the same
+  // primary key are either kept or cause a failure.
+  void CopyTable(
+      const Database& database,
+      const std::string& table,
+      const std::unordered_map<std::string, sqlite3_int64>& column_offsets,
+      bool skip_existing = false) const;
 
   sqlite3* database_ = nullptr;
 
@@ -272,6 +346,8 @@ class Database {
   // the VACUUM command in such case
   mutable bool database_cleared_ = false;
 
+  bool compact_inlier_matches_ = false;
+
   // Ensure that only one database object at a time updates the schema of a
   // database. Since the schema is updated every time a database is opened, this
   // is to ensure that there are no race conditions ("database locked" error
@@ -295,6 +371,8 @@ class Database {
   sqlite3_stmt* sql_stmt_exists_image_name_ = nullptr;
   sqlite3_stmt* sql_stmt_exists_keypoints_ = nullptr;
   sqlite3_stmt* sql_stmt_exists_descriptors_ = nullptr;
+  sqlite3_stmt* sql_stmt_exists_descriptor_codes_ = nullptr;
+  sqlite3_stmt* sql_stmt_exists_descriptor_codebook_ = nullptr;
   sqlite3_stmt* sql_stmt_exists_matches_ = nullptr;
   sqlite3_stmt* sql_stmt_exists_two_view_geometry_ = nullptr;
 
@@ -314,17 +392,24 @@ class Database {
   sqlite3_stmt* sql_stmt_read_images_ = nullptr;
   sqlite3_stmt* sql_stmt_read_keypoints_ = nullptr;
   sqlite3_stmt* sql_stmt_read_descriptors_ = nullptr;
+  sqlite3_stmt* sql_stmt_read_descriptor_codes_ = nullptr;
+  sqlite3_stmt* sql_stmt_read_descriptor_codebook_ = nullptr;
   sqlite3_stmt* sql_stmt_read_matches_ = nullptr;
   sqlite3_stmt* sql_stmt_read_matches_all_ = nullptr;
   sqlite3_stmt* sql_stmt_read_two_view_geometry_ = nullptr;
   sqlite3_stmt* sql_stmt_read_two_view_geometries_ = nullptr;
+  sqlite3_stmt* sql_stmt_read_two_view_geometry_poses_ = nullptr;
   sqlite3_stmt* sql_stmt_read_two_view_geometry_num_inliers_ = nullptr;
+  sqlite3_stmt* sql_stmt_read_best_fit_cameras_ = nullptr;
 
   // write_*
   sqlite3_stmt* sql_stmt_write_keypoints_ = nullptr;
   sqlite3_stmt* sql_stmt_write_descriptors_ = nullptr;
+  sqlite3_stmt* sql_stmt_write_descriptor_codes_ = nullptr;
+  sqlite3_stmt* sql_stmt_write_descriptor_codebook_ = nullptr;
   sqlite3_stmt* sql_stmt_write_matches_ = nullptr;
   sqlite3_stmt* sql_stmt_write_two_view_geometry_ = nullptr;
+  sqlite3_stmt* sql_stmt_write_best_fit_camera_ = nullptr;
 
   // delete_*
   sqlite3_stmt* sql_stmt_delete_matches_ = nullptr;
@@ -334,6 +419,8 @@ class Database {
   sqlite3_stmt* sql_stmt_clear_cameras_ = nullptr;
   sqlite3_stmt* sql_stmt_clear_images_ = nullptr;
   sqlite3_stmt* sql_stmt_clear_descriptors_ = nullptr;
+  sqlite3_stmt* sql_stmt_clear_descriptor_codes_ = nullptr;
+  sqlite3_stmt* sql_stmt_clear_descriptor_codebook_ = nullptr;
   sqlite3_stmt* sql_stmt_clear_keypoints_ = nullptr;
   sqlite3_stmt* sql_stmt_clear_matches_ = nullptr;
   sqlite3_stmt* sql_stmt_clear_two_view_geometries_ = nullptr;
@@ -354,6 +441,31 @@ class DatabaseTransaction {
   std::unique_lock<std::mutex> database_lock_;
 };
 
+// Pool of read-only connections to a database with one connection per thread,
+// so that concurrent reads do not serialize on the single connection and the
+// prepared statements of the given database. The connections are opened
+// lazily on the first read of a thread. In-memory databases cannot be shared
+// by multiple connections, in which case all threads read from the given
+// database and must serialize their reads themselves.
+class DatabaseReaderPool {
+ public:
+  explicit DatabaseReaderPool(const Database* database);
+
+  // Whether the threads read from the given database.
+  bool IsShared() const;
+
+  // The connection of the calling thread.
+  const Database& Reader();
+
+ private:
+  NON_COPYABLE(DatabaseReaderPool)
+  NON_MOVABLE(DatabaseReaderPool)
+  const Database* database_;
+  const std::string path_;
+  std::mutex readers_mutex_;
+  std::unordered_map<std::thread::id, std::unique_ptr<Database>> readers_;
+};
+
 ////////////////////////////////////////////////////////////////////////////////
 // Implementation
 ////////////////////////////////////////////////////////////////////////////////
@@ -30,18 +30,136 @@
 #include "colmap/scene/database_cache.h"
 
 #include "colmap/feature/utils.h"
+#include "colmap/util/endian.h"
+#include "colmap/util/misc.h"
 #include "colmap/util/string.h"
 #include "colmap/util/timer.h"
 
+#include <algorithm>
+#include <fstream>
+#include <mutex>
+#include <sstream>
 #include <unordered_set>
 
 namespace colmap {
 
+namespace {
+
+// Key of the loading options and the database contents, which invalidates a
+// cached correspondence graph when the features or matches in the database or
+// the loaded images change.
+std::vector<uint64_t> CorrespondenceGraphCacheKey(
+    const Database& database,
+    const size_t min_num_matches,
+    const bool ignore_watermarks,
+    const std::unordered_set<image_t>& image_ids) {
+  std::vector<uint64_t> key = {min_num_matches,
+                               ignore_watermarks,
+                               database.NumKeypoints(),
+                               database.NumVerifiedImagePairs(),
+                               database.NumInlierMatches(),
+                               image_ids.size()};
+  std::vector<image_t> sorted_image_ids(image_ids.begin(), image_ids.end());
+  std::sort(sorted_image_ids.begin(), sorted_image_ids.end());
+  key.insert(key.end(), sorted_image_ids.begin(), sorted_image_ids.end());
+  return key;
+}
+
+bool ReadCorrespondenceGraphCache(const std::string& path,
+                                  const std::vector<uint64_t>& key,
+                                  CorrespondenceGraph* correspondence_graph) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file.is_open()) {
+    return false;
+  }
+  if (ReadBinaryLittleEndian<uint64_t>(&file) != key.size() || !file.good()) {
+    return false;
+  }
+  std::vector<uint64_t> file_key(key.size());
+  ReadBinaryLittleEndian<uint64_t>(&file, &file_key);
+  return file.good() && file_key == key && correspondence_graph->Read(&file);
+}
+
+void WriteCorrespondenceGraphCache(
+    const std::string& path,
+    const std::vector<uint64_t>& key,
+    const CorrespondenceGraph& correspondence_graph) {
+  std::ofstream file(path, std::ios::trunc | std::ios::binary);
+  if (!file.is_open()) {
+    LOG(WARNING) << "Failed to write correspondence graph cache " << path;
+    return;
+  }
+  WriteBinaryLittleEndian<uint64_t>(&file, key.size());
+  WriteBinaryLittleEndian<uint64_t>(&file, key);
+  correspondence_graph.Write(&file);
+}
+
+// FNV-1a hash, which is stable across platforms and runs as opposed to
+// std::hash, such that the snapshot keys remain valid between sessions.
+void HashBytes(const void* data, const size_t num_bytes, uint64_t* hash) {
+  const unsigned char* bytes = static_cast<const unsigned char*>(data);
+  for (size_t i = 0; i < num_bytes; ++i) {
+    *hash ^= bytes[i];
+    *hash *= 1099511628211ULL;
+  }
+}
+
+// Hash of the contents of the camera and image rows, i.e., of the intrinsics
+// and the pose priors, which can change without changing any row count.
+uint64_t CameraAndImageRowsHash(const Database& database) {
+  uint64_t hash = 14695981039346656037ULL;
+
+  std::vector<Camera> cameras = database.ReadAllCameras();
+  std::sort(cameras.begin(),
+            cameras.end(),
+            [](const Camera& camera1, const Camera& camera2) {
+              return camera1.camera_id < camera2.camera_id;
+            });
+  for (const Camera& camera : cameras) {
+    const int64_t ids[6] = {static_cast<int64_t>(camera.camera_id),
+                            static_cast<int64_t>(camera.model_id),
+                            static_cast<int64_t>(camera.width),
+                            static_cast<int64_t>(camera.height),
+                            static_cast<int64_t>(camera.has_prior_focal_length),
+                            static_cast<int64_t>(camera.refrac_model_id)};
+    HashBytes(ids, sizeof(ids), &hash);
+    HashBytes(
+        camera.params.data(), camera.params.size() * sizeof(double), &hash);
+    HashBytes(camera.refrac_params.data(),
+              camera.refrac_params.size() * sizeof(double),
+              &hash);
+  }
+
+  std::vector<Image> images = database.ReadAllImages();
+  std::sort(images.begin(),
+            images.end(),
+            [](const Image& image1, const Image& image2) {
+              return image1.ImageId() < image2.ImageId();
+            });
+  for (const Image& image : images) {
+    const int64_t ids[2] = {static_cast<int64_t>(image.ImageId()),
+                            static_cast<int64_t>(image.CameraId())};
+    HashBytes(ids, sizeof(ids), &hash);
+    HashBytes(image.Name().data(), image.Name().size(), &hash);
+    const Rigid3d& prior = image.CamFromWorldPrior();
+    HashBytes(prior.rotation.coeffs().data(), 4 * sizeof(double), &hash);
+    HashBytes(prior.translation.data(), 3 * sizeof(double), &hash);
+    HashBytes(image.CamFromWorldPriorCov().data(),
+              image.CamFromWorldPriorCov().size() * sizeof(double),
+              &hash);
+  }
+
+  return hash;
+}
+
+}  // namespace
+
 std::shared_ptr<DatabaseCache> DatabaseCache::Create(
     const Database& database,
     const size_t min_num_matches,
     const bool ignore_watermarks,
-    const std::unordered_set<std::string>& image_names) {
+    const std::unordered_set<std::string>& image_names,
+    const std::string& correspondence_graph_cache_path) {
   auto cache = std::make_shared<DatabaseCache>();
 
   //////////////////////////////////////////////////////////////////////////////
@@ -64,19 +182,59 @@ std::shared_ptr<DatabaseCache> DatabaseCache::Create(
   LOG(INFO) << StringPrintf(
       " %d in %.3fs", cache->cameras_.size(), timer.ElapsedSeconds());
 
+  std::vector<class Image> images = database.ReadAllImages();
+
+  // Determines for which images data should be loaded.
+  std::unordered_set<image_t> image_ids;
+  if (image_names.empty()) {
+    for (const auto& image : images) {
+      image_ids.insert(image.ImageId());
+    }
+  } else {
+    for (const auto& image : images) {
+      if (image_names.count(image.Name()) > 0) {
+        image_ids.insert(image.ImageId());
+      }
+    }
+  }
+
   //////////////////////////////////////////////////////////////////////////////
-  // Load matches
+  // Load cached correspondence graph
   //////////////////////////////////////////////////////////////////////////////
 
-  timer.Restart();
-  LOG(INFO) << "Loading matches...";
+  std::vector<uint64_t> cache_key;
+  if (!correspondence_graph_cache_path.empty()) {
+    timer.Restart();
+    LOG(INFO) << "Loading cached correspondence graph...";
+
+    cache_key = CorrespondenceGraphCacheKey(
+        database, min_num_matches, ignore_watermarks, image_ids);
+    auto correspondence_graph = std::make_shared<class CorrespondenceGraph>();
+    if (ReadCorrespondenceGraphCache(correspondence_graph_cache_path,
+                                     cache_key,
+                                     correspondence_graph.get())) {
+      cache->correspondence_graph_ = std::move(correspondence_graph);
+      LOG(INFO) << StringPrintf(" in %.3fs", timer.ElapsedSeconds());
+    } else {
+      LOG(INFO) << " not found or outdated";
+    }
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+  // Load matches
+  //////////////////////////////////////////////////////////////////////////////
 
   std::vector<image_pair_t> image_pair_ids;
   std::vector<TwoViewGeometry> two_view_geometries;
-  database.ReadTwoViewGeometries(&image_pair_ids, &two_view_geometries);
+  if (!cache->correspondence_graph_) {
+    timer.Restart();
+    LOG(INFO) << "Loading matches...";
 
-  LOG(INFO) << StringPrintf(
-      " %d in %.3fs", image_pair_ids.size(), timer.ElapsedSeconds());
+    database.ReadTwoViewGeometries(&image_pair_ids, &two_view_geometries);
+
+    LOG(INFO) << StringPrintf(
+        " %d in %.3fs", image_pair_ids.size(), timer.ElapsedSeconds());
+  }
 
   auto UseInlierMatchesCheck = [min_num_matches, ignore_watermarks](
                                    const TwoViewGeometry& two_view_geometry) {
@@ -93,36 +251,30 @@ std::shared_ptr<DatabaseCache> DatabaseCache::Create(
   timer.Restart();
   LOG(INFO) << "Loading images...";
 
-  std::unordered_set<image_t> image_ids;
-
   {
-    std::vector<class Image> images = database.ReadAllImages();
     const size_t num_images = images.size();
 
-    // Determines for which images data should be loaded.
-    if (image_names.empty()) {
-      for (const auto& image : images) {
-        image_ids.insert(image.ImageId());
-      }
-    } else {
-      for (const auto& image : images) {
-        if (image_names.count(image.Name()) > 0) {
-          image_ids.insert(image.ImageId());
-        }
-      }
-    }
-
     // Collect all images that are connected in the correspondence graph.
     std::unordered_set<image_t> connected_image_ids;
     connected_image_ids.reserve(image_ids.size());
-    for (size_t i = 0; i < image_pair_ids.size(); ++i) {
-      if (UseInlierMatchesCheck(two_view_geometries[i])) {
-        image_t image_id1;
-        image_t image_id2;
-        Database::PairIdToImagePair(image_pair_ids[i], &image_id1, &image_id2);
-        if (image_ids.count(image_id1) > 0 && image_ids.count(image_id2) > 0) {
-          connected_image_ids.insert(image_id1);
-          connected_image_ids.insert(image_id2);
+    if (cache->correspondence_graph_) {
+      for (const image_t image_id : image_ids) {
+        if (cache->correspondence_graph_->ExistsImage(image_id)) {
+          connected_image_ids.insert(image_id);
+        }
+      }
+    } else {
+      for (size_t i = 0; i < image_pair_ids.size(); ++i) {
+        if (UseInlierMatchesCheck(two_view_geometries[i])) {
+          image_t image_id1;
+          image_t image_id2;
+          Database::PairIdToImagePair(
+              image_pair_ids[i], &image_id1, &image_id2);
+          if (image_ids.count(image_id1) > 0 &&
+              image_ids.count(image_id2) > 0) {
+            connected_image_ids.insert(image_id1);
+            connected_image_ids.insert(image_id2);
+          }
         }
       }
     }
@@ -150,34 +302,60 @@ std::shared_ptr<DatabaseCache> DatabaseCache::Create(
   // Build correspondence graph
   //////////////////////////////////////////////////////////////////////////////
 
-  timer.Restart();
-  LOG(INFO) << "Building correspondence graph...";
+  if (!cache->correspondence_graph_) {
+    timer.Restart();
+    LOG(INFO) << "Building correspondence graph...";
 
-  cache->correspondence_graph_ = std::make_shared<class CorrespondenceGraph>();
+    cache->correspondence_graph_ =
+        std::make_shared<class CorrespondenceGraph>();
 
-  for (const auto& image : cache->images_) {
-    cache->correspondence_graph_->AddImage(image.first,
-                                           image.second.NumPoints2D());
-  }
+    for (const auto& image : cache->images_) {
+      cache->correspondence_graph_->AddImage(image.first,
+                                             image.second.NumPoints2D());
+    }
 
-  size_t num_ignored_image_pairs = 0;
-  for (size_t i = 0; i < image_pair_ids.size(); ++i) {
-    if (UseInlierMatchesCheck(two_view_geometries[i])) {
-      image_t image_id1;
-      image_t image_id2;
-      Database::PairIdToImagePair(image_pair_ids[i], &image_id1, &image_id2);
-      if (image_ids.count(image_id1) > 0 && image_ids.count(image_id2) > 0) {
-        cache->correspondence_graph_->AddCorrespondences(
-            image_id1, image_id2, two_view_geometries[i].inlier_matches);
+    std::vector<std::pair<image_t, image_t>> image_pairs;
+    std::vector<FeatureMatches> matches;
+    image_pairs.reserve(image_pair_ids.size());
+    matches.reserve(image_pair_ids.size());
+    size_t num_ignored_image_pairs = 0;
+    for (size_t i = 0; i < image_pair_ids.size(); ++i) {
+      if (UseInlierMatchesCheck(two_view_geometries[i])) {
+        image_t image_id1;
+        image_t image_id2;
+        Database::PairIdToImagePair(image_pair_ids[i], &image_id1, &image_id2);
+        if (image_ids.count(image_id1) > 0 && image_ids.count(image_id2) > 0) {
+          image_pairs.emplace_back(image_id1, image_id2);
+          matches.push_back(std::move(two_view_geometries[i].inlier_matches));
+        } else {
+          num_ignored_image_pairs += 1;
+        }
       } else {
         num_ignored_image_pairs += 1;
       }
-    } else {
-      num_ignored_image_pairs += 1;
     }
-  }
 
-  cache->correspondence_graph_->Finalize();
+    // The matches were moved into the correspondence graph input.
+    two_view_geometries.clear();
+    two_view_geometries.shrink_to_fit();
+
+    LOG(INFO) << StringPrintf(" adding %d image pairs", image_pairs.size());
+    cache->correspondence_graph_->AddCorrespondences(image_pairs, matches);
+    matches.clear();
+    matches.shrink_to_fit();
+
+    cache->correspondence_graph_->Finalize();
+
+    LOG(INFO) << StringPrintf(" in %.3fs (ignored %d)",
+                              timer.ElapsedSeconds(),
+                              num_ignored_image_pairs);
+
+    if (!correspondence_graph_cache_path.empty()) {
+      WriteCorrespondenceGraphCache(correspondence_graph_cache_path,
+                                    cache_key,
+                                    *cache->correspondence_graph_);
+    }
+  }
 
   // Set number of observations and correspondences per image.
   for (auto& image : cache->images_) {
@@ -187,13 +365,446 @@ std::shared_ptr<DatabaseCache> DatabaseCache::Create(
         cache->correspondence_graph_->NumCorrespondencesForImage(image.first));
   }
 
-  LOG(INFO) << StringPrintf(" in %.3fs (ignored %d)",
-                            timer.ElapsedSeconds(),
-                            num_ignored_image_pairs);
+  //////////////////////////////////////////////////////////////////////////////
+  // Load relative poses
+  //////////////////////////////////////////////////////////////////////////////
+
+  {
+    timer.Restart();
+    LOG(INFO) << "Loading relative poses...";
+
+    std::vector<image_pair_t> pose_image_pair_ids;
+    std::vector<TwoViewGeometry> pose_two_view_geometries;
+    database.ReadTwoViewGeometryPoses(&pose_image_pair_ids,
+                                      &pose_two_view_geometries);
+    for (size_t i = 0; i < pose_image_pair_ids.size(); ++i) {
+      image_t image_id1;
+      image_t image_id2;
+      Database::PairIdToImagePair(
+          pose_image_pair_ids[i], &image_id1, &image_id2);
+      if (cache->ExistsImage(image_id1) && cache->ExistsImage(image_id2)) {
+        cache->two_view_geometry_poses_.emplace(
+            pose_image_pair_ids[i], std::move(pose_two_view_geometries[i]));
+      }
+    }
+
+    LOG(INFO) << StringPrintf(" %d in %.3fs",
+                              cache->two_view_geometry_poses_.size(),
+                              timer.ElapsedSeconds());
+  }
+
+  return cache;
+}
+
+std::shared_ptr<DatabaseCache> DatabaseCache::CreateOrLoadSnapshot(
+    const Database& database,
+    const size_t min_num_matches,
+    const bool ignore_watermarks,
+    const std::unordered_set<std::string>& image_names,
+    const std::string& snapshot_path) {
+  if (snapshot_path.empty()) {
+    return Create(database, min_num_matches, ignore_watermarks, image_names);
+  }
+
+  const std::string key =
+      SnapshotKey(database, min_num_matches, ignore_watermarks, image_names);
+
+  Timer timer;
+  timer.Start();
+  LOG(INFO) << "Loading database cache snapshot...";
+  std::shared_ptr<DatabaseCache> cache = LoadSnapshot(snapshot_path, key);
+  if (cache) {
+    LOG(INFO) << StringPrintf(
+        " %d images in %.3fs", cache->NumImages(), timer.ElapsedSeconds());
+    return cache;
+  }
+  LOG(INFO) << " not found or outdated";
+
+  cache = Create(database, min_num_matches, ignore_watermarks, image_names);
+  cache->SaveSnapshot(snapshot_path, key);
+  return cache;
+}
+
+namespace {
+
+struct RetainedCache {
+  std::string key;
+  std::shared_ptr<const DatabaseCache> cache;
+};
+
+struct RetainedCaches {
+  std::mutex mutex;
+  bool retain = false;
+  // The most recent cache of every database path.
+  std::unordered_map<std::string, RetainedCache> caches;
+};
+
+RetainedCaches& GetRetainedCaches() {
+  static RetainedCaches retained_caches;
+  return retained_caches;
+}
+
+}  // namespace
+
+void DatabaseCache::SetRetainCaches(const bool retain) {
+  RetainedCaches& retained_caches = GetRetainedCaches();
+  std::lock_guard<std::mutex> lock(retained_caches.mutex);
+  retained_caches.retain = retain;
+  if (!retain) {
+    retained_caches.caches.clear();
+  }
+}
+
+std::shared_ptr<const DatabaseCache> DatabaseCache::CreateOrRetain(
+    const std::string& database_path,
+    const size_t min_num_matches,
+    const bool ignore_watermarks,
+    const std::unordered_set<std::string>& image_names,
+    const std::string& snapshot_path) {
+  const Database database(database_path);
+
+  RetainedCaches& retained_caches = GetRetainedCaches();
+  std::unique_lock<std::mutex> lock(retained_caches.mutex);
+  if (!retained_caches.retain) {
+    lock.unlock();
+    return CreateOrLoadSnapshot(database,
+                                min_num_matches,
+                                ignore_watermarks,
+                                image_names,
+                                snapshot_path);
+  }
+
+  // Loading is serialized, so that concurrent jobs on the same database do
+  // not load the same cache twice.
+  const std::string key =
+      SnapshotKey(database, min_num_matches, ignore_watermarks, image_names);
+  RetainedCache& retained_cache = retained_caches.caches[database_path];
+  if (retained_cache.cache && retained_cache.key == key) {
+    LOG(INFO) << StringPrintf("Reusing retained database cache with %d images",
+                              retained_cache.cache->NumImages());
+    return retained_cache.cache;
+  }
+
+  retained_cache.key = key;
+  retained_cache.cache = CreateOrLoadSnapshot(database,
+                                              min_num_matches,
+                                              ignore_watermarks,
+                                              image_names,
+                                              snapshot_path);
+  return retained_cache.cache;
+}
+
+namespace {
+
+// Version of the snapshot format, to be increased on any change of the format.
+const uint64_t kSnapshotVersion = 2;
+
+void WriteString(std::ostream* stream, const std::string& str) {
+  WriteBinaryLittleEndian<uint64_t>(stream, str.size());
+  stream->write(str.data(), str.size());
+}
+
+std::string ReadString(std::istream* stream) {
+  std::string str(ReadBinaryLittleEndian<uint64_t>(stream), '\0');
+  stream->read(&str[0], str.size());
+  return str;
+}
+
+}  // namespace
+
+void DatabaseCache::SaveSnapshot(const std::string& path,
+                                 const std::string& key) const {
+  std::ofstream file(path, std::ios::trunc | std::ios::binary);
+  if (!file.is_open()) {
+    LOG(WARNING) << "Failed to write database cache snapshot " << path;
+    return;
+  }
+
+  WriteBinaryLittleEndian<uint64_t>(&file, kSnapshotVersion);
+  WriteString(&file, key);
+
+  WriteBinaryLittleEndian<uint64_t>(&file, cameras_.size());
+  for (const auto& camera : cameras_) {
+    WriteBinaryLittleEndian<camera_t>(&file, camera.first);
+    WriteBinaryLittleEndian<int>(&file,
+                                 static_cast<int>(camera.second.model_id));
+    WriteBinaryLittleEndian<int>(
+        &file, static_cast<int>(camera.second.refrac_model_id));
+    WriteBinaryLittleEndian<uint64_t>(&file, camera.second.width);
+    WriteBinaryLittleEndian<uint64_t>(&file, camera.second.height);
+    WriteBinaryLittleEndian<uint64_t>(&file, camera.second.params.size());
+    WriteBinaryLittleEndian<double>(&file, camera.second.params);
+    WriteBinaryLittleEndian<uint64_t>(&file,
+                                      camera.second.refrac_params.size());
+    WriteBinaryLittleEndian<double>(&file, camera.second.refrac_params);
+    WriteBinaryLittleEndian<uint8_t>(&file,
+                                     camera.second.has_prior_focal_length);
+  }
+
+  WriteBinaryLittleEndian<uint64_t>(&file, images_.size());
+  for (const auto& image : images_) {
+    WriteBinaryLittleEndian<image_t>(&file, image.first);
+    WriteString(&file, image.second.Name());
+    WriteBinaryLittleEndian<camera_t>(&file, image.second.CameraId());
+    const Rigid3d& cam_from_world_prior = image.second.CamFromWorldPrior();
+    WriteBinaryLittleEndian<double>(&file, cam_from_world_prior.rotation.w());
+    WriteBinaryLittleEndian<double>(&file, cam_from_world_prior.rotation.x());
+    WriteBinaryLittleEndian<double>(&file, cam_from_world_prior.rotation.y());
+    WriteBinaryLittleEndian<double>(&file, cam_from_world_prior.rotation.z());
+    WriteBinaryLittleEndian<double>(&file,
+                                    cam_from_world_prior.translation.x());
+    WriteBinaryLittleEndian<double>(&file,
+                                    cam_from_world_prior.translation.y());
+    WriteBinaryLittleEndian<double>(&file,
+                                    cam_from_world_prior.translation.z());
+    const Eigen::Matrix7d& cam_from_world_prior_cov =
+        image.second.CamFromWorldPriorCov();
+    for (int i = 0; i < cam_from_world_prior_cov.size(); ++i) {
+      WriteBinaryLittleEndian<double>(&file, cam_from_world_prior_cov(i));
+    }
+    WriteBinaryLittleEndian<uint64_t>(&file, image.second.NumPoints2D());
+    for (const auto& point2D : image.second.Points2D()) {
+      WriteBinaryLittleEndian<double>(&file, point2D.xy(0));
+      WriteBinaryLittleEndian<double>(&file, point2D.xy(1));
+    }
+  }
+
+  correspondence_graph_->Write(&file);
+
+  WriteBinaryLittleEndian<uint64_t>(&file, two_view_geometry_poses_.size());
+  for (const auto& two_view_geometry : two_view_geometry_poses_) {
+    const Rigid3d& cam2_from_cam1 = two_view_geometry.second.cam2_from_cam1;
+    WriteBinaryLittleEndian<image_pair_t>(&file, two_view_geometry.first);
+    WriteBinaryLittleEndian<int>(&file, two_view_geometry.second.config);
+    WriteBinaryLittleEndian<double>(&file, cam2_from_cam1.rotation.w());
+    WriteBinaryLittleEndian<double>(&file, cam2_from_cam1.rotation.x());
+    WriteBinaryLittleEndian<double>(&file, cam2_from_cam1.rotation.y());
+    WriteBinaryLittleEndian<double>(&file, cam2_from_cam1.rotation.z());
+    WriteBinaryLittleEndian<double>(&file, cam2_from_cam1.translation.x());
+    WriteBinaryLittleEndian<double>(&file, cam2_from_cam1.translation.y());
+    WriteBinaryLittleEndian<double>(&file, cam2_from_cam1.translation.z());
+    WriteBinaryLittleEndian<double>(&file, two_view_geometry.second.tri_angle);
+  }
+}
+
+std::shared_ptr<DatabaseCache> DatabaseCache::LoadSnapshot(
+    const std::string& path, const std::string& key) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file.is_open()) {
+    return nullptr;
+  }
+
+  if (ReadBinaryLittleEndian<uint64_t>(&file) != kSnapshotVersion ||
+      !file.good() ||
+      ReadBinaryLittleEndian<uint64_t>(&file) != key.size() ||
+      !file.good()) {
+    return nullptr;
+  }
+  std::string file_key(key.size(), '\0');
+  file.read(&file_key[0], file_key.size());
+  if (!file.good() || file_key != key) {
+    return nullptr;
+  }
+
+  auto cache = std::make_shared<DatabaseCache>();
+
+  const size_t num_cameras = ReadBinaryLittleEndian<uint64_t>(&file);
+  for (size_t i = 0; i < num_cameras && file.good(); ++i) {
+    struct Camera camera;
+    camera.camera_id = ReadBinaryLittleEndian<camera_t>(&file);
+    camera.model_id =
+        static_cast<CameraModelId>(ReadBinaryLittleEndian<int>(&file));
+    camera.refrac_model_id =
+        static_cast<CameraRefracModelId>(ReadBinaryLittleEndian<int>(&file));
+    camera.width = ReadBinaryLittleEndian<uint64_t>(&file);
+    camera.height = ReadBinaryLittleEndian<uint64_t>(&file);
+    camera.params.resize(ReadBinaryLittleEndian<uint64_t>(&file));
+    ReadBinaryLittleEndian<double>(&file, &camera.params);
+    camera.refrac_params.resize(ReadBinaryLittleEndian<uint64_t>(&file));
+    ReadBinaryLittleEndian<double>(&file, &camera.refrac_params);
+    camera.has_prior_focal_length = ReadBinaryLittleEndian<uint8_t>(&file);
+    cache->cameras_.emplace(camera.camera_id, std::move(camera));
+  }
+
+  const size_t num_images = ReadBinaryLittleEndian<uint64_t>(&file);
+  cache->images_.reserve(num_images);
+  for (size_t i = 0; i < num_images && file.good(); ++i) {
+    class Image image;
+    image.SetImageId(ReadBinaryLittleEndian<image_t>(&file));
+    image.SetName(ReadString(&file));
+    image.SetCameraId(ReadBinaryLittleEndian<camera_t>(&file));
+    Rigid3d& cam_from_world_prior = image.CamFromWorldPrior();
+    cam_from_world_prior.rotation.w() = ReadBinaryLittleEndian<double>(&file);
+    cam_from_world_prior.rotation.x() = ReadBinaryLittleEndian<double>(&file);
+    cam_from_world_prior.rotation.y() = ReadBinaryLittleEndian<double>(&file);
+    cam_from_world_prior.rotation.z() = ReadBinaryLittleEndian<double>(&file);
+    cam_from_world_prior.translation.x() =
+        ReadBinaryLittleEndian<double>(&file);
+    cam_from_world_prior.translation.y() =
+        ReadBinaryLittleEndian<double>(&file);
+    cam_from_world_prior.translation.z() =
+        ReadBinaryLittleEndian<double>(&file);
+    Eigen::Matrix7d& cam_from_world_prior_cov = image.CamFromWorldPriorCov();
+    for (int j = 0; j < cam_from_world_prior_cov.size(); ++j) {
+      cam_from_world_prior_cov(j) = ReadBinaryLittleEndian<double>(&file);
+    }
+    std::vector<Eigen::Vector2d> points2D(
+        ReadBinaryLittleEndian<uint64_t>(&file));
+    for (auto& point2D : points2D) {
+      point2D(0) = ReadBinaryLittleEndian<double>(&file);
+      point2D(1) = ReadBinaryLittleEndian<double>(&file);
+    }
+    image.SetPoints2D(points2D);
+    const image_t image_id = image.ImageId();
+    cache->images_.emplace(image_id, std::move(image));
+  }
+
+  cache->correspondence_graph_ = std::make_shared<class CorrespondenceGraph>();
+  if (!file.good() || !cache->correspondence_graph_->Read(&file)) {
+    return nullptr;
+  }
+
+  const size_t num_two_view_geometry_poses =
+      ReadBinaryLittleEndian<uint64_t>(&file);
+  for (size_t i = 0; i < num_two_view_geometry_poses && file.good(); ++i) {
+    const image_pair_t pair_id = ReadBinaryLittleEndian<image_pair_t>(&file);
+    TwoViewGeometry two_view_geometry;
+    Rigid3d& cam2_from_cam1 = two_view_geometry.cam2_from_cam1;
+    two_view_geometry.config = ReadBinaryLittleEndian<int>(&file);
+    cam2_from_cam1.rotation.w() = ReadBinaryLittleEndian<double>(&file);
+    cam2_from_cam1.rotation.x() = ReadBinaryLittleEndian<double>(&file);
+    cam2_from_cam1.rotation.y() = ReadBinaryLittleEndian<double>(&file);
+    cam2_from_cam1.rotation.z() = ReadBinaryLittleEndian<double>(&file);
+    cam2_from_cam1.translation.x() = ReadBinaryLittleEndian<double>(&file);
+    cam2_from_cam1.translation.y() = ReadBinaryLittleEndian<double>(&file);
+    cam2_from_cam1.translation.z() = ReadBinaryLittleEndian<double>(&file);
+    two_view_geometry.tri_angle = ReadBinaryLittleEndian<double>(&file);
+    cache->two_view_geometry_poses_.emplace(pair_id,
+                                            std::move(two_view_geometry));
+  }
+  if (!file.good()) {
+    return nullptr;
+  }
+
+  for (auto& image : cache->images_) {
+    if (!cache->correspondence_graph_->ExistsImage(image.first) ||
+        !cache->ExistsCamera(image.second.CameraId())) {
+      return nullptr;
+    }
+    image.second.SetNumObservations(
+        cache->correspondence_graph_->NumObservationsForImage(image.first));
+    image.second.SetNumCorrespondences(
+        cache->correspondence_graph_->NumCorrespondencesForImage(image.first));
+  }
 
   return cache;
 }
 
+std::string DatabaseCache::SnapshotKey(
+    const Database& database,
+    const size_t min_num_matches,
+    const bool ignore_watermarks,
+    const std::unordered_set<std::string>& image_names) {
+  std::ostringstream key;
+  key << database.NumCameras() << ";" << database.NumImages() << ";"
+      << database.NumKeypoints() << ";" << database.NumVerifiedImagePairs()
+      << ";" << database.NumInlierMatches() << ";" << min_num_matches << ";"
+      << ignore_watermarks << ";" << std::hex
+      << CameraAndImageRowsHash(database) << std::dec;
+  std::vector<std::string> sorted_image_names(image_names.begin(),
+                                              image_names.end());
+  std::sort(sorted_image_names.begin(), sorted_image_names.end());
+  for (const auto& image_name : sorted_image_names) {
+    key << ";" << image_name;
+  }
+  return key.str();
+}
+
+std::shared_ptr<DatabaseCache> DatabaseCache::CreateSubset(
+    const DatabaseCache& cache, const std::unordered_set<image_t>& image_ids) {
+  auto subset = std::make_shared<DatabaseCache>();
+
+  const class CorrespondenceGraph& correspondence_graph =
+      *cache.correspondence_graph_;
+
+  // Collect the correspondences between all images of the subset in a single
+  // pass over the correspondence graph of the source cache.
+  std::unordered_map<image_pair_t, FeatureMatches> image_pair_matches;
+  std::unordered_set<image_t> connected_image_ids;
+  connected_image_ids.reserve(image_ids.size());
+  for (const image_t image_id1 : image_ids) {
+    if (!correspondence_graph.ExistsImage(image_id1)) {
+      continue;
+    }
+    const point2D_t num_points2D = cache.Image(image_id1).NumPoints2D();
+    for (point2D_t point2D_idx1 = 0; point2D_idx1 < num_points2D;
+         ++point2D_idx1) {
+      const auto range =
+          correspondence_graph.FindCorrespondences(image_id1, point2D_idx1);
+      for (const auto* corr = range.beg; corr < range.end; ++corr) {
+        // Each correspondence is stored for both images, only keep one.
+        if (corr->image_id <= image_id1 ||
+            image_ids.count(corr->image_id) == 0) {
+          continue;
+        }
+        image_pair_matches[Database::ImagePairToPairId(image_id1,
+                                                       corr->image_id)]
+            .emplace_back(point2D_idx1, corr->point2D_idx);
+        connected_image_ids.insert(image_id1);
+        connected_image_ids.insert(corr->image_id);
+      }
+    }
+  }
+
+  subset->images_.reserve(connected_image_ids.size());
+  for (const image_t image_id : connected_image_ids) {
+    const class Image& image = cache.Image(image_id);
+    subset->images_.emplace(image_id, image);
+    if (subset->cameras_.count(image.CameraId()) == 0) {
+      subset->cameras_.emplace(image.CameraId(),
+                               cache.Camera(image.CameraId()));
+    }
+  }
+
+  subset->correspondence_graph_ = std::make_shared<class CorrespondenceGraph>();
+
+  for (const auto& image : subset->images_) {
+    subset->correspondence_graph_->AddImage(image.first,
+                                            image.second.NumPoints2D());
+  }
+
+  for (const auto& image_pair : image_pair_matches) {
+    image_t image_id1;
+    image_t image_id2;
+    Database::PairIdToImagePair(image_pair.first, &image_id1, &image_id2);
+    // The matches were collected from the image with the smaller id, which
+    // is also the first image of the pair.
+    subset->correspondence_graph_->AddCorrespondences(
+        image_id1, image_id2, image_pair.second);
+  }
+
+  subset->correspondence_graph_->Finalize();
+
+  for (const auto& two_view_geometry : cache.two_view_geometry_poses_) {
+    image_t image_id1;
+    image_t image_id2;
+    Database::PairIdToImagePair(
+        two_view_geometry.first, &image_id1, &image_id2);
+    if (subset->ExistsImage(image_id1) && subset->ExistsImage(image_id2)) {
+      subset->two_view_geometry_poses_.insert(two_view_geometry);
+    }
+  }
+
+  for (auto& image : subset->images_) {
+    image.second.SetNumObservations(
+        subset->correspondence_graph_->NumObservationsForImage(image.first));
+    image.second.SetNumCorrespondences(
+        subset->correspondence_graph_->NumCorrespondencesForImage(image.first));
+  }
+
+  return subset;
+}
+
 const class Image* DatabaseCache::FindImageWithName(
     const std::string& name) const {
   for (const auto& image : images_) {
@@ -204,4 +815,19 @@ const class Image* DatabaseCache::FindImageWithName(
   return nullptr;
 }
 
+size_t DatabaseCache::MemoryUsage() const {
+  size_t memory_usage = cameras_.MemoryUsage() + images_.MemoryUsage();
+  for (const auto& camera : cameras_) {
+    memory_usage += camera.second.MemoryUsage();
+  }
+  for (const auto& image : images_) {
+    memory_usage += image.second.MemoryUsage();
+  }
+  if (correspondence_graph_) {
+    memory_usage += correspondence_graph_->MemoryUsage();
+  }
+  memory_usage += HashTableMemoryUsage(two_view_geometry_poses_);
+  return memory_usage;
+}
+
 }  // namespace colmap
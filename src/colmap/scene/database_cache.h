@@ -34,6 +34,7 @@
 #include "colmap/scene/database.h"
 #include "colmap/scene/image.h"
 #include "colmap/sensor/models.h"
+#include "colmap/util/dense_id_map.h"
 #include "colmap/util/eigen_alignment.h"
 #include "colmap/util/types.h"
 
@@ -59,12 +60,76 @@ class DatabaseCache {
   // @param ignore_watermarks     Whether to ignore watermark image pairs.
   // @param image_names           Whether to use only load the data for a subset
   //                              of the images. All images are used if empty.
+  // @param correspondence_graph_cache_path
+  //                              Optional path of a binary cache file of the
+  //                              correspondence graph. If the file matches the
+  //                              database and options, the graph is read from
+  //                              it instead of being rebuilt from the matches,
+  //                              otherwise the rebuilt graph is written to it.
   static std::shared_ptr<DatabaseCache> Create(
+      const Database& database,
+      size_t min_num_matches,
+      bool ignore_watermarks,
+      const std::unordered_set<std::string>& image_names,
+      const std::string& correspondence_graph_cache_path = "");
+
+  // Load the cache from a snapshot file if it was saved for the same database
+  // contents and options, otherwise create the cache from the database and
+  // save it as a new snapshot. Equivalent to `Create` if the snapshot path is
+  // empty.
+  //
+  // @param snapshot_path         Path of the snapshot file.
+  static std::shared_ptr<DatabaseCache> CreateOrLoadSnapshot(
+      const Database& database,
+      size_t min_num_matches,
+      bool ignore_watermarks,
+      const std::unordered_set<std::string>& image_names,
+      const std::string& snapshot_path);
+
+  // Enable or disable the process-wide retention of loaded caches, which is
+  // used by long-running processes, such as `colmap serve`, that run many jobs
+  // on the same database. The most recent cache of every database path is
+  // retained until retention is disabled again. Disabled by default.
+  static void SetRetainCaches(bool retain);
+
+  // Return the retained cache of a previous call with the same database path,
+  // if its snapshot key still matches the database, and otherwise load the
+  // cache as in `CreateOrLoadSnapshot`, retaining it if enabled.
+  static std::shared_ptr<const DatabaseCache> CreateOrRetain(
+      const std::string& database_path,
+      size_t min_num_matches,
+      bool ignore_watermarks,
+      const std::unordered_set<std::string>& image_names,
+      const std::string& snapshot_path);
+
+  // Save/load the cache to/from a versioned binary snapshot file. The key
+  // identifies the source of the cache and loading returns null if the file is
+  // missing, invalid, or was saved with a different key.
+  void SaveSnapshot(const std::string& path, const std::string& key) const;
+  static std::shared_ptr<DatabaseCache> LoadSnapshot(const std::string& path,
+                                                     const std::string& key);
+
+  // Key of a snapshot that identifies the database by the number of its
+  // cameras, images, features, and matches, a hash of the contents of its
+  // camera and image rows, i.e., of the intrinsics and pose priors, together
+  // with the loading options. The modification time of the database file is
+  // not used, since opening a database already updates it.
+  static std::string SnapshotKey(
       const Database& database,
       size_t min_num_matches,
       bool ignore_watermarks,
       const std::unordered_set<std::string>& image_names);
 
+  // Create a cache for a subset of the images of an existing cache without
+  // accessing the database again, e.g., to reconstruct multiple clusters of
+  // the same scene in parallel. As in `Create`, images without any
+  // correspondences to the other images of the subset are discarded.
+  //
+  // @param cache                 Source cache from which to copy data.
+  // @param image_ids             The images of the subset.
+  static std::shared_ptr<DatabaseCache> CreateSubset(
+      const DatabaseCache& cache, const std::unordered_set<image_t>& image_ids);
+
   // Get number of objects.
   inline size_t NumCameras() const;
   inline size_t NumImages() const;
@@ -76,8 +141,8 @@ class DatabaseCache {
   inline const class Image& Image(image_t image_id) const;
 
   // Get all objects.
-  inline const std::unordered_map<camera_t, struct Camera>& Cameras() const;
-  inline const std::unordered_map<image_t, class Image>& Images() const;
+  inline const DenseIdMap<camera_t, struct Camera>& Cameras() const;
+  inline const DenseIdMap<image_t, class Image>& Images() const;
 
   // Check whether specific object exists.
   inline bool ExistsCamera(camera_t camera_id) const;
@@ -87,14 +152,27 @@ class DatabaseCache {
   inline std::shared_ptr<const class CorrespondenceGraph> CorrespondenceGraph()
       const;
 
+  // Get the relative pose and triangulation angle of an image pair, which were
+  // estimated and stored during matching, as a two-view geometry without
+  // inlier matches. The inlier matches are the correspondences of the pair.
+  // The pose is relative to the order of the images in the pair identifier.
+  // Returns null if no pose was stored for the pair.
+  inline const TwoViewGeometry* FindTwoViewGeometryPose(
+      image_pair_t pair_id) const;
+
   // Find specific image by name. Note that this uses linear search.
   const class Image* FindImageWithName(const std::string& name) const;
 
+  // Estimate the heap memory in bytes allocated by the cache, including the
+  // correspondence graph.
+  size_t MemoryUsage() const;
+
  private:
   std::shared_ptr<class CorrespondenceGraph> correspondence_graph_;
 
-  std::unordered_map<camera_t, struct Camera> cameras_;
-  std::unordered_map<image_t, class Image> images_;
+  DenseIdMap<camera_t, struct Camera> cameras_;
+  DenseIdMap<image_t, class Image> images_;
+  std::unordered_map<image_pair_t, TwoViewGeometry> two_view_geometry_poses_;
 };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -120,12 +198,11 @@ const class Image& DatabaseCache::Image(const image_t image_id) const {
   return images_.at(image_id);
 }
 
-const std::unordered_map<camera_t, struct Camera>& DatabaseCache::Cameras()
-    const {
+const DenseIdMap<camera_t, struct Camera>& DatabaseCache::Cameras() const {
   return cameras_;
 }
 
-const std::unordered_map<image_t, class Image>& DatabaseCache::Images() const {
+const DenseIdMap<image_t, class Image>& DatabaseCache::Images() const {
   return images_;
 }
 
@@ -142,4 +219,13 @@ DatabaseCache::CorrespondenceGraph() const {
   return correspondence_graph_;
 }
 
+const TwoViewGeometry* DatabaseCache::FindTwoViewGeometryPose(
+    const image_pair_t pair_id) const {
+  const auto it = two_view_geometry_poses_.find(pair_id);
+  if (it == two_view_geometry_poses_.end()) {
+    return nullptr;
+  }
+  return &it->second;
+}
+
 }  // namespace colmap
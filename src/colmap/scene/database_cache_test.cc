@@ -29,6 +29,9 @@
 
 #include "colmap/scene/database_cache.h"
 
+#include "colmap/util/misc.h"
+#include "colmap/util/testing.h"
+
 #include <gtest/gtest.h>
 
 namespace colmap {
@@ -90,5 +93,338 @@ TEST(DatabaseCache, Nominal) {
             1);
 }
 
+TEST(DatabaseCache, CorrespondenceGraphCache) {
+  const std::string cache_path =
+      CreateTestDir() + "/correspondence_graph.bin";
+  Database database(Database::kInMemoryDatabasePath);
+  const Camera camera = Camera::CreateFromModelId(
+      kInvalidCameraId, SimplePinholeCameraModel::model_id, 1, 1, 1);
+  const camera_t camera_id = database.WriteCamera(camera);
+  std::vector<image_t> image_ids;
+  for (int i = 0; i < 3; ++i) {
+    Image image;
+    image.SetName("image" + std::to_string(i));
+    image.SetCameraId(camera_id);
+    image_ids.push_back(database.WriteImage(image));
+    database.WriteKeypoints(image_ids.back(), FeatureKeypoints(10));
+  }
+  TwoViewGeometry two_view_geometry;
+  two_view_geometry.config = TwoViewGeometry::ConfigurationType::CALIBRATED;
+  two_view_geometry.inlier_matches = {{0, 1}, {2, 3}};
+  database.WriteTwoViewGeometry(image_ids[0], image_ids[1], two_view_geometry);
+
+  auto cache = DatabaseCache::Create(database,
+                                     /*min_num_matches=*/0,
+                                     /*ignore_watermarks=*/false,
+                                     /*image_names=*/{},
+                                     cache_path);
+  EXPECT_TRUE(ExistsFile(cache_path));
+  EXPECT_EQ(cache->NumImages(), 2);
+
+  auto cached_cache = DatabaseCache::Create(database,
+                                            /*min_num_matches=*/0,
+                                            /*ignore_watermarks=*/false,
+                                            /*image_names=*/{},
+                                            cache_path);
+  EXPECT_EQ(cached_cache->NumImages(), 2);
+  EXPECT_FALSE(cached_cache->ExistsImage(image_ids[2]));
+  EXPECT_EQ(cached_cache->Image(image_ids[0]).NumPoints2D(), 10);
+  EXPECT_EQ(cached_cache->Image(image_ids[0]).NumCorrespondences(), 2);
+  EXPECT_EQ(cached_cache->CorrespondenceGraph()
+                ->FindCorrespondencesBetweenImages(image_ids[0], image_ids[1])
+                .size(),
+            2);
+
+  // New matches in the database invalidate the cached correspondence graph.
+  two_view_geometry.inlier_matches = {{4, 5}};
+  database.WriteTwoViewGeometry(image_ids[2], image_ids[1], two_view_geometry);
+  auto updated_cache = DatabaseCache::Create(database,
+                                             /*min_num_matches=*/0,
+                                             /*ignore_watermarks=*/false,
+                                             /*image_names=*/{},
+                                             cache_path);
+  EXPECT_EQ(updated_cache->NumImages(), 3);
+  EXPECT_EQ(updated_cache->Image(image_ids[2]).NumCorrespondences(), 1);
+}
+
+TEST(DatabaseCache, Snapshot) {
+  const std::string snapshot_path = CreateTestDir() + "/database_cache.bin";
+  Database database(Database::kInMemoryDatabasePath);
+  Camera camera = Camera::CreateFromModelId(
+      kInvalidCameraId, SimplePinholeCameraModel::model_id, 1, 1, 1);
+  camera.has_prior_focal_length = true;
+  const camera_t camera_id = database.WriteCamera(camera);
+  std::vector<image_t> image_ids;
+  for (int i = 0; i < 2; ++i) {
+    Image image;
+    image.SetName("image" + std::to_string(i));
+    image.SetCameraId(camera_id);
+    image.CamFromWorldPrior() =
+        Rigid3d(Eigen::Quaterniond::UnitRandom(), Eigen::Vector3d::Random());
+    image_ids.push_back(database.WriteImage(image));
+    FeatureKeypoints keypoints(10);
+    keypoints[3] = FeatureKeypoint(1, 2);
+    database.WriteKeypoints(image_ids.back(), keypoints);
+  }
+  TwoViewGeometry two_view_geometry;
+  two_view_geometry.config = TwoViewGeometry::ConfigurationType::CALIBRATED;
+  two_view_geometry.inlier_matches = {{0, 1}, {2, 3}};
+  two_view_geometry.cam2_from_cam1 =
+      Rigid3d(Eigen::Quaterniond::UnitRandom(), Eigen::Vector3d::Random());
+  two_view_geometry.tri_angle = 0.25;
+  database.WriteTwoViewGeometry(image_ids[0], image_ids[1], two_view_geometry);
+
+  EXPECT_TRUE(DatabaseCache::LoadSnapshot(snapshot_path, "key") == nullptr);
+  auto cache = DatabaseCache::CreateOrLoadSnapshot(database,
+                                                   /*min_num_matches=*/0,
+                                                   /*ignore_watermarks=*/false,
+                                                   /*image_names=*/{},
+                                                   snapshot_path);
+  EXPECT_TRUE(ExistsFile(snapshot_path));
+  const std::string key =
+      DatabaseCache::SnapshotKey(database,
+                                 /*min_num_matches=*/0,
+                                 /*ignore_watermarks=*/false,
+                                 /*image_names=*/{});
+  EXPECT_NE(key,
+            DatabaseCache::SnapshotKey(database,
+                                       /*min_num_matches=*/5,
+                                       /*ignore_watermarks=*/false,
+                                       /*image_names=*/{}));
+  EXPECT_TRUE(DatabaseCache::LoadSnapshot(snapshot_path, "key") == nullptr);
+
+  auto snapshot = DatabaseCache::LoadSnapshot(snapshot_path, key);
+  ASSERT_TRUE(snapshot != nullptr);
+  EXPECT_EQ(snapshot->NumCameras(), 1);
+  EXPECT_EQ(snapshot->Camera(camera_id).model_id, camera.model_id);
+  EXPECT_EQ(snapshot->Camera(camera_id).params, camera.params);
+  EXPECT_TRUE(snapshot->Camera(camera_id).has_prior_focal_length);
+  EXPECT_EQ(snapshot->NumImages(), 2);
+  for (const image_t image_id : image_ids) {
+    const Image& image = cache->Image(image_id);
+    const Image& snapshot_image = snapshot->Image(image_id);
+    EXPECT_EQ(snapshot_image.Name(), image.Name());
+    EXPECT_EQ(snapshot_image.CameraId(), image.CameraId());
+    EXPECT_EQ(snapshot_image.CamFromWorldPrior().ToMatrix(),
+              image.CamFromWorldPrior().ToMatrix());
+    ASSERT_EQ(snapshot_image.NumPoints2D(), image.NumPoints2D());
+    EXPECT_EQ(snapshot_image.Point2D(3).xy, image.Point2D(3).xy);
+    EXPECT_EQ(snapshot_image.NumObservations(), image.NumObservations());
+    EXPECT_EQ(snapshot_image.NumCorrespondences(), image.NumCorrespondences());
+  }
+  EXPECT_EQ(snapshot->CorrespondenceGraph()->NumCorrespondencesBetweenImages(
+                image_ids[0], image_ids[1]),
+            2);
+  const TwoViewGeometry* snapshot_two_view_geometry =
+      snapshot->FindTwoViewGeometryPose(
+          Database::ImagePairToPairId(image_ids[0], image_ids[1]));
+  ASSERT_TRUE(snapshot_two_view_geometry != nullptr);
+  EXPECT_EQ(snapshot_two_view_geometry->config, two_view_geometry.config);
+  EXPECT_EQ(snapshot_two_view_geometry->cam2_from_cam1.ToMatrix(),
+            two_view_geometry.cam2_from_cam1.ToMatrix());
+  EXPECT_EQ(snapshot_two_view_geometry->tri_angle, two_view_geometry.tri_angle);
+}
+
+TEST(DatabaseCache, SnapshotInvalidatedByCamerasAndPriors) {
+  const std::string snapshot_path = CreateTestDir() + "/database_cache.bin";
+  Database database(Database::kInMemoryDatabasePath);
+  Camera camera = Camera::CreateFromModelId(
+      kInvalidCameraId, SimplePinholeCameraModel::model_id, 1, 1, 1);
+  camera.camera_id = database.WriteCamera(camera);
+  std::vector<image_t> image_ids;
+  for (int i = 0; i < 2; ++i) {
+    Image image;
+    image.SetName("image" + std::to_string(i));
+    image.SetCameraId(camera.camera_id);
+    image_ids.push_back(database.WriteImage(image));
+    database.WriteKeypoints(image_ids.back(), FeatureKeypoints(10));
+  }
+  TwoViewGeometry two_view_geometry;
+  two_view_geometry.config = TwoViewGeometry::ConfigurationType::CALIBRATED;
+  two_view_geometry.inlier_matches = {{0, 1}, {2, 3}};
+  database.WriteTwoViewGeometry(image_ids[0], image_ids[1], two_view_geometry);
+
+  auto SnapshotKey = [&database]() {
+    return DatabaseCache::SnapshotKey(database,
+                                      /*min_num_matches=*/0,
+                                      /*ignore_watermarks=*/false,
+                                      /*image_names=*/{});
+  };
+  auto CreateOrLoadSnapshot = [&database, &snapshot_path]() {
+    return DatabaseCache::CreateOrLoadSnapshot(database,
+                                               /*min_num_matches=*/0,
+                                               /*ignore_watermarks=*/false,
+                                               /*image_names=*/{},
+                                               snapshot_path);
+  };
+
+  CreateOrLoadSnapshot();
+  const std::string key = SnapshotKey();
+  ASSERT_TRUE(DatabaseCache::LoadSnapshot(snapshot_path, key) != nullptr);
+
+  // Changing the intrinsics does not change any row count of the database.
+  camera.params[0] = 2;
+  database.UpdateCamera(camera);
+  const std::string camera_key = SnapshotKey();
+  EXPECT_NE(camera_key, key);
+  EXPECT_TRUE(DatabaseCache::LoadSnapshot(snapshot_path, camera_key) ==
+              nullptr);
+  EXPECT_EQ(CreateOrLoadSnapshot()->Camera(camera.camera_id).params,
+            camera.params);
+  EXPECT_TRUE(DatabaseCache::LoadSnapshot(snapshot_path, camera_key) !=
+              nullptr);
+
+  // Neither does changing the pose prior of an image.
+  Image image = database.ReadImage(image_ids[0]);
+  image.CamFromWorldPrior() =
+      Rigid3d(Eigen::Quaterniond::Identity(), Eigen::Vector3d(1, 2, 3));
+  database.UpdateImage(image);
+  const std::string prior_key = SnapshotKey();
+  EXPECT_NE(prior_key, camera_key);
+  EXPECT_TRUE(DatabaseCache::LoadSnapshot(snapshot_path, prior_key) ==
+              nullptr);
+  EXPECT_EQ(CreateOrLoadSnapshot()
+                ->Image(image_ids[0])
+                .CamFromWorldPrior()
+                .translation,
+            Eigen::Vector3d(1, 2, 3));
+}
+
+TEST(DatabaseCache, RetainCaches) {
+  const std::string database_path = CreateTestDir() + "/database.db";
+  Database database(database_path);
+  const camera_t camera_id = database.WriteCamera(Camera::CreateFromModelId(
+      kInvalidCameraId, SimplePinholeCameraModel::model_id, 1, 1, 1));
+  std::vector<image_t> image_ids;
+  for (int i = 0; i < 3; ++i) {
+    Image image;
+    image.SetName("image" + std::to_string(i));
+    image.SetCameraId(camera_id);
+    image_ids.push_back(database.WriteImage(image));
+    database.WriteKeypoints(image_ids.back(), FeatureKeypoints(10));
+  }
+  TwoViewGeometry two_view_geometry;
+  two_view_geometry.config = TwoViewGeometry::ConfigurationType::CALIBRATED;
+  two_view_geometry.inlier_matches = {{0, 1}, {2, 3}};
+  database.WriteTwoViewGeometry(image_ids[0], image_ids[1], two_view_geometry);
+
+  const auto CreateOrRetain = [&database_path]() {
+    return DatabaseCache::CreateOrRetain(database_path,
+                                         /*min_num_matches=*/0,
+                                         /*ignore_watermarks=*/false,
+                                         /*image_names=*/{},
+                                         /*snapshot_path=*/"");
+  };
+
+  EXPECT_NE(CreateOrRetain(), CreateOrRetain());
+
+  DatabaseCache::SetRetainCaches(true);
+  const auto cache = CreateOrRetain();
+  EXPECT_EQ(cache->NumImages(), 2);
+  EXPECT_EQ(CreateOrRetain(), cache);
+
+  // Changes of the database invalidate the retained cache.
+  database.WriteTwoViewGeometry(image_ids[1], image_ids[2], two_view_geometry);
+  const auto updated_cache = CreateOrRetain();
+  EXPECT_NE(updated_cache, cache);
+  EXPECT_EQ(updated_cache->NumImages(), 3);
+  EXPECT_EQ(CreateOrRetain(), updated_cache);
+
+  DatabaseCache::SetRetainCaches(false);
+  EXPECT_NE(CreateOrRetain(), updated_cache);
+}
+
+TEST(DatabaseCache, TwoViewGeometryPoses) {
+  Database database(Database::kInMemoryDatabasePath);
+  const Camera camera = Camera::CreateFromModelId(
+      kInvalidCameraId, SimplePinholeCameraModel::model_id, 1, 1, 1);
+  const camera_t camera_id = database.WriteCamera(camera);
+  std::vector<image_t> image_ids;
+  for (int i = 0; i < 3; ++i) {
+    Image image;
+    image.SetName("image" + std::to_string(i));
+    image.SetCameraId(camera_id);
+    image_ids.push_back(database.WriteImage(image));
+    database.WriteKeypoints(image_ids.back(), FeatureKeypoints(10));
+  }
+  TwoViewGeometry two_view_geometry;
+  two_view_geometry.config = TwoViewGeometry::ConfigurationType::REFRACTIVE;
+  two_view_geometry.inlier_matches = {{0, 1}, {2, 3}};
+  database.WriteTwoViewGeometry(image_ids[0], image_ids[1], two_view_geometry);
+  two_view_geometry.cam2_from_cam1 =
+      Rigid3d(Eigen::Quaterniond::UnitRandom(), Eigen::Vector3d::Random());
+  two_view_geometry.tri_angle = 0.1;
+  // Stored in the swapped order of the pair.
+  database.WriteTwoViewGeometry(image_ids[2], image_ids[1], two_view_geometry);
+
+  auto cache = DatabaseCache::Create(database,
+                                     /*min_num_matches=*/0,
+                                     /*ignore_watermarks=*/false,
+                                     /*image_names=*/{});
+  EXPECT_TRUE(cache->FindTwoViewGeometryPose(Database::ImagePairToPairId(
+                  image_ids[0], image_ids[1])) == nullptr);
+  const TwoViewGeometry* cached_two_view_geometry =
+      cache->FindTwoViewGeometryPose(
+          Database::ImagePairToPairId(image_ids[1], image_ids[2]));
+  ASSERT_TRUE(cached_two_view_geometry != nullptr);
+  EXPECT_EQ(cached_two_view_geometry->config, two_view_geometry.config);
+  EXPECT_TRUE(cached_two_view_geometry->inlier_matches.empty());
+  EXPECT_EQ(cached_two_view_geometry->tri_angle, two_view_geometry.tri_angle);
+  EXPECT_TRUE(cached_two_view_geometry->cam2_from_cam1.ToMatrix().isApprox(
+      Inverse(two_view_geometry.cam2_from_cam1).ToMatrix()));
+
+  auto subset =
+      DatabaseCache::CreateSubset(*cache, {image_ids[0], image_ids[1]});
+  EXPECT_TRUE(subset->FindTwoViewGeometryPose(Database::ImagePairToPairId(
+                  image_ids[1], image_ids[2])) == nullptr);
+}
+
+TEST(DatabaseCache, CreateSubset) {
+  Database database(Database::kInMemoryDatabasePath);
+  const Camera camera = Camera::CreateFromModelId(
+      kInvalidCameraId, SimplePinholeCameraModel::model_id, 1, 1, 1);
+  const camera_t camera_id = database.WriteCamera(camera);
+  std::vector<image_t> image_ids;
+  for (int i = 0; i < 3; ++i) {
+    Image image;
+    image.SetName("image" + std::to_string(i));
+    image.SetCameraId(camera_id);
+    image_ids.push_back(database.WriteImage(image));
+    database.WriteKeypoints(image_ids.back(), FeatureKeypoints(10));
+  }
+  TwoViewGeometry two_view_geometry;
+  two_view_geometry.config = TwoViewGeometry::ConfigurationType::CALIBRATED;
+  two_view_geometry.inlier_matches = {{0, 1}, {2, 3}};
+  database.WriteTwoViewGeometry(image_ids[0], image_ids[1], two_view_geometry);
+  two_view_geometry.inlier_matches = {{4, 5}};
+  database.WriteTwoViewGeometry(image_ids[2], image_ids[1], two_view_geometry);
+  auto cache = DatabaseCache::Create(database,
+                                     /*min_num_matches=*/0,
+                                     /*ignore_watermarks=*/false,
+                                     /*image_names=*/{});
+  EXPECT_EQ(cache->NumImages(), 3);
+
+  auto subset =
+      DatabaseCache::CreateSubset(*cache, {image_ids[1], image_ids[2]});
+  EXPECT_EQ(subset->NumCameras(), 1);
+  EXPECT_EQ(subset->NumImages(), 2);
+  EXPECT_FALSE(subset->ExistsImage(image_ids[0]));
+  EXPECT_EQ(subset->Image(image_ids[1]).NumPoints2D(), 10);
+  EXPECT_EQ(subset->Image(image_ids[1]).NumCorrespondences(), 1);
+  EXPECT_EQ(subset->Image(image_ids[2]).NumCorrespondences(), 1);
+  const FeatureMatches matches =
+      subset->CorrespondenceGraph()->FindCorrespondencesBetweenImages(
+          image_ids[2], image_ids[1]);
+  ASSERT_EQ(matches.size(), 1);
+  EXPECT_EQ(matches[0].point2D_idx1, 4);
+  EXPECT_EQ(matches[0].point2D_idx2, 5);
+
+  // Images without correspondences within the subset are discarded.
+  EXPECT_EQ(
+      DatabaseCache::CreateSubset(*cache, {image_ids[0], image_ids[2]})
+          ->NumImages(),
+      0);
+}
+
 }  // namespace
 }  // namespace colmap
@@ -31,7 +31,9 @@
 
 #include "colmap/geometry/pose.h"
 #include "colmap/util/eigen_alignment.h"
+#include "colmap/util/testing.h"
 
+#include <algorithm>
 #include <thread>
 
 #include <Eigen/Geometry>
@@ -71,6 +73,49 @@ TEST(Database, TransactionMultiThreaded) {
   thread2.join();
 }
 
+TEST(Database, ReaderPool) {
+  const std::string database_path = CreateTestDir() + "/database.db";
+  Database database(database_path);
+  EXPECT_FALSE(database.Path().empty());
+  Image image;
+  image.SetName("test");
+  image.SetCameraId(database.WriteCamera(Camera::CreateFromModelName(
+      kInvalidCameraId, "SIMPLE_PINHOLE", 1.0, 1, 1)));
+  const image_t image_id = database.WriteImage(image);
+  database.WriteKeypoints(image_id, FeatureKeypoints(10));
+
+  DatabaseReaderPool readers(&database);
+  EXPECT_FALSE(readers.IsShared());
+  const Database* main_reader = &readers.Reader();
+  EXPECT_NE(main_reader, &database);
+  EXPECT_EQ(main_reader, &readers.Reader());
+  EXPECT_EQ(main_reader->ReadKeypoints(image_id).size(), 10);
+
+  std::thread thread([&]() {
+    const Database& reader = readers.Reader();
+    EXPECT_NE(&reader, main_reader);
+    EXPECT_EQ(reader.ReadKeypoints(image_id).size(), 10);
+    EXPECT_EQ(reader.ReadImageWithName("test").ImageId(), image_id);
+  });
+  thread.join();
+
+  // The readers do not see uncommitted changes.
+  {
+    DatabaseTransaction database_transaction(&database);
+    database.WriteDescriptors(image_id, FeatureDescriptors::Random(10, 128));
+    EXPECT_FALSE(main_reader->ExistsDescriptors(image_id));
+  }
+  EXPECT_TRUE(main_reader->ExistsDescriptors(image_id));
+}
+
+TEST(Database, ReaderPoolInMemory) {
+  Database database(Database::kInMemoryDatabasePath);
+  EXPECT_EQ(database.Path(), "");
+  DatabaseReaderPool readers(&database);
+  EXPECT_TRUE(readers.IsShared());
+  EXPECT_EQ(&readers.Reader(), &database);
+}
+
 TEST(Database, Empty) {
   Database database(Database::kInMemoryDatabasePath);
   EXPECT_EQ(database.NumCameras(), 0);
@@ -276,6 +321,53 @@ TEST(Database, Descriptors) {
   EXPECT_EQ(database.NumDescriptorsForImage(image.ImageId()), 0);
 }
 
+TEST(Database, ReadImageIdsWithFeatures) {
+  Database database(Database::kInMemoryDatabasePath);
+  Camera camera;
+  camera.camera_id = database.WriteCamera(camera);
+  Image image;
+  image.SetCameraId(camera.camera_id);
+  image.SetName("test1");
+  const image_t image_id1 = database.WriteImage(image);
+  image.SetName("test2");
+  const image_t image_id2 = database.WriteImage(image);
+  image.SetName("test3");
+  const image_t image_id3 = database.WriteImage(image);
+  EXPECT_TRUE(database.ReadImageIdsWithFeatures().empty());
+  database.WriteKeypoints(image_id1, FeatureKeypoints(10));
+  database.WriteDescriptors(image_id1, FeatureDescriptors(10, 128));
+  database.WriteKeypoints(image_id2, FeatureKeypoints(10));
+  database.WriteDescriptors(image_id3, FeatureDescriptors(10, 128));
+  EXPECT_EQ(database.ReadImageIdsWithFeatures(),
+            std::vector<image_t>{image_id1});
+}
+
+TEST(Database, DescriptorCodes) {
+  Database database(Database::kInMemoryDatabasePath);
+  Camera camera;
+  camera.camera_id = database.WriteCamera(camera);
+  Image image;
+  image.SetName("test");
+  image.SetCameraId(camera.camera_id);
+  image.SetImageId(database.WriteImage(image));
+  EXPECT_FALSE(database.ExistsDescriptorCodes(image.ImageId()));
+  EXPECT_FALSE(database.ExistsDescriptorCodebook());
+  const FeatureDescriptors codes = FeatureDescriptors::Random(10, 16);
+  database.WriteDescriptorCodes(image.ImageId(), codes);
+  EXPECT_TRUE(database.ExistsDescriptorCodes(image.ImageId()));
+  EXPECT_EQ(database.ReadDescriptorCodes(image.ImageId()), codes);
+  const FeatureDescriptors codebook = FeatureDescriptors::Random(256, 128);
+  database.WriteDescriptorCodebook(codebook);
+  EXPECT_TRUE(database.ExistsDescriptorCodebook());
+  EXPECT_EQ(database.ReadDescriptorCodebook(), codebook);
+  const FeatureDescriptors codebook2 = FeatureDescriptors::Random(256, 128);
+  database.WriteDescriptorCodebook(codebook2);
+  EXPECT_EQ(database.ReadDescriptorCodebook(), codebook2);
+  database.ClearDescriptorCodes();
+  EXPECT_FALSE(database.ExistsDescriptorCodes(image.ImageId()));
+  EXPECT_FALSE(database.ExistsDescriptorCodebook());
+}
+
 TEST(Database, Matches) {
   Database database(Database::kInMemoryDatabasePath);
   const image_t image_id1 = 1;
@@ -314,6 +406,7 @@ TEST(Database, TwoViewGeometry) {
   two_view_geometry.H = Eigen::Matrix3d::Random();
   two_view_geometry.cam2_from_cam1 =
       Rigid3d(Eigen::Quaterniond::UnitRandom(), Eigen::Vector3d::Random());
+  two_view_geometry.tri_angle = 0.5;
   database.WriteTwoViewGeometry(image_id1, image_id2, two_view_geometry);
   const TwoViewGeometry two_view_geometry_read =
       database.ReadTwoViewGeometry(image_id1, image_id2);
@@ -334,6 +427,7 @@ TEST(Database, TwoViewGeometry) {
             two_view_geometry_read.cam2_from_cam1.rotation.coeffs());
   EXPECT_EQ(two_view_geometry.cam2_from_cam1.translation,
             two_view_geometry_read.cam2_from_cam1.translation);
+  EXPECT_EQ(two_view_geometry.tri_angle, two_view_geometry_read.tri_angle);
 
   const TwoViewGeometry two_view_geometry_read_inv =
       database.ReadTwoViewGeometry(image_id2, image_id1);
@@ -373,6 +467,18 @@ TEST(Database, TwoViewGeometry) {
             two_view_geometries[0].cam2_from_cam1.translation);
   EXPECT_EQ(two_view_geometry.inlier_matches.size(),
             two_view_geometries[0].inlier_matches.size());
+  EXPECT_EQ(two_view_geometry.tri_angle, two_view_geometries[0].tri_angle);
+  image_pair_ids.clear();
+  two_view_geometries.clear();
+  database.ReadTwoViewGeometryPoses(&image_pair_ids, &two_view_geometries);
+  ASSERT_EQ(image_pair_ids.size(), 1);
+  EXPECT_EQ(image_pair_ids[0],
+            Database::ImagePairToPairId(image_id1, image_id2));
+  EXPECT_EQ(two_view_geometry.config, two_view_geometries[0].config);
+  EXPECT_EQ(two_view_geometry.cam2_from_cam1.translation,
+            two_view_geometries[0].cam2_from_cam1.translation);
+  EXPECT_EQ(two_view_geometry.tri_angle, two_view_geometries[0].tri_angle);
+  EXPECT_TRUE(two_view_geometries[0].inlier_matches.empty());
   std::vector<std::pair<image_t, image_t>> image_pairs;
   std::vector<int> num_inliers;
   database.ReadTwoViewGeometryNumInliers(&image_pairs, &num_inliers);
@@ -390,6 +496,95 @@ TEST(Database, TwoViewGeometry) {
   EXPECT_EQ(database.NumInlierMatches(), 0);
 }
 
+TEST(Database, CompactInlierMatches) {
+  Database database(Database::kInMemoryDatabasePath);
+  database.SetCompactInlierMatches(true);
+
+  FeatureMatches matches;
+  for (point2D_t i = 0; i < 1000; ++i) {
+    matches.emplace_back(3 * (999 - i) + i % 2, (7919 * i) % 10007);
+  }
+  matches.emplace_back(kInvalidPoint2DIdx, kInvalidPoint2DIdx);
+  FeatureMatches sorted_matches = matches;
+  std::sort(sorted_matches.begin(),
+            sorted_matches.end(),
+            [](const FeatureMatch& match1, const FeatureMatch& match2) {
+              return match1.point2D_idx1 < match2.point2D_idx1;
+            });
+
+  TwoViewGeometry two_view_geometry;
+  two_view_geometry.inlier_matches = matches;
+  database.WriteTwoViewGeometry(1, 2, two_view_geometry);
+  two_view_geometry.inlier_matches = {FeatureMatch(5, 0)};
+  database.WriteTwoViewGeometry(1, 3, two_view_geometry);
+  two_view_geometry.inlier_matches.clear();
+  database.WriteTwoViewGeometry(2, 3, two_view_geometry);
+  database.SetCompactInlierMatches(false);
+  two_view_geometry.inlier_matches = matches;
+  database.WriteTwoViewGeometry(3, 4, two_view_geometry);
+  EXPECT_EQ(database.NumInlierMatches(), 2 * matches.size() + 1);
+
+  auto ExpectEqualMatches = [](const FeatureMatches& matches1,
+                               const FeatureMatches& matches2) {
+    ASSERT_EQ(matches1.size(), matches2.size());
+    for (size_t i = 0; i < matches1.size(); ++i) {
+      EXPECT_EQ(matches1[i].point2D_idx1, matches2[i].point2D_idx1);
+      EXPECT_EQ(matches1[i].point2D_idx2, matches2[i].point2D_idx2);
+    }
+  };
+
+  ExpectEqualMatches(database.ReadTwoViewGeometry(1, 2).inlier_matches,
+                     sorted_matches);
+  const FeatureMatches inv_matches =
+      database.ReadTwoViewGeometry(2, 1).inlier_matches;
+  ASSERT_EQ(inv_matches.size(), sorted_matches.size());
+  for (size_t i = 0; i < inv_matches.size(); ++i) {
+    EXPECT_EQ(inv_matches[i].point2D_idx1, sorted_matches[i].point2D_idx2);
+    EXPECT_EQ(inv_matches[i].point2D_idx2, sorted_matches[i].point2D_idx1);
+  }
+  ExpectEqualMatches(database.ReadTwoViewGeometry(1, 3).inlier_matches,
+                     {FeatureMatch(5, 0)});
+  EXPECT_TRUE(database.ReadTwoViewGeometry(2, 3).inlier_matches.empty());
+  ExpectEqualMatches(database.ReadTwoViewGeometry(3, 4).inlier_matches,
+                     matches);
+
+  std::vector<image_pair_t> image_pair_ids;
+  std::vector<TwoViewGeometry> two_view_geometries;
+  database.ReadTwoViewGeometries(&image_pair_ids, &two_view_geometries);
+  // Pairs without inlier matches are not read.
+  ASSERT_EQ(image_pair_ids.size(), 3);
+  for (size_t i = 0; i < image_pair_ids.size(); ++i) {
+    if (image_pair_ids[i] == Database::ImagePairToPairId(1, 2)) {
+      ExpectEqualMatches(two_view_geometries[i].inlier_matches,
+                         sorted_matches);
+    } else if (image_pair_ids[i] == Database::ImagePairToPairId(3, 4)) {
+      ExpectEqualMatches(two_view_geometries[i].inlier_matches, matches);
+    }
+  }
+}
+
+TEST(Database, BestFitCameras) {
+  Database database(Database::kInMemoryDatabasePath);
+  EXPECT_TRUE(database.ReadAllBestFitCameras().empty());
+  Camera camera =
+      Camera::CreateFromModelName(kInvalidCameraId, "OPENCV", 1, 2, 3);
+  const std::string key("key\0with\0zeros", 15);
+  database.WriteBestFitCamera(key, camera);
+  camera.params[0] = 2;
+  database.WriteBestFitCamera(key, camera);
+  database.WriteBestFitCamera("key2", camera);
+  const auto best_fit_cameras = database.ReadAllBestFitCameras();
+  ASSERT_EQ(best_fit_cameras.size(), 2);
+  for (const auto& best_fit_camera : best_fit_cameras) {
+    EXPECT_TRUE(best_fit_camera.first == key ||
+                best_fit_camera.first == "key2");
+    EXPECT_EQ(best_fit_camera.second.model_id, camera.model_id);
+    EXPECT_EQ(best_fit_camera.second.width, camera.width);
+    EXPECT_EQ(best_fit_camera.second.height, camera.height);
+    EXPECT_EQ(best_fit_camera.second.params, camera.params);
+  }
+}
+
 TEST(Database, Merge) {
   Database database1(Database::kInMemoryDatabasePath);
   Database database2(Database::kInMemoryDatabasePath);
@@ -476,5 +671,98 @@ TEST(Database, Merge) {
   EXPECT_EQ(merged_database.NumMatches(), 0);
 }
 
+TEST(Database, MergeMatches) {
+  Database database(Database::kInMemoryDatabasePath);
+  Database shard_database(Database::kInMemoryDatabasePath);
+
+  Camera camera = Camera::CreateFromModelName(
+      kInvalidCameraId, "SIMPLE_PINHOLE", 1.0, 1, 1);
+  camera.camera_id = database.WriteCamera(camera);
+  camera.camera_id = shard_database.WriteCamera(camera);
+
+  Image image;
+  image.SetCameraId(camera.camera_id);
+  image.SetName("test1");
+  const image_t image_id1 = database.WriteImage(image);
+  image.SetName("test2");
+  const image_t image_id2 = database.WriteImage(image);
+  image.SetName("test3");
+  const image_t image_id3 = database.WriteImage(image);
+
+  // The images are written in a different order to the shard.
+  image.SetName("test3");
+  const image_t shard_image_id3 = shard_database.WriteImage(image);
+  image.SetName("test1");
+  const image_t shard_image_id1 = shard_database.WriteImage(image);
+  image.SetName("test2");
+  const image_t shard_image_id2 = shard_database.WriteImage(image);
+
+  database.WriteMatches(image_id1, image_id2, FeatureMatches(10));
+  database.WriteTwoViewGeometry(image_id1, image_id2, TwoViewGeometry());
+  shard_database.WriteMatches(
+      shard_image_id1, shard_image_id2, FeatureMatches(20));
+  shard_database.WriteMatches(
+      shard_image_id1, shard_image_id3, FeatureMatches(30));
+  TwoViewGeometry two_view_geometry;
+  two_view_geometry.config = TwoViewGeometry::CALIBRATED;
+  two_view_geometry.inlier_matches = FeatureMatches(5);
+  shard_database.WriteTwoViewGeometry(
+      shard_image_id1, shard_image_id3, two_view_geometry);
+
+  Database::MergeMatches(shard_database, &database);
+  EXPECT_EQ(database.NumImages(), 3);
+  EXPECT_EQ(database.NumMatchedImagePairs(), 2);
+  EXPECT_EQ(database.NumVerifiedImagePairs(), 2);
+  EXPECT_EQ(database.ReadMatches(image_id1, image_id2).size(), 10);
+  EXPECT_EQ(database.ReadMatches(image_id1, image_id3).size(), 30);
+  EXPECT_FALSE(database.ExistsMatches(image_id2, image_id3));
+  EXPECT_EQ(database.ReadTwoViewGeometry(image_id1, image_id3).config,
+            TwoViewGeometry::CALIBRATED);
+  EXPECT_EQ(
+      database.ReadTwoViewGeometry(image_id1, image_id3).inlier_matches.size(),
+      5);
+}
+
+TEST(Database, MergeMatchesSameImageIds) {
+  Database database(Database::kInMemoryDatabasePath);
+  Database shard_database(Database::kInMemoryDatabasePath);
+
+  Camera camera = Camera::CreateFromModelName(
+      kInvalidCameraId, "SIMPLE_PINHOLE", 1.0, 1, 1);
+  camera.camera_id = database.WriteCamera(camera);
+  camera.camera_id = shard_database.WriteCamera(camera);
+
+  Image image;
+  image.SetCameraId(camera.camera_id);
+  image.SetName("test1");
+  const image_t image_id1 = database.WriteImage(image);
+  shard_database.WriteImage(image);
+  image.SetName("test2");
+  const image_t image_id2 = database.WriteImage(image);
+  shard_database.WriteImage(image);
+  image.SetName("test3");
+  const image_t image_id3 = database.WriteImage(image);
+  shard_database.WriteImage(image);
+
+  database.WriteMatches(image_id1, image_id2, FeatureMatches(10));
+  shard_database.WriteMatches(image_id1, image_id2, FeatureMatches(20));
+  shard_database.WriteMatches(image_id3, image_id1, FeatureMatches(30));
+  TwoViewGeometry two_view_geometry;
+  two_view_geometry.config = TwoViewGeometry::CALIBRATED;
+  two_view_geometry.inlier_matches = FeatureMatches(5);
+  shard_database.WriteTwoViewGeometry(image_id3, image_id1, two_view_geometry);
+
+  Database::MergeMatches(shard_database, &database);
+  EXPECT_EQ(database.NumMatchedImagePairs(), 2);
+  EXPECT_EQ(database.NumVerifiedImagePairs(), 1);
+  EXPECT_EQ(database.ReadMatches(image_id1, image_id2).size(), 10);
+  EXPECT_EQ(database.ReadMatches(image_id3, image_id1).size(), 30);
+  EXPECT_EQ(database.ReadTwoViewGeometry(image_id1, image_id3).config,
+            TwoViewGeometry::CALIBRATED);
+  EXPECT_EQ(
+      database.ReadTwoViewGeometry(image_id1, image_id3).inlier_matches.size(),
+      5);
+}
+
 }  // namespace
 }  // namespace colmap
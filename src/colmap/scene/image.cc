@@ -31,6 +31,7 @@
 
 #include "colmap/geometry/pose.h"
 #include "colmap/scene/projection.h"
+#include "colmap/util/misc.h"
 
 namespace colmap {
 namespace {
@@ -58,6 +59,18 @@ void Image::SetUp(const struct Camera& camera) {
   CHECK_EQ(camera_id_, camera.camera_id);
   point3D_visibility_pyramid_ = VisibilityPyramid(
       kNumPoint3DVisibilityPyramidLevels, camera.width, camera.height);
+
+  // Restore the already visible image points in one batch.
+  std::vector<Eigen::Vector2d> visible_points;
+  visible_points.reserve(num_visible_points3D_);
+  for (size_t point2D_idx = 0;
+       point2D_idx < num_correspondences_have_point3D_.size();
+       ++point2D_idx) {
+    if (num_correspondences_have_point3D_[point2D_idx] > 0) {
+      visible_points.push_back(points2D_xy_[point2D_idx]);
+    }
+  }
+  point3D_visibility_pyramid_.SetPoints(visible_points);
 }
 
 void Image::TearDown() {
@@ -65,20 +78,22 @@ void Image::TearDown() {
 }
 
 void Image::SetPoints2D(const std::vector<Eigen::Vector2d>& points) {
-  CHECK(points2D_.empty());
-  points2D_.resize(points.size());
+  CHECK(points2D_xy_.empty());
+  points2D_xy_ = points;
+  points2D_point3D_ids_.resize(points.size(), kInvalidPoint3DId);
   num_correspondences_have_point3D_.resize(points.size(), 0);
-  for (point2D_t point2D_idx = 0; point2D_idx < points.size(); ++point2D_idx) {
-    points2D_[point2D_idx].xy = points[point2D_idx];
-  }
 }
 
 void Image::SetPoints2D(const std::vector<struct Point2D>& points) {
-  CHECK(points2D_.empty());
-  points2D_ = points;
+  CHECK(points2D_xy_.empty());
+  points2D_xy_.resize(points.size());
+  points2D_point3D_ids_.resize(points.size());
   num_correspondences_have_point3D_.resize(points.size(), 0);
   num_points3D_ = 0;
-  for (const auto& point2D : points2D_) {
+  for (size_t point2D_idx = 0; point2D_idx < points.size(); ++point2D_idx) {
+    const struct Point2D& point2D = points[point2D_idx];
+    points2D_xy_[point2D_idx] = point2D.xy;
+    points2D_point3D_ids_[point2D_idx] = point2D.point3D_id;
     if (point2D.HasPoint3D()) {
       num_points3D_ += 1;
     }
@@ -88,52 +103,50 @@ void Image::SetPoints2D(const std::vector<struct Point2D>& points) {
 void Image::SetPoint3DForPoint2D(const point2D_t point2D_idx,
                                  const point3D_t point3D_id) {
   CHECK_NE(point3D_id, kInvalidPoint3DId);
-  struct Point2D& point2D = points2D_.at(point2D_idx);
-  if (!point2D.HasPoint3D()) {
+  point3D_t& point2D_point3D_id = points2D_point3D_ids_.at(point2D_idx);
+  if (point2D_point3D_id == kInvalidPoint3DId) {
     num_points3D_ += 1;
   }
-  point2D.point3D_id = point3D_id;
+  point2D_point3D_id = point3D_id;
 }
 
 void Image::ResetPoint3DForPoint2D(const point2D_t point2D_idx) {
-  struct Point2D& point2D = points2D_.at(point2D_idx);
-  if (point2D.HasPoint3D()) {
-    point2D.point3D_id = kInvalidPoint3DId;
+  point3D_t& point2D_point3D_id = points2D_point3D_ids_.at(point2D_idx);
+  if (point2D_point3D_id != kInvalidPoint3DId) {
+    point2D_point3D_id = kInvalidPoint3DId;
     num_points3D_ -= 1;
   }
 }
 
 bool Image::HasPoint3D(const point3D_t point3D_id) const {
-  return std::find_if(points2D_.begin(),
-                      points2D_.end(),
-                      [point3D_id](const struct Point2D& point2D) {
-                        return point2D.point3D_id == point3D_id;
-                      }) != points2D_.end();
+  return std::find(points2D_point3D_ids_.begin(),
+                   points2D_point3D_ids_.end(),
+                   point3D_id) != points2D_point3D_ids_.end();
 }
 
 void Image::IncrementCorrespondenceHasPoint3D(const point2D_t point2D_idx) {
-  const struct Point2D& point2D = points2D_.at(point2D_idx);
+  const Eigen::Vector2d& xy = points2D_xy_.at(point2D_idx);
 
   num_correspondences_have_point3D_[point2D_idx] += 1;
   if (num_correspondences_have_point3D_[point2D_idx] == 1) {
     num_visible_points3D_ += 1;
+    // The score only depends on whether the image point is visible, so the
+    // pyramid is only updated when the image point becomes visible.
+    point3D_visibility_pyramid_.SetPoint(xy(0), xy(1));
   }
 
-  point3D_visibility_pyramid_.SetPoint(point2D.xy(0), point2D.xy(1));
-
   assert(num_visible_points3D_ <= num_observations_);
 }
 
 void Image::DecrementCorrespondenceHasPoint3D(const point2D_t point2D_idx) {
-  const struct Point2D& point2D = points2D_.at(point2D_idx);
+  const Eigen::Vector2d& xy = points2D_xy_.at(point2D_idx);
 
   num_correspondences_have_point3D_[point2D_idx] -= 1;
   if (num_correspondences_have_point3D_[point2D_idx] == 0) {
     num_visible_points3D_ -= 1;
+    point3D_visibility_pyramid_.ResetPoint(xy(0), xy(1));
   }
 
-  point3D_visibility_pyramid_.ResetPoint(point2D.xy(0), point2D.xy(1));
-
   assert(num_visible_points3D_ <= num_observations_);
 }
 
@@ -145,4 +158,15 @@ Eigen::Vector3d Image::ViewingDirection() const {
   return cam_from_world_.rotation.toRotationMatrix().row(2);
 }
 
+size_t Image::MemoryUsage() const {
+  return name_.capacity() + VectorMemoryUsage(points2D_xy_) +
+         VectorMemoryUsage(points2D_point3D_ids_) +
+         VectorMemoryUsage(num_correspondences_have_point3D_) +
+         point3D_visibility_pyramid_.MemoryUsage();
+}
+
+std::vector<struct Point2D> Points2DView::ToVector() const {
+  return std::vector<struct Point2D>(begin(), end());
+}
+
 }  // namespace colmap
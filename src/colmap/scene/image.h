@@ -38,6 +38,8 @@
 #include "colmap/util/logging.h"
 #include "colmap/util/types.h"
 
+#include <cstddef>
+#include <iterator>
 #include <string>
 #include <vector>
 
@@ -45,6 +47,49 @@
 
 namespace colmap {
 
+// Read-only view of the image points of an image. The image stores the
+// coordinates and the 3D point identifiers of its points in separate arrays,
+// such that the view assembles the points on access and returns them by value.
+class Points2DView {
+ public:
+  class Iterator {
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = struct Point2D;
+    using difference_type = std::ptrdiff_t;
+    using pointer = void;
+    using reference = struct Point2D;
+
+    inline Iterator(const Points2DView* view, size_t idx);
+
+    inline struct Point2D operator*() const;
+    inline Iterator& operator++();
+    inline bool operator==(const Iterator& other) const;
+    inline bool operator!=(const Iterator& other) const;
+
+   private:
+    const Points2DView* view_;
+    size_t idx_;
+  };
+
+  inline Points2DView(const std::vector<Eigen::Vector2d>& xys,
+                      const std::vector<point3D_t>& point3D_ids);
+
+  inline size_t size() const;
+  inline bool empty() const;
+  inline struct Point2D operator[](size_t idx) const;
+
+  inline Iterator begin() const;
+  inline Iterator end() const;
+
+  // Copy the image points into an array of structures.
+  std::vector<struct Point2D> ToVector() const;
+
+ private:
+  const std::vector<Eigen::Vector2d>& xys_;
+  const std::vector<point3D_t>& point3D_ids_;
+};
+
 // Class that holds information about an image. An image is the product of one
 // camera shot at a certain location (parameterized as the pose). An image may
 // share a camera with multiple other images, if its intrinsics are the same.
@@ -121,11 +166,24 @@ class Image {
   inline const Rigid3d& CamFromWorldPrior() const;
   inline Rigid3d& CamFromWorldPrior();
 
-  // Access the coordinates of image points.
-  inline const struct Point2D& Point2D(point2D_t point2D_idx) const;
-  inline struct Point2D& Point2D(point2D_t point2D_idx);
-  inline const std::vector<struct Point2D>& Points2D() const;
-  inline std::vector<struct Point2D>& Points2D();
+  // Access the image points. The points are returned by value, since their
+  // coordinates and 3D point identifiers are stored in separate arrays. The 3D
+  // point identifiers must be modified through `SetPoint3DForPoint2D` and
+  // `ResetPoint3DForPoint2D`.
+  inline struct Point2D Point2D(point2D_t point2D_idx) const;
+  inline Points2DView Points2D() const;
+
+  // Access the contiguous coordinates of the image points, e.g., to pass them
+  // to batched camera model functions without copying.
+  inline const Eigen::Vector2d& Point2DXY(point2D_t point2D_idx) const;
+  inline Eigen::Vector2d& Point2DXY(point2D_t point2D_idx);
+  inline const std::vector<Eigen::Vector2d>& Points2DXY() const;
+
+  // Access the 3D point identifiers of the image points, which are
+  // `kInvalidPoint3DId` for image points without a 3D point.
+  inline point3D_t Point2DPoint3DId(point2D_t point2D_idx) const;
+  inline const std::vector<point3D_t>& Points2DPoint3DIds() const;
+
   void SetPoints2D(const std::vector<Eigen::Vector2d>& points);
   void SetPoints2D(const std::vector<struct Point2D>& points);
 
@@ -164,6 +222,10 @@ class Image {
   inline const Eigen::Matrix7d& CamFromWorldPriorCov() const;
   inline Eigen::Matrix7d& CamFromWorldPriorCov();
 
+  // The heap memory in bytes allocated by the image, i.e., mostly by its 2D
+  // points, excluding the size of the image object itself.
+  size_t MemoryUsage() const;
+
   // The number of levels in the 3D point multi-resolution visibility pyramid.
   static const int kNumPoint3DVisibilityPyramidLevels;
 
@@ -206,8 +268,10 @@ class Image {
   // Covariance matrix of the pose prior measured as world to prior.
   Eigen::Matrix7d cam_from_world_prior_cov_;
 
-  // All image points, including points that are not part of a 3D point track.
-  std::vector<struct Point2D> points2D_;
+  // All image points, including points that are not part of a 3D point track,
+  // stored as separate arrays of coordinates and 3D point identifiers.
+  std::vector<Eigen::Vector2d> points2D_xy_;
+  std::vector<point3D_t> points2D_point3D_ids_;
 
   // Per image point, the number of correspondences that have a 3D point.
   std::vector<point2D_t> num_correspondences_have_point3D_;
@@ -221,6 +285,49 @@ class Image {
 // Implementation
 ////////////////////////////////////////////////////////////////////////////////
 
+Points2DView::Iterator::Iterator(const Points2DView* view, const size_t idx)
+    : view_(view), idx_(idx) {}
+
+struct Point2D Points2DView::Iterator::operator*() const {
+  return (*view_)[idx_];
+}
+
+Points2DView::Iterator& Points2DView::Iterator::operator++() {
+  ++idx_;
+  return *this;
+}
+
+bool Points2DView::Iterator::operator==(const Iterator& other) const {
+  return idx_ == other.idx_;
+}
+
+bool Points2DView::Iterator::operator!=(const Iterator& other) const {
+  return idx_ != other.idx_;
+}
+
+Points2DView::Points2DView(const std::vector<Eigen::Vector2d>& xys,
+                           const std::vector<point3D_t>& point3D_ids)
+    : xys_(xys), point3D_ids_(point3D_ids) {}
+
+size_t Points2DView::size() const { return xys_.size(); }
+
+bool Points2DView::empty() const { return xys_.empty(); }
+
+struct Point2D Points2DView::operator[](const size_t idx) const {
+  struct Point2D point2D;
+  point2D.xy = xys_[idx];
+  point2D.point3D_id = point3D_ids_[idx];
+  return point2D;
+}
+
+Points2DView::Iterator Points2DView::begin() const {
+  return Iterator(this, 0);
+}
+
+Points2DView::Iterator Points2DView::end() const {
+  return Iterator(this, size());
+}
+
 image_t Image::ImageId() const { return image_id_; }
 
 void Image::SetImageId(const image_t image_id) { image_id_ = image_id; }
@@ -245,7 +352,7 @@ bool Image::IsRegistered() const { return registered_; }
 void Image::SetRegistered(const bool registered) { registered_ = registered; }
 
 point2D_t Image::NumPoints2D() const {
-  return static_cast<point2D_t>(points2D_.size());
+  return static_cast<point2D_t>(points2D_xy_.size());
 }
 
 point2D_t Image::NumPoints3D() const { return num_points3D_; }
@@ -278,17 +385,36 @@ const Rigid3d& Image::CamFromWorldPrior() const {
 
 Rigid3d& Image::CamFromWorldPrior() { return cam_from_world_prior_; }
 
-const struct Point2D& Image::Point2D(const point2D_t point2D_idx) const {
-  return points2D_.at(point2D_idx);
+struct Point2D Image::Point2D(const point2D_t point2D_idx) const {
+  struct Point2D point2D;
+  point2D.xy = points2D_xy_.at(point2D_idx);
+  point2D.point3D_id = points2D_point3D_ids_[point2D_idx];
+  return point2D;
+}
+
+Points2DView Image::Points2D() const {
+  return Points2DView(points2D_xy_, points2D_point3D_ids_);
+}
+
+const Eigen::Vector2d& Image::Point2DXY(const point2D_t point2D_idx) const {
+  return points2D_xy_.at(point2D_idx);
 }
 
-struct Point2D& Image::Point2D(const point2D_t point2D_idx) {
-  return points2D_.at(point2D_idx);
+Eigen::Vector2d& Image::Point2DXY(const point2D_t point2D_idx) {
+  return points2D_xy_.at(point2D_idx);
 }
 
-const std::vector<struct Point2D>& Image::Points2D() const { return points2D_; }
+const std::vector<Eigen::Vector2d>& Image::Points2DXY() const {
+  return points2D_xy_;
+}
 
-std::vector<struct Point2D>& Image::Points2D() { return points2D_; }
+point3D_t Image::Point2DPoint3DId(const point2D_t point2D_idx) const {
+  return points2D_point3D_ids_.at(point2D_idx);
+}
+
+const std::vector<point3D_t>& Image::Points2DPoint3DIds() const {
+  return points2D_point3D_ids_;
+}
 
 bool Image::IsPoint3DVisible(const point2D_t point2D_idx) const {
   return num_correspondences_have_point3D_.at(point2D_idx) > 0;
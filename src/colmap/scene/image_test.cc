@@ -189,6 +189,25 @@ TEST(Image, Point3DVisibilityScore) {
             2 * scores.sum() + 2 * scores.bottomRows(scores.size() - 1).sum());
 }
 
+TEST(Image, Point3DVisibilityScoreSetUp) {
+  Image image;
+  image.SetPoints2D({Eigen::Vector2d(0, 0), Eigen::Vector2d(3, 3)});
+  image.SetNumObservations(2);
+  Camera camera;
+  camera.width = 4;
+  camera.height = 4;
+  image.SetUp(camera);
+  image.IncrementCorrespondenceHasPoint3D(0);
+  image.IncrementCorrespondenceHasPoint3D(1);
+  image.DecrementCorrespondenceHasPoint3D(1);
+  const size_t score = image.Point3DVisibilityScore();
+  EXPECT_GT(score, 0);
+  image.TearDown();
+  EXPECT_EQ(image.Point3DVisibilityScore(), 0);
+  image.SetUp(camera);
+  EXPECT_EQ(image.Point3DVisibilityScore(), score);
+}
+
 TEST(Image, Points2D) {
   Image image;
   EXPECT_EQ(image.Points2D().size(), 0);
@@ -214,6 +233,35 @@ TEST(Image, Points2DWith3D) {
   EXPECT_EQ(image.NumPoints3D(), 1);
 }
 
+TEST(Image, Points2DArrays) {
+  Image image;
+  std::vector<Point2D> points2D(3);
+  points2D[0].xy = Eigen::Vector2d(1.0, 2.0);
+  points2D[1].xy = Eigen::Vector2d(3.0, 4.0);
+  points2D[1].point3D_id = 1;
+  image.SetPoints2D(points2D);
+  EXPECT_EQ(image.Points2DXY().size(), 3);
+  EXPECT_EQ(image.Points2DXY()[1], Eigen::Vector2d(3.0, 4.0));
+  EXPECT_EQ(image.Points2DPoint3DIds(),
+            std::vector<point3D_t>({kInvalidPoint3DId, 1, kInvalidPoint3DId}));
+  EXPECT_EQ(image.Point2DPoint3DId(1), 1);
+  image.Point2DXY(2) = Eigen::Vector2d(5.0, 6.0);
+  image.SetPoint3DForPoint2D(2, 2);
+  EXPECT_EQ(image.Point2D(2).xy, Eigen::Vector2d(5.0, 6.0));
+  EXPECT_EQ(image.Point2D(2).point3D_id, 2);
+  size_t num_points2D = 0;
+  for (const Point2D& point2D : image.Points2D()) {
+    EXPECT_EQ(point2D.xy, image.Point2DXY(num_points2D));
+    EXPECT_EQ(point2D.point3D_id, image.Point2DPoint3DId(num_points2D));
+    num_points2D += 1;
+  }
+  EXPECT_EQ(num_points2D, 3);
+  const std::vector<Point2D> points2D_copy = image.Points2D().ToVector();
+  EXPECT_EQ(points2D_copy.size(), 3);
+  EXPECT_EQ(points2D_copy[2].xy, Eigen::Vector2d(5.0, 6.0));
+  EXPECT_EQ(points2D_copy[2].point3D_id, 2);
+}
+
 TEST(Image, Points3D) {
   Image image;
   image.SetPoints2D(std::vector<Eigen::Vector2d>(2));
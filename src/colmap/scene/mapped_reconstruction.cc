@@ -0,0 +1,661 @@
+#include "colmap/scene/mapped_reconstruction.h"
+
+#include "colmap/scene/reconstruction.h"
+#include "colmap/util/endian.h"
+#include "colmap/util/logging.h"
+#include "colmap/util/misc.h"
+#include "colmap/util/threading.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+namespace colmap {
+namespace {
+
+const char kMagic[8] = {'C', 'O', 'L', 'M', 'A', 'P', 'M', 'R'};
+
+const size_t kSectionAlignment = 8;
+
+// The records are written and mapped as is, so their layout must not change.
+static_assert(sizeof(MappedReconstruction::Header) == 16, "");
+static_assert(sizeof(MappedReconstruction::SectionHeader) == 24, "");
+static_assert(sizeof(MappedReconstruction::CameraRecord) == 48, "");
+static_assert(sizeof(MappedReconstruction::ImageRecord) == 88, "");
+static_assert(sizeof(MappedReconstruction::Point2DRecord) == 24, "");
+static_assert(sizeof(MappedReconstruction::Point3DRecord) == 64, "");
+static_assert(sizeof(MappedReconstruction::TrackElementRecord) == 8, "");
+
+size_t AlignSectionOffset(const size_t offset) {
+  return (offset + kSectionAlignment - 1) / kSectionAlignment *
+         kSectionAlignment;
+}
+
+template <typename Record, typename Id>
+bool FindRecord(const Record* records,
+                const size_t num_records,
+                const Id id,
+                Id Record::*id_member,
+                size_t* idx) {
+  const Record* end = records + num_records;
+  const Record* record = std::lower_bound(
+      records, end, id, [id_member](const Record& record, const Id value) {
+        return record.*id_member < value;
+      });
+  if (record == end || record->*id_member != id) {
+    return false;
+  }
+  *idx = record - records;
+  return true;
+}
+
+// Buffers the serialized records of a binary file and writes them to the
+// file in large blocks.
+class BufferedBinaryWriter {
+ public:
+  explicit BufferedBinaryWriter(const std::string& path)
+      : file_(path, std::ios::trunc | std::ios::binary) {
+    CHECK(file_.is_open()) << path;
+  }
+
+  ~BufferedBinaryWriter() { Flush(); }
+
+  template <typename T>
+  void Append(const T& data) {
+    AppendBinaryLittleEndian<T>(&buffer_, data);
+    if (buffer_.size() >= kMaxBufferSize) {
+      Flush();
+    }
+  }
+
+  void Append(const char* data, const size_t size) {
+    buffer_.append(data, size);
+  }
+
+  void Flush() {
+    file_.write(buffer_.data(), buffer_.size());
+    CHECK(file_.good());
+    buffer_.clear();
+  }
+
+ private:
+  static const size_t kMaxBufferSize = 1 << 22;
+
+  std::ofstream file_;
+  std::string buffer_;
+};
+
+// The bounding box of the given coordinates, as computed by
+// Reconstruction::ComputeBoundingBox.
+std::pair<Eigen::Vector3d, Eigen::Vector3d> ComputeCoordsBoundingBox(
+    std::vector<float>* coords_x,
+    std::vector<float>* coords_y,
+    std::vector<float>* coords_z,
+    const double p0,
+    const double p1) {
+  CHECK_GE(p0, 0);
+  CHECK_LE(p0, 1);
+  CHECK_GE(p1, 0);
+  CHECK_LE(p1, 1);
+  CHECK_LE(p0, p1);
+
+  if (coords_x->empty()) {
+    return std::make_pair(Eigen::Vector3d(0, 0, 0), Eigen::Vector3d(0, 0, 0));
+  }
+
+  const size_t P0 = static_cast<size_t>(
+      (coords_x->size() > 3) ? p0 * (coords_x->size() - 1) : 0);
+  const size_t P1 = static_cast<size_t>((coords_x->size() > 3)
+                                            ? p1 * (coords_x->size() - 1)
+                                            : coords_x->size() - 1);
+
+  Eigen::Vector3d bbox_min;
+  Eigen::Vector3d bbox_max;
+  int dim = 0;
+  for (std::vector<float>* coords : {coords_x, coords_y, coords_z}) {
+    std::nth_element(coords->begin(), coords->begin() + P0, coords->end());
+    bbox_min(dim) = (*coords)[P0];
+    std::nth_element(coords->begin(), coords->begin() + P1, coords->end());
+    bbox_max(dim) = (*coords)[P1];
+    dim += 1;
+  }
+
+  return std::make_pair(bbox_min, bbox_max);
+}
+
+class SectionWriter {
+ public:
+  explicit SectionWriter(const std::string& path)
+      : file_(path, std::ios::trunc | std::ios::binary) {
+    CHECK(file_.is_open()) << path;
+  }
+
+  template <typename T>
+  void AddSection(const MappedReconstruction::SectionType type,
+                  const std::vector<T>& data) {
+    MappedReconstruction::SectionHeader section;
+    section.type = type;
+    section.stride = sizeof(T);
+    section.count = data.size();
+    section.offset = 0;
+    sections_.push_back(section);
+    section_data_.push_back(reinterpret_cast<const char*>(data.data()));
+  }
+
+  void Write() {
+    MappedReconstruction::Header header;
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = MappedReconstruction::kVersion;
+    header.num_sections = static_cast<uint32_t>(sections_.size());
+
+    size_t offset = AlignSectionOffset(
+        sizeof(header) +
+        sections_.size() * sizeof(MappedReconstruction::SectionHeader));
+    for (auto& section : sections_) {
+      section.offset = offset;
+      offset = AlignSectionOffset(offset + section.stride * section.count);
+    }
+
+    file_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file_.write(reinterpret_cast<const char*>(sections_.data()),
+                sections_.size() * sizeof(sections_[0]));
+    for (size_t i = 0; i < sections_.size(); ++i) {
+      const size_t num_padding_bytes =
+          sections_[i].offset - static_cast<size_t>(file_.tellp());
+      const char kPadding[kSectionAlignment] = {0};
+      file_.write(kPadding, num_padding_bytes);
+      file_.write(section_data_[i], sections_[i].stride * sections_[i].count);
+    }
+    CHECK(file_.good());
+  }
+
+ private:
+  std::ofstream file_;
+  std::vector<MappedReconstruction::SectionHeader> sections_;
+  std::vector<const char*> section_data_;
+};
+
+}  // namespace
+
+const char kMappedReconstructionFileName[] = "reconstruction.mbin";
+
+const uint32_t MappedReconstruction::kVersion;
+
+MappedReconstruction::MappedReconstruction(const std::string& path)
+    : file_(std::make_shared<MappedFile>(path)) {
+  CHECK(IsLittleEndian())
+      << "The mapped reconstruction format requires a little endian system";
+  CHECK_GE(file_->Size(), sizeof(Header)) << path;
+  const Header& header = *reinterpret_cast<const Header*>(file_->Data());
+  CHECK_EQ(std::memcmp(header.magic, kMagic, sizeof(kMagic)), 0)
+      << path << " is not a mapped reconstruction";
+  CHECK_EQ(header.version, kVersion)
+      << path << " has an unsupported version";
+  CHECK_LE(sizeof(Header) + header.num_sections * sizeof(SectionHeader),
+           file_->Size())
+      << path;
+
+  cameras_ = Section<CameraRecord>(SectionType::kCameras, &num_cameras_);
+  camera_params_ =
+      Section<double>(SectionType::kCameraParams, &num_camera_params_);
+  images_ = Section<ImageRecord>(SectionType::kImages, &num_images_);
+  image_names_ = Section<char>(SectionType::kImageNames, &num_image_names_);
+  points2D_ = Section<Point2DRecord>(SectionType::kPoints2D, &num_points2D_);
+  points3D_ = Section<Point3DRecord>(SectionType::kPoints3D, &num_points3D_);
+  track_elements_ = Section<TrackElementRecord>(SectionType::kTrackElements,
+                                                &num_track_elements_);
+}
+
+template <typename T>
+const T* MappedReconstruction::Section(const SectionType type,
+                                       size_t* count) const {
+  const Header& header = *reinterpret_cast<const Header*>(file_->Data());
+  const SectionHeader* sections =
+      reinterpret_cast<const SectionHeader*>(file_->Data() + sizeof(Header));
+  for (uint32_t i = 0; i < header.num_sections; ++i) {
+    if (sections[i].type != type) {
+      continue;
+    }
+    CHECK_EQ(sections[i].stride, sizeof(T));
+    CHECK_EQ(sections[i].offset % kSectionAlignment, 0u);
+    CHECK_LE(sections[i].offset + sections[i].stride * sections[i].count,
+             file_->Size());
+    *count = sections[i].count;
+    return reinterpret_cast<const T*>(file_->Data() + sections[i].offset);
+  }
+  *count = 0;
+  return nullptr;
+}
+
+void MappedReconstruction::Write(const Reconstruction& reconstruction,
+                                 const std::string& path) {
+  std::vector<camera_t> camera_ids;
+  camera_ids.reserve(reconstruction.NumCameras());
+  for (const auto& camera : reconstruction.Cameras()) {
+    camera_ids.push_back(camera.first);
+  }
+  std::sort(camera_ids.begin(), camera_ids.end());
+
+  std::vector<CameraRecord> cameras;
+  cameras.reserve(camera_ids.size());
+  std::vector<double> camera_params;
+  for (const camera_t camera_id : camera_ids) {
+    const struct Camera& camera = reconstruction.Camera(camera_id);
+    CameraRecord record;
+    std::memset(&record, 0, sizeof(record));
+    record.camera_id = camera_id;
+    record.model_id = static_cast<int32_t>(camera.model_id);
+    record.width = camera.width;
+    record.height = camera.height;
+    record.refrac_model_id = static_cast<int32_t>(camera.refrac_model_id);
+    record.num_params = camera.params.size();
+    record.num_refrac_params =
+        camera.IsCameraRefractive() ? camera.refrac_params.size() : 0;
+    record.params_idx = camera_params.size();
+    camera_params.insert(
+        camera_params.end(), camera.params.begin(), camera.params.end());
+    camera_params.insert(camera_params.end(),
+                         camera.refrac_params.begin(),
+                         camera.refrac_params.begin() +
+                             record.num_refrac_params);
+    cameras.push_back(record);
+  }
+
+  std::vector<image_t> image_ids = reconstruction.RegImageIds();
+  std::sort(image_ids.begin(), image_ids.end());
+
+  std::vector<ImageRecord> images;
+  images.reserve(image_ids.size());
+  std::vector<char> image_names;
+  std::vector<Point2DRecord> points2D;
+  for (const image_t image_id : image_ids) {
+    const class Image& image = reconstruction.Image(image_id);
+    ImageRecord record;
+    std::memset(&record, 0, sizeof(record));
+    record.image_id = image_id;
+    record.camera_id = image.CameraId();
+    const Rigid3d& cam_from_world = image.CamFromWorld();
+    record.rotation[0] = cam_from_world.rotation.w();
+    record.rotation[1] = cam_from_world.rotation.x();
+    record.rotation[2] = cam_from_world.rotation.y();
+    record.rotation[3] = cam_from_world.rotation.z();
+    record.translation[0] = cam_from_world.translation.x();
+    record.translation[1] = cam_from_world.translation.y();
+    record.translation[2] = cam_from_world.translation.z();
+    record.name_idx = image_names.size();
+    record.name_length = image.Name().size();
+    image_names.insert(
+        image_names.end(), image.Name().begin(), image.Name().end());
+    record.num_points2D = image.NumPoints2D();
+    record.points2D_idx = points2D.size();
+    for (const auto& point2D : image.Points2D()) {
+      Point2DRecord point2D_record;
+      point2D_record.xy[0] = point2D.xy(0);
+      point2D_record.xy[1] = point2D.xy(1);
+      point2D_record.point3D_id = point2D.point3D_id;
+      points2D.push_back(point2D_record);
+    }
+    images.push_back(record);
+  }
+
+  std::vector<point3D_t> point3D_ids;
+  point3D_ids.reserve(reconstruction.NumPoints3D());
+  for (const auto& point3D : reconstruction.Points3D()) {
+    point3D_ids.push_back(point3D.first);
+  }
+  std::sort(point3D_ids.begin(), point3D_ids.end());
+
+  std::vector<Point3DRecord> points3D;
+  points3D.reserve(point3D_ids.size());
+  std::vector<TrackElementRecord> track_elements;
+  for (const point3D_t point3D_id : point3D_ids) {
+    const struct Point3D& point3D = reconstruction.Point3D(point3D_id);
+    Point3DRecord record;
+    std::memset(&record, 0, sizeof(record));
+    record.point3D_id = point3D_id;
+    for (int i = 0; i < 3; ++i) {
+      record.xyz[i] = point3D.xyz(i);
+      record.color[i] = point3D.color(i);
+    }
+    record.error = point3D.error;
+    record.track_length = point3D.track.Length();
+    record.track_idx = track_elements.size();
+    for (const auto& track_el : point3D.track.Elements()) {
+      TrackElementRecord track_el_record;
+      track_el_record.image_id = track_el.image_id;
+      track_el_record.point2D_idx = track_el.point2D_idx;
+      track_elements.push_back(track_el_record);
+    }
+    points3D.push_back(record);
+  }
+
+  SectionWriter writer(path);
+  writer.AddSection(SectionType::kCameras, cameras);
+  writer.AddSection(SectionType::kCameraParams, camera_params);
+  writer.AddSection(SectionType::kImages, images);
+  writer.AddSection(SectionType::kImageNames, image_names);
+  writer.AddSection(SectionType::kPoints2D, points2D);
+  writer.AddSection(SectionType::kPoints3D, points3D);
+  writer.AddSection(SectionType::kTrackElements, track_elements);
+  writer.Write();
+}
+
+bool MappedReconstruction::FindCamera(const camera_t camera_id,
+                                      size_t* idx) const {
+  return FindRecord(
+      cameras_, num_cameras_, camera_id, &CameraRecord::camera_id, idx);
+}
+
+bool MappedReconstruction::FindImage(const image_t image_id,
+                                     size_t* idx) const {
+  return FindRecord(
+      images_, num_images_, image_id, &ImageRecord::image_id, idx);
+}
+
+bool MappedReconstruction::FindPoint3D(const point3D_t point3D_id,
+                                       size_t* idx) const {
+  return FindRecord(
+      points3D_, num_points3D_, point3D_id, &Point3DRecord::point3D_id, idx);
+}
+
+std::vector<image_t> MappedReconstruction::ImageIds() const {
+  std::vector<image_t> image_ids(num_images_);
+  for (size_t i = 0; i < num_images_; ++i) {
+    image_ids[i] = images_[i].image_id;
+  }
+  return image_ids;
+}
+
+std::string MappedReconstruction::ImageName(const size_t idx) const {
+  const ImageRecord& record = images_[idx];
+  CHECK_LE(record.name_idx + record.name_length, num_image_names_);
+  return std::string(image_names_ + record.name_idx, record.name_length);
+}
+
+Rigid3d MappedReconstruction::CamFromWorld(const size_t idx) const {
+  const ImageRecord& record = images_[idx];
+  return Rigid3d(Eigen::Quaterniond(record.rotation[0],
+                                    record.rotation[1],
+                                    record.rotation[2],
+                                    record.rotation[3])
+                     .normalized(),
+                 Eigen::Vector3d(record.translation[0],
+                                 record.translation[1],
+                                 record.translation[2]));
+}
+
+struct Camera MappedReconstruction::Camera(const size_t idx) const {
+  const CameraRecord& record = cameras_[idx];
+  CHECK_LE(record.params_idx + record.num_params + record.num_refrac_params,
+           num_camera_params_);
+  struct Camera camera;
+  camera.camera_id = record.camera_id;
+  camera.model_id = static_cast<CameraModelId>(record.model_id);
+  camera.width = record.width;
+  camera.height = record.height;
+  const double* params = camera_params_ + record.params_idx;
+  camera.params.assign(params, params + record.num_params);
+  CHECK(camera.VerifyParams());
+  const CameraRefracModelId refrac_model_id =
+      static_cast<CameraRefracModelId>(record.refrac_model_id);
+  if (refrac_model_id != CameraRefracModelId::kInvalid) {
+    camera.refrac_model_id = refrac_model_id;
+    camera.refrac_params.assign(
+        params + record.num_params,
+        params + record.num_params + record.num_refrac_params);
+    CHECK(camera.VerifyRefracParams());
+  }
+  return camera;
+}
+
+class Image MappedReconstruction::Image(const size_t idx) const {
+  const ImageRecord& record = images_[idx];
+  CHECK_LE(record.points2D_idx + record.num_points2D, num_points2D_);
+
+  class Image image;
+  image.SetImageId(record.image_id);
+  image.SetCameraId(record.camera_id);
+  image.SetName(ImageName(idx));
+  image.CamFromWorld() = CamFromWorld(idx);
+
+  size_t camera_idx;
+  CHECK(FindCamera(record.camera_id, &camera_idx));
+  image.SetUp(Camera(camera_idx));
+
+  const Point2DRecord* points2D = points2D_ + record.points2D_idx;
+  std::vector<Eigen::Vector2d> xys(record.num_points2D);
+  for (uint32_t i = 0; i < record.num_points2D; ++i) {
+    xys[i] = Eigen::Vector2d(points2D[i].xy[0], points2D[i].xy[1]);
+  }
+  image.SetPoints2D(xys);
+  for (point2D_t point2D_idx = 0; point2D_idx < record.num_points2D;
+       ++point2D_idx) {
+    if (points2D[point2D_idx].point3D_id != kInvalidPoint3DId) {
+      image.SetPoint3DForPoint2D(point2D_idx,
+                                 points2D[point2D_idx].point3D_id);
+    }
+  }
+
+  image.SetRegistered(true);
+  return image;
+}
+
+struct Point3D MappedReconstruction::Point3D(const size_t idx) const {
+  const Point3DRecord& record = points3D_[idx];
+  CHECK_LE(record.track_idx + record.track_length, num_track_elements_);
+
+  struct Point3D point3D;
+  point3D.xyz = Eigen::Vector3d(record.xyz[0], record.xyz[1], record.xyz[2]);
+  point3D.color =
+      Eigen::Vector3ub(record.color[0], record.color[1], record.color[2]);
+  point3D.error = record.error;
+  point3D.track.Reserve(record.track_length);
+  const TrackElementRecord* track_elements =
+      track_elements_ + record.track_idx;
+  for (uint32_t i = 0; i < record.track_length; ++i) {
+    point3D.track.AddElement(track_elements[i].image_id,
+                             track_elements[i].point2D_idx);
+  }
+  return point3D;
+}
+
+std::pair<Eigen::Vector3d, Eigen::Vector3d>
+MappedReconstruction::ComputeBoundingBox(const double p0,
+                                         const double p1) const {
+  std::vector<float> coords_x(num_points3D_);
+  std::vector<float> coords_y(num_points3D_);
+  std::vector<float> coords_z(num_points3D_);
+  for (size_t i = 0; i < num_points3D_; ++i) {
+    coords_x[i] = static_cast<float>(points3D_[i].xyz[0]);
+    coords_y[i] = static_cast<float>(points3D_[i].xyz[1]);
+    coords_z[i] = static_cast<float>(points3D_[i].xyz[2]);
+  }
+  return ComputeCoordsBoundingBox(&coords_x, &coords_y, &coords_z, p0, p1);
+}
+
+std::vector<MappedReconstruction::Crop> MappedReconstruction::ComputeCrops(
+    const std::vector<std::pair<Eigen::Vector3d, Eigen::Vector3d>>& bboxes,
+    const int num_threads) const {
+  ThreadPool thread_pool(GetEffectiveNumThreads(num_threads));
+
+  // Route the 3D points to the bounding boxes containing them, where every
+  // chunk of points collects its own lists, which are concatenated in order.
+  const size_t kChunkSize = 1 << 16;
+  const size_t num_chunks = (num_points3D_ + kChunkSize - 1) / kChunkSize;
+  std::vector<std::vector<std::vector<size_t>>> chunk_point3D_idxs(
+      num_chunks, std::vector<std::vector<size_t>>(bboxes.size()));
+  thread_pool.ParallelFor(0, num_chunks, 1, [&](const int64_t chunk_idx) {
+    const size_t begin = chunk_idx * kChunkSize;
+    const size_t end = std::min(begin + kChunkSize, num_points3D_);
+    for (size_t point3D_idx = begin; point3D_idx < end; ++point3D_idx) {
+      const Eigen::Map<const Eigen::Vector3d> xyz(
+          points3D_[point3D_idx].xyz);
+      for (size_t i = 0; i < bboxes.size(); ++i) {
+        if ((xyz.array() >= bboxes[i].first.array()).all() &&
+            (xyz.array() <= bboxes[i].second.array()).all()) {
+          chunk_point3D_idxs[chunk_idx][i].push_back(point3D_idx);
+        }
+      }
+    }
+  });
+
+  std::vector<Crop> crops(bboxes.size());
+  thread_pool.ParallelFor(0, bboxes.size(), 1, [&](const int64_t i) {
+    Crop& crop = crops[i];
+
+    size_t num_cropped_points3D = 0;
+    for (const auto& point3D_idxs : chunk_point3D_idxs) {
+      num_cropped_points3D += point3D_idxs[i].size();
+    }
+    crop.point3D_idxs.reserve(num_cropped_points3D);
+    for (auto& point3D_idxs : chunk_point3D_idxs) {
+      crop.point3D_idxs.insert(crop.point3D_idxs.end(),
+                               point3D_idxs[i].begin(),
+                               point3D_idxs[i].end());
+      point3D_idxs[i] = std::vector<size_t>();
+    }
+
+    // Collect the observing images and the bounding box of the points.
+    std::vector<image_t> image_ids;
+    std::vector<float> coords_x(num_cropped_points3D);
+    std::vector<float> coords_y(num_cropped_points3D);
+    std::vector<float> coords_z(num_cropped_points3D);
+    for (size_t j = 0; j < num_cropped_points3D; ++j) {
+      const Point3DRecord& record = points3D_[crop.point3D_idxs[j]];
+      CHECK_LE(record.track_idx + record.track_length, num_track_elements_);
+      const TrackElementRecord* track_elements =
+          track_elements_ + record.track_idx;
+      for (uint32_t k = 0; k < record.track_length; ++k) {
+        image_ids.push_back(track_elements[k].image_id);
+      }
+      coords_x[j] = static_cast<float>(record.xyz[0]);
+      coords_y[j] = static_cast<float>(record.xyz[1]);
+      coords_z[j] = static_cast<float>(record.xyz[2]);
+    }
+
+    std::sort(image_ids.begin(), image_ids.end());
+    image_ids.erase(std::unique(image_ids.begin(), image_ids.end()),
+                    image_ids.end());
+    crop.image_idxs.resize(image_ids.size());
+    for (size_t j = 0; j < image_ids.size(); ++j) {
+      CHECK(FindImage(image_ids[j], &crop.image_idxs[j]))
+          << "Track of 3D point refers to missing image " << image_ids[j];
+    }
+
+    crop.bbox = ComputeCoordsBoundingBox(
+        &coords_x, &coords_y, &coords_z, /*p0=*/0.0, /*p1=*/1.0);
+  });
+
+  return crops;
+}
+
+void MappedReconstruction::WriteCropBinary(const Crop& crop,
+                                           const std::string& path) const {
+  // All cameras are kept, as in Reconstruction::Crop.
+  {
+    BufferedBinaryWriter writer(JoinPaths(path, "cameras.bin"));
+    writer.Append<uint64_t>(num_cameras_);
+    for (size_t i = 0; i < num_cameras_; ++i) {
+      const CameraRecord& record = cameras_[i];
+      CHECK_LE(
+          record.params_idx + record.num_params + record.num_refrac_params,
+          num_camera_params_);
+      writer.Append<camera_t>(record.camera_id);
+      writer.Append<int>(record.model_id);
+      writer.Append<uint64_t>(record.width);
+      writer.Append<uint64_t>(record.height);
+      const double* params = camera_params_ + record.params_idx;
+      for (uint32_t j = 0; j < record.num_params; ++j) {
+        writer.Append<double>(params[j]);
+      }
+      writer.Append<int>(record.refrac_model_id);
+      for (uint32_t j = 0; j < record.num_refrac_params; ++j) {
+        writer.Append<double>(params[record.num_params + j]);
+      }
+    }
+  }
+
+  // The cropped points are numbered consecutively and only their
+  // observations keep a 3D point in the images.
+  std::vector<image_t> image_ids(crop.image_idxs.size());
+  std::vector<size_t> points2D_offsets(crop.image_idxs.size() + 1, 0);
+  for (size_t i = 0; i < crop.image_idxs.size(); ++i) {
+    const ImageRecord& record = images_[crop.image_idxs[i]];
+    CHECK_LE(record.points2D_idx + record.num_points2D, num_points2D_);
+    image_ids[i] = record.image_id;
+    points2D_offsets[i + 1] = points2D_offsets[i] + record.num_points2D;
+  }
+
+  std::vector<point3D_t> point3D_ids(points2D_offsets.back(),
+                                     kInvalidPoint3DId);
+  for (size_t i = 0; i < crop.point3D_idxs.size(); ++i) {
+    const Point3DRecord& record = points3D_[crop.point3D_idxs[i]];
+    const TrackElementRecord* track_elements =
+        track_elements_ + record.track_idx;
+    for (uint32_t j = 0; j < record.track_length; ++j) {
+      const size_t image_pos =
+          std::lower_bound(
+              image_ids.begin(), image_ids.end(), track_elements[j].image_id) -
+          image_ids.begin();
+      CHECK_LT(image_pos, image_ids.size());
+      CHECK_LT(track_elements[j].point2D_idx,
+               points2D_offsets[image_pos + 1] - points2D_offsets[image_pos]);
+      point3D_ids[points2D_offsets[image_pos] +
+                  track_elements[j].point2D_idx] = i + 1;
+    }
+  }
+
+  {
+    BufferedBinaryWriter writer(JoinPaths(path, "images.bin"));
+    writer.Append<uint64_t>(crop.image_idxs.size());
+    for (size_t i = 0; i < crop.image_idxs.size(); ++i) {
+      const size_t image_idx = crop.image_idxs[i];
+      const ImageRecord& record = images_[image_idx];
+      writer.Append<image_t>(record.image_id);
+      const Rigid3d cam_from_world = CamFromWorld(image_idx);
+      writer.Append<double>(cam_from_world.rotation.w());
+      writer.Append<double>(cam_from_world.rotation.x());
+      writer.Append<double>(cam_from_world.rotation.y());
+      writer.Append<double>(cam_from_world.rotation.z());
+      writer.Append<double>(cam_from_world.translation.x());
+      writer.Append<double>(cam_from_world.translation.y());
+      writer.Append<double>(cam_from_world.translation.z());
+      writer.Append<camera_t>(record.camera_id);
+      const std::string name = ImageName(image_idx);
+      writer.Append(name.c_str(), name.size() + 1);
+      writer.Append<uint64_t>(record.num_points2D);
+      const Point2DRecord* points2D = points2D_ + record.points2D_idx;
+      for (uint32_t j = 0; j < record.num_points2D; ++j) {
+        writer.Append<double>(points2D[j].xy[0]);
+        writer.Append<double>(points2D[j].xy[1]);
+        writer.Append<point3D_t>(point3D_ids[points2D_offsets[i] + j]);
+      }
+    }
+  }
+
+  // As in Reconstruction::Crop, the errors of the cropped points are unset.
+  {
+    BufferedBinaryWriter writer(JoinPaths(path, "points3D.bin"));
+    writer.Append<uint64_t>(crop.point3D_idxs.size());
+    for (size_t i = 0; i < crop.point3D_idxs.size(); ++i) {
+      const Point3DRecord& record = points3D_[crop.point3D_idxs[i]];
+      writer.Append<point3D_t>(i + 1);
+      writer.Append<double>(record.xyz[0]);
+      writer.Append<double>(record.xyz[1]);
+      writer.Append<double>(record.xyz[2]);
+      writer.Append<uint8_t>(record.color[0]);
+      writer.Append<uint8_t>(record.color[1]);
+      writer.Append<uint8_t>(record.color[2]);
+      writer.Append<double>(-1.0);
+      writer.Append<uint64_t>(record.track_length);
+      const TrackElementRecord* track_elements =
+          track_elements_ + record.track_idx;
+      for (uint32_t j = 0; j < record.track_length; ++j) {
+        writer.Append<image_t>(track_elements[j].image_id);
+        writer.Append<point2D_t>(track_elements[j].point2D_idx);
+      }
+    }
+  }
+}
+
+}  // namespace colmap
@@ -0,0 +1,231 @@
+#pragma once
+
+#include "colmap/geometry/rigid3.h"
+#include "colmap/scene/camera.h"
+#include "colmap/scene/image.h"
+#include "colmap/scene/point3d.h"
+#include "colmap/util/mapped_file.h"
+#include "colmap/util/types.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace colmap {
+
+class Reconstruction;
+
+// Name of the file of the mapped format in a reconstruction folder.
+extern const char kMappedReconstructionFileName[];
+
+// Single-file binary format of a reconstruction, which is designed to be
+// memory-mapped. The cameras, registered images, 2D points, 3D points, and
+// track elements are stored in separate sections of fixed-stride records,
+// which are located through a section table after the header. Cameras, images,
+// and 3D points are sorted by identifier and looked up by binary search.
+// Readers can thus, e.g., access the poses of all images without parsing or
+// materializing any 2D points or tracks, and only the pages of the accessed
+// records are read from disk. Everything else is materialized on demand.
+//
+// Layout, in little endian and with all sections aligned to 8 bytes:
+//
+//    Header                    {magic, version, num_sections}
+//    SectionHeader[]           {type, stride, offset, count}
+//    kCameras section          CameraRecord[]
+//    kCameraParams section     double[], intrinsic and refractive params
+//    kImages section           ImageRecord[]
+//    kImageNames section       char[], names without null terminators
+//    kPoints2D section         Point2DRecord[], per image consecutively
+//    kPoints3D section         Point3DRecord[]
+//    kTrackElements section    TrackElementRecord[], per point consecutively
+//
+// Readers reject files of other versions and ignore unknown sections, such
+// that sections can be added without breaking older readers.
+class MappedReconstruction {
+ public:
+  static const uint32_t kVersion = 1;
+
+  enum class SectionType : uint32_t {
+    kCameras = 1,
+    kCameraParams = 2,
+    kImages = 3,
+    kImageNames = 4,
+    kPoints2D = 5,
+    kPoints3D = 6,
+    kTrackElements = 7,
+  };
+
+  struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t num_sections;
+  };
+
+  struct SectionHeader {
+    SectionType type;
+    uint32_t stride;
+    uint64_t offset;
+    uint64_t count;
+  };
+
+  struct CameraRecord {
+    camera_t camera_id;
+    int32_t model_id;
+    uint64_t width;
+    uint64_t height;
+    int32_t refrac_model_id;
+    uint32_t num_params;
+    uint32_t num_refrac_params;
+    uint32_t padding;
+    // Index of the first intrinsic parameter in the parameters section,
+    // which are followed by the refractive parameters.
+    uint64_t params_idx;
+  };
+
+  struct ImageRecord {
+    image_t image_id;
+    camera_t camera_id;
+    // Rotation as quaternion (w, x, y, z) and translation of cam_from_world.
+    double rotation[4];
+    double translation[3];
+    uint64_t name_idx;
+    uint32_t name_length;
+    uint32_t num_points2D;
+    uint64_t points2D_idx;
+  };
+
+  struct Point2DRecord {
+    double xy[2];
+    point3D_t point3D_id;
+  };
+
+  struct Point3DRecord {
+    point3D_t point3D_id;
+    double xyz[3];
+    double error;
+    uint8_t color[3];
+    uint8_t padding1[5];
+    uint32_t track_length;
+    uint32_t padding2;
+    uint64_t track_idx;
+  };
+
+  struct TrackElementRecord {
+    image_t image_id;
+    point2D_t point2D_idx;
+  };
+
+  // Map the file at the given path and verify its header.
+  explicit MappedReconstruction(const std::string& path);
+
+  // Write the reconstruction in the mapped format to the given file path.
+  static void Write(const Reconstruction& reconstruction,
+                    const std::string& path);
+
+  inline size_t NumCameras() const;
+  inline size_t NumImages() const;
+  inline size_t NumPoints3D() const;
+  inline size_t NumObservations() const;
+
+  // Access the raw records by index, which are sorted by identifier.
+  inline const CameraRecord& CameraRecordAt(size_t idx) const;
+  inline const ImageRecord& ImageRecordAt(size_t idx) const;
+  inline const Point3DRecord& Point3DRecordAt(size_t idx) const;
+
+  // Find the index of the record with the given identifier or return false.
+  bool FindCamera(camera_t camera_id, size_t* idx) const;
+  bool FindImage(image_t image_id, size_t* idx) const;
+  bool FindPoint3D(point3D_t point3D_id, size_t* idx) const;
+
+  // Access the properties of images without materializing them.
+  std::vector<image_t> ImageIds() const;
+  std::string ImageName(size_t idx) const;
+  Rigid3d CamFromWorld(size_t idx) const;
+
+  // Materialize cameras, images with their 2D points, and 3D points with
+  // their tracks. Images are set up with their camera and registered.
+  struct Camera Camera(size_t idx) const;
+  class Image Image(size_t idx) const;
+  struct Point3D Point3D(size_t idx) const;
+
+  // Compute the bounding box of the 3D points, as Reconstruction does.
+  std::pair<Eigen::Vector3d, Eigen::Vector3d> ComputeBoundingBox(
+      double p0 = 0.0, double p1 = 1.0) const;
+
+  // The crop of the reconstruction to a bounding box, which refers to the
+  // records of the cropped 3D points and of the images observing them.
+  struct Crop {
+    // Indices of the 3D points inside the bounding box in increasing order.
+    std::vector<size_t> point3D_idxs;
+    // Indices of the images observing the cropped points in increasing order.
+    std::vector<size_t> image_idxs;
+    // Bounding box of the cropped 3D points.
+    std::pair<Eigen::Vector3d, Eigen::Vector3d> bbox;
+  };
+
+  // Crop the reconstruction to all bounding boxes with a single pass over the
+  // 3D points, which is processed in parallel chunks.
+  std::vector<Crop> ComputeCrops(
+      const std::vector<std::pair<Eigen::Vector3d, Eigen::Vector3d>>& bboxes,
+      int num_threads = -1) const;
+
+  // Write the crop in the binary format to the given directory. The written
+  // model equals Reconstruction::Crop of the materialized reconstruction,
+  // where the cropped 3D points are numbered consecutively.
+  void WriteCropBinary(const Crop& crop, const std::string& path) const;
+
+ private:
+  template <typename T>
+  const T* Section(SectionType type, size_t* count) const;
+
+  std::shared_ptr<MappedFile> file_;
+
+  const CameraRecord* cameras_;
+  const double* camera_params_;
+  const ImageRecord* images_;
+  const char* image_names_;
+  const Point2DRecord* points2D_;
+  const Point3DRecord* points3D_;
+  const TrackElementRecord* track_elements_;
+
+  size_t num_cameras_;
+  size_t num_camera_params_;
+  size_t num_images_;
+  size_t num_image_names_;
+  size_t num_points2D_;
+  size_t num_points3D_;
+  size_t num_track_elements_;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Implementation
+////////////////////////////////////////////////////////////////////////////////
+
+size_t MappedReconstruction::NumCameras() const { return num_cameras_; }
+
+size_t MappedReconstruction::NumImages() const { return num_images_; }
+
+size_t MappedReconstruction::NumPoints3D() const { return num_points3D_; }
+
+size_t MappedReconstruction::NumObservations() const {
+  return num_track_elements_;
+}
+
+const MappedReconstruction::CameraRecord& MappedReconstruction::CameraRecordAt(
+    const size_t idx) const {
+  return cameras_[idx];
+}
+
+const MappedReconstruction::ImageRecord& MappedReconstruction::ImageRecordAt(
+    const size_t idx) const {
+  return images_[idx];
+}
+
+const MappedReconstruction::Point3DRecord&
+MappedReconstruction::Point3DRecordAt(const size_t idx) const {
+  return points3D_[idx];
+}
+
+}  // namespace colmap
@@ -0,0 +1,201 @@
+#include "colmap/scene/mapped_reconstruction.h"
+
+#include "colmap/scene/reconstruction.h"
+#include "colmap/scene/synthetic.h"
+#include "colmap/util/misc.h"
+#include "colmap/util/testing.h"
+
+#include <algorithm>
+
+#include <gtest/gtest.h>
+
+namespace colmap {
+namespace {
+
+void SynthesizeRefracReconstruction(Reconstruction* reconstruction) {
+  SyntheticDatasetOptions options;
+  options.num_cameras = 2;
+  options.num_images = 10;
+  options.num_points3D = 50;
+  options.camera_refrac_model_id = CameraRefracModelId::kFlatPort;
+  options.camera_refrac_params = {0, 0, 1, 0.05, 0.007, 1.003, 1.473, 1.333};
+  SynthesizeDataset(options, reconstruction);
+}
+
+TEST(MappedReconstruction, Empty) {
+  const std::string test_dir = CreateTestDir();
+  const std::string path = JoinPaths(test_dir, kMappedReconstructionFileName);
+  Reconstruction reconstruction;
+  MappedReconstruction::Write(reconstruction, path);
+  const MappedReconstruction mapped(path);
+  EXPECT_EQ(mapped.NumCameras(), 0);
+  EXPECT_EQ(mapped.NumImages(), 0);
+  EXPECT_EQ(mapped.NumPoints3D(), 0);
+  EXPECT_EQ(mapped.NumObservations(), 0);
+  EXPECT_TRUE(mapped.ImageIds().empty());
+  size_t idx;
+  EXPECT_FALSE(mapped.FindImage(1, &idx));
+}
+
+TEST(MappedReconstruction, LazyAccess) {
+  Reconstruction reconstruction;
+  SynthesizeRefracReconstruction(&reconstruction);
+
+  const std::string test_dir = CreateTestDir();
+  const std::string path = JoinPaths(test_dir, kMappedReconstructionFileName);
+  MappedReconstruction::Write(reconstruction, path);
+  const MappedReconstruction mapped(path);
+
+  EXPECT_EQ(mapped.NumCameras(), reconstruction.NumCameras());
+  EXPECT_EQ(mapped.NumImages(), reconstruction.NumRegImages());
+  EXPECT_EQ(mapped.NumPoints3D(), reconstruction.NumPoints3D());
+  EXPECT_EQ(mapped.NumObservations(),
+            reconstruction.ComputeNumObservations());
+
+  size_t idx;
+  for (const auto& camera : reconstruction.Cameras()) {
+    ASSERT_TRUE(mapped.FindCamera(camera.first, &idx));
+    const struct Camera mapped_camera = mapped.Camera(idx);
+    EXPECT_EQ(mapped_camera.camera_id, camera.first);
+    EXPECT_EQ(mapped_camera.model_id, camera.second.model_id);
+    EXPECT_EQ(mapped_camera.width, camera.second.width);
+    EXPECT_EQ(mapped_camera.height, camera.second.height);
+    EXPECT_EQ(mapped_camera.params, camera.second.params);
+    EXPECT_EQ(mapped_camera.refrac_model_id, camera.second.refrac_model_id);
+    EXPECT_EQ(mapped_camera.refrac_params, camera.second.refrac_params);
+  }
+
+  std::vector<image_t> image_ids = reconstruction.RegImageIds();
+  std::sort(image_ids.begin(), image_ids.end());
+  EXPECT_EQ(mapped.ImageIds(), image_ids);
+  for (const image_t image_id : image_ids) {
+    const class Image& image = reconstruction.Image(image_id);
+    ASSERT_TRUE(mapped.FindImage(image_id, &idx));
+    EXPECT_EQ(mapped.ImageName(idx), image.Name());
+    EXPECT_EQ(mapped.CamFromWorld(idx).rotation.coeffs(),
+              image.CamFromWorld().rotation.coeffs());
+    EXPECT_EQ(mapped.CamFromWorld(idx).translation,
+              image.CamFromWorld().translation);
+
+    const class Image mapped_image = mapped.Image(idx);
+    EXPECT_EQ(mapped_image.ImageId(), image_id);
+    EXPECT_EQ(mapped_image.CameraId(), image.CameraId());
+    EXPECT_TRUE(mapped_image.IsRegistered());
+    EXPECT_TRUE(mapped_image.HasCamera());
+    EXPECT_EQ(mapped_image.NumPoints2D(), image.NumPoints2D());
+    EXPECT_EQ(mapped_image.NumPoints3D(), image.NumPoints3D());
+    for (point2D_t point2D_idx = 0; point2D_idx < image.NumPoints2D();
+         ++point2D_idx) {
+      EXPECT_EQ(mapped_image.Point2D(point2D_idx).xy,
+                image.Point2D(point2D_idx).xy);
+      EXPECT_EQ(mapped_image.Point2D(point2D_idx).point3D_id,
+                image.Point2D(point2D_idx).point3D_id);
+    }
+  }
+  EXPECT_FALSE(mapped.FindImage(kInvalidImageId, &idx));
+
+  for (const auto& point3D : reconstruction.Points3D()) {
+    ASSERT_TRUE(mapped.FindPoint3D(point3D.first, &idx));
+    EXPECT_EQ(mapped.Point3DRecordAt(idx).point3D_id, point3D.first);
+    const struct Point3D mapped_point3D = mapped.Point3D(idx);
+    EXPECT_EQ(mapped_point3D.xyz, point3D.second.xyz);
+    EXPECT_EQ(mapped_point3D.color, point3D.second.color);
+    EXPECT_EQ(mapped_point3D.error, point3D.second.error);
+    ASSERT_EQ(mapped_point3D.track.Length(), point3D.second.track.Length());
+    for (size_t i = 0; i < point3D.second.track.Length(); ++i) {
+      EXPECT_EQ(mapped_point3D.track.Element(i).image_id,
+                point3D.second.track.Element(i).image_id);
+      EXPECT_EQ(mapped_point3D.track.Element(i).point2D_idx,
+                point3D.second.track.Element(i).point2D_idx);
+    }
+  }
+}
+
+TEST(MappedReconstruction, ReadWrite) {
+  Reconstruction reconstruction;
+  SynthesizeRefracReconstruction(&reconstruction);
+
+  const std::string test_dir = CreateTestDir();
+  reconstruction.WriteMapped(test_dir);
+
+  Reconstruction read_reconstruction;
+  read_reconstruction.Read(test_dir);
+  EXPECT_EQ(read_reconstruction.NumCameras(), reconstruction.NumCameras());
+  EXPECT_EQ(read_reconstruction.NumImages(), reconstruction.NumImages());
+  EXPECT_EQ(read_reconstruction.NumRegImages(), reconstruction.NumRegImages());
+  EXPECT_EQ(read_reconstruction.NumPoints3D(), reconstruction.NumPoints3D());
+  EXPECT_EQ(read_reconstruction.ComputeNumObservations(),
+            reconstruction.ComputeNumObservations());
+  EXPECT_TRUE(read_reconstruction.Camera(1).IsCameraRefractive());
+  EXPECT_NEAR(read_reconstruction.ComputeMeanReprojectionError(),
+              reconstruction.ComputeMeanReprojectionError(),
+              1e-12);
+
+  // New 3D points must not collide with the identifiers of read 3D points.
+  const point3D_t point3D_id =
+      read_reconstruction.AddPoint3D(Eigen::Vector3d::Zero(), Track());
+  EXPECT_FALSE(reconstruction.ExistsPoint3D(point3D_id));
+}
+
+TEST(MappedReconstruction, Crop) {
+  Reconstruction reconstruction;
+  SynthesizeRefracReconstruction(&reconstruction);
+
+  const std::string test_dir = CreateTestDir();
+  const std::string path = JoinPaths(test_dir, kMappedReconstructionFileName);
+  MappedReconstruction::Write(reconstruction, path);
+  const MappedReconstruction mapped(path);
+
+  EXPECT_EQ(mapped.ComputeBoundingBox(), reconstruction.ComputeBoundingBox());
+  EXPECT_EQ(mapped.ComputeBoundingBox(0.1, 0.9),
+            reconstruction.ComputeBoundingBox(0.1, 0.9));
+
+  const auto bbox = reconstruction.ComputeBoundingBox();
+  const Eigen::Vector3d center = 0.5 * (bbox.first + bbox.second);
+  const std::vector<std::pair<Eigen::Vector3d, Eigen::Vector3d>> bboxes = {
+      bbox,
+      {bbox.first, center},
+      {center, bbox.second},
+      {bbox.second + Eigen::Vector3d::Ones(),
+       bbox.second + 2 * Eigen::Vector3d::Ones()}};
+  for (const int num_threads : {1, 3}) {
+    const std::vector<MappedReconstruction::Crop> crops =
+        mapped.ComputeCrops(bboxes, num_threads);
+    ASSERT_EQ(crops.size(), bboxes.size());
+    for (size_t i = 0; i < bboxes.size(); ++i) {
+      const Reconstruction expected = reconstruction.Crop(bboxes[i]);
+      EXPECT_EQ(crops[i].point3D_idxs.size(), expected.NumPoints3D());
+      EXPECT_EQ(crops[i].image_idxs.size(), expected.NumRegImages());
+      EXPECT_EQ(crops[i].bbox, expected.ComputeBoundingBox());
+
+      mapped.WriteCropBinary(crops[i], test_dir);
+      Reconstruction cropped;
+      cropped.Read(test_dir);
+      EXPECT_EQ(cropped.NumCameras(), expected.NumCameras());
+      EXPECT_EQ(cropped.NumRegImages(), expected.NumRegImages());
+      EXPECT_EQ(cropped.NumPoints3D(), expected.NumPoints3D());
+      EXPECT_EQ(cropped.ComputeNumObservations(),
+                expected.ComputeNumObservations());
+      EXPECT_EQ(cropped.ComputeBoundingBox(), expected.ComputeBoundingBox());
+
+      std::vector<image_t> reg_image_ids = cropped.RegImageIds();
+      std::vector<image_t> expected_reg_image_ids = expected.RegImageIds();
+      std::sort(reg_image_ids.begin(), reg_image_ids.end());
+      std::sort(expected_reg_image_ids.begin(), expected_reg_image_ids.end());
+      EXPECT_EQ(reg_image_ids, expected_reg_image_ids);
+
+      for (const auto& point3D : cropped.Points3D()) {
+        EXPECT_EQ(point3D.second.error, -1);
+        for (const auto& track_el : point3D.second.track.Elements()) {
+          EXPECT_EQ(cropped.Image(track_el.image_id)
+                        .Point2D(track_el.point2D_idx)
+                        .point3D_id,
+                    point3D.first);
+        }
+      }
+    }
+  }
+}
+
+}  // namespace
+}  // namespace colmap
@@ -30,10 +30,12 @@
 #pragma once
 
 #include "colmap/scene/track.h"
+#include "colmap/util/arena.h"
 #include "colmap/util/eigen_alignment.h"
 #include "colmap/util/logging.h"
 #include "colmap/util/types.h"
 
+#include <unordered_map>
 #include <vector>
 
 #include <Eigen/Core>
@@ -57,4 +59,13 @@ struct Point3D {
   inline bool HasError() const { return error != -1.; }
 };
 
+// Map of 3D points by identifier, whose nodes are allocated from a memory pool
+// instead of one heap allocation per point.
+using Point3DMap =
+    std::unordered_map<point3D_t,
+                       Point3D,
+                       std::hash<point3D_t>,
+                       std::equal_to<point3D_t>,
+                       PoolAllocator<std::pair<const point3D_t, Point3D>>>;
+
 }  // namespace colmap
@@ -84,6 +84,62 @@ double CalculateSquaredReprojectionError(
   return (proj_point2D - point2D).squaredNorm();
 }
 
+void CalculateSquaredReprojectionErrors(
+    const std::vector<Eigen::Vector2d>& points2D,
+    const std::vector<Eigen::Vector3d>& points3D,
+    const Rigid3d& cam_from_world,
+    const Camera& camera,
+    std::vector<double>* squared_reproj_errors,
+    const bool is_refractive) {
+  CHECK_EQ(points2D.size(), points3D.size());
+  CHECK_NOTNULL(squared_reproj_errors);
+  const size_t num_points = points2D.size();
+  squared_reproj_errors->resize(num_points);
+
+  const Eigen::Matrix3d cam_from_world_rotation =
+      cam_from_world.rotation.toRotationMatrix();
+
+  if (!is_refractive) {
+    for (size_t i = 0; i < num_points; ++i) {
+      const Eigen::Vector3d point3D_in_cam =
+          cam_from_world_rotation * points3D[i] + cam_from_world.translation;
+      if (point3D_in_cam.z() < std::numeric_limits<double>::epsilon()) {
+        (*squared_reproj_errors)[i] = std::numeric_limits<double>::max();
+      } else {
+        (*squared_reproj_errors)[i] =
+            (camera.ImgFromCam(point3D_in_cam.hnormalized()) - points2D[i])
+                .squaredNorm();
+      }
+    }
+    return;
+  }
+
+  // Only the points in front of the camera are projected, which are gathered
+  // into contiguous buffers that are reused by the calling thread.
+  thread_local std::vector<size_t> point_idxs;
+  thread_local std::vector<Eigen::Vector3d> points3D_in_cam;
+  thread_local std::vector<Eigen::Vector2d> proj_points2D;
+  point_idxs.clear();
+  points3D_in_cam.clear();
+  for (size_t i = 0; i < num_points; ++i) {
+    const Eigen::Vector3d point3D_in_cam =
+        cam_from_world_rotation * points3D[i] + cam_from_world.translation;
+    if (point3D_in_cam.z() < std::numeric_limits<double>::epsilon()) {
+      (*squared_reproj_errors)[i] = std::numeric_limits<double>::max();
+    } else {
+      point_idxs.push_back(i);
+      points3D_in_cam.push_back(point3D_in_cam);
+    }
+  }
+
+  camera.ImgFromCamRefracBatch(points3D_in_cam, &proj_points2D);
+  for (size_t j = 0; j < point_idxs.size(); ++j) {
+    const size_t i = point_idxs[j];
+    (*squared_reproj_errors)[i] =
+        (proj_points2D[j] - points2D[i]).squaredNorm();
+  }
+}
+
 double CalculateAngularError(const Eigen::Vector2d& point2D,
                              const Eigen::Vector3d& point3D,
                              const Rigid3d& cam_from_world,
@@ -58,6 +58,22 @@ double CalculateSquaredReprojectionError(
     const Camera& camera,
     bool is_refractive = false);
 
+// Calculate the squared reprojection errors of many observations in the same
+// image at once, which is equivalent to but faster than calling
+// `CalculateSquaredReprojectionError` for every observation. The points are
+// transformed with the pose at once and the refractive projection is traced
+// for all points in front of the camera at once, see
+// `Camera::ImgFromCamRefracBatch`. The errors are written to
+// `squared_reproj_errors`, which is resized to the number of points and whose
+// memory is reused between calls.
+void CalculateSquaredReprojectionErrors(
+    const std::vector<Eigen::Vector2d>& points2D,
+    const std::vector<Eigen::Vector3d>& points3D,
+    const Rigid3d& cam_from_world,
+    const Camera& camera,
+    std::vector<double>* squared_reproj_errors,
+    bool is_refractive = false);
+
 // Calculate the angular error.
 //
 // The angular error is the angle between the observed viewing ray and the
@@ -32,6 +32,7 @@
 #include "colmap/geometry/pose.h"
 #include "colmap/math/math.h"
 #include "colmap/sensor/models.h"
+#include "colmap/sensor/models_refrac.h"
 #include "colmap/util/eigen_alignment.h"
 
 #include <Eigen/Core>
@@ -71,6 +72,49 @@ TEST(CalculateSquaredReprojectionError, Nominal) {
               1e-6);
 }
 
+TEST(CalculateSquaredReprojectionErrors, Nominal) {
+  const Rigid3d cam_from_world(
+      Eigen::Quaterniond(EulerAnglesToRotationMatrix(0.1, -0.2, 0.3)),
+      Eigen::Vector3d(0.1, -0.3, 0.2));
+  Camera camera = Camera::CreateFromModelId(
+      1, SimplePinholeCameraModel::model_id, 1000, 1000, 800);
+
+  std::vector<Eigen::Vector2d> points2D;
+  std::vector<Eigen::Vector3d> points3D;
+  for (int i = 0; i < 50; ++i) {
+    points2D.push_back(500 * Eigen::Vector2d::Random().cwiseAbs());
+    points3D.push_back(Eigen::Vector3d::Random() + Eigen::Vector3d(0, 0, 4));
+  }
+  // A point behind the camera.
+  points2D.emplace_back(10, 10);
+  points3D.push_back(Inverse(cam_from_world) * Eigen::Vector3d(0, 0, -1));
+
+  std::vector<double> squared_reproj_errors;
+  for (const bool is_refractive : {false, true}) {
+    if (is_refractive) {
+      camera.refrac_model_id = FlatPort::refrac_model_id;
+      camera.refrac_params = {0.1, 0.05, 0.99, 0.05, 0.007, 1.0, 1.52, 1.33};
+      Eigen::Map<Eigen::Vector3d>(camera.refrac_params.data()).normalize();
+    }
+    CalculateSquaredReprojectionErrors(points2D,
+                                       points3D,
+                                       cam_from_world,
+                                       camera,
+                                       &squared_reproj_errors,
+                                       is_refractive);
+    ASSERT_EQ(squared_reproj_errors.size(), points2D.size());
+    for (size_t i = 0; i < points2D.size(); ++i) {
+      const double squared_reproj_error = CalculateSquaredReprojectionError(
+          points2D[i], points3D[i], cam_from_world, camera, is_refractive);
+      EXPECT_NEAR(squared_reproj_errors[i],
+                  squared_reproj_error,
+                  1e-6 * std::max(1.0, squared_reproj_error));
+    }
+    EXPECT_EQ(squared_reproj_errors.back(),
+              std::numeric_limits<double>::max());
+  }
+}
+
 TEST(CalculateAngularError, Nominal) {
   const Rigid3d cam_from_world(Eigen::Quaterniond::Identity(),
                                Eigen::Vector3d::Zero());
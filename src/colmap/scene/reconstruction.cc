@@ -33,18 +33,193 @@
 #include "colmap/geometry/pose.h"
 #include "colmap/geometry/triangulation.h"
 #include "colmap/scene/database_cache.h"
+#include "colmap/scene/mapped_reconstruction.h"
 #include "colmap/scene/projection.h"
+#include "colmap/scene/refrac_rays.h"
 #include "colmap/sensor/bitmap.h"
 #include "colmap/sensor/models_refrac.h"
 #include "colmap/util/misc.h"
 #include "colmap/util/ply.h"
+#include "colmap/util/threading.h"
 
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <deque>
 #include <fstream>
+#include <future>
 
 namespace colmap {
+namespace {
+
+// Evaluates func(i) for all i in [0, num_items) in contiguous chunks on
+// `num_threads` threads. The function must only write to per-item state.
+template <typename Func>
+void ParallelFor(const size_t num_items, const int num_threads, Func&& func) {
+  const size_t num_eff_threads = std::min<size_t>(
+      num_items, static_cast<size_t>(GetEffectiveNumThreads(num_threads)));
+  if (num_eff_threads <= 1) {
+    for (size_t i = 0; i < num_items; ++i) {
+      func(i);
+    }
+    return;
+  }
+
+  ThreadPool thread_pool(num_eff_threads);
+  const size_t chunk_size = (num_items + num_eff_threads - 1) / num_eff_threads;
+  for (size_t begin = 0; begin < num_items; begin += chunk_size) {
+    const size_t end = std::min(begin + chunk_size, num_items);
+    thread_pool.AddTask([begin, end, &func]() {
+      for (size_t i = begin; i < end; ++i) {
+        func(i);
+      }
+    });
+  }
+  thread_pool.Wait();
+}
+
+// Records of the binary files are serialized and parsed in parallel in chunks
+// of this many records, where a batch of chunks is processed at a time to bound
+// the memory of the intermediate buffers.
+const size_t kBinaryChunkSize = 4096;
+const size_t kBinaryNumChunksPerBatch = 64;
+const size_t kBinaryBatchSize = kBinaryChunkSize * kBinaryNumChunksPerBatch;
+
+// The number of points, which are transformed at a time by a thread.
+const size_t kTransformBatchSize = 16384;
+
+// Serializes the records [0, num_records) with serialize(i, &buffer) into
+// in-memory buffers in parallel and writes the buffers to the stream in order,
+// such that the file is written with few large sequential writes.
+template <typename Func>
+void WriteBinaryRecords(std::ostream* stream,
+                        const size_t num_records,
+                        Func&& serialize) {
+  std::vector<std::string> buffers(kBinaryNumChunksPerBatch);
+  for (size_t batch_begin = 0; batch_begin < num_records;
+       batch_begin += kBinaryBatchSize) {
+    const size_t batch_end =
+        std::min(batch_begin + kBinaryBatchSize, num_records);
+    const size_t num_chunks =
+        (batch_end - batch_begin + kBinaryChunkSize - 1) / kBinaryChunkSize;
+    ParallelFor(num_chunks, ThreadPool::kMaxNumThreads, [&](const size_t i) {
+      std::string& buffer = buffers[i];
+      buffer.clear();
+      const size_t chunk_begin = batch_begin + i * kBinaryChunkSize;
+      const size_t chunk_end =
+          std::min(chunk_begin + kBinaryChunkSize, batch_end);
+      for (size_t j = chunk_begin; j < chunk_end; ++j) {
+        serialize(j, &buffer);
+      }
+    });
+    for (size_t i = 0; i < num_chunks; ++i) {
+      stream->write(buffers[i].data(), buffers[i].size());
+    }
+  }
+}
+
+// Reads the entire file into memory with a single sequential read.
+std::string ReadBinaryFile(const std::string& path) {
+  std::ifstream file(path, std::ios::binary | std::ios::ate);
+  CHECK(file.is_open()) << path;
+  const std::streamsize num_bytes = file.tellg();
+  std::string buffer(num_bytes, '\0');
+  file.seekg(0, std::ios::beg);
+  file.read(&buffer[0], num_bytes);
+  CHECK(file) << path;
+  return buffer;
+}
+
+// Skip the given number of bytes of a memory buffer, which must not exceed the
+// end of the buffer.
+void SkipBinaryBytes(const size_t num_bytes,
+                     const char* buffer_end,
+                     const char** buffer) {
+  CHECK_LE(num_bytes, static_cast<size_t>(buffer_end - *buffer))
+      << "Unexpected end of binary file";
+  *buffer += num_bytes;
+}
+
+// Computes the squared reprojection errors of all observations of the points,
+// where the observations are grouped by image and the observations of every
+// image are evaluated in one batch, see `CalculateSquaredReprojectionErrors`.
+// The errors of the track of the i-th point are stored in track order starting
+// at `offsets[i]`, where null points are skipped and have no errors.
+void ComputeSquaredReprojectionErrors(
+    const Reconstruction& reconstruction,
+    const std::vector<const Point3D*>& points3D,
+    const bool is_refractive,
+    const int num_threads,
+    std::vector<size_t>* offsets,
+    std::vector<double>* squared_reproj_errors) {
+  offsets->resize(points3D.size() + 1);
+  (*offsets)[0] = 0;
+  for (size_t i = 0; i < points3D.size(); ++i) {
+    (*offsets)[i + 1] =
+        (*offsets)[i] + (points3D[i] ? points3D[i]->track.Length() : 0);
+  }
+  squared_reproj_errors->resize(offsets->back());
+
+  // The observations of every image as the index of the point and of the
+  // element in its track.
+  std::unordered_map<image_t, size_t> image_id_to_idx;
+  std::vector<image_t> image_ids;
+  std::vector<std::vector<std::pair<size_t, size_t>>> image_observations;
+  for (size_t i = 0; i < points3D.size(); ++i) {
+    if (points3D[i] == nullptr) {
+      continue;
+    }
+    const auto& track_els = points3D[i]->track.Elements();
+    for (size_t j = 0; j < track_els.size(); ++j) {
+      const auto it =
+          image_id_to_idx.emplace(track_els[j].image_id, image_ids.size());
+      if (it.second) {
+        image_ids.push_back(track_els[j].image_id);
+        image_observations.emplace_back();
+      }
+      image_observations[it.first->second].emplace_back(i, j);
+    }
+  }
+
+  ParallelFor(image_ids.size(), num_threads, [&](const size_t k) {
+    const Image& image = reconstruction.Image(image_ids[k]);
+    const Camera& camera = reconstruction.Camera(image.CameraId());
+    const auto& observations = image_observations[k];
+
+    thread_local std::vector<Eigen::Vector2d> image_points2D;
+    thread_local std::vector<Eigen::Vector3d> image_points3D;
+    thread_local std::vector<double> image_squared_reproj_errors;
+    image_points2D.resize(observations.size());
+    image_points3D.resize(observations.size());
+    for (size_t l = 0; l < observations.size(); ++l) {
+      const Point3D& point3D = *points3D[observations[l].first];
+      const TrackElement& track_el =
+          point3D.track.Element(observations[l].second);
+      image_points2D[l] = image.Point2D(track_el.point2D_idx).xy;
+      image_points3D[l] = point3D.xyz;
+    }
+
+    CalculateSquaredReprojectionErrors(image_points2D,
+                                       image_points3D,
+                                       image.CamFromWorld(),
+                                       camera,
+                                       &image_squared_reproj_errors,
+                                       is_refractive);
+
+    for (size_t l = 0; l < observations.size(); ++l) {
+      (*squared_reproj_errors)[(*offsets)[observations[l].first] +
+                               observations[l].second] =
+          image_squared_reproj_errors[l];
+    }
+  });
+}
+
+}  // namespace
 
 Reconstruction::Reconstruction()
-    : correspondence_graph_(nullptr), num_added_points3D_(0) {}
+    : correspondence_graph_(nullptr),
+      num_added_points3D_(0),
+      all_points3D_modified_(true) {}
 
 std::unordered_set<point3D_t> Reconstruction::Point3DIds() const {
   std::unordered_set<point3D_t> point3D_ids;
@@ -77,7 +252,7 @@ void Reconstruction::Load(const DatabaseCache& database_cache) {
       class Image& existing_image = Image(image.second.ImageId());
       CHECK_EQ(existing_image.Name(), image.second.Name());
       if (existing_image.NumPoints2D() == 0) {
-        existing_image.SetPoints2D(image.second.Points2D());
+        existing_image.SetPoints2D(image.second.Points2D().ToVector());
       } else {
         CHECK_EQ(image.second.NumPoints2D(), existing_image.NumPoints2D());
       }
@@ -196,6 +371,8 @@ point3D_t Reconstruction::AddPoint3D(const Eigen::Vector3d& xyz,
   point3D.track = std::move(track);
   point3D.color = color;
 
+  SetModifiedPoint3D(point3D_id);
+
   return point3D_id;
 }
 
@@ -213,6 +390,8 @@ void Reconstruction::AddObservation(const point3D_t point3D_id,
   const bool kIsContinuedPoint3D = true;
   SetObservationAsTriangulated(
       track_el.image_id, track_el.point2D_idx, kIsContinuedPoint3D);
+
+  SetModifiedPoint3D(point3D_id);
 }
 
 point3D_t Reconstruction::MergePoints3D(const point3D_t point3D_id1,
@@ -262,6 +441,7 @@ void Reconstruction::DeletePoint3D(const point3D_t point3D_id) {
   }
 
   points3D_.erase(point3D_id);
+  modified_point3D_ids_.erase(point3D_id);
 }
 
 void Reconstruction::DeleteObservation(const image_t image_id,
@@ -284,10 +464,33 @@ void Reconstruction::DeleteObservation(const image_t image_id,
   ResetTriObservations(image_id, point2D_idx, kIsDeletedPoint3D);
 
   image.ResetPoint3DForPoint2D(point2D_idx);
+
+  SetModifiedPoint3D(point3D_id);
+}
+
+void Reconstruction::CompactPoints3D() {
+  std::vector<point3D_t> point3D_ids;
+  point3D_ids.reserve(points3D_.size());
+  for (const auto& point3D : points3D_) {
+    point3D_ids.push_back(point3D.first);
+  }
+  std::sort(point3D_ids.begin(), point3D_ids.end());
+
+  Point3DMap points3D;
+  points3D.reserve(point3D_ids.size());
+  for (const point3D_t point3D_id : point3D_ids) {
+    struct Point3D& point3D =
+        points3D.emplace(point3D_id, std::move(points3D_.at(point3D_id)))
+            .first->second;
+    point3D.track.Compress();
+  }
+
+  points3D_ = std::move(points3D);
 }
 
 void Reconstruction::DeleteAllPoints2DAndPoints3D() {
   points3D_.clear();
+  modified_point3D_ids_.clear();
   for (auto& image : images_) {
     class Image new_image;
     new_image.SetImageId(image.second.ImageId());
@@ -307,6 +510,7 @@ void Reconstruction::RegisterImage(const image_t image_id) {
   if (!image.IsRegistered()) {
     image.SetRegistered(true);
     reg_image_ids_.push_back(image_id);
+    visibility_changed_image_ids_.insert(image_id);
   }
 }
 
@@ -321,6 +525,7 @@ void Reconstruction::DeRegisterImage(const image_t image_id) {
   }
 
   image.SetRegistered(false);
+  visibility_changed_image_ids_.insert(image_id);
 
   reg_image_ids_.erase(
       std::remove(reg_image_ids_.begin(), reg_image_ids_.end(), image_id),
@@ -410,38 +615,71 @@ Reconstruction::ComputeBoundsAndCentroid(const double p0,
     }
   }
 
-  // Determine robust bounding box and mean.
-
-  std::sort(coords_x.begin(), coords_x.end());
-  std::sort(coords_y.begin(), coords_y.end());
-  std::sort(coords_z.begin(), coords_z.end());
+  // Determine robust bounding box and mean. Only the coordinates between the
+  // percentiles are required, such that the coordinates are partitioned around
+  // the percentiles instead of fully sorted.
 
   const size_t P0 = static_cast<size_t>(
       (coords_x.size() > 3) ? p0 * (coords_x.size() - 1) : 0);
   const size_t P1 = static_cast<size_t>(
       (coords_x.size() > 3) ? p1 * (coords_x.size() - 1) : coords_x.size() - 1);
 
-  const Eigen::Vector3d bbox_min(coords_x[P0], coords_y[P0], coords_z[P0]);
-  const Eigen::Vector3d bbox_max(coords_x[P1], coords_y[P1], coords_z[P1]);
-
-  Eigen::Vector3d mean_coord(0, 0, 0);
-  for (size_t i = P0; i <= P1; ++i) {
-    mean_coord(0) += coords_x[i];
-    mean_coord(1) += coords_y[i];
-    mean_coord(2) += coords_z[i];
+  Eigen::Vector3d bbox_min;
+  Eigen::Vector3d bbox_max;
+  Eigen::Vector3d mean_coord;
+  std::array<std::vector<float>*, 3> coords = {&coords_x, &coords_y, &coords_z};
+  for (int d = 0; d < 3; ++d) {
+    std::vector<float>& coords_d = *coords[d];
+    std::nth_element(coords_d.begin(), coords_d.begin() + P0, coords_d.end());
+    bbox_min(d) = coords_d[P0];
+    std::nth_element(
+        coords_d.begin() + P0, coords_d.begin() + P1, coords_d.end());
+    bbox_max(d) = coords_d[P1];
+    double sum = 0;
+    for (size_t i = P0; i <= P1; ++i) {
+      sum += coords_d[i];
+    }
+    mean_coord(d) = sum / (P1 - P0 + 1);
   }
-  mean_coord /= P1 - P0 + 1;
 
   return std::make_tuple(bbox_min, bbox_max, mean_coord);
 }
 
-void Reconstruction::Transform(const Sim3d& new_from_old_world) {
+void Reconstruction::Transform(const Sim3d& new_from_old_world,
+                               const int num_threads) {
   for (auto& image : images_) {
     image.second.CamFromWorld() =
         TransformCameraWorld(new_from_old_world, image.second.CamFromWorld());
   }
+
+  // The points are scattered over the nodes of the map, such that they are
+  // gathered into contiguous batches, transformed with vectorized arithmetic,
+  // and scattered back in parallel.
+  std::vector<Eigen::Vector3d*> xyzs;
+  xyzs.reserve(points3D_.size());
   for (auto& point3D : points3D_) {
-    point3D.second.xyz = new_from_old_world * point3D.second.xyz;
+    xyzs.push_back(&point3D.second.xyz);
+  }
+  const size_t num_batches =
+      (xyzs.size() + kTransformBatchSize - 1) / kTransformBatchSize;
+  ParallelFor(num_batches, num_threads, [&](const size_t i) {
+    const size_t begin = i * kTransformBatchSize;
+    const size_t end = std::min(begin + kTransformBatchSize, xyzs.size());
+    Points3DSoA old_xyzs(3, end - begin);
+    for (size_t j = begin; j < end; ++j) {
+      old_xyzs.col(j - begin) = *xyzs[j];
+    }
+    Points3DSoA new_xyzs;
+    TransformPoints(new_from_old_world, old_xyzs, &new_xyzs);
+    for (size_t j = begin; j < end; ++j) {
+      *xyzs[j] = new_xyzs.col(j - begin);
+    }
+  });
+
+  // Rigid transformations preserve the reprojection errors and triangulation
+  // angles, while scaling changes the errors of refractive cameras.
+  if (new_from_old_world.scale != 1) {
+    SetAllPoints3DModified();
   }
 }
 
@@ -503,7 +741,7 @@ void Reconstruction::TranscribeImageIdsToDatabase(const Database& database) {
   std::unordered_map<image_t, image_t> old_to_new_image_ids;
   old_to_new_image_ids.reserve(NumImages());
 
-  std::unordered_map<image_t, class Image> new_images;
+  DenseIdMap<image_t, class Image> new_images;
   new_images.reserve(NumImages());
 
   for (auto& image : images_) {
@@ -536,12 +774,13 @@ size_t Reconstruction::FilterPoints3D(
     const double max_reproj_error,
     const double min_tri_angle,
     const std::unordered_set<point3D_t>& point3D_ids,
-    bool is_refractive) {
+    const bool is_refractive,
+    const int num_threads) {
   size_t num_filtered = 0;
   num_filtered += FilterPoints3DWithLargeReprojectionError(
-      max_reproj_error, point3D_ids, is_refractive);
+      max_reproj_error, point3D_ids, is_refractive, num_threads);
   num_filtered += FilterPoints3DWithSmallTriangulationAngle(
-      min_tri_angle, point3D_ids, is_refractive);
+      min_tri_angle, point3D_ids, is_refractive, num_threads);
   return num_filtered;
 }
 
@@ -549,7 +788,8 @@ size_t Reconstruction::FilterPoints3DInImages(
     const double max_reproj_error,
     const double min_tri_angle,
     const std::unordered_set<image_t>& image_ids,
-    bool is_refractive) {
+    const bool is_refractive,
+    const int num_threads) {
   std::unordered_set<point3D_t> point3D_ids;
   for (const image_t image_id : image_ids) {
     const class Image& image = Image(image_id);
@@ -559,22 +799,26 @@ size_t Reconstruction::FilterPoints3DInImages(
       }
     }
   }
-  return FilterPoints3D(
-      max_reproj_error, min_tri_angle, point3D_ids, is_refractive);
+  return FilterPoints3D(max_reproj_error,
+                        min_tri_angle,
+                        point3D_ids,
+                        is_refractive,
+                        num_threads);
 }
 
 size_t Reconstruction::FilterAllPoints3D(const double max_reproj_error,
                                          const double min_tri_angle,
-                                         bool is_refractive) {
+                                         const bool is_refractive,
+                                         const int num_threads) {
   // Important: First filter observations and points with large reprojection
   // error, so that observations with large reprojection error do not make
   // a point stable through a large triangulation angle.
   const std::unordered_set<point3D_t>& point3D_ids = Point3DIds();
   size_t num_filtered = 0;
   num_filtered += FilterPoints3DWithLargeReprojectionError(
-      max_reproj_error, point3D_ids, is_refractive);
+      max_reproj_error, point3D_ids, is_refractive, num_threads);
   num_filtered += FilterPoints3DWithSmallTriangulationAngle(
-      min_tri_angle, point3D_ids, is_refractive);
+      min_tri_angle, point3D_ids, is_refractive, num_threads);
   return num_filtered;
 }
 
@@ -664,25 +908,149 @@ double Reconstruction::ComputeMeanReprojectionError() const {
   }
 }
 
-void Reconstruction::UpdatePoint3DErrors(const bool is_refractive) {
-  for (auto& point3D : points3D_) {
-    if (point3D.second.track.Length() == 0) {
-      point3D.second.error = 0;
-      continue;
+size_t Reconstruction::MemoryUsage() const {
+  size_t memory_usage = cameras_.MemoryUsage() + images_.MemoryUsage() +
+                        HashTableMemoryUsage(points3D_) +
+                        HashTableMemoryUsage(image_pair_stats_) +
+                        VectorMemoryUsage(reg_image_ids_) +
+                        HashTableMemoryUsage(modified_point3D_ids_) +
+                        HashTableMemoryUsage(visibility_changed_image_ids_);
+  for (const auto& camera : cameras_) {
+    memory_usage += camera.second.MemoryUsage();
+  }
+  for (const auto& image : images_) {
+    memory_usage += image.second.MemoryUsage();
+  }
+  for (const auto& point3D : points3D_) {
+    memory_usage += point3D.second.track.MemoryUsage();
+  }
+  return memory_usage;
+}
+
+void Reconstruction::UpdatePoint3DErrors(const bool is_refractive,
+                                         const int num_threads) {
+  UpdatePoint3DErrors(Point3DIds(), is_refractive, num_threads);
+}
+
+void Reconstruction::UpdatePoint3DErrors(
+    const std::unordered_set<point3D_t>& point3D_ids,
+    const bool is_refractive,
+    const int num_threads) {
+  if (is_refractive) {
+    UpdateRefracProjectionTables();
+  }
+
+  std::vector<struct Point3D*> points3D;
+  points3D.reserve(point3D_ids.size());
+  for (const point3D_t point3D_id : point3D_ids) {
+    if (ExistsPoint3D(point3D_id)) {
+      points3D.push_back(&Point3D(point3D_id));
     }
-    point3D.second.error = 0;
-    for (const auto& track_el : point3D.second.track.Elements()) {
-      const auto& image = Image(track_el.image_id);
-      const auto& point2D = image.Point2D(track_el.point2D_idx);
-      const auto& camera = Camera(image.CameraId());
-      point3D.second.error +=
-          std::sqrt(CalculateSquaredReprojectionError(point2D.xy,
-                                                      point3D.second.xyz,
-                                                      image.CamFromWorld(),
-                                                      camera,
-                                                      is_refractive));
+  }
+
+  std::vector<size_t> offsets;
+  std::vector<double> squared_reproj_errors;
+  ComputeSquaredReprojectionErrors(
+      *this,
+      std::vector<const struct Point3D*>(points3D.begin(), points3D.end()),
+      is_refractive,
+      num_threads,
+      &offsets,
+      &squared_reproj_errors);
+
+  ParallelFor(points3D.size(), num_threads, [&](const size_t i) {
+    struct Point3D& point3D = *points3D[i];
+    point3D.error = 0;
+    if (point3D.track.Length() == 0) {
+      return;
+    }
+    for (size_t j = offsets[i]; j < offsets[i + 1]; ++j) {
+      point3D.error += std::sqrt(squared_reproj_errors[j]);
+    }
+    point3D.error /= point3D.track.Length();
+  });
+}
+
+void Reconstruction::SetModifiedPoint3D(const point3D_t point3D_id) {
+  if (!all_points3D_modified_) {
+    modified_point3D_ids_.insert(point3D_id);
+  }
+}
+
+void Reconstruction::SetModifiedImage(const image_t image_id) {
+  if (all_points3D_modified_) {
+    return;
+  }
+  for (const Point2D& point2D : Image(image_id).Points2D()) {
+    if (point2D.HasPoint3D()) {
+      modified_point3D_ids_.insert(point2D.point3D_id);
+    }
+  }
+}
+
+void Reconstruction::SetModifiedCamera(const camera_t camera_id) {
+  if (all_points3D_modified_) {
+    return;
+  }
+  for (const image_t image_id : reg_image_ids_) {
+    if (Image(image_id).CameraId() == camera_id) {
+      SetModifiedImage(image_id);
+    }
+  }
+}
+
+void Reconstruction::SetAllPoints3DModified() {
+  all_points3D_modified_ = true;
+  modified_point3D_ids_.clear();
+}
+
+std::unordered_set<point3D_t> Reconstruction::ModifiedPoint3DIds() const {
+  if (all_points3D_modified_) {
+    return Point3DIds();
+  }
+  return modified_point3D_ids_;
+}
+
+void Reconstruction::ClearModifiedPoints3D() {
+  all_points3D_modified_ = false;
+  modified_point3D_ids_.clear();
+}
+
+void Reconstruction::ClearVisibilityChangedImages() {
+  visibility_changed_image_ids_.clear();
+}
+
+size_t Reconstruction::FilterModifiedPoints3D(const double max_reproj_error,
+                                              const double min_tri_angle,
+                                              const bool is_refractive,
+                                              const int num_threads) {
+  // Important: First filter observations and points with large reprojection
+  // error, see `FilterAllPoints3D`.
+  const std::unordered_set<point3D_t> point3D_ids = ModifiedPoint3DIds();
+  size_t num_filtered = 0;
+  num_filtered += FilterPoints3DWithLargeReprojectionError(
+      max_reproj_error, point3D_ids, is_refractive, num_threads);
+  num_filtered += FilterPoints3DWithSmallTriangulationAngle(
+      min_tri_angle, point3D_ids, is_refractive, num_threads);
+  ClearModifiedPoints3D();
+  return num_filtered;
+}
+
+void Reconstruction::UpdateRefracProjectionTables() {
+  for (auto& camera : cameras_) {
+    if (camera.second.IsCameraRefractive() &&
+        !camera.second.HasValidRefracProjectionTable()) {
+      camera.second.BuildRefracProjectionTable();
+    }
+  }
+}
+
+void Reconstruction::UpdateRefracVirtualCameraTables() {
+  for (auto& camera : cameras_) {
+    if (camera.second.IsCameraRefractive() &&
+        !camera.second.HasValidRefracVirtualCameraTable()) {
+      camera.second.BuildRefracVirtualCameraTable();
     }
-    point3D.second.error /= point3D.second.track.Length();
   }
 }
 
@@ -695,6 +1063,8 @@ void Reconstruction::Read(const std::string& path) {
              ExistsFile(JoinPaths(path, "images.txt")) &&
              ExistsFile(JoinPaths(path, "points3D.txt"))) {
     ReadText(path);
+  } else if (ExistsFile(JoinPaths(path, kMappedReconstructionFileName))) {
+    ReadMapped(path);
   } else {
     LOG(FATAL) << "cameras, images, points3D files do not exist at " << path;
   }
@@ -706,12 +1076,47 @@ void Reconstruction::ReadText(const std::string& path) {
   ReadCamerasText(JoinPaths(path, "cameras.txt"));
   ReadImagesText(JoinPaths(path, "images.txt"));
   ReadPoints3DText(JoinPaths(path, "points3D.txt"));
+  SetAllPoints3DModified();
 }
 
 void Reconstruction::ReadBinary(const std::string& path) {
   ReadCamerasBinary(JoinPaths(path, "cameras.bin"));
   ReadImagesBinary(JoinPaths(path, "images.bin"));
   ReadPoints3DBinary(JoinPaths(path, "points3D.bin"));
+  SetAllPoints3DModified();
+}
+
+void Reconstruction::ReadMapped(const std::string& path) {
+  const MappedReconstruction mapped(
+      JoinPaths(path, kMappedReconstructionFileName));
+
+  cameras_.reserve(mapped.NumCameras());
+  for (size_t i = 0; i < mapped.NumCameras(); ++i) {
+    struct Camera camera = mapped.Camera(i);
+    cameras_.emplace(camera.camera_id, std::move(camera));
+  }
+
+  images_.reserve(mapped.NumImages());
+  reg_image_ids_.reserve(mapped.NumImages());
+  for (size_t i = 0; i < mapped.NumImages(); ++i) {
+    class Image image = mapped.Image(i);
+    reg_image_ids_.push_back(image.ImageId());
+    images_.emplace(image.ImageId(), std::move(image));
+  }
+
+  points3D_.reserve(mapped.NumPoints3D());
+  for (size_t i = 0; i < mapped.NumPoints3D(); ++i) {
+    const point3D_t point3D_id = mapped.Point3DRecordAt(i).point3D_id;
+    num_added_points3D_ = std::max(num_added_points3D_, point3D_id);
+    points3D_.emplace(point3D_id, mapped.Point3D(i));
+  }
+
+  SetAllPoints3DModified();
+}
+
+void Reconstruction::WriteMapped(const std::string& path) const {
+  MappedReconstruction::Write(*this,
+                              JoinPaths(path, kMappedReconstructionFileName));
 }
 
 void Reconstruction::WriteText(const std::string& path) const {
@@ -724,6 +1129,14 @@ void Reconstruction::WriteBinary(const std::string& path) const {
   WriteCamerasBinary(JoinPaths(path, "cameras.bin"));
   WriteImagesBinary(JoinPaths(path, "images.bin"));
   WritePoints3DBinary(JoinPaths(path, "points3D.bin"));
+  // Persist the refracted rays of the observations, such that consumers of
+  // refractive models do not need to trace them again.
+  for (const auto& camera : cameras_) {
+    if (camera.second.IsCameraRefractive()) {
+      MappedRefracRays::Write(*this, JoinPaths(path, kRefracRaysFileName));
+      break;
+    }
+  }
 }
 
 std::vector<PlyPoint> Reconstruction::ConvertToPLY() const {
@@ -746,6 +1159,7 @@ std::vector<PlyPoint> Reconstruction::ConvertToPLY() const {
 
 void Reconstruction::ImportPLY(const std::string& path) {
   points3D_.clear();
+  SetAllPoints3DModified();
 
   const auto ply_points = ReadPly(path);
 
@@ -760,6 +1174,7 @@ void Reconstruction::ImportPLY(const std::string& path) {
 
 void Reconstruction::ImportPLY(const std::vector<PlyPoint>& ply_points) {
   points3D_.clear();
+  SetAllPoints3DModified();
   points3D_.reserve(ply_points.size());
   for (const auto& ply_point : ply_points) {
     AddPoint3D(Eigen::Vector3d(ply_point.x, ply_point.y, ply_point.z),
@@ -1264,59 +1679,118 @@ bool Reconstruction::ExtractColorsForImage(const image_t image_id,
   }
 
   const Eigen::Vector3ub kBlackColor(0, 0, 0);
+  std::vector<struct Point3D*> points3D;
+  std::vector<Eigen::Vector2d> points;
   for (const Point2D& point2D : image.Points2D()) {
     if (point2D.HasPoint3D()) {
       struct Point3D& point3D = Point3D(point2D.point3D_id);
       if (point3D.color == kBlackColor) {
-        BitmapColor<float> color;
+        points3D.push_back(&point3D);
         // COLMAP assumes that the upper left pixel center is (0.5, 0.5).
-        if (bitmap.InterpolateBilinear(
-                point2D.xy(0) - 0.5, point2D.xy(1) - 0.5, &color)) {
-          const BitmapColor<uint8_t> color_ub = color.Cast<uint8_t>();
-          point3D.color = Eigen::Vector3ub(color_ub.r, color_ub.g, color_ub.b);
-        }
+        points.emplace_back(point2D.xy(0) - 0.5, point2D.xy(1) - 0.5);
       }
     }
   }
 
+  std::vector<BitmapColor<float>> colors;
+  std::vector<char> valid;
+  bitmap.InterpolateBilinear(points, &colors, &valid);
+  for (size_t i = 0; i < points3D.size(); ++i) {
+    if (valid[i]) {
+      const BitmapColor<uint8_t> color_ub = colors[i].Cast<uint8_t>();
+      points3D[i]->color = Eigen::Vector3ub(color_ub.r, color_ub.g, color_ub.b);
+    }
+  }
+
   return true;
 }
 
-void Reconstruction::ExtractColorsForAllImages(const std::string& path) {
+void Reconstruction::ExtractColorsForAllImages(const std::string& path,
+                                               const int num_threads) {
+  // Colors of the observations of an image with 3D points.
+  struct ImageColors {
+    bool read = false;
+    std::vector<point3D_t> point3D_ids;
+    std::vector<BitmapColor<float>> colors;
+    std::vector<char> valid;
+  };
+
+  // Reads the image and samples the colors of its observations. The bitmap is
+  // released before returning, so that only the sampled colors are queued.
+  const auto ReadImageColors = [this, &path](const image_t image_id) {
+    const class Image& image = Image(image_id);
+    ImageColors image_colors;
+    Bitmap bitmap;
+    if (!bitmap.Read(JoinPaths(path, image.Name()))) {
+      return image_colors;
+    }
+    image_colors.read = true;
+
+    std::vector<Eigen::Vector2d> points;
+    points.reserve(image.NumPoints3D());
+    image_colors.point3D_ids.reserve(image.NumPoints3D());
+    for (const Point2D& point2D : image.Points2D()) {
+      if (point2D.HasPoint3D()) {
+        image_colors.point3D_ids.push_back(point2D.point3D_id);
+        // COLMAP assumes that the upper left pixel center is (0.5, 0.5).
+        points.emplace_back(point2D.xy(0) - 0.5, point2D.xy(1) - 0.5);
+      }
+    }
+
+    bitmap.InterpolateBilinear(
+        points, &image_colors.colors, &image_colors.valid);
+    return image_colors;
+  };
+
   std::unordered_map<point3D_t, Eigen::Vector3d> color_sums;
   std::unordered_map<point3D_t, size_t> color_counts;
-
+  color_sums.reserve(points3D_.size());
+  color_counts.reserve(points3D_.size());
+
+  // Images are read and sampled on the thread pool, while the colors are
+  // accumulated in the order of the registered images, so that the result
+  // does not depend on the number of threads. A bounded number of images is
+  // prefetched ahead of the accumulation to limit the memory usage.
+  ThreadPool thread_pool(GetEffectiveNumThreads(num_threads));
+  const size_t max_num_prefetched = 2 * thread_pool.NumThreads();
+  std::deque<std::future<ImageColors>> futures;
+  size_t next_image_idx = 0;
   for (size_t i = 0; i < reg_image_ids_.size(); ++i) {
-    const class Image& image = Image(reg_image_ids_[i]);
-    const std::string image_path = JoinPaths(path, image.Name());
+    while (next_image_idx < reg_image_ids_.size() &&
+           next_image_idx < i + max_num_prefetched) {
+      futures.push_back(thread_pool.AddTask(
+          ReadImageColors, reg_image_ids_[next_image_idx]));
+      ++next_image_idx;
+    }
 
-    Bitmap bitmap;
-    if (!bitmap.Read(image_path)) {
+    const ImageColors image_colors = futures.front().get();
+    futures.pop_front();
+
+    if (!image_colors.read) {
+      const class Image& image = Image(reg_image_ids_[i]);
       LOG(WARNING) << StringPrintf("Could not read image %s at path %s.",
                                    image.Name().c_str(),
-                                   image_path.c_str())
+                                   JoinPaths(path, image.Name()).c_str())
                    << std::endl;
       continue;
     }
 
-    for (const Point2D& point2D : image.Points2D()) {
-      if (point2D.HasPoint3D()) {
-        BitmapColor<float> color;
-        // COLMAP assumes that the upper left pixel center is (0.5, 0.5).
-        if (bitmap.InterpolateBilinear(
-                point2D.xy(0) - 0.5, point2D.xy(1) - 0.5, &color)) {
-          if (color_sums.count(point2D.point3D_id)) {
-            Eigen::Vector3d& color_sum = color_sums[point2D.point3D_id];
-            color_sum(0) += color.r;
-            color_sum(1) += color.g;
-            color_sum(2) += color.b;
-            color_counts[point2D.point3D_id] += 1;
-          } else {
-            color_sums.emplace(point2D.point3D_id,
-                               Eigen::Vector3d(color.r, color.g, color.b));
-            color_counts.emplace(point2D.point3D_id, 1);
-          }
-        }
+    for (size_t j = 0; j < image_colors.point3D_ids.size(); ++j) {
+      if (!image_colors.valid[j]) {
+        continue;
+      }
+      const point3D_t point3D_id = image_colors.point3D_ids[j];
+      const BitmapColor<float>& color = image_colors.colors[j];
+      const auto color_sum = color_sums.find(point3D_id);
+      if (color_sum != color_sums.end()) {
+        color_sum->second(0) += color.r;
+        color_sum->second(1) += color.g;
+        color_sum->second(2) += color.b;
+        color_counts[point3D_id] += 1;
+      } else {
+        color_sums.emplace(point3D_id,
+                           Eigen::Vector3d(color.r, color.g, color.b));
+        color_counts.emplace(point3D_id, 1);
       }
     }
   }
@@ -1357,74 +1831,63 @@ void Reconstruction::CreateImageDirs(const std::string& path) const {
 size_t Reconstruction::FilterPoints3DWithSmallTriangulationAngle(
     const double min_tri_angle,
     const std::unordered_set<point3D_t>& point3D_ids,
-    bool is_refractive) {
-  // Number of filtered points.
-  size_t num_filtered = 0;
-
+    const bool is_refractive,
+    const int num_threads) {
   // Minimum triangulation angle in radians.
   const double min_tri_angle_rad = DegToRad(min_tri_angle);
 
-  // Cache for image projection centers.
-  std::unordered_map<image_t, Eigen::Vector3d> proj_centers;
+  const std::vector<point3D_t> existing_point3D_ids =
+      ExistingPoint3DIds(point3D_ids);
 
-  for (const auto point3D_id : point3D_ids) {
-    if (!ExistsPoint3D(point3D_id)) {
-      continue;
-    }
+  // Evaluate the points in parallel and delete them sequentially afterwards.
+  std::vector<char> keep_points(existing_point3D_ids.size(), 0);
+  ParallelFor(existing_point3D_ids.size(), num_threads, [&](const size_t i) {
+    const struct Point3D& point3D = Point3D(existing_point3D_ids[i]);
 
-    const struct Point3D& point3D = Point3D(point3D_id);
+    // Projection centers of the track elements. In the refractive case, these
+    // are the centers of the virtual cameras of the individual observations.
+    std::vector<Eigen::Vector3d> proj_centers(point3D.track.Length());
 
     // Calculate triangulation angle for all pairwise combinations of image
     // poses in the track. Only delete point if none of the combinations
     // has a sufficient triangulation angle.
-    bool keep_point = false;
     for (size_t i1 = 0; i1 < point3D.track.Length(); ++i1) {
-      const image_t image_id1 = point3D.track.Element(i1).image_id;
-
-      Eigen::Vector3d proj_center1;
-      if (proj_centers.count(image_id1) == 0) {
-        const class Image& image1 = Image(image_id1);
-        if (!is_refractive) {
-          // Non-refractive case
-          proj_center1 = image1.ProjectionCenter();
-        } else {
-          const class Camera& camera1 = Camera(image1.CameraId());
-          const Eigen::Vector2d point2D1 =
-              image1.Point2D(point3D.track.Element(i1).point2D_idx).xy;
-          class Camera virtual_camera1;
-          Rigid3d virtual_from_real;
-          camera1.ComputeVirtual(point2D1, virtual_camera1, virtual_from_real);
-          const Rigid3d virtual_from_world =
-              virtual_from_real * image1.CamFromWorld();
-          proj_center1 = virtual_from_world.rotation.inverse() *
-                         -virtual_from_world.translation;
-        }
-        proj_centers.emplace(image_id1, proj_center1);
+      const TrackElement& track_el = point3D.track.Element(i1);
+      const class Image& image1 = Image(track_el.image_id);
+      if (!is_refractive) {
+        // Non-refractive case
+        proj_centers[i1] = image1.ProjectionCenter();
       } else {
-        proj_center1 = proj_centers.at(image_id1);
+        const class Camera& camera1 = Camera(image1.CameraId());
+        class Camera virtual_camera1;
+        Rigid3d virtual_from_real;
+        camera1.ComputeVirtual(image1.Point2DXY(track_el.point2D_idx),
+                               virtual_camera1,
+                               virtual_from_real);
+        const Rigid3d virtual_from_world =
+            virtual_from_real * image1.CamFromWorld();
+        proj_centers[i1] = virtual_from_world.rotation.inverse() *
+                           -virtual_from_world.translation;
       }
 
       for (size_t i2 = 0; i2 < i1; ++i2) {
-        const image_t image_id2 = point3D.track.Element(i2).image_id;
-        const Eigen::Vector3d proj_center2 = proj_centers.at(image_id2);
-
         const double tri_angle = CalculateTriangulationAngle(
-            proj_center1, proj_center2, point3D.xyz);
-
+            proj_centers[i1], proj_centers[i2], point3D.xyz);
         if (tri_angle >= min_tri_angle_rad) {
-          keep_point = true;
-          break;
+          keep_points[i] = 1;
+          return;
         }
       }
-
-      if (keep_point) {
-        break;
-      }
     }
+  });
 
-    if (!keep_point) {
+  // Number of filtered points.
+  size_t num_filtered = 0;
+
+  for (size_t i = 0; i < existing_point3D_ids.size(); ++i) {
+    if (!keep_points[i]) {
       num_filtered += 1;
-      DeletePoint3D(point3D_id);
+      DeletePoint3D(existing_point3D_ids[i]);
     }
   }
 
@@ -1434,58 +1897,91 @@ size_t Reconstruction::FilterPoints3DWithSmallTriangulationAngle(
 size_t Reconstruction::FilterPoints3DWithLargeReprojectionError(
     const double max_reproj_error,
     const std::unordered_set<point3D_t>& point3D_ids,
-    bool is_refractive) {
+    const bool is_refractive,
+    const int num_threads) {
   const double max_squared_reproj_error = max_reproj_error * max_reproj_error;
 
-  // Number of filtered points.
-  size_t num_filtered = 0;
-
-  for (const auto point3D_id : point3D_ids) {
-    if (!ExistsPoint3D(point3D_id)) {
-      continue;
-    }
-
-    struct Point3D& point3D = Point3D(point3D_id);
-
-    if (point3D.track.Length() < 2) {
-      num_filtered += point3D.track.Length();
-      DeletePoint3D(point3D_id);
-      continue;
-    }
-
-    double reproj_error_sum = 0.0;
+  if (is_refractive) {
+    UpdateRefracProjectionTables();
+  }
 
-    std::vector<TrackElement> track_els_to_delete;
+  const std::vector<point3D_t> existing_point3D_ids =
+      ExistingPoint3DIds(point3D_ids);
 
-    for (const auto& track_el : point3D.track.Elements()) {
-      const class Image& image = Image(track_el.image_id);
-      const struct Camera& camera = Camera(image.CameraId());
-      const Point2D& point2D = image.Point2D(track_el.point2D_idx);
-      const double squared_reproj_error = CalculateSquaredReprojectionError(
-          point2D.xy, point3D.xyz, image.CamFromWorld(), camera, is_refractive);
+  // Evaluate the points in parallel without modifying the reconstruction and
+  // apply the deletions sequentially afterwards. Points with too short tracks
+  // are deleted without evaluating them.
+  std::vector<const struct Point3D*> points3D;
+  points3D.reserve(existing_point3D_ids.size());
+  for (const point3D_t point3D_id : existing_point3D_ids) {
+    const struct Point3D& point3D = Point3D(point3D_id);
+    points3D.push_back(point3D.track.Length() < 2 ? nullptr : &point3D);
+  }
+
+  std::vector<size_t> offsets;
+  std::vector<double> squared_reproj_errors;
+  ComputeSquaredReprojectionErrors(*this,
+                                   points3D,
+                                   is_refractive,
+                                   num_threads,
+                                   &offsets,
+                                   &squared_reproj_errors);
+
+  std::vector<std::vector<TrackElement>> track_els_to_delete(
+      existing_point3D_ids.size());
+  std::vector<double> reproj_error_sums(existing_point3D_ids.size(), 0.0);
+  ParallelFor(existing_point3D_ids.size(), num_threads, [&](const size_t i) {
+    if (points3D[i] == nullptr) {
+      return;
+    }
+    const struct Point3D& point3D = *points3D[i];
+    for (size_t j = 0; j < point3D.track.Length(); ++j) {
+      const TrackElement& track_el = point3D.track.Element(j);
+      const double squared_reproj_error = squared_reproj_errors[offsets[i] + j];
       if (std::isnan(squared_reproj_error) ||
           squared_reproj_error > max_squared_reproj_error) {
-        track_els_to_delete.push_back(track_el);
+        track_els_to_delete[i].push_back(track_el);
       } else {
-        reproj_error_sum += std::sqrt(squared_reproj_error);
+        reproj_error_sums[i] += std::sqrt(squared_reproj_error);
       }
     }
+  });
 
-    if (track_els_to_delete.size() >= point3D.track.Length() - 1) {
+  // Number of filtered points.
+  size_t num_filtered = 0;
+
+  for (size_t i = 0; i < existing_point3D_ids.size(); ++i) {
+    const point3D_t point3D_id = existing_point3D_ids[i];
+    struct Point3D& point3D = Point3D(point3D_id);
+
+    if (point3D.track.Length() < 2 ||
+        track_els_to_delete[i].size() >= point3D.track.Length() - 1) {
       num_filtered += point3D.track.Length();
       DeletePoint3D(point3D_id);
     } else {
-      num_filtered += track_els_to_delete.size();
-      for (const auto& track_el : track_els_to_delete) {
+      num_filtered += track_els_to_delete[i].size();
+      for (const auto& track_el : track_els_to_delete[i]) {
         DeleteObservation(track_el.image_id, track_el.point2D_idx);
       }
-      point3D.error = reproj_error_sum / point3D.track.Length();
+      point3D.error = reproj_error_sums[i] / point3D.track.Length();
     }
   }
 
   return num_filtered;
 }
 
+std::vector<point3D_t> Reconstruction::ExistingPoint3DIds(
+    const std::unordered_set<point3D_t>& point3D_ids) const {
+  std::vector<point3D_t> existing_point3D_ids;
+  existing_point3D_ids.reserve(point3D_ids.size());
+  for (const point3D_t point3D_id : point3D_ids) {
+    if (ExistsPoint3D(point3D_id)) {
+      existing_point3D_ids.push_back(point3D_id);
+    }
+  }
+  return existing_point3D_ids;
+}
+
 void Reconstruction::ReadCamerasText(const std::string& path) {
   cameras_.clear();
 
@@ -1761,93 +2257,168 @@ void Reconstruction::ReadCamerasBinary(const std::string& path) {
 }
 
 void Reconstruction::ReadImagesBinary(const std::string& path) {
-  std::ifstream file(path, std::ios::binary);
-  CHECK(file.is_open()) << path;
-
-  const size_t num_reg_images = ReadBinaryLittleEndian<uint64_t>(&file);
+  const std::string buffer = ReadBinaryFile(path);
+  const char* data = buffer.data();
+  const char* data_end = data + buffer.size();
+
+  const char* header = data;
+  SkipBinaryBytes(sizeof(uint64_t), data_end, &data);
+  const size_t num_reg_images = ReadBinaryLittleEndian<uint64_t>(&header);
+
+  // Locate the variable-length records in a sequential pass, such that they
+  // can then be parsed in parallel.
+  const size_t kNumFixedBytes =
+      sizeof(image_t) + 7 * sizeof(double) + sizeof(camera_t);
+  const size_t kNumPoint2DBytes = 2 * sizeof(double) + sizeof(point3D_t);
+  std::vector<const char*> records(num_reg_images);
   for (size_t i = 0; i < num_reg_images; ++i) {
-    class Image image;
-
-    image.SetImageId(ReadBinaryLittleEndian<image_t>(&file));
-
-    Rigid3d& cam_from_world = image.CamFromWorld();
-    cam_from_world.rotation.w() = ReadBinaryLittleEndian<double>(&file);
-    cam_from_world.rotation.x() = ReadBinaryLittleEndian<double>(&file);
-    cam_from_world.rotation.y() = ReadBinaryLittleEndian<double>(&file);
-    cam_from_world.rotation.z() = ReadBinaryLittleEndian<double>(&file);
-    cam_from_world.rotation.normalize();
-    cam_from_world.translation.x() = ReadBinaryLittleEndian<double>(&file);
-    cam_from_world.translation.y() = ReadBinaryLittleEndian<double>(&file);
-    cam_from_world.translation.z() = ReadBinaryLittleEndian<double>(&file);
-
-    image.SetCameraId(ReadBinaryLittleEndian<camera_t>(&file));
-
-    char name_char;
-    do {
-      file.read(&name_char, 1);
-      if (name_char != '\0') {
-        image.Name() += name_char;
+    records[i] = data;
+    SkipBinaryBytes(kNumFixedBytes, data_end, &data);
+    const char* name_end = static_cast<const char*>(
+        std::memchr(data, '\0', data_end - data));
+    CHECK(name_end != nullptr) << "Unexpected end of binary file";
+    data = name_end + 1;
+    const char* num_points2D_data = data;
+    SkipBinaryBytes(sizeof(uint64_t), data_end, &data);
+    const size_t num_points2D =
+        ReadBinaryLittleEndian<uint64_t>(&num_points2D_data);
+    CHECK_LE(num_points2D, (data_end - data) / kNumPoint2DBytes)
+        << "Unexpected end of binary file";
+    data += num_points2D * kNumPoint2DBytes;
+  }
+
+  images_.reserve(num_reg_images);
+  reg_image_ids_.reserve(num_reg_images);
+
+  std::vector<class Image> images;
+  for (size_t batch_begin = 0; batch_begin < num_reg_images;
+       batch_begin += kBinaryBatchSize) {
+    const size_t batch_end =
+        std::min(batch_begin + kBinaryBatchSize, num_reg_images);
+    images.clear();
+    images.resize(batch_end - batch_begin);
+
+    ParallelFor(images.size(), ThreadPool::kMaxNumThreads, [&](const size_t i) {
+      const char* record = records[batch_begin + i];
+      class Image& image = images[i];
+
+      image.SetImageId(ReadBinaryLittleEndian<image_t>(&record));
+
+      Rigid3d& cam_from_world = image.CamFromWorld();
+      cam_from_world.rotation.w() = ReadBinaryLittleEndian<double>(&record);
+      cam_from_world.rotation.x() = ReadBinaryLittleEndian<double>(&record);
+      cam_from_world.rotation.y() = ReadBinaryLittleEndian<double>(&record);
+      cam_from_world.rotation.z() = ReadBinaryLittleEndian<double>(&record);
+      cam_from_world.rotation.normalize();
+      cam_from_world.translation.x() = ReadBinaryLittleEndian<double>(&record);
+      cam_from_world.translation.y() = ReadBinaryLittleEndian<double>(&record);
+      cam_from_world.translation.z() = ReadBinaryLittleEndian<double>(&record);
+
+      image.SetCameraId(ReadBinaryLittleEndian<camera_t>(&record));
+
+      image.SetName(record);
+      record += image.Name().size() + 1;
+
+      const size_t num_points2D = ReadBinaryLittleEndian<uint64_t>(&record);
+
+      std::vector<Eigen::Vector2d> points2D;
+      points2D.reserve(num_points2D);
+      std::vector<point3D_t> point3D_ids;
+      point3D_ids.reserve(num_points2D);
+      for (size_t j = 0; j < num_points2D; ++j) {
+        const double x = ReadBinaryLittleEndian<double>(&record);
+        const double y = ReadBinaryLittleEndian<double>(&record);
+        points2D.emplace_back(x, y);
+        point3D_ids.push_back(ReadBinaryLittleEndian<point3D_t>(&record));
       }
-    } while (name_char != '\0');
 
-    const size_t num_points2D = ReadBinaryLittleEndian<uint64_t>(&file);
-
-    std::vector<Eigen::Vector2d> points2D;
-    points2D.reserve(num_points2D);
-    std::vector<point3D_t> point3D_ids;
-    point3D_ids.reserve(num_points2D);
-    for (size_t j = 0; j < num_points2D; ++j) {
-      const double x = ReadBinaryLittleEndian<double>(&file);
-      const double y = ReadBinaryLittleEndian<double>(&file);
-      points2D.emplace_back(x, y);
-      point3D_ids.push_back(ReadBinaryLittleEndian<point3D_t>(&file));
-    }
+      image.SetUp(Camera(image.CameraId()));
+      image.SetPoints2D(points2D);
 
-    image.SetUp(Camera(image.CameraId()));
-    image.SetPoints2D(points2D);
-
-    for (point2D_t point2D_idx = 0; point2D_idx < image.NumPoints2D();
-         ++point2D_idx) {
-      if (point3D_ids[point2D_idx] != kInvalidPoint3DId) {
-        image.SetPoint3DForPoint2D(point2D_idx, point3D_ids[point2D_idx]);
+      for (point2D_t point2D_idx = 0; point2D_idx < image.NumPoints2D();
+           ++point2D_idx) {
+        if (point3D_ids[point2D_idx] != kInvalidPoint3DId) {
+          image.SetPoint3DForPoint2D(point2D_idx, point3D_ids[point2D_idx]);
+        }
       }
-    }
 
-    image.SetRegistered(true);
-    reg_image_ids_.push_back(image.ImageId());
+      image.SetRegistered(true);
+    });
 
-    images_.emplace(image.ImageId(), image);
+    for (class Image& image : images) {
+      reg_image_ids_.push_back(image.ImageId());
+      images_.emplace(image.ImageId(), std::move(image));
+    }
   }
 }
 
 void Reconstruction::ReadPoints3DBinary(const std::string& path) {
-  std::ifstream file(path, std::ios::binary);
-  CHECK(file.is_open()) << path;
-
-  const size_t num_points3D = ReadBinaryLittleEndian<uint64_t>(&file);
+  const std::string buffer = ReadBinaryFile(path);
+  const char* data = buffer.data();
+  const char* data_end = data + buffer.size();
+
+  const char* header = data;
+  SkipBinaryBytes(sizeof(uint64_t), data_end, &data);
+  const size_t num_points3D = ReadBinaryLittleEndian<uint64_t>(&header);
+
+  // Locate the variable-length records in a sequential pass, such that they
+  // can then be parsed in parallel.
+  const size_t kNumFixedBytes =
+      sizeof(point3D_t) + 3 * sizeof(double) + 3 * sizeof(uint8_t) +
+      sizeof(double);
+  const size_t kNumTrackElementBytes = sizeof(image_t) + sizeof(point2D_t);
+  std::vector<const char*> records(num_points3D);
   for (size_t i = 0; i < num_points3D; ++i) {
-    struct Point3D point3D;
-
-    const point3D_t point3D_id = ReadBinaryLittleEndian<point3D_t>(&file);
-    num_added_points3D_ = std::max(num_added_points3D_, point3D_id);
-
-    point3D.xyz(0) = ReadBinaryLittleEndian<double>(&file);
-    point3D.xyz(1) = ReadBinaryLittleEndian<double>(&file);
-    point3D.xyz(2) = ReadBinaryLittleEndian<double>(&file);
-    point3D.color(0) = ReadBinaryLittleEndian<uint8_t>(&file);
-    point3D.color(1) = ReadBinaryLittleEndian<uint8_t>(&file);
-    point3D.color(2) = ReadBinaryLittleEndian<uint8_t>(&file);
-    point3D.error = ReadBinaryLittleEndian<double>(&file);
+    records[i] = data;
+    SkipBinaryBytes(kNumFixedBytes, data_end, &data);
+    const char* track_length_data = data;
+    SkipBinaryBytes(sizeof(uint64_t), data_end, &data);
+    const size_t track_length =
+        ReadBinaryLittleEndian<uint64_t>(&track_length_data);
+    CHECK_LE(track_length, (data_end - data) / kNumTrackElementBytes)
+        << "Unexpected end of binary file";
+    data += track_length * kNumTrackElementBytes;
+  }
+
+  points3D_.reserve(num_points3D);
+
+  std::vector<std::pair<point3D_t, struct Point3D>> points3D;
+  for (size_t batch_begin = 0; batch_begin < num_points3D;
+       batch_begin += kBinaryBatchSize) {
+    const size_t batch_end =
+        std::min(batch_begin + kBinaryBatchSize, num_points3D);
+    points3D.clear();
+    points3D.resize(batch_end - batch_begin);
+
+    ParallelFor(
+        points3D.size(), ThreadPool::kMaxNumThreads, [&](const size_t i) {
+          const char* record = records[batch_begin + i];
+          struct Point3D& point3D = points3D[i].second;
+
+          points3D[i].first = ReadBinaryLittleEndian<point3D_t>(&record);
+
+          point3D.xyz(0) = ReadBinaryLittleEndian<double>(&record);
+          point3D.xyz(1) = ReadBinaryLittleEndian<double>(&record);
+          point3D.xyz(2) = ReadBinaryLittleEndian<double>(&record);
+          point3D.color(0) = ReadBinaryLittleEndian<uint8_t>(&record);
+          point3D.color(1) = ReadBinaryLittleEndian<uint8_t>(&record);
+          point3D.color(2) = ReadBinaryLittleEndian<uint8_t>(&record);
+          point3D.error = ReadBinaryLittleEndian<double>(&record);
+
+          const size_t track_length = ReadBinaryLittleEndian<uint64_t>(&record);
+          point3D.track.Reserve(track_length);
+          for (size_t j = 0; j < track_length; ++j) {
+            const image_t image_id = ReadBinaryLittleEndian<image_t>(&record);
+            const point2D_t point2D_idx =
+                ReadBinaryLittleEndian<point2D_t>(&record);
+            point3D.track.AddElement(image_id, point2D_idx);
+          }
+        });
 
-    const size_t track_length = ReadBinaryLittleEndian<uint64_t>(&file);
-    for (size_t j = 0; j < track_length; ++j) {
-      const image_t image_id = ReadBinaryLittleEndian<image_t>(&file);
-      const point2D_t point2D_idx = ReadBinaryLittleEndian<point2D_t>(&file);
-      point3D.track.AddElement(image_id, point2D_idx);
+    for (auto& point3D : points3D) {
+      num_added_points3D_ = std::max(num_added_points3D_, point3D.first);
+      points3D_.emplace(point3D.first, std::move(point3D.second));
     }
-    point3D.track.Compress();
-
-    points3D_.emplace(point3D_id, point3D);
   }
 }
 
@@ -2021,34 +2592,43 @@ void Reconstruction::WriteImagesBinary(const std::string& path) const {
 
   WriteBinaryLittleEndian<uint64_t>(&file, reg_image_ids_.size());
 
+  std::vector<const class Image*> reg_images;
+  reg_images.reserve(reg_image_ids_.size());
   for (const auto& image : images_) {
-    if (!image.second.IsRegistered()) {
-      continue;
+    if (image.second.IsRegistered()) {
+      reg_images.push_back(&image.second);
     }
+  }
 
-    WriteBinaryLittleEndian<image_t>(&file, image.first);
+  WriteBinaryRecords(
+      &file, reg_images.size(), [&](const size_t i, std::string* buffer) {
+        const class Image& image = *reg_images[i];
 
-    const Rigid3d& cam_from_world = image.second.CamFromWorld();
-    WriteBinaryLittleEndian<double>(&file, cam_from_world.rotation.w());
-    WriteBinaryLittleEndian<double>(&file, cam_from_world.rotation.x());
-    WriteBinaryLittleEndian<double>(&file, cam_from_world.rotation.y());
-    WriteBinaryLittleEndian<double>(&file, cam_from_world.rotation.z());
-    WriteBinaryLittleEndian<double>(&file, cam_from_world.translation.x());
-    WriteBinaryLittleEndian<double>(&file, cam_from_world.translation.y());
-    WriteBinaryLittleEndian<double>(&file, cam_from_world.translation.z());
+        AppendBinaryLittleEndian<image_t>(buffer, image.ImageId());
 
-    WriteBinaryLittleEndian<camera_t>(&file, image.second.CameraId());
+        const Rigid3d& cam_from_world = image.CamFromWorld();
+        AppendBinaryLittleEndian<double>(buffer, cam_from_world.rotation.w());
+        AppendBinaryLittleEndian<double>(buffer, cam_from_world.rotation.x());
+        AppendBinaryLittleEndian<double>(buffer, cam_from_world.rotation.y());
+        AppendBinaryLittleEndian<double>(buffer, cam_from_world.rotation.z());
+        AppendBinaryLittleEndian<double>(buffer,
+                                         cam_from_world.translation.x());
+        AppendBinaryLittleEndian<double>(buffer,
+                                         cam_from_world.translation.y());
+        AppendBinaryLittleEndian<double>(buffer,
+                                         cam_from_world.translation.z());
 
-    const std::string name = image.second.Name() + '\0';
-    file.write(name.c_str(), name.size());
+        AppendBinaryLittleEndian<camera_t>(buffer, image.CameraId());
 
-    WriteBinaryLittleEndian<uint64_t>(&file, image.second.NumPoints2D());
-    for (const Point2D& point2D : image.second.Points2D()) {
-      WriteBinaryLittleEndian<double>(&file, point2D.xy(0));
-      WriteBinaryLittleEndian<double>(&file, point2D.xy(1));
-      WriteBinaryLittleEndian<point3D_t>(&file, point2D.point3D_id);
-    }
-  }
+        buffer->append(image.Name().c_str(), image.Name().size() + 1);
+
+        AppendBinaryLittleEndian<uint64_t>(buffer, image.NumPoints2D());
+        for (const Point2D& point2D : image.Points2D()) {
+          AppendBinaryLittleEndian<double>(buffer, point2D.xy(0));
+          AppendBinaryLittleEndian<double>(buffer, point2D.xy(1));
+          AppendBinaryLittleEndian<point3D_t>(buffer, point2D.point3D_id);
+        }
+      });
 }
 
 void Reconstruction::WritePoints3DBinary(const std::string& path) const {
@@ -2057,22 +2637,31 @@ void Reconstruction::WritePoints3DBinary(const std::string& path) const {
 
   WriteBinaryLittleEndian<uint64_t>(&file, points3D_.size());
 
+  std::vector<const Point3DMap::value_type*> points3D;
+  points3D.reserve(points3D_.size());
   for (const auto& point3D : points3D_) {
-    WriteBinaryLittleEndian<point3D_t>(&file, point3D.first);
-    WriteBinaryLittleEndian<double>(&file, point3D.second.xyz(0));
-    WriteBinaryLittleEndian<double>(&file, point3D.second.xyz(1));
-    WriteBinaryLittleEndian<double>(&file, point3D.second.xyz(2));
-    WriteBinaryLittleEndian<uint8_t>(&file, point3D.second.color(0));
-    WriteBinaryLittleEndian<uint8_t>(&file, point3D.second.color(1));
-    WriteBinaryLittleEndian<uint8_t>(&file, point3D.second.color(2));
-    WriteBinaryLittleEndian<double>(&file, point3D.second.error);
-
-    WriteBinaryLittleEndian<uint64_t>(&file, point3D.second.track.Length());
-    for (const auto& track_el : point3D.second.track.Elements()) {
-      WriteBinaryLittleEndian<image_t>(&file, track_el.image_id);
-      WriteBinaryLittleEndian<point2D_t>(&file, track_el.point2D_idx);
-    }
-  }
+    points3D.push_back(&point3D);
+  }
+
+  WriteBinaryRecords(
+      &file, points3D.size(), [&](const size_t i, std::string* buffer) {
+        const point3D_t point3D_id = points3D[i]->first;
+        const struct Point3D& point3D = points3D[i]->second;
+        AppendBinaryLittleEndian<point3D_t>(buffer, point3D_id);
+        AppendBinaryLittleEndian<double>(buffer, point3D.xyz(0));
+        AppendBinaryLittleEndian<double>(buffer, point3D.xyz(1));
+        AppendBinaryLittleEndian<double>(buffer, point3D.xyz(2));
+        AppendBinaryLittleEndian<uint8_t>(buffer, point3D.color(0));
+        AppendBinaryLittleEndian<uint8_t>(buffer, point3D.color(1));
+        AppendBinaryLittleEndian<uint8_t>(buffer, point3D.color(2));
+        AppendBinaryLittleEndian<double>(buffer, point3D.error);
+
+        AppendBinaryLittleEndian<uint64_t>(buffer, point3D.track.Length());
+        for (const auto& track_el : point3D.track.Elements()) {
+          AppendBinaryLittleEndian<image_t>(buffer, track_el.image_id);
+          AppendBinaryLittleEndian<point2D_t>(buffer, track_el.point2D_idx);
+        }
+      });
 }
 
 void Reconstruction::SetObservationAsTriangulated(
@@ -2095,6 +2684,9 @@ void Reconstruction::SetObservationAsTriangulated(
     class Image& corr_image = Image(corr->image_id);
     const Point2D& corr_point2D = corr_image.Point2D(corr->point2D_idx);
     corr_image.IncrementCorrespondenceHasPoint3D(corr->point2D_idx);
+    if (!corr_image.IsRegistered()) {
+      visibility_changed_image_ids_.insert(corr->image_id);
+    }
     // Update number of shared 3D points between image pairs and make sure to
     // only count the correspondences once (not twice forward and backward).
     if (point2D.point3D_id == corr_point2D.point3D_id &&
@@ -2128,6 +2720,9 @@ void Reconstruction::ResetTriObservations(const image_t image_id,
     class Image& corr_image = Image(corr->image_id);
     const Point2D& corr_point2D = corr_image.Point2D(corr->point2D_idx);
     corr_image.DecrementCorrespondenceHasPoint3D(corr->point2D_idx);
+    if (!corr_image.IsRegistered()) {
+      visibility_changed_image_ids_.insert(corr->image_id);
+    }
     // Update number of shared 3D points between image pairs and make sure to
     // only count the correspondences once (not twice forward and backward).
     if (point2D.point3D_id == corr_point2D.point3D_id &&
@@ -36,6 +36,7 @@
 #include "colmap/scene/point2d.h"
 #include "colmap/scene/point3d.h"
 #include "colmap/scene/track.h"
+#include "colmap/util/dense_id_map.h"
 #include "colmap/util/eigen_alignment.h"
 #include "colmap/util/types.h"
 
@@ -91,10 +92,10 @@ class Reconstruction {
                                         image_t image_id2) const;
 
   // Get reference to all objects.
-  inline const std::unordered_map<camera_t, struct Camera>& Cameras() const;
-  inline const std::unordered_map<image_t, class Image>& Images() const;
+  inline const DenseIdMap<camera_t, struct Camera>& Cameras() const;
+  inline const DenseIdMap<image_t, class Image>& Images() const;
   inline const std::vector<image_t>& RegImageIds() const;
-  inline const std::unordered_map<point3D_t, struct Point3D>& Points3D() const;
+  inline const Point3DMap& Points3D() const;
   inline const std::unordered_map<image_pair_t, ImagePairStat>& ImagePairs()
       const;
 
@@ -154,6 +155,13 @@ class Reconstruction {
   // Delete all 2D points of all images and all 3D points.
   void DeleteAllPoints2DAndPoints3D();
 
+  // Move the 3D points in the order of their identifiers into a new memory
+  // pool and shrink their tracks. This releases the memory of deleted points
+  // and tracks, such that iterating over all points is a mostly sequential
+  // memory scan again. Identifiers are unchanged, but references to 3D points
+  // are invalidated.
+  void CompactPoints3D();
+
   // Register an existing image.
   void RegisterImage(image_t image_id);
 
@@ -163,6 +171,13 @@ class Reconstruction {
   // Check if image is registered.
   inline bool IsImageRegistered(image_t image_id) const;
 
+  // The images whose registration changed or whose visible 3D points changed
+  // while not being registered since the last call to
+  // `ClearVisibilityChangedImages`. Used to incrementally update the ranking
+  // of the next images to register.
+  inline const std::unordered_set<image_t>& VisibilityChangedImageIds() const;
+  void ClearVisibilityChangedImages();
+
   // Normalize scene by scaling and translation to avoid degenerate
   // visualization after bundle adjustment and to improve numerical
   // stability of algorithms.
@@ -186,8 +201,10 @@ class Reconstruction {
   std::pair<Eigen::Vector3d, Eigen::Vector3d> ComputeBoundingBox(
       double p0 = 0.0, double p1 = 1.0) const;
 
-  // Apply the 3D similarity transformation to all images and points.
-  void Transform(const Sim3d& new_from_old_world);
+  // Apply the 3D similarity transformation to all images and points. The
+  // points are transformed in batches on `num_threads` threads, where -1 uses
+  // all cores.
+  void Transform(const Sim3d& new_from_old_world, int num_threads = -1);
 
   // Creates a cropped reconstruction using the input bounds as corner points
   // of the bounding box containing the included 3D points of the new
@@ -214,19 +231,25 @@ class Reconstruction {
   // @param max_reproj_error    The maximum reprojection error.
   // @param min_tri_angle       The minimum triangulation angle.
   // @param point3D_ids         The points to be filtered.
+  // @param num_threads         The number of threads to evaluate the points,
+  //                            where -1 uses all cores. The points are then
+  //                            deleted sequentially.
   //
   // @return                    The number of filtered observations.
   size_t FilterPoints3D(double max_reproj_error,
                         double min_tri_angle,
                         const std::unordered_set<point3D_t>& point3D_ids,
-                        bool is_refractive = false);
+                        bool is_refractive = false,
+                        int num_threads = 1);
   size_t FilterPoints3DInImages(double max_reproj_error,
                                 double min_tri_angle,
                                 const std::unordered_set<image_t>& image_ids,
-                                bool is_refractive = false);
+                                bool is_refractive = false,
+                                int num_threads = 1);
   size_t FilterAllPoints3D(double max_reproj_error,
                            double min_tri_angle,
-                           bool is_refractive = false);
+                           bool is_refractive = false,
+                           int num_threads = 1);
 
   // Filter observations that have negative depth.
   //
@@ -246,10 +269,51 @@ class Reconstruction {
   double ComputeMeanObservationsPerRegImage() const;
   double ComputeMeanReprojectionError() const;
 
-  // Updates mean reprojection errors for all 3D points.
-  void UpdatePoint3DErrors(bool is_refractive = false);
+  // Estimate the heap memory in bytes allocated by the reconstruction, i.e.,
+  // by its cameras, images with their 2D points, and 3D points with their
+  // tracks. The correspondence graph is shared with the database cache and
+  // not included.
+  size_t MemoryUsage() const;
+
+  // Updates mean reprojection errors for all 3D points, which are evaluated
+  // on `num_threads` threads, where -1 uses all cores.
+  void UpdatePoint3DErrors(bool is_refractive = false, int num_threads = 1);
+  void UpdatePoint3DErrors(const std::unordered_set<point3D_t>& point3D_ids,
+                           bool is_refractive = false,
+                           int num_threads = 1);
+
+  // Track the 3D points whose reprojection errors and triangulation angles may
+  // have changed since the last call to `ClearModifiedPoints3D`, because their
+  // position or track, or the pose or camera of an observing image changed.
+  // Changes through the methods of this class are tracked automatically, while
+  // direct modifications, e.g., by bundle adjustment, must be reported. Before
+  // the first call to `ClearModifiedPoints3D` and after reading or scaling the
+  // reconstruction, all 3D points are considered modified.
+  void SetModifiedPoint3D(point3D_t point3D_id);
+  void SetModifiedImage(image_t image_id);
+  void SetModifiedCamera(camera_t camera_id);
+  void SetAllPoints3DModified();
+  std::unordered_set<point3D_t> ModifiedPoint3DIds() const;
+  void ClearModifiedPoints3D();
+
+  // Filter the modified 3D points, as in `FilterAllPoints3D`, and clear the
+  // modified 3D points. If all 3D points were checked with the same thresholds
+  // before, this is equivalent to `FilterAllPoints3D`.
+  size_t FilterModifiedPoints3D(double max_reproj_error,
+                                double min_tri_angle,
+                                bool is_refractive = false,
+                                int num_threads = 1);
+
+  // (Re-)build the refractive projection tables of all refractive cameras
+  // whose tables are missing or outdated w.r.t. the camera parameters.
+  void UpdateRefracProjectionTables();
+
+  // (Re-)build the virtual camera tables of all refractive cameras whose
+  // tables are missing or outdated w.r.t. the camera parameters.
+  void UpdateRefracVirtualCameraTables();
 
-  // Read data from text or binary file. Prefer binary data if it exists.
+  // Read data from text, binary, or mapped binary file. Prefer binary data
+  // if it exists, followed by mapped binary data.
   void Read(const std::string& path);
   void Write(const std::string& path) const;
 
@@ -261,6 +325,11 @@ class Reconstruction {
   void WriteText(const std::string& path) const;
   void WriteBinary(const std::string& path) const;
 
+  // Read/write all data from/to a single file in the memory-mappable binary
+  // format, see `MappedReconstruction` for reading only parts of the data.
+  void ReadMapped(const std::string& path);
+  void WriteMapped(const std::string& path) const;
+
   // Convert 3D points in reconstruction to PLY point cloud.
   std::vector<PlyPoint> ConvertToPLY() const;
 
@@ -361,7 +430,10 @@ class Reconstruction {
   // @param path          Absolute or relative path to root folder of image.
   //                      The image path is determined by concatenating the
   //                      root path and the name of the image.
-  void ExtractColorsForAllImages(const std::string& path);
+  // @param num_threads   Number of threads reading the images, where -1 uses
+  //                      all available threads.
+  void ExtractColorsForAllImages(const std::string& path,
+                                 int num_threads = -1);
 
   // Create all image sub-directories in the given path.
   void CreateImageDirs(const std::string& path) const;
@@ -373,11 +445,17 @@ class Reconstruction {
   size_t FilterPoints3DWithSmallTriangulationAngle(
       double min_tri_angle,
       const std::unordered_set<point3D_t>& point3D_ids,
-      bool is_refractive = false);
+      bool is_refractive = false,
+      int num_threads = 1);
   size_t FilterPoints3DWithLargeReprojectionError(
       double max_reproj_error,
       const std::unordered_set<point3D_t>& point3D_ids,
-      bool is_refractive = false);
+      bool is_refractive = false,
+      int num_threads = 1);
+
+  // Identifiers of the given 3D points that exist in the reconstruction.
+  std::vector<point3D_t> ExistingPoint3DIds(
+      const std::unordered_set<point3D_t>& point3D_ids) const;
 
   std::tuple<Eigen::Vector3d, Eigen::Vector3d, Eigen::Vector3d>
   ComputeBoundsAndCentroid(double p0, double p1, bool use_images) const;
@@ -405,9 +483,9 @@ class Reconstruction {
 
   std::shared_ptr<const CorrespondenceGraph> correspondence_graph_;
 
-  std::unordered_map<camera_t, struct Camera> cameras_;
-  std::unordered_map<image_t, class Image> images_;
-  std::unordered_map<point3D_t, struct Point3D> points3D_;
+  DenseIdMap<camera_t, struct Camera> cameras_;
+  DenseIdMap<image_t, class Image> images_;
+  Point3DMap points3D_;
 
   std::unordered_map<image_pair_t, ImagePairStat> image_pair_stats_;
 
@@ -417,6 +495,15 @@ class Reconstruction {
   // Total number of added 3D points, used to generate unique identifiers.
   point3D_t num_added_points3D_;
 
+  // The modified 3D points since the last call to `ClearModifiedPoints3D`,
+  // which are only tracked if not all 3D points are considered modified.
+  std::unordered_set<point3D_t> modified_point3D_ids_;
+  bool all_points3D_modified_;
+
+  // The images whose visibility changed since the last call to
+  // `ClearVisibilityChangedImages`.
+  std::unordered_set<image_t> visibility_changed_image_ids_;
+
   // transformation from the camera coordinate frame to the prior coordinate
   // frame.
   /// TODO: This is not the right place to store such a parameter. A better
@@ -490,11 +577,11 @@ Reconstruction::ImagePairStat& Reconstruction::ImagePair(
   return image_pair_stats_.at(pair_id);
 }
 
-const std::unordered_map<camera_t, Camera>& Reconstruction::Cameras() const {
+const DenseIdMap<camera_t, Camera>& Reconstruction::Cameras() const {
   return cameras_;
 }
 
-const std::unordered_map<image_t, class Image>& Reconstruction::Images() const {
+const DenseIdMap<image_t, class Image>& Reconstruction::Images() const {
   return images_;
 }
 
@@ -502,7 +589,7 @@ const std::vector<image_t>& Reconstruction::RegImageIds() const {
   return reg_image_ids_;
 }
 
-const std::unordered_map<point3D_t, Point3D>& Reconstruction::Points3D() const {
+const Point3DMap& Reconstruction::Points3D() const {
   return points3D_;
 }
 
@@ -531,6 +618,11 @@ bool Reconstruction::IsImageRegistered(const image_t image_id) const {
   return Image(image_id).IsRegistered();
 }
 
+const std::unordered_set<image_t>& Reconstruction::VisibilityChangedImageIds()
+    const {
+  return visibility_changed_image_ids_;
+}
+
 const Rigid3d& Reconstruction::PriorFromCam() const { return prior_from_cam_; }
 
 Rigid3d& Reconstruction::PriorFromCam() { return prior_from_cam_; }
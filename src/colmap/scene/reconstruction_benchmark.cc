@@ -0,0 +1,66 @@
+#include "colmap/scene/reconstruction.h"
+
+#include <benchmark/benchmark.h>
+
+namespace colmap {
+namespace {
+
+Reconstruction CreateReconstruction(const int num_points3D) {
+  Reconstruction reconstruction;
+  for (int i = 0; i < num_points3D; ++i) {
+    reconstruction.AddPoint3D(Eigen::Vector3d::Random(), Track());
+  }
+  return reconstruction;
+}
+
+Sim3d CreateTransform() {
+  const Eigen::Vector3d axis = Eigen::Vector3d(1, 2, 3).normalized();
+  return Sim3d(2,
+               Eigen::Quaterniond(Eigen::AngleAxisd(0.3, axis)),
+               Eigen::Vector3d(1, 2, 3));
+}
+
+// Transform of arg0 points on arg1 threads.
+void BM_ReconstructionTransform(benchmark::State& state) {
+  Reconstruction reconstruction = CreateReconstruction(state.range(0));
+  const Sim3d tform = CreateTransform();
+  for (auto _ : state) {
+    reconstruction.Transform(tform, state.range(1));
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_ReconstructionTransform)
+    ->Args({1 << 14, 1})
+    ->Args({1 << 20, 1})
+    ->Args({1 << 20, -1});
+
+// The previous implementation, which transforms one point at a time.
+void BM_ReconstructionTransformPerPoint(benchmark::State& state) {
+  Reconstruction reconstruction = CreateReconstruction(state.range(0));
+  const Sim3d tform = CreateTransform();
+  const std::unordered_set<point3D_t> point3D_ids =
+      reconstruction.Point3DIds();
+  for (auto _ : state) {
+    for (const point3D_t point3D_id : point3D_ids) {
+      Point3D& point3D = reconstruction.Point3D(point3D_id);
+      point3D.xyz = tform * point3D.xyz;
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_ReconstructionTransformPerPoint)->Arg(1 << 14)->Arg(1 << 20);
+
+void BM_ReconstructionNormalize(benchmark::State& state) {
+  Reconstruction reconstruction = CreateReconstruction(state.range(0));
+  for (auto _ : state) {
+    reconstruction.Normalize(/*extent=*/10.0,
+                             /*p0=*/0.1,
+                             /*p1=*/0.9,
+                             /*use_images=*/false);
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_ReconstructionNormalize)->Arg(1 << 14)->Arg(1 << 20);
+
+}  // namespace
+}  // namespace colmap
@@ -0,0 +1,342 @@
+#include "colmap/scene/reconstruction_overlay.h"
+
+#include "colmap/scene/projection.h"
+#include "colmap/util/logging.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace colmap {
+
+ReconstructionOverlay::ReconstructionOverlay(
+    std::shared_ptr<const Reconstruction> parent)
+    : parent_(std::move(parent)) {
+  CHECK_NOTNULL(parent_);
+  for (const auto& point3D : parent_->Points3D()) {
+    max_point3D_id_ = std::max(max_point3D_id_, point3D.first);
+  }
+}
+
+size_t ReconstructionOverlay::NumRegImages() const {
+  return parent_->NumRegImages() + reg_image_ids_.size();
+}
+
+size_t ReconstructionOverlay::NumPoints3D() const {
+  return parent_->NumPoints3D() + added_point3D_ids_.size() -
+         deleted_point3D_ids_.size();
+}
+
+std::vector<image_t> ReconstructionOverlay::RegImageIds() const {
+  std::vector<image_t> reg_image_ids = parent_->RegImageIds();
+  reg_image_ids.insert(
+      reg_image_ids.end(), reg_image_ids_.begin(), reg_image_ids_.end());
+  return reg_image_ids;
+}
+
+bool ReconstructionOverlay::ExistsCamera(const camera_t camera_id) const {
+  return cameras_.count(camera_id) > 0 || parent_->ExistsCamera(camera_id);
+}
+
+bool ReconstructionOverlay::ExistsImage(const image_t image_id) const {
+  return images_.count(image_id) > 0 || parent_->ExistsImage(image_id);
+}
+
+bool ReconstructionOverlay::ExistsPoint3D(const point3D_t point3D_id) const {
+  if (points3D_.count(point3D_id) > 0) {
+    return true;
+  }
+  return deleted_point3D_ids_.count(point3D_id) == 0 &&
+         parent_->ExistsPoint3D(point3D_id);
+}
+
+bool ReconstructionOverlay::IsImageRegistered(const image_t image_id) const {
+  return Image(image_id).IsRegistered();
+}
+
+const struct Camera& ReconstructionOverlay::Camera(
+    const camera_t camera_id) const {
+  const auto camera_it = cameras_.find(camera_id);
+  if (camera_it != cameras_.end()) {
+    return camera_it->second;
+  }
+  return parent_->Camera(camera_id);
+}
+
+const class Image& ReconstructionOverlay::Image(const image_t image_id) const {
+  const auto image_it = images_.find(image_id);
+  if (image_it != images_.end()) {
+    return image_it->second;
+  }
+  return parent_->Image(image_id);
+}
+
+const struct Point3D& ReconstructionOverlay::Point3D(
+    const point3D_t point3D_id) const {
+  const auto point3D_it = points3D_.find(point3D_id);
+  if (point3D_it != points3D_.end()) {
+    return point3D_it->second;
+  }
+  CHECK_EQ(deleted_point3D_ids_.count(point3D_id), 0);
+  return parent_->Point3D(point3D_id);
+}
+
+struct Camera& ReconstructionOverlay::MutableCamera(const camera_t camera_id) {
+  const auto camera_it = cameras_.find(camera_id);
+  if (camera_it != cameras_.end()) {
+    return camera_it->second;
+  }
+  return cameras_.emplace(camera_id, parent_->Camera(camera_id)).first->second;
+}
+
+class Image& ReconstructionOverlay::MutableImage(const image_t image_id) {
+  const auto image_it = images_.find(image_id);
+  if (image_it != images_.end()) {
+    return image_it->second;
+  }
+  return images_.emplace(image_id, parent_->Image(image_id)).first->second;
+}
+
+struct Point3D& ReconstructionOverlay::MutablePoint3D(
+    const point3D_t point3D_id) {
+  const auto point3D_it = points3D_.find(point3D_id);
+  if (point3D_it != points3D_.end()) {
+    return point3D_it->second;
+  }
+  CHECK_EQ(deleted_point3D_ids_.count(point3D_id), 0);
+  return points3D_.emplace(point3D_id, parent_->Point3D(point3D_id))
+      .first->second;
+}
+
+void ReconstructionOverlay::AddCamera(struct Camera camera) {
+  const camera_t camera_id = camera.camera_id;
+  CHECK(camera.VerifyParams());
+  CHECK(!parent_->ExistsCamera(camera_id));
+  CHECK(cameras_.emplace(camera_id, std::move(camera)).second);
+}
+
+void ReconstructionOverlay::AddImage(class Image image) {
+  const image_t image_id = image.ImageId();
+  const bool is_registered = image.IsRegistered();
+  CHECK(!parent_->ExistsImage(image_id));
+  CHECK(images_.emplace(image_id, std::move(image)).second);
+  if (is_registered) {
+    reg_image_ids_.push_back(image_id);
+  }
+}
+
+void ReconstructionOverlay::RegisterImage(const image_t image_id) {
+  if (Image(image_id).IsRegistered()) {
+    return;
+  }
+  MutableImage(image_id).SetRegistered(true);
+  reg_image_ids_.push_back(image_id);
+}
+
+point3D_t ReconstructionOverlay::AddPoint3D(const Eigen::Vector3d& xyz,
+                                            Track track,
+                                            const Eigen::Vector3ub& color) {
+  const point3D_t point3D_id = ++max_point3D_id_;
+
+  for (const auto& track_el : track.Elements()) {
+    class Image& image = MutableImage(track_el.image_id);
+    CHECK(!image.Point2D(track_el.point2D_idx).HasPoint3D());
+    image.SetPoint3DForPoint2D(track_el.point2D_idx, point3D_id);
+  }
+
+  struct Point3D& point3D = points3D_[point3D_id];
+  point3D.xyz = xyz;
+  point3D.track = std::move(track);
+  point3D.color = color;
+  added_point3D_ids_.insert(point3D_id);
+
+  return point3D_id;
+}
+
+point3D_t ReconstructionOverlay::MergePoints3D(const point3D_t point3D_id1,
+                                               const point3D_t point3D_id2) {
+  const struct Point3D& point3D1 = Point3D(point3D_id1);
+  const struct Point3D& point3D2 = Point3D(point3D_id2);
+
+  const Eigen::Vector3d merged_xyz =
+      (point3D1.track.Length() * point3D1.xyz +
+       point3D2.track.Length() * point3D2.xyz) /
+      (point3D1.track.Length() + point3D2.track.Length());
+  const Eigen::Vector3d merged_rgb =
+      (point3D1.track.Length() * point3D1.color.cast<double>() +
+       point3D2.track.Length() * point3D2.color.cast<double>()) /
+      (point3D1.track.Length() + point3D2.track.Length());
+
+  Track merged_track;
+  merged_track.Reserve(point3D1.track.Length() + point3D2.track.Length());
+  merged_track.AddElements(point3D1.track.Elements());
+  merged_track.AddElements(point3D2.track.Elements());
+
+  DeletePoint3D(point3D_id1);
+  DeletePoint3D(point3D_id2);
+
+  return AddPoint3D(merged_xyz, merged_track, merged_rgb.cast<uint8_t>());
+}
+
+void ReconstructionOverlay::DeletePoint3D(const point3D_t point3D_id) {
+  // Copy the elements, since a local 3D point is erased below.
+  const std::vector<TrackElement> track_els =
+      Point3D(point3D_id).track.Elements();
+  for (const auto& track_el : track_els) {
+    MutableImage(track_el.image_id)
+        .ResetPoint3DForPoint2D(track_el.point2D_idx);
+  }
+
+  points3D_.erase(point3D_id);
+  if (added_point3D_ids_.erase(point3D_id) == 0) {
+    deleted_point3D_ids_.insert(point3D_id);
+  }
+}
+
+void ReconstructionOverlay::DeleteObservation(const image_t image_id,
+                                              const point2D_t point2D_idx) {
+  const point3D_t point3D_id = Image(image_id).Point2D(point2D_idx).point3D_id;
+  if (Point3D(point3D_id).track.Length() <= 2) {
+    DeletePoint3D(point3D_id);
+    return;
+  }
+
+  MutablePoint3D(point3D_id).track.DeleteElement(image_id, point2D_idx);
+  MutableImage(image_id).ResetPoint3DForPoint2D(point2D_idx);
+}
+
+size_t ReconstructionOverlay::FilterLocalPoints3D(
+    const double max_reproj_error, const bool is_refractive) {
+  const double max_squared_reproj_error = max_reproj_error * max_reproj_error;
+
+  std::vector<point3D_t> point3D_ids;
+  point3D_ids.reserve(points3D_.size());
+  for (const auto& point3D : points3D_) {
+    point3D_ids.push_back(point3D.first);
+  }
+  // Filter in a deterministic order, independent of the hash map.
+  std::sort(point3D_ids.begin(), point3D_ids.end());
+
+  size_t num_filtered = 0;
+  std::vector<TrackElement> track_els_to_delete;
+  for (const point3D_t point3D_id : point3D_ids) {
+    const struct Point3D& point3D = Point3D(point3D_id);
+    if (point3D.track.Length() < 2) {
+      num_filtered += point3D.track.Length();
+      DeletePoint3D(point3D_id);
+      continue;
+    }
+
+    track_els_to_delete.clear();
+    double reproj_error_sum = 0.0;
+    for (const auto& track_el : point3D.track.Elements()) {
+      const class Image& image = Image(track_el.image_id);
+      const double squared_reproj_error = CalculateSquaredReprojectionError(
+          image.Point2DXY(track_el.point2D_idx),
+          point3D.xyz,
+          image.CamFromWorld(),
+          Camera(image.CameraId()),
+          is_refractive);
+      if (std::isnan(squared_reproj_error) ||
+          squared_reproj_error > max_squared_reproj_error) {
+        track_els_to_delete.push_back(track_el);
+      } else {
+        reproj_error_sum += std::sqrt(squared_reproj_error);
+      }
+    }
+
+    if (track_els_to_delete.size() >= point3D.track.Length() - 1) {
+      num_filtered += point3D.track.Length();
+      DeletePoint3D(point3D_id);
+    } else {
+      num_filtered += track_els_to_delete.size();
+      for (const auto& track_el : track_els_to_delete) {
+        DeleteObservation(track_el.image_id, track_el.point2D_idx);
+      }
+      struct Point3D& filtered_point3D = MutablePoint3D(point3D_id);
+      filtered_point3D.error =
+          reproj_error_sum / filtered_point3D.track.Length();
+    }
+  }
+
+  return num_filtered;
+}
+
+void ReconstructionOverlay::Commit(Reconstruction* reconstruction) const {
+  CHECK_NOTNULL(reconstruction);
+
+  for (const auto& camera : cameras_) {
+    if (reconstruction->ExistsCamera(camera.first)) {
+      reconstruction->Camera(camera.first) = camera.second;
+      reconstruction->SetModifiedCamera(camera.first);
+    } else {
+      reconstruction->AddCamera(camera.second);
+    }
+  }
+
+  // Delete the 3D points first, such that their observations are free for the
+  // added 3D points.
+  for (const point3D_t point3D_id : deleted_point3D_ids_) {
+    reconstruction->DeletePoint3D(point3D_id);
+  }
+
+  // The observations of the added images are set by the added 3D points, while
+  // only the poses and registrations of the existing images are modified.
+  for (const auto& image : images_) {
+    if (reconstruction->ExistsImage(image.first)) {
+      class Image& existing_image = reconstruction->Image(image.first);
+      existing_image.CamFromWorld() = image.second.CamFromWorld();
+      reconstruction->SetModifiedImage(image.first);
+      if (image.second.IsRegistered()) {
+        reconstruction->RegisterImage(image.first);
+      }
+    } else {
+      class Image new_image = image.second;
+      for (point2D_t point2D_idx = 0; point2D_idx < new_image.NumPoints2D();
+           ++point2D_idx) {
+        new_image.ResetPoint3DForPoint2D(point2D_idx);
+      }
+      reconstruction->AddImage(std::move(new_image));
+    }
+  }
+
+  for (const auto& point3D : points3D_) {
+    if (added_point3D_ids_.count(point3D.first) > 0) {
+      continue;
+    }
+    // The track of a modified 3D point of the parent can only have lost
+    // observations, which leaves at least two observations in the loop.
+    const Track& track = point3D.second.track;
+    const std::vector<TrackElement> track_els =
+        reconstruction->Point3D(point3D.first).track.Elements();
+    for (const auto& track_el : track_els) {
+      if (std::find_if(track.Elements().begin(),
+                       track.Elements().end(),
+                       [&track_el](const TrackElement& other) {
+                         return other.image_id == track_el.image_id &&
+                                other.point2D_idx == track_el.point2D_idx;
+                       }) == track.Elements().end()) {
+        reconstruction->DeleteObservation(track_el.image_id,
+                                          track_el.point2D_idx);
+      }
+    }
+    struct Point3D& existing_point3D = reconstruction->Point3D(point3D.first);
+    existing_point3D.xyz = point3D.second.xyz;
+    existing_point3D.color = point3D.second.color;
+    existing_point3D.error = point3D.second.error;
+    reconstruction->SetModifiedPoint3D(point3D.first);
+  }
+
+  // Add the 3D points in the order of their identifiers in the view, such that
+  // the new identifiers are deterministic.
+  std::vector<point3D_t> added_point3D_ids(added_point3D_ids_.begin(),
+                                           added_point3D_ids_.end());
+  std::sort(added_point3D_ids.begin(), added_point3D_ids.end());
+  for (const point3D_t point3D_id : added_point3D_ids) {
+    const struct Point3D& point3D = points3D_.at(point3D_id);
+    const point3D_t new_point3D_id =
+        reconstruction->AddPoint3D(point3D.xyz, point3D.track, point3D.color);
+    reconstruction->Point3D(new_point3D_id).error = point3D.error;
+  }
+}
+
+}  // namespace colmap
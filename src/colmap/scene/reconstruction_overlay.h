@@ -0,0 +1,138 @@
+#pragma once
+
+#include "colmap/scene/camera.h"
+#include "colmap/scene/image.h"
+#include "colmap/scene/point3d.h"
+#include "colmap/scene/reconstruction.h"
+#include "colmap/scene/track.h"
+#include "colmap/util/types.h"
+
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <Eigen/Core>
+
+namespace colmap {
+
+// Copy-on-write view of a reconstruction. The view references the cameras,
+// images, and 3D points of an immutable parent reconstruction and only stores
+// the objects that are added or modified through the view. An object of the
+// parent is copied into the view on its first mutable access, such that
+// modifying a few images and points of a large reconstruction does not copy
+// the entire reconstruction.
+//
+// The modifications are applied to a reconstruction with `Commit`, which must
+// be the parent or a copy of it. The 3D points added through the view receive
+// new identifiers in the committed reconstruction. The view does not track
+// the correspondences of the parent's correspondence graph, i.e., the number
+// of triangulated correspondences of the images and image pairs, and images
+// cannot be de-registered through the view.
+class ReconstructionOverlay {
+ public:
+  explicit ReconstructionOverlay(std::shared_ptr<const Reconstruction> parent);
+
+  inline const Reconstruction& Parent() const;
+
+  // Get number of objects, including the objects of the parent.
+  size_t NumRegImages() const;
+  size_t NumPoints3D() const;
+
+  // Get number of objects stored in the view, i.e., added or copied objects.
+  inline size_t NumLocalImages() const;
+  inline size_t NumLocalPoints3D() const;
+
+  // The identifiers of the registered images of the parent followed by the
+  // images registered through the view.
+  std::vector<image_t> RegImageIds() const;
+
+  // Check whether specific object exists.
+  bool ExistsCamera(camera_t camera_id) const;
+  bool ExistsImage(image_t image_id) const;
+  bool ExistsPoint3D(point3D_t point3D_id) const;
+  bool IsImageRegistered(image_t image_id) const;
+
+  // Get const objects, which does not copy the objects of the parent.
+  const struct Camera& Camera(camera_t camera_id) const;
+  const class Image& Image(image_t image_id) const;
+  const struct Point3D& Point3D(point3D_t point3D_id) const;
+
+  // Get mutable objects, which copies the objects of the parent into the view
+  // on first access. The track of a 3D point must only be modified through
+  // `DeleteObservation`.
+  struct Camera& MutableCamera(camera_t camera_id);
+  class Image& MutableImage(image_t image_id);
+  struct Point3D& MutablePoint3D(point3D_t point3D_id);
+
+  // Add new camera or image, which must not exist in the view or the parent.
+  void AddCamera(struct Camera camera);
+  void AddImage(class Image image);
+
+  // Register an existing image.
+  void RegisterImage(image_t image_id);
+
+  // Add new 3D point, and return its identifier in the view.
+  point3D_t AddPoint3D(
+      const Eigen::Vector3d& xyz,
+      Track track,
+      const Eigen::Vector3ub& color = Eigen::Vector3ub::Zero());
+
+  // Merge two 3D points and return the identifier of the new 3D point, as in
+  // `Reconstruction::MergePoints3D`.
+  point3D_t MergePoints3D(point3D_t point3D_id1, point3D_t point3D_id2);
+
+  // Delete a 3D point, and all its references in the observed images.
+  void DeletePoint3D(point3D_t point3D_id);
+
+  // Delete one observation from an image and the corresponding 3D point, which
+  // is deleted entirely if its track has two elements.
+  void DeleteObservation(image_t image_id, point2D_t point2D_idx);
+
+  // Filter the observations of the added or modified 3D points with large
+  // reprojection error, as in `Reconstruction::FilterPoints3D`. The 3D points
+  // of the parent that are not modified in the view are not filtered.
+  //
+  // @return    The number of filtered observations.
+  size_t FilterLocalPoints3D(double max_reproj_error,
+                             bool is_refractive = false);
+
+  // Apply all modifications of the view to the given reconstruction, which
+  // must be the parent or a copy of it.
+  void Commit(Reconstruction* reconstruction) const;
+
+ private:
+  std::shared_ptr<const Reconstruction> parent_;
+
+  // The added cameras and images and the copies of the modified cameras and
+  // images of the parent.
+  std::unordered_map<camera_t, struct Camera> cameras_;
+  std::unordered_map<image_t, class Image> images_;
+
+  // The images of the parent or the added images registered through the view.
+  std::vector<image_t> reg_image_ids_;
+
+  // The added 3D points and the copies of the modified 3D points of the
+  // parent, and the identifiers of the added and deleted 3D points.
+  std::unordered_map<point3D_t, struct Point3D> points3D_;
+  std::unordered_set<point3D_t> added_point3D_ids_;
+  std::unordered_set<point3D_t> deleted_point3D_ids_;
+
+  // The largest identifier of the 3D points of the parent and the view, used
+  // to generate unique identifiers.
+  point3D_t max_point3D_id_ = 0;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Implementation
+////////////////////////////////////////////////////////////////////////////////
+
+const Reconstruction& ReconstructionOverlay::Parent() const { return *parent_; }
+
+size_t ReconstructionOverlay::NumLocalImages() const { return images_.size(); }
+
+size_t ReconstructionOverlay::NumLocalPoints3D() const {
+  return points3D_.size();
+}
+
+}  // namespace colmap
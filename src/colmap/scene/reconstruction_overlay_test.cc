@@ -0,0 +1,163 @@
+#include "colmap/scene/reconstruction_overlay.h"
+
+#include "colmap/scene/synthetic.h"
+
+#include <gtest/gtest.h>
+
+namespace colmap {
+namespace {
+
+std::shared_ptr<const Reconstruction> CreateSyntheticReconstruction() {
+  auto reconstruction = std::make_shared<Reconstruction>();
+  SyntheticDatasetOptions synthetic_options;
+  synthetic_options.num_cameras = 2;
+  synthetic_options.num_images = 5;
+  synthetic_options.num_points3D = 20;
+  SynthesizeDataset(synthetic_options, reconstruction.get());
+  return reconstruction;
+}
+
+TEST(ReconstructionOverlay, ReadsParent) {
+  const auto parent = CreateSyntheticReconstruction();
+  const ReconstructionOverlay overlay(parent);
+  EXPECT_EQ(&overlay.Parent(), parent.get());
+  EXPECT_EQ(overlay.NumRegImages(), parent->NumRegImages());
+  EXPECT_EQ(overlay.NumPoints3D(), parent->NumPoints3D());
+  EXPECT_EQ(overlay.RegImageIds(), parent->RegImageIds());
+  EXPECT_EQ(overlay.NumLocalImages(), 0);
+  EXPECT_EQ(overlay.NumLocalPoints3D(), 0);
+  for (const image_t image_id : parent->RegImageIds()) {
+    EXPECT_TRUE(overlay.IsImageRegistered(image_id));
+    EXPECT_EQ(&overlay.Image(image_id), &parent->Image(image_id));
+  }
+  for (const auto& point3D : parent->Points3D()) {
+    EXPECT_TRUE(overlay.ExistsPoint3D(point3D.first));
+    EXPECT_EQ(&overlay.Point3D(point3D.first), &point3D.second);
+  }
+}
+
+TEST(ReconstructionOverlay, CopyOnWrite) {
+  const auto parent = CreateSyntheticReconstruction();
+  ReconstructionOverlay overlay(parent);
+  const image_t image_id = parent->RegImageIds()[0];
+  const point3D_t point3D_id = parent->Points3D().begin()->first;
+  const Eigen::Vector3d parent_xyz = parent->Point3D(point3D_id).xyz;
+
+  overlay.MutableImage(image_id).CamFromWorld().translation.x() += 1;
+  overlay.MutablePoint3D(point3D_id).xyz.x() += 1;
+  EXPECT_EQ(overlay.NumLocalImages(), 1);
+  EXPECT_EQ(overlay.NumLocalPoints3D(), 1);
+  EXPECT_NE(&overlay.Image(image_id), &parent->Image(image_id));
+  EXPECT_EQ(overlay.Image(image_id).CamFromWorld().translation.x(),
+            parent->Image(image_id).CamFromWorld().translation.x() + 1);
+  EXPECT_EQ(overlay.Point3D(point3D_id).xyz.x(), parent_xyz.x() + 1);
+  EXPECT_EQ(parent->Point3D(point3D_id).xyz, parent_xyz);
+
+  Reconstruction reconstruction = *parent;
+  overlay.Commit(&reconstruction);
+  EXPECT_EQ(reconstruction.Image(image_id).CamFromWorld().translation,
+            overlay.Image(image_id).CamFromWorld().translation);
+  EXPECT_EQ(reconstruction.Point3D(point3D_id).xyz,
+            overlay.Point3D(point3D_id).xyz);
+}
+
+TEST(ReconstructionOverlay, AddDeletePoints3D) {
+  const auto parent = CreateSyntheticReconstruction();
+  ReconstructionOverlay overlay(parent);
+  const point3D_t point3D_id = parent->Points3D().begin()->first;
+  const struct Point3D point3D = parent->Point3D(point3D_id);
+  const TrackElement& track_el = point3D.track.Element(0);
+
+  overlay.DeletePoint3D(point3D_id);
+  EXPECT_FALSE(overlay.ExistsPoint3D(point3D_id));
+  EXPECT_EQ(overlay.NumPoints3D(), parent->NumPoints3D() - 1);
+  EXPECT_FALSE(overlay.Image(track_el.image_id)
+                   .Point2D(track_el.point2D_idx)
+                   .HasPoint3D());
+  EXPECT_TRUE(parent->ExistsPoint3D(point3D_id));
+  EXPECT_TRUE(parent->Image(track_el.image_id)
+                  .Point2D(track_el.point2D_idx)
+                  .HasPoint3D());
+
+  const point3D_t new_point3D_id = overlay.AddPoint3D(
+      point3D.xyz + Eigen::Vector3d(0, 0, 1), point3D.track, point3D.color);
+  EXPECT_FALSE(parent->ExistsPoint3D(new_point3D_id));
+  EXPECT_TRUE(overlay.ExistsPoint3D(new_point3D_id));
+  EXPECT_EQ(overlay.NumPoints3D(), parent->NumPoints3D());
+  EXPECT_EQ(overlay.Image(track_el.image_id)
+                .Point2D(track_el.point2D_idx)
+                .point3D_id,
+            new_point3D_id);
+
+  const point3D_t point3D_id2 = std::next(parent->Points3D().begin())->first;
+  const TrackElement track_el2 = parent->Point3D(point3D_id2).track.Element(0);
+  overlay.DeleteObservation(track_el2.image_id, track_el2.point2D_idx);
+  EXPECT_EQ(overlay.Point3D(point3D_id2).track.Length(),
+            parent->Point3D(point3D_id2).track.Length() - 1);
+
+  Reconstruction reconstruction = *parent;
+  overlay.Commit(&reconstruction);
+  EXPECT_EQ(reconstruction.NumPoints3D(), overlay.NumPoints3D());
+  EXPECT_FALSE(reconstruction.ExistsPoint3D(point3D_id));
+  EXPECT_EQ(reconstruction.Point3D(point3D_id2).track.Length(),
+            overlay.Point3D(point3D_id2).track.Length());
+  const point3D_t committed_point3D_id =
+      reconstruction.Image(track_el.image_id)
+          .Point2D(track_el.point2D_idx)
+          .point3D_id;
+  EXPECT_EQ(reconstruction.Point3D(committed_point3D_id).xyz,
+            overlay.Point3D(new_point3D_id).xyz);
+  EXPECT_EQ(reconstruction.Point3D(committed_point3D_id).track.Length(),
+            point3D.track.Length());
+  for (const image_t image_id : reconstruction.RegImageIds()) {
+    EXPECT_EQ(reconstruction.Image(image_id).NumPoints3D(),
+              overlay.Image(image_id).NumPoints3D());
+  }
+}
+
+TEST(ReconstructionOverlay, AddImage) {
+  const auto parent = CreateSyntheticReconstruction();
+  auto partial_parent = std::make_shared<Reconstruction>();
+  for (const auto& camera : parent->Cameras()) {
+    partial_parent->AddCamera(camera.second);
+  }
+  const image_t image_id = parent->RegImageIds()[0];
+  ReconstructionOverlay overlay(partial_parent);
+  EXPECT_FALSE(overlay.ExistsImage(image_id));
+
+  class Image image = parent->Image(image_id);
+  image.SetRegistered(false);
+  for (point2D_t point2D_idx = 0; point2D_idx < image.NumPoints2D();
+       ++point2D_idx) {
+    image.ResetPoint3DForPoint2D(point2D_idx);
+  }
+  overlay.AddImage(image);
+  EXPECT_TRUE(overlay.ExistsImage(image_id));
+  EXPECT_FALSE(overlay.IsImageRegistered(image_id));
+  overlay.RegisterImage(image_id);
+  EXPECT_TRUE(overlay.IsImageRegistered(image_id));
+  EXPECT_EQ(overlay.NumRegImages(), 1);
+  EXPECT_EQ(partial_parent->NumImages(), 0);
+
+  Reconstruction reconstruction = *partial_parent;
+  overlay.Commit(&reconstruction);
+  EXPECT_EQ(reconstruction.NumRegImages(), 1);
+  EXPECT_TRUE(reconstruction.IsImageRegistered(image_id));
+  EXPECT_EQ(reconstruction.Image(image_id).CamFromWorld().translation,
+            parent->Image(image_id).CamFromWorld().translation);
+}
+
+TEST(ReconstructionOverlay, FilterLocalPoints3D) {
+  const auto parent = CreateSyntheticReconstruction();
+  ReconstructionOverlay overlay(parent);
+  const point3D_t point3D_id = parent->Points3D().begin()->first;
+  overlay.MutablePoint3D(point3D_id).xyz += Eigen::Vector3d(10, 10, 0);
+  const size_t num_observations = parent->Point3D(point3D_id).track.Length();
+  EXPECT_EQ(overlay.FilterLocalPoints3D(/*max_reproj_error=*/1.0),
+            num_observations);
+  EXPECT_FALSE(overlay.ExistsPoint3D(point3D_id));
+  EXPECT_EQ(overlay.NumPoints3D(), parent->NumPoints3D() - 1);
+}
+
+}  // namespace
+}  // namespace colmap
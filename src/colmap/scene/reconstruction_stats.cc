@@ -0,0 +1,250 @@
+#include "colmap/scene/reconstruction_stats.h"
+
+#include "colmap/geometry/triangulation.h"
+#include "colmap/math/math.h"
+#include "colmap/scene/projection.h"
+#include "colmap/util/logging.h"
+#include "colmap/util/threading.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <unordered_map>
+
+namespace colmap {
+namespace {
+
+// Index of the uniform histogram bin of the value, where the last bin also
+// counts all larger values.
+size_t HistogramBin(const double value,
+                    const double max_value,
+                    const int num_bins) {
+  const double bin = value / max_value * num_bins;
+  if (!(bin < num_bins - 1)) {
+    return num_bins - 1;
+  }
+  return static_cast<size_t>(std::max(0.0, bin));
+}
+
+void AccumulateObservationStats(const ObservationStats& stats,
+                                ObservationStats* accum_stats) {
+  const size_t num_valid = stats.num_observations - stats.num_behind_camera;
+  const size_t accum_num_valid =
+      accum_stats->num_observations - accum_stats->num_behind_camera;
+  if (num_valid + accum_num_valid > 0) {
+    accum_stats->mean_reproj_error =
+        (accum_stats->mean_reproj_error * accum_num_valid +
+         stats.mean_reproj_error * num_valid) /
+        (num_valid + accum_num_valid);
+  }
+  accum_stats->num_observations += stats.num_observations;
+  accum_stats->num_behind_camera += stats.num_behind_camera;
+  for (size_t i = 0; i < stats.reproj_error_histogram.size(); ++i) {
+    accum_stats->reproj_error_histogram[i] += stats.reproj_error_histogram[i];
+  }
+}
+
+// Maximum triangulation angle in radians over all pairs of observations.
+double ComputeMaxTriangulationAngle(const Reconstruction& reconstruction,
+                                    const Point3D& point3D,
+                                    const bool is_refractive) {
+  // Projection centers of the track elements. In the refractive case, these
+  // are the centers of the virtual cameras of the individual observations.
+  std::vector<Eigen::Vector3d> proj_centers(point3D.track.Length());
+  double max_tri_angle = 0.0;
+  for (size_t i1 = 0; i1 < point3D.track.Length(); ++i1) {
+    const TrackElement& track_el = point3D.track.Element(i1);
+    const class Image& image1 = reconstruction.Image(track_el.image_id);
+    if (!is_refractive) {
+      proj_centers[i1] = image1.ProjectionCenter();
+    } else {
+      const struct Camera& camera1 = reconstruction.Camera(image1.CameraId());
+      struct Camera virtual_camera1;
+      Rigid3d virtual_from_real;
+      camera1.ComputeVirtual(image1.Point2DXY(track_el.point2D_idx),
+                             virtual_camera1,
+                             virtual_from_real);
+      const Rigid3d virtual_from_world =
+          virtual_from_real * image1.CamFromWorld();
+      proj_centers[i1] = virtual_from_world.rotation.inverse() *
+                         -virtual_from_world.translation;
+    }
+
+    for (size_t i2 = 0; i2 < i1; ++i2) {
+      max_tri_angle = std::max(
+          max_tri_angle,
+          CalculateTriangulationAngle(
+              proj_centers[i1], proj_centers[i2], point3D.xyz));
+    }
+  }
+  return max_tri_angle;
+}
+
+}  // namespace
+
+bool ReconstructionStatsOptions::Check() const {
+  CHECK_OPTION_GT(num_reproj_error_bins, 0);
+  CHECK_OPTION_GT(max_reproj_error, 0);
+  CHECK_OPTION_GT(num_tri_angle_bins, 0);
+  CHECK_OPTION_GT(max_tri_angle, 0);
+  CHECK_OPTION_GT(coverage_grid_size, 0);
+  return true;
+}
+
+ReconstructionStats ComputeReconstructionStats(
+    const ReconstructionStatsOptions& options,
+    const Reconstruction& reconstruction) {
+  CHECK(options.Check());
+
+  ThreadPool thread_pool(GetEffectiveNumThreads(options.num_threads));
+
+  ReconstructionStats stats;
+  stats.num_cameras = reconstruction.NumCameras();
+  stats.num_images = reconstruction.NumImages();
+  stats.num_reg_images = reconstruction.NumRegImages();
+  stats.num_points3D = reconstruction.NumPoints3D();
+  stats.observations.reproj_error_histogram.resize(
+      options.num_reproj_error_bins, 0);
+
+  // Statistics of the observations of the registered images.
+  std::vector<image_t> reg_image_ids = reconstruction.RegImageIds();
+  std::sort(reg_image_ids.begin(), reg_image_ids.end());
+  stats.images.resize(reg_image_ids.size());
+  const size_t grid_size = options.coverage_grid_size;
+  thread_pool.ParallelFor(0, reg_image_ids.size(), 1, [&](const int64_t i) {
+    const class Image& image = reconstruction.Image(reg_image_ids[i]);
+    const struct Camera& camera = reconstruction.Camera(image.CameraId());
+
+    ImageStats& image_stats = stats.images[i];
+    image_stats.image_id = image.ImageId();
+    image_stats.camera_id = image.CameraId();
+    image_stats.reproj_error_histogram.resize(options.num_reproj_error_bins,
+                                              0);
+    image_stats.coverage_map.resize(grid_size * grid_size, 0);
+
+    double sum_reproj_error = 0.0;
+    for (const Point2D& point2D : image.Points2D()) {
+      if (!point2D.HasPoint3D()) {
+        continue;
+      }
+
+      image_stats.num_observations += 1;
+
+      const double squared_reproj_error = CalculateSquaredReprojectionError(
+          point2D.xy,
+          reconstruction.Point3D(point2D.point3D_id).xyz,
+          image.CamFromWorld(),
+          camera,
+          options.is_refractive);
+      if (squared_reproj_error == std::numeric_limits<double>::max()) {
+        image_stats.num_behind_camera += 1;
+        image_stats.reproj_error_histogram.back() += 1;
+      } else {
+        const double reproj_error = std::sqrt(squared_reproj_error);
+        sum_reproj_error += reproj_error;
+        image_stats.reproj_error_histogram[HistogramBin(
+            reproj_error,
+            options.max_reproj_error,
+            options.num_reproj_error_bins)] += 1;
+      }
+
+      const size_t col = std::min<size_t>(
+          grid_size - 1,
+          std::max(0.0, point2D.xy(0) / camera.width * grid_size));
+      const size_t row = std::min<size_t>(
+          grid_size - 1,
+          std::max(0.0, point2D.xy(1) / camera.height * grid_size));
+      image_stats.coverage_map[row * grid_size + col] += 1;
+    }
+
+    const size_t num_valid =
+        image_stats.num_observations - image_stats.num_behind_camera;
+    if (num_valid > 0) {
+      image_stats.mean_reproj_error = sum_reproj_error / num_valid;
+    }
+    image_stats.coverage =
+        std::count_if(image_stats.coverage_map.begin(),
+                      image_stats.coverage_map.end(),
+                      [](const size_t count) { return count > 0; }) /
+        static_cast<double>(image_stats.coverage_map.size());
+  });
+
+  // Accumulate the statistics of the images per camera and overall.
+  std::unordered_map<camera_t, size_t> camera_idxs;
+  for (const auto& camera : reconstruction.Cameras()) {
+    CameraStats camera_stats;
+    camera_stats.camera_id = camera.first;
+    camera_stats.reproj_error_histogram.resize(options.num_reproj_error_bins,
+                                               0);
+    stats.cameras.push_back(std::move(camera_stats));
+  }
+  std::sort(stats.cameras.begin(),
+            stats.cameras.end(),
+            [](const CameraStats& camera_stats1,
+               const CameraStats& camera_stats2) {
+              return camera_stats1.camera_id < camera_stats2.camera_id;
+            });
+  for (size_t i = 0; i < stats.cameras.size(); ++i) {
+    camera_idxs.emplace(stats.cameras[i].camera_id, i);
+  }
+  for (const ImageStats& image_stats : stats.images) {
+    CameraStats& camera_stats =
+        stats.cameras[camera_idxs.at(image_stats.camera_id)];
+    camera_stats.num_reg_images += 1;
+    AccumulateObservationStats(image_stats, &camera_stats);
+    AccumulateObservationStats(image_stats, &stats.observations);
+  }
+
+  stats.num_observations = stats.observations.num_observations;
+  if (stats.num_points3D > 0) {
+    stats.mean_track_length =
+        stats.num_observations / static_cast<double>(stats.num_points3D);
+  }
+  if (stats.num_reg_images > 0) {
+    stats.mean_observations_per_reg_image =
+        stats.num_observations / static_cast<double>(stats.num_reg_images);
+  }
+
+  // Triangulation angles of the 3D points.
+  std::vector<const Point3D*> points3D;
+  points3D.reserve(stats.num_points3D);
+  for (const auto& point3D : reconstruction.Points3D()) {
+    points3D.push_back(&point3D.second);
+  }
+  std::vector<double> tri_angles(points3D.size());
+  thread_pool.ParallelFor(0, points3D.size(), 64, [&](const int64_t i) {
+    tri_angles[i] = RadToDeg(ComputeMaxTriangulationAngle(
+        reconstruction, *points3D[i], options.is_refractive));
+  });
+
+  double sum_error = 0.0;
+  size_t num_errors = 0;
+  stats.tri_angle_histogram.resize(options.num_tri_angle_bins, 0);
+  for (size_t i = 0; i < points3D.size(); ++i) {
+    const Point3D& point3D = *points3D[i];
+    if (point3D.HasError()) {
+      sum_error += point3D.error;
+      num_errors += 1;
+    }
+    const size_t track_length = point3D.track.Length();
+    if (stats.track_length_histogram.size() <= track_length) {
+      stats.track_length_histogram.resize(track_length + 1, 0);
+    }
+    stats.track_length_histogram[track_length] += 1;
+    stats.tri_angle_histogram[HistogramBin(tri_angles[i],
+                                           options.max_tri_angle,
+                                           options.num_tri_angle_bins)] += 1;
+  }
+  if (num_errors > 0) {
+    stats.mean_reproj_error = sum_error / num_errors;
+  }
+  if (!tri_angles.empty()) {
+    auto median = tri_angles.begin() + tri_angles.size() / 2;
+    std::nth_element(tri_angles.begin(), median, tri_angles.end());
+    stats.median_tri_angle = *median;
+  }
+
+  return stats;
+}
+
+}  // namespace colmap
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "colmap/scene/reconstruction.h"
+#include "colmap/util/types.h"
+
+#include <vector>
+
+namespace colmap {
+
+struct ReconstructionStatsOptions {
+  // Whether to compute reprojection errors and triangulation angles with the
+  // refractive camera models.
+  bool is_refractive = false;
+
+  // Number of uniform bins and upper bound in pixels of the reprojection
+  // error histograms. The last bin also counts all larger errors.
+  int num_reproj_error_bins = 16;
+  double max_reproj_error = 8.0;
+
+  // Number of uniform bins and upper bound in degrees of the triangulation
+  // angle histogram. The last bin also counts all larger angles.
+  int num_tri_angle_bins = 18;
+  double max_tri_angle = 90.0;
+
+  // Number of cells per image dimension of the coverage maps.
+  int coverage_grid_size = 8;
+
+  // The number of threads, where -1 uses all available threads.
+  int num_threads = -1;
+
+  bool Check() const;
+};
+
+// Statistics of the observations of an image, of a camera, or of all images.
+struct ObservationStats {
+  size_t num_observations = 0;
+  // Observations behind the camera, which are counted in the last bin of the
+  // histogram and excluded from the mean error.
+  size_t num_behind_camera = 0;
+  // Mean of the reprojection errors recomputed from the current model.
+  double mean_reproj_error = 0.0;
+  std::vector<size_t> reproj_error_histogram;
+};
+
+struct ImageStats : public ObservationStats {
+  image_t image_id = kInvalidImageId;
+  camera_t camera_id = kInvalidCameraId;
+  // Number of observations in the cells of a row-major grid over the image.
+  std::vector<size_t> coverage_map;
+  // Fraction of cells of the coverage map with at least one observation.
+  double coverage = 0.0;
+};
+
+struct CameraStats : public ObservationStats {
+  camera_t camera_id = kInvalidCameraId;
+  size_t num_reg_images = 0;
+};
+
+// Statistics of a reconstruction, which are shared by the model analyzer,
+// the GUI, and monitoring tools.
+struct ReconstructionStats {
+  size_t num_cameras = 0;
+  size_t num_images = 0;
+  size_t num_reg_images = 0;
+  size_t num_points3D = 0;
+  size_t num_observations = 0;
+  double mean_track_length = 0.0;
+  double mean_observations_per_reg_image = 0.0;
+  // Mean of the errors stored in the 3D points, as in
+  // Reconstruction::ComputeMeanReprojectionError.
+  double mean_reproj_error = 0.0;
+
+  // Statistics of all observations with recomputed reprojection errors.
+  ObservationStats observations;
+
+  // Number of 3D points by track length, indexed by the track length.
+  std::vector<size_t> track_length_histogram;
+
+  // Maximum triangulation angle over all pairs of observations of 3D points.
+  double median_tri_angle = 0.0;
+  std::vector<size_t> tri_angle_histogram;
+
+  // Per registered image and per camera, sorted by identifier.
+  std::vector<ImageStats> images;
+  std::vector<CameraStats> cameras;
+};
+
+// Compute all statistics with one parallel pass over the registered images and
+// one parallel pass over the 3D points. For refractive cameras, the caller
+// should have updated the refractive projection and virtual camera tables
+// beforehand.
+ReconstructionStats ComputeReconstructionStats(
+    const ReconstructionStatsOptions& options,
+    const Reconstruction& reconstruction);
+
+}  // namespace colmap
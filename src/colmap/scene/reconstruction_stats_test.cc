@@ -0,0 +1,137 @@
+#include "colmap/scene/reconstruction_stats.h"
+
+#include "colmap/scene/synthetic.h"
+
+#include <numeric>
+
+#include <gtest/gtest.h>
+
+namespace colmap {
+namespace {
+
+size_t SumHistogram(const std::vector<size_t>& histogram) {
+  return std::accumulate(histogram.begin(), histogram.end(), size_t(0));
+}
+
+TEST(ComputeReconstructionStats, Empty) {
+  Reconstruction reconstruction;
+  const ReconstructionStats stats =
+      ComputeReconstructionStats(ReconstructionStatsOptions(), reconstruction);
+  EXPECT_EQ(stats.num_cameras, 0);
+  EXPECT_EQ(stats.num_reg_images, 0);
+  EXPECT_EQ(stats.num_points3D, 0);
+  EXPECT_EQ(stats.num_observations, 0);
+  EXPECT_EQ(stats.mean_track_length, 0);
+  EXPECT_EQ(stats.mean_reproj_error, 0);
+  EXPECT_EQ(stats.median_tri_angle, 0);
+  EXPECT_TRUE(stats.images.empty());
+  EXPECT_TRUE(stats.cameras.empty());
+  EXPECT_TRUE(stats.track_length_histogram.empty());
+}
+
+TEST(ComputeReconstructionStats, Nominal) {
+  Reconstruction reconstruction;
+  SyntheticDatasetOptions synthetic_options;
+  synthetic_options.num_cameras = 2;
+  synthetic_options.num_images = 10;
+  synthetic_options.num_points3D = 100;
+  SynthesizeDataset(synthetic_options, &reconstruction);
+
+  ReconstructionStatsOptions options;
+  for (const int num_threads : {1, 4}) {
+    options.num_threads = num_threads;
+    const ReconstructionStats stats =
+        ComputeReconstructionStats(options, reconstruction);
+
+    EXPECT_EQ(stats.num_cameras, reconstruction.NumCameras());
+    EXPECT_EQ(stats.num_images, reconstruction.NumImages());
+    EXPECT_EQ(stats.num_reg_images, reconstruction.NumRegImages());
+    EXPECT_EQ(stats.num_points3D, reconstruction.NumPoints3D());
+    EXPECT_EQ(stats.num_observations,
+              reconstruction.ComputeNumObservations());
+    EXPECT_EQ(stats.mean_track_length,
+              reconstruction.ComputeMeanTrackLength());
+    EXPECT_EQ(stats.mean_observations_per_reg_image,
+              reconstruction.ComputeMeanObservationsPerRegImage());
+    EXPECT_NEAR(stats.mean_reproj_error,
+                reconstruction.ComputeMeanReprojectionError(),
+                1e-12);
+
+    // The synthetic observations are noise-free.
+    EXPECT_EQ(stats.observations.num_observations, stats.num_observations);
+    EXPECT_EQ(stats.observations.num_behind_camera, 0);
+    EXPECT_NEAR(stats.observations.mean_reproj_error, 0, 1e-6);
+    ASSERT_EQ(stats.observations.reproj_error_histogram.size(),
+              options.num_reproj_error_bins);
+    EXPECT_EQ(stats.observations.reproj_error_histogram[0],
+              stats.num_observations);
+
+    EXPECT_LE(stats.track_length_histogram.size(),
+              synthetic_options.num_images + 1);
+    EXPECT_EQ(SumHistogram(stats.track_length_histogram), stats.num_points3D);
+    size_t num_track_elements = 0;
+    for (size_t i = 0; i < stats.track_length_histogram.size(); ++i) {
+      num_track_elements += i * stats.track_length_histogram[i];
+    }
+    EXPECT_EQ(num_track_elements, stats.num_observations);
+    ASSERT_EQ(stats.tri_angle_histogram.size(), options.num_tri_angle_bins);
+    EXPECT_EQ(SumHistogram(stats.tri_angle_histogram), stats.num_points3D);
+    EXPECT_GT(stats.median_tri_angle, 0);
+
+    ASSERT_EQ(stats.images.size(), reconstruction.NumRegImages());
+    for (size_t i = 0; i < stats.images.size(); ++i) {
+      const ImageStats& image_stats = stats.images[i];
+      if (i > 0) {
+        EXPECT_LT(stats.images[i - 1].image_id, image_stats.image_id);
+      }
+      const class Image& image = reconstruction.Image(image_stats.image_id);
+      EXPECT_EQ(image_stats.camera_id, image.CameraId());
+      EXPECT_EQ(image_stats.num_observations, image.NumPoints3D());
+      EXPECT_EQ(SumHistogram(image_stats.reproj_error_histogram),
+                image.NumPoints3D());
+      EXPECT_EQ(image_stats.coverage_map.size(),
+                options.coverage_grid_size * options.coverage_grid_size);
+      EXPECT_EQ(SumHistogram(image_stats.coverage_map), image.NumPoints3D());
+      EXPECT_GT(image_stats.coverage, 0);
+      EXPECT_LE(image_stats.coverage, 1);
+    }
+
+    ASSERT_EQ(stats.cameras.size(), reconstruction.NumCameras());
+    size_t num_camera_observations = 0;
+    size_t num_camera_reg_images = 0;
+    for (const CameraStats& camera_stats : stats.cameras) {
+      EXPECT_TRUE(reconstruction.ExistsCamera(camera_stats.camera_id));
+      num_camera_observations += camera_stats.num_observations;
+      num_camera_reg_images += camera_stats.num_reg_images;
+    }
+    EXPECT_EQ(num_camera_observations, stats.num_observations);
+    EXPECT_EQ(num_camera_reg_images, stats.num_reg_images);
+  }
+}
+
+TEST(ComputeReconstructionStats, Histograms) {
+  Reconstruction reconstruction;
+  SyntheticDatasetOptions synthetic_options;
+  synthetic_options.num_cameras = 1;
+  synthetic_options.num_images = 5;
+  synthetic_options.num_points3D = 50;
+  synthetic_options.point2D_stddev = 1.0;
+  SynthesizeDataset(synthetic_options, &reconstruction);
+
+  ReconstructionStatsOptions options;
+  options.num_reproj_error_bins = 4;
+  options.max_reproj_error = 0.5;
+  options.num_tri_angle_bins = 1;
+  const ReconstructionStats stats =
+      ComputeReconstructionStats(options, reconstruction);
+  EXPECT_GT(stats.observations.mean_reproj_error, 0);
+  EXPECT_EQ(SumHistogram(stats.observations.reproj_error_histogram),
+            stats.num_observations);
+  // Errors beyond the upper bound are counted in the last bin.
+  EXPECT_GT(stats.observations.reproj_error_histogram.back(), 0);
+  EXPECT_EQ(stats.tri_angle_histogram,
+            std::vector<size_t>({stats.num_points3D}));
+}
+
+}  // namespace
+}  // namespace colmap
@@ -33,6 +33,7 @@
 #include "colmap/geometry/sim3.h"
 #include "colmap/scene/correspondence_graph.h"
 #include "colmap/sensor/models.h"
+#include "colmap/util/testing.h"
 
 #include <gtest/gtest.h>
 
@@ -212,6 +213,49 @@ TEST(Reconstruction, RegisterImage) {
   EXPECT_FALSE(reconstruction.IsImageRegistered(1));
 }
 
+TEST(Reconstruction, VisibilityChangedImageIds) {
+  Reconstruction reconstruction;
+  GenerateReconstruction(3, &reconstruction);
+  reconstruction.DeRegisterImage(3);
+  EXPECT_EQ(reconstruction.VisibilityChangedImageIds(),
+            std::unordered_set<image_t>({3}));
+  reconstruction.ClearVisibilityChangedImages();
+  EXPECT_TRUE(reconstruction.VisibilityChangedImageIds().empty());
+
+  auto correspondence_graph = std::make_shared<CorrespondenceGraph>();
+  for (image_t image_id = 1; image_id <= 3; ++image_id) {
+    correspondence_graph->AddImage(image_id, 10);
+  }
+  FeatureMatches matches(1);
+  matches[0].point2D_idx1 = 0;
+  matches[0].point2D_idx2 = 0;
+  correspondence_graph->AddCorrespondences(1, 2, matches);
+  correspondence_graph->AddCorrespondences(1, 3, matches);
+  correspondence_graph->Finalize();
+  reconstruction.SetUp(correspondence_graph);
+
+  // Only the visibility of the unregistered image is tracked.
+  Track track;
+  track.AddElement(1, 0);
+  track.AddElement(2, 0);
+  const point3D_t point3D_id =
+      reconstruction.AddPoint3D(Eigen::Vector3d::Zero(), track);
+  EXPECT_EQ(reconstruction.Image(3).NumVisiblePoints3D(), 1);
+  EXPECT_EQ(reconstruction.VisibilityChangedImageIds(),
+            std::unordered_set<image_t>({3}));
+  reconstruction.ClearVisibilityChangedImages();
+
+  reconstruction.DeletePoint3D(point3D_id);
+  EXPECT_EQ(reconstruction.Image(3).NumVisiblePoints3D(), 0);
+  EXPECT_EQ(reconstruction.VisibilityChangedImageIds(),
+            std::unordered_set<image_t>({3}));
+  reconstruction.ClearVisibilityChangedImages();
+
+  reconstruction.RegisterImage(3);
+  EXPECT_EQ(reconstruction.VisibilityChangedImageIds(),
+            std::unordered_set<image_t>({3}));
+}
+
 TEST(Reconstruction, Normalize) {
   Reconstruction reconstruction;
   GenerateReconstruction(3, &reconstruction);
@@ -509,6 +553,98 @@ TEST(Reconstruction, FilterAllPoints) {
   EXPECT_EQ(reconstruction.NumPoints3D(), 0);
 }
 
+TEST(Reconstruction, FilterAllPointsParallel) {
+  Reconstruction reconstruction;
+  GenerateReconstruction(3, &reconstruction);
+  for (size_t i = 0; i < 10; ++i) {
+    const point3D_t point3D_id = reconstruction.AddPoint3D(
+        Eigen::Vector3d(-0.5 - 0.02 * i, -0.5, 1), Track());
+    reconstruction.AddObservation(point3D_id, TrackElement(1, i));
+    reconstruction.AddObservation(point3D_id, TrackElement(2, i));
+    if (i % 2 == 0) {
+      reconstruction.AddObservation(point3D_id, TrackElement(3, i));
+    }
+  }
+  Reconstruction reconstruction_serial = reconstruction;
+  const size_t num_filtered_serial =
+      reconstruction_serial.FilterAllPoints3D(0.1, 0.0);
+  const size_t num_filtered =
+      reconstruction.FilterAllPoints3D(0.1,
+                                       0.0,
+                                       /*is_refractive=*/false,
+                                       /*num_threads=*/4);
+  EXPECT_GT(num_filtered, 0);
+  EXPECT_EQ(num_filtered, num_filtered_serial);
+  EXPECT_EQ(reconstruction.Point3DIds(), reconstruction_serial.Point3DIds());
+  EXPECT_EQ(reconstruction.ComputeNumObservations(),
+            reconstruction_serial.ComputeNumObservations());
+}
+
+TEST(Reconstruction, ModifiedPoints3D) {
+  Reconstruction reconstruction;
+  GenerateReconstruction(3, &reconstruction);
+  const point3D_t point3D_id1 =
+      reconstruction.AddPoint3D(Eigen::Vector3d(0, 0, 1), Track());
+  reconstruction.AddObservation(point3D_id1, TrackElement(1, 0));
+  reconstruction.AddObservation(point3D_id1, TrackElement(2, 0));
+  const point3D_t point3D_id2 =
+      reconstruction.AddPoint3D(Eigen::Vector3d(0, 0, 1), Track());
+  reconstruction.AddObservation(point3D_id2, TrackElement(2, 1));
+  reconstruction.AddObservation(point3D_id2, TrackElement(3, 1));
+  reconstruction.AddObservation(point3D_id2, TrackElement(1, 1));
+
+  // All points are modified before the tracking starts.
+  EXPECT_EQ(reconstruction.ModifiedPoint3DIds().size(), 2);
+  reconstruction.ClearModifiedPoints3D();
+  EXPECT_TRUE(reconstruction.ModifiedPoint3DIds().empty());
+
+  reconstruction.SetModifiedImage(3);
+  EXPECT_EQ(reconstruction.ModifiedPoint3DIds(),
+            std::unordered_set<point3D_t>({point3D_id2}));
+  reconstruction.ClearModifiedPoints3D();
+
+  reconstruction.DeleteObservation(1, 1);
+  EXPECT_EQ(reconstruction.ModifiedPoint3DIds(),
+            std::unordered_set<point3D_t>({point3D_id2}));
+  reconstruction.DeletePoint3D(point3D_id2);
+  EXPECT_TRUE(reconstruction.ModifiedPoint3DIds().empty());
+
+  reconstruction.SetModifiedCamera(1);
+  EXPECT_EQ(reconstruction.ModifiedPoint3DIds(),
+            std::unordered_set<point3D_t>({point3D_id1}));
+  reconstruction.ClearModifiedPoints3D();
+
+  // Rigid transformations preserve the reprojection errors.
+  reconstruction.Transform(Sim3d(1,
+                                 Eigen::Quaterniond(0.5, 0.5, 0.5, 0.5),
+                                 Eigen::Vector3d(1, 2, 3)));
+  EXPECT_TRUE(reconstruction.ModifiedPoint3DIds().empty());
+  reconstruction.Transform(Sim3d(
+      2, Eigen::Quaterniond::Identity(), Eigen::Vector3d::Zero()));
+  EXPECT_EQ(reconstruction.ModifiedPoint3DIds().size(), 1);
+}
+
+TEST(Reconstruction, FilterModifiedPoints3D) {
+  Reconstruction reconstruction;
+  GenerateReconstruction(2, &reconstruction);
+  const point3D_t point3D_id1 =
+      reconstruction.AddPoint3D(Eigen::Vector3d(-0.5, -0.5, 1), Track());
+  reconstruction.AddObservation(point3D_id1, TrackElement(1, 0));
+  reconstruction.AddObservation(point3D_id1, TrackElement(2, 0));
+  EXPECT_EQ(reconstruction.FilterModifiedPoints3D(0.1, 0.0), 0);
+  EXPECT_EQ(reconstruction.NumPoints3D(), 1);
+
+  // Unreported modifications are not filtered.
+  reconstruction.Point3D(point3D_id1).xyz = Eigen::Vector3d(-0.6, -0.5, 1);
+  EXPECT_EQ(reconstruction.FilterModifiedPoints3D(0.09, 0.0), 0);
+  EXPECT_EQ(reconstruction.NumPoints3D(), 1);
+
+  reconstruction.SetModifiedPoint3D(point3D_id1);
+  EXPECT_EQ(reconstruction.FilterModifiedPoints3D(0.09, 0.0), 2);
+  EXPECT_EQ(reconstruction.NumPoints3D(), 0);
+  EXPECT_TRUE(reconstruction.ModifiedPoint3DIds().empty());
+}
+
 TEST(Reconstruction, FilterObservationsWithNegativeDepth) {
   Reconstruction reconstruction;
   GenerateReconstruction(2, &reconstruction);
@@ -614,7 +750,7 @@ TEST(Reconstruction, UpdatePoint3DErrors) {
   EXPECT_EQ(reconstruction.ComputeMeanReprojectionError(), 0);
   Track track;
   track.AddElement(1, 0);
-  reconstruction.Image(1).Point2D(0).xy = Eigen::Vector2d(0.5, 0.5);
+  reconstruction.Image(1).Point2DXY(0) = Eigen::Vector2d(0.5, 0.5);
   const point3D_t point3D_id =
       reconstruction.AddPoint3D(Eigen::Vector3d(0, 0, 1), track);
   EXPECT_EQ(reconstruction.Point3D(point3D_id).error, -1);
@@ -623,6 +759,107 @@ TEST(Reconstruction, UpdatePoint3DErrors) {
   reconstruction.Point3D(point3D_id).xyz = Eigen::Vector3d(0, 1, 1);
   reconstruction.UpdatePoint3DErrors();
   EXPECT_EQ(reconstruction.Point3D(point3D_id).error, 1);
+  reconstruction.Point3D(point3D_id).xyz = Eigen::Vector3d(0, 0, 1);
+  reconstruction.UpdatePoint3DErrors(std::unordered_set<point3D_t>());
+  EXPECT_EQ(reconstruction.Point3D(point3D_id).error, 1);
+  reconstruction.UpdatePoint3DErrors({point3D_id});
+  EXPECT_EQ(reconstruction.Point3D(point3D_id).error, 0);
+}
+
+TEST(Reconstruction, CompactPoints3D) {
+  Reconstruction reconstruction;
+  GenerateReconstruction(2, &reconstruction);
+  std::vector<point3D_t> point3D_ids;
+  for (point2D_t point2D_idx = 0; point2D_idx < 10; ++point2D_idx) {
+    Track track;
+    track.AddElement(1, point2D_idx);
+    track.AddElement(2, point2D_idx);
+    point3D_ids.push_back(reconstruction.AddPoint3D(
+        Eigen::Vector3d::Constant(point2D_idx), track));
+  }
+  for (size_t i = 0; i < point3D_ids.size(); i += 2) {
+    reconstruction.DeletePoint3D(point3D_ids[i]);
+  }
+  reconstruction.CompactPoints3D();
+  EXPECT_EQ(reconstruction.NumPoints3D(), 5);
+  for (size_t i = 1; i < point3D_ids.size(); i += 2) {
+    const Point3D& point3D = reconstruction.Point3D(point3D_ids[i]);
+    EXPECT_EQ(point3D.xyz, Eigen::Vector3d::Constant(i));
+    EXPECT_EQ(point3D.track.Length(), 2);
+    EXPECT_EQ(reconstruction.Image(1).Point2D(i).point3D_id, point3D_ids[i]);
+  }
+  EXPECT_EQ(reconstruction.Image(1).NumPoints3D(), 5);
+  EXPECT_EQ(reconstruction.Image(2).NumPoints3D(), 5);
+}
+
+TEST(Reconstruction, ReadWriteBinary) {
+  Reconstruction reconstruction;
+  GenerateReconstruction(3, &reconstruction);
+  for (point2D_t point2D_idx = 0; point2D_idx < 10; ++point2D_idx) {
+    Track track;
+    track.AddElement(1, point2D_idx);
+    track.AddElement(3, point2D_idx);
+    reconstruction.AddPoint3D(Eigen::Vector3d::Random(), track);
+  }
+  // Enough points to be serialized in multiple chunks.
+  for (int i = 0; i < 10000; ++i) {
+    reconstruction.AddPoint3D(
+        Eigen::Vector3d::Random(), Track(), Eigen::Vector3ub(i % 256, 1, 2));
+  }
+  reconstruction.DeRegisterImage(2);
+
+  const std::string test_dir = CreateTestDir();
+  reconstruction.WriteBinary(test_dir);
+  Reconstruction read_reconstruction;
+  read_reconstruction.ReadBinary(test_dir);
+
+  EXPECT_EQ(read_reconstruction.NumCameras(), 1);
+  EXPECT_EQ(read_reconstruction.NumImages(), 2);
+  EXPECT_EQ(read_reconstruction.NumRegImages(), 2);
+  EXPECT_FALSE(read_reconstruction.ExistsImage(2));
+  for (const image_t image_id : {1, 3}) {
+    const Image& image = reconstruction.Image(image_id);
+    const Image& read_image = read_reconstruction.Image(image_id);
+    EXPECT_EQ(read_image.Name(), image.Name());
+    EXPECT_EQ(read_image.CameraId(), image.CameraId());
+    EXPECT_TRUE(read_image.IsRegistered());
+    EXPECT_EQ(read_image.NumPoints2D(), image.NumPoints2D());
+    EXPECT_EQ(read_image.NumPoints3D(), image.NumPoints3D());
+    for (point2D_t point2D_idx = 0; point2D_idx < image.NumPoints2D();
+         ++point2D_idx) {
+      EXPECT_EQ(read_image.Point2D(point2D_idx).point3D_id,
+                image.Point2D(point2D_idx).point3D_id);
+    }
+  }
+
+  EXPECT_EQ(read_reconstruction.NumPoints3D(), reconstruction.NumPoints3D());
+  for (const auto& point3D : reconstruction.Points3D()) {
+    const Point3D& read_point3D = read_reconstruction.Point3D(point3D.first);
+    EXPECT_EQ(read_point3D.xyz, point3D.second.xyz);
+    EXPECT_EQ(read_point3D.color, point3D.second.color);
+    EXPECT_EQ(read_point3D.error, point3D.second.error);
+    EXPECT_EQ(read_point3D.track.Length(), point3D.second.track.Length());
+  }
+
+  // New 3D points must not collide with the identifiers of read 3D points.
+  const point3D_t point3D_id =
+      read_reconstruction.AddPoint3D(Eigen::Vector3d::Zero(), Track());
+  EXPECT_FALSE(reconstruction.ExistsPoint3D(point3D_id));
+}
+
+TEST(Reconstruction, MemoryUsage) {
+  Reconstruction reconstruction;
+  const size_t empty_memory_usage = reconstruction.MemoryUsage();
+  GenerateReconstruction(2, &reconstruction);
+  const size_t images_memory_usage = reconstruction.MemoryUsage();
+  EXPECT_GT(images_memory_usage,
+            empty_memory_usage + 2 * 10 * sizeof(Point2D));
+  Track track;
+  track.AddElement(1, 0);
+  track.AddElement(2, 0);
+  reconstruction.AddPoint3D(Eigen::Vector3d::Random(), track);
+  EXPECT_GE(reconstruction.MemoryUsage(),
+            images_memory_usage + sizeof(Point3D) + 2 * sizeof(TrackElement));
 }
 
 }  // namespace
@@ -0,0 +1,237 @@
+#include "colmap/scene/refrac_rays.h"
+
+#include "colmap/scene/reconstruction.h"
+#include "colmap/util/endian.h"
+#include "colmap/util/logging.h"
+#include "colmap/util/threading.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+namespace colmap {
+namespace {
+
+const char kMagic[8] = {'C', 'O', 'L', 'M', 'A', 'P', 'R', 'R'};
+
+// The records are written and mapped as is, so their layout must not change.
+static_assert(sizeof(MappedRefracRays::Header) == 40, "");
+static_assert(sizeof(MappedRefracRays::CameraRecord) == 16, "");
+static_assert(sizeof(MappedRefracRays::ImageRecord) == 24, "");
+static_assert(sizeof(MappedRefracRays::RayRecord) == 56, "");
+
+// FNV-1a hash, which is stable across platforms and runs as opposed to
+// std::hash, such that the hashes remain valid between sessions.
+void HashBytes(const void* data, const size_t num_bytes, uint64_t* hash) {
+  const unsigned char* bytes = static_cast<const unsigned char*>(data);
+  for (size_t i = 0; i < num_bytes; ++i) {
+    *hash ^= bytes[i];
+    *hash *= 1099511628211ULL;
+  }
+}
+
+template <typename T>
+void WriteRecords(const std::vector<T>& records, std::ofstream* file) {
+  file->write(reinterpret_cast<const char*>(records.data()),
+              records.size() * sizeof(T));
+}
+
+}  // namespace
+
+const char kRefracRaysFileName[] = "rays.bin";
+
+const uint32_t MappedRefracRays::kVersion;
+
+MappedRefracRays::MappedRefracRays(const std::string& path)
+    : file_(std::make_shared<MappedFile>(path)) {
+  CHECK(IsLittleEndian())
+      << "The refracted rays format requires a little endian system";
+  CHECK_GE(file_->Size(), sizeof(Header)) << path;
+  const Header& header = *reinterpret_cast<const Header*>(file_->Data());
+  CHECK_EQ(std::memcmp(header.magic, kMagic, sizeof(kMagic)), 0)
+      << path << " is not a refracted rays file";
+  CHECK_EQ(header.version, kVersion) << path << " has an unsupported version";
+
+  num_cameras_ = header.num_cameras;
+  num_images_ = header.num_images;
+  num_rays_ = header.num_rays;
+  CHECK_EQ(sizeof(Header) + num_cameras_ * sizeof(CameraRecord) +
+               num_images_ * sizeof(ImageRecord) +
+               num_rays_ * sizeof(RayRecord),
+           file_->Size())
+      << path;
+
+  cameras_ =
+      reinterpret_cast<const CameraRecord*>(file_->Data() + sizeof(Header));
+  images_ = reinterpret_cast<const ImageRecord*>(cameras_ + num_cameras_);
+  rays_ = reinterpret_cast<const RayRecord*>(images_ + num_images_);
+}
+
+uint64_t MappedRefracRays::CameraParamsHash(const Camera& camera) {
+  uint64_t hash = 14695981039346656037ULL;
+  const int64_t ids[4] = {static_cast<int64_t>(camera.model_id),
+                          static_cast<int64_t>(camera.refrac_model_id),
+                          static_cast<int64_t>(camera.width),
+                          static_cast<int64_t>(camera.height)};
+  HashBytes(ids, sizeof(ids), &hash);
+  HashBytes(camera.params.data(), camera.params.size() * sizeof(double), &hash);
+  HashBytes(camera.refrac_params.data(),
+            camera.refrac_params.size() * sizeof(double),
+            &hash);
+  return hash;
+}
+
+void MappedRefracRays::Write(const Reconstruction& reconstruction,
+                             const std::string& path,
+                             const int num_threads) {
+  std::vector<CameraRecord> cameras;
+  for (const auto& camera : reconstruction.Cameras()) {
+    if (!camera.second.IsCameraRefractive()) {
+      continue;
+    }
+    CameraRecord record;
+    std::memset(&record, 0, sizeof(record));
+    record.camera_id = camera.first;
+    record.params_hash = CameraParamsHash(camera.second);
+    cameras.push_back(record);
+  }
+  std::sort(cameras.begin(),
+            cameras.end(),
+            [](const CameraRecord& record1, const CameraRecord& record2) {
+              return record1.camera_id < record2.camera_id;
+            });
+
+  std::vector<image_t> image_ids = reconstruction.RegImageIds();
+  std::sort(image_ids.begin(), image_ids.end());
+
+  std::vector<ImageRecord> images;
+  for (const image_t image_id : image_ids) {
+    const class Image& image = reconstruction.Image(image_id);
+    if (!reconstruction.Camera(image.CameraId()).IsCameraRefractive()) {
+      continue;
+    }
+    ImageRecord record;
+    std::memset(&record, 0, sizeof(record));
+    record.image_id = image_id;
+    record.camera_id = image.CameraId();
+    record.rays_idx =
+        images.empty() ? 0 : images.back().rays_idx + images.back().num_rays;
+    record.num_rays = image.NumPoints3D();
+    images.push_back(record);
+  }
+
+  const size_t num_rays =
+      images.empty() ? 0 : images.back().rays_idx + images.back().num_rays;
+  std::vector<RayRecord> rays(num_rays);
+  ThreadPool thread_pool(GetEffectiveNumThreads(num_threads));
+  thread_pool.ParallelFor(0, images.size(), 1, [&](const int64_t i) {
+    const ImageRecord& record = images[i];
+    const class Image& image = reconstruction.Image(record.image_id);
+    const struct Camera& camera = reconstruction.Camera(record.camera_id);
+
+    std::vector<point2D_t> point2D_idxs;
+    std::vector<Eigen::Vector2d> points2D;
+    point2D_idxs.reserve(record.num_rays);
+    points2D.reserve(record.num_rays);
+    for (point2D_t point2D_idx = 0; point2D_idx < image.NumPoints2D();
+         ++point2D_idx) {
+      const Point2D& point2D = image.Point2D(point2D_idx);
+      if (point2D.HasPoint3D()) {
+        point2D_idxs.push_back(point2D_idx);
+        points2D.push_back(point2D.xy);
+      }
+    }
+    CHECK_EQ(points2D.size(), record.num_rays);
+
+    Ray3DBatch batch;
+    camera.CamFromImgRefracBatch(points2D, &batch);
+    for (size_t j = 0; j < points2D.size(); ++j) {
+      RayRecord& ray = rays[record.rays_idx + j];
+      std::memset(&ray, 0, sizeof(ray));
+      ray.point2D_idx = point2D_idxs[j];
+      for (int k = 0; k < 3; ++k) {
+        ray.ori[k] = batch.oris(j, k);
+        ray.dir[k] = batch.dirs(j, k);
+      }
+    }
+  });
+
+  Header header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.num_cameras = cameras.size();
+  header.num_images = images.size();
+  header.num_rays = rays.size();
+
+  std::ofstream file(path, std::ios::trunc | std::ios::binary);
+  CHECK(file.is_open()) << path;
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  WriteRecords(cameras, &file);
+  WriteRecords(images, &file);
+  WriteRecords(rays, &file);
+  CHECK(file.good()) << path;
+}
+
+bool MappedRefracRays::IsValidFor(const Camera& camera) const {
+  const CameraRecord* end = cameras_ + num_cameras_;
+  const CameraRecord* record = std::lower_bound(
+      cameras_,
+      end,
+      camera.camera_id,
+      [](const CameraRecord& record, const camera_t camera_id) {
+        return record.camera_id < camera_id;
+      });
+  return record != end && record->camera_id == camera.camera_id &&
+         record->params_hash == CameraParamsHash(camera);
+}
+
+bool MappedRefracRays::FindImage(const image_t image_id, size_t* idx) const {
+  const ImageRecord* end = images_ + num_images_;
+  const ImageRecord* record = std::lower_bound(
+      images_,
+      end,
+      image_id,
+      [](const ImageRecord& record, const image_t image_id) {
+        return record.image_id < image_id;
+      });
+  if (record == end || record->image_id != image_id) {
+    return false;
+  }
+  *idx = record - images_;
+  return true;
+}
+
+std::pair<const MappedRefracRays::RayRecord*,
+          const MappedRefracRays::RayRecord*>
+MappedRefracRays::ImageRays(const size_t idx) const {
+  const ImageRecord& record = images_[idx];
+  return std::make_pair(rays_ + record.rays_idx,
+                        rays_ + record.rays_idx + record.num_rays);
+}
+
+bool MappedRefracRays::FindRay(const image_t image_id,
+                               const point2D_t point2D_idx,
+                               Ray3D* ray) const {
+  size_t idx;
+  if (!FindImage(image_id, &idx)) {
+    return false;
+  }
+  const auto image_rays = ImageRays(idx);
+  const RayRecord* record = std::lower_bound(
+      image_rays.first,
+      image_rays.second,
+      point2D_idx,
+      [](const RayRecord& record, const point2D_t point2D_idx) {
+        return record.point2D_idx < point2D_idx;
+      });
+  if (record == image_rays.second || record->point2D_idx != point2D_idx) {
+    return false;
+  }
+  ray->ori = Eigen::Vector3d(record->ori[0], record->ori[1], record->ori[2]);
+  ray->dir = Eigen::Vector3d(record->dir[0], record->dir[1], record->dir[2]);
+  return true;
+}
+
+}  // namespace colmap
@@ -0,0 +1,122 @@
+#pragma once
+
+#include "colmap/scene/camera.h"
+#include "colmap/sensor/ray3d.h"
+#include "colmap/util/mapped_file.h"
+#include "colmap/util/types.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+
+namespace colmap {
+
+class Reconstruction;
+
+// Name of the sidecar file of the refracted rays in a reconstruction folder.
+extern const char kRefracRaysFileName[];
+
+// Sidecar of a sparse model with the refracted viewing rays of all
+// observations of the registered images of refractive cameras, such that
+// consumers of the model do not trace the refraction of every observation
+// again. The rays are given in the camera frame, as `CamFromImgRefrac`.
+// Every camera record holds a hash of the camera model and parameters the rays
+// were traced with, such that rays of changed cameras are detected as stale.
+//
+// Layout, in little endian, memory-mapped when read:
+//
+//    Header          {magic, version, num_cameras, num_images, num_rays}
+//    CameraRecord[]  sorted by camera identifier
+//    ImageRecord[]   sorted by image identifier
+//    RayRecord[]     per image consecutively, sorted by 2D point index
+class MappedRefracRays {
+ public:
+  static const uint32_t kVersion = 1;
+
+  struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t padding;
+    uint64_t num_cameras;
+    uint64_t num_images;
+    uint64_t num_rays;
+  };
+
+  struct CameraRecord {
+    camera_t camera_id;
+    uint32_t padding;
+    uint64_t params_hash;
+  };
+
+  struct ImageRecord {
+    image_t image_id;
+    camera_t camera_id;
+    uint64_t rays_idx;
+    uint64_t num_rays;
+  };
+
+  struct RayRecord {
+    point2D_t point2D_idx;
+    uint32_t padding;
+    double ori[3];
+    double dir[3];
+  };
+
+  // Map the file at the given path and verify its header.
+  explicit MappedRefracRays(const std::string& path);
+
+  // Trace the rays of the observations in the reconstruction on `num_threads`
+  // threads and write them to the given file path.
+  static void Write(const Reconstruction& reconstruction,
+                    const std::string& path,
+                    int num_threads = -1);
+
+  // Hash of the camera model and parameters, which determine the rays.
+  static uint64_t CameraParamsHash(const Camera& camera);
+
+  inline size_t NumCameras() const;
+  inline size_t NumImages() const;
+  inline size_t NumRays() const;
+
+  // Whether the rays of the camera were traced with its current parameters.
+  bool IsValidFor(const Camera& camera) const;
+
+  // Find the index of the image record with the given identifier.
+  bool FindImage(image_t image_id, size_t* idx) const;
+  inline const ImageRecord& ImageRecordAt(size_t idx) const;
+
+  // The ray records of the image record with the given index.
+  std::pair<const RayRecord*, const RayRecord*> ImageRays(size_t idx) const;
+
+  // Find the ray of an observation or return false, if it is not stored.
+  bool FindRay(image_t image_id, point2D_t point2D_idx, Ray3D* ray) const;
+
+ private:
+  std::shared_ptr<MappedFile> file_;
+
+  const CameraRecord* cameras_;
+  const ImageRecord* images_;
+  const RayRecord* rays_;
+
+  size_t num_cameras_;
+  size_t num_images_;
+  size_t num_rays_;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Implementation
+////////////////////////////////////////////////////////////////////////////////
+
+size_t MappedRefracRays::NumCameras() const { return num_cameras_; }
+
+size_t MappedRefracRays::NumImages() const { return num_images_; }
+
+size_t MappedRefracRays::NumRays() const { return num_rays_; }
+
+const MappedRefracRays::ImageRecord& MappedRefracRays::ImageRecordAt(
+    const size_t idx) const {
+  return images_[idx];
+}
+
+}  // namespace colmap
@@ -0,0 +1,111 @@
+#include "colmap/scene/refrac_rays.h"
+
+#include "colmap/scene/reconstruction.h"
+#include "colmap/scene/synthetic.h"
+#include "colmap/util/misc.h"
+#include "colmap/util/testing.h"
+
+#include <gtest/gtest.h>
+
+namespace colmap {
+namespace {
+
+void SynthesizeRefracReconstruction(Reconstruction* reconstruction) {
+  SyntheticDatasetOptions options;
+  options.num_cameras = 2;
+  options.num_images = 10;
+  options.num_points3D = 50;
+  options.camera_refrac_model_id = CameraRefracModelId::kFlatPort;
+  options.camera_refrac_params = {0, 0, 1, 0.05, 0.007, 1.003, 1.473, 1.333};
+  SynthesizeDataset(options, reconstruction);
+}
+
+TEST(MappedRefracRays, Empty) {
+  const std::string test_dir = CreateTestDir();
+  const std::string path = JoinPaths(test_dir, kRefracRaysFileName);
+  Reconstruction reconstruction;
+  MappedRefracRays::Write(reconstruction, path);
+  const MappedRefracRays rays(path);
+  EXPECT_EQ(rays.NumCameras(), 0);
+  EXPECT_EQ(rays.NumImages(), 0);
+  EXPECT_EQ(rays.NumRays(), 0);
+  size_t idx;
+  EXPECT_FALSE(rays.FindImage(1, &idx));
+  Ray3D ray;
+  EXPECT_FALSE(rays.FindRay(1, 0, &ray));
+}
+
+TEST(MappedRefracRays, Nominal) {
+  Reconstruction reconstruction;
+  SynthesizeRefracReconstruction(&reconstruction);
+
+  const std::string test_dir = CreateTestDir();
+  const std::string path = JoinPaths(test_dir, kRefracRaysFileName);
+  MappedRefracRays::Write(reconstruction, path);
+  const MappedRefracRays rays(path);
+
+  EXPECT_EQ(rays.NumCameras(), reconstruction.NumCameras());
+  EXPECT_EQ(rays.NumImages(), reconstruction.NumRegImages());
+  EXPECT_EQ(rays.NumRays(), reconstruction.ComputeNumObservations());
+  for (const auto& camera : reconstruction.Cameras()) {
+    EXPECT_TRUE(rays.IsValidFor(camera.second));
+  }
+
+  for (const image_t image_id : reconstruction.RegImageIds()) {
+    const Image& image = reconstruction.Image(image_id);
+    const Camera& camera = reconstruction.Camera(image.CameraId());
+    size_t idx;
+    ASSERT_TRUE(rays.FindImage(image_id, &idx));
+    EXPECT_EQ(rays.ImageRecordAt(idx).camera_id, image.CameraId());
+    const auto image_rays = rays.ImageRays(idx);
+    EXPECT_EQ(image_rays.second - image_rays.first, image.NumPoints3D());
+    for (point2D_t point2D_idx = 0; point2D_idx < image.NumPoints2D();
+         ++point2D_idx) {
+      const Point2D& point2D = image.Point2D(point2D_idx);
+      Ray3D ray;
+      if (!point2D.HasPoint3D()) {
+        EXPECT_FALSE(rays.FindRay(image_id, point2D_idx, &ray));
+        continue;
+      }
+      ASSERT_TRUE(rays.FindRay(image_id, point2D_idx, &ray));
+      const Ray3D expected_ray = camera.CamFromImgRefrac(point2D.xy);
+      EXPECT_LT((ray.ori - expected_ray.ori).norm(), 1e-12);
+      EXPECT_LT((ray.dir - expected_ray.dir).norm(), 1e-12);
+    }
+  }
+}
+
+TEST(MappedRefracRays, StaleCamera) {
+  Reconstruction reconstruction;
+  SynthesizeRefracReconstruction(&reconstruction);
+
+  const std::string test_dir = CreateTestDir();
+  const std::string path = JoinPaths(test_dir, kRefracRaysFileName);
+  MappedRefracRays::Write(reconstruction, path);
+  const MappedRefracRays rays(path);
+
+  Camera camera = reconstruction.Cameras().begin()->second;
+  EXPECT_TRUE(rays.IsValidFor(camera));
+  camera.refrac_params[3] += 0.01;
+  EXPECT_FALSE(rays.IsValidFor(camera));
+  camera.camera_id += 100;
+  EXPECT_FALSE(rays.IsValidFor(camera));
+}
+
+TEST(MappedRefracRays, WriteBinary) {
+  const std::string test_dir = CreateTestDir();
+
+  Reconstruction reconstruction;
+  SynthesizeDataset(SyntheticDatasetOptions(), &reconstruction);
+  reconstruction.WriteBinary(test_dir);
+  EXPECT_FALSE(ExistsFile(JoinPaths(test_dir, kRefracRaysFileName)));
+
+  Reconstruction refrac_reconstruction;
+  SynthesizeRefracReconstruction(&refrac_reconstruction);
+  refrac_reconstruction.WriteBinary(test_dir);
+  const MappedRefracRays rays(JoinPaths(test_dir, kRefracRaysFileName));
+  EXPECT_EQ(rays.NumImages(), refrac_reconstruction.NumRegImages());
+}
+
+}  // namespace
+}  // namespace colmap
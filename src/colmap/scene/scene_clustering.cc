@@ -31,14 +31,88 @@
 
 #include "colmap/math/graph_cut.h"
 #include "colmap/math/random.h"
+#include "colmap/util/string.h"
+#include "colmap/util/threading.h"
 
+#include <fstream>
+#include <numeric>
 #include <set>
+#include <sstream>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <Eigen/Geometry>
 
 namespace colmap {
+namespace {
+
+struct SpatialLeafCluster {
+  // The path from the root cluster to the leaf cluster.
+  std::vector<SceneClustering::Cluster*> path;
+  // The indices of the images assigned to the leaf cluster.
+  std::vector<size_t> image_idxs;
+};
+
+// Recursively bisect the cluster at the median of the longer extent of the
+// footprint centers of its images.
+void BisectSpatialCluster(const std::vector<image_t>& image_ids,
+                          const std::vector<Eigen::Vector2d>& centers,
+                          const size_t max_num_images,
+                          std::vector<size_t> image_idxs,
+                          std::vector<SceneClustering::Cluster*> path,
+                          std::vector<SpatialLeafCluster>* leaf_clusters) {
+  SceneClustering::Cluster* cluster = path.back();
+  cluster->image_ids.reserve(image_idxs.size());
+  for (const size_t image_idx : image_idxs) {
+    cluster->image_ids.push_back(image_ids[image_idx]);
+  }
+
+  if (image_idxs.size() <= max_num_images) {
+    leaf_clusters->push_back({std::move(path), std::move(image_idxs)});
+    return;
+  }
+
+  Eigen::AlignedBox2d bbox;
+  for (const size_t image_idx : image_idxs) {
+    bbox.extend(centers[image_idx]);
+  }
+  int axis = 0;
+  bbox.sizes().maxCoeff(&axis);
+
+  const auto median = image_idxs.begin() + image_idxs.size() / 2;
+  std::nth_element(image_idxs.begin(),
+                   median,
+                   image_idxs.end(),
+                   [&](const size_t image_idx1, const size_t image_idx2) {
+                     return centers[image_idx1](axis) <
+                            centers[image_idx2](axis);
+                   });
+
+  cluster->child_clusters.resize(2);
+  std::vector<size_t> image_idxs1(image_idxs.begin(), median);
+  std::vector<size_t> image_idxs2(median, image_idxs.end());
+  path.push_back(&cluster->child_clusters[0]);
+  BisectSpatialCluster(image_ids,
+                       centers,
+                       max_num_images,
+                       std::move(image_idxs1),
+                       path,
+                       leaf_clusters);
+  path.back() = &cluster->child_clusters[1];
+  BisectSpatialCluster(image_ids,
+                       centers,
+                       max_num_images,
+                       std::move(image_idxs2),
+                       std::move(path),
+                       leaf_clusters);
+}
+
+}  // namespace
 
 bool SceneClustering::Options::Check() const {
   CHECK_OPTION_GT(branching, 0);
   CHECK_OPTION_GE(image_overlap, 0);
+  CHECK_OPTION_GT(max_leaf_imbalance, 0);
   return true;
 }
 
@@ -64,7 +138,9 @@ void SceneClustering::Partition(
   root_cluster_ = std::make_unique<Cluster>();
   root_cluster_->image_ids.insert(
       root_cluster_->image_ids.end(), image_ids.begin(), image_ids.end());
-  if (options_.is_hierarchical) {
+  if (options_.is_hierarchical && options_.use_kway_partition) {
+    PartitionKwayCluster(edges, num_inliers);
+  } else if (options_.is_hierarchical) {
     PartitionHierarchicalCluster(edges, num_inliers, root_cluster_.get());
   } else {
     PartitionFlatCluster(edges, num_inliers);
@@ -274,6 +350,275 @@ void SceneClustering::PartitionFlatCluster(
   }
 }
 
+void SceneClustering::PartitionKwayCluster(
+    const std::vector<std::pair<int, int>>& edges,
+    const std::vector<int>& weights) {
+  CHECK_EQ(edges.size(), weights.size());
+
+  const size_t num_images = root_cluster_->image_ids.size();
+  const size_t num_parts =
+      (num_images + options_.leaf_max_num_images - 1) /
+      options_.leaf_max_num_images;
+  if (edges.empty() || num_parts <= 1) {
+    return;
+  }
+
+  // Partition the scene graph into balanced leaf clusters at once, where the
+  // multilevel partitioning coarsens the graph, partitions the coarsest graph,
+  // and refines the partition while uncoarsening.
+  const auto labels = ComputeNormalizedMinGraphCut(
+      edges, weights, num_parts, options_.max_leaf_imbalance);
+
+  root_cluster_->child_clusters.resize(num_parts);
+  for (const auto image_id : root_cluster_->image_ids) {
+    root_cluster_->child_clusters.at(labels.at(image_id))
+        .image_ids.push_back(image_id);
+  }
+
+  // Collect the edges between the leaf clusters.
+  std::vector<std::vector<std::pair<int, int>>> overlapping_edges(num_parts);
+  for (size_t i = 0; i < edges.size(); ++i) {
+    const int label1 = labels.at(edges[i].first);
+    const int label2 = labels.at(edges[i].second);
+    if (label1 != label2) {
+      overlapping_edges[label1].emplace_back(edges[i].second, weights[i]);
+      overlapping_edges[label2].emplace_back(edges[i].first, weights[i]);
+    }
+  }
+
+  // Expand the leaf clusters by the overlapping images with the most inlier
+  // matches, which is independent for every leaf cluster.
+  if (options_.image_overlap > 0) {
+    ThreadPool thread_pool(
+        std::min(GetEffectiveNumThreads(options_.num_threads),
+                 static_cast<int>(num_parts)));
+    thread_pool.ParallelFor(0, num_parts, 1, [&](const int i) {
+      std::sort(overlapping_edges[i].begin(),
+                overlapping_edges[i].end(),
+                [](const std::pair<int, int>& edge1,
+                   const std::pair<int, int>& edge2) {
+                  return edge1.second > edge2.second;
+                });
+
+      std::set<int> overlapping_image_ids;
+      for (const auto& edge : overlapping_edges[i]) {
+        if (overlapping_image_ids.size() >=
+            static_cast<size_t>(options_.image_overlap)) {
+          break;
+        }
+        overlapping_image_ids.insert(edge.first);
+      }
+
+      std::vector<image_t>& image_ids =
+          root_cluster_->child_clusters[i].image_ids;
+      image_ids.insert(image_ids.end(),
+                       overlapping_image_ids.begin(),
+                       overlapping_image_ids.end());
+    });
+  }
+
+  // Remove empty clusters, which Metis may produce for disconnected graphs.
+  root_cluster_->child_clusters.erase(
+      std::remove_if(root_cluster_->child_clusters.begin(),
+                     root_cluster_->child_clusters.end(),
+                     [](const Cluster& child_cluster) {
+                       return child_cluster.image_ids.empty();
+                     }),
+      root_cluster_->child_clusters.end());
+  if (root_cluster_->child_clusters.size() == 1) {
+    root_cluster_->child_clusters = {};
+  }
+}
+
+void SceneClustering::PartitionSpatially(
+    const std::vector<image_t>& image_ids,
+    const std::vector<Eigen::Vector2d>& footprint_centers,
+    const std::vector<double>& footprint_radii) {
+  CHECK(!root_cluster_);
+  CHECK_EQ(image_ids.size(), footprint_centers.size());
+  CHECK_EQ(image_ids.size(), footprint_radii.size());
+
+  root_cluster_ = std::make_unique<Cluster>();
+
+  std::vector<size_t> image_idxs(image_ids.size());
+  std::iota(image_idxs.begin(), image_idxs.end(), 0);
+  std::vector<SpatialLeafCluster> leaf_clusters;
+  BisectSpatialCluster(image_ids,
+                       footprint_centers,
+                       options_.leaf_max_num_images,
+                       std::move(image_idxs),
+                       {root_cluster_.get()},
+                       &leaf_clusters);
+
+  if (options_.image_overlap <= 0 || leaf_clusters.size() <= 1) {
+    return;
+  }
+
+  // Find the overlapping images of every leaf cluster, which is independent
+  // for every leaf cluster, and insert them afterwards, since the leaf
+  // clusters share their parent clusters.
+  std::vector<std::vector<image_t>> overlapping_image_ids(
+      leaf_clusters.size());
+  ThreadPool thread_pool(
+      std::min(GetEffectiveNumThreads(options_.num_threads),
+               static_cast<int>(leaf_clusters.size())));
+  thread_pool.ParallelFor(0, leaf_clusters.size(), 1, [&](const int i) {
+    const std::vector<size_t>& leaf_image_idxs = leaf_clusters[i].image_idxs;
+    Eigen::AlignedBox2d bbox;
+    for (const size_t image_idx : leaf_image_idxs) {
+      bbox.extend(footprint_centers[image_idx]);
+    }
+    const std::unordered_set<size_t> leaf_image_idxs_set(
+        leaf_image_idxs.begin(), leaf_image_idxs.end());
+
+    std::vector<std::pair<double, size_t>> candidates;
+    for (size_t image_idx = 0; image_idx < image_ids.size(); ++image_idx) {
+      const double distance =
+          bbox.exteriorDistance(footprint_centers[image_idx]);
+      if (distance < footprint_radii[image_idx] &&
+          leaf_image_idxs_set.count(image_idx) == 0) {
+        candidates.emplace_back(distance, image_idx);
+      }
+    }
+
+    const size_t num_overlapping_images = std::min(
+        candidates.size(), static_cast<size_t>(options_.image_overlap));
+    std::partial_sort(candidates.begin(),
+                      candidates.begin() + num_overlapping_images,
+                      candidates.end());
+    overlapping_image_ids[i].reserve(num_overlapping_images);
+    for (size_t j = 0; j < num_overlapping_images; ++j) {
+      overlapping_image_ids[i].push_back(image_ids[candidates[j].second]);
+    }
+  });
+
+  // The overlapping images are added to the leaf cluster and to those of its
+  // parent clusters, which do not contain them yet.
+  for (size_t i = 0; i < leaf_clusters.size(); ++i) {
+    for (Cluster* cluster : leaf_clusters[i].path) {
+      const std::unordered_set<image_t> cluster_image_ids(
+          cluster->image_ids.begin(), cluster->image_ids.end());
+      for (const image_t image_id : overlapping_image_ids[i]) {
+        if (cluster_image_ids.count(image_id) == 0) {
+          cluster->image_ids.push_back(image_id);
+        }
+      }
+    }
+  }
+}
+
+std::vector<const SceneClustering::Cluster*> SceneClustering::AppendImages(
+    const std::vector<std::pair<image_t, image_t>>& image_pairs,
+    const std::vector<int>& num_inliers) {
+  CHECK(root_cluster_);
+  CHECK_EQ(image_pairs.size(), num_inliers.size());
+
+  // Collect the path from the root to every leaf cluster.
+  std::vector<std::vector<Cluster*>> leaf_paths;
+  std::vector<std::vector<Cluster*>> paths = {{root_cluster_.get()}};
+  while (!paths.empty()) {
+    std::vector<Cluster*> path = std::move(paths.back());
+    paths.pop_back();
+    if (path.back()->child_clusters.empty()) {
+      leaf_paths.push_back(std::move(path));
+    } else {
+      for (auto& child_cluster : path.back()->child_clusters) {
+        paths.push_back(path);
+        paths.back().push_back(&child_cluster);
+      }
+    }
+  }
+
+  std::unordered_map<image_t, std::vector<int>> image_id_to_leaf_idxs;
+  for (size_t leaf_idx = 0; leaf_idx < leaf_paths.size(); ++leaf_idx) {
+    for (const image_t image_id : leaf_paths[leaf_idx].back()->image_ids) {
+      image_id_to_leaf_idxs[image_id].push_back(leaf_idx);
+    }
+  }
+
+  // Scene graph of the new images.
+  std::unordered_map<image_t, std::vector<std::pair<image_t, int>>>
+      new_image_neighbors;
+  const std::unordered_set<image_t> root_image_ids(
+      root_cluster_->image_ids.begin(), root_cluster_->image_ids.end());
+  for (size_t i = 0; i < image_pairs.size(); ++i) {
+    const image_t image_id1 = image_pairs[i].first;
+    const image_t image_id2 = image_pairs[i].second;
+    if (root_image_ids.count(image_id1) == 0) {
+      new_image_neighbors[image_id1].emplace_back(image_id2, num_inliers[i]);
+    }
+    if (root_image_ids.count(image_id2) == 0) {
+      new_image_neighbors[image_id2].emplace_back(image_id1, num_inliers[i]);
+    }
+  }
+
+  // Assign the new images in rounds, such that new images connected only to
+  // other new images are assigned once their neighbors are in the partition.
+  std::set<int> dirty_leaf_idxs;
+  while (!new_image_neighbors.empty()) {
+    std::vector<std::pair<image_t, int>> assignments;
+    for (const auto& image_el : new_image_neighbors) {
+      std::unordered_map<int, int> leaf_weights;
+      for (const auto& neighbor : image_el.second) {
+        const auto leaf_idxs = image_id_to_leaf_idxs.find(neighbor.first);
+        if (leaf_idxs != image_id_to_leaf_idxs.end()) {
+          for (const int leaf_idx : leaf_idxs->second) {
+            leaf_weights[leaf_idx] += neighbor.second;
+          }
+        }
+      }
+
+      int best_leaf_idx = -1;
+      int best_leaf_weight = 0;
+      for (const auto& leaf_weight : leaf_weights) {
+        if (leaf_weight.second > best_leaf_weight ||
+            (leaf_weight.second == best_leaf_weight &&
+             leaf_weight.first < best_leaf_idx)) {
+          best_leaf_idx = leaf_weight.first;
+          best_leaf_weight = leaf_weight.second;
+        }
+      }
+
+      if (best_leaf_idx >= 0) {
+        assignments.emplace_back(image_el.first, best_leaf_idx);
+      }
+    }
+
+    if (assignments.empty()) {
+      break;
+    }
+
+    for (const auto& assignment : assignments) {
+      for (Cluster* cluster : leaf_paths[assignment.second]) {
+        cluster->image_ids.push_back(assignment.first);
+      }
+      image_id_to_leaf_idxs[assignment.first].push_back(assignment.second);
+      dirty_leaf_idxs.insert(assignment.second);
+      new_image_neighbors.erase(assignment.first);
+    }
+  }
+
+  if (!new_image_neighbors.empty()) {
+    LOG(WARNING) << "Skipped " << new_image_neighbors.size()
+                 << " new images without connection to the partition";
+  }
+
+  std::vector<const Cluster*> dirty_leaf_clusters;
+  dirty_leaf_clusters.reserve(dirty_leaf_idxs.size());
+  const size_t max_num_leaf_images =
+      options_.leaf_max_num_images + options_.image_overlap;
+  for (const int leaf_idx : dirty_leaf_idxs) {
+    const Cluster* leaf_cluster = leaf_paths[leaf_idx].back();
+    if (leaf_cluster->image_ids.size() > max_num_leaf_images) {
+      LOG(WARNING) << "Leaf cluster grew to " << leaf_cluster->image_ids.size()
+                   << " images, consider partitioning the scene again";
+    }
+    dirty_leaf_clusters.push_back(leaf_cluster);
+  }
+
+  return dirty_leaf_clusters;
+}
+
 const SceneClustering::Cluster* SceneClustering::GetRootCluster() const {
   return root_cluster_.get();
 }
@@ -310,6 +655,71 @@ std::vector<const SceneClustering::Cluster*> SceneClustering::GetLeafClusters()
   return leaf_clusters;
 }
 
+void SceneClustering::Write(const std::string& path) const {
+  CHECK(root_cluster_);
+
+  std::ofstream file(path, std::ios::trunc);
+  CHECK(file.is_open()) << path;
+
+  file << "# Clusters in depth-first order with one line of data as:\n";
+  file << "#   NUM_CHILD_CLUSTERS, NUM_IMAGES, IMAGE_IDS[]\n";
+
+  std::vector<const Cluster*> clusters = {root_cluster_.get()};
+  while (!clusters.empty()) {
+    const Cluster* cluster = clusters.back();
+    clusters.pop_back();
+    file << cluster->child_clusters.size() << " " << cluster->image_ids.size();
+    for (const image_t image_id : cluster->image_ids) {
+      file << " " << image_id;
+    }
+    file << "\n";
+    for (auto child_cluster = cluster->child_clusters.rbegin();
+         child_cluster != cluster->child_clusters.rend();
+         ++child_cluster) {
+      clusters.push_back(&*child_cluster);
+    }
+  }
+}
+
+void SceneClustering::Read(const std::string& path) {
+  std::ifstream file(path);
+  CHECK(file.is_open()) << path;
+
+  std::string line;
+  const auto read_cluster = [&file, &line](Cluster* cluster) {
+    while (std::getline(file, line)) {
+      StringTrim(&line);
+      if (!line.empty() && line[0] != '#') {
+        break;
+      }
+    }
+    std::stringstream line_stream(line);
+    size_t num_child_clusters = 0;
+    size_t num_images = 0;
+    line_stream >> num_child_clusters >> num_images;
+    CHECK(!line_stream.fail()) << "Invalid cluster in " << line;
+    cluster->image_ids.resize(num_images);
+    for (image_t& image_id : cluster->image_ids) {
+      line_stream >> image_id;
+    }
+    CHECK(!line_stream.fail()) << "Invalid cluster in " << line;
+    cluster->child_clusters.resize(num_child_clusters);
+  };
+
+  root_cluster_ = std::make_unique<Cluster>();
+  std::vector<Cluster*> clusters = {root_cluster_.get()};
+  while (!clusters.empty()) {
+    Cluster* cluster = clusters.back();
+    clusters.pop_back();
+    read_cluster(cluster);
+    for (auto child_cluster = cluster->child_clusters.rbegin();
+         child_cluster != cluster->child_clusters.rend();
+         ++child_cluster) {
+      clusters.push_back(&*child_cluster);
+    }
+  }
+}
+
 SceneClustering SceneClustering::Create(const Options& options,
                                         const Database& database) {
   LOG(INFO) << "Reading scene graph...";
@@ -33,8 +33,11 @@
 #include "colmap/util/types.h"
 
 #include <memory>
+#include <string>
 #include <vector>
 
+#include <Eigen/Core>
+
 namespace colmap {
 
 // Scene clustering approach using normalized cuts on the scene graph. The scene
@@ -61,6 +64,32 @@ class SceneClustering {
     // overlap` images to satisfy the overlap constraint.
     int leaf_max_num_images = 500;
 
+    // Whether to partition the hierarchical clustering with a single balanced
+    // multilevel k-way partitioning of the scene graph instead of recursively
+    // partitioning it with the branching factor. The number of leaf clusters
+    // is derived from `leaf_max_num_images`, such that the leaf clusters are
+    // of similar size and are the children of the root cluster.
+    bool use_kway_partition = false;
+
+    // The maximum imbalance of the leaf cluster sizes in the k-way
+    // partitioning, e.g., 0.03 allows leaf clusters with 3% more images than
+    // the average leaf cluster before the overlap is added.
+    double max_leaf_imbalance = 0.03;
+
+    // The number of threads used to expand the leaf clusters by their
+    // overlapping images in the k-way and spatial partitioning.
+    int num_threads = -1;
+
+    // Whether to partition the scene spatially by the image footprints as
+    // predicted from the pose priors instead of by the scene graph, see
+    // `PartitionSpatially`. Images without pose prior are assigned by the
+    // scene graph afterwards. Only used by the hybrid mapper.
+    bool use_pose_priors = false;
+
+    // The distance of the cameras to the scene along their optical axes in
+    // the unit of the pose priors, which determines the predicted footprints.
+    double prior_altitude = 2.0;
+
     bool Check() const;
   };
 
@@ -74,9 +103,39 @@ class SceneClustering {
   void Partition(const std::vector<std::pair<image_t, image_t>>& image_pairs,
                  const std::vector<int>& num_inliers);
 
+  // Partition the scene spatially by the footprints of the images in the
+  // xy-plane, e.g., the disks observed by the cameras of a survey as predicted
+  // from their pose priors. The clusters are recursively bisected at the
+  // median of their longer extent until they have at most
+  // `leaf_max_num_images` images. Every leaf cluster is then expanded by up to
+  // `image_overlap` images of other clusters, whose footprints reach into the
+  // bounding box of the footprint centers of the leaf cluster, where images
+  // with closer footprints are preferred.
+  void PartitionSpatially(const std::vector<image_t>& image_ids,
+                          const std::vector<Eigen::Vector2d>& footprint_centers,
+                          const std::vector<double>& footprint_radii);
+
+  // Append new images of an extended scene graph to the existing partition.
+  // Images that are not yet in the root cluster are assigned to the leaf
+  // cluster with which they share the most inliers and are added to all of its
+  // parent clusters. New images that are only connected to other new images
+  // are assigned in subsequent rounds, and images without any connection to
+  // the partition are skipped. The hierarchy itself is not changed, such that
+  // pointers to existing clusters remain valid. Returns the leaf clusters that
+  // received new images.
+  std::vector<const Cluster*> AppendImages(
+      const std::vector<std::pair<image_t, image_t>>& image_pairs,
+      const std::vector<int>& num_inliers);
+
   const Cluster* GetRootCluster() const;
   std::vector<const Cluster*> GetLeafClusters() const;
 
+  // Write the cluster hierarchy to a text file and read it back, replacing
+  // the current partition. The order of the clusters and their images is
+  // preserved, such that the leaf clusters are in the same order.
+  void Write(const std::string& path) const;
+  void Read(const std::string& path);
+
   static SceneClustering Create(const Options& options,
                                 const Database& database);
 
@@ -89,6 +148,9 @@ class SceneClustering {
   void PartitionFlatCluster(const std::vector<std::pair<int, int>>& edges,
                             const std::vector<int>& weights);
 
+  void PartitionKwayCluster(const std::vector<std::pair<int, int>>& edges,
+                            const std::vector<int>& weights);
+
   const Options options_;
   std::unique_ptr<Cluster> root_cluster_;
 };
@@ -30,9 +30,11 @@
 #include "colmap/scene/scene_clustering.h"
 
 #include "colmap/scene/database.h"
+#include "colmap/util/testing.h"
 
 #include <set>
 
+#include <Eigen/Geometry>
 #include <gtest/gtest.h>
 
 namespace colmap {
@@ -158,5 +160,193 @@ TEST(SceneClustering, ThreeFlatClustersTwoOverlap) {
   EXPECT_TRUE(image_ids2.count(5));
 }
 
+TEST(SceneClustering, KwayClusters) {
+  // Three strongly connected groups of four images, which are weakly connected
+  // in a chain.
+  std::vector<std::pair<image_t, image_t>> image_pairs;
+  std::vector<int> num_inliers;
+  for (image_t group_idx = 0; group_idx < 3; ++group_idx) {
+    for (image_t i = 0; i < 4; ++i) {
+      for (image_t j = i + 1; j < 4; ++j) {
+        image_pairs.emplace_back(4 * group_idx + i, 4 * group_idx + j);
+        num_inliers.push_back(100);
+      }
+    }
+  }
+  image_pairs.emplace_back(3, 4);
+  num_inliers.push_back(1);
+  image_pairs.emplace_back(7, 8);
+  num_inliers.push_back(1);
+
+  SceneClustering::Options options;
+  options.use_kway_partition = true;
+  options.image_overlap = 0;
+  options.leaf_max_num_images = 4;
+  SceneClustering scene_clustering(options);
+  scene_clustering.Partition(image_pairs, num_inliers);
+  EXPECT_EQ(scene_clustering.GetRootCluster()->image_ids.size(), 12);
+  const std::vector<const SceneClustering::Cluster*> leaf_clusters =
+      scene_clustering.GetLeafClusters();
+  ASSERT_EQ(leaf_clusters.size(), 3);
+  std::set<image_t> leaf_image_ids;
+  for (const SceneClustering::Cluster* leaf_cluster : leaf_clusters) {
+    EXPECT_EQ(leaf_cluster->image_ids.size(), 4);
+    leaf_image_ids.insert(leaf_cluster->image_ids.begin(),
+                          leaf_cluster->image_ids.end());
+  }
+  EXPECT_EQ(leaf_image_ids.size(), 12);
+}
+
+TEST(SceneClustering, KwayClustersOverlap) {
+  std::vector<std::pair<image_t, image_t>> image_pairs;
+  std::vector<int> num_inliers;
+  for (image_t image_id = 0; image_id + 1 < 12; ++image_id) {
+    image_pairs.emplace_back(image_id, image_id + 1);
+    num_inliers.push_back(100);
+  }
+
+  SceneClustering::Options options;
+  options.use_kway_partition = true;
+  options.image_overlap = 1;
+  options.leaf_max_num_images = 4;
+  SceneClustering scene_clustering(options);
+  scene_clustering.Partition(image_pairs, num_inliers);
+  const std::vector<const SceneClustering::Cluster*> leaf_clusters =
+      scene_clustering.GetLeafClusters();
+  ASSERT_EQ(leaf_clusters.size(), 3);
+  for (const SceneClustering::Cluster* leaf_cluster : leaf_clusters) {
+    EXPECT_GE(leaf_cluster->image_ids.size(), 4);
+    EXPECT_LE(leaf_cluster->image_ids.size(), 5);
+  }
+}
+
+TEST(SceneClustering, PartitionSpatially) {
+  // A grid of 4x4 images, where the footprints of neighboring images overlap.
+  std::vector<image_t> image_ids;
+  std::vector<Eigen::Vector2d> footprint_centers;
+  for (int y = 0; y < 4; ++y) {
+    for (int x = 0; x < 4; ++x) {
+      image_ids.push_back(4 * y + x);
+      footprint_centers.emplace_back(x, y);
+    }
+  }
+  const std::vector<double> footprint_radii(image_ids.size(), 0.8);
+
+  SceneClustering::Options options;
+  options.image_overlap = 0;
+  options.leaf_max_num_images = 4;
+  SceneClustering scene_clustering(options);
+  scene_clustering.PartitionSpatially(
+      image_ids, footprint_centers, footprint_radii);
+  EXPECT_EQ(scene_clustering.GetRootCluster()->image_ids.size(), 16);
+  const std::vector<const SceneClustering::Cluster*> leaf_clusters =
+      scene_clustering.GetLeafClusters();
+  ASSERT_EQ(leaf_clusters.size(), 4);
+  for (const SceneClustering::Cluster* leaf_cluster : leaf_clusters) {
+    // Every leaf cluster is a compact block of 2x2 images.
+    ASSERT_EQ(leaf_cluster->image_ids.size(), 4);
+    Eigen::AlignedBox2d bbox;
+    for (const image_t image_id : leaf_cluster->image_ids) {
+      bbox.extend(footprint_centers[image_id]);
+    }
+    EXPECT_EQ(bbox.sizes(), Eigen::Vector2d(1, 1));
+  }
+}
+
+TEST(SceneClustering, PartitionSpatiallyOverlap) {
+  std::vector<image_t> image_ids;
+  std::vector<Eigen::Vector2d> footprint_centers;
+  for (int x = 0; x < 8; ++x) {
+    image_ids.push_back(x);
+    footprint_centers.emplace_back(x, 0);
+  }
+  const std::vector<double> footprint_radii(image_ids.size(), 1.5);
+
+  SceneClustering::Options options;
+  options.image_overlap = 3;
+  options.leaf_max_num_images = 4;
+  SceneClustering scene_clustering(options);
+  scene_clustering.PartitionSpatially(
+      image_ids, footprint_centers, footprint_radii);
+  const std::vector<const SceneClustering::Cluster*> leaf_clusters =
+      scene_clustering.GetLeafClusters();
+  ASSERT_EQ(leaf_clusters.size(), 2);
+
+  // Only the images within the footprint radius of the other leaf cluster
+  // overlap, even though more overlapping images are allowed.
+  const std::set<image_t> leaf_image_ids1(leaf_clusters[0]->image_ids.begin(),
+                                          leaf_clusters[0]->image_ids.end());
+  const std::set<image_t> leaf_image_ids2(leaf_clusters[1]->image_ids.begin(),
+                                          leaf_clusters[1]->image_ids.end());
+  EXPECT_EQ(leaf_image_ids1, std::set<image_t>({0, 1, 2, 3, 4}));
+  EXPECT_EQ(leaf_image_ids2, std::set<image_t>({3, 4, 5, 6, 7}));
+  EXPECT_EQ(scene_clustering.GetRootCluster()->image_ids.size(), 8);
+}
+
+TEST(SceneClustering, AppendImagesOneLevel) {
+  SceneClustering::Options options;
+  options.branching = 2;
+  options.image_overlap = 0;
+  options.leaf_max_num_images = 2;
+  SceneClustering scene_clustering(options);
+  scene_clustering.Partition({{0, 1}}, {10});
+  const std::vector<const SceneClustering::Cluster*> dirty_leaf_clusters =
+      scene_clustering.AppendImages({{0, 1}, {1, 2}, {2, 3}, {5, 6}},
+                                    {10, 10, 10, 10});
+  EXPECT_EQ(dirty_leaf_clusters.size(), 1);
+  EXPECT_EQ(dirty_leaf_clusters[0], scene_clustering.GetRootCluster());
+  EXPECT_EQ(scene_clustering.GetRootCluster()->child_clusters.size(), 0);
+  const std::set<image_t> image_ids(
+      scene_clustering.GetRootCluster()->image_ids.begin(),
+      scene_clustering.GetRootCluster()->image_ids.end());
+  EXPECT_EQ(image_ids, std::set<image_t>({0, 1, 2, 3}));
+}
+
+TEST(SceneClustering, AppendImagesTwoLevels) {
+  SceneClustering::Options options;
+  options.branching = 2;
+  options.image_overlap = 0;
+  options.leaf_max_num_images = 2;
+  SceneClustering scene_clustering(options);
+  scene_clustering.Partition({{0, 1}, {2, 3}, {1, 2}}, {100, 100, 1});
+  ASSERT_EQ(scene_clustering.GetLeafClusters().size(), 2);
+  const std::vector<const SceneClustering::Cluster*> dirty_leaf_clusters =
+      scene_clustering.AppendImages({{3, 4}, {0, 4}}, {50, 10});
+  ASSERT_EQ(dirty_leaf_clusters.size(), 1);
+  const std::set<image_t> leaf_image_ids(
+      dirty_leaf_clusters[0]->image_ids.begin(),
+      dirty_leaf_clusters[0]->image_ids.end());
+  EXPECT_EQ(leaf_image_ids, std::set<image_t>({2, 3, 4}));
+  EXPECT_EQ(scene_clustering.GetRootCluster()->image_ids.size(), 5);
+  EXPECT_EQ(scene_clustering.GetLeafClusters().size(), 2);
+}
+
+TEST(SceneClustering, WriteRead) {
+  SceneClustering::Options options;
+  options.branching = 2;
+  options.image_overlap = 1;
+  options.leaf_max_num_images = 2;
+  SceneClustering scene_clustering(options);
+  scene_clustering.Partition({{0, 1}, {2, 3}, {1, 2}, {4, 5}, {3, 4}},
+                             {100, 100, 1, 100, 1});
+  const std::string path = CreateTestDir() + "/clusters.txt";
+  scene_clustering.Write(path);
+
+  SceneClustering read_scene_clustering(options);
+  read_scene_clustering.Read(path);
+  const std::vector<const SceneClustering::Cluster*> leaf_clusters =
+      scene_clustering.GetLeafClusters();
+  const std::vector<const SceneClustering::Cluster*> read_leaf_clusters =
+      read_scene_clustering.GetLeafClusters();
+  ASSERT_EQ(read_leaf_clusters.size(), leaf_clusters.size());
+  for (size_t i = 0; i < leaf_clusters.size(); ++i) {
+    EXPECT_EQ(read_leaf_clusters[i]->image_ids, leaf_clusters[i]->image_ids);
+  }
+  EXPECT_EQ(read_scene_clustering.GetRootCluster()->image_ids,
+            scene_clustering.GetRootCluster()->image_ids);
+  EXPECT_EQ(read_scene_clustering.GetRootCluster()->child_clusters.size(),
+            scene_clustering.GetRootCluster()->child_clusters.size());
+}
+
 }  // namespace
 }  // namespace colmap
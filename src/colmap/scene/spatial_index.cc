@@ -0,0 +1,494 @@
+#include "colmap/scene/spatial_index.h"
+
+#include "colmap/util/logging.h"
+
+#include <algorithm>
+#include <limits>
+#include <queue>
+#include <utility>
+
+namespace colmap {
+namespace {
+
+// The maximum number of entries of the leaf nodes of the tree.
+const uint32_t kMaxLeafSize = 16;
+
+// The tree is rebuilt once the number of removed and separately stored
+// entries exceeds this fraction of the entries of the tree or the minimum.
+const size_t kRebuildFraction = 8;
+const size_t kMinNumChangesForRebuild = 64;
+
+// The number of sampled rays per image edge of refractive frustums.
+const int kNumEdgeSamples = 16;
+
+// The squared distance to the farthest corner of the box.
+double SquaredInteriorDistance(const Eigen::AlignedBox3d& bbox,
+                               const Eigen::Vector3d& point) {
+  return (point - bbox.min())
+      .cwiseAbs()
+      .cwiseMax((point - bbox.max()).cwiseAbs())
+      .squaredNorm();
+}
+
+// The distance of the plane to the corners of the box with the smallest and
+// largest signed distance to the plane.
+void PlaneBoxDistances(const Eigen::Vector4d& plane,
+                       const Eigen::AlignedBox3d& bbox,
+                       double* min_dist,
+                       double* max_dist) {
+  *min_dist = plane(3);
+  *max_dist = plane(3);
+  for (int d = 0; d < 3; ++d) {
+    const double dist1 = plane(d) * bbox.min()(d);
+    const double dist2 = plane(d) * bbox.max()(d);
+    *min_dist += std::min(dist1, dist2);
+    *max_dist += std::max(dist1, dist2);
+  }
+}
+
+bool IsInFrustum(const Frustum& frustum, const Eigen::Vector3d& point) {
+  for (const Eigen::Vector4d& plane : frustum) {
+    if (plane.head<3>().dot(point) + plane(3) < 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+Frustum ComputeImageFrustum(const Camera& camera,
+                            const Rigid3d& cam_from_world,
+                            const double min_depth,
+                            const double max_depth) {
+  CHECK_GT(min_depth, 0);
+  CHECK_GT(max_depth, min_depth);
+
+  const std::array<Eigen::Vector2d, 4> corners = {
+      Eigen::Vector2d(0, 0),
+      Eigen::Vector2d(camera.width, 0),
+      Eigen::Vector2d(camera.width, camera.height),
+      Eigen::Vector2d(0, camera.height)};
+
+  // The points on the boundary of the image at the minimum and maximum depth
+  // in the camera frame, sampled along the edges starting at the corners.
+  // Refracted rays do not pass through the camera center and the refracted
+  // edges are curved, so the rays are intersected with the depth planes at
+  // several samples per edge.
+  const int num_samples = camera.IsCameraRefractive() ? kNumEdgeSamples : 1;
+  std::vector<Eigen::Vector3d> near_points(4 * num_samples);
+  std::vector<Eigen::Vector3d> far_points(4 * num_samples);
+  bool refracted = camera.IsCameraRefractive();
+  for (int i = 0; i < 4 && refracted; ++i) {
+    for (int k = 0; k < num_samples; ++k) {
+      const Eigen::Vector2d image_point =
+          corners[i] + (corners[(i + 1) % 4] - corners[i]) * k / num_samples;
+      const Ray3D ray = camera.CamFromImgRefrac(image_point);
+      if (!ray.ori.allFinite() || !ray.dir.allFinite() || ray.dir.z() <= 0) {
+        refracted = false;
+        break;
+      }
+      const int idx = i * num_samples + k;
+      near_points[idx] =
+          ray.ori + (min_depth - ray.ori.z()) / ray.dir.z() * ray.dir;
+      far_points[idx] =
+          ray.ori + (max_depth - ray.ori.z()) / ray.dir.z() * ray.dir;
+    }
+  }
+  if (!refracted) {
+    // Fall back to the unrefracted corner rays, e.g., if a corner ray is
+    // totally reflected at the port.
+    near_points.resize(4);
+    far_points.resize(4);
+    for (int i = 0; i < 4; ++i) {
+      const Eigen::Vector3d ray = camera.CamFromImg(corners[i]).homogeneous();
+      near_points[i] = min_depth * ray;
+      far_points[i] = max_depth * ray;
+    }
+  }
+  const int num_points = near_points.size();
+  const int corner_stride = num_points / 4;
+
+  Eigen::Vector3d centroid = Eigen::Vector3d::Zero();
+  for (int i = 0; i < num_points; ++i) {
+    centroid += near_points[i] + far_points[i];
+  }
+  centroid /= 2 * num_points;
+
+  // The side planes are spanned by the diagonals between the near and far
+  // corners of the side, which pass through the camera center for
+  // unrefracted rays. The planes are shifted outwards to contain all
+  // boundary points, such that the frustum conservatively contains the
+  // refracted frustum.
+  Frustum cam_frustum;
+  for (int i = 0; i < 4; ++i) {
+    const int c0 = i * corner_stride;
+    const int c1 = ((i + 1) % 4) * corner_stride;
+    Eigen::Vector3d normal = (far_points[c1] - near_points[c0])
+                                 .cross(far_points[c0] - near_points[c1])
+                                 .normalized();
+    if (normal.dot(centroid - near_points[c0]) < 0) {
+      normal = -normal;
+    }
+    double d = std::numeric_limits<double>::max();
+    for (int k = 0; k < num_points; ++k) {
+      d = std::min(d, std::min(normal.dot(near_points[k]),
+                               normal.dot(far_points[k])));
+    }
+    cam_frustum[i] << normal, -d;
+  }
+  cam_frustum[4] << 0, 0, 1, -min_depth;
+  cam_frustum[5] << 0, 0, -1, max_depth;
+
+  // A plane (n, d) in the camera frame is (R^T n, n^T t + d) in the world
+  // frame for x_in_cam = R x_in_world + t.
+  const Eigen::Matrix3d R = cam_from_world.rotation.toRotationMatrix();
+  Frustum frustum;
+  for (int i = 0; i < 6; ++i) {
+    const Eigen::Vector3d normal = cam_frustum[i].head<3>();
+    frustum[i] << R.transpose() * normal,
+        normal.dot(cam_from_world.translation) + cam_frustum[i](3);
+  }
+  return frustum;
+}
+
+void SpatialIndex::Build(const std::vector<Id>& ids,
+                         const std::vector<Eigen::Vector3d>& positions) {
+  CHECK_EQ(ids.size(), positions.size());
+  std::vector<Entry> entries(ids.size());
+  for (size_t i = 0; i < ids.size(); ++i) {
+    entries[i].position = positions[i];
+    entries[i].id = ids[i];
+  }
+  BuildFromEntries(std::move(entries));
+}
+
+void SpatialIndex::BuildFromEntries(std::vector<Entry> entries) {
+  CHECK_LE(entries.size(), std::numeric_limits<uint32_t>::max());
+  Clear();
+  entries_ = std::move(entries);
+  removed_.resize(entries_.size(), false);
+  if (!entries_.empty()) {
+    nodes_.reserve(2 * entries_.size() / kMaxLeafSize + 1);
+    BuildNode(0, entries_.size());
+  }
+  id_to_idx_.reserve(entries_.size());
+  for (size_t i = 0; i < entries_.size(); ++i) {
+    CHECK(id_to_idx_.emplace(entries_[i].id, i).second)
+        << "Duplicate identifier " << entries_[i].id;
+  }
+}
+
+int SpatialIndex::BuildNode(const uint32_t begin, const uint32_t end) {
+  const int node_idx = nodes_.size();
+  nodes_.emplace_back();
+  nodes_[node_idx].begin = begin;
+  nodes_[node_idx].end = end;
+
+  Eigen::AlignedBox3d bbox;
+  for (uint32_t i = begin; i < end; ++i) {
+    bbox.extend(entries_[i].position);
+  }
+  nodes_[node_idx].bbox = bbox;
+
+  if (end - begin <= kMaxLeafSize) {
+    return node_idx;
+  }
+
+  // Split at the median of the axis of the largest extent.
+  int axis = 0;
+  bbox.sizes().maxCoeff(&axis);
+  const uint32_t mid = begin + (end - begin) / 2;
+  std::nth_element(entries_.begin() + begin,
+                   entries_.begin() + mid,
+                   entries_.begin() + end,
+                   [axis](const Entry& entry1, const Entry& entry2) {
+                     return entry1.position(axis) < entry2.position(axis);
+                   });
+
+  const int left = BuildNode(begin, mid);
+  const int right = BuildNode(mid, end);
+  nodes_[node_idx].left = left;
+  nodes_[node_idx].right = right;
+  return node_idx;
+}
+
+void SpatialIndex::Insert(const Id id, const Eigen::Vector3d& position) {
+  const auto it = id_to_idx_.find(id);
+  if (it != id_to_idx_.end() && it->second < 0) {
+    new_entries_[-(it->second + 1)].position = position;
+    return;
+  }
+
+  if (it != id_to_idx_.end()) {
+    removed_[it->second] = true;
+    num_removed_ += 1;
+  }
+  new_entries_.push_back({position, id});
+  id_to_idx_[id] = -static_cast<int64_t>(new_entries_.size());
+  MaybeRebuild();
+}
+
+void SpatialIndex::Remove(const Id id) {
+  const auto it = id_to_idx_.find(id);
+  if (it == id_to_idx_.end()) {
+    return;
+  }
+
+  if (it->second >= 0) {
+    removed_[it->second] = true;
+    num_removed_ += 1;
+  } else {
+    // Move the last separately stored entry into the slot of the entry.
+    const size_t idx = -(it->second + 1);
+    if (idx + 1 < new_entries_.size()) {
+      new_entries_[idx] = new_entries_.back();
+      id_to_idx_[new_entries_[idx].id] = it->second;
+    }
+    new_entries_.pop_back();
+  }
+  id_to_idx_.erase(id);
+  MaybeRebuild();
+}
+
+void SpatialIndex::MaybeRebuild() {
+  const size_t num_changes = num_removed_ + new_entries_.size();
+  if (num_changes <= std::max(kMinNumChangesForRebuild,
+                              entries_.size() / kRebuildFraction)) {
+    return;
+  }
+
+  std::vector<Entry> entries;
+  entries.reserve(id_to_idx_.size());
+  for (size_t i = 0; i < entries_.size(); ++i) {
+    if (!removed_[i]) {
+      entries.push_back(entries_[i]);
+    }
+  }
+  entries.insert(entries.end(), new_entries_.begin(), new_entries_.end());
+  BuildFromEntries(std::move(entries));
+}
+
+void SpatialIndex::Clear() {
+  nodes_.clear();
+  entries_.clear();
+  removed_.clear();
+  num_removed_ = 0;
+  new_entries_.clear();
+  id_to_idx_.clear();
+}
+
+size_t SpatialIndex::Size() const { return id_to_idx_.size(); }
+
+bool SpatialIndex::Exists(const Id id) const {
+  return id_to_idx_.count(id) > 0;
+}
+
+template <typename Prune, typename Contains, typename Test>
+std::vector<SpatialIndex::Id> SpatialIndex::QueryRegion(
+    const Prune& prune, const Contains& contains, const Test& test) const {
+  std::vector<Id> ids;
+
+  std::vector<int> node_stack;
+  if (!nodes_.empty()) {
+    node_stack.push_back(0);
+  }
+  while (!node_stack.empty()) {
+    const Node& node = nodes_[node_stack.back()];
+    node_stack.pop_back();
+    if (prune(node.bbox)) {
+      continue;
+    }
+    const bool contained = contains(node.bbox);
+    if (contained || node.left == -1) {
+      for (uint32_t i = node.begin; i < node.end; ++i) {
+        if (!removed_[i] && (contained || test(entries_[i].position))) {
+          ids.push_back(entries_[i].id);
+        }
+      }
+    } else {
+      node_stack.push_back(node.right);
+      node_stack.push_back(node.left);
+    }
+  }
+
+  for (const Entry& entry : new_entries_) {
+    if (test(entry.position)) {
+      ids.push_back(entry.id);
+    }
+  }
+
+  return ids;
+}
+
+std::vector<SpatialIndex::Id> SpatialIndex::QueryBox(
+    const Eigen::AlignedBox3d& box) const {
+  return QueryRegion(
+      [&box](const Eigen::AlignedBox3d& bbox) { return !box.intersects(bbox); },
+      [&box](const Eigen::AlignedBox3d& bbox) { return box.contains(bbox); },
+      [&box](const Eigen::Vector3d& position) {
+        return box.contains(position);
+      });
+}
+
+std::vector<SpatialIndex::Id> SpatialIndex::QueryRadius(
+    const Eigen::Vector3d& center, const double radius) const {
+  const double squared_radius = radius * radius;
+  return QueryRegion(
+      [&](const Eigen::AlignedBox3d& bbox) {
+        return bbox.squaredExteriorDistance(center) > squared_radius;
+      },
+      [&](const Eigen::AlignedBox3d& bbox) {
+        return SquaredInteriorDistance(bbox, center) <= squared_radius;
+      },
+      [&](const Eigen::Vector3d& position) {
+        return (position - center).squaredNorm() <= squared_radius;
+      });
+}
+
+std::vector<SpatialIndex::Id> SpatialIndex::QueryNearest(
+    const Eigen::Vector3d& point,
+    const size_t k,
+    const double max_distance) const {
+  if (k == 0) {
+    return {};
+  }
+
+  const double max_squared_dist = max_distance * max_distance;
+
+  // Max-heap of the squared distances of the k nearest entries so far.
+  std::priority_queue<std::pair<double, Id>> nearest;
+  auto AddEntry = [&](const Entry& entry) {
+    const double squared_dist = (entry.position - point).squaredNorm();
+    if (squared_dist > max_squared_dist) {
+      return;
+    }
+    if (nearest.size() < k) {
+      nearest.emplace(squared_dist, entry.id);
+    } else if (squared_dist < nearest.top().first) {
+      nearest.pop();
+      nearest.emplace(squared_dist, entry.id);
+    }
+  };
+
+  for (const Entry& entry : new_entries_) {
+    AddEntry(entry);
+  }
+
+  // Best-first traversal of the nodes by the distance of their boxes.
+  typedef std::pair<double, int> NodeDistance;
+  std::priority_queue<NodeDistance,
+                      std::vector<NodeDistance>,
+                      std::greater<NodeDistance>>
+      node_queue;
+  if (!nodes_.empty()) {
+    node_queue.emplace(nodes_[0].bbox.squaredExteriorDistance(point), 0);
+  }
+  while (!node_queue.empty()) {
+    const NodeDistance node_dist = node_queue.top();
+    node_queue.pop();
+    if (node_dist.first > max_squared_dist ||
+        (nearest.size() == k && node_dist.first >= nearest.top().first)) {
+      break;
+    }
+    const Node& node = nodes_[node_dist.second];
+    if (node.left == -1) {
+      for (uint32_t i = node.begin; i < node.end; ++i) {
+        if (!removed_[i]) {
+          AddEntry(entries_[i]);
+        }
+      }
+    } else {
+      for (const int child_idx : {node.left, node.right}) {
+        node_queue.emplace(
+            nodes_[child_idx].bbox.squaredExteriorDistance(point), child_idx);
+      }
+    }
+  }
+
+  std::vector<Id> ids(nearest.size());
+  for (auto it = ids.rbegin(); it != ids.rend(); ++it) {
+    *it = nearest.top().second;
+    nearest.pop();
+  }
+  return ids;
+}
+
+std::vector<SpatialIndex::Id> SpatialIndex::QueryFrustum(
+    const Frustum& frustum) const {
+  return QueryRegion(
+      [&frustum](const Eigen::AlignedBox3d& bbox) {
+        double min_dist = 0;
+        double max_dist = 0;
+        for (const Eigen::Vector4d& plane : frustum) {
+          PlaneBoxDistances(plane, bbox, &min_dist, &max_dist);
+          if (max_dist < 0) {
+            return true;
+          }
+        }
+        return false;
+      },
+      [&frustum](const Eigen::AlignedBox3d& bbox) {
+        double min_dist = 0;
+        double max_dist = 0;
+        for (const Eigen::Vector4d& plane : frustum) {
+          PlaneBoxDistances(plane, bbox, &min_dist, &max_dist);
+          if (min_dist < 0) {
+            return false;
+          }
+        }
+        return true;
+      },
+      [&frustum](const Eigen::Vector3d& position) {
+        return IsInFrustum(frustum, position);
+      });
+}
+
+ReconstructionSpatialIndex::ReconstructionSpatialIndex(
+    const Reconstruction& reconstruction) {
+  Build(reconstruction);
+}
+
+void ReconstructionSpatialIndex::Build(const Reconstruction& reconstruction) {
+  std::vector<SpatialIndex::Id> ids;
+  std::vector<Eigen::Vector3d> positions;
+  ids.reserve(reconstruction.NumPoints3D());
+  positions.reserve(reconstruction.NumPoints3D());
+  for (const auto& point3D : reconstruction.Points3D()) {
+    ids.push_back(point3D.first);
+    positions.push_back(point3D.second.xyz);
+  }
+  points3D_.Build(ids, positions);
+
+  ids.clear();
+  positions.clear();
+  for (const image_t image_id : reconstruction.RegImageIds()) {
+    ids.push_back(image_id);
+    positions.push_back(reconstruction.Image(image_id).ProjectionCenter());
+  }
+  images_.Build(ids, positions);
+}
+
+void ReconstructionSpatialIndex::Update(
+    const Reconstruction& reconstruction,
+    const std::unordered_set<point3D_t>& point3D_ids,
+    const std::unordered_set<image_t>& image_ids) {
+  for (const point3D_t point3D_id : point3D_ids) {
+    if (reconstruction.ExistsPoint3D(point3D_id)) {
+      points3D_.Insert(point3D_id, reconstruction.Point3D(point3D_id).xyz);
+    } else {
+      points3D_.Remove(point3D_id);
+    }
+  }
+  for (const image_t image_id : image_ids) {
+    if (reconstruction.ExistsImage(image_id) &&
+        reconstruction.IsImageRegistered(image_id)) {
+      images_.Insert(image_id,
+                     reconstruction.Image(image_id).ProjectionCenter());
+    } else {
+      images_.Remove(image_id);
+    }
+  }
+}
+
+}  // namespace colmap
@@ -0,0 +1,162 @@
+#pragma once
+
+#include "colmap/scene/reconstruction.h"
+#include "colmap/util/types.h"
+
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+
+namespace colmap {
+
+// A view frustum given by planes (n, d) with inward-facing unit normals n,
+// such that a point x is inside the frustum if n^T x + d >= 0 for all planes.
+using Frustum = std::array<Eigen::Vector4d, 6>;
+
+// Compute the frustum of the image in world coordinates between the given
+// depths, where the sides of the frustum pass through the unprojected
+// corners of the image. For refractive cameras, the image edges are
+// unprojected with refraction and the sides are widened to contain the
+// curved refracted edges between the depths, such that the frustum is a
+// conservative bound. If the refraction of an edge ray fails, the corners
+// are unprojected without refraction.
+Frustum ComputeImageFrustum(const Camera& camera,
+                            const Rigid3d& cam_from_world,
+                            double min_depth,
+                            double max_depth);
+
+// Spatial index of 3D positions with identifiers for box, radius, k-nearest
+// neighbor, and frustum queries in logarithmic instead of linear time per
+// query. The positions are stored in a balanced k-d tree, where every node
+// holds the bounding box of its positions, such that the queries skip the
+// nodes outside and take all positions of the nodes inside of the query
+// region without further tests.
+//
+// Inserted, moved, and removed positions invalidate the tree incrementally:
+// Removed positions are marked in the tree and new positions are kept in a
+// separate list, which is scanned by every query. The tree is rebuilt once the
+// number of changes exceeds a fraction of its size, such that the amortized
+// cost of a change is logarithmic.
+//
+// The queries are const and thread-safe for concurrent readers, while changes
+// must not be concurrent with other changes or queries.
+class SpatialIndex {
+ public:
+  typedef uint64_t Id;
+
+  // Build the index over the given positions, which replaces the previous
+  // positions.
+  void Build(const std::vector<Id>& ids,
+             const std::vector<Eigen::Vector3d>& positions);
+
+  // Insert a new position or move the existing position of the identifier.
+  void Insert(Id id, const Eigen::Vector3d& position);
+
+  // Remove the position of the identifier, if it exists.
+  void Remove(Id id);
+
+  void Clear();
+
+  size_t Size() const;
+  bool Exists(Id id) const;
+
+  // The identifiers of the positions inside of the box.
+  std::vector<Id> QueryBox(const Eigen::AlignedBox3d& box) const;
+
+  // The identifiers of the positions within the radius around the center.
+  std::vector<Id> QueryRadius(const Eigen::Vector3d& center,
+                              double radius) const;
+
+  // The identifiers of the k nearest positions to the point within the
+  // maximum distance, sorted by their distance to the point.
+  std::vector<Id> QueryNearest(
+      const Eigen::Vector3d& point,
+      size_t k,
+      double max_distance = std::numeric_limits<double>::max()) const;
+
+  // The identifiers of the positions inside of the frustum.
+  std::vector<Id> QueryFrustum(const Frustum& frustum) const;
+
+ private:
+  struct Entry {
+    Eigen::Vector3d position;
+    Id id;
+  };
+
+  struct Node {
+    Eigen::AlignedBox3d bbox;
+    // The range of the entries of the node in `entries_`.
+    uint32_t begin = 0;
+    uint32_t end = 0;
+    // The indices of the child nodes or -1 for leaf nodes.
+    int left = -1;
+    int right = -1;
+  };
+
+  void BuildFromEntries(std::vector<Entry> entries);
+  int BuildNode(uint32_t begin, uint32_t end);
+
+  // Rebuild the tree, if the removed and the separately stored entries exceed
+  // a fraction of the tree.
+  void MaybeRebuild();
+
+  // The identifiers of the positions for which test(position) is true, where
+  // prune(bbox) is true if no position and contains(bbox) is true if all
+  // positions in the box pass the test.
+  template <typename Prune, typename Contains, typename Test>
+  std::vector<Id> QueryRegion(const Prune& prune,
+                              const Contains& contains,
+                              const Test& test) const;
+
+  std::vector<Node> nodes_;
+
+  // The entries of the tree, grouped by node.
+  std::vector<Entry> entries_;
+  std::vector<char> removed_;
+  size_t num_removed_ = 0;
+
+  // The entries inserted or moved since the last build.
+  std::vector<Entry> new_entries_;
+
+  // The index of every identifier in the tree or, if negative, the index
+  // -(idx + 1) in the separate list.
+  std::unordered_map<Id, int64_t> id_to_idx_;
+};
+
+// Spatial indices of the 3D points and of the projection centers of the
+// registered images of a reconstruction, e.g., to crop models, to find the
+// images in the local area of an image, or to select the points in the view
+// of an image, without a linear pass over the reconstruction per query.
+class ReconstructionSpatialIndex {
+ public:
+  ReconstructionSpatialIndex() = default;
+  explicit ReconstructionSpatialIndex(const Reconstruction& reconstruction);
+
+  void Build(const Reconstruction& reconstruction);
+
+  // Update the index for the given 3D points and images, which were added,
+  // moved, deleted, registered, or deregistered since the last build or
+  // update, e.g., as reported by `Reconstruction::ModifiedPoint3DIds`.
+  void Update(const Reconstruction& reconstruction,
+              const std::unordered_set<point3D_t>& point3D_ids,
+              const std::unordered_set<image_t>& image_ids);
+
+  // The index of the 3D points by their identifiers.
+  inline const SpatialIndex& Points3D() const { return points3D_; }
+
+  // The index of the projection centers of the registered images by their
+  // identifiers.
+  inline const SpatialIndex& Images() const { return images_; }
+
+ private:
+  SpatialIndex points3D_;
+  SpatialIndex images_;
+};
+
+}  // namespace colmap
@@ -0,0 +1,237 @@
+#include "colmap/scene/spatial_index.h"
+
+#include "colmap/math/random.h"
+#include "colmap/scene/synthetic.h"
+#include "colmap/sensor/models_refrac.h"
+
+#include <algorithm>
+#include <map>
+
+#include <gtest/gtest.h>
+
+namespace colmap {
+namespace {
+
+typedef std::map<SpatialIndex::Id, Eigen::Vector3d> Positions;
+
+Positions RandomPositions(const int num_positions) {
+  Positions positions;
+  for (int i = 0; i < num_positions; ++i) {
+    positions.emplace(
+        10 * i,
+        Eigen::Vector3d(RandomUniformReal<double>(-1, 1),
+                        RandomUniformReal<double>(-1, 1),
+                        RandomUniformReal<double>(-1, 1)));
+  }
+  return positions;
+}
+
+void BuildIndex(const Positions& positions, SpatialIndex* index) {
+  std::vector<SpatialIndex::Id> ids;
+  std::vector<Eigen::Vector3d> xyzs;
+  for (const auto& position : positions) {
+    ids.push_back(position.first);
+    xyzs.push_back(position.second);
+  }
+  index->Build(ids, xyzs);
+}
+
+template <typename Test>
+std::vector<SpatialIndex::Id> BruteForceQuery(const Positions& positions,
+                                              const Test& test) {
+  std::vector<SpatialIndex::Id> ids;
+  for (const auto& position : positions) {
+    if (test(position.second)) {
+      ids.push_back(position.first);
+    }
+  }
+  return ids;
+}
+
+std::vector<SpatialIndex::Id> Sorted(std::vector<SpatialIndex::Id> ids) {
+  std::sort(ids.begin(), ids.end());
+  return ids;
+}
+
+void ExpectEqualQueries(const Positions& positions,
+                        const SpatialIndex& index) {
+  EXPECT_EQ(index.Size(), positions.size());
+
+  const Eigen::AlignedBox3d box(Eigen::Vector3d(-0.5, -0.2, 0),
+                                Eigen::Vector3d(0.3, 0.6, 0.8));
+  EXPECT_EQ(Sorted(index.QueryBox(box)),
+            BruteForceQuery(positions, [&](const Eigen::Vector3d& xyz) {
+              return box.contains(xyz);
+            }));
+
+  const Eigen::Vector3d center(0.1, -0.2, 0.3);
+  EXPECT_EQ(Sorted(index.QueryRadius(center, 0.4)),
+            BruteForceQuery(positions, [&](const Eigen::Vector3d& xyz) {
+              return (xyz - center).norm() <= 0.4;
+            }));
+
+  std::vector<std::pair<double, SpatialIndex::Id>> dists;
+  for (const auto& position : positions) {
+    dists.emplace_back((position.second - center).squaredNorm(),
+                       position.first);
+  }
+  std::sort(dists.begin(), dists.end());
+  std::vector<SpatialIndex::Id> nearest_ids;
+  for (size_t i = 0; i < std::min<size_t>(7, dists.size()); ++i) {
+    nearest_ids.push_back(dists[i].second);
+  }
+  EXPECT_EQ(index.QueryNearest(center, 7), nearest_ids);
+  std::vector<SpatialIndex::Id> nearest_ids_within_distance;
+  for (size_t i = 0; i < dists.size() && i < 7 && dists[i].first <= 0.01;
+       ++i) {
+    nearest_ids_within_distance.push_back(dists[i].second);
+  }
+  EXPECT_EQ(index.QueryNearest(center, 7, 0.1), nearest_ids_within_distance);
+  EXPECT_TRUE(index.QueryNearest(center, 0).empty());
+  EXPECT_EQ(index.QueryNearest(center, positions.size() + 1).size(),
+            positions.size());
+}
+
+TEST(SpatialIndex, Empty) {
+  SpatialIndex index;
+  EXPECT_EQ(index.Size(), 0);
+  EXPECT_TRUE(index.QueryBox(Eigen::AlignedBox3d(Eigen::Vector3d(-1, -1, -1),
+                                                 Eigen::Vector3d(1, 1, 1)))
+                  .empty());
+  EXPECT_TRUE(index.QueryRadius(Eigen::Vector3d::Zero(), 1).empty());
+  EXPECT_TRUE(index.QueryNearest(Eigen::Vector3d::Zero(), 3).empty());
+}
+
+TEST(SpatialIndex, Queries) {
+  SetPRNGSeed(0);
+  for (const int num_positions : {1, 10, 1000}) {
+    const Positions positions = RandomPositions(num_positions);
+    SpatialIndex index;
+    BuildIndex(positions, &index);
+    ExpectEqualQueries(positions, index);
+  }
+}
+
+TEST(SpatialIndex, InsertMoveRemove) {
+  SetPRNGSeed(0);
+  Positions positions = RandomPositions(1000);
+  SpatialIndex index;
+  BuildIndex(positions, &index);
+
+  // Enough changes to trigger rebuilds in between.
+  for (int i = 0; i < 500; ++i) {
+    const SpatialIndex::Id id = 10 * RandomUniformInteger<int>(0, 1200) +
+                                RandomUniformInteger<int>(0, 1);
+    if (RandomUniformReal<double>(0, 1) < 0.3) {
+      index.Remove(id);
+      positions.erase(id);
+    } else {
+      const Eigen::Vector3d xyz(RandomUniformReal<double>(-1, 1),
+                                RandomUniformReal<double>(-1, 1),
+                                RandomUniformReal<double>(-1, 1));
+      index.Insert(id, xyz);
+      positions[id] = xyz;
+    }
+    EXPECT_EQ(index.Exists(id), positions.count(id) > 0);
+    if (i % 50 == 0) {
+      ExpectEqualQueries(positions, index);
+    }
+  }
+  ExpectEqualQueries(positions, index);
+}
+
+TEST(SpatialIndex, QueryFrustum) {
+  SetPRNGSeed(0);
+  const Positions positions = RandomPositions(1000);
+  SpatialIndex index;
+  BuildIndex(positions, &index);
+
+  const Camera camera =
+      Camera::CreateFromModelName(1, "SIMPLE_PINHOLE", 100, 200, 100);
+  const Rigid3d cam_from_world(
+      Eigen::Quaterniond(Eigen::AngleAxisd(0.2, Eigen::Vector3d::UnitY())),
+      Eigen::Vector3d(0.1, 0, 1.5));
+  const Frustum frustum = ComputeImageFrustum(camera, cam_from_world, 1, 2.5);
+
+  const std::vector<SpatialIndex::Id> expected_ids =
+      BruteForceQuery(positions, [&](const Eigen::Vector3d& xyz) {
+        const Eigen::Vector3d cam_xyz = cam_from_world * xyz;
+        if (cam_xyz.z() < 1 || cam_xyz.z() > 2.5) {
+          return false;
+        }
+        const Eigen::Vector2d img_xy =
+            camera.ImgFromCam(cam_xyz.hnormalized());
+        return img_xy.x() >= 0 && img_xy.x() <= camera.width &&
+               img_xy.y() >= 0 && img_xy.y() <= camera.height;
+      });
+  EXPECT_FALSE(expected_ids.empty());
+  EXPECT_LT(expected_ids.size(), positions.size());
+  EXPECT_EQ(Sorted(index.QueryFrustum(frustum)), expected_ids);
+}
+
+TEST(SpatialIndex, QueryFrustumRefractive) {
+  SetPRNGSeed(0);
+  const Positions positions = RandomPositions(1000);
+  SpatialIndex index;
+  BuildIndex(positions, &index);
+
+  Camera camera =
+      Camera::CreateFromModelName(1, "SIMPLE_PINHOLE", 100, 200, 100);
+  camera.refrac_model_id = FlatPort::refrac_model_id;
+  camera.refrac_params = {0.1, 0.05, 0.99, 0.05, 0.007, 1.0, 1.52, 1.33};
+  Eigen::Map<Eigen::Vector3d>(camera.refrac_params.data()).normalize();
+  const Rigid3d cam_from_world(
+      Eigen::Quaterniond(Eigen::AngleAxisd(0.2, Eigen::Vector3d::UnitY())),
+      Eigen::Vector3d(0.1, 0, 1.5));
+  const Frustum frustum = ComputeImageFrustum(camera, cam_from_world, 1, 2.5);
+
+  // The refracted sides are not exactly planar, such that the frustum
+  // contains all visible positions but possibly a few more.
+  const std::vector<SpatialIndex::Id> expected_ids =
+      BruteForceQuery(positions, [&](const Eigen::Vector3d& xyz) {
+        const Eigen::Vector3d cam_xyz = cam_from_world * xyz;
+        if (cam_xyz.z() < 1 || cam_xyz.z() > 2.5) {
+          return false;
+        }
+        const Eigen::Vector2d img_xy = camera.ImgFromCamRefrac(cam_xyz);
+        return img_xy.allFinite() && img_xy.x() >= 0 &&
+               img_xy.x() <= camera.width && img_xy.y() >= 0 &&
+               img_xy.y() <= camera.height;
+      });
+  const std::vector<SpatialIndex::Id> ids = Sorted(index.QueryFrustum(frustum));
+  EXPECT_FALSE(expected_ids.empty());
+  EXPECT_TRUE(std::includes(
+      ids.begin(), ids.end(), expected_ids.begin(), expected_ids.end()));
+  EXPECT_LT(ids.size(), expected_ids.size() * 5 / 4);
+}
+
+TEST(ReconstructionSpatialIndex, BuildAndUpdate) {
+  SetPRNGSeed(0);
+  Reconstruction reconstruction;
+  SyntheticDatasetOptions synthetic_dataset_options;
+  synthetic_dataset_options.num_images = 10;
+  synthetic_dataset_options.num_points3D = 100;
+  SynthesizeDataset(synthetic_dataset_options, &reconstruction);
+
+  ReconstructionSpatialIndex index(reconstruction);
+  EXPECT_EQ(index.Points3D().Size(), reconstruction.NumPoints3D());
+  EXPECT_EQ(index.Images().Size(), reconstruction.NumRegImages());
+
+  const image_t image_id = reconstruction.RegImageIds()[0];
+  const Eigen::Vector3d center =
+      reconstruction.Image(image_id).ProjectionCenter();
+  EXPECT_EQ(index.Images().QueryNearest(center, 1),
+            std::vector<SpatialIndex::Id>{image_id});
+
+  const point3D_t point3D_id = reconstruction.Points3D().begin()->first;
+  reconstruction.Point3D(point3D_id).xyz = Eigen::Vector3d(100, 100, 100);
+  reconstruction.DeRegisterImage(image_id);
+  index.Update(reconstruction, {point3D_id}, {image_id});
+  EXPECT_EQ(index.Points3D().QueryRadius(Eigen::Vector3d(100, 100, 100), 1),
+            std::vector<SpatialIndex::Id>{point3D_id});
+  EXPECT_FALSE(index.Images().Exists(image_id));
+  EXPECT_EQ(index.Images().Size(), reconstruction.NumRegImages());
+}
+
+}  // namespace
+}  // namespace colmap
@@ -31,10 +31,14 @@
 
 #include "colmap/geometry/essential_matrix.h"
 #include "colmap/geometry/pose.h"
+#include "colmap/math/math.h"
 #include "colmap/math/random.h"
 #include "colmap/scene/projection.h"
 #include "colmap/util/eigen_alignment.h"
 
+#include <cmath>
+#include <unordered_map>
+
 #include <Eigen/Geometry>
 
 namespace colmap {
@@ -73,6 +77,11 @@ void SynthesizeExhaustiveMatches(Reconstruction* reconstruction,
         }
       }
 
+      // Images of large surveys only overlap with their neighbors.
+      if (two_view_geometry.inlier_matches.empty()) {
+        continue;
+      }
+
       database->WriteTwoViewGeometry(
           image1.ImageId(), image2.ImageId(), two_view_geometry);
     }
@@ -84,7 +93,7 @@ void SynthesizeChainedMatches(Reconstruction* reconstruction,
   std::unordered_map<image_pair_t, TwoViewGeometry> two_view_geometries;
   for (const auto& point3D : reconstruction->Points3D()) {
     std::vector<TrackElement> track_elements = point3D.second.track.Elements();
-    std::shuffle(track_elements.begin(), track_elements.end(), *PRNG);
+    std::shuffle(track_elements.begin(), track_elements.end(), GetPRNG());
     for (size_t i = 1; i < track_elements.size(); ++i) {
       const auto& prev_track_el = track_elements[i - 1];
       const auto& curr_track_el = track_elements[i];
@@ -117,6 +126,134 @@ void SynthesizeChainedMatches(Reconstruction* reconstruction,
   }
 }
 
+// The pose of the image_idx-th image of a lawnmower survey, where the camera
+// looks down at the seafloor at z = 0 with the image x-axis along the line.
+Rigid3d LawnmowerCamFromWorld(const SyntheticDatasetOptions& options,
+                              const int image_idx) {
+  const int line_idx = image_idx / options.lawnmower_num_images_per_line;
+  const int line_image_idx = image_idx % options.lawnmower_num_images_per_line;
+  const bool forward = line_idx % 2 == 0;
+  const Eigen::Vector3d proj_center(
+      options.lawnmower_image_spacing *
+          (forward ? line_image_idx
+                   : options.lawnmower_num_images_per_line - 1 -
+                         line_image_idx),
+      options.lawnmower_line_spacing * line_idx,
+      options.lawnmower_altitude);
+  Eigen::Quaterniond cam_from_world_rotation(
+      Eigen::AngleAxisd(M_PI, Eigen::Vector3d::UnitX()));
+  if (!forward) {
+    cam_from_world_rotation =
+        Eigen::AngleAxisd(M_PI, Eigen::Vector3d::UnitZ()) *
+        cam_from_world_rotation;
+  }
+  return Rigid3d(cam_from_world_rotation,
+                 cam_from_world_rotation * -proj_center);
+}
+
+// Perturb the pose by Gaussian noise in position and rotation.
+Rigid3d NoisyCamFromWorld(const SyntheticDatasetOptions& options,
+                          const Rigid3d& cam_from_world) {
+  const Eigen::Vector3d position_noise(
+      RandomGaussian<double>(0, options.prior_position_stddev),
+      RandomGaussian<double>(0, options.prior_position_stddev),
+      RandomGaussian<double>(0, options.prior_position_stddev));
+  const Eigen::Vector3d rotation_noise(
+      RandomGaussian<double>(0, DegToRad(options.prior_rotation_stddev)),
+      RandomGaussian<double>(0, DegToRad(options.prior_rotation_stddev)),
+      RandomGaussian<double>(0, DegToRad(options.prior_rotation_stddev)));
+  Rigid3d noisy_cam_from_world;
+  noisy_cam_from_world.rotation =
+      (cam_from_world.rotation *
+       Eigen::Quaterniond(Eigen::AngleAxisd(rotation_noise.norm(),
+                                            rotation_noise.normalized())))
+          .normalized();
+  const Eigen::Vector3d proj_center =
+      Inverse(cam_from_world).translation + position_noise;
+  noisy_cam_from_world.translation =
+      noisy_cam_from_world.rotation * -proj_center;
+  return noisy_cam_from_world;
+}
+
+// Uniform grid over the surveyed area of a lawnmower trajectory, which finds
+// the 3D points observed by an image without projecting all 3D points.
+class SurveyGrid {
+ public:
+  void Init(const SyntheticDatasetOptions& options, const Camera& camera) {
+    // The radius of the footprint of the non-refractive camera at the lowest
+    // terrain. Flat ports narrow the field of view, such that the footprint
+    // of refractive cameras is typically contained.
+    double max_normalized_radius = 0;
+    for (const double x : {0.0, static_cast<double>(camera.width)}) {
+      for (const double y : {0.0, static_cast<double>(camera.height)}) {
+        max_normalized_radius =
+            std::max(max_normalized_radius,
+                     camera.CamFromImg(Eigen::Vector2d(x, y)).norm());
+      }
+    }
+    cell_size_ = max_normalized_radius * (options.lawnmower_altitude +
+                                          options.lawnmower_terrain_relief);
+
+    const int num_lines = (options.num_images - 1) /
+                              options.lawnmower_num_images_per_line +
+                          1;
+    min_xy_ = Eigen::Vector2d(-cell_size_, -cell_size_);
+    max_xy_ = Eigen::Vector2d(
+        options.lawnmower_image_spacing *
+                (std::min(options.num_images,
+                          options.lawnmower_num_images_per_line) -
+                 1) +
+            cell_size_,
+        options.lawnmower_line_spacing * (num_lines - 1) + cell_size_);
+  }
+
+  Eigen::Vector3d RandomPoint3D(const SyntheticDatasetOptions& options) const {
+    return Eigen::Vector3d(RandomUniformReal(min_xy_.x(), max_xy_.x()),
+                           RandomUniformReal(min_xy_.y(), max_xy_.y()),
+                           RandomUniformReal(-options.lawnmower_terrain_relief,
+                                             options.lawnmower_terrain_relief));
+  }
+
+  void AddPoint3D(const point3D_t point3D_id, const Eigen::Vector3d& xyz) {
+    cells_[CellKey(CellIndex(xyz.x()), CellIndex(xyz.y()))].push_back(
+        point3D_id);
+  }
+
+  // Calls func for all 3D points within the cell size of the given position.
+  template <typename Func>
+  void ForEachPoint3DNear(const Eigen::Vector3d& position,
+                          const Func& func) const {
+    const int64_t cell_x = CellIndex(position.x());
+    const int64_t cell_y = CellIndex(position.y());
+    for (int64_t x = cell_x - 1; x <= cell_x + 1; ++x) {
+      for (int64_t y = cell_y - 1; y <= cell_y + 1; ++y) {
+        const auto cell = cells_.find(CellKey(x, y));
+        if (cell == cells_.end()) {
+          continue;
+        }
+        for (const point3D_t point3D_id : cell->second) {
+          func(point3D_id);
+        }
+      }
+    }
+  }
+
+ private:
+  int64_t CellIndex(const double coord) const {
+    return static_cast<int64_t>(std::floor(coord / cell_size_));
+  }
+
+  static uint64_t CellKey(const int64_t x, const int64_t y) {
+    return (static_cast<uint64_t>(x) << 32) ^
+           static_cast<uint64_t>(static_cast<uint32_t>(y));
+  }
+
+  double cell_size_ = 1;
+  Eigen::Vector2d min_xy_ = Eigen::Vector2d::Zero();
+  Eigen::Vector2d max_xy_ = Eigen::Vector2d::Zero();
+  std::unordered_map<uint64_t, std::vector<point3D_t>> cells_;
+};
+
 }  // namespace
 
 void SynthesizeDataset(const SyntheticDatasetOptions& options,
@@ -128,6 +265,18 @@ void SynthesizeDataset(const SyntheticDatasetOptions& options,
   CHECK_GE(options.num_points3D, 0);
   CHECK_GE(options.num_points2D_without_point3D, 0);
   CHECK_GE(options.point2D_stddev, 0);
+  CHECK_GE(options.prior_rotation_stddev, 0);
+  if (options.trajectory_config ==
+      SyntheticDatasetOptions::TrajectoryConfig::LAWNMOWER) {
+    CHECK_GT(options.lawnmower_num_images_per_line, 0);
+    CHECK_GT(options.lawnmower_image_spacing, 0);
+    CHECK_GT(options.lawnmower_line_spacing, 0);
+    CHECK_GT(options.lawnmower_altitude, options.lawnmower_terrain_relief);
+    CHECK_GE(options.lawnmower_terrain_relief, 0);
+  }
+
+  const bool is_refractive =
+      options.camera_refrac_model_id != CameraRefracModelId::kInvalid;
 
   // Synthesize cameras.
   std::vector<camera_t> camera_ids(options.num_cameras);
@@ -138,6 +287,11 @@ void SynthesizeDataset(const SyntheticDatasetOptions& options,
     camera.model_id = options.camera_model_id;
     camera.params = options.camera_params;
     CHECK(camera.VerifyParams());
+    if (is_refractive) {
+      camera.refrac_model_id = options.camera_refrac_model_id;
+      camera.refrac_params = options.camera_refrac_params;
+      CHECK(camera.VerifyRefracParams());
+    }
     const camera_t camera_id =
         (database == nullptr) ? camera_idx + 1 : database->WriteCamera(camera);
     camera_ids[camera_idx] = camera_id;
@@ -145,10 +299,24 @@ void SynthesizeDataset(const SyntheticDatasetOptions& options,
     reconstruction->AddCamera(std::move(camera));
   }
 
-  // Synthesize 3D points on unit sphere centered at origin.
-  for (int point3D_idx = 0; point3D_idx < options.num_points3D; ++point3D_idx) {
-    reconstruction->AddPoint3D(Eigen::Vector3d::Random().normalized(),
-                               /*track=*/{});
+  // Synthesize 3D points.
+  SurveyGrid survey_grid;
+  if (options.trajectory_config ==
+      SyntheticDatasetOptions::TrajectoryConfig::LAWNMOWER) {
+    survey_grid.Init(options, reconstruction->Camera(camera_ids[0]));
+    for (int point3D_idx = 0; point3D_idx < options.num_points3D;
+         ++point3D_idx) {
+      const Eigen::Vector3d xyz = survey_grid.RandomPoint3D(options);
+      survey_grid.AddPoint3D(reconstruction->AddPoint3D(xyz, /*track=*/{}),
+                             xyz);
+    }
+  } else {
+    // 3D points on unit sphere centered at origin.
+    for (int point3D_idx = 0; point3D_idx < options.num_points3D;
+         ++point3D_idx) {
+      reconstruction->AddPoint3D(Eigen::Vector3d::Random().normalized(),
+                                 /*track=*/{});
+    }
   }
 
   // Synthesize images.
@@ -159,14 +327,24 @@ void SynthesizeDataset(const SyntheticDatasetOptions& options,
     Image image;
     image.SetName("image" + std::to_string(existing_num_images + image_idx));
     image.SetCameraId(camera_ids[image_idx % options.num_cameras]);
-    // Synthesize image poses with projection centers on sphere with radious 5
-    // centered at origin.
-    const Eigen::Vector3d view_dir = -Eigen::Vector3d::Random().normalized();
-    const Eigen::Vector3d proj_center = -5 * view_dir;
-    image.CamFromWorld().rotation =
-        Eigen::Quaterniond::FromTwoVectors(view_dir, Eigen::Vector3d(0, 0, 1));
-    image.CamFromWorld().translation =
-        image.CamFromWorld().rotation * -proj_center;
+    if (options.trajectory_config ==
+        SyntheticDatasetOptions::TrajectoryConfig::LAWNMOWER) {
+      image.CamFromWorld() = LawnmowerCamFromWorld(options, image_idx);
+    } else {
+      // Synthesize image poses with projection centers on sphere with radious
+      // 5 centered at origin.
+      const Eigen::Vector3d view_dir = -Eigen::Vector3d::Random().normalized();
+      const Eigen::Vector3d proj_center = -5 * view_dir;
+      image.CamFromWorld().rotation = Eigen::Quaterniond::FromTwoVectors(
+          view_dir, Eigen::Vector3d(0, 0, 1));
+      image.CamFromWorld().translation =
+          image.CamFromWorld().rotation * -proj_center;
+    }
+
+    if (options.prior_position_stddev >= 0) {
+      image.CamFromWorldPrior() = NoisyCamFromWorld(options,
+                                                    image.CamFromWorld());
+    }
 
     const Camera& camera = reconstruction->Camera(image.CameraId());
 
@@ -174,11 +352,16 @@ void SynthesizeDataset(const SyntheticDatasetOptions& options,
     points2D.reserve(options.num_points3D +
                      options.num_points2D_without_point3D);
 
-    // Create 3D point observations by project all 3D points to the image.
-    for (auto& point3D : reconstruction->Points3D()) {
+    // Create 3D point observations by projecting the 3D points to the image.
+    const auto add_observation = [&](const point3D_t point3D_id,
+                                     const Eigen::Vector3d& xyz) {
+      const Eigen::Vector3d point3D_in_cam = image.CamFromWorld() * xyz;
+      if (point3D_in_cam.z() <= 0) {
+        return;
+      }
       Point2D point2D;
-      point2D.xy = camera.ImgFromCam(
-          (image.CamFromWorld() * point3D.second.xyz).hnormalized());
+      point2D.xy = is_refractive ? camera.ImgFromCamRefrac(point3D_in_cam)
+                                 : camera.ImgFromCam(point3D_in_cam.hnormalized());
       if (options.point2D_stddev > 0) {
         const Eigen::Vector2d noise(
             RandomGaussian<double>(0, options.point2D_stddev),
@@ -187,9 +370,23 @@ void SynthesizeDataset(const SyntheticDatasetOptions& options,
       }
       if (point2D.xy(0) >= 0 && point2D.xy(1) >= 0 &&
           point2D.xy(0) <= camera.width && point2D.xy(1) <= camera.height) {
-        point2D.point3D_id = point3D.first;
+        point2D.point3D_id = point3D_id;
         points2D.push_back(point2D);
       }
+    };
+
+    if (options.trajectory_config ==
+        SyntheticDatasetOptions::TrajectoryConfig::LAWNMOWER) {
+      // Only project the points near the footprint of the image.
+      survey_grid.ForEachPoint3DNear(
+          image.ProjectionCenter(), [&](const point3D_t point3D_id) {
+            add_observation(point3D_id,
+                            reconstruction->Point3D(point3D_id).xyz);
+          });
+    } else {
+      for (const auto& point3D : reconstruction->Points3D()) {
+        add_observation(point3D.first, point3D.second.xyz);
+      }
     }
 
     // Synthesize uniform random 2D points without 3D points.
@@ -201,7 +398,7 @@ void SynthesizeDataset(const SyntheticDatasetOptions& options,
     }
 
     // Shuffle 2D points, so each image has another order of observed 3D points.
-    std::shuffle(points2D.begin(), points2D.end(), *PRNG);
+    std::shuffle(points2D.begin(), points2D.end(), GetPRNG());
 
     const image_t image_id =
         (database == nullptr) ? image_idx + 1 : database->WriteImage(image);
@@ -243,7 +440,7 @@ void SynthesizeDataset(const SyntheticDatasetOptions& options,
     }
   }
 
-  reconstruction->UpdatePoint3DErrors();
+  reconstruction->UpdatePoint3DErrors(is_refractive);
 }
 
 }  // namespace colmap
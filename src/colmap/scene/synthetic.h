@@ -32,6 +32,7 @@
 #include "colmap/scene/database.h"
 #include "colmap/scene/reconstruction.h"
 #include "colmap/sensor/models.h"
+#include "colmap/sensor/models_refrac.h"
 #include "colmap/util/types.h"
 
 namespace colmap {
@@ -46,6 +47,11 @@ struct SyntheticDatasetOptions {
   CameraModelId camera_model_id = SimpleRadialCameraModel::model_id;
   std::vector<double> camera_params = {1280, 512, 384, 0.05};
 
+  // The refractive model of the cameras, e.g., a flat or dome port. If the
+  // model is invalid, the cameras are not refractive.
+  CameraRefracModelId camera_refrac_model_id = CameraRefracModelId::kInvalid;
+  std::vector<double> camera_refrac_params;
+
   int num_points2D_without_point3D = 10;
   double point2D_stddev = 0.0;
 
@@ -56,6 +62,33 @@ struct SyntheticDatasetOptions {
     CHAINED = 2,
   };
   MatchConfig match_config = MatchConfig::EXHAUSTIVE;
+
+  enum class TrajectoryConfig {
+    // Projection centers on a sphere of radius 5 looking at the origin and
+    // 3D points on the unit sphere, such that all images observe all points.
+    SPHERE = 1,
+    // Downward looking survey of the seafloor in parallel lines of
+    // alternating direction, where the 3D points are scattered over the
+    // surveyed area and every image only observes the points in its footprint.
+    LAWNMOWER = 2,
+  };
+  TrajectoryConfig trajectory_config = TrajectoryConfig::SPHERE;
+
+  // The number of images per line, the distance between successive images
+  // and lines, and the altitude above the seafloor of the lawnmower survey.
+  int lawnmower_num_images_per_line = 20;
+  double lawnmower_image_spacing = 0.5;
+  double lawnmower_line_spacing = 1.5;
+  double lawnmower_altitude = 3.0;
+
+  // The maximum height of the 3D points above or below the seafloor plane.
+  double lawnmower_terrain_relief = 0.25;
+
+  // The standard deviations of the noise of the synthesized pose priors in
+  // position and in rotation (in degrees). Pose priors are only synthesized,
+  // if the position standard deviation is non-negative.
+  double prior_position_stddev = -1.0;
+  double prior_rotation_stddev = 1.0;
 };
 
 void SynthesizeDataset(const SyntheticDatasetOptions& options,
@@ -146,6 +146,45 @@ TEST(SynthesizeDataset, ChainedMatches) {
             (options.num_images - 1) * options.num_points3D);
 }
 
+TEST(SynthesizeDataset, RefractiveLawnmower) {
+  Database database(Database::kInMemoryDatabasePath);
+  Reconstruction reconstruction;
+  SyntheticDatasetOptions options;
+  options.num_cameras = 1;
+  options.num_images = 40;
+  options.num_points3D = 2000;
+  options.camera_refrac_model_id = CameraRefracModelId::kFlatPort;
+  options.camera_refrac_params = {0, 0, 1, 0.05, 0.007, 1.003, 1.473, 1.333};
+  options.trajectory_config =
+      SyntheticDatasetOptions::TrajectoryConfig::LAWNMOWER;
+  options.lawnmower_num_images_per_line = 10;
+  options.prior_position_stddev = 0.1;
+  SynthesizeDataset(options, &reconstruction, &database);
+
+  EXPECT_TRUE(reconstruction.Camera(1).IsCameraRefractive());
+  EXPECT_EQ(database.ReadCamera(1).refrac_model_id,
+            CameraRefracModelId::kFlatPort);
+  EXPECT_EQ(reconstruction.NumRegImages(), options.num_images);
+  for (const auto& image : reconstruction.Images()) {
+    // Every image only observes the points in its footprint.
+    EXPECT_GT(image.second.NumPoints3D(), 0);
+    EXPECT_LT(image.second.NumPoints3D(), options.num_points3D / 4);
+    EXPECT_NEAR(
+        image.second.ProjectionCenter().z(), options.lawnmower_altitude, 1e-6);
+    EXPECT_LT((Inverse(image.second.CamFromWorldPrior()).translation -
+               image.second.ProjectionCenter())
+                  .norm(),
+              1.0);
+  }
+
+  // Only neighboring images overlap.
+  const int num_image_pairs = options.num_images * (options.num_images - 1) / 2;
+  EXPECT_GT(database.NumVerifiedImagePairs(), 0);
+  EXPECT_LT(database.NumVerifiedImagePairs(), num_image_pairs);
+
+  EXPECT_NEAR(reconstruction.ComputeMeanReprojectionError(), 0, 1e-3);
+}
+
 TEST(SynthesizeDataset, NoDatabase) {
   Database database(Database::kInMemoryDatabasePath);
   SyntheticDatasetOptions options;
@@ -79,6 +79,9 @@ class Track {
   // Shrink the capacity of track vector to fit its size to save memory.
   inline void Compress();
 
+  // The heap memory in bytes allocated by the track elements.
+  inline size_t MemoryUsage() const;
+
  private:
   std::vector<TrackElement> elements_;
 };
@@ -131,4 +134,8 @@ void Track::Reserve(const size_t num_elements) {
 
 void Track::Compress() { elements_.shrink_to_fit(); }
 
+size_t Track::MemoryUsage() const {
+  return elements_.capacity() * sizeof(TrackElement);
+}
+
 }  // namespace colmap
@@ -76,7 +76,8 @@ struct TwoViewGeometry {
   // Inlier matches of the configuration.
   FeatureMatches inlier_matches;
 
-  // Median triangulation angle.
+  // Median triangulation angle, or negative if the relative pose was not
+  // estimated.
   double tri_angle = -1;
 
   // Invert the geometry to match swapped cameras.
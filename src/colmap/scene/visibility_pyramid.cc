@@ -32,76 +32,170 @@
 #include "colmap/math/math.h"
 #include "colmap/util/logging.h"
 
+#include <limits>
+
 namespace colmap {
 
+namespace {
+
+// The number of cells of a level, which is also the score contributed by each
+// of its populated cells.
+inline size_t LevelSize(const size_t level) {
+  const size_t dim = size_t(1) << (level + 1);
+  return dim * dim;
+}
+
+// The offset of a coarser level in the concatenated child counts.
+inline size_t LevelOffset(const size_t level) {
+  return (LevelSize(level) - 4) / 3;
+}
+
+}  // namespace
+
 VisibilityPyramid::VisibilityPyramid() : VisibilityPyramid(0, 0, 0) {}
 
 VisibilityPyramid::VisibilityPyramid(const size_t num_levels,
                                      const size_t width,
                                      const size_t height)
-    : width_(width), height_(height), score_(0), max_score_(0) {
-  pyramid_.resize(num_levels);
+    : width_(width),
+      height_(height),
+      num_levels_(num_levels),
+      score_(0),
+      max_score_(0) {
   for (size_t level = 0; level < num_levels; ++level) {
-    const size_t level_plus_one = level + 1;
-    const int dim = 1 << level_plus_one;
-    pyramid_[level].setZero(dim, dim);
-    max_score_ += dim * dim * dim * dim;
+    max_score_ += LevelSize(level) * LevelSize(level);
+  }
+  if (num_levels > 0) {
+    point_counts_.resize(LevelSize(num_levels - 1), 0);
+    child_counts_.resize(LevelOffset(num_levels - 1), 0);
   }
 }
 
 void VisibilityPyramid::SetPoint(const double x, const double y) {
-  CHECK_GT(pyramid_.size(), 0);
+  CHECK_GT(num_levels_, 0);
 
   size_t cx = 0;
   size_t cy = 0;
   CellForPoint(x, y, &cx, &cy);
+  SetCell(cx, cy);
 
-  for (int i = static_cast<int>(pyramid_.size() - 1); i >= 0; --i) {
-    auto& level = pyramid_[i];
+  CHECK_LE(score_, max_score_);
+}
 
-    level(cy, cx) += 1;
-    if (level(cy, cx) == 1) {
-      score_ += level.size();
-    }
+void VisibilityPyramid::ResetPoint(const double x, const double y) {
+  CHECK_GT(num_levels_, 0);
 
-    cx = cx >> 1;
-    cy = cy >> 1;
-  }
+  size_t cx = 0;
+  size_t cy = 0;
+  CellForPoint(x, y, &cx, &cy);
+  ResetCell(cx, cy);
 
   CHECK_LE(score_, max_score_);
 }
 
-void VisibilityPyramid::ResetPoint(const double x, const double y) {
-  CHECK_GT(pyramid_.size(), 0);
+void VisibilityPyramid::SetPoints(const std::vector<Eigen::Vector2d>& points) {
+  if (points.empty()) {
+    return;
+  }
+
+  CHECK_GT(num_levels_, 0);
 
   size_t cx = 0;
   size_t cy = 0;
-  CellForPoint(x, y, &cx, &cy);
+  for (const auto& point : points) {
+    CellForPoint(point.x(), point.y(), &cx, &cy);
+    SetCell(cx, cy);
+  }
 
-  for (int i = static_cast<int>(pyramid_.size() - 1); i >= 0; --i) {
-    auto& level = pyramid_[i];
+  CHECK_LE(score_, max_score_);
+}
 
-    level(cy, cx) -= 1;
-    if (level(cy, cx) == 0) {
-      score_ -= level.size();
-    }
+void VisibilityPyramid::ResetPoints(
+    const std::vector<Eigen::Vector2d>& points) {
+  if (points.empty()) {
+    return;
+  }
 
-    cx = cx >> 1;
-    cy = cy >> 1;
+  CHECK_GT(num_levels_, 0);
+
+  size_t cx = 0;
+  size_t cy = 0;
+  for (const auto& point : points) {
+    CellForPoint(point.x(), point.y(), &cx, &cy);
+    ResetCell(cx, cy);
   }
 
   CHECK_LE(score_, max_score_);
 }
 
+size_t VisibilityPyramid::MemoryUsage() const {
+  return point_counts_.capacity() * sizeof(uint16_t) +
+         child_counts_.capacity() * sizeof(uint8_t);
+}
+
 void VisibilityPyramid::CellForPoint(const double x,
                                      const double y,
                                      size_t* cx,
                                      size_t* cy) const {
   CHECK_GT(width_, 0);
   CHECK_GT(height_, 0);
-  const int max_dim = 1 << pyramid_.size();
+  const int max_dim = 1 << num_levels_;
   *cx = Clamp<size_t>(max_dim * x / width_, 0, max_dim - 1);
   *cy = Clamp<size_t>(max_dim * y / height_, 0, max_dim - 1);
 }
 
+void VisibilityPyramid::SetCell(size_t cx, size_t cy) {
+  size_t level = num_levels_ - 1;
+
+  uint16_t& point_count = point_counts_[(cy << num_levels_) + cx];
+  CHECK_LT(point_count, std::numeric_limits<uint16_t>::max());
+  point_count += 1;
+  if (point_count > 1) {
+    return;
+  }
+  score_ += LevelSize(level);
+
+  // Propagate the newly populated cell to the coarser levels until a level
+  // whose cell was already populated.
+  while (level > 0) {
+    --level;
+    cx = cx >> 1;
+    cy = cy >> 1;
+    uint8_t& child_count =
+        child_counts_[LevelOffset(level) + (cy << (level + 1)) + cx];
+    child_count += 1;
+    if (child_count > 1) {
+      return;
+    }
+    score_ += LevelSize(level);
+  }
+}
+
+void VisibilityPyramid::ResetCell(size_t cx, size_t cy) {
+  size_t level = num_levels_ - 1;
+
+  uint16_t& point_count = point_counts_[(cy << num_levels_) + cx];
+  CHECK_GT(point_count, 0);
+  point_count -= 1;
+  if (point_count > 0) {
+    return;
+  }
+  score_ -= LevelSize(level);
+
+  // Propagate the emptied cell to the coarser levels until a level whose cell
+  // remains populated.
+  while (level > 0) {
+    --level;
+    cx = cx >> 1;
+    cy = cy >> 1;
+    uint8_t& child_count =
+        child_counts_[LevelOffset(level) + (cy << (level + 1)) + cx];
+    child_count -= 1;
+    if (child_count > 0) {
+      return;
+    }
+    score_ -= LevelSize(level);
+  }
+}
+
 }  // namespace colmap
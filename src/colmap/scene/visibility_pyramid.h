@@ -31,6 +31,7 @@
 
 #include "colmap/util/eigen_alignment.h"
 
+#include <cstdint>
 #include <vector>
 
 #include <Eigen/Core>
@@ -48,6 +49,11 @@ namespace colmap {
 // populated by at least one point and the contributed score is according
 // to its resolution in the pyramid. A cell in a higher resolution level
 // contributes a higher score to the overall score.
+//
+// Only the finest level stores the number of points per cell. A cell of a
+// coarser level stores the number of its populated child cells, such that an
+// update stops at the first level whose populated state does not change and
+// the score is maintained without traversing the levels' cells.
 class VisibilityPyramid {
  public:
   VisibilityPyramid();
@@ -56,6 +62,11 @@ class VisibilityPyramid {
   void SetPoint(double x, double y);
   void ResetPoint(double x, double y);
 
+  // Set or reset multiple points at once, equivalent to calling `SetPoint` or
+  // `ResetPoint` for each point.
+  void SetPoints(const std::vector<Eigen::Vector2d>& points);
+  void ResetPoints(const std::vector<Eigen::Vector2d>& points);
+
   inline size_t NumLevels() const;
   inline size_t Width() const;
   inline size_t Height() const;
@@ -63,28 +74,44 @@ class VisibilityPyramid {
   inline size_t Score() const;
   inline size_t MaxScore() const;
 
- private:
+  // The heap memory in bytes allocated by the pyramid levels.
+  size_t MemoryUsage() const;
+
+  // The cell of the finest level, which contains the point. The finest level
+  // has `2^NumLevels()` cells in each dimension.
   void CellForPoint(double x, double y, size_t* cx, size_t* cy) const;
 
+ private:
+
+  void SetCell(size_t cx, size_t cy);
+  void ResetCell(size_t cx, size_t cy);
+
   // Range of the input points.
   size_t width_;
   size_t height_;
 
+  // The number of levels of the pyramid.
+  size_t num_levels_;
+
   // The overall visibility score.
   size_t score_;
 
   // The maximum score when all cells are populated.
   size_t max_score_;
 
-  // The visibilty pyramid with multiple levels.
-  std::vector<Eigen::MatrixXi> pyramid_;
+  // The number of points per cell of the finest level in row-major order.
+  std::vector<uint16_t> point_counts_;
+
+  // The number of populated child cells per cell of the coarser levels in
+  // row-major order, concatenated from the coarsest to the finest level.
+  std::vector<uint8_t> child_counts_;
 };
 
 ////////////////////////////////////////////////////////////////////////////////
 // Implementation
 ////////////////////////////////////////////////////////////////////////////////
 
-size_t VisibilityPyramid::NumLevels() const { return pyramid_.size(); }
+size_t VisibilityPyramid::NumLevels() const { return num_levels_; }
 
 size_t VisibilityPyramid::Width() const { return width_; }
 
@@ -29,6 +29,8 @@
 
 #include "colmap/scene/visibility_pyramid.h"
 
+#include "colmap/math/random.h"
+
 #include <gtest/gtest.h>
 
 namespace colmap {
@@ -87,5 +89,59 @@ TEST(VisibilityPyramid, Score) {
   }
 }
 
+size_t ReferenceScore(const size_t num_levels,
+                      const double width,
+                      const double height,
+                      const std::vector<Eigen::Vector2d>& points) {
+  size_t score = 0;
+  for (size_t level = 0; level < num_levels; ++level) {
+    const int dim = 1 << (level + 1);
+    Eigen::MatrixXi counts = Eigen::MatrixXi::Zero(dim, dim);
+    for (const auto& point : points) {
+      const int cx =
+          std::min(static_cast<int>(dim * point.x() / width), dim - 1);
+      const int cy =
+          std::min(static_cast<int>(dim * point.y() / height), dim - 1);
+      counts(cy, cx) += 1;
+    }
+    score += (counts.array() > 0).count() * dim * dim;
+  }
+  return score;
+}
+
+TEST(VisibilityPyramid, SetResetPoints) {
+  SetPRNGSeed();
+  const size_t kNumLevels = 6;
+  const double kWidth = 640;
+  const double kHeight = 480;
+  std::vector<Eigen::Vector2d> points(1000);
+  for (auto& point : points) {
+    point.x() = RandomUniformReal<double>(0, kWidth);
+    point.y() = RandomUniformReal<double>(0, kHeight);
+  }
+
+  VisibilityPyramid pyramid(kNumLevels, kWidth, kHeight);
+  pyramid.SetPoints(points);
+  EXPECT_EQ(pyramid.Score(),
+            ReferenceScore(kNumLevels, kWidth, kHeight, points));
+
+  VisibilityPyramid pyramid2(kNumLevels, kWidth, kHeight);
+  for (const auto& point : points) {
+    pyramid2.SetPoint(point.x(), point.y());
+  }
+  EXPECT_EQ(pyramid2.Score(), pyramid.Score());
+
+  const std::vector<Eigen::Vector2d> reset_points(points.begin(),
+                                                  points.begin() + 900);
+  const std::vector<Eigen::Vector2d> remaining_points(points.begin() + 900,
+                                                      points.end());
+  pyramid.ResetPoints(reset_points);
+  EXPECT_EQ(pyramid.Score(),
+            ReferenceScore(kNumLevels, kWidth, kHeight, remaining_points));
+  pyramid.ResetPoints(remaining_points);
+  EXPECT_EQ(pyramid.Score(), 0);
+  EXPECT_GT(pyramid.MemoryUsage(), 0);
+}
+
 }  // namespace
 }  // namespace colmap
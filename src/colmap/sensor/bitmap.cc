@@ -92,9 +92,151 @@ bool IsPtrRGB(FIBITMAP* ptr) {
 
 bool IsPtrSupported(FIBITMAP* ptr) { return IsPtrGrey(ptr) || IsPtrRGB(ptr); }
 
+// Bilinear interpolation of the color at the given position in the rows of
+// a grey or RGB image, where the 0-th row is at the bottom.
+inline bool InterpolateBilinearRows(const uint8_t* bits,
+                                    const size_t pitch,
+                                    const int width,
+                                    const int height,
+                                    const int channels,
+                                    const double x,
+                                    const double y,
+                                    BitmapColor<float>* color) {
+  // FreeImage's coordinate system origin is in the lower left of the image.
+  const double inv_y = height - 1 - y;
+
+  const int x0 = static_cast<int>(std::floor(x));
+  const int x1 = x0 + 1;
+  const int y0 = static_cast<int>(std::floor(inv_y));
+  const int y1 = y0 + 1;
+
+  if (x0 < 0 || x1 >= width || y0 < 0 || y1 >= height) {
+    return false;
+  }
+
+  const double dx = x - x0;
+  const double dy = inv_y - y0;
+  const double dx_1 = 1 - dx;
+  const double dy_1 = 1 - dy;
+
+  const uint8_t* line0 = bits + y0 * pitch;
+  const uint8_t* line1 = bits + y1 * pitch;
+
+  if (channels == 1) {
+    // Top row, column-wise linear interpolation.
+    const double v0 = dx_1 * line0[x0] + dx * line0[x1];
+
+    // Bottom row, column-wise linear interpolation.
+    const double v1 = dx_1 * line1[x0] + dx * line1[x1];
+
+    // Row-wise linear interpolation.
+    color->r = dy_1 * v0 + dy * v1;
+    return true;
+  } else if (channels == 3) {
+    const uint8_t* p00 = &line0[3 * x0];
+    const uint8_t* p01 = &line0[3 * x1];
+    const uint8_t* p10 = &line1[3 * x0];
+    const uint8_t* p11 = &line1[3 * x1];
+
+    // Top row, column-wise linear interpolation.
+    const double v0_r = dx_1 * p00[FI_RGBA_RED] + dx * p01[FI_RGBA_RED];
+    const double v0_g = dx_1 * p00[FI_RGBA_GREEN] + dx * p01[FI_RGBA_GREEN];
+    const double v0_b = dx_1 * p00[FI_RGBA_BLUE] + dx * p01[FI_RGBA_BLUE];
+
+    // Bottom row, column-wise linear interpolation.
+    const double v1_r = dx_1 * p10[FI_RGBA_RED] + dx * p11[FI_RGBA_RED];
+    const double v1_g = dx_1 * p10[FI_RGBA_GREEN] + dx * p11[FI_RGBA_GREEN];
+    const double v1_b = dx_1 * p10[FI_RGBA_BLUE] + dx * p11[FI_RGBA_BLUE];
+
+    // Row-wise linear interpolation.
+    color->r = dy_1 * v0_r + dy * v1_r;
+    color->g = dy_1 * v0_g + dy * v1_g;
+    color->b = dy_1 * v0_b + dy * v1_b;
+    return true;
+  }
+
+  return false;
+}
+
+// Contributions of the source pixels to every destination pixel of a
+// resampled line. The filter is widened by the inverse scale when
+// downsampling, as in FreeImage's resize engine.
+struct ResampleWeights {
+  // Range [begin, end) of the contributing source pixels.
+  std::vector<int> begin;
+  std::vector<int> end;
+  // Normalized weights of the contributing source pixels, which start at a
+  // stride of the window size for every destination pixel.
+  std::vector<float> weights;
+  int window_size = 0;
+};
+
+ResampleWeights ComputeResampleWeights(const Bitmap::RescaleFilter filter,
+                                       const int src_size,
+                                       const int dst_size) {
+  double filter_width = 0;
+  switch (filter) {
+    case Bitmap::RescaleFilter::kBilinear:
+      filter_width = 1.0;
+      break;
+    case Bitmap::RescaleFilter::kBox:
+      filter_width = 0.5;
+      break;
+    default:
+      LOG(FATAL) << "Filter not implemented";
+  }
+
+  const auto Filter = [filter, filter_width](const double val) {
+    const double abs_val = std::abs(val);
+    if (filter == Bitmap::RescaleFilter::kBox) {
+      return abs_val <= filter_width ? 1.0 : 0.0;
+    } else {
+      return abs_val < 1.0 ? 1.0 - abs_val : 0.0;
+    }
+  };
+
+  const double scale = static_cast<double>(dst_size) / src_size;
+  const double width = scale < 1.0 ? filter_width / scale : filter_width;
+  const double filter_scale = std::min(1.0, scale);
+  const double offset = 0.5 / scale;
+
+  ResampleWeights weights;
+  weights.window_size = 2 * static_cast<int>(std::ceil(width)) + 1;
+  weights.begin.resize(dst_size);
+  weights.end.resize(dst_size);
+  weights.weights.resize(dst_size * weights.window_size, 0.0f);
+  std::vector<double> pixel_weights(weights.window_size);
+  for (int u = 0; u < dst_size; ++u) {
+    const double center = u / scale + offset;
+    const int begin = std::max(0, static_cast<int>(center - width + 0.5));
+    const int end =
+        std::min(static_cast<int>(center + width + 0.5), src_size);
+    CHECK_LE(end - begin, weights.window_size);
+
+    double total_weight = 0;
+    for (int i = begin; i < end; ++i) {
+      pixel_weights[i - begin] =
+          filter_scale * Filter(filter_scale * (i + 0.5 - center));
+      total_weight += pixel_weights[i - begin];
+    }
+
+    weights.begin[u] = begin;
+    weights.end[u] = end;
+    float* u_weights = &weights.weights[u * weights.window_size];
+    for (int i = begin; i < end; ++i) {
+      u_weights[i - begin] = static_cast<float>(
+          total_weight > 0 ? pixel_weights[i - begin] / total_weight
+                           : pixel_weights[i - begin]);
+    }
+  }
+
+  return weights;
+}
+
 }  // namespace
 
-Bitmap::Bitmap() : width_(0), height_(0), channels_(0) {}
+Bitmap::Bitmap()
+    : width_(0), height_(0), channels_(0), bits_(nullptr), pitch_(0) {}
 
 Bitmap::Bitmap(const Bitmap& other) : Bitmap() {
   if (other.handle_.ptr != nullptr) {
@@ -107,9 +249,13 @@ Bitmap::Bitmap(Bitmap&& other) noexcept : Bitmap() {
   width_ = other.width_;
   height_ = other.height_;
   channels_ = other.channels_;
+  bits_ = other.bits_;
+  pitch_ = other.pitch_;
   other.width_ = 0;
   other.height_ = 0;
   other.channels_ = 0;
+  other.bits_ = nullptr;
+  other.pitch_ = 0;
 }
 
 Bitmap::Bitmap(FIBITMAP* data) : Bitmap() { SetPtr(data); }
@@ -127,9 +273,13 @@ Bitmap& Bitmap::operator=(Bitmap&& other) noexcept {
     width_ = other.width_;
     height_ = other.height_;
     channels_ = other.channels_;
+    bits_ = other.bits_;
+    pitch_ = other.pitch_;
     other.width_ = 0;
     other.height_ = 0;
     other.channels_ = 0;
+    other.bits_ = nullptr;
+    other.pitch_ = 0;
   }
   return *this;
 }
@@ -148,6 +298,7 @@ bool Bitmap::Allocate(const int width, const int height, const bool as_rgb) {
         FreeImageHandle(FreeImage_Allocate(width, height, kNumBitsPerPixel));
     channels_ = 1;
   }
+  UpdateBits();
   return handle_.ptr != nullptr;
 }
 
@@ -156,6 +307,7 @@ void Bitmap::Deallocate() {
   width_ = 0;
   height_ = 0;
   channels_ = 0;
+  UpdateBits();
 }
 
 size_t Bitmap::NumBytes() const {
@@ -175,11 +327,17 @@ unsigned int Bitmap::ScanWidth() const {
 }
 
 std::vector<uint8_t> Bitmap::ConvertToRawBits() const {
+  std::vector<uint8_t> raw_bits;
+  ConvertToRawBits(&raw_bits);
+  return raw_bits;
+}
+
+void Bitmap::ConvertToRawBits(std::vector<uint8_t>* raw_bits) const {
   const unsigned int scan_width = ScanWidth();
   const unsigned int bpp = BitsPerPixel();
   const bool kTopDown = true;
-  std::vector<uint8_t> raw_bits(scan_width * height_, 0);
-  FreeImage_ConvertToRawBits(raw_bits.data(),
+  raw_bits->assign(scan_width * height_, 0);
+  FreeImage_ConvertToRawBits(raw_bits->data(),
                              handle_.ptr,
                              scan_width,
                              bpp,
@@ -187,20 +345,13 @@ std::vector<uint8_t> Bitmap::ConvertToRawBits() const {
                              FI_RGBA_GREEN_MASK,
                              FI_RGBA_BLUE_MASK,
                              kTopDown);
-  return raw_bits;
 }
 
 std::vector<uint8_t> Bitmap::ConvertToRowMajorArray() const {
   std::vector<uint8_t> array(width_ * height_ * channels_);
-  size_t i = 0;
+  const size_t row_size = width_ * channels_;
   for (int y = 0; y < height_; ++y) {
-    const uint8_t* line = FreeImage_GetScanLine(handle_.ptr, height_ - 1 - y);
-    for (int x = 0; x < width_; ++x) {
-      for (int d = 0; d < channels_; ++d) {
-        array[i] = line[x * channels_ + d];
-        i += 1;
-      }
-    }
+    std::copy(Row(y), Row(y) + row_size, array.data() + y * row_size);
   }
   return array;
 }
@@ -211,9 +362,7 @@ std::vector<uint8_t> Bitmap::ConvertToColMajorArray() const {
   for (int d = 0; d < channels_; ++d) {
     for (int x = 0; x < width_; ++x) {
       for (int y = 0; y < height_; ++y) {
-        const uint8_t* line =
-            FreeImage_GetScanLine(handle_.ptr, height_ - 1 - y);
-        array[i] = line[x * channels_ + d];
+        array[i] = Row(y)[x * channels_ + d];
         i += 1;
       }
     }
@@ -228,7 +377,7 @@ bool Bitmap::GetPixel(const int x,
     return false;
   }
 
-  const uint8_t* line = FreeImage_GetScanLine(handle_.ptr, height_ - 1 - y);
+  const uint8_t* line = Row(y);
 
   if (IsGrey()) {
     color->r = line[x];
@@ -250,7 +399,7 @@ bool Bitmap::SetPixel(const int x,
     return false;
   }
 
-  uint8_t* line = FreeImage_GetScanLine(handle_.ptr, height_ - 1 - y);
+  uint8_t* line = Row(y);
 
   if (IsGrey()) {
     line[x] = color.r;
@@ -268,16 +417,22 @@ bool Bitmap::SetPixel(const int x,
 const uint8_t* Bitmap::GetScanline(const int y) const {
   CHECK_GE(y, 0);
   CHECK_LT(y, height_);
-  return FreeImage_GetScanLine(handle_.ptr, height_ - 1 - y);
+  return Row(y);
+}
+
+uint8_t* Bitmap::GetScanline(const int y) {
+  CHECK_GE(y, 0);
+  CHECK_LT(y, height_);
+  return Row(y);
 }
 
 void Bitmap::Fill(const BitmapColor<uint8_t>& color) {
   for (int y = 0; y < height_; ++y) {
-    uint8_t* line = FreeImage_GetScanLine(handle_.ptr, height_ - 1 - y);
-    for (int x = 0; x < width_; ++x) {
-      if (IsGrey()) {
-        line[x] = color.r;
-      } else if (IsRGB()) {
+    uint8_t* line = Row(y);
+    if (IsGrey()) {
+      std::fill(line, line + width_, color.r);
+    } else if (IsRGB()) {
+      for (int x = 0; x < width_; ++x) {
         line[3 * x + FI_RGBA_RED] = color.r;
         line[3 * x + FI_RGBA_GREEN] = color.g;
         line[3 * x + FI_RGBA_BLUE] = color.b;
@@ -297,60 +452,25 @@ bool Bitmap::InterpolateNearestNeighbor(const double x,
 bool Bitmap::InterpolateBilinear(const double x,
                                  const double y,
                                  BitmapColor<float>* color) const {
-  // FreeImage's coordinate system origin is in the lower left of the image.
-  const double inv_y = height_ - 1 - y;
-
-  const int x0 = static_cast<int>(std::floor(x));
-  const int x1 = x0 + 1;
-  const int y0 = static_cast<int>(std::floor(inv_y));
-  const int y1 = y0 + 1;
-
-  if (x0 < 0 || x1 >= width_ || y0 < 0 || y1 >= height_) {
-    return false;
-  }
-
-  const double dx = x - x0;
-  const double dy = inv_y - y0;
-  const double dx_1 = 1 - dx;
-  const double dy_1 = 1 - dy;
-
-  const uint8_t* line0 = FreeImage_GetScanLine(handle_.ptr, y0);
-  const uint8_t* line1 = FreeImage_GetScanLine(handle_.ptr, y1);
-
-  if (IsGrey()) {
-    // Top row, column-wise linear interpolation.
-    const double v0 = dx_1 * line0[x0] + dx * line0[x1];
-
-    // Bottom row, column-wise linear interpolation.
-    const double v1 = dx_1 * line1[x0] + dx * line1[x1];
-
-    // Row-wise linear interpolation.
-    color->r = dy_1 * v0 + dy * v1;
-    return true;
-  } else if (IsRGB()) {
-    const uint8_t* p00 = &line0[3 * x0];
-    const uint8_t* p01 = &line0[3 * x1];
-    const uint8_t* p10 = &line1[3 * x0];
-    const uint8_t* p11 = &line1[3 * x1];
-
-    // Top row, column-wise linear interpolation.
-    const double v0_r = dx_1 * p00[FI_RGBA_RED] + dx * p01[FI_RGBA_RED];
-    const double v0_g = dx_1 * p00[FI_RGBA_GREEN] + dx * p01[FI_RGBA_GREEN];
-    const double v0_b = dx_1 * p00[FI_RGBA_BLUE] + dx * p01[FI_RGBA_BLUE];
-
-    // Bottom row, column-wise linear interpolation.
-    const double v1_r = dx_1 * p10[FI_RGBA_RED] + dx * p11[FI_RGBA_RED];
-    const double v1_g = dx_1 * p10[FI_RGBA_GREEN] + dx * p11[FI_RGBA_GREEN];
-    const double v1_b = dx_1 * p10[FI_RGBA_BLUE] + dx * p11[FI_RGBA_BLUE];
+  return InterpolateBilinearRows(
+      bits_, pitch_, width_, height_, channels_, x, y, color);
+}
 
-    // Row-wise linear interpolation.
-    color->r = dy_1 * v0_r + dy * v1_r;
-    color->g = dy_1 * v0_g + dy * v1_g;
-    color->b = dy_1 * v0_b + dy * v1_b;
-    return true;
+void Bitmap::InterpolateBilinear(const std::vector<Eigen::Vector2d>& points,
+                                 std::vector<BitmapColor<float>>* colors,
+                                 std::vector<char>* valid) const {
+  colors->resize(points.size());
+  valid->resize(points.size());
+  for (size_t i = 0; i < points.size(); ++i) {
+    (*valid)[i] = InterpolateBilinearRows(bits_,
+                                          pitch_,
+                                          width_,
+                                          height_,
+                                          channels_,
+                                          points[i].x(),
+                                          points[i].y(),
+                                          &(*colors)[i]);
   }
-
-  return false;
 }
 
 bool Bitmap::ExifCameraModel(std::string* camera_model) const {
@@ -558,6 +678,7 @@ bool Bitmap::Read(const std::string& path, const bool as_rgb) {
 
   handle_ = FreeImageHandle(FreeImage_Load(format, path.c_str()));
   if (handle_.ptr == nullptr) {
+    UpdateBits();
     return false;
   }
 
@@ -571,12 +692,14 @@ bool Bitmap::Read(const std::string& path, const bool as_rgb) {
 
   if (!IsPtrSupported(handle_.ptr)) {
     handle_ = FreeImageHandle();
+    UpdateBits();
     return false;
   }
 
   width_ = FreeImage_GetWidth(handle_.ptr);
   height_ = FreeImage_GetHeight(handle_.ptr);
   channels_ = as_rgb ? 3 : 1;
+  UpdateBits();
 
   return true;
 }
@@ -611,7 +734,7 @@ void Bitmap::Smooth(const float sigma_x, const float sigma_y) {
   for (int d = 0; d < channels_; ++d) {
     size_t i = 0;
     for (int y = 0; y < height_; ++y) {
-      const uint8_t* line = FreeImage_GetScanLine(handle_.ptr, height_ - 1 - y);
+      const uint8_t* line = Row(y);
       for (int x = 0; x < width_; ++x) {
         array[i] = line[x * channels_ + d];
         i += 1;
@@ -629,7 +752,7 @@ void Bitmap::Smooth(const float sigma_x, const float sigma_y) {
 
     i = 0;
     for (int y = 0; y < height_; ++y) {
-      uint8_t* line = FreeImage_GetScanLine(handle_.ptr, height_ - 1 - y);
+      uint8_t* line = Row(y);
       for (int x = 0; x < width_; ++x) {
         line[x * channels_ + d] =
             TruncateCast<float, uint8_t>(array_smoothed[i]);
@@ -642,18 +765,57 @@ void Bitmap::Smooth(const float sigma_x, const float sigma_y) {
 void Bitmap::Rescale(const int new_width,
                      const int new_height,
                      RescaleFilter filter) {
-  FREE_IMAGE_FILTER fi_filter = FILTER_BILINEAR;
-  switch (filter) {
-    case RescaleFilter::kBilinear:
-      fi_filter = FILTER_BILINEAR;
-      break;
-    case RescaleFilter::kBox:
-      fi_filter = FILTER_BOX;
-      break;
-    default:
-      LOG(FATAL) << "Filter not implemented";
+  CHECK_GT(new_width, 0);
+  CHECK_GT(new_height, 0);
+
+  const ResampleWeights col_weights =
+      ComputeResampleWeights(filter, width_, new_width);
+  const ResampleWeights row_weights =
+      ComputeResampleWeights(filter, height_, new_height);
+
+  // Resample the rows horizontally into an intermediate floating point image.
+  const size_t new_row_size = new_width * channels_;
+  std::vector<float> resampled_rows(height_ * new_row_size);
+  for (int y = 0; y < height_; ++y) {
+    const uint8_t* line = Row(y);
+    float* resampled_line = &resampled_rows[y * new_row_size];
+    for (int u = 0; u < new_width; ++u) {
+      const float* weights =
+          &col_weights.weights[u * col_weights.window_size];
+      for (int d = 0; d < channels_; ++d) {
+        float value = 0;
+        for (int x = col_weights.begin[u]; x < col_weights.end[u]; ++x) {
+          value += weights[x - col_weights.begin[u]] * line[x * channels_ + d];
+        }
+        resampled_line[u * channels_ + d] = value;
+      }
+    }
+  }
+
+  // Resample the columns vertically by accumulating entire rows, which the
+  // compiler vectorizes over the contiguous row elements.
+  Bitmap rescaled;
+  CHECK(rescaled.Allocate(new_width, new_height, IsRGB()));
+  std::vector<float> accum_line(new_row_size);
+  for (int v = 0; v < new_height; ++v) {
+    std::fill(accum_line.begin(), accum_line.end(), 0.0f);
+    const float* weights = &row_weights.weights[v * row_weights.window_size];
+    for (int y = row_weights.begin[v]; y < row_weights.end[v]; ++y) {
+      const float weight = weights[y - row_weights.begin[v]];
+      const float* resampled_line = &resampled_rows[y * new_row_size];
+      for (size_t i = 0; i < new_row_size; ++i) {
+        accum_line[i] += weight * resampled_line[i];
+      }
+    }
+    uint8_t* line = rescaled.Row(v);
+    for (size_t i = 0; i < new_row_size; ++i) {
+      line[i] = static_cast<uint8_t>(
+          std::min(255.0f, std::max(0.0f, accum_line[i] + 0.5f)));
+    }
   }
-  SetPtr(FreeImage_Rescale(handle_.ptr, new_width, new_height, fi_filter));
+
+  CloneMetadata(&rescaled);
+  *this = std::move(rescaled);
 }
 
 Bitmap Bitmap::Clone() const {
@@ -664,9 +826,23 @@ Bitmap Bitmap::Clone() const {
 Bitmap Bitmap::CloneAsGrey() const {
   if (IsGrey()) {
     return Clone();
-  } else {
-    return Bitmap(FreeImage_ConvertToGreyscale(handle_.ptr));
   }
+
+  // Convert with the Rec. 709 luma weights, as FreeImage does.
+  Bitmap grey;
+  CHECK(grey.Allocate(width_, height_, /*as_rgb=*/false));
+  for (int y = 0; y < height_; ++y) {
+    const uint8_t* line = Row(y);
+    uint8_t* grey_line = grey.Row(y);
+    for (int x = 0; x < width_; ++x) {
+      grey_line[x] =
+          static_cast<uint8_t>(0.2126f * line[3 * x + FI_RGBA_RED] +
+                               0.7152f * line[3 * x + FI_RGBA_GREEN] +
+                               0.0722f * line[3 * x + FI_RGBA_BLUE] + 0.5f);
+    }
+  }
+  CloneMetadata(&grey);
+  return grey;
 }
 
 Bitmap Bitmap::CloneAsRGB() const {
@@ -677,6 +853,26 @@ Bitmap Bitmap::CloneAsRGB() const {
   }
 }
 
+Bitmap Bitmap::Crop(const int x,
+                    const int y,
+                    const int width,
+                    const int height) const {
+  CHECK_GE(x, 0);
+  CHECK_GE(y, 0);
+  CHECK_GT(width, 0);
+  CHECK_GT(height, 0);
+  CHECK_LE(x + width, width_);
+  CHECK_LE(y + height, height_);
+
+  Bitmap cropped;
+  CHECK(cropped.Allocate(width, height, IsRGB()));
+  for (int row = 0; row < height; ++row) {
+    const uint8_t* line = Row(y + row) + x * channels_;
+    std::copy(line, line + width * channels_, cropped.Row(row));
+  }
+  return cropped;
+}
+
 void Bitmap::CloneMetadata(Bitmap* target) const {
   CHECK_NOTNULL(target);
   CHECK_NOTNULL(target->Data());
@@ -696,6 +892,17 @@ void Bitmap::SetPtr(FIBITMAP* ptr) {
   width_ = FreeImage_GetWidth(handle_.ptr);
   height_ = FreeImage_GetHeight(handle_.ptr);
   channels_ = IsPtrRGB(handle_.ptr) ? 3 : 1;
+  UpdateBits();
+}
+
+void Bitmap::UpdateBits() {
+  if (handle_.ptr == nullptr) {
+    bits_ = nullptr;
+    pitch_ = 0;
+  } else {
+    bits_ = FreeImage_GetBits(handle_.ptr);
+    pitch_ = FreeImage_GetPitch(handle_.ptr);
+  }
 }
 
 Bitmap::FreeImageHandle::FreeImageHandle() : ptr(nullptr) {}
@@ -29,6 +29,7 @@
 
 #pragma once
 
+#include "colmap/util/eigen_alignment.h"
 #include "colmap/util/string.h"
 
 #include <algorithm>
@@ -39,6 +40,8 @@
 #include <string>
 #include <vector>
 
+#include <Eigen/Core>
+
 struct FIBITMAP;
 
 namespace colmap {
@@ -65,7 +68,9 @@ struct BitmapColor {
   T b;
 };
 
-// Wrapper class around FreeImage bitmaps.
+// Wrapper class around FreeImage bitmaps. FreeImage is only used for reading,
+// writing, and metadata, while pixel access, conversion, interpolation, and
+// resampling operate directly on the contiguous pixel buffer.
 class Bitmap {
  public:
   Bitmap();
@@ -113,8 +118,10 @@ class Bitmap {
   // Number of bytes required to store image.
   size_t NumBytes() const;
 
-  // Copy raw image data to array.
+  // Copy raw image data to array. The overload with an output argument reuses
+  // the memory of the given array, e.g., when converting many images.
   std::vector<uint8_t> ConvertToRawBits() const;
+  void ConvertToRawBits(std::vector<uint8_t>* raw_bits) const;
   std::vector<uint8_t> ConvertToRowMajorArray() const;
   std::vector<uint8_t> ConvertToColMajorArray() const;
 
@@ -125,6 +132,7 @@ class Bitmap {
 
   // Get pointer to y-th scanline, where the 0-th scanline is at the top.
   const uint8_t* GetScanline(int y) const;
+  uint8_t* GetScanline(int y);
 
   // Fill entire bitmap with uniform color. For grayscale images, the first
   // element of the vector is used.
@@ -136,6 +144,13 @@ class Bitmap {
                                   BitmapColor<uint8_t>* color) const;
   bool InterpolateBilinear(double x, double y, BitmapColor<float>* color) const;
 
+  // Interpolate the colors at a batch of positions, which is equivalent to but
+  // faster than the single-position overload. Positions outside the image are
+  // marked as invalid and their colors are left undefined.
+  void InterpolateBilinear(const std::vector<Eigen::Vector2d>& points,
+                           std::vector<BitmapColor<float>>* colors,
+                           std::vector<char>* valid) const;
+
   // Extract EXIF information from bitmap. Returns false if no EXIF information
   // is embedded in the bitmap.
   bool ExifCameraModel(std::string* camera_model) const;
@@ -154,7 +169,8 @@ class Bitmap {
   // Smooth the image using a Gaussian kernel.
   void Smooth(float sigma_x, float sigma_y);
 
-  // Rescale image to the new dimensions.
+  // Rescale image to the new dimensions with a separable filter, which is
+  // widened when downsampling to avoid aliasing.
   enum class RescaleFilter {
     kBilinear,
     kBox,
@@ -168,6 +184,10 @@ class Bitmap {
   Bitmap CloneAsGrey() const;
   Bitmap CloneAsRGB() const;
 
+  // Crop the region of the given size with the top-left pixel (x, y) to a new
+  // bitmap object. The region must lie inside the image.
+  Bitmap Crop(int x, int y, int width, int height) const;
+
   // Clone metadata from this bitmap object to another target bitmap object.
   void CloneMetadata(Bitmap* target) const;
 
@@ -185,10 +205,20 @@ class Bitmap {
 
   void SetPtr(FIBITMAP* ptr);
 
+  // Update the cached pixel buffer of the FreeImage bitmap.
+  void UpdateBits();
+
+  // Get pointer to y-th row, where the 0-th row is at the top. FreeImage
+  // stores the rows bottom-up with a stride of the scan width.
+  inline const uint8_t* Row(int y) const;
+  inline uint8_t* Row(int y);
+
   FreeImageHandle handle_;
   int width_;
   int height_;
   int channels_;
+  uint8_t* bits_;
+  size_t pitch_;
 };
 
 // Jet colormap inspired by Matlab. Grayvalues are expected in the range [0, 1]
@@ -269,4 +299,12 @@ bool Bitmap::IsRGB() const { return channels_ == 3; }
 
 bool Bitmap::IsGrey() const { return channels_ == 1; }
 
+const uint8_t* Bitmap::Row(const int y) const {
+  return bits_ + (height_ - 1 - y) * pitch_;
+}
+
+uint8_t* Bitmap::Row(const int y) {
+  return bits_ + (height_ - 1 - y) * pitch_;
+}
+
 }  // namespace colmap
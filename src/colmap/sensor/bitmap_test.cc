@@ -231,6 +231,24 @@ TEST(Bitmap, ConvertToColMajorArrayGrey) {
   EXPECT_EQ(array[3], 3);
 }
 
+TEST(Bitmap, ConvertToRawBitsGrey) {
+  Bitmap bitmap;
+  bitmap.Allocate(2, 2, false);
+  bitmap.SetPixel(0, 0, BitmapColor<uint8_t>(0, 0, 0));
+  bitmap.SetPixel(0, 1, BitmapColor<uint8_t>(1, 0, 0));
+  bitmap.SetPixel(1, 0, BitmapColor<uint8_t>(2, 0, 0));
+  bitmap.SetPixel(1, 1, BitmapColor<uint8_t>(3, 0, 0));
+  const std::vector<uint8_t> raw_bits = bitmap.ConvertToRawBits();
+  EXPECT_EQ(raw_bits.size(), bitmap.ScanWidth() * 2);
+  EXPECT_EQ(raw_bits[0], 0);
+  EXPECT_EQ(raw_bits[1], 2);
+  EXPECT_EQ(raw_bits[bitmap.ScanWidth()], 1);
+  EXPECT_EQ(raw_bits[bitmap.ScanWidth() + 1], 3);
+  std::vector<uint8_t> reused_raw_bits(100, 255);
+  bitmap.ConvertToRawBits(&reused_raw_bits);
+  EXPECT_EQ(reused_raw_bits, raw_bits);
+}
+
 TEST(Bitmap, GetAndSetPixelRGB) {
   Bitmap bitmap;
   bitmap.Allocate(1, 1, true);
@@ -282,6 +300,18 @@ TEST(Bitmap, GetScanlineGrey) {
   }
 }
 
+TEST(Bitmap, WriteScanline) {
+  Bitmap bitmap;
+  bitmap.Allocate(3, 2, false);
+  bitmap.Fill(BitmapColor<uint8_t>(0));
+  bitmap.GetScanline(1)[2] = 7;
+  BitmapColor<uint8_t> color;
+  EXPECT_TRUE(bitmap.GetPixel(2, 1, &color));
+  EXPECT_EQ(color.r, 7);
+  EXPECT_TRUE(bitmap.GetPixel(2, 0, &color));
+  EXPECT_EQ(color.r, 0);
+}
+
 TEST(Bitmap, Fill) {
   Bitmap bitmap;
   bitmap.Allocate(100, 100, true);
@@ -325,6 +355,33 @@ TEST(Bitmap, InterpolateBilinear) {
   EXPECT_EQ(color, BitmapColor<float>(0.25, 0.5, 0.75));
 }
 
+TEST(Bitmap, InterpolateBilinearBatch) {
+  Bitmap bitmap;
+  bitmap.Allocate(11, 11, true);
+  bitmap.Fill(BitmapColor<uint8_t>(0, 0, 0));
+  bitmap.SetPixel(5, 5, BitmapColor<uint8_t>(1, 2, 3));
+  const std::vector<Eigen::Vector2d> points = {Eigen::Vector2d(5, 5),
+                                               Eigen::Vector2d(5.5, 5.5),
+                                               Eigen::Vector2d(-1, 5),
+                                               Eigen::Vector2d(4.2, 6.7),
+                                               Eigen::Vector2d(10, 5)};
+  std::vector<BitmapColor<float>> colors;
+  std::vector<char> valid;
+  bitmap.InterpolateBilinear(points, &colors, &valid);
+  ASSERT_EQ(colors.size(), points.size());
+  ASSERT_EQ(valid.size(), points.size());
+  for (size_t i = 0; i < points.size(); ++i) {
+    BitmapColor<float> color;
+    EXPECT_EQ(valid[i],
+              bitmap.InterpolateBilinear(points[i].x(), points[i].y(), &color));
+    if (valid[i]) {
+      EXPECT_EQ(colors[i], color);
+    }
+  }
+  EXPECT_FALSE(valid[2]);
+  EXPECT_FALSE(valid[4]);
+}
+
 TEST(Bitmap, SmoothRGB) {
   Bitmap bitmap;
   bitmap.Allocate(50, 50, true);
@@ -393,6 +450,74 @@ TEST(Bitmap, RescaleGrey) {
   EXPECT_EQ(bitmap2.Channels(), 1);
 }
 
+TEST(Bitmap, RescaleUniform) {
+  for (const bool as_rgb : {true, false}) {
+    for (const auto filter :
+         {Bitmap::RescaleFilter::kBilinear, Bitmap::RescaleFilter::kBox}) {
+      Bitmap bitmap;
+      bitmap.Allocate(40, 30, as_rgb);
+      bitmap.Fill(BitmapColor<uint8_t>(10, 20, 30));
+      for (const auto& size : {std::make_pair(13, 7),
+                               std::make_pair(40, 30),
+                               std::make_pair(97, 61)}) {
+        Bitmap rescaled = bitmap.Clone();
+        rescaled.Rescale(size.first, size.second, filter);
+        for (int y = 0; y < size.second; ++y) {
+          for (int x = 0; x < size.first; ++x) {
+            BitmapColor<uint8_t> color;
+            EXPECT_TRUE(rescaled.GetPixel(x, y, &color));
+            EXPECT_EQ(color.r, 10);
+            if (as_rgb) {
+              EXPECT_EQ(color.g, 20);
+              EXPECT_EQ(color.b, 30);
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+TEST(Bitmap, RescaleBox) {
+  // Downsampling by a factor of two with the box filter averages 2x2 blocks.
+  Bitmap bitmap;
+  bitmap.Allocate(4, 2, false);
+  bitmap.SetPixel(0, 0, BitmapColor<uint8_t>(0));
+  bitmap.SetPixel(1, 0, BitmapColor<uint8_t>(4));
+  bitmap.SetPixel(0, 1, BitmapColor<uint8_t>(8));
+  bitmap.SetPixel(1, 1, BitmapColor<uint8_t>(12));
+  bitmap.SetPixel(2, 0, BitmapColor<uint8_t>(100));
+  bitmap.SetPixel(3, 0, BitmapColor<uint8_t>(100));
+  bitmap.SetPixel(2, 1, BitmapColor<uint8_t>(200));
+  bitmap.SetPixel(3, 1, BitmapColor<uint8_t>(200));
+  bitmap.Rescale(2, 1, Bitmap::RescaleFilter::kBox);
+  BitmapColor<uint8_t> color;
+  EXPECT_TRUE(bitmap.GetPixel(0, 0, &color));
+  EXPECT_EQ(color.r, 6);
+  EXPECT_TRUE(bitmap.GetPixel(1, 0, &color));
+  EXPECT_EQ(color.r, 150);
+}
+
+TEST(Bitmap, RescaleBilinearUpsample) {
+  // Upsampling a gradient keeps it monotonic within the original range.
+  Bitmap bitmap;
+  bitmap.Allocate(10, 1, false);
+  for (int x = 0; x < 10; ++x) {
+    bitmap.SetPixel(x, 0, BitmapColor<uint8_t>(20 * x));
+  }
+  bitmap.Rescale(40, 3);
+  for (int y = 0; y < 3; ++y) {
+    BitmapColor<uint8_t> prev_color(0);
+    for (int x = 0; x < 40; ++x) {
+      BitmapColor<uint8_t> color;
+      EXPECT_TRUE(bitmap.GetPixel(x, y, &color));
+      EXPECT_GE(color.r, prev_color.r);
+      EXPECT_LE(color.r, 180);
+      prev_color = color;
+    }
+  }
+}
+
 TEST(Bitmap, Clone) {
   Bitmap bitmap;
   bitmap.Allocate(100, 100, true);
@@ -403,6 +528,28 @@ TEST(Bitmap, Clone) {
   EXPECT_NE(bitmap.Data(), cloned_bitmap.Data());
 }
 
+TEST(Bitmap, Crop) {
+  Bitmap bitmap;
+  bitmap.Allocate(10, 8, true);
+  for (int y = 0; y < 8; ++y) {
+    for (int x = 0; x < 10; ++x) {
+      bitmap.SetPixel(x, y, BitmapColor<uint8_t>(x, y, x + y));
+    }
+  }
+
+  const Bitmap cropped_bitmap = bitmap.Crop(2, 3, 5, 4);
+  EXPECT_EQ(cropped_bitmap.Width(), 5);
+  EXPECT_EQ(cropped_bitmap.Height(), 4);
+  EXPECT_EQ(cropped_bitmap.Channels(), 3);
+  for (int y = 0; y < 4; ++y) {
+    for (int x = 0; x < 5; ++x) {
+      BitmapColor<uint8_t> color;
+      EXPECT_TRUE(cropped_bitmap.GetPixel(x, y, &color));
+      EXPECT_EQ(color, BitmapColor<uint8_t>(x + 2, y + 3, x + y + 5));
+    }
+  }
+}
+
 TEST(Bitmap, CloneAsRGB) {
   Bitmap bitmap;
   bitmap.Allocate(100, 100, false);
@@ -423,6 +570,21 @@ TEST(Bitmap, CloneAsGrey) {
   EXPECT_NE(bitmap.Data(), cloned_bitmap.Data());
 }
 
+TEST(Bitmap, CloneAsGreyValues) {
+  Bitmap bitmap;
+  bitmap.Allocate(3, 2, true);
+  bitmap.Fill(BitmapColor<uint8_t>(0, 0, 0));
+  bitmap.SetPixel(0, 0, BitmapColor<uint8_t>(255, 0, 0));
+  bitmap.SetPixel(1, 0, BitmapColor<uint8_t>(0, 255, 0));
+  bitmap.SetPixel(2, 0, BitmapColor<uint8_t>(0, 0, 255));
+  bitmap.SetPixel(0, 1, BitmapColor<uint8_t>(255, 255, 255));
+  bitmap.SetPixel(1, 1, BitmapColor<uint8_t>(100, 150, 200));
+  const Bitmap grey_bitmap = bitmap.CloneAsGrey();
+  // Rec. 709 luma weights.
+  EXPECT_EQ(grey_bitmap.ConvertToRowMajorArray(),
+            std::vector<uint8_t>({54, 182, 18, 255, 143, 0}));
+}
+
 TEST(Bitmap, ReadWriteAsRGB) {
   Bitmap bitmap;
   bitmap.Allocate(2, 3, true);
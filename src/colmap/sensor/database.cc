@@ -33,7 +33,17 @@
 
 namespace colmap {
 
-const camera_specs_t CameraDatabase::specs_ = InitializeCameraSpecs();
+size_t CameraDatabase::NumEntries() const {
+  // The models of a make are contiguous.
+  size_t num_makes = 0;
+  for (size_t i = 0; i < kNumCameraSpecs; ++i) {
+    if (i == 0 ||
+        std::string(kCameraSpecs[i].make) != kCameraSpecs[i - 1].make) {
+      ++num_makes;
+    }
+  }
+  return num_makes;
+}
 
 bool CameraDatabase::QuerySensorWidth(const std::string& make,
                                       const std::string& model,
@@ -54,14 +64,24 @@ bool CameraDatabase::QuerySensorWidth(const std::string& make,
   // Check if cleaned_make exists in database: Test whether EXIF string is
   // substring of database entry and vice versa.
   size_t spec_matches = 0;
-  for (const auto& make_elem : specs_) {
-    if (StringContains(cleaned_make, make_elem.first) ||
-        StringContains(make_elem.first, cleaned_make)) {
-      for (const auto& model_elem : make_elem.second) {
-        if (StringContains(cleaned_model, model_elem.first) ||
-            StringContains(model_elem.first, cleaned_model)) {
-          *sensor_width = model_elem.second;
-          if (cleaned_model == model_elem.first) {
+  size_t make_end = 0;
+  for (size_t make_begin = 0; make_begin < kNumCameraSpecs;
+       make_begin = make_end) {
+    const std::string spec_make = kCameraSpecs[make_begin].make;
+    make_end = make_begin + 1;
+    while (make_end < kNumCameraSpecs &&
+           spec_make == kCameraSpecs[make_end].make) {
+      ++make_end;
+    }
+
+    if (StringContains(cleaned_make, spec_make) ||
+        StringContains(spec_make, cleaned_make)) {
+      for (size_t i = make_begin; i < make_end; ++i) {
+        const std::string spec_model = kCameraSpecs[i].model;
+        if (StringContains(cleaned_model, spec_model) ||
+            StringContains(spec_model, cleaned_model)) {
+          *sensor_width = kCameraSpecs[i].sensor_width;
+          if (cleaned_model == spec_model) {
             // Model exactly matches, return immediately.
             return true;
           }
@@ -41,14 +41,15 @@ struct CameraDatabase {
  public:
   CameraDatabase() = default;
 
-  size_t NumEntries() const { return specs_.size(); }
+  // Number of camera makes in the database.
+  size_t NumEntries() const;
+
+  // Number of camera models over all makes in the database.
+  size_t NumModels() const { return kNumCameraSpecs; }
 
   bool QuerySensorWidth(const std::string& make,
                         const std::string& model,
                         double* sensor_width);
-
- private:
-  static const camera_specs_t specs_;
 };
 
 }  // namespace colmap
@@ -29,6 +29,8 @@
 
 #include "colmap/sensor/database.h"
 
+#include <set>
+
 #include <gtest/gtest.h>
 
 namespace colmap {
@@ -36,8 +38,17 @@ namespace {
 
 TEST(CameraDatabase, Initialization) {
   CameraDatabase database;
-  camera_specs_t specs = InitializeCameraSpecs();
-  EXPECT_EQ(database.NumEntries(), specs.size());
+  EXPECT_EQ(database.NumModels(), kNumCameraSpecs);
+
+  // The models of a make must be contiguous.
+  std::set<std::string> makes;
+  for (size_t i = 0; i < kNumCameraSpecs; ++i) {
+    if (i == 0 ||
+        std::string(kCameraSpecs[i].make) != kCameraSpecs[i - 1].make) {
+      EXPECT_TRUE(makes.insert(kCameraSpecs[i].make).second);
+    }
+  }
+  EXPECT_EQ(database.NumEntries(), makes.size());
 }
 
 TEST(CameraDatabase, ExactMatch) {
@@ -1,6 +1,10 @@
 #include "colmap/sensor/models_refrac.h"
 
+#include <algorithm>
+#include <cmath>
+#include <limits>
 #include <unordered_map>
+#include <utility>
 
 namespace colmap {
 
@@ -16,7 +20,22 @@ namespace colmap {
   const std::vector<size_t> CameraRefracModel::optimizable_params_idxs = \
       CameraRefracModel::InitializeOptimizableParamsIdxs();
 
-CAMERA_REFRAC_MODEL_CASES
+CAMERA_REFRAC_MODEL_NON_TEMPLATE_CASES
+
+#undef CAMERA_REFRAC_MODEL_CASE
+
+#define CAMERA_REFRAC_MODEL_CASE(CameraRefracModel)                      \
+  template <>                                                            \
+  const std::string CameraRefracModel::refrac_model_name =               \
+      CameraRefracModel::InitializeRefracModelName();                    \
+  template <>                                                            \
+  const std::string CameraRefracModel::refrac_params_info =              \
+      CameraRefracModel::InitializeRefracParamsInfo();                   \
+  template <>                                                            \
+  const std::vector<size_t> CameraRefracModel::optimizable_params_idxs = \
+      CameraRefracModel::InitializeOptimizableParamsIdxs();
+
+CAMERA_REFRAC_MODEL_TEMPLATE_CASES
 
 #undef CAMERA_REFRAC_MODEL_CASE
 
@@ -153,4 +172,277 @@ bool CameraRefracModelVerifyParams(const CameraRefracModelId refrac_model_id,
   return false;
 }
 
-}  // namespace colmap
\ No newline at end of file
+namespace {
+
+// Solve for the sine `s` of the incidence angle in air of the ray refracted
+// through the interface, such that it hits the point at radial distance `r`.
+// The air, glass and water layers have the axial extents `a`, `t`, `b`.
+// The radial offset r(s) = sum_m l_m * tan(theta_m) with
+// sin(theta_m) = na / n_m * s is monotonically increasing and convex in s.
+bool SolveFlatPortSine(const double na,
+                       const double ng,
+                       const double nw,
+                       const double a,
+                       const double t,
+                       const double b,
+                       const double r,
+                       double* s) {
+  const double kg = na / ng;
+  const double kw = na / nw;
+
+  // Upper bound of the sine beyond which total internal reflection occurs.
+  const double s_max = std::min({1.0, 1.0 / kg, 1.0 / kw});
+
+  const auto Evaluate = [&](const double s, double* f, double* df) {
+    *f = -r;
+    *df = 0;
+    for (const auto& layer : {std::make_pair(a, 1.0),
+                              std::make_pair(t, kg),
+                              std::make_pair(b, kw)}) {
+      const double k_s = layer.second * s;
+      const double cos_sq = 1 - k_s * k_s;
+      const double cos_theta = std::sqrt(cos_sq);
+      *f += layer.first * k_s / cos_theta;
+      *df += layer.first * layer.second / (cos_sq * cos_theta);
+    }
+  };
+
+  double s_min = 0;
+  double s_upper = s_max;
+  *s = std::min(r / std::sqrt(r * r + (a + t + b) * (a + t + b)), 0.5 * s_max);
+
+  const int kMaxNumIterations = 100;
+  const double kMaxStepSize = 1e-15;
+  for (int i = 0; i < kMaxNumIterations; ++i) {
+    double f, df;
+    Evaluate(*s, &f, &df);
+    if (f > 0) {
+      s_upper = *s;
+    } else {
+      s_min = *s;
+    }
+
+    double s_next = *s - f / df;
+    if (!(s_next > s_min && s_next < s_upper)) {
+      // Fall back to bisection if the Newton step leaves the bracket.
+      s_next = 0.5 * (s_min + s_upper);
+    }
+
+    const double step = std::abs(s_next - *s);
+    *s = s_next;
+    if (step < kMaxStepSize) {
+      return true;
+    }
+  }
+
+  return std::isfinite(*s);
+}
+
+}  // namespace
+
+bool FlatPortAxialNormalizedFromCam(const double* refrac_params,
+                                    const double u,
+                                    const double v,
+                                    const double w,
+                                    double* nu,
+                                    double* nv) {
+  const double kMaxAxisDeviation = 1e-10;
+  if (std::abs(refrac_params[0]) > kMaxAxisDeviation ||
+      std::abs(refrac_params[1]) > kMaxAxisDeviation ||
+      refrac_params[2] <= 0) {
+    return false;
+  }
+
+  const double int_dist = refrac_params[3];
+  const double int_thick = refrac_params[4];
+  const double na = refrac_params[5];
+  const double ng = refrac_params[6];
+  const double nw = refrac_params[7];
+
+  // The point must lie beyond the outer surface of the interface, otherwise
+  // the ray is not refracted consistently with `FlatPort::CamFromImgPoint`.
+  const double dist_water = w - int_dist - int_thick;
+  if (int_dist <= 0 || int_thick < 0 || dist_water <= 0) {
+    return false;
+  }
+
+  const double r = std::sqrt(u * u + v * v);
+  if (r < std::numeric_limits<double>::epsilon()) {
+    *nu = 0;
+    *nv = 0;
+    return true;
+  }
+
+  double s;
+  if (!SolveFlatPortSine(na, ng, nw, int_dist, int_thick, dist_water, r, &s)) {
+    return false;
+  }
+  const double tan_air = s / std::sqrt(1 - s * s);
+
+  *nu = tan_air * u / r;
+  *nv = tan_air * v / r;
+  return true;
+}
+
+namespace {
+
+// Outward unit normals of the sphere at the given points on its surface.
+Eigen::ArrayX3d SphereNormalsBatch(const Eigen::ArrayX3d& points,
+                                   const Eigen::Vector3d& center) {
+  Eigen::ArrayX3d normals = points.rowwise() - center.transpose().array();
+  const Eigen::ArrayXd norms = normals.square().rowwise().sum().sqrt();
+  normals.colwise() /= norms;
+  return normals;
+}
+
+// Replace the rays with an intersection by the corresponding refracted rays
+// and leave the remaining rays unchanged.
+void SelectRefractedRays(const Eigen::Array<bool, Eigen::Dynamic, 1>& mask,
+                         Ray3DBatch&& refracted,
+                         Ray3DBatch* rays) {
+  if (mask.all()) {
+    *rays = std::move(refracted);
+    return;
+  }
+  rays->oris = mask.replicate(1, 3).select(refracted.oris, rays->oris);
+  rays->dirs = mask.replicate(1, 3).select(refracted.dirs, rays->dirs);
+}
+
+}  // namespace
+
+void FlatPort::RefractRayBatch(const double* refrac_params, Ray3DBatch* rays) {
+  const Eigen::Vector3d int_normal(
+      refrac_params[0], refrac_params[1], refrac_params[2]);
+
+  const double int_dist = refrac_params[3];
+  const double int_thick = refrac_params[4];
+  const double na = refrac_params[5];
+  const double ng = refrac_params[6];
+  const double nw = refrac_params[7];
+
+  Eigen::ArrayXd d;
+  Eigen::Array<bool, Eigen::Dynamic, 1> is_intersect;
+  RayPlaneIntersectionBatch(
+      rays->oris, rays->dirs, int_normal, int_dist, &d, &is_intersect);
+
+  Ray3DBatch refracted = *rays;
+  refracted.oris += refracted.dirs.colwise() * d;
+  ComputeRefractionBatch(int_normal, na, ng, &refracted.dirs);
+
+  Eigen::Array<bool, Eigen::Dynamic, 1> is_intersect_outer;
+  RayPlaneIntersectionBatch(refracted.oris,
+                            refracted.dirs,
+                            int_normal,
+                            int_dist + int_thick,
+                            &d,
+                            &is_intersect_outer);
+  refracted.oris += refracted.dirs.colwise() * d;
+  ComputeRefractionBatch(int_normal, ng, nw, &refracted.dirs);
+
+  // The back-projected rays without intersection with the planar interface
+  // are not refracted, same as in `RefractRay`. Rays through the inner plane
+  // always hit the parallel outer plane, such that the outer mask only drops
+  // degenerate rays, for which the refracted ray is undefined.
+  SelectRefractedRays(
+      is_intersect && is_intersect_outer, std::move(refracted), rays);
+}
+
+void DomePort::RefractRayBatch(const double* refrac_params, Ray3DBatch* rays) {
+  if (IsCentered(refrac_params)) {
+    return;
+  }
+
+  const Eigen::Vector3d sphere_center(
+      refrac_params[0], refrac_params[1], refrac_params[2]);
+  const double int_radius = refrac_params[3];
+  const double int_thick = refrac_params[4];
+  const double na = refrac_params[5];
+  const double ng = refrac_params[6];
+  const double nw = refrac_params[7];
+
+  Eigen::ArrayXd dmin, dmax;
+  Eigen::Array<bool, Eigen::Dynamic, 1> is_intersect;
+  RaySphereIntersectionBatch(rays->oris,
+                             rays->dirs,
+                             sphere_center,
+                             int_radius,
+                             &dmin,
+                             &dmax,
+                             &is_intersect);
+
+  Ray3DBatch refracted = *rays;
+  refracted.oris += refracted.dirs.colwise() * dmax;
+  ComputeRefractionBatch(SphereNormalsBatch(refracted.oris, sphere_center),
+                         na,
+                         ng,
+                         &refracted.dirs);
+
+  Eigen::Array<bool, Eigen::Dynamic, 1> is_intersect_outer;
+  RaySphereIntersectionBatch(refracted.oris,
+                             refracted.dirs,
+                             sphere_center,
+                             int_radius + int_thick,
+                             &dmin,
+                             &dmax,
+                             &is_intersect_outer);
+  refracted.oris += refracted.dirs.colwise() * dmax;
+  ComputeRefractionBatch(SphereNormalsBatch(refracted.oris, sphere_center),
+                         ng,
+                         nw,
+                         &refracted.dirs);
+
+  // The back-projected rays without intersection with the spherical interface
+  // are not refracted, same as in `RefractRay`. Rays from inside the inner
+  // sphere always hit the enclosing outer sphere, such that the outer mask
+  // only drops degenerate rays, for which the refracted ray is undefined.
+  SelectRefractedRays(
+      is_intersect && is_intersect_outer, std::move(refracted), rays);
+}
+
+template <int kNumLayers>
+void MultiLayerFlatPort<kNumLayers>::RefractRayBatch(
+    const double* refrac_params, Ray3DBatch* rays) {
+  const Eigen::Vector3d int_normal(
+      refrac_params[0], refrac_params[1], refrac_params[2]);
+  double int_dist = refrac_params[3];
+  const double* int_thicks = refrac_params + 4;
+  const double* ns = refrac_params + 4 + kNumLayers;
+
+  Eigen::ArrayXd d;
+  Eigen::Array<bool, Eigen::Dynamic, 1> is_intersect;
+  RayPlaneIntersectionBatch(
+      rays->oris, rays->dirs, int_normal, int_dist, &d, &is_intersect);
+
+  Ray3DBatch refracted = *rays;
+  refracted.oris += refracted.dirs.colwise() * d;
+  ComputeRefractionBatch(int_normal, ns[0], ns[1], &refracted.dirs);
+
+  Eigen::Array<bool, Eigen::Dynamic, 1> is_intersect_outer;
+  for (int i = 1; i <= kNumLayers; ++i) {
+    int_dist += int_thicks[i - 1];
+    RayPlaneIntersectionBatch(refracted.oris,
+                              refracted.dirs,
+                              int_normal,
+                              int_dist,
+                              &d,
+                              &is_intersect_outer);
+    is_intersect = is_intersect && is_intersect_outer;
+    refracted.oris += refracted.dirs.colwise() * d;
+    ComputeRefractionBatch(int_normal, ns[i], ns[i + 1], &refracted.dirs);
+  }
+
+  // The back-projected rays without intersection with the planar interface
+  // are not refracted, same as in `RefractRay`. Rays through the inner plane
+  // always hit the parallel outer planes, such that the outer masks only drop
+  // degenerate rays, for which the refracted ray is undefined.
+  SelectRefractedRays(is_intersect, std::move(refracted), rays);
+}
+
+#define CAMERA_REFRAC_MODEL_CASE(CameraRefracModel) \
+  template void CameraRefracModel::RefractRayBatch(const double*, Ray3DBatch*);
+
+CAMERA_REFRAC_MODEL_TEMPLATE_CASES
+
+#undef CAMERA_REFRAC_MODEL_CASE
+
+}  // namespace colmap
@@ -2,6 +2,10 @@
 
 #include "colmap/sensor/models.h"
 #include "colmap/sensor/ray3d.h"
+#include "colmap/util/tracing.h"
+
+#include <algorithm>
+#include <type_traits>
 
 namespace colmap {
 
@@ -12,8 +16,9 @@ namespace colmap {
 //  1. Add a new struct in this file which implements all the necessary methods.
 //  2. Define an unique refrac_model_name and refrac_model_id for the refractive
 //  camera model.
-//  3. Add refractive camera model to `CAMERA_REFRAC_MODEL_CASES` macro in this
-//  file.
+//  3. Add refractive camera model to `CAMERA_REFRAC_MODEL_NON_TEMPLATE_CASES`
+//  macro in this file, or to `CAMERA_REFRAC_MODEL_TEMPLATE_CASES` for
+//  specializations of a class template such as `MultiLayerFlatPort`.
 //  4. Add new template specialization of test case for refractive camera model
 //  to
 //     `models_refrac_test.cc`.
@@ -35,6 +40,11 @@ namespace colmap {
 //  - `CamFromImgPoint`: transform image coordinates to camera
 //    coordinates (the inverse of `ImgFromCam`) given a depth `d`. Produces
 //    camera coordinates as (u, v, w).
+//  - `RefractRay`: refract a ray starting at the camera center with the given
+//    direction through the interface. Produces the origin and direction of
+//    the refracted ray in camera coordinates.
+//  - `RefractRayBatch`: batched variant of `RefractRay` for double precision,
+//    which traces all rays of a `Ray3DBatch` at once.
 //
 // Whenever you specify the refractive camera parameters in a list, they must
 // appear exactly in the order as they are accessed in the defined model struct.
@@ -48,6 +58,8 @@ enum class CameraRefracModelId {
   kInvalid = -1,
   kFlatPort = 0,
   kDomePort = 1,
+  kFlatPort2L = 2,
+  kFlatPort3L = 3,
 };
 
 #ifndef CAMERA_REFRAC_MODEL_DEFINITIONS
@@ -87,42 +99,85 @@ enum class CameraRefracModelId {
                               T d,                                             \
                               Eigen::Matrix<T, 3, 1>* uvw);                    \
   template <typename T>                                                        \
+  static void RefractRay(const T* refrac_params,                               \
+                         Eigen::Matrix<T, 3, 1>* ori,                          \
+                         Eigen::Matrix<T, 3, 1>* dir);                         \
+  static void RefractRayBatch(const double* refrac_params, Ray3DBatch* rays);  \
+  template <typename T>                                                        \
   static void RefractionAxis(const T* refrac_params,                           \
                              Eigen::Matrix<T, 3, 1>* refraction_axis);
 #endif
 
 #ifndef CAMERA_REFRAC_MODEL_CASES
-#define CAMERA_REFRAC_MODEL_CASES    \
-  CAMERA_REFRAC_MODEL_CASE(FlatPort) \
+#define CAMERA_REFRAC_MODEL_CASES        \
+  CAMERA_REFRAC_MODEL_NON_TEMPLATE_CASES \
+  CAMERA_REFRAC_MODEL_TEMPLATE_CASES
+#endif
+
+#ifndef CAMERA_REFRAC_MODEL_NON_TEMPLATE_CASES
+#define CAMERA_REFRAC_MODEL_NON_TEMPLATE_CASES \
+  CAMERA_REFRAC_MODEL_CASE(FlatPort)           \
   CAMERA_REFRAC_MODEL_CASE(DomePort)
 #endif
 
+// Refractive camera models which are specializations of a class template,
+// whose static members are defined as explicit specializations.
+#ifndef CAMERA_REFRAC_MODEL_TEMPLATE_CASES
+#define CAMERA_REFRAC_MODEL_TEMPLATE_CASES \
+  CAMERA_REFRAC_MODEL_CASE(FlatPort2L)     \
+  CAMERA_REFRAC_MODEL_CASE(FlatPort3L)
+#endif
+
 #ifndef CAMERA_COMBINATION_MODEL_CASES
-#define CAMERA_COMBINATION_MODEL_CASES                                    \
-  CAMERA_COMBINATION_MODEL_CASE(FlatPort, SimplePinholeCameraModel)       \
-  CAMERA_COMBINATION_MODEL_CASE(FlatPort, PinholeCameraModel)             \
-  CAMERA_COMBINATION_MODEL_CASE(FlatPort, SimpleRadialCameraModel)        \
-  CAMERA_COMBINATION_MODEL_CASE(FlatPort, SimpleRadialFisheyeCameraModel) \
-  CAMERA_COMBINATION_MODEL_CASE(FlatPort, RadialCameraModel)              \
-  CAMERA_COMBINATION_MODEL_CASE(FlatPort, RadialFisheyeCameraModel)       \
-  CAMERA_COMBINATION_MODEL_CASE(FlatPort, OpenCVCameraModel)              \
-  CAMERA_COMBINATION_MODEL_CASE(FlatPort, OpenCVFisheyeCameraModel)       \
-  CAMERA_COMBINATION_MODEL_CASE(FlatPort, FullOpenCVCameraModel)          \
-  CAMERA_COMBINATION_MODEL_CASE(FlatPort, FOVCameraModel)                 \
-  CAMERA_COMBINATION_MODEL_CASE(FlatPort, ThinPrismFisheyeCameraModel)    \
-  CAMERA_COMBINATION_MODEL_CASE(FlatPort, MetashapeFisheyeCameraModel)    \
-  CAMERA_COMBINATION_MODEL_CASE(DomePort, SimplePinholeCameraModel)       \
-  CAMERA_COMBINATION_MODEL_CASE(DomePort, PinholeCameraModel)             \
-  CAMERA_COMBINATION_MODEL_CASE(DomePort, SimpleRadialCameraModel)        \
-  CAMERA_COMBINATION_MODEL_CASE(DomePort, SimpleRadialFisheyeCameraModel) \
-  CAMERA_COMBINATION_MODEL_CASE(DomePort, RadialCameraModel)              \
-  CAMERA_COMBINATION_MODEL_CASE(DomePort, RadialFisheyeCameraModel)       \
-  CAMERA_COMBINATION_MODEL_CASE(DomePort, OpenCVCameraModel)              \
-  CAMERA_COMBINATION_MODEL_CASE(DomePort, OpenCVFisheyeCameraModel)       \
-  CAMERA_COMBINATION_MODEL_CASE(DomePort, FullOpenCVCameraModel)          \
-  CAMERA_COMBINATION_MODEL_CASE(DomePort, FOVCameraModel)                 \
-  CAMERA_COMBINATION_MODEL_CASE(DomePort, ThinPrismFisheyeCameraModel)    \
-  CAMERA_COMBINATION_MODEL_CASE(DomePort, MetashapeFisheyeCameraModel)
+#define CAMERA_COMBINATION_MODEL_CASES                                      \
+  CAMERA_COMBINATION_MODEL_CASE(FlatPort, SimplePinholeCameraModel)         \
+  CAMERA_COMBINATION_MODEL_CASE(FlatPort, PinholeCameraModel)               \
+  CAMERA_COMBINATION_MODEL_CASE(FlatPort, SimpleRadialCameraModel)          \
+  CAMERA_COMBINATION_MODEL_CASE(FlatPort, SimpleRadialFisheyeCameraModel)   \
+  CAMERA_COMBINATION_MODEL_CASE(FlatPort, RadialCameraModel)                \
+  CAMERA_COMBINATION_MODEL_CASE(FlatPort, RadialFisheyeCameraModel)         \
+  CAMERA_COMBINATION_MODEL_CASE(FlatPort, OpenCVCameraModel)                \
+  CAMERA_COMBINATION_MODEL_CASE(FlatPort, OpenCVFisheyeCameraModel)         \
+  CAMERA_COMBINATION_MODEL_CASE(FlatPort, FullOpenCVCameraModel)            \
+  CAMERA_COMBINATION_MODEL_CASE(FlatPort, FOVCameraModel)                   \
+  CAMERA_COMBINATION_MODEL_CASE(FlatPort, ThinPrismFisheyeCameraModel)      \
+  CAMERA_COMBINATION_MODEL_CASE(FlatPort, MetashapeFisheyeCameraModel)      \
+  CAMERA_COMBINATION_MODEL_CASE(DomePort, SimplePinholeCameraModel)         \
+  CAMERA_COMBINATION_MODEL_CASE(DomePort, PinholeCameraModel)               \
+  CAMERA_COMBINATION_MODEL_CASE(DomePort, SimpleRadialCameraModel)          \
+  CAMERA_COMBINATION_MODEL_CASE(DomePort, SimpleRadialFisheyeCameraModel)   \
+  CAMERA_COMBINATION_MODEL_CASE(DomePort, RadialCameraModel)                \
+  CAMERA_COMBINATION_MODEL_CASE(DomePort, RadialFisheyeCameraModel)         \
+  CAMERA_COMBINATION_MODEL_CASE(DomePort, OpenCVCameraModel)                \
+  CAMERA_COMBINATION_MODEL_CASE(DomePort, OpenCVFisheyeCameraModel)         \
+  CAMERA_COMBINATION_MODEL_CASE(DomePort, FullOpenCVCameraModel)            \
+  CAMERA_COMBINATION_MODEL_CASE(DomePort, FOVCameraModel)                   \
+  CAMERA_COMBINATION_MODEL_CASE(DomePort, ThinPrismFisheyeCameraModel)      \
+  CAMERA_COMBINATION_MODEL_CASE(DomePort, MetashapeFisheyeCameraModel)      \
+  CAMERA_COMBINATION_MODEL_CASE(FlatPort2L, SimplePinholeCameraModel)       \
+  CAMERA_COMBINATION_MODEL_CASE(FlatPort2L, PinholeCameraModel)             \
+  CAMERA_COMBINATION_MODEL_CASE(FlatPort2L, SimpleRadialCameraModel)        \
+  CAMERA_COMBINATION_MODEL_CASE(FlatPort2L, SimpleRadialFisheyeCameraModel) \
+  CAMERA_COMBINATION_MODEL_CASE(FlatPort2L, RadialCameraModel)              \
+  CAMERA_COMBINATION_MODEL_CASE(FlatPort2L, RadialFisheyeCameraModel)       \
+  CAMERA_COMBINATION_MODEL_CASE(FlatPort2L, OpenCVCameraModel)              \
+  CAMERA_COMBINATION_MODEL_CASE(FlatPort2L, OpenCVFisheyeCameraModel)       \
+  CAMERA_COMBINATION_MODEL_CASE(FlatPort2L, FullOpenCVCameraModel)          \
+  CAMERA_COMBINATION_MODEL_CASE(FlatPort2L, FOVCameraModel)                 \
+  CAMERA_COMBINATION_MODEL_CASE(FlatPort2L, ThinPrismFisheyeCameraModel)    \
+  CAMERA_COMBINATION_MODEL_CASE(FlatPort2L, MetashapeFisheyeCameraModel)    \
+  CAMERA_COMBINATION_MODEL_CASE(FlatPort3L, SimplePinholeCameraModel)       \
+  CAMERA_COMBINATION_MODEL_CASE(FlatPort3L, PinholeCameraModel)             \
+  CAMERA_COMBINATION_MODEL_CASE(FlatPort3L, SimpleRadialCameraModel)        \
+  CAMERA_COMBINATION_MODEL_CASE(FlatPort3L, SimpleRadialFisheyeCameraModel) \
+  CAMERA_COMBINATION_MODEL_CASE(FlatPort3L, RadialCameraModel)              \
+  CAMERA_COMBINATION_MODEL_CASE(FlatPort3L, RadialFisheyeCameraModel)       \
+  CAMERA_COMBINATION_MODEL_CASE(FlatPort3L, OpenCVCameraModel)              \
+  CAMERA_COMBINATION_MODEL_CASE(FlatPort3L, OpenCVFisheyeCameraModel)       \
+  CAMERA_COMBINATION_MODEL_CASE(FlatPort3L, FullOpenCVCameraModel)          \
+  CAMERA_COMBINATION_MODEL_CASE(FlatPort3L, FOVCameraModel)                 \
+  CAMERA_COMBINATION_MODEL_CASE(FlatPort3L, ThinPrismFisheyeCameraModel)    \
+  CAMERA_COMBINATION_MODEL_CASE(FlatPort3L, MetashapeFisheyeCameraModel)
 #endif
 
 #ifndef CAMERA_REFRAC_MODEL_SWITCH_CASES
@@ -150,15 +205,104 @@ enum class CameraRefracModelId {
   }
 #endif
 
+// Statistics of the Newton iteration of `IterativeProjection`.
+struct IterativeProjectionReport {
+  enum class Termination {
+    // The step size fell below the threshold.
+    CONVERGED,
+    // The maximum number of iterations was reached.
+    NO_CONVERGENCE,
+  };
+
+  Termination termination = Termination::NO_CONVERGENCE;
+
+  // The number of performed iterations.
+  size_t num_iterations = 0;
+
+  // The number of iterations saved by the early exit on convergence, i.e. the
+  // maximum minus the performed number of iterations.
+  size_t num_saved_iterations = 0;
+
+  // The number of evaluations of the refraction, i.e. one per iteration with
+  // automatic and five per iteration with numerical differentiation.
+  size_t num_refraction_evaluations = 0;
+};
+
 // The "Curiously Recurring Template Pattern" (CRTP) is
 // used here, so that we can reuse some shared
 // functionality between all camera models - defined in
 // the BaseCameraRefracModel.
 template <typename CameraRefracModel>
 struct BaseCameraRefracModel {
+  // Refine the projection of the point (u, v, w) starting from the initial
+  // guess of the image coordinates (x, y) using a Newton iteration.
+  //
+  // For double precision, the Jacobian is computed by automatic
+  // differentiation of the refraction in normalized camera coordinates, which
+  // requires a single evaluation of the refraction per iteration and avoids
+  // the iterative undistortion of the camera model. For other scalar types
+  // (e.g. ceres Jets), the Jacobian is computed by numerical central
+  // differences.
+  //
+  // @param report  Optional statistics of the iteration.
+  //
+  // @return    The number of performed iterations. If the iteration did not
+  //            converge, the maximum number of iterations is returned.
   template <typename CameraModel, typename T>
-  static inline void IterativeProjection(
-      const T* cam_params, const T* refrac_params, T u, T v, T w, T* x, T* y);
+  static inline size_t IterativeProjection(
+      const T* cam_params,
+      const T* refrac_params,
+      T u,
+      T v,
+      T w,
+      T* x,
+      T* y,
+      IterativeProjectionReport* report = nullptr);
+
+  // Transform normalized camera coordinates (u, v) of the ray in air to the
+  // point on the refracted ray at distance `d` from the camera center.
+  template <typename T>
+  static inline void CamFromNormalizedPoint(const T* refrac_params,
+                                            T u,
+                                            T v,
+                                            T d,
+                                            Eigen::Matrix<T, 3, 1>* uvw);
+
+  // Transform a batch of image coordinates to refracted rays in the camera
+  // frame. The back-projection through the camera model is computed per point,
+  // whereas the refraction of all rays is traced at once by `RefractRayBatch`.
+  template <typename CameraModel>
+  static inline void CamFromImgBatch(
+      const double* cam_params,
+      const double* refrac_params,
+      const std::vector<Eigen::Vector2d>& points2D,
+      Ray3DBatch* rays);
+
+  static constexpr size_t kMaxNumProjectionIterations = 100;
+  static constexpr Eigen::Index kCamFromImgBatchSize = 256;
+
+ private:
+  template <typename CameraModel>
+  static inline void IterativeProjectionImpl(const double* cam_params,
+                                             const double* refrac_params,
+                                             double u,
+                                             double v,
+                                             double w,
+                                             double* x,
+                                             double* y,
+                                             IterativeProjectionReport* report,
+                                             std::true_type);
+
+  template <typename CameraModel, typename T>
+  static inline void IterativeProjectionImpl(const T* cam_params,
+                                             const T* refrac_params,
+                                             T u,
+                                             T v,
+                                             T w,
+                                             T* x,
+                                             T* y,
+                                             IterativeProjectionReport* report,
+                                             std::false_type);
 };
 
 // FlatPort refraction model (thick planar glass interface).
@@ -177,6 +321,21 @@ struct BaseCameraRefracModel {
 // https://link.springer.com/chapter/10.1007/978-3-642-33715-4_61
 struct FlatPort : public BaseCameraRefracModel<FlatPort> {
   CAMERA_REFRAC_MODEL_DEFINITIONS(CameraRefracModelId::kFlatPort, "FLATPORT", 8)
+
+  // Closed-form projection for interfaces whose normal is aligned with the
+  // optical axis, see `FlatPortAxialNormalizedFromCam`. Only implemented for
+  // double precision, returns false if the fast path is not applicable.
+  template <typename CameraModel, typename T>
+  static inline bool AxialImgFromCam(
+      const T* cam_params, const T* refrac_params, T u, T v, T w, T* x, T* y);
+  template <typename CameraModel>
+  static inline bool AxialImgFromCam(const double* cam_params,
+                                     const double* refrac_params,
+                                     double u,
+                                     double v,
+                                     double w,
+                                     double* x,
+                                     double* y);
 };
 
 // DomePort (thick spherical glass interface).
@@ -191,8 +350,78 @@ struct FlatPort : public BaseCameraRefracModel<FlatPort> {
 // https://link.springer.com/chapter/10.1007/978-3-030-33676-9_6
 struct DomePort : public BaseCameraRefracModel<DomePort> {
   CAMERA_REFRAC_MODEL_DEFINITIONS(CameraRefracModelId::kDomePort, "DOMEPORT", 8)
+
+  // Whether the dome is exactly centered at the camera center, such that all
+  // rays pass the interfaces perpendicularly and are not refracted. The
+  // projection then reduces to the perspective camera model. For ceres Jets,
+  // the derivatives of the center must vanish as well, i.e. a center that is
+  // optimized is never considered centered.
+  template <typename T>
+  static inline bool IsCentered(const T* refrac_params);
+};
+
+namespace internal {
+
+// Unique identifier of the multi-layer flat port with the given number of
+// layers, or `kInvalid` if the number of layers is not registered.
+constexpr CameraRefracModelId MultiLayerFlatPortModelId(const int num_layers) {
+  return num_layers == 2   ? CameraRefracModelId::kFlatPort2L
+         : num_layers == 3 ? CameraRefracModelId::kFlatPort3L
+                           : CameraRefracModelId::kInvalid;
+}
+
+}  // namespace internal
+
+// Multi-layer FlatPort refraction model (stack of `kNumLayers` parallel planar
+// layers, e.g. an acrylic port with an anti-reflective coating, or two glass
+// plates enclosing a dry gap).
+//
+// Parameter list is expected in the following order:
+//
+// Nx, Ny, Nz, int_dist, int_thick_1, ..., int_thick_L, na, n_1, ..., n_L, nw
+//
+// where L is the number of layers, int_dist is the distance of the innermost
+// interface to the camera center, and int_thick_i and n_i are the thickness
+// and the refractive index of the i-th layer counted from the camera. The
+// parameters of a single layer are the same as for `FlatPort`.
+//
+// The ray is traced through the L + 1 interfaces by a recursion over the
+// interfaces, which is unrolled at compile time. New numbers of layers are
+// registered by adding an identifier to `MultiLayerFlatPortModelId`, a typedef
+// below, and the typedef to `CAMERA_REFRAC_MODEL_TEMPLATE_CASES`.
+template <int kNumLayers>
+struct MultiLayerFlatPort
+    : public BaseCameraRefracModel<MultiLayerFlatPort<kNumLayers>> {
+  static_assert(internal::MultiLayerFlatPortModelId(kNumLayers) !=
+                    CameraRefracModelId::kInvalid,
+                "Number of layers is not registered");
+
+  CAMERA_REFRAC_MODEL_DEFINITIONS(
+      internal::MultiLayerFlatPortModelId(kNumLayers),
+      "FLATPORT_" + std::to_string(kNumLayers) + "L",
+      2 * kNumLayers + 6)
+
+  static constexpr int num_layers = kNumLayers;
 };
 
+typedef MultiLayerFlatPort<2> FlatPort2L;
+typedef MultiLayerFlatPort<3> FlatPort3L;
+
+// The static members of the template refractive camera models are explicitly
+// specialized in `models_refrac.cc`, such that they are initialized in order
+// with the static lookup tables of all refractive camera models.
+#define CAMERA_REFRAC_MODEL_CASE(CameraRefracModel)                 \
+  template <>                                                       \
+  const std::string CameraRefracModel::refrac_model_name;           \
+  template <>                                                       \
+  const std::string CameraRefracModel::refrac_params_info;          \
+  template <>                                                       \
+  const std::vector<size_t> CameraRefracModel::optimizable_params_idxs;
+
+CAMERA_REFRAC_MODEL_TEMPLATE_CASES
+
+#undef CAMERA_REFRAC_MODEL_CASE
+
 // Check whether refractive camera with given name or identifier
 // exists
 bool ExistsCameraRefracModelWithName(const std::string& refrac_model_name);
@@ -289,6 +518,25 @@ inline Ray3D CameraRefracModelCamFromImg(
 // @param d            Depth of the point in the camera system.
 //
 // @return              Output Coordinates in camera system as (u, v, w).
+// Transform a batch of image coordinates to 3D rays in camera frame using
+// refractive camera model. This is equivalent to calling
+// `CameraRefracModelCamFromImg` for every point, but the refraction is traced
+// for all rays at once with vectorized array operations.
+//
+// @param model_id      Unique identifier of camera model.
+// @param refrac_model_id      Unique identifier of refractive camera model.
+// @param cam_params        Array of camera parameters.
+// @param refrac_params        Array of refractive camera parameters.
+// @param points2D      Image coordinates in pixels.
+// @param rays          Output rays in camera system.
+inline void CameraRefracModelCamFromImgBatch(
+    CameraModelId model_id,
+    CameraRefracModelId refrac_model_id,
+    const std::vector<double>& cam_params,
+    const std::vector<double>& refrac_params,
+    const std::vector<Eigen::Vector2d>& points2D,
+    Ray3DBatch* rays);
+
 inline Eigen::Vector3d CameraRefracModelCamFromImgPoint(
     CameraModelId model_id,
     CameraRefracModelId refrac_model_id,
@@ -301,6 +549,126 @@ inline Eigen::Vector3d CameraRefracModelRefractionAxis(
     CameraRefracModelId refrac_model_id,
     const std::vector<double>& refrac_params);
 
+// Project a point in the camera frame through a flat port whose interface
+// normal is aligned with the optical axis, i.e. the normal is (0, 0, 1).
+//
+// Due to the rotational symmetry of the axis-aligned configuration, the
+// projection reduces to a 1D problem in the plane spanned by the optical axis
+// and the point. The radial offset of the refracted ray at the depth of the
+// point is a monotonic and convex function of the sine of the incidence angle
+// in air, which is solved by a bracketed scalar Newton iteration. This is
+// considerably faster than the quartic (thin interface) or 12th degree (thick
+// interface) polynomial formulations of:
+//
+//    A. Agrawal, S. Ramalingam, Y. Taguchi, V. Chari, "A Theory of Multi-Layer
+//    Flat Refractive Geometry", CVPR 2012.
+//
+// which require an eigenvalue decomposition of the companion matrix.
+//
+// @param refrac_params   Array of the flat port parameters.
+// @param u, v, w         Coordinates in camera system as (u, v, w).
+// @param nu, nv          Output normalized coordinates of the ray in air.
+//
+// @return                False if the interface is tilted or the point does
+//                        not lie beyond the interface.
+bool FlatPortAxialNormalizedFromCam(const double* refrac_params,
+                                    double u,
+                                    double v,
+                                    double w,
+                                    double* nu,
+                                    double* nv);
+
+// Refine the projection of a point in the camera frame to the image plane
+// using the Newton iteration of the refractive camera model, starting from the
+// given initial guess of the image coordinates. With a good initial guess,
+// this converges in far fewer iterations than `CameraRefracModelImgFromCam`.
+//
+// @param model_id              Unique identifier of camera model.
+// @param refrac_model_id       Unique identifier of refractive camera model.
+// @param cam_params            Array of camera parameters.
+// @param refrac_params         Array of refractive parameters.
+// @param uvw                   Coordinates in camera system as (u, v, w).
+// @param xy                    Initial guess of the image coordinates.
+//
+// @return                      Output image coordinates in pixels.
+inline Eigen::Vector2d CameraRefracModelRefineImgFromCam(
+    CameraModelId model_id,
+    CameraRefracModelId refrac_model_id,
+    const std::vector<double>& cam_params,
+    const std::vector<double>& refrac_params,
+    const Eigen::Vector3d& uvw,
+    const Eigen::Vector2d& xy);
+
+// Kernels of a resolved combination of a perspective and a refractive camera
+// model. The `CameraRefracModel*` functions above dispatch over all model
+// combinations on every call, which dominates bulk loops over many points.
+// The kernel is resolved once by `CameraRefracModelKernel` and its batch
+// functions loop over the points with the model combination known at compile
+// time, such that the per-point refraction is inlined.
+//
+// The kernel references the parameter arrays, which must not be resized or
+// destroyed while the kernel is in use.
+struct CameraRefracKernel {
+  typedef void (*ImgFromCamFunc)(const double* cam_params,
+                                 const double* refrac_params,
+                                 size_t num_points,
+                                 const Eigen::Vector3d* uvws,
+                                 Eigen::Vector2d* xys);
+  typedef void (*CamFromImgFunc)(const double* cam_params,
+                                 const double* refrac_params,
+                                 size_t num_points,
+                                 const Eigen::Vector2d* xys,
+                                 Ray3D* rays);
+  typedef void (*CamFromImgPointFunc)(const double* cam_params,
+                                      const double* refrac_params,
+                                      size_t num_points,
+                                      const Eigen::Vector2d* xys,
+                                      double d,
+                                      Eigen::Vector3d* uvws);
+
+  const double* cam_params = nullptr;
+  const double* refrac_params = nullptr;
+
+  ImgFromCamFunc img_from_cam = nullptr;
+  // Refines the initial guesses given in `xys` in-place, see
+  // `CameraRefracModelRefineImgFromCam`.
+  ImgFromCamFunc refine_img_from_cam = nullptr;
+  CamFromImgFunc cam_from_img = nullptr;
+  CamFromImgPointFunc cam_from_img_point = nullptr;
+
+  inline Eigen::Vector2d ImgFromCam(const Eigen::Vector3d& uvw) const;
+  inline Ray3D CamFromImg(const Eigen::Vector2d& xy) const;
+  inline Eigen::Vector3d CamFromImgPoint(const Eigen::Vector2d& xy,
+                                         double d) const;
+
+  // Batch variants over `num_points` contiguous points.
+  inline void ImgFromCam(size_t num_points,
+                         const Eigen::Vector3d* uvws,
+                         Eigen::Vector2d* xys) const;
+  inline void RefineImgFromCam(size_t num_points,
+                               const Eigen::Vector3d* uvws,
+                               Eigen::Vector2d* xys) const;
+  inline void CamFromImg(size_t num_points,
+                         const Eigen::Vector2d* xys,
+                         Ray3D* rays) const;
+  inline void CamFromImgPoint(size_t num_points,
+                              const Eigen::Vector2d* xys,
+                              double d,
+                              Eigen::Vector3d* uvws) const;
+};
+
+// Resolve the kernels of the given model combination.
+//
+// @param model_id              Unique identifier of camera model.
+// @param refrac_model_id       Unique identifier of refractive camera model.
+// @param cam_params            Array of camera parameters.
+// @param refrac_params         Array of refractive parameters.
+inline CameraRefracKernel CameraRefracModelKernel(
+    CameraModelId model_id,
+    CameraRefracModelId refrac_model_id,
+    const std::vector<double>& cam_params,
+    const std::vector<double>& refrac_params);
+
 ////////////////////////////////////////////////////////////////////////////////
 // Implementation
 ////////////////////////////////////////////////////////////////////////////////
@@ -308,16 +676,175 @@ inline Eigen::Vector3d CameraRefracModelRefractionAxis(
 ////////////////////////////////////////////////////////////////////////////////
 // BaseCameraRefracModel
 
+template <typename CameraRefracModel>
+constexpr size_t
+    BaseCameraRefracModel<CameraRefracModel>::kMaxNumProjectionIterations;
+template <typename CameraRefracModel>
+constexpr Eigen::Index
+    BaseCameraRefracModel<CameraRefracModel>::kCamFromImgBatchSize;
+
 template <typename CameraRefracModel>
 template <typename CameraModel, typename T>
-void BaseCameraRefracModel<CameraRefracModel>::IterativeProjection(
-    const T* cam_params, const T* refrac_params, T u, T v, T w, T* x, T* y) {
+size_t BaseCameraRefracModel<CameraRefracModel>::IterativeProjection(
+    const T* cam_params,
+    const T* refrac_params,
+    T u,
+    T v,
+    T w,
+    T* x,
+    T* y,
+    IterativeProjectionReport* report) {
+  IterativeProjectionReport local_report;
+  if (report == nullptr) {
+    report = &local_report;
+  }
+  *report = IterativeProjectionReport();
+  IterativeProjectionImpl<CameraModel>(cam_params,
+                                       refrac_params,
+                                       u,
+                                       v,
+                                       w,
+                                       x,
+                                       y,
+                                       report,
+                                       std::is_same<T, double>());
+  report->num_saved_iterations =
+      kMaxNumProjectionIterations - report->num_iterations;
+  COLMAP_TRACE_HISTOGRAM("IterativeProjection iterations",
+                         report->num_iterations);
+  return report->num_iterations;
+}
+
+template <typename CameraRefracModel>
+template <typename T>
+void BaseCameraRefracModel<CameraRefracModel>::CamFromNormalizedPoint(
+    const T* refrac_params, T u, T v, T d, Eigen::Matrix<T, 3, 1>* uvw) {
+  Eigen::Matrix<T, 3, 1> ori = Eigen::Matrix<T, 3, 1>::Zero();
+  Eigen::Matrix<T, 3, 1> dir(u, v, T(1));
+  dir.normalize();
+  CameraRefracModel::RefractRay(refrac_params, &ori, &dir);
+
+  // Intersect the refracted ray with the sphere of radius `d` around the
+  // camera center, where the direction of the refracted ray is normalized.
+  const T ori_dot_dir = ori.dot(dir);
+  const T disc = ori_dot_dir * ori_dot_dir - ori.squaredNorm() + d * d;
+  const T sqrt_disc = sqrt(disc);
+  T lambd = -(ori_dot_dir + sqrt_disc);
+  if (lambd < T(0)) {
+    lambd = -(ori_dot_dir - sqrt_disc);
+  }
+
+  *uvw = ori + lambd * dir;
+}
+
+template <typename CameraRefracModel>
+template <typename CameraModel>
+void BaseCameraRefracModel<CameraRefracModel>::CamFromImgBatch(
+    const double* cam_params,
+    const double* refrac_params,
+    const std::vector<Eigen::Vector2d>& points2D,
+    Ray3DBatch* rays) {
+  const Eigen::Index num_points = points2D.size();
+  rays->Resize(num_points);
+
+  // Trace the rays in chunks, such that the intermediate arrays of the batched
+  // refraction remain in cache.
+  Ray3DBatch chunk;
+  for (Eigen::Index begin = 0; begin < num_points;
+       begin += kCamFromImgBatchSize) {
+    const Eigen::Index size =
+        std::min(kCamFromImgBatchSize, num_points - begin);
+    chunk.Resize(size);
+    chunk.oris.setZero();
+    for (Eigen::Index i = 0; i < size; ++i) {
+      const Eigen::Vector2d& point2D = points2D[begin + i];
+      Eigen::Vector3d dir;
+      CameraModel::CamFromImg(
+          cam_params, point2D.x(), point2D.y(), &dir(0), &dir(1), &dir(2));
+      chunk.dirs.row(i) = dir.normalized().transpose();
+    }
+    CameraRefracModel::RefractRayBatch(refrac_params, &chunk);
+    rays->oris.middleRows(begin, size) = chunk.oris;
+    rays->dirs.middleRows(begin, size) = chunk.dirs;
+  }
+}
+
+template <typename CameraRefracModel>
+template <typename CameraModel>
+void BaseCameraRefracModel<CameraRefracModel>::IterativeProjectionImpl(
+    const double* cam_params,
+    const double* refrac_params,
+    const double u,
+    const double v,
+    const double w,
+    double* x,
+    double* y,
+    IterativeProjectionReport* report,
+    std::true_type) {
+  typedef ceres::Jet<double, 2> JetT;
+
+  // Parameters for Newton iteration in normalized camera coordinates using
+  // automatic differentiation. The step size threshold corresponds to the
+  // threshold of the numerical variant in pixels.
+  const Eigen::Vector3d uvw(u, v, w);
+  const double d = uvw.norm();
+  const double kMaxStepNorm =
+      std::pow(CameraModel::CamFromImgThreshold(cam_params, 1e-5), 2);
+
+  JetT refrac_params_jet[CameraRefracModel::num_params];
+  for (size_t i = 0; i < CameraRefracModel::num_params; ++i) {
+    refrac_params_jet[i] = JetT(refrac_params[i]);
+  }
+  const JetT d_jet(d);
+
+  // Lift the initial guess to normalized camera coordinates.
+  Eigen::Vector3d ray;
+  CameraModel::CamFromImg(cam_params, *x, *y, &ray(0), &ray(1), &ray(2));
+  Eigen::Vector2d X = ray.hnormalized();
+
+  Eigen::Matrix<double, 3, 2> J;
+  Eigen::Vector3d err;
+  Eigen::Matrix<JetT, 3, 1> uvw_jet;
+
+  while (report->num_iterations < kMaxNumProjectionIterations) {
+    report->num_iterations += 1;
+    report->num_refraction_evaluations += 1;
+    CamFromNormalizedPoint<JetT>(
+        refrac_params_jet, JetT(X(0), 0), JetT(X(1), 1), d_jet, &uvw_jet);
+    for (int i = 0; i < 3; ++i) {
+      err(i) = uvw_jet(i).a - uvw(i);
+      J.row(i) = uvw_jet(i).v.transpose();
+    }
+    const Eigen::Matrix2d H = J.transpose() * J;
+    const Eigen::Vector2d b = J.transpose() * err;
+    const Eigen::Vector2d step_x = H.partialPivLu().solve(b);
+    X -= step_x;
+    if (step_x.squaredNorm() < kMaxStepNorm) {
+      report->termination = IterativeProjectionReport::Termination::CONVERGED;
+      break;
+    }
+  }
+
+  CameraModel::ImgFromCam(cam_params, X(0), X(1), 1.0, x, y);
+}
+
+template <typename CameraRefracModel>
+template <typename CameraModel, typename T>
+void BaseCameraRefracModel<CameraRefracModel>::IterativeProjectionImpl(
+    const T* cam_params,
+    const T* refrac_params,
+    const T u,
+    const T v,
+    const T w,
+    T* x,
+    T* y,
+    IterativeProjectionReport* report,
+    std::false_type) {
   // Parameters for Newton iteration using numerical differentiation with
   // central differences, 100 iterations should be enough even for complex
   // camera models with higher order terms.
   const Eigen::Matrix<T, 3, 1> uvw(u, v, w);
   const T d = uvw.norm();
-  const size_t kNumIterations = 100;
   const T kMaxStepNorm = T(1e-10);
   const T kRelStepSize = T(1e-9);
   const T kAbsStepSize = T(1e-6);
@@ -331,7 +858,9 @@ void BaseCameraRefracModel<CameraRefracModel>::IterativeProjection(
   Eigen::Matrix<T, 3, 1> dx_1b;
   Eigen::Matrix<T, 3, 1> dx_1f;
 
-  for (size_t i = 0; i < kNumIterations; ++i) {
+  while (report->num_iterations < kMaxNumProjectionIterations) {
+    report->num_iterations += 1;
+    report->num_refraction_evaluations += 5;
     const T step0 = std::max(kAbsStepSize, ceres::abs(kRelStepSize * X(0)));
     const T step1 = std::max(kAbsStepSize, ceres::abs(kRelStepSize * X(1)));
     CameraRefracModel::template CamFromImgPoint<CameraModel, T>(
@@ -356,6 +885,7 @@ void BaseCameraRefracModel<CameraRefracModel>::IterativeProjection(
     const Eigen::Matrix<T, 2, 1> step_x = H.partialPivLu().solve(b);
     X -= step_x;
     if (step_x.squaredNorm() < kMaxStepNorm) {
+      report->termination = IterativeProjectionReport::Termination::CONVERGED;
       break;
     }
   }
@@ -378,11 +908,41 @@ std::vector<size_t> FlatPort::InitializeOptimizableParamsIdxs() {
 template <typename CameraModel, typename T>
 void FlatPort::ImgFromCam(
     const T* cam_params, const T* refrac_params, T u, T v, T w, T* x, T* y) {
+  if (AxialImgFromCam<CameraModel>(cam_params, refrac_params, u, v, w, x, y)) {
+    return;
+  }
   CameraModel::ImgFromCam(cam_params, u, v, w, x, y);
   IterativeProjection<CameraModel, T>(cam_params, refrac_params, u, v, w, x, y);
   return;
 }
 
+template <typename CameraModel, typename T>
+bool FlatPort::AxialImgFromCam(const T* cam_params,
+                               const T* refrac_params,
+                               const T u,
+                               const T v,
+                               const T w,
+                               T* x,
+                               T* y) {
+  return false;
+}
+
+template <typename CameraModel>
+bool FlatPort::AxialImgFromCam(const double* cam_params,
+                               const double* refrac_params,
+                               const double u,
+                               const double v,
+                               const double w,
+                               double* x,
+                               double* y) {
+  double nu, nv;
+  if (!FlatPortAxialNormalizedFromCam(refrac_params, u, v, w, &nu, &nv)) {
+    return false;
+  }
+  CameraModel::ImgFromCam(cam_params, nu, nv, 1.0, x, y);
+  return true;
+}
+
 template <typename CameraModel, typename T>
 void FlatPort::CamFromImg(const T* cam_params,
                           const T* refrac_params,
@@ -393,6 +953,13 @@ void FlatPort::CamFromImg(const T* cam_params,
   (*ori) = Eigen::Matrix<T, 3, 1>::Zero();
   CameraModel::CamFromImg(cam_params, x, y, &(*dir)(0), &(*dir)(1), &(*dir)(2));
   (*dir).normalize();
+  RefractRay(refrac_params, ori, dir);
+}
+
+template <typename T>
+void FlatPort::RefractRay(const T* refrac_params,
+                          Eigen::Matrix<T, 3, 1>* ori,
+                          Eigen::Matrix<T, 3, 1>* dir) {
   const Eigen::Matrix<T, 3, 1> int_normal(
       refrac_params[0], refrac_params[1], refrac_params[2]);
 
@@ -488,10 +1055,34 @@ std::vector<size_t> DomePort::InitializeOptimizableParamsIdxs() {
   return {0, 1, 2};
 }
 
+namespace internal {
+
+template <typename T>
+inline bool IsExactlyZero(const T& x) {
+  return x == T(0);
+}
+
+template <typename T, int N>
+inline bool IsExactlyZero(const ceres::Jet<T, N>& x) {
+  return x.a == T(0) && x.v.isZero();
+}
+
+}  // namespace internal
+
+template <typename T>
+bool DomePort::IsCentered(const T* refrac_params) {
+  return internal::IsExactlyZero(refrac_params[0]) &&
+         internal::IsExactlyZero(refrac_params[1]) &&
+         internal::IsExactlyZero(refrac_params[2]);
+}
+
 template <typename CameraModel, typename T>
 void DomePort::ImgFromCam(
     const T* cam_params, const T* refrac_params, T u, T v, T w, T* x, T* y) {
   CameraModel::ImgFromCam(cam_params, u, v, w, x, y);
+  if (IsCentered(refrac_params)) {
+    return;
+  }
   IterativeProjection<CameraModel, T>(cam_params, refrac_params, u, v, w, x, y);
   return;
 }
@@ -506,6 +1097,19 @@ void DomePort::CamFromImg(const T* cam_params,
   (*ori) = Eigen::Matrix<T, 3, 1>::Zero();
   CameraModel::CamFromImg(cam_params, x, y, &(*dir)(0), &(*dir)(1), &(*dir)(2));
   (*dir).normalize();
+  RefractRay(refrac_params, ori, dir);
+}
+
+template <typename T>
+void DomePort::RefractRay(const T* refrac_params,
+                          Eigen::Matrix<T, 3, 1>* ori,
+                          Eigen::Matrix<T, 3, 1>* dir) {
+  // The rays of a centered dome are not refracted and the ray origin at the
+  // camera center lies on the same line as the origin on the interface.
+  if (IsCentered(refrac_params)) {
+    return;
+  }
+
   const Eigen::Matrix<T, 3, 1> sphere_center(
       refrac_params[0], refrac_params[1], refrac_params[2]);
   const T int_radius = refrac_params[3];
@@ -588,6 +1192,167 @@ void DomePort::CamFromImgPoint(const T* cam_params,
 template <typename T>
 void DomePort::RefractionAxis(const T* refrac_params,
                               Eigen::Matrix<T, 3, 1>* refraction_axis) {
+  // All rays of a centered dome pass through the camera center, such that
+  // any axis through the camera center is a valid refraction axis.
+  if (IsCentered(refrac_params)) {
+    *refraction_axis = Eigen::Matrix<T, 3, 1>(T(0), T(0), T(1));
+    return;
+  }
+  (*refraction_axis)[0] = refrac_params[0];
+  (*refraction_axis)[1] = refrac_params[1];
+  (*refraction_axis)[2] = refrac_params[2];
+  (*refraction_axis).normalize();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// MultiLayerFlatPort
+
+namespace internal {
+
+// Refract the ray at the interfaces [kInterface, kNumInterfaces) of a
+// multi-layer flat port, where the interface i separates the media with the
+// refractive indices ns[i] and ns[i + 1]. The recursion over the interfaces
+// is resolved at compile time, such that the loop is fully unrolled.
+template <int kInterface, int kNumInterfaces>
+struct MultiLayerFlatPortInterfaces {
+  // @param prev_int_dist    Distance of the previous interface.
+  // @param int_thicks       Thicknesses of the layers between the interfaces.
+  // @param ns               Refractive indices of the media.
+  template <typename T>
+  static inline void RefractRay(const Eigen::Matrix<T, 3, 1>& int_normal,
+                                const T prev_int_dist,
+                                const T* int_thicks,
+                                const T* ns,
+                                Eigen::Matrix<T, 3, 1>* ori,
+                                Eigen::Matrix<T, 3, 1>* dir) {
+    const T int_dist = prev_int_dist + int_thicks[kInterface - 1];
+    T d;
+    RayPlaneIntersection(*ori, *dir, int_normal, int_dist, &d);
+    *ori += d * *dir;
+    ComputeRefraction(int_normal, ns[kInterface], ns[kInterface + 1], dir);
+    MultiLayerFlatPortInterfaces<kInterface + 1, kNumInterfaces>::RefractRay(
+        int_normal, int_dist, int_thicks, ns, ori, dir);
+  }
+};
+
+template <int kNumInterfaces>
+struct MultiLayerFlatPortInterfaces<kNumInterfaces, kNumInterfaces> {
+  template <typename T>
+  static inline void RefractRay(const Eigen::Matrix<T, 3, 1>& int_normal,
+                                const T prev_int_dist,
+                                const T* int_thicks,
+                                const T* ns,
+                                Eigen::Matrix<T, 3, 1>* ori,
+                                Eigen::Matrix<T, 3, 1>* dir) {}
+};
+
+}  // namespace internal
+
+template <int kNumLayers>
+constexpr size_t MultiLayerFlatPort<kNumLayers>::num_params;
+template <int kNumLayers>
+constexpr CameraRefracModelId MultiLayerFlatPort<kNumLayers>::refrac_model_id;
+template <int kNumLayers>
+constexpr int MultiLayerFlatPort<kNumLayers>::num_layers;
+
+template <int kNumLayers>
+std::string MultiLayerFlatPort<kNumLayers>::InitializeRefracParamsInfo() {
+  std::string params_info = "Nx, Ny, Nz, int_dist, ";
+  for (int i = 1; i <= kNumLayers; ++i) {
+    params_info += "int_thick_" + std::to_string(i) + ", ";
+  }
+  params_info += "na, ";
+  for (int i = 1; i <= kNumLayers; ++i) {
+    params_info += "n_" + std::to_string(i) + ", ";
+  }
+  params_info += "nw\n(Note that [Nx, Ny, Nz] must be unit vector)";
+  return params_info;
+}
+
+template <int kNumLayers>
+std::vector<size_t>
+MultiLayerFlatPort<kNumLayers>::InitializeOptimizableParamsIdxs() {
+  return {0, 1, 2, 3};
+}
+
+template <int kNumLayers>
+template <typename CameraModel, typename T>
+void MultiLayerFlatPort<kNumLayers>::ImgFromCam(
+    const T* cam_params, const T* refrac_params, T u, T v, T w, T* x, T* y) {
+  CameraModel::ImgFromCam(cam_params, u, v, w, x, y);
+  MultiLayerFlatPort::template IterativeProjection<CameraModel, T>(
+      cam_params, refrac_params, u, v, w, x, y);
+}
+
+template <int kNumLayers>
+template <typename CameraModel, typename T>
+void MultiLayerFlatPort<kNumLayers>::CamFromImg(const T* cam_params,
+                                                const T* refrac_params,
+                                                const T x,
+                                                const T y,
+                                                Eigen::Matrix<T, 3, 1>* ori,
+                                                Eigen::Matrix<T, 3, 1>* dir) {
+  (*ori) = Eigen::Matrix<T, 3, 1>::Zero();
+  CameraModel::CamFromImg(cam_params, x, y, &(*dir)(0), &(*dir)(1), &(*dir)(2));
+  (*dir).normalize();
+  RefractRay(refrac_params, ori, dir);
+}
+
+template <int kNumLayers>
+template <typename T>
+void MultiLayerFlatPort<kNumLayers>::RefractRay(const T* refrac_params,
+                                                Eigen::Matrix<T, 3, 1>* ori,
+                                                Eigen::Matrix<T, 3, 1>* dir) {
+  const Eigen::Matrix<T, 3, 1> int_normal(
+      refrac_params[0], refrac_params[1], refrac_params[2]);
+  const T int_dist = refrac_params[3];
+  const T* int_thicks = refrac_params + 4;
+  const T* ns = refrac_params + 4 + kNumLayers;
+
+  T d;
+  const bool is_intersect =
+      RayPlaneIntersection(*ori, *dir, int_normal, int_dist, &d);
+
+  // The back-projected ray has no intersection with the planar interface,
+  // continue
+  if (!is_intersect) return;
+  *ori += d * *dir;
+  ComputeRefraction(int_normal, ns[0], ns[1], dir);
+
+  internal::MultiLayerFlatPortInterfaces<1, kNumLayers + 1>::RefractRay(
+      int_normal, int_dist, int_thicks, ns, ori, dir);
+}
+
+template <int kNumLayers>
+template <typename CameraModel, typename T>
+void MultiLayerFlatPort<kNumLayers>::CamFromImgPoint(
+    const T* cam_params,
+    const T* refrac_params,
+    T x,
+    T y,
+    T d,
+    Eigen::Matrix<T, 3, 1>* uvw) {
+  Eigen::Matrix<T, 3, 1> ori;
+  Eigen::Matrix<T, 3, 1> dir;
+  CamFromImg<CameraModel, T>(cam_params, refrac_params, x, y, &ori, &dir);
+
+  // Intersect the refracted ray with the sphere of radius `d` around the
+  // camera center, where the direction of the refracted ray is normalized.
+  const T ori_dot_dir = ori.dot(dir);
+  const T disc = ori_dot_dir * ori_dot_dir - ori.squaredNorm() + d * d;
+  const T sqrt_disc = sqrt(disc);
+  T lambd = -(ori_dot_dir + sqrt_disc);
+  if (lambd < T(0)) {
+    lambd = -(ori_dot_dir - sqrt_disc);
+  }
+
+  *uvw = ori + lambd * dir;
+}
+
+template <int kNumLayers>
+template <typename T>
+void MultiLayerFlatPort<kNumLayers>::RefractionAxis(
+    const T* refrac_params, Eigen::Matrix<T, 3, 1>* refraction_axis) {
   (*refraction_axis)[0] = refrac_params[0];
   (*refraction_axis)[1] = refrac_params[1];
   (*refraction_axis)[2] = refrac_params[2];
@@ -621,6 +1386,33 @@ Eigen::Vector2d CameraRefracModelImgFromCam(
   return xy;
 }
 
+Eigen::Vector2d CameraRefracModelRefineImgFromCam(
+    const CameraModelId model_id,
+    const CameraRefracModelId refrac_model_id,
+    const std::vector<double>& cam_params,
+    const std::vector<double>& refrac_params,
+    const Eigen::Vector3d& uvw,
+    const Eigen::Vector2d& xy) {
+  Eigen::Vector2d refined_xy = xy;
+#define CAMERA_COMBINATION_MODEL_CASE(CameraRefracModel, CameraModel)  \
+  if (model_id == CameraModel::model_id &&                             \
+      refrac_model_id == CameraRefracModel::refrac_model_id) {         \
+    CameraRefracModel::IterativeProjection<CameraModel>(               \
+        cam_params.data(),                                             \
+        refrac_params.data(),                                          \
+        uvw.x(),                                                       \
+        uvw.y(),                                                       \
+        uvw.z(),                                                       \
+        &refined_xy.x(),                                               \
+        &refined_xy.y());                                              \
+  } else
+
+  CAMERA_COMBINATION_MODEL_IF_ELSE_CASES
+
+#undef CAMERA_COMBINATION_MODEL_CASE
+  return refined_xy;
+}
+
 Ray3D CameraRefracModelCamFromImg(const CameraModelId model_id,
                                   const CameraRefracModelId refrac_model_id,
                                   const std::vector<double>& cam_params,
@@ -644,6 +1436,25 @@ Ray3D CameraRefracModelCamFromImg(const CameraModelId model_id,
   return ray;
 }
 
+void CameraRefracModelCamFromImgBatch(
+    const CameraModelId model_id,
+    const CameraRefracModelId refrac_model_id,
+    const std::vector<double>& cam_params,
+    const std::vector<double>& refrac_params,
+    const std::vector<Eigen::Vector2d>& points2D,
+    Ray3DBatch* rays) {
+#define CAMERA_COMBINATION_MODEL_CASE(CameraRefracModel, CameraModel) \
+  if (model_id == CameraModel::model_id &&                            \
+      refrac_model_id == CameraRefracModel::refrac_model_id) {        \
+    CameraRefracModel::CamFromImgBatch<CameraModel>(                  \
+        cam_params.data(), refrac_params.data(), points2D, rays);     \
+  } else
+
+  CAMERA_COMBINATION_MODEL_IF_ELSE_CASES
+
+#undef CAMERA_COMBINATION_MODEL_CASE
+}
+
 Eigen::Vector3d CameraRefracModelCamFromImgPoint(
     const CameraModelId model_id,
     const CameraRefracModelId refrac_model_id,
@@ -682,4 +1493,151 @@ Eigen::Vector3d CameraRefracModelRefractionAxis(
   return refrac_axis;
 }
 
-}  // namespace colmap
\ No newline at end of file
+////////////////////////////////////////////////////////////////////////////////
+// CameraRefracKernel
+
+namespace internal {
+
+template <typename CameraRefracModel, typename CameraModel>
+void CameraRefracKernelImgFromCam(const double* cam_params,
+                                  const double* refrac_params,
+                                  const size_t num_points,
+                                  const Eigen::Vector3d* uvws,
+                                  Eigen::Vector2d* xys) {
+  for (size_t i = 0; i < num_points; ++i) {
+    CameraRefracModel::template ImgFromCam<CameraModel>(cam_params,
+                                                        refrac_params,
+                                                        uvws[i].x(),
+                                                        uvws[i].y(),
+                                                        uvws[i].z(),
+                                                        &xys[i].x(),
+                                                        &xys[i].y());
+  }
+}
+
+template <typename CameraRefracModel, typename CameraModel>
+void CameraRefracKernelRefineImgFromCam(const double* cam_params,
+                                        const double* refrac_params,
+                                        const size_t num_points,
+                                        const Eigen::Vector3d* uvws,
+                                        Eigen::Vector2d* xys) {
+  for (size_t i = 0; i < num_points; ++i) {
+    CameraRefracModel::template IterativeProjection<CameraModel>(
+        cam_params,
+        refrac_params,
+        uvws[i].x(),
+        uvws[i].y(),
+        uvws[i].z(),
+        &xys[i].x(),
+        &xys[i].y());
+  }
+}
+
+template <typename CameraRefracModel, typename CameraModel>
+void CameraRefracKernelCamFromImg(const double* cam_params,
+                                  const double* refrac_params,
+                                  const size_t num_points,
+                                  const Eigen::Vector2d* xys,
+                                  Ray3D* rays) {
+  for (size_t i = 0; i < num_points; ++i) {
+    CameraRefracModel::template CamFromImg<CameraModel>(cam_params,
+                                                        refrac_params,
+                                                        xys[i].x(),
+                                                        xys[i].y(),
+                                                        &rays[i].ori,
+                                                        &rays[i].dir);
+  }
+}
+
+template <typename CameraRefracModel, typename CameraModel>
+void CameraRefracKernelCamFromImgPoint(const double* cam_params,
+                                       const double* refrac_params,
+                                       const size_t num_points,
+                                       const Eigen::Vector2d* xys,
+                                       const double d,
+                                       Eigen::Vector3d* uvws) {
+  for (size_t i = 0; i < num_points; ++i) {
+    CameraRefracModel::template CamFromImgPoint<CameraModel>(
+        cam_params, refrac_params, xys[i].x(), xys[i].y(), d, &uvws[i]);
+  }
+}
+
+}  // namespace internal
+
+Eigen::Vector2d CameraRefracKernel::ImgFromCam(
+    const Eigen::Vector3d& uvw) const {
+  Eigen::Vector2d xy;
+  img_from_cam(cam_params, refrac_params, 1, &uvw, &xy);
+  return xy;
+}
+
+Ray3D CameraRefracKernel::CamFromImg(const Eigen::Vector2d& xy) const {
+  Ray3D ray;
+  cam_from_img(cam_params, refrac_params, 1, &xy, &ray);
+  return ray;
+}
+
+Eigen::Vector3d CameraRefracKernel::CamFromImgPoint(const Eigen::Vector2d& xy,
+                                                    const double d) const {
+  Eigen::Vector3d uvw;
+  cam_from_img_point(cam_params, refrac_params, 1, &xy, d, &uvw);
+  return uvw;
+}
+
+void CameraRefracKernel::ImgFromCam(const size_t num_points,
+                                    const Eigen::Vector3d* uvws,
+                                    Eigen::Vector2d* xys) const {
+  img_from_cam(cam_params, refrac_params, num_points, uvws, xys);
+}
+
+void CameraRefracKernel::RefineImgFromCam(const size_t num_points,
+                                          const Eigen::Vector3d* uvws,
+                                          Eigen::Vector2d* xys) const {
+  refine_img_from_cam(cam_params, refrac_params, num_points, uvws, xys);
+}
+
+void CameraRefracKernel::CamFromImg(const size_t num_points,
+                                    const Eigen::Vector2d* xys,
+                                    Ray3D* rays) const {
+  cam_from_img(cam_params, refrac_params, num_points, xys, rays);
+}
+
+void CameraRefracKernel::CamFromImgPoint(const size_t num_points,
+                                         const Eigen::Vector2d* xys,
+                                         const double d,
+                                         Eigen::Vector3d* uvws) const {
+  cam_from_img_point(cam_params, refrac_params, num_points, xys, d, uvws);
+}
+
+CameraRefracKernel CameraRefracModelKernel(
+    const CameraModelId model_id,
+    const CameraRefracModelId refrac_model_id,
+    const std::vector<double>& cam_params,
+    const std::vector<double>& refrac_params) {
+  CameraRefracKernel kernel;
+  kernel.cam_params = cam_params.data();
+  kernel.refrac_params = refrac_params.data();
+#define CAMERA_COMBINATION_MODEL_CASE(CameraRefracModel, CameraModel)        \
+  if (model_id == CameraModel::model_id &&                                   \
+      refrac_model_id == CameraRefracModel::refrac_model_id) {               \
+    kernel.img_from_cam =                                                    \
+        &internal::CameraRefracKernelImgFromCam<CameraRefracModel,           \
+                                                CameraModel>;                \
+    kernel.refine_img_from_cam =                                             \
+        &internal::CameraRefracKernelRefineImgFromCam<CameraRefracModel,     \
+                                                      CameraModel>;          \
+    kernel.cam_from_img =                                                    \
+        &internal::CameraRefracKernelCamFromImg<CameraRefracModel,           \
+                                                CameraModel>;                \
+    kernel.cam_from_img_point =                                              \
+        &internal::CameraRefracKernelCamFromImgPoint<CameraRefracModel,      \
+                                                     CameraModel>;           \
+  } else
+
+  CAMERA_COMBINATION_MODEL_IF_ELSE_CASES
+
+#undef CAMERA_COMBINATION_MODEL_CASE
+  return kernel;
+}
+
+}  // namespace colmap
@@ -0,0 +1,128 @@
+#include "colmap/math/random.h"
+#include "colmap/sensor/models_refrac.h"
+
+#include <type_traits>
+
+#include <benchmark/benchmark.h>
+
+namespace colmap {
+namespace {
+
+const size_t kWidth = 2000;
+const size_t kHeight = 1500;
+const double kFocalLength = 1500;
+const int kNumPoints = 1024;
+
+// Refractive parameters of a slightly tilted flat port and a slightly
+// decentered dome port, such that the general code paths are measured.
+template <typename CameraRefracModel>
+std::vector<double> RefracParams() {
+  if (std::is_same<CameraRefracModel, FlatPort>::value) {
+    const Eigen::Vector3d int_normal =
+        Eigen::Vector3d(0.01, -0.02, 1).normalized();
+    return {int_normal.x(),
+            int_normal.y(),
+            int_normal.z(),
+            0.05,
+            0.007,
+            1.003,
+            1.473,
+            1.333};
+  } else {
+    return {0.00042007, 0.00366894, 0.0283927, 0.05, 0.007, 1.003, 1.473, 1.333};
+  }
+}
+
+std::vector<Eigen::Vector2d> RandomPoints2D() {
+  SetPRNGSeed(0);
+  std::vector<Eigen::Vector2d> points2D(kNumPoints);
+  for (auto& point2D : points2D) {
+    point2D = Eigen::Vector2d(RandomUniformReal<double>(0, kWidth),
+                              RandomUniformReal<double>(0, kHeight));
+  }
+  return points2D;
+}
+
+std::vector<Eigen::Vector3d> RandomPoints3D() {
+  SetPRNGSeed(0);
+  std::vector<Eigen::Vector3d> points3D(kNumPoints);
+  for (auto& point3D : points3D) {
+    point3D = RandomUniformReal(1.0, 5.0) *
+              Eigen::Vector3d(RandomUniformReal(-0.5, 0.5),
+                              RandomUniformReal(-0.4, 0.4),
+                              1);
+  }
+  return points3D;
+}
+
+template <typename CameraRefracModel, typename CameraModel>
+void BM_CameraRefracModelImgFromCam(benchmark::State& state) {
+  const std::vector<double> cam_params =
+      CameraModel::InitializeParams(kFocalLength, kWidth, kHeight);
+  const std::vector<double> refrac_params = RefracParams<CameraRefracModel>();
+  const std::vector<Eigen::Vector3d> points3D = RandomPoints3D();
+  for (auto _ : state) {
+    for (const auto& point3D : points3D) {
+      benchmark::DoNotOptimize(
+          CameraRefracModelImgFromCam(CameraModel::model_id,
+                                      CameraRefracModel::refrac_model_id,
+                                      cam_params,
+                                      refrac_params,
+                                      point3D));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * points3D.size());
+}
+
+template <typename CameraRefracModel, typename CameraModel>
+void BM_CameraRefracModelCamFromImg(benchmark::State& state) {
+  const std::vector<double> cam_params =
+      CameraModel::InitializeParams(kFocalLength, kWidth, kHeight);
+  const std::vector<double> refrac_params = RefracParams<CameraRefracModel>();
+  const std::vector<Eigen::Vector2d> points2D = RandomPoints2D();
+  for (auto _ : state) {
+    for (const auto& point2D : points2D) {
+      benchmark::DoNotOptimize(
+          CameraRefracModelCamFromImg(CameraModel::model_id,
+                                      CameraRefracModel::refrac_model_id,
+                                      cam_params,
+                                      refrac_params,
+                                      point2D));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * points2D.size());
+}
+
+template <typename CameraRefracModel, typename CameraModel>
+void BM_CameraRefracModelCamFromImgBatch(benchmark::State& state) {
+  const std::vector<double> cam_params =
+      CameraModel::InitializeParams(kFocalLength, kWidth, kHeight);
+  const std::vector<double> refrac_params = RefracParams<CameraRefracModel>();
+  const std::vector<Eigen::Vector2d> points2D = RandomPoints2D();
+  Ray3DBatch rays;
+  for (auto _ : state) {
+    CameraRefracModelCamFromImgBatch(CameraModel::model_id,
+                                     CameraRefracModel::refrac_model_id,
+                                     cam_params,
+                                     refrac_params,
+                                     points2D,
+                                     &rays);
+    benchmark::DoNotOptimize(rays.dirs.data());
+  }
+  state.SetItemsProcessed(state.iterations() * points2D.size());
+}
+
+#define CAMERA_COMBINATION_MODEL_CASE(CameraRefracModel, CameraModel)       \
+  BENCHMARK_TEMPLATE(                                                       \
+      BM_CameraRefracModelImgFromCam, CameraRefracModel, CameraModel);      \
+  BENCHMARK_TEMPLATE(                                                       \
+      BM_CameraRefracModelCamFromImg, CameraRefracModel, CameraModel);      \
+  BENCHMARK_TEMPLATE(                                                       \
+      BM_CameraRefracModelCamFromImgBatch, CameraRefracModel, CameraModel);
+
+CAMERA_COMBINATION_MODEL_CASES
+
+#undef CAMERA_COMBINATION_MODEL_CASE
+
+}  // namespace
+}  // namespace colmap
@@ -66,6 +66,57 @@ void TestCamFromImgToImg(const std::vector<double>& cam_params,
                            << " computed";
 }
 
+template <typename CameraRefracModel, typename CameraModel>
+void TestIterativeProjection(const std::vector<double>& cam_params,
+                             const std::vector<double>& refrac_params,
+                             const double u0,
+                             const double v0,
+                             const double w0) {
+  double x, y;
+  CameraModel::ImgFromCam(cam_params.data(), u0, v0, w0, &x, &y);
+  IterativeProjectionReport report;
+  const size_t num_iterations =
+      CameraRefracModel::template IterativeProjection<CameraModel, double>(
+          cam_params.data(), refrac_params.data(), u0, v0, w0, &x, &y, &report);
+  EXPECT_GE(num_iterations, 1);
+  EXPECT_LT(num_iterations, 10);
+  EXPECT_EQ(report.termination,
+            IterativeProjectionReport::Termination::CONVERGED);
+  EXPECT_EQ(report.num_iterations, num_iterations);
+  EXPECT_EQ(report.num_saved_iterations,
+            CameraRefracModel::kMaxNumProjectionIterations - num_iterations);
+  EXPECT_EQ(report.num_refraction_evaluations, num_iterations);
+
+  // The numerically differentiated projection for other scalar types must
+  // yield the same result as the automatic differentiation for doubles.
+  typedef ceres::Jet<double, 1> JetT;
+  std::vector<JetT> cam_params_jet(cam_params.begin(), cam_params.end());
+  std::vector<JetT> refrac_params_jet(refrac_params.begin(),
+                                      refrac_params.end());
+  JetT x_jet, y_jet;
+  CameraModel::ImgFromCam(
+      cam_params_jet.data(), JetT(u0), JetT(v0), JetT(w0), &x_jet, &y_jet);
+  IterativeProjectionReport report_jet;
+  const size_t num_iterations_jet =
+      CameraRefracModel::template IterativeProjection<CameraModel, JetT>(
+          cam_params_jet.data(),
+          refrac_params_jet.data(),
+          JetT(u0),
+          JetT(v0),
+          JetT(w0),
+          &x_jet,
+          &y_jet,
+          &report_jet);
+  EXPECT_LT(num_iterations_jet,
+            CameraRefracModel::kMaxNumProjectionIterations);
+  EXPECT_EQ(report_jet.termination,
+            IterativeProjectionReport::Termination::CONVERGED);
+  EXPECT_GT(report_jet.num_saved_iterations, 0);
+  EXPECT_EQ(report_jet.num_refraction_evaluations, 5 * num_iterations_jet);
+  EXPECT_NEAR(x_jet.a, x, 1e-6 + 1e-9 * std::abs(x));
+  EXPECT_NEAR(y_jet.a, y, 1e-6 + 1e-9 * std::abs(y));
+}
+
 template <typename CameraRefracModel, typename CameraModel>
 void TestModel(const std::vector<double>& cam_params,
                const std::vector<double>& refrac_params) {
@@ -111,6 +162,8 @@ void TestModel(const std::vector<double>& cam_params,
       for (double w = 0.5; w <= 5.5; w += 0.2) {
         TestCamToCamFromImg<CameraRefracModel, CameraModel>(
             cam_params, refrac_params, u, v, w);
+        TestIterativeProjection<CameraRefracModel, CameraModel>(
+            cam_params, refrac_params, u, v, w);
       }
     }
   }
@@ -126,6 +179,92 @@ void TestModel(const std::vector<double>& cam_params,
   }
 }
 
+template <typename CameraRefracModel, typename CameraModel>
+void TestCamFromImgBatch(const std::vector<double>& cam_params,
+                         const std::vector<double>& refrac_params) {
+  std::vector<Eigen::Vector2d> points2D;
+  for (int i = 0; i < 100; ++i) {
+    points2D.emplace_back(RandomUniformReal(0.0, 5568.0),
+                          RandomUniformReal(0.0, 4176.0));
+  }
+  Ray3DBatch rays;
+  CameraRefracModelCamFromImgBatch(CameraModel::model_id,
+                                   CameraRefracModel::refrac_model_id,
+                                   cam_params,
+                                   refrac_params,
+                                   points2D,
+                                   &rays);
+  ASSERT_EQ(rays.Size(), points2D.size());
+  for (size_t i = 0; i < points2D.size(); ++i) {
+    const Ray3D ray =
+        CameraRefracModelCamFromImg(CameraModel::model_id,
+                                    CameraRefracModel::refrac_model_id,
+                                    cam_params,
+                                    refrac_params,
+                                    points2D[i]);
+    EXPECT_LT((rays.Ray(i).ori - ray.ori).norm(), 1e-12);
+    EXPECT_LT((rays.Ray(i).dir - ray.dir).norm(), 1e-12);
+  }
+}
+
+template <typename CameraRefracModel, typename CameraModel>
+void TestKernel(const std::vector<double>& cam_params,
+                const std::vector<double>& refrac_params) {
+  const CameraRefracKernel kernel =
+      CameraRefracModelKernel(CameraModel::model_id,
+                              CameraRefracModel::refrac_model_id,
+                              cam_params,
+                              refrac_params);
+  const double d = 2.0;
+  std::vector<Eigen::Vector2d> points2D;
+  for (int i = 0; i < 100; ++i) {
+    points2D.emplace_back(RandomUniformReal(0.0, 5568.0),
+                          RandomUniformReal(0.0, 4176.0));
+  }
+
+  std::vector<Ray3D> rays(points2D.size());
+  kernel.CamFromImg(points2D.size(), points2D.data(), rays.data());
+  std::vector<Eigen::Vector3d> points3D(points2D.size());
+  kernel.CamFromImgPoint(points2D.size(), points2D.data(), d, points3D.data());
+  std::vector<Eigen::Vector2d> proj_points2D(points2D.size());
+  kernel.ImgFromCam(points3D.size(), points3D.data(), proj_points2D.data());
+  std::vector<Eigen::Vector2d> refined_points2D = points2D;
+  kernel.RefineImgFromCam(
+      points3D.size(), points3D.data(), refined_points2D.data());
+
+  for (size_t i = 0; i < points2D.size(); ++i) {
+    const Ray3D ray =
+        CameraRefracModelCamFromImg(CameraModel::model_id,
+                                    CameraRefracModel::refrac_model_id,
+                                    cam_params,
+                                    refrac_params,
+                                    points2D[i]);
+    EXPECT_EQ(rays[i].ori, ray.ori);
+    EXPECT_EQ(rays[i].dir, ray.dir);
+    EXPECT_EQ(kernel.CamFromImg(points2D[i]).dir, ray.dir);
+
+    const Eigen::Vector3d point3D =
+        CameraRefracModelCamFromImgPoint(CameraModel::model_id,
+                                         CameraRefracModel::refrac_model_id,
+                                         cam_params,
+                                         refrac_params,
+                                         points2D[i],
+                                         d);
+    EXPECT_EQ(points3D[i], point3D);
+    EXPECT_EQ(kernel.CamFromImgPoint(points2D[i], d), point3D);
+
+    const Eigen::Vector2d proj_point2D =
+        CameraRefracModelImgFromCam(CameraModel::model_id,
+                                    CameraRefracModel::refrac_model_id,
+                                    cam_params,
+                                    refrac_params,
+                                    point3D);
+    EXPECT_EQ(proj_points2D[i], proj_point2D);
+    EXPECT_EQ(kernel.ImgFromCam(point3D), proj_point2D);
+    EXPECT_LT((refined_points2D[i] - points2D[i]).norm(), 1e-6);
+  }
+}
+
 TEST(FlatPort, Nominal) {
   std::vector<double> cam_params = {3200.484,
                                     3200.917,
@@ -149,6 +288,68 @@ TEST(FlatPort, Nominal) {
                                        1.473,
                                        1.333};
   TestModel<FlatPort, OpenCVCameraModel>(cam_params, refrac_params);
+  TestCamFromImgBatch<FlatPort, OpenCVCameraModel>(cam_params, refrac_params);
+  TestKernel<FlatPort, OpenCVCameraModel>(cam_params, refrac_params);
+}
+
+void TestFlatPortAxial(const std::vector<double>& cam_params,
+                       const std::vector<double>& refrac_params) {
+  TestModel<FlatPort, OpenCVCameraModel>(cam_params, refrac_params);
+
+  // The closed-form projection must agree with the Newton iteration.
+  // NOLINTNEXTLINE(clang-analyzer-security.FloatLoopCounter)
+  for (double u = -0.5; u <= 0.5; u += 0.1) {
+    // NOLINTNEXTLINE(clang-analyzer-security.FloatLoopCounter)
+    for (double v = -0.5; v <= 0.5; v += 0.1) {
+      // NOLINTNEXTLINE(clang-analyzer-security.FloatLoopCounter)
+      for (double w = 0.5; w <= 5.5; w += 0.2) {
+        double x, y;
+        EXPECT_TRUE(FlatPort::AxialImgFromCam<OpenCVCameraModel>(
+            cam_params.data(), refrac_params.data(), u, v, w, &x, &y));
+        double x_iter, y_iter;
+        OpenCVCameraModel::ImgFromCam(
+            cam_params.data(), u, v, w, &x_iter, &y_iter);
+        FlatPort::IterativeProjection<OpenCVCameraModel>(cam_params.data(),
+                                                         refrac_params.data(),
+                                                         u,
+                                                         v,
+                                                         w,
+                                                         &x_iter,
+                                                         &y_iter);
+        EXPECT_NEAR(x, x_iter, 1e-6);
+        EXPECT_NEAR(y, y_iter, 1e-6);
+      }
+    }
+  }
+
+  // Points in front of the interface are not handled by the fast path.
+  double x, y;
+  EXPECT_FALSE(FlatPort::AxialImgFromCam<OpenCVCameraModel>(
+      cam_params.data(), refrac_params.data(), 0.0, 0.0, 0.01, &x, &y));
+
+  // Tilted interfaces are not handled by the fast path.
+  std::vector<double> tilted_refrac_params = refrac_params;
+  tilted_refrac_params[0] = 0.1;
+  tilted_refrac_params[2] = std::sqrt(1 - 0.1 * 0.1);
+  EXPECT_FALSE(FlatPort::AxialImgFromCam<OpenCVCameraModel>(
+      cam_params.data(), tilted_refrac_params.data(), 0.1, 0.1, 1, &x, &y));
+}
+
+TEST(FlatPort, AxisAligned) {
+  std::vector<double> cam_params = {3200.484,
+                                    3200.917,
+                                    2790.172,
+                                    2108.726,
+                                    -0.233072717236466,
+                                    0.065022474710061,
+                                    1.008118149931866e-06,
+                                    -2.863880315774651e-05};
+  TestFlatPortAxial(cam_params,
+                    {0.0, 0.0, 1.0, 0.05, 0.007, 1.003, 1.473, 1.333});
+  TestFlatPortAxial(cam_params,
+                    {0.0, 0.0, 1.0, 0.05, 0.0, 1.003, 1.473, 1.333});
+  TestFlatPortAxial(cam_params,
+                    {0.0, 0.0, 1.0, 0.05, 0.007, 1.003, 1.333, 1.333});
 }
 
 TEST(DomePort, Case1) {
@@ -163,6 +364,8 @@ TEST(DomePort, Case1) {
   std::vector<double> refrac_params = {
       0.00042007, 0.00366894, 0.0283927, 0.05, 0.007, 1.003, 1.473, 1.333};
   TestModel<DomePort, OpenCVCameraModel>(cam_params, refrac_params);
+  TestCamFromImgBatch<DomePort, OpenCVCameraModel>(cam_params, refrac_params);
+  TestKernel<DomePort, OpenCVCameraModel>(cam_params, refrac_params);
 }
 
 TEST(DomePort, Case2) {
@@ -177,6 +380,8 @@ TEST(DomePort, Case2) {
   std::vector<double> refrac_params = {
       0.0342007, 0.0366894, 0.0083927, 0.1, 0.007, 1.003, 1.523, 1.333};
   TestModel<DomePort, OpenCVCameraModel>(cam_params, refrac_params);
+  TestCamFromImgBatch<DomePort, OpenCVCameraModel>(cam_params, refrac_params);
+  TestKernel<DomePort, OpenCVCameraModel>(cam_params, refrac_params);
 }
 
 TEST(DomePort, Case3) {
@@ -191,6 +396,161 @@ TEST(DomePort, Case3) {
   std::vector<double> refrac_params = {
       0.0, 0.0, 0.0, 0.1, 0.007, 1.003, 1.523, 1.333};
   TestModel<DomePort, OpenCVCameraModel>(cam_params, refrac_params);
+  TestCamFromImgBatch<DomePort, OpenCVCameraModel>(cam_params, refrac_params);
+  TestKernel<DomePort, OpenCVCameraModel>(cam_params, refrac_params);
+}
+
+TEST(DomePort, Centered) {
+  const std::vector<double> cam_params = {
+      3200.484, 3200.917, 2790.172, 2108.726, -0.233, 0.065, 1e-6, -2.9e-05};
+  const std::vector<double> refrac_params = {
+      0.0, 0.0, 0.0, 0.1, 0.007, 1.003, 1.523, 1.333};
+  EXPECT_TRUE(DomePort::IsCentered(refrac_params.data()));
+  const std::vector<double> decentered_refrac_params = {
+      0.0, 0.0, 1e-4, 0.1, 0.007, 1.003, 1.523, 1.333};
+  EXPECT_FALSE(DomePort::IsCentered(decentered_refrac_params.data()));
+
+  // An optimized center is never considered centered.
+  typedef ceres::Jet<double, 3> JetT;
+  JetT refrac_params_jet[3] = {JetT(0.0, 0), JetT(0.0, 1), JetT(0.0, 2)};
+  EXPECT_FALSE(DomePort::IsCentered(refrac_params_jet));
+  refrac_params_jet[0] = refrac_params_jet[1] = refrac_params_jet[2] = JetT(0);
+  EXPECT_TRUE(DomePort::IsCentered(refrac_params_jet));
+
+  // The projection reduces to the perspective camera model.
+  const Eigen::Vector3d uvw(0.4, -0.3, 2.0);
+  double x, y;
+  OpenCVCameraModel::ImgFromCam(
+      cam_params.data(), uvw.x(), uvw.y(), uvw.z(), &x, &y);
+  const Eigen::Vector2d xy =
+      CameraRefracModelImgFromCam(OpenCVCameraModel::model_id,
+                                  DomePort::refrac_model_id,
+                                  cam_params,
+                                  refrac_params,
+                                  uvw);
+  EXPECT_EQ(xy.x(), x);
+  EXPECT_EQ(xy.y(), y);
+  const Ray3D ray = CameraRefracModelCamFromImg(OpenCVCameraModel::model_id,
+                                                DomePort::refrac_model_id,
+                                                cam_params,
+                                                refrac_params,
+                                                xy);
+  EXPECT_LT(ray.ori.norm(), 1e-12);
+  EXPECT_LT((ray.dir - uvw.normalized()).norm(), 1e-6);
+}
+
+TEST(MultiLayerFlatPort, Nominal) {
+  std::vector<double> cam_params = {3200.484,
+                                    3200.917,
+                                    2790.172,
+                                    2108.726,
+                                    -0.233072717236466,
+                                    0.065022474710061,
+                                    1.008118149931866e-06,
+                                    -2.863880315774651e-05};
+  Eigen::Vector3d int_normal(RandomUniformReal(-0.1, 0.1),
+                             RandomUniformReal(-0.1, 0.1),
+                             RandomUniformReal(0.9, 1.1));
+  int_normal.normalize();
+
+  // Acrylic port with an anti-reflective coating.
+  const std::vector<double> refrac_params_2l = {int_normal(0),
+                                                int_normal(1),
+                                                int_normal(2),
+                                                0.05,
+                                                0.0005,
+                                                0.007,
+                                                1.003,
+                                                1.38,
+                                                1.49,
+                                                1.333};
+  EXPECT_EQ(FlatPort2L::num_params, 10);
+  EXPECT_EQ(FlatPort2L::refrac_model_name, "FLATPORT_2L");
+  TestModel<FlatPort2L, OpenCVCameraModel>(cam_params, refrac_params_2l);
+  TestCamFromImgBatch<FlatPort2L, OpenCVCameraModel>(cam_params,
+                                                     refrac_params_2l);
+  TestKernel<FlatPort2L, OpenCVCameraModel>(cam_params, refrac_params_2l);
+
+  // Two glass plates enclosing a dry gap.
+  const std::vector<double> refrac_params_3l = {int_normal(0),
+                                                int_normal(1),
+                                                int_normal(2),
+                                                0.05,
+                                                0.004,
+                                                0.01,
+                                                0.004,
+                                                1.003,
+                                                1.473,
+                                                1.0,
+                                                1.473,
+                                                1.333};
+  EXPECT_EQ(FlatPort3L::num_params, 12);
+  EXPECT_EQ(FlatPort3L::refrac_model_name, "FLATPORT_3L");
+  TestModel<FlatPort3L, OpenCVCameraModel>(cam_params, refrac_params_3l);
+  TestCamFromImgBatch<FlatPort3L, OpenCVCameraModel>(cam_params,
+                                                     refrac_params_3l);
+  TestKernel<FlatPort3L, OpenCVCameraModel>(cam_params, refrac_params_3l);
+}
+
+TEST(MultiLayerFlatPort, EquivalentFlatPort) {
+  Eigen::Vector3d int_normal(RandomUniformReal(-0.1, 0.1),
+                             RandomUniformReal(-0.1, 0.1),
+                             RandomUniformReal(0.9, 1.1));
+  int_normal.normalize();
+  const std::vector<double> refrac_params = {int_normal(0),
+                                             int_normal(1),
+                                             int_normal(2),
+                                             0.05,
+                                             0.007,
+                                             1.003,
+                                             1.473,
+                                             1.333};
+
+  // Splitting the glass into layers with the same refractive index must not
+  // change the refracted rays.
+  const std::vector<double> refrac_params_2l = {int_normal(0),
+                                                int_normal(1),
+                                                int_normal(2),
+                                                0.05,
+                                                0.003,
+                                                0.004,
+                                                1.003,
+                                                1.473,
+                                                1.473,
+                                                1.333};
+  const std::vector<double> refrac_params_3l = {int_normal(0),
+                                                int_normal(1),
+                                                int_normal(2),
+                                                0.05,
+                                                0.002,
+                                                0.001,
+                                                0.004,
+                                                1.003,
+                                                1.473,
+                                                1.473,
+                                                1.473,
+                                                1.333};
+
+  for (int i = 0; i < 100; ++i) {
+    const Eigen::Vector3d dir(RandomUniformReal(-0.5, 0.5),
+                              RandomUniformReal(-0.5, 0.5),
+                              1.0);
+    Eigen::Vector3d ori = Eigen::Vector3d::Zero();
+    Eigen::Vector3d refrac_dir = dir.normalized();
+    FlatPort::RefractRay(refrac_params.data(), &ori, &refrac_dir);
+
+    Eigen::Vector3d ori_2l = Eigen::Vector3d::Zero();
+    Eigen::Vector3d refrac_dir_2l = dir.normalized();
+    FlatPort2L::RefractRay(refrac_params_2l.data(), &ori_2l, &refrac_dir_2l);
+    EXPECT_LT((ori_2l - ori).norm(), 1e-12);
+    EXPECT_LT((refrac_dir_2l - refrac_dir).norm(), 1e-12);
+
+    Eigen::Vector3d ori_3l = Eigen::Vector3d::Zero();
+    Eigen::Vector3d refrac_dir_3l = dir.normalized();
+    FlatPort3L::RefractRay(refrac_params_3l.data(), &ori_3l, &refrac_dir_3l);
+    EXPECT_LT((ori_3l - ori).norm(), 1e-12);
+    EXPECT_LT((refrac_dir_3l - refrac_dir).norm(), 1e-12);
+  }
 }
 
-}  // namespace colmap
\ No newline at end of file
+}  // namespace colmap
@@ -1,6 +1,26 @@
 #include "colmap/sensor/ray3d.h"
 
+#include <limits>
+
 namespace colmap {
+namespace {
+
+// Dot products of the rows of `a` with the vector `b`.
+Eigen::ArrayXd RowwiseDot(const Eigen::ArrayX3d& a, const Eigen::Vector3d& b) {
+  return a.col(0) * b(0) + a.col(1) * b(1) + a.col(2) * b(2);
+}
+
+// Dot products of the corresponding rows of `a` and `b`.
+Eigen::ArrayXd RowwiseDot(const Eigen::ArrayX3d& a, const Eigen::ArrayX3d& b) {
+  return a.col(0) * b.col(0) + a.col(1) * b.col(1) + a.col(2) * b.col(2);
+}
+
+void NormalizeRows(Eigen::ArrayX3d* v) {
+  const Eigen::ArrayXd norms = RowwiseDot(*v, *v).sqrt();
+  v->colwise() /= norms;
+}
+
+}  // namespace
 
 Ray3D::Ray3D()
     : ori(Eigen::Vector3d::Zero()), dir(Eigen::Vector3d(0.0, 0.0, 1.0)) {}
@@ -11,4 +31,132 @@ Ray3D::Ray3D(const Eigen::Vector3d& ori, const Eigen::Vector3d& dir)
 Eigen::Vector3d Ray3D::At(const double distance) const {
   return ori + dir * distance;
 }
+
+Ray3DBatch::Ray3DBatch(const Eigen::Index num_rays) { Resize(num_rays); }
+
+Eigen::Index Ray3DBatch::Size() const { return oris.rows(); }
+
+void Ray3DBatch::Resize(const Eigen::Index num_rays) {
+  oris.resize(num_rays, 3);
+  dirs.resize(num_rays, 3);
+}
+
+Ray3D Ray3DBatch::Ray(const Eigen::Index idx) const {
+  Ray3D ray;
+  ray.ori = oris.row(idx).transpose();
+  ray.dir = dirs.row(idx).transpose();
+  return ray;
+}
+
+void Ray3DBatch::SetRay(const Eigen::Index idx, const Ray3D& ray) {
+  oris.row(idx) = ray.ori.transpose();
+  dirs.row(idx) = ray.dir.transpose();
+}
+
+void ComputeRefractionBatch(const Eigen::Vector3d& normal,
+                            const double n1,
+                            const double n2,
+                            Eigen::ArrayX3d* v) {
+  if (n1 == n2) return;
+
+  const double r = n1 / n2;
+  const Eigen::ArrayXd c = RowwiseDot(*v, normal);
+  const Eigen::ArrayXd scale =
+      r * c - (1.0 - r * r * (1.0 - c.square())).sqrt();
+  for (int k = 0; k < 3; ++k) {
+    v->col(k) = r * v->col(k) - scale * normal(k);
+  }
+  NormalizeRows(v);
+}
+
+void ComputeRefractionBatch(const Eigen::ArrayX3d& normals,
+                            const double n1,
+                            const double n2,
+                            Eigen::ArrayX3d* v) {
+  if (n1 == n2) return;
+
+  const double r = n1 / n2;
+  const Eigen::ArrayXd c = RowwiseDot(*v, normals);
+  const Eigen::ArrayXd scale =
+      r * c - (1.0 - r * r * (1.0 - c.square())).sqrt();
+  for (int k = 0; k < 3; ++k) {
+    v->col(k) = r * v->col(k) - scale * normals.col(k);
+  }
+  NormalizeRows(v);
+}
+
+void RaySphereIntersectionBatch(
+    const Eigen::ArrayX3d& ray_oris,
+    const Eigen::ArrayX3d& ray_dirs,
+    const Eigen::Vector3d& center,
+    const double r,
+    Eigen::ArrayXd* dmin,
+    Eigen::ArrayXd* dmax,
+    Eigen::Array<bool, Eigen::Dynamic, 1>* is_intersect) {
+  const Eigen::ArrayX3d diff =
+      (-ray_oris).rowwise() + center.transpose().array();
+  const Eigen::ArrayXd t0 = RowwiseDot(diff, ray_dirs);
+  const Eigen::ArrayXd d_squared = RowwiseDot(diff, diff) - t0.square();
+  *is_intersect = d_squared <= r * r;
+  const Eigen::ArrayXd t1 = (r * r - d_squared).max(0.0).sqrt();
+  *dmin = is_intersect->select(t0 - t1, 0.0);
+  *dmax = is_intersect->select(t0 + t1, 0.0);
+}
+
+void RayPlaneIntersectionBatch(
+    const Eigen::ArrayX3d& ray_oris,
+    const Eigen::ArrayX3d& ray_dirs,
+    const Eigen::Vector3d& normal,
+    const double dist,
+    Eigen::ArrayXd* d,
+    Eigen::Array<bool, Eigen::Dynamic, 1>* is_intersect) {
+  const double p0_dot_normal = dist * normal.squaredNorm();
+  const Eigen::ArrayXd denom = RowwiseDot(ray_dirs, normal);
+  *is_intersect = denom.abs() >= std::numeric_limits<double>::epsilon();
+  *d = is_intersect->select(
+      (p0_dot_normal - RowwiseDot(ray_oris, normal)) / denom, 0.0);
+}
+
+void IntersectLinesWithToleranceBatch(
+    const Eigen::Vector3d& origin1,
+    const Eigen::Vector3d& dir1,
+    const Eigen::ArrayX3d& origins2,
+    const Eigen::ArrayX3d& dirs2,
+    Eigen::ArrayX3d* intersections,
+    Eigen::Array<bool, Eigen::Dynamic, 1>* is_intersect,
+    const double tolerance) {
+  const Eigen::ArrayX3d o = (-origins2).rowwise() + origin1.transpose().array();
+  const double a = dir1.dot(dir1);
+  const Eigen::ArrayXd b = RowwiseDot(dirs2, dir1);
+  const Eigen::ArrayXd c = RowwiseDot(dirs2, dirs2);
+  const Eigen::ArrayXd d = RowwiseDot(o, dir1);
+  const Eigen::ArrayXd e = RowwiseDot(dirs2, o);
+  const Eigen::ArrayXd denom = b * b - a * c;
+  const Eigen::ArrayXd s = (c * d - b * e) / denom;
+  const Eigen::ArrayXd t = (b * d - a * e) / denom;
+
+  Eigen::ArrayX3d midpoints(origins2.rows(), 3);
+  Eigen::ArrayX3d diff(origins2.rows(), 3);
+  for (int k = 0; k < 3; ++k) {
+    const Eigen::ArrayXd pa = origin1(k) + s * dir1(k);
+    diff.col(k) = origins2.col(k) + t * dirs2.col(k) - pa;
+    midpoints.col(k) = pa + 0.5 * diff.col(k);
+  }
+
+  // Parallel lines intersect at the origin of the first line.
+  const Eigen::Array<bool, Eigen::Dynamic, 1> is_parallel =
+      denom.abs() <= std::numeric_limits<double>::epsilon();
+  const Eigen::Array<bool, Eigen::Dynamic, 1> is_close =
+      RowwiseDot(diff, diff).sqrt() < tolerance;
+  *is_intersect = is_parallel || is_close;
+
+  // The intersections of the other lines are undefined and set to NaN.
+  intersections->resize(origins2.rows(), 3);
+  for (int k = 0; k < 3; ++k) {
+    intersections->col(k) = is_parallel.select(
+        origin1(k),
+        is_close.select(midpoints.col(k),
+                        std::numeric_limits<double>::quiet_NaN()));
+  }
+}
 }  // namespace colmap
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <ceres/ceres.h>
+#include <Eigen/Core>
 
 namespace colmap {
 
@@ -20,6 +21,26 @@ struct Ray3D {
   Eigen::Vector3d dir;
 };
 
+// Batch of 3D rays stored as structure-of-arrays. Each column of `oris` and
+// `dirs` holds one coordinate of all rays, so that the batched functions below
+// process packs of rays with vectorized Eigen array expressions.
+struct Ray3DBatch {
+  Ray3DBatch() = default;
+  explicit Ray3DBatch(Eigen::Index num_rays);
+
+  Eigen::Index Size() const;
+  void Resize(Eigen::Index num_rays);
+
+  Ray3D Ray(Eigen::Index idx) const;
+  void SetRay(Eigen::Index idx, const Ray3D& ray);
+
+  // The 3D positions of the ray origins as rows.
+  Eigen::ArrayX3d oris;
+
+  // The 3D unit direction vectors of the rays as rows.
+  Eigen::ArrayX3d dirs;
+};
+
 // Compute ray refraction accroding to Snell's law
 // (note that the total reflection case is not handled here, if there is a total
 // reflection event happening, the refracted ray will become (-nan -nan -nan))
@@ -68,6 +89,54 @@ inline T PointToRayDistance(const Eigen::Matrix<T, 3, 1>& point,
                             const Eigen::Matrix<T, 3, 1>& ray_ori,
                             const Eigen::Matrix<T, 3, 1>& ray_dir);
 
+// Batched variants of the above functions for double precision.
+//
+// The rays are given as rows of structure-of-arrays and the semantics are the
+// same as for the corresponding single ray functions. Instead of an early
+// return, the batched intersection functions report per ray whether an
+// intersection exists and set the distances of rays without intersection to
+// zero.
+
+// Refract the ray directions `v` at an interface with a common normal.
+void ComputeRefractionBatch(const Eigen::Vector3d& normal,
+                            double n1,
+                            double n2,
+                            Eigen::ArrayX3d* v);
+
+// Refract the ray directions `v` at an interface with per-ray normals.
+void ComputeRefractionBatch(const Eigen::ArrayX3d& normals,
+                            double n1,
+                            double n2,
+                            Eigen::ArrayX3d* v);
+
+void RaySphereIntersectionBatch(
+    const Eigen::ArrayX3d& ray_oris,
+    const Eigen::ArrayX3d& ray_dirs,
+    const Eigen::Vector3d& center,
+    double r,
+    Eigen::ArrayXd* dmin,
+    Eigen::ArrayXd* dmax,
+    Eigen::Array<bool, Eigen::Dynamic, 1>* is_intersect);
+
+void RayPlaneIntersectionBatch(
+    const Eigen::ArrayX3d& ray_oris,
+    const Eigen::ArrayX3d& ray_dirs,
+    const Eigen::Vector3d& normal,
+    double dist,
+    Eigen::ArrayXd* d,
+    Eigen::Array<bool, Eigen::Dynamic, 1>* is_intersect);
+
+// Intersect a common line with a batch of lines. The intersections of lines
+// which do not intersect within the tolerance are set to NaN.
+void IntersectLinesWithToleranceBatch(
+    const Eigen::Vector3d& origin1,
+    const Eigen::Vector3d& dir1,
+    const Eigen::ArrayX3d& origins2,
+    const Eigen::ArrayX3d& dirs2,
+    Eigen::ArrayX3d* intersections,
+    Eigen::Array<bool, Eigen::Dynamic, 1>* is_intersect,
+    double tolerance = 1e-8);
+
 ////////////////////////////////////////////////////////////////////////////////
 // Implementation
 ////////////////////////////////////////////////////////////////////////////////
@@ -116,4 +116,141 @@ TEST(Ray3D, PointToRayDistanceNaive) {
   EXPECT_EQ(d3, 4.2);
 }
 
-}  // namespace colmap
\ No newline at end of file
+Ray3DBatch RandomRay3DBatch(const Eigen::Index num_rays) {
+  Ray3DBatch rays(num_rays);
+  for (Eigen::Index i = 0; i < num_rays; ++i) {
+    rays.SetRay(i,
+                Ray3D(Eigen::Vector3d(RandomUniformReal(-0.5, 0.5),
+                                      RandomUniformReal(-0.5, 0.5),
+                                      RandomUniformReal(-0.5, 0.5)),
+                      Eigen::Vector3d(RandomUniformReal(-0.5, 0.5),
+                                      RandomUniformReal(-0.5, 0.5),
+                                      1.0)));
+  }
+  return rays;
+}
+
+TEST(Ray3DBatch, Basic) {
+  Ray3DBatch rays;
+  EXPECT_EQ(rays.Size(), 0);
+  rays.Resize(3);
+  EXPECT_EQ(rays.Size(), 3);
+  const Ray3D ray(Eigen::Vector3d(1, 2, 3), Eigen::Vector3d(0, 0, 2));
+  rays.SetRay(1, ray);
+  EXPECT_EQ(rays.Ray(1).ori, ray.ori);
+  EXPECT_EQ(rays.Ray(1).dir, ray.dir);
+}
+
+TEST(Ray3DBatch, ComputeRefraction) {
+  const Ray3DBatch rays = RandomRay3DBatch(100);
+  const Eigen::Vector3d normal = Eigen::Vector3d(0.1, -0.2, 1.0).normalized();
+  Eigen::ArrayX3d normals(rays.Size(), 3);
+  for (Eigen::Index i = 0; i < rays.Size(); ++i) {
+    normals.row(i) = rays.oris.row(i) / rays.oris.matrix().row(i).norm();
+  }
+
+  Eigen::ArrayX3d dirs = rays.dirs;
+  ComputeRefractionBatch(normal, 1.0, 1.5, &dirs);
+  Eigen::ArrayX3d dirs_normals = rays.dirs;
+  ComputeRefractionBatch(normals, 1.0, 1.5, &dirs_normals);
+  for (Eigen::Index i = 0; i < rays.Size(); ++i) {
+    Eigen::Vector3d dir = rays.Ray(i).dir;
+    ComputeRefraction(normal, 1.0, 1.5, &dir);
+    EXPECT_LT((dirs.row(i).matrix().transpose() - dir).norm(), 1e-12);
+
+    Eigen::Vector3d dir_normal = rays.Ray(i).dir;
+    ComputeRefraction<double>(
+        normals.row(i).matrix().transpose(), 1.0, 1.5, &dir_normal);
+    EXPECT_LT((dirs_normals.row(i).matrix().transpose() - dir_normal).norm(),
+              1e-12);
+  }
+}
+
+TEST(Ray3DBatch, RaySphereIntersection) {
+  const Ray3DBatch rays = RandomRay3DBatch(100);
+  const Eigen::Vector3d center(0.1, 0.2, 2.0);
+  const double r = 1.0;
+  Eigen::ArrayXd dmin, dmax;
+  Eigen::Array<bool, Eigen::Dynamic, 1> is_intersect;
+  RaySphereIntersectionBatch(
+      rays.oris, rays.dirs, center, r, &dmin, &dmax, &is_intersect);
+  int num_intersects = 0;
+  for (Eigen::Index i = 0; i < rays.Size(); ++i) {
+    const Ray3D ray = rays.Ray(i);
+    double ray_dmin, ray_dmax;
+    const bool is_ray_intersect = RaySphereIntersection(
+        ray.ori, ray.dir, center, r, &ray_dmin, &ray_dmax);
+    EXPECT_EQ(is_intersect(i), is_ray_intersect);
+    if (is_ray_intersect) {
+      ++num_intersects;
+      EXPECT_NEAR(dmin(i), ray_dmin, 1e-12);
+      EXPECT_NEAR(dmax(i), ray_dmax, 1e-12);
+    } else {
+      EXPECT_EQ(dmin(i), 0);
+      EXPECT_EQ(dmax(i), 0);
+    }
+  }
+  EXPECT_GT(num_intersects, 0);
+  EXPECT_LT(num_intersects, rays.Size());
+}
+
+TEST(Ray3DBatch, RayPlaneIntersection) {
+  Ray3DBatch rays = RandomRay3DBatch(100);
+  // Ray parallel to the plane.
+  rays.SetRay(0, Ray3D(Eigen::Vector3d::Zero(), Eigen::Vector3d(1, 0, 0)));
+  const Eigen::Vector3d normal(0, 0, 1);
+  Eigen::ArrayXd d;
+  Eigen::Array<bool, Eigen::Dynamic, 1> is_intersect;
+  RayPlaneIntersectionBatch(
+      rays.oris, rays.dirs, normal, 1.0, &d, &is_intersect);
+  EXPECT_FALSE(is_intersect(0));
+  EXPECT_EQ(d(0), 0);
+  for (Eigen::Index i = 1; i < rays.Size(); ++i) {
+    const Ray3D ray = rays.Ray(i);
+    double ray_d;
+    EXPECT_TRUE(RayPlaneIntersection(ray.ori, ray.dir, normal, 1.0, &ray_d));
+    EXPECT_TRUE(is_intersect(i));
+    EXPECT_NEAR(d(i), ray_d, 1e-12);
+  }
+}
+
+TEST(Ray3DBatch, IntersectLinesWithTolerance) {
+  const Eigen::Vector3d origin1 = Eigen::Vector3d::Zero();
+  const Eigen::Vector3d dir1(0, 0, 1);
+  Ray3DBatch rays = RandomRay3DBatch(100);
+  // Lines through the first line.
+  for (Eigen::Index i = 0; i < rays.Size(); i += 2) {
+    const Eigen::Vector3d point(0, 0, RandomUniformReal(-1.0, 1.0));
+    rays.SetRay(i, Ray3D(point - rays.Ray(i).dir, rays.Ray(i).dir));
+  }
+  // Line parallel to the first line.
+  rays.SetRay(1, Ray3D(Eigen::Vector3d(1, 0, 0), dir1));
+
+  Eigen::ArrayX3d intersections;
+  Eigen::Array<bool, Eigen::Dynamic, 1> is_intersect;
+  IntersectLinesWithToleranceBatch(origin1,
+                                   dir1,
+                                   rays.oris,
+                                   rays.dirs,
+                                   &intersections,
+                                   &is_intersect);
+  for (Eigen::Index i = 0; i < rays.Size(); ++i) {
+    const Ray3D ray = rays.Ray(i);
+    Eigen::Vector3d intersection;
+    EXPECT_EQ(is_intersect(i),
+              IntersectLinesWithTolerance<double>(
+                  origin1, dir1, ray.ori, ray.dir, intersection));
+    if (is_intersect(i)) {
+      EXPECT_LT(
+          (intersections.row(i).matrix().transpose() - intersection).norm(),
+          1e-12);
+    } else {
+      EXPECT_TRUE(intersections.row(i).isNaN().all());
+    }
+  }
+  EXPECT_TRUE(is_intersect(0));
+  EXPECT_TRUE(is_intersect(1));
+  EXPECT_FALSE(is_intersect(3));
+}
+
+}  // namespace colmap
@@ -0,0 +1,183 @@
+#include "colmap/sensor/refrac_projection_table.h"
+
+#include "colmap/util/logging.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace colmap {
+
+bool RefracProjectionTableOptions::Check() const {
+  CHECK_OPTION_GE(num_dir_samples, 2);
+  CHECK_OPTION_GE(num_depth_samples, 2);
+  CHECK_OPTION_GT(min_depth, 0);
+  CHECK_OPTION_GT(max_depth, min_depth);
+  return true;
+}
+
+void RefracProjectionTable::Build(const RefracProjectionTableOptions& options,
+                                  const CameraModelId model_id,
+                                  const CameraRefracModelId refrac_model_id,
+                                  const size_t width,
+                                  const size_t height,
+                                  const std::vector<double>& cam_params,
+                                  const std::vector<double>& refrac_params) {
+  CHECK(options.Check());
+  CHECK_GT(width, 0);
+  CHECK_GT(height, 0);
+
+  model_id_ = model_id;
+  refrac_model_id_ = refrac_model_id;
+  cam_params_ = cam_params;
+  refrac_params_ = refrac_params;
+  num_dir_samples_ = options.num_dir_samples;
+  num_depth_samples_ = options.num_depth_samples;
+  min_inv_depth_ = 1.0 / options.max_depth;
+  max_inv_depth_ = 1.0 / options.min_depth;
+
+  // Determine the bounds of the viewing directions by back-projecting the
+  // image border at the minimum and maximum depth.
+  min_dir_.setConstant(std::numeric_limits<double>::max());
+  max_dir_.setConstant(std::numeric_limits<double>::lowest());
+  const int kNumBorderSamples = 32;
+  for (int n = 0; n <= kNumBorderSamples; ++n) {
+    const double t = static_cast<double>(n) / kNumBorderSamples;
+    const double x = t * width;
+    const double y = t * height;
+    for (const Eigen::Vector2d& point2D : {Eigen::Vector2d(x, 0),
+                                           Eigen::Vector2d(x, height),
+                                           Eigen::Vector2d(0, y),
+                                           Eigen::Vector2d(width, y)}) {
+      for (const double depth : {options.min_depth, options.max_depth}) {
+        const Eigen::Vector3d uvw =
+            CameraRefracModelCamFromImgPoint(model_id,
+                                             refrac_model_id,
+                                             cam_params,
+                                             refrac_params,
+                                             point2D,
+                                             depth);
+        if (!uvw.allFinite() || uvw.z() <= 0) {
+          continue;
+        }
+        const Eigen::Vector2d dir = uvw.hnormalized();
+        min_dir_ = min_dir_.cwiseMin(dir);
+        max_dir_ = max_dir_.cwiseMax(dir);
+      }
+    }
+  }
+
+  samples_.clear();
+  if ((max_dir_.array() <= min_dir_.array()).any()) {
+    LOG(WARNING) << "Failed to determine the field of view of the refractive "
+                    "camera, the projection table is left empty";
+    return;
+  }
+
+  dir_step_ = (max_dir_ - min_dir_) / (num_dir_samples_ - 1);
+  inv_depth_step_ =
+      (max_inv_depth_ - min_inv_depth_) / (num_depth_samples_ - 1);
+
+  samples_.resize(static_cast<size_t>(num_depth_samples_) * num_dir_samples_ *
+                  num_dir_samples_);
+  for (int k = 0; k < num_depth_samples_; ++k) {
+    const double depth = 1.0 / (min_inv_depth_ + k * inv_depth_step_);
+    for (int j = 0; j < num_dir_samples_; ++j) {
+      for (int i = 0; i < num_dir_samples_; ++i) {
+        const Eigen::Vector3d dir(min_dir_.x() + i * dir_step_.x(),
+                                  min_dir_.y() + j * dir_step_.y(),
+                                  1);
+        samples_[Index(i, j, k)] =
+            CameraRefracModelImgFromCam(model_id,
+                                        refrac_model_id,
+                                        cam_params,
+                                        refrac_params,
+                                        depth * dir.normalized());
+      }
+    }
+  }
+}
+
+bool RefracProjectionTable::IsValidFor(
+    const CameraModelId model_id,
+    const CameraRefracModelId refrac_model_id,
+    const std::vector<double>& cam_params,
+    const std::vector<double>& refrac_params) const {
+  return !samples_.empty() && model_id == model_id_ &&
+         refrac_model_id == refrac_model_id_ && cam_params == cam_params_ &&
+         refrac_params == refrac_params_;
+}
+
+bool RefracProjectionTable::IsEmpty() const { return samples_.empty(); }
+
+bool RefracProjectionTable::InitialGuess(const Eigen::Vector3d& uvw,
+                                         Eigen::Vector2d* xy) const {
+  if (samples_.empty() || uvw.z() <= 0) {
+    return false;
+  }
+
+  const double norm = uvw.norm();
+  if (norm < std::numeric_limits<double>::epsilon()) {
+    return false;
+  }
+
+  const Eigen::Vector2d dir = uvw.hnormalized();
+  if ((dir.array() < min_dir_.array()).any() ||
+      (dir.array() > max_dir_.array()).any()) {
+    return false;
+  }
+
+  const double inv_depth =
+      std::min(std::max(1.0 / norm, min_inv_depth_), max_inv_depth_);
+
+  const Eigen::Vector2d grid_dir = (dir - min_dir_).cwiseQuotient(dir_step_);
+  const double grid_depth = (inv_depth - min_inv_depth_) / inv_depth_step_;
+
+  const int i0 = std::min(static_cast<int>(grid_dir.x()), num_dir_samples_ - 2);
+  const int j0 = std::min(static_cast<int>(grid_dir.y()), num_dir_samples_ - 2);
+  const int k0 =
+      std::min(static_cast<int>(grid_depth), num_depth_samples_ - 2);
+
+  const double ti = grid_dir.x() - i0;
+  const double tj = grid_dir.y() - j0;
+  const double tk = grid_depth - k0;
+
+  Eigen::Vector2d interp = Eigen::Vector2d::Zero();
+  for (int dk = 0; dk < 2; ++dk) {
+    const double wk = dk == 0 ? 1 - tk : tk;
+    for (int dj = 0; dj < 2; ++dj) {
+      const double wj = dj == 0 ? 1 - tj : tj;
+      for (int di = 0; di < 2; ++di) {
+        const double wi = di == 0 ? 1 - ti : ti;
+        interp += wi * wj * wk * samples_[Index(i0 + di, j0 + dj, k0 + dk)];
+      }
+    }
+  }
+
+  if (!interp.allFinite()) {
+    return false;
+  }
+
+  *xy = interp;
+  return true;
+}
+
+Eigen::Vector2d RefracProjectionTable::ImgFromCam(
+    const Eigen::Vector3d& uvw) const {
+  Eigen::Vector2d xy;
+  if (!InitialGuess(uvw, &xy)) {
+    return CameraRefracModelImgFromCam(
+        model_id_, refrac_model_id_, cam_params_, refrac_params_, uvw);
+  }
+  return CameraRefracModelRefineImgFromCam(
+      model_id_, refrac_model_id_, cam_params_, refrac_params_, uvw, xy);
+}
+
+size_t RefracProjectionTable::Index(const int i,
+                                    const int j,
+                                    const int k) const {
+  return (static_cast<size_t>(k) * num_dir_samples_ + j) * num_dir_samples_ +
+         i;
+}
+
+}  // namespace colmap
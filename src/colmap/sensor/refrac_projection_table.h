@@ -0,0 +1,95 @@
+#pragma once
+
+#include "colmap/sensor/models.h"
+#include "colmap/sensor/models_refrac.h"
+
+#include <vector>
+
+#include <Eigen/Core>
+
+namespace colmap {
+
+struct RefracProjectionTableOptions {
+  // Number of grid samples along the normalized x- and y-coordinates of the
+  // viewing direction.
+  int num_dir_samples = 16;
+
+  // Number of grid samples along the inverse depth.
+  int num_depth_samples = 8;
+
+  // Depth range covered by the table. Points outside of this range are
+  // clamped to the closest depth sample for the initial guess.
+  double min_depth = 0.1;
+  double max_depth = 100.0;
+
+  bool Check() const;
+};
+
+// Dense lookup table of refractive projections for a single camera.
+//
+// The table samples the refractive projection `ImgFromCam` on a regular grid
+// over the normalized viewing direction (u / w, v / w) and the inverse
+// distance 1 / |uvw| of a point in the camera frame. A trilinear interpolation
+// of the table gives an initial guess for the Newton iteration in
+// `BaseCameraRefracModel::IterativeProjection`, which then typically converges
+// in one to two iterations instead of starting from the non-refractive
+// projection. The final projection therefore has the same accuracy as the
+// direct computation.
+//
+// The table stores a copy of the parameters it was built with and it must only
+// be used for cameras with the same parameters, see `IsValidFor`.
+class RefracProjectionTable {
+ public:
+  RefracProjectionTable() = default;
+
+  // Build the table for the given camera of size `width` x `height`.
+  void Build(const RefracProjectionTableOptions& options,
+             CameraModelId model_id,
+             CameraRefracModelId refrac_model_id,
+             size_t width,
+             size_t height,
+             const std::vector<double>& cam_params,
+             const std::vector<double>& refrac_params);
+
+  // Check whether the table was built for the given camera parameters.
+  bool IsValidFor(CameraModelId model_id,
+                  CameraRefracModelId refrac_model_id,
+                  const std::vector<double>& cam_params,
+                  const std::vector<double>& refrac_params) const;
+
+  bool IsEmpty() const;
+
+  // Interpolate an initial guess for the projection of a point in the camera
+  // frame. Returns false if the point is not covered by the table.
+  bool InitialGuess(const Eigen::Vector3d& uvw, Eigen::Vector2d* xy) const;
+
+  // Project the point from the camera frame to the image plane using the
+  // interpolated initial guess and Newton refinement.
+  Eigen::Vector2d ImgFromCam(const Eigen::Vector3d& uvw) const;
+
+ private:
+  size_t Index(int i, int j, int k) const;
+
+  CameraModelId model_id_ = CameraModelId::kInvalid;
+  CameraRefracModelId refrac_model_id_ = CameraRefracModelId::kInvalid;
+  std::vector<double> cam_params_;
+  std::vector<double> refrac_params_;
+
+  int num_dir_samples_ = 0;
+  int num_depth_samples_ = 0;
+
+  // Bounds of the normalized viewing direction and the inverse depth.
+  Eigen::Vector2d min_dir_ = Eigen::Vector2d::Zero();
+  Eigen::Vector2d max_dir_ = Eigen::Vector2d::Zero();
+  double min_inv_depth_ = 0.0;
+  double max_inv_depth_ = 0.0;
+
+  // Grid step sizes.
+  Eigen::Vector2d dir_step_ = Eigen::Vector2d::Zero();
+  double inv_depth_step_ = 0.0;
+
+  // Projected image points, stored in row-major order as [depth][y][x].
+  std::vector<Eigen::Vector2d> samples_;
+};
+
+}  // namespace colmap
@@ -0,0 +1,112 @@
+#include "colmap/sensor/refrac_projection_table.h"
+
+#include "colmap/math/random.h"
+
+#include <gtest/gtest.h>
+
+namespace colmap {
+namespace {
+
+const std::vector<double> kCamParams = {3200.484,
+                                        3200.917,
+                                        2790.172,
+                                        2108.726,
+                                        -0.233072717236466,
+                                        0.065022474710061,
+                                        1.008118149931866e-06,
+                                        -2.863880315774651e-05};
+const size_t kWidth = 5568;
+const size_t kHeight = 4176;
+
+void TestTable(const CameraRefracModelId refrac_model_id,
+               const std::vector<double>& refrac_params) {
+  RefracProjectionTable table;
+  EXPECT_TRUE(table.IsEmpty());
+  table.Build(RefracProjectionTableOptions(),
+              CameraModelId::kOpenCV,
+              refrac_model_id,
+              kWidth,
+              kHeight,
+              kCamParams,
+              refrac_params);
+  EXPECT_FALSE(table.IsEmpty());
+  EXPECT_TRUE(table.IsValidFor(
+      CameraModelId::kOpenCV, refrac_model_id, kCamParams, refrac_params));
+
+  std::vector<double> other_refrac_params = refrac_params;
+  other_refrac_params[3] += 0.01;
+  EXPECT_FALSE(table.IsValidFor(CameraModelId::kOpenCV,
+                                refrac_model_id,
+                                kCamParams,
+                                other_refrac_params));
+  EXPECT_FALSE(table.IsValidFor(
+      CameraModelId::kPinhole, refrac_model_id, kCamParams, refrac_params));
+
+  for (double x = 0; x <= kWidth; x += 250.0) {
+    for (double y = 0; y <= kHeight; y += 250.0) {
+      const double d = RandomUniformReal(0.2, 10.0);
+      const Eigen::Vector2d xy(x, y);
+      const Eigen::Vector3d uvw =
+          CameraRefracModelCamFromImgPoint(CameraModelId::kOpenCV,
+                                           refrac_model_id,
+                                           kCamParams,
+                                           refrac_params,
+                                           xy,
+                                           d);
+      Eigen::Vector2d xy_guess;
+      EXPECT_TRUE(table.InitialGuess(uvw, &xy_guess));
+      EXPECT_LT((xy_guess - xy).norm(), 0.1 * kWidth);
+      EXPECT_LT((table.ImgFromCam(uvw) - xy).norm(), 1e-6);
+    }
+  }
+
+  // Points behind the camera are not covered by the table, but they are still
+  // projected using the direct computation.
+  Eigen::Vector2d xy_guess;
+  const Eigen::Vector3d uvw_behind(0.1, 0.2, -1.0);
+  EXPECT_FALSE(table.InitialGuess(uvw_behind, &xy_guess));
+  const Eigen::Vector2d xy_behind =
+      CameraRefracModelImgFromCam(CameraModelId::kOpenCV,
+                                  refrac_model_id,
+                                  kCamParams,
+                                  refrac_params,
+                                  uvw_behind);
+  const Eigen::Vector2d xy_behind_table = table.ImgFromCam(uvw_behind);
+  EXPECT_TRUE(xy_behind == xy_behind_table ||
+              (!xy_behind.allFinite() && !xy_behind_table.allFinite()));
+}
+
+TEST(RefracProjectionTable, FlatPort) {
+  Eigen::Vector3d int_normal(RandomUniformReal(-0.1, 0.1),
+                             RandomUniformReal(-0.1, 0.1),
+                             RandomUniformReal(0.9, 1.1));
+  int_normal.normalize();
+  TestTable(CameraRefracModelId::kFlatPort,
+            {int_normal(0),
+             int_normal(1),
+             int_normal(2),
+             0.05,
+             0.007,
+             1.003,
+             1.473,
+             1.333});
+}
+
+TEST(RefracProjectionTable, DomePort) {
+  TestTable(
+      CameraRefracModelId::kDomePort,
+      {0.00042007, 0.00366894, 0.0283927, 0.05, 0.007, 1.003, 1.473, 1.333});
+}
+
+TEST(RefracProjectionTableOptions, Check) {
+  RefracProjectionTableOptions options;
+  EXPECT_TRUE(options.Check());
+  options.min_depth = 0;
+  EXPECT_FALSE(options.Check());
+  options.min_depth = 1;
+  options.max_depth = 0.5;
+  EXPECT_FALSE(options.Check());
+}
+
+}  // namespace
+}  // namespace colmap
@@ -0,0 +1,123 @@
+#include "colmap/sensor/refrac_virtual_camera_table.h"
+
+#include "colmap/sensor/ray3d.h"
+#include "colmap/util/logging.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace colmap {
+
+bool RefracVirtualCameraTableOptions::Check() const {
+  CHECK_OPTION_GT(grid_step, 0);
+  return true;
+}
+
+void RefracVirtualCameraTable::Build(
+    const RefracVirtualCameraTableOptions& options,
+    const CameraModelId model_id,
+    const CameraRefracModelId refrac_model_id,
+    const size_t width,
+    const size_t height,
+    const std::vector<double>& cam_params,
+    const std::vector<double>& refrac_params) {
+  CHECK(options.Check());
+  CHECK_GT(width, 0);
+  CHECK_GT(height, 0);
+
+  model_id_ = model_id;
+  refrac_model_id_ = refrac_model_id;
+  cam_params_ = cam_params;
+  refrac_params_ = refrac_params;
+  refrac_axis_ =
+      CameraRefracModelRefractionAxis(refrac_model_id, refrac_params)
+          .normalized();
+
+  num_samples_x_ = static_cast<int>(std::ceil(width / options.grid_step)) + 1;
+  num_samples_y_ = static_cast<int>(std::ceil(height / options.grid_step)) + 1;
+  step_ = Eigen::Vector2d(static_cast<double>(width) / (num_samples_x_ - 1),
+                          static_cast<double>(height) / (num_samples_y_ - 1));
+
+  std::vector<Eigen::Vector2d> points2D;
+  points2D.reserve(static_cast<size_t>(num_samples_x_) * num_samples_y_);
+  for (int j = 0; j < num_samples_y_; ++j) {
+    for (int i = 0; i < num_samples_x_; ++i) {
+      points2D.emplace_back(i * step_.x(), j * step_.y());
+    }
+  }
+
+  Ray3DBatch rays_refrac;
+  CameraRefracModelCamFromImgBatch(model_id,
+                                   refrac_model_id,
+                                   cam_params,
+                                   refrac_params,
+                                   points2D,
+                                   &rays_refrac);
+
+  Eigen::ArrayX3d centers(points2D.size(), 3);
+  Eigen::Array<bool, Eigen::Dynamic, 1> is_intersect;
+  IntersectLinesWithToleranceBatch(Eigen::Vector3d::Zero(),
+                                   refrac_axis_,
+                                   rays_refrac.oris,
+                                   -rays_refrac.dirs,
+                                   &centers,
+                                   &is_intersect);
+
+  samples_.resize(points2D.size());
+  for (size_t i = 0; i < points2D.size(); ++i) {
+    const Eigen::Vector3d dir = rays_refrac.dirs.row(i).transpose();
+    if (!is_intersect(i) || !dir.allFinite()) {
+      samples_[i].setConstant(std::numeric_limits<double>::quiet_NaN());
+      continue;
+    }
+    samples_[i](0) = centers.row(i).matrix().dot(refrac_axis_);
+    samples_[i].tail<2>() = dir.hnormalized();
+  }
+}
+
+bool RefracVirtualCameraTable::IsValidFor(
+    const CameraModelId model_id,
+    const CameraRefracModelId refrac_model_id,
+    const std::vector<double>& cam_params,
+    const std::vector<double>& refrac_params) const {
+  return !samples_.empty() && model_id == model_id_ &&
+         refrac_model_id == refrac_model_id_ && cam_params == cam_params_ &&
+         refrac_params == refrac_params_;
+}
+
+bool RefracVirtualCameraTable::IsEmpty() const { return samples_.empty(); }
+
+bool RefracVirtualCameraTable::Interpolate(const Eigen::Vector2d& xy,
+                                           double* center_offset,
+                                           Eigen::Vector2d* dir) const {
+  if (samples_.empty()) {
+    return false;
+  }
+
+  const Eigen::Vector2d grid_xy = xy.cwiseQuotient(step_);
+  if (!(grid_xy.x() >= 0 && grid_xy.x() <= num_samples_x_ - 1 &&
+        grid_xy.y() >= 0 && grid_xy.y() <= num_samples_y_ - 1)) {
+    return false;
+  }
+
+  const int i0 = std::min(static_cast<int>(grid_xy.x()), num_samples_x_ - 2);
+  const int j0 = std::min(static_cast<int>(grid_xy.y()), num_samples_y_ - 2);
+  const double ti = grid_xy.x() - i0;
+  const double tj = grid_xy.y() - j0;
+
+  const size_t idx00 = static_cast<size_t>(j0) * num_samples_x_ + i0;
+  const size_t idx10 = idx00 + num_samples_x_;
+  const Eigen::Vector3d interp =
+      (1 - tj) * ((1 - ti) * samples_[idx00] + ti * samples_[idx00 + 1]) +
+      tj * ((1 - ti) * samples_[idx10] + ti * samples_[idx10 + 1]);
+  if (!interp.allFinite()) {
+    return false;
+  }
+
+  *center_offset = interp(0);
+  *dir = interp.tail<2>();
+  return true;
+}
+
+}  // namespace colmap
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "colmap/sensor/models.h"
+#include "colmap/sensor/models_refrac.h"
+
+#include <vector>
+
+#include <Eigen/Core>
+
+namespace colmap {
+
+struct RefracVirtualCameraTableOptions {
+  // Spacing of the grid samples in pixels.
+  double grid_step = 8.0;
+
+  bool Check() const;
+};
+
+// Lookup table of the virtual cameras of a single refractive camera.
+//
+// The virtual camera of an image point, see `Camera::ComputeVirtual`, only
+// depends on the image point for fixed camera parameters. Its center lies on
+// the refraction axis at the intersection with the refracted ray and its
+// principal point is `xy - f * dir`, where `dir` are the normalized image
+// coordinates of the refracted ray direction. The table samples the offset of
+// the center along the refraction axis and `dir` on a regular grid over the
+// image and interpolates them bilinearly. Since the principal point is linear
+// in `xy`, interpolating `dir` is equivalent to interpolating the principal
+// point. This replaces tracing the ray through the interface and intersecting
+// it with the axis by a lookup, at the cost of a small interpolation error.
+//
+// The table stores a copy of the parameters it was built with and it must only
+// be used for cameras with the same parameters, see `IsValidFor`.
+class RefracVirtualCameraTable {
+ public:
+  RefracVirtualCameraTable() = default;
+
+  // Build the table for the given camera of size `width` x `height`.
+  void Build(const RefracVirtualCameraTableOptions& options,
+             CameraModelId model_id,
+             CameraRefracModelId refrac_model_id,
+             size_t width,
+             size_t height,
+             const std::vector<double>& cam_params,
+             const std::vector<double>& refrac_params);
+
+  // Check whether the table was built for the given camera parameters.
+  bool IsValidFor(CameraModelId model_id,
+                  CameraRefracModelId refrac_model_id,
+                  const std::vector<double>& cam_params,
+                  const std::vector<double>& refrac_params) const;
+
+  bool IsEmpty() const;
+
+  // The normalized refraction axis of the camera.
+  inline const Eigen::Vector3d& RefractionAxis() const;
+
+  // Interpolate the offset of the virtual camera center along the refraction
+  // axis and the normalized direction of the refracted ray of an image point.
+  // Returns false if the point is outside of the image or if the refraction
+  // of a neighboring sample failed, e.g., due to total reflection.
+  bool Interpolate(const Eigen::Vector2d& xy,
+                   double* center_offset,
+                   Eigen::Vector2d* dir) const;
+
+ private:
+  CameraModelId model_id_ = CameraModelId::kInvalid;
+  CameraRefracModelId refrac_model_id_ = CameraRefracModelId::kInvalid;
+  std::vector<double> cam_params_;
+  std::vector<double> refrac_params_;
+
+  Eigen::Vector3d refrac_axis_ = Eigen::Vector3d::Zero();
+
+  int num_samples_x_ = 0;
+  int num_samples_y_ = 0;
+  Eigen::Vector2d step_ = Eigen::Vector2d::Zero();
+
+  // Center offset and direction of the samples in row-major order, where the
+  // values of failed samples are NaN.
+  std::vector<Eigen::Vector3d> samples_;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Implementation
+////////////////////////////////////////////////////////////////////////////////
+
+const Eigen::Vector3d& RefracVirtualCameraTable::RefractionAxis() const {
+  return refrac_axis_;
+}
+
+}  // namespace colmap
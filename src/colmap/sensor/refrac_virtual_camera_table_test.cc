@@ -0,0 +1,115 @@
+#include "colmap/sensor/refrac_virtual_camera_table.h"
+
+#include "colmap/math/random.h"
+#include "colmap/sensor/ray3d.h"
+
+#include <gtest/gtest.h>
+
+namespace colmap {
+namespace {
+
+const std::vector<double> kCamParams = {3200.484,
+                                        3200.917,
+                                        2790.172,
+                                        2108.726,
+                                        -0.233072717236466,
+                                        0.065022474710061,
+                                        1.008118149931866e-06,
+                                        -2.863880315774651e-05};
+const size_t kWidth = 5568;
+const size_t kHeight = 4176;
+
+void TestTable(const CameraRefracModelId refrac_model_id,
+               const std::vector<double>& refrac_params) {
+  RefracVirtualCameraTable table;
+  EXPECT_TRUE(table.IsEmpty());
+  table.Build(RefracVirtualCameraTableOptions(),
+              CameraModelId::kOpenCV,
+              refrac_model_id,
+              kWidth,
+              kHeight,
+              kCamParams,
+              refrac_params);
+  EXPECT_FALSE(table.IsEmpty());
+  EXPECT_TRUE(table.IsValidFor(
+      CameraModelId::kOpenCV, refrac_model_id, kCamParams, refrac_params));
+
+  std::vector<double> other_refrac_params = refrac_params;
+  other_refrac_params[3] += 0.01;
+  EXPECT_FALSE(table.IsValidFor(CameraModelId::kOpenCV,
+                                refrac_model_id,
+                                kCamParams,
+                                other_refrac_params));
+  EXPECT_FALSE(table.IsValidFor(
+      CameraModelId::kPinhole, refrac_model_id, kCamParams, refrac_params));
+
+  const Eigen::Vector3d refrac_axis =
+      CameraRefracModelRefractionAxis(refrac_model_id, refrac_params)
+          .normalized();
+  EXPECT_LT((table.RefractionAxis() - refrac_axis).norm(), 1e-12);
+
+  for (int i = 0; i < 100; ++i) {
+    const Eigen::Vector2d xy(RandomUniformReal(0.0, double(kWidth)),
+                             RandomUniformReal(0.0, double(kHeight)));
+    const Ray3D ray_refrac = CameraRefracModelCamFromImg(CameraModelId::kOpenCV,
+                                                         refrac_model_id,
+                                                         kCamParams,
+                                                         refrac_params,
+                                                         xy);
+    Eigen::Vector3d center;
+    ASSERT_TRUE(IntersectLinesWithTolerance<double>(Eigen::Vector3d::Zero(),
+                                                    refrac_axis,
+                                                    ray_refrac.ori,
+                                                    -ray_refrac.dir,
+                                                    center));
+
+    double center_offset;
+    Eigen::Vector2d dir;
+    ASSERT_TRUE(table.Interpolate(xy, &center_offset, &dir));
+    EXPECT_NEAR(center_offset, center.dot(refrac_axis), 1e-5);
+    // Error of the virtual principal point in pixels.
+    EXPECT_LT(kCamParams[0] * (dir - ray_refrac.dir.hnormalized()).norm(),
+              0.05);
+  }
+
+  double center_offset;
+  Eigen::Vector2d dir;
+  EXPECT_TRUE(table.Interpolate(
+      Eigen::Vector2d(kWidth, kHeight), &center_offset, &dir));
+  EXPECT_FALSE(
+      table.Interpolate(Eigen::Vector2d(-1, 0), &center_offset, &dir));
+  EXPECT_FALSE(
+      table.Interpolate(Eigen::Vector2d(0, kHeight + 1), &center_offset, &dir));
+}
+
+TEST(RefracVirtualCameraTable, FlatPort) {
+  Eigen::Vector3d int_normal(RandomUniformReal(-0.1, 0.1),
+                             RandomUniformReal(-0.1, 0.1),
+                             RandomUniformReal(0.9, 1.1));
+  int_normal.normalize();
+  TestTable(CameraRefracModelId::kFlatPort,
+            {int_normal(0),
+             int_normal(1),
+             int_normal(2),
+             0.05,
+             0.007,
+             1.003,
+             1.473,
+             1.333});
+}
+
+TEST(RefracVirtualCameraTable, DomePort) {
+  TestTable(
+      CameraRefracModelId::kDomePort,
+      {0.00042007, 0.00366894, 0.0283927, 0.05, 0.007, 1.003, 1.473, 1.333});
+}
+
+TEST(RefracVirtualCameraTableOptions, Check) {
+  RefracVirtualCameraTableOptions options;
+  EXPECT_TRUE(options.Check());
+  options.grid_step = 0;
+  EXPECT_FALSE(options.Check());
+}
+
+}  // namespace
+}  // namespace colmap
@@ -29,16 +29,21 @@
 
 #pragma once
 
-#include <string>
-#include <unordered_map>
-#include <vector>
+#include <cstddef>
 
 namespace colmap {
 
-// { make1 : ({ model1 : sensor-width in mm }, ...), ... }
-typedef std::vector<std::pair<std::string, float>> camera_make_specs_t;
-typedef std::unordered_map<std::string, camera_make_specs_t> camera_specs_t;
+struct CameraSpec {
+  const char* make;
+  const char* model;
+  // Sensor width in mm.
+  float sensor_width;
+};
 
-camera_specs_t InitializeCameraSpecs();
+// Table of camera specifications, where the models of a make are contiguous.
+// The table is constant-initialized at compile time, so that it adds no
+// startup cost to executables linking the sensor library.
+extern const CameraSpec kCameraSpecs[];
+extern const size_t kNumCameraSpecs;
 
 }  // namespace colmap
@@ -0,0 +1,449 @@
+#include "colmap/sfm/global_mapper.h"
+
+#include "colmap/estimators/cost_functions.h"
+#include "colmap/estimators/similarity_transform.h"
+#include "colmap/math/math.h"
+#include "colmap/util/logging.h"
+#include "colmap/util/misc.h"
+#include "colmap/util/threading.h"
+#include "colmap/util/tracing.h"
+
+#include <algorithm>
+#include <limits>
+#include <numeric>
+#include <queue>
+
+#include <ceres/ceres.h>
+
+namespace colmap {
+namespace {
+
+image_t FindRoot(std::unordered_map<image_t, image_t>* parents,
+                 image_t image_id) {
+  while (parents->at(image_id) != image_id) {
+    image_t& parent = parents->at(image_id);
+    parent = parents->at(parent);
+    image_id = parent;
+  }
+  return image_id;
+}
+
+void SolveAveraging(const GlobalMapper::Options& options,
+                    const std::string& name,
+                    ceres::Problem* problem) {
+  ceres::Solver::Options solver_options;
+  solver_options.max_num_iterations = options.max_num_iterations;
+  solver_options.linear_solver_type = ceres::SPARSE_NORMAL_CHOLESKY;
+  solver_options.num_threads = GetEffectiveNumThreads(options.num_threads);
+#if CERES_VERSION_MAJOR < 2
+  solver_options.num_linear_solver_threads = solver_options.num_threads;
+#endif  // CERES_VERSION_MAJOR
+
+  std::string solver_error;
+  CHECK(solver_options.IsValid(&solver_error)) << solver_error;
+
+  ceres::Solver::Summary summary;
+  ceres::Solve(solver_options, problem, &summary);
+
+  PrintHeading2(name + " report");
+  LOG(INFO) << summary.BriefReport();
+}
+
+}  // namespace
+
+bool GlobalMapper::Options::Check() const {
+  CHECK_OPTION_GE(min_num_inliers, 0);
+  CHECK_OPTION_GE(min_tri_angle, 0);
+  CHECK_OPTION_GT(rotation_loss_scale, 0);
+  CHECK_OPTION_GT(max_rotation_error, 0);
+  CHECK_OPTION_GT(translation_loss_scale, 0);
+  CHECK_OPTION_GT(prior_position_std, 0);
+  CHECK_OPTION_GT(max_num_iterations, 0);
+  CHECK_OPTION_GE(num_threads, -1);
+  return true;
+}
+
+GlobalMapper::GlobalMapper(std::shared_ptr<const DatabaseCache> database_cache)
+    : database_cache_(std::move(database_cache)) {}
+
+void GlobalMapper::BeginReconstruction(
+    const std::shared_ptr<Reconstruction>& reconstruction) {
+  CHECK(reconstruction_ == nullptr);
+  CHECK_EQ(reconstruction->NumRegImages(), 0);
+  reconstruction_ = reconstruction;
+  reconstruction_->Load(*database_cache_);
+  rotations_.clear();
+  root_image_id_ = kInvalidImageId;
+}
+
+void GlobalMapper::EndReconstruction() {
+  CHECK_NOTNULL(reconstruction_);
+  reconstruction_->TearDown();
+  reconstruction_ = nullptr;
+  relative_poses_.clear();
+  rotations_.clear();
+}
+
+void GlobalMapper::LoadRelativePoses(const Options& options,
+                                     const Database& database) {
+  std::vector<image_pair_t> image_pair_ids;
+  std::vector<TwoViewGeometry> two_view_geometries;
+  database.ReadTwoViewGeometryPoses(&image_pair_ids, &two_view_geometries);
+
+  const auto correspondence_graph = database_cache_->CorrespondenceGraph();
+
+  relative_poses_.clear();
+  for (size_t i = 0; i < image_pair_ids.size(); ++i) {
+    RelativePose relative_pose;
+    Database::PairIdToImagePair(
+        image_pair_ids[i], &relative_pose.image_id1, &relative_pose.image_id2);
+    if (!database_cache_->ExistsImage(relative_pose.image_id1) ||
+        !database_cache_->ExistsImage(relative_pose.image_id2)) {
+      continue;
+    }
+
+    relative_pose.num_inliers =
+        correspondence_graph->NumCorrespondencesBetweenImages(
+            relative_pose.image_id1, relative_pose.image_id2);
+    if (relative_pose.num_inliers <
+        static_cast<point2D_t>(options.min_num_inliers)) {
+      continue;
+    }
+
+    const TwoViewGeometry& two_view_geometry = two_view_geometries[i];
+    relative_pose.cam2_from_cam1 = two_view_geometry.cam2_from_cam1;
+    relative_pose.cam2_from_cam1.rotation.normalize();
+    relative_pose.tri_angle = two_view_geometry.tri_angle;
+    relative_pose.is_metric =
+        two_view_geometry.config == TwoViewGeometry::REFRACTIVE;
+    relative_poses_.push_back(relative_pose);
+  }
+
+  LOG(INFO) << "  => Relative poses: " << relative_poses_.size();
+}
+
+size_t GlobalMapper::AverageRotations(const Options& options) {
+  COLMAP_TRACE_SCOPE("GlobalMapper::AverageRotations");
+  CHECK_NOTNULL(reconstruction_);
+  CHECK(options.Check());
+
+  rotations_.clear();
+  root_image_id_ = kInvalidImageId;
+  if (relative_poses_.empty()) {
+    return 0;
+  }
+
+  // Find the maximum spanning tree of the view graph weighted by the number
+  // of inliers (Kruskal), whose relative rotations initialize the averaging.
+  std::vector<size_t> pose_idxs(relative_poses_.size());
+  std::iota(pose_idxs.begin(), pose_idxs.end(), 0);
+  std::sort(pose_idxs.begin(), pose_idxs.end(), [&](size_t idx1, size_t idx2) {
+    return relative_poses_[idx1].num_inliers >
+           relative_poses_[idx2].num_inliers;
+  });
+
+  std::unordered_map<image_t, image_t> parents;
+  for (const auto& relative_pose : relative_poses_) {
+    parents.emplace(relative_pose.image_id1, relative_pose.image_id1);
+    parents.emplace(relative_pose.image_id2, relative_pose.image_id2);
+  }
+
+  std::unordered_map<image_t, std::vector<size_t>> tree_pose_idxs;
+  for (const size_t pose_idx : pose_idxs) {
+    const auto& relative_pose = relative_poses_[pose_idx];
+    const image_t root1 = FindRoot(&parents, relative_pose.image_id1);
+    const image_t root2 = FindRoot(&parents, relative_pose.image_id2);
+    if (root1 == root2) {
+      continue;
+    }
+    parents[root1] = root2;
+    tree_pose_idxs[relative_pose.image_id1].push_back(pose_idx);
+    tree_pose_idxs[relative_pose.image_id2].push_back(pose_idx);
+  }
+
+  // Only the largest connected component is reconstructed, which is rooted
+  // at its image with the most tree edges.
+  std::unordered_map<image_t, size_t> component_sizes;
+  for (const auto& parent : parents) {
+    component_sizes[FindRoot(&parents, parent.first)] += 1;
+  }
+  const image_t component_root =
+      std::max_element(component_sizes.begin(),
+                       component_sizes.end(),
+                       [](const std::pair<const image_t, size_t>& size1,
+                          const std::pair<const image_t, size_t>& size2) {
+                         return size1.second < size2.second;
+                       })
+          ->first;
+  for (const auto& image_pose_idxs : tree_pose_idxs) {
+    if (FindRoot(&parents, image_pose_idxs.first) == component_root &&
+        (root_image_id_ == kInvalidImageId ||
+         image_pose_idxs.second.size() >
+             tree_pose_idxs.at(root_image_id_).size())) {
+      root_image_id_ = image_pose_idxs.first;
+    }
+  }
+
+  // Propagate the rotations along the spanning tree.
+  rotations_.emplace(root_image_id_, Eigen::Quaterniond::Identity());
+  std::queue<image_t> image_queue;
+  image_queue.push(root_image_id_);
+  while (!image_queue.empty()) {
+    const image_t image_id = image_queue.front();
+    image_queue.pop();
+    const Eigen::Quaterniond rotation = rotations_.at(image_id);
+    for (const size_t pose_idx : tree_pose_idxs.at(image_id)) {
+      const auto& relative_pose = relative_poses_[pose_idx];
+      if (relative_pose.image_id1 == image_id) {
+        if (rotations_
+                .emplace(relative_pose.image_id2,
+                         relative_pose.cam2_from_cam1.rotation * rotation)
+                .second) {
+          image_queue.push(relative_pose.image_id2);
+        }
+      } else if (rotations_
+                     .emplace(relative_pose.image_id1,
+                              relative_pose.cam2_from_cam1.rotation.inverse() *
+                                  rotation)
+                     .second) {
+        image_queue.push(relative_pose.image_id1);
+      }
+    }
+  }
+
+  // Refine the rotations with all relative rotations of the component.
+  ceres::Problem problem;
+  for (const auto& relative_pose : relative_poses_) {
+    auto rotation1 = rotations_.find(relative_pose.image_id1);
+    auto rotation2 = rotations_.find(relative_pose.image_id2);
+    if (rotation1 == rotations_.end() || rotation2 == rotations_.end()) {
+      continue;
+    }
+    problem.AddResidualBlock(
+        RelativeRotationErrorCostFunction::Create(
+            relative_pose.cam2_from_cam1.rotation),
+        new ceres::SoftLOneLoss(DegToRad(options.rotation_loss_scale)),
+        rotation1->second.coeffs().data(),
+        rotation2->second.coeffs().data());
+  }
+  for (auto& rotation : rotations_) {
+    SetQuaternionManifold(&problem, rotation.second.coeffs().data());
+  }
+  problem.SetParameterBlockConstant(
+      rotations_.at(root_image_id_).coeffs().data());
+
+  SolveAveraging(options, "Rotation averaging", &problem);
+
+  for (auto& rotation : rotations_) {
+    rotation.second.normalize();
+  }
+
+  LOG(INFO) << "  => Averaged rotations: " << rotations_.size();
+
+  return rotations_.size();
+}
+
+size_t GlobalMapper::AverageTranslations(const Options& options) {
+  COLMAP_TRACE_SCOPE("GlobalMapper::AverageTranslations");
+  CHECK_NOTNULL(reconstruction_);
+  CHECK(options.Check());
+
+  if (rotations_.empty()) {
+    return 0;
+  }
+
+  // The relative translations in the world frame of the image pairs that
+  // agree with the averaged rotations and have sufficient baselines.
+  struct Baseline {
+    image_t image_id1 = kInvalidImageId;
+    image_t image_id2 = kInvalidImageId;
+    Eigen::Vector3d direction;
+    double scale = 1;
+    bool is_metric = false;
+  };
+
+  const double max_rotation_error = DegToRad(options.max_rotation_error);
+  const double min_tri_angle = DegToRad(options.min_tri_angle);
+
+  std::vector<Baseline> baselines;
+  std::unordered_map<image_t, std::vector<size_t>> image_baseline_idxs;
+  bool has_metric_baselines = false;
+  for (const auto& relative_pose : relative_poses_) {
+    const auto rotation1 = rotations_.find(relative_pose.image_id1);
+    const auto rotation2 = rotations_.find(relative_pose.image_id2);
+    if (rotation1 == rotations_.end() || rotation2 == rotations_.end() ||
+        relative_pose.tri_angle < min_tri_angle) {
+      continue;
+    }
+
+    const Eigen::Quaterniond cam2_from_cam1_rotation =
+        rotation2->second * rotation1->second.inverse();
+    if (cam2_from_cam1_rotation.angularDistance(
+            relative_pose.cam2_from_cam1.rotation) > max_rotation_error) {
+      continue;
+    }
+
+    // From the projection center of image 1 to the one of image 2.
+    const Eigen::Vector3d translation =
+        -(rotation2->second.inverse() *
+          relative_pose.cam2_from_cam1.translation);
+    const double translation_norm = translation.norm();
+    if (translation_norm < std::numeric_limits<double>::epsilon()) {
+      continue;
+    }
+
+    Baseline baseline;
+    baseline.image_id1 = relative_pose.image_id1;
+    baseline.image_id2 = relative_pose.image_id2;
+    baseline.direction = translation / translation_norm;
+    baseline.is_metric = relative_pose.is_metric;
+    if (baseline.is_metric) {
+      baseline.scale = translation_norm;
+      has_metric_baselines = true;
+    }
+    image_baseline_idxs[baseline.image_id1].push_back(baselines.size());
+    image_baseline_idxs[baseline.image_id2].push_back(baselines.size());
+    baselines.push_back(baseline);
+  }
+
+  if (baselines.empty()) {
+    return 0;
+  }
+
+  // Initialize the projection centers of the component, which contains the
+  // image with the most baselines, by a breadth-first traversal.
+  image_t root_image_id = image_baseline_idxs.begin()->first;
+  for (const auto& baseline_idxs : image_baseline_idxs) {
+    if (baseline_idxs.second.size() >
+        image_baseline_idxs.at(root_image_id).size()) {
+      root_image_id = baseline_idxs.first;
+    }
+  }
+
+  std::unordered_map<image_t, Eigen::Vector3d> proj_centers;
+  proj_centers.emplace(root_image_id, Eigen::Vector3d::Zero());
+  std::queue<image_t> image_queue;
+  image_queue.push(root_image_id);
+  while (!image_queue.empty()) {
+    const image_t image_id = image_queue.front();
+    image_queue.pop();
+    const Eigen::Vector3d proj_center = proj_centers.at(image_id);
+    for (const size_t baseline_idx : image_baseline_idxs.at(image_id)) {
+      const Baseline& baseline = baselines[baseline_idx];
+      const Eigen::Vector3d translation = baseline.scale * baseline.direction;
+      if (baseline.image_id1 == image_id) {
+        if (proj_centers.emplace(baseline.image_id2, proj_center + translation)
+                .second) {
+          image_queue.push(baseline.image_id2);
+        }
+      } else if (proj_centers
+                     .emplace(baseline.image_id1, proj_center - translation)
+                     .second) {
+        image_queue.push(baseline.image_id1);
+      }
+    }
+  }
+
+  // Without metric baselines, the scale is fixed by bounding the scales of the
+  // baselines from below.
+  ceres::Problem problem;
+  std::vector<double*> free_scales;
+  for (auto& baseline : baselines) {
+    auto proj_center1 = proj_centers.find(baseline.image_id1);
+    auto proj_center2 = proj_centers.find(baseline.image_id2);
+    if (proj_center1 == proj_centers.end() ||
+        proj_center2 == proj_centers.end()) {
+      continue;
+    }
+    problem.AddResidualBlock(
+        RelativeTranslationErrorCostFunction::Create(baseline.direction),
+        new ceres::HuberLoss(options.translation_loss_scale),
+        proj_center1->second.data(),
+        proj_center2->second.data(),
+        &baseline.scale);
+    if (baseline.is_metric) {
+      problem.SetParameterBlockConstant(&baseline.scale);
+    } else {
+      problem.SetParameterLowerBound(
+          &baseline.scale, 0, has_metric_baselines ? 0.0 : 1.0);
+      free_scales.push_back(&baseline.scale);
+    }
+  }
+  problem.SetParameterBlockConstant(proj_centers.at(root_image_id).data());
+
+  SolveAveraging(options, "Translation averaging", &problem);
+
+  std::unordered_map<image_t, Eigen::Quaterniond> rotations;
+  rotations.reserve(proj_centers.size());
+  for (const auto& proj_center : proj_centers) {
+    rotations.emplace(proj_center.first, rotations_.at(proj_center.first));
+  }
+
+  // Align the projection centers to the position priors and refine them with
+  // the priors as additional constraints.
+  if (options.use_pose_prior) {
+    const Rigid3d cam_from_prior = Inverse(reconstruction_->PriorFromCam());
+    std::vector<image_t> prior_image_ids;
+    std::vector<Eigen::Vector3d> src_proj_centers;
+    std::vector<Eigen::Vector3d> prior_proj_centers;
+    for (const auto& proj_center : proj_centers) {
+      const Rigid3d cam_from_world_prior =
+          cam_from_prior *
+          reconstruction_->Image(proj_center.first).CamFromWorldPrior();
+      const Eigen::Vector3d prior_proj_center =
+          Inverse(cam_from_world_prior).translation;
+      if (!prior_proj_center.allFinite()) {
+        continue;
+      }
+      prior_image_ids.push_back(proj_center.first);
+      src_proj_centers.push_back(proj_center.second);
+      prior_proj_centers.push_back(prior_proj_center);
+    }
+
+    Sim3d prior_from_world;
+    if (prior_image_ids.size() < 3 ||
+        !EstimateSim3d(
+            src_proj_centers, prior_proj_centers, prior_from_world)) {
+      LOG(WARNING) << "Failed to align the projection centers to the "
+                      "position priors.";
+    } else {
+      for (auto& proj_center : proj_centers) {
+        proj_center.second = prior_from_world * proj_center.second;
+      }
+      for (auto& rotation : rotations) {
+        rotation.second = rotation.second * prior_from_world.rotation.inverse();
+      }
+      for (double* scale : free_scales) {
+        *scale *= prior_from_world.scale;
+        problem.SetParameterLowerBound(scale, 0, 0.0);
+      }
+
+      const Eigen::Matrix3d prior_sqrt_information =
+          Eigen::Matrix3d::Identity() / options.prior_position_std;
+      for (size_t i = 0; i < prior_image_ids.size(); ++i) {
+        problem.AddResidualBlock(
+            new ceres::NormalPrior(prior_sqrt_information,
+                                   prior_proj_centers[i]),
+            nullptr,
+            proj_centers.at(prior_image_ids[i]).data());
+      }
+      problem.SetParameterBlockVariable(proj_centers.at(root_image_id).data());
+
+      SolveAveraging(options, "Translation averaging with priors", &problem);
+    }
+  }
+
+  // Register the images with the averaged poses.
+  for (const auto& proj_center : proj_centers) {
+    const Eigen::Quaterniond& rotation = rotations.at(proj_center.first);
+    Image& image = reconstruction_->Image(proj_center.first);
+    image.CamFromWorld() = Rigid3d(rotation, -(rotation * proj_center.second));
+    reconstruction_->RegisterImage(proj_center.first);
+  }
+
+  LOG(INFO) << "  => Averaged projection centers: " << proj_centers.size();
+
+  return proj_centers.size();
+}
+
+}  // namespace colmap
@@ -0,0 +1,111 @@
+#pragma once
+
+#include "colmap/geometry/rigid3.h"
+#include "colmap/scene/database.h"
+#include "colmap/scene/database_cache.h"
+#include "colmap/scene/reconstruction.h"
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include <Eigen/Geometry>
+
+namespace colmap {
+
+// Global structure-from-motion, which estimates the poses of all images at
+// once from the relative poses of the verified image pairs instead of
+// registering the images one after another. The rotations are estimated by
+// robust rotation averaging and the projection centers by translation
+// averaging. The relative translations of refractive image pairs are metric
+// and fix the scale of the reconstruction. The triangulation and bundle
+// adjustment of the registered images is left to the `IncrementalMapper`, see
+// `GlobalMapperController`.
+class GlobalMapper {
+ public:
+  struct Options {
+    // The minimum number of inlier matches of an image pair for its relative
+    // pose to be used.
+    int min_num_inliers = 30;
+
+    // The minimum triangulation angle in degrees of an image pair for its
+    // relative translation to be used. The relative rotations of all image
+    // pairs are used.
+    double min_tri_angle = 1.0;
+
+    // The scale in degrees of the robust loss of the rotation averaging.
+    double rotation_loss_scale = 2.0;
+
+    // The maximum angular error in degrees between the relative rotation of an
+    // image pair and the averaged rotations, beyond which the image pair is
+    // discarded in translation averaging.
+    double max_rotation_error = 5.0;
+
+    // The scale of the robust loss of the translation averaging in the units
+    // of the reconstruction, where the baselines of non-metric image pairs are
+    // at least 1 without pose priors.
+    double translation_loss_scale = 0.1;
+
+    // Whether to align the averaged projection centers to the position priors
+    // of the images and to refine them with the priors as constraints.
+    bool use_pose_prior = false;
+
+    // The standard deviation of the position priors.
+    double prior_position_std = 1.0;
+
+    // The maximum number of solver iterations of the averaging problems.
+    int max_num_iterations = 200;
+
+    // The number of threads, where -1 uses all available threads.
+    int num_threads = -1;
+
+    bool Check() const;
+  };
+
+  explicit GlobalMapper(std::shared_ptr<const DatabaseCache> database_cache);
+
+  // Load the images and cameras of the database cache into the
+  // reconstruction, which must not have registered images.
+  void BeginReconstruction(
+      const std::shared_ptr<Reconstruction>& reconstruction);
+
+  // Cleanup the mapper after the current reconstruction is done, such that
+  // the reconstruction can be passed to the `IncrementalMapper`.
+  void EndReconstruction();
+
+  // Read the estimated relative poses of the image pairs in the database
+  // cache from the database.
+  void LoadRelativePoses(const Options& options, const Database& database);
+
+  // Estimate the rotations of the images in the largest connected component
+  // of the view graph. Returns the number of images with rotations.
+  size_t AverageRotations(const Options& options);
+
+  // Estimate the projection centers of the images with averaged rotations and
+  // register the images in the largest connected component of the remaining
+  // view graph. Returns the number of registered images.
+  size_t AverageTranslations(const Options& options);
+
+ private:
+  struct RelativePose {
+    image_t image_id1 = kInvalidImageId;
+    image_t image_id2 = kInvalidImageId;
+    Rigid3d cam2_from_cam1;
+    point2D_t num_inliers = 0;
+    double tri_angle = 0;
+    // Whether the relative translation is metric, i.e., of a refractive pair.
+    bool is_metric = false;
+  };
+
+  std::shared_ptr<const DatabaseCache> database_cache_;
+  std::shared_ptr<Reconstruction> reconstruction_;
+
+  std::vector<RelativePose> relative_poses_;
+
+  // The averaged cam_from_world rotations and the image whose rotation fixes
+  // the gauge.
+  std::unordered_map<image_t, Eigen::Quaterniond> rotations_;
+  image_t root_image_id_ = kInvalidImageId;
+};
+
+}  // namespace colmap
@@ -1,19 +1,328 @@
 #include "colmap/sfm/hybrid_mapper.h"
 
 #include "colmap/estimators/alignment.h"
+#include "colmap/estimators/bundle_adjustment.h"
+#include "colmap/estimators/cost_functions.h"
+#include "colmap/estimators/covariance.h"
 #include "colmap/estimators/pose_graph_optimizer.h"
 #include "colmap/estimators/triangulation.h"
+#include "colmap/geometry/pose.h"
+#include "colmap/scene/reconstruction_overlay.h"
+#include "colmap/scene/spatial_index.h"
+#include "colmap/sensor/models.h"
 #include "colmap/util/misc.h"
 #include "colmap/util/threading.h"
+#include "colmap/util/tracing.h"
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+
+#include <Eigen/Cholesky>
 
 namespace colmap {
+namespace {
+
+// Evenly distributes the threads among the workers that are still running, so
+// that threads freed by finished workers are handed to the remaining ones.
+std::function<int()> DynamicNumThreadsPerWorker(
+    const int num_threads,
+    const int num_workers,
+    const std::atomic<int>* num_pending_clusters) {
+  return [num_threads, num_workers, num_pending_clusters]() {
+    const int num_active_workers =
+        std::max(1, std::min(num_workers, num_pending_clusters->load()));
+    return std::max(1, num_threads / num_active_workers);
+  };
+}
+
+// Refines the position of a 3D point with respect to its observations, where
+// the camera poses and intrinsics are fixed. Note that the rotations of the
+// camera poses must be normalized.
+bool RefinePoint3D(const BundleAdjustmentOptions& options,
+                   const Reconstruction& reconstruction,
+                   const point3D_t point3D_id,
+                   Eigen::Vector3d* xyz) {
+  const Point3D& point3D = reconstruction.Point3D(point3D_id);
+  *xyz = point3D.xyz;
+
+  ceres::Problem::Options problem_options;
+  problem_options.loss_function_ownership = ceres::DO_NOT_TAKE_OWNERSHIP;
+  ceres::Problem problem(problem_options);
+  const auto loss_function =
+      std::unique_ptr<ceres::LossFunction>(options.CreateLossFunction());
+
+  // The camera parameters are copied, such that the constant parameter blocks
+  // are not shared between the problems solved in parallel.
+  std::vector<std::vector<double>> camera_params;
+  camera_params.reserve(point3D.track.Length());
+
+  for (const auto& track_el : point3D.track.Elements()) {
+    const Image& image = reconstruction.Image(track_el.image_id);
+    const Camera& camera = reconstruction.Camera(image.CameraId());
+    const Point2D& point2D = image.Point2D(track_el.point2D_idx);
+
+    ceres::CostFunction* cost_function = nullptr;
+
+    if (!options.enable_refraction) {
+      switch (camera.model_id) {
+#define CAMERA_MODEL_CASE(CameraModel)                                        \
+  case CameraModel::model_id:                                                 \
+    cost_function = ReprojErrorConstantPoseCostFunction<CameraModel>::Create( \
+        image.CamFromWorld(), point2D.xy);                                    \
+    break;
+
+        CAMERA_MODEL_SWITCH_CASES
+
+#undef CAMERA_MODEL_CASE
+      }
+      camera_params.push_back(camera.params);
+      problem.AddResidualBlock(cost_function,
+                               loss_function.get(),
+                               xyz->data(),
+                               camera_params.back().data());
+      problem.SetParameterBlockConstant(camera_params.back().data());
+    } else {
+      const Ray3D ray_refrac = camera.CamFromImgRefrac(point2D.xy);
+      cost_function = ReprojErrorRefracConstantPoseCameraCostFunction::Create(
+          image.CamFromWorld(),
+          camera.VirtualCameraCenter(ray_refrac),
+          ray_refrac.dir.hnormalized(),
+          camera.params[0]);
+      problem.AddResidualBlock(cost_function, loss_function.get(), xyz->data());
+    }
+  }
+
+  if (problem.NumResiduals() == 0) {
+    return false;
+  }
+
+  ceres::Solver::Options solver_options = options.solver_options;
+  solver_options.linear_solver_type = ceres::DENSE_QR;
+  solver_options.num_threads = 1;
+#if CERES_VERSION_MAJOR < 2
+  solver_options.num_linear_solver_threads = 1;
+#endif  // CERES_VERSION_MAJOR
+  solver_options.logging_type = ceres::LoggingType::SILENT;
+  solver_options.minimizer_progress_to_stdout = false;
+
+  ceres::Solver::Summary summary;
+  ceres::Solve(solver_options, &problem, &summary);
+
+  return summary.IsSolutionUsable();
+}
+
+// Estimates the covariances of the poses of a sub-reconstruction from its
+// bundle adjustment problem, which is set up at the current parameters without
+// refining them, and propagates them to the relative pose constraints of the
+// pose graph optimization.
+class SubReconstructionPoseCovariance {
+ public:
+  bool Estimate(const BundleAdjustmentOptions& ba_options,
+                const Reconstruction& reconstruction) {
+    reconstruction_ = reconstruction;
+    const std::vector<image_t>& reg_image_ids = reconstruction_.RegImageIds();
+    if (reg_image_ids.size() < 2) {
+      return false;
+    }
+
+    BundleAdjustmentConfig config;
+    for (const image_t image_id : reg_image_ids) {
+      config.AddImage(image_id);
+    }
+    // Without pose priors, the gauge is fixed as in the incremental mapper.
+    if (!ba_options.use_pose_prior) {
+      config.SetConstantCamPose(reg_image_ids[0]);
+      config.SetConstantCamPositions(reg_image_ids[1], {0});
+    }
+
+    BundleAdjustmentOptions options = ba_options;
+    options.print_summary = false;
+    options.solver_options.max_num_iterations = 0;
+    bundle_adjuster_ = std::make_unique<BundleAdjuster>(options, config);
+    if (!bundle_adjuster_->Solve(&reconstruction_)) {
+      return false;
+    }
+
+    BundleAdjustmentCovarianceOptions covariance_options;
+    covariance_options.num_threads = ba_options.solver_options.num_threads;
+    estimator_ = std::make_unique<BundleAdjustmentCovarianceEstimator>(
+        covariance_options, bundle_adjuster_->Problem(), &reconstruction_);
+    return estimator_->Compute();
+  }
+
+  // Information matrix of the residual of the relative pose cam2_from_cam1 in
+  // the pose graph optimization. Returns false if it is not available, e.g.,
+  // for the images with constant pose parameters.
+  bool RelativePoseInformation(const image_t image_id1,
+                               const image_t image_id2,
+                               Eigen::Matrix6d* information) const {
+    if (!estimator_->HasPose(image_id1) && !estimator_->HasPose(image_id2)) {
+      return false;
+    }
+
+    // Poses of images that are not covisible are treated as uncorrelated.
+    Eigen::Matrix6d cross_cov12;
+    if (!estimator_->PoseCrossCovariance(image_id1, image_id2, &cross_cov12)) {
+      cross_cov12.setZero();
+    }
+
+    const Rigid3d& cam1_from_world =
+        reconstruction_.Image(image_id1).CamFromWorld();
+    const Rigid3d& cam2_from_world =
+        reconstruction_.Image(image_id2).CamFromWorld();
+    const Eigen::Matrix6d rel_cov =
+        RelativePoseCovariance(cam1_from_world,
+                               cam2_from_world,
+                               estimator_->PoseCovariance(image_id1),
+                               estimator_->PoseCovariance(image_id2),
+                               cross_cov12);
+
+    // The residual of the relative pose is r = -A * [dr, dt] for a small
+    // perturbation of the measurement.
+    const Rigid3d cam2_from_cam1 = cam2_from_world * Inverse(cam1_from_world);
+    Eigen::Matrix6d residual_jacobian = Eigen::Matrix6d::Identity();
+    residual_jacobian.bottomLeftCorner<3, 3>() =
+        CrossProductMatrix(cam2_from_cam1.translation);
+    const Eigen::LLT<Eigen::Matrix6d> llt(
+        residual_jacobian * rel_cov * residual_jacobian.transpose());
+    if (llt.info() != Eigen::Success) {
+      return false;
+    }
+    *information = llt.solve(Eigen::Matrix6d::Identity());
+    return true;
+  }
+
+ private:
+  // The bundle adjustment problem refers to the parameters of this copy.
+  Reconstruction reconstruction_;
+  std::unique_ptr<BundleAdjuster> bundle_adjuster_;
+  std::unique_ptr<BundleAdjustmentCovarianceEstimator> estimator_;
+};
+
+// Predict the footprint of the image in the xy-plane of the pose priors as the
+// disk around the point at the given altitude along its optical axis, whose
+// radius is given by the field of view of the camera. Returns false if the
+// image has no valid pose prior.
+bool PredictPriorFootprint(const Image& image,
+                           const Camera& camera,
+                           const double altitude,
+                           Eigen::Vector2d* center,
+                           double* radius) {
+  const Rigid3d& cam_from_world_prior = image.CamFromWorldPrior();
+  if (!cam_from_world_prior.rotation.coeffs().array().isFinite().all() ||
+      !cam_from_world_prior.translation.array().isFinite().all()) {
+    return false;
+  }
+
+  *center = (Inverse(cam_from_world_prior) * Eigen::Vector3d(0, 0, altitude))
+                .head<2>();
+
+  double max_tan_half_fov = 0;
+  const double width = static_cast<double>(camera.width);
+  const double height = static_cast<double>(camera.height);
+  for (const Eigen::Vector2d& corner : {Eigen::Vector2d(0, 0),
+                                        Eigen::Vector2d(width, 0),
+                                        Eigen::Vector2d(0, height),
+                                        Eigen::Vector2d(width, height)}) {
+    max_tan_half_fov =
+        std::max(max_tan_half_fov, camera.CamFromImg(corner).norm());
+  }
+  *radius = altitude * max_tan_half_fov;
+  return true;
+}
+
+// Greedily merges every local area into the previously merged area, with which
+// it shares the largest ratio of the images of the smaller area, if the ratio
+// exceeds `max_overlap_ratio` and the merged area has at most `max_num_images`
+// images. The areas are visited in the order of their center images and the
+// merged areas keep the center image of their first area.
+std::unordered_map<image_t, std::vector<image_t>> MergeOverlappingAreas(
+    const std::unordered_map<image_t, std::vector<image_t>>& areas,
+    const double max_overlap_ratio,
+    const size_t max_num_images) {
+  std::vector<image_t> center_image_ids;
+  center_image_ids.reserve(areas.size());
+  for (const auto& area : areas) {
+    center_image_ids.push_back(area.first);
+  }
+  std::sort(center_image_ids.begin(), center_image_ids.end());
+
+  std::vector<image_t> merged_center_image_ids;
+  std::vector<std::vector<image_t>> merged_image_ids;
+  // The merged areas of every image, such that only the areas sharing images
+  // are compared instead of all pairs of areas.
+  std::unordered_map<image_t, std::vector<size_t>> image_merged_area_idxs;
+  for (const image_t center_image_id : center_image_ids) {
+    const std::vector<image_t>& image_ids = areas.at(center_image_id);
+
+    std::unordered_map<size_t, size_t> num_shared_images;
+    for (const image_t image_id : image_ids) {
+      const auto it = image_merged_area_idxs.find(image_id);
+      if (it != image_merged_area_idxs.end()) {
+        for (const size_t merged_area_idx : it->second) {
+          num_shared_images[merged_area_idx] += 1;
+        }
+      }
+    }
+
+    size_t best_merged_area_idx = merged_image_ids.size();
+    double best_overlap_ratio = max_overlap_ratio;
+    for (const auto& shared : num_shared_images) {
+      const size_t num_merged_images = merged_image_ids[shared.first].size();
+      if (num_merged_images + image_ids.size() - shared.second >
+          max_num_images) {
+        continue;
+      }
+      const double overlap_ratio =
+          static_cast<double>(shared.second) /
+          std::min(num_merged_images, image_ids.size());
+      if (overlap_ratio > best_overlap_ratio ||
+          (overlap_ratio == best_overlap_ratio &&
+           best_merged_area_idx < merged_image_ids.size() &&
+           shared.first < best_merged_area_idx)) {
+        best_merged_area_idx = shared.first;
+        best_overlap_ratio = overlap_ratio;
+      }
+    }
+
+    if (best_merged_area_idx == merged_image_ids.size()) {
+      merged_center_image_ids.push_back(center_image_id);
+      merged_image_ids.emplace_back();
+    }
+    std::vector<image_t>& merged_area = merged_image_ids[best_merged_area_idx];
+    for (const image_t image_id : image_ids) {
+      std::vector<size_t>& merged_area_idxs = image_merged_area_idxs[image_id];
+      if (std::find(merged_area_idxs.begin(),
+                    merged_area_idxs.end(),
+                    best_merged_area_idx) == merged_area_idxs.end()) {
+        merged_area_idxs.push_back(best_merged_area_idx);
+        merged_area.push_back(image_id);
+      }
+    }
+  }
+
+  std::unordered_map<image_t, std::vector<image_t>> merged_areas;
+  merged_areas.reserve(merged_image_ids.size());
+  for (size_t i = 0; i < merged_image_ids.size(); ++i) {
+    merged_areas.emplace(merged_center_image_ids[i],
+                         std::move(merged_image_ids[i]));
+  }
+  return merged_areas;
+}
+
+}  // namespace
 
 bool HybridMapper::Options::Check() const {
   CHECK_OPTION_GT(re_max_num_images, 0);
   CHECK_OPTION_GT(re_max_distance, 0);
+  CHECK_OPTION_GE(re_max_overlap_ratio, 0);
+  CHECK_OPTION_LE(re_max_overlap_ratio, 1);
   CHECK_OPTION_GE(pgo_rel_pose_multi, 0);
   CHECK_OPTION_GE(pgo_abs_pose_multi, 0);
   CHECK_OPTION_GE(pgo_smooth_multi, 0);
+  CHECK_OPTION(pgo_options.Check());
   return true;
 }
 
@@ -67,7 +376,6 @@ void HybridMapper::EndReconstruction() {
   num_registrations_.clear();
   image_pair_stats_.clear();
   upgraded_image_pair_stats_.clear();
-  image_id_to_name_.clear();
 }
 
 std::shared_ptr<const Reconstruction> HybridMapper::GetReconstruction() const {
@@ -77,17 +385,106 @@ std::shared_ptr<const Reconstruction> HybridMapper::GetReconstruction() const {
 
 void HybridMapper::PartitionScene(
     const SceneClustering::Options& clustering_options) {
-  database_.Open(database_path_);
-  LOG(INFO) << "Reading images...";
-  const auto images = database_.ReadAllImages();
-  image_id_to_name_.reserve(images.size());
-  for (const auto& image : images) {
-    image_id_to_name_.emplace(image.ImageId(), image.Name());
+  COLMAP_TRACE_SCOPE("HybridMapper::PartitionScene");
+  database_.Open(database_path_, /*read_only=*/true);
+  if (clustering_options.use_pose_priors) {
+    CHECK_NOTNULL(reconstruction_);
+
+    // Sort the images for a deterministic partitioning.
+    std::vector<image_t> image_ids;
+    image_ids.reserve(reconstruction_->NumImages());
+    for (const auto& image_el : reconstruction_->Images()) {
+      image_ids.push_back(image_el.first);
+    }
+    std::sort(image_ids.begin(), image_ids.end());
+
+    std::vector<image_t> prior_image_ids;
+    std::vector<Eigen::Vector2d> footprint_centers;
+    std::vector<double> footprint_radii;
+    prior_image_ids.reserve(image_ids.size());
+    footprint_centers.reserve(image_ids.size());
+    footprint_radii.reserve(image_ids.size());
+    for (const image_t image_id : image_ids) {
+      const Image& image = reconstruction_->Image(image_id);
+      Eigen::Vector2d footprint_center;
+      double footprint_radius;
+      if (PredictPriorFootprint(image,
+                                reconstruction_->Camera(image.CameraId()),
+                                clustering_options.prior_altitude,
+                                &footprint_center,
+                                &footprint_radius)) {
+        prior_image_ids.push_back(image_id);
+        footprint_centers.push_back(footprint_center);
+        footprint_radii.push_back(footprint_radius);
+      }
+    }
+
+    LOG(INFO) << "Partitioning scene by the pose priors of "
+              << prior_image_ids.size() << " images...";
+    scene_clustering_ = std::make_unique<SceneClustering>(clustering_options);
+    scene_clustering_->PartitionSpatially(
+        prior_image_ids, footprint_centers, footprint_radii);
+
+    // Assign the images without pose prior by the scene graph.
+    std::vector<std::pair<image_t, image_t>> image_pairs;
+    std::vector<int> num_inliers;
+    database_.ReadTwoViewGeometryNumInliers(&image_pairs, &num_inliers);
+    scene_clustering_->AppendImages(image_pairs, num_inliers);
+  } else {
+    scene_clustering_ = std::make_unique<SceneClustering>(
+        SceneClustering::Create(clustering_options, database_));
   }
+  database_.Close();
+
+  reconstruction_managers_.clear();
+  merged_reconstruction_managers_.clear();
+  const auto leaf_clusters = scene_clustering_->GetLeafClusters();
+  dirty_clusters_ = std::unordered_set<const SceneClustering::Cluster*>(
+      leaf_clusters.begin(), leaf_clusters.end());
+}
+
+void HybridMapper::AppendImages(
+    std::shared_ptr<const DatabaseCache> database_cache) {
+  COLMAP_TRACE_SCOPE("HybridMapper::AppendImages");
+  CHECK_NOTNULL(reconstruction_);
+  CHECK(scene_clustering_) << "Scene must be partitioned before appending";
+
+  // Load the new images and initialize them by their pose priors as in
+  // `BeginReconstruction`, while keeping the poses of the existing images.
+  database_cache_ = std::move(database_cache);
+  reconstruction_->Load(*database_cache_);
+  reconstruction_->SetUp(database_cache_->CorrespondenceGraph());
 
-  scene_clustering_ = std::make_unique<SceneClustering>(
-      SceneClustering::Create(clustering_options, database_));
+  const Rigid3d cam_from_prior = Inverse(reconstruction_->PriorFromCam());
+  for (const auto& image_el : reconstruction_->Images()) {
+    if (image_el.second.IsRegistered()) {
+      continue;
+    }
+    Image& image = reconstruction_->Image(image_el.first);
+    image.CamFromWorld() = cam_from_prior * image.CamFromWorldPrior();
+    reconstruction_->RegisterImage(image_el.first);
+    num_registrations_.emplace(image_el.first, 0);
+  }
+
+  for (const auto& image_pair : reconstruction_->ImagePairs()) {
+    image_pair_stats_.emplace(image_pair.first,
+                              image_pair.second.num_total_corrs);
+  }
+
+  std::vector<std::pair<image_t, image_t>> image_pairs;
+  std::vector<int> num_inliers;
+  database_.Open(database_path_, /*read_only=*/true);
+  database_.ReadTwoViewGeometryNumInliers(&image_pairs, &num_inliers);
   database_.Close();
+
+  const auto dirty_leaf_clusters =
+      scene_clustering_->AppendImages(image_pairs, num_inliers);
+  dirty_clusters_.insert(dirty_leaf_clusters.begin(),
+                         dirty_leaf_clusters.end());
+
+  LOG(INFO) << StringPrintf("Appended images to %d of %d clusters",
+                            dirty_leaf_clusters.size(),
+                            scene_clustering_->GetLeafClusters().size());
 }
 
 void HybridMapper::ExtractViewGraphStats(
@@ -144,7 +541,16 @@ void HybridMapper::ExtractViewGraphStats(
 }
 
 void HybridMapper::ReconstructClusters(const Options& options) {
-  auto leaf_clusters = scene_clustering_->GetLeafClusters();
+  COLMAP_TRACE_SCOPE("HybridMapper::ReconstructClusters");
+  // Only reconstruct the clusters that changed since their last
+  // reconstruction, e.g., after appending new images.
+  std::vector<const SceneClustering::Cluster*> leaf_clusters;
+  for (const auto* cluster : scene_clustering_->GetLeafClusters()) {
+    if (dirty_clusters_.count(cluster) > 0 ||
+        reconstruction_managers_.count(cluster) == 0) {
+      leaf_clusters.push_back(cluster);
+    }
+  }
 
   size_t total_num_images = 0;
   for (size_t i = 0; i < leaf_clusters.size(); ++i) {
@@ -162,11 +568,17 @@ void HybridMapper::ReconstructClusters(const Options& options) {
   const int kDefaultNumWorkers = 8;
   const int num_eff_workers =
       options.num_workers < 1
-          ? std::min(static_cast<int>(leaf_clusters.size()),
-                     std::min(kDefaultNumWorkers, num_eff_threads))
+          ? std::max(1,
+                     std::min(static_cast<int>(leaf_clusters.size()),
+                              std::min(kDefaultNumWorkers, num_eff_threads)))
           : options.num_workers;
-  const int num_threads_per_worker =
-      std::max(1, num_eff_threads / num_eff_workers);
+  std::atomic<int> num_pending_clusters(static_cast<int>(leaf_clusters.size()));
+  max_memory_usage_ = options.max_memory_usage_mb > 0
+                          ? static_cast<size_t>(options.max_memory_usage_mb) *
+                                1024 * 1024
+                          : 0;
+  const std::function<int()> dynamic_num_threads = DynamicNumThreadsPerWorker(
+      num_eff_threads, num_eff_workers, &num_pending_clusters);
 
   // Start reconstructing the bigger clusters first for better resource usage.
   std::sort(leaf_clusters.begin(),
@@ -180,11 +592,6 @@ void HybridMapper::ReconstructClusters(const Options& options) {
   // thread to avoid race conditions.
   reconstruction_managers_.reserve(leaf_clusters.size());
   {
-    // I honestly don't know why, but having database opened during this
-    // multi-threaded reconstruction is helpful to reduce the chance of getting
-    // `database is locked error`. But this does not help to completely avoid
-    // it.
-    database_.Open(database_path_);
     ThreadPool thread_pool(num_eff_workers);
     for (const auto& cluster : leaf_clusters) {
       reconstruction_managers_[cluster] =
@@ -193,21 +600,32 @@ void HybridMapper::ReconstructClusters(const Options& options) {
           *incremental_options_.get());
       incremental_options->multiple_models = true;
       if (incremental_options->num_threads < 0) {
-        incremental_options->num_threads = num_threads_per_worker;
-      }
-
-      for (const auto image_id : cluster->image_ids) {
-        incremental_options->image_names.insert(image_id_to_name_.at(image_id));
+        incremental_options->dynamic_num_threads = dynamic_num_threads;
       }
 
       thread_pool.AddTask(&HybridMapper::ReconstructCluster,
                           this,
                           incremental_options,
-                          reconstruction_managers_[cluster]);
+                          std::unordered_set<image_t>(
+                              cluster->image_ids.begin(),
+                              cluster->image_ids.end()),
+                          reconstruction_managers_[cluster],
+                          &num_pending_clusters);
     }
     thread_pool.Wait();
-    database_.Close();
   }
+
+  // The reconstructions of the revisited clusters were replaced.
+  ResetViewGraphStats();
+}
+
+void HybridMapper::ResetViewGraphStats() {
+  for (auto& image_el : num_registrations_) {
+    image_el.second = 0;
+  }
+  upgraded_image_pair_stats_.clear();
+  weak_area_reconstructions_.clear();
+
   std::vector<std::shared_ptr<const Reconstruction>> sub_recons;
   for (const auto& cluster_el : reconstruction_managers_) {
     for (size_t i = 0; i < cluster_el.second->Size(); i++) {
@@ -218,6 +636,7 @@ void HybridMapper::ReconstructClusters(const Options& options) {
 }
 
 void HybridMapper::ReconstructWeakArea(const Options& options) {
+  COLMAP_TRACE_SCOPE("HybridMapper::ReconstructWeakArea");
   // Collect for weakly reconstructed iamges.
   std::unordered_set<image_t> weak_image_ids;
   for (const auto& image : num_registrations_) {
@@ -269,6 +688,63 @@ void HybridMapper::ReconstructWeakArea(const Options& options) {
   LOG(INFO) << "  => Searched " << weak_area_clusters.size()
             << " clusters of images to revisit";
 
+  if (options.re_max_overlap_ratio < 1) {
+    const size_t num_weak_area_clusters = weak_area_clusters.size();
+    weak_area_clusters =
+        MergeOverlappingAreas(weak_area_clusters,
+                              options.re_max_overlap_ratio,
+                              2 * options.re_max_num_images);
+    LOG(INFO) << "  => Merged " << num_weak_area_clusters
+              << " overlapping clusters into " << weak_area_clusters.size()
+              << " clusters";
+  }
+
+  // The previous sub-reconstructions, whose poses initialize the areas with
+  // all images registered in one of them.
+  std::vector<std::shared_ptr<const Reconstruction>> init_recons;
+  std::unordered_map<image_t, std::vector<size_t>> image_init_recon_idxs;
+  if (options.re_reuse_poses) {
+    for (const auto& cluster_el : reconstruction_managers_) {
+      for (size_t i = 0; i < cluster_el.second->Size(); i++) {
+        init_recons.push_back(cluster_el.second->Get(i));
+      }
+    }
+    for (const auto& recons : weak_area_reconstructions_) {
+      for (size_t i = 0; i < recons->Size(); i++) {
+        init_recons.push_back(recons->Get(i));
+      }
+    }
+    for (size_t i = 0; i < init_recons.size(); ++i) {
+      for (const image_t image_id : init_recons[i]->RegImageIds()) {
+        image_init_recon_idxs[image_id].push_back(i);
+      }
+    }
+  }
+
+  const auto find_init_recon = [&](const std::vector<image_t>& image_ids) {
+    std::unordered_map<size_t, size_t> num_reg_images;
+    for (const image_t image_id : image_ids) {
+      const auto it = image_init_recon_idxs.find(image_id);
+      if (it == image_init_recon_idxs.end()) {
+        return std::shared_ptr<const Reconstruction>();
+      }
+      for (const size_t init_recon_idx : it->second) {
+        num_reg_images[init_recon_idx] += 1;
+      }
+    }
+    size_t best_init_recon_idx = init_recons.size();
+    for (const auto& num_reg_images_el : num_reg_images) {
+      if (num_reg_images_el.second == image_ids.size() &&
+          num_reg_images_el.first < best_init_recon_idx) {
+        best_init_recon_idx = num_reg_images_el.first;
+      }
+    }
+    if (best_init_recon_idx == init_recons.size()) {
+      return std::shared_ptr<const Reconstruction>();
+    }
+    return init_recons[best_init_recon_idx];
+  };
+
   ss.clear();
   size_t wr_cnt = 0;
   for (const auto& weak_area : weak_area_clusters) {
@@ -290,8 +766,14 @@ void HybridMapper::ReconstructWeakArea(const Options& options) {
           ? std::min(static_cast<int>(weak_area_clusters.size()),
                      std::min(kDefaultNumWorkers, num_eff_threads))
           : options.num_workers;
-  const int num_threads_per_worker =
-      std::max(1, num_eff_threads / num_eff_workers);
+  std::atomic<int> num_pending_clusters(
+      static_cast<int>(weak_area_clusters.size()));
+  max_memory_usage_ = options.max_memory_usage_mb > 0
+                          ? static_cast<size_t>(options.max_memory_usage_mb) *
+                                1024 * 1024
+                          : 0;
+  const std::function<int()> dynamic_num_threads = DynamicNumThreadsPerWorker(
+      num_eff_threads, num_eff_workers, &num_pending_clusters);
 
   // Start the reconstruction workers. Use a separate reconstruction manager per
   // thread to avoid race conditions.
@@ -299,8 +781,8 @@ void HybridMapper::ReconstructWeakArea(const Options& options) {
       weak_area_reconstructions;
   weak_area_reconstructions.reserve(weak_area_clusters.size());
 
+  size_t num_reused_clusters = 0;
   {
-    database_.Open(database_path_);
     ThreadPool thread_pool(num_eff_workers);
     for (const auto& cluster : weak_area_clusters) {
       // Use the weak image id as one of the initial image pair.
@@ -312,21 +794,40 @@ void HybridMapper::ReconstructWeakArea(const Options& options) {
       incremental_options->min_model_size = 3;
       incremental_options->init_image_id1 = cluster.first;
       if (incremental_options->num_threads < 0) {
-        incremental_options->num_threads = num_threads_per_worker;
+        incremental_options->dynamic_num_threads = dynamic_num_threads;
       }
 
-      for (const auto image_id : cluster.second) {
-        incremental_options->image_names.insert(image_id_to_name_.at(image_id));
+      std::shared_ptr<const Reconstruction> init_recon =
+          options.re_reuse_poses ? find_init_recon(cluster.second) : nullptr;
+      if (init_recon) {
+        num_reused_clusters += 1;
+        thread_pool.AddTask(&HybridMapper::TriangulateWeakArea,
+                            this,
+                            incremental_options,
+                            std::move(init_recon),
+                            std::unordered_set<image_t>(cluster.second.begin(),
+                                                        cluster.second.end()),
+                            weak_area_reconstructions[cluster.first],
+                            &num_pending_clusters);
+        continue;
       }
 
-      thread_pool.AddTask(&HybridMapper::ReconstructCluster,
-                          this,
-                          incremental_options,
-                          weak_area_reconstructions[cluster.first]);
+      thread_pool.AddTask(
+          &HybridMapper::ReconstructCluster,
+          this,
+          incremental_options,
+          std::unordered_set<image_t>(cluster.second.begin(),
+                                      cluster.second.end()),
+          weak_area_reconstructions[cluster.first],
+          &num_pending_clusters);
     }
     thread_pool.Wait();
-    database_.Close();
   }
+  if (options.re_reuse_poses) {
+    LOG(INFO) << "  => Triangulated " << num_reused_clusters
+              << " clusters from the poses of previous reconstructions";
+  }
+
   std::vector<std::shared_ptr<const Reconstruction>> sub_recons;
   for (const auto& cluster_el : weak_area_reconstructions) {
     for (size_t i = 0; i < cluster_el.second->Size(); i++) {
@@ -354,7 +855,8 @@ void HybridMapper::ReconstructWeakArea(const Options& options) {
 }
 
 void HybridMapper::GlobalPoseGraphOptim(const Options& options) {
-  PoseGraphOptimizer pgo_optim(reconstruction_);
+  COLMAP_TRACE_SCOPE("HybridMapper::GlobalPoseGraphOptim");
+  PoseGraphOptimizer pgo_optim(options.pgo_options, reconstruction_);
 
   // Reuse some of the options from BundleAdjustment.
   BundleAdjustmentOptions ba_options =
@@ -380,6 +882,15 @@ void HybridMapper::GlobalPoseGraphOptim(const Options& options) {
   }
 
   for (const auto recon : sub_recons) {
+    SubReconstructionPoseCovariance pose_covariance;
+    const bool has_pose_covariance =
+        options.pgo_use_pose_covariance &&
+        pose_covariance.Estimate(ba_options, *recon);
+    if (options.pgo_use_pose_covariance && !has_pose_covariance) {
+      LOG(WARNING) << "Failed to estimate the pose covariances of a "
+                      "sub-reconstruction, using identity information.";
+    }
+
     for (const auto& image_pair : upgraded_image_pair_stats_) {
       image_t image_id1;
       image_t image_id2;
@@ -396,10 +907,15 @@ void HybridMapper::GlobalPoseGraphOptim(const Options& options) {
 
       const Rigid3d cam2_from_cam1 =
           image_b.CamFromWorld() * Inverse(image_a.CamFromWorld());
+      Eigen::Matrix6d rel_information = information;
+      if (has_pose_covariance) {
+        pose_covariance.RelativePoseInformation(
+            image_id1, image_id2, &rel_information);
+      }
       pgo_optim.AddRelativePose(image_id1,
                                 image_id2,
                                 cam2_from_cam1,
-                                information * options.pgo_rel_pose_multi,
+                                rel_information * options.pgo_rel_pose_multi,
                                 nullptr);
       num_rel++;
     }
@@ -541,13 +1057,15 @@ void HybridMapper::GlobalPoseGraphOptim(const Options& options) {
 }
 
 void HybridMapper::ReconstructInlierTracks(const Options& options) {
+  COLMAP_TRACE_SCOPE("HybridMapper::ReconstructInlierTracks");
   // First merge all sub-reconstructions to collect for all tracks.
-  MergeClusters();
+  MergeClusters(options);
   // Collect for all inlier tracks and re-estimate them using the optimized
   // poses.
 
   std::shared_ptr<const Reconstruction> merged_recon =
-      reconstruction_managers_.begin()->second->Get(0);
+      merged_reconstruction_managers_.at(scene_clustering_->GetRootCluster())
+          ->Get(0);
 
   // Re-use some options from IncrementalTriangulator.
   IncrementalTriangulator::Options tri_options =
@@ -556,32 +1074,125 @@ void HybridMapper::ReconstructInlierTracks(const Options& options) {
   const auto& points3Ds = merged_recon->Points3D();
   LOG(INFO) << "  => Re-triangulating " << points3Ds.size() << " 3D points";
 
+  std::vector<const Track*> tracks;
+  tracks.reserve(points3Ds.size());
   for (const auto& point3D_el : points3Ds) {
     if (point3D_el.second.track.Length() < 2 ||
         (point3D_el.second.track.Length() == 2 &&
          tri_options.ignore_two_view_tracks)) {
       continue;
     }
-    const Track& track = point3D_el.second.track;
-    TriangulateTrack(tri_options, track);
+    tracks.push_back(&point3D_el.second.track);
   }
 
-  // Bundle adjust the triangulated 3D points.
-  auto ba_options = incremental_options_->GlobalBundleAdjustment();
-  ba_options.refine_focal_length = false;
-  ba_options.refine_principal_point = false;
-  ba_options.refine_extra_params = false;
-  ba_options.refine_extrinsics = false;
+  // The tracks are triangulated in parallel and the new points are staged per
+  // chunk, since the reconstruction cannot be modified concurrently.
+  struct TriangulatedPoint {
+    Eigen::Vector3d xyz;
+    Track track;
+  };
+
+  const int num_threads =
+      GetEffectiveNumThreads(incremental_options_->NumThreads());
+  const size_t kNumPointsPerChunk = 1000;
+  const size_t num_chunks =
+      (tracks.size() + kNumPointsPerChunk - 1) / kNumPointsPerChunk;
+  std::vector<std::vector<TriangulatedPoint>> triangulated_points(num_chunks);
 
-  // Configure bundle adjustment to adjust only 3D points.
-  BundleAdjustmentConfig ba_config;
-  for (const image_t image_id : reconstruction_->RegImageIds()) {
-    ba_config.AddImage(image_id);
+  {
+    ThreadPool thread_pool(num_threads);
+    for (size_t chunk_idx = 0; chunk_idx < num_chunks; ++chunk_idx) {
+      thread_pool.AddTask([&, chunk_idx]() {
+        const size_t begin = chunk_idx * kNumPointsPerChunk;
+        const size_t end =
+            std::min(tracks.size(), begin + kNumPointsPerChunk);
+        std::vector<TriangulatedPoint>& chunk_points =
+            triangulated_points[chunk_idx];
+        chunk_points.reserve(end - begin);
+        TriangulatedPoint point;
+        for (size_t i = begin; i < end; ++i) {
+          if (TriangulateTrack(
+                  tri_options, *tracks[i], &point.xyz, &point.track)) {
+            chunk_points.push_back(std::move(point));
+          }
+        }
+      });
+    }
+    thread_pool.Wait();
+  }
+
+  for (auto& chunk_points : triangulated_points) {
+    for (auto& point : chunk_points) {
+      reconstruction_->AddPoint3D(point.xyz, std::move(point.track));
+    }
   }
 
   reconstruction_->FilterObservationsWithNegativeDepth();
-  BundleAdjuster bundle_adjuster(ba_options, ba_config);
-  CHECK(bundle_adjuster.Solve(reconstruction_.get()));
+
+  const BundleAdjustmentOptions ba_options =
+      incremental_options_->GlobalBundleAdjustment();
+
+  // The refractive parameters are shared by the points of their cameras, so
+  // that refining them requires one joint bundle adjustment of all points.
+  if (ba_options.enable_refraction && ba_options.refine_refrac_params) {
+    BundleAdjustmentOptions joint_ba_options = ba_options;
+    joint_ba_options.refine_focal_length = false;
+    joint_ba_options.refine_principal_point = false;
+    joint_ba_options.refine_extra_params = false;
+    joint_ba_options.refine_extrinsics = false;
+
+    // Configure bundle adjustment to adjust only 3D points and the
+    // refractive parameters.
+    BundleAdjustmentConfig ba_config;
+    for (const image_t image_id : reconstruction_->RegImageIds()) {
+      ba_config.AddImage(image_id);
+    }
+
+    LOG(INFO) << "  => Refining 3D points and refractive parameters";
+    BundleAdjuster bundle_adjuster(joint_ba_options, ba_config);
+    CHECK(bundle_adjuster.Solve(reconstruction_.get()));
+    return;
+  }
+
+  // Refine the triangulated 3D points. With fixed camera poses and
+  // intrinsics, each point is an independent problem, which is solved in
+  // parallel instead of one joint bundle adjustment of all points.
+
+  // The cost functions refer to the poses, which must be normalized.
+  for (const image_t image_id : reconstruction_->RegImageIds()) {
+    reconstruction_->Image(image_id).CamFromWorld().rotation.normalize();
+  }
+
+  std::vector<point3D_t> point3D_ids;
+  point3D_ids.reserve(reconstruction_->NumPoints3D());
+  for (const auto& point3D : reconstruction_->Points3D()) {
+    point3D_ids.push_back(point3D.first);
+  }
+
+  LOG(INFO) << "  => Refining " << point3D_ids.size() << " 3D points";
+
+  std::atomic<size_t> num_refined_points(0);
+  {
+    ThreadPool thread_pool(num_threads);
+    for (size_t begin = 0; begin < point3D_ids.size();
+         begin += kNumPointsPerChunk) {
+      thread_pool.AddTask([&, begin]() {
+        const size_t end =
+            std::min(point3D_ids.size(), begin + kNumPointsPerChunk);
+        for (size_t i = begin; i < end; ++i) {
+          Eigen::Vector3d xyz;
+          if (RefinePoint3D(
+                  ba_options, *reconstruction_, point3D_ids[i], &xyz)) {
+            reconstruction_->Point3D(point3D_ids[i]).xyz = xyz;
+            ++num_refined_points;
+          }
+        }
+      });
+    }
+    thread_pool.Wait();
+  }
+
+  LOG(INFO) << "  => Refined " << num_refined_points << " 3D points";
 }
 
 void HybridMapper::PrintViewGraphStats() const {
@@ -656,55 +1267,237 @@ HybridMapper::GetReconstructionManagers() const {
   return reconstruction_managers_;
 }
 
+void HybridMapper::WritePartition(const std::string& path) const {
+  CHECK(scene_clustering_) << "Scene must be partitioned before writing";
+  scene_clustering_->Write(path);
+}
+
+void HybridMapper::ReadPartition(
+    const SceneClustering::Options& clustering_options,
+    const std::string& path) {
+  scene_clustering_ = std::make_unique<SceneClustering>(clustering_options);
+  scene_clustering_->Read(path);
+
+  reconstruction_managers_.clear();
+  merged_reconstruction_managers_.clear();
+  const auto leaf_clusters = scene_clustering_->GetLeafClusters();
+  dirty_clusters_ = std::unordered_set<const SceneClustering::Cluster*>(
+      leaf_clusters.begin(), leaf_clusters.end());
+}
+
+std::vector<std::shared_ptr<ReconstructionManager>>
+HybridMapper::GetLeafReconstructionManagers() const {
+  CHECK(scene_clustering_) << "Scene must be partitioned";
+  std::vector<std::shared_ptr<ReconstructionManager>> reconstruction_managers;
+  for (const auto* cluster : scene_clustering_->GetLeafClusters()) {
+    reconstruction_managers.push_back(reconstruction_managers_.at(cluster));
+  }
+  return reconstruction_managers;
+}
+
+void HybridMapper::SetLeafReconstructionManagers(
+    const std::vector<std::shared_ptr<ReconstructionManager>>&
+        reconstruction_managers) {
+  CHECK(scene_clustering_) << "Scene must be partitioned";
+  const auto leaf_clusters = scene_clustering_->GetLeafClusters();
+  CHECK_EQ(leaf_clusters.size(), reconstruction_managers.size());
+  for (size_t i = 0; i < leaf_clusters.size(); ++i) {
+    reconstruction_managers_[leaf_clusters[i]] =
+        CHECK_NOTNULL(reconstruction_managers[i]);
+    dirty_clusters_.erase(leaf_clusters[i]);
+  }
+  ResetViewGraphStats();
+}
+
+const std::vector<std::shared_ptr<ReconstructionManager>>&
+HybridMapper::GetWeakAreaReconstructionManagers() const {
+  return weak_area_reconstructions_;
+}
+
+void HybridMapper::AddWeakAreaReconstructionManager(
+    std::shared_ptr<ReconstructionManager> reconstruction_manager) {
+  std::vector<std::shared_ptr<const Reconstruction>> sub_recons;
+  for (size_t i = 0; i < reconstruction_manager->Size(); i++) {
+    sub_recons.push_back(reconstruction_manager->Get(i));
+  }
+  ExtractViewGraphStats(sub_recons);
+  weak_area_reconstructions_.push_back(std::move(reconstruction_manager));
+}
+
+void HybridMapper::RestoreReconstruction(const Reconstruction& reconstruction) {
+  CHECK_NOTNULL(reconstruction_);
+  CHECK_EQ(reconstruction_->NumPoints3D(), 0);
+  for (const image_t image_id : reconstruction.RegImageIds()) {
+    CHECK(reconstruction_->IsImageRegistered(image_id));
+    reconstruction_->Image(image_id).CamFromWorld() =
+        reconstruction.Image(image_id).CamFromWorld();
+  }
+  for (const auto& point3D : reconstruction.Points3D()) {
+    const point3D_t point3D_id = reconstruction_->AddPoint3D(
+        point3D.second.xyz, point3D.second.track, point3D.second.color);
+    reconstruction_->Point3D(point3D_id).error = point3D.second.error;
+  }
+}
+
 void HybridMapper::ReconstructCluster(
     std::shared_ptr<const IncrementalMapperOptions> incremental_options,
-    std::shared_ptr<ReconstructionManager> reconstruction_manager) {
-  IncrementalMapperController mapper(std::move(incremental_options),
-                                     image_path_,
-                                     database_path_,
-                                     std::move(reconstruction_manager));
-  mapper.Start();
-  mapper.Wait();
+    const std::unordered_set<image_t>& image_ids,
+    std::shared_ptr<ReconstructionManager> reconstruction_manager,
+    std::atomic<int>* num_pending_clusters) {
+  COLMAP_TRACE_SCOPE("HybridMapper::ReconstructCluster");
+  const size_t memory_usage = EstimateClusterMemoryUsage(image_ids.size());
+  ReserveMemory(memory_usage);
+  {
+    // Reconstruct from a subset of the shared in-memory cache, since reading
+    // the database concurrently from all workers is slow and prone to locking.
+    IncrementalMapperController mapper(
+        std::move(incremental_options),
+        image_path_,
+        DatabaseCache::CreateSubset(*database_cache_, image_ids),
+        std::move(reconstruction_manager));
+    mapper.Start();
+    mapper.Wait();
+  }
+  ReleaseMemory(memory_usage);
+  // Hand the threads of this worker to the still running workers.
+  --(*num_pending_clusters);
 }
 
-std::unordered_map<image_t, std::vector<image_t>> HybridMapper::FindLocalAreas(
+void HybridMapper::TriangulateWeakArea(
+    std::shared_ptr<const IncrementalMapperOptions> incremental_options,
+    std::shared_ptr<const Reconstruction> init_reconstruction,
     const std::unordered_set<image_t>& image_ids,
-    const size_t max_num_images,
-    const double max_distance) const {
-  const std::vector<image_t>& reg_image_ids = reconstruction_->RegImageIds();
+    std::shared_ptr<ReconstructionManager> reconstruction_manager,
+    std::atomic<int>* num_pending_clusters) {
+  COLMAP_TRACE_SCOPE("HybridMapper::TriangulateWeakArea");
+  const size_t memory_usage = EstimateClusterMemoryUsage(image_ids.size());
+  ReserveMemory(memory_usage);
+  {
+    std::shared_ptr<const DatabaseCache> database_cache =
+        DatabaseCache::CreateSubset(*database_cache_, image_ids);
+    const size_t reconstruction_idx = reconstruction_manager->Add();
+    std::shared_ptr<Reconstruction> reconstruction =
+        reconstruction_manager->Get(reconstruction_idx);
+
+    // Register the images with the poses and cameras of the initial
+    // reconstruction before the mapper sets up the reconstruction.
+    reconstruction->Load(*database_cache);
+    for (const image_t image_id : image_ids) {
+      const Image& init_image = init_reconstruction->Image(image_id);
+      reconstruction->Camera(init_image.CameraId()) =
+          init_reconstruction->Camera(init_image.CameraId());
+      reconstruction->Image(image_id).CamFromWorld() =
+          init_image.CamFromWorld();
+      reconstruction->RegisterImage(image_id);
+    }
 
-  struct ImageInfo {
-    image_t image_id;
-    double distance;
-  };
+    IncrementalMapper mapper(database_cache);
+    mapper.BeginReconstruction(reconstruction);
+    if (incremental_options->enable_refraction) {
+      reconstruction->UpdateRefracVirtualCameraTables();
+    }
+    mapper.TriangulateImages(
+        incremental_options->Triangulation(),
+        std::vector<image_t>(image_ids.begin(), image_ids.end()));
+    mapper.AdjustGlobalBundle(incremental_options->Mapper(),
+                              incremental_options->GlobalBundleAdjustment());
+    mapper.FilterPoints(incremental_options->Mapper());
+
+    const bool discard = reconstruction->NumPoints3D() == 0;
+    mapper.EndReconstruction(discard);
+    if (discard) {
+      reconstruction_manager->Delete(reconstruction_idx);
+    }
+  }
+  ReleaseMemory(memory_usage);
+  // Hand the threads of this worker to the still running workers.
+  --(*num_pending_clusters);
+}
 
-  std::unordered_map<image_t, std::vector<ImageInfo>> local_image_infos;
+size_t HybridMapper::EstimateClusterMemoryUsage(const size_t num_images) const {
+  if (max_memory_usage_ == 0 || database_cache_->NumImages() == 0) {
+    return 0;
+  }
+  // The subset of the database cache scales roughly with the number of images,
+  // and the reconstruction holds about as much as its database cache.
+  const size_t kReconstructionFactor = 2;
+  return kReconstructionFactor * num_images *
+         (database_cache_->MemoryUsage() / database_cache_->NumImages());
+}
 
-  for (const image_t image_id : image_ids) {
-    Eigen::Vector3d center_image_position =
-        reconstruction_->Image(image_id).ProjectionCenter();
+void HybridMapper::ReserveMemory(const size_t num_bytes) {
+  if (max_memory_usage_ == 0) {
+    return;
+  }
+  std::unique_lock<std::mutex> lock(memory_mutex_);
+  // Always admit a cluster if no other cluster is reconstructed, even if it
+  // exceeds the budget on its own, to guarantee progress.
+  memory_condition_.wait(lock, [this, num_bytes]() {
+    return reserved_memory_usage_ == 0 ||
+           reserved_memory_usage_ + num_bytes <= max_memory_usage_;
+  });
+  reserved_memory_usage_ += num_bytes;
+  COLMAP_TRACE_HISTOGRAM("HybridMapper reserved memory [MB]",
+                         reserved_memory_usage_ / (1024.0 * 1024.0));
+}
 
-    std::vector<ImageInfo> local_images;
+void HybridMapper::ReleaseMemory(const size_t num_bytes) {
+  if (max_memory_usage_ == 0) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(memory_mutex_);
+    reserved_memory_usage_ -= num_bytes;
+  }
+  memory_condition_.notify_all();
+}
 
-    for (const image_t reg_image_id : reg_image_ids) {
-      if (reg_image_id == image_id) {
-        continue;
-      }
+std::unordered_map<image_t, std::vector<image_t>> HybridMapper::FindLocalAreas(
+    const std::unordered_set<image_t>& image_ids,
+    const size_t max_num_images,
+    const double max_distance) const {
+  const std::vector<image_t>& reg_image_ids = reconstruction_->RegImageIds();
 
-      Eigen::Vector3d position =
-          reconstruction_->Image(reg_image_id).ProjectionCenter();
-      const double distance = (center_image_position - position).norm();
-      if (distance > max_distance) {
-        continue;
+  // Index the projection centers of the registered images, such that the
+  // local area of every image is found by a k-nearest neighbor search with a
+  // radius cutoff instead of comparing it to every registered image.
+  std::vector<SpatialIndex::Id> reg_ids(reg_image_ids.begin(),
+                                        reg_image_ids.end());
+  std::vector<Eigen::Vector3d> reg_centers;
+  reg_centers.reserve(reg_image_ids.size());
+  for (const image_t image_id : reg_image_ids) {
+    reg_centers.push_back(reconstruction_->Image(image_id).ProjectionCenter());
+  }
+  SpatialIndex reg_index;
+  reg_index.Build(reg_ids, reg_centers);
+
+  const std::vector<image_t> query_image_ids(image_ids.begin(),
+                                             image_ids.end());
+  const size_t num_queries = query_image_ids.size();
+
+  // A registered image finds itself as its nearest neighbor.
+  std::vector<std::vector<image_t>> query_local_image_ids(num_queries);
+  ThreadPool thread_pool(
+      GetEffectiveNumThreads(incremental_options_->num_threads));
+  thread_pool.ParallelFor(0, num_queries, 16, [&](const int64_t i) {
+    const image_t image_id = query_image_ids[i];
+    const std::vector<SpatialIndex::Id> nearest_ids = reg_index.QueryNearest(
+        reconstruction_->Image(image_id).ProjectionCenter(),
+        max_num_images + 1,
+        max_distance);
+    std::vector<image_t>& local_images = query_local_image_ids[i];
+    for (const SpatialIndex::Id id : nearest_ids) {
+      if (id != image_id && local_images.size() < max_num_images) {
+        local_images.push_back(static_cast<image_t>(id));
       }
-
-      ImageInfo image_info;
-      image_info.image_id = reg_image_id;
-      image_info.distance = distance;
-      local_images.push_back(image_info);
     }
+  });
 
-    local_image_infos.emplace(image_id, local_images);
+  std::unordered_map<image_t, std::vector<image_t>> local_image_ids;
+  local_image_ids.reserve(num_queries);
+  for (size_t i = 0; i < num_queries; ++i) {
+    local_image_ids.emplace(query_image_ids[i],
+                            std::move(query_local_image_ids[i]));
   }
 
   // Creating clusters of images for each image id.
@@ -722,20 +1515,9 @@ std::unordered_map<image_t, std::vector<image_t>> HybridMapper::FindLocalAreas(
     total_images_to_be_reconstructed.insert(image_id);
     cluster.push_back(image_id);
 
-    std::vector<ImageInfo>& local_images = local_image_infos.at(image_id);
-
-    std::sort(local_images.begin(),
-              local_images.end(),
-              [](const ImageInfo& image1, const ImageInfo& image2) {
-                return image1.distance < image2.distance;
-              });
-
-    for (size_t i = 0; i < local_images.size(); i++) {
-      if (i >= max_num_images) {
-        break;
-      }
-      total_images_to_be_reconstructed.insert(local_images[i].image_id);
-      cluster.push_back(local_images[i].image_id);
+    for (const image_t local_image_id : local_image_ids.at(image_id)) {
+      total_images_to_be_reconstructed.insert(local_image_id);
+      cluster.push_back(local_image_id);
     }
 
     clusters.emplace(std::make_pair(image_id, cluster));
@@ -789,6 +1571,7 @@ void HybridMapper::UpdateSubReconstructions() {
       }
       // Update the image pose.
       image.CamFromWorld() = reconstruction_->Image(image_id).CamFromWorld();
+      recon->SetModifiedImage(image_id);
     }
 
     // Refine all 3D points of this sub-reconstruction.
@@ -812,67 +1595,123 @@ void HybridMapper::UpdateSubReconstructions() {
   }
 }
 
-void HybridMapper::MergeClusters(const SceneClustering::Cluster& cluster) {
-  // Extract all reconstructions from all child clusters.
-  std::vector<std::shared_ptr<Reconstruction>> reconstructions;
+bool HybridMapper::IsClusterDirty(
+    const SceneClustering::Cluster& cluster) const {
+  if (dirty_clusters_.count(&cluster) > 0) {
+    return true;
+  }
   for (const auto& child_cluster : cluster.child_clusters) {
-    if (!child_cluster.child_clusters.empty()) {
-      MergeClusters(child_cluster);
+    if (IsClusterDirty(child_cluster)) {
+      return true;
     }
+  }
+  return false;
+}
+
+void HybridMapper::MergeChildClusters(
+    const SceneClustering::Cluster& cluster) const {
+  // Collect the reconstructions of all child clusters, which must not be
+  // modified by the merging, since the merged reconstructions of unchanged
+  // branches are reused.
+  std::vector<std::shared_ptr<const Reconstruction>> reconstructions;
+  for (const auto& child_cluster : cluster.child_clusters) {
+    const std::shared_ptr<ReconstructionManager>& reconstruction_manager =
+        child_cluster.child_clusters.empty()
+            ? reconstruction_managers_.at(&child_cluster)
+            : merged_reconstruction_managers_.at(&child_cluster);
 
-    auto& reconstruction_manager = reconstruction_managers_.at(&child_cluster);
     for (size_t i = 0; i < reconstruction_manager->Size(); ++i) {
       reconstructions.push_back(reconstruction_manager->Get(i));
     }
   }
 
-  // Try to merge all child cluster reconstruction.
-  while (reconstructions.size() > 1) {
-    bool merge_success = false;
-    for (size_t i = 0; i < reconstructions.size(); ++i) {
-      const int num_reg_images_i = reconstructions[i]->NumRegImages();
-      for (size_t j = 0; j < i; ++j) {
-        const double kMaxReprojError = 32.0;
-        const int num_reg_images_j = reconstructions[j]->NumRegImages();
-        if (MergeReconstructions(kMaxReprojError,
-                                 *reconstructions[j],
-                                 reconstructions[i].get(),
-                                 false)) {
-          LOG(INFO) << StringPrintf(
-              " => Merged clusters with %d and %d images into %d images",
-              num_reg_images_i,
-              num_reg_images_j,
-              reconstructions[i]->NumRegImages());
-          reconstructions.erase(reconstructions.begin() + j);
-          merge_success = true;
-          break;
-        }
-      }
+  if (reconstructions.empty()) {
+    return;
+  }
 
-      if (merge_success) {
-        break;
-      }
+  // Merge all reconstructions into a copy-on-write view of the largest one, in
+  // their fixed order. Only the merged images and 3D points are stored in the
+  // view, instead of copying all child reconstructions before merging them.
+  const size_t base_idx =
+      std::max_element(reconstructions.begin(),
+                       reconstructions.end(),
+                       [](const std::shared_ptr<const Reconstruction>& recon1,
+                          const std::shared_ptr<const Reconstruction>& recon2) {
+                         return recon1->NumRegImages() < recon2->NumRegImages();
+                       }) -
+      reconstructions.begin();
+  ReconstructionOverlay merged_overlay(reconstructions[base_idx]);
+  for (size_t i = 0; i < reconstructions.size(); ++i) {
+    if (i == base_idx) {
+      continue;
     }
+    const double kMaxReprojError = 32.0;
+    const int num_reg_images_before =
+        static_cast<int>(merged_overlay.NumRegImages());
+    MergeReconstructions(kMaxReprojError, *reconstructions[i], &merged_overlay);
+    LOG(INFO) << StringPrintf(
+        " => Merged clusters with %d and %d images into %d images",
+        static_cast<int>(reconstructions[i]->NumRegImages()),
+        num_reg_images_before,
+        static_cast<int>(merged_overlay.NumRegImages()));
+  }
 
-    if (!merge_success) {
-      break;
+  auto merged_reconstruction =
+      std::make_shared<Reconstruction>(*reconstructions[base_idx]);
+  merged_overlay.Commit(merged_reconstruction.get());
+
+  const auto& reconstruction_manager =
+      merged_reconstruction_managers_.at(&cluster);
+  reconstruction_manager->Get(reconstruction_manager->Add()) =
+      std::move(merged_reconstruction);
+}
+
+void HybridMapper::MergeClusters(const SceneClustering::Cluster& root_cluster,
+                                 const int num_workers) {
+  // Collect the non-leaf clusters to merge by their level in the hierarchy.
+  // Branches without dirty clusters reuse their previously merged result.
+  std::vector<std::vector<const SceneClustering::Cluster*>> levels;
+  std::vector<const SceneClustering::Cluster*> level_clusters = {&root_cluster};
+  while (!level_clusters.empty()) {
+    std::vector<const SceneClustering::Cluster*> merge_clusters;
+    std::vector<const SceneClustering::Cluster*> child_clusters;
+    for (const auto* cluster : level_clusters) {
+      if (cluster->child_clusters.empty() ||
+          (cluster != &root_cluster && !IsClusterDirty(*cluster) &&
+           merged_reconstruction_managers_.count(cluster) > 0)) {
+        continue;
+      }
+      merge_clusters.push_back(cluster);
+      for (const auto& child_cluster : cluster->child_clusters) {
+        child_clusters.push_back(&child_cluster);
+      }
     }
+    if (!merge_clusters.empty()) {
+      levels.push_back(std::move(merge_clusters));
+    }
+    level_clusters = std::move(child_clusters);
   }
 
-  // Insert a new reconstruction manager for merged cluster.
-  auto& reconstruction_manager = reconstruction_managers_[&cluster];
-  reconstruction_manager = std::make_shared<ReconstructionManager>();
-  for (const auto& reconstruction : reconstructions) {
-    reconstruction_manager->Get(reconstruction_manager->Add()) = reconstruction;
-  }
+  // Clusters on the same level do not share any reconstructions and are merged
+  // in parallel, starting from the deepest level. Each cluster merges its
+  // children in their fixed order, so the result does not depend on the
+  // scheduling of the threads.
+  ThreadPool thread_pool(num_workers);
+  for (auto level = levels.rbegin(); level != levels.rend(); ++level) {
+    for (const auto* cluster : *level) {
+      merged_reconstruction_managers_[cluster] =
+          std::make_shared<ReconstructionManager>();
+    }
 
-  // Delete all merged child cluster reconstruction managers.
-  for (const auto& child_cluster : cluster.child_clusters) {
-    reconstruction_managers_.erase(&child_cluster);
+    for (const auto* cluster : *level) {
+      thread_pool.AddTask([this, cluster]() { MergeChildClusters(*cluster); });
+    }
+    thread_pool.Wait();
   }
 }
 
-void HybridMapper::MergeClusters() {
+void HybridMapper::MergeClusters(const Options& options) {
+  COLMAP_TRACE_SCOPE("HybridMapper::MergeClusters");
   // Update sub-reconstructions and then try to merge them. Since we have
   // updated camera poses and 3D points. There is no need to perform
   // similarity transformation to align them when merging.
@@ -880,13 +1719,36 @@ void HybridMapper::MergeClusters() {
 
   LOG(INFO) << " => Merging clusters";
 
-  MergeClusters(*scene_clustering_->GetRootCluster());
+  const SceneClustering::Cluster* root_cluster =
+      scene_clustering_->GetRootCluster();
+  if (root_cluster->child_clusters.empty()) {
+    auto& reconstruction_manager =
+        merged_reconstruction_managers_[root_cluster];
+    reconstruction_manager = std::make_shared<ReconstructionManager>();
+    const auto& leaf_reconstruction_manager =
+        reconstruction_managers_.at(root_cluster);
+    for (size_t i = 0; i < leaf_reconstruction_manager->Size(); ++i) {
+      reconstruction_manager->Get(reconstruction_manager->Add()) =
+          std::make_shared<Reconstruction>(
+              *leaf_reconstruction_manager->Get(i));
+    }
+  } else {
+    const int kMaxNumThreads = -1;
+    const int kDefaultNumWorkers = 8;
+    const int num_eff_workers =
+        options.num_workers < 1
+            ? std::min(kDefaultNumWorkers,
+                       GetEffectiveNumThreads(kMaxNumThreads))
+            : options.num_workers;
+    MergeClusters(*root_cluster, num_eff_workers);
+  }
+  dirty_clusters_.clear();
 
   LOG(INFO) << " => Merging weak areas";
 
   // Also merge weak area reconstructions if there are any.
   std::shared_ptr<Reconstruction> merged_recon =
-      reconstruction_managers_.begin()->second->Get(0);
+      merged_reconstruction_managers_.at(root_cluster)->Get(0);
   const double kMaxReprojError = 32.0;
   for (size_t i = 0; i < weak_area_reconstructions_.size(); i++) {
     for (size_t j = 0; j < weak_area_reconstructions_[i]->Size(); j++) {
@@ -907,14 +1769,15 @@ void HybridMapper::MergeClusters() {
 }
 
 bool HybridMapper::TriangulateTrack(
-    const IncrementalTriangulator::Options& tri_options, const Track& track) {
+    const IncrementalTriangulator::Options& tri_options,
+    const Track& track,
+    Eigen::Vector3d* xyz,
+    Track* inlier_track) const {
   // Setup data for triangulation estimation.
   std::vector<TriangulationEstimator::PointData> point_data;
   point_data.resize(track.Length());
   std::vector<TriangulationEstimator::PoseData> pose_data;
   pose_data.resize(track.Length());
-  std::vector<Camera> virtual_cameras;
-  virtual_cameras.resize(track.Length());
   for (size_t i = 0; i < track.Length(); i++) {
     const TrackElement& track_el = track.Element(i);
     const Image& image = reconstruction_->Image(track_el.image_id);
@@ -928,18 +1791,16 @@ bool HybridMapper::TriangulateTrack(
       pose_data[i].proj_center = image.ProjectionCenter();
       pose_data[i].camera = &camera;
     } else {
-      // Refractive case.
-      Rigid3d virtual_from_real;
-      camera.ComputeVirtual(point2D.xy, virtual_cameras[i], virtual_from_real);
+      // Refractive case, where the point is triangulated from the refracted
+      // viewing rays in world frame.
+      const Ray3D ray = camera.CamFromImgRefrac(point2D.xy);
+      const Rigid3d world_from_cam = Inverse(image.CamFromWorld());
       point_data[i].point = point2D.xy;
-      point_data[i].point_normalized =
-          virtual_cameras[i].CamFromImg(point_data[i].point);
-      const Rigid3d virtual_from_world =
-          virtual_from_real * image.CamFromWorld();
-      pose_data[i].proj_matrix = virtual_from_world.ToMatrix();
-      pose_data[i].proj_center = virtual_from_world.rotation.inverse() *
-                                 -virtual_from_world.translation;
-      pose_data[i].camera = &virtual_cameras[i];
+      point_data[i].ray_origin = world_from_cam * ray.ori;
+      point_data[i].ray_direction = world_from_cam.rotation * ray.dir;
+      pose_data[i].proj_matrix = image.CamFromWorld().ToMatrix();
+      pose_data[i].proj_center = image.ProjectionCenter();
+      pose_data[i].camera = &camera;
     }
   }
 
@@ -953,6 +1814,7 @@ bool HybridMapper::TriangulateTrack(
   tri_est_options.ransac_options.confidence = 0.9999;
   tri_est_options.ransac_options.min_inlier_ratio = 0.02;
   tri_est_options.ransac_options.max_num_trials = 10000;
+  tri_est_options.enable_refraction = tri_options.enable_refraction;
 
   // Enforce exhaustive sampling for small track lengths.
   const size_t kExhaustiveSamplingThreshold = 15;
@@ -962,23 +1824,20 @@ bool HybridMapper::TriangulateTrack(
   }
 
   // Estimate triangulation.
-  Eigen::Vector3d xyz;
   std::vector<char> inlier_mask;
   if (!EstimateTriangulation(
-          tri_est_options, point_data, pose_data, &inlier_mask, &xyz)) {
-    return 0;
+          tri_est_options, point_data, pose_data, &inlier_mask, xyz)) {
+    return false;
   }
 
-  Track new_track;
-  new_track.Reserve(track.Length());
+  *inlier_track = Track();
+  inlier_track->Reserve(track.Length());
   for (size_t i = 0; i < inlier_mask.size(); ++i) {
     if (inlier_mask[i]) {
-      new_track.AddElement(track.Element(i));
+      inlier_track->AddElement(track.Element(i));
     }
   }
 
-  // Add estimated point to reconstruction.
-  reconstruction_->AddPoint3D(xyz, std::move(new_track));
   return true;
 }
 
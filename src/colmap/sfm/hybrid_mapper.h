@@ -1,11 +1,16 @@
 #pragma once
 
 #include "colmap/controllers/incremental_mapper.h"
+#include "colmap/estimators/pose_graph_optimizer.h"
 #include "colmap/scene/database.h"
 #include "colmap/scene/database_cache.h"
 #include "colmap/scene/reconstruction.h"
 #include "colmap/scene/scene_clustering.h"
 
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+
 namespace colmap {
 class HybridMapper {
  public:
@@ -13,16 +18,41 @@ class HybridMapper {
     // The number of workers used to reconstruct clusters in parallel.
     int num_workers = -1;
 
+    // The maximum memory in megabytes of the clusters reconstructed in
+    // parallel. Further workers wait until enough memory is released by the
+    // finished clusters, while a single cluster is always reconstructed.
+    // Unlimited if <= 0.
+    int max_memory_usage_mb = -1;
+
     // The maximum number of images for weak area revisit.
     size_t re_max_num_images = 30;
 
     // How large the radius is when selecting a weak area to revisit.
     double re_max_distance = 2.5;
 
+    // Weak areas, which share more than this ratio of the images of the
+    // smaller area, are merged into one area with the union of their images,
+    // as long as the merged area has at most twice `re_max_num_images`
+    // images. Heavily overlapping areas then do not reconstruct their shared
+    // images repeatedly. A ratio of 1 disables the merging.
+    double re_max_overlap_ratio = 1.0;
+
+    // Whether to initialize the weak areas, whose images are all registered
+    // in one of the previous sub-reconstructions, with the poses and cameras
+    // of that reconstruction. These areas are only triangulated and bundle
+    // adjusted instead of reconstructed incrementally from scratch.
+    bool re_reuse_poses = false;
+
     // The multiplier factor for the relative pose term in pose graph
     // optimization.
     double pgo_rel_pose_multi = 1.0;
 
+    // Whether to weight the relative pose terms in pose graph optimization by
+    // the inverse covariances of the relative poses, as estimated from the
+    // bundle adjustment problems of the sub-reconstructions, instead of the
+    // identity.
+    bool pgo_use_pose_covariance = false;
+
     // The multiplier factor for the absolute pose prior term in pose graph
     // optimization.
     double pgo_abs_pose_multi = 0.1;
@@ -31,6 +61,9 @@ class HybridMapper {
     // optimization.
     double pgo_smooth_multi = 100.0;
 
+    // Options of the pose graph optimization.
+    PoseGraphOptimizer::Options pgo_options;
+
     bool Check() const;
   };
 
@@ -50,6 +83,12 @@ class HybridMapper {
 
   void PartitionScene(const SceneClustering::Options& clustering_options);
 
+  // Append a new batch of images to the partitioned scene. The given database
+  // cache must hold the previously loaded and the new images. The new images
+  // are assigned to the existing leaf clusters, and subsequent calls to
+  // `ReconstructClusters` and the merging only revisit the affected clusters.
+  void AppendImages(std::shared_ptr<const DatabaseCache> database_cache);
+
   void ExtractViewGraphStats(
       const std::vector<std::shared_ptr<const Reconstruction>>&
           reconstructions);
@@ -68,29 +107,93 @@ class HybridMapper {
                            std::shared_ptr<ReconstructionManager>>&
   GetReconstructionManagers() const;
 
+  // The state of the mapper for checkpoints, which is restored in the same
+  // order of stages as it is computed, e.g., to resume the mapping after a
+  // crash, see `HybridMapperController`.
+  //
+  // Write the partition of the scene and read it instead of partitioning the
+  // scene.
+  void WritePartition(const std::string& path) const;
+  void ReadPartition(const SceneClustering::Options& clustering_options,
+                     const std::string& path);
+
+  // The reconstructions of the leaf clusters in the order of
+  // `SceneClustering::GetLeafClusters`, which can be set instead of
+  // reconstructing the clusters.
+  std::vector<std::shared_ptr<ReconstructionManager>>
+  GetLeafReconstructionManagers() const;
+  void SetLeafReconstructionManagers(
+      const std::vector<std::shared_ptr<ReconstructionManager>>&
+          reconstruction_managers);
+
+  // The reconstructions of all weak area revisits, which can be added instead
+  // of revisiting the weak areas.
+  const std::vector<std::shared_ptr<ReconstructionManager>>&
+  GetWeakAreaReconstructionManagers() const;
+  void AddWeakAreaReconstructionManager(
+      std::shared_ptr<ReconstructionManager> reconstruction_manager);
+
+  // Set the poses of the registered images and add the 3D points of a
+  // previous state of the global reconstruction, e.g., after the pose graph
+  // optimization, which must not have more registered images.
+  void RestoreReconstruction(const Reconstruction& reconstruction);
+
  protected:
   void ReconstructCluster(
       std::shared_ptr<const IncrementalMapperOptions> incremental_options,
-      std::shared_ptr<ReconstructionManager> reconstruction_manager);
+      const std::unordered_set<image_t>& image_ids,
+      std::shared_ptr<ReconstructionManager> reconstruction_manager,
+      std::atomic<int>* num_pending_clusters);
+
+  // Triangulate and bundle adjust a weak area, whose images are all registered
+  // in the given reconstruction, starting from its poses and cameras.
+  void TriangulateWeakArea(
+      std::shared_ptr<const IncrementalMapperOptions> incremental_options,
+      std::shared_ptr<const Reconstruction> init_reconstruction,
+      const std::unordered_set<image_t>& image_ids,
+      std::shared_ptr<ReconstructionManager> reconstruction_manager,
+      std::atomic<int>* num_pending_clusters);
+
+  // Estimate the peak memory of reconstructing a cluster, i.e., of its
+  // database cache subset and reconstruction.
+  size_t EstimateClusterMemoryUsage(size_t num_images) const;
+
+  // Block until the given memory fits into the budget of the parallel
+  // cluster reconstructions, and release it after the cluster is done.
+  void ReserveMemory(size_t num_bytes);
+  void ReleaseMemory(size_t num_bytes);
 
   std::unordered_map<image_t, std::vector<image_t>> FindLocalAreas(
       const std::unordered_set<image_t>& image_ids,
       const size_t max_num_images,
       const double max_distance) const;
 
+  // Collect the view graph stats of all cluster reconstructions from scratch
+  // and discard the weak area reconstructions.
+  void ResetViewGraphStats();
+
   void UpdateSubReconstructions();
 
-  void MergeClusters(const SceneClustering::Cluster& cluster);
+  bool IsClusterDirty(const SceneClustering::Cluster& cluster) const;
+
+  void MergeChildClusters(const SceneClustering::Cluster& cluster) const;
+
+  void MergeClusters(const SceneClustering::Cluster& root_cluster,
+                     int num_workers);
 
-  void MergeClusters();
+  void MergeClusters(const Options& options);
 
+  // Triangulate the track with the current camera poses. Only reads from the
+  // reconstruction and is thus safe to be called concurrently.
   bool TriangulateTrack(const IncrementalTriangulator::Options& tri_options,
-                        const Track& track);
+                        const Track& track,
+                        Eigen::Vector3d* xyz,
+                        Track* inlier_track) const;
 
   // Class that holds options for incremental mapping.
   const std::shared_ptr<const IncrementalMapperOptions> incremental_options_;
   // Class that holds all necessary data from database in memory.
-  const std::shared_ptr<const DatabaseCache> database_cache_;
+  std::shared_ptr<const DatabaseCache> database_cache_;
 
   const std::string database_path_;
   const std::string image_path_;
@@ -110,13 +213,29 @@ class HybridMapper {
 
   std::unique_ptr<SceneClustering> scene_clustering_;
 
-  std::unordered_map<image_t, std::string> image_id_to_name_;
-
   std::unordered_map<const SceneClustering::Cluster*,
                      std::shared_ptr<ReconstructionManager>>
       reconstruction_managers_;
 
+  // Merged reconstructions of the non-leaf clusters. The reconstructions of
+  // the leaf clusters are kept untouched, such that only the branches of
+  // appended images need to be merged again.
+  std::unordered_map<const SceneClustering::Cluster*,
+                     std::shared_ptr<ReconstructionManager>>
+      merged_reconstruction_managers_;
+
+  // Leaf clusters that have not been reconstructed and merged since the scene
+  // was partitioned or images were appended.
+  std::unordered_set<const SceneClustering::Cluster*> dirty_clusters_;
+
   std::vector<std::shared_ptr<ReconstructionManager>>
       weak_area_reconstructions_;
+
+  // Memory budget and currently reserved memory of the clusters reconstructed
+  // in parallel, where a budget of zero is unlimited.
+  size_t max_memory_usage_ = 0;
+  size_t reserved_memory_usage_ = 0;
+  std::mutex memory_mutex_;
+  std::condition_variable memory_condition_;
 };
 }  // namespace colmap
\ No newline at end of file
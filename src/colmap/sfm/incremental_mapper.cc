@@ -34,32 +34,19 @@
 #include "colmap/estimators/two_view_geometry.h"
 #include "colmap/geometry/triangulation.h"
 #include "colmap/scene/projection.h"
+#include "colmap/scene/visibility_pyramid.h"
 #include "colmap/sensor/bitmap.h"
 #include "colmap/util/misc.h"
+#include "colmap/util/threading.h"
+#include "colmap/util/tracing.h"
 
+#include <algorithm>
 #include <array>
 #include <fstream>
 
 namespace colmap {
 namespace {
 
-void SortAndAppendNextImages(std::vector<std::pair<image_t, float>> image_ranks,
-                             std::vector<image_t>* sorted_images_ids) {
-  std::sort(image_ranks.begin(),
-            image_ranks.end(),
-            [](const std::pair<image_t, float>& image1,
-               const std::pair<image_t, float>& image2) {
-              return image1.second > image2.second;
-            });
-
-  sorted_images_ids->reserve(sorted_images_ids->size() + image_ranks.size());
-  for (const auto& image : image_ranks) {
-    sorted_images_ids->push_back(image.first);
-  }
-
-  image_ranks.clear();
-}
-
 float RankNextImageMaxVisiblePointsNum(const Image& image) {
   return static_cast<float>(image.NumVisiblePoints3D());
 }
@@ -73,6 +60,106 @@ float RankNextImageMinUncertainty(const Image& image) {
   return static_cast<float>(image.Point3DVisibilityScore());
 }
 
+bool IsSuitableInitialTwoViewGeometry(
+    const IncrementalMapper::Options& options,
+    const TwoViewGeometry& two_view_geometry) {
+  return static_cast<int>(two_view_geometry.inlier_matches.size()) >=
+             options.init_min_num_inliers &&
+         std::abs(two_view_geometry.cam2_from_cam1.translation.normalized()
+                      .z()) < options.init_max_forward_motion &&
+         two_view_geometry.tri_angle > DegToRad(options.init_min_tri_angle);
+}
+
+// The direction of the z-axis of the world frame in the camera frame of the
+// pose prior of the image.
+Eigen::Vector3d ComputePriorGravityInCam(const Reconstruction& reconstruction,
+                                         const Image& image) {
+  return (Inverse(reconstruction.PriorFromCam()) * image.CamFromWorldPrior())
+             .rotation *
+         Eigen::Vector3d::UnitZ();
+}
+
+// Select a spatially uniform subset of the well-conditioned 3D points of the
+// registered images. The observations of every image are binned into the cells
+// of the finest level of a visibility pyramid and, per cell, the points with
+// the longest tracks and the smallest errors are selected until the cell
+// contains the given number of selected points, including the points already
+// selected for other images.
+std::unordered_set<point3D_t> SelectUniformPoints3D(
+    const Reconstruction& reconstruction, const int max_num_points_per_cell) {
+  struct CellPoint {
+    size_t cell_idx;
+    size_t track_length;
+    double error;
+    point3D_t point3D_id;
+  };
+
+  std::unordered_set<point3D_t> point3D_ids;
+  std::vector<CellPoint> cell_points;
+  for (const image_t image_id : reconstruction.RegImageIds()) {
+    const Image& image = reconstruction.Image(image_id);
+    const Camera& camera = reconstruction.Camera(image.CameraId());
+    const VisibilityPyramid pyramid(
+        Image::kNumPoint3DVisibilityPyramidLevels, camera.width, camera.height);
+
+    cell_points.clear();
+    for (const Point2D& point2D : image.Points2D()) {
+      if (!point2D.HasPoint3D()) {
+        continue;
+      }
+      const Point3D& point3D = reconstruction.Point3D(point2D.point3D_id);
+      size_t cx = 0;
+      size_t cy = 0;
+      pyramid.CellForPoint(point2D.xy(0), point2D.xy(1), &cx, &cy);
+      cell_points.push_back({(cy << pyramid.NumLevels()) + cx,
+                             point3D.track.Length(),
+                             point3D.error,
+                             point2D.point3D_id});
+    }
+
+    std::sort(cell_points.begin(),
+              cell_points.end(),
+              [](const CellPoint& point1, const CellPoint& point2) {
+                if (point1.cell_idx != point2.cell_idx) {
+                  return point1.cell_idx < point2.cell_idx;
+                }
+                if (point1.track_length != point2.track_length) {
+                  return point1.track_length > point2.track_length;
+                }
+                if (point1.error != point2.error) {
+                  return point1.error < point2.error;
+                }
+                return point1.point3D_id < point2.point3D_id;
+              });
+
+    size_t begin = 0;
+    while (begin < cell_points.size()) {
+      size_t end = begin + 1;
+      while (end < cell_points.size() &&
+             cell_points[end].cell_idx == cell_points[begin].cell_idx) {
+        ++end;
+      }
+
+      int num_selected = 0;
+      for (size_t i = begin; i < end; ++i) {
+        if (point3D_ids.count(cell_points[i].point3D_id) > 0) {
+          num_selected += 1;
+        }
+      }
+      for (size_t i = begin; i < end && num_selected < max_num_points_per_cell;
+           ++i) {
+        if (point3D_ids.insert(cell_points[i].point3D_id).second) {
+          num_selected += 1;
+        }
+      }
+
+      begin = end;
+    }
+  }
+
+  return point3D_ids;
+}
+
 }  // namespace
 
 bool IncrementalMapper::Options::Check() const {
@@ -82,18 +169,22 @@ bool IncrementalMapper::Options::Check() const {
   CHECK_OPTION_LE(init_max_forward_motion, 1.0);
   CHECK_OPTION_GE(init_min_tri_angle, 0.0);
   CHECK_OPTION_GE(init_max_reg_trials, 1);
+  CHECK_OPTION_GE(init_num_parallel_pairs, 1);
   CHECK_OPTION_GT(abs_pose_max_error, 0.0);
   CHECK_OPTION_GT(abs_pose_min_num_inliers, 0);
   CHECK_OPTION_GE(abs_pose_min_inlier_ratio, 0.0);
   CHECK_OPTION_LE(abs_pose_min_inlier_ratio, 1.0);
   CHECK_OPTION_GE(local_ba_num_images, 2);
   CHECK_OPTION_GE(local_ba_min_tri_angle, 0.0);
+  CHECK_OPTION_GE(local_ba_max_num_residuals, 0);
+  CHECK_OPTION_GE(global_ba_max_num_points_per_cell, 0);
   CHECK_OPTION_GE(min_focal_length_ratio, 0.0);
   CHECK_OPTION_GE(max_focal_length_ratio, min_focal_length_ratio);
   CHECK_OPTION_GE(max_extra_param, 0.0);
   CHECK_OPTION_GE(filter_max_reproj_error, 0.0);
   CHECK_OPTION_GE(filter_min_tri_angle, 0.0);
   CHECK_OPTION_GE(max_reg_trials, 1);
+  CHECK_OPTION_GE(num_parallel_reg_images, 1);
   return true;
 }
 
@@ -130,6 +221,7 @@ void IncrementalMapper::BeginReconstruction(
 
   filtered_images_.clear();
   num_reg_trials_.clear();
+  next_image_queue_ = NextImageQueue();
 
   best_fit_cameras_.clear();
 }
@@ -146,6 +238,8 @@ void IncrementalMapper::EndReconstruction(const bool discard) {
   reconstruction_->TearDown();
   reconstruction_ = nullptr;
   triangulator_.reset();
+  local_bundle_adjuster_.reset();
+  pose_prior_information_cache_.Clear();
 }
 
 bool IncrementalMapper::FindInitialImagePair(const Options& options,
@@ -171,32 +265,40 @@ bool IncrementalMapper::FindInitialImagePair(const Options& options,
     image_ids1 = FindFirstInitialImage(options);
   }
 
-  // Try to find good initial pair.
+  // Try to find good initial pair, where batches of candidate pairs in the
+  // order of their suitability are estimated in parallel.
+  std::vector<std::pair<image_t, image_t>> image_pairs;
+  std::unordered_set<image_pair_t> pair_ids;
   for (size_t i1 = 0; i1 < image_ids1.size(); ++i1) {
-    *image_id1 = image_ids1[i1];
-
     const std::vector<image_t> image_ids2 =
-        FindSecondInitialImage(options, *image_id1);
+        FindSecondInitialImage(options, image_ids1[i1]);
 
     for (size_t i2 = 0; i2 < image_ids2.size(); ++i2) {
-      *image_id2 = image_ids2[i2];
-
       const image_pair_t pair_id =
-          Database::ImagePairToPairId(*image_id1, *image_id2);
+          Database::ImagePairToPairId(image_ids1[i1], image_ids2[i2]);
 
       // Try every pair only once.
-      if (init_image_pairs_.count(pair_id) > 0) {
+      if (init_image_pairs_.count(pair_id) > 0 ||
+          !pair_ids.insert(pair_id).second) {
         continue;
       }
 
-      init_image_pairs_.insert(pair_id);
-
-      if (EstimateInitialTwoViewGeometry(options, *image_id1, *image_id2)) {
-        return true;
+      image_pairs.emplace_back(image_ids1[i1], image_ids2[i2]);
+      if (image_pairs.size() ==
+          static_cast<size_t>(options.init_num_parallel_pairs)) {
+        if (SelectInitialImagePair(
+                options, image_pairs, image_id1, image_id2)) {
+          return true;
+        }
+        image_pairs.clear();
       }
     }
   }
 
+  if (SelectInitialImagePair(options, image_pairs, image_id1, image_id2)) {
+    return true;
+  }
+
   // No suitable pair found in entire dataset.
   *image_id1 = kInvalidImageId;
   *image_id2 = kInvalidImageId;
@@ -208,56 +310,95 @@ std::vector<image_t> IncrementalMapper::FindNextImages(const Options& options) {
   CHECK_NOTNULL(reconstruction_);
   CHECK(options.Check());
 
-  std::function<float(const Image&)> rank_image_func;
-  switch (options.image_selection_method) {
-    case Options::ImageSelectionMethod::MAX_VISIBLE_POINTS_NUM:
-      rank_image_func = RankNextImageMaxVisiblePointsNum;
-      break;
-    case Options::ImageSelectionMethod::MAX_VISIBLE_POINTS_RATIO:
-      rank_image_func = RankNextImageMaxVisiblePointsRatio;
-      break;
-    case Options::ImageSelectionMethod::MIN_UNCERTAINTY:
-      rank_image_func = RankNextImageMinUncertainty;
-      break;
+  if (!next_image_queue_.is_valid ||
+      next_image_queue_.image_selection_method !=
+          options.image_selection_method ||
+      next_image_queue_.abs_pose_min_num_inliers !=
+          options.abs_pose_min_num_inliers ||
+      next_image_queue_.max_reg_trials != options.max_reg_trials) {
+    next_image_queue_ = NextImageQueue();
+    next_image_queue_.is_valid = true;
+    next_image_queue_.image_selection_method = options.image_selection_method;
+    next_image_queue_.abs_pose_min_num_inliers =
+        options.abs_pose_min_num_inliers;
+    next_image_queue_.max_reg_trials = options.max_reg_trials;
+    for (const auto& image : reconstruction_->Images()) {
+      UpdateNextImageRank(options, image.first);
+    }
+  } else {
+    for (const image_t image_id :
+         reconstruction_->VisibilityChangedImageIds()) {
+      UpdateNextImageRank(options, image_id);
+    }
+    for (const image_t image_id : next_image_queue_.changed_image_ids) {
+      UpdateNextImageRank(options, image_id);
+    }
   }
+  reconstruction_->ClearVisibilityChangedImages();
+  next_image_queue_.changed_image_ids.clear();
 
-  std::vector<std::pair<image_t, float>> image_ranks;
-  std::vector<std::pair<image_t, float>> other_image_ranks;
-
-  // Append images that have not failed to register before.
-  for (const auto& image : reconstruction_->Images()) {
-    // Skip images that are already registered.
-    if (image.second.IsRegistered()) {
-      continue;
+  std::vector<image_t> ranked_images_ids;
+  ranked_images_ids.reserve(next_image_queue_.image_ranks.size());
+  for (const auto& bucket : next_image_queue_.buckets) {
+    for (const auto& image_rank : bucket) {
+      ranked_images_ids.push_back(image_rank.second);
     }
+  }
 
-    // Only consider images with a sufficient number of visible points.
-    if (image.second.NumVisiblePoints3D() <
-        static_cast<size_t>(options.abs_pose_min_num_inliers)) {
-      continue;
-    }
+  return ranked_images_ids;
+}
 
-    // Only try registration for a certain maximum number of times.
-    const size_t num_reg_trials = num_reg_trials_[image.first];
-    if (num_reg_trials >= static_cast<size_t>(options.max_reg_trials)) {
-      continue;
-    }
+void IncrementalMapper::UpdateNextImageRank(const Options& options,
+                                            const image_t image_id) {
+  auto& image_ranks = next_image_queue_.image_ranks;
+  const auto prev_rank_it = image_ranks.find(image_id);
+  if (prev_rank_it != image_ranks.end()) {
+    next_image_queue_.buckets[prev_rank_it->second.first].erase(
+        {prev_rank_it->second.second, image_id});
+    image_ranks.erase(prev_rank_it);
+  }
 
-    // If image has been filtered or failed to register, place it in the
-    // second bucket and prefer images that have not been tried before.
-    const float rank = rank_image_func(image.second);
-    if (filtered_images_.count(image.first) == 0 && num_reg_trials == 0) {
-      image_ranks.emplace_back(image.first, rank);
-    } else {
-      other_image_ranks.emplace_back(image.first, rank);
-    }
+  const Image& image = reconstruction_->Image(image_id);
+
+  // Skip images that are already registered.
+  if (image.IsRegistered()) {
+    return;
   }
 
-  std::vector<image_t> ranked_images_ids;
-  SortAndAppendNextImages(image_ranks, &ranked_images_ids);
-  SortAndAppendNextImages(other_image_ranks, &ranked_images_ids);
+  // Only consider images with a sufficient number of visible points.
+  if (image.NumVisiblePoints3D() <
+      static_cast<size_t>(options.abs_pose_min_num_inliers)) {
+    return;
+  }
 
-  return ranked_images_ids;
+  // Only try registration for a certain maximum number of times.
+  const auto num_reg_trials_it = num_reg_trials_.find(image_id);
+  const size_t num_reg_trials =
+      num_reg_trials_it == num_reg_trials_.end() ? 0
+                                                 : num_reg_trials_it->second;
+  if (num_reg_trials >= static_cast<size_t>(options.max_reg_trials)) {
+    return;
+  }
+
+  float rank = 0;
+  switch (options.image_selection_method) {
+    case Options::ImageSelectionMethod::MAX_VISIBLE_POINTS_NUM:
+      rank = RankNextImageMaxVisiblePointsNum(image);
+      break;
+    case Options::ImageSelectionMethod::MAX_VISIBLE_POINTS_RATIO:
+      rank = RankNextImageMaxVisiblePointsRatio(image);
+      break;
+    case Options::ImageSelectionMethod::MIN_UNCERTAINTY:
+      rank = RankNextImageMinUncertainty(image);
+      break;
+  }
+
+  // If image has been filtered or failed to register, place it in the
+  // second bucket and prefer images that have not been tried before.
+  const size_t bucket_idx =
+      (filtered_images_.count(image_id) == 0 && num_reg_trials == 0) ? 0 : 1;
+  next_image_queue_.buckets[bucket_idx].emplace(rank, image_id);
+  image_ranks.emplace(image_id, std::make_pair(bucket_idx, rank));
 }
 
 bool IncrementalMapper::RegisterInitialImagePair(const Options& options,
@@ -272,6 +413,8 @@ bool IncrementalMapper::RegisterInitialImagePair(const Options& options,
   init_num_reg_trials_[image_id2] += 1;
   num_reg_trials_[image_id1] += 1;
   num_reg_trials_[image_id2] += 1;
+  next_image_queue_.changed_image_ids.insert(image_id1);
+  next_image_queue_.changed_image_ids.insert(image_id2);
 
   const image_pair_t pair_id =
       Database::ImagePairToPairId(image_id1, image_id2);
@@ -347,9 +490,9 @@ bool IncrementalMapper::RegisterInitialImagePair(const Options& options,
     if (!options.enable_refraction) {
       // Non-refractive case.
       const Eigen::Vector2d point2D1 =
-          camera1.CamFromImg(image1.Point2D(corr.point2D_idx1).xy);
+          camera1.CamFromImg(image1.Point2DXY(corr.point2D_idx1));
       const Eigen::Vector2d point2D2 =
-          camera2.CamFromImg(image2.Point2D(corr.point2D_idx2).xy);
+          camera2.CamFromImg(image2.Point2DXY(corr.point2D_idx2));
       const Eigen::Vector3d& xyz = TriangulatePoint(
           cam_from_world1, cam_from_world2, point2D1, point2D2);
       const double tri_angle =
@@ -367,10 +510,10 @@ bool IncrementalMapper::RegisterInitialImagePair(const Options& options,
       Camera virtual_camera2;
       Rigid3d virtual_from_real1;
       Rigid3d virtual_from_real2;
-      camera1.ComputeVirtual(image1.Point2D(corr.point2D_idx1).xy,
+      camera1.ComputeVirtual(image1.Point2DXY(corr.point2D_idx1),
                              virtual_camera1,
                              virtual_from_real1);
-      camera2.ComputeVirtual(image2.Point2D(corr.point2D_idx2).xy,
+      camera2.ComputeVirtual(image2.Point2DXY(corr.point2D_idx2),
                              virtual_camera2,
                              virtual_from_real2);
       const Rigid3d virtual_from_world1 =
@@ -390,9 +533,9 @@ bool IncrementalMapper::RegisterInitialImagePair(const Options& options,
       // Now do the same triangulation as above.
 
       const Eigen::Vector2d point2D1 =
-          virtual_camera1.CamFromImg(image1.Point2D(corr.point2D_idx1).xy);
+          virtual_camera1.CamFromImg(image1.Point2DXY(corr.point2D_idx1));
       const Eigen::Vector2d point2D2 =
-          virtual_camera2.CamFromImg(image2.Point2D(corr.point2D_idx2).xy);
+          virtual_camera2.CamFromImg(image2.Point2DXY(corr.point2D_idx2));
       const Eigen::Vector3d& xyz =
           TriangulatePoint(proj_matrix1, proj_matrix2, point2D1, point2D2);
 
@@ -412,242 +555,136 @@ bool IncrementalMapper::RegisterInitialImagePair(const Options& options,
 
 bool IncrementalMapper::RegisterNextImage(const Options& options,
                                           const image_t image_id) {
+  COLMAP_TRACE_SCOPE("IncrementalMapper::RegisterNextImage");
   CHECK_NOTNULL(reconstruction_);
   CHECK_GE(reconstruction_->NumRegImages(), 2);
 
   CHECK(options.Check());
 
-  Image& image = reconstruction_->Image(image_id);
-  Camera& camera = reconstruction_->Camera(image.CameraId());
+  const Image& image = reconstruction_->Image(image_id);
 
   CHECK(!image.IsRegistered()) << "Image cannot be registered multiple times";
 
   num_reg_trials_[image_id] += 1;
+  next_image_queue_.changed_image_ids.insert(image_id);
 
-  // Check if enough 2D-3D correspondences.
-  if (image.NumVisiblePoints3D() <
-      static_cast<size_t>(options.abs_pose_min_num_inliers)) {
+  NextImageRegistration registration;
+  if (!FindNextImageCorrespondences(options, image_id, &registration)) {
     return false;
   }
 
-  //////////////////////////////////////////////////////////////////////////////
-  // Search for 2D-3D correspondences
-  //////////////////////////////////////////////////////////////////////////////
-
-  std::vector<std::pair<point2D_t, point3D_t>> tri_corrs;
-  std::vector<Eigen::Vector2d> tri_points2D;
-  std::vector<Eigen::Vector3d> tri_points3D;
-
-  const std::shared_ptr<const CorrespondenceGraph> correspondence_graph =
-      database_cache_->CorrespondenceGraph();
-
-  std::unordered_set<point3D_t> corr_point3D_ids;
-  for (point2D_t point2D_idx = 0; point2D_idx < image.NumPoints2D();
-       ++point2D_idx) {
-    const Point2D& point2D = image.Point2D(point2D_idx);
-
-    corr_point3D_ids.clear();
-    const auto corr_range =
-        correspondence_graph->FindCorrespondences(image_id, point2D_idx);
-    for (const auto* corr = corr_range.beg; corr < corr_range.end; ++corr) {
-      const Image& corr_image = reconstruction_->Image(corr->image_id);
-      if (!corr_image.IsRegistered()) {
-        continue;
-      }
-
-      const Point2D& corr_point2D = corr_image.Point2D(corr->point2D_idx);
-      if (!corr_point2D.HasPoint3D()) {
-        continue;
-      }
-
-      // Avoid duplicate correspondences.
-      if (corr_point3D_ids.count(corr_point2D.point3D_id) > 0) {
-        continue;
-      }
-
-      const Camera& corr_camera =
-          reconstruction_->Camera(corr_image.CameraId());
-
-      // Avoid correspondences to images with bogus camera parameters.
-      if (corr_camera.HasBogusParams(options.min_focal_length_ratio,
-                                     options.max_focal_length_ratio,
-                                     options.max_extra_param)) {
-        continue;
-      }
-
-      const Point3D& point3D =
-          reconstruction_->Point3D(corr_point2D.point3D_id);
-
-      tri_corrs.emplace_back(point2D_idx, corr_point2D.point3D_id);
-      corr_point3D_ids.insert(corr_point2D.point3D_id);
-      tri_points2D.push_back(point2D.xy);
-      tri_points3D.push_back(point3D.xyz);
-    }
-  }
-
-  // The size of `next_image.num_tri_obs` and `tri_corrs_point2D_idxs.size()`
-  // can only differ, when there are images with bogus camera parameters, and
-  // hence we skip some of the 2D-3D correspondences.
-  if (tri_points2D.size() <
-      static_cast<size_t>(options.abs_pose_min_num_inliers)) {
-    return false;
-  }
-
-  //////////////////////////////////////////////////////////////////////////////
-  // 2D-3D estimation
-  //////////////////////////////////////////////////////////////////////////////
-
-  // Only refine / estimate focal length, if no focal length was specified
-  // (manually or through EXIF) and if it was not already estimated previously
-  // from another image (when multiple images share the same camera
-  // parameters)
-
   AbsolutePoseEstimationOptions abs_pose_options;
-  abs_pose_options.num_threads = options.num_threads;
-  abs_pose_options.num_focal_length_samples = 30;
-  abs_pose_options.min_focal_length_ratio = options.min_focal_length_ratio;
-  abs_pose_options.max_focal_length_ratio = options.max_focal_length_ratio;
-  abs_pose_options.ransac_options.max_error = options.abs_pose_max_error;
-  abs_pose_options.ransac_options.min_inlier_ratio =
-      options.abs_pose_min_inlier_ratio;
-  // Use high confidence to avoid preemptive termination of P3P RANSAC
-  // - too early termination may lead to bad registration.
-  abs_pose_options.ransac_options.min_num_trials = 100;
-  abs_pose_options.ransac_options.max_num_trials = 10000;
-  abs_pose_options.ransac_options.confidence = 0.99999;
-
   AbsolutePoseRefinementOptions abs_pose_refinement_options;
-  if (num_reg_images_per_camera_[image.CameraId()] > 0) {
-    // Camera already refined from another image with the same camera.
-    if (camera.HasBogusParams(options.min_focal_length_ratio,
-                              options.max_focal_length_ratio,
-                              options.max_extra_param)) {
-      // Previously refined camera has bogus parameters,
-      // so reset parameters and try to re-estimage.
-      camera.params = database_cache_->Camera(image.CameraId()).params;
-      abs_pose_options.estimate_focal_length = !camera.has_prior_focal_length;
-      abs_pose_refinement_options.refine_focal_length = true;
-      abs_pose_refinement_options.refine_extra_params = true;
-    } else {
-      abs_pose_options.estimate_focal_length = false;
-      abs_pose_refinement_options.refine_focal_length = false;
-      abs_pose_refinement_options.refine_extra_params = false;
-    }
-  } else {
-    // Camera not refined before. Note that the camera parameters might have
-    // been changed before but the image was filtered, so we explicitly reset
-    // the camera parameters and try to re-estimate them.
-    camera.params = database_cache_->Camera(image.CameraId()).params;
-    abs_pose_options.estimate_focal_length = !camera.has_prior_focal_length;
-    abs_pose_refinement_options.refine_focal_length = true;
-    abs_pose_refinement_options.refine_extra_params = true;
-  }
-
-  if (!options.abs_pose_refine_focal_length) {
-    abs_pose_options.estimate_focal_length = false;
-    abs_pose_refinement_options.refine_focal_length = false;
+  PrepareNextImageCamera(
+      options, image_id, &abs_pose_options, &abs_pose_refinement_options);
+
+  if (!EstimateNextImagePose(options,
+                             image_id,
+                             abs_pose_options,
+                             abs_pose_refinement_options,
+                             &registration)) {
+    return false;
   }
 
-  if (!options.abs_pose_refine_extra_params) {
-    abs_pose_refinement_options.refine_extra_params = false;
-  }
+  CommitNextImage(image_id, registration);
 
-  size_t num_inliers;
-  std::vector<char> inlier_mask;
-
-  if (!options.enable_refraction) {
-    // Non-refractive case.
-    if (!EstimateAbsolutePose(abs_pose_options,
-                              tri_points2D,
-                              tri_points3D,
-                              &image.CamFromWorld(),
-                              &camera,
-                              &num_inliers,
-                              &inlier_mask)) {
-      return false;
-    }
+  return true;
+}
 
-    if (num_inliers < static_cast<size_t>(options.abs_pose_min_num_inliers)) {
-      return false;
-    }
+std::vector<image_t> IncrementalMapper::RegisterNextImages(
+    const Options& options, const std::vector<image_t>& image_ids) {
+  COLMAP_TRACE_SCOPE("IncrementalMapper::RegisterNextImages");
+  CHECK_NOTNULL(reconstruction_);
+  CHECK_GE(reconstruction_->NumRegImages(), 2);
 
-    //////////////////////////////////////////////////////////////////////////////
-    // Pose refinement
-    //////////////////////////////////////////////////////////////////////////////
+  CHECK(options.Check());
 
-    if (!RefineAbsolutePose(abs_pose_refinement_options,
-                            inlier_mask,
-                            tri_points2D,
-                            tri_points3D,
-                            &image.CamFromWorld(),
-                            &camera)) {
-      return false;
+  // The cameras are prepared sequentially, since different images may share
+  // the same camera. Only one image per camera may estimate the camera
+  // parameters, and the other images of the camera are deferred until the
+  // estimated camera is committed.
+  std::vector<image_t> batch_image_ids;
+  std::vector<image_t> deferred_image_ids;
+  std::unordered_set<camera_t> refined_camera_ids;
+  std::vector<AbsolutePoseEstimationOptions> abs_pose_options;
+  std::vector<AbsolutePoseRefinementOptions> abs_pose_refinement_options;
+  batch_image_ids.reserve(image_ids.size());
+  abs_pose_options.reserve(image_ids.size());
+  abs_pose_refinement_options.reserve(image_ids.size());
+  for (const image_t image_id : image_ids) {
+    const Image& image = reconstruction_->Image(image_id);
+    CHECK(!image.IsRegistered())
+        << "Image cannot be registered multiple times";
+    CHECK_EQ(std::count(image_ids.begin(), image_ids.end(), image_id), 1);
+    AbsolutePoseEstimationOptions image_abs_pose_options;
+    AbsolutePoseRefinementOptions image_abs_pose_refinement_options;
+    PrepareNextImageCamera(options,
+                           image_id,
+                           &image_abs_pose_options,
+                           &image_abs_pose_refinement_options);
+    if (!options.enable_refraction &&
+        (image_abs_pose_options.estimate_focal_length ||
+         image_abs_pose_refinement_options.refine_focal_length ||
+         image_abs_pose_refinement_options.refine_extra_params) &&
+        !refined_camera_ids.insert(image.CameraId()).second) {
+      deferred_image_ids.push_back(image_id);
+      continue;
     }
-  } else {
-    // Refractive case.
-    std::vector<Camera> virtual_cameras;
-    std::vector<Rigid3d> virtual_from_reals;
-    camera.ComputeVirtuals(tri_points2D, virtual_cameras, virtual_from_reals);
-
-    std::vector<size_t> camera_idxs(tri_points2D.size());
-    std::iota(camera_idxs.begin(), camera_idxs.end(), 0);
+    num_reg_trials_[image_id] += 1;
+    next_image_queue_.changed_image_ids.insert(image_id);
+    batch_image_ids.push_back(image_id);
+    abs_pose_options.push_back(image_abs_pose_options);
+    abs_pose_refinement_options.push_back(image_abs_pose_refinement_options);
+  }
 
-    if (!EstimateGeneralizedAbsolutePose(abs_pose_options.ransac_options,
-                                         tri_points2D,
-                                         tri_points3D,
-                                         camera_idxs,
-                                         virtual_from_reals,
-                                         virtual_cameras,
-                                         &image.CamFromWorld(),
-                                         &num_inliers,
-                                         &inlier_mask)) {
-      return false;
-    }
+  const size_t num_images = batch_image_ids.size();
 
-    if (num_inliers < static_cast<size_t>(options.abs_pose_min_num_inliers)) {
-      return false;
+  // The images are already estimated concurrently.
+  if (num_images > 1) {
+    for (auto& image_abs_pose_options : abs_pose_options) {
+      image_abs_pose_options.num_threads = 1;
+      image_abs_pose_options.ransac_options.num_threads = 1;
     }
+  }
 
-    //////////////////////////////////////////////////////////////////////////////
-    // Pose refinement
-    //////////////////////////////////////////////////////////////////////////////
+  // The poses are estimated concurrently against the same state of the
+  // reconstruction, which is not modified until all estimations finished.
+  std::vector<NextImageRegistration> registrations(num_images);
+  std::vector<char> success(num_images, false);
+  const int num_threads = std::min<int>(
+      num_images, GetEffectiveNumThreads(options.num_threads));
+  ThreadPool thread_pool(std::max(1, num_threads));
+  for (size_t i = 0; i < num_images; ++i) {
+    thread_pool.AddTask([&, i]() {
+      success[i] = FindNextImageCorrespondences(
+                       options, batch_image_ids[i], &registrations[i]) &&
+                   EstimateNextImagePose(options,
+                                         batch_image_ids[i],
+                                         abs_pose_options[i],
+                                         abs_pose_refinement_options[i],
+                                         &registrations[i]);
+    });
+  }
+  thread_pool.Wait();
 
-    abs_pose_refinement_options.refine_focal_length = false;
-    abs_pose_refinement_options.refine_extra_params = false;
-
-    if (!RefineGeneralizedAbsolutePose(abs_pose_refinement_options,
-                                       inlier_mask,
-                                       tri_points2D,
-                                       tri_points3D,
-                                       camera_idxs,
-                                       virtual_from_reals,
-                                       &image.CamFromWorld(),
-                                       &virtual_cameras)) {
-      return false;
+  std::vector<image_t> reg_image_ids;
+  for (size_t i = 0; i < num_images; ++i) {
+    if (success[i]) {
+      CommitNextImage(batch_image_ids[i], registrations[i]);
+      reg_image_ids.push_back(batch_image_ids[i]);
     }
   }
 
-  //////////////////////////////////////////////////////////////////////////////
-  // Continue tracks
-  //////////////////////////////////////////////////////////////////////////////
-
-  reconstruction_->RegisterImage(image_id);
-  RegisterImageEvent(image_id);
-
-  for (size_t i = 0; i < inlier_mask.size(); ++i) {
-    if (inlier_mask[i]) {
-      const point2D_t point2D_idx = tri_corrs[i].first;
-      const Point2D& point2D = image.Point2D(point2D_idx);
-      if (!point2D.HasPoint3D()) {
-        const point3D_t point3D_id = tri_corrs[i].second;
-        const TrackElement track_el(image_id, point2D_idx);
-        reconstruction_->AddObservation(point3D_id, track_el);
-        triangulator_->AddModifiedPoint3D(point3D_id);
-      }
-    }
+  // Every round registers at least one image of every deferred camera.
+  if (!deferred_image_ids.empty()) {
+    const std::vector<image_t> deferred_reg_image_ids =
+        RegisterNextImages(options, deferred_image_ids);
+    reg_image_ids.insert(reg_image_ids.end(),
+                         deferred_reg_image_ids.begin(),
+                         deferred_reg_image_ids.end());
   }
 
-  return true;
+  return reg_image_ids;
 }
 
 size_t IncrementalMapper::TriangulateImage(
@@ -657,6 +694,13 @@ size_t IncrementalMapper::TriangulateImage(
   return triangulator_->TriangulateImage(tri_options, image_id);
 }
 
+size_t IncrementalMapper::TriangulateImages(
+    const IncrementalTriangulator::Options& tri_options,
+    const std::vector<image_t>& image_ids) {
+  CHECK_NOTNULL(reconstruction_);
+  return triangulator_->TriangulateImages(tri_options, image_ids);
+}
+
 size_t IncrementalMapper::Retriangulate(
     const IncrementalTriangulator::Options& tri_options) {
   CHECK_NOTNULL(reconstruction_);
@@ -688,7 +732,34 @@ IncrementalMapper::AdjustLocalBundle(
   LocalBundleAdjustmentReport report;
 
   // Find images that have most 3D points with given image in common.
-  const std::vector<image_t> local_bundle = FindLocalBundle(options, image_id);
+  std::vector<image_t> local_bundle = FindLocalBundle(options, image_id);
+
+  // The observations of an image in the bundle adjustment are all observations
+  // of its 3D points, which are two residuals each.
+  const auto num_image_residuals = [this](const image_t image_id) {
+    return 2 * reconstruction_->Image(image_id).NumPoints3D();
+  };
+
+  // Limit the local bundle to the most connected images within the budget of
+  // residuals, while keeping at least one image to fix the gauge.
+  size_t num_residuals = 0;
+  if (options.local_ba_max_num_residuals > 0) {
+    const size_t max_num_residuals =
+        static_cast<size_t>(options.local_ba_max_num_residuals);
+    num_residuals = num_image_residuals(image_id);
+    size_t num_local_images = 0;
+    while (num_local_images < local_bundle.size()) {
+      const size_t num_local_image_residuals =
+          num_image_residuals(local_bundle[num_local_images]);
+      if (num_local_images > 0 &&
+          num_residuals + num_local_image_residuals > max_num_residuals) {
+        break;
+      }
+      num_residuals += num_local_image_residuals;
+      num_local_images += 1;
+    }
+    local_bundle.resize(num_local_images);
+  }
 
   // Do the bundle adjustment only if there is any connected images.
   if (local_bundle.size() > 0) {
@@ -745,22 +816,66 @@ IncrementalMapper::AdjustLocalBundle(
     // long track 3D points as they are usually already very stable and adding
     // to them to bundle adjustment and track merging/completion would slow
     // down the local bundle adjustment significantly.
-    std::unordered_set<point3D_t> variable_point3D_ids;
+    std::vector<std::pair<size_t, point3D_t>> track_lengths_and_point3D_ids;
+    track_lengths_and_point3D_ids.reserve(point3D_ids.size());
     for (const point3D_t point3D_id : point3D_ids) {
       const Point3D& point3D = reconstruction_->Point3D(point3D_id);
       const size_t kMaxTrackLength = 15;
       if (!point3D.HasError() || point3D.track.Length() <= kMaxTrackLength) {
-        ba_config.AddVariablePoint(point3D_id);
-        variable_point3D_ids.insert(point3D_id);
+        track_lengths_and_point3D_ids.emplace_back(point3D.track.Length(),
+                                                   point3D_id);
       }
     }
 
-    // Adjust the local bundle.
-    BundleAdjuster bundle_adjuster(ba_options, ba_config);
-    bundle_adjuster.Solve(reconstruction_.get());
+    // With a limited budget, the new and modified points with the shortest
+    // tracks are refined first, which are the least constrained. Their
+    // observations in images outside of the local bundle add residuals.
+    if (options.local_ba_max_num_residuals > 0) {
+      std::sort(track_lengths_and_point3D_ids.begin(),
+                track_lengths_and_point3D_ids.end());
+    }
+
+    std::unordered_set<point3D_t> variable_point3D_ids;
+    for (const auto& track_length_and_point3D_id :
+         track_lengths_and_point3D_ids) {
+      const point3D_t point3D_id = track_length_and_point3D_id.second;
+      if (options.local_ba_max_num_residuals > 0) {
+        size_t num_point_residuals = 0;
+        for (const TrackElement& track_el :
+             reconstruction_->Point3D(point3D_id).track.Elements()) {
+          if (!ba_config.HasImage(track_el.image_id)) {
+            num_point_residuals += 2;
+          }
+        }
+        if (num_residuals + num_point_residuals >
+            static_cast<size_t>(options.local_ba_max_num_residuals)) {
+          break;
+        }
+        num_residuals += num_point_residuals;
+      }
+      ba_config.AddVariablePoint(point3D_id);
+      variable_point3D_ids.insert(point3D_id);
+    }
 
-    report.num_adjusted_observations =
-        bundle_adjuster.Summary().num_residuals / 2;
+    // Adjust the local bundle. The problem is kept between subsequent local
+    // bundle adjustments, since the local bundles of consecutively registered
+    // images largely overlap.
+    if (PersistentBundleAdjuster::IsSupported(ba_options)) {
+      if (!local_bundle_adjuster_) {
+        local_bundle_adjuster_ =
+            std::make_unique<PersistentBundleAdjuster>(ba_options);
+      }
+      local_bundle_adjuster_->Solve(ba_config, reconstruction_.get());
+      report.num_adjusted_observations =
+          local_bundle_adjuster_->Summary().num_residuals / 2;
+    } else {
+      BundleAdjuster bundle_adjuster(ba_options, ba_config);
+      bundle_adjuster.SetPosePriorInformationCache(
+          &pose_prior_information_cache_);
+      bundle_adjuster.Solve(reconstruction_.get());
+      report.num_adjusted_observations =
+          bundle_adjuster.Summary().num_residuals / 2;
+    }
 
     // Merge refined tracks with other existing points.
     report.num_merged_observations =
@@ -786,12 +901,14 @@ IncrementalMapper::AdjustLocalBundle(
       reconstruction_->FilterPoints3DInImages(options.filter_max_reproj_error,
                                               options.filter_min_tri_angle,
                                               filter_image_ids,
-                                              options.enable_refraction);
+                                              options.enable_refraction,
+                                              options.num_threads);
   report.num_filtered_observations +=
       reconstruction_->FilterPoints3D(options.filter_max_reproj_error,
                                       options.filter_min_tri_angle,
                                       point3D_ids,
-                                      options.enable_refraction);
+                                      options.enable_refraction,
+                                      options.num_threads);
 
   return report;
 }
@@ -835,12 +952,43 @@ bool IncrementalMapper::AdjustGlobalBundle(
     }
   }
 
+  // In the reduced bundle adjustment, the poses are only refined on a
+  // spatially uniform subset of the points. The remaining points are refined
+  // independently of each other on the refined poses.
+  std::vector<point3D_t> remaining_point3D_ids;
+  if (options.global_ba_max_num_points_per_cell > 0) {
+    std::unordered_set<point3D_t> point3D_ids = SelectUniformPoints3D(
+        *reconstruction_, options.global_ba_max_num_points_per_cell);
+    for (const auto& point3D : reconstruction_->Points3D()) {
+      if (point3D_ids.count(point3D.first) == 0) {
+        remaining_point3D_ids.push_back(point3D.first);
+      }
+    }
+    if (!remaining_point3D_ids.empty()) {
+      VLOG(2) << "Reduced global bundle adjustment with "
+              << point3D_ids.size() << " of "
+              << reconstruction_->NumPoints3D() << " points";
+      ba_config.SetPointSubset(std::move(point3D_ids));
+    }
+  }
+
   // Run bundle adjustment.
   BundleAdjuster bundle_adjuster(ba_options, ba_config);
+  bundle_adjuster.SetPosePriorInformationCache(&pose_prior_information_cache_);
   if (!bundle_adjuster.Solve(reconstruction_.get())) {
     return false;
   }
 
+  if (!remaining_point3D_ids.empty()) {
+    AdjustPoints3D(ba_options,
+                   remaining_point3D_ids,
+                   options.num_threads,
+                   reconstruction_.get());
+    for (const point3D_t point3D_id : remaining_point3D_ids) {
+      reconstruction_->SetModifiedPoint3D(point3D_id);
+    }
+  }
+
   // Normalize scene for numerical stability and
   // to avoid large scale changes in viewer.
   if (!options.use_pose_prior) {
@@ -875,6 +1023,7 @@ size_t IncrementalMapper::FilterImages(const Options& options) {
   for (const image_t image_id : image_ids) {
     DeRegisterImageEvent(image_id);
     filtered_images_.insert(image_id);
+    next_image_queue_.changed_image_ids.insert(image_id);
   }
 
   return image_ids.size();
@@ -883,9 +1032,13 @@ size_t IncrementalMapper::FilterImages(const Options& options) {
 size_t IncrementalMapper::FilterPoints(const Options& options) {
   CHECK_NOTNULL(reconstruction_);
   CHECK(options.Check());
-  return reconstruction_->FilterAllPoints3D(options.filter_max_reproj_error,
-                                            options.filter_min_tri_angle,
-                                            options.enable_refraction);
+  // Only the 3D points modified since the last call need to be filtered,
+  // since the thresholds are the same for all calls.
+  return reconstruction_->FilterModifiedPoints3D(
+      options.filter_max_reproj_error,
+      options.filter_min_tri_angle,
+      options.enable_refraction,
+      options.num_threads);
 }
 
 const Reconstruction& IncrementalMapper::GetReconstruction() const {
@@ -1279,6 +1432,336 @@ std::vector<image_t> IncrementalMapper::FindLocalBundle(
   return local_bundle_image_ids;
 }
 
+bool IncrementalMapper::FindNextImageCorrespondences(
+    const Options& options,
+    const image_t image_id,
+    NextImageRegistration* registration) const {
+  const Image& image = reconstruction_->Image(image_id);
+
+  // Check if enough 2D-3D correspondences.
+  if (image.NumVisiblePoints3D() <
+      static_cast<size_t>(options.abs_pose_min_num_inliers)) {
+    return false;
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+  // Search for 2D-3D correspondences
+  //////////////////////////////////////////////////////////////////////////////
+
+  std::vector<std::pair<point2D_t, point3D_t>>& tri_corrs =
+      registration->tri_corrs;
+  std::vector<Eigen::Vector2d>& tri_points2D = registration->tri_points2D;
+  std::vector<Eigen::Vector3d>& tri_points3D = registration->tri_points3D;
+  tri_corrs.clear();
+  tri_points2D.clear();
+  tri_points3D.clear();
+
+  const std::shared_ptr<const CorrespondenceGraph> correspondence_graph =
+      database_cache_->CorrespondenceGraph();
+
+  std::unordered_set<point3D_t> corr_point3D_ids;
+  for (point2D_t point2D_idx = 0; point2D_idx < image.NumPoints2D();
+       ++point2D_idx) {
+    const Point2D& point2D = image.Point2D(point2D_idx);
+
+    corr_point3D_ids.clear();
+    const auto corr_range =
+        correspondence_graph->FindCorrespondences(image_id, point2D_idx);
+    for (const auto* corr = corr_range.beg; corr < corr_range.end; ++corr) {
+      const Image& corr_image = reconstruction_->Image(corr->image_id);
+      if (!corr_image.IsRegistered()) {
+        continue;
+      }
+
+      const Point2D& corr_point2D = corr_image.Point2D(corr->point2D_idx);
+      if (!corr_point2D.HasPoint3D()) {
+        continue;
+      }
+
+      // Avoid duplicate correspondences.
+      if (corr_point3D_ids.count(corr_point2D.point3D_id) > 0) {
+        continue;
+      }
+
+      const Camera& corr_camera =
+          reconstruction_->Camera(corr_image.CameraId());
+
+      // Avoid correspondences to images with bogus camera parameters.
+      if (corr_camera.HasBogusParams(options.min_focal_length_ratio,
+                                     options.max_focal_length_ratio,
+                                     options.max_extra_param)) {
+        continue;
+      }
+
+      const Point3D& point3D =
+          reconstruction_->Point3D(corr_point2D.point3D_id);
+
+      tri_corrs.emplace_back(point2D_idx, corr_point2D.point3D_id);
+      corr_point3D_ids.insert(corr_point2D.point3D_id);
+      tri_points2D.push_back(point2D.xy);
+      tri_points3D.push_back(point3D.xyz);
+    }
+  }
+
+  // The size of `next_image.num_tri_obs` and `tri_corrs_point2D_idxs.size()`
+  // can only differ, when there are images with bogus camera parameters, and
+  // hence we skip some of the 2D-3D correspondences.
+  if (tri_points2D.size() <
+      static_cast<size_t>(options.abs_pose_min_num_inliers)) {
+    return false;
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+  // Gate 2D-3D correspondences with pose prior
+  //////////////////////////////////////////////////////////////////////////////
+
+  if (options.use_pose_prior && options.abs_pose_prior_max_error > 0) {
+    const Camera& camera = reconstruction_->Camera(image.CameraId());
+    const Eigen::Matrix3x4d cam_from_world_prior =
+        (Inverse(reconstruction_->PriorFromCam()) * image.CamFromWorldPrior())
+            .ToMatrix();
+    const double max_squared_error =
+        options.abs_pose_prior_max_error * options.abs_pose_prior_max_error;
+    std::vector<char> gate_mask(tri_corrs.size(), false);
+    size_t num_gated_corrs = 0;
+    for (size_t i = 0; i < tri_corrs.size(); ++i) {
+      const double squared_error =
+          CalculateSquaredReprojectionError(tri_points2D[i],
+                                            tri_points3D[i],
+                                            cam_from_world_prior,
+                                            camera,
+                                            options.enable_refraction);
+      if (squared_error <= max_squared_error) {
+        gate_mask[i] = true;
+        num_gated_corrs += 1;
+      }
+    }
+
+    // Otherwise, the pose prior is considered unreliable and all
+    // correspondences are used.
+    if (num_gated_corrs >=
+        static_cast<size_t>(options.abs_pose_min_num_inliers)) {
+      size_t gated_idx = 0;
+      for (size_t i = 0; i < tri_corrs.size(); ++i) {
+        if (gate_mask[i]) {
+          tri_corrs[gated_idx] = tri_corrs[i];
+          tri_points2D[gated_idx] = tri_points2D[i];
+          tri_points3D[gated_idx] = tri_points3D[i];
+          gated_idx += 1;
+        }
+      }
+      tri_corrs.resize(num_gated_corrs);
+      tri_points2D.resize(num_gated_corrs);
+      tri_points3D.resize(num_gated_corrs);
+    }
+  }
+
+  return true;
+}
+
+void IncrementalMapper::PrepareNextImageCamera(
+    const Options& options,
+    const image_t image_id,
+    AbsolutePoseEstimationOptions* abs_pose_options,
+    AbsolutePoseRefinementOptions* abs_pose_refinement_options) {
+  const Image& image = reconstruction_->Image(image_id);
+  Camera& camera = reconstruction_->Camera(image.CameraId());
+
+  // Only refine / estimate focal length, if no focal length was specified
+  // (manually or through EXIF) and if it was not already estimated previously
+  // from another image (when multiple images share the same camera
+  // parameters)
+
+  abs_pose_options->num_threads = options.num_threads;
+  abs_pose_options->num_focal_length_samples = 30;
+  abs_pose_options->min_focal_length_ratio = options.min_focal_length_ratio;
+  abs_pose_options->max_focal_length_ratio = options.max_focal_length_ratio;
+  abs_pose_options->ransac_options.max_error = options.abs_pose_max_error;
+  abs_pose_options->ransac_options.min_inlier_ratio =
+      options.abs_pose_min_inlier_ratio;
+  // Use high confidence to avoid preemptive termination of P3P RANSAC
+  // - too early termination may lead to bad registration.
+  abs_pose_options->ransac_options.min_num_trials = 100;
+  abs_pose_options->ransac_options.max_num_trials = 10000;
+  abs_pose_options->ransac_options.confidence = 0.99999;
+  abs_pose_options->ransac_options.num_threads = options.num_threads;
+  if (options.use_pose_prior && options.use_prior_gravity) {
+    abs_pose_options->gravity_in_cam =
+        ComputePriorGravityInCam(*reconstruction_, image);
+  }
+
+  if (num_reg_images_per_camera_[image.CameraId()] > 0) {
+    // Camera already refined from another image with the same camera.
+    if (camera.HasBogusParams(options.min_focal_length_ratio,
+                              options.max_focal_length_ratio,
+                              options.max_extra_param)) {
+      // Previously refined camera has bogus parameters,
+      // so reset parameters and try to re-estimage.
+      camera.params = database_cache_->Camera(image.CameraId()).params;
+      reconstruction_->SetModifiedCamera(image.CameraId());
+      abs_pose_options->estimate_focal_length = !camera.has_prior_focal_length;
+      abs_pose_refinement_options->refine_focal_length = true;
+      abs_pose_refinement_options->refine_extra_params = true;
+    } else {
+      abs_pose_options->estimate_focal_length = false;
+      abs_pose_refinement_options->refine_focal_length = false;
+      abs_pose_refinement_options->refine_extra_params = false;
+    }
+  } else {
+    // Camera not refined before. Note that the camera parameters might have
+    // been changed before but the image was filtered, so we explicitly reset
+    // the camera parameters and try to re-estimate them.
+    camera.params = database_cache_->Camera(image.CameraId()).params;
+    abs_pose_options->estimate_focal_length = !camera.has_prior_focal_length;
+    abs_pose_refinement_options->refine_focal_length = true;
+    abs_pose_refinement_options->refine_extra_params = true;
+  }
+
+  if (!options.abs_pose_refine_focal_length) {
+    abs_pose_options->estimate_focal_length = false;
+    abs_pose_refinement_options->refine_focal_length = false;
+  }
+
+  if (!options.abs_pose_refine_extra_params) {
+    abs_pose_refinement_options->refine_extra_params = false;
+  }
+}
+
+bool IncrementalMapper::EstimateNextImagePose(
+    const Options& options,
+    const image_t image_id,
+    const AbsolutePoseEstimationOptions& abs_pose_options,
+    const AbsolutePoseRefinementOptions& abs_pose_refinement_options,
+    NextImageRegistration* registration) {
+  const Image& image = reconstruction_->Image(image_id);
+  const std::vector<Eigen::Vector2d>& tri_points2D = registration->tri_points2D;
+  const std::vector<Eigen::Vector3d>& tri_points3D = registration->tri_points3D;
+  Rigid3d& cam_from_world = registration->cam_from_world;
+  std::vector<char>& inlier_mask = registration->inlier_mask;
+  cam_from_world = image.CamFromWorld();
+
+  size_t num_inliers;
+
+  if (!options.enable_refraction) {
+    // Non-refractive case, where the camera parameters may be estimated. The
+    // camera is estimated on a copy, which is only committed together with
+    // the image, such that multiple images can be estimated concurrently.
+    Camera& camera = registration->camera;
+    camera = reconstruction_->Camera(image.CameraId());
+    registration->refined_camera =
+        abs_pose_options.estimate_focal_length ||
+        abs_pose_refinement_options.refine_focal_length ||
+        abs_pose_refinement_options.refine_extra_params;
+    if (!EstimateAbsolutePose(abs_pose_options,
+                              tri_points2D,
+                              tri_points3D,
+                              &cam_from_world,
+                              &camera,
+                              &num_inliers,
+                              &inlier_mask)) {
+      return false;
+    }
+
+    if (num_inliers < static_cast<size_t>(options.abs_pose_min_num_inliers)) {
+      return false;
+    }
+
+    //////////////////////////////////////////////////////////////////////////////
+    // Pose refinement
+    //////////////////////////////////////////////////////////////////////////////
+
+    if (!RefineAbsolutePose(abs_pose_refinement_options,
+                            inlier_mask,
+                            tri_points2D,
+                            tri_points3D,
+                            &cam_from_world,
+                            &camera)) {
+      return false;
+    }
+  } else {
+    // Refractive case, where the camera is not modified, such that multiple
+    // images can be estimated concurrently.
+    const Camera& camera = reconstruction_->Camera(image.CameraId());
+    VirtualPinholeCameras virtual_cameras;
+    camera.ComputeVirtuals(tri_points2D, &virtual_cameras);
+
+    if (!EstimateGeneralizedAbsolutePose(abs_pose_options.ransac_options,
+                                         tri_points2D,
+                                         tri_points3D,
+                                         virtual_cameras,
+                                         &cam_from_world,
+                                         &num_inliers,
+                                         &inlier_mask,
+                                         abs_pose_options.gravity_in_cam)) {
+      return false;
+    }
+
+    if (num_inliers < static_cast<size_t>(options.abs_pose_min_num_inliers)) {
+      return false;
+    }
+
+    //////////////////////////////////////////////////////////////////////////////
+    // Pose refinement
+    //////////////////////////////////////////////////////////////////////////////
+
+    AbsolutePoseRefinementOptions generalized_refinement_options =
+        abs_pose_refinement_options;
+    generalized_refinement_options.refine_focal_length = false;
+    generalized_refinement_options.refine_extra_params = false;
+
+    if (!RefineGeneralizedAbsolutePoseLocally(
+            generalized_refinement_options,
+            abs_pose_options.ransac_options.max_error,
+            tri_points2D,
+            tri_points3D,
+            virtual_cameras,
+            &cam_from_world,
+            &inlier_mask)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void IncrementalMapper::CommitNextImage(
+    const image_t image_id, const NextImageRegistration& registration) {
+  Image& image = reconstruction_->Image(image_id);
+  image.CamFromWorld() = registration.cam_from_world;
+
+  if (registration.refined_camera) {
+    // The other registered images of the camera are affected by its changes.
+    const auto num_reg_images_for_camera =
+        num_reg_images_per_camera_.find(image.CameraId());
+    if (num_reg_images_for_camera != num_reg_images_per_camera_.end() &&
+        num_reg_images_for_camera->second > 0) {
+      reconstruction_->SetModifiedCamera(image.CameraId());
+    }
+    reconstruction_->Camera(image.CameraId()).params =
+        registration.camera.params;
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+  // Continue tracks
+  //////////////////////////////////////////////////////////////////////////////
+
+  reconstruction_->RegisterImage(image_id);
+  RegisterImageEvent(image_id);
+
+  for (size_t i = 0; i < registration.inlier_mask.size(); ++i) {
+    if (registration.inlier_mask[i]) {
+      const point2D_t point2D_idx = registration.tri_corrs[i].first;
+      const Point2D& point2D = image.Point2D(point2D_idx);
+      if (!point2D.HasPoint3D()) {
+        const point3D_t point3D_id = registration.tri_corrs[i].second;
+        const TrackElement track_el(image_id, point2D_idx);
+        reconstruction_->AddObservation(point3D_id, track_el);
+        triangulator_->AddModifiedPoint3D(point3D_id);
+      }
+    }
+  }
+}
+
 void IncrementalMapper::RegisterImageEvent(const image_t image_id) {
   const Image& image = reconstruction_->Image(image_id);
   size_t& num_reg_images_for_camera =
@@ -1319,6 +1802,150 @@ bool IncrementalMapper::EstimateInitialTwoViewGeometry(
     return true;
   }
 
+  EstimateInitialTwoViewGeometries(options, {image_pair_id});
+
+  TwoViewGeometry two_view_geometry =
+      init_two_view_geometries_.at(image_pair_id);
+  if (!IsSuitableInitialTwoViewGeometry(options, two_view_geometry)) {
+    return false;
+  }
+
+  image_t ordered_image_id1;
+  image_t ordered_image_id2;
+  Database::PairIdToImagePair(
+      image_pair_id, &ordered_image_id1, &ordered_image_id2);
+  if (ordered_image_id1 != image_id1) {
+    two_view_geometry.Invert();
+  }
+
+  prev_init_image_pair_id_ = image_pair_id;
+  prev_init_two_view_geometry_ = std::move(two_view_geometry);
+  return true;
+}
+
+void IncrementalMapper::EstimateInitialTwoViewGeometries(
+    const Options& options, const std::vector<image_pair_t>& image_pair_ids) {
+  std::vector<image_pair_t> new_image_pair_ids;
+  for (const image_pair_t image_pair_id : image_pair_ids) {
+    if (init_two_view_geometries_.count(image_pair_id) > 0) {
+      continue;
+    }
+
+    if (options.init_use_stored_poses &&
+        !(options.use_pose_prior && options.use_prior_gravity)) {
+      const TwoViewGeometry* stored_two_view_geometry =
+          database_cache_->FindTwoViewGeometryPose(image_pair_id);
+      if (stored_two_view_geometry != nullptr &&
+          (stored_two_view_geometry->config ==
+           TwoViewGeometry::ConfigurationType::REFRACTIVE) ==
+              options.enable_refraction) {
+        // The stored inlier matches are the correspondences of the pair.
+        TwoViewGeometry two_view_geometry = *stored_two_view_geometry;
+        image_t image_id1;
+        image_t image_id2;
+        Database::PairIdToImagePair(image_pair_id, &image_id1, &image_id2);
+        two_view_geometry.inlier_matches =
+            database_cache_->CorrespondenceGraph()
+                ->FindCorrespondencesBetweenImages(image_id1, image_id2);
+        init_two_view_geometries_.emplace(image_pair_id,
+                                          std::move(two_view_geometry));
+        continue;
+      }
+    }
+
+    new_image_pair_ids.push_back(image_pair_id);
+
+    // The best fit cameras are cached upfront, such that they are only read
+    // during the concurrent estimation.
+    if (options.enable_refraction) {
+      const double kApproxDepth = 5.0;
+      image_t image_ids[2];
+      Database::PairIdToImagePair(image_pair_id, &image_ids[0], &image_ids[1]);
+      for (const image_t image_id : image_ids) {
+        const Image& image = database_cache_->Image(image_id);
+        const Camera& camera = database_cache_->Camera(image.CameraId());
+        if (best_fit_cameras_.count(camera.camera_id) == 0) {
+          best_fit_cameras_.emplace(
+              camera.camera_id,
+              BestFitNonRefracCamera(
+                  CameraModelId::kOpenCV, camera, kApproxDepth));
+        }
+      }
+    }
+  }
+
+  std::vector<TwoViewGeometry> two_view_geometries(new_image_pair_ids.size());
+  const int num_threads = std::min<int>(
+      new_image_pair_ids.size(), GetEffectiveNumThreads(options.num_threads));
+  ThreadPool thread_pool(std::max(1, num_threads));
+  // A single pair is estimated with the threads inside of RANSAC.
+  const int ransac_num_threads =
+      new_image_pair_ids.size() == 1 ? options.num_threads : 1;
+  for (size_t i = 0; i < new_image_pair_ids.size(); ++i) {
+    thread_pool.AddTask([&, i]() {
+      image_t image_id1;
+      image_t image_id2;
+      Database::PairIdToImagePair(
+          new_image_pair_ids[i], &image_id1, &image_id2);
+      two_view_geometries[i] = ComputeInitialTwoViewGeometry(
+          options, image_id1, image_id2, ransac_num_threads);
+    });
+  }
+  thread_pool.Wait();
+
+  for (size_t i = 0; i < new_image_pair_ids.size(); ++i) {
+    init_two_view_geometries_.emplace(new_image_pair_ids[i],
+                                      std::move(two_view_geometries[i]));
+  }
+}
+
+bool IncrementalMapper::SelectInitialImagePair(
+    const Options& options,
+    const std::vector<std::pair<image_t, image_t>>& image_pairs,
+    image_t* image_id1,
+    image_t* image_id2) {
+  std::vector<image_pair_t> image_pair_ids;
+  image_pair_ids.reserve(image_pairs.size());
+  for (const auto& image_pair : image_pairs) {
+    image_pair_ids.push_back(
+        Database::ImagePairToPairId(image_pair.first, image_pair.second));
+  }
+
+  EstimateInitialTwoViewGeometries(options, image_pair_ids);
+
+  int best_idx = -1;
+  double best_score = 0;
+  for (size_t i = 0; i < image_pair_ids.size(); ++i) {
+    const TwoViewGeometry& two_view_geometry =
+        init_two_view_geometries_.at(image_pair_ids[i]);
+    if (!IsSuitableInitialTwoViewGeometry(options, two_view_geometry)) {
+      init_image_pairs_.insert(image_pair_ids[i]);
+      continue;
+    }
+    const double score = two_view_geometry.inlier_matches.size() *
+                         two_view_geometry.tri_angle;
+    if (best_idx == -1 || score > best_score) {
+      best_idx = static_cast<int>(i);
+      best_score = score;
+    }
+  }
+
+  if (best_idx == -1) {
+    return false;
+  }
+
+  *image_id1 = image_pairs[best_idx].first;
+  *image_id2 = image_pairs[best_idx].second;
+  init_image_pairs_.insert(image_pair_ids[best_idx]);
+  // Caches the chosen geometry for `RegisterInitialImagePair`.
+  return EstimateInitialTwoViewGeometry(options, *image_id1, *image_id2);
+}
+
+TwoViewGeometry IncrementalMapper::ComputeInitialTwoViewGeometry(
+    const Options& options,
+    const image_t image_id1,
+    const image_t image_id2,
+    const int ransac_num_threads) const {
   const Image& image1 = database_cache_->Image(image_id1);
   const Camera& camera1 = database_cache_->Camera(image1.CameraId());
 
@@ -1344,6 +1971,13 @@ bool IncrementalMapper::EstimateInitialTwoViewGeometry(
   TwoViewGeometryOptions two_view_geometry_options;
   two_view_geometry_options.ransac_options.min_num_trials = 30;
   two_view_geometry_options.ransac_options.max_error = options.init_max_error;
+  two_view_geometry_options.ransac_options.num_threads = ransac_num_threads;
+  if (options.use_pose_prior && options.use_prior_gravity) {
+    two_view_geometry_options.gravity_in_cam1 = ComputePriorGravityInCam(
+        *reconstruction_, reconstruction_->Image(image_id1));
+    two_view_geometry_options.gravity_in_cam2 = ComputePriorGravityInCam(
+        *reconstruction_, reconstruction_->Image(image_id2));
+  }
   TwoViewGeometry two_view_geometry;
 
   if (!options.enable_refraction) {
@@ -1352,59 +1986,30 @@ bool IncrementalMapper::EstimateInitialTwoViewGeometry(
 
     if (!EstimateTwoViewGeometryPose(
             camera1, points1, camera2, points2, &two_view_geometry)) {
-      return false;
+      return TwoViewGeometry();
     }
   } else {
-    const double kApproxDepth = 5.0;
-
-    if (best_fit_cameras_.count(camera1.camera_id) == 0) {
-      Camera best_fit =
-          BestFitNonRefracCamera(CameraModelId::kOpenCV, camera1, kApproxDepth);
-      best_fit_cameras_.emplace(camera1.camera_id, std::move(best_fit));
-    }
-
-    if (best_fit_cameras_.count(camera2.camera_id) == 0) {
-      Camera best_fit =
-          BestFitNonRefracCamera(CameraModelId::kOpenCV, camera2, kApproxDepth);
-      best_fit_cameras_.emplace(camera2.camera_id, std::move(best_fit));
-    }
-
     const Camera& best_fit_camera1 = best_fit_cameras_.at(camera1.camera_id);
     const Camera& best_fit_camera2 = best_fit_cameras_.at(camera2.camera_id);
-    std::vector<Camera> virtual_cameras1;
-    std::vector<Camera> virtual_cameras2;
-    std::vector<Rigid3d> virtual_from_reals1;
-    std::vector<Rigid3d> virtual_from_reals2;
-
-    camera1.ComputeVirtuals(points1, virtual_cameras1, virtual_from_reals1);
-    camera2.ComputeVirtuals(points2, virtual_cameras2, virtual_from_reals2);
+    VirtualPinholeCameras virtual_cameras1;
+    VirtualPinholeCameras virtual_cameras2;
+    camera1.ComputeVirtuals(points1, &virtual_cameras1);
+    camera2.ComputeVirtuals(points2, &virtual_cameras2);
 
     two_view_geometry_options.compute_relative_pose = true;
     two_view_geometry =
         EstimateRefractiveTwoViewGeometryUseBestFit(best_fit_camera1,
                                                     points1,
                                                     virtual_cameras1,
-                                                    virtual_from_reals1,
                                                     best_fit_camera2,
                                                     points2,
                                                     virtual_cameras2,
-                                                    virtual_from_reals2,
                                                     matches,
                                                     two_view_geometry_options,
                                                     true);
   }
 
-  if (static_cast<int>(two_view_geometry.inlier_matches.size()) >=
-          options.init_min_num_inliers &&
-      std::abs(two_view_geometry.cam2_from_cam1.translation.normalized().z()) <
-          options.init_max_forward_motion &&
-      two_view_geometry.tri_angle > DegToRad(options.init_min_tri_angle)) {
-    prev_init_image_pair_id_ = image_pair_id;
-    prev_init_two_view_geometry_ = two_view_geometry;
-    return true;
-  }
-
-  return false;
+  return two_view_geometry;
 }
 
 }  // namespace colmap
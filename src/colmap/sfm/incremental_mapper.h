@@ -30,11 +30,16 @@
 #pragma once
 
 #include "colmap/estimators/bundle_adjustment.h"
+#include "colmap/estimators/pose.h"
 #include "colmap/scene/database.h"
 #include "colmap/scene/database_cache.h"
 #include "colmap/scene/reconstruction.h"
 #include "colmap/sfm/incremental_triangulator.h"
 
+#include <array>
+#include <functional>
+#include <set>
+
 namespace colmap {
 
 // Class that provides all functionality for the incremental reconstruction
@@ -76,6 +81,18 @@ class IncrementalMapper {
     // Maximum number of trials to use an image for initialization.
     int init_max_reg_trials = 2;
 
+    // Number of candidate initial image pairs whose two-view geometries are
+    // estimated in parallel. Among the suitable pairs of a batch, the pair
+    // with the largest product of inliers and triangulation angle is chosen.
+    int init_num_parallel_pairs = 1;
+
+    // Whether to use the relative poses of candidate initial image pairs,
+    // which were estimated and stored during matching with
+    // `compute_relative_pose`, instead of estimating them again. The stored
+    // poses were estimated with the error threshold of the matching. Pairs
+    // without stored poses or with gravity priors are still estimated.
+    bool init_use_stored_poses = true;
+
     // Maximum reprojection error in absolute pose estimation.
     double abs_pose_max_error = 12.0;
 
@@ -85,6 +102,19 @@ class IncrementalMapper {
     // Minimum inlier ratio in absolute pose estimation.
     double abs_pose_min_inlier_ratio = 0.25;
 
+    // Maximum distance in pixels between the observations of the next image
+    // and the projections of their 3D points with the pose prior of the image.
+    // Correspondences with larger distances are discarded before absolute pose
+    // estimation, which reduces the number of RANSAC iterations. Only used
+    // with pose priors and disabled if non-positive.
+    double abs_pose_prior_max_error = -1;
+
+    // Whether to estimate the poses of the next images and of the initial
+    // image pair with the upright solvers, where the gravity direction is
+    // taken from the orientation of the pose priors. Assumes that the z-axis
+    // of the prior frame is vertical and is only used with pose priors.
+    bool use_prior_gravity = false;
+
     // Whether to estimate the focal length in absolute pose estimation.
     bool abs_pose_refine_focal_length = true;
 
@@ -97,6 +127,23 @@ class IncrementalMapper {
     // Minimum triangulation for images to be chosen in local bundle adjustment.
     double local_ba_min_tri_angle = 6;
 
+    // The maximum number of residuals of the local bundle adjustment, such
+    // that its cost does not grow with the size of the model. The local images
+    // are added in the order of their connectivity to the registered image
+    // until the budget is exhausted, and the remaining, less connected images
+    // only constrain the refined points through constant poses. The new and
+    // modified points are refined in the order of their track length. Set to
+    // 0 to not limit the number of residuals.
+    int local_ba_max_num_residuals = 0;
+
+    // The maximum number of points per cell of the finest level of the
+    // visibility pyramid of every image in the reduced global bundle
+    // adjustment. The poses are refined on a spatially uniform subset of the
+    // points with the longest tracks and smallest errors, and the remaining
+    // points are then refined in parallel on the fixed poses. Set to 0 to
+    // refine all points jointly with the poses.
+    int global_ba_max_num_points_per_cell = 0;
+
     // Thresholds for bogus camera parameters. Images with bogus camera
     // parameters are filtered and ignored in triangulation.
     double min_focal_length_ratio = 0.1;  // Opening angle of ~130deg
@@ -124,6 +171,10 @@ class IncrementalMapper {
     // Whether to use refractive camera model in reconstruction.
     bool enable_refraction = false;
 
+    // Number of next images whose poses are estimated in parallel and which
+    // are registered together. Only used in the refractive case.
+    int num_parallel_reg_images = 1;
+
     // Method to find and select next best image to register.
     enum class ImageSelectionMethod {
       MAX_VISIBLE_POINTS_NUM,
@@ -168,7 +219,9 @@ class IncrementalMapper {
 
   // Find best next image to register in the incremental reconstruction. The
   // images should be passed to `RegisterNextImage`. This function automatically
-  // ignores images that failed to registered for `max_reg_trials`.
+  // ignores images that failed to registered for `max_reg_trials`. The ranks of
+  // the images are maintained across calls and only updated for the images
+  // whose visibility, registration or registration trials changed.
   std::vector<image_t> FindNextImages(const Options& options);
 
   // Attempt to seed the reconstruction from an image pair.
@@ -180,10 +233,24 @@ class IncrementalMapper {
   // a previous call to `RegisterInitialImagePair` was successful.
   bool RegisterNextImage(const Options& options, image_t image_id);
 
+  // Attempt to register multiple images to the existing model, where the
+  // poses of all images are estimated in parallel against the same state of
+  // the model. Returns the successfully registered images. In the
+  // non-refractive case, only one image per camera estimates the camera
+  // parameters, and the other images of the camera are registered afterwards
+  // against the estimated camera.
+  std::vector<image_t> RegisterNextImages(
+      const Options& options, const std::vector<image_t>& image_ids);
+
   // Triangulate observations of image.
   size_t TriangulateImage(const IncrementalTriangulator::Options& tri_options,
                           image_t image_id);
 
+  // Triangulate observations of multiple images in parallel, see
+  // `IncrementalTriangulator::TriangulateImages`.
+  size_t TriangulateImages(const IncrementalTriangulator::Options& tri_options,
+                           const std::vector<image_t>& image_ids);
+
   // Retriangulate image pairs that should have common observations according to
   // the scene graph but don't due to drift, etc. To handle drift, the employed
   // reprojection error thresholds should be relatively large. If the thresholds
@@ -238,6 +305,20 @@ class IncrementalMapper {
   void ClearModifiedPoints3D();
 
  private:
+  // Data of the next image to register, which is estimated independently from
+  // the reconstruction and then committed to it.
+  struct NextImageRegistration {
+    std::vector<std::pair<point2D_t, point3D_t>> tri_corrs;
+    std::vector<Eigen::Vector2d> tri_points2D;
+    std::vector<Eigen::Vector3d> tri_points3D;
+    Rigid3d cam_from_world;
+    std::vector<char> inlier_mask;
+    // The estimated camera in the non-refractive case, which is only committed
+    // if its parameters were estimated or refined.
+    Camera camera;
+    bool refined_camera = false;
+  };
+
   // Find seed images for incremental reconstruction. Suitable seed images have
   // a large number of correspondences and have camera calibration priors. The
   // returned list is ordered such that most suitable images are in the front.
@@ -261,10 +342,51 @@ class IncrementalMapper {
   void RegisterImageEvent(image_t image_id);
   void DeRegisterImageEvent(image_t image_id);
 
+  // Steps of `RegisterNextImage`: Find the 2D-3D correspondences of the image,
+  // prepare the camera and the pose estimation options, estimate the pose and
+  // finally register the image and continue the tracks of its inliers.
+  bool FindNextImageCorrespondences(const Options& options,
+                                    image_t image_id,
+                                    NextImageRegistration* registration) const;
+  void PrepareNextImageCamera(
+      const Options& options,
+      image_t image_id,
+      AbsolutePoseEstimationOptions* abs_pose_options,
+      AbsolutePoseRefinementOptions* abs_pose_refinement_options);
+  bool EstimateNextImagePose(
+      const Options& options,
+      image_t image_id,
+      const AbsolutePoseEstimationOptions& abs_pose_options,
+      const AbsolutePoseRefinementOptions& abs_pose_refinement_options,
+      NextImageRegistration* registration);
+  void CommitNextImage(image_t image_id,
+                       const NextImageRegistration& registration);
+
   bool EstimateInitialTwoViewGeometry(const Options& options,
                                       image_t image_id1,
                                       image_t image_id2);
 
+  // Update the rank of the image in `next_image_queue_` or remove it, if it is
+  // not a candidate for the next image registration.
+  void UpdateNextImageRank(const Options& options, image_t image_id);
+
+  // Estimate the two-view geometries of the candidate initial image pairs in
+  // parallel, skipping pairs whose geometry was estimated before.
+  void EstimateInitialTwoViewGeometries(
+      const Options& options, const std::vector<image_pair_t>& image_pair_ids);
+  TwoViewGeometry ComputeInitialTwoViewGeometry(const Options& options,
+                                                image_t image_id1,
+                                                image_t image_id2,
+                                                int ransac_num_threads) const;
+
+  // Select the best suitable pair of the estimated candidates, or return false
+  // if none of them is suitable. Unsuitable pairs are not tried again.
+  bool SelectInitialImagePair(
+      const Options& options,
+      const std::vector<std::pair<image_t, image_t>>& image_pairs,
+      image_t* image_id1,
+      image_t* image_id2);
+
   // Class that holds all necessary data from database in memory.
   const std::shared_ptr<const DatabaseCache> database_cache_;
 
@@ -274,6 +396,15 @@ class IncrementalMapper {
   // Class that is responsible for incremental triangulation.
   std::unique_ptr<IncrementalTriangulator> triangulator_;
 
+  // Bundle adjuster, whose problem is reused across local bundle
+  // adjustments. It assumes that the local bundle adjustment options do not
+  // change during a reconstruction.
+  std::unique_ptr<PersistentBundleAdjuster> local_bundle_adjuster_;
+
+  // Square-root information matrices of the pose priors, which are shared by
+  // all bundle adjustments of the reconstruction.
+  PosePriorInformationCache pose_prior_information_cache_;
+
   // Number of images that are registered in at least on reconstruction.
   size_t num_total_reg_images_;
 
@@ -291,6 +422,12 @@ class IncrementalMapper {
   std::unordered_map<image_t, size_t> init_num_reg_trials_;
   std::unordered_set<image_pair_t> init_image_pairs_;
 
+  // Two-view geometries of the candidate initial image pairs in the order of
+  // their pair identifiers. Suitable candidates, which were not chosen, are
+  // reused by subsequent calls to `FindInitialImagePair` without estimating
+  // them again. Assumes that `init_max_error` does not change.
+  std::unordered_map<image_pair_t, TwoViewGeometry> init_two_view_geometries_;
+
   // The number of registered images per camera. This information is used
   // to avoid duplicate refinement of camera parameters and degradation of
   // already refined camera parameters in local bundle adjustment when multiple
@@ -307,6 +444,24 @@ class IncrementalMapper {
   // an upper bound to the number of trials to register an image.
   std::unordered_map<image_t, size_t> num_reg_trials_;
 
+  // Candidates for the next image registration ordered by their rank. Images
+  // that have not failed to register before are in the first bucket, all other
+  // images in the second. The queue is rebuilt if the options change.
+  struct NextImageQueue {
+    bool is_valid = false;
+    Options::ImageSelectionMethod image_selection_method;
+    int abs_pose_min_num_inliers = 0;
+    int max_reg_trials = 0;
+    std::array<std::set<std::pair<float, image_t>,
+                        std::greater<std::pair<float, image_t>>>,
+               2>
+        buckets;
+    std::unordered_map<image_t, std::pair<size_t, float>> image_ranks;
+    // Images whose registration trials changed since the last update.
+    std::unordered_set<image_t> changed_image_ids;
+  };
+  NextImageQueue next_image_queue_;
+
   // Images that were registered before beginning the reconstruction.
   // This image list will be non-empty, if the reconstruction is continued from
   // an existing reconstruction.
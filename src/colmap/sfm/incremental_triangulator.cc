@@ -30,10 +30,350 @@
 #include "colmap/sfm/incremental_triangulator.h"
 
 #include "colmap/estimators/triangulation.h"
+#include "colmap/geometry/triangulation.h"
 #include "colmap/scene/projection.h"
 #include "colmap/util/misc.h"
+#include "colmap/util/threading.h"
+#include "colmap/util/tracing.h"
 
 namespace colmap {
+namespace {
+
+typedef IncrementalTriangulator::CorrData CorrData;
+
+// Buffers to set up the triangulation of a new 3D point, which are reused
+// across points to avoid allocations for every observation.
+struct CreateScratch {
+  std::vector<size_t> create_idxs;
+  std::vector<TriangulationEstimator::PointData> point_data;
+  std::vector<TriangulationEstimator::PoseData> pose_data;
+  std::vector<char> inlier_mask;
+};
+
+// Estimate a new 3D point from the correspondences that are not yet
+// triangulated according to `is_triangulated(idx)`. On success, the inlier
+// correspondences are marked in `inlier_mask` and the number of employed
+// correspondences is returned. Otherwise, zero is returned. Only reads the
+// reconstruction, such that multiple points can be estimated concurrently.
+template <typename IsTriangulated>
+size_t EstimateNewPoint3D(const IncrementalTriangulator::Options& options,
+                          const CorrespondenceGraph& correspondence_graph,
+                          const CorrData* corrs_data,
+                          const size_t num_corrs,
+                          const IsTriangulated& is_triangulated,
+                          CreateScratch* scratch,
+                          char* inlier_mask,
+                          Eigen::Vector3d* xyz) {
+  // Extract correspondences without an existing triangulated observation.
+  std::vector<size_t>& create_idxs = scratch->create_idxs;
+  create_idxs.clear();
+  for (size_t idx = 0; idx < num_corrs; ++idx) {
+    if (!is_triangulated(idx)) {
+      create_idxs.push_back(idx);
+    }
+  }
+
+  if (create_idxs.size() < 2) {
+    // Need at least two observations for triangulation.
+    return 0;
+  } else if (options.ignore_two_view_tracks && create_idxs.size() == 2) {
+    const CorrData& corr_data1 = corrs_data[create_idxs[0]];
+    if (correspondence_graph.IsTwoViewObservation(corr_data1.image_id,
+                                                  corr_data1.point2D_idx)) {
+      return 0;
+    }
+  }
+
+  // Setup data for triangulation estimation.
+  std::vector<TriangulationEstimator::PointData>& point_data =
+      scratch->point_data;
+  point_data.resize(create_idxs.size());
+  std::vector<TriangulationEstimator::PoseData>& pose_data =
+      scratch->pose_data;
+  pose_data.resize(create_idxs.size());
+  for (size_t i = 0; i < create_idxs.size(); ++i) {
+    const CorrData& corr_data = corrs_data[create_idxs[i]];
+    if (!options.enable_refraction) {
+      // Non-refractive case.
+      point_data[i].point = corr_data.Point2DXY();
+      point_data[i].point_normalized =
+          corr_data.camera->CamFromImg(point_data[i].point);
+      pose_data[i].proj_matrix = corr_data.image->CamFromWorld().ToMatrix();
+      pose_data[i].proj_center = corr_data.image->ProjectionCenter();
+      pose_data[i].camera = corr_data.camera;
+    } else {
+      // Refractive case, where the point is triangulated from the refracted
+      // viewing rays in world frame.
+      const Ray3D ray =
+          corr_data.camera->CamFromImgRefrac(corr_data.Point2DXY());
+      const Rigid3d world_from_cam = Inverse(corr_data.image->CamFromWorld());
+      point_data[i].point = corr_data.Point2DXY();
+      point_data[i].ray_origin = world_from_cam * ray.ori;
+      point_data[i].ray_direction = world_from_cam.rotation * ray.dir;
+      pose_data[i].proj_matrix = corr_data.image->CamFromWorld().ToMatrix();
+      pose_data[i].proj_center = corr_data.image->ProjectionCenter();
+      pose_data[i].camera = corr_data.camera;
+    }
+  }
+
+  // Setup estimation options.
+  EstimateTriangulationOptions tri_options;
+  tri_options.min_tri_angle = DegToRad(options.min_angle);
+  tri_options.residual_type =
+      TriangulationEstimator::ResidualType::ANGULAR_ERROR;
+  tri_options.ransac_options.max_error =
+      DegToRad(options.create_max_angle_error);
+  tri_options.ransac_options.confidence = 0.9999;
+  tri_options.ransac_options.min_inlier_ratio = 0.02;
+  tri_options.ransac_options.max_num_trials = 10000;
+  tri_options.enable_refraction = options.enable_refraction;
+
+  // Enforce exhaustive sampling for small track lengths.
+  const size_t kExhaustiveSamplingThreshold = 15;
+  if (point_data.size() <= kExhaustiveSamplingThreshold) {
+    tri_options.ransac_options.min_num_trials = NChooseK(point_data.size(), 2);
+  }
+
+  // Estimate triangulation.
+  if (!EstimateTriangulation(
+          tri_options, point_data, pose_data, &scratch->inlier_mask, xyz)) {
+    return 0;
+  }
+
+  std::fill(inlier_mask, inlier_mask + num_corrs, false);
+  for (size_t i = 0; i < create_idxs.size(); ++i) {
+    inlier_mask[create_idxs[i]] = scratch->inlier_mask[i];
+  }
+
+  return create_idxs.size();
+}
+
+// Find the triangulated correspondence, whose 3D point has the smallest
+// angular error in the reference observation. Returns the index of the
+// correspondence or the maximum index, if no point is within the maximum
+// angular error for continuation.
+size_t FindContinuedPoint3D(const IncrementalTriangulator::Options& options,
+                            const Reconstruction& reconstruction,
+                            const CorrData& ref_corr_data,
+                            const CorrData* corrs_data,
+                            const size_t num_corrs) {
+  double best_angle_error = std::numeric_limits<double>::max();
+  size_t best_idx = std::numeric_limits<size_t>::max();
+
+  // The refracted viewing ray of the reference observation is the same for
+  // all candidate points.
+  Eigen::Vector3d ref_ray_origin;
+  Eigen::Vector3d ref_ray_direction;
+  if (options.enable_refraction) {
+    const Ray3D ray =
+        ref_corr_data.camera->CamFromImgRefrac(ref_corr_data.Point2DXY());
+    const Rigid3d world_from_cam = Inverse(ref_corr_data.image->CamFromWorld());
+    ref_ray_origin = world_from_cam * ray.ori;
+    ref_ray_direction = world_from_cam.rotation * ray.dir;
+  }
+
+  for (size_t idx = 0; idx < num_corrs; ++idx) {
+    const CorrData& corr_data = corrs_data[idx];
+    if (!corr_data.HasPoint3D()) {
+      continue;
+    }
+
+    const Point3D& point3D =
+        reconstruction.Point3D(corr_data.Point3DId());
+
+    double angle_error;
+    if (!options.enable_refraction) {
+      // Non-refractive case.
+      angle_error = CalculateAngularError(ref_corr_data.Point2DXY(),
+                                          point3D.xyz,
+                                          ref_corr_data.image->CamFromWorld(),
+                                          *ref_corr_data.camera);
+    } else {
+      // Refractive case, where the angular error is measured between the
+      // refracted viewing ray and the direction from its origin to the point.
+      angle_error = CalculateRayAngularError(
+          ref_ray_origin, ref_ray_direction, point3D.xyz);
+    }
+    if (angle_error < best_angle_error) {
+      best_angle_error = angle_error;
+      best_idx = idx;
+    }
+  }
+
+  const double max_angle_error = DegToRad(options.continue_max_angle_error);
+  if (best_angle_error <= max_angle_error) {
+    return best_idx;
+  }
+
+  return std::numeric_limits<size_t>::max();
+}
+
+// Find the observations that transitively correspond to the track of the 3D
+// point, are not yet triangulated, and have a small enough reprojection error
+// to complete the track, in the order in which they are found.
+template <typename HasCameraBogusParams>
+void FindTrackCompletions(const IncrementalTriangulator::Options& options,
+                          const Reconstruction& reconstruction,
+                          const CorrespondenceGraph& correspondence_graph,
+                          const point3D_t point3D_id,
+                          const HasCameraBogusParams& has_camera_bogus_params,
+                          std::vector<TrackElement>* completions) {
+  completions->clear();
+
+  const double max_squared_reproj_error =
+      options.complete_max_reproj_error * options.complete_max_reproj_error;
+
+  const Point3D& point3D = reconstruction.Point3D(point3D_id);
+
+  // Observations are only added once, even if they are found repeatedly.
+  const auto is_completed = [&](const image_t image_id,
+                                const point2D_t point2D_idx) {
+    return std::find_if(completions->begin(),
+                        completions->end(),
+                        [&](const TrackElement& track_el) {
+                          return track_el.image_id == image_id &&
+                                 track_el.point2D_idx == point2D_idx;
+                        }) != completions->end();
+  };
+
+  std::vector<TrackElement> queue = point3D.track.Elements();
+
+  const int max_transitivity = options.complete_max_transitivity;
+  for (int transitivity = 0; transitivity < max_transitivity; ++transitivity) {
+    if (queue.empty()) {
+      break;
+    }
+
+    const std::vector<TrackElement> prev_queue = queue;
+    queue.clear();
+
+    for (const TrackElement& queue_elem : prev_queue) {
+      const auto corr_range = correspondence_graph.FindCorrespondences(
+          queue_elem.image_id, queue_elem.point2D_idx);
+      for (const auto* corr = corr_range.beg; corr < corr_range.end; ++corr) {
+        const Image& image = reconstruction.Image(corr->image_id);
+        if (!image.IsRegistered()) {
+          continue;
+        }
+
+        const Point2D& point2D = image.Point2D(corr->point2D_idx);
+        if (point2D.HasPoint3D() ||
+            is_completed(corr->image_id, corr->point2D_idx)) {
+          continue;
+        }
+
+        const Camera& camera = reconstruction.Camera(image.CameraId());
+        if (has_camera_bogus_params(camera)) {
+          continue;
+        }
+
+        const double squared_reproj_error =
+            CalculateSquaredReprojectionError(point2D.xy,
+                                              point3D.xyz,
+                                              image.CamFromWorld(),
+                                              camera,
+                                              options.enable_refraction);
+
+        if (std::isnan(squared_reproj_error) ||
+            squared_reproj_error > max_squared_reproj_error) {
+          continue;
+        }
+
+        // Success, add observation to point track.
+        completions->emplace_back(corr->image_id, corr->point2D_idx);
+
+        // Recursively complete track for this new correspondence.
+        if (transitivity < max_transitivity - 1) {
+          queue.emplace_back(corr->image_id, corr->point2D_idx);
+        }
+      }
+    }
+  }
+}
+
+// Find the first 3D point corresponding to the track of the given 3D point,
+// such that all observations of the merged track are inliers. Candidates for
+// which `skip_candidate(id)` is true are not tried and `on_trial(id)` is called
+// for every tried candidate. Returns kInvalidPoint3DId, if no candidate can be
+// merged.
+template <typename SkipCandidate, typename OnTrial>
+point3D_t FindMergedPoint3D(const IncrementalTriangulator::Options& options,
+                            const Reconstruction& reconstruction,
+                            const CorrespondenceGraph& correspondence_graph,
+                            const point3D_t point3D_id,
+                            const SkipCandidate& skip_candidate,
+                            const OnTrial& on_trial) {
+  const double max_squared_reproj_error =
+      options.merge_max_reproj_error * options.merge_max_reproj_error;
+
+  const auto& point3D = reconstruction.Point3D(point3D_id);
+
+  for (const auto& track_el : point3D.track.Elements()) {
+    const auto corr_range = correspondence_graph.FindCorrespondences(
+        track_el.image_id, track_el.point2D_idx);
+    for (const auto* corr = corr_range.beg; corr < corr_range.end; ++corr) {
+      const auto& image = reconstruction.Image(corr->image_id);
+      if (!image.IsRegistered()) {
+        continue;
+      }
+
+      const Point2D& corr_point2D = image.Point2D(corr->point2D_idx);
+      if (!corr_point2D.HasPoint3D() || corr_point2D.point3D_id == point3D_id ||
+          skip_candidate(corr_point2D.point3D_id)) {
+        continue;
+      }
+
+      // Try to merge the two 3D points.
+
+      const Point3D& corr_point3D =
+          reconstruction.Point3D(corr_point2D.point3D_id);
+
+      on_trial(corr_point2D.point3D_id);
+
+      // Weighted average of point locations, depending on track length.
+      const Eigen::Vector3d merged_xyz =
+          (point3D.track.Length() * point3D.xyz +
+           corr_point3D.track.Length() * corr_point3D.xyz) /
+          (point3D.track.Length() + corr_point3D.track.Length());
+
+      // Count number of inlier track elements of the merged track.
+      bool merge_success = true;
+      for (const Track* track : {&point3D.track, &corr_point3D.track}) {
+        for (const auto test_track_el : track->Elements()) {
+          const Image& test_image =
+              reconstruction.Image(test_track_el.image_id);
+          const Camera& test_camera =
+              reconstruction.Camera(test_image.CameraId());
+          const Point2D& test_point2D =
+              test_image.Point2D(test_track_el.point2D_idx);
+          const double squared_reproj_error =
+              CalculateSquaredReprojectionError(test_point2D.xy,
+                                                merged_xyz,
+                                                test_image.CamFromWorld(),
+                                                test_camera,
+                                                options.enable_refraction);
+          if (std::isnan(squared_reproj_error) ||
+              squared_reproj_error > max_squared_reproj_error) {
+            merge_success = false;
+            break;
+          }
+        }
+        if (!merge_success) {
+          break;
+        }
+      }
+
+      // Only accept merge if all track elements are inliers.
+      if (merge_success) {
+        return corr_point2D.point3D_id;
+      }
+    }
+  }
+
+  return kInvalidPoint3DId;
+}
+
+}  // namespace
 
 bool IncrementalTriangulator::Options::Check() const {
   CHECK_OPTION_GE(max_transitivity, 0);
@@ -58,50 +398,87 @@ IncrementalTriangulator::IncrementalTriangulator(
 
 size_t IncrementalTriangulator::TriangulateImage(const Options& options,
                                                  const image_t image_id) {
+  COLMAP_TRACE_SCOPE("IncrementalTriangulator::TriangulateImage");
   CHECK(options.Check());
 
-  size_t num_tris = 0;
+  ClearCaches();
+
+  // Every observation of the image once becomes the reference correspondence.
+  std::vector<CorrData> ref_corrs_data;
+  AppendImageObservations(options, image_id, &ref_corrs_data);
+
+  return TriangulateObservations(options, ref_corrs_data);
+}
+
+size_t IncrementalTriangulator::TriangulateImages(
+    const Options& options, const std::vector<image_t>& image_ids) {
+  COLMAP_TRACE_SCOPE("IncrementalTriangulator::TriangulateImages");
+  CHECK(options.Check());
 
   ClearCaches();
 
+  // The images are partitioned into batches of roughly this many
+  // observations, which bounds the memory of the gathered correspondences.
+  const size_t kMaxNumBatchObservations = 1 << 18;
+
+  size_t num_tris = 0;
+  std::vector<CorrData> ref_corrs_data;
+  for (size_t i = 0; i < image_ids.size(); ++i) {
+    AppendImageObservations(options, image_ids[i], &ref_corrs_data);
+    if (ref_corrs_data.size() >= kMaxNumBatchObservations ||
+        i + 1 == image_ids.size()) {
+      num_tris += TriangulateObservations(options, ref_corrs_data);
+      ref_corrs_data.clear();
+    }
+  }
+
+  return num_tris;
+}
+
+void IncrementalTriangulator::AppendImageObservations(
+    const Options& options,
+    const image_t image_id,
+    std::vector<CorrData>* ref_corrs_data) {
   const Image& image = reconstruction_->Image(image_id);
   if (!image.IsRegistered()) {
-    return num_tris;
+    return;
   }
 
   const Camera& camera = reconstruction_->Camera(image.CameraId());
   if (HasCameraBogusParams(options, camera)) {
-    return num_tris;
+    return;
   }
 
-  // Correspondence data for reference observation in given image. We iterate
-  // over all observations of the image and each observation once becomes
-  // the reference correspondence.
   CorrData ref_corr_data;
   ref_corr_data.image_id = image_id;
   ref_corr_data.image = &image;
   ref_corr_data.camera = &camera;
+  ref_corrs_data->reserve(ref_corrs_data->size() + image.NumPoints2D());
+  for (point2D_t point2D_idx = 0; point2D_idx < image.NumPoints2D();
+       ++point2D_idx) {
+    ref_corr_data.point2D_idx = point2D_idx;
+    ref_corrs_data->push_back(ref_corr_data);
+  }
+}
+
+size_t IncrementalTriangulator::TriangulateObservations(
+    const Options& options, const std::vector<CorrData>& ref_corrs_data) {
+  size_t num_tris = 0;
 
   // Container for correspondences from reference observation to other images.
   std::vector<CorrData> corrs_data;
 
-  // Try to triangulate all image observations.
-  for (point2D_t point2D_idx = 0; point2D_idx < image.NumPoints2D();
-       ++point2D_idx) {
+  const auto triangulate_point2D = [&](const CorrData& ref_corr_data) {
     const size_t num_triangulated =
         Find(options,
-             image_id,
-             point2D_idx,
+             ref_corr_data.image_id,
+             ref_corr_data.point2D_idx,
              static_cast<size_t>(options.max_transitivity),
              &corrs_data);
     if (corrs_data.empty()) {
-      continue;
+      return;
     }
 
-    const Point2D& point2D = image.Point2D(point2D_idx);
-    ref_corr_data.point2D_idx = point2D_idx;
-    ref_corr_data.point2D = &point2D;
-
     if (num_triangulated == 0) {
       corrs_data.push_back(ref_corr_data);
       num_tris += Create(options, corrs_data);
@@ -112,6 +489,140 @@ size_t IncrementalTriangulator::TriangulateImage(const Options& options,
       corrs_data.push_back(ref_corr_data);
       num_tris += Create(options, corrs_data);
     }
+  };
+
+  const int num_threads = GetEffectiveNumThreads(options.num_threads);
+  if (num_threads == 1) {
+    // Try to triangulate all observations.
+    for (const CorrData& ref_corr_data : ref_corrs_data) {
+      triangulate_point2D(ref_corr_data);
+    }
+    return num_tris;
+  }
+
+  // Gather the correspondences of all observations into contiguous arrays.
+  // The correspondences of the i-th observation are in the range
+  // [corrs_offsets[i], corrs_offsets[i + 1]) and end with the reference
+  // correspondence. Their triangulation state is recorded, such that
+  // triangulations made by previous observations can be detected.
+  std::vector<size_t> ref_idxs;
+  ref_idxs.reserve(ref_corrs_data.size());
+  std::vector<size_t> corrs_offsets;
+  corrs_offsets.reserve(ref_corrs_data.size() + 1);
+  corrs_offsets.push_back(0);
+  std::vector<size_t> nums_triangulated;
+  nums_triangulated.reserve(ref_corrs_data.size());
+  std::vector<CorrData> batch_corrs_data;
+  std::vector<char> batch_corrs_triangulated;
+  for (size_t ref_idx = 0; ref_idx < ref_corrs_data.size(); ++ref_idx) {
+    const CorrData& ref_corr_data = ref_corrs_data[ref_idx];
+    const size_t num_triangulated =
+        Find(options,
+             ref_corr_data.image_id,
+             ref_corr_data.point2D_idx,
+             static_cast<size_t>(options.max_transitivity),
+             &corrs_data);
+    if (corrs_data.empty()) {
+      continue;
+    }
+
+    corrs_data.push_back(ref_corr_data);
+
+    ref_idxs.push_back(ref_idx);
+    nums_triangulated.push_back(num_triangulated);
+    batch_corrs_data.insert(
+        batch_corrs_data.end(), corrs_data.begin(), corrs_data.end());
+    for (const CorrData& corr_data : corrs_data) {
+      batch_corrs_triangulated.push_back(corr_data.HasPoint3D());
+    }
+    corrs_offsets.push_back(batch_corrs_data.size());
+  }
+
+  // Estimate the continued and created 3D points of all observations in
+  // parallel, assuming that no other observation modifies their tracks.
+  const size_t num_points2D = ref_idxs.size();
+  std::vector<size_t> continue_idxs(num_points2D,
+                                    std::numeric_limits<size_t>::max());
+  std::vector<size_t> nums_create_corrs(num_points2D, 0);
+  std::vector<Eigen::Vector3d> created_xyzs(num_points2D);
+  std::vector<char> batch_inlier_mask(batch_corrs_data.size(), false);
+
+  ThreadPool thread_pool(num_threads);
+  std::vector<CreateScratch> scratches(thread_pool.NumThreads());
+
+  const int64_t kGrainSize = 32;
+  thread_pool.ParallelFor(0, num_points2D, kGrainSize, [&](const int64_t i) {
+    const size_t corrs_offset = corrs_offsets[i];
+    const size_t num_corrs = corrs_offsets[i + 1] - corrs_offset;
+    const CorrData* point_corrs_data = batch_corrs_data.data() + corrs_offset;
+    const char* corrs_triangulated =
+        batch_corrs_triangulated.data() + corrs_offset;
+    const size_t ref_idx = num_corrs - 1;
+
+    if (nums_triangulated[i] > 0 && !corrs_triangulated[ref_idx]) {
+      continue_idxs[i] = FindContinuedPoint3D(options,
+                                              *reconstruction_,
+                                              point_corrs_data[ref_idx],
+                                              point_corrs_data,
+                                              ref_idx);
+    }
+
+    const bool ref_continued =
+        continue_idxs[i] != std::numeric_limits<size_t>::max();
+    nums_create_corrs[i] = EstimateNewPoint3D(
+        options,
+        *correspondence_graph_,
+        point_corrs_data,
+        num_corrs,
+        [&](const size_t idx) {
+          return corrs_triangulated[idx] || (ref_continued && idx == ref_idx);
+        },
+        &scratches[thread_pool.GetThreadIndex()],
+        batch_inlier_mask.data() + corrs_offset,
+        &created_xyzs[i]);
+  });
+
+  // Apply the estimates in the order of the observations. If previous
+  // observations triangulated any of the correspondences, the estimate is
+  // outdated and the observation is triangulated anew.
+  for (size_t i = 0; i < num_points2D; ++i) {
+    const size_t corrs_offset = corrs_offsets[i];
+    const size_t num_corrs = corrs_offsets[i + 1] - corrs_offset;
+    const CorrData* point_corrs_data = batch_corrs_data.data() + corrs_offset;
+
+    bool outdated = false;
+    for (size_t idx = 0; idx < num_corrs; ++idx) {
+      if (point_corrs_data[idx].HasPoint3D() !=
+          static_cast<bool>(batch_corrs_triangulated[corrs_offset + idx])) {
+        outdated = true;
+        break;
+      }
+    }
+
+    if (outdated) {
+      triangulate_point2D(ref_corrs_data[ref_idxs[i]]);
+      continue;
+    }
+
+    if (continue_idxs[i] != std::numeric_limits<size_t>::max()) {
+      const CorrData& point_ref_corr_data = point_corrs_data[num_corrs - 1];
+      const CorrData& corr_data = point_corrs_data[continue_idxs[i]];
+      const TrackElement track_el(point_ref_corr_data.image_id,
+                                  point_ref_corr_data.point2D_idx);
+      reconstruction_->AddObservation(corr_data.Point3DId(), track_el);
+      modified_point3D_ids_.insert(corr_data.Point3DId());
+      num_tris += 1;
+    }
+
+    if (nums_create_corrs[i] > 0) {
+      num_tris +=
+          AddCreatedPoint3D(options,
+                            point_corrs_data,
+                            num_corrs,
+                            batch_inlier_mask.data() + corrs_offset,
+                            nums_create_corrs[i],
+                            created_xyzs[i]);
+    }
   }
 
   return num_tris;
@@ -119,6 +630,7 @@ size_t IncrementalTriangulator::TriangulateImage(const Options& options,
 
 size_t IncrementalTriangulator::CompleteImage(const Options& options,
                                               const image_t image_id) {
+  COLMAP_TRACE_SCOPE("IncrementalTriangulator::CompleteImage");
   CHECK(options.Check());
 
   size_t num_tris = 0;
@@ -144,6 +656,7 @@ size_t IncrementalTriangulator::CompleteImage(const Options& options,
   tri_options.ransac_options.confidence = 0.9999;
   tri_options.ransac_options.min_inlier_ratio = 0.02;
   tri_options.ransac_options.max_num_trials = 10000;
+  tri_options.enable_refraction = options.enable_refraction;
 
   // Correspondence data for reference observation in given image. We iterate
   // over all observations of the image and each observation once becomes
@@ -180,7 +693,6 @@ size_t IncrementalTriangulator::CompleteImage(const Options& options,
       continue;
     }
 
-    ref_corr_data.point2D = &point2D;
     ref_corr_data.point2D_idx = point2D_idx;
     corrs_data.push_back(ref_corr_data);
 
@@ -189,34 +701,29 @@ size_t IncrementalTriangulator::CompleteImage(const Options& options,
     point_data.resize(corrs_data.size());
     std::vector<TriangulationEstimator::PoseData> pose_data;
     pose_data.resize(corrs_data.size());
-    std::vector<Camera> virtual_cameras;
-    virtual_cameras.resize(corrs_data.size());
     for (size_t i = 0; i < corrs_data.size(); ++i) {
       const CorrData& corr_data = corrs_data[i];
       if (!options.enable_refraction) {
         // Non-refractive case.
-        point_data[i].point = corr_data.point2D->xy;
+        point_data[i].point = corr_data.Point2DXY();
         point_data[i].point_normalized =
             corr_data.camera->CamFromImg(point_data[i].point);
         pose_data[i].proj_matrix = corr_data.image->CamFromWorld().ToMatrix();
         pose_data[i].proj_center = corr_data.image->ProjectionCenter();
         pose_data[i].camera = corr_data.camera;
       } else {
-        // Refractive case.
-        Rigid3d virtual_from_real;
-        corr_data.camera->ComputeVirtual(
-            corr_data.point2D->xy, virtual_cameras[i], virtual_from_real);
-        point_data[i].point = corr_data.point2D->xy;
-        point_data[i].point_normalized =
-            virtual_cameras[i].CamFromImg(point_data[i].point);
-
-        const Rigid3d virtual_from_world =
-            virtual_from_real * corr_data.image->CamFromWorld();
-        pose_data[i].proj_matrix = virtual_from_world.ToMatrix();
-        pose_data[i].proj_center = virtual_from_world.rotation.inverse() *
-                                   -virtual_from_world.translation;
-
-        pose_data[i].camera = &virtual_cameras[i];
+        // Refractive case, where the point is triangulated from the refracted
+        // viewing rays in world frame.
+        const Ray3D ray = corr_data.camera->CamFromImgRefrac(
+            corr_data.Point2DXY());
+        const Rigid3d world_from_cam =
+            Inverse(corr_data.image->CamFromWorld());
+        point_data[i].point = corr_data.Point2DXY();
+        point_data[i].ray_origin = world_from_cam * ray.ori;
+        point_data[i].ray_direction = world_from_cam.rotation * ray.dir;
+        pose_data[i].proj_matrix = corr_data.image->CamFromWorld().ToMatrix();
+        pose_data[i].proj_center = corr_data.image->ProjectionCenter();
+        pose_data[i].camera = corr_data.camera;
       }
     }
 
@@ -256,63 +763,178 @@ size_t IncrementalTriangulator::CompleteImage(const Options& options,
 
 size_t IncrementalTriangulator::CompleteTracks(
     const Options& options, const std::unordered_set<point3D_t>& point3D_ids) {
+  COLMAP_TRACE_SCOPE("IncrementalTriangulator::CompleteTracks");
   CHECK(options.Check());
 
   size_t num_completed = 0;
 
   ClearCaches();
 
-  for (const point3D_t point3D_id : point3D_ids) {
-    num_completed += Complete(options, point3D_id);
+  const int num_threads = GetEffectiveNumThreads(options.num_threads);
+  if (num_threads == 1) {
+    for (const point3D_t point3D_id : point3D_ids) {
+      num_completed += Complete(options, point3D_id);
+    }
+    return num_completed;
   }
 
-  return num_completed;
-}
-
-size_t IncrementalTriangulator::CompleteAllTracks(const Options& options) {
-  CHECK(options.Check());
+  // The bogus camera parameters are cached up front, such that the cache is
+  // only read concurrently.
+  for (const auto& camera : reconstruction_->Cameras()) {
+    HasCameraBogusParams(options, camera.second);
+  }
 
-  size_t num_completed = 0;
+  // Find the completions of all tracks in parallel. Tracks only compete for
+  // the same observations, which are claimed in the order of the serial
+  // version below.
+  const std::vector<point3D_t> ordered_point3D_ids(point3D_ids.begin(),
+                                                   point3D_ids.end());
+  std::vector<std::vector<TrackElement>> completions(
+      ordered_point3D_ids.size());
+
+  ThreadPool thread_pool(num_threads);
+  const int64_t kGrainSize = 256;
+  thread_pool.ParallelFor(
+      0, ordered_point3D_ids.size(), kGrainSize, [&](const int64_t i) {
+        if (!reconstruction_->ExistsPoint3D(ordered_point3D_ids[i])) {
+          return;
+        }
+        FindTrackCompletions(
+            options,
+            *reconstruction_,
+            *correspondence_graph_,
+            ordered_point3D_ids[i],
+            [&](const Camera& camera) {
+              return camera_has_bogus_params_.at(camera.camera_id);
+            },
+            &completions[i]);
+      });
+
+  // If a previous track claimed any of the observations, the track is
+  // completed anew, as its remaining completions may differ.
+  for (size_t i = 0; i < ordered_point3D_ids.size(); ++i) {
+    const point3D_t point3D_id = ordered_point3D_ids[i];
+    bool claimed = false;
+    for (const TrackElement& track_el : completions[i]) {
+      if (reconstruction_->Image(track_el.image_id)
+              .Point2D(track_el.point2D_idx)
+              .HasPoint3D()) {
+        claimed = true;
+        break;
+      }
+    }
 
-  ClearCaches();
+    if (claimed) {
+      num_completed += Complete(options, point3D_id);
+      continue;
+    }
 
-  for (const point3D_t point3D_id : reconstruction_->Point3DIds()) {
-    num_completed += Complete(options, point3D_id);
+    for (const TrackElement& track_el : completions[i]) {
+      reconstruction_->AddObservation(point3D_id, track_el);
+      modified_point3D_ids_.insert(point3D_id);
+    }
+    num_completed += completions[i].size();
   }
 
   return num_completed;
 }
 
+size_t IncrementalTriangulator::CompleteAllTracks(const Options& options) {
+  COLMAP_TRACE_SCOPE("IncrementalTriangulator::CompleteAllTracks");
+  return CompleteTracks(options, reconstruction_->Point3DIds());
+}
+
 size_t IncrementalTriangulator::MergeTracks(
     const Options& options, const std::unordered_set<point3D_t>& point3D_ids) {
+  COLMAP_TRACE_SCOPE("IncrementalTriangulator::MergeTracks");
   CHECK(options.Check());
 
   size_t num_merged = 0;
 
   ClearCaches();
 
-  for (const point3D_t point3D_id : point3D_ids) {
-    num_merged += Merge(options, point3D_id);
+  const int num_threads = GetEffectiveNumThreads(options.num_threads);
+  if (num_threads == 1) {
+    for (const point3D_t point3D_id : point3D_ids) {
+      num_merged += Merge(options, point3D_id);
+    }
+    return num_merged;
   }
 
-  return num_merged;
-}
+  // Find the merge candidate of all points in parallel, trying all
+  // candidates in the same order as the serial version.
+  const std::vector<point3D_t> ordered_point3D_ids(point3D_ids.begin(),
+                                                   point3D_ids.end());
+  std::vector<point3D_t> merged_point3D_ids(ordered_point3D_ids.size(),
+                                            kInvalidPoint3DId);
+  std::vector<std::vector<point3D_t>> tried_point3D_ids(
+      ordered_point3D_ids.size());
+
+  ThreadPool thread_pool(num_threads);
+  const int64_t kGrainSize = 256;
+  thread_pool.ParallelFor(
+      0, ordered_point3D_ids.size(), kGrainSize, [&](const int64_t i) {
+        if (!reconstruction_->ExistsPoint3D(ordered_point3D_ids[i])) {
+          return;
+        }
+        merged_point3D_ids[i] = FindMergedPoint3D(
+            options,
+            *reconstruction_,
+            *correspondence_graph_,
+            ordered_point3D_ids[i],
+            [&](const point3D_t corr_point3D_id) {
+              return std::find(tried_point3D_ids[i].begin(),
+                               tried_point3D_ids[i].end(),
+                               corr_point3D_id) != tried_point3D_ids[i].end();
+            },
+            [&](const point3D_t corr_point3D_id) {
+              tried_point3D_ids[i].push_back(corr_point3D_id);
+            });
+      });
+
+  // Merges delete both points and only affect the points, whose tracks
+  // correspond to any of them. If a previous merge deleted any of the tried
+  // candidates, the point is merged anew.
+  for (size_t i = 0; i < ordered_point3D_ids.size(); ++i) {
+    const point3D_t point3D_id = ordered_point3D_ids[i];
+    if (!reconstruction_->ExistsPoint3D(point3D_id)) {
+      continue;
+    }
 
-size_t IncrementalTriangulator::MergeAllTracks(const Options& options) {
-  CHECK(options.Check());
+    bool outdated = false;
+    for (const point3D_t corr_point3D_id : tried_point3D_ids[i]) {
+      if (!reconstruction_->ExistsPoint3D(corr_point3D_id)) {
+        outdated = true;
+        break;
+      }
+    }
 
-  size_t num_merged = 0;
+    if (outdated) {
+      num_merged += Merge(options, point3D_id);
+      continue;
+    }
 
-  ClearCaches();
+    for (const point3D_t corr_point3D_id : tried_point3D_ids[i]) {
+      merge_trials_[point3D_id].insert(corr_point3D_id);
+      merge_trials_[corr_point3D_id].insert(point3D_id);
+    }
 
-  for (const point3D_t point3D_id : reconstruction_->Point3DIds()) {
-    num_merged += Merge(options, point3D_id);
+    if (merged_point3D_ids[i] != kInvalidPoint3DId) {
+      num_merged +=
+          MergePoint3DPair(options, point3D_id, merged_point3D_ids[i]);
+    }
   }
 
   return num_merged;
 }
 
+size_t IncrementalTriangulator::MergeAllTracks(const Options& options) {
+  COLMAP_TRACE_SCOPE("IncrementalTriangulator::MergeAllTracks");
+  return MergeTracks(options, reconstruction_->Point3DIds());
+}
+
 size_t IncrementalTriangulator::Retriangulate(const Options& options) {
+  COLMAP_TRACE_SCOPE("IncrementalTriangulator::Retriangulate");
   CHECK(options.Check());
 
   size_t num_tris = 0;
@@ -386,14 +1008,12 @@ size_t IncrementalTriangulator::Retriangulate(const Options& options) {
       corr_data1.point2D_idx = corr.point2D_idx1;
       corr_data1.image = &image1;
       corr_data1.camera = &camera1;
-      corr_data1.point2D = &point2D1;
 
       CorrData corr_data2;
       corr_data2.image_id = image_id2;
       corr_data2.point2D_idx = corr.point2D_idx2;
       corr_data2.image = &image2;
       corr_data2.camera = &camera2;
-      corr_data2.point2D = &point2D2;
 
       if (point2D1.HasPoint3D() && !point2D2.HasPoint3D()) {
         const std::vector<CorrData> corrs_data1 = {corr_data1};
@@ -472,11 +1092,10 @@ size_t IncrementalTriangulator::Find(const Options& options,
     corr_data.point2D_idx = corr.point2D_idx;
     corr_data.image = &corr_image;
     corr_data.camera = &corr_camera;
-    corr_data.point2D = &corr_image.Point2D(corr.point2D_idx);
 
     corrs_data->push_back(corr_data);
 
-    if (corr_data.point2D->HasPoint3D()) {
+    if (corr_data.HasPoint3D()) {
       num_triangulated += 1;
     }
   }
@@ -486,92 +1105,43 @@ size_t IncrementalTriangulator::Find(const Options& options,
 
 size_t IncrementalTriangulator::Create(
     const Options& options, const std::vector<CorrData>& corrs_data) {
-  // Extract correspondences without an existing triangulated observation.
-  std::vector<CorrData> create_corrs_data;
-  create_corrs_data.reserve(corrs_data.size());
-  for (const CorrData& corr_data : corrs_data) {
-    if (!corr_data.point2D->HasPoint3D()) {
-      create_corrs_data.push_back(corr_data);
-    }
-  }
-
-  if (create_corrs_data.size() < 2) {
-    // Need at least two observations for triangulation.
-    return 0;
-  } else if (options.ignore_two_view_tracks && create_corrs_data.size() == 2) {
-    const CorrData& corr_data1 = create_corrs_data[0];
-    if (correspondence_graph_->IsTwoViewObservation(corr_data1.image_id,
-                                                    corr_data1.point2D_idx)) {
-      return 0;
-    }
-  }
-
-  // Setup data for triangulation estimation.
-  std::vector<TriangulationEstimator::PointData> point_data;
-  point_data.resize(create_corrs_data.size());
-  std::vector<TriangulationEstimator::PoseData> pose_data;
-  pose_data.resize(create_corrs_data.size());
-  std::vector<Camera> virtual_cameras;
-  virtual_cameras.resize(create_corrs_data.size());
-  for (size_t i = 0; i < create_corrs_data.size(); ++i) {
-    const CorrData& corr_data = create_corrs_data[i];
-    if (!options.enable_refraction) {
-      // Non-refractive case.
-      point_data[i].point = corr_data.point2D->xy;
-      point_data[i].point_normalized =
-          corr_data.camera->CamFromImg(point_data[i].point);
-      pose_data[i].proj_matrix = corr_data.image->CamFromWorld().ToMatrix();
-      pose_data[i].proj_center = corr_data.image->ProjectionCenter();
-      pose_data[i].camera = corr_data.camera;
-    } else {
-      // Refractive case.
-      Rigid3d virtual_from_real;
-      corr_data.camera->ComputeVirtual(
-          corr_data.point2D->xy, virtual_cameras[i], virtual_from_real);
-      point_data[i].point = corr_data.point2D->xy;
-      point_data[i].point_normalized =
-          virtual_cameras[i].CamFromImg(point_data[i].point);
-
-      const Rigid3d virtual_from_world =
-          virtual_from_real * corr_data.image->CamFromWorld();
-      pose_data[i].proj_matrix = virtual_from_world.ToMatrix();
-      pose_data[i].proj_center = virtual_from_world.rotation.inverse() *
-                                 -virtual_from_world.translation;
-      pose_data[i].camera = &virtual_cameras[i];
-    }
-  }
-
-  // Setup estimation options.
-  EstimateTriangulationOptions tri_options;
-  tri_options.min_tri_angle = DegToRad(options.min_angle);
-  tri_options.residual_type =
-      TriangulationEstimator::ResidualType::ANGULAR_ERROR;
-  tri_options.ransac_options.max_error =
-      DegToRad(options.create_max_angle_error);
-  tri_options.ransac_options.confidence = 0.9999;
-  tri_options.ransac_options.min_inlier_ratio = 0.02;
-  tri_options.ransac_options.max_num_trials = 10000;
-
-  // Enforce exhaustive sampling for small track lengths.
-  const size_t kExhaustiveSamplingThreshold = 15;
-  if (point_data.size() <= kExhaustiveSamplingThreshold) {
-    tri_options.ransac_options.min_num_trials = NChooseK(point_data.size(), 2);
-  }
-
-  // Estimate triangulation.
+  CreateScratch scratch;
+  std::vector<char> inlier_mask(corrs_data.size());
   Eigen::Vector3d xyz;
-  std::vector<char> inlier_mask;
-  if (!EstimateTriangulation(
-          tri_options, point_data, pose_data, &inlier_mask, &xyz)) {
+  const size_t num_create_corrs = EstimateNewPoint3D(
+      options,
+      *correspondence_graph_,
+      corrs_data.data(),
+      corrs_data.size(),
+      [&](const size_t idx) { return corrs_data[idx].HasPoint3D(); },
+      &scratch,
+      inlier_mask.data(),
+      &xyz);
+  if (num_create_corrs == 0) {
     return 0;
   }
 
+  return AddCreatedPoint3D(options,
+                           corrs_data.data(),
+                           corrs_data.size(),
+                           inlier_mask.data(),
+                           num_create_corrs,
+                           xyz);
+}
+
+size_t IncrementalTriangulator::AddCreatedPoint3D(
+    const Options& options,
+    const CorrData* corrs_data,
+    const size_t num_corrs,
+    const char* inlier_mask,
+    const size_t num_create_corrs,
+    const Eigen::Vector3d& xyz) {
   // Add inliers to estimated track.
   Track track;
-  track.Reserve(create_corrs_data.size());
-  for (size_t i = 0; i < inlier_mask.size(); ++i) {
+  track.Reserve(num_create_corrs);
+  for (size_t i = 0; i < num_corrs; ++i) {
     if (inlier_mask[i]) {
-      const CorrData& corr_data = create_corrs_data[i];
+      const CorrData& corr_data = corrs_data[i];
       track.AddElement(corr_data.image_id, corr_data.point2D_idx);
     }
   }
@@ -582,9 +1152,13 @@ size_t IncrementalTriangulator::Create(
       reconstruction_->AddPoint3D(xyz, std::move(track));
   modified_point3D_ids_.insert(point3D_id);
 
+  // Try to create further points from the correspondences that are still
+  // not triangulated.
   const size_t kMinRecursiveTrackLength = 3;
-  if (create_corrs_data.size() - track_length >= kMinRecursiveTrackLength) {
-    return track_length + Create(options, create_corrs_data);
+  if (num_create_corrs - track_length >= kMinRecursiveTrackLength) {
+    return track_length +
+           Create(options,
+                  std::vector<CorrData>(corrs_data, corrs_data + num_corrs));
   }
 
   return track_length;
@@ -595,56 +1169,21 @@ size_t IncrementalTriangulator::Continue(
     const CorrData& ref_corr_data,
     const std::vector<CorrData>& corrs_data) {
   // No need to continue, if the reference observation is triangulated.
-  if (ref_corr_data.point2D->HasPoint3D()) {
+  if (ref_corr_data.HasPoint3D()) {
     return 0;
   }
 
-  double best_angle_error = std::numeric_limits<double>::max();
-  size_t best_idx = std::numeric_limits<size_t>::max();
-
-  for (size_t idx = 0; idx < corrs_data.size(); ++idx) {
-    const CorrData& corr_data = corrs_data[idx];
-    if (!corr_data.point2D->HasPoint3D()) {
-      continue;
-    }
-
-    const Point3D& point3D =
-        reconstruction_->Point3D(corr_data.point2D->point3D_id);
-
-    double angle_error;
-    if (!options.enable_refraction) {
-      // Non-refractive case.
-      angle_error = CalculateAngularError(ref_corr_data.point2D->xy,
-                                          point3D.xyz,
-                                          ref_corr_data.image->CamFromWorld(),
-                                          *ref_corr_data.camera);
-    } else {
-      // Refractive case.
-      Camera virtual_camera;
-      Rigid3d virtual_from_real;
-      ref_corr_data.camera->ComputeVirtual(
-          ref_corr_data.point2D->xy, virtual_camera, virtual_from_real);
-      const Rigid3d virtual_from_world =
-          virtual_from_real * ref_corr_data.image->CamFromWorld();
-      angle_error = CalculateAngularError(ref_corr_data.point2D->xy,
-                                          point3D.xyz,
-                                          virtual_from_world,
-                                          virtual_camera);
-    }
-    if (angle_error < best_angle_error) {
-      best_angle_error = angle_error;
-      best_idx = idx;
-    }
-  }
-
-  const double max_angle_error = DegToRad(options.continue_max_angle_error);
-  if (best_angle_error <= max_angle_error &&
-      best_idx != std::numeric_limits<size_t>::max()) {
+  const size_t best_idx = FindContinuedPoint3D(options,
+                                               *reconstruction_,
+                                               ref_corr_data,
+                                               corrs_data.data(),
+                                               corrs_data.size());
+  if (best_idx != std::numeric_limits<size_t>::max()) {
     const CorrData& corr_data = corrs_data[best_idx];
     const TrackElement track_el(ref_corr_data.image_id,
                                 ref_corr_data.point2D_idx);
-    reconstruction_->AddObservation(corr_data.point2D->point3D_id, track_el);
-    modified_point3D_ids_.insert(corr_data.point2D->point3D_id);
+    reconstruction_->AddObservation(corr_data.Point3DId(), track_el);
+    modified_point3D_ids_.insert(corr_data.Point3DId());
     return 1;
   }
 
@@ -657,165 +1196,72 @@ size_t IncrementalTriangulator::Merge(const Options& options,
     return 0;
   }
 
-  const double max_squared_reproj_error =
-      options.merge_max_reproj_error * options.merge_max_reproj_error;
-
-  const auto& point3D = reconstruction_->Point3D(point3D_id);
-
-  for (const auto& track_el : point3D.track.Elements()) {
-    const auto corr_range = correspondence_graph_->FindCorrespondences(
-        track_el.image_id, track_el.point2D_idx);
-    for (const auto* corr = corr_range.beg; corr < corr_range.end; ++corr) {
-      const auto& image = reconstruction_->Image(corr->image_id);
-      if (!image.IsRegistered()) {
-        continue;
-      }
-
-      const Point2D& corr_point2D = image.Point2D(corr->point2D_idx);
-      if (!corr_point2D.HasPoint3D() || corr_point2D.point3D_id == point3D_id ||
-          merge_trials_[point3D_id].count(corr_point2D.point3D_id) > 0) {
-        continue;
-      }
-
-      // Try to merge the two 3D points.
-
-      const Point3D& corr_point3D =
-          reconstruction_->Point3D(corr_point2D.point3D_id);
-
-      merge_trials_[point3D_id].insert(corr_point2D.point3D_id);
-      merge_trials_[corr_point2D.point3D_id].insert(point3D_id);
-
-      // Weighted average of point locations, depending on track length.
-      const Eigen::Vector3d merged_xyz =
-          (point3D.track.Length() * point3D.xyz +
-           corr_point3D.track.Length() * corr_point3D.xyz) /
-          (point3D.track.Length() + corr_point3D.track.Length());
+  const point3D_t corr_point3D_id = FindMergedPoint3D(
+      options,
+      *reconstruction_,
+      *correspondence_graph_,
+      point3D_id,
+      [&](const point3D_t corr_point3D_id) {
+        return merge_trials_[point3D_id].count(corr_point3D_id) > 0;
+      },
+      [&](const point3D_t corr_point3D_id) {
+        merge_trials_[point3D_id].insert(corr_point3D_id);
+        merge_trials_[corr_point3D_id].insert(point3D_id);
+      });
+  if (corr_point3D_id == kInvalidPoint3DId) {
+    return 0;
+  }
 
-      // Count number of inlier track elements of the merged track.
-      bool merge_success = true;
-      for (const Track* track : {&point3D.track, &corr_point3D.track}) {
-        for (const auto test_track_el : track->Elements()) {
-          const Image& test_image =
-              reconstruction_->Image(test_track_el.image_id);
-          const Camera& test_camera =
-              reconstruction_->Camera(test_image.CameraId());
-          const Point2D& test_point2D =
-              test_image.Point2D(test_track_el.point2D_idx);
-          const double squared_reproj_error =
-              CalculateSquaredReprojectionError(test_point2D.xy,
-                                                merged_xyz,
-                                                test_image.CamFromWorld(),
-                                                test_camera,
-                                                options.enable_refraction);
-          if (std::isnan(squared_reproj_error) ||
-              squared_reproj_error > max_squared_reproj_error) {
-            merge_success = false;
-            break;
-          }
-        }
-        if (!merge_success) {
-          break;
-        }
-      }
+  return MergePoint3DPair(options, point3D_id, corr_point3D_id);
+}
 
-      // Only accept merge if all track elements are inliers.
-      if (merge_success) {
-        const size_t num_merged =
-            point3D.track.Length() + corr_point3D.track.Length();
-
-        const point3D_t merged_point3D_id =
-            reconstruction_->MergePoints3D(point3D_id, corr_point2D.point3D_id);
-
-        modified_point3D_ids_.erase(point3D_id);
-        modified_point3D_ids_.erase(corr_point2D.point3D_id);
-        modified_point3D_ids_.insert(merged_point3D_id);
-
-        // Merge merged 3D point and return, as the original points are
-        // deleted.
-        const size_t num_merged_recursive = Merge(options, merged_point3D_id);
-        if (num_merged_recursive > 0) {
-          return num_merged_recursive;
-        } else {
-          return num_merged;
-        }
-      }
-    }
+size_t IncrementalTriangulator::MergePoint3DPair(
+    const Options& options,
+    const point3D_t point3D_id1,
+    const point3D_t point3D_id2) {
+  const size_t num_merged =
+      reconstruction_->Point3D(point3D_id1).track.Length() +
+      reconstruction_->Point3D(point3D_id2).track.Length();
+
+  const point3D_t merged_point3D_id =
+      reconstruction_->MergePoints3D(point3D_id1, point3D_id2);
+
+  modified_point3D_ids_.erase(point3D_id1);
+  modified_point3D_ids_.erase(point3D_id2);
+  modified_point3D_ids_.insert(merged_point3D_id);
+
+  // Merge merged 3D point and return, as the original points are deleted.
+  const size_t num_merged_recursive = Merge(options, merged_point3D_id);
+  if (num_merged_recursive > 0) {
+    return num_merged_recursive;
+  } else {
+    return num_merged;
   }
-
-  return 0;
 }
 
 size_t IncrementalTriangulator::Complete(const Options& options,
                                          const point3D_t point3D_id) {
-  size_t num_completed = 0;
-
   if (!reconstruction_->ExistsPoint3D(point3D_id)) {
-    return num_completed;
+    return 0;
   }
 
-  const double max_squared_reproj_error =
-      options.complete_max_reproj_error * options.complete_max_reproj_error;
-
-  const Point3D& point3D = reconstruction_->Point3D(point3D_id);
-
-  std::vector<TrackElement> queue = point3D.track.Elements();
-
-  const int max_transitivity = options.complete_max_transitivity;
-  for (int transitivity = 0; transitivity < max_transitivity; ++transitivity) {
-    if (queue.empty()) {
-      break;
-    }
-
-    const std::vector<TrackElement> prev_queue = queue;
-    queue.clear();
-
-    for (const TrackElement& queue_elem : prev_queue) {
-      const auto corr_range = correspondence_graph_->FindCorrespondences(
-          queue_elem.image_id, queue_elem.point2D_idx);
-      for (const auto* corr = corr_range.beg; corr < corr_range.end; ++corr) {
-        const Image& image = reconstruction_->Image(corr->image_id);
-        if (!image.IsRegistered()) {
-          continue;
-        }
-
-        const Point2D& point2D = image.Point2D(corr->point2D_idx);
-        if (point2D.HasPoint3D()) {
-          continue;
-        }
-
-        const Camera& camera = reconstruction_->Camera(image.CameraId());
-        if (HasCameraBogusParams(options, camera)) {
-          continue;
-        }
-
-        const double squared_reproj_error =
-            CalculateSquaredReprojectionError(point2D.xy,
-                                              point3D.xyz,
-                                              image.CamFromWorld(),
-                                              camera,
-                                              options.enable_refraction);
-
-        if (std::isnan(squared_reproj_error) ||
-            squared_reproj_error > max_squared_reproj_error) {
-          continue;
-        }
-
-        // Success, add observation to point track.
-        const TrackElement track_el(corr->image_id, corr->point2D_idx);
-        reconstruction_->AddObservation(point3D_id, track_el);
-        modified_point3D_ids_.insert(point3D_id);
-
-        // Recursively complete track for this new correspondence.
-        if (transitivity < max_transitivity - 1) {
-          queue.emplace_back(corr->image_id, corr->point2D_idx);
-        }
-
-        num_completed += 1;
-      }
-    }
+  std::vector<TrackElement> completions;
+  FindTrackCompletions(
+      options,
+      *reconstruction_,
+      *correspondence_graph_,
+      point3D_id,
+      [&](const Camera& camera) {
+        return HasCameraBogusParams(options, camera);
+      },
+      &completions);
+
+  for (const TrackElement& track_el : completions) {
+    reconstruction_->AddObservation(point3D_id, track_el);
+    modified_point3D_ids_.insert(point3D_id);
   }
 
-  return num_completed;
+  return completions.size();
 }
 
 bool IncrementalTriangulator::HasCameraBogusParams(const Options& options,
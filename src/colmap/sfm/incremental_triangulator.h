@@ -85,6 +85,10 @@ class IncrementalTriangulator {
     // Whether to use refractive camera model in reconstruction.
     bool enable_refraction = false;
 
+    // Number of threads to triangulate the observations of an image and to
+    // complete and merge tracks.
+    int num_threads = -1;
+
     bool Check() const;
   };
 
@@ -103,6 +107,15 @@ class IncrementalTriangulator {
   // in the associated reconstruction.
   size_t TriangulateImage(const Options& options, image_t image_id);
 
+  // Triangulate observations of multiple images, see `TriangulateImage`. The
+  // observations of all images are estimated in parallel against the same
+  // state of the reconstruction and then applied in the order of the images.
+  // Observations whose correspondences were triangulated by a previous
+  // observation in the meantime, e.g. the same track seen from another image,
+  // are triangulated anew against the updated tracks.
+  size_t TriangulateImages(const Options& options,
+                           const std::vector<image_t>& image_ids);
+
   // Complete triangulations for image. Tries to create new tracks for not
   // yet triangulated observations and tries to complete existing tracks.
   // Returns the number of completed observations.
@@ -154,13 +167,34 @@ class IncrementalTriangulator {
     point2D_t point2D_idx;
     const Image* image;
     const Camera* camera;
-    const Point2D* point2D;
+
+    // The current state of the image point, read through the image.
+    inline const Eigen::Vector2d& Point2DXY() const {
+      return image->Point2DXY(point2D_idx);
+    }
+    inline point3D_t Point3DId() const {
+      return image->Point2DPoint3DId(point2D_idx);
+    }
+    inline bool HasPoint3D() const { return Point3DId() != kInvalidPoint3DId; }
   };
 
  private:
   // Clear cache of bogus camera parameters and merge trials.
   void ClearCaches();
 
+  // Append the observations of a registered image with valid camera
+  // parameters as reference correspondences for triangulation.
+  void AppendImageObservations(const Options& options,
+                               image_t image_id,
+                               std::vector<CorrData>* ref_corrs_data);
+
+  // Triangulate the given reference observations. The observations are
+  // estimated in parallel and applied in their order, where observations
+  // whose correspondences were triangulated in the meantime are triangulated
+  // anew.
+  size_t TriangulateObservations(const Options& options,
+                                 const std::vector<CorrData>& ref_corrs_data);
+
   // Find (transitive) correspondences to other images.
   size_t Find(const Options& options,
               image_t image_id,
@@ -172,6 +206,16 @@ class IncrementalTriangulator {
   size_t Create(const Options& options,
                 const std::vector<CorrData>& corrs_data);
 
+  // Add a new 3D point with the given inlier correspondences and its
+  // estimated position. Recursively tries to create further points from the
+  // remaining correspondences.
+  size_t AddCreatedPoint3D(const Options& options,
+                           const CorrData* corrs_data,
+                           size_t num_corrs,
+                           const char* inlier_mask,
+                           size_t num_create_corrs,
+                           const Eigen::Vector3d& xyz);
+
   // Try to continue the 3D point with the given correspondences.
   size_t Continue(const Options& options,
                   const CorrData& ref_corr_data,
@@ -180,6 +224,11 @@ class IncrementalTriangulator {
   // Try to merge 3D point with any of its corresponding 3D points.
   size_t Merge(const Options& options, point3D_t point3D_id);
 
+  // Merge two 3D points and recursively try to merge the merged 3D point.
+  size_t MergePoint3DPair(const Options& options,
+                          point3D_t point3D_id1,
+                          point3D_t point3D_id2);
+
   // Try to transitively complete the track of a 3D point.
   size_t Complete(const Options& options, point3D_t point3D_id);
 
@@ -0,0 +1,355 @@
+#include "colmap/controllers/hybrid_mapper.h"
+#include "colmap/controllers/incremental_mapper.h"
+#include "colmap/controllers/option_manager.h"
+#include "colmap/estimators/alignment.h"
+#include "colmap/math/math.h"
+#include "colmap/math/random.h"
+#include "colmap/scene/database.h"
+#include "colmap/scene/reconstruction_manager.h"
+#include "colmap/scene/synthetic.h"
+#include "colmap/util/logging.h"
+#include "colmap/util/misc.h"
+#include "colmap/util/string.h"
+#include "colmap/util/timer.h"
+#include "colmap/util/tracing.h"
+
+#include <cstdio>
+#include <fstream>
+#include <utility>
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+using namespace colmap;
+
+// End-to-end benchmark of the refractive structure-from-motion pipeline on a
+// synthetic lawnmower survey. The synthesized scene is written to a database,
+// from which the incremental or hybrid mapper reconstructs the survey. The
+// wall time of every stage, the peak memory, and the accuracy of the
+// reconstruction w.r.t. the synthesized ground truth are reported. If COLMAP is
+// built with tracing and --trace_path is given, the summary of the traced hot
+// paths inside the mapper is reported as well.
+//
+// Example:
+//
+//    bench_refrac_sfm --output_path bench --num_images 1000 --mapper hybrid
+
+namespace {
+
+// The peak resident memory of the process in bytes or 0 if unknown.
+size_t GetPeakMemoryUsage() {
+#if defined(__linux__) || defined(__APPLE__)
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) {
+    return 0;
+  }
+#if defined(__APPLE__)
+  return static_cast<size_t>(usage.ru_maxrss);
+#else
+  return static_cast<size_t>(usage.ru_maxrss) * 1024;
+#endif
+#else
+  return 0;
+#endif
+}
+
+struct AccuracyStatistics {
+  size_t num_reg_images = 0;
+  size_t num_points3D = 0;
+  double mean_reproj_error = 0;
+  double mean_track_length = 0;
+  bool aligned = false;
+  double mean_rotation_error_deg = 0;
+  double median_rotation_error_deg = 0;
+  double mean_proj_center_error = 0;
+  double median_proj_center_error = 0;
+};
+
+AccuracyStatistics EvaluateAccuracy(const Reconstruction& reconstruction,
+                                    const Reconstruction& gt_reconstruction,
+                                    const double max_proj_center_error) {
+  AccuracyStatistics stats;
+  stats.num_reg_images = reconstruction.NumRegImages();
+  stats.num_points3D = reconstruction.NumPoints3D();
+  stats.mean_reproj_error = reconstruction.ComputeMeanReprojectionError();
+  stats.mean_track_length = reconstruction.ComputeMeanTrackLength();
+
+  Sim3d gt_from_reconstruction;
+  stats.aligned = AlignReconstructionsViaProjCenters(reconstruction,
+                                                     gt_reconstruction,
+                                                     max_proj_center_error,
+                                                     &gt_from_reconstruction);
+  if (!stats.aligned) {
+    return stats;
+  }
+
+  std::vector<double> rotation_errors;
+  std::vector<double> proj_center_errors;
+  for (const auto& error : ComputeImageAlignmentError(
+           reconstruction, gt_reconstruction, gt_from_reconstruction)) {
+    if (error.rotation_error_deg < 0) {
+      continue;
+    }
+    rotation_errors.push_back(error.rotation_error_deg);
+    proj_center_errors.push_back(error.proj_center_error);
+  }
+  if (!rotation_errors.empty()) {
+    stats.mean_rotation_error_deg = Mean(rotation_errors);
+    stats.median_rotation_error_deg = Median(rotation_errors);
+    stats.mean_proj_center_error = Mean(proj_center_errors);
+    stats.median_proj_center_error = Median(proj_center_errors);
+  }
+  return stats;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  InitializeGlog(argv);
+
+  std::string output_path;
+  std::string mapper = "incremental";
+  int seed = 0;
+  int num_points3D_per_image = 200;
+  std::string camera_model = "SIMPLE_RADIAL";
+  std::string camera_params = "1280, 512, 384, 0.05";
+  std::string camera_refrac_model = "FLATPORT";
+  std::string camera_refrac_params =
+      "0, 0, 1, 0.05, 0.007, 1.003, 1.473, 1.333";
+  double max_proj_center_error = 1.0;
+
+  SyntheticDatasetOptions synthetic_options;
+  synthetic_options.num_cameras = 1;
+  synthetic_options.num_images = 1000;
+  synthetic_options.camera_width = 1024;
+  synthetic_options.camera_height = 768;
+  synthetic_options.num_points2D_without_point3D = 50;
+  synthetic_options.point2D_stddev = 0.5;
+  synthetic_options.match_config =
+      SyntheticDatasetOptions::MatchConfig::CHAINED;
+  synthetic_options.trajectory_config =
+      SyntheticDatasetOptions::TrajectoryConfig::LAWNMOWER;
+  synthetic_options.lawnmower_num_images_per_line = 50;
+  synthetic_options.prior_position_stddev = 0.1;
+  synthetic_options.prior_rotation_stddev = 1.0;
+
+  HybridMapperController::Options hybrid_options;
+
+  OptionManager options;
+  options.AddRequiredOption("output_path", &output_path);
+  options.AddDefaultOption("mapper", &mapper, "{incremental, hybrid}");
+  options.AddDefaultOption("seed", &seed);
+  options.AddDefaultOption("num_images", &synthetic_options.num_images);
+  options.AddDefaultOption("num_points3D_per_image", &num_points3D_per_image);
+  options.AddDefaultOption("num_points2D_without_point3D",
+                           &synthetic_options.num_points2D_without_point3D);
+  options.AddDefaultOption("point2D_stddev",
+                           &synthetic_options.point2D_stddev);
+  options.AddDefaultOption("camera_model", &camera_model);
+  options.AddDefaultOption("camera_width", &synthetic_options.camera_width);
+  options.AddDefaultOption("camera_height", &synthetic_options.camera_height);
+  options.AddDefaultOption("camera_params", &camera_params);
+  options.AddDefaultOption(
+      "camera_refrac_model",
+      &camera_refrac_model,
+      "{NONE, FLATPORT, DOMEPORT, FLATPORT_2L, FLATPORT_3L}");
+  options.AddDefaultOption("camera_refrac_params", &camera_refrac_params);
+  options.AddDefaultOption("images_per_line",
+                           &synthetic_options.lawnmower_num_images_per_line);
+  options.AddDefaultOption("image_spacing",
+                           &synthetic_options.lawnmower_image_spacing);
+  options.AddDefaultOption("line_spacing",
+                           &synthetic_options.lawnmower_line_spacing);
+  options.AddDefaultOption("altitude", &synthetic_options.lawnmower_altitude);
+  options.AddDefaultOption("terrain_relief",
+                           &synthetic_options.lawnmower_terrain_relief);
+  options.AddDefaultOption("prior_position_stddev",
+                           &synthetic_options.prior_position_stddev);
+  options.AddDefaultOption("prior_rotation_stddev",
+                           &synthetic_options.prior_rotation_stddev);
+  options.AddDefaultOption("max_proj_center_error", &max_proj_center_error);
+  options.AddDefaultOption("num_workers", &hybrid_options.num_workers);
+  options.AddDefaultOption(
+      "leaf_max_num_images",
+      &hybrid_options.clustering_options.leaf_max_num_images);
+  options.AddDefaultOption("image_overlap",
+                           &hybrid_options.clustering_options.image_overlap);
+  options.AddMapperOptions();
+  options.Parse(argc, argv);
+
+  if (mapper != "incremental" && mapper != "hybrid") {
+    LOG(ERROR) << "Invalid mapper: " << mapper;
+    return EXIT_FAILURE;
+  }
+  CHECK_GT(num_points3D_per_image, 0);
+
+  CreateDirIfNotExists(output_path, /*recursive=*/true);
+  const std::string database_path = JoinPaths(output_path, "database.db");
+  if (ExistsFile(database_path)) {
+    std::remove(database_path.c_str());
+  }
+
+  synthetic_options.num_points3D =
+      num_points3D_per_image * synthetic_options.num_images;
+  synthetic_options.camera_model_id = CameraModelNameToId(camera_model);
+  synthetic_options.camera_params = CSVToVector<double>(camera_params);
+  if (camera_refrac_model != "NONE") {
+    synthetic_options.camera_refrac_model_id =
+        CameraRefracModelNameToId(camera_refrac_model);
+    synthetic_options.camera_refrac_params =
+        CSVToVector<double>(camera_refrac_params);
+  }
+
+  std::vector<std::pair<std::string, double>> stage_seconds;
+  Timer timer;
+
+  //////////////////////////////////////////////////////////////////////////////
+  // Synthesize survey
+  //////////////////////////////////////////////////////////////////////////////
+
+  PrintHeading1("Synthesizing survey");
+
+  SetPRNGSeed(seed);
+  Reconstruction gt_reconstruction;
+  timer.Start();
+  {
+    Database database(database_path);
+    DatabaseTransaction database_transaction(&database);
+    SynthesizeDataset(synthetic_options, &gt_reconstruction, &database);
+  }
+  stage_seconds.emplace_back("synthesize", timer.ElapsedSeconds());
+
+  LOG(INFO) << StringPrintf("Images: %d", gt_reconstruction.NumImages());
+  LOG(INFO) << StringPrintf("Points: %d", gt_reconstruction.NumPoints3D());
+  LOG(INFO) << StringPrintf("Observations: %d",
+                            gt_reconstruction.ComputeNumObservations());
+
+  //////////////////////////////////////////////////////////////////////////////
+  // Reconstruct survey
+  //////////////////////////////////////////////////////////////////////////////
+
+  PrintHeading1("Reconstructing survey");
+
+  auto& mapper_options = *options.mapper;
+  mapper_options.enable_refraction =
+      synthetic_options.camera_refrac_model_id != CameraRefracModelId::kInvalid;
+  mapper_options.use_pose_prior = synthetic_options.prior_position_stddev >= 0;
+  mapper_options.extract_colors = false;
+
+  auto reconstruction_manager = std::make_shared<ReconstructionManager>();
+  timer.Restart();
+  if (mapper == "incremental") {
+    IncrementalMapperController mapper_controller(
+        options.mapper, output_path, database_path, reconstruction_manager);
+    mapper_controller.Start();
+    mapper_controller.Wait();
+  } else {
+    hybrid_options.image_path = output_path;
+    hybrid_options.database_path = database_path;
+    hybrid_options.incremental_options = mapper_options;
+    HybridMapperController mapper_controller(hybrid_options,
+                                             reconstruction_manager);
+    mapper_controller.Start();
+    mapper_controller.Wait();
+  }
+  stage_seconds.emplace_back("reconstruct", timer.ElapsedSeconds());
+
+  if (reconstruction_manager->Size() == 0) {
+    LOG(ERROR) << "Failed to reconstruct the survey";
+    return EXIT_FAILURE;
+  }
+
+  // The largest reconstruction, which is the global reconstruction of the
+  // hybrid mapper.
+  size_t largest_idx = 0;
+  for (size_t i = 1; i < reconstruction_manager->Size(); ++i) {
+    if (reconstruction_manager->Get(i)->NumRegImages() >
+        reconstruction_manager->Get(largest_idx)->NumRegImages()) {
+      largest_idx = i;
+    }
+  }
+  const Reconstruction& reconstruction =
+      *reconstruction_manager->Get(largest_idx);
+
+  const std::string sparse_path = JoinPaths(output_path, "sparse");
+  CreateDirIfNotExists(sparse_path);
+  reconstruction.Write(sparse_path);
+
+  //////////////////////////////////////////////////////////////////////////////
+  // Evaluate
+  //////////////////////////////////////////////////////////////////////////////
+
+  PrintHeading1("Evaluating reconstruction");
+
+  timer.Restart();
+  const AccuracyStatistics accuracy = EvaluateAccuracy(
+      reconstruction, gt_reconstruction, max_proj_center_error);
+  stage_seconds.emplace_back("evaluate", timer.ElapsedSeconds());
+
+  if (!accuracy.aligned) {
+    LOG(WARNING) << "Failed to align the reconstruction to the ground truth";
+  }
+
+  const bool tracing = Tracer::IsEnabled();
+  std::vector<TraceStatistics> trace_statistics;
+  if (tracing) {
+    trace_statistics = Tracer::Instance().Summary();
+    Tracer::Instance().Stop();
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+  // Report
+  //////////////////////////////////////////////////////////////////////////////
+
+  std::vector<std::pair<std::string, std::string>> report;
+  report.emplace_back("mapper", mapper);
+  report.emplace_back("camera_refrac_model", camera_refrac_model);
+  report.emplace_back("num_images",
+                      std::to_string(synthetic_options.num_images));
+  report.emplace_back("num_points3D",
+                      std::to_string(synthetic_options.num_points3D));
+  for (const auto& stage : stage_seconds) {
+    report.emplace_back("time_" + stage.first + "_s",
+                        std::to_string(stage.second));
+  }
+  // The traced spans are accumulated over all threads.
+  for (const auto& stats : trace_statistics) {
+    if (stats.type == TraceStatistics::Type::SPAN) {
+      report.emplace_back("trace_" + stats.name + "_s",
+                          std::to_string(stats.sum * 1e-6));
+    }
+  }
+  report.emplace_back("peak_memory_mb",
+                      std::to_string(GetPeakMemoryUsage() / (1024 * 1024)));
+  report.emplace_back("num_reg_images",
+                      std::to_string(accuracy.num_reg_images));
+  report.emplace_back("num_points3D_reconstructed",
+                      std::to_string(accuracy.num_points3D));
+  report.emplace_back("mean_reproj_error",
+                      std::to_string(accuracy.mean_reproj_error));
+  report.emplace_back("mean_track_length",
+                      std::to_string(accuracy.mean_track_length));
+  report.emplace_back("aligned", std::to_string(accuracy.aligned));
+  report.emplace_back("mean_rotation_error_deg",
+                      std::to_string(accuracy.mean_rotation_error_deg));
+  report.emplace_back("median_rotation_error_deg",
+                      std::to_string(accuracy.median_rotation_error_deg));
+  report.emplace_back("mean_proj_center_error",
+                      std::to_string(accuracy.mean_proj_center_error));
+  report.emplace_back("median_proj_center_error",
+                      std::to_string(accuracy.median_proj_center_error));
+
+  PrintHeading1("Benchmark report");
+
+  const std::string report_path = JoinPaths(output_path, "benchmark.csv");
+  std::ofstream file(report_path, std::ios::trunc);
+  CHECK(file.is_open()) << report_path;
+  file << "metric,value" << std::endl;
+  for (const auto& entry : report) {
+    LOG(INFO) << entry.first << ": " << entry.second;
+    file << entry.first << "," << entry.second << std::endl;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -13,8 +13,7 @@ struct PointsData {
   std::vector<Eigen::Vector2d> points2D_refrac;
   std::vector<Eigen::Vector3d> points3D;
 
-  std::vector<Camera> virtual_cameras;
-  std::vector<Rigid3d> virtual_from_reals;
+  VirtualPinholeCameras virtual_cameras;
 
   Rigid3d cam_from_world_gt;
 };
@@ -77,8 +76,7 @@ void GenerateRandom3D2DPoints(const Camera& camera,
   }
 
   camera.ComputeVirtuals(points_data.points2D_refrac,
-                         points_data.virtual_cameras,
-                         points_data.virtual_from_reals);
+                         &points_data.virtual_cameras);
 }
 
 size_t EstimatePose(Camera& camera,
@@ -126,14 +124,9 @@ size_t EstimatePose(Camera& camera,
 
   } else {
     // Refractive pose estimation
-    std::vector<size_t> camera_idxs(points_data.points2D_refrac.size());
-    std::iota(camera_idxs.begin(), camera_idxs.end(), 0);
-
     if (!EstimateGeneralizedAbsolutePose(abs_pose_options.ransac_options,
                                          points_data.points2D_refrac,
                                          points_data.points3D,
-                                         camera_idxs,
-                                         points_data.virtual_from_reals,
                                          points_data.virtual_cameras,
                                          &cam_from_world,
                                          &num_inliers,
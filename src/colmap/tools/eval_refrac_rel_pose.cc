@@ -26,10 +26,8 @@ struct PointsData {
   std::vector<Eigen::Vector2d> points2D2_refrac;
 
   // Store virtual cameras here.
-  std::vector<Camera> virtual_cameras1;
-  std::vector<Camera> virtual_cameras2;
-  std::vector<Rigid3d> virtual_from_reals1;
-  std::vector<Rigid3d> virtual_from_reals2;
+  VirtualPinholeCameras virtual_cameras1;
+  VirtualPinholeCameras virtual_cameras2;
   Camera best_fit_camera;
 
   colmap::Rigid3d cam2_from_cam1_gt;
@@ -152,11 +150,9 @@ void GenerateRandom2D2DPoints(const Camera& camera,
   }
 
   camera.ComputeVirtuals(points_data.points2D1_refrac,
-                         points_data.virtual_cameras1,
-                         points_data.virtual_from_reals1);
+                         &points_data.virtual_cameras1);
   camera.ComputeVirtuals(points_data.points2D2_refrac,
-                         points_data.virtual_cameras2,
-                         points_data.virtual_from_reals2);
+                         &points_data.virtual_cameras2);
 
   const double kApproxDepth = 5.0;
   points_data.best_fit_camera =
@@ -197,10 +193,8 @@ size_t EstimateRelativePose(Camera& camera,
       two_view_geometry =
           EstimateRefractiveTwoViewGeometry(points_data.points2D1_refrac,
                                             points_data.virtual_cameras1,
-                                            points_data.virtual_from_reals1,
                                             points_data.points2D2_refrac,
                                             points_data.virtual_cameras2,
-                                            points_data.virtual_from_reals2,
                                             matches,
                                             two_view_geometry_options,
                                             false);
@@ -210,10 +204,8 @@ size_t EstimateRelativePose(Camera& camera,
       two_view_geometry =
           EstimateRefractiveTwoViewGeometry(points_data.points2D1_refrac,
                                             points_data.virtual_cameras1,
-                                            points_data.virtual_from_reals1,
                                             points_data.points2D2_refrac,
                                             points_data.virtual_cameras2,
-                                            points_data.virtual_from_reals2,
                                             matches,
                                             two_view_geometry_options,
                                             true);
@@ -224,11 +216,9 @@ size_t EstimateRelativePose(Camera& camera,
           points_data.best_fit_camera,
           points_data.points2D1_refrac,
           points_data.virtual_cameras1,
-          points_data.virtual_from_reals1,
           points_data.best_fit_camera,
           points_data.points2D2_refrac,
           points_data.virtual_cameras2,
-          points_data.virtual_from_reals2,
           matches,
           two_view_geometry_options,
           false);
@@ -238,11 +228,9 @@ size_t EstimateRelativePose(Camera& camera,
           points_data.best_fit_camera,
           points_data.points2D1_refrac,
           points_data.virtual_cameras1,
-          points_data.virtual_from_reals1,
           points_data.best_fit_camera,
           points_data.points2D2_refrac,
           points_data.virtual_cameras2,
-          points_data.virtual_from_reals2,
           matches,
           two_view_geometry_options,
           true);
@@ -251,10 +239,8 @@ size_t EstimateRelativePose(Camera& camera,
       two_view_geometry =
           EstimateRefractiveTwoViewGeometryHu(points_data.points2D1_refrac,
                                               points_data.virtual_cameras1,
-                                              points_data.virtual_from_reals1,
                                               points_data.points2D2_refrac,
                                               points_data.virtual_cameras2,
-                                              points_data.virtual_from_reals2,
                                               matches,
                                               two_view_geometry_options,
                                               false);
@@ -263,10 +249,8 @@ size_t EstimateRelativePose(Camera& camera,
       two_view_geometry =
           EstimateRefractiveTwoViewGeometryHu(points_data.points2D1_refrac,
                                               points_data.virtual_cameras1,
-                                              points_data.virtual_from_reals1,
                                               points_data.points2D2_refrac,
                                               points_data.virtual_cameras2,
-                                              points_data.virtual_from_reals2,
                                               matches,
                                               two_view_geometry_options,
                                               true);
@@ -1,7 +1,10 @@
 #include "colmap/controllers/option_manager.h"
+#include "colmap/scene/mapped_reconstruction.h"
 #include "colmap/scene/reconstruction.h"
 #include "colmap/util/misc.h"
 
+#include <algorithm>
+
 using namespace colmap;
 
 int main(int argc, char** argv) {
@@ -46,26 +49,48 @@ int main(int argc, char** argv) {
     CreateDirIfNotExists(JoinPaths(output_path, "pose_priors"));
   }
 
-  auto reconstruction = std::make_shared<Reconstruction>();
-  reconstruction->Read(input_path);
-
-  const std::vector<image_t>& reg_image_ids = reconstruction->RegImageIds();
-
-  Eigen::Vector3d center_view_position =
-      reconstruction->Image(static_cast<image_t>(center_view_id))
-          .ProjectionCenter();
+  // Only the names and positions of the images are needed, which are accessed
+  // without loading the 2D and 3D points for models in the mapped format.
+  std::vector<image_t> image_ids;
+  std::vector<std::string> image_names;
+  std::vector<Eigen::Vector3d> positions;
+  if (!ExistsFile(JoinPaths(input_path, "cameras.bin")) &&
+      !ExistsFile(JoinPaths(input_path, "cameras.txt")) &&
+      ExistsFile(JoinPaths(input_path, kMappedReconstructionFileName))) {
+    const MappedReconstruction mapped(
+        JoinPaths(input_path, kMappedReconstructionFileName));
+    for (size_t i = 0; i < mapped.NumImages(); ++i) {
+      image_ids.push_back(mapped.ImageRecordAt(i).image_id);
+      image_names.push_back(mapped.ImageName(i));
+      positions.push_back(Inverse(mapped.CamFromWorld(i)).translation);
+    }
+  } else {
+    Reconstruction reconstruction;
+    reconstruction.Read(input_path);
+    for (const image_t image_id : reconstruction.RegImageIds()) {
+      const Image& image = reconstruction.Image(image_id);
+      image_ids.push_back(image_id);
+      image_names.push_back(image.Name());
+      positions.push_back(image.ProjectionCenter());
+    }
+  }
 
-  for (const image_t image_id : reg_image_ids) {
-    const Image& image = reconstruction->Image(image_id);
+  const auto center_view_it =
+      std::find(image_ids.begin(), image_ids.end(), center_view_id);
+  CHECK(center_view_it != image_ids.end())
+      << "Center view is not a registered image";
+  const Eigen::Vector3d center_view_position =
+      positions[center_view_it - image_ids.begin()];
 
-    Eigen::Vector3d position = image.ProjectionCenter();
-    const double distance = (center_view_position - position).norm();
+  for (size_t i = 0; i < image_ids.size(); ++i) {
+    const image_t image_id = image_ids[i];
+    const double distance = (center_view_position - positions[i]).norm();
     if (distance > radius) {
       continue;
     }
 
     LOG(INFO) << "Copying " << image_id << " , distance " << distance;
-    const std::string& image_name = image.Name();
+    const std::string& image_name = image_names[i];
     std::string src_path = JoinPaths(*options.image_path.get(), image_name);
     std::string dst_path = JoinPaths(output_path, "images", image_name);
 
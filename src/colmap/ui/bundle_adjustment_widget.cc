@@ -64,6 +64,8 @@ BundleAdjustmentWidget::BundleAdjustmentWidget(MainWindow* main_window,
       "parameter_tolerance [10eX]",
       -1000,
       1000);
+  AddOptionBool(&options->bundle_adjustment->adaptive_termination,
+                "adaptive_termination");
 
   AddOptionBool(&options->bundle_adjustment->refine_focal_length,
                 "refine_focal_length");
@@ -77,6 +79,23 @@ BundleAdjustmentWidget::BundleAdjustmentWidget(MainWindow* main_window,
                 "enable_refraction");
   AddOptionBool(&options->bundle_adjustment->refine_refrac_params,
                 "refine_refrac_params");
+  AddOptionBool(&options->bundle_adjustment->refrac_calibration_two_stage,
+                "refrac_calibration_two_stage");
+  AddOptionInt(
+      &options->bundle_adjustment->refrac_calibration_max_num_iterations,
+      "refrac_calibration_max_num_iterations");
+  AddOptionInt(
+      &options->bundle_adjustment->refrac_calibration_max_num_observations,
+      "refrac_calibration_max_num_observations");
+  AddOptionDoubleLog(
+      &options->bundle_adjustment->refrac_calibration_tolerance,
+      "refrac_calibration_tolerance [10eX]",
+      -1000,
+      1000);
+  AddOptionBool(&options->bundle_adjustment->refrac_mixed_precision,
+                "refrac_mixed_precision");
+  AddOptionBool(&options->bundle_adjustment->use_gpu, "use_gpu");
+  AddOptionText(&options->bundle_adjustment->gpu_index, "gpu_index");
 
   QPushButton* run_button = new QPushButton(tr("Run"), this);
   grid_layout_->addWidget(run_button, grid_layout_->rowCount(), 1);
@@ -43,9 +43,9 @@ class PointColormapBase {
   PointColormapBase();
   virtual ~PointColormapBase() = default;
 
-  virtual void Prepare(std::unordered_map<camera_t, Camera>& cameras,
-                       std::unordered_map<image_t, Image>& images,
-                       std::unordered_map<point3D_t, Point3D>& points3D,
+  virtual void Prepare(DenseIdMap<camera_t, Camera>& cameras,
+                       DenseIdMap<image_t, Image>& images,
+                       Point3DMap& points3D,
                        std::vector<image_t>& reg_image_ids) = 0;
 
   virtual Eigen::Vector4f ComputeColor(point3D_t point3D_id,
@@ -65,9 +65,9 @@ class PointColormapBase {
 // Map color according to RGB value from image.
 class PointColormapPhotometric : public PointColormapBase {
  public:
-  void Prepare(std::unordered_map<camera_t, Camera>& cameras,
-               std::unordered_map<image_t, Image>& images,
-               std::unordered_map<point3D_t, Point3D>& points3D,
+  void Prepare(DenseIdMap<camera_t, Camera>& cameras,
+               DenseIdMap<image_t, Image>& images,
+               Point3DMap& points3D,
                std::vector<image_t>& reg_image_ids) override;
 
   Eigen::Vector4f ComputeColor(point3D_t point3D_id,
@@ -77,9 +77,9 @@ class PointColormapPhotometric : public PointColormapBase {
 // Map color according to error.
 class PointColormapError : public PointColormapBase {
  public:
-  void Prepare(std::unordered_map<camera_t, Camera>& cameras,
-               std::unordered_map<image_t, Image>& images,
-               std::unordered_map<point3D_t, Point3D>& points3D,
+  void Prepare(DenseIdMap<camera_t, Camera>& cameras,
+               DenseIdMap<image_t, Image>& images,
+               Point3DMap& points3D,
                std::vector<image_t>& reg_image_ids) override;
 
   Eigen::Vector4f ComputeColor(point3D_t point3D_id,
@@ -89,9 +89,9 @@ class PointColormapError : public PointColormapBase {
 // Map color according to track length.
 class PointColormapTrackLen : public PointColormapBase {
  public:
-  void Prepare(std::unordered_map<camera_t, Camera>& cameras,
-               std::unordered_map<image_t, Image>& images,
-               std::unordered_map<point3D_t, Point3D>& points3D,
+  void Prepare(DenseIdMap<camera_t, Camera>& cameras,
+               DenseIdMap<image_t, Image>& images,
+               Point3DMap& points3D,
                std::vector<image_t>& reg_image_ids) override;
 
   Eigen::Vector4f ComputeColor(point3D_t point3D_id,
@@ -101,9 +101,9 @@ class PointColormapTrackLen : public PointColormapBase {
 // Map color according to ground-resolution.
 class PointColormapGroundResolution : public PointColormapBase {
  public:
-  void Prepare(std::unordered_map<camera_t, Camera>& cameras,
-               std::unordered_map<image_t, Image>& images,
-               std::unordered_map<point3D_t, Point3D>& points3D,
+  void Prepare(DenseIdMap<camera_t, Camera>& cameras,
+               DenseIdMap<image_t, Image>& images,
+               Point3DMap& points3D,
                std::vector<image_t>& reg_image_ids) override;
 
   Eigen::Vector4f ComputeColor(point3D_t point3D_id,
@@ -119,9 +119,9 @@ class ImageColormapBase {
   ImageColormapBase();
   virtual ~ImageColormapBase() = default;
 
-  virtual void Prepare(std::unordered_map<camera_t, Camera>& cameras,
-                       std::unordered_map<image_t, Image>& images,
-                       std::unordered_map<point3D_t, Point3D>& points3D,
+  virtual void Prepare(DenseIdMap<camera_t, Camera>& cameras,
+                       DenseIdMap<image_t, Image>& images,
+                       Point3DMap& points3D,
                        std::vector<image_t>& reg_image_ids) = 0;
 
   virtual void ComputeColor(const Image& image,
@@ -135,9 +135,9 @@ class ImageColormapBase {
 // Use uniform color for all images.
 class ImageColormapUniform : public ImageColormapBase {
  public:
-  void Prepare(std::unordered_map<camera_t, Camera>& cameras,
-               std::unordered_map<image_t, Image>& images,
-               std::unordered_map<point3D_t, Point3D>& points3D,
+  void Prepare(DenseIdMap<camera_t, Camera>& cameras,
+               DenseIdMap<image_t, Image>& images,
+               Point3DMap& points3D,
                std::vector<image_t>& reg_image_ids) override;
 
   void ComputeColor(const Image& image,
@@ -151,9 +151,9 @@ class ImageColormapUniform : public ImageColormapBase {
 // Use color for images with specific words in their name.
 class ImageColormapNameFilter : public ImageColormapBase {
  public:
-  void Prepare(std::unordered_map<camera_t, Camera>& cameras,
-               std::unordered_map<image_t, Image>& images,
-               std::unordered_map<point3D_t, Point3D>& points3D,
+  void Prepare(DenseIdMap<camera_t, Camera>& cameras,
+               DenseIdMap<image_t, Image>& images,
+               Point3DMap& points3D,
                std::vector<image_t>& reg_image_ids) override;
 
   void AddColorForWord(const std::string& word,
@@ -30,6 +30,7 @@
 #include "colmap/ui/dense_reconstruction_widget.h"
 
 #include "colmap/image/undistortion.h"
+#include "colmap/mvs/compressed_map.h"
 #include "colmap/mvs/fusion.h"
 #include "colmap/mvs/meshing.h"
 #include "colmap/mvs/patch_match.h"
@@ -54,6 +55,8 @@ class StereoOptionsTab : public OptionsWidget {
     AddOptionInt(
         &options->patch_match_stereo->max_image_size, "max_image_size", -1);
     AddOptionText(&options->patch_match_stereo->gpu_index, "gpu_index");
+    AddOptionInt(&options->patch_match_stereo->num_problems_per_gpu,
+                 "num_problems_per_gpu");
     AddOptionDouble(&options->patch_match_stereo->depth_min, "depth_min", -1);
     AddOptionDouble(&options->patch_match_stereo->depth_max, "depth_max", -1);
     AddOptionInt(&options->patch_match_stereo->window_radius, "window_radius");
@@ -69,6 +72,16 @@ class StereoOptionsTab : public OptionsWidget {
                     "incident_angle_sigma");
     AddOptionInt(&options->patch_match_stereo->num_iterations,
                  "num_iterations");
+    AddOptionInt(&options->patch_match_stereo->max_tile_size,
+                 "max_tile_size",
+                 -1);
+    AddOptionInt(&options->patch_match_stereo->tile_overlap, "tile_overlap");
+    AddOptionBool(&options->patch_match_stereo->init_from_sparse_points,
+                  "init_from_sparse_points");
+    AddOptionInt(&options->patch_match_stereo->sparse_prior_cell_size,
+                 "sparse_prior_cell_size");
+    AddOptionDouble(&options->patch_match_stereo->sparse_prior_depth_margin,
+                    "sparse_prior_depth_margin");
     AddOptionBool(&options->patch_match_stereo->geom_consistency,
                   "geom_consistency");
     AddOptionDouble(&options->patch_match_stereo->geom_consistency_regularizer,
@@ -92,8 +105,15 @@ class StereoOptionsTab : public OptionsWidget {
                     std::numeric_limits<double>::max(),
                     0.1,
                     1);
+    AddOptionBool(&options->patch_match_stereo->cache_images, "cache_images");
     AddOptionBool(&options->patch_match_stereo->write_consistency_graph,
                   "write_consistency_graph");
+    AddOptionBool(&options->patch_match_stereo->pack_consistency_graph,
+                  "pack_consistency_graph");
+    AddOptionBool(&options->patch_match_stereo->write_compressed_maps,
+                  "write_compressed_maps");
+    AddOptionBool(&options->patch_match_stereo->pipeline_geom_consistency,
+                  "pipeline_geom_consistency");
   }
 };
 
@@ -125,6 +145,11 @@ class FusionOptionsTab : public OptionsWidget {
                     0.1,
                     1);
     AddOptionBool(&options->stereo_fusion->use_cache, "use_cache");
+    AddOptionBool(&options->stereo_fusion->enable_refraction,
+                  "enable_refraction");
+    AddOptionInt(&options->stereo_fusion->num_tiles, "num_tiles", 0);
+    AddOptionInt(&options->stereo_fusion->block_size, "block_size", 0);
+    AddOptionBool(&options->stereo_fusion->cache_images, "cache_images");
   }
 };
 
@@ -138,6 +163,11 @@ class MeshingOptionsTab : public OptionsWidget {
     AddOptionDouble(&options->poisson_meshing->color, "color", 0);
     AddOptionDouble(&options->poisson_meshing->trim, "trim", 0);
     AddOptionInt(&options->poisson_meshing->num_threads, "num_threads", -1);
+    AddOptionInt(&options->poisson_meshing->max_chunk_num_points,
+                 "max_chunk_num_points",
+                 -1);
+    AddOptionDouble(
+        &options->poisson_meshing->chunk_overlap, "chunk_overlap", 0);
 
     AddSection("Delaunay Meshing");
     AddOptionDouble(
@@ -156,6 +186,16 @@ class MeshingOptionsTab : public OptionsWidget {
     AddOptionDouble(&options->delaunay_meshing->max_side_length_percentile,
                     "max_side_length_percentile",
                     0);
+    AddOptionInt(&options->delaunay_meshing->max_block_num_points,
+                 "max_block_num_points",
+                 -1);
+    AddOptionDouble(
+        &options->delaunay_meshing->block_overlap, "block_overlap", 0);
+    AddOptionBool(&options->delaunay_meshing->accelerate_visibility,
+                  "accelerate_visibility");
+    AddOptionInt(&options->delaunay_meshing->max_num_visibility_rays,
+                 "max_num_visibility_rays",
+                 -1);
     AddOptionInt(&options->delaunay_meshing->num_threads, "num_threads", -1);
   }
 };
@@ -651,7 +691,7 @@ QWidget* DenseReconstructionWidget::GenerateTableButtonWidget(
             &QPushButton::released,
             [this, image_name, depth_map_path]() {
               mvs::DepthMap depth_map;
-              depth_map.Read(depth_map_path);
+              mvs::ReadDepthMap(depth_map_path, &depth_map);
               image_viewer_widget_->setWindowTitle(
                   QString("Depth map for %1").arg(image_name.c_str()));
               image_viewer_widget_->ShowBitmap(depth_map.ToBitmap(2, 98));
@@ -672,7 +712,7 @@ QWidget* DenseReconstructionWidget::GenerateTableButtonWidget(
             &QPushButton::released,
             [this, image_name, normal_map_path]() {
               mvs::NormalMap normal_map;
-              normal_map.Read(normal_map_path);
+              mvs::ReadNormalMap(normal_map_path, &normal_map);
               image_viewer_widget_->setWindowTitle(
                   QString("Normal map for %1").arg(image_name.c_str()));
               image_viewer_widget_->ShowBitmap(normal_map.ToBitmap());
@@ -77,8 +77,15 @@ SIFTExtractionWidget::SIFTExtractionWidget(QWidget* parent,
   AddOptionDirPath(&options->image_reader->mask_path, "mask_path");
   AddOptionFilePath(&options->image_reader->camera_mask_path,
                     "camera_mask_path");
+  AddOptionBool(&options->image_reader->refrac_validity_mask,
+                "refrac_validity_mask");
   // Directory that contains Pose prior files (.csv).
   AddOptionDirPath(&options->image_reader->pose_prior_path, "pose_prior_path");
+  // Alternatively, a single navigation log with the image timestamps.
+  AddOptionFilePath(&options->image_reader->pose_prior_navigation_log_path,
+                    "pose_prior_navigation_log_path");
+  AddOptionFilePath(&options->image_reader->image_timestamps_path,
+                    "image_timestamps_path");
 
   AddOptionInt(&options->sift_extraction->max_image_size, "max_image_size");
   AddOptionInt(&options->sift_extraction->max_num_features, "max_num_features");
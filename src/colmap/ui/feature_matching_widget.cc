@@ -137,10 +137,14 @@ void FeatureMatchingTab::CreateGeneralOptions() {
       1,
       0.001,
       3);
+  options_widget_->AddOptionBool(
+      &options_->two_view_geometry->ransac_options.use_sprt, "use_sprt");
   options_widget_->AddOptionInt(&options_->two_view_geometry->min_num_inliers,
                                 "min_num_inliers");
   options_widget_->AddOptionBool(&options_->two_view_geometry->multiple_models,
                                  "multiple_models");
+  options_widget_->AddOptionBool(&options_->two_view_geometry->use_prosac,
+                                 "use_prosac");
   options_widget_->AddOptionBool(
       &options_->two_view_geometry->enable_refraction, "enable_refraction");
   options_widget_->AddSpacer();
@@ -186,6 +190,15 @@ SequentialMatchingTab::SequentialMatchingTab(QWidget* parent,
   options_widget_->AddOptionInt(
       &options_->sequential_matching->loop_detection_period,
       "loop_detection_period");
+  options_widget_->AddOptionBool(
+      &options_->sequential_matching->loop_detection_online,
+      "loop_detection_online");
+  options_widget_->AddOptionBool(
+      &options_->sequential_matching->loop_detection_background,
+      "loop_detection_background");
+  options_widget_->AddOptionInt(
+      &options_->sequential_matching->loop_detection_nms_radius,
+      "loop_detection_nms_radius");
   options_widget_->AddOptionInt(
       &options_->sequential_matching->loop_detection_num_images,
       "loop_detection_num_images");
@@ -33,6 +33,20 @@
 #include "colmap/util/misc.h"
 
 namespace colmap {
+namespace {
+
+std::string GetThumbnailCachePath() {
+  const QString cache_path =
+      QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+  if (cache_path.isEmpty()) {
+    return JoinPaths(QDir::tempPath().toUtf8().constData(),
+                     "colmap",
+                     "thumbnails");
+  }
+  return JoinPaths(cache_path.toUtf8().constData(), "thumbnails");
+}
+
+}  // namespace
 
 const double ImageViewerWidget::kZoomFactor = 1.20;
 
@@ -46,7 +60,12 @@ QGraphicsPixmapItem* ImageViewerGraphicsScene::ImagePixmapItem() const {
   return image_pixmap_item_;
 }
 
-ImageViewerWidget::ImageViewerWidget(QWidget* parent) : QWidget(parent) {
+ImageViewerWidget::ImageViewerWidget(QWidget* parent)
+    : QWidget(parent),
+      load_generation_(0),
+      has_loaded_images_(false),
+      thumbnail_cache_(GetThumbnailCachePath()),
+      loader_thread_pool_(1) {
   setWindowFlags(Qt::Window | Qt::WindowTitleHint |
                  Qt::WindowMinimizeButtonHint | Qt::WindowMaximizeButtonHint |
                  Qt::WindowCloseButtonHint);
@@ -92,6 +111,19 @@ ImageViewerWidget::ImageViewerWidget(QWidget* parent) : QWidget(parent) {
   connect(save_button, &QPushButton::released, this, &ImageViewerWidget::Save);
 
   grid_layout_->addLayout(button_layout_, 2, 0, Qt::AlignRight);
+
+  loaded_action_ = new QAction(this);
+  connect(loaded_action_,
+          &QAction::triggered,
+          this,
+          &ImageViewerWidget::ShowLoadedImages,
+          Qt::QueuedConnection);
+}
+
+ImageViewerWidget::~ImageViewerWidget() {
+  // Let a running load function stop early.
+  ++load_generation_;
+  loader_thread_pool_.Stop();
 }
 
 void ImageViewerWidget::resizeEvent(QResizeEvent* event) {
@@ -101,6 +133,14 @@ void ImageViewerWidget::resizeEvent(QResizeEvent* event) {
 }
 
 void ImageViewerWidget::closeEvent(QCloseEvent* event) {
+  // Discard pending requests, which would otherwise reopen the viewer.
+  {
+    std::lock_guard<std::mutex> lock(loaded_mutex_);
+    ++load_generation_;
+    has_loaded_images_ = false;
+    loaded_image1_ = QImage();
+    loaded_image2_ = QImage();
+  }
   graphics_scene_.ImagePixmapItem()->setPixmap(QPixmap());
 }
 
@@ -119,12 +159,91 @@ void ImageViewerWidget::ShowPixmap(const QPixmap& pixmap) {
 }
 
 void ImageViewerWidget::ReadAndShow(const std::string& path) {
+  LoadAsync([this, path](const ShowCallback& show) {
+    QImage thumbnail;
+    if (ReadThumbnail(path, &thumbnail) && !show(thumbnail, thumbnail)) {
+      return;
+    }
+    QImage image;
+    ReadImage(path, &image);
+    show(image, image);
+  });
+}
+
+void ImageViewerWidget::LoadAsync(
+    std::function<void(const ShowCallback&)> load) {
+  int64_t generation;
+  {
+    std::lock_guard<std::mutex> lock(loaded_mutex_);
+    generation = ++load_generation_;
+    has_loaded_images_ = false;
+    loaded_image1_ = QImage();
+    loaded_image2_ = QImage();
+  }
+
+  loader_thread_pool_.AddTask([this, generation, load = std::move(load)]() {
+    if (generation != load_generation_) {
+      return;
+    }
+    load([this, generation](QImage image1, QImage image2) {
+      std::lock_guard<std::mutex> lock(loaded_mutex_);
+      if (generation != load_generation_) {
+        return false;
+      }
+      const bool triggered = has_loaded_images_;
+      has_loaded_images_ = true;
+      loaded_image1_ = std::move(image1);
+      loaded_image2_ = std::move(image2);
+      // Images that were not shown yet are replaced without triggering again.
+      if (!triggered) {
+        loaded_action_->trigger();
+      }
+      return true;
+    });
+  });
+}
+
+void ImageViewerWidget::ShowLoadedImages() {
+  QImage image1;
+  QImage image2;
+  {
+    std::lock_guard<std::mutex> lock(loaded_mutex_);
+    if (!has_loaded_images_) {
+      return;
+    }
+    has_loaded_images_ = false;
+    std::swap(image1, loaded_image1_);
+    std::swap(image2, loaded_image2_);
+  }
+  ShowImages(image1, image2);
+}
+
+void ImageViewerWidget::ShowImages(const QImage& image1,
+                                   const QImage& image2) {
+  ShowPixmap(QPixmap::fromImage(image1));
+}
+
+bool ImageViewerWidget::ReadThumbnail(const std::string& path,
+                                      QImage* image) const {
+  Bitmap bitmap;
+  if (!thumbnail_cache_.Read(path, &bitmap)) {
+    return false;
+  }
+  *image = BitmapToQImageRGB(bitmap);
+  return true;
+}
+
+bool ImageViewerWidget::ReadImage(const std::string& path,
+                                  QImage* image) const {
   Bitmap bitmap;
   if (!bitmap.Read(path, true)) {
     LOG(ERROR) << "Cannot read image at path " << path;
+    *image = QImage();
+    return false;
   }
-
-  ShowBitmap(bitmap);
+  thumbnail_cache_.Write(path, bitmap);
+  *image = BitmapToQImageRGB(bitmap);
+  return true;
 }
 
 void ImageViewerWidget::ZoomIn() {
@@ -172,14 +291,6 @@ void FeatureImageViewerWidget::ReadAndShowWithKeypoints(
     const std::string& path,
     const FeatureKeypoints& keypoints,
     const std::vector<char>& tri_mask) {
-  Bitmap bitmap;
-  if (!bitmap.Read(path, true)) {
-    LOG(ERROR) << "Cannot read image at path " << path;
-  }
-
-  image1_ = QPixmap::fromImage(BitmapToQImageRGB(bitmap));
-  image2_ = image1_;
-
   const size_t num_tri_keypoints = std::count_if(
       tri_mask.begin(), tri_mask.end(), [](const bool tri) { return tri; });
 
@@ -197,14 +308,25 @@ void FeatureImageViewerWidget::ReadAndShowWithKeypoints(
     }
   }
 
-  DrawKeypoints(&image2_, keypoints_tri, Qt::magenta);
-  DrawKeypoints(&image2_, keypoints_not_tri, Qt::red);
+  // The thumbnail is shown without keypoints until the full resolution image
+  // is read, on which the keypoints are drawn in the background.
+  LoadAsync([this,
+             path,
+             keypoints_tri = std::move(keypoints_tri),
+             keypoints_not_tri = std::move(keypoints_not_tri)](
+                const ShowCallback& show) {
+    QImage thumbnail;
+    if (ReadThumbnail(path, &thumbnail) && !show(thumbnail, thumbnail)) {
+      return;
+    }
 
-  if (switch_state_) {
-    ShowPixmap(image2_);
-  } else {
-    ShowPixmap(image1_);
-  }
+    QImage image1;
+    ReadImage(path, &image1);
+    QImage image2 = image1;
+    DrawKeypoints(&image2, keypoints_tri, Qt::magenta);
+    DrawKeypoints(&image2, keypoints_not_tri, Qt::red);
+    show(image1, image2);
+  });
 }
 
 void FeatureImageViewerWidget::ReadAndShowWithMatches(
@@ -213,18 +335,33 @@ void FeatureImageViewerWidget::ReadAndShowWithMatches(
     const FeatureKeypoints& keypoints1,
     const FeatureKeypoints& keypoints2,
     const FeatureMatches& matches) {
-  Bitmap bitmap1;
-  Bitmap bitmap2;
-  if (!bitmap1.Read(path1, true) || !bitmap2.Read(path2, true)) {
-    LOG(ERROR) << "Cannot read images at paths " << path1 << " and " << path2;
-    return;
-  }
+  LoadAsync([this, path1, path2, keypoints1, keypoints2, matches](
+                const ShowCallback& show) {
+    QImage thumbnail1;
+    QImage thumbnail2;
+    if (ReadThumbnail(path1, &thumbnail1) &&
+        ReadThumbnail(path2, &thumbnail2)) {
+      const QImage thumbnails = ShowImagesSideBySide(thumbnail1, thumbnail2);
+      if (!show(thumbnails, thumbnails)) {
+        return;
+      }
+    }
 
-  const auto image1 = QPixmap::fromImage(BitmapToQImageRGB(bitmap1));
-  const auto image2 = QPixmap::fromImage(BitmapToQImageRGB(bitmap2));
+    QImage image1;
+    QImage image2;
+    if (!ReadImage(path1, &image1) || !ReadImage(path2, &image2)) {
+      return;
+    }
+
+    show(ShowImagesSideBySide(image1, image2),
+         DrawMatches(image1, image2, keypoints1, keypoints2, matches));
+  });
+}
 
-  image1_ = ShowImagesSideBySide(image1, image2);
-  image2_ = DrawMatches(image1, image2, keypoints1, keypoints2, matches);
+void FeatureImageViewerWidget::ShowImages(const QImage& image1,
+                                          const QImage& image2) {
+  image1_ = QPixmap::fromImage(image1);
+  image2_ = QPixmap::fromImage(image2);
 
   if (switch_state_) {
     ShowPixmap(image2_);
@@ -385,8 +522,8 @@ void DatabaseImageViewerWidget::ShowImageWithId(const image_t image_id) {
 
   FeatureKeypoints keypoints(image.NumPoints2D());
   for (point2D_t i = 0; i < image.NumPoints2D(); ++i) {
-    keypoints[i].x = static_cast<float>(image.Point2D(i).xy(0));
-    keypoints[i].y = static_cast<float>(image.Point2D(i).xy(1));
+    keypoints[i].x = static_cast<float>(image.Point2DXY(i)(0));
+    keypoints[i].y = static_cast<float>(image.Point2DXY(i)(1));
   }
 
   const std::string path = JoinPaths(*options_->image_path, image.Name());
@@ -34,6 +34,12 @@
 #include "colmap/scene/projection.h"
 #include "colmap/scene/reconstruction.h"
 #include "colmap/ui/qt_utils.h"
+#include "colmap/ui/thumbnail_cache.h"
+#include "colmap/util/threading.h"
+
+#include <atomic>
+#include <functional>
+#include <mutex>
 
 #include <QtCore>
 #include <QtWidgets>
@@ -55,18 +61,52 @@ class ImageViewerGraphicsScene : public QGraphicsScene {
 class ImageViewerWidget : public QWidget {
  public:
   explicit ImageViewerWidget(QWidget* parent);
+  ~ImageViewerWidget();
 
   void ShowBitmap(const Bitmap& bitmap);
   void ShowPixmap(const QPixmap& pixmap);
+
+  // Read the image in the background and show its cached thumbnail before
+  // the full resolution image.
   void ReadAndShow(const std::string& path);
 
  private:
   static const double kZoomFactor;
 
+  void ShowLoadedImages();
+
   ImageViewerGraphicsScene graphics_scene_;
   QGraphicsView* graphics_view_;
 
+  QAction* loaded_action_;
+
+  // Requests are numbered, such that the images of superseded requests are
+  // discarded. The loaded images are handed over to the UI thread.
+  std::atomic<int64_t> load_generation_;
+  std::mutex loaded_mutex_;
+  bool has_loaded_images_;
+  QImage loaded_image1_;
+  QImage loaded_image2_;
+
  protected:
+  // Callback of the load functions to show intermediate or final images.
+  // Returns false if the request was superseded, in which case the load
+  // function should stop early.
+  using ShowCallback = std::function<bool(QImage, QImage)>;
+
+  // Run the load function in a background thread. Only the most recent
+  // request is shown and pending requests are skipped.
+  void LoadAsync(std::function<void(const ShowCallback&)> load);
+
+  // Show the images of a load function in the UI thread, where the second
+  // image with overlays is only used by the feature image viewers.
+  virtual void ShowImages(const QImage& image1, const QImage& image2);
+
+  // Read the cached thumbnail of an image or the full resolution image, which
+  // is added to the thumbnail cache. Safe to call from the load functions.
+  bool ReadThumbnail(const std::string& path, QImage* image) const;
+  bool ReadImage(const std::string& path, QImage* image) const;
+
   void resizeEvent(QResizeEvent* event);
   void closeEvent(QCloseEvent* event);
   void ZoomIn();
@@ -75,6 +115,13 @@ class ImageViewerWidget : public QWidget {
 
   QGridLayout* grid_layout_;
   QHBoxLayout* button_layout_;
+
+ private:
+  const ThumbnailCache thumbnail_cache_;
+
+  // Declared last to stop the loader before the state it accesses is
+  // destructed.
+  ThreadPool loader_thread_pool_;
 };
 
 class FeatureImageViewerWidget : public ImageViewerWidget {
@@ -92,6 +139,7 @@ class FeatureImageViewerWidget : public ImageViewerWidget {
                               const FeatureMatches& matches);
 
  protected:
+  void ShowImages(const QImage& image1, const QImage& image2) override;
   void ShowOrHide();
 
   QPixmap image1_;
@@ -33,7 +33,7 @@
 
 namespace colmap {
 
-LinePainter::LinePainter() : num_geoms_(0) {}
+LinePainter::LinePainter() : num_geoms_(0), capacity_(0) {}
 
 LinePainter::~LinePainter() {
   vao_.destroy();
@@ -59,6 +59,8 @@ void LinePainter::Setup() {
 
   vao_.create();
   vbo_.create();
+  capacity_ = 0;
+  uploaded_data_.clear();
 
 #if DEBUG
   glDebugLog();
@@ -74,20 +76,42 @@ void LinePainter::Upload(const std::vector<LinePainter::Data>& data) {
   vao_.bind();
   vbo_.bind();
 
-  // Upload data array to GPU
-  vbo_.setUsagePattern(QOpenGLBuffer::DynamicDraw);
-  vbo_.allocate(data.data(),
-                static_cast<int>(data.size() * sizeof(LinePainter::Data)));
-
-  // in_position
-  shader_program_.enableAttributeArray("a_pos");
-  shader_program_.setAttributeBuffer(
-      "a_pos", GL_FLOAT, 0, 3, sizeof(PointPainter::Data));
+  if (data.size() > capacity_) {
+    // Upload data array to GPU and leave room for growth, such that appended
+    // data can be uploaded without reallocating the buffer.
+    capacity_ = 2 * data.size();
+    vbo_.setUsagePattern(QOpenGLBuffer::DynamicDraw);
+    vbo_.allocate(static_cast<int>(capacity_ * sizeof(LinePainter::Data)));
+    vbo_.write(0,
+               data.data(),
+               static_cast<int>(data.size() * sizeof(LinePainter::Data)));
+
+    // in_position
+    shader_program_.enableAttributeArray("a_pos");
+    shader_program_.setAttributeBuffer(
+        "a_pos", GL_FLOAT, 0, 3, sizeof(PointPainter::Data));
+
+    // in_color
+    shader_program_.enableAttributeArray("a_color");
+    shader_program_.setAttributeBuffer("a_color",
+                                       GL_FLOAT,
+                                       3 * sizeof(GLfloat),
+                                       4,
+                                       sizeof(PointPainter::Data));
+  } else {
+    // Only upload the data that changed since the last upload.
+    size_t begin;
+    size_t end;
+    FindChangedRange(uploaded_data_, data, &begin, &end);
+    if (begin < end) {
+      const size_t num_bytes = (end - begin) * sizeof(LinePainter::Data);
+      vbo_.write(static_cast<int>(begin * sizeof(LinePainter::Data)),
+                 data.data() + begin,
+                 static_cast<int>(num_bytes));
+    }
+  }
 
-  // in_color
-  shader_program_.enableAttributeArray("a_color");
-  shader_program_.setAttributeBuffer(
-      "a_color", GL_FLOAT, 3 * sizeof(GLfloat), 4, sizeof(PointPainter::Data));
+  uploaded_data_ = data;
 
   // Make sure they are not changed from the outside
   vbo_.release();
@@ -0,0 +1,204 @@
+#include "colmap/ui/match_matrix.h"
+
+#include "colmap/util/logging.h"
+
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+
+namespace colmap {
+namespace {
+
+// Sort the entries of a row by their column and merge duplicate columns to
+// their maximum value.
+void SortAndMergeRow(std::vector<MatchMatrix::Entry>* entries,
+                     const size_t begin) {
+  const auto row_begin = entries->begin() + begin;
+  std::sort(row_begin,
+            entries->end(),
+            [](const MatchMatrix::Entry& entry1,
+               const MatchMatrix::Entry& entry2) {
+              return entry1.col < entry2.col;
+            });
+  size_t num_merged = begin;
+  for (size_t i = begin; i < entries->size(); ++i) {
+    const MatchMatrix::Entry& entry = (*entries)[i];
+    if (num_merged > begin && (*entries)[num_merged - 1].col == entry.col) {
+      (*entries)[num_merged - 1].value =
+          std::max((*entries)[num_merged - 1].value, entry.value);
+    } else {
+      (*entries)[num_merged++] = entry;
+    }
+  }
+  entries->resize(num_merged);
+}
+
+}  // namespace
+
+void MatchMatrix::Build(
+    const std::vector<image_t>& image_ids,
+    const std::vector<std::pair<image_t, image_t>>& image_pairs,
+    const std::vector<int>& num_inliers) {
+  CHECK_EQ(image_pairs.size(), num_inliers.size());
+
+  num_images_ = image_ids.size();
+  max_value_ = 0;
+  levels_.clear();
+  if (num_images_ == 0) {
+    return;
+  }
+
+  std::unordered_map<image_t, uint32_t> image_id_to_idx;
+  image_id_to_idx.reserve(image_ids.size());
+  for (size_t idx = 0; idx < image_ids.size(); ++idx) {
+    image_id_to_idx.emplace(image_ids[idx], static_cast<uint32_t>(idx));
+  }
+
+  // Bucket the symmetric entries of the finest level by their row in a single
+  // pass over the image pairs.
+  std::vector<std::pair<uint32_t, uint32_t>> idx_pairs;
+  std::vector<int> values;
+  idx_pairs.reserve(image_pairs.size());
+  values.reserve(image_pairs.size());
+  Level level;
+  level.size = num_images_;
+  level.row_offsets.resize(num_images_ + 1, 0);
+  for (size_t i = 0; i < image_pairs.size(); ++i) {
+    const auto idx1 = image_id_to_idx.find(image_pairs[i].first);
+    const auto idx2 = image_id_to_idx.find(image_pairs[i].second);
+    if (num_inliers[i] <= 0 || idx1 == image_id_to_idx.end() ||
+        idx2 == image_id_to_idx.end()) {
+      continue;
+    }
+    idx_pairs.emplace_back(idx1->second, idx2->second);
+    values.push_back(num_inliers[i]);
+    max_value_ = std::max(max_value_, num_inliers[i]);
+    level.row_offsets[idx1->second + 1] += 1;
+    level.row_offsets[idx2->second + 1] += 1;
+  }
+
+  for (size_t row = 0; row < num_images_; ++row) {
+    level.row_offsets[row + 1] += level.row_offsets[row];
+  }
+
+  level.entries.resize(level.row_offsets.back());
+  std::vector<size_t> row_ends(level.row_offsets.begin(),
+                               level.row_offsets.end() - 1);
+  for (size_t i = 0; i < idx_pairs.size(); ++i) {
+    const uint32_t idx1 = idx_pairs[i].first;
+    const uint32_t idx2 = idx_pairs[i].second;
+    level.entries[row_ends[idx1]++] = Entry{idx2, values[i]};
+    level.entries[row_ends[idx2]++] = Entry{idx1, values[i]};
+  }
+
+  std::vector<Entry> sorted_entries;
+  sorted_entries.reserve(level.entries.size());
+  for (size_t row = 0; row < num_images_; ++row) {
+    const size_t begin = sorted_entries.size();
+    sorted_entries.insert(sorted_entries.end(),
+                          level.entries.begin() + level.row_offsets[row],
+                          level.entries.begin() + level.row_offsets[row + 1]);
+    SortAndMergeRow(&sorted_entries, begin);
+    level.row_offsets[row] = begin;
+  }
+  level.row_offsets.back() = sorted_entries.size();
+  level.entries = std::move(sorted_entries);
+  levels_.push_back(std::move(level));
+
+  // Aggregate blocks of 2x2 cells to the coarser levels.
+  while (levels_.back().size > 1) {
+    const Level& fine_level = levels_.back();
+    Level coarse_level;
+    coarse_level.size = (fine_level.size + 1) / 2;
+    coarse_level.row_offsets.reserve(coarse_level.size + 1);
+    for (size_t row = 0; row < coarse_level.size; ++row) {
+      coarse_level.row_offsets.push_back(coarse_level.entries.size());
+      const size_t begin = coarse_level.entries.size();
+      const size_t fine_row_end = std::min(2 * row + 2, fine_level.size);
+      for (size_t fine_row = 2 * row; fine_row < fine_row_end; ++fine_row) {
+        for (size_t i = fine_level.row_offsets[fine_row];
+             i < fine_level.row_offsets[fine_row + 1];
+             ++i) {
+          const Entry& entry = fine_level.entries[i];
+          coarse_level.entries.push_back(Entry{entry.col / 2, entry.value});
+        }
+      }
+      SortAndMergeRow(&coarse_level.entries, begin);
+    }
+    coarse_level.row_offsets.push_back(coarse_level.entries.size());
+    levels_.push_back(std::move(coarse_level));
+  }
+}
+
+size_t MatchMatrix::NumImages() const { return num_images_; }
+
+int MatchMatrix::MaxValue() const { return max_value_; }
+
+int MatchMatrix::NumLevels() const { return static_cast<int>(levels_.size()); }
+
+size_t MatchMatrix::LevelSize(const int level) const {
+  return levels_.at(level).size;
+}
+
+std::pair<const MatchMatrix::Entry*, const MatchMatrix::Entry*>
+MatchMatrix::Row(const int level, const size_t row) const {
+  const Level& matrix_level = levels_.at(level);
+  CHECK_LT(row, matrix_level.size);
+  const Entry* entries = matrix_level.entries.data();
+  return {entries + matrix_level.row_offsets[row],
+          entries + matrix_level.row_offsets[row + 1]};
+}
+
+int MatchMatrix::Value(const int level,
+                       const size_t row,
+                       const size_t col) const {
+  const auto entries = Row(level, row);
+  const Entry* entry = std::lower_bound(
+      entries.first,
+      entries.second,
+      col,
+      [](const Entry& entry, const size_t col) { return entry.col < col; });
+  if (entry == entries.second || entry->col != col) {
+    return 0;
+  }
+  return entry->value;
+}
+
+Bitmap MatchMatrix::Render(const int level,
+                           const size_t row_begin,
+                           const size_t col_begin,
+                           const size_t num_rows,
+                           const size_t num_cols) const {
+  Bitmap bitmap;
+  bitmap.Allocate(
+      static_cast<int>(num_cols), static_cast<int>(num_rows), /*as_rgb=*/true);
+  bitmap.Fill(BitmapColor<uint8_t>(255));
+  if (max_value_ == 0) {
+    return bitmap;
+  }
+
+  const double max_value = std::log1p(max_value_);
+  const size_t col_end = col_begin + num_cols;
+  const size_t row_end = std::min(row_begin + num_rows, LevelSize(level));
+  for (size_t row = row_begin; row < row_end; ++row) {
+    const auto entries = Row(level, row);
+    const Entry* entry = std::lower_bound(
+        entries.first,
+        entries.second,
+        col_begin,
+        [](const Entry& entry, const size_t col) { return entry.col < col; });
+    for (; entry != entries.second && entry->col < col_end; ++entry) {
+      const double value = std::log1p(entry->value) / max_value;
+      const BitmapColor<float> color(255 * JetColormap::Red(value),
+                                     255 * JetColormap::Green(value),
+                                     255 * JetColormap::Blue(value));
+      bitmap.SetPixel(static_cast<int>(entry->col - col_begin),
+                      static_cast<int>(row - row_begin),
+                      color.Cast<uint8_t>());
+    }
+  }
+
+  return bitmap;
+}
+
+}  // namespace colmap
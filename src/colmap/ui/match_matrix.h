@@ -0,0 +1,71 @@
+#pragma once
+
+#include "colmap/sensor/bitmap.h"
+#include "colmap/util/types.h"
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace colmap {
+
+// Multi-resolution sparse matrix of the number of inlier matches between all
+// pairs of images for the visualization of large databases. Level 0 holds one
+// cell per image pair and every coarser level aggregates blocks of 2x2 cells
+// of the previous level to their maximum, such that a view at any zoom only
+// touches as many cells as it shows pixels. The levels are stored as sparse
+// rows, whose memory is bounded by the number of image pairs per level.
+class MatchMatrix {
+ public:
+  struct Entry {
+    uint32_t col;
+    int value;
+  };
+
+  // Build the levels from the number of inliers of the image pairs. The rows
+  // and columns of the matrix are given by the order of the images. Image
+  // pairs with unknown images or without inliers are ignored.
+  void Build(const std::vector<image_t>& image_ids,
+             const std::vector<std::pair<image_t, image_t>>& image_pairs,
+             const std::vector<int>& num_inliers);
+
+  size_t NumImages() const;
+  int MaxValue() const;
+
+  // The number of levels, where the coarsest level has a single cell.
+  int NumLevels() const;
+
+  // The number of rows and columns of the level, where every cell covers
+  // `1 << level` images in both dimensions.
+  size_t LevelSize(int level) const;
+
+  // The non-zero cells of a row of the level sorted by their column.
+  std::pair<const Entry*, const Entry*> Row(int level, size_t row) const;
+
+  // The value of a cell or zero for cells without inlier matches.
+  int Value(int level, size_t row, size_t col) const;
+
+  // Render the cells [row_begin, row_begin + num_rows) x
+  // [col_begin, col_begin + num_cols) of the level with one pixel per cell,
+  // where empty cells and cells outside of the matrix are white. The values
+  // are colored on a logarithmic scale relative to `MaxValue`.
+  Bitmap Render(int level,
+                size_t row_begin,
+                size_t col_begin,
+                size_t num_rows,
+                size_t num_cols) const;
+
+ private:
+  struct Level {
+    size_t size = 0;
+    // The entries of row i are in [row_offsets[i], row_offsets[i + 1]).
+    std::vector<size_t> row_offsets;
+    std::vector<Entry> entries;
+  };
+
+  size_t num_images_ = 0;
+  int max_value_ = 0;
+  std::vector<Level> levels_;
+};
+
+}  // namespace colmap
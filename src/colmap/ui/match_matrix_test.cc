@@ -0,0 +1,78 @@
+#include "colmap/ui/match_matrix.h"
+
+#include <gtest/gtest.h>
+
+namespace colmap {
+namespace {
+
+TEST(MatchMatrix, Empty) {
+  MatchMatrix match_matrix;
+  match_matrix.Build({}, {}, {});
+  EXPECT_EQ(match_matrix.NumImages(), 0);
+  EXPECT_EQ(match_matrix.NumLevels(), 0);
+}
+
+TEST(MatchMatrix, Levels) {
+  MatchMatrix match_matrix;
+  // The rows are given by the order of the images and unknown images or pairs
+  // without inliers are ignored.
+  match_matrix.Build({5, 4, 3, 2, 1},
+                     {{5, 4}, {1, 5}, {3, 1}, {2, 1}, {2, 6}, {4, 3}},
+                     {10, 20, 30, 40, 50, 0});
+  EXPECT_EQ(match_matrix.NumImages(), 5);
+  EXPECT_EQ(match_matrix.MaxValue(), 40);
+  ASSERT_EQ(match_matrix.NumLevels(), 4);
+  EXPECT_EQ(match_matrix.LevelSize(0), 5);
+  EXPECT_EQ(match_matrix.LevelSize(1), 3);
+  EXPECT_EQ(match_matrix.LevelSize(2), 2);
+  EXPECT_EQ(match_matrix.LevelSize(3), 1);
+
+  EXPECT_EQ(match_matrix.Value(0, 0, 1), 10);
+  EXPECT_EQ(match_matrix.Value(0, 1, 0), 10);
+  EXPECT_EQ(match_matrix.Value(0, 0, 4), 20);
+  EXPECT_EQ(match_matrix.Value(0, 4, 2), 30);
+  EXPECT_EQ(match_matrix.Value(0, 3, 4), 40);
+  EXPECT_EQ(match_matrix.Value(0, 1, 2), 0);
+  EXPECT_EQ(match_matrix.Value(0, 0, 0), 0);
+
+  // Blocks of 2x2 cells are aggregated to their maximum.
+  EXPECT_EQ(match_matrix.Value(1, 0, 0), 10);
+  EXPECT_EQ(match_matrix.Value(1, 0, 2), 20);
+  EXPECT_EQ(match_matrix.Value(1, 1, 2), 40);
+  EXPECT_EQ(match_matrix.Value(1, 2, 1), 40);
+  EXPECT_EQ(match_matrix.Value(1, 1, 1), 0);
+  EXPECT_EQ(match_matrix.Value(2, 0, 0), 10);
+  EXPECT_EQ(match_matrix.Value(2, 0, 1), 40);
+  EXPECT_EQ(match_matrix.Value(3, 0, 0), 40);
+
+  const auto row = match_matrix.Row(0, 4);
+  ASSERT_EQ(row.second - row.first, 3);
+  EXPECT_EQ(row.first[0].col, 0);
+  EXPECT_EQ(row.first[1].col, 2);
+  EXPECT_EQ(row.first[2].col, 3);
+}
+
+TEST(MatchMatrix, Render) {
+  MatchMatrix match_matrix;
+  match_matrix.Build({1, 2, 3}, {{1, 2}, {2, 3}}, {10, 100});
+
+  const Bitmap bitmap = match_matrix.Render(0, 1, 0, 3, 4);
+  EXPECT_EQ(bitmap.Width(), 4);
+  EXPECT_EQ(bitmap.Height(), 3);
+  BitmapColor<uint8_t> color;
+  const BitmapColor<uint8_t> white(255);
+  ASSERT_TRUE(bitmap.GetPixel(0, 0, &color));
+  EXPECT_NE(color, white);
+  ASSERT_TRUE(bitmap.GetPixel(1, 0, &color));
+  EXPECT_EQ(color, white);
+  ASSERT_TRUE(bitmap.GetPixel(2, 0, &color));
+  EXPECT_NE(color, white);
+  // Cells outside of the matrix.
+  ASSERT_TRUE(bitmap.GetPixel(3, 0, &color));
+  EXPECT_EQ(color, white);
+  ASSERT_TRUE(bitmap.GetPixel(0, 2, &color));
+  EXPECT_EQ(color, white);
+}
+
+}  // namespace
+}  // namespace colmap
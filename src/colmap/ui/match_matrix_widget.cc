@@ -29,11 +29,272 @@
 
 #include "colmap/ui/match_matrix_widget.h"
 
+#include "colmap/ui/qt_utils.h"
+
+#include <algorithm>
+#include <cmath>
+
 namespace colmap {
 
+const int MatchMatrixItem::kTileSize = 256;
+
+MatchMatrixItem::MatchMatrixItem(const MatchMatrix* match_matrix)
+    : match_matrix_(match_matrix), tiles_(256) {
+  setFlag(QGraphicsItem::ItemUsesExtendedStyleOption);
+}
+
+QRectF MatchMatrixItem::boundingRect() const {
+  const qreal size = static_cast<qreal>(match_matrix_->NumImages());
+  return QRectF(0, 0, size, size);
+}
+
+void MatchMatrixItem::paint(QPainter* painter,
+                            const QStyleOptionGraphicsItem* option,
+                            QWidget* widget) {
+  if (match_matrix_->NumLevels() == 0) {
+    return;
+  }
+
+  // Choose the finest level, whose cells cover at least one screen pixel.
+  const qreal pixels_per_image =
+      option->levelOfDetailFromTransform(painter->worldTransform());
+  int level = 0;
+  while (level + 1 < match_matrix_->NumLevels() &&
+         (1 << level) * pixels_per_image < 1) {
+    level += 1;
+  }
+
+  const size_t level_size = match_matrix_->LevelSize(level);
+  const qreal tile_extent = static_cast<qreal>(kTileSize << level);
+  const QRectF exposed_rect = option->exposedRect.intersected(boundingRect());
+  const size_t num_tiles = (level_size + kTileSize - 1) / kTileSize;
+  const size_t tile_col_begin =
+      static_cast<size_t>(std::max(0.0, exposed_rect.left() / tile_extent));
+  const size_t tile_row_begin =
+      static_cast<size_t>(std::max(0.0, exposed_rect.top() / tile_extent));
+  const size_t tile_col_end = std::min(
+      num_tiles,
+      static_cast<size_t>(std::ceil(exposed_rect.right() / tile_extent)));
+  const size_t tile_row_end = std::min(
+      num_tiles,
+      static_cast<size_t>(std::ceil(exposed_rect.bottom() / tile_extent)));
+
+  for (size_t tile_row = tile_row_begin; tile_row < tile_row_end;
+       ++tile_row) {
+    for (size_t tile_col = tile_col_begin; tile_col < tile_col_end;
+         ++tile_col) {
+      const quint64 key = (static_cast<quint64>(level) << 58) |
+                          (static_cast<quint64>(tile_row) << 29) | tile_col;
+      QImage* tile = tiles_.object(key);
+      if (tile == nullptr) {
+        const size_t row_begin = tile_row * kTileSize;
+        const size_t col_begin = tile_col * kTileSize;
+        tile = new QImage(BitmapToQImageRGB(match_matrix_->Render(
+            level,
+            row_begin,
+            col_begin,
+            std::min<size_t>(kTileSize, level_size - row_begin),
+            std::min<size_t>(kTileSize, level_size - col_begin))));
+        tiles_.insert(key, tile);
+      }
+      // The cells of coarse levels may extend beyond the last image.
+      const qreal cell_extent = static_cast<qreal>(1 << level);
+      const QRectF target_rect =
+          QRectF(tile_col * tile_extent,
+                 tile_row * tile_extent,
+                 tile->width() * cell_extent,
+                 tile->height() * cell_extent)
+              .intersected(boundingRect());
+      painter->drawImage(target_rect,
+                         *tile,
+                         QRectF(0,
+                                0,
+                                target_rect.width() / cell_extent,
+                                target_rect.height() / cell_extent));
+    }
+  }
+}
+
+void MatchMatrixItem::ClearCache() {
+  prepareGeometryChange();
+  tiles_.clear();
+}
+
+MatchMatrixPairsModel::MatchMatrixPairsModel(QObject* parent)
+    : QAbstractTableModel(parent) {}
+
+void MatchMatrixPairsModel::SetPairs(
+    const MatchMatrix& match_matrix,
+    const std::vector<std::string>& image_names) {
+  beginResetModel();
+  image_names_ = image_names;
+  pairs_.clear();
+  if (match_matrix.NumLevels() > 0) {
+    for (size_t row = 0; row < match_matrix.NumImages(); ++row) {
+      const auto entries = match_matrix.Row(0, row);
+      for (auto entry = entries.first; entry != entries.second; ++entry) {
+        if (entry->col > row) {
+          pairs_.push_back(
+              Pair{static_cast<uint32_t>(row), entry->col, entry->value});
+        }
+      }
+    }
+  }
+  endResetModel();
+  sort(3, Qt::AscendingOrder);
+}
+
+std::pair<size_t, size_t> MatchMatrixPairsModel::PairIdxs(
+    const int row) const {
+  const Pair& pair = pairs_.at(row);
+  return {pair.idx1, pair.idx2};
+}
+
+int MatchMatrixPairsModel::rowCount(const QModelIndex& parent) const {
+  return parent.isValid() ? 0 : static_cast<int>(pairs_.size());
+}
+
+int MatchMatrixPairsModel::columnCount(const QModelIndex& parent) const {
+  return parent.isValid() ? 0 : 4;
+}
+
+QVariant MatchMatrixPairsModel::data(const QModelIndex& index,
+                                     const int role) const {
+  if (!index.isValid() || role != Qt::DisplayRole) {
+    return QVariant();
+  }
+
+  const Pair& pair = pairs_.at(index.row());
+  switch (index.column()) {
+    case 0:
+      return QString::fromStdString(image_names_[pair.idx1]);
+    case 1:
+      return QString::fromStdString(image_names_[pair.idx2]);
+    case 2:
+      return pair.num_inliers;
+    case 3:
+      return pair.idx2 - pair.idx1;
+    default:
+      return QVariant();
+  }
+}
+
+QVariant MatchMatrixPairsModel::headerData(const int section,
+                                           const Qt::Orientation orientation,
+                                           const int role) const {
+  if (orientation != Qt::Horizontal || role != Qt::DisplayRole) {
+    return QVariant();
+  }
+
+  switch (section) {
+    case 0:
+      return tr("Image 1");
+    case 1:
+      return tr("Image 2");
+    case 2:
+      return tr("Inliers");
+    case 3:
+      return tr("Distance");
+    default:
+      return QVariant();
+  }
+}
+
+void MatchMatrixPairsModel::sort(const int column, const Qt::SortOrder order) {
+  // Sort by the column and then by the proximity of the images.
+  const auto key = [this, column](const Pair& pair) {
+    const uint32_t distance = pair.idx2 - pair.idx1;
+    switch (column) {
+      case 0:
+        return std::make_pair(pair.idx1, pair.idx2);
+      case 1:
+        return std::make_pair(pair.idx2, pair.idx1);
+      case 2:
+        return std::make_pair(static_cast<uint32_t>(pair.num_inliers),
+                              distance);
+      default:
+        return std::make_pair(distance, pair.idx1);
+    }
+  };
+
+  emit layoutAboutToBeChanged();
+  std::sort(pairs_.begin(),
+            pairs_.end(),
+            [&key, order](const Pair& pair1, const Pair& pair2) {
+              return order == Qt::AscendingOrder ? key(pair1) < key(pair2)
+                                                 : key(pair2) < key(pair1);
+            });
+  emit layoutChanged();
+}
+
+const double MatchMatrixWidget::kZoomFactor = 1.20;
+
 MatchMatrixWidget::MatchMatrixWidget(QWidget* parent, OptionManager* options)
-    : ImageViewerWidget(parent), options_(options) {
+    : QWidget(parent), options_(options) {
+  setWindowFlags(Qt::Window | Qt::WindowTitleHint |
+                 Qt::WindowMinimizeButtonHint | Qt::WindowMaximizeButtonHint |
+                 Qt::WindowCloseButtonHint);
   setWindowTitle("Match matrix");
+  resize(parent->width() - 20, parent->height() - 20);
+
+  QFont font;
+  font.setPointSize(10);
+  setFont(font);
+
+  QGridLayout* grid_layout = new QGridLayout(this);
+  grid_layout->setContentsMargins(5, 5, 5, 5);
+
+  graphics_scene_ = new QGraphicsScene(this);
+  match_matrix_item_ = new MatchMatrixItem(&match_matrix_);
+  graphics_scene_->addItem(match_matrix_item_);
+
+  graphics_view_ = new QGraphicsView(graphics_scene_);
+  graphics_view_->setAlignment(Qt::AlignLeft | Qt::AlignTop);
+  graphics_view_->setDragMode(QGraphicsView::ScrollHandDrag);
+  graphics_view_->setTransformationAnchor(QGraphicsView::AnchorUnderMouse);
+
+  pairs_model_ = new MatchMatrixPairsModel(this);
+  pairs_view_ = new QTableView(this);
+  pairs_view_->setModel(pairs_model_);
+  pairs_view_->setSortingEnabled(true);
+  pairs_view_->setSelectionBehavior(QAbstractItemView::SelectRows);
+  pairs_view_->setEditTriggers(QAbstractItemView::NoEditTriggers);
+  pairs_view_->horizontalHeader()->setStretchLastSection(true);
+  pairs_view_->verticalHeader()->hide();
+  connect(pairs_view_,
+          &QTableView::doubleClicked,
+          this,
+          &MatchMatrixWidget::ShowPair);
+
+  tab_widget_ = new QTabWidget(this);
+  tab_widget_->addTab(graphics_view_, tr("Matrix"));
+  tab_widget_->addTab(pairs_view_, tr("Pairs"));
+  grid_layout->addWidget(tab_widget_, 1, 0);
+
+  QHBoxLayout* button_layout = new QHBoxLayout();
+
+  QPushButton* zoom_in_button = new QPushButton("+", this);
+  zoom_in_button->setFont(font);
+  zoom_in_button->setFixedWidth(50);
+  button_layout->addWidget(zoom_in_button);
+  connect(
+      zoom_in_button, &QPushButton::released, this, &MatchMatrixWidget::ZoomIn);
+
+  QPushButton* zoom_out_button = new QPushButton("-", this);
+  zoom_out_button->setFont(font);
+  zoom_out_button->setFixedWidth(50);
+  button_layout->addWidget(zoom_out_button);
+  connect(zoom_out_button,
+          &QPushButton::released,
+          this,
+          &MatchMatrixWidget::ZoomOut);
+
+  QPushButton* save_button = new QPushButton("Save view", this);
+  save_button->setFont(font);
+  button_layout->addWidget(save_button);
+  connect(save_button, &QPushButton::released, this, &MatchMatrixWidget::Save);
+
+  grid_layout->addLayout(button_layout, 2, 0, Qt::AlignRight);
 }
 
 void MatchMatrixWidget::Show() {
@@ -51,38 +312,62 @@ void MatchMatrixWidget::Show() {
               return image1.Name() < image2.Name();
             });
 
-  // Allocate the match matrix image.
-  Bitmap match_matrix;
-  match_matrix.Allocate(images.size(), images.size(), true);
-  match_matrix.Fill(BitmapColor<uint8_t>(255));
-
-  // Map image identifiers to match matrix locations.
-  std::unordered_map<image_t, size_t> image_id_to_idx;
-  for (size_t idx = 0; idx < images.size(); ++idx) {
-    image_id_to_idx.emplace(images[idx].ImageId(), idx);
+  std::vector<image_t> image_ids;
+  std::vector<std::string> image_names;
+  image_ids.reserve(images.size());
+  image_names.reserve(images.size());
+  for (const auto& image : images) {
+    image_ids.push_back(image.ImageId());
+    image_names.push_back(image.Name());
   }
 
   std::vector<std::pair<image_t, image_t>> image_pairs;
   std::vector<int> num_inliers;
   database.ReadTwoViewGeometryNumInliers(&image_pairs, &num_inliers);
 
-  // Fill the match matrix.
-  if (!num_inliers.empty()) {
-    const double max_value =
-        std::log1p(*std::max_element(num_inliers.begin(), num_inliers.end()));
-    for (size_t i = 0; i < image_pairs.size(); ++i) {
-      const double value = std::log1p(num_inliers[i]) / max_value;
-      const size_t idx1 = image_id_to_idx.at(image_pairs[i].first);
-      const size_t idx2 = image_id_to_idx.at(image_pairs[i].second);
-      const BitmapColor<float> color(255 * JetColormap::Red(value),
-                                     255 * JetColormap::Green(value),
-                                     255 * JetColormap::Blue(value));
-      match_matrix.SetPixel(idx1, idx2, color.Cast<uint8_t>());
-      match_matrix.SetPixel(idx2, idx1, color.Cast<uint8_t>());
-    }
+  match_matrix_item_->ClearCache();
+  match_matrix_.Build(image_ids, image_pairs, num_inliers);
+  pairs_model_->SetPairs(match_matrix_, image_names);
+
+  graphics_scene_->setSceneRect(match_matrix_item_->boundingRect());
+
+  show();
+  graphics_view_->fitInView(graphics_scene_->sceneRect(), Qt::KeepAspectRatio);
+
+  raise();
+}
+
+void MatchMatrixWidget::ZoomIn() {
+  graphics_view_->scale(kZoomFactor, kZoomFactor);
+}
+
+void MatchMatrixWidget::ZoomOut() {
+  graphics_view_->scale(1.0 / kZoomFactor, 1.0 / kZoomFactor);
+}
+
+void MatchMatrixWidget::Save() {
+  QString filter("PNG (*.png)");
+  const QString save_path =
+      QFileDialog::getSaveFileName(this,
+                                   tr("Select destination..."),
+                                   "",
+                                   "PNG (*.png);;JPEG (*.jpg);;BMP (*.bmp)",
+                                   &filter);
+
+  // Selection canceled?
+  if (save_path.isEmpty()) {
+    return;
   }
 
-  ShowBitmap(match_matrix);
+  // Only the current view is saved, since the full resolution matrix of large
+  // databases does not fit into memory.
+  graphics_view_->viewport()->grab().save(save_path);
+}
+
+void MatchMatrixWidget::ShowPair(const QModelIndex& index) {
+  const std::pair<size_t, size_t> idxs = pairs_model_->PairIdxs(index.row());
+  tab_widget_->setCurrentWidget(graphics_view_);
+  graphics_view_->centerOn(idxs.second + 0.5, idxs.first + 0.5);
 }
 
 }  // namespace colmap
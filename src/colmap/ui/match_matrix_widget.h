@@ -30,19 +30,95 @@
 #pragma once
 
 #include "colmap/controllers/option_manager.h"
-#include "colmap/ui/image_viewer_widget.h"
+#include "colmap/ui/match_matrix.h"
+
+#include <QtCore>
+#include <QtWidgets>
 
 namespace colmap {
 
-// Widget to visualize match matrix.
-class MatchMatrixWidget : public ImageViewerWidget {
+// Graphics item of the match matrix with one scene unit per image. Only the
+// visible tiles of the level, whose cells cover at least one screen pixel at
+// the current zoom, are rendered on demand and cached.
+class MatchMatrixItem : public QGraphicsItem {
+ public:
+  explicit MatchMatrixItem(const MatchMatrix* match_matrix);
+
+  QRectF boundingRect() const override;
+
+  void paint(QPainter* painter,
+             const QStyleOptionGraphicsItem* option,
+             QWidget* widget) override;
+
+  // Clear the cached tiles after rebuilding the match matrix.
+  void ClearCache();
+
+ private:
+  // The number of cells per tile in both dimensions.
+  static const int kTileSize;
+
+  const MatchMatrix* match_matrix_;
+  QCache<quint64, QImage> tiles_;
+};
+
+// Table of the image pairs with inlier matches, which are initially sorted by
+// the proximity of the images, i.e., the distance of their rows in the match
+// matrix, and can be sorted by any column.
+class MatchMatrixPairsModel : public QAbstractTableModel {
+ public:
+  explicit MatchMatrixPairsModel(QObject* parent);
+
+  void SetPairs(const MatchMatrix& match_matrix,
+                const std::vector<std::string>& image_names);
+
+  // The rows of the images of a pair in the match matrix.
+  std::pair<size_t, size_t> PairIdxs(int row) const;
+
+  int rowCount(const QModelIndex& parent) const override;
+  int columnCount(const QModelIndex& parent) const override;
+  QVariant data(const QModelIndex& index, int role) const override;
+  QVariant headerData(int section,
+                      Qt::Orientation orientation,
+                      int role) const override;
+  void sort(int column, Qt::SortOrder order) override;
+
+ private:
+  struct Pair {
+    uint32_t idx1;
+    uint32_t idx2;
+    int num_inliers;
+  };
+
+  std::vector<Pair> pairs_;
+  std::vector<std::string> image_names_;
+};
+
+// Widget to visualize the match matrix of large databases with a
+// multi-resolution match matrix and a sparse list of the image pairs.
+class MatchMatrixWidget : public QWidget {
  public:
   MatchMatrixWidget(QWidget* parent, OptionManager* options);
 
   void Show();
 
  private:
+  static const double kZoomFactor;
+
+  void ZoomIn();
+  void ZoomOut();
+  void Save();
+  void ShowPair(const QModelIndex& index);
+
   OptionManager* options_;
+
+  MatchMatrix match_matrix_;
+
+  QTabWidget* tab_widget_;
+  QGraphicsScene* graphics_scene_;
+  QGraphicsView* graphics_view_;
+  MatchMatrixItem* match_matrix_item_;
+  MatchMatrixPairsModel* pairs_model_;
+  QTableView* pairs_view_;
 };
 
 }  // namespace colmap
@@ -69,6 +69,23 @@ inline Eigen::Vector4f IndexToRGB(const size_t index) {
   return color;
 }
 
+// Generate camera dimensions in OpenGL (world) coordinate space.
+void ComputeImageModelSize(const Camera& camera,
+                           const float image_size,
+                           float* image_width,
+                           float* image_height,
+                           float* focal_length) {
+  const float kBaseCameraWidth = 1024.0f;
+  *image_width = image_size * camera.width / kBaseCameraWidth;
+  *image_height = *image_width * static_cast<float>(camera.height) /
+                  static_cast<float>(camera.width);
+  const float image_extent = std::max(*image_width, *image_height);
+  const float camera_extent = std::max(camera.width, camera.height);
+  const float camera_extent_normalized =
+      static_cast<float>(camera.CamFromImgThreshold(camera_extent));
+  *focal_length = 2.0f * image_extent / camera_extent_normalized;
+}
+
 void BuildImageModel(const Image& image,
                      const Camera& camera,
                      const float image_size,
@@ -76,16 +93,11 @@ void BuildImageModel(const Image& image,
                      const Eigen::Vector4f& frame_color,
                      std::vector<TrianglePainter::Data>* triangle_data,
                      std::vector<LinePainter::Data>* line_data) {
-  // Generate camera dimensions in OpenGL (world) coordinate space.
-  const float kBaseCameraWidth = 1024.0f;
-  const float image_width = image_size * camera.width / kBaseCameraWidth;
-  const float image_height = image_width * static_cast<float>(camera.height) /
-                             static_cast<float>(camera.width);
-  const float image_extent = std::max(image_width, image_height);
-  const float camera_extent = std::max(camera.width, camera.height);
-  const float camera_extent_normalized =
-      static_cast<float>(camera.CamFromImgThreshold(camera_extent));
-  const float focal_length = 2.0f * image_extent / camera_extent_normalized;
+  float image_width;
+  float image_height;
+  float focal_length;
+  ComputeImageModelSize(
+      camera, image_size, &image_width, &image_height, &focal_length);
 
   const Eigen::Matrix<float, 3, 4> inv_proj_matrix =
       Inverse(image.CamFromWorld()).ToMatrix().cast<float>();
@@ -492,11 +504,150 @@ void BuildPosePriorImageModel(const Image& image,
   }
 }
 
+// Number of samples per image border of the refractive image models.
+const int kNumRefracImageModelEdgeSamples = 8;
+
+// Trace the rays through the image border of a refractive camera in the
+// camera frame. The border rays are ordered along the border, starting at the
+// top-left corner, and are followed by the ray through the image center.
+void TraceRefracImageModelRays(const Camera& camera,
+                               std::vector<Eigen::Vector3f>* oris,
+                               std::vector<Eigen::Vector3f>* dirs) {
+  const double width = static_cast<double>(camera.width);
+  const double height = static_cast<double>(camera.height);
+  const std::array<Eigen::Vector2d, 4> corners = {
+      {Eigen::Vector2d(0, 0),
+       Eigen::Vector2d(width, 0),
+       Eigen::Vector2d(width, height),
+       Eigen::Vector2d(0, height)}};
+
+  std::vector<Eigen::Vector2d> image_points;
+  image_points.reserve(4 * kNumRefracImageModelEdgeSamples + 1);
+  for (int edge = 0; edge < 4; ++edge) {
+    const Eigen::Vector2d& begin = corners[edge];
+    const Eigen::Vector2d& end = corners[(edge + 1) % 4];
+    for (int i = 0; i < kNumRefracImageModelEdgeSamples; ++i) {
+      image_points.push_back(begin + (end - begin) * static_cast<double>(i) /
+                                         kNumRefracImageModelEdgeSamples);
+    }
+  }
+  image_points.emplace_back(0.5 * width, 0.5 * height);
+
+  Ray3DBatch rays;
+  camera.CamFromImgRefracBatch(image_points, &rays);
+
+  oris->resize(image_points.size());
+  dirs->resize(image_points.size());
+  for (size_t i = 0; i < image_points.size(); ++i) {
+    (*oris)[i] = rays.oris.row(i).matrix().transpose().cast<float>();
+    (*dirs)[i] = rays.dirs.row(i).matrix().transpose().cast<float>();
+  }
+}
+
+// Build the refracted viewing volume of an image from the rays traced by
+// `TraceRefracImageModelRays`. The rays are extended to the depth of the image
+// plane of `BuildImageModel`, whose border is drawn together with the border
+// of the refractive interface and the rays through the image corners. Returns
+// false if the ray through the image center is not valid.
+bool BuildRefracImageModel(const Image& image,
+                           const Camera& camera,
+                           const std::vector<Eigen::Vector3f>& oris,
+                           const std::vector<Eigen::Vector3f>& dirs,
+                           const float image_size,
+                           const Eigen::Vector4f& plane_color,
+                           const Eigen::Vector4f& frame_color,
+                           std::vector<TrianglePainter::Data>* triangle_data,
+                           std::vector<LinePainter::Data>* line_data) {
+  float image_width;
+  float image_height;
+  float focal_length;
+  ComputeImageModelSize(
+      camera, image_size, &image_width, &image_height, &focal_length);
+
+  const Eigen::Matrix<float, 3, 4> inv_proj_matrix =
+      Inverse(image.CamFromWorld()).ToMatrix().cast<float>();
+
+  // Rays that are totally reflected or point backwards are not drawn.
+  const size_t num_rays = oris.size();
+  std::vector<bool> valid(num_rays, false);
+  std::vector<Eigen::Vector3f> ori_points(num_rays);
+  std::vector<Eigen::Vector3f> far_points(num_rays);
+  for (size_t i = 0; i < num_rays; ++i) {
+    if (!oris[i].allFinite() || !dirs[i].allFinite() || dirs[i].z() <= 0) {
+      continue;
+    }
+    const float distance =
+        std::max(0.0f, (focal_length - oris[i].z()) / dirs[i].z());
+    valid[i] = true;
+    ori_points[i] = inv_proj_matrix * oris[i].homogeneous();
+    far_points[i] =
+        inv_proj_matrix * (oris[i] + distance * dirs[i]).homogeneous();
+  }
+
+  const size_t center_idx = num_rays - 1;
+  if (num_rays == 0 || !valid[center_idx]) {
+    return false;
+  }
+
+  const auto ToData = [](const Eigen::Vector3f& point,
+                         const Eigen::Vector4f& color) {
+    return PointPainter::Data(point(0),
+                              point(1),
+                              point(2),
+                              color(0),
+                              color(1),
+                              color(2),
+                              color(3));
+  };
+
+  const size_t num_border_rays = num_rays - 1;
+
+  // Curved image plane as a fan of triangles around the image center.
+  if (triangle_data != nullptr) {
+    for (size_t i = 0; i < num_border_rays; ++i) {
+      const size_t j = (i + 1) % num_border_rays;
+      if (valid[i] && valid[j]) {
+        triangle_data->emplace_back(ToData(far_points[center_idx], plane_color),
+                                    ToData(far_points[i], plane_color),
+                                    ToData(far_points[j], plane_color));
+      }
+    }
+  }
+
+  if (line_data != nullptr) {
+    // Border of the image plane and of the refractive interface.
+    for (size_t i = 0; i < num_border_rays; ++i) {
+      const size_t j = (i + 1) % num_border_rays;
+      if (valid[i] && valid[j]) {
+        line_data->emplace_back(ToData(far_points[i], frame_color),
+                                ToData(far_points[j], frame_color));
+        line_data->emplace_back(ToData(ori_points[i], frame_color),
+                                ToData(ori_points[j], frame_color));
+      }
+    }
+
+    // Rays through the image corners from the projection center.
+    const Eigen::Vector3f pc = inv_proj_matrix.rightCols<1>();
+    for (size_t i = 0; i < num_border_rays;
+         i += kNumRefracImageModelEdgeSamples) {
+      if (valid[i]) {
+        line_data->emplace_back(ToData(pc, frame_color),
+                                ToData(ori_points[i], frame_color));
+        line_data->emplace_back(ToData(ori_points[i], frame_color),
+                                ToData(far_points[i], frame_color));
+      }
+    }
+  }
+
+  return true;
+}
+
 }  // namespace
 
 ModelViewerWidget::ModelViewerWidget(QWidget* parent, OptionManager* options)
     : QOpenGLWidget(parent),
       options_(options),
+      points_pending_(false),
       point_viewer_widget_(new PointViewerWidget(parent, this, options)),
       image_viewer_widget_(
           new DatabaseImageViewerWidget(parent, this, options)),
@@ -541,11 +692,29 @@ void ModelViewerWidget::initializeGL() {
 }
 
 void ModelViewerWidget::paintGL() {
+  points_pending_ =
+      RenderScene(projection_matrix_,
+                  width(),
+                  height(),
+                  static_cast<int>(devicePixelRatio() * width()),
+                  static_cast<int>(devicePixelRatio() * height()));
+
+  // Continue streaming the points at the required level of detail.
+  if (points_pending_) {
+    update();
+  }
+}
+
+bool ModelViewerWidget::RenderScene(const QMatrix4x4& projection_matrix,
+                                    const int width,
+                                    const int height,
+                                    const int pixel_width,
+                                    const int pixel_height) {
   glClearColor(
       background_color_[0], background_color_[1], background_color_[2], 1.0f);
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-  const QMatrix4x4 pmv_matrix = projection_matrix_ * model_view_matrix_;
+  const QMatrix4x4 pmv_matrix = projection_matrix * model_view_matrix_;
 
   // Model view matrix for center of view
   QMatrix4x4 model_view_center_matrix = model_view_matrix_;
@@ -557,29 +726,34 @@ void ModelViewerWidget::paintGL() {
 
   // Coordinate system
   if (coordinate_grid_enabled_) {
-    const QMatrix4x4 pmvc_matrix =
-        projection_matrix_ * model_view_center_matrix;
-    coordinate_axes_painter_.Render(pmv_matrix, width(), height(), 2);
-    coordinate_grid_painter_.Render(pmvc_matrix, width(), height(), 1);
+    const QMatrix4x4 pmvc_matrix = projection_matrix * model_view_center_matrix;
+    coordinate_axes_painter_.Render(pmv_matrix, width, height, 2);
+    coordinate_grid_painter_.Render(pmvc_matrix, width, height, 1);
   }
 
   // Points
-  point_painter_.Render(pmv_matrix, point_size_);
-  point_connection_painter_.Render(pmv_matrix, width(), height(), 1);
+  PointLODPainter::Options point_options;
+  point_options.max_screen_error = options_->render->max_point_screen_error;
+  point_options.max_gpu_memory_mb = options_->render->max_point_gpu_memory_mb;
+  const bool points_pending = point_painter_.Render(
+      pmv_matrix, pixel_width, pixel_height, point_size_, point_options);
+  point_connection_painter_.Render(pmv_matrix, width, height, 1);
 
   // Images
-  image_line_painter_.Render(pmv_matrix, width(), height(), 1);
+  image_line_painter_.Render(pmv_matrix, width, height, 1);
   image_triangle_painter_.Render(pmv_matrix);
-  image_connection_painter_.Render(pmv_matrix, width(), height(), 1);
+  image_connection_painter_.Render(pmv_matrix, width, height, 1);
 
   // Movie grabber cameras
-  movie_grabber_path_painter_.Render(pmv_matrix, width(), height(), 1.5);
-  movie_grabber_line_painter_.Render(pmv_matrix, width(), height(), 1);
+  movie_grabber_path_painter_.Render(pmv_matrix, width, height, 1.5);
+  movie_grabber_line_painter_.Render(pmv_matrix, width, height, 1);
   movie_grabber_triangle_painter_.Render(pmv_matrix);
 
   // Pose priors
-  pose_prior_image_line_painter_.Render(pmv_matrix, width(), height(), 1);
+  pose_prior_image_line_painter_.Render(pmv_matrix, width, height, 1);
   pose_prior_image_triangle_painter_.Render(pmv_matrix);
+
+  return points_pending;
 }
 
 void ModelViewerWidget::resizeGL(int width, int height) {
@@ -613,6 +787,7 @@ void ModelViewerWidget::ReloadReconstruction() {
 
 void ModelViewerWidget::ClearReconstruction() {
   cameras.clear();
+  refrac_image_model_rays_.clear();
   images.clear();
   points3D.clear();
   reg_image_ids.clear();
@@ -789,15 +964,14 @@ void ModelViewerWidget::SelectObject(const int x, const int y) {
   glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-  // Upload data in selection mode (one color per object).
+  // Upload data in selection mode (one color per object). Points are picked
+  // against the last rendered level of detail instead.
   UploadImageData(true);
-  UploadPointData(true);
   UploadPosePriorData(true);
 
-  // Render in selection mode, with larger points to improve selection accuracy.
+  // Render in selection mode.
   const QMatrix4x4 pmv_matrix = projection_matrix_ * model_view_matrix_;
   image_triangle_painter_.Render(pmv_matrix);
-  point_painter_.Render(pmv_matrix, 2 * point_size_);
 
   const int scaled_x = devicePixelRatio() * x;
   const int scaled_y = devicePixelRatio() * (height() - y - 1);
@@ -826,7 +1000,18 @@ void ModelViewerWidget::SelectObject(const int x, const int y) {
 
   const size_t index = RGBToIndex(color[0], color[1], color[2]);
 
-  if (index < selection_buffer_.size()) {
+  // Points take precedence over images, with a larger pick radius than the
+  // rendered points to improve the selection accuracy.
+  point3D_t point3D_id;
+  if (point_painter_.Pick(devicePixelRatio() * (x + 0.5f),
+                          devicePixelRatio() * (y + 0.5f),
+                          std::max(point_size_, 3.0f),
+                          &point3D_id) &&
+      points3D.count(point3D_id) != 0) {
+    selected_image_id_ = kInvalidImageId;
+    selected_point3D_id_ = point3D_id;
+    ShowPointInfo(selected_point3D_id_);
+  } else if (index < selection_buffer_.size()) {
     const char buffer_type = selection_buffer_[index].second;
     if (buffer_type == SELECTION_BUFFER_IMAGE_IDX) {
       selected_image_id_ = static_cast<image_t>(selection_buffer_[index].first);
@@ -868,44 +1053,68 @@ void ModelViewerWidget::SelectMoviewGrabberView(const size_t view_idx) {
 }
 
 QImage ModelViewerWidget::GrabImage() {
-  makeCurrent();
-
   DisableCoordinateGrid();
+  const QImage image =
+      RenderImage(static_cast<int>(devicePixelRatio() * width()),
+                  static_cast<int>(devicePixelRatio() * height()));
+  EnableCoordinateGrid();
+  return image;
+}
 
-  paintGL();
+QImage ModelViewerWidget::RenderImage(const int width, const int height) {
+  CHECK_GT(width, 0);
+  CHECK_GT(height, 0);
 
-  const int scaled_width = static_cast<int>(devicePixelRatio() * width());
-  const int scaled_height = static_cast<int>(devicePixelRatio() * height());
+  makeCurrent();
 
-  QOpenGLFramebufferObjectFormat fbo_format;
-  fbo_format.setSamples(0);
-  QOpenGLFramebufferObject fbo(scaled_width, scaled_height, fbo_format);
+  // The framebuffers are reused between the frames of a movie.
+  if (render_fbo_ == nullptr || render_fbo_->width() != width ||
+      render_fbo_->height() != height) {
+    QOpenGLFramebufferObjectFormat fbo_format;
+    fbo_format.setAttachment(QOpenGLFramebufferObject::CombinedDepthStencil);
+    fbo_format.setSamples(format().samples());
+    render_fbo_ =
+        std::make_unique<QOpenGLFramebufferObject>(width, height, fbo_format);
+    if (fbo_format.samples() > 0) {
+      resolve_fbo_ = std::make_unique<QOpenGLFramebufferObject>(width, height);
+    } else {
+      resolve_fbo_.reset();
+    }
+  }
 
-  glBindFramebuffer(GL_READ_FRAMEBUFFER, defaultFramebufferObject());
-  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo.handle());
-  glBlitFramebuffer(0,
-                    0,
-                    scaled_width,
-                    scaled_height,
-                    0,
-                    0,
-                    scaled_width,
-                    scaled_height,
-                    GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT,
-                    GL_NEAREST);
+  render_fbo_->bind();
+  glViewport(0, 0, width, height);
 
-  fbo.bind();
-  QImage image(scaled_width, scaled_height, QImage::Format_RGB888);
-  glReadPixels(0,
-               0,
-               scaled_width,
-               scaled_height,
-               GL_RGB,
-               GL_UNSIGNED_BYTE,
-               image.bits());
-  fbo.release();
+  // Scale the line widths relative to the window, such that the image looks
+  // the same as on the screen.
+  const double line_scale = static_cast<double>(height) / (devicePixelRatio() *
+                                                           this->height());
+  const int line_width = static_cast<int>(width / line_scale);
+  const int line_height = static_cast<int>(height / line_scale);
+
+  // Render until all points are uploaded at the required level of detail.
+  const QMatrix4x4 projection_matrix =
+      ProjectionMatrix(static_cast<float>(width) / height);
+  while (RenderScene(
+      projection_matrix, line_width, line_height, width, height)) {
+  }
 
-  EnableCoordinateGrid();
+  QOpenGLFramebufferObject* read_fbo = render_fbo_.get();
+  if (resolve_fbo_ != nullptr) {
+    QOpenGLFramebufferObject::blitFramebuffer(resolve_fbo_.get(),
+                                              render_fbo_.get());
+    read_fbo = resolve_fbo_.get();
+  }
+
+  read_fbo->bind();
+  QImage image(width, height, QImage::Format_RGB888);
+  glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, image.bits());
+  read_fbo->release();
+
+  glViewport(0,
+             0,
+             static_cast<int>(devicePixelRatio() * this->width()),
+             static_cast<int>(devicePixelRatio() * this->height()));
 
   return image.mirrored();
 }
@@ -1136,85 +1345,46 @@ void ModelViewerWidget::UploadCoordinateGridData() {
   coordinate_axes_painter_.Upload(axes_data);
 }
 
-void ModelViewerWidget::UploadPointData(const bool selection_mode) {
-  makeCurrent();
+void ModelViewerWidget::UploadPointData() {
+  selected_image_point3D_ids_.clear();
+  if (images.count(selected_image_id_) != 0) {
+    for (const auto& point2D : images.at(selected_image_id_).Points2D()) {
+      if (point2D.HasPoint3D()) {
+        selected_image_point3D_ids_.insert(point2D.point3D_id);
+      }
+    }
+  }
 
   std::vector<PointPainter::Data> data;
+  std::vector<uint64_t> ids;
 
   // Assume we want to display the majority of points
   data.reserve(points3D.size());
+  ids.reserve(points3D.size());
 
   const size_t min_track_len =
       static_cast<size_t>(options_->render->min_track_len);
 
-  if (selected_image_id_ == kInvalidImageId &&
-      images.count(selected_image_id_) == 0) {
-    for (const auto& point3D : points3D) {
-      if (point3D.second.error <= options_->render->max_error &&
-          point3D.second.track.Length() >= min_track_len) {
-        PointPainter::Data painter_point;
-
-        painter_point.x = static_cast<float>(point3D.second.xyz(0));
-        painter_point.y = static_cast<float>(point3D.second.xyz(1));
-        painter_point.z = static_cast<float>(point3D.second.xyz(2));
-
-        Eigen::Vector4f color;
-        if (selection_mode) {
-          const size_t index = selection_buffer_.size();
-          selection_buffer_.push_back(
-              std::make_pair(point3D.first, SELECTION_BUFFER_POINT_IDX));
-          color = IndexToRGB(index);
-
-        } else if (point3D.first == selected_point3D_id_) {
-          color = kSelectedPointColor;
-        } else {
-          color = point_colormap_->ComputeColor(point3D.first, point3D.second);
-        }
-
-        painter_point.r = color(0);
-        painter_point.g = color(1);
-        painter_point.b = color(2);
-        painter_point.a = color(3);
-
-        data.push_back(painter_point);
-      }
-    }
-  } else {  // Image selected
-    const auto& selected_image = images[selected_image_id_];
-    for (const auto& point3D : points3D) {
-      if (point3D.second.error <= options_->render->max_error &&
-          point3D.second.track.Length() >= min_track_len) {
-        PointPainter::Data painter_point;
-
-        painter_point.x = static_cast<float>(point3D.second.xyz(0));
-        painter_point.y = static_cast<float>(point3D.second.xyz(1));
-        painter_point.z = static_cast<float>(point3D.second.xyz(2));
-
-        Eigen::Vector4f color;
-        if (selection_mode) {
-          const size_t index = selection_buffer_.size();
-          selection_buffer_.push_back(
-              std::make_pair(point3D.first, SELECTION_BUFFER_POINT_IDX));
-          color = IndexToRGB(index);
-        } else if (selected_image.HasPoint3D(point3D.first)) {
-          color = kSelectedImagePlaneColor;
-        } else if (point3D.first == selected_point3D_id_) {
-          color = kSelectedPointColor;
-        } else {
-          color = point_colormap_->ComputeColor(point3D.first, point3D.second);
-        }
-
-        painter_point.r = color(0);
-        painter_point.g = color(1);
-        painter_point.b = color(2);
-        painter_point.a = color(3);
-
-        data.push_back(painter_point);
-      }
+  for (const auto& point3D : points3D) {
+    if (point3D.second.error <= options_->render->max_error &&
+        point3D.second.track.Length() >= min_track_len) {
+      const Eigen::Vector4f color = PointColor(point3D.first);
+      data.emplace_back(static_cast<float>(point3D.second.xyz(0)),
+                        static_cast<float>(point3D.second.xyz(1)),
+                        static_cast<float>(point3D.second.xyz(2)),
+                        color(0),
+                        color(1),
+                        color(2),
+                        color(3));
+      ids.push_back(point3D.first);
     }
   }
 
-  point_painter_.Upload(data);
+  // The points are organized in the background and only the changed parts
+  // are uploaded again, which keeps the viewer responsive during live
+  // reconstruction.
+  point_painter_.SetPoints(
+      std::move(data), std::move(ids), PointOctree::Options());
 }
 
 void ModelViewerWidget::UploadPointConnectionData() {
@@ -1289,6 +1459,22 @@ void ModelViewerWidget::UploadImageData(const bool selection_mode) {
 
     // Lines are not colored with the indexed color in selection mode, so do not
     // show them, so they do not block the selection process
+    if (options_->render->refrac_image_models &&
+        camera.IsCameraRefractive()) {
+      const RefracImageModelRays& rays = GetRefracImageModelRays(camera);
+      if (BuildRefracImageModel(image,
+                                camera,
+                                rays.oris,
+                                rays.dirs,
+                                image_size_,
+                                plane_color,
+                                frame_color,
+                                &triangle_data,
+                                selection_mode ? nullptr : &line_data)) {
+        continue;
+      }
+    }
+
     BuildImageModel(image,
                     camera,
                     image_size_,
@@ -1496,22 +1682,54 @@ void ModelViewerWidget::UploadPosePriorData(const bool selection_mode) {
   pose_prior_image_triangle_painter_.Upload(triangle_data);
 }
 
+const ModelViewerWidget::RefracImageModelRays&
+ModelViewerWidget::GetRefracImageModelRays(const Camera& camera) {
+  // The rays only need to be traced again if the camera changed.
+  RefracImageModelRays& rays = refrac_image_model_rays_[camera.camera_id];
+  if (rays.oris.empty() || rays.camera.model_id != camera.model_id ||
+      rays.camera.refrac_model_id != camera.refrac_model_id ||
+      rays.camera.width != camera.width ||
+      rays.camera.height != camera.height ||
+      rays.camera.params != camera.params ||
+      rays.camera.refrac_params != camera.refrac_params) {
+    rays.camera = camera;
+    TraceRefracImageModelRays(camera, &rays.oris, &rays.dirs);
+  }
+  return rays;
+}
+
+Eigen::Vector4f ModelViewerWidget::PointColor(
+    const point3D_t point3D_id) const {
+  if (selected_image_point3D_ids_.count(point3D_id) != 0) {
+    return kSelectedImagePlaneColor;
+  } else if (point3D_id == selected_point3D_id_) {
+    return kSelectedPointColor;
+  } else {
+    return point_colormap_->ComputeColor(point3D_id, points3D.at(point3D_id));
+  }
+}
+
 void ModelViewerWidget::ComposeProjectionMatrix() {
-  projection_matrix_.setToIdentity();
+  projection_matrix_ = ProjectionMatrix(AspectRatio());
+}
+
+QMatrix4x4 ModelViewerWidget::ProjectionMatrix(const float aspect_ratio) const {
+  QMatrix4x4 projection_matrix;
   if (options_->render->projection_type ==
       RenderOptions::ProjectionType::PERSPECTIVE) {
-    projection_matrix_.perspective(
-        kFieldOfView, AspectRatio(), near_plane_, kFarPlane);
+    projection_matrix.perspective(
+        kFieldOfView, aspect_ratio, near_plane_, kFarPlane);
   } else if (options_->render->projection_type ==
              RenderOptions::ProjectionType::ORTHOGRAPHIC) {
     const float extent = OrthographicWindowExtent();
-    projection_matrix_.ortho(-AspectRatio() * extent,
-                             AspectRatio() * extent,
-                             -extent,
-                             extent,
-                             near_plane_,
-                             kFarPlane);
+    projection_matrix.ortho(-aspect_ratio * extent,
+                            aspect_ratio * extent,
+                            -extent,
+                            extent,
+                            near_plane_,
+                            kFarPlane);
   }
+  return projection_matrix;
 }
 
 float ModelViewerWidget::ZoomScale() const {
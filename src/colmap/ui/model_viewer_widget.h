@@ -36,11 +36,15 @@
 #include "colmap/ui/image_viewer_widget.h"
 #include "colmap/ui/line_painter.h"
 #include "colmap/ui/movie_grabber_widget.h"
+#include "colmap/ui/point_lod_painter.h"
 #include "colmap/ui/point_painter.h"
 #include "colmap/ui/point_viewer_widget.h"
 #include "colmap/ui/render_options.h"
 #include "colmap/ui/triangle_painter.h"
 
+#include <unordered_map>
+#include <unordered_set>
+
 #include <QOpenGLFunctions_3_2_Core>
 #include <QtCore>
 #include <QtOpenGL>
@@ -105,6 +109,10 @@ class ModelViewerWidget : public QOpenGLWidget,
   QImage GrabImage();
   void GrabMovie();
 
+  // Render the current view into an offscreen framebuffer of the given size
+  // in pixels independent of the size and visibility of the window.
+  QImage RenderImage(int width, int height);
+
   void ShowPointInfo(point3D_t point3D_id);
   void ShowImageInfo(image_t image_id);
 
@@ -117,9 +125,9 @@ class ModelViewerWidget : public QOpenGLWidget,
 
   // Copy of current scene data that is displayed
   std::shared_ptr<Reconstruction> reconstruction;
-  std::unordered_map<camera_t, Camera> cameras;
-  std::unordered_map<image_t, Image> images;
-  std::unordered_map<point3D_t, Point3D> points3D;
+  DenseIdMap<camera_t, Camera> cameras;
+  DenseIdMap<image_t, Image> images;
+  Point3DMap points3D;
   std::vector<image_t> reg_image_ids;
 
   Rigid3d prior_from_cam_;
@@ -134,6 +142,16 @@ class ModelViewerWidget : public QOpenGLWidget,
  private:
   void mousePressEvent(QMouseEvent* event) override;
   void mouseReleaseEvent(QMouseEvent* event) override;
+
+  // Render the scene into the bound framebuffer, where the logical size
+  // scales the line widths and the size in pixels the level of detail of
+  // the points. Returns true if the level of detail of the points is
+  // incomplete and the scene should be rendered again.
+  bool RenderScene(const QMatrix4x4& projection_matrix,
+                   int width,
+                   int height,
+                   int pixel_width,
+                   int pixel_height);
   void mouseMoveEvent(QMouseEvent* event) override;
   void wheelEvent(QWheelEvent* event) override;
 
@@ -142,7 +160,7 @@ class ModelViewerWidget : public QOpenGLWidget,
 
   void Upload();
   void UploadCoordinateGridData();
-  void UploadPointData(bool selection_mode = false);
+  void UploadPointData();
   void UploadPointConnectionData();
   void UploadImageData(bool selection_mode = false);
   void UploadImageConnectionData();
@@ -150,6 +168,19 @@ class ModelViewerWidget : public QOpenGLWidget,
   void UploadPosePriorData(const bool selection_mode = false);
 
   void ComposeProjectionMatrix();
+  QMatrix4x4 ProjectionMatrix(float aspect_ratio) const;
+
+  // The rays of the refractive image models, which are traced once per camera
+  // and reused for all images of the camera and all their poses.
+  struct RefracImageModelRays {
+    Camera camera;
+    std::vector<Eigen::Vector3f> oris;
+    std::vector<Eigen::Vector3f> dirs;
+  };
+
+  const RefracImageModelRays& GetRefracImageModelRays(const Camera& camera);
+
+  Eigen::Vector4f PointColor(point3D_t point3D_id) const;
 
   float ZoomScale() const;
   float AspectRatio() const;
@@ -165,9 +196,18 @@ class ModelViewerWidget : public QOpenGLWidget,
   LinePainter coordinate_axes_painter_;
   LinePainter coordinate_grid_painter_;
 
-  PointPainter point_painter_;
+  PointLODPainter point_painter_;
+  // Whether the level of detail of the last rendered points is incomplete.
+  bool points_pending_;
+
+  // Offscreen framebuffers of RenderImage, where multisampled images are
+  // resolved into a second framebuffer before reading them.
+  std::unique_ptr<QOpenGLFramebufferObject> render_fbo_;
+  std::unique_ptr<QOpenGLFramebufferObject> resolve_fbo_;
   LinePainter point_connection_painter_;
 
+  std::unordered_map<camera_t, RefracImageModelRays> refrac_image_model_rays_;
+
   LinePainter image_line_painter_;
   TrianglePainter image_triangle_painter_;
   LinePainter image_connection_painter_;
@@ -195,6 +235,7 @@ class ModelViewerWidget : public QOpenGLWidget,
   std::vector<std::pair<size_t, char>> selection_buffer_;
   image_t selected_image_id_;
   point3D_t selected_point3D_id_;
+  std::unordered_set<point3D_t> selected_image_point3D_ids_;
   size_t selected_movie_grabber_view_;
 
   bool coordinate_grid_enabled_;
@@ -32,8 +32,141 @@
 #include "colmap/geometry/pose.h"
 #include "colmap/scene/projection.h"
 #include "colmap/ui/model_viewer_widget.h"
+#include "colmap/util/threading.h"
+
+#include <cmath>
+#include <deque>
+#include <future>
+#include <memory>
 
 namespace colmap {
+namespace {
+
+enum OutputType {
+  IMAGE_FILES = 0,
+  VIDEO_X264 = 1,
+  VIDEO_NVENC = 2,
+};
+
+class FrameWriter {
+ public:
+  virtual ~FrameWriter() = default;
+  virtual bool Write(const QImage& image) = 0;
+  // Wait until all frames are written.
+  virtual bool Finish() = 0;
+};
+
+// Writes the frames as images in the background, such that the rendering of
+// the next frames overlaps with the encoding of the previous frames.
+class ImageFrameWriter : public FrameWriter {
+ public:
+  explicit ImageFrameWriter(const QDir& dir)
+      : dir_(dir), max_num_pending_frames_(2 * thread_pool_.NumThreads()) {}
+
+  bool Write(const QImage& image) override {
+    if (pending_frames_.size() >= max_num_pending_frames_ && !WaitOne()) {
+      return false;
+    }
+    const QString path = dir_.filePath(
+        "frame" + QString().asprintf("%06zu", frame_number_) + ".png");
+    pending_frames_.push_back(
+        thread_pool_.AddTask([image, path]() { return image.save(path); }));
+    frame_number_ += 1;
+    return true;
+  }
+
+  bool Finish() override {
+    bool success = true;
+    while (!pending_frames_.empty()) {
+      success &= WaitOne();
+    }
+    return success;
+  }
+
+ private:
+  bool WaitOne() {
+    const bool success = pending_frames_.front().get();
+    pending_frames_.pop_front();
+    if (!success) {
+      LOG(ERROR) << "Failed to write movie frame";
+    }
+    return success;
+  }
+
+  const QDir dir_;
+  ThreadPool thread_pool_;
+  const size_t max_num_pending_frames_;
+  std::deque<std::future<bool>> pending_frames_;
+  size_t frame_number_ = 0;
+};
+
+// Streams the raw frames into an FFmpeg process, which encodes them in a
+// separate process, optionally on the GPU with NVENC.
+class VideoFrameWriter : public FrameWriter {
+ public:
+  bool Start(const QString& path,
+             const int width,
+             const int height,
+             const int frame_rate,
+             const bool nvenc) {
+    process_.setProcessChannelMode(QProcess::ForwardedChannels);
+    const QStringList arguments = {
+        "-y",
+        "-loglevel",
+        "error",
+        "-f",
+        "rawvideo",
+        "-pix_fmt",
+        "rgb24",
+        "-s",
+        QString("%1x%2").arg(width).arg(height),
+        "-framerate",
+        QString::number(frame_rate),
+        "-i",
+        "-",
+        "-c:v",
+        nvenc ? "h264_nvenc" : "libx264",
+        "-pix_fmt",
+        "yuv420p",
+        path,
+    };
+    process_.start("ffmpeg", arguments);
+    return process_.waitForStarted();
+  }
+
+  bool Write(const QImage& image) override {
+    // The scanlines of the image are padded to multiples of 4 bytes.
+    const qint64 line_size = 3 * image.width();
+    for (int y = 0; y < image.height(); ++y) {
+      if (process_.write(reinterpret_cast<const char*>(image.constScanLine(y)),
+                         line_size) != line_size) {
+        return false;
+      }
+    }
+    // Limit the buffered frames, if the encoder is slower than the rendering.
+    while (process_.bytesToWrite() > kMaxNumPendingFrames * line_size *
+                                         image.height()) {
+      if (!process_.waitForBytesWritten(-1)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  bool Finish() override {
+    process_.closeWriteChannel();
+    return process_.waitForFinished(-1) &&
+           process_.exitStatus() == QProcess::NormalExit &&
+           process_.exitCode() == 0;
+  }
+
+ private:
+  static const int kMaxNumPendingFrames = 4;
+
+  QProcess process_;
+};
+
+}  // namespace
 
 MovieGrabberWidget::MovieGrabberWidget(QWidget* parent,
                                        ModelViewerWidget* model_viewer_widget)
@@ -103,12 +236,39 @@ MovieGrabberWidget::MovieGrabberWidget(QWidget* parent,
   smoothness_sb_->setValue(0.5);
   grid->addWidget(smoothness_sb_, 4, 2);
 
+  // The frames are rendered offscreen at the given resolution, which defaults
+  // to the size of the viewer.
+  grid->addWidget(new QLabel(tr("Width"), this), 5, 1);
+  width_sb_ = new QSpinBox(this);
+  width_sb_->setMinimum(0);
+  width_sb_->setMaximum(16384);
+  width_sb_->setSingleStep(2);
+  width_sb_->setSpecialValueText(tr("Viewer"));
+  width_sb_->setValue(0);
+  grid->addWidget(width_sb_, 5, 2);
+
+  grid->addWidget(new QLabel(tr("Height"), this), 6, 1);
+  height_sb_ = new QSpinBox(this);
+  height_sb_->setMinimum(0);
+  height_sb_->setMaximum(16384);
+  height_sb_->setSingleStep(2);
+  height_sb_->setSpecialValueText(tr("Viewer"));
+  height_sb_->setValue(0);
+  grid->addWidget(height_sb_, 6, 2);
+
+  grid->addWidget(new QLabel(tr("Output"), this), 7, 1);
+  output_cb_ = new QComboBox(this);
+  output_cb_->addItem(tr("Image files"));
+  output_cb_->addItem(tr("Video (FFmpeg)"));
+  output_cb_->addItem(tr("Video (FFmpeg, NVENC)"));
+  grid->addWidget(output_cb_, 7, 2);
+
   assemble_button_ = new QPushButton(tr("Assemble movie"), this);
   connect(assemble_button_,
           &QPushButton::released,
           this,
           &MovieGrabberWidget::Assemble);
-  grid->addWidget(assemble_button_, 5, 1, 1, 2);
+  grid->addWidget(assemble_button_, 8, 1, 1, 2);
 }
 
 void MovieGrabberWidget::Add() {
@@ -172,15 +332,68 @@ void MovieGrabberWidget::Assemble() {
     return;
   }
 
-  const QString path = QFileDialog::getExistingDirectory(
-      this, tr("Choose destination..."), "", QFileDialog::ShowDirsOnly);
+  const int output_type = output_cb_->currentIndex();
+
+  QString path;
+  if (output_type == IMAGE_FILES) {
+    path = QFileDialog::getExistingDirectory(
+        this, tr("Choose destination..."), "", QFileDialog::ShowDirsOnly);
+  } else {
+    path = QFileDialog::getSaveFileName(
+        this, tr("Choose destination..."), "", tr("Video (*.mp4 *.mkv)"));
+  }
 
   // File dialog cancelled?
   if (path == "") {
     return;
   }
 
-  const QDir dir = QDir(path);
+  int width = width_sb_->value();
+  int height = height_sb_->value();
+  if (width == 0 || height == 0) {
+    const qreal pixel_ratio = model_viewer_widget_->devicePixelRatio();
+    width = static_cast<int>(pixel_ratio * model_viewer_widget_->width());
+    height = static_cast<int>(pixel_ratio * model_viewer_widget_->height());
+  }
+
+  const float frame_rate = frame_rate_sb_->value();
+
+  std::unique_ptr<FrameWriter> frame_writer;
+  if (output_type == IMAGE_FILES) {
+    frame_writer = std::make_unique<ImageFrameWriter>(QDir(path));
+  } else {
+    // The chroma subsampling of the encoders requires even dimensions.
+    width -= width % 2;
+    height -= height % 2;
+    auto video_frame_writer = std::make_unique<VideoFrameWriter>();
+    if (!video_frame_writer->Start(path,
+                                   width,
+                                   height,
+                                   frame_rate_sb_->value(),
+                                   output_type == VIDEO_NVENC)) {
+      QMessageBox::critical(
+          this, tr("Error"), tr("Failed to start FFmpeg, is it installed?"));
+      return;
+    }
+    frame_writer = std::move(video_frame_writer);
+  }
+
+  size_t num_frames_total = 0;
+  for (int row = 1; row < table_->rowCount(); ++row) {
+    const auto logical_idx = table_->verticalHeader()->logicalIndex(row);
+    const float dt =
+        std::abs(table_->item(logical_idx, 0)->text().toFloat() -
+                 table_->item(logical_idx - 1, 0)->text().toFloat());
+    num_frames_total += static_cast<size_t>(std::ceil(dt * frame_rate));
+  }
+
+  QProgressDialog progress_dialog(tr("Assembling movie..."),
+                                  tr("Cancel"),
+                                  0,
+                                  static_cast<int>(num_frames_total),
+                                  this);
+  progress_dialog.setWindowModality(Qt::WindowModal);
+  progress_dialog.setMinimumDuration(0);
 
   const QMatrix4x4 model_view_matrix_cached =
       model_viewer_widget_->ModelViewMatrix();
@@ -193,8 +406,8 @@ void MovieGrabberWidget::Assemble() {
   model_viewer_widget_->UpdateMovieGrabber();
   model_viewer_widget_->DisableCoordinateGrid();
 
-  const float frame_rate = frame_rate_sb_->value();
   const float frame_time = 1.0f / frame_rate;
+  bool success = true;
   size_t frame_number = 0;
 
   // Data of first view.
@@ -205,7 +418,7 @@ void MovieGrabberWidget::Assemble() {
       Rigid3d(Eigen::Quaterniond(prev_model_view_matrix.topLeftCorner<3, 3>()),
               prev_model_view_matrix.topRightCorner<3, 1>()));
 
-  for (int row = 1; row < table_->rowCount(); ++row) {
+  for (int row = 1; row < table_->rowCount() && success; ++row) {
     const auto logical_idx = table_->verticalHeader()->logicalIndex(row);
     QTableWidgetItem* prev_table_item = table_->item(logical_idx - 1, 0);
     QTableWidgetItem* table_item = table_->item(logical_idx, 0);
@@ -229,7 +442,7 @@ void MovieGrabberWidget::Assemble() {
     const float dimage_size = view_data.image_size - prev_view_data.image_size;
 
     const auto num_frames = dt * frame_rate;
-    for (size_t i = 0; i < num_frames; ++i) {
+    for (size_t i = 0; i < num_frames && success; ++i) {
       const float t = i * frame_time;
       float tt = t / dt;
 
@@ -253,15 +466,26 @@ void MovieGrabberWidget::Assemble() {
       model_viewer_widget_->SetImageSize(prev_view_data.image_size +
                                          dimage_size * tt);
 
-      QImage image = model_viewer_widget_->GrabImage();
-      image.save(dir.filePath(
-          "frame" + QString().asprintf("%06zu", frame_number) + ".png"));
+      success = frame_writer->Write(
+          model_viewer_widget_->RenderImage(width, height));
       frame_number += 1;
+
+      progress_dialog.setValue(frame_number);
+      if (progress_dialog.wasCanceled()) {
+        success = false;
+      }
     }
 
     prev_view_model = curr_view_model;
   }
 
+  const bool canceled = progress_dialog.wasCanceled();
+  success &= frame_writer->Finish();
+  progress_dialog.reset();
+  if (!success && !canceled) {
+    QMessageBox::critical(this, tr("Error"), tr("Failed to write the movie."));
+  }
+
   views = views_cached;
   model_viewer_widget_->SetPointSize(point_size_cached);
   model_viewer_widget_->SetImageSize(image_size_cached);
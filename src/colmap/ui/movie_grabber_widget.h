@@ -83,6 +83,9 @@ class MovieGrabberWidget : public QWidget {
   QSpinBox* frame_rate_sb_;
   QCheckBox* smooth_cb_;
   QDoubleSpinBox* smoothness_sb_;
+  QSpinBox* width_sb_;
+  QSpinBox* height_sb_;
+  QComboBox* output_cb_;
 
   std::unordered_map<const QTableWidgetItem*, ViewData> view_data_;
 };
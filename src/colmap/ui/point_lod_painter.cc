@@ -0,0 +1,417 @@
+#include "colmap/ui/point_lod_painter.h"
+
+#include "colmap/ui/qt_utils.h"
+#include "colmap/util/logging.h"
+#include "colmap/util/opengl_utils.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <numeric>
+#include <unordered_map>
+
+namespace colmap {
+
+PointLODPainter::PointLODPainter()
+    : num_gpu_bytes_(0),
+      frame_(0),
+      has_queued_points_(false),
+      rendered_width_(0),
+      rendered_height_(0) {}
+
+PointLODPainter::~PointLODPainter() {
+  if (next_point_cloud_.valid()) {
+    next_point_cloud_.wait();
+  }
+  ReleaseNodes();
+}
+
+void PointLODPainter::Setup() {
+  ReleaseNodes();
+  if (shader_program_.isLinked()) {
+    shader_program_.release();
+    shader_program_.removeAllShaders();
+  }
+
+  shader_program_.addShaderFromSourceFile(QOpenGLShader::Vertex,
+                                          ":/shaders/points.v.glsl");
+  shader_program_.addShaderFromSourceFile(QOpenGLShader::Fragment,
+                                          ":/shaders/points.f.glsl");
+  shader_program_.link();
+  shader_program_.bind();
+
+#if DEBUG
+  glDebugLog();
+#endif
+}
+
+void PointLODPainter::SetPoints(std::vector<PointPainter::Data> data,
+                                std::vector<uint64_t> ids,
+                                const PointOctree::Options& octree_options) {
+  CHECK_EQ(data.size(), ids.size());
+  CHECK(octree_options.Check());
+  if (next_point_cloud_.valid()) {
+    has_queued_points_ = true;
+    queued_data_ = std::move(data);
+    queued_ids_ = std::move(ids);
+    queued_octree_options_ = octree_options;
+  } else {
+    StartBuildPointCloud(std::move(data), std::move(ids), octree_options);
+  }
+}
+
+bool PointLODPainter::Render(const QMatrix4x4& pmv_matrix,
+                             const int width,
+                             const int height,
+                             const float point_size,
+                             const Options& options) {
+  ++frame_;
+
+  if (next_point_cloud_.valid() &&
+      next_point_cloud_.wait_for(std::chrono::seconds(0)) ==
+          std::future_status::ready) {
+    SwapPointCloud(next_point_cloud_.get());
+    if (has_queued_points_) {
+      has_queued_points_ = false;
+      StartBuildPointCloud(std::move(queued_data_),
+                           std::move(queued_ids_),
+                           queued_octree_options_);
+    }
+  }
+
+  bool pending = next_point_cloud_.valid();
+
+  rendered_node_idxs_.clear();
+  rendered_pmv_matrix_ = pmv_matrix;
+  rendered_width_ = width;
+  rendered_height_ = height;
+
+  if (point_cloud_ == nullptr) {
+    return pending;
+  }
+
+  const PointOctree& octree = point_cloud_->octree;
+  rendered_node_idxs_ =
+      octree.SelectNodes(QMatrixToEigen(pmv_matrix),
+                         height,
+                         static_cast<float>(options.max_screen_error));
+
+  for (const int node_idx : rendered_node_idxs_) {
+    node_buffers_[node_idx].frame = frame_;
+  }
+
+  // Candidates for eviction, sorted by the frame they were last rendered in.
+  std::vector<int> eviction_node_idxs;
+  bool eviction_node_idxs_collected = false;
+  size_t next_eviction_idx = 0;
+
+  const size_t max_num_gpu_bytes =
+      static_cast<size_t>(options.max_gpu_memory_mb) * 1024 * 1024;
+  size_t num_upload_points = 0;
+
+  // Nodes are selected from coarse to fine, such that the coarse nodes are
+  // uploaded first and the rendering is refined in subsequent frames.
+  for (const int node_idx : rendered_node_idxs_) {
+    if (node_buffers_[node_idx].vbo != nullptr) {
+      continue;
+    }
+
+    const size_t num_points = octree.Nodes()[node_idx].NumPoints();
+    if (num_upload_points > 0 &&
+        num_upload_points + num_points >
+            static_cast<size_t>(options.max_num_upload_points)) {
+      pending = true;
+      continue;
+    }
+
+    const size_t num_bytes = num_points * sizeof(PointPainter::Data);
+    if (!eviction_node_idxs_collected) {
+      for (size_t i = 0; i < node_buffers_.size(); ++i) {
+        if (node_buffers_[i].vbo != nullptr &&
+            node_buffers_[i].frame != frame_) {
+          eviction_node_idxs.push_back(static_cast<int>(i));
+        }
+      }
+      std::sort(eviction_node_idxs.begin(),
+                eviction_node_idxs.end(),
+                [&](const int node_idx1, const int node_idx2) {
+                  return node_buffers_[node_idx1].frame <
+                         node_buffers_[node_idx2].frame;
+                });
+      eviction_node_idxs_collected = true;
+    }
+    while (num_gpu_bytes_ + num_bytes > max_num_gpu_bytes &&
+           next_eviction_idx < eviction_node_idxs.size()) {
+      ReleaseNode(&node_buffers_[eviction_node_idxs[next_eviction_idx]]);
+      next_eviction_idx += 1;
+    }
+    // Without further nodes to evict, the node is skipped until the view
+    // changes.
+    if (num_gpu_bytes_ + num_bytes > max_num_gpu_bytes) {
+      continue;
+    }
+
+    UploadNode(node_idx);
+    num_upload_points += num_points;
+  }
+
+  if (rendered_node_idxs_.empty()) {
+    return pending;
+  }
+
+  shader_program_.bind();
+  shader_program_.setUniformValue("u_pmv_matrix", pmv_matrix);
+  shader_program_.setUniformValue("u_point_size", point_size);
+
+  QOpenGLFunctions* gl_funcs = QOpenGLContext::currentContext()->functions();
+  for (const int node_idx : rendered_node_idxs_) {
+    NodeBuffer& node_buffer = node_buffers_[node_idx];
+    if (node_buffer.vao == nullptr) {
+      continue;
+    }
+    node_buffer.vao->bind();
+    gl_funcs->glDrawArrays(
+        GL_POINTS,
+        0,
+        static_cast<GLsizei>(octree.Nodes()[node_idx].NumPoints()));
+    node_buffer.vao->release();
+  }
+
+#if DEBUG
+  glDebugLog();
+#endif
+
+  return pending;
+}
+
+bool PointLODPainter::Pick(const float x,
+                           const float y,
+                           const float radius,
+                           uint64_t* id) const {
+  if (point_cloud_ == nullptr) {
+    return false;
+  }
+  uint32_t idx;
+  if (!point_cloud_->octree.Pick(rendered_node_idxs_,
+                                 QMatrixToEigen(rendered_pmv_matrix_),
+                                 rendered_width_,
+                                 rendered_height_,
+                                 x,
+                                 y,
+                                 radius,
+                                 &idx)) {
+    return false;
+  }
+  *id = point_cloud_->ids[point_cloud_->octree.Points()[idx].idx];
+  return true;
+}
+
+std::shared_ptr<const PointLODPainter::PointCloud>
+PointLODPainter::BuildPointCloud(
+    std::vector<PointPainter::Data> data,
+    std::vector<uint64_t> ids,
+    const PointOctree::Options octree_options,
+    std::shared_ptr<const PointCloud> prev_point_cloud) {
+  auto point_cloud = std::make_shared<PointCloud>();
+
+  std::vector<size_t> order(ids.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [&](const size_t i, const size_t j) {
+    return ids[i] < ids[j];
+  });
+  point_cloud->data.reserve(data.size());
+  point_cloud->ids.reserve(ids.size());
+  for (const size_t i : order) {
+    point_cloud->data.push_back(data[i]);
+    point_cloud->ids.push_back(ids[i]);
+  }
+
+  std::vector<Eigen::Vector3f> positions(point_cloud->data.size());
+  Eigen::AlignedBox3f bbox;
+  for (size_t i = 0; i < positions.size(); ++i) {
+    const PointPainter::Data& point = point_cloud->data[i];
+    positions[i] = Eigen::Vector3f(point.x, point.y, point.z);
+    bbox.extend(positions[i]);
+  }
+
+  const bool has_prev_octree = prev_point_cloud != nullptr &&
+                               !prev_point_cloud->octree.Nodes().empty();
+
+  // If only the colors changed, e.g., for a new selection, the octree is
+  // reused as is.
+  bool same_positions =
+      has_prev_octree && prev_point_cloud->ids == point_cloud->ids;
+  for (size_t i = 0; same_positions && i < positions.size(); ++i) {
+    const PointPainter::Data& prev_point = prev_point_cloud->data[i];
+    same_positions = prev_point.x == positions[i].x() &&
+                     prev_point.y == positions[i].y() &&
+                     prev_point.z == positions[i].z();
+  }
+
+  if (same_positions) {
+    point_cloud->octree = prev_point_cloud->octree;
+  } else if (!positions.empty()) {
+    // Keep the root of the previous octree while it contains all points and
+    // is not too coarse, such that the nodes of unchanged regions remain
+    // identical. Otherwise, leave room for the growth of the reconstruction.
+    const float kRootPadding = 1.5f;
+    const float kMinRootFill = 0.25f;
+    const float extent = std::max(bbox.sizes().maxCoeff(), 1e-6f);
+    Eigen::AlignedBox3f root_bbox;
+    if (has_prev_octree &&
+        prev_point_cloud->octree.Nodes()[0].bbox.contains(bbox) &&
+        extent >= kMinRootFill *
+                      prev_point_cloud->octree.Nodes()[0].bbox.sizes().x()) {
+      root_bbox = prev_point_cloud->octree.Nodes()[0].bbox;
+    } else {
+      const float half_extent = 0.5f * kRootPadding * extent;
+      root_bbox = Eigen::AlignedBox3f(bbox.center().array() - half_extent,
+                                      bbox.center().array() + half_extent);
+    }
+    point_cloud->octree.Build(positions, octree_options, root_bbox);
+  }
+
+  // The hash of a node covers its cell and the identifiers, positions, and
+  // colors of its points.
+  const auto HashCombine = [](const size_t value, size_t* hash) {
+    *hash ^= value + 0x9e3779b97f4a7c15ull + (*hash << 6) + (*hash >> 2);
+  };
+  const auto HashFloat = [&HashCombine](const float value, size_t* hash) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    HashCombine(bits, hash);
+  };
+
+  const PointOctree& octree = point_cloud->octree;
+  point_cloud->node_hashes.resize(octree.Nodes().size());
+  for (size_t node_idx = 0; node_idx < octree.Nodes().size(); ++node_idx) {
+    const PointOctree::Node& node = octree.Nodes()[node_idx];
+    size_t hash = node.NumPoints();
+    for (int dim = 0; dim < 3; ++dim) {
+      HashFloat(node.bbox.min()(dim), &hash);
+      HashFloat(node.bbox.max()(dim), &hash);
+    }
+    for (uint32_t i = node.begin; i < node.end; ++i) {
+      const uint32_t idx = octree.Points()[i].idx;
+      const PointPainter::Data& point = point_cloud->data[idx];
+      HashCombine(point_cloud->ids[idx], &hash);
+      for (const float value :
+           {point.x, point.y, point.z, point.r, point.g, point.b, point.a}) {
+        HashFloat(value, &hash);
+      }
+    }
+    point_cloud->node_hashes[node_idx] = hash;
+  }
+
+  return point_cloud;
+}
+
+void PointLODPainter::StartBuildPointCloud(
+    std::vector<PointPainter::Data> data,
+    std::vector<uint64_t> ids,
+    const PointOctree::Options& octree_options) {
+  next_point_cloud_ = std::async(std::launch::async,
+                                 &PointLODPainter::BuildPointCloud,
+                                 std::move(data),
+                                 std::move(ids),
+                                 octree_options,
+                                 point_cloud_);
+}
+
+void PointLODPainter::SwapPointCloud(
+    std::shared_ptr<const PointCloud> point_cloud) {
+  // Take over the uploaded buffers of the nodes that did not change.
+  std::unordered_map<size_t, int> uploaded_node_idxs;
+  for (size_t node_idx = 0; node_idx < node_buffers_.size(); ++node_idx) {
+    if (node_buffers_[node_idx].vbo != nullptr) {
+      uploaded_node_idxs.emplace(point_cloud_->node_hashes[node_idx],
+                                 static_cast<int>(node_idx));
+    }
+  }
+
+  std::vector<NodeBuffer> node_buffers(point_cloud->octree.Nodes().size());
+  for (size_t node_idx = 0; node_idx < node_buffers.size(); ++node_idx) {
+    const auto it =
+        uploaded_node_idxs.find(point_cloud->node_hashes[node_idx]);
+    if (it != uploaded_node_idxs.end()) {
+      node_buffers[node_idx] = std::move(node_buffers_[it->second]);
+      uploaded_node_idxs.erase(it);
+    }
+  }
+
+  ReleaseNodes();
+  for (const NodeBuffer& node_buffer : node_buffers) {
+    num_gpu_bytes_ += node_buffer.num_bytes;
+  }
+
+  point_cloud_ = std::move(point_cloud);
+  node_buffers_ = std::move(node_buffers);
+  rendered_node_idxs_.clear();
+}
+
+void PointLODPainter::UploadNode(const int node_idx) {
+  const PointOctree& octree = point_cloud_->octree;
+  const PointOctree::Node& node = octree.Nodes()[node_idx];
+
+  std::vector<PointPainter::Data> data;
+  data.reserve(node.NumPoints());
+  for (uint32_t i = node.begin; i < node.end; ++i) {
+    data.push_back(point_cloud_->data[octree.Points()[i].idx]);
+  }
+
+  NodeBuffer& node_buffer = node_buffers_[node_idx];
+  node_buffer.vao = std::make_unique<QOpenGLVertexArrayObject>();
+  node_buffer.vao->create();
+  node_buffer.vbo = std::make_unique<QOpenGLBuffer>();
+  node_buffer.vbo->create();
+
+  node_buffer.vao->bind();
+  node_buffer.vbo->bind();
+
+  node_buffer.vbo->setUsagePattern(QOpenGLBuffer::StaticDraw);
+  node_buffer.vbo->allocate(
+      data.data(), static_cast<int>(data.size() * sizeof(PointPainter::Data)));
+  node_buffer.num_bytes = data.size() * sizeof(PointPainter::Data);
+  num_gpu_bytes_ += node_buffer.num_bytes;
+
+  shader_program_.bind();
+
+  // in_position
+  shader_program_.enableAttributeArray("a_position");
+  shader_program_.setAttributeBuffer(
+      "a_position", GL_FLOAT, 0, 3, sizeof(PointPainter::Data));
+
+  // in_color
+  shader_program_.enableAttributeArray("a_color");
+  shader_program_.setAttributeBuffer(
+      "a_color", GL_FLOAT, 3 * sizeof(GLfloat), 4, sizeof(PointPainter::Data));
+
+  // Make sure they are not changed from the outside
+  node_buffer.vbo->release();
+  node_buffer.vao->release();
+
+#if DEBUG
+  glDebugLog();
+#endif
+}
+
+void PointLODPainter::ReleaseNode(NodeBuffer* node_buffer) {
+  if (node_buffer->vbo == nullptr) {
+    return;
+  }
+  node_buffer->vao->destroy();
+  node_buffer->vbo->destroy();
+  node_buffer->vao.reset();
+  node_buffer->vbo.reset();
+  num_gpu_bytes_ -= node_buffer->num_bytes;
+  node_buffer->num_bytes = 0;
+}
+
+void PointLODPainter::ReleaseNodes() {
+  for (NodeBuffer& node_buffer : node_buffers_) {
+    ReleaseNode(&node_buffer);
+  }
+  num_gpu_bytes_ = 0;
+}
+
+}  // namespace colmap
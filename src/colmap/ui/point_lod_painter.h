@@ -0,0 +1,119 @@
+#pragma once
+
+#include "colmap/ui/point_octree.h"
+#include "colmap/ui/point_painter.h"
+
+#include <future>
+#include <memory>
+#include <vector>
+
+#include <QtCore>
+#include <QtOpenGL>
+
+namespace colmap {
+
+// Renders large point clouds with a level of detail. The points are organized
+// in an octree, of which only the visible nodes at the resolution required by
+// the screen-space error are rendered. Missing nodes are uploaded on demand
+// within a budget per frame, such that the rendering is refined progressively
+// over multiple frames, and are kept on the GPU under a memory budget, from
+// which the least recently rendered nodes are evicted.
+//
+// Updated points are organized on a background thread, while the previous
+// points are still rendered. Nodes whose points did not change keep their
+// uploaded buffers, such that only the changed parts of the point cloud are
+// uploaded again, e.g., during live reconstruction.
+class PointLODPainter {
+ public:
+  struct Options {
+    // Maximum screen-space error of the rendered points in pixels.
+    double max_screen_error = 1.0;
+
+    // Maximum GPU memory of the uploaded points in megabytes.
+    int max_gpu_memory_mb = 1024;
+
+    // Maximum number of points uploaded per frame.
+    int max_num_upload_points = 2000000;
+  };
+
+  PointLODPainter();
+  ~PointLODPainter();
+
+  void Setup();
+
+  // Replace the points with the given unique identifiers asynchronously. If
+  // points are already being organized, only the most recent points are
+  // organized afterwards.
+  void SetPoints(std::vector<PointPainter::Data> data,
+                 std::vector<uint64_t> ids,
+                 const PointOctree::Options& octree_options);
+
+  // Render the points and return whether some of the required nodes are
+  // missing or updated points are being organized, in which case further
+  // frames should be rendered.
+  bool Render(const QMatrix4x4& pmv_matrix,
+              int width,
+              int height,
+              float point_size,
+              const Options& options);
+
+  // Find the point closest to the viewer among the points rendered in the last
+  // frame within `radius` pixels of the pixel (x, y) and return its
+  // identifier. This avoids rendering all points in selection mode.
+  bool Pick(float x, float y, float radius, uint64_t* id) const;
+
+ private:
+  // The points sorted by identifier, such that the octree samples the same
+  // points in unchanged regions, and the hashes of the contents of the nodes.
+  struct PointCloud {
+    std::vector<PointPainter::Data> data;
+    std::vector<uint64_t> ids;
+    PointOctree octree;
+    std::vector<size_t> node_hashes;
+  };
+
+  struct NodeBuffer {
+    std::unique_ptr<QOpenGLVertexArrayObject> vao;
+    std::unique_ptr<QOpenGLBuffer> vbo;
+    size_t num_bytes = 0;
+    // The frame in which the node was last rendered.
+    size_t frame = 0;
+  };
+
+  static std::shared_ptr<const PointCloud> BuildPointCloud(
+      std::vector<PointPainter::Data> data,
+      std::vector<uint64_t> ids,
+      PointOctree::Options octree_options,
+      std::shared_ptr<const PointCloud> prev_point_cloud);
+
+  void StartBuildPointCloud(std::vector<PointPainter::Data> data,
+                            std::vector<uint64_t> ids,
+                            const PointOctree::Options& octree_options);
+  void SwapPointCloud(std::shared_ptr<const PointCloud> point_cloud);
+
+  void UploadNode(int node_idx);
+  void ReleaseNode(NodeBuffer* node_buffer);
+  void ReleaseNodes();
+
+  QOpenGLShaderProgram shader_program_;
+
+  std::shared_ptr<const PointCloud> point_cloud_;
+  std::vector<NodeBuffer> node_buffers_;
+  size_t num_gpu_bytes_;
+  size_t frame_;
+
+  // The points being organized and the most recent points to organize next.
+  std::future<std::shared_ptr<const PointCloud>> next_point_cloud_;
+  bool has_queued_points_;
+  std::vector<PointPainter::Data> queued_data_;
+  std::vector<uint64_t> queued_ids_;
+  PointOctree::Options queued_octree_options_;
+
+  // The state of the last rendered frame for picking.
+  std::vector<int> rendered_node_idxs_;
+  QMatrix4x4 rendered_pmv_matrix_;
+  int rendered_width_;
+  int rendered_height_;
+};
+
+}  // namespace colmap
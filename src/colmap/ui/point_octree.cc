@@ -0,0 +1,324 @@
+#include "colmap/ui/point_octree.h"
+
+#include "colmap/util/logging.h"
+
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <queue>
+
+namespace colmap {
+namespace {
+
+std::array<Eigen::Vector4f, 8> ProjectCorners(
+    const Eigen::AlignedBox3f& bbox, const Eigen::Matrix4f& pmv_matrix) {
+  std::array<Eigen::Vector4f, 8> corners;
+  for (int i = 0; i < 8; ++i) {
+    corners[i] =
+        pmv_matrix *
+        bbox.corner(static_cast<Eigen::AlignedBox3f::CornerType>(i))
+            .homogeneous();
+  }
+  return corners;
+}
+
+// Whether all corners are outside the same plane of the view frustum.
+bool IsOutsideFrustum(const std::array<Eigen::Vector4f, 8>& corners) {
+  for (int dim = 0; dim < 3; ++dim) {
+    bool all_below = true;
+    bool all_above = true;
+    for (const Eigen::Vector4f& corner : corners) {
+      all_below = all_below && corner(dim) < -corner(3);
+      all_above = all_above && corner(dim) > corner(3);
+    }
+    if (all_below || all_above) {
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace
+
+bool PointOctree::Options::Check() const {
+  CHECK_OPTION_GT(grid_size, 0);
+  CHECK_OPTION_LE(grid_size, 256);
+  CHECK_OPTION_GT(max_leaf_size, 0);
+  CHECK_OPTION_GE(max_depth, 0);
+  return true;
+}
+
+bool PointOctree::Node::IsLeaf() const {
+  for (const int child : children) {
+    if (child != -1) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void PointOctree::Build(const std::vector<Eigen::Vector3f>& positions,
+                        const Options& options) {
+  Eigen::AlignedBox3f bbox;
+  for (const Eigen::Vector3f& position : positions) {
+    bbox.extend(position);
+  }
+
+  // The cube of the root slightly exceeds the bounding box, such that all
+  // points are strictly inside the cells of the octree.
+  const float half_extent =
+      0.5f * std::max(bbox.sizes().maxCoeff(), 1e-6f) * 1.0001f;
+  const Eigen::Vector3f center = bbox.center();
+  Build(positions,
+        options,
+        Eigen::AlignedBox3f(center.array() - half_extent,
+                            center.array() + half_extent));
+}
+
+void PointOctree::Build(const std::vector<Eigen::Vector3f>& positions,
+                        const Options& options,
+                        const Eigen::AlignedBox3f& root_bbox) {
+  CHECK(options.Check());
+  CHECK_LE(positions.size(), std::numeric_limits<uint32_t>::max());
+
+  Clear();
+
+  if (positions.empty()) {
+    return;
+  }
+
+  points_.resize(positions.size());
+  for (size_t i = 0; i < positions.size(); ++i) {
+    CHECK(root_bbox.contains(positions[i]));
+    points_[i].xyz = positions[i];
+    points_[i].idx = static_cast<uint32_t>(i);
+  }
+
+  nodes_.emplace_back();
+  nodes_[0].bbox = root_bbox;
+
+  std::vector<uint8_t> grid(options.grid_size * options.grid_size *
+                                options.grid_size,
+                            0);
+  BuildNode(0, 0, static_cast<uint32_t>(points_.size()), options, &grid);
+}
+
+void PointOctree::Clear() {
+  nodes_.clear();
+  points_.clear();
+}
+
+void PointOctree::BuildNode(const int node_idx,
+                            const uint32_t begin,
+                            const uint32_t end,
+                            const Options& options,
+                            std::vector<uint8_t>* grid) {
+  const Eigen::AlignedBox3f bbox = nodes_[node_idx].bbox;
+  const int depth = nodes_[node_idx].depth;
+  nodes_[node_idx].begin = begin;
+
+  if (end - begin <= static_cast<uint32_t>(options.max_leaf_size) ||
+      depth >= options.max_depth) {
+    nodes_[node_idx].end = end;
+    return;
+  }
+
+  // Keep the first point in each grid cell at the front of the range.
+  const int grid_size = options.grid_size;
+  const float spacing = bbox.sizes().x() / grid_size;
+  std::vector<uint32_t> occupied_cells;
+  uint32_t mid = begin;
+  for (uint32_t i = begin; i < end; ++i) {
+    const Eigen::Vector3i cell =
+        ((points_[i].xyz - bbox.min()) / spacing)
+            .cast<int>()
+            .cwiseMax(0)
+            .cwiseMin(grid_size - 1);
+    const uint32_t cell_idx =
+        cell.x() + grid_size * (cell.y() + grid_size * cell.z());
+    if ((*grid)[cell_idx] == 0) {
+      (*grid)[cell_idx] = 1;
+      occupied_cells.push_back(cell_idx);
+      std::swap(points_[i], points_[mid]);
+      ++mid;
+    }
+  }
+  for (const uint32_t cell_idx : occupied_cells) {
+    (*grid)[cell_idx] = 0;
+  }
+
+  nodes_[node_idx].end = mid;
+  nodes_[node_idx].spacing = spacing;
+
+  // Partition the remaining points into the octants, whose index is composed
+  // of the bits of the upper halves of the x, y, z axes.
+  const Eigen::Vector3f center = bbox.center();
+  const auto begin_it = points_.begin() + mid;
+  const auto end_it = points_.begin() + end;
+  std::array<std::vector<Point>::iterator, 9> octant_its;
+  octant_its[0] = begin_it;
+  octant_its[8] = end_it;
+  octant_its[4] = std::partition(begin_it, end_it, [&](const Point& point) {
+    return point.xyz.z() < center.z();
+  });
+  for (int z = 0; z < 2; ++z) {
+    octant_its[4 * z + 2] =
+        std::partition(octant_its[4 * z],
+                       octant_its[4 * z + 4],
+                       [&](const Point& point) {
+                         return point.xyz.y() < center.y();
+                       });
+    for (int y = 0; y < 2; ++y) {
+      octant_its[4 * z + 2 * y + 1] =
+          std::partition(octant_its[4 * z + 2 * y],
+                         octant_its[4 * z + 2 * y + 2],
+                         [&](const Point& point) {
+                           return point.xyz.x() < center.x();
+                         });
+    }
+  }
+
+  for (int octant = 0; octant < 8; ++octant) {
+    if (octant_its[octant] == octant_its[octant + 1]) {
+      continue;
+    }
+
+    Eigen::AlignedBox3f child_bbox;
+    for (int dim = 0; dim < 3; ++dim) {
+      if (octant & (1 << dim)) {
+        child_bbox.min()(dim) = center(dim);
+        child_bbox.max()(dim) = bbox.max()(dim);
+      } else {
+        child_bbox.min()(dim) = bbox.min()(dim);
+        child_bbox.max()(dim) = center(dim);
+      }
+    }
+
+    const int child_idx = static_cast<int>(nodes_.size());
+    nodes_.emplace_back();
+    nodes_[child_idx].bbox = child_bbox;
+    nodes_[child_idx].depth = depth + 1;
+    nodes_[node_idx].children[octant] = child_idx;
+
+    BuildNode(child_idx,
+              static_cast<uint32_t>(octant_its[octant] - points_.begin()),
+              static_cast<uint32_t>(octant_its[octant + 1] - points_.begin()),
+              options,
+              grid);
+  }
+}
+
+std::vector<int> PointOctree::SelectNodes(const Eigen::Matrix4f& pmv_matrix,
+                                          const int height,
+                                          const float max_screen_error) const {
+  std::vector<int> node_idxs;
+  if (nodes_.empty()) {
+    return node_idxs;
+  }
+
+  // A length d at the clip coordinate w projects to d * s / w in normalized
+  // device coordinates, which span 2 units over the viewport height, where the
+  // scale s of the projection is the norm of the second row of its 3x3 block.
+  const float pixel_scale =
+      0.5f * height * pmv_matrix.block<1, 3>(1, 0).norm();
+
+  std::queue<int> queue;
+  queue.push(0);
+  while (!queue.empty()) {
+    const int node_idx = queue.front();
+    queue.pop();
+    const Node& node = nodes_[node_idx];
+
+    const std::array<Eigen::Vector4f, 8> corners =
+        ProjectCorners(node.bbox, pmv_matrix);
+    if (IsOutsideFrustum(corners)) {
+      continue;
+    }
+
+    node_idxs.push_back(node_idx);
+
+    if (node.IsLeaf()) {
+      continue;
+    }
+
+    float min_w = std::numeric_limits<float>::max();
+    for (const Eigen::Vector4f& corner : corners) {
+      min_w = std::min(min_w, corner(3));
+    }
+
+    // Nodes that reach behind the viewer are always refined.
+    const float kMinW = 1e-6f;
+    if (min_w > kMinW &&
+        node.spacing * pixel_scale / min_w <= max_screen_error) {
+      continue;
+    }
+
+    for (const int child_idx : node.children) {
+      if (child_idx != -1) {
+        queue.push(child_idx);
+      }
+    }
+  }
+
+  return node_idxs;
+}
+
+bool PointOctree::Pick(const std::vector<int>& node_idxs,
+                       const Eigen::Matrix4f& pmv_matrix,
+                       const int width,
+                       const int height,
+                       const float x,
+                       const float y,
+                       const float radius,
+                       uint32_t* idx) const {
+  const auto ProjectToPixel = [&](const Eigen::Vector4f& clip) {
+    return Eigen::Vector2f((clip.x() / clip.w() + 1.0f) * 0.5f * width,
+                           (1.0f - clip.y() / clip.w()) * 0.5f * height);
+  };
+
+  const Eigen::Vector2f query(x, y);
+  const float radius_squared = radius * radius;
+
+  bool found = false;
+  float min_depth = std::numeric_limits<float>::max();
+  for (const int node_idx : node_idxs) {
+    const Node& node = nodes_.at(node_idx);
+
+    // Skip nodes whose projection does not overlap the query.
+    const std::array<Eigen::Vector4f, 8> corners =
+        ProjectCorners(node.bbox, pmv_matrix);
+    bool all_in_front = true;
+    Eigen::AlignedBox2f rect;
+    for (const Eigen::Vector4f& corner : corners) {
+      if (corner.w() <= 0) {
+        all_in_front = false;
+        break;
+      }
+      rect.extend(ProjectToPixel(corner));
+    }
+    if (all_in_front && rect.exteriorDistance(query) > radius) {
+      continue;
+    }
+
+    for (uint32_t i = node.begin; i < node.end; ++i) {
+      const Eigen::Vector4f clip = pmv_matrix * points_[i].xyz.homogeneous();
+      if (clip.w() <= 0) {
+        continue;
+      }
+      const float depth = clip.z() / clip.w();
+      if (depth < -1.0f || depth > 1.0f || depth >= min_depth) {
+        continue;
+      }
+      if ((ProjectToPixel(clip) - query).squaredNorm() > radius_squared) {
+        continue;
+      }
+      found = true;
+      min_depth = depth;
+      *idx = i;
+    }
+  }
+
+  return found;
+}
+
+}  // namespace colmap
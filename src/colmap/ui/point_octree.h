@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+
+namespace colmap {
+
+// Octree for the level-of-detail rendering of large point clouds. Every point
+// is stored in exactly one node: Inner nodes keep a spatially uniform sample of
+// the points in their cell with at most one point per cell of a regular grid
+// over the node, and pass the remaining points on to their children. Rendering
+// a node together with its ancestors thus shows the points in its cell at the
+// resolution of its grid, such that the traversal can stop at nodes whose grid
+// spacing projects to less than the tolerated screen-space error.
+class PointOctree {
+ public:
+  struct Options {
+    // Number of grid cells per axis for sampling the points of inner nodes.
+    int grid_size = 64;
+
+    // Maximum number of points of leaf nodes.
+    int max_leaf_size = 16384;
+
+    // Maximum depth of the tree, at which all remaining points are stored in
+    // the leaf, e.g., for many duplicate points.
+    int max_depth = 20;
+
+    bool Check() const;
+  };
+
+  struct Point {
+    Eigen::Vector3f xyz;
+    // The index of the point in the input of `Build`.
+    uint32_t idx;
+  };
+
+  struct Node {
+    // Axis-aligned cube of the node.
+    Eigen::AlignedBox3f bbox;
+
+    // The distance between the sampled points of the node, i.e., the size of
+    // its grid cells or zero for leaf nodes with all remaining points.
+    float spacing = 0;
+
+    int depth = 0;
+
+    // The range of the points of the node in `Points()`.
+    uint32_t begin = 0;
+    uint32_t end = 0;
+
+    // The indices of the child nodes or -1 for empty children.
+    int children[8] = {-1, -1, -1, -1, -1, -1, -1, -1};
+
+    inline uint32_t NumPoints() const { return end - begin; }
+    bool IsLeaf() const;
+  };
+
+  // Build the octree over the given points, which replaces previous points.
+  void Build(const std::vector<Eigen::Vector3f>& positions,
+             const Options& options);
+
+  // Build the octree with the given cube of the root node, which must contain
+  // all points. A fixed root keeps the nodes of unchanged regions identical
+  // when the octree is rebuilt for updated points.
+  void Build(const std::vector<Eigen::Vector3f>& positions,
+             const Options& options,
+             const Eigen::AlignedBox3f& root_bbox);
+
+  void Clear();
+
+  // The nodes of the tree, where the first node is the root.
+  inline const std::vector<Node>& Nodes() const { return nodes_; }
+
+  // The points, which are grouped by node.
+  inline const std::vector<Point>& Points() const { return points_; }
+
+  // Select the nodes to render for the given projection-model-view matrix and
+  // viewport height in pixels. Nodes outside the view frustum are culled and
+  // the traversal descends into children while the grid spacing of a node
+  // projects to more than `max_screen_error` pixels. Coarser nodes are
+  // returned first.
+  std::vector<int> SelectNodes(const Eigen::Matrix4f& pmv_matrix,
+                               int height,
+                               float max_screen_error) const;
+
+  // Find the point of the given nodes that is closest to the viewer among the
+  // points projected within `radius` pixels of the pixel (x, y), where the
+  // origin is the top-left corner of the viewport. Returns false if there is
+  // no such point and otherwise the index of the point in `Points()`.
+  bool Pick(const std::vector<int>& node_idxs,
+            const Eigen::Matrix4f& pmv_matrix,
+            int width,
+            int height,
+            float x,
+            float y,
+            float radius,
+            uint32_t* idx) const;
+
+ private:
+  void BuildNode(int node_idx,
+                 uint32_t begin,
+                 uint32_t end,
+                 const Options& options,
+                 std::vector<uint8_t>* grid);
+
+  std::vector<Node> nodes_;
+  std::vector<Point> points_;
+};
+
+}  // namespace colmap
@@ -0,0 +1,188 @@
+#include "colmap/ui/point_octree.h"
+
+#include <algorithm>
+#include <numeric>
+#include <random>
+#include <unordered_set>
+
+#include <gtest/gtest.h>
+
+namespace colmap {
+namespace {
+
+std::vector<Eigen::Vector3f> RandomPositions(const size_t num_points) {
+  std::mt19937 prng(0);
+  std::uniform_real_distribution<float> distribution(-1, 1);
+  std::vector<Eigen::Vector3f> positions(num_points);
+  for (auto& position : positions) {
+    position = Eigen::Vector3f(
+        distribution(prng), distribution(prng), distribution(prng));
+  }
+  return positions;
+}
+
+// Camera at (0, 0, distance) looking at the origin.
+Eigen::Matrix4f PerspectiveMatrix(const float distance = 5) {
+  const float kNear = 0.1f;
+  const float kFar = 100.0f;
+  const float kFocal = 2.0f;
+  Eigen::Matrix4f proj_matrix = Eigen::Matrix4f::Zero();
+  proj_matrix(0, 0) = kFocal;
+  proj_matrix(1, 1) = kFocal;
+  proj_matrix(2, 2) = -(kFar + kNear) / (kFar - kNear);
+  proj_matrix(2, 3) = -2 * kFar * kNear / (kFar - kNear);
+  proj_matrix(3, 2) = -1;
+  Eigen::Matrix4f view_matrix = Eigen::Matrix4f::Identity();
+  view_matrix(2, 3) = -distance;
+  return proj_matrix * view_matrix;
+}
+
+TEST(PointOctree, Empty) {
+  PointOctree octree;
+  octree.Build({}, PointOctree::Options());
+  EXPECT_TRUE(octree.Nodes().empty());
+  EXPECT_TRUE(octree.Points().empty());
+  EXPECT_TRUE(octree.SelectNodes(PerspectiveMatrix(), 100, 1).empty());
+}
+
+TEST(PointOctree, Build) {
+  const std::vector<Eigen::Vector3f> positions = RandomPositions(20000);
+  PointOctree::Options options;
+  options.grid_size = 8;
+  options.max_leaf_size = 1000;
+  PointOctree octree;
+  octree.Build(positions, options);
+
+  ASSERT_EQ(octree.Points().size(), positions.size());
+  std::unordered_set<uint32_t> idxs;
+  for (const auto& point : octree.Points()) {
+    EXPECT_EQ(point.xyz, positions[point.idx]);
+    idxs.insert(point.idx);
+  }
+  EXPECT_EQ(idxs.size(), positions.size());
+
+  const auto& nodes = octree.Nodes();
+  ASSERT_GT(nodes.size(), 1);
+  uint32_t num_points = 0;
+  for (const auto& node : nodes) {
+    num_points += node.NumPoints();
+    for (uint32_t i = node.begin; i < node.end; ++i) {
+      EXPECT_TRUE(node.bbox.contains(octree.Points()[i].xyz));
+    }
+    if (node.IsLeaf()) {
+      EXPECT_LE(node.NumPoints(), options.max_leaf_size);
+    } else {
+      // Inner nodes store at most one point per grid cell.
+      EXPECT_LE(node.NumPoints(),
+                options.grid_size * options.grid_size * options.grid_size);
+      EXPECT_FLOAT_EQ(node.spacing, node.bbox.sizes().x() / options.grid_size);
+      for (const int child_idx : node.children) {
+        if (child_idx != -1) {
+          EXPECT_EQ(nodes[child_idx].depth, node.depth + 1);
+          EXPECT_TRUE(node.bbox.contains(nodes[child_idx].bbox));
+        }
+      }
+    }
+  }
+  EXPECT_EQ(num_points, positions.size());
+}
+
+TEST(PointOctree, BuildDuplicatePoints) {
+  const std::vector<Eigen::Vector3f> positions(100, Eigen::Vector3f(1, 2, 3));
+  PointOctree::Options options;
+  options.max_leaf_size = 10;
+  options.max_depth = 3;
+  PointOctree octree;
+  octree.Build(positions, options);
+  EXPECT_EQ(octree.Points().size(), positions.size());
+  for (const auto& node : octree.Nodes()) {
+    EXPECT_LE(node.depth, options.max_depth);
+  }
+}
+
+TEST(PointOctree, BuildWithRootBox) {
+  const std::vector<Eigen::Vector3f> positions = RandomPositions(1000);
+  const Eigen::AlignedBox3f root_bbox(Eigen::Vector3f(-2, -2, -2),
+                                      Eigen::Vector3f(6, 6, 6));
+  PointOctree::Options options;
+  options.grid_size = 4;
+  options.max_leaf_size = 100;
+  PointOctree octree;
+  octree.Build(positions, options, root_bbox);
+  ASSERT_FALSE(octree.Nodes().empty());
+  EXPECT_TRUE(octree.Nodes()[0].bbox.isApprox(root_bbox));
+  EXPECT_EQ(octree.Points().size(), positions.size());
+
+  // Adding points to one octant leaves the other octants unchanged.
+  std::vector<Eigen::Vector3f> new_positions = positions;
+  new_positions.emplace_back(5, 5, 5);
+  PointOctree new_octree;
+  new_octree.Build(new_positions, options, root_bbox);
+  ASSERT_NE(octree.Nodes()[0].children[0], -1);
+  const PointOctree::Node& child =
+      octree.Nodes()[octree.Nodes()[0].children[0]];
+  const PointOctree::Node& new_child =
+      new_octree.Nodes()[new_octree.Nodes()[0].children[0]];
+  EXPECT_EQ(child.NumPoints(), new_child.NumPoints());
+  EXPECT_TRUE(child.bbox.isApprox(new_child.bbox));
+}
+
+TEST(PointOctree, SelectNodes) {
+  const std::vector<Eigen::Vector3f> positions = RandomPositions(50000);
+  PointOctree::Options options;
+  options.grid_size = 16;
+  options.max_leaf_size = 1000;
+  PointOctree octree;
+  octree.Build(positions, options);
+
+  // A large error only selects the root and a small error selects all nodes.
+  const std::vector<int> coarse_node_idxs =
+      octree.SelectNodes(PerspectiveMatrix(), 100, 1000);
+  EXPECT_EQ(coarse_node_idxs, std::vector<int>{0});
+  const std::vector<int> fine_node_idxs =
+      octree.SelectNodes(PerspectiveMatrix(), 100, 0);
+  EXPECT_EQ(fine_node_idxs.size(), octree.Nodes().size());
+  EXPECT_EQ(fine_node_idxs[0], 0);
+
+  // Coarser nodes come first.
+  for (size_t i = 1; i < fine_node_idxs.size(); ++i) {
+    EXPECT_LE(octree.Nodes()[fine_node_idxs[i - 1]].depth,
+              octree.Nodes()[fine_node_idxs[i]].depth);
+  }
+
+  // Farther views need fewer nodes.
+  EXPECT_LT(octree.SelectNodes(PerspectiveMatrix(50), 1000, 10).size(),
+            octree.SelectNodes(PerspectiveMatrix(5), 1000, 10).size());
+
+  // Points behind the viewer are culled.
+  EXPECT_TRUE(octree.SelectNodes(PerspectiveMatrix(-5), 1000, 1).empty());
+}
+
+TEST(PointOctree, Pick) {
+  std::vector<Eigen::Vector3f> positions = RandomPositions(5000);
+  // Points on the optical axis, the closest of which must be picked.
+  positions.emplace_back(0, 0, -2);
+  positions.emplace_back(0, 0, 1.5);
+  positions.emplace_back(0, 0, 0);
+  PointOctree::Options options;
+  options.grid_size = 4;
+  options.max_leaf_size = 100;
+  PointOctree octree;
+  octree.Build(positions, options);
+
+  std::vector<int> node_idxs(octree.Nodes().size());
+  std::iota(node_idxs.begin(), node_idxs.end(), 0);
+
+  uint32_t idx;
+  ASSERT_TRUE(octree.Pick(
+      node_idxs, PerspectiveMatrix(), 100, 100, 50, 50, 0.01f, &idx));
+  EXPECT_EQ(octree.Points()[idx].idx, 5001);
+
+  EXPECT_FALSE(octree.Pick(
+      node_idxs, PerspectiveMatrix(), 100, 100, -50, -50, 1, &idx));
+  EXPECT_FALSE(
+      octree.Pick({}, PerspectiveMatrix(), 100, 100, 50, 50, 0.01f, &idx));
+}
+
+}  // namespace
+}  // namespace colmap
@@ -29,6 +29,10 @@
 
 #pragma once
 
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
 #include <QtCore>
 #include <QtOpenGL>
 
@@ -66,4 +70,27 @@ class PointPainter {
   size_t num_geoms_;
 };
 
+// Find the range [begin, end) of the elements in `data` that differ from the
+// previously uploaded data, such that only this range must be uploaded again.
+template <typename T>
+void FindChangedRange(const std::vector<T>& prev_data,
+                      const std::vector<T>& data,
+                      size_t* begin,
+                      size_t* end) {
+  const size_t num_common = std::min(prev_data.size(), data.size());
+  *begin = 0;
+  while (*begin < num_common &&
+         std::memcmp(&prev_data[*begin], &data[*begin], sizeof(T)) == 0) {
+    *begin += 1;
+  }
+  *end = data.size();
+  if (data.size() <= prev_data.size()) {
+    while (*end > *begin &&
+           std::memcmp(&prev_data[*end - 1], &data[*end - 1], sizeof(T)) ==
+               0) {
+      *end -= 1;
+    }
+  }
+}
+
 }  // namespace colmap
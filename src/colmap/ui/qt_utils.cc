@@ -68,31 +68,32 @@ QImage BitmapToQImageRGB(const Bitmap& bitmap) {
   return image;
 }
 
-QPixmap ShowImagesSideBySide(const QPixmap& image1, const QPixmap& image2) {
-  QPixmap image = QPixmap(QSize(image1.width() + image2.width(),
-                                std::max(image1.height(), image2.height())));
+QImage ShowImagesSideBySide(const QImage& image1, const QImage& image2) {
+  QImage image(QSize(image1.width() + image2.width(),
+                     std::max(image1.height(), image2.height())),
+               QImage::Format_RGB32);
 
   image.fill(Qt::black);
 
   QPainter painter(&image);
-  painter.drawImage(0, 0, image1.toImage());
-  painter.drawImage(image1.width(), 0, image2.toImage());
+  painter.drawImage(0, 0, image1);
+  painter.drawImage(image1.width(), 0, image2);
 
   return image;
 }
 
-void DrawKeypoints(QPixmap* pixmap,
+void DrawKeypoints(QImage* image,
                    const FeatureKeypoints& points,
                    const QColor& color) {
-  if (pixmap->isNull()) {
+  if (image->isNull()) {
     return;
   }
 
-  const int pen_width = std::max(pixmap->width(), pixmap->height()) / 2048 + 1;
+  const int pen_width = std::max(image->width(), image->height()) / 2048 + 1;
   const int radius = 3 * pen_width + (3 * pen_width) % 2;
   const float radius2 = radius / 2.0f;
 
-  QPainter painter(pixmap);
+  QPainter painter(image);
   painter.setRenderHint(QPainter::Antialiasing);
 
   QPen pen;
@@ -105,13 +106,13 @@ void DrawKeypoints(QPixmap* pixmap,
   }
 }
 
-QPixmap DrawMatches(const QPixmap& image1,
-                    const QPixmap& image2,
-                    const FeatureKeypoints& points1,
-                    const FeatureKeypoints& points2,
-                    const FeatureMatches& matches,
-                    const QColor& keypoints_color) {
-  QPixmap image = ShowImagesSideBySide(image1, image2);
+QImage DrawMatches(const QImage& image1,
+                   const QImage& image2,
+                   const FeatureKeypoints& points1,
+                   const FeatureKeypoints& points2,
+                   const FeatureMatches& matches,
+                   const QColor& keypoints_color) {
+  QImage image = ShowImagesSideBySide(image1, image2);
 
   QPainter painter(&image);
   painter.setRenderHint(QPainter::Antialiasing);
@@ -47,17 +47,19 @@ QMatrix4x4 EigenToQMatrix(const Eigen::Matrix4f& matrix);
 
 QImage BitmapToQImageRGB(const Bitmap& bitmap);
 
-void DrawKeypoints(QPixmap* image,
+// The drawing functions operate on images instead of pixmaps, such that they
+// can be used outside of the UI thread.
+void DrawKeypoints(QImage* image,
                    const FeatureKeypoints& points,
                    const QColor& color = Qt::red);
 
-QPixmap ShowImagesSideBySide(const QPixmap& image1, const QPixmap& image2);
+QImage ShowImagesSideBySide(const QImage& image1, const QImage& image2);
 
-QPixmap DrawMatches(const QPixmap& image1,
-                    const QPixmap& image2,
-                    const FeatureKeypoints& points1,
-                    const FeatureKeypoints& points2,
-                    const FeatureMatches& matches,
-                    const QColor& keypoints_color = Qt::red);
+QImage DrawMatches(const QImage& image1,
+                   const QImage& image2,
+                   const FeatureKeypoints& points1,
+                   const FeatureKeypoints& points2,
+                   const FeatureMatches& matches,
+                   const QColor& keypoints_color = Qt::red);
 
 }  // namespace colmap
@@ -86,6 +86,11 @@ MapperRegistrationOptionsWidget::MapperRegistrationOptionsWidget(
                "abs_pose_min_num_inliers");
   AddOptionDouble(&options->mapper->mapper.abs_pose_min_inlier_ratio,
                   "abs_pose_min_inlier_ratio");
+  AddOptionDouble(&options->mapper->mapper.abs_pose_prior_max_error,
+                  "abs_pose_prior_max_error [px]",
+                  -1);
+  AddOptionBool(&options->mapper->mapper.use_prior_gravity,
+                "use_prior_gravity");
   AddOptionInt(&options->mapper->mapper.max_reg_trials, "max_reg_trials", 1);
 }
 
@@ -118,11 +123,17 @@ MapperBundleAdjustmentOptionsWidget::MapperBundleAdjustmentOptionsWidget(
                 "refine_extra_params");
   AddOptionBool(&options->mapper->ba_refine_refrac_params,
                 "refine_refrac_params");
+  AddOptionBool(&options->mapper->ba_refrac_mixed_precision,
+                "refrac_mixed_precision");
+  AddOptionBool(&options->mapper->ba_adaptive_termination,
+                "adaptive_termination");
 
   AddSpacer();
 
   AddSection("Local Bundle Adjustment");
   AddOptionInt(&options->mapper->ba_local_num_images, "num_images");
+  AddOptionInt(&options->mapper->ba_local_max_num_residuals,
+               "max_num_residuals");
   AddOptionInt(&options->mapper->ba_local_max_num_iterations,
                "max_num_iterations");
   AddOptionInt(
@@ -143,6 +154,8 @@ MapperBundleAdjustmentOptionsWidget::MapperBundleAdjustmentOptionsWidget(
   AddOptionInt(&options->mapper->ba_global_points_freq, "points_freq");
   AddOptionInt(&options->mapper->ba_global_max_num_iterations,
                "max_num_iterations");
+  AddOptionInt(&options->mapper->ba_global_max_num_points_per_cell,
+               "max_num_points_per_cell");
   AddOptionInt(
       &options->mapper->ba_global_max_refinements, "max_refinements", 1);
   AddOptionDouble(&options->mapper->ba_global_max_refinement_change,
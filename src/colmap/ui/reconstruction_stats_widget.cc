@@ -29,6 +29,8 @@
 
 #include "colmap/ui/reconstruction_stats_widget.h"
 
+#include "colmap/util/misc.h"
+
 namespace colmap {
 
 ReconstructionStatsWidget::ReconstructionStatsWidget(QWidget* parent)
@@ -48,25 +50,36 @@ ReconstructionStatsWidget::ReconstructionStatsWidget(QWidget* parent)
 }
 
 void ReconstructionStatsWidget::Show(const Reconstruction& reconstruction) {
-  QString stats;
-
   stats_table_->clearContents();
   stats_table_->setRowCount(0);
 
-  AddStatistic("Cameras", QString::number(reconstruction.NumCameras()));
-  AddStatistic("Images", QString::number(reconstruction.NumImages()));
-  AddStatistic("Registered images",
-               QString::number(reconstruction.NumRegImages()));
-  AddStatistic("Points", QString::number(reconstruction.NumPoints3D()));
-  AddStatistic("Observations",
-               QString::number(reconstruction.ComputeNumObservations()));
-  AddStatistic("Mean track length",
-               QString::number(reconstruction.ComputeMeanTrackLength()));
-  AddStatistic(
-      "Mean observations per image",
-      QString::number(reconstruction.ComputeMeanObservationsPerRegImage()));
+  const ReconstructionStats stats =
+      ComputeReconstructionStats(ReconstructionStatsOptions(), reconstruction);
+
+  AddStatistic("Cameras", QString::number(stats.num_cameras));
+  AddStatistic("Images", QString::number(stats.num_images));
+  AddStatistic("Registered images", QString::number(stats.num_reg_images));
+  AddStatistic("Points", QString::number(stats.num_points3D));
+  AddStatistic("Observations", QString::number(stats.num_observations));
+  AddStatistic("Mean track length", QString::number(stats.mean_track_length));
+  AddStatistic("Mean observations per image",
+               QString::number(stats.mean_observations_per_reg_image));
   AddStatistic("Mean reprojection error",
-               QString::number(reconstruction.ComputeMeanReprojectionError()));
+               QString::number(stats.mean_reproj_error));
+  AddStatistic("Mean observation reprojection error",
+               QString::number(stats.observations.mean_reproj_error));
+  AddStatistic("Median triangulation angle",
+               QString::number(stats.median_tri_angle));
+  AddStatistic(
+      "Reprojection error histogram",
+      QString::fromStdString(
+          VectorToCSV(stats.observations.reproj_error_histogram)));
+  AddStatistic(
+      "Triangulation angle histogram",
+      QString::fromStdString(VectorToCSV(stats.tri_angle_histogram)));
+  AddStatistic(
+      "Track length histogram",
+      QString::fromStdString(VectorToCSV(stats.track_length_histogram)));
 }
 
 void ReconstructionStatsWidget::AddStatistic(const QString& header,
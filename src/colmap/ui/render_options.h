@@ -47,6 +47,13 @@ struct RenderOptions {
   // Maximum error for a point to be rendered.
   double max_error = 2;
 
+  // Maximum screen-space error in pixels of the level of detail, at which the
+  // points are rendered.
+  double max_point_screen_error = 1;
+
+  // Maximum GPU memory in megabytes of the rendered points.
+  int max_point_gpu_memory_mb = 1024;
+
   // The rate of registered images at which to refresh.
   int refresh_rate = 1;
 
@@ -63,9 +70,15 @@ struct RenderOptions {
   // Whether to render pose priors.
   bool render_pose_priors = true;
 
+  // Whether to render the refracted viewing volume of refractive cameras
+  // instead of a pinhole frustum.
+  bool refrac_image_models = false;
+
   inline bool Check() const {
     CHECK_OPTION_GE(min_track_len, 0);
     CHECK_OPTION_GE(max_error, 0);
+    CHECK_OPTION_GT(max_point_screen_error, 0);
+    CHECK_OPTION_GT(max_point_gpu_memory_mb, 0);
     CHECK_OPTION_GT(refresh_rate, 0);
     CHECK_OPTION(projection_type == ProjectionType::PERSPECTIVE ||
                  projection_type == ProjectionType::ORTHOGRAPHIC);
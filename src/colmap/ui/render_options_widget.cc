@@ -103,6 +103,11 @@ RenderOptionsWidget::RenderOptionsWidget(QWidget* parent,
 
   AddOptionDouble(&options->render->max_error, "Point max. error [px]");
   AddOptionInt(&options->render->min_track_len, "Point min. track length", 0);
+  AddOptionDouble(&options->render->max_point_screen_error,
+                  "Point max. screen error [px]");
+  AddOptionInt(&options->render->max_point_gpu_memory_mb,
+               "Point max. GPU memory [MB]",
+               1);
 
   AddSpacer();
 
@@ -177,6 +182,8 @@ RenderOptionsWidget::RenderOptionsWidget(QWidget* parent,
 
   AddOptionBool(&options->render->image_connections, "Image connections");
   AddOptionBool(&options->render->render_pose_priors, "Render pose priors");
+  AddOptionBool(&options->render->refrac_image_models,
+                "Refractive image models");
 
   AddSpacer();
 
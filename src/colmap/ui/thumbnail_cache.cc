@@ -0,0 +1,133 @@
+#include "colmap/ui/thumbnail_cache.h"
+
+#include "colmap/util/logging.h"
+#include "colmap/util/misc.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <ctime>
+#include <functional>
+#include <iomanip>
+#include <sstream>
+#include <thread>
+
+#include <boost/filesystem.hpp>
+
+namespace colmap {
+namespace {
+
+// FNV-1a hash, which is stable across platforms and runs as opposed to
+// std::hash, such that the cache remains valid between sessions.
+uint64_t HashString(const std::string& str) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (const char c : str) {
+    hash ^= static_cast<unsigned char>(c);
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+}  // namespace
+
+void ThumbnailSize(const int width,
+                   const int height,
+                   const int max_size,
+                   int* thumb_width,
+                   int* thumb_height) {
+  CHECK_GT(max_size, 0);
+  const int size = std::max(width, height);
+  if (size <= max_size) {
+    *thumb_width = width;
+    *thumb_height = height;
+    return;
+  }
+  const double scale = static_cast<double>(max_size) / size;
+  *thumb_width = std::max(1, static_cast<int>(std::round(scale * width)));
+  *thumb_height = std::max(1, static_cast<int>(std::round(scale * height)));
+}
+
+ThumbnailCache::ThumbnailCache(std::string cache_path, const int max_size)
+    : cache_path_(std::move(cache_path)), max_size_(max_size) {
+  CHECK(!cache_path_.empty());
+  CHECK_GT(max_size_, 0);
+}
+
+const std::string& ThumbnailCache::CachePath() const { return cache_path_; }
+
+int ThumbnailCache::MaxSize() const { return max_size_; }
+
+std::string ThumbnailCache::ThumbnailPath(const std::string& image_path) const {
+  boost::system::error_code error;
+  const boost::filesystem::path path =
+      boost::filesystem::absolute(image_path).lexically_normal();
+  const uintmax_t file_size = boost::filesystem::file_size(path, error);
+  if (error) {
+    return "";
+  }
+  const std::time_t write_time =
+      boost::filesystem::last_write_time(path, error);
+  if (error) {
+    return "";
+  }
+
+  std::ostringstream key;
+  key << path.string() << "|" << file_size << "|" << write_time << "|"
+      << max_size_;
+  std::ostringstream file_name;
+  file_name << std::hex << std::setw(16) << std::setfill('0')
+            << HashString(key.str()) << ".jpg";
+  return JoinPaths(cache_path_, file_name.str());
+}
+
+bool ThumbnailCache::Read(const std::string& image_path,
+                          Bitmap* thumbnail) const {
+  const std::string thumbnail_path = ThumbnailPath(image_path);
+  if (thumbnail_path.empty() || !ExistsFile(thumbnail_path)) {
+    return false;
+  }
+  return thumbnail->Read(thumbnail_path, /*as_rgb=*/true);
+}
+
+bool ThumbnailCache::Write(const std::string& image_path,
+                           const Bitmap& image) const {
+  if (std::max(image.Width(), image.Height()) <= max_size_) {
+    return false;
+  }
+
+  const std::string thumbnail_path = ThumbnailPath(image_path);
+  if (thumbnail_path.empty()) {
+    return false;
+  }
+  if (ExistsFile(thumbnail_path)) {
+    return true;
+  }
+
+  int thumb_width;
+  int thumb_height;
+  ThumbnailSize(
+      image.Width(), image.Height(), max_size_, &thumb_width, &thumb_height);
+  Bitmap thumbnail = image.CloneAsRGB();
+  thumbnail.Rescale(thumb_width, thumb_height);
+
+  CreateDirIfNotExists(cache_path_, /*recursive=*/true);
+
+  // Write the thumbnail under a name unique to the thread and then rename it,
+  // such that concurrent readers never see partially written thumbnails. The
+  // temporary name keeps the extension, which determines the file format.
+  std::ostringstream tmp_path;
+  tmp_path << thumbnail_path.substr(0, thumbnail_path.size() - 4) << "."
+           << std::hash<std::thread::id>()(std::this_thread::get_id())
+           << ".tmp.jpg";
+  if (!thumbnail.Write(tmp_path.str())) {
+    LOG(WARNING) << "Failed to write thumbnail " << tmp_path.str();
+    return false;
+  }
+  if (std::rename(tmp_path.str().c_str(), thumbnail_path.c_str()) != 0) {
+    std::remove(tmp_path.str().c_str());
+    return false;
+  }
+  return true;
+}
+
+}  // namespace colmap
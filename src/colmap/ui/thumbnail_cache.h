@@ -0,0 +1,45 @@
+#pragma once
+
+#include "colmap/sensor/bitmap.h"
+
+#include <string>
+
+namespace colmap {
+
+// Compute the dimensions of the thumbnail of an image, such that its larger
+// dimension is at most `max_size` while preserving the aspect ratio. Images
+// that are smaller than `max_size` keep their dimensions.
+void ThumbnailSize(
+    int width, int height, int max_size, int* thumb_width, int* thumb_height);
+
+// Persistent cache of downsampled images on disk for the progressive display
+// of images in the viewers. The thumbnails are keyed by the absolute path, the
+// size, and the modification time of the image, such that changed images are
+// not served from stale thumbnails. The cache is safe to use from multiple
+// threads and processes, since thumbnails are written atomically.
+class ThumbnailCache {
+ public:
+  explicit ThumbnailCache(std::string cache_path, int max_size = 512);
+
+  const std::string& CachePath() const;
+  int MaxSize() const;
+
+  // The path of the thumbnail of the image or an empty string if the image
+  // does not exist.
+  std::string ThumbnailPath(const std::string& image_path) const;
+
+  // Read the cached thumbnail of the image. Returns false if no thumbnail was
+  // cached for the current version of the image.
+  bool Read(const std::string& image_path, Bitmap* thumbnail) const;
+
+  // Downsample the decoded image and cache it as the thumbnail of the image,
+  // unless it is already cached. Images that are not larger than the
+  // thumbnails are not cached, since they are as fast to read directly.
+  bool Write(const std::string& image_path, const Bitmap& image) const;
+
+ private:
+  const std::string cache_path_;
+  const int max_size_;
+};
+
+}  // namespace colmap
@@ -0,0 +1,77 @@
+#include "colmap/ui/thumbnail_cache.h"
+
+#include "colmap/util/misc.h"
+#include "colmap/util/testing.h"
+
+#include <fstream>
+
+#include <gtest/gtest.h>
+
+namespace colmap {
+namespace {
+
+TEST(ThumbnailSize, Nominal) {
+  int width;
+  int height;
+  ThumbnailSize(4000, 3000, 512, &width, &height);
+  EXPECT_EQ(width, 512);
+  EXPECT_EQ(height, 384);
+  ThumbnailSize(3000, 4000, 512, &width, &height);
+  EXPECT_EQ(width, 384);
+  EXPECT_EQ(height, 512);
+  ThumbnailSize(100, 50, 512, &width, &height);
+  EXPECT_EQ(width, 100);
+  EXPECT_EQ(height, 50);
+  ThumbnailSize(10000, 1, 512, &width, &height);
+  EXPECT_EQ(width, 512);
+  EXPECT_EQ(height, 1);
+}
+
+TEST(ThumbnailCache, ThumbnailPath) {
+  const std::string test_dir = CreateTestDir();
+  const std::string cache_path = JoinPaths(test_dir, "thumbnails");
+  ThumbnailCache cache(cache_path);
+  EXPECT_EQ(cache.CachePath(), cache_path);
+  EXPECT_EQ(cache.MaxSize(), 512);
+
+  const std::string image_path = JoinPaths(test_dir, "image.jpg");
+  EXPECT_EQ(cache.ThumbnailPath(image_path), "");
+  Bitmap thumbnail;
+  EXPECT_FALSE(cache.Read(image_path, &thumbnail));
+
+  {
+    std::ofstream file(image_path);
+    file << "a";
+  }
+  const std::string thumbnail_path = cache.ThumbnailPath(image_path);
+  EXPECT_EQ(GetParentDir(thumbnail_path), cache_path);
+  EXPECT_TRUE(HasFileExtension(thumbnail_path, ".jpg"));
+  EXPECT_EQ(cache.ThumbnailPath(image_path), thumbnail_path);
+  EXPECT_FALSE(cache.Read(image_path, &thumbnail));
+
+  // Thumbnails of changed images and of other sizes are not shared.
+  {
+    std::ofstream file(image_path);
+    file << "ab";
+  }
+  EXPECT_NE(cache.ThumbnailPath(image_path), thumbnail_path);
+  EXPECT_NE(ThumbnailCache(cache_path, 256).ThumbnailPath(image_path),
+            cache.ThumbnailPath(image_path));
+}
+
+TEST(ThumbnailCache, SmallImagesNotCached) {
+  const std::string test_dir = CreateTestDir();
+  ThumbnailCache cache(JoinPaths(test_dir, "thumbnails"), 16);
+  const std::string image_path = JoinPaths(test_dir, "image.jpg");
+  {
+    std::ofstream file(image_path);
+    file << "a";
+  }
+  Bitmap image;
+  image.Allocate(16, 8, true);
+  EXPECT_FALSE(cache.Write(image_path, image));
+  EXPECT_FALSE(ExistsDir(cache.CachePath()));
+}
+
+}  // namespace
+}  // namespace colmap
@@ -33,7 +33,7 @@
 
 namespace colmap {
 
-TrianglePainter::TrianglePainter() : num_geoms_(0) {}
+TrianglePainter::TrianglePainter() : num_geoms_(0), capacity_(0) {}
 
 TrianglePainter::~TrianglePainter() {
   vao_.destroy();
@@ -57,6 +57,8 @@ void TrianglePainter::Setup() {
 
   vao_.create();
   vbo_.create();
+  capacity_ = 0;
+  uploaded_data_.clear();
 
 #if DEBUG
   glDebugLog();
@@ -72,20 +74,42 @@ void TrianglePainter::Upload(const std::vector<TrianglePainter::Data>& data) {
   vao_.bind();
   vbo_.bind();
 
-  // Upload data array to GPU
-  vbo_.setUsagePattern(QOpenGLBuffer::DynamicDraw);
-  vbo_.allocate(data.data(),
-                static_cast<int>(data.size() * sizeof(TrianglePainter::Data)));
-
-  // in_position
-  shader_program_.enableAttributeArray("a_position");
-  shader_program_.setAttributeBuffer(
-      "a_position", GL_FLOAT, 0, 3, sizeof(PointPainter::Data));
+  if (data.size() > capacity_) {
+    // Upload data array to GPU and leave room for growth, such that appended
+    // data can be uploaded without reallocating the buffer.
+    capacity_ = 2 * data.size();
+    vbo_.setUsagePattern(QOpenGLBuffer::DynamicDraw);
+    vbo_.allocate(static_cast<int>(capacity_ * sizeof(TrianglePainter::Data)));
+    vbo_.write(0,
+               data.data(),
+               static_cast<int>(data.size() * sizeof(TrianglePainter::Data)));
+
+    // in_position
+    shader_program_.enableAttributeArray("a_position");
+    shader_program_.setAttributeBuffer(
+        "a_position", GL_FLOAT, 0, 3, sizeof(PointPainter::Data));
+
+    // in_color
+    shader_program_.enableAttributeArray("a_color");
+    shader_program_.setAttributeBuffer("a_color",
+                                       GL_FLOAT,
+                                       3 * sizeof(GLfloat),
+                                       4,
+                                       sizeof(PointPainter::Data));
+  } else {
+    // Only upload the data that changed since the last upload.
+    size_t begin;
+    size_t end;
+    FindChangedRange(uploaded_data_, data, &begin, &end);
+    if (begin < end) {
+      const size_t num_bytes = (end - begin) * sizeof(TrianglePainter::Data);
+      vbo_.write(static_cast<int>(begin * sizeof(TrianglePainter::Data)),
+                 data.data() + begin,
+                 static_cast<int>(num_bytes));
+    }
+  }
 
-  // in_color
-  shader_program_.enableAttributeArray("a_color");
-  shader_program_.setAttributeBuffer(
-      "a_color", GL_FLOAT, 3 * sizeof(GLfloat), 4, sizeof(PointPainter::Data));
+  uploaded_data_ = data;
 
   // Make sure they are not changed from the outside
   vbo_.release();
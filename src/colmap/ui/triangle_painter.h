@@ -63,6 +63,10 @@ class TrianglePainter {
   QOpenGLBuffer vbo_;
 
   size_t num_geoms_;
+  // The allocated number of geometries in the buffer and a copy of the last
+  // uploaded data, such that only changed data is uploaded again.
+  size_t capacity_;
+  std::vector<TrianglePainter::Data> uploaded_data_;
 };
 
 }  // namespace colmap
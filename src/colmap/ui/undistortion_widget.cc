@@ -56,6 +56,9 @@ UndistortionWidget::UndistortionWidget(QWidget* parent,
   AddOptionDouble(&undistortion_options_.roi_min_y, "roi_min_y", 0.0, 1.0);
   AddOptionDouble(&undistortion_options_.roi_max_x, "roi_max_x", 0.0, 1.0);
   AddOptionDouble(&undistortion_options_.roi_max_y, "roi_max_y", 0.0, 1.0);
+  AddOptionDouble(&undistortion_options_.refrac_reference_distance,
+                  "refrac_reference_distance",
+                  0.0);
   AddOptionDirPath(&output_path_, "output_path");
 
   AddSpacer();
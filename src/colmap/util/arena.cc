@@ -0,0 +1,74 @@
+#include "colmap/util/arena.h"
+
+#include "colmap/util/logging.h"
+
+#include <new>
+
+namespace colmap {
+namespace {
+
+size_t SizeClass(const size_t num_bytes) {
+  return (num_bytes + MemoryPool::kAlignment - 1) / MemoryPool::kAlignment - 1;
+}
+
+}  // namespace
+
+MemoryPool::MemoryPool(const size_t slab_size)
+    : slab_size_(slab_size), slab_begin_(nullptr), slab_end_(nullptr) {
+  CHECK_GE(slab_size_, kMaxBlockSize);
+  free_lists_.fill(nullptr);
+}
+
+void* MemoryPool::Allocate(const size_t num_bytes) {
+  if (num_bytes == 0 || num_bytes > kMaxBlockSize) {
+    return ::operator new(num_bytes);
+  }
+
+  const size_t size_class = SizeClass(num_bytes);
+  const size_t block_size = (size_class + 1) * kAlignment;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  FreeBlock*& free_list = free_lists_[size_class];
+  if (free_list != nullptr) {
+    FreeBlock* block = free_list;
+    free_list = block->next;
+    return block;
+  }
+
+  if (slab_begin_ + block_size > slab_end_) {
+    // The remainder of the previous slab is smaller than the largest block
+    // size and thus negligible.
+    slabs_.emplace_back(new char[slab_size_]);
+    slab_begin_ = slabs_.back().get();
+    slab_end_ = slab_begin_ + slab_size_;
+  }
+
+  void* block = slab_begin_;
+  slab_begin_ += block_size;
+  return block;
+}
+
+void MemoryPool::Deallocate(void* ptr, const size_t num_bytes) {
+  if (ptr == nullptr) {
+    return;
+  }
+
+  if (num_bytes == 0 || num_bytes > kMaxBlockSize) {
+    ::operator delete(ptr);
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  FreeBlock*& free_list = free_lists_[SizeClass(num_bytes)];
+  FreeBlock* block = static_cast<FreeBlock*>(ptr);
+  block->next = free_list;
+  free_list = block;
+}
+
+size_t MemoryPool::NumSlabBytes() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return slabs_.size() * slab_size_;
+}
+
+}  // namespace colmap
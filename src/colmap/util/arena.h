@@ -0,0 +1,147 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <vector>
+
+namespace colmap {
+
+// Pool of small memory blocks, which are carved from large slabs and recycled
+// through one free list per size class. Requests of up to kMaxBlockSize bytes
+// are rounded up to a multiple of kAlignment, while larger requests are
+// forwarded to the global allocator. This avoids one malloc/free per node of
+// node-based containers with millions of elements and keeps nodes allocated
+// in sequence close in memory. The memory of the slabs is only returned to the
+// system when the pool is destroyed.
+class MemoryPool {
+ public:
+  static constexpr size_t kAlignment = alignof(std::max_align_t);
+  static constexpr size_t kMaxBlockSize = 256;
+
+  explicit MemoryPool(size_t slab_size = 1 << 20);
+
+  MemoryPool(const MemoryPool&) = delete;
+  MemoryPool& operator=(const MemoryPool&) = delete;
+
+  void* Allocate(size_t num_bytes);
+  void Deallocate(void* ptr, size_t num_bytes);
+
+  // The number of bytes allocated in slabs, including the free blocks.
+  size_t NumSlabBytes() const;
+
+ private:
+  struct FreeBlock {
+    FreeBlock* next;
+  };
+
+  static constexpr size_t kNumSizeClasses = kMaxBlockSize / kAlignment;
+
+  const size_t slab_size_;
+  mutable std::mutex mutex_;
+  std::array<FreeBlock*, kNumSizeClasses> free_lists_;
+  std::vector<std::unique_ptr<char[]>> slabs_;
+  char* slab_begin_;
+  char* slab_end_;
+};
+
+// Standard allocator, which allocates from a shared memory pool. Copies of the
+// allocator, including rebound copies for other types, share the same pool,
+// while copy-constructed containers get their own pool. The allocator is
+// intended for the nodes of containers, such as std::unordered_map.
+//
+// Example usage:
+//
+//    std::unordered_map<int, double, std::hash<int>, std::equal_to<int>,
+//                       PoolAllocator<std::pair<const int, double>>> map;
+//
+template <typename T>
+class PoolAllocator {
+ public:
+  using value_type = T;
+  using propagate_on_container_copy_assignment = std::true_type;
+  using propagate_on_container_move_assignment = std::true_type;
+  using propagate_on_container_swap = std::true_type;
+  using is_always_equal = std::false_type;
+
+  PoolAllocator();
+  explicit PoolAllocator(std::shared_ptr<MemoryPool> pool);
+  // Moves intentionally copy, such that moved-from allocators keep their pool.
+  PoolAllocator(const PoolAllocator& other) = default;
+  PoolAllocator& operator=(const PoolAllocator& other) = default;
+  template <typename U>
+  PoolAllocator(const PoolAllocator<U>& other);  // NOLINT
+
+  T* allocate(size_t n);
+  void deallocate(T* ptr, size_t n);
+
+  PoolAllocator select_on_container_copy_construction() const;
+
+  const std::shared_ptr<MemoryPool>& Pool() const;
+
+  template <typename U>
+  bool operator==(const PoolAllocator<U>& other) const;
+  template <typename U>
+  bool operator!=(const PoolAllocator<U>& other) const;
+
+ private:
+  template <typename U>
+  friend class PoolAllocator;
+
+  std::shared_ptr<MemoryPool> pool_;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Implementation
+////////////////////////////////////////////////////////////////////////////////
+
+template <typename T>
+PoolAllocator<T>::PoolAllocator() : pool_(std::make_shared<MemoryPool>()) {}
+
+template <typename T>
+PoolAllocator<T>::PoolAllocator(std::shared_ptr<MemoryPool> pool)
+    : pool_(std::move(pool)) {}
+
+template <typename T>
+template <typename U>
+PoolAllocator<T>::PoolAllocator(const PoolAllocator<U>& other)
+    : pool_(other.pool_) {}
+
+template <typename T>
+T* PoolAllocator<T>::allocate(const size_t n) {
+  static_assert(alignof(T) <= MemoryPool::kAlignment,
+                "Over-aligned types are not supported by the memory pool");
+  return static_cast<T*>(pool_->Allocate(n * sizeof(T)));
+}
+
+template <typename T>
+void PoolAllocator<T>::deallocate(T* ptr, const size_t n) {
+  pool_->Deallocate(ptr, n * sizeof(T));
+}
+
+template <typename T>
+PoolAllocator<T> PoolAllocator<T>::select_on_container_copy_construction()
+    const {
+  return PoolAllocator();
+}
+
+template <typename T>
+const std::shared_ptr<MemoryPool>& PoolAllocator<T>::Pool() const {
+  return pool_;
+}
+
+template <typename T>
+template <typename U>
+bool PoolAllocator<T>::operator==(const PoolAllocator<U>& other) const {
+  return pool_ == other.pool_;
+}
+
+template <typename T>
+template <typename U>
+bool PoolAllocator<T>::operator!=(const PoolAllocator<U>& other) const {
+  return pool_ != other.pool_;
+}
+
+}  // namespace colmap
@@ -0,0 +1,84 @@
+#include "colmap/util/arena.h"
+
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace colmap {
+namespace {
+
+TEST(MemoryPool, AllocateDeallocate) {
+  MemoryPool pool(1024);
+  EXPECT_EQ(pool.NumSlabBytes(), 0);
+  void* ptr1 = pool.Allocate(24);
+  void* ptr2 = pool.Allocate(24);
+  EXPECT_NE(ptr1, ptr2);
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(ptr1) % MemoryPool::kAlignment, 0);
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(ptr2) % MemoryPool::kAlignment, 0);
+  EXPECT_EQ(pool.NumSlabBytes(), 1024);
+  pool.Deallocate(ptr1, 24);
+  // Freed blocks are recycled for the same size class.
+  EXPECT_EQ(pool.Allocate(20), ptr1);
+  pool.Deallocate(ptr1, 20);
+  pool.Deallocate(ptr2, 24);
+}
+
+TEST(MemoryPool, ManySlabs) {
+  MemoryPool pool(1024);
+  std::vector<void*> ptrs;
+  for (int i = 0; i < 100; ++i) {
+    ptrs.push_back(pool.Allocate(MemoryPool::kMaxBlockSize));
+    std::memset(ptrs.back(), i, MemoryPool::kMaxBlockSize);
+  }
+  EXPECT_EQ(pool.NumSlabBytes(), 25 * 1024);
+  for (void* ptr : ptrs) {
+    pool.Deallocate(ptr, MemoryPool::kMaxBlockSize);
+  }
+}
+
+TEST(MemoryPool, LargeAllocation) {
+  MemoryPool pool(1024);
+  void* ptr = pool.Allocate(2 * MemoryPool::kMaxBlockSize);
+  EXPECT_NE(ptr, nullptr);
+  EXPECT_EQ(pool.NumSlabBytes(), 0);
+  pool.Deallocate(ptr, 2 * MemoryPool::kMaxBlockSize);
+}
+
+TEST(PoolAllocator, UnorderedMap) {
+  using Map = std::unordered_map<int,
+                                 double,
+                                 std::hash<int>,
+                                 std::equal_to<int>,
+                                 PoolAllocator<std::pair<const int, double>>>;
+  Map map;
+  for (int i = 0; i < 1000; ++i) {
+    map.emplace(i, i);
+  }
+  for (int i = 0; i < 1000; i += 2) {
+    map.erase(i);
+  }
+  EXPECT_EQ(map.size(), 500);
+  for (int i = 1; i < 1000; i += 2) {
+    EXPECT_EQ(map.at(i), i);
+  }
+
+  // Copies get their own pool, while moves take over the pool.
+  Map map_copy = map;
+  EXPECT_NE(map_copy.get_allocator(), map.get_allocator());
+  EXPECT_EQ(map_copy, map);
+  const std::shared_ptr<MemoryPool> pool = map.get_allocator().Pool();
+  Map map_move = std::move(map);
+  EXPECT_EQ(map_move.get_allocator().Pool(), pool);
+  EXPECT_EQ(map_move, map_copy);
+
+  map_copy = map_move;
+  EXPECT_EQ(map_copy, map_move);
+  map_copy.clear();
+  EXPECT_EQ(map_move.size(), 500);
+}
+
+}  // namespace
+}  // namespace colmap
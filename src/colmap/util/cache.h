@@ -55,6 +55,10 @@ class LRUCache {
   // Check whether the element with the given key exists.
   bool Exists(const key_t& key) const;
 
+  // Get the value of an element without computing it or marking it as
+  // recently used. Returns null if the element does not exist.
+  const value_t* Peek(const key_t& key) const;
+
   // Get the value of an element either from the cache or compute the new value.
   const value_t& Get(const key_t& key);
   value_t& GetMutable(const key_t& key);
@@ -145,6 +149,15 @@ bool LRUCache<key_t, value_t>::Exists(const key_t& key) const {
   return elems_map_.find(key) != elems_map_.end();
 }
 
+template <typename key_t, typename value_t>
+const value_t* LRUCache<key_t, value_t>::Peek(const key_t& key) const {
+  const auto it = elems_map_.find(key);
+  if (it == elems_map_.end()) {
+    return nullptr;
+  }
+  return &it->second->second;
+}
+
 template <typename key_t, typename value_t>
 const value_t& LRUCache<key_t, value_t>::Get(const key_t& key) {
   return GetMutable(key);
@@ -66,6 +66,20 @@ TEST(LRUCache, Get) {
   EXPECT_TRUE(cache.Exists(6));
 }
 
+TEST(LRUCache, Peek) {
+  LRUCache<int, int> cache(2, [](const int key) { return key; });
+  EXPECT_EQ(cache.Peek(0), nullptr);
+  EXPECT_EQ(cache.NumElems(), 0);
+  cache.Get(0);
+  cache.Get(1);
+  ASSERT_NE(cache.Peek(0), nullptr);
+  EXPECT_EQ(*cache.Peek(0), 0);
+  // Peeking does not mark the element as recently used.
+  cache.Get(2);
+  EXPECT_EQ(cache.Peek(0), nullptr);
+  EXPECT_TRUE(cache.Exists(1));
+}
+
 TEST(LRUCache, GetMutable) {
   LRUCache<int, int> cache(5, [](const int key) { return key; });
   EXPECT_EQ(cache.NumElems(), 0);
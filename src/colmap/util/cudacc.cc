@@ -74,7 +74,8 @@ void CudaCheck(const char* file, const int line) {
 }
 
 void CudaSyncAndCheck(const char* file, const int line) {
-  // Synchronizes the default stream which is a nullptr.
+  // Synchronizes the default stream which is a nullptr. With the per-thread
+  // default streams of colmap_util_cuda, this is the calling thread's stream.
   const cudaError error = cudaStreamSynchronize(nullptr);
   if (cudaSuccess != error) {
     LOG(ERROR) << StringPrintf(
@@ -0,0 +1,440 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace colmap {
+
+// Map from integer identifiers to values, which stores the values in blocks
+// of consecutive identifiers with an occupancy bitmap per block. This replaces
+// hashing by direct indexing for dense identifiers, e.g., from the
+// autoincrement keys of the database, and iterates in ascending order of
+// identifiers. Like std::unordered_map, references and iterators to elements
+// remain valid when inserting or erasing other elements. The memory scales
+// with the largest identifier, so it is not suitable for sparse identifiers.
+//
+// The interface is the subset of std::unordered_map used by this library.
+template <typename Key, typename Value>
+class DenseIdMap {
+  static_assert(std::is_integral<Key>::value && std::is_unsigned<Key>::value,
+                "Identifiers must be unsigned integers");
+
+ public:
+  using key_type = Key;
+  using mapped_type = Value;
+  using value_type = std::pair<const Key, Value>;
+  using size_type = size_t;
+
+  template <bool kIsConst>
+  class Iterator;
+  using iterator = Iterator<false>;
+  using const_iterator = Iterator<true>;
+
+  DenseIdMap() = default;
+  DenseIdMap(const DenseIdMap& other);
+  DenseIdMap(DenseIdMap&& other) noexcept;
+  DenseIdMap& operator=(const DenseIdMap& other);
+  DenseIdMap& operator=(DenseIdMap&& other) noexcept;
+  ~DenseIdMap();
+
+  inline size_t size() const;
+  inline bool empty() const;
+
+  // Remove all elements and release their memory.
+  void clear();
+
+  // Reserve the memory for identifiers in the range [0, num_elements).
+  void reserve(size_t num_elements);
+
+  inline size_t count(Key key) const;
+  inline iterator find(Key key);
+  inline const_iterator find(Key key) const;
+
+  // Access the element with the given identifier, where `at` throws
+  // std::out_of_range for missing elements and `operator[]` inserts a default
+  // constructed value.
+  inline Value& at(Key key);
+  inline const Value& at(Key key) const;
+  Value& operator[](Key key);
+
+  template <typename... Args>
+  std::pair<iterator, bool> emplace(Key key, Args&&... args);
+
+  size_t erase(Key key);
+  iterator erase(const_iterator pos);
+
+  inline iterator begin();
+  inline iterator end();
+  inline const_iterator begin() const;
+  inline const_iterator end() const;
+  inline const_iterator cbegin() const;
+  inline const_iterator cend() const;
+
+  // The heap memory in bytes allocated by the map, excluding the heap memory
+  // of the values themselves.
+  size_t MemoryUsage() const;
+
+  template <bool kIsConst>
+  class Iterator {
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = typename DenseIdMap::value_type;
+    using difference_type = std::ptrdiff_t;
+    using pointer =
+        typename std::conditional<kIsConst, const value_type*, value_type*>::
+            type;
+    using reference =
+        typename std::conditional<kIsConst, const value_type&, value_type&>::
+            type;
+    using map_pointer =
+        typename std::conditional<kIsConst, const DenseIdMap*, DenseIdMap*>::
+            type;
+
+    Iterator() = default;
+    Iterator(map_pointer map, size_t index);
+    // Allow the conversion of mutable to constant iterators.
+    template <bool kIsOtherConst,
+              typename = typename std::enable_if<kIsConst &&
+                                                 !kIsOtherConst>::type>
+    Iterator(const Iterator<kIsOtherConst>& other);  // NOLINT
+
+    reference operator*() const { return *operator->(); }
+    pointer operator->() const { return map_->Slot(index_); }
+
+    Iterator& operator++();
+    Iterator operator++(int);
+
+    bool operator==(const Iterator& other) const {
+      return index_ == other.index_;
+    }
+    bool operator!=(const Iterator& other) const {
+      return index_ != other.index_;
+    }
+
+   private:
+    template <bool kIsOtherConst>
+    friend class Iterator;
+    friend class DenseIdMap;
+
+    map_pointer map_ = nullptr;
+    // The identifier of the element, where the end has the index of the
+    // first slot after the last block.
+    size_t index_ = 0;
+  };
+
+ private:
+  static constexpr size_t kBlockSize = 64;
+
+  struct Block {
+    uint64_t occupied = 0;
+    typename std::aligned_storage<sizeof(value_type),
+                                  alignof(value_type)>::type slots[kBlockSize];
+  };
+
+  inline bool IsOccupied(size_t index) const;
+  inline value_type* Slot(size_t index);
+  inline const value_type* Slot(size_t index) const;
+  // The index of the first occupied slot at or after the given index, or the
+  // end index if there is none.
+  size_t NextOccupied(size_t index) const;
+  inline size_t EndIndex() const;
+
+  std::vector<std::unique_ptr<Block>> blocks_;
+  size_t size_ = 0;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Implementation
+////////////////////////////////////////////////////////////////////////////////
+
+template <typename Key, typename Value>
+DenseIdMap<Key, Value>::DenseIdMap(const DenseIdMap& other) {
+  *this = other;
+}
+
+template <typename Key, typename Value>
+DenseIdMap<Key, Value>::DenseIdMap(DenseIdMap&& other) noexcept
+    : blocks_(std::move(other.blocks_)), size_(other.size_) {
+  other.blocks_.clear();
+  other.size_ = 0;
+}
+
+template <typename Key, typename Value>
+DenseIdMap<Key, Value>& DenseIdMap<Key, Value>::operator=(
+    const DenseIdMap& other) {
+  if (this != &other) {
+    clear();
+    blocks_.resize(other.blocks_.size());
+    for (const auto& element : other) {
+      emplace(element.first, element.second);
+    }
+  }
+  return *this;
+}
+
+template <typename Key, typename Value>
+DenseIdMap<Key, Value>& DenseIdMap<Key, Value>::operator=(
+    DenseIdMap&& other) noexcept {
+  if (this != &other) {
+    clear();
+    blocks_ = std::move(other.blocks_);
+    size_ = other.size_;
+    other.blocks_.clear();
+    other.size_ = 0;
+  }
+  return *this;
+}
+
+template <typename Key, typename Value>
+DenseIdMap<Key, Value>::~DenseIdMap() {
+  clear();
+}
+
+template <typename Key, typename Value>
+size_t DenseIdMap<Key, Value>::size() const {
+  return size_;
+}
+
+template <typename Key, typename Value>
+bool DenseIdMap<Key, Value>::empty() const {
+  return size_ == 0;
+}
+
+template <typename Key, typename Value>
+void DenseIdMap<Key, Value>::clear() {
+  for (size_t index = NextOccupied(0); index < EndIndex();
+       index = NextOccupied(index + 1)) {
+    Slot(index)->~value_type();
+  }
+  blocks_.clear();
+  size_ = 0;
+}
+
+template <typename Key, typename Value>
+void DenseIdMap<Key, Value>::reserve(const size_t num_elements) {
+  blocks_.reserve((num_elements + kBlockSize - 1) / kBlockSize);
+}
+
+template <typename Key, typename Value>
+size_t DenseIdMap<Key, Value>::count(const Key key) const {
+  return IsOccupied(key) ? 1 : 0;
+}
+
+template <typename Key, typename Value>
+typename DenseIdMap<Key, Value>::iterator DenseIdMap<Key, Value>::find(
+    const Key key) {
+  return IsOccupied(key) ? iterator(this, key) : end();
+}
+
+template <typename Key, typename Value>
+typename DenseIdMap<Key, Value>::const_iterator DenseIdMap<Key, Value>::find(
+    const Key key) const {
+  return IsOccupied(key) ? const_iterator(this, key) : end();
+}
+
+template <typename Key, typename Value>
+Value& DenseIdMap<Key, Value>::at(const Key key) {
+  if (!IsOccupied(key)) {
+    throw std::out_of_range("DenseIdMap::at");
+  }
+  return Slot(key)->second;
+}
+
+template <typename Key, typename Value>
+const Value& DenseIdMap<Key, Value>::at(const Key key) const {
+  if (!IsOccupied(key)) {
+    throw std::out_of_range("DenseIdMap::at");
+  }
+  return Slot(key)->second;
+}
+
+template <typename Key, typename Value>
+Value& DenseIdMap<Key, Value>::operator[](const Key key) {
+  return emplace(key).first->second;
+}
+
+template <typename Key, typename Value>
+template <typename... Args>
+std::pair<typename DenseIdMap<Key, Value>::iterator, bool>
+DenseIdMap<Key, Value>::emplace(const Key key, Args&&... args) {
+  const size_t index = static_cast<size_t>(key);
+  if (IsOccupied(index)) {
+    return std::make_pair(iterator(this, index), false);
+  }
+
+  const size_t block_idx = index / kBlockSize;
+  if (block_idx >= blocks_.size()) {
+    blocks_.resize(block_idx + 1);
+  }
+  std::unique_ptr<Block>& block = blocks_[block_idx];
+  if (!block) {
+    block.reset(new Block);
+  }
+
+  new (Slot(index))
+      value_type(std::piecewise_construct,
+                 std::forward_as_tuple(key),
+                 std::forward_as_tuple(std::forward<Args>(args)...));
+  block->occupied |= uint64_t(1) << (index % kBlockSize);
+  ++size_;
+
+  return std::make_pair(iterator(this, index), true);
+}
+
+template <typename Key, typename Value>
+size_t DenseIdMap<Key, Value>::erase(const Key key) {
+  if (!IsOccupied(key)) {
+    return 0;
+  }
+  erase(const_iterator(this, key));
+  return 1;
+}
+
+template <typename Key, typename Value>
+typename DenseIdMap<Key, Value>::iterator DenseIdMap<Key, Value>::erase(
+    const const_iterator pos) {
+  const size_t index = pos.index_;
+  Slot(index)->~value_type();
+  std::unique_ptr<Block>& block = blocks_[index / kBlockSize];
+  block->occupied &= ~(uint64_t(1) << (index % kBlockSize));
+  --size_;
+  // Release empty blocks, which does not invalidate iterators to other
+  // elements, since they are in other blocks. The number of blocks is kept,
+  // such that the end iterator remains valid.
+  if (block->occupied == 0) {
+    block.reset();
+  }
+  return iterator(this, NextOccupied(index + 1));
+}
+
+template <typename Key, typename Value>
+typename DenseIdMap<Key, Value>::iterator DenseIdMap<Key, Value>::begin() {
+  return iterator(this, NextOccupied(0));
+}
+
+template <typename Key, typename Value>
+typename DenseIdMap<Key, Value>::iterator DenseIdMap<Key, Value>::end() {
+  return iterator(this, EndIndex());
+}
+
+template <typename Key, typename Value>
+typename DenseIdMap<Key, Value>::const_iterator DenseIdMap<Key, Value>::begin()
+    const {
+  return const_iterator(this, NextOccupied(0));
+}
+
+template <typename Key, typename Value>
+typename DenseIdMap<Key, Value>::const_iterator DenseIdMap<Key, Value>::end()
+    const {
+  return const_iterator(this, EndIndex());
+}
+
+template <typename Key, typename Value>
+typename DenseIdMap<Key, Value>::const_iterator
+DenseIdMap<Key, Value>::cbegin() const {
+  return begin();
+}
+
+template <typename Key, typename Value>
+typename DenseIdMap<Key, Value>::const_iterator DenseIdMap<Key, Value>::cend()
+    const {
+  return end();
+}
+
+template <typename Key, typename Value>
+size_t DenseIdMap<Key, Value>::MemoryUsage() const {
+  size_t memory_usage = blocks_.capacity() * sizeof(std::unique_ptr<Block>);
+  for (const auto& block : blocks_) {
+    if (block) {
+      memory_usage += sizeof(Block);
+    }
+  }
+  return memory_usage;
+}
+
+template <typename Key, typename Value>
+bool DenseIdMap<Key, Value>::IsOccupied(const size_t index) const {
+  const size_t block_idx = index / kBlockSize;
+  return block_idx < blocks_.size() && blocks_[block_idx] &&
+         (blocks_[block_idx]->occupied >> (index % kBlockSize)) & 1;
+}
+
+template <typename Key, typename Value>
+typename DenseIdMap<Key, Value>::value_type* DenseIdMap<Key, Value>::Slot(
+    const size_t index) {
+  return reinterpret_cast<value_type*>(
+      &blocks_[index / kBlockSize]->slots[index % kBlockSize]);
+}
+
+template <typename Key, typename Value>
+const typename DenseIdMap<Key, Value>::value_type*
+DenseIdMap<Key, Value>::Slot(const size_t index) const {
+  return reinterpret_cast<const value_type*>(
+      &blocks_[index / kBlockSize]->slots[index % kBlockSize]);
+}
+
+template <typename Key, typename Value>
+size_t DenseIdMap<Key, Value>::NextOccupied(const size_t index) const {
+  size_t block_idx = index / kBlockSize;
+  size_t slot_idx = index % kBlockSize;
+  while (block_idx < blocks_.size()) {
+    if (blocks_[block_idx]) {
+      uint64_t occupied = blocks_[block_idx]->occupied >> slot_idx;
+      if (occupied != 0) {
+        while ((occupied & 1) == 0) {
+          occupied >>= 1;
+          ++slot_idx;
+        }
+        return block_idx * kBlockSize + slot_idx;
+      }
+    }
+    ++block_idx;
+    slot_idx = 0;
+  }
+  return EndIndex();
+}
+
+template <typename Key, typename Value>
+size_t DenseIdMap<Key, Value>::EndIndex() const {
+  return blocks_.size() * kBlockSize;
+}
+
+template <typename Key, typename Value>
+template <bool kIsConst>
+DenseIdMap<Key, Value>::Iterator<kIsConst>::Iterator(map_pointer map,
+                                                     const size_t index)
+    : map_(map), index_(index) {}
+
+template <typename Key, typename Value>
+template <bool kIsConst>
+template <bool kIsOtherConst, typename>
+DenseIdMap<Key, Value>::Iterator<kIsConst>::Iterator(
+    const Iterator<kIsOtherConst>& other)
+    : map_(other.map_), index_(other.index_) {}
+
+template <typename Key, typename Value>
+template <bool kIsConst>
+typename DenseIdMap<Key, Value>::template Iterator<kIsConst>&
+DenseIdMap<Key, Value>::Iterator<kIsConst>::operator++() {
+  index_ = map_->NextOccupied(index_ + 1);
+  return *this;
+}
+
+template <typename Key, typename Value>
+template <bool kIsConst>
+typename DenseIdMap<Key, Value>::template Iterator<kIsConst>
+DenseIdMap<Key, Value>::Iterator<kIsConst>::operator++(int) {
+  Iterator iterator = *this;
+  ++(*this);
+  return iterator;
+}
+
+}  // namespace colmap
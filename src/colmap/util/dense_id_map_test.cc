@@ -0,0 +1,107 @@
+#include "colmap/util/dense_id_map.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace colmap {
+namespace {
+
+TEST(DenseIdMap, Empty) {
+  DenseIdMap<uint32_t, int> map;
+  EXPECT_EQ(map.size(), 0);
+  EXPECT_TRUE(map.empty());
+  EXPECT_EQ(map.begin(), map.end());
+  EXPECT_EQ(map.count(0), 0);
+  EXPECT_EQ(map.find(1), map.end());
+  EXPECT_THROW(map.at(1), std::out_of_range);
+  EXPECT_EQ(map.erase(1), 0);
+}
+
+TEST(DenseIdMap, EmplaceFindErase) {
+  DenseIdMap<uint32_t, std::string> map;
+  EXPECT_TRUE(map.emplace(3, "3").second);
+  EXPECT_TRUE(map.emplace(200, "200").second);
+  EXPECT_TRUE(map.emplace(1, "1").second);
+  EXPECT_FALSE(map.emplace(1, "x").second);
+  EXPECT_EQ(map.size(), 3);
+  EXPECT_EQ(map.count(1), 1);
+  EXPECT_EQ(map.count(2), 0);
+  EXPECT_EQ(map.at(200), "200");
+  EXPECT_EQ(map.find(3)->second, "3");
+  EXPECT_EQ(map.find(1000), map.end());
+
+  // Iteration is in ascending order of identifiers.
+  std::vector<uint32_t> keys;
+  for (const auto& element : map) {
+    keys.push_back(element.first);
+  }
+  EXPECT_EQ(keys, (std::vector<uint32_t>{1, 3, 200}));
+
+  const std::string& value = map.at(3);
+  map[100] = "100";
+  EXPECT_EQ(value, "3");
+  EXPECT_EQ(map.size(), 4);
+  EXPECT_EQ(map[5], "");
+  EXPECT_EQ(map.size(), 5);
+
+  EXPECT_EQ(map.erase(200), 1);
+  EXPECT_EQ(map.erase(200), 0);
+  EXPECT_EQ(map.size(), 4);
+  EXPECT_EQ(map.count(200), 0);
+
+  for (auto it = map.begin(); it != map.end();) {
+    if (it->first % 2 == 1) {
+      it = map.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  EXPECT_EQ(map.size(), 1);
+  EXPECT_EQ(map.begin()->first, 100);
+
+  for (auto it = map.begin(); it != map.end();) {
+    map.erase(it++);
+  }
+  EXPECT_TRUE(map.empty());
+  EXPECT_EQ(map.begin(), map.end());
+}
+
+TEST(DenseIdMap, CopyMove) {
+  DenseIdMap<uint32_t, std::unique_ptr<int>> map;
+  map.emplace(1, std::make_unique<int>(1));
+  map.emplace(70, std::make_unique<int>(70));
+  DenseIdMap<uint32_t, std::unique_ptr<int>> map_move = std::move(map);
+  EXPECT_TRUE(map.empty());
+  EXPECT_EQ(map_move.size(), 2);
+  EXPECT_EQ(*map_move.at(70), 70);
+
+  DenseIdMap<uint32_t, std::string> map1;
+  map1.emplace(1, "1");
+  map1.emplace(130, "130");
+  DenseIdMap<uint32_t, std::string> map2 = map1;
+  map2.at(1) = "x";
+  EXPECT_EQ(map1.at(1), "1");
+  EXPECT_EQ(map2.at(130), "130");
+  map1 = map2;
+  EXPECT_EQ(map1.at(1), "x");
+  map1.clear();
+  EXPECT_TRUE(map1.empty());
+  EXPECT_EQ(map2.size(), 2);
+}
+
+TEST(DenseIdMap, ConstIterator) {
+  DenseIdMap<uint32_t, int> map;
+  map.emplace(2, 2);
+  const auto& const_map = map;
+  DenseIdMap<uint32_t, int>::const_iterator it = map.begin();
+  EXPECT_EQ(it, const_map.begin());
+  EXPECT_EQ(it->second, 2);
+  EXPECT_EQ(const_map.find(2)->second, 2);
+  EXPECT_GT(map.MemoryUsage(), 0);
+}
+
+}  // namespace
+}  // namespace colmap
@@ -30,7 +30,9 @@
 #pragma once
 
 #include <algorithm>
+#include <cstring>
 #include <iostream>
+#include <string>
 #include <vector>
 
 namespace colmap {
@@ -67,6 +69,16 @@ void WriteBinaryLittleEndian(std::ostream* stream, const T& data);
 template <typename T>
 void WriteBinaryLittleEndian(std::ostream* stream, const std::vector<T>& data);
 
+// Read data in little endian format from a memory buffer and advance the
+// buffer pointer past the read data.
+template <typename T>
+T ReadBinaryLittleEndian(const char** buffer);
+
+// Append data in little endian format to a memory buffer, e.g., to serialize
+// data in memory before writing it to a stream with a single call.
+template <typename T>
+void AppendBinaryLittleEndian(std::string* buffer, const T& data);
+
 ////////////////////////////////////////////////////////////////////////////////
 // Implementation
 ////////////////////////////////////////////////////////////////////////////////
@@ -158,4 +170,18 @@ void WriteBinaryLittleEndian(std::ostream* stream, const std::vector<T>& data) {
   }
 }
 
+template <typename T>
+T ReadBinaryLittleEndian(const char** buffer) {
+  T data_little_endian;
+  std::memcpy(&data_little_endian, *buffer, sizeof(T));
+  *buffer += sizeof(T);
+  return LittleEndianToNative(data_little_endian);
+}
+
+template <typename T>
+void AppendBinaryLittleEndian(std::string* buffer, const T& data) {
+  const T data_little_endian = NativeToLittleEndian(data);
+  buffer->append(reinterpret_cast<const char*>(&data_little_endian), sizeof(T));
+}
+
 }  // namespace colmap
@@ -205,5 +205,29 @@ TEST(ReadWriteBinaryLittleEndian, Nominal) {
   TestFloatReadWriteBinaryLittleEndian<double>();
 }
 
+TEST(AppendReadBinaryLittleEndian, Nominal) {
+  std::string buffer;
+  AppendBinaryLittleEndian<uint8_t>(&buffer, 42);
+  AppendBinaryLittleEndian<int32_t>(&buffer, -7);
+  AppendBinaryLittleEndian<uint64_t>(&buffer, 1234567890123);
+  AppendBinaryLittleEndian<double>(&buffer, 3.5);
+  EXPECT_EQ(buffer.size(), 1 + 4 + 8 + 8);
+
+  // Serialized data matches the data written to a stream.
+  std::stringstream file;
+  WriteBinaryLittleEndian<uint8_t>(&file, 42);
+  WriteBinaryLittleEndian<int32_t>(&file, -7);
+  WriteBinaryLittleEndian<uint64_t>(&file, 1234567890123);
+  WriteBinaryLittleEndian<double>(&file, 3.5);
+  EXPECT_EQ(buffer, file.str());
+
+  const char* data = buffer.data();
+  EXPECT_EQ(ReadBinaryLittleEndian<uint8_t>(&data), 42);
+  EXPECT_EQ(ReadBinaryLittleEndian<int32_t>(&data), -7);
+  EXPECT_EQ(ReadBinaryLittleEndian<uint64_t>(&data), 1234567890123);
+  EXPECT_EQ(ReadBinaryLittleEndian<double>(&data), 3.5);
+  EXPECT_EQ(data, buffer.data() + buffer.size());
+}
+
 }  // namespace
 }  // namespace colmap
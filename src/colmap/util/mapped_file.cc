@@ -0,0 +1,47 @@
+#include "colmap/util/mapped_file.h"
+
+#include "colmap/util/logging.h"
+#include "colmap/util/misc.h"
+
+#include <fstream>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace colmap {
+
+MappedFile::MappedFile(const std::string& path) : data_(nullptr), size_(0) {
+  size_ = GetFileSize(path);
+  if (size_ == 0) {
+    return;
+  }
+
+#if defined(_WIN32)
+  std::ifstream file(path, std::ios::binary);
+  CHECK(file.is_open()) << path;
+  buffer_.resize(size_);
+  file.read(buffer_.data(), size_);
+  CHECK(file) << path;
+  data_ = buffer_.data();
+#else
+  const int fd = open(path.c_str(), O_RDONLY);
+  CHECK_NE(fd, -1) << path;
+  void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  CHECK(data != MAP_FAILED) << path;
+  data_ = static_cast<const char*>(data);
+#endif
+}
+
+MappedFile::~MappedFile() {
+#if !defined(_WIN32)
+  if (data_ != nullptr) {
+    munmap(const_cast<char*>(data_), size_);
+  }
+#endif
+}
+
+}  // namespace colmap
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace colmap {
+
+// Read-only memory mapping of a file, such that only the accessed pages are
+// read from disk. On platforms without mmap, the file is read into memory.
+class MappedFile {
+ public:
+  explicit MappedFile(const std::string& path);
+  ~MappedFile();
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  inline const char* Data() const;
+  inline size_t Size() const;
+
+ private:
+  const char* data_;
+  size_t size_;
+  // Fallback buffer if memory mapping is not supported.
+  std::vector<char> buffer_;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Implementation
+////////////////////////////////////////////////////////////////////////////////
+
+const char* MappedFile::Data() const { return data_; }
+
+size_t MappedFile::Size() const { return size_; }
+
+}  // namespace colmap
@@ -0,0 +1,274 @@
+#include "colmap/util/metrics.h"
+
+#include "colmap/util/logging.h"
+
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+#if defined(__linux__)
+#include <unistd.h>
+#endif
+
+namespace colmap {
+namespace {
+
+std::string EscapeJSON(const std::string& str) {
+  std::string escaped;
+  escaped.reserve(str.size());
+  for (const char c : str) {
+    if (c == '"' || c == '\\') {
+      escaped += '\\';
+      escaped += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      escaped += ' ';
+    } else {
+      escaped += c;
+    }
+  }
+  return escaped;
+}
+
+std::string EscapePrometheusHelp(const std::string& str) {
+  std::string escaped;
+  escaped.reserve(str.size());
+  for (const char c : str) {
+    if (c == '\\') {
+      escaped += "\\\\";
+    } else if (c == '\n') {
+      escaped += "\\n";
+    } else {
+      escaped += c;
+    }
+  }
+  return escaped;
+}
+
+void WritePrometheusHeader(const std::string& metric_name,
+                           const std::string& help,
+                           const std::string& type,
+                           std::ostream* stream) {
+  *stream << "# HELP " << metric_name << " " << EscapePrometheusHelp(help)
+          << "\n# TYPE " << metric_name << " " << type << "\n";
+}
+
+void WritePrometheusSummary(const std::string& metric_name,
+                            const TraceStatistics& statistics,
+                            std::ostream* stream) {
+  WritePrometheusHeader(metric_name, statistics.name, "summary", stream);
+  *stream << metric_name << "{quantile=\"0.5\"} " << statistics.p50 << "\n"
+          << metric_name << "{quantile=\"0.9\"} " << statistics.p90 << "\n"
+          << metric_name << "{quantile=\"0.99\"} " << statistics.p99 << "\n"
+          << metric_name << "_sum " << statistics.sum << "\n"
+          << metric_name << "_count " << statistics.count << "\n";
+}
+
+// Write the file under a temporary name and then rename it, such that readers
+// either see the previous or the new file.
+bool WriteFileAtomically(const std::string& path, const std::string& content) {
+  const std::string tmp_path = path + ".tmp";
+  {
+    std::ofstream file(tmp_path, std::ios::trunc);
+    if (!file.is_open()) {
+      LOG(ERROR) << "Failed to open metrics file " << tmp_path;
+      return false;
+    }
+    file << content;
+    if (!file.good()) {
+      return false;
+    }
+  }
+  if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+    LOG(ERROR) << "Failed to replace metrics file " << path;
+    return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+std::string PrometheusMetricName(const std::string& name) {
+  std::string metric_name = "colmap_";
+  metric_name.reserve(metric_name.size() + name.size());
+  for (const char c : name) {
+    if (std::isalnum(static_cast<unsigned char>(c))) {
+      metric_name += static_cast<char>(
+          std::tolower(static_cast<unsigned char>(c)));
+    } else if (metric_name.back() != '_') {
+      metric_name += '_';
+    }
+  }
+  while (metric_name.back() == '_') {
+    metric_name.pop_back();
+  }
+  return metric_name;
+}
+
+std::string FormatPrometheusMetrics(
+    const std::vector<TraceStatistics>& statistics,
+    const double uptime,
+    const int64_t resident_memory) {
+  std::ostringstream stream;
+  // Ensure that we do not lose any precision by storing in text.
+  stream.precision(17);
+
+  WritePrometheusHeader(
+      "colmap_uptime_seconds", "Uptime of the tracer", "gauge", &stream);
+  stream << "colmap_uptime_seconds " << uptime << "\n";
+  if (resident_memory >= 0) {
+    WritePrometheusHeader("colmap_resident_memory_bytes",
+                          "Resident memory of the process",
+                          "gauge",
+                          &stream);
+    stream << "colmap_resident_memory_bytes " << resident_memory << "\n";
+  }
+
+  for (const auto& stats : statistics) {
+    const std::string metric_name = PrometheusMetricName(stats.name);
+    switch (stats.type) {
+      case TraceStatistics::Type::SPAN:
+        WritePrometheusSummary(metric_name + "_microseconds", stats, &stream);
+        break;
+      case TraceStatistics::Type::COUNTER:
+        WritePrometheusHeader(
+            metric_name + "_total", stats.name, "counter", &stream);
+        stream << metric_name << "_total " << stats.sum << "\n";
+        break;
+      case TraceStatistics::Type::HISTOGRAM:
+        WritePrometheusSummary(metric_name, stats, &stream);
+        break;
+      case TraceStatistics::Type::GAUGE:
+        WritePrometheusHeader(metric_name, stats.name, "gauge", &stream);
+        stream << metric_name << " " << stats.sum << "\n";
+        break;
+    }
+  }
+
+  return stream.str();
+}
+
+std::string FormatJSONMetrics(const std::vector<TraceStatistics>& statistics,
+                              const std::vector<double>& rates,
+                              const double uptime,
+                              const int64_t resident_memory) {
+  CHECK_EQ(statistics.size(), rates.size());
+
+  std::ostringstream stream;
+  stream.precision(17);
+
+  stream << "{\"uptime\":" << uptime
+         << ",\"resident_memory\":" << resident_memory << ",\"metrics\":[";
+  for (size_t i = 0; i < statistics.size(); ++i) {
+    const TraceStatistics& stats = statistics[i];
+    if (i > 0) {
+      stream << ",";
+    }
+    stream << "\n{\"type\":\"" << TraceStatisticsTypeToString(stats.type)
+           << "\",\"name\":\"" << EscapeJSON(stats.name)
+           << "\",\"count\":" << stats.count << ",\"sum\":" << stats.sum
+           << ",\"mean\":" << stats.Mean() << ",\"min\":" << stats.min
+           << ",\"max\":" << stats.max << ",\"p50\":" << stats.p50
+           << ",\"p90\":" << stats.p90 << ",\"p99\":" << stats.p99
+           << ",\"rate\":" << rates[i] << "}";
+  }
+  stream << "\n]}\n";
+
+  return stream.str();
+}
+
+int64_t GetResidentMemory() {
+#if defined(__linux__)
+  std::ifstream file("/proc/self/statm");
+  int64_t num_total_pages = 0;
+  int64_t num_resident_pages = 0;
+  if (file >> num_total_pages >> num_resident_pages) {
+    return num_resident_pages * sysconf(_SC_PAGESIZE);
+  }
+#endif
+  return -1;
+}
+
+MetricsExporter::MetricsExporter(std::string path, const double interval)
+    : path_(std::move(path)), interval_(interval) {
+  CHECK(!path_.empty());
+  CHECK_GT(interval_, 0);
+}
+
+MetricsExporter::~MetricsExporter() { Stop(); }
+
+void MetricsExporter::Start() {
+  CHECK(!thread_.joinable());
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = false;
+  }
+  thread_ = std::thread(&MetricsExporter::Run, this);
+}
+
+void MetricsExporter::Stop() {
+  if (!thread_.joinable()) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  stop_condition_.notify_all();
+  thread_.join();
+  Export();
+}
+
+bool MetricsExporter::Export() {
+  const std::vector<TraceStatistics> statistics = Tracer::Instance().Summary();
+  const double uptime = Tracer::Instance().NowMicroSeconds() / 1e6;
+  const int64_t resident_memory = GetResidentMemory();
+
+  std::lock_guard<std::mutex> lock(export_mutex_);
+
+  // The statistics are cleared when the tracer is restarted, in which case
+  // the rates are computed from the restart.
+  const double elapsed = uptime - prev_uptime_;
+  const bool restarted = elapsed <= 0;
+  std::map<std::string, double> values;
+  std::vector<double> rates;
+  rates.reserve(statistics.size());
+  for (const auto& stats : statistics) {
+    const std::string key =
+        TraceStatisticsTypeToString(stats.type) + ":" + stats.name;
+    const double value = stats.type == TraceStatistics::Type::COUNTER
+                             ? stats.sum
+                             : static_cast<double>(stats.count);
+    values.emplace(key, value);
+    const auto prev_value = prev_values_.find(key);
+    if (restarted || prev_value == prev_values_.end()) {
+      rates.push_back(uptime > 0 ? value / uptime : 0);
+    } else {
+      rates.push_back((value - prev_value->second) / elapsed);
+    }
+  }
+  prev_uptime_ = uptime;
+  prev_values_ = std::move(values);
+
+  return WriteFileAtomically(
+             path_ + ".prom",
+             FormatPrometheusMetrics(statistics, uptime, resident_memory)) &&
+         WriteFileAtomically(
+             path_ + ".json",
+             FormatJSONMetrics(statistics, rates, uptime, resident_memory));
+}
+
+void MetricsExporter::Run() {
+  const auto interval = std::chrono::duration<double>(interval_);
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!stop_condition_.wait_for(lock, interval, [this]() {
+    return stop_;
+  })) {
+    lock.unlock();
+    Export();
+    lock.lock();
+  }
+}
+
+}  // namespace colmap
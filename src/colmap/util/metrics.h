@@ -0,0 +1,84 @@
+#pragma once
+
+#include "colmap/util/tracing.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace colmap {
+
+// Convert the name of a traced statistic into a metric name of Prometheus by
+// prefixing it with "colmap_" and replacing all other characters than letters
+// and digits with underscores, e.g., "Extracted images" into
+// "colmap_extracted_images".
+std::string PrometheusMetricName(const std::string& name);
+
+// Format the statistics in the text exposition format of Prometheus. Counters
+// are exported as "<name>_total", gauges by their name, and spans and
+// histograms as summaries with their percentiles, where the span durations are
+// exported as "<name>_microseconds". The uptime in seconds and the resident
+// memory of the process are exported as additional gauges, where a negative
+// memory is omitted.
+std::string FormatPrometheusMetrics(
+    const std::vector<TraceStatistics>& statistics,
+    double uptime,
+    int64_t resident_memory);
+
+// Format the statistics as a JSON object with the uptime, the resident memory,
+// and the list of statistics. The rate of every statistic is the increase per
+// second of the sum of counters or of the count of all other statistics, e.g.,
+// since the previous export.
+std::string FormatJSONMetrics(const std::vector<TraceStatistics>& statistics,
+                              const std::vector<double>& rates,
+                              double uptime,
+                              int64_t resident_memory);
+
+// Resident memory of the process in bytes or -1 if it is unknown on the
+// platform.
+int64_t GetResidentMemory();
+
+// Periodically exports the statistics of the tracer as metrics for external
+// monitoring, e.g., to derive the throughput of long-running jobs or to detect
+// stalled jobs. The metrics are written to "<path>.prom" in the text format of
+// Prometheus, e.g., for the textfile collector of the node exporter, and to
+// "<path>.json". The files are replaced atomically, such that readers never
+// see partially written metrics. The exporter is owned by the tracer, which
+// starts it if `TracerOptions::metrics_path` is set.
+class MetricsExporter {
+ public:
+  MetricsExporter(std::string path, double interval);
+  ~MetricsExporter();
+
+  // Start the periodic export in a background thread.
+  void Start();
+
+  // Stop the periodic export and export the final metrics.
+  void Stop();
+
+  // Export the current metrics.
+  bool Export();
+
+ private:
+  void Run();
+
+  const std::string path_;
+  const double interval_;
+
+  std::thread thread_;
+  std::mutex mutex_;
+  std::condition_variable stop_condition_;
+  bool stop_ = false;
+
+  // The uptime and the sums or counts of the statistics of the previous export
+  // to compute the rates.
+  std::mutex export_mutex_;
+  double prev_uptime_ = 0;
+  std::map<std::string, double> prev_values_;
+};
+
+}  // namespace colmap
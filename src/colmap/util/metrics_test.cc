@@ -0,0 +1,133 @@
+#include "colmap/util/metrics.h"
+
+#include "colmap/util/misc.h"
+#include "colmap/util/testing.h"
+
+#include <fstream>
+#include <sstream>
+
+#include <gtest/gtest.h>
+
+namespace colmap {
+namespace {
+
+std::string ReadFile(const std::string& path) {
+  std::ifstream file(path);
+  std::stringstream content;
+  content << file.rdbuf();
+  return content.str();
+}
+
+TEST(PrometheusMetricName, Nominal) {
+  EXPECT_EQ(PrometheusMetricName("Extracted images"),
+            "colmap_extracted_images");
+  EXPECT_EQ(PrometheusMetricName("DatabaseCache memory [MB]"),
+            "colmap_databasecache_memory_mb");
+  EXPECT_EQ(PrometheusMetricName("FeatureMatcherWorker::Match"),
+            "colmap_featurematcherworker_match");
+  EXPECT_EQ(PrometheusMetricName(""), "colmap");
+}
+
+TEST(FormatPrometheusMetrics, Nominal) {
+  std::vector<TraceStatistics> statistics(3);
+  statistics[0].type = TraceStatistics::Type::SPAN;
+  statistics[0].name = "Span";
+  statistics[0].count = 2;
+  statistics[0].sum = 10;
+  statistics[1].type = TraceStatistics::Type::COUNTER;
+  statistics[1].name = "Counter";
+  statistics[1].sum = 7;
+  statistics[2].type = TraceStatistics::Type::GAUGE;
+  statistics[2].name = "Gauge";
+  statistics[2].sum = 3;
+
+  const std::string metrics = FormatPrometheusMetrics(statistics, 1.5, 1024);
+  EXPECT_NE(metrics.find("colmap_uptime_seconds 1.5\n"), std::string::npos);
+  EXPECT_NE(metrics.find("colmap_resident_memory_bytes 1024\n"),
+            std::string::npos);
+  EXPECT_NE(metrics.find("# TYPE colmap_span_microseconds summary\n"),
+            std::string::npos);
+  EXPECT_NE(metrics.find("colmap_span_microseconds_sum 10\n"),
+            std::string::npos);
+  EXPECT_NE(metrics.find("colmap_span_microseconds_count 2\n"),
+            std::string::npos);
+  EXPECT_NE(metrics.find("# TYPE colmap_counter_total counter\n"),
+            std::string::npos);
+  EXPECT_NE(metrics.find("colmap_counter_total 7\n"), std::string::npos);
+  EXPECT_NE(metrics.find("# TYPE colmap_gauge gauge\n"), std::string::npos);
+  EXPECT_NE(metrics.find("colmap_gauge 3\n"), std::string::npos);
+
+  EXPECT_EQ(FormatPrometheusMetrics(statistics, 1.5, -1)
+                .find("colmap_resident_memory_bytes"),
+            std::string::npos);
+}
+
+TEST(FormatJSONMetrics, Nominal) {
+  std::vector<TraceStatistics> statistics(1);
+  statistics[0].type = TraceStatistics::Type::COUNTER;
+  statistics[0].name = "Counter \"quoted\"";
+  statistics[0].count = 2;
+  statistics[0].sum = 4;
+
+  const std::string metrics = FormatJSONMetrics(statistics, {0.5}, 8, 1024);
+  EXPECT_NE(metrics.find("{\"uptime\":8,\"resident_memory\":1024"),
+            std::string::npos);
+  EXPECT_NE(metrics.find("\"type\":\"counter\",\"name\":\"Counter "
+                         "\\\"quoted\\\"\",\"count\":2,\"sum\":4"),
+            std::string::npos);
+  EXPECT_NE(metrics.find("\"rate\":0.5}"), std::string::npos);
+}
+
+TEST(GetResidentMemory, Nominal) {
+#if defined(__linux__)
+  EXPECT_GT(GetResidentMemory(), 0);
+#endif
+}
+
+TEST(MetricsExporter, Nominal) {
+  const std::string test_dir = CreateTestDir();
+  Tracer& tracer = Tracer::Instance();
+  TracerOptions options;
+  options.metrics_path = JoinPaths(test_dir, "metrics");
+  options.metrics_interval = 0.001;
+  tracer.Start(options);
+  COLMAP_METRIC_COUNTER("Extracted images", 3);
+  COLMAP_METRIC_GAUGE("Queue size", 2);
+  COLMAP_METRIC_HISTOGRAM("Iterations", 5);
+  tracer.Stop();
+
+  // The final metrics are exported on stop.
+  const std::string prometheus_metrics =
+      ReadFile(options.metrics_path + ".prom");
+  EXPECT_NE(prometheus_metrics.find("colmap_extracted_images_total 3\n"),
+            std::string::npos);
+  EXPECT_NE(prometheus_metrics.find("colmap_queue_size 2\n"),
+            std::string::npos);
+  EXPECT_NE(prometheus_metrics.find("colmap_iterations_count 1\n"),
+            std::string::npos);
+  EXPECT_FALSE(ExistsFile(options.metrics_path + ".prom.tmp"));
+
+  const std::string json_metrics = ReadFile(options.metrics_path + ".json");
+  EXPECT_NE(json_metrics.find("\"name\":\"Extracted images\""),
+            std::string::npos);
+  EXPECT_NE(json_metrics.find("\"name\":\"Queue size\""), std::string::npos);
+  EXPECT_NE(json_metrics.find("\"name\":\"Iterations\""), std::string::npos);
+}
+
+TEST(MetricsExporter, Rates) {
+  const std::string test_dir = CreateTestDir();
+  Tracer& tracer = Tracer::Instance();
+  tracer.Start();
+  MetricsExporter exporter(JoinPaths(test_dir, "metrics"), 1);
+  tracer.AddCounter("Counter", 1);
+  ASSERT_TRUE(exporter.Export());
+  // No increase since the previous export.
+  ASSERT_TRUE(exporter.Export());
+  tracer.Stop();
+
+  EXPECT_NE(ReadFile(JoinPaths(test_dir, "metrics.json")).find("\"rate\":0}"),
+            std::string::npos);
+}
+
+}  // namespace
+}  // namespace colmap
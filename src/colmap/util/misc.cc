@@ -29,6 +29,8 @@
 
 #include "colmap/util/misc.h"
 
+#include "colmap/util/threading.h"
+
 #include <cstdarg>
 
 namespace colmap {
@@ -158,6 +160,55 @@ std::vector<std::string> GetRecursiveFileList(const std::string& path) {
   return file_list;
 }
 
+std::vector<std::string> GetRecursiveFileList(const std::string& path,
+                                              const int num_threads) {
+  struct DirEntries {
+    std::vector<std::string> files;
+    std::vector<std::string> dirs;
+  };
+
+  // Like the recursive directory iterator, symbolic links to directories are
+  // not followed, which avoids cycles in the tree.
+  const auto ListDir = [](const std::string& dir_path) {
+    DirEntries entries;
+    for (auto it = boost::filesystem::directory_iterator(dir_path);
+         it != boost::filesystem::directory_iterator();
+         ++it) {
+      if (boost::filesystem::is_directory(it->symlink_status())) {
+        entries.dirs.push_back(it->path().string());
+      } else if (boost::filesystem::is_regular_file(it->status())) {
+        entries.files.push_back(it->path().string());
+      }
+    }
+    return entries;
+  };
+
+  ThreadPool thread_pool(GetEffectiveNumThreads(num_threads));
+
+  std::vector<std::string> file_list;
+  std::vector<std::string> dir_paths = {path};
+  std::vector<std::future<DirEntries>> futures;
+  while (!dir_paths.empty()) {
+    futures.clear();
+    futures.reserve(dir_paths.size());
+    for (const std::string& dir_path : dir_paths) {
+      futures.push_back(thread_pool.AddTask(ListDir, dir_path));
+    }
+    dir_paths.clear();
+    for (auto& future : futures) {
+      DirEntries entries = future.get();
+      file_list.insert(file_list.end(),
+                       std::make_move_iterator(entries.files.begin()),
+                       std::make_move_iterator(entries.files.end()));
+      dir_paths.insert(dir_paths.end(),
+                       std::make_move_iterator(entries.dirs.begin()),
+                       std::make_move_iterator(entries.dirs.end()));
+    }
+  }
+
+  return file_list;
+}
+
 std::vector<std::string> GetDirList(const std::string& path) {
   std::vector<std::string> dir_list;
   for (auto it = boost::filesystem::directory_iterator(path);
@@ -94,6 +94,13 @@ std::vector<std::string> GetFileList(const std::string& path);
 // Return list of files, recursively in all sub-directories.
 std::vector<std::string> GetRecursiveFileList(const std::string& path);
 
+// Return list of files, recursively in all sub-directories, where the
+// directories of the same depth are listed in parallel. This hides the
+// latency of listing large trees on network storage. The order of the files
+// is unspecified.
+std::vector<std::string> GetRecursiveFileList(const std::string& path,
+                                              int num_threads);
+
 // Return list of directories, recursively in all sub-directories.
 std::vector<std::string> GetDirList(const std::string& path);
 
@@ -139,6 +146,14 @@ std::vector<std::string> ReadTextFileLines(const std::string& path);
 // Remove an argument from the list of command-line arguments.
 void RemoveCommandLineArgument(const std::string& arg, int* argc, char** argv);
 
+// Estimate the heap memory in bytes allocated by a vector or by a hash map or
+// set of the standard library, excluding the memory of the container object
+// itself and the memory owned by the elements.
+template <typename T>
+size_t VectorMemoryUsage(const std::vector<T>& vector);
+template <typename HashTable>
+size_t HashTableMemoryUsage(const HashTable& hash_table);
+
 ////////////////////////////////////////////////////////////////////////////////
 // Implementation
 ////////////////////////////////////////////////////////////////////////////////
@@ -174,6 +189,22 @@ std::string VectorToCSV(const std::vector<T>& values) {
   return string.substr(0, string.length() - 2);
 }
 
+template <typename T>
+size_t VectorMemoryUsage(const std::vector<T>& vector) {
+  return vector.capacity() * sizeof(T);
+}
+
+template <typename HashTable>
+size_t HashTableMemoryUsage(const HashTable& hash_table) {
+  // Every element is stored in a separately allocated node, which holds the
+  // value, the pointer to the next node, and, depending on the key type, the
+  // cached hash value.
+  const size_t node_size =
+      sizeof(typename HashTable::value_type) + 2 * sizeof(void*);
+  return hash_table.size() * node_size +
+         hash_table.bucket_count() * sizeof(void*);
+}
+
 template <typename T>
 void ReadBinaryBlob(const std::string& path, std::vector<T>* data) {
   std::ifstream file(path, std::ios::binary | std::ios::ate);
@@ -29,6 +29,11 @@
 
 #include "colmap/util/misc.h"
 
+#include "colmap/util/testing.h"
+
+#include <algorithm>
+#include <fstream>
+
 #include <gtest/gtest.h>
 
 namespace colmap {
@@ -137,6 +142,26 @@ TEST(JoinPaths, Nominal) {
             "/test1/test2/test3.ext");
 }
 
+TEST(GetRecursiveFileList, Parallel) {
+  const std::string test_dir = CreateTestDir();
+  CreateDirIfNotExists(JoinPaths(test_dir, "a", "b"), /*recursive=*/true);
+  CreateDirIfNotExists(JoinPaths(test_dir, "c"));
+  std::ofstream(JoinPaths(test_dir, "file0")).close();
+  std::ofstream(JoinPaths(test_dir, "a", "file1")).close();
+  std::ofstream(JoinPaths(test_dir, "a", "b", "file2")).close();
+  std::ofstream(JoinPaths(test_dir, "c", "file3")).close();
+
+  std::vector<std::string> file_list = GetRecursiveFileList(test_dir);
+  std::sort(file_list.begin(), file_list.end());
+  EXPECT_EQ(file_list.size(), 4);
+  for (const int num_threads : {1, 4}) {
+    std::vector<std::string> parallel_file_list =
+        GetRecursiveFileList(test_dir, num_threads);
+    std::sort(parallel_file_list.begin(), parallel_file_list.end());
+    EXPECT_EQ(parallel_file_list, file_list);
+  }
+}
+
 TEST(VectorContainsValue, Nominal) {
   EXPECT_TRUE(VectorContainsValue<int>({1, 2, 3}, 1));
   EXPECT_FALSE(VectorContainsValue<int>({2, 3}, 1));
@@ -31,11 +31,123 @@
 
 #include "colmap/util/logging.h"
 
+#if defined(COLMAP_EGL_ENABLED)
+#define EGL_NO_X11
+#include <algorithm>
+#include <vector>
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GL/gl.h>
+#endif
+
 namespace colmap {
 
-#if defined(COLMAP_GUI_ENABLED)
+#if defined(COLMAP_EGL_ENABLED)
+namespace {
+
+EGLDisplay GetEGLDeviceDisplay(const int device_index) {
+  const auto query_devices = reinterpret_cast<PFNEGLQUERYDEVICESEXTPROC>(
+      eglGetProcAddress("eglQueryDevicesEXT"));
+  const auto get_platform_display =
+      reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(
+          eglGetProcAddress("eglGetPlatformDisplayEXT"));
+  if (query_devices == nullptr || get_platform_display == nullptr) {
+    CHECK_LE(device_index, 0)
+        << "EGL device enumeration is not supported by the EGL driver";
+    LOG(WARNING) << "EGL device enumeration is not supported by the EGL "
+                    "driver, falling back to the default display";
+    return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+  }
+
+  EGLint num_devices = 0;
+  CHECK(query_devices(0, nullptr, &num_devices));
+  CHECK_GT(num_devices, 0) << "Could not find any EGL devices";
+  std::vector<EGLDeviceEXT> devices(num_devices);
+  CHECK(query_devices(num_devices, devices.data(), &num_devices));
+  const int device_idx = std::max(device_index, 0);
+  CHECK_LT(device_idx, num_devices)
+      << "Invalid EGL device index, only found " << num_devices << " devices";
+  return get_platform_display(
+      EGL_PLATFORM_DEVICE_EXT, devices[device_idx], nullptr);
+}
+
+}  // namespace
+
+OpenGLContextManager::OpenGLContextManager(const int opengl_major_version,
+                                           const int opengl_minor_version,
+                                           const int device_index)
+    : display_(GetEGLDeviceDisplay(device_index)),
+      surface_(EGL_NO_SURFACE),
+      context_(EGL_NO_CONTEXT) {
+  CHECK(display_ != EGL_NO_DISPLAY) << "Could not get EGL display";
+  EGLint egl_major_version = 0;
+  EGLint egl_minor_version = 0;
+  CHECK(eglInitialize(display_, &egl_major_version, &egl_minor_version))
+      << "Could not initialize EGL display";
+
+  const EGLint config_attribs[] = {EGL_SURFACE_TYPE,
+                                   EGL_PBUFFER_BIT,
+                                   EGL_RENDERABLE_TYPE,
+                                   EGL_OPENGL_BIT,
+                                   EGL_RED_SIZE,
+                                   8,
+                                   EGL_GREEN_SIZE,
+                                   8,
+                                   EGL_BLUE_SIZE,
+                                   8,
+                                   EGL_DEPTH_SIZE,
+                                   24,
+                                   EGL_NONE};
+  EGLConfig config;
+  EGLint num_configs = 0;
+  CHECK(eglChooseConfig(display_, config_attribs, &config, 1, &num_configs));
+  CHECK_EQ(num_configs, 1) << "Could not find EGL config for OpenGL";
+
+  // SiftGPU renders into its own framebuffer objects, such that a minimal
+  // pbuffer surface suffices, similar to the offscreen surface of Qt.
+  const EGLint surface_attribs[] = {EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE};
+  surface_ = eglCreatePbufferSurface(display_, config, surface_attribs);
+  CHECK(surface_ != EGL_NO_SURFACE) << "Could not create EGL surface";
+
+  CHECK(eglBindAPI(EGL_OPENGL_API));
+  const EGLint context_attribs[] = {
+      EGL_CONTEXT_MAJOR_VERSION,
+      opengl_major_version,
+      EGL_CONTEXT_MINOR_VERSION,
+      opengl_minor_version,
+      EGL_CONTEXT_OPENGL_PROFILE_MASK,
+      EGL_CONTEXT_OPENGL_COMPATIBILITY_PROFILE_BIT,
+      EGL_NONE};
+  context_ =
+      eglCreateContext(display_, config, EGL_NO_CONTEXT, context_attribs);
+  CHECK(context_ != EGL_NO_CONTEXT) << "Could not create valid OpenGL context";
+
+  VLOG(2) << "Created EGL " << egl_major_version << "." << egl_minor_version
+          << " context on device " << std::max(device_index, 0);
+}
+
+OpenGLContextManager::~OpenGLContextManager() {
+  // The display is shared by all contexts on the same device and is thus not
+  // terminated. Contexts that are still current in another thread are only
+  // destroyed once they are released by that thread.
+  if (eglGetCurrentContext() == context_) {
+    eglMakeCurrent(display_, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+  }
+  eglDestroyContext(display_, context_);
+  eglDestroySurface(display_, surface_);
+}
+
+bool OpenGLContextManager::MakeCurrent() {
+  // The bound client API is a per-thread state of EGL.
+  return eglBindAPI(EGL_OPENGL_API) &&
+         eglMakeCurrent(display_, surface_, surface_, context_);
+}
+
+#elif defined(COLMAP_GUI_ENABLED)
 OpenGLContextManager::OpenGLContextManager(int opengl_major_version,
-                                           int opengl_minor_version)
+                                           int opengl_minor_version,
+                                           int device_index)
     : parent_thread_(QThread::currentThread()),
       current_thread_(nullptr),
       make_current_action_(new QAction(this)) {
@@ -87,6 +199,10 @@ void RunThreadWithOpenGLContext(Thread* thread) {
   QCoreApplication::processEvents();
 }
 
+#endif
+
+#if defined(COLMAP_EGL_ENABLED) || defined(COLMAP_GUI_ENABLED)
+
 void GLError(const char* file, const int line) {
   GLenum error_code(glGetError());
   while (error_code != GL_NO_ERROR) {
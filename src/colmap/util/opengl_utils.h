@@ -48,15 +48,55 @@ namespace colmap {
 #define glDebugLog()
 #endif
 
-#if defined(COLMAP_GUI_ENABLED)
+#if defined(COLMAP_EGL_ENABLED)
+
+// This class manages a headless OpenGL context on an EGL device, which neither
+// requires Qt nor a display server. In contrast to the Qt implementation, the
+// context can be created in any thread and RunThreadWithOpenGLContext does not
+// need a running QApplication. The device index selects the GPU of the context
+// among the EGL devices, where a negative index selects the first device.
+class OpenGLContextManager {
+ public:
+  explicit OpenGLContextManager(int opengl_major_version = 2,
+                                int opengl_minor_version = 1,
+                                int device_index = -1);
+  ~OpenGLContextManager();
+
+  OpenGLContextManager(const OpenGLContextManager&) = delete;
+  OpenGLContextManager& operator=(const OpenGLContextManager&) = delete;
+
+  // Make the OpenGL context current in the current thread. The context must
+  // not be current in any other thread.
+  bool MakeCurrent();
+
+ private:
+  // The EGLDisplay, EGLSurface, and EGLContext handles, which are kept opaque
+  // to not leak the platform headers of EGL into the includes of this header.
+  void* display_;
+  void* surface_;
+  void* context_;
+};
+
+inline void RunThreadWithOpenGLContext(Thread* thread) {
+  thread->Start();
+  thread->Wait();
+}
+
+// Get the OpenGL errors and print them to stderr.
+void GLError(const char* file, int line);
+
+#elif defined(COLMAP_GUI_ENABLED)
 
 // This class manages a thread-safe OpenGL context. Note that this class must be
 // instantiated in the main Qt thread, since an OpenGL context must be created
 // in it. The context can then be made current in any other thread.
 class OpenGLContextManager : public QObject {
  public:
+  // The device index is ignored, since Qt creates the context on the GPU of
+  // the display.
   explicit OpenGLContextManager(int opengl_major_version = 2,
-                                int opengl_minor_version = 1);
+                                int opengl_minor_version = 1,
+                                int device_index = -1);
 
   // Make the OpenGL context available by moving it from the thread where it was
   // created to the current thread and making it current.
@@ -88,11 +128,12 @@ void GLError(const char* file, int line);
 
 #else
 
-// Dummy implementation when GUI support is disabled
+// Dummy implementation when GUI and EGL support are disabled
 class OpenGLContextManager {
  public:
   explicit OpenGLContextManager(int opengl_major_version = 2,
-                                int opengl_minor_version = 1) {}
+                                int opengl_minor_version = 1,
+                                int device_index = -1) {}
   inline bool MakeCurrent() { return false; }
 };
 
@@ -29,14 +29,52 @@
 
 #include "colmap/util/opengl_utils.h"
 
-#include <QApplication>
 #include <thread>
 
 #include <gtest/gtest.h>
 
+#if !defined(COLMAP_EGL_ENABLED)
+#include <QApplication>
+#endif
+
 namespace colmap {
 namespace {
 
+#if defined(COLMAP_EGL_ENABLED)
+
+TEST(OpenGLContextManager, Nominal) {
+  OpenGLContextManager manager;
+
+  std::thread thread([&manager]() {
+    EXPECT_TRUE(manager.MakeCurrent());
+    EXPECT_TRUE(manager.MakeCurrent());
+  });
+  thread.join();
+}
+
+TEST(OpenGLContextManager, MultipleContexts) {
+  OpenGLContextManager manager1;
+  OpenGLContextManager manager2(2, 1, 0);
+
+  std::thread thread1([&manager1]() { EXPECT_TRUE(manager1.MakeCurrent()); });
+  std::thread thread2([&manager2]() { EXPECT_TRUE(manager2.MakeCurrent()); });
+  thread1.join();
+  thread2.join();
+}
+
+TEST(RunThreadWithOpenGLContext, Nominal) {
+  class TestThread : public Thread {
+   private:
+    void Run() { EXPECT_TRUE(opengl_context_.MakeCurrent()); }
+    OpenGLContextManager opengl_context_;
+  };
+
+  TestThread thread;
+  RunThreadWithOpenGLContext(&thread);
+}
+
+#else
+
 TEST(OpenGLContextManager, Nominal) {
   char app_name[] = "Test";
   int argc = 1;
@@ -71,5 +109,7 @@ TEST(RunThreadWithOpenGLContext, Nominal) {
   RunThreadWithOpenGLContext(&thread);
 }
 
+#endif
+
 }  // namespace
 }  // namespace colmap
@@ -31,13 +31,84 @@
 
 #include "colmap/util/eigen_alignment.h"
 #include "colmap/util/logging.h"
+#include "colmap/util/mapped_file.h"
 #include "colmap/util/misc.h"
+#include "colmap/util/threading.h"
 
+#include <algorithm>
+#include <cstring>
 #include <fstream>
+#include <sstream>
 
 #include <Eigen/Core>
 
 namespace colmap {
+namespace {
+
+size_t GetPlyTypeNumBytes(const std::string& type) {
+  if (type == "char" || type == "uchar" || type == "int8" || type == "uint8") {
+    return 1;
+  } else if (type == "short" || type == "ushort" || type == "int16" ||
+             type == "uint16") {
+    return 2;
+  } else if (type == "int" || type == "uint" || type == "float" ||
+             type == "int32" || type == "uint32" || type == "float32") {
+    return 4;
+  } else if (type == "double" || type == "float64") {
+    return 8;
+  }
+  LOG(FATAL) << "Invalid data type: " << type;
+  return 0;
+}
+
+template <typename T>
+double ReadBinaryPlyValue(std::istream* stream, const bool is_little_endian) {
+  T value;
+  stream->read(reinterpret_cast<char*>(&value), sizeof(T));
+  return is_little_endian ? LittleEndianToNative(value)
+                          : BigEndianToNative(value);
+}
+
+template <typename T>
+T ReadBinaryPlyValue(const char* data, const bool is_little_endian) {
+  T value;
+  std::memcpy(&value, data, sizeof(T));
+  return is_little_endian ? LittleEndianToNative(value)
+                          : BigEndianToNative(value);
+}
+
+template <typename T>
+void WriteBinaryPlyValue(const T value, char** data) {
+  const T little_endian_value = NativeToLittleEndian(value);
+  std::memcpy(*data, &little_endian_value, sizeof(T));
+  *data += sizeof(T);
+}
+
+double ReadBinaryPlyValue(std::istream* stream,
+                          const std::string& type,
+                          const bool is_little_endian) {
+  if (type == "char" || type == "int8") {
+    return ReadBinaryPlyValue<int8_t>(stream, is_little_endian);
+  } else if (type == "uchar" || type == "uint8") {
+    return ReadBinaryPlyValue<uint8_t>(stream, is_little_endian);
+  } else if (type == "short" || type == "int16") {
+    return ReadBinaryPlyValue<int16_t>(stream, is_little_endian);
+  } else if (type == "ushort" || type == "uint16") {
+    return ReadBinaryPlyValue<uint16_t>(stream, is_little_endian);
+  } else if (type == "int" || type == "int32") {
+    return ReadBinaryPlyValue<int32_t>(stream, is_little_endian);
+  } else if (type == "uint" || type == "uint32") {
+    return ReadBinaryPlyValue<uint32_t>(stream, is_little_endian);
+  } else if (type == "float" || type == "float32") {
+    return ReadBinaryPlyValue<float>(stream, is_little_endian);
+  } else if (type == "double" || type == "float64") {
+    return ReadBinaryPlyValue<double>(stream, is_little_endian);
+  }
+  LOG(FATAL) << "Invalid data type: " << type;
+  return 0;
+}
+
+}  // namespace
 
 std::vector<PlyPoint> ReadPly(const std::string& path) {
   std::ifstream file(path, std::ios::binary);
@@ -209,78 +280,47 @@ std::vector<PlyPoint> ReadPly(const std::string& path) {
   points.reserve(num_vertices);
 
   if (is_binary) {
-    std::vector<char> buffer(num_bytes_per_line);
-    for (size_t i = 0; i < num_vertices; ++i) {
-      file.read(buffer.data(), num_bytes_per_line);
-
-      PlyPoint point;
+    // The binary vertices have a fixed stride after the header, such that they
+    // can be decoded from the memory mapped file in parallel.
+    const size_t header_num_bytes = file.tellg();
+    file.close();
+    const MappedFile mapped_file(path);
+    CHECK_GE(mapped_file.Size(),
+             header_num_bytes + num_vertices * num_bytes_per_line)
+        << path;
+    const char* data = mapped_file.Data() + header_num_bytes;
+
+    auto ReadFloat = [is_little_endian](const char* value_data,
+                                        const bool is_double) {
+      if (is_double) {
+        return static_cast<float>(
+            ReadBinaryPlyValue<double>(value_data, is_little_endian));
+      }
+      return ReadBinaryPlyValue<float>(value_data, is_little_endian);
+    };
 
-      if (is_little_endian) {
-        point.x = LittleEndianToNative(
-            X_double ? *reinterpret_cast<double*>(&buffer[X_byte_pos])
-                     : *reinterpret_cast<float*>(&buffer[X_byte_pos]));
-        point.y = LittleEndianToNative(
-            Y_double ? *reinterpret_cast<double*>(&buffer[Y_byte_pos])
-                     : *reinterpret_cast<float*>(&buffer[Y_byte_pos]));
-        point.z = LittleEndianToNative(
-            Z_double ? *reinterpret_cast<double*>(&buffer[Z_byte_pos])
-                     : *reinterpret_cast<float*>(&buffer[Z_byte_pos]));
-
-        if (!is_normal_missing) {
-          point.nx = LittleEndianToNative(
-              NX_double ? *reinterpret_cast<double*>(&buffer[NX_byte_pos])
-                        : *reinterpret_cast<float*>(&buffer[NX_byte_pos]));
-          point.ny = LittleEndianToNative(
-              NY_double ? *reinterpret_cast<double*>(&buffer[NY_byte_pos])
-                        : *reinterpret_cast<float*>(&buffer[NY_byte_pos]));
-          point.nz = LittleEndianToNative(
-              NZ_double ? *reinterpret_cast<double*>(&buffer[NZ_byte_pos])
-                        : *reinterpret_cast<float*>(&buffer[NZ_byte_pos]));
-        }
+    points.resize(num_vertices);
+    ThreadPool thread_pool;
+    thread_pool.ParallelFor(0, num_vertices, 1 << 14, [&](const int64_t i) {
+      const char* line_data = data + i * num_bytes_per_line;
+      PlyPoint& point = points[i];
 
-        if (!is_rgb_missing) {
-          point.r = LittleEndianToNative(
-              *reinterpret_cast<uint8_t*>(&buffer[R_byte_pos]));
-          point.g = LittleEndianToNative(
-              *reinterpret_cast<uint8_t*>(&buffer[G_byte_pos]));
-          point.b = LittleEndianToNative(
-              *reinterpret_cast<uint8_t*>(&buffer[B_byte_pos]));
-        }
-      } else {
-        point.x = BigEndianToNative(
-            X_double ? *reinterpret_cast<double*>(&buffer[X_byte_pos])
-                     : *reinterpret_cast<float*>(&buffer[X_byte_pos]));
-        point.y = BigEndianToNative(
-            Y_double ? *reinterpret_cast<double*>(&buffer[Y_byte_pos])
-                     : *reinterpret_cast<float*>(&buffer[Y_byte_pos]));
-        point.z = BigEndianToNative(
-            Z_double ? *reinterpret_cast<double*>(&buffer[Z_byte_pos])
-                     : *reinterpret_cast<float*>(&buffer[Z_byte_pos]));
-
-        if (!is_normal_missing) {
-          point.nx = BigEndianToNative(
-              NX_double ? *reinterpret_cast<double*>(&buffer[NX_byte_pos])
-                        : *reinterpret_cast<float*>(&buffer[NX_byte_pos]));
-          point.ny = BigEndianToNative(
-              NY_double ? *reinterpret_cast<double*>(&buffer[NY_byte_pos])
-                        : *reinterpret_cast<float*>(&buffer[NY_byte_pos]));
-          point.nz = BigEndianToNative(
-              NZ_double ? *reinterpret_cast<double*>(&buffer[NZ_byte_pos])
-                        : *reinterpret_cast<float*>(&buffer[NZ_byte_pos]));
-        }
+      point.x = ReadFloat(line_data + X_byte_pos, X_double);
+      point.y = ReadFloat(line_data + Y_byte_pos, Y_double);
+      point.z = ReadFloat(line_data + Z_byte_pos, Z_double);
 
-        if (!is_rgb_missing) {
-          point.r = BigEndianToNative(
-              *reinterpret_cast<uint8_t*>(&buffer[R_byte_pos]));
-          point.g = BigEndianToNative(
-              *reinterpret_cast<uint8_t*>(&buffer[G_byte_pos]));
-          point.b = BigEndianToNative(
-              *reinterpret_cast<uint8_t*>(&buffer[B_byte_pos]));
-        }
+      if (!is_normal_missing) {
+        point.nx = ReadFloat(line_data + NX_byte_pos, NX_double);
+        point.ny = ReadFloat(line_data + NY_byte_pos, NY_double);
+        point.nz = ReadFloat(line_data + NZ_byte_pos, NZ_double);
       }
 
-      points.push_back(point);
-    }
+      if (!is_rgb_missing) {
+        point.r = line_data[R_byte_pos];
+        point.g = line_data[G_byte_pos];
+        point.b = line_data[B_byte_pos];
+      }
+    });
   } else {
     while (std::getline(file, line)) {
       StringTrim(&line);
@@ -400,28 +440,217 @@ void WriteBinaryPlyPoints(const std::string& path,
                            std::ios::out | std::ios::binary | std::ios::app);
   CHECK(binary_file.is_open()) << path;
 
-  for (const auto& point : points) {
-    WriteBinaryLittleEndian<float>(&binary_file, point.x);
-    WriteBinaryLittleEndian<float>(&binary_file, point.y);
-    WriteBinaryLittleEndian<float>(&binary_file, point.z);
+  // The points are encoded into a buffer in parallel and written in blocks.
+  const size_t num_bytes_per_point =
+      3 * sizeof(float) + (write_normal ? 3 * sizeof(float) : 0) +
+      (write_rgb ? 3 * sizeof(uint8_t) : 0);
+  const size_t kBlockNumPoints = 1 << 16;
+  std::vector<char> buffer(
+      std::min(points.size(), kBlockNumPoints) * num_bytes_per_point);
+  ThreadPool thread_pool;
+  for (size_t begin = 0; begin < points.size(); begin += kBlockNumPoints) {
+    const size_t end = std::min(points.size(), begin + kBlockNumPoints);
+    thread_pool.ParallelFor(begin, end, 1 << 12, [&](const int64_t i) {
+      const PlyPoint& point = points[i];
+      char* data = buffer.data() + (i - begin) * num_bytes_per_point;
+
+      WriteBinaryPlyValue<float>(point.x, &data);
+      WriteBinaryPlyValue<float>(point.y, &data);
+      WriteBinaryPlyValue<float>(point.z, &data);
+
+      if (write_normal) {
+        WriteBinaryPlyValue<float>(point.nx, &data);
+        WriteBinaryPlyValue<float>(point.ny, &data);
+        WriteBinaryPlyValue<float>(point.nz, &data);
+      }
 
-    if (write_normal) {
-      WriteBinaryLittleEndian<float>(&binary_file, point.nx);
-      WriteBinaryLittleEndian<float>(&binary_file, point.ny);
-      WriteBinaryLittleEndian<float>(&binary_file, point.nz);
+      if (write_rgb) {
+        WriteBinaryPlyValue<uint8_t>(point.r, &data);
+        WriteBinaryPlyValue<uint8_t>(point.g, &data);
+        WriteBinaryPlyValue<uint8_t>(point.b, &data);
+      }
+    });
+    binary_file.write(buffer.data(), (end - begin) * num_bytes_per_point);
+  }
+
+  binary_file.close();
+}
+
+PlyMesh ReadPlyMesh(const std::string& path) {
+  std::ifstream file(path, std::ios::binary);
+  CHECK(file.is_open()) << path;
+
+  struct PlyProperty {
+    std::string name;
+    std::string type;
+    // The type of the number of list elements for list properties.
+    std::string list_size_type;
+  };
+
+  bool is_binary = false;
+  bool is_little_endian = false;
+  size_t num_vertices = 0;
+  size_t num_faces = 0;
+  std::vector<PlyProperty> vertex_properties;
+  std::vector<PlyProperty> face_properties;
+  std::vector<PlyProperty>* properties = nullptr;
+
+  std::string line;
+  while (std::getline(file, line)) {
+    StringTrim(&line);
+
+    if (line.empty()) {
+      continue;
     }
 
-    if (write_rgb) {
-      WriteBinaryLittleEndian<uint8_t>(&binary_file, point.r);
-      WriteBinaryLittleEndian<uint8_t>(&binary_file, point.g);
-      WriteBinaryLittleEndian<uint8_t>(&binary_file, point.b);
+    if (line == "end_header") {
+      break;
+    }
+
+    const std::vector<std::string> line_elems = StringSplit(line, " ");
+
+    if (line_elems[0] == "format") {
+      if (line == "format ascii 1.0") {
+        is_binary = false;
+      } else if (line == "format binary_little_endian 1.0") {
+        is_binary = true;
+        is_little_endian = true;
+      } else if (line == "format binary_big_endian 1.0") {
+        is_binary = true;
+        is_little_endian = false;
+      }
+    } else if (line_elems.size() >= 3 && line_elems[0] == "element") {
+      properties = nullptr;
+      if (line_elems[1] == "vertex") {
+        num_vertices = std::stoll(line_elems[2]);
+        properties = &vertex_properties;
+      } else if (line_elems[1] == "face") {
+        num_faces = std::stoll(line_elems[2]);
+        properties = &face_properties;
+      } else {
+        CHECK_EQ(std::stoll(line_elems[2]), 0)
+            << "Only vertex and face elements supported";
+      }
+    } else if (line_elems.size() >= 3 && line_elems[0] == "property" &&
+               properties != nullptr) {
+      PlyProperty property;
+      if (line_elems[1] == "list") {
+        CHECK_EQ(line_elems.size(), 5);
+        property.list_size_type = line_elems[2];
+        property.type = line_elems[3];
+        property.name = line_elems[4];
+      } else {
+        property.type = line_elems[1];
+        property.name = line_elems[2];
+      }
+      GetPlyTypeNumBytes(property.type);
+      properties->push_back(property);
     }
   }
 
-  binary_file.close();
+  PlyMesh mesh;
+  mesh.vertices.resize(num_vertices);
+  mesh.faces.reserve(num_faces);
+
+  std::vector<double> values;
+  std::vector<size_t> vertex_idxs;
+
+  // Read the values of all properties of an element, where the values of a
+  // list property are appended to the vertex indices.
+  auto ReadElement = [&](const std::vector<PlyProperty>& properties) {
+    values.clear();
+    vertex_idxs.clear();
+    std::istringstream line_stream;
+    if (!is_binary) {
+      CHECK(std::getline(file, line)) << path;
+      line_stream.str(line);
+    }
+    auto ReadValue = [&](const std::string& type) {
+      if (is_binary) {
+        return ReadBinaryPlyValue(&file, type, is_little_endian);
+      }
+      double value;
+      CHECK(line_stream >> value) << path;
+      return value;
+    };
+    for (const auto& property : properties) {
+      if (property.list_size_type.empty()) {
+        values.push_back(ReadValue(property.type));
+      } else {
+        const size_t list_size =
+            static_cast<size_t>(ReadValue(property.list_size_type));
+        for (size_t i = 0; i < list_size; ++i) {
+          vertex_idxs.push_back(static_cast<size_t>(ReadValue(property.type)));
+        }
+        values.push_back(0);
+      }
+    }
+  };
+
+  auto FindProperty = [](const std::vector<PlyProperty>& properties,
+                         const std::vector<std::string>& names) {
+    for (size_t i = 0; i < properties.size(); ++i) {
+      if (std::find(names.begin(), names.end(), properties[i].name) !=
+          names.end()) {
+        return static_cast<int>(i);
+      }
+    }
+    return -1;
+  };
+
+  const int x_idx = FindProperty(vertex_properties, {"x"});
+  const int y_idx = FindProperty(vertex_properties, {"y"});
+  const int z_idx = FindProperty(vertex_properties, {"z"});
+  const int r_idx = FindProperty(vertex_properties, {"r", "red"});
+  const int g_idx = FindProperty(vertex_properties, {"g", "green"});
+  const int b_idx = FindProperty(vertex_properties, {"b", "blue"});
+  CHECK(x_idx != -1 && y_idx != -1 && z_idx != -1)
+      << "Invalid PLY file format: x, y, z properties missing";
+  const bool is_rgb_missing = r_idx == -1 || g_idx == -1 || b_idx == -1;
+
+  for (auto& vertex : mesh.vertices) {
+    ReadElement(vertex_properties);
+    vertex.x = values[x_idx];
+    vertex.y = values[y_idx];
+    vertex.z = values[z_idx];
+    if (!is_rgb_missing) {
+      vertex.r = values[r_idx];
+      vertex.g = values[g_idx];
+      vertex.b = values[b_idx];
+    }
+  }
+
+  const int vertex_idxs_idx =
+      FindProperty(face_properties, {"vertex_indices", "vertex_index"});
+  CHECK(num_faces == 0 || vertex_idxs_idx != -1)
+      << "Invalid PLY file format: vertex_indices property missing";
+  CHECK(num_faces == 0 ||
+        !face_properties[vertex_idxs_idx].list_size_type.empty());
+  CHECK(std::count_if(face_properties.begin(),
+                      face_properties.end(),
+                      [](const PlyProperty& property) {
+                        return !property.list_size_type.empty();
+                      }) <= 1)
+      << "Only a single list property of faces supported";
+
+  for (size_t i = 0; i < num_faces; ++i) {
+    ReadElement(face_properties);
+    for (const size_t vertex_idx : vertex_idxs) {
+      CHECK_LT(vertex_idx, num_vertices) << path;
+    }
+    // Triangulate polygonal faces as a fan.
+    for (size_t j = 2; j < vertex_idxs.size(); ++j) {
+      mesh.faces.emplace_back(
+          vertex_idxs[0], vertex_idxs[j - 1], vertex_idxs[j]);
+    }
+  }
+
+  return mesh;
 }
 
-void WriteTextPlyMesh(const std::string& path, const PlyMesh& mesh) {
+void WriteTextPlyMesh(const std::string& path,
+                      const PlyMesh& mesh,
+                      const bool write_rgb) {
   std::fstream file(path, std::ios::out);
   CHECK(file.is_open());
 
@@ -431,12 +660,22 @@ void WriteTextPlyMesh(const std::string& path, const PlyMesh& mesh) {
   file << "property float x" << std::endl;
   file << "property float y" << std::endl;
   file << "property float z" << std::endl;
+  if (write_rgb) {
+    file << "property uchar red" << std::endl;
+    file << "property uchar green" << std::endl;
+    file << "property uchar blue" << std::endl;
+  }
   file << "element face " << mesh.faces.size() << std::endl;
   file << "property list uchar int vertex_index" << std::endl;
   file << "end_header" << std::endl;
 
   for (const auto& vertex : mesh.vertices) {
-    file << vertex.x << " " << vertex.y << " " << vertex.z << std::endl;
+    file << vertex.x << " " << vertex.y << " " << vertex.z;
+    if (write_rgb) {
+      file << " " << static_cast<int>(vertex.r) << " "
+           << static_cast<int>(vertex.g) << " " << static_cast<int>(vertex.b);
+    }
+    file << std::endl;
   }
 
   for (const auto& face : mesh.faces) {
@@ -448,7 +687,9 @@ void WriteTextPlyMesh(const std::string& path, const PlyMesh& mesh) {
   }
 }
 
-void WriteBinaryPlyMesh(const std::string& path, const PlyMesh& mesh) {
+void WriteBinaryPlyMesh(const std::string& path,
+                        const PlyMesh& mesh,
+                        const bool write_rgb) {
   std::fstream text_file(path, std::ios::out);
   CHECK(text_file.is_open());
 
@@ -458,6 +699,11 @@ void WriteBinaryPlyMesh(const std::string& path, const PlyMesh& mesh) {
   text_file << "property float x" << std::endl;
   text_file << "property float y" << std::endl;
   text_file << "property float z" << std::endl;
+  if (write_rgb) {
+    text_file << "property uchar red" << std::endl;
+    text_file << "property uchar green" << std::endl;
+    text_file << "property uchar blue" << std::endl;
+  }
   text_file << "element face " << mesh.faces.size() << std::endl;
   text_file << "property list uchar int vertex_index" << std::endl;
   text_file << "end_header" << std::endl;
@@ -471,6 +717,11 @@ void WriteBinaryPlyMesh(const std::string& path, const PlyMesh& mesh) {
     WriteBinaryLittleEndian<float>(&binary_file, vertex.x);
     WriteBinaryLittleEndian<float>(&binary_file, vertex.y);
     WriteBinaryLittleEndian<float>(&binary_file, vertex.z);
+    if (write_rgb) {
+      WriteBinaryLittleEndian<uint8_t>(&binary_file, vertex.r);
+      WriteBinaryLittleEndian<uint8_t>(&binary_file, vertex.g);
+      WriteBinaryLittleEndian<uint8_t>(&binary_file, vertex.b);
+    }
   }
 
   for (const auto& face : mesh.faces) {
@@ -56,6 +56,9 @@ struct PlyMeshVertex {
   float x = 0.0f;
   float y = 0.0f;
   float z = 0.0f;
+  uint8_t r = 0;
+  uint8_t g = 0;
+  uint8_t b = 0;
 };
 
 struct PlyMeshFace {
@@ -90,8 +93,15 @@ void WriteBinaryPlyPoints(const std::string& path,
                           bool write_normal = true,
                           bool write_rgb = true);
 
+// Read PLY mesh from text or binary file. Polygonal faces are triangulated.
+PlyMesh ReadPlyMesh(const std::string& path);
+
 // Write PLY mesh to text or binary file.
-void WriteTextPlyMesh(const std::string& path, const PlyMesh& mesh);
-void WriteBinaryPlyMesh(const std::string& path, const PlyMesh& mesh);
+void WriteTextPlyMesh(const std::string& path,
+                      const PlyMesh& mesh,
+                      bool write_rgb = false);
+void WriteBinaryPlyMesh(const std::string& path,
+                        const PlyMesh& mesh,
+                        bool write_rgb = false);
 
 }  // namespace colmap
@@ -0,0 +1,205 @@
+#include "colmap/util/ply.h"
+
+#include "colmap/util/endian.h"
+#include "colmap/util/testing.h"
+
+#include <fstream>
+
+#include <gtest/gtest.h>
+
+namespace colmap {
+namespace {
+
+PlyMesh CreateTestMesh() {
+  PlyMesh mesh;
+  for (int i = 0; i < 4; ++i) {
+    PlyMeshVertex vertex(i, 2 * i, -i);
+    vertex.r = i;
+    vertex.g = 10 * i;
+    vertex.b = 255 - i;
+    mesh.vertices.push_back(vertex);
+  }
+  mesh.faces.emplace_back(0, 1, 2);
+  mesh.faces.emplace_back(1, 3, 2);
+  return mesh;
+}
+
+void ExpectEqualMeshes(const PlyMesh& mesh1,
+                       const PlyMesh& mesh2,
+                       const bool compare_rgb) {
+  ASSERT_EQ(mesh1.vertices.size(), mesh2.vertices.size());
+  for (size_t i = 0; i < mesh1.vertices.size(); ++i) {
+    EXPECT_EQ(mesh1.vertices[i].x, mesh2.vertices[i].x);
+    EXPECT_EQ(mesh1.vertices[i].y, mesh2.vertices[i].y);
+    EXPECT_EQ(mesh1.vertices[i].z, mesh2.vertices[i].z);
+    if (compare_rgb) {
+      EXPECT_EQ(mesh1.vertices[i].r, mesh2.vertices[i].r);
+      EXPECT_EQ(mesh1.vertices[i].g, mesh2.vertices[i].g);
+      EXPECT_EQ(mesh1.vertices[i].b, mesh2.vertices[i].b);
+    }
+  }
+  ASSERT_EQ(mesh1.faces.size(), mesh2.faces.size());
+  for (size_t i = 0; i < mesh1.faces.size(); ++i) {
+    EXPECT_EQ(mesh1.faces[i].vertex_idx1, mesh2.faces[i].vertex_idx1);
+    EXPECT_EQ(mesh1.faces[i].vertex_idx2, mesh2.faces[i].vertex_idx2);
+    EXPECT_EQ(mesh1.faces[i].vertex_idx3, mesh2.faces[i].vertex_idx3);
+  }
+}
+
+std::vector<PlyPoint> CreateTestPoints(const size_t num_points) {
+  std::vector<PlyPoint> points(num_points);
+  for (size_t i = 0; i < num_points; ++i) {
+    points[i].x = i;
+    points[i].y = -0.5f * i;
+    points[i].z = 0.25f * (i % 100);
+    points[i].nx = 1;
+    points[i].ny = 2;
+    points[i].nz = -3;
+    points[i].r = i % 256;
+    points[i].g = (i / 256) % 256;
+    points[i].b = 7;
+  }
+  return points;
+}
+
+void ExpectEqualPoints(const std::vector<PlyPoint>& points1,
+                       const std::vector<PlyPoint>& points2,
+                       const bool compare_normal,
+                       const bool compare_rgb) {
+  ASSERT_EQ(points1.size(), points2.size());
+  for (size_t i = 0; i < points1.size(); ++i) {
+    EXPECT_EQ(points1[i].x, points2[i].x);
+    EXPECT_EQ(points1[i].y, points2[i].y);
+    EXPECT_EQ(points1[i].z, points2[i].z);
+    if (compare_normal) {
+      EXPECT_EQ(points1[i].nx, points2[i].nx);
+      EXPECT_EQ(points1[i].ny, points2[i].ny);
+      EXPECT_EQ(points1[i].nz, points2[i].nz);
+    }
+    if (compare_rgb) {
+      EXPECT_EQ(points1[i].r, points2[i].r);
+      EXPECT_EQ(points1[i].g, points2[i].g);
+      EXPECT_EQ(points1[i].b, points2[i].b);
+    }
+  }
+}
+
+TEST(PlyPoints, ReadWriteText) {
+  const std::string test_dir = CreateTestDir();
+  const std::string path = test_dir + "/points.ply";
+  const std::vector<PlyPoint> points = CreateTestPoints(100);
+  WriteTextPlyPoints(path, points);
+  ExpectEqualPoints(ReadPly(path),
+                    points,
+                    /*compare_normal=*/true,
+                    /*compare_rgb=*/true);
+}
+
+TEST(PlyPoints, ReadWriteBinary) {
+  const std::string test_dir = CreateTestDir();
+  const std::string path = test_dir + "/points.ply";
+  // More points than are written in a single block.
+  const std::vector<PlyPoint> points = CreateTestPoints(100000);
+  for (const bool write_normal : {true, false}) {
+    for (const bool write_rgb : {true, false}) {
+      WriteBinaryPlyPoints(path, points, write_normal, write_rgb);
+      ExpectEqualPoints(ReadPly(path), points, write_normal, write_rgb);
+    }
+  }
+  WriteBinaryPlyPoints(path, {});
+  EXPECT_TRUE(ReadPly(path).empty());
+}
+
+TEST(PlyPoints, ReadBinaryBigEndianDouble) {
+  const std::string test_dir = CreateTestDir();
+  const std::string path = test_dir + "/points.ply";
+  {
+    std::ofstream file(path, std::ios::binary);
+    file << "ply\n"
+         << "format binary_big_endian 1.0\n"
+         << "element vertex 2\n"
+         << "property double x\n"
+         << "property double y\n"
+         << "property double z\n"
+         << "property uchar red\n"
+         << "property uchar green\n"
+         << "property uchar blue\n"
+         << "end_header\n";
+    for (int i = 0; i < 2; ++i) {
+      for (const double value : {1.5 + i, -2.0, 3.25}) {
+        const double big_endian_value = NativeToBigEndian(value);
+        file.write(reinterpret_cast<const char*>(&big_endian_value),
+                   sizeof(double));
+      }
+      const uint8_t rgb[3] = {10, 20, static_cast<uint8_t>(30 + i)};
+      file.write(reinterpret_cast<const char*>(rgb), sizeof(rgb));
+    }
+  }
+  const std::vector<PlyPoint> points = ReadPly(path);
+  ASSERT_EQ(points.size(), 2);
+  EXPECT_EQ(points[1].x, 2.5f);
+  EXPECT_EQ(points[1].y, -2.0f);
+  EXPECT_EQ(points[1].z, 3.25f);
+  EXPECT_EQ(points[1].r, 10);
+  EXPECT_EQ(points[1].g, 20);
+  EXPECT_EQ(points[1].b, 31);
+}
+
+TEST(PlyMesh, ReadWriteText) {
+  const std::string test_dir = CreateTestDir();
+  const std::string path = test_dir + "/mesh.ply";
+  const PlyMesh mesh = CreateTestMesh();
+  WriteTextPlyMesh(path, mesh);
+  ExpectEqualMeshes(ReadPlyMesh(path), mesh, /*compare_rgb=*/false);
+  EXPECT_EQ(ReadPlyMesh(path).vertices[3].b, 0);
+  WriteTextPlyMesh(path, mesh, /*write_rgb=*/true);
+  ExpectEqualMeshes(ReadPlyMesh(path), mesh, /*compare_rgb=*/true);
+}
+
+TEST(PlyMesh, ReadWriteBinary) {
+  const std::string test_dir = CreateTestDir();
+  const std::string path = test_dir + "/mesh.ply";
+  const PlyMesh mesh = CreateTestMesh();
+  WriteBinaryPlyMesh(path, mesh);
+  ExpectEqualMeshes(ReadPlyMesh(path), mesh, /*compare_rgb=*/false);
+  WriteBinaryPlyMesh(path, mesh, /*write_rgb=*/true);
+  ExpectEqualMeshes(ReadPlyMesh(path), mesh, /*compare_rgb=*/true);
+}
+
+TEST(PlyMesh, ReadPolygons) {
+  const std::string test_dir = CreateTestDir();
+  const std::string path = test_dir + "/mesh.ply";
+  {
+    std::ofstream file(path);
+    file << "ply\n"
+         << "format ascii 1.0\n"
+         << "comment polygon mesh with additional properties\n"
+         << "element vertex 4\n"
+         << "property double x\n"
+         << "property double y\n"
+         << "property double z\n"
+         << "property float value\n"
+         << "element face 1\n"
+         << "property list uchar int vertex_indices\n"
+         << "end_header\n"
+         << "0 0 0 0.5\n"
+         << "1 0 0 0.5\n"
+         << "1 1 0 0.5\n"
+         << "0 1 0 0.5\n"
+         << "4 0 1 2 3\n";
+  }
+  const PlyMesh mesh = ReadPlyMesh(path);
+  ASSERT_EQ(mesh.vertices.size(), 4);
+  EXPECT_EQ(mesh.vertices[2].x, 1);
+  EXPECT_EQ(mesh.vertices[2].y, 1);
+  ASSERT_EQ(mesh.faces.size(), 2);
+  EXPECT_EQ(mesh.faces[0].vertex_idx1, 0);
+  EXPECT_EQ(mesh.faces[0].vertex_idx2, 1);
+  EXPECT_EQ(mesh.faces[0].vertex_idx3, 2);
+  EXPECT_EQ(mesh.faces[1].vertex_idx1, 0);
+  EXPECT_EQ(mesh.faces[1].vertex_idx2, 2);
+  EXPECT_EQ(mesh.faces[1].vertex_idx3, 3);
+}
+
+}  // namespace
+}  // namespace colmap
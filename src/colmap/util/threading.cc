@@ -31,6 +31,9 @@
 
 #include "colmap/util/logging.h"
 
+#include <chrono>
+#include <stdexcept>
+
 namespace colmap {
 
 Thread::Thread()
@@ -181,9 +184,150 @@ void Thread::RunFunc() {
   Callback(FINISHED_CALLBACK);
 }
 
+thread_local ThreadPool::WorkerContext ThreadPool::current_worker_ = {nullptr,
+                                                                     -1};
+
+ThreadPool::TaskGroup::TaskGroup(ThreadPool* thread_pool)
+    : thread_pool_(thread_pool), num_pending_tasks_(0) {}
+
+ThreadPool::TaskGroup::~TaskGroup() { WaitUntilFinished(); }
+
+void ThreadPool::TaskGroup::Wait() {
+  WaitUntilFinished();
+  std::exception_ptr exception;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::swap(exception, exception_);
+  }
+  if (exception) {
+    std::rethrow_exception(exception);
+  }
+}
+
+void ThreadPool::TaskGroup::WaitUntilFinished() {
+  const int index = thread_pool_->CurrentWorkerIndex();
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (num_pending_tasks_ > 0) {
+    if (index < 0) {
+      finished_condition_.wait(lock);
+      continue;
+    }
+
+    // Workers execute pending tasks, e.g., the ones of this group, while
+    // waiting. If there are none, the remaining tasks of the group are
+    // executed by other workers, which may still spawn new tasks to steal.
+    lock.unlock();
+    const bool found_task = thread_pool_->RunPendingTask(index);
+    lock.lock();
+    if (!found_task && num_pending_tasks_ > 0) {
+      finished_condition_.wait_for(lock, std::chrono::microseconds(100));
+    }
+  }
+}
+
+void ThreadPool::TaskGroup::FinishTask(std::exception_ptr exception) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (exception && !exception_) {
+    exception_ = std::move(exception);
+  }
+  num_pending_tasks_ -= 1;
+  if (num_pending_tasks_ == 0) {
+    finished_condition_.notify_all();
+  }
+}
+
+ThreadPool::WorkStealingDeque::Buffer::Buffer(const int64_t capacity)
+    : capacity(capacity), tasks(new std::atomic<Task*>[capacity]) {}
+
+ThreadPool::Task* ThreadPool::WorkStealingDeque::Buffer::Get(
+    const int64_t idx) const {
+  return tasks[idx & (capacity - 1)].load(std::memory_order_relaxed);
+}
+
+void ThreadPool::WorkStealingDeque::Buffer::Put(const int64_t idx,
+                                                Task* task) {
+  tasks[idx & (capacity - 1)].store(task, std::memory_order_relaxed);
+}
+
+ThreadPool::WorkStealingDeque::WorkStealingDeque() : top_(0), bottom_(0) {
+  const int64_t kInitialCapacity = 256;
+  buffers_.emplace_back(new Buffer(kInitialCapacity));
+  buffer_.store(buffers_.back().get(), std::memory_order_relaxed);
+}
+
+void ThreadPool::WorkStealingDeque::Push(Task* task) {
+  const int64_t bottom = bottom_.load(std::memory_order_relaxed);
+  const int64_t top = top_.load(std::memory_order_acquire);
+  Buffer* buffer = buffer_.load(std::memory_order_relaxed);
+  if (bottom - top > buffer->capacity - 1) {
+    std::unique_ptr<Buffer> grown_buffer(new Buffer(2 * buffer->capacity));
+    for (int64_t idx = top; idx < bottom; ++idx) {
+      grown_buffer->Put(idx, buffer->Get(idx));
+    }
+    buffer = grown_buffer.get();
+    buffers_.push_back(std::move(grown_buffer));
+    buffer_.store(buffer, std::memory_order_release);
+  }
+  buffer->Put(bottom, task);
+  bottom_.store(bottom + 1, std::memory_order_release);
+}
+
+ThreadPool::Task* ThreadPool::WorkStealingDeque::Pop() {
+  const int64_t bottom = bottom_.load(std::memory_order_relaxed) - 1;
+  Buffer* buffer = buffer_.load(std::memory_order_relaxed);
+  // Sequentially consistent to order the store of the bottom before the load
+  // of the top with respect to concurrent steals.
+  bottom_.store(bottom, std::memory_order_seq_cst);
+  int64_t top = top_.load(std::memory_order_seq_cst);
+  if (top > bottom) {
+    // The deque is empty.
+    bottom_.store(bottom + 1, std::memory_order_relaxed);
+    return nullptr;
+  }
+
+  Task* task = buffer->Get(bottom);
+  if (top == bottom) {
+    // Race against concurrent steals for the last task.
+    if (!top_.compare_exchange_strong(top,
+                                      top + 1,
+                                      std::memory_order_seq_cst,
+                                      std::memory_order_relaxed)) {
+      task = nullptr;
+    }
+    bottom_.store(bottom + 1, std::memory_order_relaxed);
+  }
+  return task;
+}
+
+ThreadPool::Task* ThreadPool::WorkStealingDeque::Steal() {
+  int64_t top = top_.load(std::memory_order_seq_cst);
+  const int64_t bottom = bottom_.load(std::memory_order_seq_cst);
+  if (top >= bottom) {
+    return nullptr;
+  }
+
+  Buffer* buffer = buffer_.load(std::memory_order_acquire);
+  Task* task = buffer->Get(top);
+  if (!top_.compare_exchange_strong(top,
+                                    top + 1,
+                                    std::memory_order_seq_cst,
+                                    std::memory_order_relaxed)) {
+    // Lost the race against another steal or the owner.
+    return nullptr;
+  }
+  return task;
+}
+
 ThreadPool::ThreadPool(const int num_threads)
-    : stopped_(false), num_active_workers_(0) {
+    : stopped_(false),
+      num_queued_tasks_(0),
+      num_shared_tasks_(0),
+      num_unfinished_tasks_(0),
+      num_sleeping_workers_(0) {
   const int num_effective_threads = GetEffectiveNumThreads(num_threads);
+  for (int index = 0; index < num_effective_threads; ++index) {
+    deques_.emplace_back(new WorkStealingDeque());
+  }
   for (int index = 0; index < num_effective_threads; ++index) {
     std::function<void(void)> worker =
         std::bind(&ThreadPool::WorkerFunc, this, index);
@@ -202,9 +346,6 @@ void ThreadPool::Stop() {
     }
 
     stopped_ = true;
-
-    std::queue<std::function<void()>> empty_tasks;
-    std::swap(tasks_, empty_tasks);
   }
 
   task_condition_.notify_all();
@@ -213,55 +354,163 @@ void ThreadPool::Stop() {
     worker.join();
   }
 
+  // Discard all tasks that were not executed.
+  std::vector<Task*> discarded_tasks;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!tasks_.empty()) {
+      discarded_tasks.push_back(tasks_.front());
+      tasks_.pop();
+    }
+  }
+  for (auto& deque : deques_) {
+    while (Task* task = deque->Pop()) {
+      discarded_tasks.push_back(task);
+    }
+  }
+  for (Task* task : discarded_tasks) {
+    delete task;
+  }
+  num_queued_tasks_ = 0;
+  num_shared_tasks_ = 0;
+
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    num_unfinished_tasks_ -= static_cast<int64_t>(discarded_tasks.size());
+  }
+
   finished_condition_.notify_all();
 }
 
 void ThreadPool::Wait() {
   std::unique_lock<std::mutex> lock(mutex_);
-  if (!tasks_.empty() || num_active_workers_ > 0) {
-    finished_condition_.wait(
-        lock, [this]() { return tasks_.empty() && num_active_workers_ == 0; });
-  }
+  finished_condition_.wait(lock,
+                           [this]() { return num_unfinished_tasks_ == 0; });
 }
 
 void ThreadPool::WorkerFunc(const int index) {
-  {
-    std::lock_guard<std::mutex> lock(mutex_);
-    thread_id_to_index_.emplace(GetThreadId(), index);
-  }
-
-  while (true) {
-    std::function<void()> task;
-    {
-      std::unique_lock<std::mutex> lock(mutex_);
-      task_condition_.wait(lock,
-                           [this] { return stopped_ || !tasks_.empty(); });
-      if (stopped_ && tasks_.empty()) {
-        return;
-      }
-      task = std::move(tasks_.front());
-      tasks_.pop();
-      num_active_workers_ += 1;
+  current_worker_.thread_pool = this;
+  current_worker_.index = index;
+
+  while (!stopped_) {
+    Task* task = FindTask(index);
+    if (task != nullptr) {
+      RunTask(task);
+      continue;
     }
 
-    task();
+    std::unique_lock<std::mutex> lock(mutex_);
+    // The counters are sequentially consistent, such that either a task that
+    // is pushed concurrently is visible here or the pushing thread observes
+    // the sleeping worker and notifies it.
+    num_sleeping_workers_ += 1;
+    task_condition_.wait(
+        lock, [this] { return stopped_ || num_queued_tasks_ > 0; });
+    num_sleeping_workers_ -= 1;
+  }
+}
+
+int ThreadPool::CurrentWorkerIndex() const {
+  return current_worker_.thread_pool == this ? current_worker_.index : -1;
+}
 
-    {
-      std::unique_lock<std::mutex> lock(mutex_);
-      num_active_workers_ -= 1;
+bool ThreadPool::PushTask(Task* task) {
+  const int index = CurrentWorkerIndex();
+  if (index >= 0) {
+    // Workers are only stopped after finishing their current task, which
+    // discards all tasks pushed until then.
+    if (stopped_) {
+      return false;
+    }
+    num_unfinished_tasks_ += 1;
+    num_queued_tasks_ += 1;
+    deques_[index]->Push(task);
+  } else {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (stopped_) {
+      return false;
     }
+    num_unfinished_tasks_ += 1;
+    num_queued_tasks_ += 1;
+    num_shared_tasks_ += 1;
+    tasks_.push(task);
+  }
+
+  if (num_sleeping_workers_ > 0) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    task_condition_.notify_one();
+  }
 
+  return true;
+}
+
+ThreadPool::Task* ThreadPool::FindTask(const int index) {
+  if (num_queued_tasks_ == 0) {
+    return nullptr;
+  }
+
+  Task* task = deques_[index]->Pop();
+
+  if (task == nullptr && num_shared_tasks_ > 0) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (!tasks_.empty()) {
+      task = tasks_.front();
+      tasks_.pop();
+      num_shared_tasks_ -= 1;
+    }
+  }
+
+  const int num_workers = static_cast<int>(deques_.size());
+  for (int offset = 1; task == nullptr && offset < num_workers; ++offset) {
+    task = deques_[(index + offset) % num_workers]->Steal();
+  }
+
+  if (task != nullptr) {
+    num_queued_tasks_ -= 1;
+  }
+
+  return task;
+}
+
+bool ThreadPool::SpawnTask(Task* task) {
+  task->stream_id = ScopedTaskStream::NextChildId();
+  return PushTask(task);
+}
+
+void ThreadPool::RunTaskInStream(Task* task) {
+  ScopedTaskStream stream(task->stream_id);
+  task->Run();
+}
+
+void ThreadPool::RunTask(Task* task) {
+  RunTaskInStream(task);
+  delete task;
+
+  if (--num_unfinished_tasks_ == 0) {
+    std::unique_lock<std::mutex> lock(mutex_);
     finished_condition_.notify_all();
   }
 }
 
+bool ThreadPool::RunPendingTask(const int index) {
+  Task* task = FindTask(index);
+  if (task == nullptr) {
+    return false;
+  }
+  RunTask(task);
+  return true;
+}
+
 std::thread::id ThreadPool::GetThreadId() const {
   return std::this_thread::get_id();
 }
 
 int ThreadPool::GetThreadIndex() {
-  std::unique_lock<std::mutex> lock(mutex_);
-  return thread_id_to_index_.at(GetThreadId());
+  const int index = CurrentWorkerIndex();
+  if (index < 0) {
+    throw std::out_of_range("The current thread is not a worker of the pool.");
+  }
+  return index;
 }
 
 int GetEffectiveNumThreads(const int num_threads) {
@@ -277,4 +526,47 @@ int GetEffectiveNumThreads(const int num_threads) {
   return num_effective_threads;
 }
 
+namespace {
+
+std::atomic<bool> deterministic_execution(false);
+
+thread_local ScopedTaskStream* current_task_stream = nullptr;
+
+// The number of tasks spawned by the current thread outside of any stream.
+thread_local uint64_t num_root_task_stream_children = 0;
+
+}  // namespace
+
+void SetDeterministicExecution(const bool deterministic) {
+  deterministic_execution.store(deterministic, std::memory_order_relaxed);
+}
+
+bool IsDeterministicExecution() {
+  return deterministic_execution.load(std::memory_order_relaxed);
+}
+
+uint64_t MixTaskStreamIds(const uint64_t id1, const uint64_t id2) {
+  uint64_t z = id1 + 0x9e3779b97f4a7c15ULL * (id2 + 1);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+ScopedTaskStream::ScopedTaskStream(const uint64_t id)
+    : id_(id), num_children_(0), parent_(current_task_stream) {
+  current_task_stream = this;
+}
+
+ScopedTaskStream::~ScopedTaskStream() { current_task_stream = parent_; }
+
+ScopedTaskStream* ScopedTaskStream::Current() { return current_task_stream; }
+
+uint64_t ScopedTaskStream::NextChildId() {
+  if (current_task_stream == nullptr) {
+    return MixTaskStreamIds(0, num_root_task_stream_children++);
+  }
+  return MixTaskStreamIds(current_task_stream->id_,
+                          current_task_stream->num_children_++);
+}
+
 }  // namespace colmap
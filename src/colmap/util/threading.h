@@ -31,15 +31,24 @@
 
 #include "colmap/util/timer.h"
 
+#include <algorithm>
 #include <atomic>
 #include <climits>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
 #include <functional>
 #include <future>
 #include <list>
+#include <memory>
+#include <mutex>
 #include <queue>
+#include <random>
 #include <thread>
 #include <type_traits>
 #include <unordered_map>
+#include <vector>
 
 namespace colmap {
 
@@ -190,6 +199,24 @@ class Thread {
 //    }
 //    thread_pool.Wait();
 //
+// Fine-grained loops and groups of tasks can be run without manual chunking:
+//
+//    thread_pool.ParallelFor(0, num_points, 64, [](const int64_t i) {
+//      /* Do some work */
+//    });
+//
+//    ThreadPool::TaskGroup task_group(&thread_pool);
+//    task_group.Run([]() { /* Do some work */ });
+//    task_group.Wait();
+//
+// Every worker owns a work-stealing deque. Tasks submitted by a worker are
+// pushed to its own deque and executed in LIFO order, whereas idle workers
+// steal the oldest tasks of the other workers. Tasks submitted by other threads
+// are distributed through a shared queue. A worker that waits for a task group
+// or a parallel loop executes pending tasks instead of blocking, such that
+// nested parallelism, e.g., a bundle adjustment within a task, neither
+// deadlocks nor idles. Note that `Wait` must not be called from a worker.
+// Tasks and chunks run in task streams, see `SetDeterministicExecution`.
 class ThreadPool {
  public:
   static const int kMaxNumThreads = -1;
@@ -201,6 +228,35 @@ class ThreadPool {
   using result_of_t = typename std::result_of<func_t(args_t...)>::type;
 #endif
 
+  // A group of tasks that can be waited for independently of the other tasks
+  // of the thread pool. The destructor waits for all tasks of the group.
+  class TaskGroup {
+   public:
+    explicit TaskGroup(ThreadPool* thread_pool);
+    ~TaskGroup();
+
+    // Add a new task to the group. If the thread pool is stopped, the task is
+    // executed by the calling thread.
+    template <class func_t>
+    void Run(func_t&& func);
+
+    // Wait until all tasks of the group are finished. Rethrows the first
+    // exception thrown by any of the tasks.
+    void Wait();
+
+   private:
+    friend class ThreadPool;
+
+    void WaitUntilFinished();
+    void FinishTask(std::exception_ptr exception);
+
+    ThreadPool* thread_pool_;
+    int64_t num_pending_tasks_;
+    std::exception_ptr exception_;
+    std::mutex mutex_;
+    std::condition_variable finished_condition_;
+  };
+
   explicit ThreadPool(int num_threads = kMaxNumThreads);
   ~ThreadPool();
 
@@ -211,6 +267,16 @@ class ThreadPool {
   auto AddTask(func_t&& f, args_t&&... args)
       -> std::future<result_of_t<func_t, args_t...>>;
 
+  // Call func(i) for all i in [begin, end). The range is split into chunks of
+  // grain_size consecutive indices, which are dynamically scheduled on the
+  // workers. Blocks until all chunks are processed and rethrows the first
+  // exception thrown by func.
+  template <class func_t>
+  void ParallelFor(int64_t begin,
+                   int64_t end,
+                   int64_t grain_size,
+                   const func_t& func);
+
   // Stop the execution of all workers.
   void Stop();
 
@@ -226,19 +292,124 @@ class ThreadPool {
   int GetThreadIndex();
 
  private:
+  class Task {
+   public:
+    virtual ~Task() = default;
+    virtual void Run() = 0;
+
+    // The task stream, which is assigned by the spawning thread.
+    uint64_t stream_id = 0;
+  };
+
+  template <class func_t>
+  class FuncTask : public Task {
+   public:
+    explicit FuncTask(func_t func) : func_(std::move(func)) {}
+    void Run() override { func_(); }
+
+   private:
+    func_t func_;
+  };
+
+  // A task of a group, which signals the group once it is destroyed, whether
+  // it was executed or discarded by `Stop`.
+  template <class func_t>
+  class GroupTask : public Task {
+   public:
+    GroupTask(TaskGroup* group, func_t func)
+        : group_(group), func_(std::move(func)) {}
+    ~GroupTask() override { group_->FinishTask(exception_); }
+    void Run() override {
+      try {
+        func_();
+      } catch (...) {
+        exception_ = std::current_exception();
+      }
+    }
+
+   private:
+    TaskGroup* group_;
+    func_t func_;
+    std::exception_ptr exception_;
+  };
+
+  // Lock-free work-stealing deque of Chase and Lev, "Dynamic circular
+  // work-stealing deque", 2005, with the memory orderings of Le et al.,
+  // "Correct and efficient work-stealing for weak memory models", 2013. Only
+  // the owning worker may push and pop at the bottom, whereas all workers may
+  // steal from the top. Buffers replaced by growing the deque are retained
+  // until its destruction, since concurrent steals may still read them.
+  class WorkStealingDeque {
+   public:
+    WorkStealingDeque();
+
+    void Push(Task* task);
+    Task* Pop();
+    Task* Steal();
+
+   private:
+    struct Buffer {
+      explicit Buffer(int64_t capacity);
+      Task* Get(int64_t idx) const;
+      void Put(int64_t idx, Task* task);
+
+      const int64_t capacity;
+      std::unique_ptr<std::atomic<Task*>[]> tasks;
+    };
+
+    std::atomic<int64_t> top_;
+    std::atomic<int64_t> bottom_;
+    std::atomic<Buffer*> buffer_;
+    std::vector<std::unique_ptr<Buffer>> buffers_;
+  };
+
   void WorkerFunc(int index);
 
+  // Get the index of the current thread, if it is a worker of this pool, or
+  // otherwise -1.
+  int CurrentWorkerIndex() const;
+
+  // Queue a new task and take ownership of it. Returns false and does not take
+  // ownership if the thread pool is stopped.
+  bool PushTask(Task* task);
+
+  // Find a pending task in the deque of the given worker, the shared queue,
+  // or the deques of the other workers, or return null.
+  Task* FindTask(int index);
+
+  // Assign the next task stream of the current thread to the task, queue it,
+  // and take ownership of it, see `PushTask`.
+  bool SpawnTask(Task* task);
+
+  // Execute the task in its task stream.
+  static void RunTaskInStream(Task* task);
+
+  // Execute and delete the task.
+  void RunTask(Task* task);
+
+  // Execute a pending task by the given worker. Returns false if there is no
+  // pending task.
+  bool RunPendingTask(int index);
+
   std::vector<std::thread> workers_;
-  std::queue<std::function<void()>> tasks_;
+  std::vector<std::unique_ptr<WorkStealingDeque>> deques_;
+  std::queue<Task*> tasks_;
 
   std::mutex mutex_;
   std::condition_variable task_condition_;
   std::condition_variable finished_condition_;
 
-  bool stopped_;
-  int num_active_workers_;
+  std::atomic<bool> stopped_;
+  std::atomic<int64_t> num_queued_tasks_;
+  std::atomic<int64_t> num_shared_tasks_;
+  std::atomic<int64_t> num_unfinished_tasks_;
+  std::atomic<int> num_sleeping_workers_;
 
-  std::unordered_map<std::thread::id, int> thread_id_to_index_;
+  struct WorkerContext {
+    const ThreadPool* thread_pool;
+    int index;
+  };
+  static thread_local WorkerContext current_worker_;
 };
 
 // A job queue class for the producer-consumer paradigm.
@@ -295,6 +466,10 @@ class JobQueue {
   // Pop a job from the queue. Waits if there is no job in the queue.
   Job Pop();
 
+  // Pop a job from the queue without waiting. Returns an invalid job if there
+  // is no job in the queue.
+  Job TryPop();
+
   // Wait for all jobs to be popped and then stop the queue.
   void Wait();
 
@@ -314,37 +489,223 @@ class JobQueue {
   std::condition_variable empty_condition_;
 };
 
+// A bounded job queue with the same semantics as `JobQueue`, in which jobs are
+// pushed and popped without locks through a ring buffer of sequenced cells, see
+// Vyukov, "Bounded MPMC queue", 2010. Only threads that need to block, because
+// the queue is full or empty, fall back to waiting on a condition variable,
+// such that many producers and consumers do not serialize on a single mutex.
+template <typename T>
+class LockFreeJobQueue {
+ public:
+  typedef typename JobQueue<T>::Job Job;
+
+  explicit LockFreeJobQueue(size_t max_num_jobs);
+  ~LockFreeJobQueue();
+
+  // The number of pushed and not popped jobs in the queue.
+  size_t Size() const;
+
+  // Push a new job to the queue. Waits if the number of jobs is exceeded.
+  bool Push(T data);
+
+  // Push a new job to the queue without waiting. Returns false and leaves the
+  // data untouched if the number of jobs is exceeded or the queue is stopped.
+  bool TryPush(T* data);
+
+  // Pop a job from the queue. Waits if there is no job in the queue.
+  Job Pop();
+
+  // Pop a job from the queue without waiting. Returns an invalid job if there
+  // is no job in the queue.
+  Job TryPop();
+
+  // Wait for all jobs to be popped and then stop the queue.
+  void Wait();
+
+  // Stop the queue and return from all push/pop calls with false.
+  void Stop();
+
+  // Clear all pushed and not popped jobs from the queue.
+  void Clear();
+
+ private:
+  struct Cell {
+    std::atomic<size_t> sequence;
+    T data;
+  };
+
+  // Enqueue or dequeue a job without waiting. The data is only moved if the
+  // job was enqueued.
+  bool TryEnqueue(T* data);
+  bool TryDequeue(T* data);
+
+  // Wake up the threads waiting for a pop or push, if any.
+  void NotifyPop();
+  void NotifyPush();
+
+  // Padding to place the positions in separate cache lines.
+  static const size_t kCacheLineSize = 64;
+
+  const size_t max_num_jobs_;
+  std::unique_ptr<Cell[]> cells_;
+  char pad0_[kCacheLineSize];
+  std::atomic<size_t> enqueue_pos_;
+  char pad1_[kCacheLineSize];
+  std::atomic<size_t> dequeue_pos_;
+  char pad2_[kCacheLineSize];
+
+  std::atomic<bool> stop_;
+  std::atomic<int> num_push_waiters_;
+  std::atomic<int> num_pop_waiters_;
+  std::atomic<int> num_empty_waiters_;
+  std::mutex mutex_;
+  std::condition_variable push_condition_;
+  std::condition_variable pop_condition_;
+  std::condition_variable empty_condition_;
+};
+
 // Return the number of logical CPU cores if num_threads <= 0,
 // otherwise return the input value of num_threads.
 int GetEffectiveNumThreads(int num_threads);
 
+// Enable or disable the deterministic parallel execution, which is disabled by
+// default. Every task of a thread pool and every chunk of a parallel loop runs
+// in its own task stream, whose identifier only depends on the stream of the
+// spawning thread and on the order of spawning, but neither on the worker that
+// executes the task nor on the number of threads. In deterministic execution,
+// the random numbers of a task are drawn from a PRNG of its stream, see
+// `GetPRNG`, such that the results are reproducible at any number of threads.
+void SetDeterministicExecution(bool deterministic);
+bool IsDeterministicExecution();
+
+// Combine two identifiers into a well-distributed 64-bit identifier using the
+// finalizer of SplitMix64.
+uint64_t MixTaskStreamIds(uint64_t id1, uint64_t id2);
+
+// Scoped task stream of the current thread, which replaces the current stream
+// until it is destroyed. Streams are opened for all tasks of thread pools and
+// can be opened manually for jobs with a stable identity, e.g., an image pair,
+// which are processed by a varying thread.
+//
+//    for (const auto& image_pair : image_pairs) {
+//      ScopedTaskStream stream(ImagePairToPairId(image_pair));
+//      /* Draw random numbers */
+//    }
+//
+class ScopedTaskStream {
+ public:
+  explicit ScopedTaskStream(uint64_t id);
+  ~ScopedTaskStream();
+
+  ScopedTaskStream(const ScopedTaskStream&) = delete;
+  ScopedTaskStream& operator=(const ScopedTaskStream&) = delete;
+
+  inline uint64_t Id() const;
+
+  // The PRNG of the stream, which is created on first use.
+  inline std::unique_ptr<std::mt19937>& PRNG();
+
+  // The innermost stream of the current thread or null.
+  static ScopedTaskStream* Current();
+
+  // The stream identifier of a new task spawned by the current thread, which
+  // is derived from the current stream and the number of tasks it spawned
+  // before. Threads outside of any stream spawn from the stream with the
+  // identifier 0.
+  static uint64_t NextChildId();
+
+ private:
+  const uint64_t id_;
+  uint64_t num_children_;
+  std::unique_ptr<std::mt19937> prng_;
+  ScopedTaskStream* const parent_;
+};
+
 ////////////////////////////////////////////////////////////////////////////////
 // Implementation
 ////////////////////////////////////////////////////////////////////////////////
 
+uint64_t ScopedTaskStream::Id() const { return id_; }
+
+std::unique_ptr<std::mt19937>& ScopedTaskStream::PRNG() { return prng_; }
+
 size_t ThreadPool::NumThreads() const { return workers_.size(); }
 
+template <class func_t>
+void ThreadPool::TaskGroup::Run(func_t&& func) {
+  typedef typename std::decay<func_t>::type task_func_t;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    num_pending_tasks_ += 1;
+  }
+  std::unique_ptr<GroupTask<task_func_t>> task(
+      new GroupTask<task_func_t>(this, std::forward<func_t>(func)));
+  if (thread_pool_->SpawnTask(task.get())) {
+    task.release();
+  } else {
+    RunTaskInStream(task.get());
+  }
+}
+
 template <class func_t, class... args_t>
 auto ThreadPool::AddTask(func_t&& f, args_t&&... args)
     -> std::future<result_of_t<func_t, args_t...>> {
   typedef result_of_t<func_t, args_t...> return_t;
 
-  auto task = std::make_shared<std::packaged_task<return_t()>>(
+  std::packaged_task<return_t()> packaged_task(
       std::bind(std::forward<func_t>(f), std::forward<args_t>(args)...));
+  std::future<return_t> result = packaged_task.get_future();
 
-  std::future<return_t> result = task->get_future();
+  std::unique_ptr<Task> task(
+      new FuncTask<std::packaged_task<return_t()>>(std::move(packaged_task)));
+  if (!SpawnTask(task.get())) {
+    throw std::runtime_error("Cannot add task to stopped thread pool.");
+  }
+  task.release();
 
-  {
-    std::unique_lock<std::mutex> lock(mutex_);
-    if (stopped_) {
-      throw std::runtime_error("Cannot add task to stopped thread pool.");
-    }
-    tasks_.emplace([task]() { (*task)(); });
+  return result;
+}
+
+template <class func_t>
+void ThreadPool::ParallelFor(const int64_t begin,
+                             const int64_t end,
+                             const int64_t grain_size,
+                             const func_t& func) {
+  if (begin >= end) {
+    return;
   }
 
-  task_condition_.notify_one();
+  const int64_t chunk_size = std::max<int64_t>(1, grain_size);
+  const int64_t num_chunks = (end - begin + chunk_size - 1) / chunk_size;
+  std::atomic<int64_t> next_chunk(0);
+  // Every chunk runs in its own task stream, which only depends on the chunk
+  // index and not on the task that pulls the chunk.
+  const uint64_t stream_id = ScopedTaskStream::NextChildId();
+  const auto run_chunks = [&]() {
+    for (int64_t chunk = next_chunk.fetch_add(1); chunk < num_chunks;
+         chunk = next_chunk.fetch_add(1)) {
+      ScopedTaskStream chunk_stream(
+          MixTaskStreamIds(stream_id, static_cast<uint64_t>(chunk)));
+      const int64_t chunk_begin = begin + chunk * chunk_size;
+      const int64_t chunk_end = std::min(end, chunk_begin + chunk_size);
+      for (int64_t i = chunk_begin; i < chunk_end; ++i) {
+        func(i);
+      }
+    }
+  };
 
-  return result;
+  TaskGroup task_group(this);
+  {
+    // The number of tasks depends on the number of threads and must thus not
+    // advance the stream of the calling thread.
+    ScopedTaskStream spawn_stream(stream_id);
+    const int64_t num_tasks =
+        std::min(static_cast<int64_t>(NumThreads()), num_chunks);
+    for (int64_t i = 0; i < num_tasks; ++i) {
+      task_group.Run(run_chunks);
+    }
+  }
+  task_group.Wait();
 }
 
 template <typename T>
@@ -399,6 +760,22 @@ typename JobQueue<T>::Job JobQueue<T>::Pop() {
   }
 }
 
+template <typename T>
+typename JobQueue<T>::Job JobQueue<T>::TryPop() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (jobs_.empty() || stop_) {
+    return Job();
+  } else {
+    Job job(std::move(jobs_.front()));
+    jobs_.pop();
+    pop_condition_.notify_one();
+    if (jobs_.empty()) {
+      empty_condition_.notify_all();
+    }
+    return job;
+  }
+}
+
 template <typename T>
 void JobQueue<T>::Wait() {
   std::unique_lock<std::mutex> lock(mutex_);
@@ -421,4 +798,195 @@ void JobQueue<T>::Clear() {
   std::swap(jobs_, empty_jobs);
 }
 
+template <typename T>
+LockFreeJobQueue<T>::LockFreeJobQueue(const size_t max_num_jobs)
+    : max_num_jobs_(std::max<size_t>(1, max_num_jobs)),
+      cells_(new Cell[max_num_jobs_]),
+      enqueue_pos_(0),
+      dequeue_pos_(0),
+      stop_(false),
+      num_push_waiters_(0),
+      num_pop_waiters_(0),
+      num_empty_waiters_(0) {
+  for (size_t i = 0; i < max_num_jobs_; ++i) {
+    cells_[i].sequence.store(i, std::memory_order_relaxed);
+  }
+}
+
+template <typename T>
+LockFreeJobQueue<T>::~LockFreeJobQueue() {
+  Stop();
+}
+
+template <typename T>
+size_t LockFreeJobQueue<T>::Size() const {
+  // Jobs are only dequeued after being enqueued, such that loading the
+  // dequeue position first yields a non-negative size.
+  const size_t dequeue_pos = dequeue_pos_.load();
+  const size_t enqueue_pos = enqueue_pos_.load();
+  return std::min(enqueue_pos - dequeue_pos, max_num_jobs_);
+}
+
+template <typename T>
+bool LockFreeJobQueue<T>::Push(T data) {
+  while (true) {
+    if (stop_) {
+      return false;
+    }
+    if (TryEnqueue(&data)) {
+      NotifyPush();
+      return true;
+    }
+    // The counter of waiters and the positions are sequentially consistent,
+    // such that either the waiter observes a concurrent pop or the popping
+    // thread observes the waiter and notifies it.
+    std::unique_lock<std::mutex> lock(mutex_);
+    num_push_waiters_ += 1;
+    pop_condition_.wait(
+        lock, [this]() { return stop_ || Size() < max_num_jobs_; });
+    num_push_waiters_ -= 1;
+  }
+}
+
+template <typename T>
+bool LockFreeJobQueue<T>::TryPush(T* data) {
+  if (stop_ || !TryEnqueue(data)) {
+    return false;
+  }
+  NotifyPush();
+  return true;
+}
+
+template <typename T>
+typename LockFreeJobQueue<T>::Job LockFreeJobQueue<T>::Pop() {
+  while (true) {
+    if (stop_) {
+      return Job();
+    }
+    T data;
+    if (TryDequeue(&data)) {
+      NotifyPop();
+      return Job(std::move(data));
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    num_pop_waiters_ += 1;
+    push_condition_.wait(lock, [this]() { return stop_ || Size() > 0; });
+    num_pop_waiters_ -= 1;
+  }
+}
+
+template <typename T>
+typename LockFreeJobQueue<T>::Job LockFreeJobQueue<T>::TryPop() {
+  if (stop_) {
+    return Job();
+  }
+  T data;
+  if (TryDequeue(&data)) {
+    NotifyPop();
+    return Job(std::move(data));
+  }
+  return Job();
+}
+
+template <typename T>
+void LockFreeJobQueue<T>::Wait() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  num_empty_waiters_ += 1;
+  empty_condition_.wait(lock, [this]() { return Size() == 0; });
+  num_empty_waiters_ -= 1;
+}
+
+template <typename T>
+void LockFreeJobQueue<T>::Stop() {
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  push_condition_.notify_all();
+  pop_condition_.notify_all();
+}
+
+template <typename T>
+void LockFreeJobQueue<T>::Clear() {
+  T data;
+  bool cleared = false;
+  while (TryDequeue(&data)) {
+    cleared = true;
+  }
+  if (cleared) {
+    NotifyPop();
+  }
+}
+
+template <typename T>
+bool LockFreeJobQueue<T>::TryEnqueue(T* data) {
+  size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+  Cell* cell;
+  while (true) {
+    cell = &cells_[pos % max_num_jobs_];
+    const size_t sequence = cell->sequence.load(std::memory_order_acquire);
+    const std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(sequence) -
+                                static_cast<std::ptrdiff_t>(pos);
+    if (diff == 0) {
+      if (enqueue_pos_.compare_exchange_weak(pos, pos + 1)) {
+        break;
+      }
+    } else if (diff < 0) {
+      // The cell was not yet dequeued, i.e., the queue is full.
+      return false;
+    } else {
+      pos = enqueue_pos_.load(std::memory_order_relaxed);
+    }
+  }
+  cell->data = std::move(*data);
+  cell->sequence.store(pos + 1, std::memory_order_release);
+  return true;
+}
+
+template <typename T>
+bool LockFreeJobQueue<T>::TryDequeue(T* data) {
+  size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+  Cell* cell;
+  while (true) {
+    cell = &cells_[pos % max_num_jobs_];
+    const size_t sequence = cell->sequence.load(std::memory_order_acquire);
+    const std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(sequence) -
+                                static_cast<std::ptrdiff_t>(pos + 1);
+    if (diff == 0) {
+      if (dequeue_pos_.compare_exchange_weak(pos, pos + 1)) {
+        break;
+      }
+    } else if (diff < 0) {
+      // The cell was not yet enqueued, i.e., the queue is empty.
+      return false;
+    } else {
+      pos = dequeue_pos_.load(std::memory_order_relaxed);
+    }
+  }
+  *data = std::move(cell->data);
+  cell->data = T();
+  cell->sequence.store(pos + max_num_jobs_, std::memory_order_release);
+  return true;
+}
+
+template <typename T>
+void LockFreeJobQueue<T>::NotifyPop() {
+  if (num_push_waiters_ > 0) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    pop_condition_.notify_all();
+  }
+  if (num_empty_waiters_ > 0 && Size() == 0) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    empty_condition_.notify_all();
+  }
+}
+
+template <typename T>
+void LockFreeJobQueue<T>::NotifyPush() {
+  if (num_pop_waiters_ > 0) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    push_condition_.notify_one();
+  }
+}
+
 }  // namespace colmap
@@ -30,6 +30,8 @@
 #include "colmap/util/threading.h"
 
 #include "colmap/util/logging.h"
+#include "colmap/util/string.h"
+#include "colmap/util/timer.h"
 
 #include <gtest/gtest.h>
 
@@ -640,6 +642,161 @@ TEST(ThreadPool, GetThreadIndex) {
   }
 }
 
+TEST(ThreadPool, ParallelFor) {
+  ThreadPool pool(4);
+
+  for (const int64_t grain_size : {0, 1, 7, 1000, 2000}) {
+    std::vector<std::atomic<int>> counts(1000);
+    for (auto& count : counts) {
+      count = 0;
+    }
+    pool.ParallelFor(0, counts.size(), grain_size, [&](const int64_t i) {
+      counts[i] += 1;
+    });
+    for (const auto& count : counts) {
+      EXPECT_EQ(count, 1);
+    }
+  }
+
+  bool called = false;
+  pool.ParallelFor(10, 10, 1, [&](const int64_t) { called = true; });
+  EXPECT_FALSE(called);
+}
+
+TEST(ThreadPool, ParallelForNested) {
+  // More outer iterations than workers, such that all workers wait for inner
+  // loops, which only finish if the waiting workers execute pending tasks.
+  ThreadPool pool(2);
+
+  std::vector<std::atomic<int>> counts(16 * 100);
+  for (auto& count : counts) {
+    count = 0;
+  }
+  pool.ParallelFor(0, 16, 1, [&](const int64_t i) {
+    pool.ParallelFor(0, 100, 3, [&](const int64_t j) {
+      counts[i * 100 + j] += 1;
+    });
+  });
+  for (const auto& count : counts) {
+    EXPECT_EQ(count, 1);
+  }
+}
+
+TEST(ThreadPool, ParallelForException) {
+  ThreadPool pool(4);
+  EXPECT_THROW(pool.ParallelFor(0,
+                                100,
+                                1,
+                                [](const int64_t i) {
+                                  if (i == 42) {
+                                    throw std::runtime_error("");
+                                  }
+                                }),
+               std::runtime_error);
+  pool.Wait();
+}
+
+TEST(ThreadPool, TaskGroup) {
+  ThreadPool pool(4);
+
+  std::atomic<int> count(0);
+  std::vector<std::future<void>> futures;
+  for (int i = 0; i < 10; ++i) {
+    futures.push_back(pool.AddTask([&]() {
+      ThreadPool::TaskGroup task_group(&pool);
+      for (int j = 0; j < 100; ++j) {
+        task_group.Run([&]() { count += 1; });
+      }
+      task_group.Wait();
+    }));
+  }
+  for (auto& future : futures) {
+    future.get();
+  }
+  EXPECT_EQ(count, 1000);
+
+  ThreadPool::TaskGroup task_group(&pool);
+  task_group.Run([]() { throw std::runtime_error(""); });
+  EXPECT_THROW(task_group.Wait(), std::runtime_error);
+  EXPECT_NO_THROW(task_group.Wait());
+}
+
+TEST(ThreadPool, TaskGroupStop) {
+  ThreadPool pool(4);
+  pool.Stop();
+
+  ThreadPool::TaskGroup task_group(&pool);
+  bool called = false;
+  task_group.Run([&]() { called = true; });
+  task_group.Wait();
+  EXPECT_TRUE(called);
+}
+
+TEST(ScopedTaskStream, Nominal) {
+  EXPECT_EQ(ScopedTaskStream::Current(), nullptr);
+  {
+    ScopedTaskStream stream1(1);
+    EXPECT_EQ(ScopedTaskStream::Current(), &stream1);
+    const uint64_t child_id1 = ScopedTaskStream::NextChildId();
+    const uint64_t child_id2 = ScopedTaskStream::NextChildId();
+    EXPECT_NE(child_id1, child_id2);
+    {
+      ScopedTaskStream stream2(2);
+      EXPECT_EQ(ScopedTaskStream::Current(), &stream2);
+      EXPECT_EQ(stream2.Id(), 2);
+      EXPECT_NE(ScopedTaskStream::NextChildId(), child_id1);
+    }
+    EXPECT_EQ(ScopedTaskStream::Current(), &stream1);
+    EXPECT_NE(ScopedTaskStream::NextChildId(), child_id2);
+
+    ScopedTaskStream other_stream1(1);
+    EXPECT_EQ(ScopedTaskStream::NextChildId(), child_id1);
+  }
+  EXPECT_EQ(ScopedTaskStream::Current(), nullptr);
+}
+
+TEST(ScopedTaskStream, ThreadPool) {
+  // The streams of all tasks and chunks are independent of the number of
+  // threads and the worker executing them.
+  auto CollectStreamIds = [](const int num_threads) {
+    ThreadPool pool(num_threads);
+    ScopedTaskStream stream(42);
+    std::vector<uint64_t> stream_ids(8 * 100 + 10);
+    pool.ParallelFor(0, 8, 1, [&](const int64_t i) {
+      pool.ParallelFor(0, 100, 3, [&](const int64_t j) {
+        stream_ids[i * 100 + j] = ScopedTaskStream::Current()->Id();
+      });
+    });
+    std::vector<std::future<void>> futures;
+    for (int i = 0; i < 10; ++i) {
+      futures.push_back(pool.AddTask([&stream_ids, i]() {
+        stream_ids[800 + i] = ScopedTaskStream::Current()->Id();
+      }));
+    }
+    for (auto& future : futures) {
+      future.get();
+    }
+    return stream_ids;
+  };
+
+  const std::vector<uint64_t> stream_ids = CollectStreamIds(1);
+  EXPECT_EQ(CollectStreamIds(2), stream_ids);
+  EXPECT_EQ(CollectStreamIds(4), stream_ids);
+  // Indices of the same chunk share the stream.
+  EXPECT_EQ(stream_ids[0], stream_ids[2]);
+  EXPECT_NE(stream_ids[0], stream_ids[3]);
+  EXPECT_NE(stream_ids[0], stream_ids[100]);
+  EXPECT_NE(stream_ids[800], stream_ids[801]);
+}
+
+TEST(SetDeterministicExecution, Nominal) {
+  EXPECT_FALSE(IsDeterministicExecution());
+  SetDeterministicExecution(true);
+  EXPECT_TRUE(IsDeterministicExecution());
+  SetDeterministicExecution(false);
+  EXPECT_FALSE(IsDeterministicExecution());
+}
+
 TEST(JobQueue, SingleProducerSingleConsumer) {
   JobQueue<int> job_queue;
 
@@ -827,6 +984,21 @@ TEST(JobQueue, Wait) {
   consumer_thread.join();
 }
 
+TEST(JobQueue, TryPop) {
+  JobQueue<int> job_queue;
+  EXPECT_FALSE(job_queue.TryPop().IsValid());
+
+  EXPECT_TRUE(job_queue.Push(0));
+  EXPECT_TRUE(job_queue.Push(1));
+  const auto job = job_queue.TryPop();
+  EXPECT_TRUE(job.IsValid());
+  EXPECT_EQ(job.Data(), 0);
+  EXPECT_EQ(job_queue.Size(), 1);
+
+  job_queue.Stop();
+  EXPECT_FALSE(job_queue.TryPop().IsValid());
+}
+
 TEST(JobQueue, StopProducer) {
   JobQueue<int> job_queue(1);
 
@@ -887,6 +1059,251 @@ TEST(JobQueue, Clear) {
   EXPECT_EQ(job_queue.Size(), 0);
 }
 
+TEST(LockFreeJobQueue, SingleProducerSingleConsumerMaxNumJobs) {
+  LockFreeJobQueue<int> job_queue(2);
+
+  // IMPORTANT: EXPECT_TRUE_* macros are not thread-safe,
+  //            so we use glog's CHECK macros inside threads.
+
+  std::thread producer_thread([&job_queue]() {
+    for (int i = 0; i < 1000; ++i) {
+      CHECK(job_queue.Push(i));
+    }
+  });
+
+  std::thread consumer_thread([&job_queue]() {
+    for (int i = 0; i < 1000; ++i) {
+      CHECK_LE(job_queue.Size(), 2);
+      const auto job = job_queue.Pop();
+      CHECK(job.IsValid());
+      CHECK_EQ(job.Data(), i);
+    }
+  });
+
+  producer_thread.join();
+  consumer_thread.join();
+}
+
+TEST(LockFreeJobQueue, MultipleProducerMultipleConsumer) {
+  LockFreeJobQueue<int> job_queue(3);
+
+  // IMPORTANT: EXPECT_TRUE_* macros are not thread-safe,
+  //            so we use glog's CHECK macros inside threads.
+
+  const int kNumThreads = 4;
+  const int kNumJobs = 1000;
+
+  std::vector<std::thread> producer_threads;
+  for (int t = 0; t < kNumThreads; ++t) {
+    producer_threads.emplace_back([&job_queue]() {
+      for (int i = 0; i < kNumJobs; ++i) {
+        CHECK(job_queue.Push(i));
+      }
+    });
+  }
+
+  std::atomic<int> sum(0);
+  std::vector<std::thread> consumer_threads;
+  for (int t = 0; t < kNumThreads; ++t) {
+    consumer_threads.emplace_back([&job_queue, &sum]() {
+      for (int i = 0; i < kNumJobs; ++i) {
+        CHECK_LE(job_queue.Size(), 3);
+        const auto job = job_queue.Pop();
+        CHECK(job.IsValid());
+        CHECK_LT(job.Data(), kNumJobs);
+        sum += job.Data();
+      }
+    });
+  }
+
+  for (auto& thread : producer_threads) {
+    thread.join();
+  }
+  for (auto& thread : consumer_threads) {
+    thread.join();
+  }
+
+  EXPECT_EQ(sum, kNumThreads * kNumJobs * (kNumJobs - 1) / 2);
+  EXPECT_EQ(job_queue.Size(), 0);
+}
+
+TEST(LockFreeJobQueue, MoveOnly) {
+  LockFreeJobQueue<std::unique_ptr<int>> job_queue(2);
+  for (int i = 0; i < 5; ++i) {
+    EXPECT_TRUE(job_queue.Push(std::unique_ptr<int>(new int(i))));
+    auto job = job_queue.Pop();
+    ASSERT_TRUE(job.IsValid());
+    EXPECT_EQ(*job.Data(), i);
+  }
+}
+
+TEST(LockFreeJobQueue, Wait) {
+  LockFreeJobQueue<int> job_queue(10);
+
+  // IMPORTANT: EXPECT_TRUE_* macros are not thread-safe,
+  //            so we use glog's CHECK macros inside threads.
+
+  for (int i = 0; i < 10; ++i) {
+    CHECK(job_queue.Push(i));
+  }
+
+  std::thread consumer_thread([&job_queue]() {
+    CHECK_EQ(job_queue.Size(), 10);
+    for (int i = 0; i < 10; ++i) {
+      const auto job = job_queue.Pop();
+      CHECK(job.IsValid());
+      CHECK_EQ(job.Data(), i);
+    }
+  });
+
+  job_queue.Wait();
+
+  EXPECT_EQ(job_queue.Size(), 0);
+  EXPECT_TRUE(job_queue.Push(0));
+  EXPECT_TRUE(job_queue.Pop().IsValid());
+
+  consumer_thread.join();
+}
+
+TEST(LockFreeJobQueue, TryPushTryPop) {
+  LockFreeJobQueue<int> job_queue(2);
+  EXPECT_FALSE(job_queue.TryPop().IsValid());
+
+  int data = 0;
+  EXPECT_TRUE(job_queue.TryPush(&data));
+  data = 1;
+  EXPECT_TRUE(job_queue.TryPush(&data));
+  data = 2;
+  EXPECT_FALSE(job_queue.TryPush(&data));
+  EXPECT_EQ(data, 2);
+  EXPECT_EQ(job_queue.Size(), 2);
+
+  const auto job = job_queue.TryPop();
+  EXPECT_TRUE(job.IsValid());
+  EXPECT_EQ(job.Data(), 0);
+  EXPECT_EQ(job_queue.Size(), 1);
+  EXPECT_TRUE(job_queue.TryPush(&data));
+
+  job_queue.Stop();
+  EXPECT_FALSE(job_queue.TryPush(&data));
+  EXPECT_FALSE(job_queue.TryPop().IsValid());
+}
+
+TEST(LockFreeJobQueue, StopProducer) {
+  LockFreeJobQueue<int> job_queue(1);
+
+  // IMPORTANT: EXPECT_TRUE_* macros are not thread-safe,
+  //            so we use glog's CHECK macros inside threads.
+
+  Barrier stopBarrier;
+  std::thread producer_thread([&job_queue, &stopBarrier]() {
+    CHECK(job_queue.Push(0));
+    stopBarrier.Wait();
+    CHECK(!job_queue.Push(0));
+  });
+
+  stopBarrier.Wait();
+  EXPECT_EQ(job_queue.Size(), 1);
+
+  job_queue.Stop();
+  producer_thread.join();
+
+  EXPECT_FALSE(job_queue.Push(0));
+  EXPECT_FALSE(job_queue.Pop().IsValid());
+}
+
+TEST(LockFreeJobQueue, StopConsumer) {
+  LockFreeJobQueue<int> job_queue(1);
+
+  // IMPORTANT: EXPECT_TRUE_* macros are not thread-safe,
+  //            so we use glog's CHECK macros inside threads.
+
+  EXPECT_TRUE(job_queue.Push(0));
+
+  Barrier popBarrier;
+  std::thread consumer_thread([&job_queue, &popBarrier]() {
+    const auto job = job_queue.Pop();
+    CHECK(job.IsValid());
+    CHECK_EQ(job.Data(), 0);
+    popBarrier.Wait();
+    CHECK(!job_queue.Pop().IsValid());
+  });
+
+  popBarrier.Wait();
+  EXPECT_EQ(job_queue.Size(), 0);
+
+  job_queue.Stop();
+  consumer_thread.join();
+
+  EXPECT_FALSE(job_queue.Push(0));
+  EXPECT_FALSE(job_queue.Pop().IsValid());
+}
+
+TEST(LockFreeJobQueue, Clear) {
+  LockFreeJobQueue<int> job_queue(2);
+
+  EXPECT_TRUE(job_queue.Push(0));
+  EXPECT_TRUE(job_queue.Push(1));
+  EXPECT_EQ(job_queue.Size(), 2);
+
+  job_queue.Clear();
+  EXPECT_EQ(job_queue.Size(), 0);
+  EXPECT_TRUE(job_queue.Push(2));
+  EXPECT_EQ(job_queue.Pop().Data(), 2);
+}
+
+template <typename JobQueueType>
+double JobQueueThroughput(const int num_producers, const int num_consumers) {
+  const int kNumJobs = 1000000;
+  const size_t kMaxNumJobs = 256;
+  JobQueueType job_queue(kMaxNumJobs);
+
+  Timer timer;
+  timer.Start();
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < num_producers; ++t) {
+    const int num_jobs = kNumJobs / num_producers +
+                         (t < kNumJobs % num_producers ? 1 : 0);
+    threads.emplace_back([&job_queue, num_jobs]() {
+      for (int i = 0; i < num_jobs; ++i) {
+        CHECK(job_queue.Push(i));
+      }
+    });
+  }
+  for (int t = 0; t < num_consumers; ++t) {
+    const int num_jobs = kNumJobs / num_consumers +
+                         (t < kNumJobs % num_consumers ? 1 : 0);
+    threads.emplace_back([&job_queue, num_jobs]() {
+      for (int i = 0; i < num_jobs; ++i) {
+        CHECK(job_queue.Pop().IsValid());
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  return kNumJobs / timer.ElapsedSeconds();
+}
+
+// Benchmark of the throughput of the job queues, run with
+// --gtest_also_run_disabled_tests.
+TEST(LockFreeJobQueue, DISABLED_Throughput) {
+  for (const int num_producers : {1, 2, 4, 8}) {
+    for (const int num_consumers : {1, 2, 4, 8}) {
+      LOG(INFO) << StringPrintf(
+          "Producers: %d, consumers: %d, jobs/s: JobQueue %.2e, "
+          "LockFreeJobQueue %.2e",
+          num_producers,
+          num_consumers,
+          JobQueueThroughput<JobQueue<int>>(num_producers, num_consumers),
+          JobQueueThroughput<LockFreeJobQueue<int>>(num_producers,
+                                                    num_consumers));
+    }
+  }
+}
+
 TEST(GetEffectiveNumThreads, Nominal) {
   EXPECT_GT(GetEffectiveNumThreads(-2), 0);
   EXPECT_GT(GetEffectiveNumThreads(-1), 0);
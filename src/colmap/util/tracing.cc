@@ -0,0 +1,447 @@
+#include "colmap/util/tracing.h"
+
+#include "colmap/util/logging.h"
+#include "colmap/util/metrics.h"
+#include "colmap/util/string.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <map>
+
+namespace colmap {
+namespace {
+
+int64_t SteadyClockNanoSeconds() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+std::string EscapeJSON(const std::string& str) {
+  std::string escaped;
+  escaped.reserve(str.size());
+  for (const char c : str) {
+    if (c == '"' || c == '\\') {
+      escaped += '\\';
+      escaped += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      escaped += ' ';
+    } else {
+      escaped += c;
+    }
+  }
+  return escaped;
+}
+
+std::string EscapeCSV(const std::string& str) {
+  if (str.find_first_of(",\"\n") == std::string::npos) {
+    return str;
+  }
+  std::string escaped = "\"";
+  for (const char c : str) {
+    if (c == '"') {
+      escaped += '"';
+    }
+    escaped += c;
+  }
+  escaped += '"';
+  return escaped;
+}
+
+}  // namespace
+
+std::string TraceStatisticsTypeToString(const TraceStatistics::Type type) {
+  switch (type) {
+    case TraceStatistics::Type::SPAN:
+      return "span";
+    case TraceStatistics::Type::COUNTER:
+      return "counter";
+    case TraceStatistics::Type::HISTOGRAM:
+      return "histogram";
+    case TraceStatistics::Type::GAUGE:
+      return "gauge";
+  }
+  return "unknown";
+}
+
+bool TracerOptions::Check() const {
+  CHECK_OPTION_GE(max_num_events_per_thread, 0);
+  CHECK_OPTION_GT(metrics_interval, 0);
+  return true;
+}
+
+double TraceStatistics::Mean() const { return count > 0 ? sum / count : 0; }
+
+std::atomic<bool> Tracer::enabled_(false);
+
+Tracer& Tracer::Instance() {
+  // Never destroyed, such that threads may still record while the process
+  // exits.
+  static Tracer* tracer = new Tracer();
+  return *tracer;
+}
+
+Tracer::Tracer()
+    : start_time_ns_(SteadyClockNanoSeconds()),
+      max_num_events_per_thread_(0) {}
+
+Tracer::~Tracer() = default;
+
+void Tracer::Start(const TracerOptions& options) {
+  CHECK(options.Check());
+#if !defined(COLMAP_TRACING_ENABLED)
+  if (!options.output_path.empty()) {
+    LOG(WARNING) << "Tracing is not compiled in, such that only explicitly "
+                    "recorded events are traced. Configure with "
+                    "-DTRACING_ENABLED=ON to trace the instrumented hot paths.";
+  }
+#endif
+
+  // Stop the exporter of a previous start, which would otherwise export the
+  // cleared statistics.
+  std::unique_ptr<MetricsExporter> prev_metrics_exporter;
+  {
+    std::lock_guard<std::mutex> lock(metrics_exporter_mutex_);
+    prev_metrics_exporter = std::move(metrics_exporter_);
+  }
+  if (prev_metrics_exporter) {
+    prev_metrics_exporter->Stop();
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& thread_buffer : thread_buffers_) {
+      std::lock_guard<std::mutex> thread_lock(thread_buffer->mutex);
+      thread_buffer->events.clear();
+      thread_buffer->num_dropped_events = 0;
+      thread_buffer->spans.clear();
+      thread_buffer->counters.clear();
+      thread_buffer->histograms.clear();
+      thread_buffer->gauges.clear();
+    }
+    output_path_ = options.output_path;
+    max_num_events_per_thread_ = options.max_num_events_per_thread;
+    start_time_ns_ = SteadyClockNanoSeconds();
+    enabled_ = true;
+  }
+
+  if (!options.metrics_path.empty()) {
+    std::lock_guard<std::mutex> lock(metrics_exporter_mutex_);
+    metrics_exporter_ = std::make_unique<MetricsExporter>(
+        options.metrics_path, options.metrics_interval);
+    metrics_exporter_->Start();
+  }
+}
+
+void Tracer::Stop() {
+  if (!enabled_.exchange(false)) {
+    return;
+  }
+
+  // Stop the exporter outside of the lock of the statistics, since it writes
+  // the final metrics on stop.
+  std::unique_ptr<MetricsExporter> metrics_exporter;
+  {
+    std::lock_guard<std::mutex> lock(metrics_exporter_mutex_);
+    metrics_exporter = std::move(metrics_exporter_);
+  }
+  if (metrics_exporter) {
+    metrics_exporter->Stop();
+  }
+
+  std::string output_path;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    output_path = output_path_;
+  }
+
+  if (output_path.empty()) {
+    return;
+  }
+
+  const std::string trace_path = output_path + ".json";
+  const std::string summary_path = output_path + ".csv";
+  if (WriteChromeTrace(trace_path) && WriteSummary(summary_path)) {
+    LOG(INFO) << "Wrote trace to " << trace_path << " and " << summary_path;
+  } else {
+    LOG(ERROR) << "Failed to write trace to " << output_path;
+  }
+}
+
+int64_t Tracer::NowMicroSeconds() const {
+  return (SteadyClockNanoSeconds() - start_time_ns_) / 1000;
+}
+
+void Tracer::AddSpan(const char* name,
+                     const int64_t begin_us,
+                     const int64_t end_us) {
+  ThreadBuffer* thread_buffer = CurrentThreadBuffer();
+  std::lock_guard<std::mutex> lock(thread_buffer->mutex);
+  const int64_t duration_us = std::max<int64_t>(0, end_us - begin_us);
+  if (thread_buffer->events.size() <
+      static_cast<size_t>(max_num_events_per_thread_)) {
+    thread_buffer->events.push_back({name, begin_us, duration_us});
+  } else {
+    thread_buffer->num_dropped_events += 1;
+  }
+  thread_buffer->spans[name].Add(static_cast<double>(duration_us));
+}
+
+void Tracer::AddCounter(const char* name, const int64_t value) {
+  ThreadBuffer* thread_buffer = CurrentThreadBuffer();
+  std::lock_guard<std::mutex> lock(thread_buffer->mutex);
+  thread_buffer->counters[name].Add(static_cast<double>(value));
+}
+
+void Tracer::AddHistogramSample(const char* name, const double value) {
+  ThreadBuffer* thread_buffer = CurrentThreadBuffer();
+  std::lock_guard<std::mutex> lock(thread_buffer->mutex);
+  thread_buffer->histograms[name].Add(value);
+}
+
+void Tracer::SetGauge(const char* name, const double value) {
+  const int64_t time_us = NowMicroSeconds();
+  ThreadBuffer* thread_buffer = CurrentThreadBuffer();
+  std::lock_guard<std::mutex> lock(thread_buffer->mutex);
+  Gauge& gauge = thread_buffer->gauges[name];
+  gauge.count += 1;
+  gauge.value = value;
+  gauge.time_us = time_us;
+}
+
+std::vector<TraceStatistics> Tracer::Summary() const {
+  // Merge the statistics of all threads by name, since the same string
+  // literal might have different addresses in different translation units.
+  std::map<std::pair<TraceStatistics::Type, std::string>, Statistics> merged;
+  // The gauges of the same name in different threads are merged into the
+  // most recently set value.
+  std::map<std::string, Gauge> merged_gauges;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& thread_buffer : thread_buffers_) {
+      std::lock_guard<std::mutex> thread_lock(thread_buffer->mutex);
+      for (const auto& span : thread_buffer->spans) {
+        merged[{TraceStatistics::Type::SPAN, span.first}].Merge(span.second);
+      }
+      for (const auto& counter : thread_buffer->counters) {
+        merged[{TraceStatistics::Type::COUNTER, counter.first}].Merge(
+            counter.second);
+      }
+      for (const auto& histogram : thread_buffer->histograms) {
+        merged[{TraceStatistics::Type::HISTOGRAM, histogram.first}].Merge(
+            histogram.second);
+      }
+      for (const auto& gauge : thread_buffer->gauges) {
+        Gauge& merged_gauge = merged_gauges[gauge.first];
+        merged_gauge.count += gauge.second.count;
+        if (gauge.second.time_us >= merged_gauge.time_us) {
+          merged_gauge.value = gauge.second.value;
+          merged_gauge.time_us = gauge.second.time_us;
+        }
+      }
+    }
+  }
+
+  std::vector<TraceStatistics> summary;
+  summary.reserve(merged.size() + merged_gauges.size());
+  for (const auto& entry : merged) {
+    const Statistics& stats = entry.second;
+
+    TraceStatistics statistics;
+    statistics.type = entry.first.first;
+    statistics.name = entry.first.second;
+    statistics.count = stats.count;
+    statistics.sum = stats.sum;
+    statistics.min = stats.min;
+    statistics.max = stats.max;
+
+    // Estimate the percentiles by the upper bound of the bucket, in which the
+    // cumulative count reaches the percentile.
+    const auto percentile = [&stats](const double fraction) {
+      const double target_count = fraction * stats.count;
+      int64_t cumulative_count = 0;
+      for (int i = 0; i < kNumBuckets; ++i) {
+        cumulative_count += stats.buckets[i];
+        if (cumulative_count >= target_count) {
+          return std::min(std::max(std::ldexp(1.0, i), stats.min), stats.max);
+        }
+      }
+      return stats.max;
+    };
+    statistics.p50 = percentile(0.5);
+    statistics.p90 = percentile(0.9);
+    statistics.p99 = percentile(0.99);
+
+    summary.push_back(std::move(statistics));
+  }
+
+  for (const auto& gauge : merged_gauges) {
+    TraceStatistics statistics;
+    statistics.type = TraceStatistics::Type::GAUGE;
+    statistics.name = gauge.first;
+    statistics.count = gauge.second.count;
+    statistics.sum = gauge.second.value;
+    statistics.min = gauge.second.value;
+    statistics.max = gauge.second.value;
+    statistics.p50 = gauge.second.value;
+    statistics.p90 = gauge.second.value;
+    statistics.p99 = gauge.second.value;
+    summary.push_back(std::move(statistics));
+  }
+
+  return summary;
+}
+
+bool Tracer::WriteChromeTrace(const std::string& path) const {
+  std::ofstream file(path, std::ios::trunc);
+  if (!file.is_open()) {
+    LOG(ERROR) << "Failed to open trace file " << path;
+    return false;
+  }
+
+  file << "{\"traceEvents\":[";
+  bool first_event = true;
+  const auto begin_event = [&file, &first_event]() {
+    if (!first_event) {
+      file << ",";
+    }
+    file << "\n";
+    first_event = false;
+  };
+
+  const int64_t end_us = NowMicroSeconds();
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (const auto& thread_buffer : thread_buffers_) {
+    std::lock_guard<std::mutex> thread_lock(thread_buffer->mutex);
+    if (thread_buffer->events.empty() && thread_buffer->counters.empty()) {
+      continue;
+    }
+
+    begin_event();
+    file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":"
+         << thread_buffer->thread_idx << ",\"args\":{\"name\":\"Thread "
+         << thread_buffer->thread_idx << "\"}}";
+
+    for (const auto& event : thread_buffer->events) {
+      begin_event();
+      file << "{\"name\":\"" << EscapeJSON(event.name)
+           << "\",\"cat\":\"colmap\",\"ph\":\"X\",\"ts\":" << event.begin_us
+           << ",\"dur\":" << event.duration_us
+           << ",\"pid\":0,\"tid\":" << thread_buffer->thread_idx << "}";
+    }
+
+    // The counters are only accumulated, such that their totals are
+    // reported at the end of the trace.
+    for (const auto& counter : thread_buffer->counters) {
+      begin_event();
+      file << "{\"name\":\"" << EscapeJSON(counter.first)
+           << "\",\"cat\":\"colmap\",\"ph\":\"C\",\"ts\":" << end_us
+           << ",\"pid\":0,\"tid\":" << thread_buffer->thread_idx
+           << ",\"args\":{\"value\":" << counter.second.sum << "}}";
+    }
+
+    if (thread_buffer->num_dropped_events > 0) {
+      LOG(WARNING) << StringPrintf(
+          "Dropped %d spans of thread %d from the trace, since the maximum "
+          "number of events per thread was exceeded",
+          static_cast<int>(thread_buffer->num_dropped_events),
+          thread_buffer->thread_idx);
+    }
+  }
+
+  file << "\n],\"displayTimeUnit\":\"ms\"}\n";
+
+  return file.good();
+}
+
+bool Tracer::WriteSummary(const std::string& path) const {
+  std::ofstream file(path, std::ios::trunc);
+  if (!file.is_open()) {
+    LOG(ERROR) << "Failed to open summary file " << path;
+    return false;
+  }
+
+  // Ensure that we do not lose any precision by storing in text.
+  file.precision(17);
+
+  file << "type,name,count,sum,mean,min,max,p50,p90,p99\n";
+  for (const auto& statistics : Summary()) {
+    file << TraceStatisticsTypeToString(statistics.type) << ","
+         << EscapeCSV(statistics.name) << "," << statistics.count << ","
+         << statistics.sum << "," << statistics.Mean() << ","
+         << statistics.min << "," << statistics.max << "," << statistics.p50
+         << "," << statistics.p90 << "," << statistics.p99 << "\n";
+  }
+
+  return file.good();
+}
+
+void Tracer::Statistics::Add(const double value) {
+  if (count == 0) {
+    min = value;
+    max = value;
+  } else {
+    min = std::min(min, value);
+    max = std::max(max, value);
+  }
+  count += 1;
+  sum += value;
+
+  // The i-th bucket contains the values in [2^(i-1), 2^i) and the first bucket
+  // all values smaller than one.
+  int bucket = 0;
+  if (value >= 1) {
+    int exponent = 0;
+    std::frexp(value, &exponent);
+    bucket = std::min(exponent, kNumBuckets - 1);
+  }
+  buckets[bucket] += 1;
+}
+
+void Tracer::Statistics::Merge(const Statistics& other) {
+  if (other.count == 0) {
+    return;
+  }
+  if (count == 0) {
+    min = other.min;
+    max = other.max;
+  } else {
+    min = std::min(min, other.min);
+    max = std::max(max, other.max);
+  }
+  count += other.count;
+  sum += other.sum;
+  for (int i = 0; i < kNumBuckets; ++i) {
+    buckets[i] += other.buckets[i];
+  }
+}
+
+Tracer::ThreadBuffer* Tracer::CurrentThreadBuffer() {
+  // The buffers are never freed, such that the cached pointer stays valid and
+  // the events of finished threads are kept until the next start.
+  thread_local ThreadBuffer* thread_buffer = nullptr;
+  if (thread_buffer == nullptr) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    thread_buffers_.emplace_back(new ThreadBuffer());
+    thread_buffer = thread_buffers_.back().get();
+    thread_buffer->thread_idx = static_cast<int>(thread_buffers_.size()) - 1;
+  }
+  return thread_buffer;
+}
+
+TraceSpan::TraceSpan(const char* name) : name_(name), begin_us_(-1) {
+  if (Tracer::IsEnabled()) {
+    begin_us_ = Tracer::Instance().NowMicroSeconds();
+  }
+}
+
+TraceSpan::~TraceSpan() {
+  if (begin_us_ >= 0) {
+    Tracer& tracer = Tracer::Instance();
+    tracer.AddSpan(name_, begin_us_, tracer.NowMicroSeconds());
+  }
+}
+
+}  // namespace colmap
@@ -0,0 +1,244 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace colmap {
+class MetricsExporter;
+}  // namespace colmap
+
+// Instrumentation of hot paths with scoped spans, counters, and histograms.
+// The macros are only compiled in if COLMAP_TRACING_ENABLED is defined, i.e.,
+// if configured with -DTRACING_ENABLED=ON, and otherwise have no overhead.
+// When compiled in, they only record while the tracer is started, e.g., by
+// the `--trace_path` option of the command-line interface. The names must be
+// string literals, since they are stored by pointer.
+//
+// Example usage:
+//
+//    void Foo() {
+//      COLMAP_TRACE_SCOPE("Foo");
+//      COLMAP_TRACE_COUNTER("Foo calls", 1);
+//      COLMAP_TRACE_HISTOGRAM("Foo iterations", num_iterations);
+//    }
+//
+#if defined(COLMAP_TRACING_ENABLED)
+#define COLMAP_TRACE_CONCAT_IMPL(a, b) a##b
+#define COLMAP_TRACE_CONCAT(a, b) COLMAP_TRACE_CONCAT_IMPL(a, b)
+#define COLMAP_TRACE_SCOPE(name) \
+  const colmap::TraceSpan COLMAP_TRACE_CONCAT(trace_span_, __LINE__)(name)
+#define COLMAP_TRACE_COUNTER(name, value)                          \
+  do {                                                             \
+    if (colmap::Tracer::IsEnabled()) {                             \
+      colmap::Tracer::Instance().AddCounter(                       \
+          name, static_cast<int64_t>(value));                      \
+    }                                                              \
+  } while (0)
+#define COLMAP_TRACE_HISTOGRAM(name, value)                        \
+  do {                                                             \
+    if (colmap::Tracer::IsEnabled()) {                             \
+      colmap::Tracer::Instance().AddHistogramSample(               \
+          name, static_cast<double>(value));                       \
+    }                                                              \
+  } while (0)
+#else
+#define COLMAP_TRACE_SCOPE(name) static_cast<void>(0)
+#define COLMAP_TRACE_COUNTER(name, value) static_cast<void>(0)
+#define COLMAP_TRACE_HISTOGRAM(name, value) static_cast<void>(0)
+#endif
+
+// Metrics of coarse-grained progress, e.g., per image or per image pair, which
+// are periodically exported while the tracer is started with a metrics path,
+// see `TracerOptions`. In contrast to the trace macros, they are always
+// compiled in, since they only cost an atomic load while the tracer is stopped.
+// Gauges report the last set value, e.g., the size of a queue.
+#define COLMAP_METRIC_COUNTER(name, value)                         \
+  do {                                                             \
+    if (colmap::Tracer::IsEnabled()) {                             \
+      colmap::Tracer::Instance().AddCounter(                       \
+          name, static_cast<int64_t>(value));                      \
+    }                                                              \
+  } while (0)
+#define COLMAP_METRIC_GAUGE(name, value)                           \
+  do {                                                             \
+    if (colmap::Tracer::IsEnabled()) {                             \
+      colmap::Tracer::Instance().SetGauge(                         \
+          name, static_cast<double>(value));                       \
+    }                                                              \
+  } while (0)
+#define COLMAP_METRIC_HISTOGRAM(name, value)                       \
+  do {                                                             \
+    if (colmap::Tracer::IsEnabled()) {                             \
+      colmap::Tracer::Instance().AddHistogramSample(               \
+          name, static_cast<double>(value));                       \
+    }                                                              \
+  } while (0)
+
+namespace colmap {
+
+struct TracerOptions {
+  // Maximum number of span events per thread recorded for the Chrome trace.
+  // Further spans are only included in the summary, such that the memory of
+  // long-running reconstructions is bounded.
+  int max_num_events_per_thread = 1000000;
+
+  // Output path without extension. If not empty, the Chrome trace and the
+  // summary are written to "<output_path>.json" and "<output_path>.csv" when
+  // the tracer is stopped.
+  std::string output_path = "";
+
+  // Output path of the metrics without extension. If not empty, the current
+  // metrics are periodically written to "<metrics_path>.prom" in the text
+  // format of Prometheus and to "<metrics_path>.json", see `MetricsExporter`.
+  std::string metrics_path = "";
+
+  // Interval in seconds between the exports of the metrics.
+  double metrics_interval = 10;
+
+  bool Check() const;
+};
+
+// Aggregated statistics of the spans, counters, histograms, or gauges of the
+// same name over all threads. Span durations are in microseconds. The
+// percentiles are estimated from power-of-two buckets. For gauges, the count is
+// the number of updates and all other statistics are the last set value.
+struct TraceStatistics {
+  enum class Type {
+    SPAN = 0,
+    COUNTER = 1,
+    HISTOGRAM = 2,
+    GAUGE = 3,
+  };
+
+  Type type = Type::SPAN;
+  std::string name;
+  int64_t count = 0;
+  double sum = 0;
+  double min = 0;
+  double max = 0;
+  double p50 = 0;
+  double p90 = 0;
+  double p99 = 0;
+
+  double Mean() const;
+};
+
+std::string TraceStatisticsTypeToString(TraceStatistics::Type type);
+
+// Process-wide collector of the traced events. Each thread records into its
+// own buffer, such that concurrent threads do not contend on a shared lock.
+class Tracer {
+ public:
+  static Tracer& Instance();
+
+  // Clear all previously recorded events and start recording.
+  void Start(const TracerOptions& options = TracerOptions());
+
+  // Stop recording and write the trace to the output path, if set.
+  void Stop();
+
+  // Whether the tracer is started, which is checked by the macros before
+  // recording to avoid the overhead of the instance lookup.
+  static inline bool IsEnabled();
+
+  // Microseconds since the tracer was started.
+  int64_t NowMicroSeconds() const;
+
+  void AddSpan(const char* name, int64_t begin_us, int64_t end_us);
+  void AddCounter(const char* name, int64_t value);
+  void AddHistogramSample(const char* name, double value);
+  void SetGauge(const char* name, double value);
+
+  // Statistics of all recorded spans, counters, histograms, and gauges sorted
+  // by type and name.
+  std::vector<TraceStatistics> Summary() const;
+
+  // Write the recorded spans in the Chrome trace event format, which can be
+  // viewed in chrome://tracing or https://ui.perfetto.dev.
+  bool WriteChromeTrace(const std::string& path) const;
+
+  // Write the summary statistics as CSV.
+  bool WriteSummary(const std::string& path) const;
+
+ private:
+  static const int kNumBuckets = 64;
+
+  struct Statistics {
+    int64_t count = 0;
+    double sum = 0;
+    double min = 0;
+    double max = 0;
+    std::array<int64_t, kNumBuckets> buckets{};
+
+    void Add(double value);
+    void Merge(const Statistics& other);
+  };
+
+  struct Gauge {
+    int64_t count = 0;
+    double value = 0;
+    int64_t time_us = 0;
+  };
+
+  struct SpanEvent {
+    const char* name;
+    int64_t begin_us;
+    int64_t duration_us;
+  };
+
+  struct ThreadBuffer {
+    int thread_idx = 0;
+    std::mutex mutex;
+    std::vector<SpanEvent> events;
+    size_t num_dropped_events = 0;
+    std::unordered_map<const char*, Statistics> spans;
+    std::unordered_map<const char*, Statistics> counters;
+    std::unordered_map<const char*, Statistics> histograms;
+    std::unordered_map<const char*, Gauge> gauges;
+  };
+
+  Tracer();
+  ~Tracer();
+
+  ThreadBuffer* CurrentThreadBuffer();
+
+  static std::atomic<bool> enabled_;
+  std::atomic<int64_t> start_time_ns_;
+  std::atomic<int> max_num_events_per_thread_;
+  std::string output_path_;
+
+  mutable std::mutex mutex_;
+  std::vector<std::unique_ptr<ThreadBuffer>> thread_buffers_;
+
+  std::mutex metrics_exporter_mutex_;
+  std::unique_ptr<MetricsExporter> metrics_exporter_;
+};
+
+// Records the span from its construction to its destruction, if the tracer is
+// enabled at construction.
+class TraceSpan {
+ public:
+  explicit TraceSpan(const char* name);
+  ~TraceSpan();
+
+ private:
+  const char* name_;
+  int64_t begin_us_;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Implementation
+////////////////////////////////////////////////////////////////////////////////
+
+bool Tracer::IsEnabled() {
+  return enabled_.load(std::memory_order_relaxed);
+}
+
+}  // namespace colmap
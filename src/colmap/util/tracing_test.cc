@@ -0,0 +1,189 @@
+#include "colmap/util/tracing.h"
+
+#include "colmap/util/misc.h"
+#include "colmap/util/testing.h"
+
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+namespace colmap {
+namespace {
+
+const TraceStatistics* FindStatistics(
+    const std::vector<TraceStatistics>& summary,
+    const TraceStatistics::Type type,
+    const std::string& name) {
+  for (const auto& statistics : summary) {
+    if (statistics.type == type && statistics.name == name) {
+      return &statistics;
+    }
+  }
+  return nullptr;
+}
+
+TEST(Tracer, NotStarted) {
+  Tracer& tracer = Tracer::Instance();
+  tracer.Start();
+  tracer.Stop();
+  EXPECT_FALSE(Tracer::IsEnabled());
+  {
+    TraceSpan span("span");
+  }
+  EXPECT_TRUE(tracer.Summary().empty());
+}
+
+TEST(Tracer, Nominal) {
+  Tracer& tracer = Tracer::Instance();
+  tracer.Start();
+  EXPECT_TRUE(Tracer::IsEnabled());
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; ++i) {
+    threads.emplace_back([&tracer]() {
+      for (int j = 0; j < 10; ++j) {
+        TraceSpan span("span");
+        tracer.AddCounter("counter", 2);
+        tracer.AddHistogramSample("histogram", j);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  tracer.Stop();
+  EXPECT_FALSE(Tracer::IsEnabled());
+
+  const std::vector<TraceStatistics> summary = tracer.Summary();
+  EXPECT_EQ(summary.size(), 3);
+
+  const TraceStatistics* span =
+      FindStatistics(summary, TraceStatistics::Type::SPAN, "span");
+  ASSERT_NE(span, nullptr);
+  EXPECT_EQ(span->count, 40);
+  EXPECT_GE(span->min, 0);
+  EXPECT_LE(span->min, span->max);
+
+  const TraceStatistics* counter =
+      FindStatistics(summary, TraceStatistics::Type::COUNTER, "counter");
+  ASSERT_NE(counter, nullptr);
+  EXPECT_EQ(counter->count, 40);
+  EXPECT_EQ(counter->sum, 80);
+
+  const TraceStatistics* histogram =
+      FindStatistics(summary, TraceStatistics::Type::HISTOGRAM, "histogram");
+  ASSERT_NE(histogram, nullptr);
+  EXPECT_EQ(histogram->count, 40);
+  EXPECT_EQ(histogram->sum, 4 * 45);
+  EXPECT_EQ(histogram->Mean(), 4.5);
+  EXPECT_EQ(histogram->min, 0);
+  EXPECT_EQ(histogram->max, 9);
+  // The samples 4..7 are in the bucket [4, 8).
+  EXPECT_EQ(histogram->p50, 8);
+  EXPECT_EQ(histogram->p90, 9);
+  EXPECT_EQ(histogram->p99, 9);
+
+  // Restarting clears the previous events.
+  tracer.Start();
+  tracer.Stop();
+  EXPECT_TRUE(tracer.Summary().empty());
+}
+
+TEST(Tracer, Gauge) {
+  Tracer& tracer = Tracer::Instance();
+  tracer.Start();
+  tracer.SetGauge("gauge", 3);
+  std::thread thread([&tracer]() { tracer.SetGauge("gauge", 5); });
+  thread.join();
+  tracer.Stop();
+
+  const std::vector<TraceStatistics> summary = tracer.Summary();
+  ASSERT_EQ(summary.size(), 1);
+  EXPECT_EQ(summary[0].type, TraceStatistics::Type::GAUGE);
+  EXPECT_EQ(summary[0].count, 2);
+  EXPECT_EQ(summary[0].sum, 5);
+  EXPECT_EQ(summary[0].min, 5);
+  EXPECT_EQ(summary[0].max, 5);
+}
+
+TEST(Tracer, MaxNumEventsPerThread) {
+  Tracer& tracer = Tracer::Instance();
+  TracerOptions options;
+  options.max_num_events_per_thread = 2;
+  tracer.Start(options);
+  for (int i = 0; i < 5; ++i) {
+    tracer.AddSpan("span", i, i + 1);
+  }
+  tracer.Stop();
+
+  const std::string test_dir = CreateTestDir();
+  const std::string trace_path = JoinPaths(test_dir, "trace.json");
+  ASSERT_TRUE(tracer.WriteChromeTrace(trace_path));
+  std::ifstream file(trace_path);
+  std::stringstream trace;
+  trace << file.rdbuf();
+  size_t num_events = 0;
+  for (size_t pos = trace.str().find("\"ph\":\"X\""); pos != std::string::npos;
+       pos = trace.str().find("\"ph\":\"X\"", pos + 1)) {
+    num_events += 1;
+  }
+  EXPECT_EQ(num_events, 2);
+
+  // All spans are included in the summary.
+  const std::vector<TraceStatistics> summary = tracer.Summary();
+  ASSERT_EQ(summary.size(), 1);
+  EXPECT_EQ(summary[0].count, 5);
+  EXPECT_EQ(summary[0].sum, 5);
+}
+
+TEST(Tracer, Write) {
+  Tracer& tracer = Tracer::Instance();
+  const std::string test_dir = CreateTestDir();
+  TracerOptions options;
+  options.output_path = JoinPaths(test_dir, "trace");
+  tracer.Start(options);
+  tracer.AddSpan("span \"quoted\"", 1, 3);
+  tracer.AddCounter("counter,comma", 1);
+  tracer.Stop();
+
+  std::ifstream trace_file(options.output_path + ".json");
+  ASSERT_TRUE(trace_file.is_open());
+  std::stringstream trace;
+  trace << trace_file.rdbuf();
+  EXPECT_NE(trace.str().find("{\"traceEvents\":["), std::string::npos);
+  EXPECT_NE(trace.str().find("\"name\":\"span \\\"quoted\\\"\""),
+            std::string::npos);
+  EXPECT_NE(trace.str().find("\"ts\":1,\"dur\":2"), std::string::npos);
+
+  std::ifstream summary_file(options.output_path + ".csv");
+  ASSERT_TRUE(summary_file.is_open());
+  std::string line;
+  std::getline(summary_file, line);
+  EXPECT_EQ(line, "type,name,count,sum,mean,min,max,p50,p90,p99");
+  std::getline(summary_file, line);
+  EXPECT_EQ(line, "span,\"span \"\"quoted\"\"\",1,2,2,2,2,2,2,2");
+  std::getline(summary_file, line);
+  EXPECT_EQ(line, "counter,\"counter,comma\",1,1,1,1,1,1,1,1");
+}
+
+TEST(Tracer, Macros) {
+  Tracer& tracer = Tracer::Instance();
+  tracer.Start();
+  {
+    COLMAP_TRACE_SCOPE("scope");
+    COLMAP_TRACE_COUNTER("counter", 1);
+    COLMAP_TRACE_HISTOGRAM("histogram", 1.5);
+  }
+  tracer.Stop();
+#if defined(COLMAP_TRACING_ENABLED)
+  EXPECT_EQ(tracer.Summary().size(), 3);
+#else
+  EXPECT_TRUE(tracer.Summary().empty());
+#endif
+}
+
+}  // namespace
+}  // namespace colmap
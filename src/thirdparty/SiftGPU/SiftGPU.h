@@ -63,6 +63,7 @@ typedef unsigned __int64 uint64_t;
 #elif __GNUC__ >= 3
 #include <stdint.h>
 #endif
+#include <stddef.h>
 
 ///////////////////////////////////////////////////////////////////
 //clss SiftParam
@@ -318,6 +319,11 @@ public:
 	//Option 2 unsigned char descriptors. They must be already normalized to 512
 	SIFTGPU_EXPORT virtual void SetDescriptors(int index, int num, const unsigned char * descriptors, int id = -1);
 
+	//Keep up to num_bytes of descriptors that were set with an id resident on the GPU,
+	//such that setting the same id again does not upload them again (CUDA only).
+	//The ids must uniquely identify the descriptors. Disabled if 0 (default).
+	SIFTGPU_EXPORT virtual void SetDescriptorCacheSize(size_t num_bytes);
+
 	//match two sets of features, the function RETURNS the number of matches.
 	//Given two normalized descriptor d1,d2, the distance here is acos(d1 *d2);
 	SIFTGPU_EXPORT virtual int  GetSiftMatch(
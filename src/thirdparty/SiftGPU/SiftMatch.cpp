@@ -668,6 +668,11 @@ void SiftMatchGPU::SetDescriptors(int index, int num, const float* descriptors,
 	__matcher->SetDescriptors(index, num, descriptors, id);
 }
 
+void SiftMatchGPU::SetDescriptorCacheSize(size_t num_bytes)
+{
+	if(__matcher) __matcher->SetDescriptorCacheSize(num_bytes);
+}
+
 void SiftMatchGPU::SetFeautreLocation(int index, const float* locations, int gap)
 {
 	__matcher->SetFeautreLocation(index, locations, gap);
@@ -48,6 +48,10 @@ SiftMatchCU::SiftMatchCU(int max_sift) : SiftMatchGPU() {
   _num_sift[0] = _num_sift[1] = 0;
   _id_sift[0] = _id_sift[1] = 0;
   _have_loc[0] = _have_loc[1] = 0;
+  _des[0] = &_texDes[0];
+  _des[1] = &_texDes[1];
+  _des_cache_bytes = 0;
+  _des_cache_max_bytes = 0;
   __max_sift = max_sift <= 0 ? 4096 : ((max_sift + 31) / 32 * 32);
   _initialized = 0;
 }
@@ -107,10 +111,69 @@ void SiftMatchCU::SetDescriptors(int index, int num,
   _id_sift[index] = id;
   if (num > __max_sift) num = __max_sift;
   _num_sift[index] = num;
+  _des[index] = &_texDes[index];
+  if (id != -1) {
+    CuTexImage* tex = GetCachedDescriptors(id, num, descriptors);
+    if (tex != NULL) {
+      _des[index] = tex;
+      return;
+    }
+  }
   _texDes[index].InitTexture(8 * num, 1, 4);
   _texDes[index].CopyFromHost((void*)descriptors);
 }
 
+void SiftMatchCU::SetDescriptorCacheSize(size_t num_bytes) {
+  _des_cache_max_bytes = num_bytes;
+  // Release the textures exceeding the new size, except the ones in use.
+  for (auto it = _des_cache.end(); it != _des_cache.begin() &&
+                                   _des_cache_bytes > _des_cache_max_bytes;) {
+    --it;
+    if (it->tex.get() == _des[0] || it->tex.get() == _des[1]) continue;
+    _des_cache_bytes -= it->tex->GetDataSize();
+    it = _des_cache.erase(it);
+  }
+}
+
+CuTexImage* SiftMatchCU::GetCachedDescriptors(
+    int id, int num, const unsigned char* descriptors) {
+  for (auto it = _des_cache.begin(); it != _des_cache.end(); ++it) {
+    if (it->id == id) {
+      _des_cache.splice(_des_cache.begin(), _des_cache, it);
+      return _des_cache.front().tex.get();
+    }
+  }
+
+  // Each descriptor occupies 8 texels of 4 floats.
+  const size_t num_bytes = 8 * 4 * sizeof(float) * static_cast<size_t>(num);
+  if (num_bytes > _des_cache_max_bytes) return NULL;
+
+  // Evict the least recently used textures, except the ones in use.
+  for (auto it = _des_cache.end(); it != _des_cache.begin() &&
+                                   _des_cache_bytes + num_bytes >
+                                       _des_cache_max_bytes;) {
+    --it;
+    if (it->tex.get() == _des[0] || it->tex.get() == _des[1]) continue;
+    _des_cache_bytes -= it->tex->GetDataSize();
+    it = _des_cache.erase(it);
+  }
+  if (_des_cache_bytes + num_bytes > _des_cache_max_bytes) return NULL;
+
+  std::unique_ptr<CuTexImage> tex(new CuTexImage());
+  if (!tex->InitTexture(8 * num, 1, 4)) {
+    // Clear the allocation error, such that the matching does not fail.
+    cudaGetLastError();
+    return NULL;
+  }
+  tex->CopyFromHost((void*)descriptors);
+  _des_cache_bytes += tex->GetDataSize();
+  CachedDescriptors cached;
+  cached.id = id;
+  cached.tex = std::move(tex);
+  _des_cache.push_front(std::move(cached));
+  return _des_cache.front().tex.get();
+}
+
 void SiftMatchCU::SetDescriptors(int index, int num, const float* descriptors,
                                  int id) {
   if (_initialized == 0) return;
@@ -152,7 +215,7 @@ int SiftMatchCU::GetGuidedSiftMatch(int max_match, uint32_t match_buffer[][2],
   if (_initialized == 0) return 0;
   if (_num_sift[0] <= 0 || _num_sift[1] <= 0) return 0;
   if (_have_loc[0] == 0 || _have_loc[1] == 0) return 0;
-  ProgramCU::MultiplyDescriptorG(_texDes, _texDes + 1, _texLoc, _texLoc + 1,
+  ProgramCU::MultiplyDescriptorG(_des[0], _des[1], _texLoc, _texLoc + 1,
                                  &_texDot, (mbm ? &_texCRT : NULL), H, hdistmax,
                                  F, fdistmax);
   return GetBestMatch(max_match, match_buffer, distmax, ratiomax, mbm);
@@ -162,7 +225,7 @@ int SiftMatchCU::GetSiftMatch(int max_match, uint32_t match_buffer[][2],
                               float distmax, float ratiomax, int mbm) {
   if (_initialized == 0) return 0;
   if (_num_sift[0] <= 0 || _num_sift[1] <= 0) return 0;
-  ProgramCU::MultiplyDescriptor(_texDes, _texDes + 1, &_texDot,
+  ProgramCU::MultiplyDescriptor(_des[0], _des[1], &_texDot,
                                 (mbm ? &_texCRT : NULL));
   return GetBestMatch(max_match, match_buffer, distmax, ratiomax, mbm);
 }
@@ -25,6 +25,9 @@
 #define CU_SIFT_MATCH_H
 #if defined(CUDA_SIFTGPU_ENABLED)
 
+#include <list>
+#include <memory>
+
 class CuTexImage;
 class SiftMatchCU:public SiftMatchGPU
 {
@@ -32,6 +35,8 @@ private:
 	//tex storage
 	CuTexImage _texLoc[2];
 	CuTexImage _texDes[2];
+	//descriptors of the two sets, either _texDes or a cached texture
+	CuTexImage* _des[2];
 	CuTexImage _texDot;
 	CuTexImage _texMatch[2];
 	CuTexImage _texCRT;
@@ -45,8 +50,19 @@ private:
 	//gpu parameter
 	int _initialized;
 	vector<int> sift_buffer;
+
+	//LRU cache of resident descriptors by id, most recently used first
+	struct CachedDescriptors
+	{
+		int id;
+		std::unique_ptr<CuTexImage> tex;
+	};
+	std::list<CachedDescriptors> _des_cache;
+	size_t _des_cache_bytes;
+	size_t _des_cache_max_bytes;
 private:
 	int  GetBestMatch(int max_match, uint32_t match_buffer[][2], float distmax, float ratiomax, int mbm);
+	CuTexImage* GetCachedDescriptors(int id, int num, const unsigned char* descriptors);
 public:
 	SiftMatchCU(int max_sift);
 	virtual ~SiftMatchCU(){};
@@ -55,6 +71,7 @@ public:
 	void SetMaxSift(int max_sift) override;
 	void SetDescriptors(int index, int num, const unsigned char * descriptor, int id = -1);
 	void SetDescriptors(int index, int num, const float * descriptor, int id = -1);
+	void SetDescriptorCacheSize(size_t num_bytes) override;
 	void SetFeautreLocation(int index, const float* locatoins, int gap);
 	int  GetSiftMatch(int max_match, uint32_t match_buffer[][2], float distmax, float ratiomax, int mbm);
 	int  GetGuidedSiftMatch(int max_match, uint32_t match_buffer[][2], float* H, float* F,